@@ -13,12 +13,84 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "../src/common/wire_protocol.h"
 
 #define MAX_MEM_BUFFER_SIZE 8192
 #define PORT_DEFAULT 8765
 
 bool is_exit_command(std::string &cmd) { return cmd == "exit" || cmd == "exit;" || cmd == "bye" || cmd == "bye;"; }
 
+// 把一行输入按引号外的';'拆成多条语句，每条带着自己的';'
+std::vector<std::string> split_statements(const std::string &line) {
+    std::vector<std::string> stmts;
+    std::string cur;
+    bool in_quote = false;
+    for (char c : line) {
+        cur.push_back(c);
+        if (c == '\'') {
+            in_quote = !in_quote;
+        } else if (c == ';' && !in_quote) {
+            stmts.push_back(std::move(cur));
+            cur.clear();
+        }
+    }
+    if (cur.find_first_not_of(" \t") != std::string::npos) {
+        stmts.push_back(std::move(cur));
+    }
+    return stmts;
+}
+
+bool recv_all(int sockfd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(sockfd, buf, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 分帧协议：一行中的所有语句一次发出，再按顺序读回每条语句的结果，多条语句只需要一次往返
+bool run_pipelined(int sockfd, const std::string &command, uint32_t *next_stmt_id) {
+    auto stmts = split_statements(command);
+    std::string out;
+    for (auto &stmt : stmts) {
+        char header[WIRE_HEADER_SIZE];
+        encode_wire_header(header, {static_cast<uint32_t>(stmt.size()), (*next_stmt_id)++, WireType::QUERY});
+        out.append(header, WIRE_HEADER_SIZE);
+        out.append(stmt);
+    }
+    if (write(sockfd, out.data(), out.size()) != static_cast<ssize_t>(out.size())) {
+        std::cerr << "send error: " << errno << ":" << strerror(errno) << " \n" << std::endl;
+        return false;
+    }
+    size_t finished = 0;
+    std::vector<char> payload;
+    while (finished < stmts.size()) {
+        char header_buf[WIRE_HEADER_SIZE];
+        if (!recv_all(sockfd, header_buf, WIRE_HEADER_SIZE)) {
+            printf("Connection has been closed\n");
+            return false;
+        }
+        WireHeader header = decode_wire_header(header_buf);
+        payload.resize(header.length);
+        if (!recv_all(sockfd, payload.data(), header.length)) {
+            printf("Connection has been closed\n");
+            return false;
+        }
+        fwrite(payload.data(), 1, payload.size(), stdout);
+        if (header.type == WireType::RESULT_END) {
+            ++finished;
+        }
+    }
+    fflush(stdout);
+    return true;
+}
+
 int init_unix_sock(const char *unix_sock_path) {
     int sockfd = socket(PF_UNIX, SOCK_STREAM, 0);
     if (sockfd < 0) {
@@ -78,10 +150,14 @@ int main(int argc, char *argv[]) {
     const char *unix_socket_path = nullptr;
     const char *server_host = "127.0.0.1";  // 127.0.0.1 192.168.31.25
     int server_port = PORT_DEFAULT;
+    bool framed = false;  // -b：使用分帧协议，一行中用';'分开的多条语句一次发出
     int opt;
 
-    while ((opt = getopt(argc, argv, "s:h:p:")) > 0) {
+    while ((opt = getopt(argc, argv, "s:h:p:b")) > 0) {
         switch (opt) {
+            case 'b':
+                framed = true;
+                break;
             case 's':
                 unix_socket_path = optarg;
                 break;
@@ -110,8 +186,13 @@ int main(int argc, char *argv[]) {
     if (sockfd < 0) {
         return 1;
     }
+    if (framed && write(sockfd, WIRE_MAGIC, sizeof(WIRE_MAGIC)) != sizeof(WIRE_MAGIC)) {
+        std::cerr << "send error: " << errno << ":" << strerror(errno) << " \n" << std::endl;
+        return 1;
+    }
 
     char recv_buf[MAX_MEM_BUFFER_SIZE];
+    uint32_t next_stmt_id = 0;
 
     while (1) {
         char *line_read = readline("Rucbase> ");
@@ -128,28 +209,43 @@ int main(int argc, char *argv[]) {
                 printf("The client will be closed.\n");
                 break;
             }
+            if (framed) {
+                if (!run_pipelined(sockfd, command, &next_stmt_id)) {
+                    break;
+                }
+                continue;
+            }
 
             if ((send_bytes = write(sockfd, command.c_str(), command.length() + 1)) == -1) {
                 // fprintf(stderr, "send error: %d:%s \n", errno, strerror(errno));
                 std::cerr << "send error: " << errno << ":" << strerror(errno) << " \n" << std::endl;
                 exit(1);
             }
-            int len = recv(sockfd, recv_buf, MAX_MEM_BUFFER_SIZE, 0);
-            if (len < 0) {
-                fprintf(stderr, "Connection was broken: %s\n", strerror(errno));
-                break;
-            } else if (len == 0) {
-                printf("Connection has been closed\n");
-                break;
-            } else {
-                for (int i = 0; i <= len; i++) {
+            // 大结果由服务端分块发送，一直读到结尾的'\0'
+            bool finished = false;
+            bool broken = false;
+            while (!finished) {
+                int len = recv(sockfd, recv_buf, MAX_MEM_BUFFER_SIZE, 0);
+                if (len < 0) {
+                    fprintf(stderr, "Connection was broken: %s\n", strerror(errno));
+                    broken = true;
+                    break;
+                } else if (len == 0) {
+                    printf("Connection has been closed\n");
+                    broken = true;
+                    break;
+                }
+                for (int i = 0; i < len; i++) {
                     if (recv_buf[i] == '\0') {
+                        finished = true;
                         break;
-                    } else {
-                        printf("%c", recv_buf[i]);
                     }
+                    printf("%c", recv_buf[i]);
                 }
-                memset(recv_buf, 0, MAX_MEM_BUFFER_SIZE);
+            }
+            fflush(stdout);
+            if (broken) {
+                break;
             }
         }
     }
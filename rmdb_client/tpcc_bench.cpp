@@ -0,0 +1,1014 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+/**
+ * TPC-C 压测客户端：多个终端线程各自连接服务端，按标准比例（45/43/4/4/4）执行
+ * NewOrder、Payment、OrderStatus、Delivery、StockLevel 五种事务，结束后按事务类型输出
+ * 吞吐（tpmC）、回滚率和延迟分位数。
+ *
+ * 服务端只支持简单的 SELECT/INSERT/UPDATE/DELETE，没有聚合和表达式，
+ * 计数、求和、自增都由客户端读出之后计算再写回；Payment 和 OrderStatus 只按 c_id 查找顾客。
+ *
+ *   tpcc_bench -g -D dir -w 4     生成 4 个仓库的数据到 dir
+ *   tpcc_bench -l -D dir          建表、LOAD dir 中的数据并建索引
+ *   tpcc_bench -D dir -t 8 -T 60  8 个终端压测 60 秒，数据规模从 dir 中的 CSV 得到
+ *   tpcc_bench -l -t 1 -n 2000 -o result.json
+ *                                 回归测试：LOAD 默认数据后每个终端执行固定的 2000 个事务，结果写成 JSON。
+ *                                 种子相同时每个终端的事务序列和参数都相同，单终端时结果可以逐次比较
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PORT_DEFAULT 8765
+#define RECV_BUFFER_SIZE 8192
+
+static constexpr const char *NULL_DATE = "1970-01-01 00:00:00";  // 没有送达的订单行的送达时间
+static constexpr int NUM_TXN_TYPES = 5;
+static const char *TXN_NAMES[NUM_TXN_TYPES] = {"NewOrder", "Payment", "OrderStatus", "Delivery", "StockLevel"};
+enum TxnType { NEW_ORDER, PAYMENT, ORDER_STATUS, DELIVERY, STOCK_LEVEL };
+
+/* 表结构，列的顺序和 CSV 文件中的列一致 */
+struct TableDef {
+    const char *name;
+    const char *columns;
+    const char *index;  // 主键
+};
+
+static const TableDef TABLES[] = {
+    {"warehouse",
+     "w_id int, w_name char(10), w_street_1 char(20), w_street_2 char(20), w_city char(20), w_state char(2), "
+     "w_zip char(9), w_tax float, w_ytd float",
+     "w_id"},
+    {"district",
+     "d_id int, d_w_id int, d_name char(10), d_street_1 char(20), d_street_2 char(20), d_city char(20), "
+     "d_state char(2), d_zip char(9), d_tax float, d_ytd float, d_next_o_id int",
+     "d_w_id, d_id"},
+    {"customer",
+     "c_id int, c_d_id int, c_w_id int, c_first char(16), c_middle char(2), c_last char(16), c_street_1 char(20), "
+     "c_street_2 char(20), c_city char(20), c_state char(2), c_zip char(9), c_phone char(16), c_since char(19), "
+     "c_credit char(2), c_credit_lim int, c_discount float, c_balance float, c_ytd_payment float, "
+     "c_payment_cnt int, c_delivery_cnt int, c_data char(50)",
+     "c_w_id, c_d_id, c_id"},
+    {"history",
+     "h_c_id int, h_c_d_id int, h_c_w_id int, h_d_id int, h_w_id int, h_date char(19), h_amount float, "
+     "h_data char(24)",
+     nullptr},
+    {"new_orders", "no_o_id int, no_d_id int, no_w_id int", "no_w_id, no_d_id, no_o_id"},
+    {"orders",
+     "o_id int, o_d_id int, o_w_id int, o_c_id int, o_entry_d char(19), o_carrier_id int, o_ol_cnt int, "
+     "o_all_local int",
+     "o_w_id, o_d_id, o_id"},
+    {"order_line",
+     "ol_o_id int, ol_d_id int, ol_w_id int, ol_number int, ol_i_id int, ol_supply_w_id int, "
+     "ol_delivery_d char(19), ol_quantity int, ol_amount float, ol_dist_info char(24)",
+     "ol_w_id, ol_d_id, ol_o_id, ol_number"},
+    {"item", "i_id int, i_im_id int, i_name char(24), i_price float, i_data char(50)", "i_id"},
+    {"stock",
+     "s_i_id int, s_w_id int, s_quantity int, s_dist_01 char(24), s_dist_02 char(24), s_dist_03 char(24), "
+     "s_dist_04 char(24), s_dist_05 char(24), s_dist_06 char(24), s_dist_07 char(24), s_dist_08 char(24), "
+     "s_dist_09 char(24), s_dist_10 char(24), s_ytd float, s_order_cnt int, s_remote_cnt int, s_data char(50)",
+     "s_w_id, s_i_id"},
+};
+
+/* 数据规模：生成数据时由参数指定，压测时从 CSV 文件的行数得到 */
+struct Scale {
+    int warehouses = 1;
+    int districts = 10;   // 每个仓库的地区数
+    int customers = 300;  // 每个地区的顾客数，也是初始的订单数
+    int items = 10000;
+};
+
+// 当前时间，格式和 CSV 中的日期一致
+static std::string now_str() {
+    char buf[32];
+    time_t t = time(nullptr);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+static std::string fmt_float(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", v);
+    return buf;
+}
+
+/* 和服务端之间的一个连接，使用以'\0'结尾的文本协议，一次发送一条语句并读完回复 */
+class Connection {
+   public:
+    enum class Status { OK, ABORTED, ERROR };
+
+    ~Connection() {
+        if (sockfd_ >= 0) {
+            close(sockfd_);
+        }
+    }
+
+    bool connect_to(const char *host, int port) {
+        struct hostent *ent = gethostbyname(host);
+        if (ent == nullptr) {
+            fprintf(stderr, "gethostbyname failed. errmsg=%d:%s\n", errno, strerror(errno));
+            return false;
+        }
+        sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd_ < 0) {
+            fprintf(stderr, "create socket error. errmsg=%d:%s\n", errno, strerror(errno));
+            return false;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr = *((struct in_addr *)ent->h_addr);
+        if (connect(sockfd_, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            fprintf(stderr, "Failed to connect. errmsg=%d:%s\n", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // 发送一条语句并读回完整的回复，连接断开时返回false
+    bool send_recv(const std::string &sql, std::string *reply) {
+        if (write(sockfd_, sql.c_str(), sql.length() + 1) != static_cast<ssize_t>(sql.length() + 1)) {
+            return false;
+        }
+        reply->clear();
+        char buf[RECV_BUFFER_SIZE];
+        while (true) {
+            ssize_t len = recv(sockfd_, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                return false;
+            }
+            char *end = static_cast<char *>(memchr(buf, '\0', len));
+            if (end != nullptr) {
+                reply->append(buf, end - buf);
+                return true;
+            }
+            reply->append(buf, len);
+        }
+    }
+
+    /**
+     * @description: 执行一条语句。rows不为nullptr时语句是SELECT，按表格解析出每一行（去掉表头）
+     * @return {Status} 服务端回滚了事务时为ABORTED，其他错误（包括连接断开）为ERROR
+     */
+    Status exec(const std::string &sql, std::vector<std::vector<std::string>> *rows = nullptr) {
+        std::string reply;
+        if (!send_recv(sql, &reply)) {
+            broken_ = true;
+            return Status::ERROR;
+        }
+        if (reply.compare(0, 5, "abort") == 0) {
+            return Status::ABORTED;
+        }
+        if (rows == nullptr) {
+            return reply.find_first_not_of(" \t\n") == std::string::npos ? Status::OK : Status::ERROR;
+        }
+        if (reply.find("Total record(s)") == std::string::npos) {
+            return Status::ERROR;
+        }
+        rows->clear();
+        bool header = true;
+        size_t pos = 0;
+        while (pos < reply.size()) {
+            size_t eol = reply.find('\n', pos);
+            if (eol == std::string::npos) {
+                eol = reply.size();
+            }
+            if (reply[pos] == '|') {
+                if (header) {
+                    header = false;
+                } else {
+                    rows->push_back(split_row(reply.substr(pos, eol - pos)));
+                }
+            }
+            pos = eol + 1;
+        }
+        return Status::OK;
+    }
+
+    bool broken() const { return broken_; }
+
+   private:
+    // "|    1 |  abc |" -> {"1", "abc"}
+    static std::vector<std::string> split_row(const std::string &line) {
+        std::vector<std::string> cells;
+        size_t pos = 1;
+        while (pos < line.size()) {
+            size_t bar = line.find('|', pos);
+            if (bar == std::string::npos) {
+                break;
+            }
+            size_t begin = line.find_first_not_of(' ', pos);
+            size_t end = line.find_last_not_of(' ', bar - 1);
+            cells.push_back(begin < bar && end >= begin ? line.substr(begin, end - begin + 1) : "");
+            pos = bar + 1;
+        }
+        return cells;
+    }
+
+    int sockfd_ = -1;
+    bool broken_ = false;
+};
+
+/* 一种事务的统计 */
+struct TxnStats {
+    uint64_t committed = 0;
+    uint64_t rolled_back = 0;  // NewOrder 中按规范有意回滚的事务，算作完成
+    uint64_t aborted = 0;      // 服务端回滚（死锁、锁冲突）或者出错的事务
+    std::vector<uint32_t> latencies_us;  // 完成的事务的延迟
+
+    void merge(const TxnStats &other) {
+        committed += other.committed;
+        rolled_back += other.rolled_back;
+        aborted += other.aborted;
+        latencies_us.insert(latencies_us.end(), other.latencies_us.begin(), other.latencies_us.end());
+    }
+};
+
+// 事务被服务端回滚或者语句出错时抛出，终端放弃这个事务
+struct TxnAbort {};
+// 事务按规范需要回滚时抛出
+struct TxnRollback {};
+
+/* 一个终端：一个连接，有自己的主仓库，依次执行随机选出的事务 */
+class Terminal {
+   public:
+    Terminal(int id, const Scale &scale, int warehouses, uint64_t seed)
+        : scale_(scale), warehouses_(warehouses), w_id_(id % warehouses + 1), rng_(seed + id) {
+        c_run_ = uniform(0, 1023);
+        i_run_ = uniform(0, 8191);
+    }
+
+    bool connect(const char *host, int port) { return conn_.connect_to(host, port); }
+
+    // 执行事务直到stop被置位，limit不为0时最多执行这么多个事务（包括被回滚的）
+    void run(const std::atomic<bool> &stop, uint64_t limit = 0) {
+        for (uint64_t n = 0; (limit == 0 || n < limit) && !stop.load(std::memory_order_relaxed) && !conn_.broken();
+             ++n) {
+            int r = uniform(1, 100);
+            TxnType type = r <= 45 ? NEW_ORDER : r <= 88 ? PAYMENT : r <= 92 ? ORDER_STATUS : r <= 96 ? DELIVERY : STOCK_LEVEL;
+            auto start = std::chrono::steady_clock::now();
+            auto &stats = stats_[type];
+            try {
+                switch (type) {
+                    case NEW_ORDER:
+                        new_order();
+                        break;
+                    case PAYMENT:
+                        payment();
+                        break;
+                    case ORDER_STATUS:
+                        order_status();
+                        break;
+                    case DELIVERY:
+                        delivery();
+                        break;
+                    case STOCK_LEVEL:
+                        stock_level();
+                        break;
+                }
+                ++stats.committed;
+            } catch (TxnRollback &) {
+                conn_.exec("abort;");
+                ++stats.rolled_back;
+            } catch (TxnAbort &) {
+                ++stats.aborted;
+                continue;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            stats.latencies_us.push_back(
+                static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        }
+    }
+
+    const TxnStats &stats(int type) const { return stats_[type]; }
+
+   private:
+    using Rows = std::vector<std::vector<std::string>>;
+
+    int uniform(int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng_); }
+
+    // TPC-C 的非均匀分布 NURand(A, x, y)
+    int nurand(int a, int c, int x, int y) { return (((uniform(0, a) | uniform(x, y)) + c) % (y - x + 1)) + x; }
+
+    int random_customer() { return nurand(1023, c_run_, 1, scale_.customers); }
+    int random_item() { return nurand(8191, i_run_, 1, scale_.items); }
+
+    // 执行语句，服务端回滚了事务或者语句出错时放弃事务
+    void exec(const std::string &sql, Rows *rows = nullptr) {
+        auto status = conn_.exec(sql, rows);
+        if (status == Connection::Status::OK) {
+            return;
+        }
+        if (status == Connection::Status::ERROR && !conn_.broken()) {
+            // 语句出错时服务端不会回滚事务
+            conn_.exec("abort;");
+        }
+        throw TxnAbort();
+    }
+
+    // 查询一行，没有结果时放弃事务
+    std::vector<std::string> exec_one(const std::string &sql) {
+        Rows rows;
+        exec(sql, &rows);
+        if (rows.empty()) {
+            conn_.exec("abort;");
+            throw TxnAbort();
+        }
+        return std::move(rows[0]);
+    }
+
+    std::string key(const char *w, int w_id, const char *d, int d_id) {
+        return std::string(w) + " = " + std::to_string(w_id) + " and " + d + " = " + std::to_string(d_id);
+    }
+
+    void new_order() {
+        int d_id = uniform(1, scale_.districts);
+        int c_id = random_customer();
+        int ol_cnt = uniform(5, 15);
+        bool rollback = uniform(1, 100) == 1;  // 1% 的事务最后一个商品不存在，需要回滚
+        std::string date = now_str();
+
+        exec("begin;");
+        exec_one("select c_discount, c_last, c_credit from customer where " + key("c_w_id", w_id_, "c_d_id", d_id) +
+                 " and c_id = " + std::to_string(c_id) + ";");
+        exec_one("select w_tax from warehouse where w_id = " + std::to_string(w_id_) + ";");
+        auto district = exec_one("select d_next_o_id, d_tax from district where " +
+                                 key("d_w_id", w_id_, "d_id", d_id) + ";");
+        int o_id = std::stoi(district[0]);
+        exec("update district set d_next_o_id = " + std::to_string(o_id + 1) + " where " +
+             key("d_w_id", w_id_, "d_id", d_id) + ";");
+
+        // 供货仓库：1% 的商品来自其他仓库
+        std::vector<int> items(ol_cnt), supply(ol_cnt), quantities(ol_cnt);
+        bool all_local = true;
+        for (int i = 0; i < ol_cnt; ++i) {
+            items[i] = random_item();
+            supply[i] = w_id_;
+            if (warehouses_ > 1 && uniform(1, 100) == 1) {
+                do {
+                    supply[i] = uniform(1, warehouses_);
+                } while (supply[i] == w_id_);
+                all_local = false;
+            }
+            quantities[i] = uniform(1, 10);
+        }
+        if (rollback) {
+            items[ol_cnt - 1] = scale_.items + 1;
+        }
+        exec("insert into orders values (" + std::to_string(o_id) + ", " + std::to_string(d_id) + ", " +
+             std::to_string(w_id_) + ", " + std::to_string(c_id) + ", '" + date + "', 0, " + std::to_string(ol_cnt) +
+             ", " + (all_local ? "1" : "0") + ");");
+        exec("insert into new_orders values (" + std::to_string(o_id) + ", " + std::to_string(d_id) + ", " +
+             std::to_string(w_id_) + ");");
+
+        for (int i = 0; i < ol_cnt; ++i) {
+            Rows rows;
+            exec("select i_price, i_name from item where i_id = " + std::to_string(items[i]) + ";", &rows);
+            if (rows.empty()) {
+                throw TxnRollback();
+            }
+            double price = std::stod(rows[0][0]);
+            std::string stock_key = key("s_w_id", supply[i], "s_i_id", items[i]);
+            auto stock = exec_one("select s_quantity, s_ytd, s_order_cnt, s_remote_cnt from stock where " +
+                                  stock_key + ";");
+            int s_quantity = std::stoi(stock[0]);
+            s_quantity = s_quantity - quantities[i] >= 10 ? s_quantity - quantities[i]
+                                                          : s_quantity - quantities[i] + 91;
+            exec("update stock set s_quantity = " + std::to_string(s_quantity) +
+                 ", s_ytd = " + fmt_float(std::stod(stock[1]) + quantities[i]) +
+                 ", s_order_cnt = " + std::to_string(std::stoi(stock[2]) + 1) +
+                 ", s_remote_cnt = " + std::to_string(std::stoi(stock[3]) + (supply[i] != w_id_)) + " where " +
+                 stock_key + ";");
+            exec("insert into order_line values (" + std::to_string(o_id) + ", " + std::to_string(d_id) + ", " +
+                 std::to_string(w_id_) + ", " + std::to_string(i + 1) + ", " + std::to_string(items[i]) + ", " +
+                 std::to_string(supply[i]) + ", '" + NULL_DATE + "', " + std::to_string(quantities[i]) + ", " +
+                 fmt_float(price * quantities[i]) + ", '" + random_string(24) + "');");
+        }
+        exec("commit;");
+    }
+
+    void payment() {
+        int d_id = uniform(1, scale_.districts);
+        // 15% 的顾客属于其他仓库
+        int c_w_id = w_id_;
+        int c_d_id = d_id;
+        if (warehouses_ > 1 && uniform(1, 100) <= 15) {
+            do {
+                c_w_id = uniform(1, warehouses_);
+            } while (c_w_id == w_id_);
+            c_d_id = uniform(1, scale_.districts);
+        }
+        int c_id = random_customer();
+        double amount = uniform(100, 500000) / 100.0;
+
+        exec("begin;");
+        std::string w_key = "w_id = " + std::to_string(w_id_);
+        auto warehouse = exec_one("select w_ytd, w_name from warehouse where " + w_key + ";");
+        exec("update warehouse set w_ytd = " + fmt_float(std::stod(warehouse[0]) + amount) + " where " + w_key +
+             ";");
+        std::string d_key = key("d_w_id", w_id_, "d_id", d_id);
+        auto district = exec_one("select d_ytd, d_name from district where " + d_key + ";");
+        exec("update district set d_ytd = " + fmt_float(std::stod(district[0]) + amount) + " where " + d_key +
+             ";");
+        std::string c_key = key("c_w_id", c_w_id, "c_d_id", c_d_id) + " and c_id = " + std::to_string(c_id);
+        auto customer = exec_one("select c_balance, c_ytd_payment, c_payment_cnt, c_credit from customer where " +
+                                 c_key + ";");
+        exec("update customer set c_balance = " + fmt_float(std::stod(customer[0]) - amount) +
+             ", c_ytd_payment = " + fmt_float(std::stod(customer[1]) + amount) +
+             ", c_payment_cnt = " + std::to_string(std::stoi(customer[2]) + 1) + " where " + c_key + ";");
+        exec("insert into history values (" + std::to_string(c_id) + ", " + std::to_string(c_d_id) + ", " +
+             std::to_string(c_w_id) + ", " + std::to_string(d_id) + ", " + std::to_string(w_id_) + ", '" +
+             now_str() + "', " + fmt_float(amount) + ", '" + random_string(24) + "');");
+        exec("commit;");
+    }
+
+    void order_status() {
+        int d_id = uniform(1, scale_.districts);
+        int c_id = random_customer();
+
+        exec("begin;");
+        exec_one("select c_balance, c_first, c_middle, c_last from customer where " +
+                 key("c_w_id", w_id_, "c_d_id", d_id) + " and c_id = " + std::to_string(c_id) + ";");
+        Rows orders;
+        exec("select o_id, o_entry_d, o_carrier_id from orders where " + key("o_w_id", w_id_, "o_d_id", d_id) +
+                 " and o_c_id = " + std::to_string(c_id) + " order by o_id desc limit 1;",
+             &orders);
+        if (!orders.empty()) {
+            Rows lines;
+            exec("select ol_i_id, ol_supply_w_id, ol_quantity, ol_amount, ol_delivery_d from order_line where " +
+                     key("ol_w_id", w_id_, "ol_d_id", d_id) + " and ol_o_id = " + orders[0][0] + ";",
+                 &lines);
+        }
+        exec("commit;");
+    }
+
+    void delivery() {
+        int carrier = uniform(1, 10);
+        std::string date = now_str();
+
+        exec("begin;");
+        for (int d_id = 1; d_id <= scale_.districts; ++d_id) {
+            Rows new_orders;
+            exec("select no_o_id from new_orders where " + key("no_w_id", w_id_, "no_d_id", d_id) +
+                     " order by no_o_id limit 1;",
+                 &new_orders);
+            if (new_orders.empty()) {
+                continue;
+            }
+            std::string o_id = new_orders[0][0];
+            exec("delete from new_orders where " + key("no_w_id", w_id_, "no_d_id", d_id) + " and no_o_id = " +
+                 o_id + ";");
+            std::string o_key = key("o_w_id", w_id_, "o_d_id", d_id) + " and o_id = " + o_id;
+            auto order = exec_one("select o_c_id from orders where " + o_key + ";");
+            exec("update orders set o_carrier_id = " + std::to_string(carrier) + " where " + o_key + ";");
+            std::string ol_key = key("ol_w_id", w_id_, "ol_d_id", d_id) + " and ol_o_id = " + o_id;
+            Rows lines;
+            exec("select ol_amount from order_line where " + ol_key + ";", &lines);
+            double total = 0;
+            for (auto &line : lines) {
+                total += std::stod(line[0]);
+            }
+            exec("update order_line set ol_delivery_d = '" + date + "' where " + ol_key + ";");
+            std::string c_key = key("c_w_id", w_id_, "c_d_id", d_id) + " and c_id = " + order[0];
+            auto customer = exec_one("select c_balance, c_delivery_cnt from customer where " + c_key + ";");
+            exec("update customer set c_balance = " + fmt_float(std::stod(customer[0]) + total) +
+                 ", c_delivery_cnt = " + std::to_string(std::stoi(customer[1]) + 1) + " where " + c_key + ";");
+        }
+        exec("commit;");
+    }
+
+    void stock_level() {
+        int d_id = uniform(1, scale_.districts);
+        int threshold = uniform(10, 20);
+
+        exec("begin;");
+        auto district = exec_one("select d_next_o_id from district where " + key("d_w_id", w_id_, "d_id", d_id) +
+                                 ";");
+        int next_o_id = std::stoi(district[0]);
+        Rows lines;
+        exec("select ol_i_id from order_line where " + key("ol_w_id", w_id_, "ol_d_id", d_id) +
+                 " and ol_o_id >= " + std::to_string(next_o_id - 20) + " and ol_o_id < " +
+                 std::to_string(next_o_id) + ";",
+             &lines);
+        std::set<std::string> items;
+        for (auto &line : lines) {
+            items.insert(line[0]);
+        }
+        int low_stock = 0;
+        for (auto &item : items) {
+            Rows stock;
+            exec("select s_quantity from stock where s_w_id = " + std::to_string(w_id_) + " and s_i_id = " + item +
+                     " and s_quantity < " + std::to_string(threshold) + ";",
+                 &stock);
+            low_stock += !stock.empty();
+        }
+        (void)low_stock;
+        exec("commit;");
+    }
+
+    std::string random_string(int len) {
+        static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+        std::string s(len, ' ');
+        for (auto &c : s) {
+            c = ALPHABET[uniform(0, sizeof(ALPHABET) - 2)];
+        }
+        return s;
+    }
+
+    Scale scale_;
+    int warehouses_;  // 终端使用的仓库数
+    int w_id_;        // 主仓库
+    std::mt19937_64 rng_;
+    int c_run_;  // NURand 的常数 C
+    int i_run_;
+    Connection conn_;
+    TxnStats stats_[NUM_TXN_TYPES];
+};
+
+/* 生成 CSV 数据，格式和 src/test/performance_test/table_data 中的一致 */
+class Generator {
+   public:
+    Generator(const Scale &scale, uint64_t seed) : scale_(scale), rng_(seed) {}
+
+    bool generate(const std::string &dir) {
+        std::string date = now_str();
+        if (!open(dir, "warehouse", "w_id,w_name,w_street_1,w_street_2,w_city,w_state,w_zip,w_tax,w_ytd")) {
+            return false;
+        }
+        for (int w = 1; w <= scale_.warehouses; ++w) {
+            out_ << w << ',' << str(10) << ',' << address() << ',' << tax() << ",300000.0\n";
+        }
+        if (!open(dir, "district",
+                  "d_id,d_w_id,d_name,d_street_1,d_street_2,d_city,d_state,d_zip,d_tax,d_ytd,d_next_o_id")) {
+            return false;
+        }
+        for (int w = 1; w <= scale_.warehouses; ++w) {
+            for (int d = 1; d <= scale_.districts; ++d) {
+                out_ << d << ',' << w << ',' << str(10) << ',' << address() << ',' << tax() << ",30000.0,"
+                     << scale_.customers + 1 << '\n';
+            }
+        }
+        if (!open(dir, "customer",
+                  "c_id,c_d_id,c_w_id,c_first,c_middle,c_last,c_street_1,c_street_2,c_city,c_state,c_zip,c_phone,"
+                  "c_since,c_credit,c_credit_lim,c_discount,c_balance,c_ytd_payment,c_payment_cnt,c_delivery_cnt,"
+                  "c_data")) {
+            return false;
+        }
+        for_each_district([&](int w, int d) {
+            for (int c = 1; c <= scale_.customers; ++c) {
+                out_ << c << ',' << d << ',' << w << ',' << str(16) << ",OE," << last_name(c) << ',' << address()
+                     << ',' << digits(16) << ',' << date << ',' << (uniform(1, 10) == 1 ? "BC" : "GC")
+                     << ",50000," << uniform(0, 5000) / 10000.0 << ",-10.0,10.0,1,0," << str(50) << '\n';
+            }
+        });
+        if (!open(dir, "history", "h_c_id,h_c_d_id,h_c_w_id,h_d_id,h_w_id,h_date,h_amount,h_data")) {
+            return false;
+        }
+        for_each_district([&](int w, int d) {
+            for (int c = 1; c <= scale_.customers; ++c) {
+                out_ << c << ',' << d << ',' << w << ',' << d << ',' << w << ',' << date << ",10.0," << str(24)
+                     << '\n';
+            }
+        });
+        // 每个顾客一个初始订单，订单号是顾客的随机排列；最后 30% 的订单还没有送达
+        int undelivered = scale_.customers - scale_.customers * 7 / 10;
+        if (!open(dir, "orders", "o_id,o_d_id,o_w_id,o_c_id,o_entry_d,o_carrier_id,o_ol_cnt,o_all_local")) {
+            return false;
+        }
+        std::ofstream lines(dir + "/order_line.csv");
+        std::ofstream new_orders(dir + "/new_orders.csv");
+        if (!lines || !new_orders) {
+            fprintf(stderr, "failed to write %s\n", dir.c_str());
+            return false;
+        }
+        lines << "ol_o_id,ol_d_id,ol_w_id,ol_number,ol_i_id,ol_supply_w_id,ol_delivery_d,ol_quantity,ol_amount,"
+                 "ol_dist_info\n";
+        new_orders << "no_o_id,no_d_id,no_w_id\n";
+        for_each_district([&](int w, int d) {
+            std::vector<int> customers(scale_.customers);
+            for (int c = 0; c < scale_.customers; ++c) {
+                customers[c] = c + 1;
+            }
+            std::shuffle(customers.begin(), customers.end(), rng_);
+            for (int o = 1; o <= scale_.customers; ++o) {
+                bool delivered = o <= scale_.customers - undelivered;
+                int ol_cnt = uniform(5, 15);
+                out_ << o << ',' << d << ',' << w << ',' << customers[o - 1] << ',' << date << ','
+                     << (delivered ? uniform(1, 10) : 0) << ',' << ol_cnt << ",1\n";
+                for (int ol = 1; ol <= ol_cnt; ++ol) {
+                    lines << o << ',' << d << ',' << w << ',' << ol << ',' << uniform(1, scale_.items) << ',' << w
+                          << ',' << (delivered ? date : NULL_DATE) << ",5,"
+                          << (delivered ? 0.0 : uniform(1, 999999) / 100.0) << ',' << str(24) << '\n';
+                }
+                if (!delivered) {
+                    new_orders << o << ',' << d << ',' << w << '\n';
+                }
+            }
+        });
+        if (!open(dir, "item", "i_id,i_im_id,i_name,i_price,i_data")) {
+            return false;
+        }
+        for (int i = 1; i <= scale_.items; ++i) {
+            out_ << i << ',' << uniform(1, 10000) << ',' << str(24) << ',' << uniform(100, 10000) / 100.0 << ','
+                 << str(50) << '\n';
+        }
+        if (!open(dir, "stock",
+                  "s_i_id,s_w_id,s_quantity,s_dist_01,s_dist_02,s_dist_03,s_dist_04,s_dist_05,s_dist_06,s_dist_07,"
+                  "s_dist_08,s_dist_09,s_dist_10,s_ytd,s_order_cnt,s_remote_cnt,s_data")) {
+            return false;
+        }
+        for (int w = 1; w <= scale_.warehouses; ++w) {
+            for (int i = 1; i <= scale_.items; ++i) {
+                out_ << i << ',' << w << ',' << uniform(10, 100);
+                for (int d = 0; d < 10; ++d) {
+                    out_ << ',' << str(24);
+                }
+                out_ << ",0.0,0,0," << str(50) << '\n';
+            }
+        }
+        out_.close();
+        return true;
+    }
+
+   private:
+    bool open(const std::string &dir, const char *table, const char *header) {
+        out_.close();
+        out_.open(dir + "/" + table + ".csv");
+        if (!out_) {
+            fprintf(stderr, "failed to write %s/%s.csv\n", dir.c_str(), table);
+            return false;
+        }
+        out_ << header << '\n';
+        return true;
+    }
+
+    template <typename Fn>
+    void for_each_district(Fn &&fn) {
+        for (int w = 1; w <= scale_.warehouses; ++w) {
+            for (int d = 1; d <= scale_.districts; ++d) {
+                fn(w, d);
+            }
+        }
+    }
+
+    int uniform(int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng_); }
+
+    std::string str(int len) {
+        static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+        std::string s(len, ' ');
+        for (auto &c : s) {
+            c = ALPHABET[uniform(0, sizeof(ALPHABET) - 2)];
+        }
+        return s;
+    }
+
+    std::string digits(int len) {
+        std::string s(len, '0');
+        for (auto &c : s) {
+            c = '0' + uniform(0, 9);
+        }
+        return s;
+    }
+
+    // street_1,street_2,city,state,zip
+    std::string address() { return str(20) + ',' + str(20) + ',' + str(20) + ',' + str(2) + ',' + digits(9); }
+
+    std::string tax() { return std::to_string(uniform(0, 2000) / 10000.0); }
+
+    // TPC-C 的姓由三个音节拼成
+    static std::string last_name(int c) {
+        static const char *SYLLABLES[] = {"BAR", "OUGHT", "ABLE", "PRI", "PRES", "ESE", "ANTI", "CALLY", "ATION", "EING"};
+        int n = (c - 1) % 1000;
+        return std::string(SYLLABLES[n / 100]) + SYLLABLES[n / 10 % 10] + SYLLABLES[n % 10];
+    }
+
+    Scale scale_;
+    std::mt19937_64 rng_;
+    std::ofstream out_;
+};
+
+// CSV 文件的数据行数
+static long count_rows(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+        return -1;
+    }
+    long rows = -1;  // 表头
+    std::string line;
+    while (std::getline(in, line)) {
+        rows += !line.empty();
+    }
+    return rows;
+}
+
+// 从数据目录中的 CSV 文件得到数据规模
+static bool read_scale(const std::string &dir, Scale *scale) {
+    long warehouses = count_rows(dir + "/warehouse.csv");
+    long districts = count_rows(dir + "/district.csv");
+    long customers = count_rows(dir + "/customer.csv");
+    long items = count_rows(dir + "/item.csv");
+    if (warehouses <= 0 || districts <= 0 || customers <= 0 || items <= 0) {
+        fprintf(stderr, "no TPC-C data in %s\n", dir.c_str());
+        return false;
+    }
+    scale->warehouses = static_cast<int>(warehouses);
+    scale->districts = static_cast<int>(districts / warehouses);
+    scale->customers = static_cast<int>(customers / districts);
+    scale->items = static_cast<int>(items);
+    return true;
+}
+
+/* 加载数据各阶段的耗时（秒） */
+struct LoadTimes {
+    double create = 0;
+    double load = 0;
+    double index = 0;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 建表、LOAD 数据目录中的 CSV 文件，最后建索引（LOAD 在服务端异步执行，下一条语句会等它结束）
+static bool load(const char *host, int port, const std::string &dir, LoadTimes *times) {
+    Connection conn;
+    if (!conn.connect_to(host, port)) {
+        return false;
+    }
+    char path[PATH_MAX];
+    if (realpath(dir.c_str(), path) == nullptr) {
+        fprintf(stderr, "bad data directory %s\n", dir.c_str());
+        return false;
+    }
+    std::string reply;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &table : TABLES) {
+        conn.send_recv(std::string("drop table ") + table.name + ";", &reply);
+        if (conn.exec(std::string("create table ") + table.name + " (" + table.columns + ");") !=
+            Connection::Status::OK) {
+            fprintf(stderr, "failed to create table %s\n", table.name);
+            return false;
+        }
+    }
+    times->create = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (auto &table : TABLES) {
+        printf("loading %s\n", table.name);
+        if (!conn.send_recv(std::string("load ") + path + "/" + table.name + ".csv into " + table.name + ";", &reply)) {
+            return false;
+        }
+    }
+    // 随便一条语句都会等所有的 LOAD 结束并刷盘，它返回时加载才算完成
+    if (!conn.send_recv("show tables;", &reply)) {
+        return false;
+    }
+    times->load = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (auto &table : TABLES) {
+        if (table.index != nullptr &&
+            conn.exec(std::string("create index ") + table.name + " (" + table.index + ");") != Connection::Status::OK) {
+            fprintf(stderr, "failed to create index on %s\n", table.name);
+            return false;
+        }
+    }
+    times->index = seconds_since(start);
+    printf("create tables: %.3f s, load: %.3f s, create indexes: %.3f s\n", times->create, times->load, times->index);
+    return true;
+}
+
+static double percentile_ms(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[idx] / 1000.0;
+}
+
+static void report(std::vector<TxnStats> &stats, double seconds) {
+    printf("%-12s %10s %10s %10s %8s %10s %10s %10s %10s\n", "txn", "committed", "rollback", "aborted", "abort%",
+           "p50(ms)", "p95(ms)", "p99(ms)", "max(ms)");
+    uint64_t total = 0;
+    for (int type = 0; type < NUM_TXN_TYPES; ++type) {
+        auto &s = stats[type];
+        std::sort(s.latencies_us.begin(), s.latencies_us.end());
+        uint64_t attempts = s.committed + s.rolled_back + s.aborted;
+        total += s.committed + s.rolled_back;
+        printf("%-12s %10lu %10lu %10lu %7.2f%% %10.2f %10.2f %10.2f %10.2f\n", TXN_NAMES[type], s.committed,
+               s.rolled_back, s.aborted, attempts == 0 ? 0.0 : 100.0 * s.aborted / attempts,
+               percentile_ms(s.latencies_us, 0.5), percentile_ms(s.latencies_us, 0.95),
+               percentile_ms(s.latencies_us, 0.99), s.latencies_us.empty() ? 0.0 : s.latencies_us.back() / 1000.0);
+    }
+    auto &new_order = stats[NEW_ORDER];
+    printf("\ntpmC: %.1f  (all transactions: %.1f per minute, %.0f seconds)\n",
+           (new_order.committed + new_order.rolled_back) * 60.0 / seconds, total * 60.0 / seconds, seconds);
+}
+
+/* 一次运行的参数，和结果一起写进 JSON */
+struct RunConfig {
+    int terminals;
+    int warehouses;
+    uint64_t seed;
+    uint64_t txns;  // 每个终端的事务数，0 表示按时间运行
+};
+
+// 把结果写成一个 JSON 对象，便于不同提交之间比较。stats 中的延迟已经由 report 排好序
+static bool write_json(const std::string &path, const RunConfig &config, const LoadTimes *load_times,
+                       const std::vector<TxnStats> &stats, double seconds) {
+    FILE *out = fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "failed to write %s\n", path.c_str());
+        return false;
+    }
+    uint64_t total = 0;
+    for (auto &s : stats) {
+        total += s.committed + s.rolled_back;
+    }
+    auto &new_order = stats[NEW_ORDER];
+    fprintf(out, "{\n  \"terminals\": %d,\n  \"warehouses\": %d,\n  \"seed\": %lu,\n  \"txns_per_terminal\": %lu,\n",
+            config.terminals, config.warehouses, config.seed, config.txns);
+    if (load_times != nullptr) {
+        fprintf(out, "  \"load\": {\"create_s\": %.3f, \"load_s\": %.3f, \"index_s\": %.3f},\n", load_times->create,
+                load_times->load, load_times->index);
+    }
+    fprintf(out, "  \"seconds\": %.3f,\n  \"tpmC\": %.1f,\n  \"tpm\": %.1f,\n  \"txns\": [\n", seconds,
+            (new_order.committed + new_order.rolled_back) * 60.0 / seconds, total * 60.0 / seconds);
+    for (int type = 0; type < NUM_TXN_TYPES; ++type) {
+        auto &s = stats[type];
+        fprintf(out,
+                "    {\"type\": \"%s\", \"committed\": %lu, \"rolled_back\": %lu, \"aborted\": %lu, "
+                "\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+                TXN_NAMES[type], s.committed, s.rolled_back, s.aborted, percentile_ms(s.latencies_us, 0.5),
+                percentile_ms(s.latencies_us, 0.95), percentile_ms(s.latencies_us, 0.99),
+                s.latencies_us.empty() ? 0.0 : s.latencies_us.back() / 1000.0, type + 1 < NUM_TXN_TYPES ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-h host] [-p port] [-D data_dir] [-g] [-l] [-w warehouses] [-t terminals] [-T seconds] "
+            "[-n txns] [-i items] [-c customers] [-s seed] [-o result.json]\n"
+            "  -g  generate CSV data for -w warehouses into data_dir and exit\n"
+            "  -l  create tables and load data_dir before running\n"
+            "  -T  run for this many seconds (0: load only)\n"
+            "  -n  run exactly this many transactions per terminal instead of -T seconds\n"
+            "  -o  also write load times, throughput and latencies to this JSON file\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    int port = PORT_DEFAULT;
+    std::string dir = "src/test/performance_test/table_data";
+    bool gen = false;
+    bool do_load = false;
+    int warehouses = 0;  // 0：使用数据中的全部仓库
+    int terminals = 4;
+    int seconds = 60;
+    uint64_t seed = 42;
+    uint64_t txns = 0;
+    std::string json_path;
+    Scale gen_scale;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:D:glw:t:T:n:i:c:s:o:")) > 0) {
+        switch (opt) {
+            case 'h':
+                host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'g':
+                gen = true;
+                break;
+            case 'l':
+                do_load = true;
+                break;
+            case 'w':
+                warehouses = atoi(optarg);
+                break;
+            case 't':
+                terminals = atoi(optarg);
+                break;
+            case 'T':
+                seconds = atoi(optarg);
+                break;
+            case 'n':
+                txns = strtoull(optarg, nullptr, 10);
+                break;
+            case 'i':
+                gen_scale.items = atoi(optarg);
+                break;
+            case 'c':
+                gen_scale.customers = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'o':
+                json_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (gen) {
+        gen_scale.warehouses = std::max(warehouses, 1);
+        return Generator(gen_scale, seed).generate(dir) ? 0 : 1;
+    }
+    Scale scale;
+    if (!read_scale(dir, &scale)) {
+        return 1;
+    }
+    if (warehouses == 0) {
+        warehouses = scale.warehouses;
+    } else if (warehouses > scale.warehouses) {
+        fprintf(stderr, "only %d warehouses in %s\n", scale.warehouses, dir.c_str());
+        return 1;
+    }
+    LoadTimes load_times;
+    if (do_load && !load(host, port, dir, &load_times)) {
+        return 1;
+    }
+    if (txns == 0 && seconds <= 0) {
+        return 0;
+    }
+
+    std::vector<std::unique_ptr<Terminal>> terms;
+    for (int i = 0; i < terminals; ++i) {
+        terms.push_back(std::make_unique<Terminal>(i, scale, warehouses, seed));
+        if (!terms.back()->connect(host, port)) {
+            return 1;
+        }
+    }
+    if (txns > 0) {
+        printf("running %d terminals on %d warehouses, %lu transactions each\n", terminals, warehouses, txns);
+    } else {
+        printf("running %d terminals on %d warehouses for %d seconds\n", terminals, warehouses, seconds);
+    }
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &term : terms) {
+        threads.emplace_back([&term, &stop, txns] { term->run(stop, txns); });
+    }
+    if (txns == 0) {
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double elapsed = seconds_since(start);
+
+    std::vector<TxnStats> stats(NUM_TXN_TYPES);
+    for (auto &term : terms) {
+        for (int type = 0; type < NUM_TXN_TYPES; ++type) {
+            stats[type].merge(term->stats(type));
+        }
+    }
+    report(stats, elapsed);
+    if (!json_path.empty() &&
+        !write_json(json_path, {terminals, warehouses, seed, txns}, do_load ? &load_times : nullptr, stats, elapsed)) {
+        return 1;
+    }
+    return 0;
+}
@@ -10,13 +10,34 @@ See the Mulan PSL v2 for more details. */
 
 #include "analyze.h"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <map>
+
 /**
  * @description: 分析器，进行语义分析和查询重写，需要检查不符合语义规定的部分
  * @param {shared_ptr<ast::TreeNode>} parse parser生成的结果集
  * @return {shared_ptr<Query>} Query 
  */
-std::shared_ptr<Query> Analyze::do_analyze(std::shared_ptr<ast::TreeNode> parse)
+std::shared_ptr<Query> Analyze::do_analyze(std::shared_ptr<ast::TreeNode> parse, uint64_t session_id)
+{
+    std::shared_ptr<Query> query = analyze_stmt(std::move(parse));
+    check_visible(*query, session_id);
+    return query;
+}
+
+/**
+ * @description: 分析一条语句，子查询和EXPLAIN中的语句递归分析
+ */
+std::shared_ptr<Query> Analyze::analyze_stmt(std::shared_ptr<ast::TreeNode> parse)
 {
+    // EXPLAIN分析其中的语句，parse换成EXPLAIN交给planner，planner再从中取出语句
+    if (auto x = std::dynamic_pointer_cast<ast::ExplainStmt>(parse)) {
+        std::shared_ptr<Query> query = analyze_stmt(x->stmt);
+        query->parse = std::move(parse);
+        return query;
+    }
     // query语句声明
     std::shared_ptr<Query> query = std::make_shared<Query>();
     // x指向不同类型的parse语法树
@@ -32,43 +53,89 @@ std::shared_ptr<Query> Analyze::do_analyze(std::shared_ptr<ast::TreeNode> parse)
             }
         }
 
-        // 处理target list，再target list中添加上表名，例如 a.id
+        std::vector<ColMeta> all_cols;
+        get_all_cols(query->tables, all_cols);
+        // 处理target list，再target list中添加上表名，例如 a.id；计算列绑定成表达式，列名是表达式的文本
         for (auto &sv_sel_col : x->cols) {
+            query->alias.push_back(sv_sel_col->alias);
+            if (sv_sel_col->agg != ast::SV_AGG_NONE) {
+                // 聚合函数：cols中是参数列，COUNT(*)时为空
+                AggType agg_type = convert_sv_agg_func(sv_sel_col->agg);
+                TabCol arg;
+                if (!sv_sel_col->col_name.empty()) {
+                    arg = check_column(all_cols, {.tab_name = sv_sel_col->tab_name, .col_name = sv_sel_col->col_name});
+                    check_agg_arg(agg_type, arg);
+                }
+                if (query->alias.back().empty()) {
+                    query->alias.back() = agg_col_name(agg_type, arg);
+                }
+                query->cols.push_back(std::move(arg));
+                query->col_exprs.push_back(nullptr);
+                query->agg_types.push_back(agg_type);
+                continue;
+            }
+            query->agg_types.push_back(AGG_COL);
+            if (sv_sel_col->expr != nullptr) {
+                auto expr = bind_expr(sv_sel_col->expr, all_cols);
+                if (expr->type == TYPE_STRING) {
+                    throw IncompatibleTypeError(coltype2str(TYPE_STRING), coltype2str(TYPE_INT));
+                }
+                query->cols.push_back({.tab_name = "", .col_name = expr->to_string()});
+                query->col_exprs.push_back(std::move(expr));
+                continue;
+            }
             TabCol sel_col = {.tab_name = sv_sel_col->tab_name, .col_name = sv_sel_col->col_name};
-            query->cols.push_back(sel_col);
+            // infer table name from column name
+            query->cols.push_back(check_column(all_cols, sel_col));  // 列元数据校验
+            query->col_exprs.push_back(nullptr);
         }
-        
-        std::vector<ColMeta> all_cols;
-        get_all_cols(query->tables, all_cols);
         if (query->cols.empty()) {
             // select all columns
             for (auto &col : all_cols) {
                 TabCol sel_col = {.tab_name = col.tab_name, .col_name = col.name};
                 query->cols.push_back(sel_col);
             }
-        } else {
-            // infer table name from column name
-            for (auto &sel_col : query->cols) {
-                sel_col = check_column(all_cols, sel_col);  // 列元数据校验
-            }
+            query->col_exprs.resize(query->cols.size());
+            query->alias.resize(query->cols.size());
+            query->agg_types.assign(query->cols.size(), AGG_COL);
         }
-        //处理where条件
+        get_group_by(*x, all_cols, *query);
+        //处理where条件，IN / NOT IN 子查询和表达式条件单独取出来
+        get_sub_conds(x->conds, all_cols, query->sub_conds);
+        get_expr_conds(x->conds, all_cols, query->expr_conds);
+        get_or_conds(x->conds, query->tables, query->or_conds);
         get_clause(x->conds, query->conds);
         check_clause(query->tables, query->conds);
+        normalize_clause(query->conds, query->or_conds, &query->always_false);
+    } else if (auto x = std::dynamic_pointer_cast<ast::CreateMatView>(parse)) {
+        std::shared_ptr<Query> select_query = analyze_stmt(x->query);
+        get_mat_view(*x->query, *select_query, *query);
     } else if (auto x = std::dynamic_pointer_cast<ast::UpdateStmt>(parse)) {
         /** TODO: */
+        check_writable(x->tab_name);
+        check_not_partitioned(x->tab_name, "UPDATE");
         // 首先提取set语句
         for (auto &set: x->set_clauses) {
             query->set_clauses.emplace_back(SetClause{
                 TabCol{"", set->col_name},   // 列名
-                convert_sv_value(set->val)   // 值
+                convert_sv_value(set->val),  // 值
+                !set->incr_col.empty(),
+                set->is_sub
             });
+            // 只支持在字段自身上加减常量
+            if (!set->incr_col.empty() && set->incr_col != set->col_name) {
+                throw RMDBError("SET " + set->col_name + " can only add to or subtract from itself");
+            }
         }
 
         // 提取完set后检查左右值类型
         auto &table_meta = sm_manager_->db_.get_table(x->tab_name);
         for (auto &set: query->set_clauses) {
             auto col_meta = table_meta.get_col(set.lhs.col_name);
+            set.lhs.col_id = col_meta->col_id;
+            if (set.is_incr && col_meta->type == TYPE_STRING) {
+                throw IncompatibleTypeError(coltype2str(col_meta->type), coltype2str(set.rhs.type));
+            }
             if (col_meta->type != set.rhs.type) {
                 if (col_meta->type == TYPE_FLOAT && set.rhs.type == TYPE_INT) {
                     set.rhs.set_float(static_cast<float>(set.rhs.int_val));
@@ -81,16 +148,31 @@ std::shared_ptr<Query> Analyze::do_analyze(std::shared_ptr<ast::TreeNode> parse)
         }
 
         // 处理where条件
+        get_expr_conds(x->conds, table_meta.cols, query->expr_conds);
+        get_or_conds(x->conds, {x->tab_name}, query->or_conds);
         get_clause(x->conds, query->conds);
         check_clause({x->tab_name}, query->conds);
+        normalize_clause(query->conds, query->or_conds, &query->always_false);
     } else if (auto x = std::dynamic_pointer_cast<ast::DeleteStmt>(parse)) {
+        check_writable(x->tab_name);
+        check_not_partitioned(x->tab_name, "DELETE");
         //处理where条件
+        get_expr_conds(x->conds, sm_manager_->db_.get_table(x->tab_name).cols, query->expr_conds);
+        get_or_conds(x->conds, {x->tab_name}, query->or_conds);
         get_clause(x->conds, query->conds);
-        check_clause({x->tab_name}, query->conds);        
+        check_clause({x->tab_name}, query->conds);
+        normalize_clause(query->conds, query->or_conds, &query->always_false);
     } else if (auto x = std::dynamic_pointer_cast<ast::InsertStmt>(parse)) {
-        // 处理insert 的values值
-        for (auto &sv_val : x->vals) {
-            query->values.push_back(convert_sv_value(sv_val));
+        check_writable(x->tab_name);
+        // 处理insert 的values值，多行的值按行依次展开
+        size_t num_cols = sm_manager_->db_.get_table(x->tab_name).cols.size();
+        for (auto &row : x->vals) {
+            if (row.size() != num_cols) {
+                throw InvalidValueCountError();
+            }
+            for (auto &sv_val : row) {
+                query->values.push_back(convert_sv_value(sv_val));
+            }
         }
     } else {
         // do nothing
@@ -100,6 +182,134 @@ std::shared_ptr<Query> Analyze::do_analyze(std::shared_ptr<ast::TreeNode> parse)
 }
 
 
+/**
+ * @description: 检查CREATE MATERIALIZED VIEW的查询能否增量维护，生成视图的定义和视图表的字段。
+ * 只支持单表上没有WHERE的GROUP BY查询：每个分组字段都要选取，至少有一个COUNT，分组的COUNT减到0时删除视图中的分组；
+ * 聚合字段用AS命名。MIN/MAX删除了极值时从基表重新计算
+ * @param {SelectStmt&} select 视图的查询
+ * @param {Query&} select_query 分析过的视图查询
+ * @param {Query&} query CREATE MATERIALIZED VIEW语句，填入基表、视图的定义和视图表的字段
+ */
+void Analyze::get_mat_view(ast::SelectStmt &select, const Query &select_query, Query &query) {
+    if (select_query.tables.size() != 1 || !select.conds.empty() || !select.havings.empty() || select.has_sort ||
+        select.limit >= 0 || select.offset > 0 || select.distinct) {
+        throw RMDBError("A materialized view must group a single table without WHERE, HAVING, ORDER BY, LIMIT or "
+                        "DISTINCT");
+    }
+    if (select_query.group_bys.empty()) {
+        throw RMDBError("A materialized view needs a GROUP BY clause");
+    }
+    query.tables = select_query.tables;
+    query.mat_view.base_tab = select_query.tables.front();
+    auto &base = sm_manager_->db_.get_table(query.mat_view.base_tab);
+    bool has_count = false;
+    for (size_t i = 0; i < select_query.cols.size(); ++i) {
+        AggType agg_type = select_query.agg_types[i];
+        auto &src = select_query.cols[i];
+        if (select_query.col_exprs[i] != nullptr) {
+            throw RMDBError("A materialized view cannot select the expression " + src.col_name);
+        }
+        // SELECT *时select.cols为空
+        std::string name = i < select.cols.size() ? select.cols[i]->alias : "";
+        if (name.empty()) {
+            if (agg_type != AGG_COL) {
+                throw RMDBError(select_query.alias[i] + " in a materialized view needs a name given with AS");
+            }
+            name = src.col_name;
+        }
+        for (auto &col_def : query.mat_view_cols) {
+            if (col_def.name == name) {
+                throw RMDBError("Duplicate column " + name + " in materialized view");
+            }
+        }
+        ColDef col_def = {.name = name, .type = TYPE_INT, .len = sizeof(int)};
+        if (agg_type != AGG_COUNT) {
+            auto col = base.get_col(src);
+            col_def.type = col->type;
+            col_def.len = col->len;
+        }
+        has_count = has_count || agg_type == AGG_COUNT;
+        query.mat_view.cols.push_back({agg_type, src.col_name});
+        query.mat_view_cols.push_back(std::move(col_def));
+    }
+    // 选取的普通字段都是分组字段，反过来每个分组字段也要选取，视图的一行对应一个分组
+    for (auto &group_by : select_query.group_bys) {
+        bool selected = false;
+        for (auto &col : query.mat_view.cols) {
+            selected = selected || (col.agg_type == AGG_COL && col.src_col == group_by.col_name);
+        }
+        if (!selected) {
+            throw RMDBError("GROUP BY column " + group_by.col_name + " must be selected by the materialized view");
+        }
+    }
+    if (!has_count) {
+        throw RMDBError("A materialized view must select COUNT(*), it tells when a group becomes empty");
+    }
+}
+
+/**
+ * @description: 物化视图只由基表的写操作维护，不能直接修改
+ */
+void Analyze::check_writable(const std::string &tab_name) {
+    if (sm_manager_->db_.get_table(tab_name).mat_view.is_view()) {
+        throw RMDBError("Cannot modify materialized view " + tab_name);
+    }
+}
+
+/**
+ * @description: 分区表只支持插入和查询：UPDATE和DELETE按扫描出的rid修改记录，还不知道rid属于哪个分区
+ */
+void Analyze::check_not_partitioned(const std::string &tab_name, const std::string &stmt) {
+    if (sm_manager_->db_.get_table(tab_name).partition.is_partitioned()) {
+        throw RMDBError(stmt + " on partitioned table " + tab_name + " is not supported");
+    }
+}
+
+/**
+ * @description: 其他会话的临时表当作不存在。语句用到临时表时记在query中，这样的计划不放进计划缓存，
+ * 否则其他会话的同一条语句会取到它
+ */
+void Analyze::check_visible(Query &query, uint64_t session_id) {
+    std::vector<std::string> tab_names = query.tables;
+    ast::TreeNode *parse = query.parse.get();
+    if (auto x = dynamic_cast<ast::ExplainStmt *>(parse)) {
+        parse = x->stmt.get();
+    }
+    auto add_tab = [&](auto *stmt) {
+        if (stmt != nullptr) {
+            tab_names.push_back(stmt->tab_name);
+        }
+    };
+    add_tab(dynamic_cast<ast::InsertStmt *>(parse));
+    add_tab(dynamic_cast<ast::DeleteStmt *>(parse));
+    add_tab(dynamic_cast<ast::UpdateStmt *>(parse));
+    add_tab(dynamic_cast<ast::DropTable *>(parse));
+    add_tab(dynamic_cast<ast::DescTable *>(parse));
+    add_tab(dynamic_cast<ast::VacuumTable *>(parse));
+    add_tab(dynamic_cast<ast::TruncateTable *>(parse));
+    add_tab(dynamic_cast<ast::AnalyzeTable *>(parse));
+    add_tab(dynamic_cast<ast::CopyTo *>(parse));
+    add_tab(dynamic_cast<ast::CreateIndex *>(parse));
+    add_tab(dynamic_cast<ast::DropIndex *>(parse));
+    add_tab(dynamic_cast<ast::ShowIndexes *>(parse));
+    for (auto &tab_name : tab_names) {
+        if (!sm_manager_->db_.is_table(tab_name)) {
+            continue;
+        }
+        auto &tab = sm_manager_->db_.get_table(tab_name);
+        if (!tab.is_visible_to(session_id)) {
+            throw TableNotFoundError(tab_name);
+        }
+        if (tab.persistence == TAB_TEMPORARY) {
+            query.uses_temp_table = true;
+        }
+    }
+    for (auto &sub_cond : query.sub_conds) {
+        check_visible(*sub_cond.query, session_id);
+        query.uses_temp_table = query.uses_temp_table || sub_cond.query->uses_temp_table;
+    }
+}
+
 TabCol Analyze::check_column(const std::vector<ColMeta> &all_cols, TabCol target) {
     if (target.tab_name.empty()) {
         // Table name not specified, infer table name from column name
@@ -110,6 +320,7 @@ TabCol Analyze::check_column(const std::vector<ColMeta> &all_cols, TabCol target
                     throw AmbiguousColumnError(target.col_name);
                 }
                 tab_name = col.tab_name;
+                target.col_id = col.col_id;
             }
         }
         if (tab_name.empty()) {
@@ -122,6 +333,7 @@ TabCol Analyze::check_column(const std::vector<ColMeta> &all_cols, TabCol target
         for (auto &col : all_cols) {
             if (col.tab_name == target.tab_name && col.name == target.col_name) {
                 flag = false;
+                target.col_id = col.col_id;
                 break;
             }
         }
@@ -140,9 +352,80 @@ void Analyze::get_all_cols(const std::vector<std::string> &tab_names, std::vecto
     }
 }
 
+// 只能对int和float字段求和，COUNT、MIN和MAX可以用在任何字段上
+void Analyze::check_agg_arg(AggType agg_type, const TabCol &arg) {
+    auto col = sm_manager_->db_.get_table(arg.tab_name).get_col(arg.col_name);
+    if (agg_type == AGG_SUM && col->type == TYPE_STRING) {
+        throw IncompatibleTypeError(coltype2str(col->type), coltype2str(TYPE_INT));
+    }
+}
+
+/**
+ * @description: 分析GROUP BY和HAVING，检查选取列表。有聚合函数、GROUP BY或HAVING时，选取的普通列必须是分组列，
+ * ORDER BY也只能按分组列排序；HAVING的常量转换成聚合结果的类型。不是聚合查询时清空agg_types
+ */
+void Analyze::get_group_by(ast::SelectStmt &select, const std::vector<ColMeta> &all_cols, Query &query) {
+    for (auto &sv_col : select.group_bys) {
+        query.group_bys.push_back(check_column(all_cols, {.tab_name = sv_col->tab_name, .col_name = sv_col->col_name}));
+    }
+    for (auto &expr : select.havings) {
+        Condition cond;
+        cond.agg_type = convert_sv_agg_func(expr->lhs->agg);
+        cond.op = convert_sv_comp_op(expr->op);
+        cond.is_rhs_val = true;
+        cond.rhs_val = convert_sv_value(std::static_pointer_cast<ast::Value>(expr->rhs));
+        ColType type = TYPE_INT;
+        int len = sizeof(int);
+        if (!expr->lhs->col_name.empty()) {
+            cond.lhs_col = check_column(all_cols, {.tab_name = expr->lhs->tab_name, .col_name = expr->lhs->col_name});
+            check_agg_arg(cond.agg_type, cond.lhs_col);
+            if (cond.agg_type != AGG_COUNT) {
+                auto col = sm_manager_->db_.get_table(cond.lhs_col.tab_name).get_col(cond.lhs_col.col_name);
+                type = col->type;
+                len = col->len;
+            }
+        }
+        if (type == TYPE_FLOAT && cond.rhs_val.type == TYPE_INT) {
+            cond.rhs_val.set_float(static_cast<float>(cond.rhs_val.int_val));
+        } else if (type != cond.rhs_val.type) {
+            throw IncompatibleTypeError(coltype2str(type), coltype2str(cond.rhs_val.type));
+        }
+        cond.rhs_val.init_raw(len);
+        query.havings.push_back(std::move(cond));
+    }
+    bool has_agg = std::any_of(query.agg_types.begin(), query.agg_types.end(),
+                               [](AggType agg_type) { return agg_type != AGG_COL; });
+    if (!has_agg && query.group_bys.empty() && query.havings.empty()) {
+        query.agg_types.clear();
+        return;
+    }
+    auto is_group_col = [&](const TabCol &col) {
+        return std::any_of(query.group_bys.begin(), query.group_bys.end(), [&](const TabCol &group_by) {
+            return group_by.tab_name == col.tab_name && group_by.col_name == col.col_name;
+        });
+    };
+    for (size_t i = 0; i < query.cols.size(); ++i) {
+        if (query.agg_types[i] != AGG_COL) {
+            continue;
+        }
+        if (query.col_exprs[i] != nullptr || !is_group_col(query.cols[i])) {
+            throw RMDBError(query.cols[i].col_name + " must appear in the GROUP BY clause or be used in an aggregate function");
+        }
+    }
+    if (select.has_sort) {
+        auto &order = select.order->cols;
+        if (!is_group_col(check_column(all_cols, {.tab_name = order->tab_name, .col_name = order->col_name}))) {
+            throw RMDBError("ORDER BY " + order->col_name + " must be a GROUP BY column");
+        }
+    }
+}
+
 void Analyze::get_clause(const std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds, std::vector<Condition> &conds) {
     conds.clear();
     for (auto &expr : sv_conds) {
+        if (std::dynamic_pointer_cast<ast::SubqueryExpr>(expr->rhs)) {
+            throw InternalError("IN subquery is only supported in SELECT");
+        }
         Condition cond;
         cond.lhs_col = {.tab_name = expr->lhs->tab_name, .col_name = expr->lhs->col_name};
         cond.op = convert_sv_comp_op(expr->op);
@@ -153,8 +436,210 @@ void Analyze::get_clause(const std::vector<std::shared_ptr<ast::BinaryExpr>> &sv
             cond.is_rhs_val = false;
             cond.rhs_col = {.tab_name = rhs_col->tab_name, .col_name = rhs_col->col_name};
         }
-        conds.push_back(cond);
+        conds.push_back(std::move(cond));
+    }
+}
+
+/**
+ * @description: 从where条件中取出至少一边是计算表达式的条件，例如 a + b > c、price * qty <= 100，两边绑定成表达式。
+ * 只能比较int/float；一个条件只能涉及一张表，在扫描这张表时计算，不涉及表的条件（1 = 2）放在第一张表上
+ */
+void Analyze::get_expr_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds,
+                             const std::vector<ColMeta> &all_cols, std::vector<ExprCond> &expr_conds) {
+    std::vector<std::shared_ptr<ast::BinaryExpr>> rest;
+    for (auto &expr : sv_conds) {
+        if (expr->lhs_expr == nullptr) {
+            rest.push_back(expr);
+            continue;
+        }
+        ExprCond cond{bind_expr(expr->lhs_expr, all_cols), convert_sv_comp_op(expr->op), bind_expr(expr->rhs, all_cols)};
+        if (cond.lhs->type == TYPE_STRING || cond.rhs->type == TYPE_STRING) {
+            throw IncompatibleTypeError(coltype2str(cond.lhs->type), coltype2str(cond.rhs->type));
+        }
+        std::vector<TabCol> cols;
+        cond.lhs->collect_cols(cols);
+        cond.rhs->collect_cols(cols);
+        for (auto &col : cols) {
+            if (col.tab_name != cols[0].tab_name) {
+                throw InternalError("expression condition can only reference one table");
+            }
+        }
+        expr_conds.push_back(std::move(cond));
+    }
+    sv_conds = std::move(rest);
+}
+
+/**
+ * @description: 从where条件中取出用OR连接的条件组。组中的条件只能是字段和常量的比较，并且都在同一张表上，
+ * 扫描这张表时计算；常量在normalize_clause中和其他条件一样转换成字段的类型
+ */
+void Analyze::get_or_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds,
+                           const std::vector<std::string> &tab_names, std::vector<OrCond> &or_conds) {
+    std::vector<std::shared_ptr<ast::BinaryExpr>> rest;
+    for (auto &expr : sv_conds) {
+        if (expr->op != ast::SV_OP_OR) {
+            rest.push_back(expr);
+            continue;
+        }
+        for (auto &disjunct : expr->disjuncts) {
+            if (disjunct->lhs == nullptr || std::dynamic_pointer_cast<ast::Value>(disjunct->rhs) == nullptr) {
+                throw InternalError("OR only supports comparisons between a column and a constant");
+            }
+        }
+        OrCond or_cond;
+        get_clause(expr->disjuncts, or_cond.conds);
+        check_clause(tab_names, or_cond.conds);
+        for (auto &cond : or_cond.conds) {
+            if (cond.lhs_col.tab_name != or_cond.conds[0].lhs_col.tab_name) {
+                throw InternalError("OR conditions can only reference one table");
+            }
+        }
+        or_conds.push_back(std::move(or_cond));
     }
+    sv_conds = std::move(rest);
+}
+
+/**
+ * @description: 绑定计算表达式：补全列的表名，确定每个结点的类型。字符串不能参与四则运算
+ */
+std::shared_ptr<const Expression> Analyze::bind_expr(const std::shared_ptr<ast::Expr> &sv_expr,
+                                                     const std::vector<ColMeta> &all_cols) {
+    if (auto col = std::dynamic_pointer_cast<ast::Col>(sv_expr)) {
+        TabCol tab_col = check_column(all_cols, {.tab_name = col->tab_name, .col_name = col->col_name});
+        ColType type = sm_manager_->db_.get_table(tab_col.tab_name).get_col(tab_col.col_name)->type;
+        return Expression::make_col(std::move(tab_col), type);
+    }
+    if (auto val = std::dynamic_pointer_cast<ast::Value>(sv_expr)) {
+        return Expression::make_const(convert_sv_value(val));
+    }
+    auto arith = std::dynamic_pointer_cast<ast::ArithExpr>(sv_expr);
+    if (arith == nullptr) {
+        throw InternalError("Unexpected sv expression type");
+    }
+    auto lhs = bind_expr(arith->lhs, all_cols);
+    auto rhs = bind_expr(arith->rhs, all_cols);
+    if (lhs->type == TYPE_STRING || rhs->type == TYPE_STRING) {
+        throw IncompatibleTypeError(coltype2str(lhs->type), coltype2str(rhs->type));
+    }
+    static const ArithOp ops[] = {ARITH_ADD, ARITH_SUB, ARITH_MUL, ARITH_DIV};
+    return Expression::make_arith(ops[arith->op], std::move(lhs), std::move(rhs));
+}
+
+/**
+ * @description: 从where条件中取出 col [NOT] IN (SELECT ...) 和 [NOT] EXISTS (SELECT ...)，递归分析子查询。
+ * IN的子查询只能选取一列，类型要和外层的列可以比较。关联条件变成半连接的等值条件，
+ * 子查询改为输出这些条件中子查询一侧的列
+ */
+void Analyze::get_sub_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds,
+                            const std::vector<ColMeta> &all_cols, std::vector<SubqueryCond> &sub_conds) {
+    std::vector<std::shared_ptr<ast::BinaryExpr>> rest;
+    for (auto &expr : sv_conds) {
+        auto sub = std::dynamic_pointer_cast<ast::SubqueryExpr>(expr->rhs);
+        if (sub == nullptr) {
+            rest.push_back(expr);
+            continue;
+        }
+        SubqueryCond sub_cond;
+        bool exists = expr->op == ast::SV_OP_EXISTS || expr->op == ast::SV_OP_NOT_EXISTS;
+        sub_cond.anti = expr->op == ast::SV_OP_NOT_IN || expr->op == ast::SV_OP_NOT_EXISTS;
+        std::vector<Condition> corr_conds;
+        get_corr_conds(*sub->select, all_cols, corr_conds);
+        // LIMIT/OFFSET是对每条外层记录分别计算的，子查询只执行一次时算不出来
+        if (!corr_conds.empty() && (sub->select->limit >= 0 || sub->select->offset > 0)) {
+            throw InternalError("LIMIT is not supported in correlated subquery");
+        }
+        sub_cond.query = analyze_stmt(sub->select);
+        auto &sub_cols = sub_cond.query->cols;
+        if (!exists) {
+            if (!sub_cond.query->agg_types.empty()) {
+                throw InternalError("aggregate functions are not supported in subquery");
+            }
+            if (sub_cols.size() != 1) {
+                throw InternalError("IN subquery must select exactly one column");
+            }
+            if (sub_cond.query->col_exprs[0] != nullptr) {
+                throw InternalError("IN subquery must select a column of a table");
+            }
+            Condition cond;
+            cond.lhs_col = check_column(all_cols, {.tab_name = expr->lhs->tab_name, .col_name = expr->lhs->col_name});
+            cond.op = OP_EQ;
+            cond.is_rhs_val = false;
+            cond.rhs_col = sub_cols[0];
+            ColType lhs_type = sm_manager_->db_.get_table(cond.lhs_col.tab_name).get_col(cond.lhs_col.col_name)->type;
+            ColType rhs_type = sm_manager_->db_.get_table(cond.rhs_col.tab_name).get_col(cond.rhs_col.col_name)->type;
+            if (lhs_type != rhs_type && (lhs_type == TYPE_STRING || rhs_type == TYPE_STRING)) {
+                throw IncompatibleTypeError(coltype2str(lhs_type), coltype2str(rhs_type));
+            }
+            sub_cond.conds.push_back(std::move(cond));
+        } else if (!corr_conds.empty()) {
+            // EXISTS不关心子查询选取的列，只输出关联条件用到的列；不关联时保留原来的列
+            sub_cols.clear();
+            sub_cond.query->col_exprs.clear();
+        }
+        for (auto &cond : corr_conds) {
+            bool found = false;
+            for (auto &col : sub_cols) {
+                found = found || (col.tab_name == cond.rhs_col.tab_name && col.col_name == cond.rhs_col.col_name);
+            }
+            if (!found) {
+                sub_cols.push_back(cond.rhs_col);
+                sub_cond.query->col_exprs.push_back(nullptr);
+            }
+            sub_cond.conds.push_back(std::move(cond));
+        }
+        sub_conds.push_back(std::move(sub_cond));
+    }
+    sv_conds = std::move(rest);
+}
+
+/**
+ * @description: 从子查询的where中取出引用外层列的条件（关联条件）。不带表名的列先在子查询的表中找，
+ * 找不到再到外层找。关联条件只能是外层的列和子查询的列的等值比较，取出后子查询不再依赖外层
+ */
+void Analyze::get_corr_conds(ast::SelectStmt &select, const std::vector<ColMeta> &outer_cols,
+                             std::vector<Condition> &corr_conds) {
+    for (auto &table : select.tabs) {
+        if (!sm_manager_->db_.is_table(table)) {
+            throw TableNotFoundError(table);
+        }
+    }
+    std::vector<ColMeta> inner_cols;
+    get_all_cols(select.tabs, inner_cols);
+    auto is_inner = [&](const ast::Col &col) {
+        for (auto &inner_col : inner_cols) {
+            if (inner_col.name == col.col_name && (col.tab_name.empty() || inner_col.tab_name == col.tab_name)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::vector<std::shared_ptr<ast::BinaryExpr>> rest;
+    for (auto &expr : select.conds) {
+        auto rhs_col = std::dynamic_pointer_cast<ast::Col>(expr->rhs);
+        bool lhs_outer = expr->lhs != nullptr && !is_inner(*expr->lhs);
+        bool rhs_outer = rhs_col != nullptr && !is_inner(*rhs_col);
+        if (!lhs_outer && !rhs_outer) {
+            rest.push_back(expr);
+            continue;
+        }
+        if (rhs_col == nullptr || lhs_outer == rhs_outer || expr->op != ast::SV_OP_EQ) {
+            throw InternalError("correlated subquery only supports equality between an outer and an inner column");
+        }
+        auto &outer = lhs_outer ? expr->lhs : rhs_col;
+        auto &inner = lhs_outer ? rhs_col : expr->lhs;
+        Condition cond;
+        cond.lhs_col = check_column(outer_cols, {.tab_name = outer->tab_name, .col_name = outer->col_name});
+        cond.op = OP_EQ;
+        cond.is_rhs_val = false;
+        cond.rhs_col = check_column(inner_cols, {.tab_name = inner->tab_name, .col_name = inner->col_name});
+        ColType lhs_type = sm_manager_->db_.get_table(cond.lhs_col.tab_name).get_col(cond.lhs_col.col_name)->type;
+        ColType rhs_type = sm_manager_->db_.get_table(cond.rhs_col.tab_name).get_col(cond.rhs_col.col_name)->type;
+        if (lhs_type != rhs_type && (lhs_type == TYPE_STRING || rhs_type == TYPE_STRING)) {
+            throw IncompatibleTypeError(coltype2str(lhs_type), coltype2str(rhs_type));
+        }
+        corr_conds.push_back(std::move(cond));
+    }
+    select.conds = std::move(rest);
 }
 
 void Analyze::check_clause(const std::vector<std::string> &tab_names, std::vector<Condition> &conds) {
@@ -189,6 +674,245 @@ void Analyze::check_clause(const std::vector<std::string> &tab_names, std::vecto
     }
 }
 
+namespace {
+
+enum FoldResult { COND_KEEP, COND_TRUE, COND_FALSE };
+
+/**
+ * @description: 把条件的右值常量转换成左值字段的类型。float字段和int常量比较时常量换成float；
+ * int字段和小数比较时换成等价的整数比较（a < 3.5 即 a < 4，a = 3.5 恒为假），超出int范围时恒为真或恒为假
+ */
+FoldResult fold_cond(Condition &cond, const ColMeta &col) {
+    Value &val = cond.rhs_val;
+    if (col.type == TYPE_FLOAT && val.type == TYPE_INT) {
+        // 计划缓存代入参数时也把int转换成float，参数编号保留
+        val.set_float(static_cast<float>(val.int_val));
+    } else if (col.type == TYPE_INT && val.type == TYPE_FLOAT) {
+        double v = val.float_val;
+        double bound;
+        switch (cond.op) {
+            case OP_EQ:
+            case OP_NE:
+                if (std::floor(v) != v || v < INT_MIN || v > INT_MAX) {
+                    return cond.op == OP_EQ ? COND_FALSE : COND_TRUE;
+                }
+                bound = v;
+                break;
+            case OP_LT:
+            case OP_GE:
+                bound = std::ceil(v);
+                break;
+            default:
+                bound = std::floor(v);
+                break;
+        }
+        bool less = cond.op == OP_LT || cond.op == OP_LE;
+        if (bound > INT_MAX) {
+            return less ? COND_TRUE : COND_FALSE;
+        }
+        if (bound < INT_MIN) {
+            return less ? COND_FALSE : COND_TRUE;
+        }
+        val.set_int(static_cast<int>(bound));
+        // 换过的常量不再是原来的字面量，这样的计划不缓存
+        val.param = -1;
+    } else {
+        return COND_KEEP;
+    }
+    val.raw.reset();
+    val.init_raw(col.len);
+    return COND_KEEP;
+}
+
+// 两个同类型的常量比较，字符串和执行时一样按字段长度比较raw
+int compare_value(const Value &a, const Value &b) {
+    switch (a.type) {
+        case TYPE_INT:
+            return a.int_val < b.int_val ? -1 : (a.int_val > b.int_val ? 1 : 0);
+        case TYPE_FLOAT:
+            return a.float_val < b.float_val ? -1 : (a.float_val > b.float_val ? 1 : 0);
+        default:
+            return memcmp(a.raw.data(), b.raw.data(), a.raw.size());
+    }
+}
+
+// 字段的值为v时是否满足cond
+bool satisfies(const Value &v, const Condition &cond) {
+    int c = compare_value(v, cond.rhs_val);
+    switch (cond.op) {
+        case OP_EQ:
+            return c == 0;
+        case OP_NE:
+            return c != 0;
+        case OP_LT:
+            return c < 0;
+        case OP_GT:
+            return c > 0;
+        case OP_LE:
+            return c <= 0;
+        default:
+            return c >= 0;
+    }
+}
+
+// 一列上和常量比较的条件，上下界只记最紧的一个
+struct ColRange {
+    const Condition *eq = nullptr;
+    const Condition *lower = nullptr;  // OP_GT或OP_GE
+    const Condition *upper = nullptr;  // OP_LT或OP_LE
+    std::vector<const Condition *> nes;
+    Condition point;  // 上下界重合时换成的等值条件
+};
+
+}  // namespace
+
+/**
+ * @description: 规范化where条件。先把和常量比较的条件中的常量转换成字段的类型，执行时不再逐条转换；
+ * 再把同一列上的条件合并成一个区间：等值条件只留一个，上下界各留最紧的一个，上下界重合时换成等值条件，
+ * 区间之外的不等条件去掉。恒为真的条件去掉；发现恒为假时设置always_false，执行时不读表。
+ * 区间越紧，索引扫描的边界也越紧。去掉了字面量的计划在计划缓存中代入不了全部参数，不会被缓存
+ */
+void Analyze::normalize_clause(std::vector<Condition> &conds, std::vector<OrCond> &or_conds, bool *always_false) {
+    // OR组中恒为假的条件去掉，有恒为真的条件时整组去掉；只剩一个条件的组就是普通的条件，并入conds一起合并
+    std::vector<OrCond> kept;
+    for (auto &or_cond : or_conds) {
+        OrCond alive;
+        bool always_true = false;
+        for (auto &cond : or_cond.conds) {
+            auto col = sm_manager_->db_.get_table(cond.lhs_col.tab_name).get_col(cond.lhs_col.col_name);
+            FoldResult fold = fold_cond(cond, *col);
+            if (fold == COND_TRUE) {
+                always_true = true;
+                break;
+            }
+            if (fold == COND_KEEP) {
+                alive.conds.push_back(std::move(cond));
+            }
+        }
+        if (always_true) {
+            continue;
+        }
+        if (alive.conds.empty()) {
+            *always_false = true;
+            return;
+        }
+        if (alive.conds.size() == 1) {
+            conds.push_back(std::move(alive.conds[0]));
+        } else {
+            kept.push_back(std::move(alive));
+        }
+    }
+    or_conds = std::move(kept);
+
+    std::map<TabCol, ColRange> ranges;
+    std::vector<TabCol> order;  // 列第一次出现的顺序
+    std::vector<Condition> col_conds;  // 列和列比较的条件
+    for (auto &cond : conds) {
+        if (!cond.is_rhs_val) {
+            col_conds.push_back(cond);
+            continue;
+        }
+        auto col = sm_manager_->db_.get_table(cond.lhs_col.tab_name).get_col(cond.lhs_col.col_name);
+        FoldResult fold = fold_cond(cond, *col);
+        if (fold == COND_TRUE) {
+            continue;
+        }
+        if (fold == COND_FALSE) {
+            *always_false = true;
+            return;
+        }
+        auto it = ranges.find(cond.lhs_col);
+        if (it == ranges.end()) {
+            it = ranges.emplace(cond.lhs_col, ColRange()).first;
+            order.push_back(cond.lhs_col);
+        }
+        ColRange &range = it->second;
+        switch (cond.op) {
+            case OP_EQ:
+                if (range.eq != nullptr && compare_value(range.eq->rhs_val, cond.rhs_val) != 0) {
+                    *always_false = true;
+                    return;
+                }
+                range.eq = &cond;
+                break;
+            case OP_NE:
+                range.nes.push_back(&cond);
+                break;
+            case OP_GT:
+            case OP_GE:
+                // 同一个值上 > 比 >= 紧
+                if (range.lower == nullptr || (satisfies(cond.rhs_val, *range.lower) &&
+                                                   (compare_value(cond.rhs_val, range.lower->rhs_val) != 0 ||
+                                                    cond.op == OP_GT))) {
+                    range.lower = &cond;
+                }
+                break;
+            default:
+                if (range.upper == nullptr || (satisfies(cond.rhs_val, *range.upper) &&
+                                                   (compare_value(cond.rhs_val, range.upper->rhs_val) != 0 ||
+                                                    cond.op == OP_LT))) {
+                    range.upper = &cond;
+                }
+                break;
+        }
+    }
+
+    std::vector<Condition> merged;
+    for (auto &tab_col : order) {
+        ColRange &range = ranges[tab_col];
+        if (range.eq == nullptr && range.lower != nullptr && range.upper != nullptr) {
+            if (!satisfies(range.lower->rhs_val, *range.upper) || !satisfies(range.upper->rhs_val, *range.lower)) {
+                *always_false = true;
+                return;
+            }
+            if (compare_value(range.lower->rhs_val, range.upper->rhs_val) == 0) {
+                // a >= v AND a <= v 即 a = v
+                range.point = *range.lower;
+                range.point.op = OP_EQ;
+                range.eq = &range.point;
+            }
+        }
+        if (range.eq != nullptr) {
+            // 等值条件要满足这一列上的其他条件，满足时其他条件都是多余的
+            if ((range.lower != nullptr && !satisfies(range.eq->rhs_val, *range.lower)) ||
+                (range.upper != nullptr && !satisfies(range.eq->rhs_val, *range.upper))) {
+                *always_false = true;
+                return;
+            }
+            for (auto ne : range.nes) {
+                if (!satisfies(range.eq->rhs_val, *ne)) {
+                    *always_false = true;
+                    return;
+                }
+            }
+            merged.push_back(std::move(*range.eq));
+            continue;
+        }
+        if (range.lower != nullptr) {
+            merged.push_back(std::move(*range.lower));
+        }
+        if (range.upper != nullptr) {
+            merged.push_back(std::move(*range.upper));
+        }
+        size_t first_ne = merged.size();
+        for (auto ne : range.nes) {
+            // 区间之外的值本来就不满足，重复的不等条件只留一个
+            if ((range.lower != nullptr && !satisfies(ne->rhs_val, *range.lower)) ||
+                (range.upper != nullptr && !satisfies(ne->rhs_val, *range.upper))) {
+                continue;
+            }
+            bool dup = false;
+            for (size_t i = first_ne; i < merged.size() && !dup; ++i) {
+                dup = compare_value(merged[i].rhs_val, ne->rhs_val) == 0;
+            }
+            if (!dup) {
+                merged.push_back(std::move(*ne));
+            }
+        }
+    }
+    merged.insert(merged.end(), std::make_move_iterator(col_conds.begin()), std::make_move_iterator(col_conds.end()));
+    conds = std::move(merged);
+}
 
 Value Analyze::convert_sv_value(const std::shared_ptr<ast::Value> &sv_val) {
     Value val;
@@ -201,9 +925,18 @@ Value Analyze::convert_sv_value(const std::shared_ptr<ast::Value> &sv_val) {
     } else {
         throw InternalError("Unexpected sv value type");
     }
+    val.param = sv_val->param;
     return val;
 }
 
+AggType Analyze::convert_sv_agg_func(ast::SvAggFunc agg) {
+    std::map<ast::SvAggFunc, AggType> m = {
+        {ast::SV_AGG_NONE, AGG_COL}, {ast::SV_AGG_COUNT, AGG_COUNT}, {ast::SV_AGG_SUM, AGG_SUM},
+        {ast::SV_AGG_MIN, AGG_MIN}, {ast::SV_AGG_MAX, AGG_MAX},
+    };
+    return m.at(agg);
+}
+
 CompOp Analyze::convert_sv_comp_op(ast::SvCompOp op) {
     std::map<ast::SvCompOp, CompOp> m = {
         {ast::SV_OP_EQ, OP_EQ}, {ast::SV_OP_NE, OP_NE}, {ast::SV_OP_LT, OP_LT},
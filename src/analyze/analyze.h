@@ -19,6 +19,18 @@ See the Mulan PSL v2 for more details. */
 #include "parser/parser.h"
 #include "system/sm.h"
 #include "common/common.h"
+#include "common/expression.h"
+
+class Query;
+
+// col [NOT] IN (SELECT ...) / [NOT] EXISTS (SELECT ...)，规划时改写成外层计划和子查询计划的半连接/反连接。
+// 关联条件从子查询中取出来，子查询不再依赖外层，只执行一次
+struct SubqueryCond {
+    std::shared_ptr<Query> query;  // 子查询，输出连接条件中用到的列
+    bool anti;                     // NOT IN / NOT EXISTS
+    // 半连接的等值条件，左边是外层的列，右边是子查询的列：IN的列和子查询选取的列，以及各个关联条件
+    std::vector<Condition> conds;
+};
 
 class Query{
     public:
@@ -26,14 +38,37 @@ class Query{
     // TODO jointree
     // where条件
     std::vector<Condition> conds;
-    // 投影列
+    // 至少一边是计算表达式的where条件，只涉及一张表
+    std::vector<ExprCond> expr_conds;
+    // OR连接的where条件组，每组只涉及一张表，组中至少有一个条件成立
+    std::vector<OrCond> or_conds;
+    // where条件恒为假，扫描时不读表
+    bool always_false = false;
+    // IN / NOT IN 子查询条件
+    std::vector<SubqueryCond> sub_conds;
+    // 投影列，聚合函数是它的参数列，COUNT(*)时为空
     std::vector<TabCol> cols;
+    // 聚合查询（有聚合函数、GROUP BY或HAVING）中和cols一一对应，普通的列是AGG_COL；不是聚合查询时为空
+    std::vector<AggType> agg_types;
+    // 和cols一一对应的输出列名：AS给出的名字，聚合函数没有AS时是COUNT(*)这样的文本，其他为空
+    std::vector<std::string> alias;
+    // GROUP BY的列
+    std::vector<TabCol> group_bys;
+    // HAVING条件，agg_type(lhs_col)和常量比较，常量已经转换成聚合结果的类型
+    std::vector<Condition> havings;
+    // 和cols一一对应，计算列是绑定好的表达式（这时cols中只有列名，是表达式的文本），普通的列为空
+    std::vector<std::shared_ptr<const Expression>> col_exprs;
     // 表名
     std::vector<std::string> tables;
     // update 的set 值
     std::vector<SetClause> set_clauses;
-    //insert 的values值
+    //insert 的values值，多行插入时按行依次存放
     std::vector<Value> values;
+    // 用到了临时表，计划不能放进计划缓存
+    bool uses_temp_table = false;
+    // CREATE MATERIALIZED VIEW：视图的定义，以及和它的字段一一对应的视图表字段
+    MatViewDef mat_view;
+    std::vector<ColDef> mat_view_cols;
 
     Query(){}
 
@@ -47,14 +82,34 @@ public:
     Analyze(SmManager *sm_manager) : sm_manager_(sm_manager){}
     ~Analyze(){}
 
-    std::shared_ptr<Query> do_analyze(std::shared_ptr<ast::TreeNode> root);
+    // session_id: 执行语句的会话，其他会话的临时表对它不可见
+    std::shared_ptr<Query> do_analyze(std::shared_ptr<ast::TreeNode> root, uint64_t session_id = 0);
 
 private:
+    std::shared_ptr<Query> analyze_stmt(std::shared_ptr<ast::TreeNode> parse);
+    void check_visible(Query &query, uint64_t session_id);
     TabCol check_column(const std::vector<ColMeta> &all_cols, TabCol target);
     void get_all_cols(const std::vector<std::string> &tab_names, std::vector<ColMeta> &all_cols);
     void get_clause(const std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds, std::vector<Condition> &conds);
+    void get_expr_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds, const std::vector<ColMeta> &all_cols,
+                        std::vector<ExprCond> &expr_conds);
+    void get_or_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds, const std::vector<std::string> &tab_names,
+                      std::vector<OrCond> &or_conds);
+    std::shared_ptr<const Expression> bind_expr(const std::shared_ptr<ast::Expr> &sv_expr,
+                                                const std::vector<ColMeta> &all_cols);
+    void get_sub_conds(std::vector<std::shared_ptr<ast::BinaryExpr>> &sv_conds, const std::vector<ColMeta> &all_cols,
+                       std::vector<SubqueryCond> &sub_conds);
+    void get_corr_conds(ast::SelectStmt &select, const std::vector<ColMeta> &outer_cols,
+                        std::vector<Condition> &corr_conds);
     void check_clause(const std::vector<std::string> &tab_names, std::vector<Condition> &conds);
+    void check_agg_arg(AggType agg_type, const TabCol &arg);
+    void get_group_by(ast::SelectStmt &select, const std::vector<ColMeta> &all_cols, Query &query);
+    void get_mat_view(ast::SelectStmt &select, const Query &select_query, Query &query);
+    void check_writable(const std::string &tab_name);
+    void check_not_partitioned(const std::string &tab_name, const std::string &stmt);
+    void normalize_clause(std::vector<Condition> &conds, std::vector<OrCond> &or_conds, bool *always_false);
     Value convert_sv_value(const std::shared_ptr<ast::Value> &sv_val);
     CompOp convert_sv_comp_op(ast::SvCompOp op);
+    AggType convert_sv_agg_func(ast::SvAggFunc agg);
 };
 
@@ -0,0 +1,109 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "common/config.h"
+
+/**
+ * @description: 一条语句的bump分配器。算子对象、key缓冲区等活到语句结束的内存从这里顺序切出，
+ * 不逐个释放，语句结束时reset一次归还；只向全局分配器申请ARENA_BLOCK_SIZE大小的块，
+ * 高并发时少争用全局分配器，长时间运行也不会因为大量小块而产生碎片。
+ * 只在执行语句的线程中使用，不加锁；并行算子的工作线程不要从这里分配
+ */
+class Arena {
+ public:
+  Arena() = default;
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // 分配bytes字节，按align对齐，内容未初始化
+  void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+    size_t pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    if (pad + bytes > left_) {
+      new_block(bytes + align);
+      pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    }
+    char* p = cur_ + pad;
+    cur_ = p + bytes;
+    left_ -= pad + bytes;
+    allocated_ += bytes;
+    return p;
+  }
+
+  char* alloc_chars(size_t bytes) {
+    return static_cast<char*>(allocate(bytes, 1));
+  }
+
+  // 归还这条语句分配的所有内存，之前分配的内存不能再访问。保留第一块给下一条语句
+  void reset() {
+    if (!blocks_.empty() && blocks_[0].size != ARENA_BLOCK_SIZE) {
+      blocks_.clear();
+    } else if (blocks_.size() > 1) {
+      blocks_.resize(1);
+    }
+    cur_ = blocks_.empty() ? nullptr : blocks_[0].data.get();
+    left_ = blocks_.empty() ? 0 : blocks_[0].size;
+    allocated_ = 0;
+  }
+
+  // reset之后分配出去的字节数
+  size_t allocated() const { return allocated_; }
+
+  // 既可以放在Arena中、也可以放在堆上的对象（算子）的operator new/delete：
+  // 对象前面有一个头记录它在哪里，delete时堆上的对象归还给全局分配器，Arena中的对象等reset一起归还
+  static void* new_object(size_t size, Arena* arena) {
+    char* p = arena != nullptr
+                  ? static_cast<char*>(arena->allocate(OBJECT_HEADER + size))
+                  : static_cast<char*>(::operator new(OBJECT_HEADER + size));
+    *reinterpret_cast<bool*>(p) = arena != nullptr;
+    return p + OBJECT_HEADER;
+  }
+
+  static void delete_object(void* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    char* p = static_cast<char*>(ptr) - OBJECT_HEADER;
+    if (!*reinterpret_cast<bool*>(p)) {
+      ::operator delete(p);
+    }
+  }
+
+ private:
+  // 对象头的大小，保持对象按max_align_t对齐
+  static constexpr size_t OBJECT_HEADER = alignof(std::max_align_t);
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  // 当前块放不下时换一块，放不下ARENA_BLOCK_SIZE的分配单独占一块
+  void new_block(size_t min_size) {
+    size_t size = std::max(min_size, ARENA_BLOCK_SIZE);
+    blocks_.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+    cur_ = blocks_.back().data.get();
+    left_ = size;
+  }
+
+  std::vector<Block> blocks_;
+  char* cur_ = nullptr;  // 当前块中下一个空闲字节
+  size_t left_ = 0;      // 当前块剩下的字节数
+  size_t allocated_ = 0;
+};
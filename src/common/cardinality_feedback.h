@@ -0,0 +1,105 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+#include "common/config.h"
+
+/**
+ * @description: 基数反馈。扫描完整地执行完一遍后，把单表条件实际过滤出的记录数和统计信息给出的估计比较，
+ * 按谓词记下修正系数（实际/估计，在对数上和之前的系数取平均），之后QueryOptimizer估算同样谓词的记录数时乘上它。
+ * 谓词按表名和各条件的字段、比较符区分，不含常量：同一种查询换了参数仍然用同一个系数。
+ * 表重新ANALYZE后统计信息变了，它的系数全部丢弃
+ */
+class CardinalityFeedback {
+ public:
+  static CardinalityFeedback& instance() {
+    static CardinalityFeedback feedback;
+    return feedback;
+  }
+
+  // 谓词的键，只看tab_name上和常量比较的条件，条件的顺序无关；没有这样的条件时返回空串
+  static std::string key(const std::string& tab_name, const std::vector<Condition>& conds) {
+    std::vector<std::string> parts;
+    for (auto& cond : conds) {
+      if (cond.is_rhs_val && cond.lhs_col.tab_name == tab_name) {
+        parts.push_back(cond.lhs_col.col_name + ' ' + std::to_string(cond.op));
+      }
+    }
+    if (parts.empty()) {
+      return "";
+    }
+    std::sort(parts.begin(), parts.end());
+    std::string key = tab_name;
+    for (auto& part : parts) {
+      key += '\n' + part;
+    }
+    return key;
+  }
+
+  // 估计值的修正系数，没有反馈时为1
+  double correction(const std::string& key) {
+    if (key.empty()) {
+      return 1.0;
+    }
+    std::lock_guard lock(mutex_);
+    auto it = factors_.find(key);
+    return it == factors_.end() ? 1.0 : std::exp(it->second);
+  }
+
+  /**
+   * @description: 记录一次观测：统计信息估计estimated条，实际扫描出actual条
+   * @return {bool} 修正系数变化了一倍以上，按旧系数生成的缓存计划可能不再合适
+   */
+  bool observe(const std::string& key, double estimated, double actual) {
+    if (key.empty()) {
+      return false;
+    }
+    double ratio = std::max(actual, 1.0) / std::max(estimated, 1.0);
+    double log_ratio = std::log(std::clamp(ratio, CARD_FEEDBACK_MIN_FACTOR, 1.0 / CARD_FEEDBACK_MIN_FACTOR));
+    std::lock_guard lock(mutex_);
+    auto it = factors_.find(key);
+    double old = it == factors_.end() ? 0.0 : it->second;
+    double updated = it == factors_.end() ? log_ratio : (old + log_ratio) / 2;
+    if (it == factors_.end() && factors_.size() >= CARD_FEEDBACK_MAX_ENTRIES) {
+      // 谓词的种类太多时整体清空重新积累，不做精细的淘汰
+      factors_.clear();
+    }
+    factors_[key] = updated;
+    return std::abs(updated - old) >= std::log(2.0);
+  }
+
+  // 表重新收集了统计信息，丢弃它的所有系数
+  void reset_table(const std::string& tab_name) {
+    std::string prefix = tab_name + '\n';
+    std::lock_guard lock(mutex_);
+    for (auto it = factors_.begin(); it != factors_.end();) {
+      if (it->first.compare(0, prefix.size(), prefix) == 0) {
+        it = factors_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+ private:
+  CardinalityFeedback() = default;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, double> factors_;  // 谓词的键 -> 修正系数的自然对数
+};
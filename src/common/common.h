@@ -22,12 +22,80 @@ See the Mulan PSL v2 for more details. */
 struct TabCol {
     std::string tab_name;
     std::string col_name;
+    int col_id = -1;  // position of the column in its table, bound during analysis; -1 if unbound
 
     friend bool operator<(const TabCol &x, const TabCol &y) {
         return std::make_pair(x.tab_name, x.col_name) < std::make_pair(y.tab_name, y.col_name);
     }
 };
 
+/* The value in column format, as long as its column. Values up to INLINE_LEN bytes (every int and float and short
+ * strings) are stored inside the object, so constants are copied and moved without touching the heap; only longer
+ * string columns allocate */
+class ValueRaw {
+   public:
+    static constexpr int INLINE_LEN = 32;
+
+    ValueRaw() = default;
+
+    explicit ValueRaw(int size) : size_(size) {
+        if (size_ > INLINE_LEN) {
+            heap_ = new char[size_];
+        }
+    }
+
+    ValueRaw(const ValueRaw &other) : ValueRaw(other.size_) { memcpy(data(), other.data(), size_); }
+
+    ValueRaw(ValueRaw &&other) noexcept { take(other); }
+
+    ValueRaw &operator=(const ValueRaw &other) {
+        if (this != &other) {
+            *this = ValueRaw(other);
+        }
+        return *this;
+    }
+
+    ValueRaw &operator=(ValueRaw &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~ValueRaw() { reset(); }
+
+    char *data() { return size_ > INLINE_LEN ? heap_ : inline_; }
+    const char *data() const { return size_ > INLINE_LEN ? heap_ : inline_; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    void reset() {
+        if (size_ > INLINE_LEN) {
+            delete[] heap_;
+        }
+        size_ = 0;
+    }
+
+   private:
+    // Steal the buffer of other, which is left empty
+    void take(ValueRaw &other) {
+        size_ = other.size_;
+        if (size_ > INLINE_LEN) {
+            heap_ = other.heap_;
+        } else {
+            memcpy(inline_, other.inline_, size_);
+        }
+        other.size_ = 0;
+    }
+
+    int size_ = 0;
+    union {
+        char inline_[INLINE_LEN];
+        char *heap_;
+    };
+};
+
 struct Value {
     ColType type;  // type of value
     union {
@@ -36,7 +104,9 @@ struct Value {
     };
     std::string str_val;  // string value
 
-    std::shared_ptr<RmRecord> raw;  // raw record buffer
+    ValueRaw raw;  // value in column format, empty until init_raw
+
+    int param = -1;  // index of the SQL literal this value came from, -1 if none
 
     void set_int(int int_val_) {
         type = TYPE_INT;
@@ -54,35 +124,57 @@ struct Value {
     }
 
     void init_raw(int len) {
-        assert(raw == nullptr);
-        raw = std::make_shared<RmRecord>(len);
+        assert(raw.empty());
+        if (type == TYPE_STRING && len < (int)str_val.size()) {
+            throw StringOverflowError();
+        }
+        raw = ValueRaw(len);
         if (type == TYPE_INT) {
             assert(len == sizeof(int));
-            *(int *)(raw->data) = int_val;
+            *(int *)(raw.data()) = int_val;
         } else if (type == TYPE_FLOAT) {
             assert(len == sizeof(float));
-            *(float *)(raw->data) = float_val;
+            *(float *)(raw.data()) = float_val;
         } else if (type == TYPE_STRING) {
-            if (len < (int)str_val.size()) {
-                throw StringOverflowError();
-            }
-            memset(raw->data, 0, len);
-            memcpy(raw->data, str_val.c_str(), str_val.size());
+            memset(raw.data(), 0, len);
+            memcpy(raw.data(), str_val.c_str(), str_val.size());
         }
     }
 };
 
 enum CompOp { OP_EQ, OP_NE, OP_LT, OP_GT, OP_LE, OP_GE };
 
+// Aggregate function of a select item or HAVING condition; AGG_COL is a plain group-by column
+enum AggType { AGG_COL, AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX };
+
+// Name of an aggregate's output column, e.g. COUNT(*) or SUM(score). The aggregate executor names its
+// output columns this way and the projection above it looks them up by the same name
+inline std::string agg_col_name(AggType agg_type, const TabCol &col) {
+    static const char *names[] = {"", "COUNT", "SUM", "MIN", "MAX"};
+    if (agg_type == AGG_COL) {
+        return col.col_name;
+    }
+    return std::string(names[agg_type]) + "(" + (col.col_name.empty() ? "*" : col.col_name) + ")";
+}
+
 struct Condition {
     TabCol lhs_col;   // left-hand side column
     CompOp op;        // comparison operator
     bool is_rhs_val;  // true if right-hand side is a value (not a column)
     TabCol rhs_col;   // right-hand side column
     Value rhs_val;    // right-hand side value
+    AggType agg_type = AGG_COL;  // HAVING conditions compare agg_type(lhs_col) with rhs_val
+};
+
+// A disjunction of column-vs-value conditions on one table, e.g. (a = 1 OR b > 2).
+// Values are already converted to the column types.
+struct OrCond {
+    std::vector<Condition> conds;
 };
 
 struct SetClause {
     TabCol lhs;
     Value rhs;
+    bool is_incr = false;  // col = col + rhs
+    bool is_sub = false;   // is_incr时为col = col - rhs；rhs本身不取相反数，计划缓存代入参数时直接替换rhs
 };
\ No newline at end of file
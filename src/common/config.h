@@ -23,8 +23,9 @@ extern std::chrono::milliseconds cycle_detection_interval;
 /** True if logging should be enabled, false otherwise. */
 extern std::atomic<bool> enable_logging;
 
-/** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT. */
-extern std::chrono::duration<int64_t> log_timeout;
+/** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT.
+ *  This bounds how much committed work an asynchronous commit (synchronous_commit = false) can lose. */
+extern std::chrono::milliseconds log_timeout;
 
 static constexpr int INVALID_FRAME_ID = -1;                                   // invalid frame id
 static constexpr int INVALID_PAGE_ID = -1;                                    // invalid page id
@@ -37,8 +38,129 @@ static constexpr int HEADER_PAGE_ID = 0;                                      //
 static constexpr int PAGE_SIZE = 4096;                                        // size of a data page in byte  4KB
 static constexpr int BUFFER_POOL_SIZE = 65536;                                // size of buffer pool 256MB
 // static constexpr int BUFFER_POOL_SIZE = 262144;                                // size of buffer pool 1GB
+static constexpr int BUFFER_POOL_INSTANCES = 16;                              // default number of buffer pool instances, -n at startup
+static constexpr int BUFFER_POOL_MAX_GROWTH = 4;                              // without -m the pool can grow online up to this many times its startup size
 static constexpr int LOG_BUFFER_SIZE = (1024 * PAGE_SIZE);                    // size of a log buffer in byte
-static constexpr int BUCKET_SIZE = 50;                                        // size of extendible hash bucket
+static constexpr int64_t LOG_SEGMENT_SIZE = 16 * 1024 * 1024;                // size of a preallocated WAL segment file, at least a few log buffers
+static constexpr int LOG_SPARE_SEGMENTS = 4;                                  // recycled segments kept ahead of the log end instead of being deleted
+static constexpr size_t LOG_FINISH_STRIPES = 16;                              // 日志缓冲区拷贝完成计数的分片数，线程按编号轮流使用，各占一个缓存行
+static constexpr int IX_HASH_MAX_GLOBAL_DEPTH = 18;                           // 哈希索引目录的最大全局深度，桶的局部深度到达后改挂溢出页
+static constexpr bool ENABLE_DIRECT_IO = false;                               // open data files with O_DIRECT, bypassing the OS page cache
+static constexpr bool ENABLE_IO_URING = true;                                 // batch page I/O through io_uring, falls back to pread/pwrite
+static constexpr unsigned IO_URING_ENTRIES = 64;                              // submission queue size of each thread's io_uring
+static constexpr int BULK_READ_RING_PAGES = 256;                              // 大表扫描使用的环形缓冲区页数 1MB
+static constexpr int BULK_WRITE_RING_PAGES = 4096;                            // 批量导入使用的环形缓冲区页数 16MB
+static constexpr int SCAN_PREFETCH_PAGES = 32;
+static constexpr bool ENABLE_SYNC_SCAN = true;                                // 同一个大表上同时进行的全表扫描从正在进行的扫描的位置开始，共享读入的页面
+static constexpr int HEAP_FILE_EXTENT_PAGES = 256;                            // 表数据文件每次预分配的页数 1MB
+static constexpr int INDEX_FILE_EXTENT_PAGES = 64;                            // 索引文件每次预分配的页数 256KB
+static constexpr int FILE_EXTENT_MAX_PAGES = 16384;                           // 大文件按已有大小的1/8增长，单次预分配的上限 64MB
+static constexpr int PAGE_COMPRESS_SLOT_SIZE = 512;                           // 压缩文件中存放页面的槽位粒度，压缩后的页面按它向上取整
+static constexpr int RM_INSERT_TARGETS = 16;                                  // 空闲空间映射中并发插入分散到的目标页面数
+static constexpr int RM_MEMORY_MAX_PAGES = 16384;                             // STORAGE = MEMORY的表按页面号直接定位的页面数，之后的页面仍然查页表 64MB
+static constexpr int SLOTTED_PAGE_FREE_PERCENT = 10;                          // 变长格式的页面留给原地更新变长的空间，插入不占用
+static constexpr int SLOTTED_PAGE_STRING_FILL = 25;                           // 变长格式估算每页槽位数时，假设字符串平均占声明长度的百分比
+static constexpr int VACUUM_FILL_PERCENT = 50;                                // VACUUM把记录数低于每页槽位数这个百分比的页面上的记录移走
+static constexpr int VACUUM_MIN_PAGES = 16;                                   // 后台清理只整理至少能腾空这么多页面的表
+static constexpr int MAX_TABLE_PARTITIONS = 1024;                             // PARTITION BY HASH的分区数上限，每个分区有自己的数据文件
+static constexpr int OPTIMISTIC_READ_RETRIES = 4;                             // optimistic index descents retried before falling back to latch coupling
+static constexpr int IX_PINNED_LEVELS = 2;                                    // B+树从根开始这么多层的内部结点常驻缓冲池，0表示不常驻
+static constexpr int IX_SWIZZLE_SLOTS = 1024;                                 // 每个B+树直接定位常驻结点的槽位数，按页面号取模
+static constexpr int IX_PROBE_GROUP = 8;                                      // 批量查找时交错下降的key数，每层先给这么多个孩子发预取再逐个读
+static constexpr int IX_ROW_HINT_SLOTS = 4096;                                // 每个B+树记住的“完整key -> rid”提示数，按key的哈希取模 64KB
+static constexpr int IX_AHI_SLOTS = 4096;                                     // 每个B+树自适应哈希索引的槽位数，按key的哈希取模 64KB
+static constexpr uint64_t IX_AHI_MIN_LOOKUPS = 64;                            // B+树上的等值查找达到这么多次后才启用自适应哈希索引
+static constexpr int OPTIMISTIC_WRITE_RETRIES = 2;                            // 插入删除只锁叶子的乐观下降失败几次后退回锁耦合
+static constexpr size_t IX_BULK_SORT_MEMORY = 64 * 1024 * 1024;               // 批量建索引时每个索引排序用的内存，超过后排好序写到临时文件 64MB
+static constexpr size_t IX_BULK_MERGE_BUFFER = 1024 * 1024;                   // 归并时每个临时文件的读缓冲区 1MB
+static constexpr int IX_BULK_FILL_PERCENT = 90;                               // 批量建索引时结点填到容量的这个百分比，留出插入的空间
+static constexpr size_t HASH_JOIN_MEMORY = 64 * 1024 * 1024;                  // 哈希连接build一侧在内存中的上限，超过后两侧都分区写到临时文件 64MB
+static constexpr int HASH_JOIN_PARTITIONS = 64;                               // grace哈希连接的分区数
+static constexpr size_t HASH_JOIN_SPILL_BUFFER = 64 * 1024;                   // 每个分区写临时文件的缓冲区 64KB
+static constexpr size_t HASH_JOIN_CACHE_BYTES = 1024 * 1024;                  // 哈希表超过这么大（约为L2缓存）时按基数分区，每个分区的哈希表不超过它 1MB
+static constexpr int HASH_JOIN_RADIX_MAX_BITS = 12;                           // 基数分区最多用的哈希位数，分区数不超过2^12
+static constexpr int HASH_JOIN_RADIX_PASS_BITS = 6;                           // 一趟分区的最大扇出位数，超过后分两趟，避免写的分区太多导致TLB未命中
+static constexpr size_t HASH_JOIN_RADIX_BLOCK = 64 * 1024;                    // 基数分区时probe一侧每次读入并分区的记录数
+static constexpr size_t NLJ_BLOCK_MEMORY = 4 * 1024 * 1024;                   // 块嵌套循环连接每块缓存的左表记录的大小 4MB
+static constexpr size_t SORT_MEMORY = 64 * 1024 * 1024;                       // 排序算子在内存中缓存的记录大小，超过后切成有序run写到临时文件 64MB
+static constexpr int SORT_MERGE_FANIN = 64;                                   // 外部排序一趟归并的最多run数
+static constexpr size_t SORT_IO_BUFFER = 256 * 1024;                          // 外部排序读写每个run的缓冲区 256KB
+static constexpr size_t SORT_RADIX_MIN_ROWS = 256;                            // 内存中排序的记录不少于这么多条时用基数排序
+static constexpr size_t SORT_PARALLEL_MIN_ROWS = 128 * 1024;                  // 内存中排序的记录不少于这么多条时在morsel调度器上并行排序
+static constexpr int AGG_PARALLEL_THREADS = 8;                                // 并行聚合的工作线程数，不大于1时不并行
+static constexpr size_t AGG_PARALLEL_MIN_BATCHES = 16;                        // 输入超过这么多批（每批TupleBatch::CAPACITY条）才转为并行聚合
+static constexpr size_t AGG_PARTITIONS = 16;                                  // 并行聚合时按key哈希值分的区数，合并时每个分区由一个线程完成
+static constexpr int MORSEL_WORKER_THREADS = 8;                               // morsel调度器共享的工作线程数，为0时由提交任务的线程串行执行
+static constexpr int MORSEL_PAGES = 64;                                       // 一个扫描morsel包含的连续页面数
+static constexpr int PARALLEL_SCAN_MIN_PAGES = 1024;                          // 页面数不少于这么多的表按morsel并行计算谓词
+static constexpr int PARALLEL_SCAN_WINDOW_MORSELS = 64;                       // 并行扫描每一轮处理的morsel数，限制缓存的匹配结果
+static constexpr int PARALLEL_INDEX_SCAN_PARTS_PER_WORKER = 4;                // 并行的索引区间扫描按分隔key切成的段数，是参与者数的这么多倍
+static constexpr size_t PARALLEL_INDEX_SCAN_MIN_PARTS = 16;                   // 索引区间能切成这么多段（大约跨过这么多个叶子）时才并行扫描
+static constexpr size_t OUTPUT_FILE_BUFFER_SIZE = 1 << 20;                    // output.txt后台写线程攒够这么多字节、或者队列空了时写一次文件
+static constexpr size_t QUERY_MEMORY_BUDGET = 256 * 1024 * 1024;              // 一条语句中排序、哈希连接、聚合等算子共用的内存预算，用完后算子溢出到临时文件 256MB
+static constexpr size_t MEMORY_RESERVE_CHUNK = 1024 * 1024;                   // 算子向内存预算申请内存的粒度 1MB
+static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;                         // 语句的Arena每次向系统申请的块大小，更大的分配单独占一块 64KB
+static constexpr size_t SPILL_IO_BUFFER = 64 * 1024;                          // 溢出临时文件默认的写缓冲区 64KB
+static constexpr bool ENABLE_SORTMERGE_DEBUG_OUTPUT = false;                  // 排序归并连接开始时把两侧排好序的输入追加到sorted_results.txt，只用于调试
+static constexpr size_t DISTINCT_PARTITIONS = 16;                             // 去重的哈希表超过内存预算后，没见过的记录按哈希值分到这么多个临时文件中
+static constexpr int ANALYZE_SAMPLE_PAGES = 300;                              // ANALYZE最多读取的页面数，表更大时随机抽取这么多个页面（块抽样），读出其中的全部记录
+static constexpr size_t ANALYZE_HIST_BUCKETS = 100;                           // 数值字段等深直方图的桶数
+static constexpr size_t ANALYZE_MCV_COUNT = 32;                               // 每个字段最多保存的常见值个数
+static constexpr int AUTO_ANALYZE_INTERVAL_SEC = 10;                          // 后台检查统计信息是否过期的间隔秒数，0表示不自动ANALYZE
+static constexpr size_t AUTO_ANALYZE_MIN_ROWS = 500;                          // 上次ANALYZE之后修改的记录数超过 AUTO_ANALYZE_MIN_ROWS + 表的记录数 * AUTO_ANALYZE_SCALE 时，后台重新ANALYZE
+static constexpr double AUTO_ANALYZE_SCALE = 0.1;                             // 见AUTO_ANALYZE_MIN_ROWS
+static constexpr size_t CARD_FEEDBACK_MAX_ENTRIES = 4096;                     // 基数反馈最多记住的谓词数
+static constexpr double CARD_FEEDBACK_MIN_FACTOR = 1e-4;                      // 基数反馈的修正系数限制在[CARD_FEEDBACK_MIN_FACTOR, 1/CARD_FEEDBACK_MIN_FACTOR]内
+static constexpr size_t JOIN_DP_MAX_TABLES = 10;                              // 连接的表不多于这么多张时用动态规划枚举连接顺序，更多时用贪心
+static constexpr size_t PLAN_CACHE_SIZE = 1024;                               // 全局计划缓存最多保存的语句形状数，按LRU淘汰
+static constexpr size_t PLAN_CACHE_SESSION_SIZE = 64;                         // 每个连接私有的计划缓存的大小，命中时不用加全局缓存的锁
+static constexpr size_t RESULT_CACHE_SIZE = 64 * 1024 * 1024;                 // 结果缓存（set result_cache = true）中所有结果的总字节数上限 64MB
+static constexpr double CPU_TUPLE_COST = 0.01;                                // 选择索引时的代价单位是顺序读一个页面，处理（检查条件）一条记录的代价
+static constexpr double INDEX_TUPLE_COST = 0.005;                             // 读取并比较一个索引项的代价
+static constexpr double INDEX_FETCH_COST = 1.0;                               // 按索引项中的rid回表读一条记录的代价，随机读，最坏情况下一条记录一次页面读
+static constexpr size_t LOCK_TABLE_SHARDS = 64;                               // 锁表按LockDataId的哈希值分成的分片数，每个分片一把latch
+static constexpr int LOCK_FREE_MAX_FD = 4096;                                 // 临时表的文件描述符小于这个值时加锁直接跳过，更大的仍然正常加锁
+static constexpr size_t LOCK_NODE_POOL_SIZE = 4096;                           // 每个线程缓存的空闲锁表结点数（每种结点），超过时还给系统
+static constexpr size_t VERSION_STORE_SHARDS = 64;                            // 版本存储按(表, 页面)的哈希值分成的分片数，每个分片一把latch
+static constexpr size_t LOCK_ESCALATION_THRESHOLD = 5000;                     // 事务在一张表上的行锁达到这么多时升级为表锁，其他事务的锁不相容时推迟到再多这么多时
+static constexpr size_t OCC_VERSION_SLOTS = 1 << 20;                          // 乐观并发控制的记录版本字个数，记录按哈希值共用，8MB
+static constexpr size_t TXN_TABLE_SHARDS = 64;                                // 全局事务表按事务ID分成的分片数，每个分片一把latch
+static constexpr size_t TXN_POOL_SIZE = 16;                                   // 每个线程缓存的结束的事务对象数，开始新事务时重新使用
+static constexpr int SERVER_IO_THREADS = 2;                                   // 等待客户端请求的I/O线程数，连接轮流分给各个I/O线程
+static constexpr size_t SERVER_WORKER_THREADS = 0;                            // 执行语句的工作线程数，为0时等于CPU核数
+static constexpr size_t SERVER_MAX_WORKERS = 256;                             // 工作线程都卡在等锁上时临时增加的工作线程的上限（包括固定的工作线程）
+static constexpr size_t SERVER_QUEUE_LIMIT = 1024;                            // 等待执行的语句数上限，超过时I/O线程停止接收请求
+static constexpr size_t SERVER_ANALYTICS_WORKERS = 0;                         // 同时执行分析类请求的工作线程数上限，为0时等于固定工作线程数的一半（至少1个）
+static constexpr int ANALYTICS_IO_PRIORITY = 7;                               // 执行分析类请求时工作线程在best-effort类中的I/O优先级，0最高7最低
+static constexpr uint64_t CANCEL_CHECK_TICKS = 1024;                          // 执行器的循环每检查这么多次取消标记才读一次时钟判断statement_timeout
+static constexpr int LOCK_WAIT_CANCEL_POLL_MS = 10;                           // 等锁时每隔这么久检查一次语句是否被KILL或者超时
+static constexpr size_t BACKUP_MAX_BYTES_PER_SEC = 64 << 20;                  // 在线备份复制数据和索引文件的速度上限 64MB/s，0表示不限制
+static constexpr int BACKUP_BATCH_PAGES = 64;                                 // 在线备份复制文件时攒够这么多页面写一次备份文件
+static constexpr int SERVER_STALL_MS = 20;                                    // 队列不空却这么久没有语句被取走时增加一个工作线程
+static constexpr int SERVER_EPOLL_EVENTS = 64;                                // I/O线程一次epoll_wait最多取出的事件数
+static constexpr bool SERVER_BATCH_IMPLICIT_TXN = false;                      // 一次请求中以分号分隔的多条语句是否包在一个事务中执行，出错时整批回滚
+static constexpr size_t METRICS_STRIPES = 8;                                  // 运行指标的计数器和直方图按线程分成的条带数，同一条带上的线程才争用同一组原子变量
+static constexpr size_t LOAD_CHUNK_SIZE = 4 << 20;                            // LOAD时数据文件切成的块的大小（字节），各块由morsel调度器并行解析
+static constexpr bool LOAD_DIRECT_WRITE = true;                               // LOAD时定长和列存格式的新页面在缓冲池之外组装后直接写盘，全部落盘后用一条日志发布
+static constexpr size_t LOAD_SORT_MEMORY = 256 * 1024 * 1024;                 // LOAD按聚簇索引排序时内存中缓存的有序run大小，超过后归并写到临时文件 256MB
+static constexpr bool LOAD_CLUSTER_BY_INDEX = true;                           // LOAD时按主索引（导入前为空、字段最少的B+树索引）排序后写入表，主索引的叶子顺序填满
+static constexpr size_t CATALOG_COMPACT_RECORDS = 1024;                       // db.meta快照之后追加的DDL日志记录超过这么多条时重写一次快照
+static constexpr int ONLINE_INDEX_CATCHUP_ROUNDS = 8;                         // 在线建索引时最多追赶写者修改的轮数，之后不管剩下多少修改都加表级 X 锁收尾
+static constexpr size_t ONLINE_INDEX_FINAL_CHANGES = 1024;                    // 在线建索引时一轮追赶的修改少于这个数就加表级 X 锁收尾
+static constexpr bool ENABLE_IX_BLOOM_FILTER = true;                          // B+树索引在内存中维护布隆过滤器，插入前查重时跳过确定不存在的key
+static constexpr int IX_BLOOM_BITS_PER_KEY = 10;                              // 每个key占的位数，误报率约1%
+static constexpr int IX_BLOOM_NUM_HASHES = 7;                                 // 每个key置位的个数
+static constexpr size_t IX_BLOOM_INIT_KEYS = 1 << 16;                         // 过滤器第一层至少能放下的key数量，装满后追加容量翻倍的一层
+static constexpr size_t PAGE_TABLE_PARTITIONS = 64;                           // 每个缓冲池实例页表的分区数，每个分区一把读写锁                                // pages a sequential scan reads ahead of its position
+static constexpr size_t RWLATCH_READER_SLOTS = 64;                            // 可扩展读写锁的读者槽数，线程按编号轮流使用槽，只有同一槽上的读者才写同一个缓存行
+static constexpr int LATCH_SPIN_LIMIT = 128;                                  // latch拿不到时先自旋的次数，超过后在futex上睡眠
+static constexpr bool ENABLE_HUGE_PAGES = true;                               // back buffer pool frames with transparent huge pages
+static constexpr bool ENABLE_HUGETLB = false;                                 // try MAP_HUGETLB first, needs vm.nr_hugepages for the max pool size, falls back to THP
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;                     // size of a huge page in byte
+static constexpr bool ENABLE_NUMA_BINDING = true;                             // spread buffer pool instances over NUMA nodes
+static constexpr int PAGE_WRITER_CLEAN_TARGET = 64;                           // clean frames kept ahead of the clock hand per instance
+static constexpr int PAGE_WRITER_BATCH_SIZE = 16;                             // max dirty pages written by the page writer per round
+static constexpr std::chrono::milliseconds PAGE_WRITER_INTERVAL{10};          // page writer wakes up at least this often
 
 using frame_id_t = int32_t;  // frame id type, 帧页ID, 页在BufferPool中的存储单元称为帧,一帧对应一页
 using page_id_t = int32_t;   // page id type , 页ID
@@ -48,10 +170,23 @@ using slot_offset_t = size_t;  // slot offset type
 using oid_t = uint16_t;
 using timestamp_t = int64_t;  // timestamp type, used for transaction concurrency
 
-// log file
+// log file, segments are named db.log.<segment number>
 static const std::string LOG_FILE_NAME = "db.log";
 
-// replacer
-static const std::string REPLACER_TYPE = "LRU";
+// replacer，可选 "CLOCK"、"LRU"、"LRU-K"，启动时可以用环境变量 RMDB_REPLACER 覆盖
+static const std::string REPLACER_TYPE = "CLOCK";
+static constexpr int LRUK_K = 2;                        // LRU-K 按倒数第K次访问的时间淘汰
+static constexpr int LRUK_CORRELATED_PERIOD = 256;      // 间隔不超过这么多次访问的重复访问视为同一次（如扫描逐条读同一页）
 
 static const std::string DB_META_NAME = "db.meta";
+// TRUNCATE creates the empty data and index files under this suffix and renames them over the old ones
+static const std::string TRUNCATE_FILE_SUFFIX = ".truncate";
+// page map of a compressed data or index file, its presence marks the file as compressed
+static const std::string COMPRESS_MAP_SUFFIX = ".cmap";
+// files of temporary tables, removed when the database is opened again after a crash
+static const std::string TEMP_FILES_NAME = "temp_files";
+// written by close_db and removed by open_db: when it is missing at open, unlogged tables are emptied
+static const std::string CLEAN_SHUTDOWN_NAME = "clean_shutdown";
+// resident pages of the buffer pool, written at clean shutdown and checkpoints, read back after restart
+static const std::string BUFFER_POOL_DUMP_NAME = "buffer_pool.dump";
+static constexpr int BUFFER_POOL_WARMUP_BATCH = 64;  // pages read per batch by the warm-up thread
@@ -10,6 +10,13 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <sys/socket.h>
+
+#include "common/arena.h"
+#include "common/memory_tracker.h"
+#include "common/metrics.h"
+#include "common/statement_cancel.h"
+#include "common/wire_protocol.h"
 #include "transaction/transaction.h"
 #include "transaction/concurrency/lock_manager.h"
 #include "recovery/log_manager.h"
@@ -28,6 +35,26 @@ public:
             ellipsis_ = false;
           }
 
+    // 把data_send_中已经写好的结果先发给客户端并清空，结果不再受BUFFER_LENGTH限制；
+    // 没有设置客户端连接或者发送失败时返回false，调用者按原来的方式截断结果。
+    // 分帧协议的连接上作为stmt_id_的一个RESULT_CHUNK发送
+    bool flush_send() {
+        if (sock_fd_ < 0 || data_send_ == nullptr) {
+            return false;
+        }
+        bool sent = framed_ ? *offset_ == 0 || send_wire_frame(sock_fd_, WireType::RESULT_CHUNK, stmt_id_,
+                                                                data_send_, *offset_)
+                            : *offset_ == 0 || send(sock_fd_, data_send_, *offset_, 0) != -1;
+        if (!sent) {
+            sock_fd_ = -1;
+            return false;
+        }
+        Metrics::instance().add(MetricCounter::BYTES_SENT, *offset_);
+        *offset_ = 0;
+        flushed_ = true;
+        return true;
+    }
+
     // TransactionManager *txn_mgr_;
     LockManager *lock_mgr_;
     LogManager *log_mgr_;
@@ -35,4 +62,14 @@ public:
     char *data_send_;
     int *offset_;
     bool ellipsis_;
+    int sock_fd_ = -1;  // 客户端连接，结果放不下时边执行边发送
+    bool framed_ = false;  // 连接使用分帧协议
+    uint32_t stmt_id_ = 0;  // 分帧协议中这条语句的编号
+    uint64_t session_id_ = 0;  // 执行语句的会话，临时表属于创建它的会话
+    bool *synchronous_commit_ = nullptr;  // 会话的synchronous_commit设置，新事务从它取得提交方式
+    WorkloadClass *workload_class_ = nullptr;  // 会话的负载类别，SET workload_class修改它
+    StatementCancel *cancel_ = nullptr;  // 会话的取消状态，SET statement_timeout修改它的超时
+    bool flushed_ = false;  // 这条语句的结果已经分块发送过
+    MemoryTracker memory_;  // 这条语句中算子共用的内存预算
+    Arena arena_;  // 这条语句的算子对象和key缓冲区，语句结束时一起释放
 };
\ No newline at end of file
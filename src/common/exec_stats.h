@@ -0,0 +1,50 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @description: 当前线程上累计的执行统计。缓冲池和锁管理器在事件发生的线程上累加，
+ * EXPLAIN ANALYZE在算子的每次调用前后取差值，得到这次调用（包括其中对儿子的调用）读取的页面和等待锁的情况。
+ * 并行扫描的工作线程上发生的事件不计入发起查询的线程
+ */
+struct ExecStats {
+  uint64_t page_fetches = 0;   // 向缓冲池请求的页面数
+  uint64_t buffer_hits = 0;    // 其中命中缓冲池的页面数
+  uint64_t buffer_misses = 0;  // 从磁盘读入的页面数，包括预读
+  uint64_t lock_waits = 0;     // 加锁时阻塞等待的次数
+  uint64_t lock_wait_us = 0;   // 阻塞等待锁的时间
+
+  ExecStats& operator+=(const ExecStats& other) {
+    page_fetches += other.page_fetches;
+    buffer_hits += other.buffer_hits;
+    buffer_misses += other.buffer_misses;
+    lock_waits += other.lock_waits;
+    lock_wait_us += other.lock_wait_us;
+    return *this;
+  }
+
+  ExecStats operator-(const ExecStats& other) const {
+    ExecStats res = *this;
+    res.page_fetches -= other.page_fetches;
+    res.buffer_hits -= other.buffer_hits;
+    res.buffer_misses -= other.buffer_misses;
+    res.lock_waits -= other.lock_waits;
+    res.lock_wait_us -= other.lock_wait_us;
+    return res;
+  }
+};
+
+inline ExecStats& thread_exec_stats() {
+  thread_local ExecStats stats;
+  return stats;
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+enum ArithOp { ARITH_ADD, ARITH_SUB, ARITH_MUL, ARITH_DIV };
+
+/**
+ * @description: 分析时绑定好的表达式树：字段、常量，或者两个子表达式的四则运算。
+ * 类型在绑定时确定，只有int和float：两边都是int时按int计算（除法取整），有一边是float时按float计算。
+ * 绑定之后不再修改，计划缓存中的计划和正在执行的计划共享同一棵树
+ */
+struct Expression {
+  enum Kind { COL, CONST, ARITH };
+
+  Kind kind;
+  ColType type;
+  TabCol col;              // COL：表名已经补全
+  Value val;               // CONST
+  ArithOp op = ARITH_ADD;  // ARITH
+  std::shared_ptr<const Expression> lhs;
+  std::shared_ptr<const Expression> rhs;
+
+  static std::shared_ptr<Expression> make_col(TabCol col, ColType type) {
+    auto expr = std::make_shared<Expression>();
+    expr->kind = COL;
+    expr->type = type;
+    expr->col = std::move(col);
+    return expr;
+  }
+
+  static std::shared_ptr<Expression> make_const(Value val) {
+    auto expr = std::make_shared<Expression>();
+    expr->kind = CONST;
+    expr->type = val.type;
+    expr->val = std::move(val);
+    return expr;
+  }
+
+  static std::shared_ptr<Expression> make_arith(
+      ArithOp op, std::shared_ptr<const Expression> lhs,
+      std::shared_ptr<const Expression> rhs) {
+    auto expr = std::make_shared<Expression>();
+    expr->kind = ARITH;
+    expr->type = lhs->type == TYPE_FLOAT || rhs->type == TYPE_FLOAT
+                     ? TYPE_FLOAT
+                     : TYPE_INT;
+    expr->op = op;
+    expr->lhs = std::move(lhs);
+    expr->rhs = std::move(rhs);
+    return expr;
+  }
+
+  // 把用到的字段加到cols中
+  void collect_cols(std::vector<TabCol>& cols) const {
+    if (kind == COL) {
+      cols.push_back(col);
+    } else if (kind == ARITH) {
+      lhs->collect_cols(cols);
+      rhs->collect_cols(cols);
+    }
+  }
+
+  // 表达式的文本，作为计算列的列名。只在需要时加括号
+  std::string to_string() const {
+    switch (kind) {
+      case COL:
+        return col.col_name;
+      case CONST: {
+        if (val.type == TYPE_STRING) {
+          return "'" + val.str_val + "'";
+        }
+        std::ostringstream os;
+        if (val.type == TYPE_INT) {
+          os << val.int_val;
+        } else {
+          os << val.float_val;
+        }
+        return os.str();
+      }
+      default: {
+        static const char* const names[] = {"+", "-", "*", "/"};
+        std::string l = lhs->to_string();
+        std::string r = rhs->to_string();
+        if (binds_looser(*lhs, false)) {
+          l = "(" + l + ")";
+        }
+        if (binds_looser(*rhs, true)) {
+          r = "(" + r + ")";
+        }
+        return l + names[op] + r;
+      }
+    }
+  }
+
+ private:
+  // child作为这个运算的左（右）操作数时是否要加括号
+  bool binds_looser(const Expression& child, bool right) const {
+    if (child.kind != ARITH) {
+      return false;
+    }
+    bool mul = op == ARITH_MUL || op == ARITH_DIV;
+    bool child_mul = child.op == ARITH_MUL || child.op == ARITH_DIV;
+    return (mul && !child_mul) ||
+           (right && mul == child_mul && (op == ARITH_SUB || op == ARITH_DIV));
+  }
+};
+
+/* 至少一边是计算表达式的比较条件，例如 a + b > c。只能涉及一张表，在扫描这张表时计算 */
+struct ExprCond {
+  std::shared_ptr<const Expression> lhs;
+  CompOp op;
+  std::shared_ptr<const Expression> rhs;
+};
@@ -0,0 +1,257 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "common/config.h"
+#include "common/metrics.h"
+
+/* 分别记账内存的子系统 */
+enum class MemTag {
+  BUFFER_POOL = 0,  // 缓冲池的帧（页面数据和Page对象）和后台写页的缓冲区
+  LOCK_TABLE,       // 锁表的结点，包括线程空闲链表中缓存的结点
+  TRANSACTION,      // 事务对象，结束后被回收重用的也算在内
+  WRITE_SET,        // 事务写集合中的WriteRecord和其中保存的记录
+  QUERY,            // 语句的内存预算中已经被算子占用的部分（排序、哈希连接、聚合等）
+  CONNECTION,       // 连接的会话和结果缓冲区
+  NUM
+};
+
+/**
+ * @description: 全局的按子系统的内存记账，SHOW MEMORY输出。只统计各子系统自己申请的主要内存，不替换全局的operator new，
+ * 所以不是进程的全部内存。计数和运行指标一样按线程分条带，释放可以发生在另一个线程上，
+ * 单个条带上的值可能为负，加起来是准确的。objects是还没有释放的对象个数，用来发现泄漏
+ */
+class MemoryAccounting {
+ public:
+  struct Usage {
+    int64_t bytes = 0;
+    int64_t objects = 0;
+  };
+
+  static MemoryAccounting& instance() {
+    static MemoryAccounting accounting;
+    return accounting;
+  }
+
+  MemoryAccounting(const MemoryAccounting&) = delete;
+  MemoryAccounting& operator=(const MemoryAccounting&) = delete;
+
+  void alloc(MemTag tag, size_t bytes, int64_t objects = 1) { add(tag, static_cast<int64_t>(bytes), objects); }
+
+  void free(MemTag tag, size_t bytes, int64_t objects = 1) { add(tag, -static_cast<int64_t>(bytes), -objects); }
+
+  Usage usage(MemTag tag) const {
+    Usage res;
+    for (auto& stripe : stripes_) {
+      res.bytes += stripe.bytes[static_cast<int>(tag)].load(std::memory_order_relaxed);
+      res.objects += stripe.objects[static_cast<int>(tag)].load(std::memory_order_relaxed);
+    }
+    return res;
+  }
+
+  // 语句结束时记录它的内存预算的最大用量
+  void record_query_peak(size_t bytes) {
+    size_t peak = query_peak_.load(std::memory_order_relaxed);
+    while (bytes > peak && !query_peak_.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+  }
+
+  // 启动以来单条语句的内存预算的最大用量
+  size_t query_peak() const { return query_peak_.load(std::memory_order_relaxed); }
+
+  static const char* name(MemTag tag) {
+    static const char* const names[] = {"buffer_pool", "lock_table", "transaction",
+                                        "write_set",   "query",      "connection"};
+    return names[static_cast<int>(tag)];
+  }
+
+ private:
+  MemoryAccounting() = default;
+
+  void add(MemTag tag, int64_t bytes, int64_t objects) {
+    auto& stripe = stripes_[LatencyHistogram::metrics_stripe()];
+    stripe.bytes[static_cast<int>(tag)].fetch_add(bytes, std::memory_order_relaxed);
+    stripe.objects[static_cast<int>(tag)].fetch_add(objects, std::memory_order_relaxed);
+  }
+
+  struct alignas(64) Stripe {
+    std::array<std::atomic<int64_t>, static_cast<int>(MemTag::NUM)> bytes{};
+    std::array<std::atomic<int64_t>, static_cast<int>(MemTag::NUM)> objects{};
+  };
+
+  std::array<Stripe, METRICS_STRIPES> stripes_{};
+  std::atomic<size_t> query_peak_{0};
+};
+
+/**
+ * @description: 作为成员放在要记账的对象中，随对象构造、拷贝和析构记账一个对象和bytes字节。
+ * 对象持有的内存在构造之后才知道时用add补上
+ */
+class MemoryCharge {
+ public:
+  MemoryCharge(MemTag tag, size_t bytes) : tag_(tag), bytes_(bytes) {
+    MemoryAccounting::instance().alloc(tag_, bytes_);
+  }
+
+  MemoryCharge(const MemoryCharge& other) : MemoryCharge(other.tag_, other.bytes_) {}
+
+  MemoryCharge& operator=(const MemoryCharge& other) {
+    if (this != &other) {
+      MemoryAccounting::instance().free(tag_, bytes_);
+      tag_ = other.tag_;
+      bytes_ = other.bytes_;
+      MemoryAccounting::instance().alloc(tag_, bytes_);
+    }
+    return *this;
+  }
+
+  ~MemoryCharge() { MemoryAccounting::instance().free(tag_, bytes_); }
+
+  void add(size_t bytes) {
+    MemoryAccounting::instance().alloc(tag_, bytes, 0);
+    bytes_ += bytes;
+  }
+
+ private:
+  MemTag tag_;
+  size_t bytes_;
+};
+
+/**
+ * @description: 一条语句的内存预算。排序、哈希连接、聚合等要缓存大量数据的算子从这里申请内存，
+ * 申请不到时把已经缓存的数据写到临时文件（见execution/spill_file.h），而不是无限增长。
+ * 同一语句中的算子（以及并行聚合的各个线程）共享一个预算，计数是原子的
+ */
+class MemoryTracker {
+ public:
+  // QUERY的对象数是正在执行的语句数
+  explicit MemoryTracker(size_t limit = QUERY_MEMORY_BUDGET) : limit_(limit) {
+    MemoryAccounting::instance().alloc(MemTag::QUERY, 0);
+  }
+
+  ~MemoryTracker() {
+    MemoryAccounting::instance().free(MemTag::QUERY, 0);
+    MemoryAccounting::instance().record_query_peak(peak_.load(std::memory_order_relaxed));
+  }
+
+  MemoryTracker(const MemoryTracker&) = delete;
+  MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+  // 预算内还有bytes时记账并返回true
+  bool try_reserve(size_t bytes) {
+    size_t used = used_.load(std::memory_order_relaxed);
+    do {
+      if (used + bytes > limit_) {
+        return false;
+      }
+    } while (!used_.compare_exchange_weak(used, used + bytes,
+                                          std::memory_order_relaxed));
+    reserved(used + bytes, bytes);
+    return true;
+  }
+
+  // 不检查预算直接记账，用于保证算子至少能继续处理一条记录
+  void force_reserve(size_t bytes) {
+    reserved(used_.fetch_add(bytes, std::memory_order_relaxed) + bytes, bytes);
+  }
+
+  void release(size_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+    MemoryAccounting::instance().free(MemTag::QUERY, bytes, 0);
+  }
+
+  size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+  // 这条语句到目前为止占用的最大内存
+  size_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+  size_t limit() const { return limit_; }
+
+ private:
+  // 占用增加了bytes，增加后为used
+  void reserved(size_t used, size_t bytes) {
+    MemoryAccounting::instance().alloc(MemTag::QUERY, bytes, 0);
+    size_t peak = peak_.load(std::memory_order_relaxed);
+    while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+  }
+
+  size_t limit_;
+  std::atomic<size_t> used_{0};
+  std::atomic<size_t> peak_{0};
+};
+
+/**
+ * @description: 一个算子（或线程）从MemoryTracker中占用的内存。按MEMORY_RESERVE_CHUNK成块申请，
+ * 在已经申请到的范围内增长不访问共享的计数；析构或reset时归还。没有MemoryTracker时不限制
+ */
+class MemoryReservation {
+ public:
+  MemoryReservation() = default;
+
+  explicit MemoryReservation(MemoryTracker* tracker) : tracker_(tracker) {}
+
+  MemoryReservation(const MemoryReservation&) = delete;
+  MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+  ~MemoryReservation() { reset(); }
+
+  void set_tracker(MemoryTracker* tracker) {
+    reset();
+    tracker_ = tracker;
+  }
+
+  // 把占用的内存增加到bytes，超出预算时不变并返回false
+  bool grow_to(size_t bytes) {
+    if (bytes <= reserved_ || tracker_ == nullptr) {
+      return true;
+    }
+    size_t target = round_up(bytes);
+    if (!tracker_->try_reserve(target - reserved_)) {
+      return false;
+    }
+    reserved_ = target;
+    return true;
+  }
+
+  // 不检查预算把占用的内存增加到bytes，例如溢出后读回一个分区
+  void force_grow_to(size_t bytes) {
+    if (bytes <= reserved_ || tracker_ == nullptr) {
+      return;
+    }
+    size_t target = round_up(bytes);
+    tracker_->force_reserve(target - reserved_);
+    reserved_ = target;
+  }
+
+  void reset() {
+    if (tracker_ != nullptr && reserved_ > 0) {
+      tracker_->release(reserved_);
+    }
+    reserved_ = 0;
+  }
+
+  size_t reserved() const { return reserved_; }
+
+ private:
+  static size_t round_up(size_t bytes) {
+    return (bytes + MEMORY_RESERVE_CHUNK - 1) / MEMORY_RESERVE_CHUNK *
+           MEMORY_RESERVE_CHUNK;
+  }
+
+  MemoryTracker* tracker_ = nullptr;
+  size_t reserved_ = 0;
+};
@@ -0,0 +1,274 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/config.h"
+
+/* 分别统计延迟的语句类型 */
+enum class StmtKind { SELECT = 0, INSERT, UPDATE, DELETE, DDL, TXN, OTHER, NUM };
+
+/* 语句执行的阶段：词法语法解析；语义分析和优化；执行 */
+enum class StmtPhase { PARSE = 0, PLAN, EXECUTE, NUM };
+
+/* 服务器的全局计数器 */
+enum class MetricCounter {
+  STATEMENT_ERRORS = 0,  // 出错或者回滚的语句
+  COMMITS,
+  ABORTS,                // 所有回滚，包括客户端的ROLLBACK
+  BYTES_SENT,            // 发给客户端的结果字节数
+  RESULT_CACHE_HITS,     // 直接用结果缓存回复的SELECT
+  NUM
+};
+
+/* 一个样本：Prometheus文本格式中的一行，SHOW STATUS中的一行 */
+struct MetricSample {
+  std::string name;
+  std::string labels;          // 例如 type="select"，没有标签时为空
+  double value;
+  const char* type = nullptr;  // counter、gauge或summary，和上一个样本同属一个指标时为空
+};
+
+/**
+ * @description: 微秒为单位的延迟直方图，按HDR直方图的方式分桶：每个2的幂区间分成16个桶，相对误差不超过1/16，
+ * 最多记录到2^40微秒。记录时只对当前线程所在条带上的计数做一次relaxed原子加，不同线程的记录互不争用，
+ * 读取时把所有条带加起来，不是同一时刻的快照
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int SUB_BITS = 4;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr int MAX_BITS = 40;
+  static constexpr int NUM_BUCKETS = SUB_BUCKETS * (MAX_BITS - SUB_BITS + 1);
+
+  /* 所有条带加起来的结果 */
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, NUM_BUCKETS> buckets{};
+
+    // 第p百分位数所在桶的上界，没有记录时为0
+    uint64_t percentile(double p) const {
+      if (count == 0) {
+        return 0;
+      }
+      uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100 * count + 0.5));
+      uint64_t seen = 0;
+      for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+          return std::min(bucket_upper(i), max);
+        }
+      }
+      return max;
+    }
+  };
+
+  void record(uint64_t us) {
+    auto& stripe = stripes_[metrics_stripe()];
+    stripe.buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = stripe.max.load(std::memory_order_relaxed);
+    while (us > max &&
+           !stripe.max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  Snapshot snapshot() const {
+    Snapshot res;
+    for (auto& stripe : stripes_) {
+      for (int i = 0; i < NUM_BUCKETS; ++i) {
+        uint64_t n = stripe.buckets[i].load(std::memory_order_relaxed);
+        res.buckets[i] += n;
+        res.count += n;
+      }
+      res.sum += stripe.sum.load(std::memory_order_relaxed);
+      res.max = std::max(res.max, stripe.max.load(std::memory_order_relaxed));
+    }
+    return res;
+  }
+
+  // 当前线程使用的条带，线程第一次记录时轮流分配
+  static size_t metrics_stripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % METRICS_STRIPES;
+    return stripe;
+  }
+
+ private:
+  // 小于2 * SUB_BUCKETS的值各占一个桶，更大的值按最高位所在的2的幂区间和其后SUB_BITS位分桶
+  static int bucket_of(uint64_t us) {
+    us = std::min<uint64_t>(us, (1ULL << MAX_BITS) - 1);
+    if (us < SUB_BUCKETS) {
+      return static_cast<int>(us);
+    }
+    int e = 63 - __builtin_clzll(us);
+    return SUB_BUCKETS * e + static_cast<int>(us >> (e - SUB_BITS)) - SUB_BUCKETS * SUB_BITS;
+  }
+
+  static uint64_t bucket_upper(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+      return bucket;
+    }
+    int e = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << (e - SUB_BITS)) - 1;
+  }
+
+  struct alignas(64) Stripe {
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+  };
+
+  std::array<Stripe, METRICS_STRIPES> stripes_{};
+};
+
+/**
+ * @description: 全局的运行指标：按语句类型的延迟、各阶段的耗时、提交回滚次数和发送的字节数。
+ * 计数器和直方图一样按线程分条带累加。缓冲池和锁的统计由它们自己维护，输出时再合并进来
+ */
+class Metrics {
+ public:
+  // 回滚原因的数量和名字，和AbortReason的顺序一致
+  static constexpr int NUM_ABORT_REASONS = 7;
+
+  static Metrics& instance() {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  void add(MetricCounter counter, uint64_t n = 1) {
+    counters_[LatencyHistogram::metrics_stripe()].values[static_cast<int>(counter)].fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
+  // 因为异常而回滚的事务，reason是AbortReason的值
+  void add_abort_reason(int reason) {
+    if (reason >= 0 && reason < NUM_ABORT_REASONS) {
+      counters_[LatencyHistogram::metrics_stripe()].abort_reasons[reason].fetch_add(
+          1, std::memory_order_relaxed);
+    }
+  }
+
+  void record_statement(StmtKind kind, uint64_t us) { statements_[static_cast<int>(kind)].record(us); }
+
+  void record_phase(StmtPhase phase, uint64_t us) { phases_[static_cast<int>(phase)].record(us); }
+
+  // 把所有指标按Prometheus的命名追加到samples中，直方图输出为summary
+  void collect(std::vector<MetricSample>& samples) const {
+    static const char* const stmt_names[] = {"select", "insert", "update", "delete", "ddl", "txn", "other"};
+    static const char* const phase_names[] = {"parse", "plan", "execute"};
+    static const char* const abort_names[] = {"lock_on_shrinking", "upgrade_conflict", "deadlock_prevention",
+                                              "deadlock_detected", "validation_failed",
+                                              "statement_timeout", "statement_canceled"};
+
+    std::array<uint64_t, static_cast<int>(MetricCounter::NUM)> counters{};
+    std::array<uint64_t, NUM_ABORT_REASONS> aborts{};
+    for (auto& stripe : counters_) {
+      for (size_t i = 0; i < counters.size(); ++i) {
+        counters[i] += stripe.values[i].load(std::memory_order_relaxed);
+      }
+      for (int i = 0; i < NUM_ABORT_REASONS; ++i) {
+        aborts[i] += stripe.abort_reasons[i].load(std::memory_order_relaxed);
+      }
+    }
+
+    collect_summary(samples, "rmdb_statement_latency_us", "type", stmt_names, statements_.data(),
+                    statements_.size());
+    collect_summary(samples, "rmdb_phase_latency_us", "phase", phase_names, phases_.data(), phases_.size());
+    samples.push_back({"rmdb_statement_errors_total", "",
+                       static_cast<double>(counters[static_cast<int>(MetricCounter::STATEMENT_ERRORS)]), "counter"});
+    samples.push_back(
+        {"rmdb_commits_total", "", static_cast<double>(counters[static_cast<int>(MetricCounter::COMMITS)]), "counter"});
+    samples.push_back(
+        {"rmdb_aborts_total", "", static_cast<double>(counters[static_cast<int>(MetricCounter::ABORTS)]), "counter"});
+    for (int i = 0; i < NUM_ABORT_REASONS; ++i) {
+      samples.push_back({"rmdb_aborts_by_reason_total", std::string("reason=\"") + abort_names[i] + "\"",
+                         static_cast<double>(aborts[i]), i == 0 ? "counter" : nullptr});
+    }
+    samples.push_back({"rmdb_bytes_sent_total", "",
+                       static_cast<double>(counters[static_cast<int>(MetricCounter::BYTES_SENT)]), "counter"});
+    samples.push_back({"rmdb_result_cache_hits_total", "",
+                       static_cast<double>(counters[static_cast<int>(MetricCounter::RESULT_CACHE_HITS)]), "counter"});
+  }
+
+ private:
+  Metrics() = default;
+
+  // 每个直方图输出几个分位数、总和、次数和最大值
+  static void collect_summary(std::vector<MetricSample>& samples, const std::string& name, const char* label,
+                              const char* const* label_values, const LatencyHistogram* hists, size_t n) {
+    static const double quantiles[] = {50, 90, 99, 99.9};
+    static const char* const quantile_names[] = {"0.5", "0.9", "0.99", "0.999"};
+    std::vector<uint64_t> maxes;
+    for (size_t i = 0; i < n; ++i) {
+      auto snapshot = hists[i].snapshot();
+      maxes.push_back(snapshot.max);
+      std::string base = std::string(label) + "=\"" + label_values[i] + "\"";
+      for (int q = 0; q < 4; ++q) {
+        samples.push_back({name, base + ",quantile=\"" + quantile_names[q] + "\"",
+                           static_cast<double>(snapshot.percentile(quantiles[q])),
+                           i == 0 && q == 0 ? "summary" : nullptr});
+      }
+      samples.push_back({name + "_sum", base, static_cast<double>(snapshot.sum)});
+      samples.push_back({name + "_count", base, static_cast<double>(snapshot.count)});
+    }
+    for (size_t i = 0; i < n; ++i) {
+      samples.push_back({name + "_max", std::string(label) + "=\"" + label_values[i] + "\"",
+                         static_cast<double>(maxes[i]), i == 0 ? "gauge" : nullptr});
+    }
+  }
+
+  struct alignas(64) CounterStripe {
+    std::array<std::atomic<uint64_t>, static_cast<int>(MetricCounter::NUM)> values{};
+    std::array<std::atomic<uint64_t>, NUM_ABORT_REASONS> abort_reasons{};
+  };
+
+  std::array<LatencyHistogram, static_cast<int>(StmtKind::NUM)> statements_;
+  std::array<LatencyHistogram, static_cast<int>(StmtPhase::NUM)> phases_;
+  std::array<CounterStripe, METRICS_STRIPES> counters_{};
+};
+
+// 从start到现在经过的微秒数
+inline uint64_t elapsed_us(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 按Prometheus的文本格式输出样本
+inline std::string format_prometheus(const std::vector<MetricSample>& samples) {
+  std::string res;
+  char value[64];
+  for (auto& sample : samples) {
+    if (sample.type != nullptr) {
+      res += "# TYPE " + sample.name + " " + sample.type + "\n";
+    }
+    res += sample.name;
+    if (!sample.labels.empty()) {
+      res += "{" + sample.labels + "}";
+    }
+    snprintf(value, sizeof(value), " %.17g\n", sample.value);
+    res += value;
+  }
+  return res;
+}
@@ -0,0 +1,191 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "common/config.h"
+
+/**
+ * @description: output.txt的异步写入。各个客户端线程把要写的内容放进无锁的多生产者单消费者队列后立即返回，
+ * 后台线程取出后拼到一块大缓冲区里，攒够OUTPUT_FILE_BUFFER_SIZE或者队列空了时一次write到文件。
+ * 文件只在第一次写入时打开一次（此时已经切换到数据库目录），之后一直追加。
+ * 同一次append的内容在文件中是连续的，不同线程之间按入队的顺序。慢查询日志也用同样的方式写入
+ */
+class OutputWriter {
+ public:
+  static OutputWriter& instance() {
+    static OutputWriter writer("output.txt");
+    return writer;
+  }
+
+  static OutputWriter& slow_query_log() {
+    static OutputWriter writer("slow_query.log");
+    return writer;
+  }
+
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+
+  ~OutputWriter() {
+    flush();
+    stop_ = true;
+    wake();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    while (Node* node = pop()) {
+      delete node;
+    }
+    delete tail_;
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  void append(std::string str) {
+    if (str.empty()) {
+      return;
+    }
+    start();
+    Node* node = new Node;
+    node->data = std::move(str);
+    pushed_.fetch_add(1);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node);
+    if (sleeping_.load()) {
+      wake();
+    }
+  }
+
+  // 等到目前为止入队的内容都写进文件，进程退出和关闭数据库前调用
+  void flush() {
+    if (!started_.load()) {
+      return;
+    }
+    size_t target = pushed_.load();
+    std::unique_lock lock(latch_);
+    flushed_cv_.wait(lock, [&] { return written_ >= target; });
+  }
+
+ private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    std::string data;
+  };
+
+  explicit OutputWriter(const char* file_name) : file_name_(file_name) {
+    // 队列中始终有一个已经取过的哑节点，tail_指向它
+    tail_ = new Node;
+    head_.store(tail_);
+  }
+
+  void start() {
+    if (started_.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::lock_guard lock(latch_);
+    if (!started_.load()) {
+      thread_ = std::thread([this] { run(); });
+      started_.store(true, std::memory_order_release);
+    }
+  }
+
+  void wake() {
+    std::lock_guard lock(latch_);
+    cv_.notify_one();
+  }
+
+  // 只有后台线程调用。返回的节点已经成为新的哑节点的前一个，调用者负责释放
+  Node* pop() {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return nullptr;
+    }
+    tail_ = next;
+    tail->data = std::move(next->data);
+    return tail;
+  }
+
+  void run() {
+    std::string buffer;
+    buffer.reserve(OUTPUT_FILE_BUFFER_SIZE);
+    size_t taken = 0;
+    while (true) {
+      Node* node;
+      while (buffer.size() < OUTPUT_FILE_BUFFER_SIZE &&
+             (node = pop()) != nullptr) {
+        buffer += node->data;
+        delete node;
+        ++taken;
+      }
+      if (!buffer.empty()) {
+        write_out(buffer);
+        buffer.clear();
+        std::lock_guard lock(latch_);
+        written_ = taken;
+        flushed_cv_.notify_all();
+        continue;
+      }
+      std::unique_lock lock(latch_);
+      sleeping_.store(true);
+      // 入队发生在设置sleeping_之前的话，这里能看到；之后的话，生产者会来唤醒
+      if (tail_->next.load() == nullptr) {
+        if (stop_) {
+          sleeping_.store(false);
+          return;
+        }
+        cv_.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      sleeping_.store(false);
+    }
+  }
+
+  void write_out(const std::string& buffer) {
+    if (fd_ < 0) {
+      fd_ = open(file_name_, O_WRONLY | O_CREAT | O_APPEND, 0644);
+      if (fd_ < 0) {
+        return;
+      }
+    }
+    size_t done = 0;
+    while (done < buffer.size()) {
+      ssize_t n = write(fd_, buffer.data() + done, buffer.size() - done);
+      if (n <= 0) {
+        return;
+      }
+      done += static_cast<size_t>(n);
+    }
+  }
+
+  const char* file_name_;
+  std::atomic<Node*> head_;  // 生产者从这里入队
+  Node* tail_;               // 只有后台线程访问
+  std::atomic<size_t> pushed_{0};
+  std::atomic<bool> started_{false};
+  std::atomic<bool> sleeping_{false};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+  std::mutex latch_;  // 保护written_，以及睡眠和唤醒
+  std::condition_variable cv_;
+  std::condition_variable flushed_cv_;
+  size_t written_ = 0;  // 已经写进文件的节点数
+  int fd_ = -1;
+};
@@ -0,0 +1,187 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/config.h"
+#include "transaction/txn_defs.h"
+
+/**
+ * @description: 一个会话上正在执行的语句的取消状态。KILL把它标记为取消，statement_timeout给每条语句一个截止时间。
+ * 执行语句的线程在语句期间把它设为本线程的当前语句，执行器的循环、排序和落盘的循环调用check_cancel()，
+ * 锁等待定期调用cancelled()；发现取消或超时时抛出TransactionAbortException，按事务回滚的路径释放锁和页面。
+ * 并行扫描的工作线程上没有当前语句，由发起扫描的线程在每一轮之间检查
+ */
+class StatementCancel {
+ public:
+  // 一条被执行中的语句的信息，SHOW SESSIONS使用
+  struct Info {
+    uint64_t session_id;
+    txn_id_t txn_id;
+    uint64_t running_us;  // 语句已经执行的时间，空闲的会话为0
+    std::string sql;      // 空闲的会话为空
+  };
+
+  explicit StatementCancel(uint64_t session_id) : session_id_(session_id) {
+    std::lock_guard lock(registry_mutex());
+    registry()[session_id_] = this;
+  }
+
+  ~StatementCancel() {
+    std::lock_guard lock(registry_mutex());
+    registry().erase(session_id_);
+  }
+
+  StatementCancel(const StatementCancel&) = delete;
+  StatementCancel& operator=(const StatementCancel&) = delete;
+
+  // 之后的语句的超时，单位毫秒，0表示不限制
+  void set_timeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  // 语句开始执行：清掉上一条语句的取消标记，按当前的超时设置截止时间
+  void begin(txn_id_t txn_id, const std::string& sql) {
+    uint64_t now = now_us();
+    deadline_us_ = timeout_ms_ > 0 ? now + static_cast<uint64_t>(timeout_ms_) * 1000 : 0;
+    ticks_ = 0;
+    killed_.store(false, std::memory_order_relaxed);
+    std::lock_guard lock(mutex_);
+    txn_id_ = txn_id;
+    start_us_ = now;
+    sql_ = sql;
+  }
+
+  void end() {
+    std::lock_guard lock(mutex_);
+    start_us_ = 0;
+    sql_.clear();
+  }
+
+  // 取消当前正在执行的语句，会话空闲时没有效果
+  void kill() { killed_.store(true, std::memory_order_relaxed); }
+
+  // 语句是否被取消或者已经超时，每次都读时钟，用于锁等待这样本来就慢的地方
+  bool cancelled(AbortReason* reason) {
+    if (killed_.load(std::memory_order_relaxed)) {
+      *reason = AbortReason::STATEMENT_CANCELED;
+      return true;
+    }
+    if (deadline_us_ != 0 && now_us() >= deadline_us_) {
+      *reason = AbortReason::STATEMENT_TIMEOUT;
+      return true;
+    }
+    return false;
+  }
+
+  // 在逐条记录或逐批的循环中调用：取消标记每次都检查，时钟每CANCEL_CHECK_TICKS次才读一次
+  void check() {
+    AbortReason reason;
+    if (killed_.load(std::memory_order_relaxed) ||
+        (deadline_us_ != 0 && ++ticks_ % CANCEL_CHECK_TICKS == 0)) {
+      if (cancelled(&reason)) {
+        throw TransactionAbortException(txn_id_, reason);
+      }
+    }
+  }
+
+  // 本线程正在执行的语句，没有时为nullptr
+  static StatementCancel*& current() {
+    thread_local StatementCancel* statement = nullptr;
+    return statement;
+  }
+
+  // 取消会话session_id上正在执行的语句，没有这个会话时返回false
+  static bool kill(uint64_t session_id) {
+    std::lock_guard lock(registry_mutex());
+    auto it = registry().find(session_id);
+    if (it == registry().end()) {
+      return false;
+    }
+    it->second->kill();
+    return true;
+  }
+
+  // 所有会话和它们正在执行的语句，按会话编号排序
+  static void list(std::vector<Info>& infos) {
+    uint64_t now = now_us();
+    std::lock_guard lock(registry_mutex());
+    infos.clear();
+    for (auto& [session_id, statement] : registry()) {
+      std::lock_guard statement_lock(statement->mutex_);
+      bool running = statement->start_us_ != 0;
+      infos.push_back({session_id, running ? statement->txn_id_ : INVALID_TXN_ID,
+                       running ? now - statement->start_us_ : 0, statement->sql_});
+    }
+    std::sort(infos.begin(), infos.end(),
+              [](const Info& a, const Info& b) { return a.session_id < b.session_id; });
+  }
+
+ private:
+  static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static std::mutex& registry_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::unordered_map<uint64_t, StatementCancel*>& registry() {
+    static std::unordered_map<uint64_t, StatementCancel*> statements;
+    return statements;
+  }
+
+  uint64_t session_id_;
+  int timeout_ms_ = 0;
+  std::atomic<bool> killed_{false};
+  // 以下两个只由执行语句的线程访问
+  uint64_t deadline_us_ = 0;  // 0表示没有截止时间
+  uint64_t ticks_ = 0;
+
+  std::mutex mutex_;  // 保护下面给SHOW SESSIONS看的字段
+  txn_id_t txn_id_ = INVALID_TXN_ID;
+  uint64_t start_us_ = 0;  // 语句开始的时间，0表示会话空闲
+  std::string sql_;
+};
+
+// 本线程上正在执行的语句被取消或者超时时抛出TransactionAbortException
+inline void check_cancel() {
+  if (StatementCancel* statement = StatementCancel::current()) {
+    statement->check();
+  }
+}
+
+/* 在作用域内把statement设为本线程的当前语句 */
+class StatementCancelScope {
+ public:
+  StatementCancelScope(StatementCancel* statement, txn_id_t txn_id, const std::string& sql)
+      : statement_(statement) {
+    statement_->begin(txn_id, sql);
+    StatementCancel::current() = statement_;
+  }
+
+  ~StatementCancelScope() {
+    StatementCancel::current() = nullptr;
+    statement_->end();
+  }
+
+ private:
+  StatementCancel* statement_;
+};
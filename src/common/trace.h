@@ -0,0 +1,43 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+/**
+ * USDT静态探针，provider为rmdb。用 cmake -DENABLE_USDT=ON 编译时展开为sys/sdt.h（systemtap-sdt-dev）的探针，
+ * 没有挂载时只是一条nop，参数只在探针处求值；默认不编译进来，宏展开为空，参数不求值。
+ * 在线上用bpftrace或perf挂载，例如：
+ *   bpftrace -e 'usdt:./rmdb:rmdb:lock__wait__done { @us = hist(arg2); }'
+ *   perf probe -x ./rmdb sdt_rmdb:disk__read__done && perf record -e sdt_rmdb:disk__read__done
+ *
+ * 探针和参数：
+ *   buffer__miss(fd, page_no)                 fetch_page未命中，开始找帧并读盘
+ *   buffer__miss__done(fd, page_no)           未命中的页面已经读入缓冲池
+ *   buffer__evict(fd, page_no, dirty)         帧被复用，换出原来的页面；空闲帧的page_no为-1
+ *   disk__read__start(fd, page_no, bytes)     DiskManager::read_page
+ *   disk__read__done(fd, page_no, bytes)
+ *   disk__write__start(fd, page_no, bytes)    DiskManager::write_page
+ *   disk__write__done(fd, page_no, bytes)
+ *   lock__wait__start(txn_id, lock_type)      锁不相容，开始等待；lock_type为LockDataType
+ *   lock__wait__done(txn_id, lock_type, us)   等待结束（拿到锁或者被选为牺牲者），us为等待的微秒数
+ *   log__flush__start(bytes)                  日志缓冲区写盘并fsync
+ *   log__flush__done(bytes, persist_lsn)
+ *   executor__open(portal_tag, root)          语句的算子树开始执行，root为根算子的地址
+ *   executor__close(portal_tag, root)         算子树执行完（抛出异常时没有）
+ */
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#define RMDB_PROBE(name, ...) STAP_PROBEV(rmdb, name, ##__VA_ARGS__)
+#else
+#define RMDB_PROBE(name, ...) \
+  do {                        \
+  } while (0)
+#endif
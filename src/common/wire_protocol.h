@@ -0,0 +1,86 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @description: 分帧的二进制协议，服务端和rmdb_client共用。
+ * 客户端连接后先发送WIRE_MAGIC（文本协议的请求不会以'\0'开头，服务端据此区分两种协议），之后双方都按帧收发：
+ * WIRE_HEADER_SIZE字节的帧头（网络字节序的负载长度、语句编号、消息类型）后面跟着负载。
+ * 客户端可以连续发送多条QUERY而不等待回复，服务端按发送的顺序执行，
+ * 每条语句的结果分成若干RESULT_CHUNK，以RESULT_END结束，都带着语句的编号
+ */
+static constexpr char WIRE_MAGIC[4] = {'\0', 'R', 'M', 'B'};
+static constexpr size_t WIRE_HEADER_SIZE = 12;
+static constexpr uint32_t WIRE_MAX_PAYLOAD = 64 << 20;  // 一帧的负载上限，超过时关闭连接
+
+enum class WireType : uint8_t {
+  QUERY = 1,         // 客户端：负载是一条SQL语句，不需要以'\0'结尾
+  RESULT_CHUNK = 2,  // 服务端：语句结果的一部分
+  RESULT_END = 3     // 服务端：语句结果的最后一部分，可以为空
+};
+
+struct WireHeader {
+  uint32_t length;   // 负载长度
+  uint32_t stmt_id;  // 客户端给语句的编号，结果原样带回
+  WireType type;
+};
+
+inline void encode_wire_header(char* buf, const WireHeader& header) {
+  uint32_t length = htonl(header.length);
+  uint32_t stmt_id = htonl(header.stmt_id);
+  memcpy(buf, &length, 4);
+  memcpy(buf + 4, &stmt_id, 4);
+  buf[8] = static_cast<char>(header.type);
+  memset(buf + 9, 0, WIRE_HEADER_SIZE - 9);
+}
+
+inline WireHeader decode_wire_header(const char* buf) {
+  uint32_t length;
+  uint32_t stmt_id;
+  memcpy(&length, buf, 4);
+  memcpy(&stmt_id, buf + 4, 4);
+  return {ntohl(length), ntohl(stmt_id), static_cast<WireType>(buf[8])};
+}
+
+// 发送一帧，帧头和负载用一次writev发出，写不完时继续写剩下的部分；失败时返回false
+inline bool send_wire_frame(int fd, WireType type, uint32_t stmt_id,
+                            const char* data, uint32_t length) {
+  char header[WIRE_HEADER_SIZE];
+  encode_wire_header(header, {length, stmt_id, type});
+  iovec iov[2] = {{header, WIRE_HEADER_SIZE},
+                  {const_cast<char*>(data), length}};
+  int iov_idx = 0;
+  while (iov_idx < 2) {
+    ssize_t n = writev(fd, iov + iov_idx, 2 - iov_idx);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    while (iov_idx < 2 && static_cast<size_t>(n) >= iov[iov_idx].iov_len) {
+      n -= iov[iov_idx].iov_len;
+      ++iov_idx;
+    }
+    if (iov_idx < 2) {
+      iov[iov_idx].iov_base = static_cast<char*>(iov[iov_idx].iov_base) + n;
+      iov[iov_idx].iov_len -= n;
+    }
+  }
+  return true;
+}
@@ -43,6 +43,12 @@ struct Rid {
 
 enum ColType { TYPE_INT, TYPE_FLOAT, TYPE_STRING };
 
+// 索引的组织方式：B+树支持范围查找，哈希只支持所有字段都是等值条件的查找
+enum IndexType { INDEX_BTREE, INDEX_HASH, INDEX_ART };
+
+// 会话的负载类别：分析类（报表等长语句）限制同时执行的工作线程数，I/O优先级较低，扫描更早改用环形缓冲区
+enum WorkloadClass { WORKLOAD_OLTP, WORKLOAD_ANALYTICS };
+
 inline std::string coltype2str(ColType type) {
   std::map<ColType, std::string> m = {
       {TYPE_INT, "INT"}, {TYPE_FLOAT, "FLOAT"}, {TYPE_STRING, "STRING"}};
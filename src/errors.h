@@ -182,6 +182,11 @@ class IncompatibleTypeError : public RMDBError {
       : RMDBError("Incompatible type error: lhs " + lhs + ", rhs " + rhs) {}
 };
 
+class DivisionByZeroError : public RMDBError {
+ public:
+  DivisionByZeroError() : RMDBError("Division by zero") {}
+};
+
 class AmbiguousColumnError : public RMDBError {
  public:
   AmbiguousColumnError(const std::string& col_name)
@@ -194,3 +199,10 @@ class PageNotExistError : public RMDBError {
       : RMDBError("Page " + std::to_string(page_no) + " in table " +
                   table_name + " not exits") {}
 };
+
+class DictionaryFullError : public RMDBError {
+ public:
+  DictionaryFullError(const std::string& table_name)
+      : RMDBError("Too many distinct values in a dictionary column of table " +
+                  table_name) {}
+};
@@ -0,0 +1,166 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "tuple_batch.h"
+
+/**
+ * @description: 不分组聚合的向量化内核。先把一批记录中的一个int/float字段取到连续的数组里，
+ * 再一次求出这批的SUM/MIN/MAX；有AVX2时每条指令处理8个值，否则是编译器可以自动向量化的循环。
+ * int的SUM和逐条相加一样按32位回绕；float的SUM改变了相加的顺序，结果可能和逐条相加差在最后几位
+ */
+namespace agg_kernels {
+
+// 把batch中每条记录offset处的值按顺序取到out中
+template <typename T>
+inline void gather(const TupleBatch& batch, int offset, T* out) {
+  for (size_t r = 0; r < batch.size(); ++r) {
+    memcpy(out + r, batch.row(r) + offset, sizeof(T));
+  }
+}
+
+#ifdef __AVX2__
+inline int hsum(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+inline float hsum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+#endif
+
+// 以下函数要求n > 0
+inline int sum(const int* v, size_t n) {
+  size_t i = 0;
+  unsigned res = 0;  // 无符号数按位回绕，避免有符号溢出
+#ifdef __AVX2__
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)));
+  }
+  res = static_cast<unsigned>(hsum(acc));
+#endif
+  for (; i < n; ++i) {
+    res += static_cast<unsigned>(v[i]);
+  }
+  return static_cast<int>(res);
+}
+
+inline float sum(const float* v, size_t n) {
+  size_t i = 0;
+  float res = 0;
+#ifdef __AVX2__
+  __m256 acc = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_ps(acc, _mm256_loadu_ps(v + i));
+  }
+  res = hsum(acc);
+#endif
+  for (; i < n; ++i) {
+    res += v[i];
+  }
+  return res;
+}
+
+inline int min(const int* v, size_t n) {
+  size_t i = 0;
+  int res = v[0];
+#ifdef __AVX2__
+  if (n >= 8) {
+    __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v));
+    for (i = 8; i + 8 <= n; i += 8) {
+      acc = _mm256_min_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)));
+    }
+    alignas(32) int lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    res = *std::min_element(lanes, lanes + 8);
+  }
+#endif
+  for (; i < n; ++i) {
+    res = std::min(res, v[i]);
+  }
+  return res;
+}
+
+inline int max(const int* v, size_t n) {
+  size_t i = 0;
+  int res = v[0];
+#ifdef __AVX2__
+  if (n >= 8) {
+    __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v));
+    for (i = 8; i + 8 <= n; i += 8) {
+      acc = _mm256_max_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)));
+    }
+    alignas(32) int lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    res = *std::max_element(lanes, lanes + 8);
+  }
+#endif
+  for (; i < n; ++i) {
+    res = std::max(res, v[i]);
+  }
+  return res;
+}
+
+inline float min(const float* v, size_t n) {
+  size_t i = 0;
+  float res = v[0];
+#ifdef __AVX2__
+  if (n >= 8) {
+    __m256 acc = _mm256_loadu_ps(v);
+    for (i = 8; i + 8 <= n; i += 8) {
+      acc = _mm256_min_ps(acc, _mm256_loadu_ps(v + i));
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, acc);
+    res = *std::min_element(lanes, lanes + 8);
+  }
+#endif
+  for (; i < n; ++i) {
+    res = std::min(res, v[i]);
+  }
+  return res;
+}
+
+inline float max(const float* v, size_t n) {
+  size_t i = 0;
+  float res = v[0];
+#ifdef __AVX2__
+  if (n >= 8) {
+    __m256 acc = _mm256_loadu_ps(v);
+    for (i = 8; i + 8 <= n; i += 8) {
+      acc = _mm256_max_ps(acc, _mm256_loadu_ps(v + i));
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, acc);
+    res = *std::max_element(lanes, lanes + 8);
+  }
+#endif
+  for (; i < n; ++i) {
+    res = std::max(res, v[i]);
+  }
+  return res;
+}
+
+}  // namespace agg_kernels
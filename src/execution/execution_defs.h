@@ -10,6 +10,8 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <algorithm>
+
 #include "common/common.h"
 #include "defs.h"
 #include "errors.h"
@@ -109,3 +111,77 @@ static inline void add(char* a, const char* b, ColType col_type) {
       throw InternalError("Unexpected data type to add！");
   }
 }
+
+/**
+ * @description: 一张表上的OR条件组，每组中至少有一个条件成立才满足。组中的条件都是字段和同类型常量的比较，
+ * 构造时查好字段的偏移，逐条计算时不再按名字查找
+ */
+class OrFilter {
+ public:
+  OrFilter() = default;
+
+  OrFilter(const std::vector<OrCond>& or_conds, const std::vector<ColMeta>& cols) {
+    for (auto& or_cond : or_conds) {
+      std::vector<Term> group;
+      for (auto& cond : or_cond.conds) {
+        auto col = std::find_if(cols.begin(), cols.end(), [&](const ColMeta& c) {
+          return c.name == cond.lhs_col.col_name;
+        });
+        group.push_back({col->offset, col->len, col->type, cond.op, cond.rhs_val});
+        ref_cols_.push_back(cond.lhs_col);
+      }
+      groups_.push_back(std::move(group));
+    }
+  }
+
+  bool empty() const { return groups_.empty(); }
+
+  // 条件中用到的字段，可能有重复
+  const std::vector<TabCol>& ref_cols() const { return ref_cols_; }
+
+  bool eval(const char* row) const {
+    for (auto& group : groups_) {
+      bool any = false;
+      for (auto& term : group) {
+        int cmp = compare(row + term.offset, term.rhs.raw.data(), term.len, term.type);
+        if (satisfies(cmp, term.op)) {
+          any = true;
+          break;
+        }
+      }
+      if (!any) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  struct Term {
+    int offset;
+    int len;
+    ColType type;
+    CompOp op;
+    Value rhs;
+  };
+
+  static bool satisfies(int cmp, CompOp op) {
+    switch (op) {
+      case OP_EQ:
+        return cmp == 0;
+      case OP_NE:
+        return cmp != 0;
+      case OP_LT:
+        return cmp < 0;
+      case OP_GT:
+        return cmp > 0;
+      case OP_LE:
+        return cmp <= 0;
+      default:
+        return cmp >= 0;
+    }
+  }
+
+  std::vector<std::vector<Term>> groups_;
+  std::vector<TabCol> ref_cols_;
+};
@@ -10,6 +10,14 @@ See the Mulan PSL v2 for more details. */
 
 #include "execution_manager.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <chrono>
+#include <string_view>
+
+#include "common/output_writer.h"
 #include "executor_delete.h"
 #include "executor_index_scan.h"
 #include "executor_insert.h"
@@ -19,14 +27,20 @@ See the Mulan PSL v2 for more details. */
 #include "executor_sortmerge_join.h"
 #include "executor_update.h"
 #include "index/ix.h"
+#include "mat_view.h"
+#include "morsel_scheduler.h"
+#include "optimizer/plan_cache.h"
 #include "record_printer.h"
+#include "recovery/backup.h"
 
 const char* help_info =
     "Supported SQL syntax:\n"
     "  command ;\n"
     "command:\n"
-    "  CREATE TABLE table_name (column_name type [, column_name type ...])\n"
+    "  CREATE [TEMPORARY | UNLOGGED] TABLE table_name (column_name type [, column_name type ...]) "
+    "[STORAGE = MEMORY]\n"
     "  DROP TABLE table_name\n"
+    "  TRUNCATE TABLE table_name\n"
     "  CREATE INDEX table_name (column_name)\n"
     "  DROP INDEX table_name (column_name)\n"
     "  INSERT INTO table_name VALUES (value [, value ...])\n"
@@ -88,12 +102,69 @@ char* my_itoa(int value, char* buff, int radix) {
   return buff;
 }
 
+// 按output.txt的格式把一行追加到out中："| a | b |\n"
+static void append_output_row(std::string& out,
+                              const std::vector<std::string>& row) {
+  out += '|';
+  for (auto& col : row) {
+    out += ' ';
+    out += col;
+    out += " |";
+  }
+  out += '\n';
+}
+
+constexpr size_t FORMAT_BUFFER_SIZE = 64;  // format_column格式化数字用的缓冲区大小
+
+/**
+ * @description: 把结果中的一个值格式化成显示的文本，和std::to_string的结果相同（浮点数保留6位小数），
+ * 数字用to_chars写进buf（至少FORMAT_BUFFER_SIZE字节），字符串直接引用记录中的数据，都不分配内存
+ */
+static std::string_view format_column(const ColMeta& col, const char* value,
+                                      char* buf) {
+  if (col.type == TYPE_INT) {
+    int v;
+    memcpy(&v, value, sizeof(v));
+    return {buf, static_cast<size_t>(
+                     std::to_chars(buf, buf + FORMAT_BUFFER_SIZE, v).ptr - buf)};
+  }
+  if (col.type == TYPE_FLOAT) {
+    float v;
+    memcpy(&v, value, sizeof(v));
+    return {buf, static_cast<size_t>(
+                     std::to_chars(buf, buf + FORMAT_BUFFER_SIZE, v,
+                                   std::chars_format::fixed, 6)
+                         .ptr -
+                     buf)};
+  }
+  return {value, strnlen(value, col.len)};
+}
+
 // 主要负责执行DDL语句
 void QlManager::run_mutli_query(std::shared_ptr<Plan>& plan, Context* context) {
   if (auto x = std::dynamic_pointer_cast<DDLPlan>(plan)) {
     switch (x->tag) {
       case T_CreateTable: {
-        sm_manager_->create_table(x->tab_name_, x->cols_, context);
+        if (x->partition_.is_partitioned()) {
+          sm_manager_->create_partitioned_table(x->tab_name_, x->cols_, x->partition_, context, x->format_,
+                                                x->persistence_, x->in_memory_, x->compressed_);
+          break;
+        }
+        sm_manager_->create_table(x->tab_name_, x->cols_, context, x->format_, x->persistence_, x->in_memory_,
+                                  x->compressed_);
+        break;
+      }
+      case T_CreateMatView: {
+        sm_manager_->create_mat_view(x->tab_name_, x->cols_, x->mat_view_, context);
+        // 基表持有表 S 锁，按其中已有的记录填入视图，之后的写由写算子维护
+        auto& base = sm_manager_->db_.get_table(x->mat_view_.base_tab);
+        RmFileHandle* fh = sm_manager_->get_fh(base.id);
+        MatViewMaintainer maintainer(sm_manager_, base, x->tab_name_, context);
+        for (RmScan scan(fh); !scan.is_end(); scan.next()) {
+          auto record = fh->get_record(scan.rid(), context, RM_LOCK_TABLE);
+          maintainer.add(record->data, 1);
+        }
+        maintainer.apply();
         break;
       }
       case T_DropTable: {
@@ -101,7 +172,7 @@ void QlManager::run_mutli_query(std::shared_ptr<Plan>& plan, Context* context) {
         break;
       }
       case T_CreateIndex: {
-        sm_manager_->create_index(x->tab_name_, x->tab_col_names_, context);
+        sm_manager_->create_index(x->tab_name_, x->tab_col_names_, context, x->index_type_);
         break;
       }
       case T_DropIndex: {
@@ -134,15 +205,68 @@ void QlManager::run_cmd_utility(std::shared_ptr<Plan>& plan,
         sm_manager_->show_indexs(x->tab_name_, context);
         break;
       }
+      case T_ShowBufferStatus: {
+        sm_manager_->show_buffer_status(context);
+        break;
+      }
+      case T_ShowLocks: {
+        sm_manager_->show_locks(context);
+        break;
+      }
+      case T_ShowLockStatus: {
+        sm_manager_->show_lock_status(context);
+        break;
+      }
+      case T_ShowStatus: {
+        sm_manager_->show_status(context);
+        break;
+      }
+      case T_ShowMemory: {
+        sm_manager_->show_memory(context);
+        break;
+      }
+      case T_ShowSessions: {
+        sm_manager_->show_sessions(context);
+        break;
+      }
       case T_DescTable: {
         sm_manager_->desc_table(x->tab_name_, context);
         break;
       }
+      case T_Vacuum: {
+        // 截断文件后无法再回滚到原来的记录位置，和其他语句放在同一个事务中时不执行
+        if (context->txn_->get_txn_mode()) {
+          throw RMDBError("VACUUM cannot run inside a transaction block");
+        }
+        sm_manager_->vacuum_table(x->tab_name_, context);
+        break;
+      }
+      case T_Truncate: {
+        // 换掉的文件无法回滚，和VACUUM一样不能放在事务中
+        if (context->txn_->get_txn_mode()) {
+          throw RMDBError("TRUNCATE cannot run inside a transaction block");
+        }
+        sm_manager_->truncate_table(x->tab_name_, context);
+        break;
+      }
+      case T_Analyze: {
+        sm_manager_->analyze_table(x->tab_name_, context);
+        break;
+      }
       case T_Transaction_begin: {
         // 显示开启一个事务
         context->txn_->set_txn_mode(true);
         break;
       }
+      case T_Transaction_begin_read_only: {
+        // 快照从BEGIN开始，事务中已经读写过的数据不在快照的保护之下
+        if (context->txn_->get_txn_mode()) {
+          throw RMDBError("BEGIN READ ONLY cannot run inside a transaction block");
+        }
+        context->txn_->set_txn_mode(true);
+        txn_mgr_->begin_read_only(context->txn_);
+        break;
+      }
       case T_Transaction_commit: {
         context->txn_ = txn_mgr_->get_transaction(*txn_id);
         txn_mgr_->commit(context->txn_, context->log_mgr_);
@@ -161,6 +285,18 @@ void QlManager::run_cmd_utility(std::shared_ptr<Plan>& plan,
       default:
         throw InternalError("Unexpected field type");
     }
+  } else if (auto x = std::dynamic_pointer_cast<CopyPlan>(plan)) {
+    copy_to(x->tab_name_, x->file_name_, x->binary_, context);
+  } else if (auto x = std::dynamic_pointer_cast<BackupPlan>(plan)) {
+    // 备份给各表加的IS锁随事务释放，放在事务中时DDL要一直等到事务结束
+    if (context->txn_->get_txn_mode()) {
+      throw RMDBError("BACKUP cannot run inside a transaction block");
+    }
+    backup_database(x->dir_, sm_manager_, txn_mgr_, context->log_mgr_, context);
+  } else if (auto x = std::dynamic_pointer_cast<KillPlan>(plan)) {
+    if (!StatementCancel::kill(x->session_id_)) {
+      throw RMDBError("No such session: " + std::to_string(x->session_id_));
+    }
   } else if (auto x = std::dynamic_pointer_cast<SetKnobPlan>(plan)) {
     switch (x->set_knob_type_) {
       case ast::SetKnobType::EnableOutputFile: {
@@ -169,10 +305,56 @@ void QlManager::run_cmd_utility(std::shared_ptr<Plan>& plan,
       }
       case ast::SetKnobType::EnableNestLoop: {
         planner_->set_enable_nestedloop_join(x->bool_value_);
+        sm_manager_->invalidate_plans();
         break;
       }
       case ast::SetKnobType::EnableSortMerge: {
         planner_->set_enable_sortmerge_join(x->bool_value_);
+        sm_manager_->invalidate_plans();
+        break;
+      }
+      case ast::SetKnobType::EnableHashJoin: {
+        planner_->set_enable_hash_join(x->bool_value_);
+        sm_manager_->invalidate_plans();
+        break;
+      }
+      case ast::SetKnobType::BufferPoolSize: {
+        // 单位为MB，缩容时被pin住的页面不会被释放
+        if (x->int_value_ <= 0) {
+          throw RMDBError("buffer_pool_size must be positive");
+        }
+        sm_manager_->get_bpm()->resize(static_cast<size_t>(x->int_value_) *
+                                       1024 * 1024 / PAGE_SIZE);
+        break;
+      }
+      case ast::SetKnobType::SynchronousCommit: {
+        // 对当前会话生效，也包括正在执行的事务
+        if (context->synchronous_commit_ != nullptr) {
+          *context->synchronous_commit_ = x->bool_value_;
+        }
+        context->txn_->set_synchronous_commit(x->bool_value_);
+        break;
+      }
+      case ast::SetKnobType::StatementTimeout: {
+        // 单位毫秒，0表示不限制，从当前会话的下一条语句开始生效
+        if (x->int_value_ < 0) {
+          throw RMDBError("statement_timeout must not be negative");
+        }
+        if (context->cancel_ != nullptr) {
+          context->cancel_->set_timeout(x->int_value_);
+        }
+        break;
+      }
+      case ast::SetKnobType::Workload: {
+        // 对当前会话之后的请求生效
+        if (context->workload_class_ != nullptr) {
+          *context->workload_class_ = static_cast<WorkloadClass>(x->int_value_);
+        }
+        break;
+      }
+      case ast::SetKnobType::EnableResultCache: {
+        // 对所有连接生效，关闭时清空
+        ResultCache::instance().set_enabled(x->bool_value_);
         break;
       }
       default: {
@@ -191,6 +373,12 @@ void QlManager::run_cmd_utility(std::shared_ptr<Plan>& plan,
     context->txn_ = txn_mgr_->get_transaction(*txn_id);
     txn_mgr_->commit(context->txn_, context->log_mgr_);
 
+#ifdef ENABLE_LOGGING
+    // 开启日志时使用模糊检查点，不需要停止其他事务，也不清空日志
+    txn_mgr_->create_fuzzy_checkpoint(context->log_mgr_);
+    return;
+#endif
+
     // 3.在日志文件中写入一个“检查点记录” 忽略
     // auto *static_checkpoint_log_record = new
     // StaticCheckpointLogRecord(context->txn_->get_transaction_id());
@@ -209,23 +397,162 @@ void QlManager::run_cmd_utility(std::shared_ptr<Plan>& plan,
       std::ignore = _;
       sm_manager_->get_ix_manager()->flush_index(ih.get());
     }
+    sm_manager_->dump_buffer_pool();
     // 直接把日志清空
-    // 如果日志文件已经开启，先关闭
-    auto disk_manager = sm_manager_->get_disk_manager();
-    auto log_fd = disk_manager->GetLogFd();
-    if (log_fd != -1) {
-      disk_manager->close_file(log_fd);
-      sm_manager_->get_disk_manager()->SetLogFd(-1);
-    }
-
-    std::ofstream ofs(LOG_FILE_NAME, std::ios::trunc);
-    ofs.close();
+    sm_manager_->get_disk_manager()->truncate_log();
 
     // exit(1);
     // 5.把日志文件中检查点记录的地址写到“重新启动文件”中 忽略
   }
 }
 
+// 二进制导出文件以它开头，之后是记录长度、字段数和每个字段的类型、长度（都是4字节整数），再之后是连续存放的记录
+static constexpr char COPY_BINARY_MAGIC[8] = {'R', 'M', 'D', 'B', 'C', 'O', 'P', 'Y'};
+
+static void write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw UnixError();
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+// 按LOAD的输入格式把一条记录追加成CSV中的一行：浮点数用能精确读回的最短形式，字符串去掉末尾的'\0'
+static void append_csv_row(std::string& out, const char* record,
+                           const std::vector<ColMeta>& cols) {
+  char num[32];
+  for (size_t i = 0; i < cols.size(); ++i) {
+    if (i > 0) {
+      out += ',';
+    }
+    const char* value = record + cols[i].offset;
+    if (cols[i].type == TYPE_INT) {
+      int v;
+      memcpy(&v, value, sizeof(v));
+      out.append(num, std::to_chars(num, num + sizeof(num), v).ptr);
+    } else if (cols[i].type == TYPE_FLOAT) {
+      float v;
+      memcpy(&v, value, sizeof(v));
+      out.append(num, std::to_chars(num, num + sizeof(num), v).ptr);
+    } else {
+      out.append(value, strnlen(value, cols[i].len));
+    }
+  }
+  out += '\n';
+}
+
+/**
+ * @description: COPY table TO 'file'。持有表级 S 锁，每一轮由morsel调度器并行格式化一批连续的页面范围（每个MORSEL_PAGES页），
+ * 每个范围写进自己的缓冲区，缓冲区在各轮之间复用；本线程再按页面顺序把缓冲区整块写到文件中。
+ * 读页面使用各参与者自己的环形缓冲区，不把共享缓冲池中的页面挤出去。
+ * CSV格式和LOAD的输入相同（第一行是字段名，字段中不能含有逗号和换行），导出的文件可以直接LOAD回去
+ * @return {size_t} 导出的记录数
+ */
+size_t QlManager::copy_to(const std::string& tab_name,
+                          const std::string& file_name, bool binary,
+                          Context* context) const {
+  if (!sm_manager_->db_.is_table(tab_name)) {
+    throw TableNotFoundError(tab_name);
+  }
+  auto& tab = sm_manager_->db_.get_table(tab_name);
+  if (tab.partition.is_partitioned()) {
+    throw RMDBError("COPY of partitioned table " + tab_name + " is not supported");
+  }
+  auto* fh = sm_manager_->fhs_.at(tab_name).get();
+  if (context != nullptr && context->lock_mgr_ != nullptr) {
+    context->lock_mgr_->lock_shared_on_table(context->txn_, fh->GetFd());
+  }
+  int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    throw UnixError();
+  }
+
+  const auto& file_hdr = fh->get_file_hdr();
+  std::string header;
+  if (binary) {
+    header.append(COPY_BINARY_MAGIC, sizeof(COPY_BINARY_MAGIC));
+    auto append_int = [&header](int v) {
+      header.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    };
+    append_int(file_hdr.record_size);
+    append_int(static_cast<int>(tab.cols.size()));
+    for (auto& col : tab.cols) {
+      append_int(col.type);
+      append_int(col.len);
+    }
+  } else {
+    for (size_t i = 0; i < tab.cols.size(); ++i) {
+      header += i > 0 ? "," : "";
+      header += tab.cols[i].name;
+    }
+    header += '\n';
+  }
+
+  size_t num_rows = 0;
+  try {
+    write_all(fd, header.data(), header.size());
+    int first_page = RM_FIRST_RECORD_PAGE;
+    int num_pages = file_hdr.num_pages;
+    size_t num_morsels =
+        std::max(0, num_pages - first_page + MORSEL_PAGES - 1) / MORSEL_PAGES;
+    auto& scheduler = MorselScheduler::instance();
+    size_t round = scheduler.num_workers();
+    std::vector<std::unique_ptr<BufferAccessStrategy>> strategies(round);
+    std::vector<std::string> bufs(round);
+    std::vector<size_t> rows(round);
+    for (size_t first = 0; first < num_morsels; first += round) {
+      size_t num = std::min(round, num_morsels - first);
+      scheduler.run(num, [&](size_t morsel, size_t worker) {
+        auto& strategy = strategies[worker];
+        if (strategy == nullptr) {
+          strategy =
+              std::make_unique<BufferAccessStrategy>(BULK_READ_RING_PAGES);
+        }
+        auto& out = bufs[morsel];
+        out.clear();
+        rows[morsel] = 0;
+        std::vector<char> record(file_hdr.record_size);
+        int begin =
+            first_page + static_cast<int>(first + morsel) * MORSEL_PAGES;
+        int end = std::min(num_pages, begin + MORSEL_PAGES);
+        int n = file_hdr.num_records_per_page;
+        for (int page_no = begin; page_no < end; ++page_no) {
+          auto&& page_handle = fh->fetch_page_handle(page_no, strategy.get());
+          for (int slot = Bitmap::first_bit(true, page_handle.bitmap, n);
+               slot < n;
+               slot = Bitmap::next_bit(true, page_handle.bitmap, n, slot)) {
+            const char* data = page_handle.get_record(slot, record.data());
+            if (binary) {
+              out.append(data, file_hdr.record_size);
+            } else {
+              append_csv_row(out, data, tab.cols);
+            }
+            ++rows[morsel];
+          }
+          sm_manager_->get_bpm()->unpin_page(page_handle.page, false);
+        }
+      });
+      for (size_t m = 0; m < num; ++m) {
+        write_all(fd, bufs[m].data(), bufs[m].size());
+        num_rows += rows[m];
+      }
+    }
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  if (close(fd) == -1) {
+    throw UnixError();
+  }
+  return num_rows;
+}
+
 // 执行select语句，select语句的输出除了需要返回客户端外，还需要写入output.txt文件中
 void QlManager::select_from(std::unique_ptr<AbstractExecutor>& executorTreeRoot,
                             std::vector<TabCol>& sel_cols, Context* context) {
@@ -240,54 +567,53 @@ void QlManager::select_from(std::unique_ptr<AbstractExecutor>& executorTreeRoot,
   rec_printer.print_separator(context);
   rec_printer.print_record(captions, context);
   rec_printer.print_separator(context);
-  // print header into file
-  std::fstream outfile;
-  if (planner_->enable_output_file) {
-    outfile.open("output.txt", std::ios::out | std::ios::app);
-    outfile << "|";
-    for (size_t i = 0; i < captions.size(); ++i) {
-      outfile << " " << captions[i] << " |";
-    }
-    outfile << "\n";
+  // print header into file，整条语句的输出攒在outfile中交给后台线程写入
+  bool to_file = planner_->enable_output_file;
+  std::string outfile;
+  if (to_file) {
+    append_output_row(outfile, captions);
   }
 
   // Print records
   size_t num_rec = 0;
-  std::vector<std::string> columns;
-  // 预留空间
-  columns.reserve(executorTreeRoot->cols().size());
-  // 执行query_plan
-  for (executorTreeRoot->beginTuple(); !executorTreeRoot->is_end();
-       executorTreeRoot->nextTuple()) {
-    columns.clear();
-    auto Tuple = executorTreeRoot->Next();
-    for (auto& col : executorTreeRoot->cols()) {
-      std::string col_str;
-      char* rec_buf = Tuple->data + col.offset;
-      if (col.type == TYPE_INT) {
-        col_str = std::to_string(*(int*)rec_buf);
-      } else if (col.type == TYPE_FLOAT) {
-        col_str = std::to_string(*(float*)rec_buf);
-      } else if (col.type == TYPE_STRING) {
-        col_str = std::string((char*)rec_buf, col.len);
-        col_str.resize(strlen(col_str.c_str()));
-      }
-      // 移动语义
-      columns.emplace_back(std::move(col_str));
-    }
-    // print record into buffer
-    rec_printer.print_record(columns, context);
-    // print record into file
-    if (planner_->enable_output_file) {
-      outfile << "|";
-      for (size_t i = 0; i < columns.size(); ++i) {
-        outfile << " " << columns[i] << " |";
-      }
-      outfile << "\n";
+  auto& cols = executorTreeRoot->cols();
+  char num[FORMAT_BUFFER_SIZE];
+  // 执行query_plan，按批取出结果。每个值只格式化一次，同时追加到发给客户端的行和output.txt的行中
+  TupleBatch batch;
+  executorTreeRoot->beginTuple();
+  while (executorTreeRoot->NextBatch(batch)) {
+    check_cancel();
+    for (size_t r = 0; r < batch.size(); ++r) {
+      const char* tuple = batch.row(r);
+      rec_printer.begin_row();
+      if (to_file) {
+        outfile += '|';
+      }
+      for (auto& col : cols) {
+        std::string_view col_str = format_column(col, tuple + col.offset, num);
+        rec_printer.add_column(col_str);
+        if (to_file) {
+          outfile += ' ';
+          outfile.append(col_str.data(), col_str.size());
+          outfile += " |";
+        }
+      }
+      // print record into buffer
+      rec_printer.end_row(context);
+      // print record into file
+      if (to_file) {
+        outfile += '\n';
+        if (outfile.size() >= OUTPUT_FILE_BUFFER_SIZE) {
+          OutputWriter::instance().append(std::move(outfile));
+          outfile.clear();
+        }
+      }
+      num_rec++;
     }
-    num_rec++;
   }
-  outfile.close();
+  if (to_file) {
+    OutputWriter::instance().append(std::move(outfile));
+  }
   // Print footer into buffer
   rec_printer.print_separator(context);
   // Print record count into buffer
@@ -297,6 +623,12 @@ void QlManager::select_from(std::unique_ptr<AbstractExecutor>& executorTreeRoot,
 // 执行select语句，select语句的输出除了需要返回客户端外，还需要写入output.txt文件中
 void QlManager::select_fast_count_star(int count, std::string& sel_col,
                                        Context* context) {
+  char buffer[20]{};
+  select_single_value(sel_col, my_itoa(count, buffer, 10), context);
+}
+
+void QlManager::select_single_value(std::string& sel_col, std::string value,
+                                    Context* context) {
   std::vector<std::string> captions;
   captions.emplace_back(std::move(sel_col));
 
@@ -305,34 +637,21 @@ void QlManager::select_fast_count_star(int count, std::string& sel_col,
   rec_printer.print_separator(context);
   rec_printer.print_record(captions, context);
   rec_printer.print_separator(context);
-  // print header into file
-  std::fstream outfile;
-  if (planner_->enable_output_file) {
-    outfile.open("output.txt", std::ios::out | std::ios::app);
-    outfile << "|";
-    for (size_t i = 0; i < captions.size(); ++i) {
-      outfile << " " << captions[i] << " |";
-    }
-    outfile << "\n";
-  }
 
   // Print records
   size_t num_rec = 1;
   std::vector<std::string> columns;
-  char buffer[20]{};
-  columns.emplace_back(my_itoa(count, buffer, 10));
+  columns.emplace_back(std::move(value));
 
   // print record into buffer
   rec_printer.print_record(columns, context);
-  // print record into file
+  // print header and record into file
   if (planner_->enable_output_file) {
-    outfile << "|";
-    for (size_t i = 0; i < columns.size(); ++i) {
-      outfile << " " << columns[i] << " |";
-    }
-    outfile << "\n";
+    std::string outfile;
+    append_output_row(outfile, captions);
+    append_output_row(outfile, columns);
+    OutputWriter::instance().append(std::move(outfile));
   }
-  outfile.close();
   // Print footer into buffer
   rec_printer.print_separator(context);
   // Print record count into buffer
@@ -343,3 +662,62 @@ void QlManager::select_fast_count_star(int count, std::string& sel_col,
 void QlManager::run_dml(std::unique_ptr<AbstractExecutor>& exec) {
   exec->Next();
 }
+
+void QlManager::explain(std::shared_ptr<Plan>& plan,
+                        std::unique_ptr<AbstractExecutor>& root,
+                        const std::shared_ptr<ExplainNode>& node,
+                        Context* context) {
+  auto x = std::dynamic_pointer_cast<ExplainPlan>(plan);
+  std::vector<std::string> lines;
+  if (!x->analyze_) {
+    std::string text = x->plan_tree_->toString();
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == std::string::npos) {
+        end = text.size();
+      }
+      if (end > pos) {
+        lines.push_back(text.substr(pos, end - pos));
+      }
+      pos = end + 1;
+    }
+  } else {
+    // 查询的结果丢弃，DML照常修改数据
+    auto start = std::chrono::steady_clock::now();
+    auto dml = std::dynamic_pointer_cast<DMLPlan>(x->subplan_);
+    if (dml != nullptr && dml->tag != T_select) {
+      run_dml(root);
+    } else {
+      TupleBatch batch;
+      root->beginTuple();
+      while (root->NextBatch(batch)) {
+        check_cancel();
+      }
+    }
+    double total_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count() /
+                      1e3;
+    if (node != nullptr) {
+      node->format(lines);
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Execution time: %.3fms", total_ms);
+    lines.emplace_back(buf);
+  }
+
+  RecordPrinter rec_printer(1);
+  rec_printer.print_separator(context);
+  rec_printer.print_record({"QUERY PLAN"}, context);
+  rec_printer.print_separator(context);
+  std::string outfile;
+  for (auto& line : lines) {
+    rec_printer.print_record({line}, context);
+    outfile += line + "\n";
+  }
+  rec_printer.print_separator(context);
+  if (planner_->enable_output_file) {
+    OutputWriter::instance().append(std::move(outfile));
+  }
+}
@@ -20,6 +20,7 @@ See the Mulan PSL v2 for more details. */
 #include "common/context.h"
 #include "execution_defs.h"
 #include "executor_abstract.h"
+#include "executor_explain.h"
 #include "optimizer/plan.h"
 #include "optimizer/planner.h"
 #include "record/rm.h"
@@ -44,11 +45,24 @@ class QlManager {
   void run_cmd_utility(std::shared_ptr<Plan>& plan, const txn_id_t* txn_id,
                        Context* context) const;
 
+  // COPY table TO 'file'：按页面顺序把整张表导出为CSV或二进制格式，返回导出的记录数
+  size_t copy_to(const std::string& tab_name, const std::string& file_name,
+                 bool binary, Context* context) const;
+
   void select_from(std::unique_ptr<AbstractExecutor>& executorTreeRoot,
                    std::vector<TabCol>& sel_cols, Context* context);
 
   void select_fast_count_star(int count, std::string& sel_col,
                               Context* context);
 
+  // 输出只有一行一列的结果，用于不需要执行计划就能得到的聚合值
+  void select_single_value(std::string& sel_col, std::string value,
+                           Context* context);
+
   static void run_dml(std::unique_ptr<AbstractExecutor>& exec);
+
+  // EXPLAIN输出优化器的计划树；EXPLAIN ANALYZE执行root，输出带有各算子运行统计的算子树
+  void explain(std::shared_ptr<Plan>& plan,
+               std::unique_ptr<AbstractExecutor>& root,
+               const std::shared_ptr<ExplainNode>& node, Context* context);
 };
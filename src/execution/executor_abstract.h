@@ -11,7 +11,10 @@ See the Mulan PSL v2 for more details. */
 #pragma once
 
 #include "execution_defs.h"
+#include "tuple_batch.h"
+#include "common/arena.h"
 #include "common/common.h"
+#include "common/statement_cancel.h"
 #include "index/ix.h"
 #include "system/sm.h"
 
@@ -21,8 +24,21 @@ class AbstractExecutor {
 
     Context *context_;
 
+    std::unique_ptr<RmRecord> view_record_; // 默认next_view()返回的记录
+
     virtual ~AbstractExecutor() = default;
 
+    // 算子可以用 new (arena) XxxExecutor(...) 放在语句的Arena中，unique_ptr照常delete，
+    // 析构函数照常执行，内存等语句结束时随Arena一起释放
+    static void *operator new(size_t size) { return Arena::new_object(size, nullptr); }
+
+    static void *operator new(size_t size, Arena *arena) { return Arena::new_object(size, arena); }
+
+    static void operator delete(void *ptr) { Arena::delete_object(ptr); }
+
+    // 构造函数抛出异常时调用
+    static void operator delete(void *ptr, Arena *) { Arena::delete_object(ptr); }
+
     virtual size_t tupleLen() const { return 0; };
 
     virtual const std::vector<ColMeta> &cols() const {
@@ -42,9 +58,43 @@ class AbstractExecutor {
 
     virtual std::unique_ptr<RmRecord> Next() = 0;
 
+    // 返回当前记录的只读视图，只在下一次nextTuple()/beginTuple()之前有效，只读取记录的算子用它避免分配。
+    // 扫描和投影直接返回页面或内部缓冲区中的数据，其他算子退化为Next()
+    virtual const RmRecord *next_view() {
+        view_record_ = Next();
+        return view_record_.get();
+    }
+
+    // 批量接口：beginTuple()之后反复调用，每次把之后最多TupleBatch::CAPACITY条记录拷贝到batch中，
+    // 没有更多记录时返回false。调用之后游标停在batch最后一条记录的下一条上，可以和逐条接口交替使用。
+    // 默认实现是逐条接口上的适配器；扫描、投影和连接重写它，省掉每条记录的虚函数调用和分配
+    virtual bool NextBatch(TupleBatch &batch) {
+        batch.reset(tupleLen());
+        for (; !is_end() && !batch.full(); nextTuple()) {
+            memcpy(batch.append(rid()), next_view()->data, tupleLen());
+        }
+        return batch.size() > 0;
+    }
+
     virtual ColMeta get_col_offset(const TabCol &target) { return ColMeta();};
 
+    // 上层算子声明只读取cols中的字段，next_view()中其余字段的内容可以不确定。列存格式的扫描据此只读取这些列
+    virtual void set_read_cols(const std::vector<ColMeta> &/*cols*/) {}
+
+    // 上层只需要前limit条记录（-1表示全部），取够之后is_end()为真，不再往后扫描。
+    // 扫描和投影据此提前结束；排序据此只保留前limit条；连接、聚合等改变行数的算子忽略
+    virtual void set_limit(int /*limit*/) {}
+
     std::vector<ColMeta>::const_iterator get_col(const std::vector<ColMeta> &rec_cols, const TabCol &target) {
+        // 分析阶段绑定过下标的字段先比较下标，下标相同时才比较表名；找不到时（算子自己构造的字段）再按名称查找
+        if (target.col_id >= 0) {
+            auto pos = std::find_if(rec_cols.begin(), rec_cols.end(), [&](const ColMeta &col) {
+                return col.col_id == target.col_id && col.tab_name == target.tab_name;
+            });
+            if (pos != rec_cols.end()) {
+                return pos;
+            }
+        }
         auto pos = std::find_if(rec_cols.begin(), rec_cols.end(), [&](const ColMeta &col) {
             return col.tab_name == target.tab_name && col.name == target.col_name;
         });
@@ -1,202 +1,131 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
 #include "execution_defs.h"
 #include "execution_manager.h"
+#include "agg_kernels.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "spill_file.h"
 #include "system/sm.h"
 
-struct AggregateKey {
-  // 用 rmcord 可能更好
-  std::vector<Value> group_bys;
-};
+/**
+ * @description: 分组聚合用的开放寻址哈希表。分组key是各分组列的原始字节拼成的定长串，
+ * 每个分组在arena_中占一个定长的条目：|key|聚合状态|，聚合状态是各个聚合值的原始格式，
+ * 由调用者初始化和更新；slots_中存条目下标加一，0表示空槽位，线性探测。
+ * 查找和插入都不分配对象，条目只在arena_末尾追加，扩容时不移动条目
+ */
+class AggregateHashTable {
+ public:
+  AggregateHashTable() = default;
 
-struct AggregateValue {
-  // 用 rmcord 可能更好，select 里面的聚合值
-  std::vector<Value> values;
-  // having 里面的聚合值
-  std::vector<Value> having_values;
-};
+  void init(size_t key_len, size_t state_len) {
+    key_len_ = key_len;
+    entry_len_ = key_len + state_len;
+    clear();
+  }
 
-struct AggregateKeyHash {
-  std::size_t operator()(const AggregateKey& key) const {
-    std::size_t hash = 0;
-    for (const auto& value : key.group_bys) {
-      switch (value.type) {
-        case TYPE_INT: {
-          hash ^= std::hash<int>()(value.int_val);
-          break;
-        }
-        case TYPE_FLOAT: {
-          hash ^= std::hash<float>()(value.float_val);
-          break;
-        }
-        case TYPE_STRING: {
-          hash ^= std::hash<std::string>()(value.str_val);
-          break;
-        }
-      }
-      // hash ^= std::hash<int>()(value.int_val) ^
-      // std::hash<float>()(value.float_val) ^ std::hash<std::string>()(
-      //     value.str_val);
-    }
-    return hash;
+  void clear() {
+    arena_.clear();
+    hashes_.clear();
+    slots_.assign(16, 0);
+    mask_ = slots_.size() - 1;
   }
-};
 
-struct AggregateKeyEqual {
-  bool operator()(const AggregateKey& lhs, const AggregateKey& rhs) const {
-    return lhs.group_bys == rhs.group_bys;
+  size_t size() const { return hashes_.size(); }
+
+  // 表占用的内存
+  size_t memory_bytes() const {
+    return arena_.capacity() + hashes_.capacity() * sizeof(uint64_t) +
+           slots_.capacity() * sizeof(uint32_t);
   }
-};
 
-class AggregateHashTable {
- public:
-  AggregateHashTable(const std::vector<AggType>& agg_types,
-                     const std::vector<Condition>& having_conds)
-      : agg_types_(agg_types), having_conds_(having_conds) {}
-
-  auto generateInitialAggregateValue(const AggregateValue& input)
-      -> AggregateValue {
-    std::vector<Value> values;
-    std::vector<Value> having_values;
-    for (std::size_t i = 0; i < agg_types_.size(); ++i) {
-      switch (agg_types_[i]) {
-        case AGG_COUNT: {
-          Value v;
-          v.set_int(1);
-          v.init_raw(sizeof(int));
-          values.emplace_back(v);
-          break;
-        }
-        case AGG_MAX:
-        case AGG_MIN:
-        case AGG_SUM:
-          // 直接初始化为输入值
-          values.emplace_back(input.values[i]);
-          break;
-        case AGG_COL:
-          // 占位
-          values.emplace_back();
-          break;
-        default:
-          throw InternalError("Unexpected aggregate type！");
-      }
-    }
+  // 第i个条目的起始位置，条目以key开头，紧跟着聚合状态
+  const char* key(size_t i) const { return arena_.data() + i * entry_len_; }
 
-    for (std::size_t i = 0; i < having_conds_.size(); ++i) {
-      switch (having_conds_[i].agg_type) {
-        case AGG_COUNT: {
-          Value v;
-          v.set_int(1);
-          v.init_raw(sizeof(int));
-          having_values.emplace_back(v);
-          break;
-        }
-        case AGG_MAX:
-        case AGG_MIN:
-        case AGG_SUM:
-          // 直接初始化为输入值
-          having_values.emplace_back(input.having_values[i]);
-          break;
-        case AGG_COL:
-        default:
-          throw InternalError("Unexpected aggregate type！");
-      }
-    }
+  char* state(size_t i) { return arena_.data() + i * entry_len_ + key_len_; }
+
+  uint64_t hash(size_t i) const { return hashes_[i]; }
 
-    return {values, having_values};
+  uint64_t hash_key(const char* key) const {
+    return std::hash<std::string_view>{}(std::string_view(key, key_len_));
   }
 
-  void combineAggregateValues(AggregateValue* result,
-                              const AggregateValue& input) {
-    for (std::size_t i = 0; i < agg_types_.size(); i++) {
-      switch (agg_types_[i]) {
-        case AGG_COUNT:
-          // result->values[i].set_int(result->values[i].int_val + 1);
-          result->values[i].int_val += 1;
-          break;
-        case AGG_MAX: {
-          auto& lhs = result->values[i];
-          auto& rhs = input.values[i];
-          if (compare(lhs.raw->data, rhs.raw->data, lhs.str_val.size(),
-                      lhs.type) < 0) {
-            lhs = rhs;
-          }
-          break;
-        }
-        case AGG_MIN: {
-          auto& lhs = result->values[i];
-          const auto& rhs = input.values[i];
-          if (compare(lhs.raw->data, rhs.raw->data, lhs.str_val.size(),
-                      lhs.type) > 0) {
-            lhs = rhs;
-          }
-          break;
-        }
-        case AGG_SUM: {
-          auto& lhs = result->values[i];
-          const auto& rhs = input.values[i];
-          add(lhs.raw->data, rhs.raw->data, lhs.type);
-          break;
-        }
-        case AGG_COL:
-          break;
+  // 查找key所在的条目，没有时新建一个，is_new表示新建，新建条目的状态由调用者初始化
+  size_t find_or_insert(const char* key, bool* is_new) {
+    return find_or_insert(key, hash_key(key), is_new);
+  }
+
+  // 只查找不插入
+  bool contains(const char* key, uint64_t hash) const {
+    for (size_t s = hash & mask_;; s = (s + 1) & mask_) {
+      uint32_t idx = slots_[s];
+      if (idx == 0) {
+        return false;
+      }
+      if (hashes_[idx - 1] == hash &&
+          memcmp(this->key(idx - 1), key, key_len_) == 0) {
+        return true;
       }
     }
+  }
 
-    for (std::size_t i = 0; i < having_conds_.size(); i++) {
-      switch (having_conds_[i].agg_type) {
-        case AGG_COUNT:
-          // result->values[i].set_int(result->values[i].int_val + 1);
-          result->having_values[i].int_val += 1;
-          break;
-        case AGG_MAX: {
-          auto& lhs = result->having_values[i];
-          auto& rhs = input.having_values[i];
-          if (compare(lhs.raw->data, rhs.raw->data, lhs.str_val.size(),
-                      lhs.type) < 0) {
-            lhs = rhs;
-          }
-          break;
-        }
-        case AGG_MIN: {
-          auto& lhs = result->having_values[i];
-          const auto& rhs = input.having_values[i];
-          if (compare(lhs.raw->data, rhs.raw->data, lhs.str_val.size(),
-                      lhs.type) > 0) {
-            lhs = rhs;
-          }
-          break;
-        }
-        case AGG_SUM: {
-          auto& lhs = result->having_values[i];
-          const auto& rhs = input.having_values[i];
-          add(lhs.raw->data, rhs.raw->data, lhs.type);
-          break;
-        }
-        case AGG_COL:
-        default:
-          throw InternalError("Unexpected aggregate type！");
+  size_t find_or_insert(const char* key, uint64_t hash, bool* is_new) {
+    for (size_t s = hash & mask_;; s = (s + 1) & mask_) {
+      uint32_t idx = slots_[s];
+      if (idx == 0) {
+        break;
+      }
+      if (hashes_[idx - 1] == hash &&
+          memcmp(this->key(idx - 1), key, key_len_) == 0) {
+        *is_new = false;
+        return idx - 1;
       }
     }
+    size_t i = hashes_.size();
+    hashes_.push_back(hash);
+    arena_.resize(arena_.size() + entry_len_);
+    memcpy(arena_.data() + i * entry_len_, key, key_len_);
+    if (hashes_.size() * 2 > slots_.size()) {
+      rehash(slots_.size() * 2);
+    } else {
+      place(i);
+    }
+    *is_new = true;
+    return i;
   }
 
-  void insertCombine(const AggregateKey& agg_key,
-                     const AggregateValue& agg_val) {
-    if (hash_table_.count(agg_key) == 0) {
-      hash_table_.emplace(agg_key, generateInitialAggregateValue(agg_val));
-    } else {
-      combineAggregateValues(&hash_table_[agg_key], agg_val);
+ private:
+  void place(size_t i) {
+    size_t s = hashes_[i] & mask_;
+    while (slots_[s] != 0) {
+      s = (s + 1) & mask_;
     }
+    slots_[s] = static_cast<uint32_t>(i + 1);
   }
 
- public:
-  std::unordered_map<AggregateKey, AggregateValue, AggregateKeyHash,
-                     AggregateKeyEqual>
-      hash_table_;
-  const std::vector<AggType>& agg_types_;
-  const std::vector<Condition>& having_conds_;
+  void rehash(size_t capacity) {
+    slots_.assign(capacity, 0);
+    mask_ = capacity - 1;
+    for (size_t i = 0; i < hashes_.size(); ++i) {
+      place(i);
+    }
+  }
+
+  size_t key_len_ = 0;
+  size_t entry_len_ = 0;
+  std::vector<char> arena_;       // 所有分组的条目，连续存放
+  std::vector<uint64_t> hashes_;  // 每个条目key的哈希值，扩容时不用重新计算
+  std::vector<uint32_t> slots_;
+  size_t mask_ = 0;
 };
 
 class AggregateExecutor : public AbstractExecutor {
@@ -210,30 +139,58 @@ class AggregateExecutor : public AbstractExecutor {
   Rid rid_;
   std::unique_ptr<RecScan> scan_;  // table_iterator
   SmManager* sm_manager_;
-  std::unique_ptr<RmRecord> rm_record_;
   std::unique_ptr<AbstractExecutor> prev_;
   std::vector<ColMeta> sel_cols_;
   std::vector<ColMeta> having_cols_;
   std::vector<AggType> agg_types_;
   std::vector<Condition> having_conds_;
   std::vector<ColMeta> group_bys_;
-
-  AggregateHashTable ht_;
-  std::unordered_map<AggregateKey, AggregateValue, AggregateKeyHash,
-                     AggregateKeyEqual>::iterator it_;
+  std::vector<ColMeta> out_cols_;  // 输出记录的字段，按select的顺序，聚合值以COUNT(*)这样的名字命名
+  std::vector<size_t> key_offs_;   // 每个非聚合的select字段在分组key中的偏移
+
+  // 聚合结果；并行聚合时按key哈希值的高位分成AGG_PARTITIONS个，串行时只有一个
+  std::vector<AggregateHashTable> parts_;
+  size_t key_len_ = 0;
+  size_t state_len_ = 0;
+  std::vector<size_t> agg_offs_;     // 每个select聚合值在聚合状态中的偏移
+  std::vector<size_t> having_offs_;  // 每个having聚合值在聚合状态中的偏移
+  std::vector<char> key_buf_;        // 当前记录的分组key
+  size_t part_ = 0;                  // 当前输出的分组所在的分区
+  size_t pos_ = 0;                   // 当前输出的分组在分区中的下标
+  MemoryReservation mem_;            // 串行阶段的哈希表占用的语句内存预算
+
+  // 哈希表超过内存预算时，把部分聚合结果（|key|聚合状态|）按key哈希值的高位写到AGG_PARTITIONS个临时文件中；
+  // 输入读完后逐个分区读回来合并、输出，同一个分组只会出现在一个分区中
+  std::vector<std::unique_ptr<SpillFile>> spill_;
+  std::vector<size_t> spill_rows_;
+  std::mutex spill_latch_;  // 并行聚合时保护spill_
+  std::atomic<bool> spilled_{false};
+  size_t spill_part_ = 0;  // 下一个读回的分区
   bool has_group_col_{false};
   bool is_empty_table_{false};
+  bool vectorized_{false};  // 不分组且只对数值字段聚合，按批用agg_kernels中的内核聚合
+  std::vector<char> col_buf_;  // 向量化聚合时取出的一批字段值
+
+  // 流式聚合：输入中分组key相同的记录相邻（按分组列有序的索引扫描或排序），key变化时输出一个分组，
+  // 只保留当前分组的状态，不建哈希表
+  bool sorted_{false};
+  std::vector<char> group_;  // 当前输出的分组 |key|聚合状态|
+  bool has_group_{false};    // group_中有分组，输入读完之后为false
+  TupleBatch in_batch_;      // 正在读的一批输入，in_pos_是下一条要聚合的记录
+  size_t in_pos_ = 0;
+  bool in_end_{false};
 
  public:
   AggregateExecutor(std::unique_ptr<AbstractExecutor> prev,
                     const std::vector<TabCol>& sel_cols,
                     std::vector<AggType> agg_types,
                     const std::vector<TabCol>& group_bys,
-                    std::vector<Condition> having_conds, Context* context)
+                    std::vector<Condition> having_conds, bool sorted,
+                    Context* context)
       : prev_(std::move(prev)),
         agg_types_(std::move(agg_types)),
         having_conds_(std::move(having_conds)),
-        ht_(agg_types_, having_conds_) {
+        sorted_(sorted) {
     // sm_manager_ = sm_manager;
     // tab_name_ = std::move(tab_name);
     // conds_ = std::move(conds);
@@ -242,8 +199,6 @@ class AggregateExecutor : public AbstractExecutor {
     // seq 的所有列
     cols_ = prev_->cols();
 
-    // 记得先清 0
-    len_ = 0;
     for (std::size_t i = 0; i < sel_cols.size(); ++i) {
       auto& sel_col = sel_cols[i];
       has_group_col_ |= agg_types_[i] == AGG_COL;
@@ -266,7 +221,6 @@ class AggregateExecutor : public AbstractExecutor {
           sel_cols_.back().offset = sizeof(int);
         }
       }
-      len_ += sel_cols_.back().len;
     }
 
     for (auto& having_cond : having_conds_) {
@@ -303,154 +257,134 @@ class AggregateExecutor : public AbstractExecutor {
       group_bys_.emplace_back(*get_col(cols_, group_by));
     }
 
+    // 输出按select的顺序：分组字段从key中取，聚合值从聚合状态中取
+    len_ = 0;
+    for (std::size_t i = 0; i < sel_cols.size(); ++i) {
+      size_t key_off = 0;
+      if (agg_types_[i] == AGG_COL) {
+        auto& col = sel_cols_[i];
+        for (auto& group_by : group_bys_) {
+          if (group_by.tab_name == col.tab_name && group_by.name == col.name) {
+            break;
+          }
+          key_off += group_by.len;
+        }
+        out_cols_.push_back(col);
+      } else {
+        ColMeta col = sel_cols_[i];
+        col.tab_name = "";
+        col.name = agg_col_name(agg_types_[i], sel_cols[i]);
+        col.col_id = -1;
+        out_cols_.push_back(col);
+      }
+      key_offs_.push_back(key_off);
+      out_cols_.back().offset = len_;
+      len_ += out_cols_.back().len;
+    }
+
+    // 只读取聚合、HAVING和分组用到的列，列存格式的表不读其他列
+    std::vector<ColMeta> read_cols = group_bys_;
+    for (std::size_t i = 0; i < sel_cols.size(); ++i) {
+      if (!sel_cols[i].col_name.empty()) {
+        read_cols.emplace_back(*get_col(cols_, sel_cols[i]));
+      }
+    }
+    for (auto& having_cond : having_conds_) {
+      if (!having_cond.lhs_col.col_name.empty()) {
+        read_cols.emplace_back(*get_col(cols_, having_cond.lhs_col));
+      }
+    }
+    prev_->set_read_cols(read_cols);
+
+    // 分组key是分组列拼起来的定长串，聚合状态依次存放select和having中的聚合值
+    size_t key_len = 0;
+    for (auto& group_by : group_bys_) {
+      key_len += group_by.len;
+    }
+    key_buf_.resize(key_len);
+    size_t state_len = 0;
+    for (std::size_t i = 0; i < agg_types_.size(); ++i) {
+      agg_offs_.push_back(state_len);
+      if (agg_types_[i] != AGG_COL) {
+        state_len += sel_cols_[i].len;
+      }
+    }
+    for (auto& having_col : having_cols_) {
+      having_offs_.push_back(state_len);
+      state_len += having_col.len;
+    }
+    key_len_ = key_len;
+    state_len_ = state_len;
+
+    vectorized_ = group_bys_.empty() && !has_group_col_;
+    for (std::size_t i = 0; i < agg_types_.size(); ++i) {
+      vectorized_ &= vectorizable(agg_types_[i], sel_cols_[i]);
+    }
+    for (std::size_t i = 0; i < having_conds_.size(); ++i) {
+      vectorized_ &= vectorizable(having_conds_[i].agg_type, having_cols_[i]);
+    }
+
     // len_ = cols_.back().offset + cols_.back().len;
     context_ = context;
+    mem_.set_tracker(tracker());
     // fed_conds_ = conds_;
   }
 
   void beginTuple() override {
+    if (sorted_) {
+      begin_stream();
+      return;
+    }
     // 子查询要清空，也可以直接缓存？
-    ht_.hash_table_.clear();
+    parts_.assign(1, AggregateHashTable());
+    parts_[0].init(key_len_, state_len_);
+    is_empty_table_ = false;
+    mem_.reset();
+    spill_.clear();
+    spill_rows_.clear();
+    spilled_ = false;
+    spill_part_ = 0;
     prev_->beginTuple();
 
-    std::vector<Value> keys(group_bys_.size());
-    std::vector<Value> values(agg_types_.size());
-    std::vector<Value> having_values(having_conds_.size());
-
-    while (!prev_->is_end()) {
-      keys.clear();
-      values.clear();
-      having_values.clear();
-
-      rm_record_ = prev_->Next();
-      for (auto& group_by : group_bys_) {
-        keys.emplace_back();
-        if (group_by.type == TYPE_INT) {
-          const int a =
-              *reinterpret_cast<const int*>(rm_record_->data + group_by.offset);
-          keys.back().set_int(a);
-        } else if (group_by.type == TYPE_FLOAT) {
-          const float a = *reinterpret_cast<const float*>(rm_record_->data +
-                                                          group_by.offset);
-          keys.back().set_float(a);
-        } else if (group_by.type == TYPE_STRING) {
-          std::string s(rm_record_->data + group_by.offset, group_by.len);
-          keys.back().set_str(s);
-        } else {
-          throw InternalError("Unexpected data type！");
-        }
-        // memcpy(keys.back().raw->data, rm_record_->data + group_by.offset,
-        // group_by.len);
-        keys.back().init_raw(group_by.len);
-      }
-
-      // 获取 select 里面的聚合值
-      for (std::size_t i = 0; i < agg_types_.size(); ++i) {
-        switch (agg_types_[i]) {
-          case AGG_COUNT: {
-            Value v;
-            v.set_int(1);
-            v.init_raw(sizeof(int));
-            values.emplace_back(v);
-            break;
-          }
-          case AGG_MAX:
-          case AGG_MIN:
-          case AGG_SUM: {
-            // TODO 记得初始化
-            Value v;
-            if (sel_cols_[i].type == TYPE_INT) {
-              const int a = *reinterpret_cast<const int*>(rm_record_->data +
-                                                          sel_cols_[i].offset);
-              v.set_int(a);
-            } else if (sel_cols_[i].type == TYPE_FLOAT) {
-              const float a = *reinterpret_cast<const float*>(
-                  rm_record_->data + sel_cols_[i].offset);
-              v.set_float(a);
-            } else if (sel_cols_[i].type == TYPE_STRING) {
-              // throw InternalError("You cant aggreagte string with
-              // max/min/sum");
-              std::string s(rm_record_->data + sel_cols_[i].offset,
-                            sel_cols_[i].len);
-              v.set_str(s);
-            }
-            v.init_raw(sel_cols_[i].len);
-            values.emplace_back(v);
-            break;
-          }
-          case AGG_COL:
-            values.emplace_back();
-            break;
-          default:
-            throw InternalError("Unexpected aggregate type！");
-        }
+    // 按批读取儿子的输出，每批只有一次虚函数调用；每条记录只拼一次key，不分配对象。
+    // 输入超过AGG_PARALLEL_MIN_BATCHES批时，剩下的交给工作线程并行预聚合
+    TupleBatch batch;
+    for (size_t n = 0; prev_->NextBatch(batch); ++n) {
+      if (n == AGG_PARALLEL_MIN_BATCHES && AGG_PARALLEL_THREADS > 1) {
+        aggregate_parallel(std::move(batch));
+        break;
       }
+      aggregate_batch(parts_[0], batch, key_buf_.data(), col_buf_);
+      check_memory(parts_[0], mem_);
+    }
 
-      // 获取 having 里面的聚合值
-      for (std::size_t i = 0; i < having_conds_.size(); ++i) {
-        switch (having_conds_[i].agg_type) {
-          case AGG_COUNT: {
-            Value v;
-            v.set_int(1);
-            v.init_raw(sizeof(int));
-            having_values.emplace_back(v);
-            break;
-          }
-          case AGG_MAX:
-          case AGG_MIN:
-          case AGG_SUM: {
-            // TODO 记得初始化
-            Value v;
-            if (having_cols_[i].type == TYPE_INT) {
-              const int a = *reinterpret_cast<const int*>(
-                  rm_record_->data + having_cols_[i].offset);
-              v.set_int(a);
-            } else if (having_cols_[i].type == TYPE_FLOAT) {
-              const float a = *reinterpret_cast<const float*>(
-                  rm_record_->data + having_cols_[i].offset);
-              v.set_float(a);
-            } else if (having_cols_[i].type == TYPE_STRING) {
-              std::string s(rm_record_->data + having_cols_[i].offset,
-                            having_cols_[i].len);
-              v.set_str(s);
-            }
-            v.init_raw(having_cols_[i].len);
-            having_values.emplace_back(v);
-            break;
-          }
-          case AGG_COL:
-          default:
-            throw InternalError("Unexpected aggregate type！");
-        }
+    part_ = 0;
+    pos_ = 0;
+    if (spilled_) {
+      // 内存中剩下的部分结果也写出去，再从第一个分区开始输出
+      spill_table(parts_[0], mem_);
+      for (auto& file : spill_) {
+        file->finish();
       }
-
-      ht_.insertCombine({keys}, {values, having_values});
-      prev_->nextTuple();
+      load_spill();
+      skip_unmatched();
+      return;
     }
-
-    it_ = ht_.hash_table_.begin();
+    mem_.force_grow_to(parts_[0].memory_bytes());
     // 空表
-    if (it_ == ht_.hash_table_.end()) {
-      // 空表且有group by，但是没有key直接输出空表
-      if (!group_bys_.empty() && has_group_col_) {
+    size_t num_groups = 0;
+    for (auto& part : parts_) {
+      num_groups += part.size();
+    }
+    if (num_groups == 0) {
+      // 空表且有group by时没有分组，输出空表
+      if (!group_bys_.empty()) {
         return;
       }
       is_empty_table_ = true;
+      return;
     }
-
-    while (it_ != ht_.hash_table_.end()) {
-      std::size_t i = 0;
-      for (; i < it_->second.having_values.size(); ++i) {
-        if (!cmp_cond(it_->second.having_values[i], having_conds_[i].rhs_val,
-                      having_conds_[i])) {
-          break;
-        }
-      }
-      if (i == having_conds_.size()) {
-        break;
-      }
-      ++it_;
-    }
+    skip_unmatched();
   }
 
   void nextTuple() override {
@@ -458,20 +392,13 @@ class AggregateExecutor : public AbstractExecutor {
       is_empty_table_ = false;
       return;
     }
-    ++it_;
-    while (it_ != ht_.hash_table_.end()) {
-      std::size_t i = 0;
-      for (; i < it_->second.having_values.size(); ++i) {
-        if (!cmp_cond(it_->second.having_values[i], having_conds_[i].rhs_val,
-                      having_conds_[i])) {
-          break;
-        }
-      }
-      if (i == having_conds_.size()) {
-        break;
-      }
-      ++it_;
+    if (sorted_) {
+      next_group();
+      skip_unmatched_groups();
+      return;
     }
+    ++pos_;
+    skip_unmatched();
   }
 
   std::unique_ptr<RmRecord> Next() override {
@@ -490,67 +417,26 @@ class AggregateExecutor : public AbstractExecutor {
           case AGG_MAX:
           case AGG_MIN:
           case AGG_SUM:
-          // {
-          //     // 为了输出空改为字符串类型，原来 len 不变
-          //     sel_cols_[i].type = TYPE_STRING;
-          //     std::string s;
-          //     memcpy(record->data + offset, s.c_str(), sel_cols_[i].len);
-          //     offset += sel_cols_[i].len;
-          //     break;
-          // }
           case AGG_COL:
           default:
             throw InternalError("Unsupported aggregate null type！");
         }
       }
-      return std::move(record);
-    }
-
-    int offset = 0;
-
-    // for (std::size_t i = 0; i < sel_cols_.size(); ++i) {
-    //     auto &sel_col = sel_cols_[i];
-    //     if (agg_types_[i] == AGG_COL) {
-    //         auto &&pos = std::find_if(group_bys_.begin(), group_bys_.end(),
-    //         [&](ColMeta& col_meta) {
-    //             return col_meta.tab_name == sel_col.tab_name && col_meta.name
-    //             == sel_col.name;
-    //         });
-    //         if (pos == group_bys_.end()) {
-    //             throw InternalError("SELECT 列表中不能出现没有在 GROUP BY
-    //             子句中的非聚集列！");
-    //         }
-    //         memcpy(record->data + offset, ->data, group_bys_[i].len);
-    //     }
-    //
-    //     memcpy(record->data + offset, key.raw->data, group_bys_[i].len);
-    //     offset += group_bys_[i].len;
-    // }
-
-    // 先生成左 key 右 value 的形式，具体列顺序由投影算子执行
-    if (has_group_col_) {
-      for (std::size_t i = 0; i < group_bys_.size(); ++i) {
-        auto& key = it_->first.group_bys[i];
-        memcpy(record->data + offset, key.raw->data, group_bys_[i].len);
-        offset += group_bys_[i].len;
-      }
+      return record;
     }
 
+    // 按select的顺序输出，分组字段从key中取
+    const char* key = sorted_ ? group_.data() : parts_[part_].key(pos_);
+    const char* state = key + key_len_;
     for (std::size_t i = 0; i < agg_types_.size(); ++i) {
+      auto& col = out_cols_[i];
       if (agg_types_[i] == AGG_COL) {
-        continue;
-      }
-      auto& value = it_->second.values[i];
-      if (agg_types_[i] == AGG_COUNT) {
-        memcpy(record->data + offset, &value.int_val, sel_cols_[i].len);
+        memcpy(record->data + col.offset, key + key_offs_[i], col.len);
       } else {
-        memcpy(record->data + offset, value.raw->data, sel_cols_[i].len);
+        memcpy(record->data + col.offset, state + agg_offs_[i], col.len);
       }
-      offset += sel_cols_[i].len;
     }
-
-    // assert(offset == len_);
-    return std::move(record);
+    return record;
   }
 
   Rid& rid() override { return rid_; }
@@ -560,28 +446,520 @@ class AggregateExecutor : public AbstractExecutor {
     if (is_empty_table_) {
       return false;
     }
-    return it_ == ht_.hash_table_.end();
+    if (sorted_) {
+      return !has_group_;
+    }
+    return part_ >= parts_.size();
   }
 
-  const std::vector<ColMeta>& cols() const override { return sel_cols_; }
+  const std::vector<ColMeta>& cols() const override { return out_cols_; }
 
   size_t tupleLen() const override { return len_; }
 
-  // 判断是否满足单个谓词条件
-  static bool cmp_cond(const Value& l_rec, const Value& r_rec,
-                       const Condition& cond) {
-    if (l_rec.type != r_rec.type) {
-      throw IncompatibleTypeError(coltype2str(l_rec.type),
-                                  coltype2str(r_rec.type));
+  // 把一条记录聚合到ht中，key_buf是调用者（线程）自己的key缓冲区
+  void aggregate_row(AggregateHashTable& ht, const char* row, char* key_buf) {
+    make_key(row, key_buf);
+    bool is_new;
+    size_t g = ht.find_or_insert(key_buf, &is_new);
+    update_group(ht.state(g), row, is_new);
+  }
+
+  // 把row的各分组列拼成分组key放到key_buf中
+  void make_key(const char* row, char* key_buf) const {
+    char* key = key_buf;
+    for (auto& group_by : group_bys_) {
+      memcpy(key, row + group_by.offset, group_by.len);
+      // -0.0和0.0是同一组
+      if (group_by.type == TYPE_FLOAT &&
+          *reinterpret_cast<const float*>(key) == 0.0f) {
+        memset(key, 0, sizeof(float));
+      }
+      key += group_by.len;
+    }
+  }
+
+  // 用row更新一个分组的聚合状态，is_new时初始化
+  void update_group(char* state, const char* row, bool is_new) {
+    for (std::size_t i = 0; i < agg_types_.size(); ++i) {
+      update_state(agg_types_[i], sel_cols_[i], state + agg_offs_[i], row,
+                   is_new);
+    }
+    for (std::size_t i = 0; i < having_conds_.size(); ++i) {
+      if (having_conds_[i].agg_type == AGG_COL) {
+        throw InternalError("Unexpected aggregate type！");
+      }
+      update_state(having_conds_[i].agg_type, having_cols_[i],
+                   state + having_offs_[i], row, is_new);
+    }
+  }
+
+  // 把一批记录聚合到ht中；不分组时每个聚合值对整批调用一次内核，再和已有的状态合并
+  void aggregate_batch(AggregateHashTable& ht, const TupleBatch& batch,
+                       char* key_buf, std::vector<char>& col_buf) {
+    if (!vectorized_) {
+      for (size_t r = 0; r < batch.size(); ++r) {
+        aggregate_row(ht, batch.row(r), key_buf);
+      }
+      return;
+    }
+    if (batch.size() == 0) {
+      return;
+    }
+    col_buf.resize(batch.size() * sizeof(int));
+    bool is_new;
+    char* state = ht.state(ht.find_or_insert(key_buf, &is_new));
+    for (std::size_t i = 0; i < agg_types_.size(); ++i) {
+      update_state_batch(agg_types_[i], sel_cols_[i], state + agg_offs_[i],
+                         batch, is_new, col_buf.data());
+    }
+    for (std::size_t i = 0; i < having_conds_.size(); ++i) {
+      update_state_batch(having_conds_[i].agg_type, having_cols_[i],
+                         state + having_offs_[i], batch, is_new,
+                         col_buf.data());
+    }
+  }
+
+  static bool vectorizable(AggType agg_type, const ColMeta& col) {
+    switch (agg_type) {
+      case AGG_COUNT:
+        return true;
+      case AGG_MAX:
+      case AGG_MIN:
+      case AGG_SUM:
+        return col.type == TYPE_INT || col.type == TYPE_FLOAT;
+      default:
+        return false;
+    }
+  }
+
+  // 用一批记录更新一个聚合值：先算出这批的部分聚合值，is_new时直接作为状态，否则合并到状态中
+  static void update_state_batch(AggType agg_type, const ColMeta& col,
+                                 char* state, const TupleBatch& batch,
+                                 bool is_new, char* buf) {
+    size_t n = batch.size();
+    char partial[sizeof(int)];
+    if (agg_type == AGG_COUNT) {
+      int count = static_cast<int>(n);
+      memcpy(partial, &count, sizeof(int));
+    } else if (col.type == TYPE_INT) {
+      int* values = reinterpret_cast<int*>(buf);
+      agg_kernels::gather(batch, col.offset, values);
+      int res = agg_type == AGG_SUM   ? agg_kernels::sum(values, n)
+                : agg_type == AGG_MIN ? agg_kernels::min(values, n)
+                                      : agg_kernels::max(values, n);
+      memcpy(partial, &res, sizeof(int));
+    } else {
+      float* values = reinterpret_cast<float*>(buf);
+      agg_kernels::gather(batch, col.offset, values);
+      float res = agg_type == AGG_SUM   ? agg_kernels::sum(values, n)
+                  : agg_type == AGG_MIN ? agg_kernels::min(values, n)
+                                        : agg_kernels::max(values, n);
+      memcpy(partial, &res, sizeof(float));
+    }
+    if (is_new) {
+      memcpy(state, partial, sizeof(int));
+    } else {
+      merge_state(agg_type, col, state, partial);
+    }
+  }
+
+  static size_t partition_of(uint64_t hash) {
+    return (hash >> 32) % AGG_PARTITIONS;
+  }
+
+  MemoryTracker* tracker() const {
+    return context_ == nullptr ? nullptr : &context_->memory_;
+  }
+
+  // 处理完一批记录后检查ht的大小，申请不到内存时把ht溢出到临时文件
+  void check_memory(AggregateHashTable& ht, MemoryReservation& mem) {
+    if (mem.grow_to(ht.memory_bytes())) {
+      return;
+    }
+    if (ht.size() == 0) {
+      mem.force_grow_to(ht.memory_bytes());
+      return;
+    }
+    spill_table(ht, mem);
+  }
+
+  // 把ht中的部分聚合结果按分区追加到临时文件中，然后清空ht并归还内存
+  void spill_table(AggregateHashTable& ht, MemoryReservation& mem) {
+    size_t entry_len = key_len_ + state_len_;
+    {
+      std::lock_guard<std::mutex> lock(spill_latch_);
+      if (spill_.empty()) {
+        for (size_t p = 0; p < AGG_PARTITIONS; ++p) {
+          spill_.push_back(std::make_unique<SpillFile>());
+        }
+        spill_rows_.assign(AGG_PARTITIONS, 0);
+      }
+      for (size_t i = 0; i < ht.size(); ++i) {
+        size_t p = partition_of(ht.hash(i));
+        spill_[p]->append(ht.key(i), entry_len);
+        ++spill_rows_[p];
+      }
+      spilled_ = true;
+    }
+    ht = AggregateHashTable();
+    ht.init(key_len_, state_len_);
+    mem.reset();
+  }
+
+  // 依次读回溢出的分区，合并到parts_[0]中，直到得到一个非空的分区；分区都读完时返回false。
+  // 读回的分区不再检查预算，key分布极度倾斜时可能超过
+  bool load_spill() {
+    size_t entry_len = key_len_ + state_len_;
+    parts_.assign(1, AggregateHashTable());
+    parts_[0].init(key_len_, state_len_);
+    mem_.reset();
+    while (spill_part_ < spill_.size()) {
+      size_t p = spill_part_++;
+      std::vector<char> entries(spill_rows_[p] * entry_len);
+      spill_[p]->read(entries.data(), entries.size(), 0);
+      spill_[p].reset();
+      for (size_t off = 0; off < entries.size(); off += entry_len) {
+        const char* key = entries.data() + off;
+        merge_entry(parts_[0], key, parts_[0].hash_key(key), key + key_len_);
+      }
+      if (parts_[0].size() > 0) {
+        mem_.force_grow_to(parts_[0].memory_bytes());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @description: 并行聚合。当前线程继续从儿子读批（算子和页面视图不是线程安全的），
+   * 放进有界队列；AGG_PARALLEL_THREADS个工作线程取批，预聚合到各自按key哈希值分区的局部表中。
+   * 输入读完后，每个分区由一个线程把所有局部表（以及串行阶段的parts_[0]）中这个分区的部分状态合并起来
+   */
+  void aggregate_parallel(TupleBatch first) {
+    struct Worker {
+      std::vector<AggregateHashTable> parts;
+      std::vector<char> key_buf;
+      std::vector<char> col_buf;
+      MemoryReservation mem;
+    };
+    std::vector<Worker> workers(AGG_PARALLEL_THREADS);
+    for (auto& w : workers) {
+      w.mem.set_tracker(tracker());
+    }
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<TupleBatch> queue;
+    bool done = false;
+    std::exception_ptr error;
+    // 记下第一个异常，并唤醒可能在等队列有空位的读线程
+    auto record_error = [&] {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      not_full.notify_all();
+    };
+
+    auto work = [&](Worker& w) {
+      w.key_buf.resize(key_len_);
+      w.parts.resize(AGG_PARTITIONS);
+      for (auto& part : w.parts) {
+        part.init(key_len_, state_len_);
+      }
+      AggregateHashTable scratch;  // 先聚合到一个表中，最后再分区，探测时不用先算分区
+      scratch.init(key_len_, state_len_);
+      while (true) {
+        TupleBatch batch;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          not_empty.wait(lock, [&] { return !queue.empty() || done; });
+          if (queue.empty()) {
+            break;
+          }
+          batch = std::move(queue.front());
+          queue.pop_front();
+        }
+        not_full.notify_one();
+        try {
+          aggregate_batch(scratch, batch, w.key_buf.data(), w.col_buf);
+          check_memory(scratch, w.mem);
+        } catch (...) {
+          record_error();
+        }
+      }
+      try {
+        if (spilled_) {
+          spill_table(scratch, w.mem);
+          return;
+        }
+        for (size_t i = 0; i < scratch.size(); ++i) {
+          move_entry(w.parts[partition_of(scratch.hash(i))], scratch, i);
+        }
+      } catch (...) {
+        record_error();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (auto& w : workers) {
+      threads.emplace_back(work, std::ref(w));
+    }
+    // 出错后不再读入，返回false
+    auto push = [&](TupleBatch&& batch) {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_full.wait(lock, [&] {
+        return queue.size() < 2 * workers.size() || error != nullptr;
+      });
+      if (error) {
+        return false;
+      }
+      queue.push_back(std::move(batch));
+      lock.unlock();
+      not_empty.notify_one();
+      return true;
+    };
+    try {
+      bool ok = push(std::move(first));
+      for (TupleBatch batch; ok && prev_->NextBatch(batch); batch = TupleBatch()) {
+        ok = push(std::move(batch));
+      }
+    } catch (...) {
+      record_error();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    not_empty.notify_all();
+    for (auto& t : threads) {
+      t.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+
+    // 有线程溢出过时，局部表也都写到临时文件中，由beginTuple逐个分区合并
+    if (spilled_) {
+      for (auto& w : workers) {
+        for (auto& part : w.parts) {
+          spill_table(part, w.mem);
+        }
+      }
+      return;
+    }
+
+    // 按分区合并
+    std::vector<AggregateHashTable> merged(AGG_PARTITIONS);
+    AggregateHashTable& serial = parts_[0];
+    threads.clear();
+    size_t num_threads = std::min<size_t>(AGG_PARALLEL_THREADS, AGG_PARTITIONS);
+    for (size_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t] {
+        try {
+          for (size_t p = t; p < merged.size(); p += num_threads) {
+            merged[p].init(key_len_, state_len_);
+            for (size_t i = 0; i < serial.size(); ++i) {
+              if (partition_of(serial.hash(i)) == p) {
+                move_entry(merged[p], serial, i);
+              }
+            }
+            for (auto& w : workers) {
+              for (size_t i = 0; i < w.parts[p].size(); ++i) {
+                move_entry(merged[p], w.parts[p], i);
+              }
+            }
+          }
+        } catch (...) {
+          record_error();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    parts_ = std::move(merged);
+  }
+
+  // 把src中第i个分组的部分状态合并到dst中
+  void move_entry(AggregateHashTable& dst, AggregateHashTable& src, size_t i) {
+    merge_entry(dst, src.key(i), src.hash(i), src.state(i));
+  }
+
+  // 把一个分组的部分状态partial合并到dst中
+  void merge_entry(AggregateHashTable& dst, const char* key, uint64_t hash,
+                   const char* partial) {
+    bool is_new;
+    size_t g = dst.find_or_insert(key, hash, &is_new);
+    char* state = dst.state(g);
+    if (is_new) {
+      memcpy(state, partial, state_len_);
+      return;
+    }
+    for (std::size_t j = 0; j < agg_types_.size(); ++j) {
+      merge_state(agg_types_[j], sel_cols_[j], state + agg_offs_[j],
+                  partial + agg_offs_[j]);
+    }
+    for (std::size_t j = 0; j < having_conds_.size(); ++j) {
+      merge_state(having_conds_[j].agg_type, having_cols_[j],
+                  state + having_offs_[j], partial + having_offs_[j]);
+    }
+  }
+
+  // 合并两个部分聚合值：计数和求和相加，最值取较大（小）者
+  static void merge_state(AggType agg_type, const ColMeta& col, char* state,
+                          const char* partial) {
+    switch (agg_type) {
+      case AGG_COUNT:
+        add(state, partial, TYPE_INT);
+        break;
+      case AGG_MAX:
+        if (compare(state, partial, col.len, col.type) < 0) {
+          memcpy(state, partial, col.len);
+        }
+        break;
+      case AGG_MIN:
+        if (compare(state, partial, col.len, col.type) > 0) {
+          memcpy(state, partial, col.len);
+        }
+        break;
+      case AGG_SUM:
+        add(state, partial, col.type);
+        break;
+      case AGG_COL:
+        break;
+      default:
+        throw InternalError("Unexpected aggregate type！");
+    }
+  }
+
+  // 用记录row更新一个聚合值，is_new时初始化
+  static void update_state(AggType agg_type, const ColMeta& col, char* state,
+                           const char* row, bool is_new) {
+    const char* value = row + col.offset;
+    switch (agg_type) {
+      case AGG_COUNT: {
+        int count = is_new ? 1 : *reinterpret_cast<int*>(state) + 1;
+        memcpy(state, &count, sizeof(int));
+        break;
+      }
+      case AGG_MAX:
+        if (is_new || compare(state, value, col.len, col.type) < 0) {
+          memcpy(state, value, col.len);
+        }
+        break;
+      case AGG_MIN:
+        if (is_new || compare(state, value, col.len, col.type) > 0) {
+          memcpy(state, value, col.len);
+        }
+        break;
+      case AGG_SUM:
+        if (is_new) {
+          memcpy(state, value, col.len);
+        } else {
+          add(state, value, col.type);
+        }
+        break;
+      case AGG_COL:
+        break;
+      default:
+        throw InternalError("Unexpected aggregate type！");
     }
-    if (l_rec.type == TYPE_INT) {
-      memcpy(l_rec.raw->data, &l_rec.int_val, sizeof(int));
+  }
+
+  // 从(part_, pos_)开始跳过不满足HAVING的分组，分区用完时换下一个分区
+  void skip_unmatched() {
+    while (part_ < parts_.size()) {
+      if (pos_ == parts_[part_].size()) {
+        pos_ = 0;
+        // 溢出时parts_中只有当前读回的分区，输出完后读回下一个
+        if (!spilled_ || !load_spill()) {
+          ++part_;
+        }
+        continue;
+      }
+      if (match_having(parts_[part_].state(pos_))) {
+        return;
+      }
+      ++pos_;
     }
+  }
 
-    auto&& lhs_value = l_rec.raw->data;
-    auto&& rhs_value = r_rec.raw->data;
+  // 分组的聚合状态是否满足所有HAVING条件
+  bool match_having(const char* state) const {
+    for (std::size_t i = 0; i < having_conds_.size(); ++i) {
+      if (!cmp_cond(state + having_offs_[i], having_cols_[i],
+                    having_conds_[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
 
-    int cmp = compare(lhs_value, rhs_value, l_rec.str_val.size(), l_rec.type);
+  void begin_stream() {
+    is_empty_table_ = false;
+    group_.resize(key_len_ + state_len_);
+    in_batch_ = TupleBatch();
+    in_pos_ = 0;
+    in_end_ = false;
+    prev_->beginTuple();
+    next_group();
+    // 和哈希聚合一样，没有group by时空表也输出一行
+    if (!has_group_ && group_bys_.empty()) {
+      is_empty_table_ = true;
+      return;
+    }
+    skip_unmatched_groups();
+  }
+
+  // 流式聚合：读入下一个分组的所有记录，聚合到group_中，输入读完时has_group_为false。
+  // 读到key不同的记录时停下，这条记录留在in_batch_中作为下一个分组的第一条
+  void next_group() {
+    bool started = false;
+    while (true) {
+      if (in_pos_ == in_batch_.size()) {
+        in_pos_ = 0;
+        if (in_end_ || !prev_->NextBatch(in_batch_)) {
+          in_end_ = true;
+          in_batch_ = TupleBatch();
+          break;
+        }
+        continue;
+      }
+      const char* row = in_batch_.row(in_pos_);
+      make_key(row, key_buf_.data());
+      if (!started) {
+        memcpy(group_.data(), key_buf_.data(), key_len_);
+      } else if (memcmp(group_.data(), key_buf_.data(), key_len_) != 0) {
+        break;
+      }
+      update_group(group_.data() + key_len_, row, !started);
+      started = true;
+      ++in_pos_;
+    }
+    has_group_ = started;
+  }
+
+  void skip_unmatched_groups() {
+    while (has_group_ && !match_having(group_.data() + key_len_)) {
+      next_group();
+    }
+  }
+
+  // 判断聚合值是否满足单个having条件
+  static bool cmp_cond(const char* lhs_value, const ColMeta& lhs_col,
+                       const Condition& cond) {
+    const Value& r_rec = cond.rhs_val;
+    if (lhs_col.type != r_rec.type) {
+      throw IncompatibleTypeError(coltype2str(lhs_col.type),
+                                  coltype2str(r_rec.type));
+    }
+
+    int cmp = compare(lhs_value, r_rec.raw.data(), lhs_col.len, lhs_col.type);
     switch (cond.op) {
       case OP_EQ:
         return cmp == 0;
@@ -600,12 +978,5 @@ class AggregateExecutor : public AbstractExecutor {
     }
   }
 
-  bool cmp_conds(const Value& l_rec, const Value& r_rec,
-                 const std::vector<Condition>& conds) {
-    return std::all_of(conds.begin(), conds.end(), [&](const Condition& cond) {
-      return cmp_cond(l_rec, r_rec, cond);
-    });
-  }
-
   std::string getType() { return "AggregateExecutor"; }
 };
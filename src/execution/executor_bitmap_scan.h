@@ -0,0 +1,260 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+
+#include "execution_defs.h"
+#include "executor_abstract.h"
+#include "executor_index_scan.h"
+#include "expr_eval.h"
+#include "system/sm.h"
+#include "transaction/version_store.h"
+
+/**
+ * @description: 位图扫描：几路索引扫描（arms_）各自取出满足自己条件的rid，OR组取并集，几个索引上的AND条件取交集，
+ * 按(page_no, slot_no)排序后回表，同一页面上的记录连续读取，每个数据页只读一次。
+ * 每一路都是IndexScanExecutor，键区间锁和快照读都由它处理：加锁读时它锁住扫描过的记录和间隙，
+ * 快照读时它给出的是快照中满足条件的rid，回表时再按快照取记录的版本。回表后检查全部条件
+ */
+class BitmapScanExecutor : public AbstractExecutor {
+   private:
+    SmManager *sm_manager_;
+    std::string tab_name_;                            // 表名称
+    std::vector<Condition> conds_;                    // 回表后检查的条件
+    RmFileHandle *fh_;                                // 表的数据文件句柄
+    std::vector<ColMeta> cols_;                       // 需要读取的字段
+    size_t len_;                                      // 选取出来的一条记录的长度
+    ExprFilter expr_filter_;                          // 表达式条件，逐条计算
+    OrFilter or_filter_;                              // OR条件组，逐条计算
+    ExprScratch expr_scratch_;
+
+    std::vector<std::unique_ptr<AbstractExecutor>> arms_;  // 每一路只取rid的索引扫描
+    bool intersect_;                                  // true取交集，false取并集
+
+    std::vector<Rid> rids_;                           // 排好序的rid
+    size_t rid_pos_ = 0;
+    size_t prefetch_pos_ = 0;                         // rids_中这个位置之前的记录所在的页面已经预取
+    Rid rid_;
+    RmRecordView view_;                               // 当前记录，直接指向页面中的槽位
+    std::shared_ptr<RmRecord> version_;               // 快照读时当前记录在快照中的版本
+    const RmRecord *current_ = nullptr;
+
+    int limit_ = -1;                                  // 上层只需要前limit_条，-1表示全部
+    size_t produced_ = 0;
+
+    timestamp_t snapshot_ts_ = INVALID_TIMESTAMP;     // 快照读的时间戳，加锁读时为INVALID_TIMESTAMP
+
+   public:
+    BitmapScanExecutor(SmManager *sm_manager, std::string tab_name, std::vector<Condition> conds,
+                       std::vector<OrCond> or_conds, std::vector<ExprCond> expr_conds,
+                       std::vector<std::unique_ptr<AbstractExecutor>> arms, bool intersect, Context *context) {
+        sm_manager_ = sm_manager;
+        context_ = context;
+        tab_name_ = std::move(tab_name);
+        TabMeta &tab = sm_manager_->db_.get_table(tab_name_);
+        conds_ = std::move(conds);
+        fh_ = sm_manager_->get_fh(tab.id);
+        cols_ = tab.cols;
+        len_ = cols_.back().offset + cols_.back().len;
+        expr_filter_ = ExprFilter(expr_conds, cols_);
+        or_filter_ = OrFilter(or_conds, cols_);
+        arms_ = std::move(arms);
+        intersect_ = intersect;
+        if (context_ != nullptr && context_->txn_->is_snapshot()) {
+            context_->lock_mgr_->settle_increments(context_->txn_, fh_->GetFd());
+            snapshot_ts_ = context_->txn_->get_snapshot_ts();
+        }
+    }
+
+    std::string getType() override { return "BitmapScanExecutor"; }
+
+    void beginTuple() override {
+        produced_ = 0;
+        collect_rids();
+        rid_pos_ = 0;
+        prefetch_pos_ = 0;
+        find_next_tuple();
+    }
+
+    void nextTuple() override {
+        if (is_end()) return;
+        ++produced_;
+        ++rid_pos_;
+        if (limit_ >= 0 && produced_ >= static_cast<size_t>(limit_)) {
+            view_.reset();
+            return;
+        }
+        find_next_tuple();
+    }
+
+    std::unique_ptr<RmRecord> Next() override { return std::make_unique<RmRecord>(current_->size, current_->data); }
+
+    const RmRecord *next_view() override { return current_; }
+
+    bool NextBatch(TupleBatch &batch) override {
+        batch.reset(len_);
+        for (; !is_end() && !batch.full(); nextTuple()) {
+            memcpy(batch.append(rid_), current_->data, len_);
+        }
+        return batch.size() > 0;
+    }
+
+    Rid &rid() override { return rid_; }
+
+    bool is_end() const override {
+        if (limit_ >= 0 && produced_ >= static_cast<size_t>(limit_)) {
+            return true;
+        }
+        return rid_pos_ == rids_.size();
+    }
+
+    void set_limit(int limit) override { limit_ = limit; }
+
+    const std::vector<ColMeta> &cols() const override { return cols_; }
+
+    size_t tupleLen() const override { return len_; }
+
+   private:
+    // 跑完每一路索引扫描，rid排序去重后取并集或交集
+    void collect_rids() {
+        rids_.clear();
+        std::vector<Rid> arm_rids, merged;
+        for (size_t i = 0; i < arms_.size(); ++i) {
+            arm_rids.clear();
+            auto &arm = arms_[i];
+            for (arm->beginTuple(); !arm->is_end(); arm->nextTuple()) {
+                arm_rids.push_back(arm->rid());
+            }
+            std::sort(arm_rids.begin(), arm_rids.end(), rid_less);
+            arm_rids.erase(std::unique(arm_rids.begin(), arm_rids.end()), arm_rids.end());
+            if (i == 0) {
+                rids_.swap(arm_rids);
+                continue;
+            }
+            merged.clear();
+            if (intersect_) {
+                std::set_intersection(rids_.begin(), rids_.end(), arm_rids.begin(), arm_rids.end(),
+                                      std::back_inserter(merged), rid_less);
+            } else {
+                std::set_union(rids_.begin(), rids_.end(), arm_rids.begin(), arm_rids.end(),
+                               std::back_inserter(merged), rid_less);
+            }
+            rids_.swap(merged);
+            // 交集已经为空时后面几路不用再扫
+            if (intersect_ && rids_.empty()) {
+                break;
+            }
+        }
+    }
+
+    static bool rid_less(const Rid &a, const Rid &b) {
+        return a.page_no != b.page_no ? a.page_no < b.page_no : a.slot_no < b.slot_no;
+    }
+
+    // 回表读到已预取的位置时，预取后面SCAN_PREFETCH_PAGES个不同的数据页
+    void prefetch_heap_pages() {
+        std::vector<PageId> page_ids;
+        size_t pos = rid_pos_;
+        for (; pos < rids_.size(); ++pos) {
+            if (page_ids.empty() || page_ids.back().page_no != rids_[pos].page_no) {
+                if (page_ids.size() == static_cast<size_t>(SCAN_PREFETCH_PAGES)) {
+                    break;
+                }
+                page_ids.push_back({fh_->GetFd(), rids_[pos].page_no});
+            }
+        }
+        prefetch_pos_ = pos;
+        sm_manager_->get_bpm()->prefetch_pages(page_ids);
+    }
+
+    // 从当前位置开始回表，停在第一条满足全部条件的记录上
+    void find_next_tuple() {
+        for (; rid_pos_ < rids_.size(); ++rid_pos_) {
+            if (rid_pos_ >= prefetch_pos_) {
+                prefetch_heap_pages();
+            }
+            rid_ = rids_[rid_pos_];
+            if (!read_record()) {
+                continue;
+            }
+            if (check_conds(current_)) {
+                return;
+            }
+        }
+        view_.reset();
+    }
+
+    // 读出rid_对应的记录放到current_，快照中没有这条记录时返回false
+    bool read_record() {
+        if (snapshot_ts_ == INVALID_TIMESTAMP) {
+            fh_->get_record_view(rid_, view_, context_);
+            current_ = view_.get();
+            return true;
+        }
+        if (VersionStore::instance().read(fh_->GetFd(), rid_, snapshot_ts_, &version_)) {
+            current_ = version_.get();
+            return current_ != nullptr;
+        }
+        try {
+            fh_->get_record_view(rid_, view_, nullptr);
+        } catch (RecordNotFoundError &) {
+            return false;
+        }
+        current_ = view_.get();
+        return true;
+    }
+
+    bool check_conds(const RmRecord *rec) {
+        for (const auto &cond : conds_) {
+            if (!check_cond(rec, cond)) {
+                return false;
+            }
+        }
+        if (!or_filter_.empty() && !or_filter_.eval(rec->data)) {
+            return false;
+        }
+        return expr_filter_.empty() || expr_filter_.eval(rec->data, expr_scratch_);
+    }
+
+    bool check_cond(const RmRecord *rec, const Condition &cond) {
+        auto lhs_meta = get_col(cols_, cond.lhs_col);
+        const char *rhs_data;
+        ColType rhs_type;
+        if (cond.is_rhs_val) {
+            rhs_type = cond.rhs_val.type;
+            rhs_data = cond.rhs_val.raw.data();
+        } else {
+            auto rhs_meta = get_col(cols_, cond.rhs_col);
+            rhs_type = rhs_meta->type;
+            rhs_data = rec->data + rhs_meta->offset;
+        }
+        int cmp = IndexScanExecutor::comp(rec->data + lhs_meta->offset, rhs_data, lhs_meta->len, lhs_meta->type,
+                                          rhs_type);
+        switch (cond.op) {
+            case OP_EQ:
+                return cmp == 0;
+            case OP_NE:
+                return cmp != 0;
+            case OP_LT:
+                return cmp < 0;
+            case OP_GT:
+                return cmp > 0;
+            case OP_LE:
+                return cmp <= 0;
+            case OP_GE:
+                return cmp >= 0;
+            default:
+                throw InternalError("Unknown comparison operator");
+        }
+    }
+};
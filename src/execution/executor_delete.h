@@ -15,6 +15,7 @@ See the Mulan PSL v2 for more details. */
 #include "execution_manager.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "mat_view.h"
 #include "system/sm.h"
 
 class DeleteExecutor : public AbstractExecutor {
@@ -25,35 +26,70 @@ private:
     std::vector<Rid> rids_; // 需要删除的记录的位置
     std::string tab_name_; // 表名称
     SmManager *sm_manager_;
+    std::unique_ptr<MatViewMaintainer> mat_views_; // 表上有物化视图时维护它们
+
+    // keys[i]中依次存放第i个索引要删除的key
+    void delete_index_entries(const std::vector<std::vector<char>> &keys) {
+        size_t i = 0;
+        std::vector<const char *> index_keys;
+        for (auto &[index_name, index] : tab_.indexes) {
+            auto &data = keys[i++];
+            index_keys.clear();
+            for (size_t pos = 0; pos < data.size(); pos += index.col_tot_len) {
+                index_keys.push_back(data.data() + pos);
+            }
+            sm_manager_->get_ih(index.id)->delete_entries(index_keys, context_->txn_);
+        }
+    }
 
 public:
     DeleteExecutor(SmManager *sm_manager, std::string tab_name, std::vector<Condition> conds,
                    std::vector<Rid> rids, Context *context): sm_manager_(sm_manager), tab_name_(std::move(tab_name)),
                                                              conds_(std::move(conds)),
                                                              rids_(std::move(rids)) {
-        tab_ = sm_manager_->db_.get_table(tab_name_);
-        fh_ = sm_manager_->fhs_.at(tab_name_).get();
         context_ = context;
+        // 先加表上的 IX 锁再复制表的元数据：在线建索引发布新索引前要加表 X 锁，之后复制的索引列表不会漏掉新索引
+        TabMeta &tab = sm_manager_->db_.get_table(tab_name_);
+        fh_ = sm_manager_->get_fh(tab.id);
+        context_->lock_mgr_->lock_IX_on_table(context_->txn_, fh_->GetFd());
+        tab_ = tab;
+        if (!tab_.mat_views.empty()) {
+            mat_views_ = std::make_unique<MatViewMaintainer>(sm_manager_, tab_, context_);
+        }
     }
 
-    // 只执行一次
+    // 只执行一次。先逐条删除记录并收集每个索引要删除的key，最后每个索引排序后批量删除，
+    // 落在同一个叶子中的key不用每次从根下降
     std::unique_ptr<RmRecord> Next() override {
-        for (auto &rid: rids_) {
-            auto &&rec = fh_->get_record(rid, context_);
-            // 如果有索引，则必然是唯一索引
-            for (auto &[index_name, index] : tab_.indexes) {
-                auto &&ih = sm_manager_->ihs_.at(index_name).get();
-                char *key = new char[index.col_tot_len];
-                int offset = 0;
-                for (size_t i = 0; i < index.col_num; ++i) {
-                    memcpy(key + offset, rec->data + index.cols[i].offset, index.cols[i].len);
-                    offset += index.cols[i].len;
+        std::vector<std::vector<char>> keys(tab_.indexes.size());
+        try {
+            for (auto &rid: rids_) {
+                auto &&rec = fh_->get_record(rid, context_);
+                fh_->save_version(rid, *rec, context_);
+                fh_->delete_record(rid, context_);
+                if (mat_views_ != nullptr) {
+                    mat_views_->add(rec->data, -1);
+                }
+                // 如果有索引，则必然是唯一索引
+                size_t i = 0;
+                for (auto &[index_name, index] : tab_.indexes) {
+                    auto &index_keys = keys[i++];
+                    for (auto &col : index.cols) {
+                        index_keys.insert(index_keys.end(), rec->data + col.offset,
+                                          rec->data + col.offset + col.len);
+                    }
                 }
-                ih->delete_entry(key, context_->txn_);
-                delete []key;
             }
-            fh_->delete_record(rid, context_);
+        } catch (...) {
+            // 已经删除的记录的索引项也要删掉，回滚时才能按记录重新插入
+            delete_index_entries(keys);
+            throw;
+        }
+        delete_index_entries(keys);
+        if (mat_views_ != nullptr) {
+            mat_views_->apply();
         }
+        fh_->note_rows_modified(rids_.size());
         return nullptr;
     }
 
@@ -0,0 +1,257 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include "executor_aggregate.h"
+#include "spill_file.h"
+
+/**
+ * @description: SELECT DISTINCT的去重算子，key是整条记录。
+ * 哈希模式用AggregateHashTable（没有聚合状态）记录已经输出过的记录，第一次见到的记录立即输出，不用等输入读完；
+ * 表超过语句的内存预算后不再插入，表中没有的记录按哈希值写到DISTINCT_PARTITIONS个临时文件中，
+ * 输入读完后逐个分区重新建表去重。分区中的记录都不在表中，所以不会和已经输出的重复。
+ * 输入中相同的记录相邻时（按唯一的输出列排序）是流式模式，只和上一条比较
+ */
+class DistinctExecutor : public AbstractExecutor {
+ private:
+  std::unique_ptr<AbstractExecutor> prev_;
+  bool sorted_;
+  size_t len_;
+  std::vector<int> float_offs_;  // float字段的偏移，-0和0是同一个值
+
+  std::vector<char> key_;  // 当前记录规范化后的key
+  std::vector<char> prev_key_;
+  bool has_prev_ = false;
+  AggregateHashTable table_;
+  MemoryReservation mem_;  // 哈希表占用的语句内存预算
+
+  // 溢出的分区
+  std::vector<std::unique_ptr<SpillFile>> spill_;
+  std::vector<size_t> spill_rows_;
+  bool spilled_ = false;
+  bool input_done_ = false;
+  size_t spill_part_ = 0;  // 正在读回的分区
+  size_t spill_read_ = 0;  // 这个分区已经读入part_buf_的记录数
+  std::vector<char> part_buf_;
+  size_t part_buf_rows_ = 0;
+  size_t part_pos_ = 0;
+
+  TupleBatch out_;  // 逐条读取时缓存的一批结果
+  size_t out_pos_ = 0;
+  RmRecord view_;  // 指向当前记录，不拥有数据
+  bool is_end_ = true;
+
+ public:
+  DistinctExecutor(std::unique_ptr<AbstractExecutor> prev, bool sorted,
+                   Context* context)
+      : prev_(std::move(prev)), sorted_(sorted) {
+    context_ = context;
+    mem_.set_tracker(context == nullptr ? nullptr : &context->memory_);
+    len_ = prev_->tupleLen();
+    for (auto& col : prev_->cols()) {
+      if (col.type == TYPE_FLOAT) {
+        float_offs_.push_back(col.offset);
+      }
+    }
+    key_.resize(len_);
+    prev_key_.resize(len_);
+    table_.init(len_, 0);
+    view_.size = static_cast<int>(len_);
+  }
+
+  void beginTuple() override {
+    table_.clear();
+    mem_.reset();
+    spill_.clear();
+    spill_rows_.clear();
+    spilled_ = false;
+    input_done_ = false;
+    has_prev_ = false;
+    spill_part_ = 0;
+    prev_->beginTuple();
+    out_pos_ = 0;
+    is_end_ = !fill(out_);
+  }
+
+  void nextTuple() override {
+    if (is_end_) {
+      return;
+    }
+    if (++out_pos_ == out_.size()) {
+      out_pos_ = 0;
+      is_end_ = !fill(out_);
+    }
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(len_);
+    memcpy(record->data, out_.row(out_pos_), len_);
+    return record;
+  }
+
+  const RmRecord* next_view() override {
+    view_.data = const_cast<char*>(out_.row(out_pos_));
+    return &view_;
+  }
+
+  // 逐条读取剩下的结果先交出去，之后直接在调用者的batch上去重
+  bool NextBatch(TupleBatch& batch) override {
+    if (is_end_) {
+      batch.reset(len_);
+      return false;
+    }
+    if (out_.size() > 0) {
+      batch.reset(len_);
+      for (; out_pos_ < out_.size(); ++out_pos_) {
+        memcpy(batch.append(out_.rid(out_pos_)), out_.row(out_pos_), len_);
+      }
+      out_.reset(len_);
+      out_pos_ = 0;
+      return true;
+    }
+    if (!fill(batch)) {
+      is_end_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool is_end() const override { return is_end_; }
+
+  Rid& rid() override {
+    _abstract_rid = out_.rid(out_pos_);
+    return _abstract_rid;
+  }
+
+  const std::vector<ColMeta>& cols() const override { return prev_->cols(); }
+
+  size_t tupleLen() const override { return len_; }
+
+  std::string getType() override { return "DistinctExecutor"; }
+
+  // 去重比较整条记录，上层读哪些字段都要读全部字段；LIMIT不能下推到去重之下
+  void set_read_cols(const std::vector<ColMeta>& /*cols*/) override {
+    prev_->set_read_cols(prev_->cols());
+  }
+
+ private:
+  void make_key(const char* row) {
+    memcpy(key_.data(), row, len_);
+    for (int off : float_offs_) {
+      if (*reinterpret_cast<const float*>(row + off) == 0.0f) {
+        memset(key_.data() + off, 0, sizeof(float));
+      }
+    }
+  }
+
+  // 读输入时判断row是否要输出；溢出后表中没有的记录写到分区中，留到输入读完后再处理
+  bool keep(const char* row) {
+    make_key(row);
+    if (sorted_) {
+      if (has_prev_ && memcmp(prev_key_.data(), key_.data(), len_) == 0) {
+        return false;
+      }
+      std::swap(prev_key_, key_);
+      has_prev_ = true;
+      return true;
+    }
+    uint64_t hash = table_.hash_key(key_.data());
+    if (!spilled_) {
+      bool is_new;
+      table_.find_or_insert(key_.data(), hash, &is_new);
+      return is_new;
+    }
+    if (!table_.contains(key_.data(), hash)) {
+      size_t p = (hash >> 32) % DISTINCT_PARTITIONS;
+      spill_[p]->append(row, len_);
+      ++spill_rows_[p];
+    }
+    return false;
+  }
+
+  // 表超过内存预算时开始溢出，表本身留在内存中，用来过滤已经输出过的记录
+  void check_memory() {
+    if (sorted_ || spilled_ || mem_.grow_to(table_.memory_bytes())) {
+      return;
+    }
+    spilled_ = true;
+    spill_rows_.assign(DISTINCT_PARTITIONS, 0);
+    for (size_t p = 0; p < DISTINCT_PARTITIONS; ++p) {
+      spill_.push_back(std::make_unique<SpillFile>());
+    }
+  }
+
+  // 得到下一批结果，放到batch中；没有了返回false
+  bool fill(TupleBatch& batch) {
+    while (!input_done_) {
+      if (!prev_->NextBatch(batch)) {
+        input_done_ = true;
+        if (spilled_) {
+          for (auto& file : spill_) {
+            file->finish();
+          }
+          start_partition();
+        }
+        break;
+      }
+      auto& sel = batch.sel();
+      size_t n = 0;
+      for (size_t r = 0; r < sel.size(); ++r) {
+        if (keep(batch.row(r))) {
+          sel[n++] = sel[r];
+        }
+      }
+      batch.truncate(n);
+      check_memory();
+      if (n > 0) {
+        return true;
+      }
+    }
+
+    // 逐个分区重新建表去重，分区都放得进内存
+    batch.reset(len_);
+    while (spilled_ && spill_part_ < spill_.size() && !batch.full()) {
+      if (part_pos_ == part_buf_rows_) {
+        size_t remain = spill_rows_[spill_part_] - spill_read_;
+        if (remain == 0) {
+          spill_[spill_part_].reset();
+          ++spill_part_;
+          start_partition();
+          continue;
+        }
+        size_t n = std::min(remain, TupleBatch::CAPACITY);
+        part_buf_.resize(n * len_);
+        spill_[spill_part_]->read(part_buf_.data(), n * len_,
+                                  spill_read_ * len_);
+        spill_read_ += n;
+        part_buf_rows_ = n;
+        part_pos_ = 0;
+      }
+      const char* row = part_buf_.data() + part_pos_++ * len_;
+      make_key(row);
+      bool is_new;
+      table_.find_or_insert(key_.data(), &is_new);
+      if (is_new) {
+        memcpy(batch.append(_abstract_rid), row, len_);
+        mem_.force_grow_to(table_.memory_bytes());
+      }
+    }
+    return batch.size() > 0;
+  }
+
+  void start_partition() {
+    table_.clear();
+    mem_.reset();
+    spill_read_ = 0;
+    part_buf_rows_ = 0;
+    part_pos_ = 0;
+  }
+};
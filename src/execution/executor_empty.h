@@ -0,0 +1,48 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include "execution_defs.h"
+#include "executor_abstract.h"
+
+/**
+ * @description: WHERE条件恒为假时代替表扫描，没有输出。不读表，也不加锁：
+ * 恒为假的谓词不匹配任何记录，包括其他事务之后插入的记录。字段和记录长度同被代替的表
+ */
+class EmptyExecutor : public AbstractExecutor {
+ private:
+  std::vector<ColMeta> cols_;
+  size_t len_;
+
+ public:
+  EmptyExecutor(std::vector<ColMeta> cols, Context* context)
+      : cols_(std::move(cols)) {
+    context_ = context;
+    len_ = cols_.back().offset + cols_.back().len;
+  }
+
+  std::unique_ptr<RmRecord> Next() override { return nullptr; }
+
+  bool NextBatch(TupleBatch& batch) override {
+    batch.reset(len_);
+    return false;
+  }
+
+  bool is_end() const override { return true; }
+
+  Rid& rid() override { return _abstract_rid; }
+
+  size_t tupleLen() const override { return len_; }
+
+  const std::vector<ColMeta>& cols() const override { return cols_; }
+
+  std::string getType() override { return "EmptyExecutor"; }
+};
@@ -0,0 +1,158 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "common/exec_stats.h"
+#include "executor_abstract.h"
+
+/**
+ * @description: EXPLAIN ANALYZE中一个算子的运行统计，儿子是它的输入算子。
+ * 时间和页面、锁的计数都包含在这个算子中调用儿子的部分
+ */
+struct ExplainNode {
+  std::string label;  // 算子类型和对象，比如 SeqScanExecutor on t
+  std::vector<std::shared_ptr<ExplainNode>> children;
+
+  size_t loops = 0;     // beginTuple的次数，连接的内表每次重新扫描加一
+  size_t rows_out = 0;  // 交给上层的记录数
+  uint64_t begin_us = 0;  // beginTuple
+  uint64_t next_us = 0;   // nextTuple和NextBatch
+  uint64_t fetch_us = 0;  // Next和next_view
+  ExecStats stats;
+
+  size_t rows_in() const {
+    size_t rows = 0;
+    for (auto& child : children) {
+      rows += child->rows_out;
+    }
+    return rows;
+  }
+
+  // 按缩进输出这个算子及其儿子，每个算子一行
+  void format(std::vector<std::string>& lines, int indent = 0) const {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "%s%s (loops=%zu rows_in=%zu rows_out=%zu time=%.3fms "
+             "begin=%.3fms next=%.3fms fetch=%.3fms pages=%lu hits=%lu "
+             "misses=%lu lock_waits=%lu lock_wait=%.3fms)",
+             std::string(indent * 2, ' ').c_str(), label.c_str(), loops,
+             rows_in(), rows_out, (begin_us + next_us + fetch_us) / 1e3,
+             begin_us / 1e3, next_us / 1e3, fetch_us / 1e3,
+             stats.page_fetches, stats.buffer_hits, stats.buffer_misses,
+             stats.lock_waits, stats.lock_wait_us / 1e3);
+    lines.emplace_back(buf);
+    for (auto& child : children) {
+      child->format(lines, indent + 1);
+    }
+  }
+};
+
+/**
+ * @description: EXPLAIN ANALYZE时包在每个算子外面，转发所有调用，并把每次调用的时间、
+ * 交出的记录数和本线程上的页面、锁统计的增量记到ExplainNode中。
+ * getType()返回被包装算子的类型，按类型判断算子的代码（投影判断聚合、UPDATE判断索引扫描）不受影响
+ */
+class ExplainAnalyzeExecutor : public AbstractExecutor {
+ private:
+  std::unique_ptr<AbstractExecutor> inner_;
+  std::shared_ptr<ExplainNode> node_;
+  bool pending_ = false;  // 当前记录已经计入rows_out，还没有交给上层
+
+  // 调用期间的耗时和统计增量记到node_中，counter是对应的耗时
+  class Timer {
+   public:
+    Timer(ExplainNode* node, uint64_t* counter)
+        : node_(node),
+          counter_(counter),
+          stats_(thread_exec_stats()),
+          start_(std::chrono::steady_clock::now()) {}
+
+    ~Timer() {
+      *counter_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start_)
+                       .count();
+      node_->stats += thread_exec_stats() - stats_;
+    }
+
+   private:
+    ExplainNode* node_;
+    uint64_t* counter_;
+    ExecStats stats_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+ public:
+  ExplainAnalyzeExecutor(std::unique_ptr<AbstractExecutor> inner,
+                         std::shared_ptr<ExplainNode> node)
+      : inner_(std::move(inner)), node_(std::move(node)) {
+    context_ = inner_->context_;
+  }
+
+  void beginTuple() override {
+    Timer timer(node_.get(), &node_->begin_us);
+    ++node_->loops;
+    inner_->beginTuple();
+    pending_ = !inner_->is_end();
+    node_->rows_out += pending_;
+  }
+
+  void nextTuple() override {
+    Timer timer(node_.get(), &node_->next_us);
+    inner_->nextTuple();
+    pending_ = !inner_->is_end();
+    node_->rows_out += pending_;
+  }
+
+  // batch从当前记录开始，当前记录已经计入时不重复计
+  bool NextBatch(TupleBatch& batch) override {
+    Timer timer(node_.get(), &node_->next_us);
+    bool res = inner_->NextBatch(batch);
+    size_t n = res ? batch.size() : 0;
+    node_->rows_out += n - (pending_ && n > 0 ? 1 : 0);
+    pending_ = false;
+    return res;
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    Timer timer(node_.get(), &node_->fetch_us);
+    return inner_->Next();
+  }
+
+  const RmRecord* next_view() override {
+    Timer timer(node_.get(), &node_->fetch_us);
+    return inner_->next_view();
+  }
+
+  bool is_end() const override { return inner_->is_end(); }
+
+  Rid& rid() override { return inner_->rid(); }
+
+  size_t tupleLen() const override { return inner_->tupleLen(); }
+
+  const std::vector<ColMeta>& cols() const override { return inner_->cols(); }
+
+  std::string getType() override { return inner_->getType(); }
+
+  ColMeta get_col_offset(const TabCol& target) override {
+    return inner_->get_col_offset(target);
+  }
+
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    inner_->set_read_cols(cols);
+  }
+
+  void set_limit(int limit) override { inner_->set_limit(limit); }
+
+  AbstractExecutor* inner() const { return inner_.get(); }
+};
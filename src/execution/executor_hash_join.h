@@ -0,0 +1,747 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <functional>
+#include <numeric>
+#include <string_view>
+
+#include "execution_defs.h"
+#include "execution_manager.h"
+#include "executor_abstract.h"
+#include "index/ix.h"
+#include "join_columns.h"
+#include "spill_file.h"
+#include "system/sm.h"
+
+/**
+ * @description: 等值连接的哈希连接。先把build一侧（规划器选出的较小输入）读入开放寻址的哈希表，
+ * 再按批读取probe一侧逐条查表。build一侧超过HASH_JOIN_MEMORY或者语句的内存预算时退化为grace哈希连接：
+ * 两侧都按key的哈希值分到HASH_JOIN_PARTITIONS个临时文件中，再逐个分区建表、探测。
+ * 内存中的哈希表超过HASH_JOIN_CACHE_BYTES（约为L2缓存）时按哈希值的基数位把build一侧分成若干个缓存大小的分区，
+ * probe一侧按块读入后也按同样的位分区，再逐个分区探测，探测时访问的哈希表留在缓存中，不再是每次都访问内存。
+ * 输出的记录总是左儿子的字段在前，和NestedLoopJoinExecutor一致
+ */
+class HashJoinExecutor : public AbstractExecutor {
+ private:
+  // key中的一列：两侧的字段，以及两侧类型不同（int和float）时统一成的类型
+  struct KeyPart {
+    ColMeta left;
+    ColMeta right;
+    ColType type;
+    int len;
+  };
+
+  // 一个分区的临时文件
+  struct Partition {
+    SpillFile file{HASH_JOIN_SPILL_BUFFER};
+    size_t num_rows = 0;
+    size_t read_rows = 0;  // probe分区已经读出的记录数
+  };
+
+  std::unique_ptr<AbstractExecutor> left_;   // 左儿子节点
+  std::unique_ptr<AbstractExecutor> right_;  // 右儿子节点
+  bool build_left_;                          // 在左儿子上建哈希表
+  AbstractExecutor* build_;
+  AbstractExecutor* probe_;
+  size_t build_len_;
+  size_t probe_len_;
+  size_t len_;                        // join后获得的每条记录的长度
+  std::vector<ColMeta> cols_;         // join后获得的记录的字段
+  std::vector<KeyPart> key_parts_;    // 等值条件组成的key
+  int key_len_ = 0;
+  std::vector<Condition> other_conds_;  // 其余的连接条件，key相等后再检查
+
+  // 哈希表：记录和key各自连续存放，slots_中存记录下标加一，0表示空槽位
+  std::vector<char> build_rows_;
+  std::vector<char> build_keys_;
+  std::vector<uint64_t> build_hashes_;
+  std::vector<uint32_t> slots_;
+  // 基数分区后build_rows_等按分区连续存放，每个分区在slots_中有自己的一段槽位；不分区时只有一个分区
+  struct TablePart {
+    size_t slot_begin;
+    size_t mask;
+  };
+  std::vector<TablePart> table_parts_;
+  int radix_bits_ = 0;  // 基数分区用的哈希位数，0表示不分区
+  MemoryReservation mem_;  // 哈希表占用的语句内存预算
+
+  // 探测的位置
+  TupleBatch probe_batch_;
+  size_t probe_pos_ = 0;
+  bool has_probe_ = false;  // probe_batch_中probe_pos_这条记录还没有查完
+  uint64_t probe_hash_ = 0;
+  std::vector<char> probe_key_;
+  const char* probe_row_ = nullptr;       // 当前的probe记录
+  const char* probe_key_data_ = nullptr;  // 当前probe记录的key
+  size_t slot_begin_ = 0;                 // 当前分区的槽位
+  size_t mask_ = 0;
+  size_t slot_pos_ = 0;
+  // 基数分区时probe一侧读入的一块记录、它们的key和哈希值，以及按分区排好的下标
+  std::vector<char> probe_block_;
+  std::vector<char> probe_keys_;
+  std::vector<uint64_t> probe_hashes_;
+  std::vector<uint32_t> probe_order_;
+  size_t order_pos_ = 0;
+  bool probe_done_ = false;  // 当前的probe输入（儿子或者分区）已经读完
+  RmRecord join_record_;  // 当前的连接结果
+  JoinColumns join_cols_;  // 拼接结果时只拷贝上层需要的字段
+  bool is_end_ = true;
+
+  // grace哈希连接的分区
+  bool spilled_ = false;
+  std::vector<std::unique_ptr<Partition>> build_parts_;
+  std::vector<std::unique_ptr<Partition>> probe_parts_;
+  size_t part_idx_ = 0;
+  std::vector<char> part_buf_;  // 从probe分区读出的一批记录
+
+ public:
+  HashJoinExecutor(std::unique_ptr<AbstractExecutor> left,
+                   std::unique_ptr<AbstractExecutor> right,
+                   std::vector<Condition> conds, bool build_left = false,
+                   Context* context = nullptr)
+      : left_(std::move(left)),
+        right_(std::move(right)),
+        build_left_(build_left) {
+    context_ = context;
+    mem_.set_tracker(context == nullptr ? nullptr : &context->memory_);
+    build_ = build_left_ ? left_.get() : right_.get();
+    probe_ = build_left_ ? right_.get() : left_.get();
+    build_len_ = build_->tupleLen();
+    probe_len_ = probe_->tupleLen();
+    len_ = left_->tupleLen() + right_->tupleLen();
+    cols_ = left_->cols();
+    auto right_cols = right_->cols();
+    for (auto& col : right_cols) {
+      col.offset += left_->tupleLen();
+    }
+    cols_.insert(cols_.end(), right_cols.begin(), right_cols.end());
+
+    for (auto& cond : conds) {
+      if (!add_key_part(cond)) {
+        other_conds_.push_back(std::move(cond));
+      }
+    }
+    if (key_parts_.empty()) {
+      throw InternalError("Hash join needs an equality join condition");
+    }
+    probe_key_.resize(key_len_);
+    join_record_ = RmRecord(len_);
+    join_cols_.init(left_->tupleLen(), right_->tupleLen());
+  }
+
+  void beginTuple() override {
+    build_rows_.clear();
+    build_keys_.clear();
+    build_hashes_.clear();
+    build_parts_.clear();
+    probe_parts_.clear();
+    spilled_ = false;
+    mem_.reset();
+    has_probe_ = false;
+    probe_batch_.reset(probe_len_);
+    probe_pos_ = 0;
+    probe_order_.clear();
+    order_pos_ = 0;
+    probe_done_ = false;
+
+    TupleBatch batch;
+    for (build_->beginTuple(); build_->NextBatch(batch);) {
+      check_cancel();
+      for (size_t r = 0; r < batch.size(); ++r) {
+        if (spilled_) {
+          spill_row(build_parts_, batch.row(r), build_len_, true);
+          continue;
+        }
+        add_build_row(batch.row(r));
+        if (build_rows_.size() > HASH_JOIN_MEMORY ||
+            !mem_.grow_to(build_bytes())) {
+          start_spill();
+        }
+      }
+    }
+
+    probe_->beginTuple();
+    if (spilled_) {
+      // 两侧都分好区，再逐个分区连接
+      while (probe_->NextBatch(batch)) {
+        check_cancel();
+        for (size_t r = 0; r < batch.size(); ++r) {
+          spill_row(probe_parts_, batch.row(r), probe_len_, false);
+        }
+      }
+      for (auto& part : build_parts_) {
+        part->file.finish();
+      }
+      for (auto& part : probe_parts_) {
+        part->file.finish();
+      }
+      part_idx_ = 0;
+      load_partition(part_idx_);
+    } else {
+      build_table();
+    }
+    is_end_ = !advance();
+  }
+
+  void nextTuple() override {
+    if (!is_end_) {
+      is_end_ = !advance();
+    }
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    return std::make_unique<RmRecord>(join_record_.size, join_record_.data);
+  }
+
+  const RmRecord* next_view() override { return &join_record_; }
+
+  bool NextBatch(TupleBatch& batch) override {
+    batch.reset(len_);
+    for (; !is_end_ && !batch.full(); is_end_ = !advance()) {
+      memcpy(batch.append(_abstract_rid), join_record_.data, len_);
+    }
+    return batch.size() > 0;
+  }
+
+  bool is_end() const override { return is_end_; }
+
+  Rid& rid() override { return _abstract_rid; }
+
+  const std::vector<ColMeta>& cols() const override { return cols_; }
+
+  size_t tupleLen() const override { return len_; }
+
+  std::string getType() override { return "HashJoinExecutor"; }
+
+  // key在两侧记录上计算，其余条件在拼接好的结果上计算，拼接时也要拷贝这些条件的字段
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    std::vector<ColMeta> copy_cols = cols;
+    for (auto& cond : other_conds_) {
+      copy_cols.push_back(*get_col(cols_, cond.lhs_col));
+      if (!cond.is_rhs_val) {
+        copy_cols.push_back(*get_col(cols_, cond.rhs_col));
+      }
+    }
+    std::vector<ColMeta> key_cols;
+    for (auto& part : key_parts_) {
+      key_cols.push_back(part.left);
+      key_cols.push_back(part.right);
+      key_cols.back().offset += static_cast<int>(left_->tupleLen());
+    }
+    join_cols_.set_read_cols(copy_cols, key_cols, left_.get(), right_.get());
+  }
+
+ private:
+  // 左右两侧各有一个字段的等值条件可以作为key的一列，int和float比较时统一成float
+  bool add_key_part(const Condition& cond) {
+    if (cond.is_rhs_val || cond.op != OP_EQ) {
+      return false;
+    }
+    auto find = [](const std::vector<ColMeta>& cols, const TabCol& target) {
+      return std::find_if(cols.begin(), cols.end(), [&](const ColMeta& col) {
+        return col.tab_name == target.tab_name && col.name == target.col_name;
+      });
+    };
+    auto& left_cols = left_->cols();
+    auto& right_cols = right_->cols();
+    auto l = find(left_cols, cond.lhs_col);
+    auto r = find(right_cols, cond.rhs_col);
+    if (l == left_cols.end() || r == right_cols.end()) {
+      l = find(left_cols, cond.rhs_col);
+      r = find(right_cols, cond.lhs_col);
+      if (l == left_cols.end() || r == right_cols.end()) {
+        return false;
+      }
+    }
+    KeyPart part{*l, *r, l->type, std::max(l->len, r->len)};
+    if (l->type != r->type) {
+      if (l->type == TYPE_STRING || r->type == TYPE_STRING) {
+        return false;
+      }
+      part.type = TYPE_FLOAT;
+      part.len = sizeof(float);
+    }
+    key_parts_.push_back(part);
+    key_len_ += part.len;
+    return true;
+  }
+
+  // 按两侧统一后的格式写出记录的key，字符串补零到两侧中较长的长度，浮点数的-0写成0
+  void make_key(const char* row, bool build_side, char* dest) const {
+    bool left_side = build_side == build_left_;
+    for (auto& part : key_parts_) {
+      const ColMeta& col = left_side ? part.left : part.right;
+      const char* data = row + col.offset;
+      if (part.type == TYPE_FLOAT) {
+        float v;
+        if (col.type == TYPE_INT) {
+          v = static_cast<float>(*reinterpret_cast<const int*>(data));
+        } else {
+          memcpy(&v, data, sizeof(float));
+        }
+        if (v == 0) {
+          v = 0;
+        }
+        memcpy(dest, &v, sizeof(float));
+      } else {
+        memcpy(dest, data, col.len);
+        memset(dest + col.len, 0, part.len - col.len);
+      }
+      dest += part.len;
+    }
+  }
+
+  uint64_t hash_key(const char* key) const {
+    return std::hash<std::string_view>{}(std::string_view(key, key_len_));
+  }
+
+  // 哈希表占用的内存：记录、key、哈希值，以及建表后的槽位
+  size_t build_bytes() const {
+    return build_rows_.size() + build_keys_.size() +
+           build_hashes_.size() * (sizeof(uint64_t) + 2 * sizeof(uint32_t));
+  }
+
+  void add_build_row(const char* row) {
+    build_rows_.insert(build_rows_.end(), row, row + build_len_);
+    size_t pos = build_keys_.size();
+    build_keys_.resize(pos + key_len_);
+    make_key(row, true, build_keys_.data() + pos);
+    build_hashes_.push_back(hash_key(build_keys_.data() + pos));
+  }
+
+  /**
+   * @description: 建哈希表。超过HASH_JOIN_CACHE_BYTES时先把build一侧按基数位分成2^radix_bits_个分区，
+   * 使每个分区的哈希表不超过缓存大小。每个分区的槽位数取不小于两倍记录数的2的幂，线性探测
+   */
+  void build_table() {
+    size_t n = build_hashes_.size();
+    radix_bits_ = 0;
+    while (radix_bits_ < HASH_JOIN_RADIX_MAX_BITS &&
+           (build_bytes() >> radix_bits_) > HASH_JOIN_CACHE_BYTES) {
+      ++radix_bits_;
+    }
+    size_t fanout = size_t{1} << radix_bits_;
+    std::vector<uint32_t> bounds{0, static_cast<uint32_t>(n)};
+    if (radix_bits_ > 0) {
+      std::vector<uint32_t> order(n);
+      std::iota(order.begin(), order.end(), 0);
+      radix_partition(build_hashes_.data(), order, bounds);
+      permute_build(order);
+    }
+    table_parts_.resize(fanout);
+    slots_.clear();
+    for (size_t p = 0; p < fanout; ++p) {
+      size_t capacity = 16;
+      while (capacity < (bounds[p + 1] - bounds[p]) * 2) {
+        capacity <<= 1;
+      }
+      TablePart& part = table_parts_[p];
+      part.slot_begin = slots_.size();
+      part.mask = capacity - 1;
+      slots_.resize(slots_.size() + capacity, 0);
+      uint32_t* slots = slots_.data() + part.slot_begin;
+      for (size_t i = bounds[p]; i < bounds[p + 1]; ++i) {
+        size_t pos = build_hashes_[i] & part.mask;
+        while (slots[pos] != 0) {
+          pos = (pos + 1) & part.mask;
+        }
+        slots[pos] = static_cast<uint32_t>(i + 1);
+      }
+    }
+  }
+
+  // 基数分区用哈希值从第40位起的radix_bits_位：低位留给分区内的槽位，第32位起的几位已经用于grace哈希连接的分区
+  size_t radix_of(uint64_t hash) const {
+    return (hash >> 40) & ((size_t{1} << radix_bits_) - 1);
+  }
+
+  /**
+   * @description: 把order中的下标按对应哈希值的基数位分区，同一分区内保持原来的顺序，bounds返回每个分区的起点，
+   * 最后一项是下标总数。位数不超过HASH_JOIN_RADIX_PASS_BITS时一趟完成，否则先按高几位分，再在每个分区内按低几位分，
+   * 每一趟同时写的分区数都不多，写合并缓冲区和TLB都放得下
+   */
+  void radix_partition(const uint64_t* hashes, std::vector<uint32_t>& order,
+                       std::vector<uint32_t>& bounds) const {
+    size_t n = order.size();
+    size_t fanout = size_t{1} << radix_bits_;
+    bounds.assign(fanout + 1, 0);
+    bounds[fanout] = static_cast<uint32_t>(n);
+    std::vector<uint32_t> tmp(n);
+    if (radix_bits_ <= HASH_JOIN_RADIX_PASS_BITS) {
+      radix_scatter(hashes, order.data(), n, 0, radix_bits_, tmp.data(),
+                    bounds.data(), 0);
+      order.swap(tmp);
+      return;
+    }
+    int low_bits = radix_bits_ / 2;
+    int high_bits = radix_bits_ - low_bits;
+    std::vector<uint32_t> outer((size_t{1} << high_bits) + 1);
+    outer.back() = static_cast<uint32_t>(n);
+    radix_scatter(hashes, order.data(), n, low_bits, high_bits, tmp.data(),
+                  outer.data(), 0);
+    for (size_t q = 0; q + 1 < outer.size(); ++q) {
+      radix_scatter(hashes, tmp.data() + outer[q], outer[q + 1] - outer[q], 0,
+                    low_bits, order.data() + outer[q],
+                    bounds.data() + (q << low_bits), outer[q]);
+    }
+  }
+
+  /**
+   * @description: 一趟基数分区：先数出每个分区的大小，算出各分区在dst中的起点（加上base写到starts），
+   * 再把src中的下标按radix_of(hash)右移shift后的低bits位写到各自的分区。每个分区有一个缓存行大小的写合并缓冲区，
+   * 攒满一行再整行拷到dst，分区多时也不会每写一个下标就碰一个不同的缓存行
+   */
+  void radix_scatter(const uint64_t* hashes, const uint32_t* src, size_t n,
+                     int shift, int bits, uint32_t* dst, uint32_t* starts,
+                     uint32_t base) const {
+    size_t fanout = size_t{1} << bits;
+    size_t digit_mask = fanout - 1;
+    auto digit = [&](uint32_t i) {
+      return (radix_of(hashes[i]) >> shift) & digit_mask;
+    };
+    std::vector<uint32_t> cursor(fanout, 0);
+    for (size_t i = 0; i < n; ++i) {
+      ++cursor[digit(src[i])];
+    }
+    uint32_t sum = 0;
+    for (size_t p = 0; p < fanout; ++p) {
+      uint32_t count = cursor[p];
+      cursor[p] = sum;
+      starts[p] = base + sum;
+      sum += count;
+    }
+    constexpr size_t LINE_ITEMS = 64 / sizeof(uint32_t);
+    struct alignas(64) Line {
+      uint32_t items[LINE_ITEMS];
+    };
+    std::vector<Line> lines(fanout);
+    std::vector<uint8_t> fill(fanout, 0);
+    for (size_t i = 0; i < n; ++i) {
+      size_t d = digit(src[i]);
+      Line& line = lines[d];
+      line.items[fill[d]++] = src[i];
+      if (fill[d] == LINE_ITEMS) {
+        memcpy(dst + cursor[d], line.items, sizeof(line.items));
+        cursor[d] += LINE_ITEMS;
+        fill[d] = 0;
+      }
+    }
+    for (size_t p = 0; p < fanout; ++p) {
+      memcpy(dst + cursor[p], lines[p].items, fill[p] * sizeof(uint32_t));
+    }
+  }
+
+  // 按order重排build一侧的记录、key和哈希值，重排后同一分区的记录连续存放；重排时短暂占用两份内存
+  void permute_build(const std::vector<uint32_t>& order) {
+    size_t n = order.size();
+    std::vector<char> rows(build_rows_.size());
+    std::vector<char> keys(build_keys_.size());
+    std::vector<uint64_t> hashes(n);
+    for (size_t i = 0; i < n; ++i) {
+      size_t from = order[i];
+      memcpy(rows.data() + i * build_len_,
+             build_rows_.data() + from * build_len_, build_len_);
+      memcpy(keys.data() + i * key_len_, build_keys_.data() + from * key_len_,
+             key_len_);
+      hashes[i] = build_hashes_[from];
+    }
+    build_rows_.swap(rows);
+    build_keys_.swap(keys);
+    build_hashes_.swap(hashes);
+  }
+
+  // 找下一条连接结果，放到join_record_中；没有了返回false
+  bool advance() {
+    while (true) {
+      if (has_probe_) {
+        const uint32_t* slots = slots_.data() + slot_begin_;
+        while (slots[slot_pos_] != 0) {
+          size_t idx = slots[slot_pos_] - 1;
+          slot_pos_ = (slot_pos_ + 1) & mask_;
+          if (build_hashes_[idx] != probe_hash_ ||
+              memcmp(build_keys_.data() + idx * key_len_, probe_key_data_,
+                     key_len_) != 0) {
+            continue;
+          }
+          const char* build_row = build_rows_.data() + idx * build_len_;
+          const char* left_row = build_left_ ? build_row : probe_row_;
+          const char* right_row = build_left_ ? probe_row_ : build_row;
+          join_cols_.copy(join_record_.data, left_row, right_row);
+          if (check_conds(join_record_.data)) {
+            return true;
+          }
+        }
+        has_probe_ = false;
+      }
+      if (!next_probe_row()) {
+        return false;
+      }
+      const TablePart& part = table_parts_[radix_of(probe_hash_)];
+      slot_begin_ = part.slot_begin;
+      mask_ = part.mask;
+      slot_pos_ = probe_hash_ & mask_;
+      has_probe_ = true;
+    }
+  }
+
+  // 取下一条probe记录放到probe_row_并算出key和哈希值；grace哈希连接时当前分区读完后换下一个分区
+  bool next_probe_row() {
+    while (!(radix_bits_ > 0 ? next_block_row() : next_batch_row())) {
+      if (!spilled_ || ++part_idx_ == build_parts_.size()) {
+        return false;
+      }
+      load_partition(part_idx_);
+    }
+    return true;
+  }
+
+  // 不分区时按批逐条探测
+  bool next_batch_row() {
+    if (++probe_pos_ >= probe_batch_.size()) {
+      if (!next_probe_batch()) {
+        return false;
+      }
+      probe_pos_ = 0;
+    }
+    probe_row_ = probe_batch_.row(probe_pos_);
+    make_key(probe_row_, false, probe_key_.data());
+    probe_key_data_ = probe_key_.data();
+    probe_hash_ = hash_key(probe_key_data_);
+    return true;
+  }
+
+  // 基数分区时按块探测，块内按分区的顺序取记录
+  bool next_block_row() {
+    if (order_pos_ == probe_order_.size() && !fill_probe_block()) {
+      return false;
+    }
+    size_t i = probe_order_[order_pos_++];
+    probe_row_ = probe_block_.data() + i * probe_len_;
+    probe_key_data_ = probe_keys_.data() + i * key_len_;
+    probe_hash_ = probe_hashes_[i];
+    return true;
+  }
+
+  /**
+   * @description: 读入probe一侧的下一块（约HASH_JOIN_RADIX_BLOCK条）记录，按和build一侧相同的基数位分区。
+   * 之后按分区的顺序探测，连续的探测都落在同一个分区的哈希表上，这个哈希表留在缓存中
+   */
+  bool fill_probe_block() {
+    probe_block_.clear();
+    probe_keys_.clear();
+    probe_hashes_.clear();
+    while (!probe_done_ && probe_hashes_.size() < HASH_JOIN_RADIX_BLOCK) {
+      if (!next_probe_batch()) {
+        probe_done_ = true;
+        break;
+      }
+      for (size_t r = 0; r < probe_batch_.size(); ++r) {
+        const char* row = probe_batch_.row(r);
+        probe_block_.insert(probe_block_.end(), row, row + probe_len_);
+        size_t pos = probe_keys_.size();
+        probe_keys_.resize(pos + key_len_);
+        make_key(row, false, probe_keys_.data() + pos);
+        probe_hashes_.push_back(hash_key(probe_keys_.data() + pos));
+      }
+    }
+    size_t n = probe_hashes_.size();
+    if (n == 0) {
+      return false;
+    }
+    probe_order_.resize(n);
+    std::iota(probe_order_.begin(), probe_order_.end(), 0);
+    std::vector<uint32_t> bounds;
+    radix_partition(probe_hashes_.data(), probe_order_, bounds);
+    order_pos_ = 0;
+    mem_.force_grow_to(build_bytes() + probe_block_.size() +
+                       probe_keys_.size() +
+                       n * (sizeof(uint64_t) + sizeof(uint32_t)));
+    return true;
+  }
+
+  // 内存中的连接直接从probe儿子取一批，grace哈希连接从当前分区的临时文件中读一批
+  bool next_probe_batch() {
+    // 哈希表是空的，这一侧（分区）不会有结果
+    if (build_hashes_.empty()) {
+      return false;
+    }
+    if (!spilled_) {
+      return probe_->NextBatch(probe_batch_);
+    }
+    auto& part = *probe_parts_[part_idx_];
+    size_t n = std::min(TupleBatch::CAPACITY, part.num_rows - part.read_rows);
+    if (n == 0) {
+      return false;
+    }
+    part_buf_.resize(n * probe_len_);
+    part.file.read(part_buf_.data(), part_buf_.size(),
+                   part.read_rows * probe_len_);
+    part.read_rows += n;
+    probe_batch_.reset(probe_len_);
+    for (size_t i = 0; i < n; ++i) {
+      memcpy(probe_batch_.append(_abstract_rid),
+             part_buf_.data() + i * probe_len_, probe_len_);
+    }
+    return true;
+  }
+
+  /**
+   * @description: build一侧超过内存预算，建立两侧的分区文件，把已经读入内存的build记录写到分区中。
+   * 临时文件建立在当前目录（数据库目录）下，创建后立即unlink，关闭时由文件系统回收
+   */
+  void start_spill() {
+    spilled_ = true;
+    for (int i = 0; i < HASH_JOIN_PARTITIONS; ++i) {
+      build_parts_.push_back(create_partition());
+      probe_parts_.push_back(create_partition());
+    }
+    size_t n = build_hashes_.size();
+    for (size_t i = 0; i < n; ++i) {
+      auto& part = *build_parts_[partition_of(build_hashes_[i])];
+      append_partition(part, build_rows_.data() + i * build_len_, build_len_);
+    }
+    build_rows_.clear();
+    build_rows_.shrink_to_fit();
+    build_keys_.clear();
+    build_keys_.shrink_to_fit();
+    build_hashes_.clear();
+    build_hashes_.shrink_to_fit();
+    mem_.reset();
+  }
+
+  std::unique_ptr<Partition> create_partition() {
+    return std::make_unique<Partition>();
+  }
+
+  // 用哈希值的高位分区，低位留给分区内的哈希表
+  static size_t partition_of(uint64_t hash) {
+    return (hash >> 32) % HASH_JOIN_PARTITIONS;
+  }
+
+  void spill_row(std::vector<std::unique_ptr<Partition>>& parts,
+                 const char* row, size_t row_len, bool build_side) {
+    char key[IX_MAX_COL_LEN * 2];
+    std::vector<char> long_key;
+    char* dest = key;
+    if (static_cast<size_t>(key_len_) > sizeof(key)) {
+      long_key.resize(key_len_);
+      dest = long_key.data();
+    }
+    make_key(row, build_side, dest);
+    append_partition(*parts[partition_of(hash_key(dest))], row, row_len);
+  }
+
+  void append_partition(Partition& part, const char* row, size_t row_len) {
+    part.file.append(row, row_len);
+    ++part.num_rows;
+  }
+
+  // 把第p个build分区读入内存建表；分区的大小不再检查，key分布极度倾斜时可能超过预算
+  void load_partition(size_t p) {
+    auto& part = *build_parts_[p];
+    std::vector<char> rows(part.num_rows * build_len_);
+    part.file.read(rows.data(), rows.size(), 0);
+    build_parts_[p].reset();
+    build_rows_.clear();
+    build_keys_.clear();
+    build_hashes_.clear();
+    for (size_t i = 0; i * build_len_ < rows.size(); ++i) {
+      add_build_row(rows.data() + i * build_len_);
+    }
+    mem_.force_grow_to(build_bytes());
+    build_table();
+    probe_batch_.reset(probe_len_);
+    probe_pos_ = 0;
+    probe_order_.clear();
+    order_pos_ = 0;
+    probe_done_ = false;
+  }
+
+  static inline int comp(const char* ldata, const char* rdata, int len,
+                         ColType lhs_type, ColType rhs_type) {
+    // 支持 int/float 混合比较
+    if (lhs_type != rhs_type && lhs_type != TYPE_STRING &&
+        rhs_type != TYPE_STRING) {
+      float lval = lhs_type == TYPE_INT
+                       ? static_cast<float>(*reinterpret_cast<const int*>(ldata))
+                       : *reinterpret_cast<const float*>(ldata);
+      float rval = rhs_type == TYPE_INT
+                       ? static_cast<float>(*reinterpret_cast<const int*>(rdata))
+                       : *reinterpret_cast<const float*>(rdata);
+      return (lval > rval) - (lval < rval);
+    }
+    if (lhs_type != rhs_type) {
+      throw IncompatibleTypeError(coltype2str(lhs_type), coltype2str(rhs_type));
+    }
+    switch (lhs_type) {
+      case TYPE_INT: {
+        const int lval = *reinterpret_cast<const int*>(ldata);
+        const int rval = *reinterpret_cast<const int*>(rdata);
+        return (lval > rval) - (lval < rval);
+      }
+      case TYPE_FLOAT: {
+        const float lval = *reinterpret_cast<const float*>(ldata);
+        const float rval = *reinterpret_cast<const float*>(rdata);
+        return (lval > rval) - (lval < rval);
+      }
+      case TYPE_STRING:
+        return memcmp(ldata, rdata, len);
+      default:
+        throw InternalError("Unexpected data type！");
+    }
+  }
+
+  // 在拼接好的记录上检查key以外的连接条件
+  bool check_conds(const char* rec) {
+    for (auto& cond : other_conds_) {
+      auto lhs = get_col(cols_, cond.lhs_col);
+      const char* rhs_data;
+      ColType rhs_type;
+      if (cond.is_rhs_val) {
+        rhs_type = cond.rhs_val.type;
+        rhs_data = cond.rhs_val.raw.data();
+      } else {
+        auto rhs = get_col(cols_, cond.rhs_col);
+        rhs_type = rhs->type;
+        rhs_data = rec + rhs->offset;
+      }
+      int cmp = comp(rec + lhs->offset, rhs_data, lhs->len, lhs->type, rhs_type);
+      bool ok;
+      switch (cond.op) {
+        case OP_EQ:
+          ok = cmp == 0;
+          break;
+        case OP_NE:
+          ok = cmp != 0;
+          break;
+        case OP_LT:
+          ok = cmp < 0;
+          break;
+        case OP_GT:
+          ok = cmp > 0;
+          break;
+        case OP_LE:
+          ok = cmp <= 0;
+          break;
+        case OP_GE:
+          ok = cmp >= 0;
+          break;
+        default:
+          throw InternalError("Unknown comparison operator");
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
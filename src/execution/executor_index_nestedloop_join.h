@@ -0,0 +1,304 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <optional>
+
+#include "execution_defs.h"
+#include "execution_manager.h"
+#include "executor_abstract.h"
+#include "index/ix.h"
+#include "join_columns.h"
+#include "system/sm.h"
+
+/**
+ * @description: 索引嵌套循环连接。内表是建有索引的基表，索引的每个字段都和外表的某个字段等值连接；
+ * 按批读取外表记录，拼出一批key后用IxIndexHandle::get_values一次查完，再回表读取匹配的内表记录。
+ * 索引的key不重复，每条外表记录最多匹配一条内表记录。
+ * 内表上的单表条件和其余连接条件在拼接好的记录上检查，输出外表的字段在前
+ */
+class IndexNestedLoopJoinExecutor : public AbstractExecutor {
+ private:
+  std::unique_ptr<AbstractExecutor> left_;  // 外表
+  SmManager* sm_manager_;
+  std::string tab_name_;  // 内表名称
+  RmFileHandle* fh_;      // 内表的数据文件句柄
+  IxIndexHandle* ih_;
+  IndexMeta index_meta_;
+  size_t left_len_;
+  size_t right_len_;
+  size_t len_;                  // join后获得的每条记录的长度
+  std::vector<ColMeta> cols_;   // join后获得的记录的字段
+  std::vector<ColMeta> key_cols_;  // 按索引字段顺序，外表中和索引字段等值连接的字段
+  std::vector<Condition> other_conds_;  // key以外的条件，包括内表的单表条件
+
+  TupleBatch left_batch_;
+  std::vector<char> keys_;  // left_batch_中每条记录拼出的key
+  std::vector<const char*> key_ptrs_;
+  std::vector<std::optional<Rid>> rids_;
+  RmRecordView view_;
+
+  JoinColumns join_cols_;  // 拼接结果时只拷贝上层需要的字段
+  TupleBatch out_;  // 一批外表记录的连接结果
+  size_t out_pos_ = 0;
+  RmRecord join_record_;
+  bool is_end_ = true;
+
+ public:
+  IndexNestedLoopJoinExecutor(SmManager* sm_manager,
+                              std::unique_ptr<AbstractExecutor> left,
+                              std::string tab_name,
+                              std::vector<Condition> inner_conds,
+                              std::vector<Condition> conds,
+                              std::vector<std::string> index_col_names,
+                              Context* context)
+      : left_(std::move(left)),
+        sm_manager_(sm_manager),
+        tab_name_(std::move(tab_name)) {
+    context_ = context;
+    TabMeta& tab = sm_manager_->db_.get_table(tab_name_);
+    index_meta_ = tab.get_index_meta(index_col_names);
+    fh_ = sm_manager_->get_fh(tab.id);
+    ih_ = sm_manager_->get_ih(index_meta_.id);
+    left_len_ = left_->tupleLen();
+    right_len_ = tab.cols.back().offset + tab.cols.back().len;
+    len_ = left_len_ + right_len_;
+    cols_ = left_->cols();
+    for (auto col : tab.cols) {
+      col.offset += left_len_;
+      cols_.push_back(col);
+    }
+
+    // 每个索引字段取第一个和外表字段等值的连接条件组成key，其余条件留到回表后检查
+    key_cols_.resize(index_meta_.cols.size());
+    std::vector<bool> found(index_meta_.cols.size(), false);
+    for (auto& cond : conds) {
+      if (!cond.is_rhs_val && cond.op == OP_EQ) {
+        const TabCol& inner =
+            cond.lhs_col.tab_name == tab_name_ ? cond.lhs_col : cond.rhs_col;
+        const TabCol& outer =
+            cond.lhs_col.tab_name == tab_name_ ? cond.rhs_col : cond.lhs_col;
+        if (outer.tab_name != tab_name_) {
+          size_t i = 0;
+          while (i < index_meta_.cols.size() &&
+                 index_meta_.cols[i].name != inner.col_name) {
+            ++i;
+          }
+          if (i < index_meta_.cols.size() && !found[i]) {
+            auto outer_col = get_col(left_->cols(), outer);
+            if (outer_col->type == index_meta_.cols[i].type &&
+                outer_col->len == index_meta_.cols[i].len) {
+              found[i] = true;
+              key_cols_[i] = *outer_col;
+              continue;
+            }
+          }
+        }
+      }
+      other_conds_.push_back(std::move(cond));
+    }
+    for (size_t i = 0; i < found.size(); ++i) {
+      if (!found[i]) {
+        throw InternalError(
+            "Index nested loop join needs an equality condition on every "
+            "index column");
+      }
+    }
+    for (auto& cond : inner_conds) {
+      other_conds_.push_back(std::move(cond));
+    }
+    keys_.resize(TupleBatch::CAPACITY * index_meta_.col_tot_len);
+    key_ptrs_.reserve(TupleBatch::CAPACITY);
+    join_record_ = RmRecord(len_);
+    join_cols_.init(left_len_, right_len_);
+  }
+
+  void beginTuple() override {
+    left_->beginTuple();
+    out_.reset(len_);
+    out_pos_ = 0;
+    is_end_ = !fill();
+  }
+
+  void nextTuple() override {
+    if (is_end_) {
+      return;
+    }
+    if (++out_pos_ == out_.size()) {
+      is_end_ = !fill();
+    }
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(len_);
+    memcpy(record->data, out_.row(out_pos_), len_);
+    return record;
+  }
+
+  const RmRecord* next_view() override {
+    memcpy(join_record_.data, out_.row(out_pos_), len_);
+    return &join_record_;
+  }
+
+  bool NextBatch(TupleBatch& batch) override {
+    batch.reset(len_);
+    while (!is_end_ && !batch.full()) {
+      memcpy(batch.append(_abstract_rid), out_.row(out_pos_), len_);
+      nextTuple();
+    }
+    return batch.size() > 0;
+  }
+
+  bool is_end() const override { return is_end_; }
+
+  Rid& rid() override { return _abstract_rid; }
+
+  const std::vector<ColMeta>& cols() const override { return cols_; }
+
+  size_t tupleLen() const override { return len_; }
+
+  std::string getType() override { return "IndexNestedLoopJoinExecutor"; }
+
+  // key取自外表记录，其余条件在拼接好的结果上计算，拼接时也要拷贝这些条件的字段
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    std::vector<ColMeta> copy_cols = cols;
+    for (auto& cond : other_conds_) {
+      copy_cols.push_back(*get_col(cols_, cond.lhs_col));
+      if (!cond.is_rhs_val) {
+        copy_cols.push_back(*get_col(cols_, cond.rhs_col));
+      }
+    }
+    join_cols_.set_read_cols(copy_cols, key_cols_, left_.get(), nullptr);
+  }
+
+ private:
+  // 读入下一批外表记录并批量探测索引，直到得到至少一条连接结果；外表读完时返回false
+  bool fill() {
+    out_.reset(len_);
+    out_pos_ = 0;
+    while (out_.size() == 0) {
+      if (!left_->NextBatch(left_batch_)) {
+        return false;
+      }
+      check_cancel();
+      key_ptrs_.clear();
+      for (size_t r = 0; r < left_batch_.size(); ++r) {
+        char* key = keys_.data() + r * index_meta_.col_tot_len;
+        int key_pos = 0;
+        for (auto& col : key_cols_) {
+          memcpy(key + key_pos, left_batch_.row(r) + col.offset, col.len);
+          key_pos += col.len;
+        }
+        key_ptrs_.push_back(key);
+        // 和等值的索引扫描一样锁住key所在的间隙，其他事务不能插入之前没有匹配的key
+        if (context_ != nullptr && context_->lock_mgr_ != nullptr) {
+          context_->lock_mgr_->lock_shared_on_gap(context_->txn_, ih_->fd_,
+                                                  ih_->next_key_rid(key));
+        }
+      }
+      ih_->get_values(key_ptrs_, &rids_,
+                      context_ == nullptr ? nullptr : context_->txn_);
+      for (size_t r = 0; r < left_batch_.size(); ++r) {
+        if (!rids_[r].has_value()) {
+          continue;
+        }
+        // 回表读取内表记录，get_record_view会加行级 S 锁
+        fh_->get_record_view(*rids_[r], view_, context_);
+        char* dest = out_.append(_abstract_rid);
+        join_cols_.copy(dest, left_batch_.row(r), view_.get()->data);
+        if (!check_conds(dest)) {
+          out_.truncate(out_.size() - 1);
+        }
+      }
+      view_.reset();
+    }
+    return true;
+  }
+
+  static inline int comp(const char* ldata, const char* rdata, int len,
+                         ColType lhs_type, ColType rhs_type) {
+    // 支持 int/float 混合比较
+    if (lhs_type != rhs_type && lhs_type != TYPE_STRING &&
+        rhs_type != TYPE_STRING) {
+      float lval = lhs_type == TYPE_INT
+                       ? static_cast<float>(*reinterpret_cast<const int*>(ldata))
+                       : *reinterpret_cast<const float*>(ldata);
+      float rval = rhs_type == TYPE_INT
+                       ? static_cast<float>(*reinterpret_cast<const int*>(rdata))
+                       : *reinterpret_cast<const float*>(rdata);
+      return (lval > rval) - (lval < rval);
+    }
+    if (lhs_type != rhs_type) {
+      throw IncompatibleTypeError(coltype2str(lhs_type), coltype2str(rhs_type));
+    }
+    switch (lhs_type) {
+      case TYPE_INT: {
+        const int lval = *reinterpret_cast<const int*>(ldata);
+        const int rval = *reinterpret_cast<const int*>(rdata);
+        return (lval > rval) - (lval < rval);
+      }
+      case TYPE_FLOAT: {
+        const float lval = *reinterpret_cast<const float*>(ldata);
+        const float rval = *reinterpret_cast<const float*>(rdata);
+        return (lval > rval) - (lval < rval);
+      }
+      case TYPE_STRING:
+        return memcmp(ldata, rdata, len);
+      default:
+        throw InternalError("Unexpected data type！");
+    }
+  }
+
+  // 在拼接好的记录上检查key以外的条件
+  bool check_conds(const char* rec) {
+    for (auto& cond : other_conds_) {
+      auto lhs = get_col(cols_, cond.lhs_col);
+      const char* rhs_data;
+      ColType rhs_type;
+      if (cond.is_rhs_val) {
+        rhs_type = cond.rhs_val.type;
+        rhs_data = cond.rhs_val.raw.data();
+      } else {
+        auto rhs = get_col(cols_, cond.rhs_col);
+        rhs_type = rhs->type;
+        rhs_data = rec + rhs->offset;
+      }
+      int cmp = comp(rec + lhs->offset, rhs_data, lhs->len, lhs->type, rhs_type);
+      bool ok;
+      switch (cond.op) {
+        case OP_EQ:
+          ok = cmp == 0;
+          break;
+        case OP_NE:
+          ok = cmp != 0;
+          break;
+        case OP_LT:
+          ok = cmp < 0;
+          break;
+        case OP_GT:
+          ok = cmp > 0;
+          break;
+        case OP_LE:
+          ok = cmp <= 0;
+          break;
+        case OP_GE:
+          ok = cmp >= 0;
+          break;
+        default:
+          throw InternalError("Unknown comparison operator");
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
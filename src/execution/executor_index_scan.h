@@ -13,11 +13,16 @@ See the Mulan PSL v2 for more details. */
 #include "execution_defs.h"
 #include "execution_manager.h"
 #include "executor_abstract.h"
+#include "expr_eval.h"
 #include "index/ix.h"
 #include "index/ix_index_handle.h"
+#include "morsel_scheduler.h"
+#include "scan_projection.h"
 #include "system/sm.h"
+#include "transaction/version_store.h"
 #include <float.h>
 #include <limits.h>
+#include <unordered_map>
 
 class IndexScanExecutor : public AbstractExecutor {
    private:
@@ -25,27 +30,77 @@ class IndexScanExecutor : public AbstractExecutor {
     TabMeta tab_;                               // 表的元数据
     std::vector<Condition> conds_;              // 扫描条件
     RmFileHandle *fh_;                          // 表的数据文件句柄
-    std::vector<ColMeta> cols_;                 // 需要读取的字段
-    size_t len_;                                // 选取出来的一条记录的长度
+    std::vector<ColMeta> cols_;                 // 表中的字段，条件在整条记录上计算
+    size_t len_;                                // 表中一条完整记录的长度
+    ScanProjection projection_;                 // 只输出查询用到的字段
     std::vector<Condition> fed_conds_;          // 扫描条件，和conds_字段相同
+    ExprFilter expr_filter_;                    // 表达式条件，逐条计算
+    OrFilter or_filter_;                        // OR条件组，逐条计算
+    ExprScratch expr_scratch_;
 
     std::vector<std::string> index_col_names_;  // index scan涉及到的索引包含的字段
     IndexMeta index_meta_;                      // index scan涉及到的索引元数据
 
     Rid rid_;
-    std::unique_ptr<RecScan> scan_;
-    std::unique_ptr<RmRecord> record_;
+    IxIndexHandle *ih_ = nullptr;
+    std::unique_ptr<IxScan> scan_;
+    Iid range_lower_;                           // open_range打开的区间，并行快照读按它切段
+    Iid range_upper_;
+    // 拼接等值前缀的key和区间端点的key，第一次beginTuple时从语句的Arena分配，重新扫描（例如作为连接的内表）时复用
+    char *search_key_ = nullptr;
+    char *bound_key_ = nullptr;                 // 区间下界，跳跃扫描时也用来找第一个字段的下一个值
+    char *upper_key_ = nullptr;                 // 区间上界，ART索引的两端一起传给art_scan，不能和下界共用
+    char *skip_key_ = nullptr;                  // 跳跃扫描：第一个字段的当前值在前，之后的内容不用
+    RmRecordView view_; // 当前记录，直接指向页面中的槽位
+
+    // 覆盖索引：用到的列都在索引中，直接用叶子中的key拼出记录，不访问表的数据文件
+    bool covering_;
+    RmRecord key_rec_;                          // 由key拼出的记录，非索引列的内容不确定
+    std::unique_ptr<char[]> key_buf_;           // 解码后的key
+
+    // rid事先全部取出放在rids_中，逐个回表：哈希索引等值查找一次得到所有rid，ART索引一次取出区间中所有rid；
+    // 按rid排序回表时沿B+树区间取出所有rid，按页面排序后回表，同一页面上的记录连续读取，每个数据页只读一次
+    bool rid_list_ = false;
+    std::vector<Rid> rids_;
+    size_t rid_pos_ = 0;
+    bool rid_sorted_;
+    size_t prefetch_pos_ = 0;                   // rids_中这个位置之前的记录所在的页面已经预取
+
+    bool desc_;                                 // 按索引字段降序输出，反向遍历区间，用于ORDER BY ... DESC
+    // 跳跃扫描：索引的第一个字段上没有条件，逐个取出它的不同值，和conds_中后面字段上的条件一起确定区间
+    bool skip_scan_;
+
+    int limit_ = -1;                            // 上层只需要前limit_条，-1表示全部
+    size_t produced_ = 0;                       // 这次扫描已经交给上层的记录数
+    bool scanned_ = false;                      // beginTuple过，析构时才能判断扫描是否完整
+
+    // 快照读（单条SELECT语句）不加锁：beginTuple时读出快照中所有满足条件的记录，按索引字段排序后逐条输出
+    timestamp_t snapshot_ts_ = INVALID_TIMESTAMP;
+    std::vector<std::pair<Rid, std::shared_ptr<RmRecord>>> snapshot_rows_;
+    size_t snapshot_pos_ = 0;
+
+    // 并行快照读：区间按内部结点的分隔key切成首尾相接的若干段，各段在MorselScheduler上各用一个IxScan读，
+    // 结果按段的顺序拼接，仍然是索引顺序
+    struct RangeWorker {
+        RmRecordView view;
+        ExprScratch scratch;
+        RmRecord key_rec;
+        std::unique_ptr<char[]> key_buf;
+    };
+    std::vector<std::unique_ptr<RangeWorker>> range_workers_;  // 下标是参与者编号
 
     SmManager *sm_manager_;
 
     constexpr static int int_min_ = INT32_MIN;
     constexpr static int int_max_ = INT32_MAX;
-    constexpr static float float_min_ = FLT_MIN;
+    constexpr static float float_min_ = -FLT_MAX;             // FLT_MIN是最小的正数，不是最小值
     constexpr static float float_max_ = FLT_MAX;
 
    public:
     IndexScanExecutor(SmManager *sm_manager, std::string tab_name, std::vector<Condition> conds, std::vector<std::string> index_col_names,
-                    Context *context) {
+                    Context *context, bool covering = false, std::vector<ExprCond> expr_conds = {},
+                    bool rid_sorted = false, bool desc = false, bool skip_scan = false,
+                    std::vector<OrCond> or_conds = {}, const std::vector<ColMeta> &out_cols = {}) {
         sm_manager_ = sm_manager;
         context_ = context;
         tab_name_ = std::move(tab_name);
@@ -55,9 +110,10 @@ class IndexScanExecutor : public AbstractExecutor {
         index_col_names_ = index_col_names; 
         // index_meta_ = *(tab_.get_index_meta(index_col_names_));
         index_meta_ = tab_.get_index_meta(index_col_names_);
-        fh_ = sm_manager_->fhs_.at(tab_name_).get();
+        fh_ = sm_manager_->get_fh(tab_.id);
         cols_ = tab_.cols;
         len_ = cols_.back().offset + cols_.back().len;
+        projection_.init(out_cols, tab_);
         std::map<CompOp, CompOp> swap_op = {
             {OP_EQ, OP_EQ}, {OP_NE, OP_NE}, {OP_LT, OP_GT}, {OP_GT, OP_LT}, {OP_LE, OP_GE}, {OP_GE, OP_LE},
         };
@@ -72,6 +128,20 @@ class IndexScanExecutor : public AbstractExecutor {
             }
         }
         fed_conds_ = conds_;
+        expr_filter_ = ExprFilter(expr_conds, cols_);
+        or_filter_ = OrFilter(or_conds, cols_);
+        covering_ = covering;
+        rid_sorted_ = rid_sorted;
+        desc_ = desc;
+        skip_scan_ = skip_scan;
+        if (covering_) {
+            key_rec_ = RmRecord(len_);
+            key_buf_ = std::make_unique<char[]>(index_meta_.col_tot_len);
+        }
+        if (context_ != nullptr && context_->txn_->is_snapshot()) {
+            context_->lock_mgr_->settle_increments(context_->txn_, fh_->GetFd());
+            snapshot_ts_ = context_->txn_->get_snapshot_ts();
+        }
     }
 
     // void beginTuple() override {
@@ -145,117 +215,613 @@ class IndexScanExecutor : public AbstractExecutor {
     //     }
     // }
 
+    // 扫描完整执行完一遍时，把满足条件的记录数报告给基数反馈。表达式和OR条件也会过滤记录，有它们时不报告
+    ~IndexScanExecutor() override {
+        if (scanned_ && limit_ < 0 && expr_filter_.empty() && or_filter_.empty() && is_end()) {
+            sm_manager_->observe_scan_rows(tab_name_, conds_, produced_);
+        }
+    }
+
     void beginTuple() override {
-        auto index_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index_col_names_);
-        auto *ih = sm_manager_->ihs_[index_name].get();
-
-        Iid lower = ih->leaf_begin();
-        Iid upper = ih->leaf_end();
-        
-        // 构建索引key
-        std::unique_ptr<char[]> key(new char[index_meta_.col_tot_len]());
-        int key_pos = 0, eq_count = 0;
-
-        // 1. 拼接所有等值条件（前缀）
-        for (size_t i = 0; i < conds_.size(); ++i) {
-            const auto &cond = conds_[i];
-            if (cond.op == OP_EQ) {
-                memcpy(key.get() + key_pos, cond.rhs_val.raw->data, cond.rhs_val.raw->size);
-                key_pos += cond.rhs_val.raw->size;
-                eq_count++;
-            } else {
+        scanned_ = true;
+        produced_ = 0;
+        auto *ih = sm_manager_->get_ih(index_meta_.id);
+        ih_ = ih;
+        if (search_key_ == nullptr) {
+            search_key_ = context_->arena_.alloc_chars(index_meta_.col_tot_len);
+            bound_key_ = context_->arena_.alloc_chars(index_meta_.col_tot_len);
+            upper_key_ = context_->arena_.alloc_chars(index_meta_.col_tot_len);
+            if (skip_scan_) {
+                skip_key_ = context_->arena_.alloc_chars(index_meta_.col_tot_len);
+            }
+        }
+
+        if (ih->is_hash()) {
+            rid_list_ = true;
+            rids_.clear();
+            rid_pos_ = 0;
+            // planner保证所有索引字段都是等值条件，并且按索引字段的顺序排在conds_最前面
+            char *key = search_key_;
+            int key_pos = 0;
+            for (size_t i = 0; i < index_meta_.cols.size(); ++i) {
+                memcpy(key + key_pos, conds_[i].rhs_val.raw.data(), index_meta_.cols[i].len);
+                key_pos += index_meta_.cols[i].len;
+            }
+            lock_gap(ih->next_key_rid(key));
+            ih->get_value(key, &rids_, context_->txn_);
+            start_scan();
+            return;
+        }
+        if (ih->is_art()) {
+            open_art_range();
+            start_scan();
+            return;
+        }
+
+        bool point = is_point_lookup();
+        if (point && lookup_row_hint()) {
+            return;
+        }
+        if (skip_scan_) {
+            // 从第一个字段的最小值开始，索引为空时区间也为空
+            if (!ih->get_boundary_key(false, skip_key_)) {
+                memset(skip_key_, 0, index_meta_.col_tot_len);
+            }
+        }
+        open_range();
+        settle_skip_scan();
+        // 有limit时只读前几条，快照读最后按索引字段排序，都不用先取出所有rid
+        rid_list_ = rid_sorted_ && !skip_scan_ && !covering_ && limit_ < 0 && snapshot_ts_ == INVALID_TIMESTAMP;
+        if (rid_list_) {
+            collect_sorted_rids();
+        }
+        start_scan();
+        if (point && !is_end()) {
+            ih->set_row_hint(search_key_, rid_);
+        }
+    }
+
+    // 加锁读时所有索引字段都是等值条件：索引是唯一的，最多一条记录
+    bool is_point_lookup() const {
+        if (snapshot_ts_ != INVALID_TIMESTAMP || skip_scan_ || covering_ || conds_.size() < index_meta_.cols.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < index_meta_.cols.size(); ++i) {
+            if (conds_[i].op != OP_EQ || !is_key_cond(conds_[i], index_meta_.cols[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 按索引上次找到的rid直接回表，不下降B+树：加 S 锁读出记录后它仍满足全部条件就是唯一的结果。
+    // S 锁期间这条记录不会被删除或改掉key，唯一性保证不会插入同一个key，所以不用锁间隙；
+    // 记录已经不在或者对不上时返回false，按正常的区间扫描再找一次
+    bool lookup_row_hint() {
+        char *key = search_key_;
+        int key_pos = 0;
+        for (size_t i = 0; i < index_meta_.cols.size(); ++i) {
+            memcpy(key + key_pos, conds_[i].rhs_val.raw.data(), index_meta_.cols[i].len);
+            key_pos += index_meta_.cols[i].len;
+        }
+        Rid rid;
+        if (!ih_->get_row_hint(key, &rid)) {
+            return false;
+        }
+        try {
+            fh_->get_record_view(rid, view_, context_);
+        } catch (RecordNotFoundError &) {
+            return false;
+        }
+        if (!check_conds(view_.get(), cols_, fed_conds_)) {
+            view_.reset();
+            return false;
+        }
+        rid_ = rid;
+        rid_list_ = true;
+        rids_.assign(1, rid);
+        rid_pos_ = 0;
+        return true;
+    }
+
+    // 扫描区间的两端，lower或upper为nullptr表示这一侧没有边界
+    struct KeyRange {
+        const char *lower = nullptr;
+        bool lower_inclusive = true;
+        const char *upper = nullptr;
+        bool upper_inclusive = true;
+    };
+
+    // 按conds_确定扫描区间的两端，下界的key放在bound_key_中，上界的放在upper_key_中
+    KeyRange key_range() {
+        // planner把前缀上的等值条件按索引字段的顺序排在conds_最前面，接着是下一个字段上的范围条件；
+        // 这里只认和对应字段、类型都对得上的条件，区间可能比条件宽，find_next_tuple会用全部条件再检查一次
+        // 跳跃扫描时第一个字段填当前的值，conds_从第二个字段开始对应
+        char *key = search_key_;
+        memset(key, 0, index_meta_.col_tot_len);
+        size_t lead = skip_scan_ ? 1 : 0;
+        int key_pos = 0;
+        if (skip_scan_) {
+            key_pos = index_meta_.cols[0].len;
+            memcpy(key, skip_key_, key_pos);
+        }
+        size_t eq_count = lead;
+
+        // 1. 拼接等值条件（前缀）
+        for (; eq_count - lead < conds_.size() && eq_count < index_meta_.cols.size(); ++eq_count) {
+            const auto &cond = conds_[eq_count - lead];
+            const auto &col = index_meta_.cols[eq_count];
+            if (cond.op != OP_EQ || !is_key_cond(cond, col)) {
                 break;
             }
+            memcpy(key + key_pos, cond.rhs_val.raw.data(), col.len);
+            key_pos += col.len;
         }
 
-        // 2. 处理范围条件
-        bool has_range = false;
-        for (size_t i = eq_count; i < conds_.size(); ++i) {
+        // 2. 下一个字段上的范围条件，下界和上界各用第一个；没有的一侧由等值前缀限定
+        KeyRange range;
+        bool has_lower = false, has_upper = false;
+        for (size_t i = eq_count - lead; eq_count < index_meta_.cols.size() && i < conds_.size(); ++i) {
             const auto &cond = conds_[i];
-            if (cond.op == OP_GT || cond.op == OP_GE || cond.op == OP_LT || cond.op == OP_LE) {
-                std::unique_ptr<char[]> bound_key(new char[index_meta_.col_tot_len]());
-                memcpy(bound_key.get(), key.get(), key_pos); // 复制等值前缀
-                memcpy(bound_key.get() + key_pos, cond.rhs_val.raw->data, cond.rhs_val.raw->size);
-
-                switch (cond.op) {
-                    case OP_GT:
-                        lower = ih->upper_bound(bound_key.get());
-                        break;
-                    case OP_GE:
-                        lower = ih->lower_bound(bound_key.get());
-                        break;
-                    case OP_LT:
-                        upper = ih->lower_bound(bound_key.get());
-                        break;
-                    case OP_LE:
-                        upper = ih->upper_bound(bound_key.get());
-                        break;
-                    default:
-                        break;
-                }
-                has_range = true;
-                break; // 只用第一个范围条件
-            }
-        }
-
-        // 3. 如果有等值条件（无论是否还有其他条件）
-        if (!has_range && eq_count > 0) {
-            // 构建下界和上界key
-            std::unique_ptr<char[]> lower_key(new char[index_meta_.col_tot_len]());
-            std::unique_ptr<char[]> upper_key(new char[index_meta_.col_tot_len]());
-            
-            // 复制等值前缀
-            memcpy(lower_key.get(), key.get(), key_pos);
-            memcpy(upper_key.get(), key.get(), key_pos);
-            
-            // 填充剩余字段：下界用最小值，上界用最大值
-            char *lower_ptr = lower_key.get();
-            char *upper_ptr = upper_key.get();
+            const auto &col = index_meta_.cols[eq_count];
+            if (!is_key_cond(cond, col)) {
+                break;
+            }
+            bool is_lower = cond.op == OP_GT || cond.op == OP_GE;
+            bool is_upper = cond.op == OP_LT || cond.op == OP_LE;
+            if ((!is_lower && !is_upper) || (is_lower && has_lower) || (is_upper && has_upper)) {
+                continue;
+            }
+            // 后面的字段：>和<=要越过这个值的所有key，填最大值；>=和<要停在这个值的第一个key之前，填最小值
+            char *bound_ptr = is_lower ? bound_key_ : upper_key_;
+            memset(bound_ptr, 0, index_meta_.col_tot_len);
+            memcpy(bound_ptr, key, key_pos);
+            memcpy(bound_ptr + key_pos, cond.rhs_val.raw.data(), col.len);
+            if (cond.op == OP_GT || cond.op == OP_LE) {
+                set_remaining_all_max(key_pos + col.len, eq_count + 1, bound_ptr);
+            } else {
+                set_remaining_all_min(key_pos + col.len, eq_count + 1, bound_ptr);
+            }
+            if (is_lower) {
+                range.lower = bound_ptr;
+                range.lower_inclusive = cond.op == OP_GE;
+            } else {
+                range.upper = bound_ptr;
+                range.upper_inclusive = cond.op == OP_LE;
+            }
+            has_lower |= is_lower;
+            has_upper |= is_upper;
+        }
+
+        // 3. 有等值前缀时，没有范围条件的一侧用前缀加最小值/最大值
+        if (eq_count > 0 && !has_lower) {
+            char *lower_ptr = bound_key_;
+            memset(lower_ptr, 0, index_meta_.col_tot_len);
+            memcpy(lower_ptr, key, key_pos);
             set_remaining_all_min(key_pos, eq_count, lower_ptr);
+            range.lower = lower_ptr;
+        }
+        if (eq_count > 0 && !has_upper) {
+            char *upper_ptr = upper_key_;
+            memset(upper_ptr, 0, index_meta_.col_tot_len);
+            memcpy(upper_ptr, key, key_pos);
             set_remaining_all_max(key_pos, eq_count, upper_ptr);
-            
-            lower = ih->lower_bound(lower_key.get());
-            upper = ih->upper_bound(upper_key.get());
+            range.upper = upper_ptr;
         }
+        return range;
+    }
+
+    // 按conds_确定扫描区间并打开scan_：包含的下界从第一个不小于它的条目开始，不包含的从第一个大于它的开始；
+    // 上界反过来，区间停在第一个越过上界的条目上
+    void open_range() {
+        auto *ih = ih_;
+        KeyRange range = key_range();
+        Iid lower = range.lower == nullptr ? ih->leaf_begin()
+                    : range.lower_inclusive ? ih->lower_bound(range.lower)
+                                            : ih->upper_bound(range.lower);
+        Iid upper = range.upper == nullptr ? ih->leaf_end()
+                    : range.upper_inclusive ? ih->upper_bound(range.upper)
+                                            : ih->lower_bound(range.upper);
 
         // std::cout << "IndexScanExecutor: lower bound = " << lower.page_no << ", " << lower.slot_no
         //           << ", upper bound = " << upper.page_no << ", " << upper.slot_no << std::endl;
 
-        scan_ = std::make_unique<IxScan>(ih, lower, upper, sm_manager_->get_bpm());
-        while (!scan_->is_end()) {
-            rid_ = scan_->rid();
-            record_ = fh_->get_record(rid_, context_);
-            if (check_conds(record_.get(), cols_, fed_conds_)) {
+        scan_.reset();  // 先放开上一个区间的叶子，不同时持有两个叶子的读锁
+        scan_ = std::make_unique<IxScan>(ih, lower, upper, sm_manager_->get_bpm(), desc_);
+        range_lower_ = lower;
+        range_upper_ = upper;
+        // 反向遍历从区间末尾开始，先锁住upper之前的间隙；之后每个条目锁住它之前的间隙，最后一个就是lower之前的
+        if (desc_) {
+            lock_gap(ih->gap_rid(upper));
+        }
+    }
+
+    // ART索引：按key的顺序一次取出区间中所有的rid，锁住每个条目之前的间隙和区间之后的间隙。
+    // 取出和加锁之间其他事务可能在区间中插入或删除，锁完再取一次，两次相同时锁住的就是整个区间
+    void open_art_range() {
+        KeyRange range = key_range();
+        rids_.clear();
+        Rid next = ih_->art_scan(range.lower, range.lower_inclusive, range.upper, range.upper_inclusive, &rids_);
+        std::vector<Rid> again;
+        while (snapshot_ts_ == INVALID_TIMESTAMP) {
+            for (const auto &rid : rids_) {
+                lock_gap(rid);
+            }
+            lock_gap(next);
+            again.clear();
+            Rid again_next =
+                ih_->art_scan(range.lower, range.lower_inclusive, range.upper, range.upper_inclusive, &again);
+            if (again_next == next && again == rids_) {
                 break;
             }
-            scan_->next();
+            rids_.swap(again);
+            next = again_next;
+        }
+        if (desc_) {
+            std::reverse(rids_.begin(), rids_.end());
+        }
+        // 和B+树索引一样，有limit时保持索引的顺序
+        if (rid_sorted_ && limit_ < 0) {
+            std::sort(rids_.begin(), rids_.end(), [](const Rid &a, const Rid &b) {
+                return a.page_no != b.page_no ? a.page_no < b.page_no : a.slot_no < b.slot_no;
+            });
         }
+        rid_list_ = true;
+        rid_pos_ = 0;
+        prefetch_pos_ = 0;
     }
-    
-    void nextTuple() override {
-        if (scan_->is_end()) return;
-        scan_->next();
+
+    // 跳跃扫描：当前值的区间扫完后锁住区间之后的间隙，换成第一个字段的下一个值，直到区间不为空或者值用完
+    void settle_skip_scan() {
+        while (skip_scan_ && scan_->is_end()) {
+            lock_gap(ih_->gap_rid(scan_->iid()));
+            if (!next_skip_value()) {
+                return;
+            }
+        }
+    }
+
+    // 找到第一个字段上比当前值大的第一个值并打开它的区间，没有更大的值时返回false
+    bool next_skip_value() {
+        const auto &lead = index_meta_.cols[0];
+        char *bound = bound_key_;
+        memset(bound, 0, index_meta_.col_tot_len);
+        memcpy(bound, skip_key_, lead.len);
+        set_remaining_all_max(lead.len, 1, bound);
+        Iid next = ih_->upper_bound(bound);
+        if (next == ih_->leaf_end()) {
+            return false;
+        }
+        memcpy(skip_key_, ih_->get_key(next).data, lead.len);
+        open_range();
+        return true;
+    }
+
+    // 沿区间取出所有rid并锁住扫描过的间隙，之后按(page_no, slot_no)排序
+    void collect_sorted_rids() {
+        rids_.clear();
+        rid_pos_ = 0;
+        prefetch_pos_ = 0;
         while (!scan_->is_end()) {
-            rid_ = scan_->rid();
-            record_ = fh_->get_record(rid_, context_);
-            if (check_conds(record_.get(), cols_, fed_conds_)) {
-                break;
+            const Rid *leaf;
+            int n = scan_->leaf_rids(&leaf);
+            for (int i = 0; i < n; ++i) {
+                lock_gap(leaf[i]);
+            }
+            rids_.insert(rids_.end(), leaf, leaf + n);
+            scan_->advance(std::max(n, 1));
+        }
+        lock_gap(ih_->gap_rid(scan_->iid()));
+        std::sort(rids_.begin(), rids_.end(), [](const Rid &a, const Rid &b) {
+            return a.page_no != b.page_no ? a.page_no < b.page_no : a.slot_no < b.slot_no;
+        });
+    }
+
+    // 回表读到已预取的位置时，预取后面SCAN_PREFETCH_PAGES个不同的数据页
+    void prefetch_heap_pages() {
+        std::vector<PageId> page_ids;
+        size_t pos = rid_pos_;
+        for (; pos < rids_.size(); ++pos) {
+            if (page_ids.empty() || page_ids.back().page_no != rids_[pos].page_no) {
+                if (page_ids.size() == static_cast<size_t>(SCAN_PREFETCH_PAGES)) {
+                    break;
+                }
+                page_ids.push_back({fh_->GetFd(), rids_[pos].page_no});
             }
-            scan_->next();
         }
+        prefetch_pos_ = pos;
+        sm_manager_->get_bpm()->prefetch_pages(page_ids);
+    }
+    
+    void nextTuple() override {
+        if (is_end()) return;
+        advance();
     }
 
     std::unique_ptr<RmRecord> Next() override {
-        return std::move(record_);
+        auto *rec = output();
+        return std::make_unique<RmRecord>(rec->size, rec->data);
+    }
+
+    const RmRecord *next_view() override { return output(); }
+
+    bool NextBatch(TupleBatch &batch) override {
+        size_t out_len = projection_.len();
+        batch.reset(out_len);
+        for (; !is_end() && !batch.full(); advance()) {
+            memcpy(batch.append(rid_), output()->data, out_len);
+        }
+        return batch.size() > 0;
+    }
+
+    // 交给上层的记录：当前记录投影出上层要的字段
+    const RmRecord *output() { return projection_.project(current()); }
+
+    const RmRecord *current() const {
+        if (snapshot_ts_ != INVALID_TIMESTAMP) {
+            return snapshot_rows_[snapshot_pos_].second.get();
+        }
+        return covering_ ? &key_rec_ : view_.get();
     }
 
     Rid &rid() override { return rid_; }
 
-    bool is_end() const { return scan_->is_end(); }
+    bool is_end() const {
+        if (limit_ >= 0 && produced_ >= static_cast<size_t>(limit_)) {
+            return true;
+        }
+        if (snapshot_ts_ != INVALID_TIMESTAMP) {
+            return snapshot_pos_ == snapshot_rows_.size();
+        }
+        return rid_list_ ? rid_pos_ == rids_.size() : scan_->is_end();
+    }
+
+    void set_limit(int limit) override { limit_ = limit; }
+
+    // 当前记录已经交给上层：取够limit_条后不再往后找下一条满足条件的记录
+    void advance() {
+        ++produced_;
+        if (limit_ >= 0 && produced_ >= static_cast<size_t>(limit_)) {
+            view_.reset();
+            return;
+        }
+        scan_next();
+        find_next_tuple();
+    }
+
+    const std::vector<ColMeta> &cols() const override { return projection_.cols(); }
+
+    size_t tupleLen() const override { return projection_.len(); }
+
+    void scan_next() {
+        if (snapshot_ts_ != INVALID_TIMESTAMP) {
+            ++snapshot_pos_;
+        } else if (rid_list_) {
+            ++rid_pos_;
+        } else {
+            scan_->next();
+            settle_skip_scan();
+        }
+    }
+
+    // 快照读时先读出所有满足条件的记录，再停在第一条上
+    void start_scan() {
+        if (snapshot_ts_ != INVALID_TIMESTAMP) {
+            read_snapshot();
+        }
+        find_next_tuple();
+    }
+
+    // 快照读：沿索引读出快照之后没有被修改过的记录，页面上的就是快照中的记录；
+    // 被修改过的记录不管现在在不在索引的区间中，都按快照中的版本判断。
+    // 写者在修改页面和索引之前保存版本，读者先读记录再查版本，读到的修改一定能查到
+    void read_snapshot() {
+        auto &store = VersionStore::instance();
+        auto rid_key = [](const Rid &rid) {
+            return (static_cast<int64_t>(rid.page_no) << 32) | static_cast<uint32_t>(rid.slot_no);
+        };
+        std::unordered_map<int64_t, std::pair<Rid, std::shared_ptr<RmRecord>>> rows;
+        std::shared_ptr<RmRecord> version;
+        auto index_next = [this] {
+            if (rid_list_) {
+                ++rid_pos_;
+            } else {
+                scan_->next();
+                settle_skip_scan();
+            }
+        };
+        std::vector<std::vector<std::pair<Rid, std::shared_ptr<RmRecord>>>> parts;
+        if (read_ranges_parallel(parts)) {
+            for (auto &part : parts) {
+                for (auto &row : part) {
+                    rows[rid_key(row.first)] = std::move(row);
+                }
+            }
+        } else {
+            for (; rid_list_ ? rid_pos_ < rids_.size() : !scan_->is_end(); index_next()) {
+                rid_ = rid_list_ ? rids_[rid_pos_] : scan_->rid();
+                const RmRecord *rec = &key_rec_;
+                if (covering_) {
+                    read_key_record();
+                } else {
+                    try {
+                        fh_->get_record_view(rid_, view_, nullptr);
+                    } catch (RecordNotFoundError &) {
+                        continue;
+                    }
+                    rec = view_.get();
+                }
+                if (!check_conds(rec, cols_, fed_conds_)) {
+                    continue;
+                }
+                auto copy = std::make_shared<RmRecord>(len_, rec->data);
+                if (!store.read(fh_->GetFd(), rid_, snapshot_ts_, &version)) {
+                    rows[rid_key(rid_)] = {rid_, std::move(copy)};
+                }
+            }
+            view_.reset();
+        }
+        std::vector<std::pair<int, std::shared_ptr<RmRecord>>> versions;
+        for (int page_no : store.changed_pages(fh_->GetFd(), snapshot_ts_)) {
+            store.read_page(fh_->GetFd(), page_no, snapshot_ts_, versions);
+            for (auto &[slot_no, record] : versions) {
+                Rid rid{page_no, slot_no};
+                if (record != nullptr && check_conds(record.get(), cols_, fed_conds_)) {
+                    rows[rid_key(rid)] = {rid, record};
+                } else {
+                    rows.erase(rid_key(rid));
+                }
+            }
+        }
+        // 按索引字段排序（desc_时降序），上层的归并连接和省掉的ORDER BY依赖索引扫描的顺序
+        snapshot_rows_.clear();
+        for (auto &[key, row] : rows) {
+            snapshot_rows_.push_back(std::move(row));
+        }
+        std::sort(snapshot_rows_.begin(), snapshot_rows_.end(), [this](const auto &a, const auto &b) {
+            for (const auto &col : index_meta_.cols) {
+                int cmp = comp(a.second->data + col.offset, b.second->data + col.offset, col.len, col.type, col.type);
+                if (cmp != 0) {
+                    return desc_ ? cmp > 0 : cmp < 0;
+                }
+            }
+            return a.first.page_no != b.first.page_no ? a.first.page_no < b.first.page_no
+                                                      : a.first.slot_no < b.first.slot_no;
+        });
+        snapshot_pos_ = 0;
+    }
+
+    /**
+     * @description: B+树上的区间跨过足够多的叶子时并行读快照：按分隔key切段，每段一个morsel。
+     * 段内沿叶子顺序读，不加锁，和串行的快照读一样只保留快照之后没有被修改过的记录
+     * @return {bool} 是否并行读了，否则由调用者串行读
+     * @param {vector} parts 第i段中的记录，按索引顺序
+     */
+    bool read_ranges_parallel(std::vector<std::vector<std::pair<Rid, std::shared_ptr<RmRecord>>>> &parts) {
+        auto &scheduler = MorselScheduler::instance();
+        if (rid_list_ || skip_scan_ || scheduler.num_workers() < 2) {
+            return false;
+        }
+        // 先放开scan_持有的叶子读锁：各段的扫描和定位切分点都要给叶子加读锁，等待中的写者会把它们挡住
+        scan_.reset();
+        std::vector<Iid> bounds = ih_->split_range(
+            range_lower_, range_upper_, static_cast<int>(scheduler.num_workers()) * PARALLEL_INDEX_SCAN_PARTS_PER_WORKER);
+        if (bounds.size() <= PARALLEL_INDEX_SCAN_MIN_PARTS) {
+            scan_ = std::make_unique<IxScan>(ih_, range_lower_, range_upper_, sm_manager_->get_bpm(), desc_);
+            return false;
+        }
+        range_workers_.resize(scheduler.num_workers());
+        parts.resize(bounds.size() - 1);
+        scheduler.run(parts.size(), [&](size_t part, size_t worker) {
+            read_range(bounds[part], bounds[part + 1], worker, parts[part]);
+        });
+        return true;
+    }
 
-    const std::vector<ColMeta> &cols() const override { return cols_; }
+    // 读[lower, upper)中的一段，worker是参与者编号
+    void read_range(const Iid &lower, const Iid &upper, size_t worker,
+                    std::vector<std::pair<Rid, std::shared_ptr<RmRecord>>> &rows) {
+        auto &w = range_workers_[worker];
+        if (w == nullptr) {
+            w = std::make_unique<RangeWorker>();
+            if (covering_) {
+                w->key_rec = RmRecord(len_);
+                w->key_buf = std::make_unique<char[]>(index_meta_.col_tot_len);
+            }
+        }
+        auto &store = VersionStore::instance();
+        std::shared_ptr<RmRecord> version;
+        IxScan scan(ih_, lower, upper, sm_manager_->get_bpm());
+        for (; !scan.is_end(); scan.next()) {
+            Rid rid = scan.rid();
+            const RmRecord *rec = &w->key_rec;
+            if (covering_) {
+                decode_key_record(scan, w->key_buf.get(), w->key_rec);
+            } else {
+                try {
+                    fh_->get_record_view(rid, w->view, nullptr);
+                } catch (RecordNotFoundError &) {
+                    continue;
+                }
+                rec = w->view.get();
+            }
+            if (!check_conds(rec, cols_, fed_conds_, w->scratch)) {
+                continue;
+            }
+            auto copy = std::make_shared<RmRecord>(len_, rec->data);
+            if (!store.read(fh_->GetFd(), rid, snapshot_ts_, &version)) {
+                rows.emplace_back(rid, std::move(copy));
+            }
+        }
+        w->view.reset();
+    }
 
-    size_t tupleLen() const override { return len_; }
+    // 从当前位置开始找第一条满足条件的记录
+    void find_next_tuple() {
+        if (snapshot_ts_ != INVALID_TIMESTAMP) {
+            if (!is_end()) {
+                rid_ = snapshot_rows_[snapshot_pos_].first;
+            }
+            return;
+        }
+        while (!is_end()) {
+            if (rid_sorted_ && rid_list_ && rid_pos_ >= prefetch_pos_) {
+                prefetch_heap_pages();
+            }
+            rid_ = rid_list_ ? rids_[rid_pos_] : scan_->rid();
+            if (!rid_list_) {
+                lock_gap(rid_);
+            }
+            if (covering_) {
+                read_key_record();
+                if (check_conds(&key_rec_, cols_, fed_conds_)) {
+                    return;
+                }
+            } else {
+                fh_->get_record_view(rid_, view_, context_);
+                if (check_conds(view_.get(), cols_, fed_conds_)) {
+                    return;
+                }
+            }
+            scan_next();
+        }
+        // 区间之后的第一个条目之前的间隙也要锁住，否则其他事务可以在区间的末尾插入；跳跃扫描在settle_skip_scan中锁
+        if (!rid_list_ && !desc_ && !skip_scan_ && scan_->is_end()) {
+            lock_gap(ih_->gap_rid(scan_->iid()));
+        }
+        view_.reset();
+    }
+
+    // 键区间锁：锁住next_rid对应条目之前的间隙，其他事务不能在扫描过的区间中插入；快照读不加锁
+    void lock_gap(const Rid &next_rid) {
+        if (snapshot_ts_ == INVALID_TIMESTAMP && context_ != nullptr && context_->lock_mgr_ != nullptr) {
+            context_->lock_mgr_->lock_shared_on_gap(context_->txn_, ih_->fd_, next_rid);
+        }
+    }
+
+    // 把当前key中的各列放到key_rec_中对应字段的位置；不读记录，但和get_record_view一样加行级 S 锁，快照读不加锁
+    void read_key_record() {
+        if (snapshot_ts_ == INVALID_TIMESTAMP && context_ != nullptr && context_->lock_mgr_ != nullptr) {
+            context_->lock_mgr_->lock_shared_on_record(context_->txn_, rid_, fh_->GetFd());
+        }
+        decode_key_record(*scan_, key_buf_.get(), key_rec_);
+    }
+
+    // 把scan当前key中的各列解码到rec中对应字段的位置，key_buf存放解码后的key
+    void decode_key_record(const IxScan &scan, char *key_buf, RmRecord &rec) const {
+        scan.get_key(key_buf);
+        int key_pos = 0;
+        for (const auto &col : index_meta_.cols) {
+            memcpy(rec.data + col.offset, key_buf + key_pos, col.len);
+            key_pos += col.len;
+        }
+    }
+
+    // cond能否拼进col对应的key：和值比较，值的类型和字段相同（int和float的格式不同）
+    bool is_key_cond(const Condition &cond, const ColMeta &col) const {
+        return cond.is_rhs_val && cond.lhs_col.col_name == col.name && cond.rhs_val.type == col.type &&
+               !cond.rhs_val.raw.empty();
+    }
 
     // 注意索引是按多列联合排序的
     // 下界（lower）：用最小值补全，确保从第一个可能的key开始
@@ -369,7 +935,7 @@ class IndexScanExecutor : public AbstractExecutor {
         } else {
             // 右值是数据
             rhs_type = cond.rhs_val.type;
-            rhs_data = cond.rhs_val.raw->data;
+            rhs_data = cond.rhs_val.raw.data();
         }
 
         int cmp = comp(lhs_data, rhs_data, lhs_meta->len, lhs_type, rhs_type);
@@ -391,13 +957,22 @@ class IndexScanExecutor : public AbstractExecutor {
         }
     }
 
-    // 检查所有条件
+    // 检查所有条件，再算OR条件组，最后计算表达式条件
     bool check_conds(const RmRecord *rec, const std::vector<ColMeta> &cols, const std::vector<Condition> &conds) {
+        return check_conds(rec, cols, conds, expr_scratch_);
+    }
+
+    // 并行读的各个参与者各用自己的scratch
+    bool check_conds(const RmRecord *rec, const std::vector<ColMeta> &cols, const std::vector<Condition> &conds,
+                     ExprScratch &scratch) {
         for (const auto &cond : conds) {
             if (!check_cond(rec, cols, cond)) {
                 return false;
             }
         }
-        return true;
+        if (!or_filter_.empty() && !or_filter_.eval(rec->data)) {
+            return false;
+        }
+        return expr_filter_.empty() || expr_filter_.eval(rec->data, scratch);
     }
 };
\ No newline at end of file
@@ -9,10 +9,14 @@ MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
 See the Mulan PSL v2 for more details. */
 
 #pragma once
+#include <algorithm>
+#include <numeric>
+
 #include "execution_defs.h"
 #include "execution_manager.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "mat_view.h"
 #include "system/sm.h"
 
 class InsertExecutor : public AbstractExecutor {
@@ -23,68 +27,158 @@ private:
     std::string tab_name_; // 表名称
     Rid rid_; // 插入的位置，由于系统默认插入时不指定位置，因此当前rid_在插入后才赋值
     SmManager *sm_manager_;
+    std::unique_ptr<MatViewMaintainer> mat_views_; // 表上有物化视图时维护它们
+    std::vector<std::unique_ptr<InsertExecutor>> partitions_; // 分区表：每个要插入记录的分区一个
 
 public:
     InsertExecutor(SmManager *sm_manager, const std::string &tab_name, std::vector<Value> values, Context *context) {
         sm_manager_ = sm_manager;
-        tab_ = sm_manager_->db_.get_table(tab_name);
-        values_ = values;
+        values_ = std::move(values);
         tab_name_ = tab_name;
-        if (values.size() != tab_.cols.size()) {
+        context_ = context;
+        // 表上的 IX 锁和全表扫描的 S 锁互斥，索引扫描过的区间由插入时的间隙锁保护。
+        // 先加锁再复制表的元数据：在线建索引发布新索引前要加表 X 锁，之后复制的索引列表不会漏掉新索引
+        TabMeta &tab = sm_manager_->db_.get_table(tab_name);
+        fh_ = sm_manager_->get_fh(tab.id);
+        context_->lock_mgr_->lock_IX_on_table(context_->txn_, fh_->GetFd());
+        tab_ = tab;
+        if (values_.empty() || values_.size() % tab_.cols.size() != 0) {
             throw InvalidValueCountError();
         }
-        fh_ = sm_manager_->fhs_.at(tab_name).get();
-        context_ = context;
+        if (!tab_.mat_views.empty()) {
+            mat_views_ = std::make_unique<MatViewMaintainer>(sm_manager_, tab_, context_);
+        }
+        if (tab_.partition.is_partitioned()) {
+            route_to_partitions();
+        }
     };
 
     std::unique_ptr<RmRecord> Next() override {
-        // Make record buffer
-        RmRecord rec(fh_->get_file_hdr().record_size);
-        for (size_t i = 0; i < values_.size(); i++) {
-            auto &col = tab_.cols[i];
-            auto &val = values_[i];
-            if (col.type != val.type) {
-                throw IncompatibleTypeError(coltype2str(col.type), coltype2str(val.type));
+        if (!partitions_.empty()) {
+            for (auto &partition : partitions_) {
+                partition->Next();
+            }
+            rid_ = partitions_.back()->rid();
+            return nullptr;
+        }
+        // Make record buffer，多行插入时values_按行依次存放，所有记录连续放在一块缓冲区中
+        size_t num_cols = tab_.cols.size();
+        size_t num_rows = values_.size() / num_cols;
+        int record_size = fh_->get_file_hdr().record_size;
+        std::vector<char> data(num_rows * record_size);
+        std::vector<char *> bufs(num_rows);
+        for (size_t row = 0; row < num_rows; ++row) {
+            bufs[row] = data.data() + row * record_size;
+            for (size_t i = 0; i < num_cols; i++) {
+                auto &col = tab_.cols[i];
+                auto &val = values_[row * num_cols + i];
+                if (col.type != val.type) {
+                    throw IncompatibleTypeError(coltype2str(col.type), coltype2str(val.type));
+                }
+                val.init_raw(col.len);
+                memcpy(bufs[row] + col.offset, val.raw.data(), col.len);
             }
-            val.init_raw(col.len);
-            memcpy(rec.data + col.offset, val.raw->data, col.len);
         }
 
-        // 先检查 key 是否是 unique
+        // 先检查 key 是否是 unique：既不能和索引中已有的key重复，也不能和同一批中的其他行重复。
+        // 这一批的key先攒起来，记录插入之后再一次性合并进索引
+        struct BatchKeys {
+            IxIndexHandle *ih;
+            std::vector<char> keys;
+            std::vector<size_t> order;
+        };
+        std::vector<BatchKeys> batch_keys;
+        batch_keys.reserve(tab_.indexes.size());
         for (auto &[index_name, index] : tab_.indexes) {
-            auto ih = sm_manager_->ihs_.at(index_name).get();
-            int offset = 0;
-            // TODO 优化 放到容器中
-            char *key = new char[index.col_tot_len];
+            auto &batch = batch_keys.emplace_back();
+            batch.ih = sm_manager_->get_ih(index.id);
+            batch.keys.resize(num_rows * index.col_tot_len);
+            std::vector<ColType> col_types;
+            std::vector<int> col_lens;
             for (size_t i = 0; i < index.col_num; ++i) {
-                memcpy(key + offset, rec.data + index.cols[i].offset, index.cols[i].len);
-                offset += index.cols[i].len;
+                col_types.push_back(index.cols[i].type);
+                col_lens.push_back(index.cols[i].len);
+            }
+            for (size_t row = 0; row < num_rows; ++row) {
+                char *key = batch.keys.data() + row * index.col_tot_len;
+                int offset = 0;
+                for (int i = 0; i < index.col_num; ++i) {
+                    memcpy(key + offset, bufs[row] + index.cols[i].offset, index.cols[i].len);
+                    offset += index.cols[i].len;
+                }
+                // 插入意向锁：key要插进的间隙被其他事务扫描过时等待
+                context_->lock_mgr_->lock_insert_on_gap(context_->txn_, batch.ih->fd_, batch.ih->next_key_rid(key));
+                Rid unique_rid{};
+                if (!batch.ih->check_unique(key, unique_rid, context_->txn_)) {
+                    throw InternalError("NonUniqueIndexError");
+                }
             }
-            Rid unique_rid{};
-            if (!ih->check_unique(key, unique_rid, context_->txn_)) {
-                delete []key;
-                throw InternalError("NonUniqueIndexError");
+            auto key_of = [&batch, &index](size_t row) { return batch.keys.data() + row * index.col_tot_len; };
+            batch.order.resize(num_rows);
+            std::iota(batch.order.begin(), batch.order.end(), 0);
+            std::sort(batch.order.begin(), batch.order.end(), [&](size_t a, size_t b) {
+                return ix_compare(key_of(a), key_of(b), col_types, col_lens) < 0;
+            });
+            for (size_t i = 1; i < num_rows; ++i) {
+                if (ix_compare(key_of(batch.order[i - 1]), key_of(batch.order[i]), col_types, col_lens) == 0) {
+                    throw InternalError("NonUniqueIndexError");
+                }
             }
-            delete []key;
         }
 
         // Insert into record file
-        rid_ = fh_->insert_record(rec.data, context_);
+        // 插入日志由 RmFileHandle 在页面 pin 住时写入并标记页面 lsn
+        std::vector<Rid> rids = fh_->insert_records(bufs, context_);
+        rid_ = rids.back();
 
         // Unique Index -> Insert into index
-        for (auto &[index_name, index] : tab_.indexes) {
-            auto ih = sm_manager_->ihs_.at(index_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t i = 0; i < index.col_num; ++i) {
-                memcpy(key + offset, rec.data + index.cols[i].offset, index.cols[i].len);
-                offset += index.cols[i].len;
+        // 按key顺序批量插入：落在同一个叶子上的key在一次加锁中插完，只有换叶子或者要分裂时才重新查找
+        for (auto &batch : batch_keys) {
+            size_t key_len = batch.keys.size() / num_rows;
+            std::vector<const char *> keys;
+            std::vector<Rid> key_rids;
+            keys.reserve(num_rows);
+            key_rids.reserve(num_rows);
+            for (size_t row : batch.order) {
+                keys.push_back(batch.keys.data() + row * key_len);
+                key_rids.push_back(rids[row]);
             }
-            ih->insert_entry(key, rid_, context_->txn_);
-            delete []key;
+            batch.ih->insert_entries(keys, key_rids, context_->txn_);
         }
+        if (mat_views_ != nullptr) {
+            for (auto *buf : bufs) {
+                mat_views_->add(buf, 1);
+            }
+            mat_views_->apply();
+        }
+        fh_->note_rows_modified(num_rows);
         return nullptr;
     }
 
     Rid &rid() override { return rid_; }
+
+private:
+    // 分区表本身不存记录：按分区字段的值把各行分给所在的分区，每个分区由自己的InsertExecutor插入
+    void route_to_partitions() {
+        size_t num_cols = tab_.cols.size();
+        auto key_col = tab_.get_col(tab_.partition.col);
+        size_t key_pos = key_col - tab_.cols.begin();
+        std::vector<std::vector<Value>> rows(tab_.partition.num);
+        for (size_t begin = 0; begin < values_.size(); begin += num_cols) {
+            // 分区内的InsertExecutor还要对这个值init_raw，这里在副本上计算哈希
+            Value key = values_[begin + key_pos];
+            if (key.type != key_col->type) {
+                throw IncompatibleTypeError(coltype2str(key_col->type), coltype2str(key.type));
+            }
+            key.init_raw(key_col->len);
+            auto &dest = rows[tab_.partition.partition_of(key.raw.data(), key_col->len)];
+            dest.insert(dest.end(), values_.begin() + begin, values_.begin() + begin + num_cols);
+        }
+        for (int i = 0; i < tab_.partition.num; ++i) {
+            if (!rows[i].empty()) {
+                partitions_.push_back(std::make_unique<InsertExecutor>(
+                    sm_manager_, PartitionDef::partition_name(tab_name_, i), std::move(rows[i]), context_));
+            }
+        }
+    }
 };
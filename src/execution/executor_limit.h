@@ -0,0 +1,76 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include "execution_defs.h"
+#include "executor_abstract.h"
+
+/**
+ * @description: LIMIT n OFFSET m。构造时把需要的行数n+m通过set_limit下推给儿子，
+ * 投影再下推给扫描，取够之后整棵算子树都不再往后读；beginTuple时逐条跳过前m条
+ */
+class LimitExecutor : public AbstractExecutor {
+ private:
+  std::unique_ptr<AbstractExecutor> prev_;
+  int limit_;         // 最多输出的记录数，-1表示没有LIMIT
+  int offset_;        // 跳过的记录数
+  int remaining_ = 0;  // 还可以输出的记录数，-1表示不限
+
+ public:
+  LimitExecutor(std::unique_ptr<AbstractExecutor> prev, int limit, int offset)
+      : prev_(std::move(prev)), limit_(limit), offset_(offset) {
+    prev_->set_limit(limit_ < 0 ? -1 : limit_ + offset_);
+  }
+
+  void beginTuple() override {
+    prev_->beginTuple();
+    for (int i = 0; i < offset_ && !prev_->is_end(); ++i) {
+      prev_->nextTuple();
+    }
+    remaining_ = limit_;
+  }
+
+  void nextTuple() override {
+    if (is_end()) {
+      return;
+    }
+    // 最后一条已经输出，不必再让儿子找下一条
+    if (remaining_ > 0 && --remaining_ == 0) {
+      return;
+    }
+    prev_->nextTuple();
+  }
+
+  std::unique_ptr<RmRecord> Next() override { return prev_->Next(); }
+
+  const RmRecord* next_view() override { return prev_->next_view(); }
+
+  bool NextBatch(TupleBatch& batch) override {
+    if (remaining_ == 0 || !prev_->NextBatch(batch)) {
+      return false;
+    }
+    if (remaining_ > 0) {
+      batch.truncate(remaining_);
+      remaining_ -= static_cast<int>(batch.size());
+    }
+    return true;
+  }
+
+  bool is_end() const override { return remaining_ == 0 || prev_->is_end(); }
+
+  Rid& rid() override { return prev_->rid(); }
+
+  const std::vector<ColMeta>& cols() const override { return prev_->cols(); }
+
+  size_t tupleLen() const override { return prev_->tupleLen(); }
+
+  std::string getType() override { return "LimitExecutor"; }
+};
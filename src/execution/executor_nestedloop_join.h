@@ -13,8 +13,13 @@ See the Mulan PSL v2 for more details. */
 #include "execution_manager.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "join_columns.h"
 #include "system/sm.h"
 
+/**
+ * @description: 块嵌套循环连接。按NLJ_BLOCK_MEMORY把左儿子的记录一块一块缓存在内存中，
+ * 每块只扫描一遍右儿子，右儿子的每条记录和块中所有左记录比较，右表的扫描次数从左表行数降到块数
+ */
 class NestedLoopJoinExecutor : public AbstractExecutor {
    private:
     std::unique_ptr<AbstractExecutor> left_;    // 左儿子节点（需要join的表）
@@ -23,9 +28,14 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
     std::vector<ColMeta> cols_;                 // join后获得的记录的字段
 
     std::vector<Condition> fed_conds_;          // join条件
-    std::unique_ptr<RmRecord> join_record_;
-    std::unique_ptr<RmRecord> lrecord_;
+    const RmRecord *rrecord_ = nullptr;         // 当前的内表记录，在右儿子nextTuple()之前有效
+    std::vector<char> block_;                   // 缓存的一块左表记录，紧密排列
+    size_t block_cap_;                          // 一块最多缓存的左表记录数
+    size_t block_rows_ = 0;                     // 当前块中的记录数
+    size_t lpos_ = 0;                           // 和rrecord_匹配的左表记录在块中的下标
     bool isend;
+    JoinColumns join_cols_;                     // 拼接结果时只拷贝上层需要的字段
+    RmRecord join_record_;                      // next_view()复用的连接结果
 
    public:
     NestedLoopJoinExecutor(std::unique_ptr<AbstractExecutor> left, std::unique_ptr<AbstractExecutor> right, 
@@ -42,58 +52,34 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
         cols_.insert(cols_.end(), right_cols.begin(), right_cols.end());
         isend = false;
         fed_conds_ = std::move(conds);
-
+        block_cap_ = std::max<size_t>(1, NLJ_BLOCK_MEMORY / std::max<size_t>(1, left_->tupleLen()));
+        join_cols_.init(left_->tupleLen(), right_->tupleLen());
+        join_record_ = RmRecord(len_);
     }
 
     void beginTuple() override {
+        isend = false;
         left_->beginTuple();
+        if (!load_block()) {
+            isend = true;
+            return;
+        }
         right_->beginTuple();
-
-        while (!left_->is_end()) {
-            lrecord_ = left_->Next();
-            while (!right_->is_end()) {
-                auto &&rrecord = right_->Next();
-                if (check_conds(lrecord_.get(), rrecord.get(), cols_, fed_conds_)) {
-                    join_record_ = std::make_unique<RmRecord>(len_);
-                    memcpy(join_record_->data, lrecord_->data, left_->tupleLen());
-                    memcpy(join_record_->data + left_->tupleLen(), rrecord->data, right_->tupleLen());
-                    // 得到第一个满足条件的tuple，返回
-                    return;
-                }
-                // 不满足条件，继续在右表找
-                right_->nextTuple();
-            }
-            // 没有找到，从左表下一个记录开始，重置右表
-            left_->nextTuple();
-            right_->beginTuple();
+        if (right_->is_end()) {
+            // 内表为空，连接结果为空，不必再读左表
+            isend = true;
+            return;
         }
+        lpos_ = 0;
+        find_match();
     }
 
     void nextTuple() override {
-        if (left_->is_end()) {
+        if (isend) {
             return;
         }
-
-        right_->nextTuple();
-
-        while (!left_->is_end()) {
-            while (!right_->is_end()) {
-                auto &&rrecord = right_->Next();
-                if (check_conds(lrecord_.get(), rrecord.get(), cols_, fed_conds_)) {
-                    join_record_ = std::make_unique<RmRecord>(len_);
-                    memcpy(join_record_->data, lrecord_->data, left_->tupleLen());
-                    memcpy(join_record_->data + left_->tupleLen(), rrecord->data, right_->tupleLen());
-                    return;
-                }
-                right_->nextTuple();
-            }
-            left_->nextTuple();
-            if (left_->is_end()) {
-                break;
-            }
-            lrecord_ = left_->Next();
-            right_->beginTuple();
-        }
+        ++lpos_;
+        find_match();
     }
 
 
@@ -101,11 +87,41 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
     // 构造并返回一条记录
     // 只是读取当前内容
     std::unique_ptr<RmRecord> Next() override {
-        return std::move(join_record_);
+        auto join_record = std::make_unique<RmRecord>(len_);
+        join_into(join_record->data);
+        return join_record;
+    }
+
+    const RmRecord *next_view() override {
+        join_into(join_record_.data);
+        return &join_record_;
+    }
+
+    // 匹配的记录直接拼接到batch中，不为每条结果分配记录
+    bool NextBatch(TupleBatch &batch) override {
+        batch.reset(len_);
+        for (; !is_end() && !batch.full(); nextTuple()) {
+            join_into(batch.append(_abstract_rid));
+        }
+        return batch.size() > 0;
+    }
+
+    void join_into(char *dest) const { join_cols_.copy(dest, left_row(lpos_), rrecord_->data); }
+
+    // 条件在左右记录上分别读取，拼接时不需要拷贝条件的字段
+    void set_read_cols(const std::vector<ColMeta> &cols) override {
+        std::vector<ColMeta> cond_cols;
+        for (auto &cond : fed_conds_) {
+            cond_cols.push_back(*get_col(cols_, cond.lhs_col));
+            if (!cond.is_rhs_val) {
+                cond_cols.push_back(*get_col(cols_, cond.rhs_col));
+            }
+        }
+        join_cols_.set_read_cols(cols, cond_cols, left_.get(), right_.get());
     }
 
     bool is_end() const override {
-        return left_->is_end();
+        return isend;
     }
 
     Rid &rid() override { return _abstract_rid; }
@@ -118,6 +134,53 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
         return len_;
     }
 
+   private:
+    const char *left_row(size_t i) const { return block_.data() + i * left_->tupleLen(); }
+
+    // 从左儿子读入下一块记录，左表读完时返回false
+    bool load_block() {
+        size_t llen = left_->tupleLen();
+        block_rows_ = 0;
+        while (!left_->is_end() && block_rows_ < block_cap_) {
+            auto lrecord = left_->next_view();
+            if (block_.size() < (block_rows_ + 1) * llen) {
+                block_.resize(std::min(block_cap_, std::max<size_t>(64, block_rows_ * 2)) * llen);
+            }
+            memcpy(block_.data() + block_rows_ * llen, lrecord->data, llen);
+            ++block_rows_;
+            left_->nextTuple();
+        }
+        return block_rows_ > 0;
+    }
+
+    // 从(右儿子当前记录, lpos_)开始找下一对满足条件的记录，找不到时置isend
+    void find_match() {
+        while (true) {
+            while (!right_->is_end()) {
+                // 内表每条记录和整块左表记录比较，只读取不拷贝
+                auto rrecord = right_->next_view();
+                for (; lpos_ < block_rows_; ++lpos_) {
+                    if (check_conds(left_row(lpos_), rrecord->data, cols_, fed_conds_)) {
+                        // 连接结果在Next()或NextBatch()中才拼接
+                        rrecord_ = rrecord;
+                        return;
+                    }
+                }
+                right_->nextTuple();
+                lpos_ = 0;
+                check_cancel();
+            }
+            // 这一块和内表比较完了，换下一块并重新扫描内表
+            if (!load_block()) {
+                isend = true;
+                return;
+            }
+            right_->beginTuple();
+            lpos_ = 0;
+        }
+    }
+
+   public:
     static inline int comp(const char *ldata, const char *rdata, int len, ColType lhs_type, ColType rhs_type) {
         // 支持 int/float 混合比较
         if ((lhs_type == TYPE_INT && rhs_type == TYPE_FLOAT) || (lhs_type == TYPE_FLOAT && rhs_type == TYPE_INT)) {
@@ -149,9 +212,9 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
     }
 
     // 检查单个条件
-    bool check_cond(const RmRecord *lrecord, const RmRecord *rrecord, const std::vector<ColMeta> &cols, const Condition &cond) {
+    bool check_cond(const char *ldata, const char *rdata, const std::vector<ColMeta> &cols, const Condition &cond) {
         const auto &lhs_meta = get_col(cols, cond.lhs_col);   // 指向 cols_中对应的字段元数据
-        const char *lhs_data = lrecord->data + lhs_meta->offset;  // 获取左侧字段的数据
+        const char *lhs_data = ldata + lhs_meta->offset;  // 获取左侧字段的数据
         const char *rhs_data;
         ColType rhs_type;
         ColType lhs_type = lhs_meta->type;
@@ -161,11 +224,11 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
             // 右值是记录中的字段，获取元数据
             const auto &rhs_meta = get_col(cols, cond.rhs_col);
             rhs_type = rhs_meta->type;
-            rhs_data = rrecord->data + rhs_meta->offset - left_->tupleLen();
+            rhs_data = rdata + rhs_meta->offset - left_->tupleLen();
         } else {
             // 右值是数据
             rhs_type = cond.rhs_val.type;
-            rhs_data = cond.rhs_val.raw->data;
+            rhs_data = cond.rhs_val.raw.data();
         }
 
         int cmp = comp(lhs_data, rhs_data, lhs_meta->len, lhs_type, rhs_type);
@@ -188,9 +251,9 @@ class NestedLoopJoinExecutor : public AbstractExecutor {
     }
 
     // 检查所有条件
-    bool check_conds(const RmRecord *lrecord, const RmRecord *rrecord, const std::vector<ColMeta> &cols, const std::vector<Condition> &conds) {
+    bool check_conds(const char *ldata, const char *rdata, const std::vector<ColMeta> &cols, const std::vector<Condition> &conds) {
         for (const auto &cond : conds) {
-            if (!check_cond(lrecord, rrecord, cols, cond)) {
+            if (!check_cond(ldata, rdata, cols, cond)) {
                 return false;  // 如果有一个条件不满足，则返回false
             }
         }
@@ -0,0 +1,178 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <numeric>
+
+#include "execution_defs.h"
+#include "executor_abstract.h"
+#include "executor_seq_scan.h"
+#include "system/sm.h"
+
+/**
+ * @description: 分区表上的扫描。分区表本身不存记录，依次扫描各个分区，输出它们的并集。
+ * 分区字段上有和常量的等值条件时，只有这个常量所在的分区可能有满足条件的记录，其余分区不扫描。
+ * 每个分区由一个SeqScanExecutor扫描，条件、加锁和快照读都由它处理；分区和分区表的字段完全相同，
+ * 条件中的表名换成分区的表名后照常使用，输出的字段仍然是分区表的字段
+ */
+class PartitionScanExecutor : public AbstractExecutor {
+   private:
+    std::string tab_name_;                                   // 分区表的名称
+    std::vector<ColMeta> cols_;                              // 输出的字段
+    std::vector<std::unique_ptr<AbstractExecutor>> parts_;   // 需要扫描的分区
+    size_t part_pos_ = 0;                                    // 当前扫描的分区
+    Rid rid_;
+
+    int limit_ = -1;                                         // 上层只需要前limit_条，-1表示全部
+    size_t produced_ = 0;
+
+   public:
+    PartitionScanExecutor(SmManager *sm_manager, std::string tab_name, std::vector<Condition> conds,
+                          Context *context, std::vector<ExprCond> expr_conds = {},
+                          std::vector<OrCond> or_conds = {}, const std::vector<ColMeta> &out_cols = {}) {
+        context_ = context;
+        tab_name_ = std::move(tab_name);
+        TabMeta &tab = sm_manager->db_.get_table(tab_name_);
+        cols_ = out_cols.empty() ? tab.cols : out_cols;
+        for (int i : prune(tab, conds)) {
+            std::string part_name = PartitionDef::partition_name(tab_name_, i);
+            parts_.push_back(std::make_unique<SeqScanExecutor>(
+                sm_manager, part_name, rename_conds(conds, part_name), context,
+                rename_expr_conds(expr_conds, part_name), or_conds, out_cols));
+        }
+    }
+
+    std::string getType() override { return "PartitionScanExecutor"; }
+
+    void beginTuple() override {
+        produced_ = 0;
+        part_pos_ = 0;
+        if (!parts_.empty()) {
+            start_part();
+        }
+        skip_empty_parts();
+    }
+
+    void nextTuple() override {
+        parts_[part_pos_]->nextTuple();
+        ++produced_;
+        skip_empty_parts();
+    }
+
+    bool is_end() const override {
+        return part_pos_ == parts_.size() || (limit_ >= 0 && produced_ >= static_cast<size_t>(limit_));
+    }
+
+    std::unique_ptr<RmRecord> Next() override { return parts_[part_pos_]->Next(); }
+
+    const RmRecord *next_view() override { return parts_[part_pos_]->next_view(); }
+
+    // 当前分区批量输出，分区扫完时换到下一个分区
+    bool NextBatch(TupleBatch &batch) override {
+        while (!is_end()) {
+            if (parts_[part_pos_]->NextBatch(batch)) {
+                produced_ += batch.size();
+                skip_empty_parts();
+                return true;
+            }
+            skip_empty_parts();
+        }
+        batch.reset(tupleLen());
+        return false;
+    }
+
+    Rid &rid() override { return part_pos_ < parts_.size() ? parts_[part_pos_]->rid() : rid_; }
+
+    const std::vector<ColMeta> &cols() const override { return cols_; }
+
+    size_t tupleLen() const override { return cols_.back().offset + cols_.back().len; }
+
+    void set_limit(int limit) override { limit_ = limit; }
+
+    // 分区按字段名查找要读取的字段，不需要换表名
+    void set_read_cols(const std::vector<ColMeta> &cols) override {
+        for (auto &part : parts_) {
+            part->set_read_cols(cols);
+        }
+    }
+
+   private:
+    // 开始扫描当前分区，上层有limit时分区只需要输出还差的条数
+    void start_part() {
+        if (limit_ >= 0) {
+            parts_[part_pos_]->set_limit(limit_ - static_cast<int>(produced_));
+        }
+        parts_[part_pos_]->beginTuple();
+    }
+
+    // 当前分区扫完时换到下一个还有记录的分区
+    void skip_empty_parts() {
+        while (part_pos_ < parts_.size() && parts_[part_pos_]->is_end()) {
+            if (++part_pos_ == parts_.size() || is_end()) {
+                return;
+            }
+            start_part();
+        }
+    }
+
+    // 可能有满足条件的记录的分区：分区字段和常量等值时只有一个，否则是全部分区
+    static std::vector<int> prune(TabMeta &tab, const std::vector<Condition> &conds) {
+        auto key_col = tab.get_col(tab.partition.col);
+        for (auto &cond : conds) {
+            if (cond.op != OP_EQ || !cond.is_rhs_val || cond.lhs_col.col_name != key_col->name ||
+                cond.rhs_val.type != key_col->type) {
+                continue;
+            }
+            Value key = cond.rhs_val;
+            if (key.raw.empty()) {
+                key.init_raw(key_col->len);
+            }
+            return {tab.partition.partition_of(key.raw.data(), key_col->len)};
+        }
+        std::vector<int> parts(tab.partition.num);
+        std::iota(parts.begin(), parts.end(), 0);
+        return parts;
+    }
+
+    static std::vector<Condition> rename_conds(std::vector<Condition> conds, const std::string &part_name) {
+        for (auto &cond : conds) {
+            cond.lhs_col.tab_name = part_name;
+            if (!cond.is_rhs_val) {
+                cond.rhs_col.tab_name = part_name;
+            }
+        }
+        return conds;
+    }
+
+    // 表达式树在计划之间共享，不能原地修改，换表名时复制用到字段的路径
+    static std::shared_ptr<const Expression> rename_expr(const std::shared_ptr<const Expression> &expr,
+                                                         const std::string &part_name) {
+        if (expr->kind == Expression::COL) {
+            TabCol col = expr->col;
+            col.tab_name = part_name;
+            return Expression::make_col(std::move(col), expr->type);
+        }
+        if (expr->kind == Expression::ARITH) {
+            return Expression::make_arith(expr->op, rename_expr(expr->lhs, part_name),
+                                          rename_expr(expr->rhs, part_name));
+        }
+        return expr;
+    }
+
+    static std::vector<ExprCond> rename_expr_conds(const std::vector<ExprCond> &expr_conds,
+                                                   const std::string &part_name) {
+        std::vector<ExprCond> renamed;
+        for (auto &cond : expr_conds) {
+            renamed.push_back({rename_expr(cond.lhs, part_name), cond.op, rename_expr(cond.rhs, part_name)});
+        }
+        return renamed;
+    }
+};
@@ -12,6 +12,7 @@ See the Mulan PSL v2 for more details. */
 #include "execution_defs.h"
 #include "execution_manager.h"
 #include "executor_abstract.h"
+#include "expr_eval.h"
 #include "index/ix.h"
 #include "system/sm.h"
 
@@ -20,15 +21,30 @@ class ProjectionExecutor : public AbstractExecutor {
   std::unique_ptr<AbstractExecutor> prev_;  // 投影节点的儿子节点
   std::vector<ColMeta> proj_cols_;          // 需要投影的字段
   size_t len_;                              // 字段总长度
-  std::vector<size_t> proj_idxs_;  // 每个投影的字段在原先表所有字段的索引
+  std::vector<size_t> proj_idxs_;  // 每个投影的字段在原先表所有字段的索引，计算列为COMPUTED
   const std::vector<ColMeta>& prev_cols_;
   bool is_agg_{false};
-  int limit_;
+  int max_rows_;  // 最多输出的记录数，-1表示全部
+  int limit_;     // 这次执行还可以输出的记录数
+  std::unique_ptr<RmRecord> proj_record_;  // next_view()复用的投影结果
+  TupleBatch prev_batch_;                  // NextBatch()从儿子取的一批
+
+  // 计算列：所有计算列编译到一个程序中，NextBatch()时在整批记录上计算
+  static constexpr size_t COMPUTED = SIZE_MAX;
+  ExprProgram program_;
+  std::vector<std::pair<size_t, int>> computed_;  // 计算列在proj_cols_中的下标和结果所在的寄存器
+  ExprScratch scratch_;
+  std::vector<const char*> rows_;
 
  public:
   ProjectionExecutor(std::unique_ptr<AbstractExecutor> prev,
-                     const std::vector<TabCol>& proj_cols, int limit = -1)
-      : prev_(std::move(prev)), prev_cols_(prev_->cols()), limit_(limit) {
+                     const std::vector<TabCol>& proj_cols,
+                     const std::vector<std::shared_ptr<const Expression>>& exprs = {},
+                     int limit = -1)
+      : prev_(std::move(prev)),
+        prev_cols_(prev_->cols()),
+        max_rows_(limit),
+        limit_(limit) {
     if (prev_->getType() == "AggregateExecutor") {
       is_agg_ = true;
       int offset = 0;
@@ -37,11 +53,28 @@ class ProjectionExecutor : public AbstractExecutor {
         proj_cols_.back().offset = offset;
         offset += col_meta.len;
       }
+      len_ = offset;
       // 这里是引用不能拷贝，聚合调用 begin 后会自动调整 offset
       // proj_cols_ = prev_cols_;
     } else {
       size_t curr_offset = 0;
-      for (auto& proj_col : proj_cols) {
+      std::vector<TabCol> ref_cols;  // 计算列用到的字段
+      for (size_t i = 0; i < proj_cols.size(); ++i) {
+        auto& proj_col = proj_cols[i];
+        if (i < exprs.size() && exprs[i] != nullptr) {
+          // 计算列只有int和float，都是4字节
+          ColMeta col;
+          col.name = proj_col.col_name;
+          col.type = exprs[i]->type;
+          col.len = sizeof(int);
+          col.offset = curr_offset;
+          col.index = false;
+          curr_offset += col.len;
+          proj_idxs_.emplace_back(COMPUTED);
+          proj_cols_.emplace_back(col);
+          exprs[i]->collect_cols(ref_cols);
+          continue;
+        }
         // 得到需要投影的列在所有列中的位置
         auto&& pos = get_col(prev_cols_, proj_col);
         // 计算偏移量
@@ -52,10 +85,40 @@ class ProjectionExecutor : public AbstractExecutor {
         proj_cols_.emplace_back(col);
       }
       len_ = curr_offset;
+      // 只读取投影的字段：连接只拼接这些字段，列存格式的扫描只读这些列
+      std::vector<ColMeta> read_cols;
+      for (auto idx : proj_idxs_) {
+        if (idx != COMPUTED) {
+          read_cols.push_back(prev_cols_[idx]);
+        }
+      }
+      for (auto& ref : ref_cols) {
+        read_cols.push_back(*get_col(prev_cols_, ref));
+      }
+      prev_->set_read_cols(read_cols);
+      for (size_t i = 0; i < proj_idxs_.size(); ++i) {
+        if (proj_idxs_[i] == COMPUTED) {
+          computed_.emplace_back(i, program_.add(*exprs[i], prev_cols_, exprs[i]->type));
+        }
+      }
     }
   }
 
-  void beginTuple() override { prev_->beginTuple(); }
+  void beginTuple() override {
+    limit_ = max_rows_;
+    prev_->beginTuple();
+  }
+
+  // 投影不改变行数，需要的行数继续下推给儿子；聚合要读完全部输入，不下推
+  void set_limit(int limit) override {
+    if (limit >= 0 && (max_rows_ < 0 || limit < max_rows_)) {
+      max_rows_ = limit;
+    }
+    limit_ = max_rows_;
+    if (!is_agg_) {
+      prev_->set_limit(max_rows_);
+    }
+  }
 
   void nextTuple() override {
     // limit 有效时，如果还需要输出记录的条数已经为 0 了，没必要再调用
@@ -70,22 +133,60 @@ class ProjectionExecutor : public AbstractExecutor {
     if (is_agg_) {
       return std::move(prev_->Next());
     }
-    // 满足谓词条件的原记录（这里不能使用std::move，字符串乱码？）
-    auto&& prev_record = prev_->Next();
     // 要投影的记录
     auto&& proj_record = std::make_unique<RmRecord>(len_);
-    for (std::size_t i = 0; i < proj_idxs_.size(); ++i) {
-      // 需要投影的字段
-      auto& prev_col = prev_cols_[proj_idxs_[i]];
-      // 被投影到的字段
-      auto& proj_col = proj_cols_[i];
-      // 拷贝投影的字段数据
-      memcpy(proj_record->data + proj_col.offset,
-             prev_record->data + prev_col.offset, prev_col.len);
-    }
+    project(proj_record.get());
     return std::move(proj_record);
   }
 
+  // 投影到内部缓冲区，整个查询只分配一次
+  const RmRecord* next_view() override {
+    --limit_;
+    if (is_agg_) {
+      return prev_->next_view();
+    }
+    if (proj_record_ == nullptr) {
+      proj_record_ = std::make_unique<RmRecord>(len_);
+    }
+    project(proj_record_.get());
+    return proj_record_.get();
+  }
+
+  // 从儿子取一批，逐条投影到batch中
+  bool NextBatch(TupleBatch& batch) override {
+    if (limit_ == 0) {
+      return false;
+    }
+    if (is_agg_) {
+      if (!prev_->NextBatch(batch)) {
+        return false;
+      }
+    } else {
+      batch.reset(len_);
+      if (!prev_->NextBatch(prev_batch_)) {
+        return false;
+      }
+      if (!computed_.empty()) {
+        // 先在整批记录上算出计算列
+        rows_.resize(prev_batch_.size());
+        for (size_t r = 0; r < prev_batch_.size(); ++r) {
+          rows_[r] = prev_batch_.row(r);
+        }
+        program_.run(rows_.data(), rows_.size(), scratch_);
+      }
+      for (size_t r = 0; r < prev_batch_.size(); ++r) {
+        char* proj_data = batch.append(prev_batch_.rid(r));
+        copy_cols(prev_batch_.row(r), proj_data);
+        store_computed(r, proj_data);
+      }
+    }
+    if (limit_ > 0) {
+      batch.truncate(limit_);
+      limit_ -= static_cast<int>(batch.size());
+    }
+    return true;
+  }
+
   Rid& rid() override { return _abstract_rid; }
 
   bool is_end() const { return limit_ == 0 || prev_->is_end(); }
@@ -94,4 +195,46 @@ class ProjectionExecutor : public AbstractExecutor {
   const std::vector<ColMeta>& cols() const override { return proj_cols_; }
 
   size_t tupleLen() const override { return len_; }
+
+ private:
+  void project(RmRecord* proj_record) {
+    // 满足谓词条件的原记录，只读取不拷贝
+    auto prev_record = prev_->next_view();
+    project(prev_record->data, proj_record->data);
+  }
+
+  void project(const char* prev_data, char* proj_data) {
+    copy_cols(prev_data, proj_data);
+    if (!computed_.empty()) {
+      program_.run(&prev_data, 1, scratch_);
+      store_computed(0, proj_data);
+    }
+  }
+
+  // 把第r条记录的计算列从寄存器写到proj_data中
+  void store_computed(size_t r, char* proj_data) {
+    for (auto& [i, reg] : computed_) {
+      auto& values = scratch_.regs[reg];
+      const void* value = proj_cols_[i].type == TYPE_INT
+                              ? static_cast<const void*>(&values.ints[r])
+                              : static_cast<const void*>(&values.floats[r]);
+      memcpy(proj_data + proj_cols_[i].offset, value, sizeof(int));
+    }
+  }
+
+  // 拷贝投影的普通字段
+  void copy_cols(const char* prev_data, char* proj_data) {
+    for (std::size_t i = 0; i < proj_idxs_.size(); ++i) {
+      if (proj_idxs_[i] == COMPUTED) {
+        continue;
+      }
+      // 需要投影的字段
+      auto& prev_col = prev_cols_[proj_idxs_[i]];
+      // 被投影到的字段
+      auto& proj_col = proj_cols_[i];
+      // 拷贝投影的字段数据
+      memcpy(proj_data + proj_col.offset, prev_data + prev_col.offset,
+             prev_col.len);
+    }
+  }
 };
@@ -0,0 +1,272 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <functional>
+#include <string_view>
+
+#include "execution_defs.h"
+#include "executor_abstract.h"
+
+/**
+ * @description: IN / EXISTS 子查询改写成的哈希半连接（NOT IN / NOT EXISTS 是反连接）。右儿子是子查询，
+ * 连接条件都是等值条件，key是各个条件的字段拼起来的；没有条件（不关联的EXISTS）时key为空，
+ * 子查询有结果时所有记录都匹配。先把子查询的key去重后放进开放寻址的哈希集合，再按批读取左儿子，
+ * 在选择向量上原地去掉不匹配（反连接时是匹配）的记录。输出的记录就是左儿子的记录，每条最多输出一次
+ */
+class HashSemiJoinExecutor : public AbstractExecutor {
+ private:
+  std::unique_ptr<AbstractExecutor> left_;   // 外层查询
+  std::unique_ptr<AbstractExecutor> right_;  // 子查询
+  bool anti_;                                // NOT IN / NOT EXISTS
+
+  // key中的一个字段
+  struct KeyPart {
+    ColMeta left_col;
+    ColMeta right_col;
+    ColType type;  // 两侧类型不同（int和float）时统一成float
+    int offset;    // 在key中的偏移
+    int len;
+  };
+  std::vector<KeyPart> parts_;
+  int key_len_ = 0;
+
+  // 哈希集合：key连续存放，slots_中存key下标加一，0表示空槽位
+  std::vector<char> keys_;
+  std::vector<uint64_t> hashes_;
+  std::vector<uint32_t> slots_;
+  size_t mask_ = 0;
+  std::vector<char> key_buf_;
+  MemoryReservation mem_;  // 哈希集合占用的语句内存预算
+  bool built_ = false;     // 哈希集合已经建好，重新扫描左儿子时不再执行子查询
+
+  TupleBatch out_;  // 逐条读取时缓存的一批结果
+  size_t out_pos_ = 0;
+  RmRecord view_;  // 指向当前记录，不拥有数据
+  bool is_end_ = true;
+
+ public:
+  HashSemiJoinExecutor(std::unique_ptr<AbstractExecutor> left,
+                       std::unique_ptr<AbstractExecutor> right,
+                       const std::vector<Condition>& conds, bool anti,
+                       Context* context)
+      : left_(std::move(left)), right_(std::move(right)), anti_(anti) {
+    context_ = context;
+    mem_.set_tracker(context == nullptr ? nullptr : &context->memory_);
+    for (auto& cond : conds) {
+      KeyPart part;
+      part.left_col = *get_col(left_->cols(), cond.lhs_col);
+      part.right_col = *get_col(right_->cols(), cond.rhs_col);
+      part.type = part.left_col.type;
+      part.len = std::max(part.left_col.len, part.right_col.len);
+      if (part.left_col.type != part.right_col.type) {
+        if (part.left_col.type == TYPE_STRING ||
+            part.right_col.type == TYPE_STRING) {
+          throw IncompatibleTypeError(coltype2str(part.left_col.type),
+                                      coltype2str(part.right_col.type));
+        }
+        part.type = TYPE_FLOAT;
+        part.len = sizeof(float);
+      }
+      part.offset = key_len_;
+      key_len_ += part.len;
+      parts_.push_back(part);
+    }
+    key_buf_.resize(key_len_);
+    view_.size = static_cast<int>(left_->tupleLen());
+  }
+
+  void beginTuple() override {
+    if (!built_) {
+      build();
+      built_ = true;
+    }
+    left_->beginTuple();
+    out_pos_ = 0;
+    is_end_ = !fill(out_);
+  }
+
+  void nextTuple() override {
+    if (is_end_) {
+      return;
+    }
+    if (++out_pos_ == out_.size()) {
+      out_pos_ = 0;
+      is_end_ = !fill(out_);
+    }
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(tupleLen());
+    memcpy(record->data, out_.row(out_pos_), tupleLen());
+    return record;
+  }
+
+  const RmRecord* next_view() override {
+    view_.data = const_cast<char*>(out_.row(out_pos_));
+    return &view_;
+  }
+
+  // 逐条读取剩下的结果先交出去，之后直接在调用者的batch上过滤
+  bool NextBatch(TupleBatch& batch) override {
+    if (is_end_) {
+      batch.reset(tupleLen());
+      return false;
+    }
+    if (out_pos_ > 0 || out_.size() > 0) {
+      batch.reset(tupleLen());
+      for (; out_pos_ < out_.size(); ++out_pos_) {
+        memcpy(batch.append(out_.rid(out_pos_)), out_.row(out_pos_), tupleLen());
+      }
+      out_.reset(tupleLen());
+      out_pos_ = 0;
+      return true;
+    }
+    if (!fill(batch)) {
+      is_end_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool is_end() const override { return is_end_; }
+
+  Rid& rid() override {
+    _abstract_rid = out_.rid(out_pos_);
+    return _abstract_rid;
+  }
+
+  const std::vector<ColMeta>& cols() const override { return left_->cols(); }
+
+  size_t tupleLen() const override { return left_->tupleLen(); }
+
+  std::string getType() override {
+    return anti_ ? "HashAntiJoinExecutor" : "HashSemiJoinExecutor";
+  }
+
+  // 上层读取的字段加上连接字段继续告诉左儿子；子查询只需要连接字段
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    std::vector<ColMeta> read_cols = cols;
+    std::vector<ColMeta> right_cols;
+    for (auto& part : parts_) {
+      read_cols.push_back(part.left_col);
+      right_cols.push_back(part.right_col);
+    }
+    left_->set_read_cols(read_cols);
+    if (!right_cols.empty()) {
+      right_->set_read_cols(right_cols);
+    }
+  }
+
+ private:
+  // 按两侧统一后的格式写出key，字符串补零到两侧中较长的长度，浮点数的-0写成0
+  void make_key(const char* row, bool left, char* dest) const {
+    for (auto& part : parts_) {
+      const ColMeta& col = left ? part.left_col : part.right_col;
+      const char* data = row + col.offset;
+      char* key = dest + part.offset;
+      if (part.type == TYPE_FLOAT) {
+        float v;
+        if (col.type == TYPE_INT) {
+          v = static_cast<float>(*reinterpret_cast<const int*>(data));
+        } else {
+          memcpy(&v, data, sizeof(float));
+        }
+        if (v == 0) {
+          v = 0;
+        }
+        memcpy(key, &v, sizeof(float));
+      } else {
+        memcpy(key, data, col.len);
+        memset(key + col.len, 0, part.len - col.len);
+      }
+    }
+  }
+
+  uint64_t hash_key(const char* key) const {
+    return std::hash<std::string_view>{}(std::string_view(key, key_len_));
+  }
+
+  // key_buf_中的key在集合中时返回true；insert为true时不在就插入
+  bool lookup(uint64_t hash, bool insert) {
+    size_t pos = hash & mask_;
+    while (slots_[pos] != 0) {
+      size_t idx = slots_[pos] - 1;
+      if (hashes_[idx] == hash &&
+          memcmp(keys_.data() + idx * key_len_, key_buf_.data(), key_len_) == 0) {
+        return true;
+      }
+      pos = (pos + 1) & mask_;
+    }
+    if (insert) {
+      keys_.insert(keys_.end(), key_buf_.begin(), key_buf_.end());
+      hashes_.push_back(hash);
+      slots_[pos] = static_cast<uint32_t>(hashes_.size());
+    }
+    return false;
+  }
+
+  // 槽位数保持不小于两倍key数的2的幂，满了就翻倍重新插入
+  void grow() {
+    size_t capacity = slots_.size() * 2;
+    slots_.assign(capacity, 0);
+    mask_ = capacity - 1;
+    for (size_t i = 0; i < hashes_.size(); ++i) {
+      size_t pos = hashes_[i] & mask_;
+      while (slots_[pos] != 0) {
+        pos = (pos + 1) & mask_;
+      }
+      slots_[pos] = static_cast<uint32_t>(i + 1);
+    }
+  }
+
+  // 执行子查询，把结果去重后放进哈希集合。关联条件已经变成连接条件，子查询不引用外层的字段，只执行一次
+  void build() {
+    keys_.clear();
+    hashes_.clear();
+    slots_.assign(16, 0);
+    mask_ = 15;
+    mem_.reset();
+    TupleBatch batch;
+    for (right_->beginTuple(); right_->NextBatch(batch);) {
+      check_cancel();
+      for (size_t r = 0; r < batch.size(); ++r) {
+        make_key(batch.row(r), false, key_buf_.data());
+        if (!lookup(hash_key(key_buf_.data()), true) &&
+            hashes_.size() * 2 > slots_.size()) {
+          grow();
+        }
+      }
+      mem_.force_grow_to(keys_.size() + hashes_.size() * sizeof(uint64_t) +
+                         slots_.size() * sizeof(uint32_t));
+    }
+  }
+
+  // 读入左儿子的下一批记录，在选择向量上原地过滤，直到剩下至少一条；左儿子读完时返回false
+  bool fill(TupleBatch& batch) {
+    while (left_->NextBatch(batch)) {
+      check_cancel();
+      auto& sel = batch.sel();
+      size_t n = 0;
+      for (size_t r = 0; r < sel.size(); ++r) {
+        make_key(batch.row(r), true, key_buf_.data());
+        if (lookup(hash_key(key_buf_.data()), false) != anti_) {
+          sel[n++] = sel[r];
+        }
+      }
+      batch.truncate(n);
+      if (n > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
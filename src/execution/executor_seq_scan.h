@@ -10,12 +10,19 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
 #include "execution_defs.h"
 #include "execution_manager.h"
 #include "executor_abstract.h"
+#include "expr_eval.h"
 #include "index/ix.h"
-#include "predicate_manager.h"
+#include "morsel_scheduler.h"
+#include "scan_projection.h"
 #include "system/sm.h"
+#include "transaction/version_store.h"
 
 class SeqScanExecutor : public AbstractExecutor {
  private:
@@ -25,29 +32,129 @@ class SeqScanExecutor : public AbstractExecutor {
   RmFileHandle* fh_;              // 表的数据文件句柄
   // std::vector<ColMeta> cols_; // scan后生成的记录的字段
   std::vector<std::vector<ColMeta>::iterator> cond_cols_;  // 谓词需要读取的字段
-  size_t len_;  // scan后生成的每条记录的长度
+  size_t len_;  // 表中一条完整记录的长度，输出的记录投影后可能更短
   // std::vector<Condition> fed_conds_; // 同conds_，两个字段相同
   Rid rid_;
   std::unique_ptr<RmScan> scan_;  // table_iterator
-  std::unique_ptr<RmRecord> rm_record_;
+  std::unique_ptr<BufferAccessStrategy> strategy_;  // 大表扫描使用的环形缓冲区
+  RmRecordView view_;  // 当前记录，直接指向页面中的槽位
+  std::vector<int> matches_;  // 当前页面中满足谓词的槽位号
+  size_t match_pos_ = 0;      // rid_在matches_中的位置
   std::vector<bool> is_need_scan_;  // 是否需要扫表（非子查询）
   bool is_sub_query_empty_;
-  // false 为共享间隙锁，true 为互斥间隙锁
-  bool gap_mode_;
   TabMeta& tab_;
 
+  // 列存格式中可以直接在mini page上批量计算的谓词：字段单独占一个mini page，右值是同类型的int/float常量
+  struct ColumnFilter {
+    int col;  // mini page号
+    ColType type;
+    CompOp op;
+    const char* rhs;
+  };
+  std::vector<ColumnFilter> column_filters_;
+  // 定长格式中可以直接比较槽位中字典编码的谓词：字典编码的字段和常量的等值、不等比较
+  struct CodeFilter {
+    int code_offset;  // 编码在槽位中的偏移
+    int dict_col;     // 字段在字典中的下标
+    CompOp op;
+    const char* rhs;
+    int code;  // 常量的编码，字典中没有该常量时为-1
+  };
+  std::vector<CodeFilter> code_filters_;
+  bool all_column_filters_ = false;  // 所有谓词都能在mini page或字典编码上计算，不需要逐条读取记录
+  int records_per_page_ = 0;
+  std::vector<uint8_t> passed_;  // 当前页面每个槽位是否满足column_filters_
+  std::vector<RmZoneFilter> zone_filters_;  // 用区域映射跳过页面的条件
+
+  // 右值是常量的谓词在构造时编译成按字段类型和比较符特化的函数，逐条计算时不再分支；
+  // filter是同样特化的整页过滤循环，融合扫描时用
+  using PageFilter = size_t (*)(const char* slots, int slot_size, const int* in,
+                                size_t n, int offset, int len, const char* rhs,
+                                int* out);
+  struct CompiledCond {
+    bool (*eval)(const char* lhs, const char* rhs, int len);
+    int offset;
+    int len;
+    const char* rhs;
+    PageFilter filter;
+  };
+  std::vector<CompiledCond> compiled_conds_;
+  std::vector<size_t> generic_conds_;  // 只能由cmp_cond计算的谓词（右值类型和字段不同，或者不是常量）的下标
+  std::vector<bool> prefiltered_;      // 已经在mini page或字典编码上计算过的谓词
+  std::vector<std::unique_ptr<char[]>> coerced_rhs_;  // 转换成字段类型的常量
+  // 融合扫描：定长格式、没有字典编码的表上，谓词直接在页面的槽位上按特化的循环整页计算，
+  // 非快照读时输出也直接从槽位投影到batch中，不再逐条经过记录视图
+  bool fused_filter_ = false;
+  bool fused_project_ = false;
+  int slot_size_ = 0;
+
+
+  // 表达式条件在一个页面上满足其他谓词的记录上整批计算：逐条计算其他谓词时把记录拷贝出来，页面算完后一起计算
+  ExprFilter expr_filter_;
+  struct ExprBatch {
+    ExprScratch scratch;
+    std::vector<char> data;  // 拷贝出来的记录，第i条在i*len_处
+    std::vector<const char*> rows;
+    std::vector<uint8_t> passed;
+  };
+  ExprBatch expr_batch_;  // 串行扫描用
+  OrFilter or_filter_;    // OR条件组，和其他谓词一起逐条计算
+
+  // 大表按morsel并行计算谓词：每轮把PARALLEL_SCAN_WINDOW_MORSELS个morsel交给MorselScheduler，
+  // 各个morsel中满足谓词的rid按页面顺序拼到window_rids_中，再由调用线程逐条读取
+  struct MorselWorker {
+    std::unique_ptr<BufferAccessStrategy> strategy;
+    RmRecordView view;
+    std::vector<uint8_t> passed;
+    std::vector<int> matches;
+    ExprBatch expr_batch;
+  };
+  bool parallel_ = false;
+  std::vector<std::unique_ptr<MorselWorker>> workers_;  // 下标是参与者编号
+  std::vector<std::vector<Rid>> morsel_rids_;
+  std::vector<Rid> window_rids_;
+  size_t window_pos_ = 0;
+  int next_page_ = 0;  // 下一轮从这个页面开始
+  int end_page_ = 0;   // 开始扫描时表的页面数
+
+  // 同步扫描：用环形缓冲区扫描的大表从其他扫描的当前位置sync_start_开始，扫到末尾后再扫[第一个数据页, sync_start_)。
+  // 没有ORDER BY时输出的顺序本来就不确定
+  bool sync_scan_ = false;
+  bool wrapped_ = false;
+  int sync_start_ = RM_FIRST_RECORD_PAGE;
+  std::vector<int> read_columns_;  // 列存格式中读取的mini page，为空时读取整条记录
+
+  int limit_ = -1;         // 上层只需要前limit_条，-1表示全部
+  size_t produced_ = 0;    // 这次扫描已经交给上层的记录数
+
+  // 快照读（单条SELECT语句）不加锁：快照之后被修改过的记录按版本存储中快照里的版本计算谓词和输出，
+  // 扫描结束后再检查没有扫描过的被修改过的页面（区域映射跳过的页面、扫描时为空的页面）
+  timestamp_t snapshot_ts_ = INVALID_TIMESTAMP;
+  std::vector<uint8_t> visited_;    // 扫描过的页面
+  std::vector<int> changed_pages_;  // 扫描结束后还要检查的页面
+  size_t changed_pos_ = 0;
+  bool in_changed_pages_ = false;
+  int page_no_ = RM_NO_PAGE;  // 串行扫描时matches_所在的页面
+  std::unique_ptr<RmRecord> snapshot_rec_;  // 当前记录的拷贝，页面上的记录随时可能被修改
+  std::shared_ptr<RmRecord> version_;       // 当前记录在快照中的版本
+  const RmRecord* current_ = nullptr;       // 交给上层的当前记录
+  ScanProjection projection_;               // 只输出查询用到的字段
+  bool scanned_ = false;                    // beginTuple过，析构时才能判断扫描是否完整
+
  public:
   SeqScanExecutor(SmManager* sm_manager, std::string tab_name,
                   std::vector<Condition> conds, Context* context,
-                  bool gap_mode = false)
+                  std::vector<ExprCond> expr_conds = {},
+                  std::vector<OrCond> or_conds = {},
+                  const std::vector<ColMeta>& out_cols = {})
       : sm_manager_(sm_manager),
         tab_name_(std::move(tab_name)),
         conds_(std::move(conds)),
-        gap_mode_(gap_mode),
         tab_(sm_manager_->db_.get_table(tab_name_)) {
-    fh_ = sm_manager_->fhs_.at(tab_name_).get();
+    fh_ = sm_manager_->get_fh(tab_.id);
     // cols_ = tab_.cols;
     len_ = tab_.cols.back().offset + tab_.cols.back().len;
+    projection_.init(out_cols, tab_);
     context_ = context;
     // fed_conds_ = conds_;
     is_sub_query_empty_ = false;
@@ -55,68 +162,881 @@ class SeqScanExecutor : public AbstractExecutor {
     cond_cols_.reserve(conds_.size());
     for (auto& cond : conds_) {
       // 存迭代器
-      cond_cols_.emplace_back(tab_.cols_map[cond.lhs_col.col_name]);
+      cond_cols_.emplace_back(tab_.get_col(cond.lhs_col));
     }
+    prefiltered_.assign(conds_.size(), false);
+    expr_filter_ = ExprFilter(expr_conds, tab_.cols);
+    or_filter_ = OrFilter(or_conds, tab_.cols);
+    init_column_filters();
+    init_code_filters();
+    init_zone_filters();
+    compile_conds();
+    init_fused_pipeline();
 
-    // S 锁
+    if (context_ != nullptr && context_->txn_->is_snapshot()) {
+      // 快照读不加表锁和间隙锁，自己推迟的递增要先应用才能读到
+      context_->lock_mgr_->settle_increments(context_->txn_, fh_->GetFd());
+      snapshot_ts_ = context_->txn_->get_snapshot_ts();
+      snapshot_rec_ = std::make_unique<RmRecord>(len_);
+      return;
+    }
+
+    // S 锁，和插入的 IX 锁互斥，全表扫描不需要再锁索引上的间隙
     if (context_ != nullptr) {
       context_->lock_mgr_->lock_shared_on_table(context_->txn_, fh_->GetFd());
     }
+  }
+
+  // 扫描完整执行完一遍时，把满足谓词的记录数报告给基数反馈。表达式、OR条件和子查询也会过滤记录，有它们时不报告
+  ~SeqScanExecutor() override {
+    if (scanned_ && limit_ < 0 && !is_sub_query_empty_ && expr_filter_.empty() &&
+        or_filter_.empty() && generic_conds_.empty() && is_end()) {
+      sm_manager_->observe_scan_rows(tab_name_, conds_, produced_);
+    }
+    end_sync_scan();
+  }
+
+  void beginTuple() override {
+    scanned_ = true;
+    // 超过缓冲池四分之一的表在私有环形缓冲区中扫描，避免冲掉热点页面；
+    // 分析类会话的扫描只要表比环形缓冲区大就用环形缓冲区，不和OLTP争抢共享缓冲池
+    bool analytics = context_ != nullptr && context_->workload_class_ != nullptr &&
+                     *context_->workload_class_ == WORKLOAD_ANALYTICS;
+    size_t ring_threshold = analytics ? static_cast<size_t>(BULK_READ_RING_PAGES)
+                                      : sm_manager_->get_bpm()->get_pool_size() / 4;
+    if (strategy_ == nullptr &&
+        static_cast<size_t>(fh_->get_file_hdr().num_pages) > ring_threshold) {
+      strategy_ = std::make_unique<BufferAccessStrategy>(BULK_READ_RING_PAGES);
+    }
+    // 常量的编码每次扫描前重新查找，上次扫描之后可能插入了新的值
+    for (auto& filter : code_filters_) {
+      filter.code = fh_->get_dict_code(filter.dict_col, filter.rhs);
+    }
+    produced_ = 0;
+    if (limit_reached()) {
+      return;
+    }
+    // 有只能逐条由cmp_cond计算的谓词时不并行；
+    // 有LIMIT时通常很快就能取够，也不并行，免得一轮并行扫过远多于需要的页面
+    end_page_ = fh_->get_file_hdr().num_pages;
+    if (snapshot_ts_ != INVALID_TIMESTAMP) {
+      visited_.assign(end_page_, 0);
+      in_changed_pages_ = false;
+    }
+    // 有LIMIT时只读开头的几页，不加入同步扫描
+    end_sync_scan();
+    sync_scan_ = ENABLE_SYNC_SCAN && strategy_ != nullptr && limit_ < 0;
+    wrapped_ = false;
+    sync_start_ = sync_scan_ ? fh_->begin_sync_scan() : RM_FIRST_RECORD_PAGE;
+    parallel_ = (!conds_.empty() || !expr_filter_.empty() || !or_filter_.empty()) &&
+                generic_conds_.empty() && limit_ < 0 &&
+                end_page_ - RM_FIRST_RECORD_PAGE >= PARALLEL_SCAN_MIN_PAGES &&
+                MorselScheduler::instance().num_workers() > 1;
+    if (parallel_) {
+      scan_.reset();
+      next_page_ = sync_start_;
+      fill_window();
+      return;
+    }
+    scan_ = std::make_unique<RmScan>(
+        fh_, strategy_.get(), zone_filters_.empty() ? nullptr : &zone_filters_,
+        sync_start_);
+    filter_pages();
+  }
 
-    // 如果表上有索引，对于全表扫操作加 (-INF, +INF) 的间隙锁
-    for (auto& [ix_name, index_meta] : tab_.indexes) {
-      auto predicate_manager = PredicateManager(index_meta);
-      auto gap = Gap(predicate_manager.getIndexConds());
-      if (gap_mode_) {
-        context_->lock_mgr_->lock_exclusive_on_gap(context_->txn_, index_meta,
-                                                   gap, fh_->GetFd());
+  void nextTuple() override {
+    if (is_end()) {
+      return;
+    }
+    // 上层要的记录已经够了，不再往后找下一条满足条件的记录
+    ++produced_;
+    if (limit_reached()) {
+      view_.reset();
+      return;
+    }
+    if (parallel_) {
+      if (++window_pos_ < window_rids_.size()) {
+        set_current();
       } else {
-        context_->lock_mgr_->lock_shared_on_gap(context_->txn_, index_meta, gap,
-                                                fh_->GetFd());
+        fill_window();
       }
+      return;
+    }
+    if (++match_pos_ < matches_.size()) {
+      set_current();
+      return;
     }
+    next_page();
   }
 
-  void beginTuple() override {
-    scan_ = std::make_unique<RmScan>(fh_);
-    for (; !scan_->is_end(); scan_->next()) {
-      rid_ = scan_->rid();
-      rm_record_ = fh_->get_record(rid_, context_);
-      // TODO 这里会跑太快
-      // rm_record_ = std::move(scan_->get_record());
-      if (cmp_conds(rm_record_.get(), conds_)) {
+  std::unique_ptr<RmRecord> Next() override {
+    return std::make_unique<RmRecord>(current_->size, current_->data);
+  }
+
+  const RmRecord* next_view() override { return current_; }
+
+  // 逐页把matches_中剩下的记录拷贝到batch中，一页的谓词本来就是整页计算的
+  bool NextBatch(TupleBatch& batch) override {
+    size_t out_len = projection_.len();
+    batch.reset(out_len);
+    if (parallel_) {
+      // 并行扫描只在没有LIMIT时使用
+      while (!is_end() && !batch.full()) {
+        for (; window_pos_ < window_rids_.size() && !batch.full(); ++window_pos_) {
+          rid_ = window_rids_[window_pos_];
+          read_current();
+          memcpy(batch.append(rid_), current_->data, out_len);
+          ++produced_;
+        }
+        if (window_pos_ < window_rids_.size()) {
+          set_current();
+          break;
+        }
+        fill_window();
+      }
+      return batch.size() > 0;
+    }
+    while (!is_end() && !batch.full()) {
+      // 快照读时记录可能要换成快照中的版本，只能逐条读取
+      bool direct = fused_project_ && snapshot_ts_ == INVALID_TIMESTAMP;
+      for (; match_pos_ < matches_.size() && !batch.full() && !limit_reached();
+           ++match_pos_, ++produced_) {
+        rid_ = {page_no_, matches_[match_pos_]};
+        if (direct) {
+          // view_停在matches_所在的页面上
+          projection_.project_into(fh_->get_slot(view_, rid_.slot_no),
+                                   batch.append(rid_));
+          continue;
+        }
+        read_current();
+        memcpy(batch.append(rid_), current_->data, out_len);
+      }
+      if (limit_reached()) {
+        view_.reset();
         break;
       }
-      if (is_sub_query_empty_) {
-        return;
+      if (match_pos_ < matches_.size()) {
+        // batch满了，游标停在下一条匹配的记录上
+        set_current();
+        break;
       }
+      next_page();
     }
+    return batch.size() > 0;
   }
 
-  void nextTuple() override {
-    if (scan_->is_end()) {
+  Rid& rid() override { return rid_; }
+
+  bool is_end() const {
+    if (is_sub_query_empty_ || limit_reached()) {
+      return true;
+    }
+    if (parallel_) {
+      return window_pos_ == window_rids_.size();
+    }
+    return in_changed_pages_ ? changed_pos_ == changed_pages_.size()
+                             : scan_->is_end();
+  }
+
+  bool limit_reached() const {
+    return limit_ >= 0 && produced_ >= static_cast<size_t>(limit_);
+  }
+
+  void set_limit(int limit) override { limit_ = limit; }
+
+  const std::vector<ColMeta>& cols() const override { return projection_.cols(); }
+
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    // 逐条计算谓词时还要读取谓词的字段。cols是输出记录中的字段，投影后偏移和表中不同，按字段名找回表中的位置
+    std::vector<std::pair<int, int>> fields;
+    for (auto& col : cols) {
+      auto tab_col = tab_.get_col(col.name);
+      fields.emplace_back(tab_col->offset, tab_col->len);
+    }
+    if (!all_column_filters_) {
+      for (auto& col : cond_cols_) {
+        fields.emplace_back(col->offset, col->len);
+      }
+      for (auto& ref : expr_filter_.ref_cols()) {
+        auto col = tab_.get_col(ref.col_name);
+        fields.emplace_back(col->offset, col->len);
+      }
+      for (auto& ref : or_filter_.ref_cols()) {
+        auto col = tab_.get_col(ref.col_name);
+        fields.emplace_back(col->offset, col->len);
+      }
+    }
+    if (records_per_page_ > 0) {
+      read_columns_ = fh_->get_pax_columns(fields);
+      view_.set_columns(read_columns_);
+    }
+  }
+
+  size_t tupleLen() const override { return projection_.len(); }
+
+  // 列存格式的表找出能在mini page上计算的谓词
+  void init_column_filters() {
+    auto file_hdr = fh_->get_file_hdr();
+    if (file_hdr.format != RM_FORMAT_PAX) {
       return;
     }
-    for (scan_->next(); !scan_->is_end(); scan_->next()) {
-      rid_ = scan_->rid();
-      rm_record_ = fh_->get_record(rid_, context_);
-      // TODO 这里会跑太快
-      // rm_record_ = std::move(scan_->get_record());
-      if (cmp_conds(rm_record_.get(), conds_)) {
-        break;
+    records_per_page_ = file_hdr.num_records_per_page;
+    for (size_t i = 0; i < conds_.size(); ++i) {
+      auto& cond = conds_[i];
+      auto& col = cond_cols_[i];
+      if (!cond.is_rhs_val || cond.rhs_val.type != col->type ||
+          (col->type != TYPE_INT && col->type != TYPE_FLOAT) ||
+          cond.op > OP_GE) {
+        continue;
+      }
+      int pax_col = fh_->get_pax_column(col->offset, col->len);
+      if (pax_col >= 0) {
+        column_filters_.push_back(
+            {pax_col, col->type, cond.op, cond.rhs_val.raw.data()});
+        prefiltered_[i] = true;
       }
     }
+    all_column_filters_ = column_filters_.size() == conds_.size();
   }
 
-  std::unique_ptr<RmRecord> Next() override { return std::move(rm_record_); }
+  // 定长格式的表找出能直接比较字典编码的谓词，编码相等当且仅当值相等
+  void init_code_filters() {
+    for (size_t i = 0; i < conds_.size(); ++i) {
+      auto& cond = conds_[i];
+      auto& col = cond_cols_[i];
+      if (!cond.is_rhs_val || cond.rhs_val.type != TYPE_STRING ||
+          col->type != TYPE_STRING || (cond.op != OP_EQ && cond.op != OP_NE)) {
+        continue;
+      }
+      int dict_col;
+      int code_offset = fh_->get_dict_code_offset(col->offset, &dict_col);
+      if (code_offset >= 0) {
+        code_filters_.push_back(
+            {code_offset, dict_col, cond.op, cond.rhs_val.raw.data(), -1});
+        prefiltered_[i] = true;
+      }
+    }
+    all_column_filters_ =
+        expr_filter_.empty() && or_filter_.empty() &&
+        column_filters_.size() + code_filters_.size() == conds_.size();
+  }
 
-  Rid& rid() override { return rid_; }
+  // 在还没有解码的槽位上计算code_filters_
+  bool filter_codes(const char* slot) const {
+    for (auto& filter : code_filters_) {
+      uint16_t code;
+      memcpy(&code, slot + filter.code_offset, RM_DICT_CODE_SIZE);
+      if ((filter.code == code) != (filter.op == OP_EQ)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 数值字段和同类型常量比较的谓词换成区域映射上的取值范围，扫描时跳过范围之外的页面
+  void init_zone_filters() {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < conds_.size(); ++i) {
+      auto& cond = conds_[i];
+      auto& col = cond_cols_[i];
+      if (!cond.is_rhs_val || cond.rhs_val.type != col->type ||
+          (col->type != TYPE_INT && col->type != TYPE_FLOAT) ||
+          cond.op == OP_NE || cond.op > OP_GE) {
+        continue;
+      }
+      int zone_col = fh_->get_zone_col(col->offset);
+      if (zone_col < 0) {
+        continue;
+      }
+      double value;
+      if (col->type == TYPE_INT) {
+        value = *reinterpret_cast<const int*>(cond.rhs_val.raw.data());
+      } else {
+        value = *reinterpret_cast<const float*>(cond.rhs_val.raw.data());
+      }
+      RmZoneFilter filter{zone_col, -inf, inf};
+      switch (cond.op) {
+        case OP_EQ:
+          filter.lo = filter.hi = value;
+          break;
+        case OP_LT:
+          filter.hi = std::nextafter(value, -inf);
+          break;
+        case OP_GT:
+          filter.lo = std::nextafter(value, inf);
+          break;
+        case OP_LE:
+          filter.hi = value;
+          break;
+        case OP_GE:
+          filter.lo = value;
+          break;
+        default:
+          break;
+      }
+      zone_filters_.push_back(filter);
+    }
+  }
 
-  bool is_end() const { return is_sub_query_empty_ || scan_->is_end(); }
+  template <CompOp op, typename T>
+  static inline bool apply_op(const T& a, const T& b) {
+    if constexpr (op == OP_EQ) {
+      return a == b;
+    } else if constexpr (op == OP_NE) {
+      return a != b;
+    } else if constexpr (op == OP_LT) {
+      return a < b;
+    } else if constexpr (op == OP_GT) {
+      return a > b;
+    } else if constexpr (op == OP_LE) {
+      return a <= b;
+    } else {
+      return a >= b;
+    }
+  }
 
-  const std::vector<ColMeta>& cols() const override { return tab_.cols; }
+  template <ColType type, CompOp op>
+  static bool eval_cond(const char* lhs, const char* rhs, int len) {
+    if constexpr (type == TYPE_INT) {
+      int a, b;
+      memcpy(&a, lhs, sizeof(int));
+      memcpy(&b, rhs, sizeof(int));
+      return apply_op<op>(a, b);
+    } else if constexpr (type == TYPE_FLOAT) {
+      float a, b;
+      memcpy(&a, lhs, sizeof(float));
+      memcpy(&b, rhs, sizeof(float));
+      return apply_op<op>(a, b);
+    } else {
+      return apply_op<op>(memcmp(lhs, rhs, len), 0);
+    }
+  }
 
-  size_t tupleLen() const override { return len_; }
+  template <ColType type>
+  static auto select_eval(CompOp op) -> decltype(&eval_cond<type, OP_EQ>) {
+    switch (op) {
+      case OP_EQ:
+        return eval_cond<type, OP_EQ>;
+      case OP_NE:
+        return eval_cond<type, OP_NE>;
+      case OP_LT:
+        return eval_cond<type, OP_LT>;
+      case OP_GT:
+        return eval_cond<type, OP_GT>;
+      case OP_LE:
+        return eval_cond<type, OP_LE>;
+      case OP_GE:
+        return eval_cond<type, OP_GE>;
+      default:
+        return nullptr;
+    }
+  }
+
+  // 编译右值是常量的谓词。int常量和float字段比较时先把常量转成float；
+  // 其余类型不一致的谓词留给cmp_cond，和原来一样报类型错误
+  void compile_conds() {
+    for (size_t i = 0; i < conds_.size(); ++i) {
+      if (prefiltered_[i]) {
+        continue;
+      }
+      auto& cond = conds_[i];
+      auto& col = cond_cols_[i];
+      if (!cond.is_rhs_val) {
+        generic_conds_.push_back(i);
+        continue;
+      }
+      const char* rhs = cond.rhs_val.raw.data();
+      if (col->type == TYPE_FLOAT && cond.rhs_val.type == TYPE_INT) {
+        auto buf = std::make_unique<char[]>(sizeof(float));
+        float v = static_cast<float>(*reinterpret_cast<const int*>(rhs));
+        memcpy(buf.get(), &v, sizeof(float));
+        rhs = buf.get();
+        coerced_rhs_.push_back(std::move(buf));
+      } else if (col->type != cond.rhs_val.type) {
+        generic_conds_.push_back(i);
+        continue;
+      }
+      bool (*eval)(const char*, const char*, int) = nullptr;
+      switch (col->type) {
+        case TYPE_INT:
+          eval = select_eval<TYPE_INT>(cond.op);
+          break;
+        case TYPE_FLOAT:
+          eval = select_eval<TYPE_FLOAT>(cond.op);
+          break;
+        case TYPE_STRING:
+          eval = select_eval<TYPE_STRING>(cond.op);
+          break;
+      }
+      if (eval == nullptr) {
+        generic_conds_.push_back(i);
+        continue;
+      }
+      PageFilter filter = nullptr;
+      switch (col->type) {
+        case TYPE_INT:
+          filter = select_filter<TYPE_INT>(cond.op);
+          break;
+        case TYPE_FLOAT:
+          filter = select_filter<TYPE_FLOAT>(cond.op);
+          break;
+        case TYPE_STRING:
+          filter = select_filter<TYPE_STRING>(cond.op);
+          break;
+      }
+      compiled_conds_.push_back({eval, col->offset, col->len, rhs, filter});
+    }
+  }
+
+  /**
+   * @description: 在一个页面上对in中的n个槽位计算一个谓词，满足的槽位号依次写到out中，out可以就是in。
+   * 字段类型和比较符都是模板参数，常量只读一次，循环体没有函数调用和分支
+   * @return {size_t} 满足谓词的槽位数
+   */
+  template <ColType type, CompOp op>
+  static size_t filter_page(const char* slots, int slot_size, const int* in,
+                            size_t n, int offset, int len, const char* rhs,
+                            int* out) {
+    size_t k = 0;
+    if constexpr (type == TYPE_STRING) {
+      for (size_t i = 0; i < n; ++i) {
+        int slot_no = in[i];
+        out[k] = slot_no;
+        k += apply_op<op>(
+            memcmp(slots + slot_no * slot_size + offset, rhs, len), 0);
+      }
+    } else {
+      using T = std::conditional_t<type == TYPE_INT, int, float>;
+      T b;
+      memcpy(&b, rhs, sizeof(T));
+      for (size_t i = 0; i < n; ++i) {
+        int slot_no = in[i];
+        T a;
+        memcpy(&a, slots + slot_no * slot_size + offset, sizeof(T));
+        out[k] = slot_no;
+        k += apply_op<op>(a, b);
+      }
+    }
+    return k;
+  }
+
+  template <ColType type>
+  static PageFilter select_filter(CompOp op) {
+    switch (op) {
+      case OP_EQ:
+        return filter_page<type, OP_EQ>;
+      case OP_NE:
+        return filter_page<type, OP_NE>;
+      case OP_LT:
+        return filter_page<type, OP_LT>;
+      case OP_GT:
+        return filter_page<type, OP_GT>;
+      case OP_LE:
+        return filter_page<type, OP_LE>;
+      case OP_GE:
+        return filter_page<type, OP_GE>;
+      default:
+        return nullptr;
+    }
+  }
+
+  // 槽位就是解码后的记录时才能融合：定长格式且没有字典编码的字段；谓词还要全部编译过
+  void init_fused_pipeline() {
+    auto file_hdr = fh_->get_file_hdr();
+    if (file_hdr.format != RM_FORMAT_FIXED || file_hdr.num_dict_cols > 0) {
+      return;
+    }
+    slot_size_ = file_hdr.slot_size > 0 ? file_hdr.slot_size : file_hdr.record_size;
+    fused_project_ = true;
+    fused_filter_ = !compiled_conds_.empty() && generic_conds_.empty() &&
+                    expr_filter_.empty() && or_filter_.empty();
+  }
+
+  // 融合扫描：依次用各个谓词的整页循环筛选槽位，后面的谓词只计算前面留下的槽位。视图已经pin住页面
+  void filter_fused(const RmRecordView& view, const std::vector<int>& slots,
+                    std::vector<int>& matches) const {
+    const char* base = fh_->get_slot(view, 0);
+    matches.resize(slots.size());
+    const int* in = slots.data();
+    size_t n = slots.size();
+    for (auto& cond : compiled_conds_) {
+      n = cond.filter(base, slot_size_, in, n, cond.offset, cond.len, cond.rhs,
+                      matches.data());
+      in = matches.data();
+    }
+    matches.resize(n);
+  }
+
+  // 对一个mini page中连续存放的n个值计算谓词，结果和passed按位与。循环体没有分支，编译器可以向量化
+  template <typename T, typename Pred>
+  static void filter_column(const char* col, int n, uint8_t* passed,
+                            Pred pred) {
+    for (int i = 0; i < n; ++i) {
+      T v;
+      memcpy(&v, col + i * sizeof(T), sizeof(T));
+      passed[i] &= static_cast<uint8_t>(pred(v));
+    }
+  }
+
+  template <typename T>
+  static void filter_column(const char* col, int n, CompOp op,
+                            const char* rhs_data, uint8_t* passed) {
+    T rhs;
+    memcpy(&rhs, rhs_data, sizeof(T));
+    switch (op) {
+      case OP_EQ:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v == rhs; });
+      case OP_NE:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v != rhs; });
+      case OP_LT:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v < rhs; });
+      case OP_GT:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v > rhs; });
+      case OP_LE:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v <= rhs; });
+      case OP_GE:
+        return filter_column<T>(col, n, passed, [rhs](T v) { return v >= rhs; });
+      default:
+        throw InternalError("Unexpected op type！");
+    }
+  }
+
+  // 列存格式：在视图当前所在页面的mini page上计算column_filters_，空槽位的结果没有意义
+  void filter_columns(RmRecordView& view, std::vector<uint8_t>& passed) const {
+    passed.assign(records_per_page_, 1);
+    for (auto& filter : column_filters_) {
+      const char* col = fh_->get_column(view, filter.col);
+      if (filter.type == TYPE_INT) {
+        filter_column<int>(col, records_per_page_, filter.op, filter.rhs,
+                           passed.data());
+      } else {
+        filter_column<float>(col, records_per_page_, filter.op, filter.rhs,
+                             passed.data());
+      }
+    }
+  }
+
+  // 对页面上的所有记录计算谓词，满足条件的槽位号放到matches中。
+  // 并行扫描时各个工作线程用自己的view、passed和batch调用，这时没有只能由cmp_cond计算的谓词，只读取执行器的状态
+  void filter_slots(int page_no, const std::vector<int>& slots,
+                    RmRecordView& view, std::vector<uint8_t>& passed,
+                    std::vector<int>& matches, ExprBatch& batch) {
+    matches.clear();
+    if (fused_filter_) {
+      if (!slots.empty()) {
+        // 快照读时slots之后被删除的记录仍按页面上的内容计算，apply_versions再按快照中的版本修正
+        read_slot({page_no, slots.front()}, view);
+        filter_fused(view, slots, matches);
+      }
+      if (snapshot_ts_ != INVALID_TIMESTAMP) {
+        apply_versions(page_no, matches, batch.scratch);
+      }
+      return;
+    }
+    if (!expr_filter_.empty() && batch.data.size() < slots.size() * len_) {
+      batch.data.resize(slots.size() * len_);
+    }
+    if ((!column_filters_.empty() || !code_filters_.empty()) &&
+        !slots.empty()) {
+      // 先让视图pin住页面，再批量计算mini page或字典编码上的谓词；记录已被删除时页面也已经pin住
+      read_slot({page_no, slots.front()}, view);
+      if (!column_filters_.empty()) {
+        filter_columns(view, passed);
+      }
+    }
+    for (int slot_no : slots) {
+      if (!column_filters_.empty() && !passed[slot_no]) {
+        continue;
+      }
+      if (!code_filters_.empty() &&
+          !filter_codes(fh_->get_slot(view, slot_no))) {
+        continue;
+      }
+      if (!all_column_filters_) {
+        if (!read_slot({page_no, slot_no}, view) ||
+            !cmp_conds(view.get(), conds_) ||
+            (!or_filter_.empty() && !or_filter_.eval(view.get()->data))) {
+          continue;
+        }
+        if (!expr_filter_.empty()) {
+          memcpy(batch.data.data() + matches.size() * len_, view.get()->data,
+                 len_);
+        }
+      }
+      matches.push_back(slot_no);
+    }
+    if (!expr_filter_.empty() && !matches.empty()) {
+      filter_exprs(matches, batch);
+    }
+    if (snapshot_ts_ != INVALID_TIMESTAMP) {
+      apply_versions(page_no, matches, batch.scratch);
+    }
+  }
+
+  // 在filter_slots拷贝出来的记录上整批计算表达式条件，去掉不满足的槽位
+  void filter_exprs(std::vector<int>& matches, ExprBatch& batch) const {
+    size_t n = matches.size();
+    batch.rows.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      batch.rows[i] = batch.data.data() + i * len_;
+    }
+    batch.passed.assign(n, 1);
+    expr_filter_.eval(batch.rows.data(), n, batch.passed.data(), batch.scratch);
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (batch.passed[i]) {
+        matches[k++] = matches[i];
+      }
+    }
+    matches.resize(k);
+  }
+
+  // 读取谓词需要的记录。构造时已经加了表级 S 锁，不需要逐条加行锁；
+  // 快照读时页面上的记录随时可能被删除，这时返回false，删除之前的版本在版本存储中
+  bool read_slot(const Rid& rid, RmRecordView& view) {
+    if (snapshot_ts_ == INVALID_TIMESTAMP) {
+      fh_->get_record_view(rid, view, context_, RM_LOCK_TABLE);
+      return true;
+    }
+    try {
+      fh_->get_record_view(rid, view, nullptr);
+    } catch (RecordNotFoundError&) {
+      return false;
+    }
+    return true;
+  }
+
+  // 快照读：页面上快照之后被修改过的记录改按快照中的版本计算谓词，快照中没有的记录去掉。
+  // 并行扫描时各个工作线程只访问[0, end_page_)中自己的页面，visited_不需要扩大
+  void apply_versions(int page_no, std::vector<int>& matches,
+                      ExprScratch& scratch) {
+    if (page_no >= static_cast<int>(visited_.size())) {
+      visited_.resize(page_no + 1);
+    }
+    visited_[page_no] = 1;
+    std::vector<std::pair<int, std::shared_ptr<RmRecord>>> versions;
+    VersionStore::instance().read_page(fh_->GetFd(), page_no, snapshot_ts_,
+                                       versions);
+    for (auto& [slot_no, record] : versions) {
+      auto it = std::lower_bound(matches.begin(), matches.end(), slot_no);
+      bool matched = record != nullptr && cmp_version(record.get(), scratch);
+      if (it != matches.end() && *it == slot_no) {
+        if (!matched) {
+          matches.erase(it);
+        }
+      } else if (matched) {
+        matches.insert(it, slot_no);
+      }
+    }
+  }
+
+  // 快照读：扫描结束后从changed_pos_开始检查没有扫描过的被修改过的页面，这些页面上只有快照中的版本可能满足条件。
+  // 停在第一个有满足条件记录的页面上，没有时返回false
+  bool filter_changed_pages() {
+    if (!in_changed_pages_) {
+      in_changed_pages_ = true;
+      changed_pages_.clear();
+      changed_pos_ = 0;
+      for (int page_no : VersionStore::instance().changed_pages(
+               fh_->GetFd(), snapshot_ts_)) {
+        if (page_no >= static_cast<int>(visited_.size()) ||
+            !visited_[page_no]) {
+          changed_pages_.push_back(page_no);
+        }
+      }
+    }
+    for (; changed_pos_ < changed_pages_.size(); ++changed_pos_) {
+      page_no_ = changed_pages_[changed_pos_];
+      filter_slots(page_no_, {}, view_, passed_, matches_, expr_batch_);
+      if (!matches_.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 从当前页面开始，逐页对页面上的所有记录计算谓词，停在第一个有满足条件记录的页面上
+  void filter_pages() {
+    for (; !in_changed_pages_ && (!scan_->is_end() || wrap_scan());
+         scan_->next_page()) {
+      check_cancel();
+      page_no_ = scan_->rid().page_no;
+      if (sync_scan_) {
+        fh_->report_sync_scan(page_no_);
+      }
+      filter_slots(page_no_, scan_->slots(), view_, passed_, matches_,
+                   expr_batch_);
+      if (!matches_.empty()) {
+        match_pos_ = 0;
+        set_current();
+        return;
+      }
+    }
+    if (snapshot_ts_ != INVALID_TIMESTAMP && filter_changed_pages()) {
+      match_pos_ = 0;
+      set_current();
+      return;
+    }
+    // 扫描结束，不再占用最后一个页面
+    view_.reset();
+  }
+
+  // 同步扫描扫到文件末尾时回到第一个数据页，扫描开始的页面之前的部分；整个扫描结束时返回false并退出同步扫描
+  bool wrap_scan() {
+    if (sync_scan_ && !wrapped_ && sync_start_ > RM_FIRST_RECORD_PAGE) {
+      wrapped_ = true;
+      scan_ = std::make_unique<RmScan>(
+          fh_, strategy_.get(), zone_filters_.empty() ? nullptr : &zone_filters_,
+          RM_FIRST_RECORD_PAGE, sync_start_);
+      if (!scan_->is_end()) {
+        return true;
+      }
+    }
+    end_sync_scan();
+    return false;
+  }
+
+  // 并行扫描的同步扫描：morsel扫到end_page_之后，改为扫描[第一个数据页, sync_start_)
+  bool wrap_window() {
+    if (sync_scan_ && !wrapped_ && sync_start_ > RM_FIRST_RECORD_PAGE) {
+      wrapped_ = true;
+      next_page_ = RM_FIRST_RECORD_PAGE;
+      end_page_ = sync_start_;
+      return true;
+    }
+    end_sync_scan();
+    return false;
+  }
+
+  void end_sync_scan() {
+    if (sync_scan_) {
+      sync_scan_ = false;
+      fh_->end_sync_scan();
+    }
+  }
+
+  // 串行扫描移到下一个页面
+  void next_page() {
+    if (in_changed_pages_) {
+      ++changed_pos_;
+    } else {
+      scan_->next_page();
+    }
+    filter_pages();
+  }
+
+  // 在[begin, end)中的页面上计算谓词，满足条件的rid按页面顺序放到rids中
+  void filter_morsel(int begin, int end, size_t worker, std::vector<Rid>& rids) {
+    auto& w = workers_[worker];
+    if (w == nullptr) {
+      w = std::make_unique<MorselWorker>();
+      w->strategy = std::make_unique<BufferAccessStrategy>(std::max<size_t>(
+          MORSEL_PAGES, BULK_READ_RING_PAGES / workers_.size()));
+      if (!read_columns_.empty()) {
+        w->view.set_columns(read_columns_);
+      }
+    }
+    rids.clear();
+    RmScan scan(fh_, w->strategy.get(),
+                zone_filters_.empty() ? nullptr : &zone_filters_, begin, end);
+    for (; !scan.is_end(); scan.next_page()) {
+      int page_no = scan.rid().page_no;
+      filter_slots(page_no, scan.slots(), w->view, w->passed, w->matches,
+                   w->expr_batch);
+      for (int slot_no : w->matches) {
+        rids.push_back({page_no, slot_no});
+      }
+    }
+    w->view.reset();
+  }
+
+  // 并行计算下一轮morsel上的谓词，直到得到至少一条满足条件的记录或扫描完所有页面
+  void fill_window() {
+    auto& scheduler = MorselScheduler::instance();
+    workers_.resize(scheduler.num_workers());
+    window_rids_.clear();
+    window_pos_ = 0;
+    while (window_rids_.empty() && (next_page_ < end_page_ || wrap_window())) {
+      check_cancel();
+      int begin = next_page_;
+      size_t num_morsels = std::min<size_t>(
+          PARALLEL_SCAN_WINDOW_MORSELS,
+          (end_page_ - begin + MORSEL_PAGES - 1) / MORSEL_PAGES);
+      morsel_rids_.resize(num_morsels);
+      scheduler.run(num_morsels, [&](size_t morsel, size_t worker) {
+        int first = begin + static_cast<int>(morsel) * MORSEL_PAGES;
+        filter_morsel(first, std::min(first + MORSEL_PAGES, end_page_), worker,
+                      morsel_rids_[morsel]);
+      });
+      next_page_ = std::min<int>(
+          begin + static_cast<int>(num_morsels) * MORSEL_PAGES, end_page_);
+      if (sync_scan_) {
+        fh_->report_sync_scan(next_page_);
+      }
+      for (size_t m = 0; m < num_morsels; ++m) {
+        window_rids_.insert(window_rids_.end(), morsel_rids_[m].begin(),
+                            morsel_rids_[m].end());
+      }
+    }
+    if (window_rids_.empty() && snapshot_ts_ != INVALID_TIMESTAMP) {
+      // 所有morsel都扫描完之后，每轮取一个被修改过的页面
+      if (in_changed_pages_) {
+        ++changed_pos_;
+      }
+      if (filter_changed_pages()) {
+        for (int slot_no : matches_) {
+          window_rids_.push_back({page_no_, slot_no});
+        }
+      }
+    }
+    if (window_rids_.empty()) {
+      view_.reset();
+      return;
+    }
+    set_current();
+  }
+
+  void set_current() {
+    if (parallel_) {
+      rid_ = window_rids_[window_pos_];
+    } else {
+      // 行锁在计算谓词时已经加过
+      rid_ = {page_no_, matches_[match_pos_]};
+    }
+    read_current();
+  }
+
+  // 读取rid_上的记录并投影出上层要的字段
+  void read_current() {
+    read_row();
+    current_ = projection_.project(current_);
+  }
+
+  // 读取rid_上的整条记录。快照读时先拷贝出页面上的记录再查版本存储，快照之后被修改过时换成快照中的版本
+  void read_row() {
+    if (snapshot_ts_ == INVALID_TIMESTAMP) {
+      fh_->get_record_view(rid_, view_, nullptr);
+      current_ = view_.get();
+      return;
+    }
+    bool present = true;
+    try {
+      fh_->get_record_view(rid_, view_, nullptr);
+      memcpy(snapshot_rec_->data, view_.get()->data, len_);
+    } catch (RecordNotFoundError&) {
+      present = false;
+    }
+    if (VersionStore::instance().read(fh_->GetFd(), rid_, snapshot_ts_,
+                                      &version_)) {
+      present = version_ != nullptr;
+      current_ = version_.get();
+    } else {
+      current_ = snapshot_rec_.get();
+    }
+    if (!present) {
+      throw RecordNotFoundError(rid_.page_no, rid_.slot_no);
+    }
+  }
 
   static inline int compare(const char* a, const char* b, int col_len,
                             ColType col_type) {
@@ -143,98 +1063,13 @@ class SeqScanExecutor : public AbstractExecutor {
   bool cmp_cond(int i, const RmRecord* rec, const Condition& cond) {
     const auto& lhs_col_meta = cond_cols_[i];
     const char* lhs_data = rec->data + lhs_col_meta->offset;
-    char* rhs_data;
+    const char* rhs_data;
     ColType rhs_type;
-    // 全局record 防止作为临时变量离开作用域自动析构，char* 指针指向错误的地址
-    std::unique_ptr<RmRecord> record;
     // 提取左值与右值的数据和类型
     // 常值
     if (cond.is_rhs_val) {
       rhs_type = cond.rhs_val.type;
-      rhs_data = cond.rhs_val.raw->data;
-    } else if (cond.is_sub_query) {
-      // 查的是值列表
-      if (!cond.rhs_value_list.empty()) {
-        // in 谓词
-        if (cond.op == OP_IN) {
-          // 前面已经强制转换和检查类型匹配过了，这里不需要
-          for (auto& value : cond.rhs_value_list) {
-            rhs_data = value.raw->data;
-            if (compare(lhs_data, rhs_data, lhs_col_meta->len, value.type) ==
-                0) {
-              return true;
-            }
-          }
-          return false;
-        }
-        // 比较谓词
-        assert(cond.rhs_value_list.size() == 1);
-        auto& value = cond.rhs_value_list[0];
-        int cmp =
-            compare(lhs_data, value.raw->data, lhs_col_meta->len, value.type);
-        switch (cond.op) {
-          case OP_EQ:
-            return cmp == 0;
-          case OP_NE:
-            return cmp != 0;
-          case OP_LT:
-            return cmp < 0;
-          case OP_GT:
-            return cmp > 0;
-          case OP_LE:
-            return cmp <= 0;
-          case OP_GE:
-            return cmp >= 0;
-          default:
-            throw InternalError("Unexpected op type！");
-        }
-      }
-      // 查的是子算子，在算子生成阶段已经检查了合法性
-      cond.prev->beginTuple();
-
-      // where id <= (select count(*) from grade);
-      // where id <= (select id from grade where id = 1); // 返回单列单行
-      ColMeta rhs_col_meta;
-      if (cond.sub_query->agg_types[0] == AGG_COUNT &&
-          cond.sub_query->cols[0].tab_name.empty() &&
-          cond.sub_query->cols[0].col_name.empty()) {
-        rhs_type = TYPE_INT;
-      } else {
-        // ！子查询右边的列值类型应该由子算子决定
-        rhs_col_meta = cond.prev->cols()[0];
-        // where id > (select count(id) from grade);
-        if (cond.sub_query->agg_types[0] == AGG_COUNT) {
-          rhs_type = TYPE_INT;
-        } else {
-          rhs_type = rhs_col_meta.type;
-        }
-      }
-
-      // 处理 in 谓词，扫描算子直到找到一个完全相等的
-      if (cond.op == OP_IN) {
-        for (; !cond.prev->is_end(); cond.prev->nextTuple()) {
-          record = cond.prev->Next();
-          rhs_data = record->data;
-          if (lhs_col_meta->type == TYPE_FLOAT && rhs_type == TYPE_INT) {
-            rhs_type = TYPE_FLOAT;
-            const float a = *reinterpret_cast<const int*>(rhs_data);
-            memcpy(rhs_data, &a, sizeof(float));
-          }
-          if (compare(lhs_data, rhs_data, lhs_col_meta->len, rhs_type) == 0) {
-            return true;
-          }
-        }
-        return false;
-      }
-
-      // 聚合或列值只能有一行
-      record = cond.prev->Next();
-      rhs_data = record->data;
-      if (lhs_col_meta->type == TYPE_FLOAT && rhs_type == TYPE_INT) {
-        rhs_type = TYPE_FLOAT;
-        const float a = *reinterpret_cast<const int*>(rhs_data);
-        memcpy(rhs_data, &a, sizeof(float));
-      }
+      rhs_data = cond.rhs_val.raw.data();
     } else {
       // 列值
       assert(0);
@@ -268,8 +1103,31 @@ class SeqScanExecutor : public AbstractExecutor {
     }
   }
 
+  // 在快照中的版本上计算所有谓词，包括在mini page或字典编码上算过的
+  bool cmp_version(const RmRecord* rec, ExprScratch& scratch) {
+    if (!cmp_conds(rec, conds_) ||
+        (!or_filter_.empty() && !or_filter_.eval(rec->data))) {
+      return false;
+    }
+    if (!expr_filter_.empty() && !expr_filter_.eval(rec->data, scratch)) {
+      return false;
+    }
+    for (size_t i = 0; i < conds_.size(); ++i) {
+      if (prefiltered_[i] && !cmp_cond(i, rec, conds_[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 先算编译过的谓词，再算其他谓词；已经在mini page或字典编码上算过的谓词跳过
   bool cmp_conds(const RmRecord* rec, const std::vector<Condition>& conds) {
-    for (int i = 0; i < conds.size(); ++i) {
+    for (auto& cond : compiled_conds_) {
+      if (!cond.eval(rec->data + cond.offset, cond.rhs, cond.len)) {
+        return false;
+      }
+    }
+    for (size_t i : generic_conds_) {
       if (!cmp_cond(i, rec, conds[i])) {
         return false;
       }
@@ -1,372 +1,524 @@
 #pragma once
 
-#include <queue>
-
-// #define SORT_EXTERNAL
-#define MAX_CHUNK_SIZE 5
-
+#include <algorithm>
+#include <array>
+
+#include "index/ix.h"
+#include "morsel_scheduler.h"
+#include "spill_file.h"
+
+/**
+ * @description: 排序算子。输入在SORT_MEMORY以内时直接在内存中排序；
+ * 超过时按内存预算切成有序的run写到临时文件，再用败者树做多路归并，
+ * run多于SORT_MERGE_FANIN时先归并成更少、更长的run，最后一趟归并的结果直接输出，不再落盘。
+ * 临时文件的读写都按SORT_IO_BUFFER成块进行。缓存的记录还受语句内存预算的限制，申请不到时提前切run。
+ * 有LIMIT n且n条记录放得进SORT_MEMORY时是Top-N模式：只在有界堆中保留当前最靠前的n条，不落盘。
+ * 内存中排序时不直接比较记录：排序字段按索引key的格式编码（ix_encode_key），前8个字节读成整数作为排序键，
+ * 和记录指针一起连续存放，用基数排序；字符串字段超过8个字节时，排序键相同的记录再按整个字段比较。
+ * 记录不少于SORT_PARALLEL_MIN_ROWS条时在morsel调度器的所有参与者上分段排序，再按取样得到的分界键并行归并；
+ * 外部排序中每个run的排序也是这样并行的
+ */
 class SortExecutor : public AbstractExecutor {
  private:
+  // 一个写到临时文件中的有序run
+  struct Run {
+    SpillFile file{SORT_IO_BUFFER};
+    size_t num_rows = 0;
+  };
+
+  // 归并时顺序读一个run，每次读入一块
+  struct RunReader {
+    const Run* run;
+    size_t len;
+    size_t read_rows = 0;  // 已经读入缓冲区的记录数
+    std::vector<char> buf;
+    size_t buf_rows = 0;
+    size_t pos = 0;
+
+    bool exhausted() const { return pos == buf_rows; }
+
+    const char* row() const { return buf.data() + pos * len; }
+  };
+
   std::unique_ptr<AbstractExecutor> prev_;
   ColMeta cols_;  // 框架中只支持一个键排序，需要自行修改数据结构支持多个键排序
-  size_t tuple_num;
   bool is_desc_;
-  std::vector<size_t> used_tuple;
-  std::unique_ptr<RmRecord> current_tuple_;
-  std::deque<std::unique_ptr<RmRecord> > records_;
   size_t len_;  // 字段总长度
-  // 题目要求排序结果写入 sorted_results.txt，字符串
-  std::fstream out_expected_file_;
-  // 排序结果实际读取文件，二进制
-  std::fstream outfile_;
-  // 实际二进制文件名
-  std::string filename_;
-  std::deque<std::string> temp_files_;
-  // 为每个 sort 算子实例分配一个 ID
-  size_t id_;
-  bool is_end_{false};
-
-  static std::size_t generateID() {
-    static size_t current_id = 0;
-    return ++current_id;
-  }
+  int limit_;   // 只需要前limit_条，-1表示全部
+
+  // 排序键：排序字段编码后的前8个字节，降序时取反，整数的大小顺序就是记录的先后顺序
+  struct SortKey {
+    uint64_t prefix;
+    const char* row;
+  };
+
+  // 内存中的记录和排好序的指针
+  std::vector<char> rows_;
+  std::vector<const char*> order_;
+  std::vector<SortKey> keys_;       // 排序键，基数排序时和keys_tmp_交替使用
+  std::vector<SortKey> keys_tmp_;
+  std::vector<ColType> key_types_;  // 排序字段的类型和长度，传给ix_encode_key
+  std::vector<int> key_lens_;
+  bool long_key_;                   // 字符串字段超过8个字节，前缀相同时还要比较整个字段
+  size_t pos_ = 0;
+  MemoryReservation mem_;  // rows_和order_占用的语句内存预算
+
+  // 外部排序
+  std::vector<Run> runs_;
+  std::vector<RunReader> readers_;
+  std::vector<int> tree_;  // 败者树，tree_[0]是胜者，其余是各个内部结点上的败者
+  bool external_ = false;
+
+  RmRecord view_;  // 指向当前记录，不拥有数据
+  bool is_end_{true};
 
-  // 排序一部分元组并放入块（临时文件）中
-  void sortAndSaveChunk() {
-    std::sort(records_.begin(), records_.end(),
-              [&](const std::unique_ptr<RmRecord>& l_rec,
-                  const std::unique_ptr<RmRecord>& r_rec) {
-                auto&& lhs = l_rec->data + cols_.offset;
-                auto&& rhs = r_rec->data + cols_.offset;
-                return is_desc_ ? compare(lhs, rhs, cols_.len, cols_.type) > 0
-                                : compare(lhs, rhs, cols_.len, cols_.type) < 0;
-              });
-
-    std::string temp_filename =
-        "sorted_chunk_" + std::to_string(temp_files_.size()) + ".tmp";
-    std::ofstream temp_file(temp_filename, std::ios::out | std::ios::binary);
-    for (const auto& record : records_) {
-      temp_file.write(record->data, record->size);
-    }
-    temp_file.close();
-    temp_files_.emplace_back(temp_filename);
-    records_.clear();
+ public:
+  SortExecutor(std::unique_ptr<AbstractExecutor> prev, const TabCol& sel_cols,
+               bool is_desc, int limit = -1, Context* context = nullptr) {
+    context_ = context;
+    mem_.set_tracker(context == nullptr ? nullptr : &context->memory_);
+    prev_ = std::move(prev);
+    cols_ = *get_col(prev_->cols(), sel_cols);
+    is_desc_ = is_desc;
+    len_ = prev_->tupleLen();
+    limit_ = limit;
+    view_.size = static_cast<int>(len_);
+    key_types_ = {cols_.type};
+    key_lens_ = {cols_.len};
+    long_key_ = cols_.type == TYPE_STRING && cols_.len > static_cast<int>(sizeof(uint64_t));
   }
 
-  void mergeSortedChunks() {
-    auto compareRecords =
-        [&](std::pair<std::unique_ptr<RmRecord>, std::ifstream*>& a,
-            std::pair<std::unique_ptr<RmRecord>, std::ifstream*>& b) {
-          auto&& lhs = a.first->data + cols_.offset;
-          auto&& rhs = b.first->data + cols_.offset;
-          return is_desc_ ? compare(lhs, rhs, cols_.len, cols_.type) < 0
-                          : compare(lhs, rhs, cols_.len, cols_.type) > 0;
-        };
-
-    std::priority_queue<
-        std::pair<std::unique_ptr<RmRecord>, std::ifstream*>,
-        std::vector<std::pair<std::unique_ptr<RmRecord>, std::ifstream*> >,
-        decltype(compareRecords)>
-        min_heap(compareRecords);
-
-    // 必须要支持多级归并排序，因为系统可以使用的文件描述符有限，超过使用限制会发生阻塞
-    // 排序阶段，已经完成了第几级排序
-    std::size_t level = 1;
-    // 每个阶段的临时文件
-    std::deque<std::string> level_temp_files;
-
-    // 一次处理100个排序好的文件，原来2000个，处理完一趟后剩下20个文件，然后再用一次就都处理完了
-    const std::size_t batch_size = 2;  // 二路归并
-
-    // 最后归并为一个排好序的文件
-    while (temp_files_.size() > 1) {
-      std::size_t total_files = temp_files_.size();
-      std::size_t processed_files = 0;
-
-      while (processed_files < total_files) {
-        std::vector<std::ifstream> temp_file_streams;
-        temp_file_streams.reserve(batch_size);
-
-        for (size_t i = 0; i < batch_size && processed_files < total_files;
-             ++i, ++processed_files) {
-          const auto& filename = temp_files_[processed_files];
-          temp_file_streams.emplace_back(filename,
-                                         std::ios::in | std::ios::binary);
-        }
-
-        for (auto& file_stream : temp_file_streams) {
-          auto record = std::make_unique<RmRecord>(len_);
-          file_stream.read(record->data, record->size);
-          if (file_stream.gcount() > 0) {
-            min_heap.emplace(std::move(record), &file_stream);
-          }
-        }
-
-        std::string temp_filename = "sorted_ID" + std::to_string(id_) +
-                                    "_chunk_" + std::to_string(level) + "_" +
-                                    std::to_string(level_temp_files.size()) +
-                                    ".tmp";
-        std::ofstream temp_file(temp_filename,
-                                std::ios::out | std::ios::binary);
-        level_temp_files.emplace_back(std::move(temp_filename));
-
-        // 放到第 level 阶段临时文件中
-        while (!min_heap.empty()) {
-          auto& [record, file_stream] = min_heap.top();
-          temp_file.write(record->data, record->size);
-          auto new_record = std::make_unique<RmRecord>(len_);
-          file_stream->read(new_record->data, new_record->size);
-          if (file_stream->gcount() > 0) {
-            min_heap.emplace(std::move(new_record), file_stream);
-          } else {
-            file_stream->close();
-          }
-          min_heap.pop();
+  void beginTuple() override {
+    rows_.clear();
+    order_.clear();
+    runs_.clear();
+    readers_.clear();
+    tree_.clear();
+    external_ = false;
+    pos_ = 0;
+    mem_.reset();
+
+    // 按内存预算读入输入，满了就排序后写成一个run
+    size_t max_rows = std::max<size_t>(1, SORT_MEMORY / std::max<size_t>(1, len_));
+    if (limit_ >= 0 && static_cast<size_t>(limit_) <= max_rows) {
+      mem_.force_grow_to(static_cast<size_t>(limit_) * row_bytes());
+      top_n();
+      is_end_ = order_.empty();
+      return;
+    }
+    TupleBatch batch;
+    for (prev_->beginTuple(); prev_->NextBatch(batch);) {
+      check_cancel();
+      for (size_t r = 0; r < batch.size(); ++r) {
+        // 条数达到上限或者语句的内存预算申请不到时切run，run中至少有一条记录
+        size_t num_rows = rows_.size() / len_;
+        if (num_rows == max_rows ||
+            (num_rows > 0 && !mem_.grow_to((num_rows + 1) * row_bytes()))) {
+          spill_run();
         }
-
-        temp_file.close();
+        mem_.force_grow_to((rows_.size() / len_ + 1) * row_bytes());
+        rows_.insert(rows_.end(), batch.row(r), batch.row(r) + len_);
       }
+    }
 
-      // 清除临时文件
-      for (auto& temp_file : temp_files_) {
-        unlink(temp_file.c_str());
+    if (runs_.empty()) {
+      sort_rows();
+      is_end_ = order_.empty();
+      return;
+    }
+    if (!rows_.empty()) {
+      spill_run();
+    }
+    rows_.clear();
+    rows_.shrink_to_fit();
+    order_.clear();
+    order_.shrink_to_fit();
+    keys_ = {};
+    keys_tmp_ = {};
+    mem_.reset();
+
+    // 多于SORT_MERGE_FANIN个run时，每次把最前面的SORT_MERGE_FANIN个归并成一个放到最后
+    while (runs_.size() > static_cast<size_t>(SORT_MERGE_FANIN)) {
+      std::vector<Run> group;
+      for (int i = 0; i < SORT_MERGE_FANIN; ++i) {
+        group.push_back(std::move(runs_[i]));
       }
+      runs_.erase(runs_.begin(), runs_.begin() + SORT_MERGE_FANIN);
+      runs_.push_back(merge_runs(group));
+    }
 
-      temp_files_ = std::move(level_temp_files);
-      level_temp_files.clear();
-      ++level;
-    }
-
-    assert(temp_files_.size() == 1);
-
-    // 最终排序好的文件名
-    filename_ = std::move(temp_files_[0]);
-    temp_files_.clear();
-
-    outfile_.open(filename_, std::ios::in | std::ios::binary);
-
-    // 以期望格式写入 sorted_results.txt
-    out_expected_file_.open("sorted_results.txt",
-                            std::ios::out | std::ios::app);
-
-    // 打印表头
-    out_expected_file_ << "|";
-    for (auto& col_meta : prev_->cols()) {
-      out_expected_file_ << " " << col_meta.name << " |";
-    }
-    out_expected_file_ << "\n";
-
-    while (true) {
-      current_tuple_ = std::make_unique<RmRecord>(len_);
-      outfile_.read(current_tuple_->data, current_tuple_->size);
-      if (outfile_.gcount() > 0) {
-        // 打印记录
-        std::vector<std::string> columns;
-        columns.reserve(prev_->cols().size());
-
-        for (auto& col : prev_->cols()) {
-          std::string col_str;
-          char* rec_buf = current_tuple_->data + col.offset;
-          if (col.type == TYPE_INT) {
-            col_str = std::to_string(*(int*)rec_buf);
-          } else if (col.type == TYPE_FLOAT) {
-            col_str = std::to_string(*(float*)rec_buf);
-          } else if (col.type == TYPE_STRING) {
-            col_str = std::string((char*)rec_buf, col.len);
-            col_str.resize(strlen(col_str.c_str()));
-          }
-          columns.emplace_back(col_str);
-        }
+    external_ = true;
+    start_merge(runs_);
+    is_end_ = readers_[tree_[0]].exhausted();
+  }
 
-        // 打印记录
-        out_expected_file_ << "|";
-        for (auto& col : columns) {
-          out_expected_file_ << " " << col << " |";
-        }
-        out_expected_file_ << "\n";
-      } else {
-        break;
-      }
+  void nextTuple() override {
+    if (is_end_) {
+      return;
+    }
+    if (external_) {
+      int winner = tree_[0];
+      advance(readers_[winner]);
+      adjust(winner);
+      is_end_ = readers_[tree_[0]].exhausted();
+    } else {
+      is_end_ = ++pos_ == order_.size();
     }
+  }
 
-    outfile_.close();
-    out_expected_file_.close();
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(len_);
+    memcpy(record->data, current(), len_);
+    return record;
   }
 
- public:
-  SortExecutor(std::unique_ptr<AbstractExecutor> prev, const TabCol& sel_cols,
-               bool is_desc) {
-    prev_ = std::move(prev);
-    // cols_ = prev_->get_col_offset(sel_cols);
-    cols_ = *get_col(prev_->cols(), sel_cols);
-    is_desc_ = is_desc;
-    tuple_num = 0;
-    used_tuple.clear();
-    len_ = prev_->tupleLen();
-    id_ = generateID();
-    // filename_ = "sorted_results" + std::to_string(id_) + ".txt";
+  const RmRecord* next_view() override {
+    view_.data = const_cast<char*>(current());
+    return &view_;
   }
 
-  void beginTuple() override {
-    records_.clear();
-    temp_files_.clear();
-    current_tuple_ = nullptr;
-
-#ifdef SORT_EXTERNAL
-    // struct stat st;
-    // 当前算子排序过了，已经存在排序结果文件
-    if (!filename_.empty()) {
-      // 可能是算子结束进来的，也有可能是到一部分重新开始了
-      if (!is_end_) {
-        outfile_.close();
-      }
+  bool NextBatch(TupleBatch& batch) override {
+    batch.reset(len_);
+    for (; !is_end_ && !batch.full(); nextTuple()) {
+      memcpy(batch.append(_abstract_rid), current(), len_);
+    }
+    return batch.size() > 0;
+  }
 
-      // 记得一定要重置，否则读到文件尾后算子会一直保持结束状态
-      is_end_ = false;
+  Rid& rid() override { return _abstract_rid; }
 
-      outfile_.open(filename_, std::ios::in | std::ios::binary);
-      if (!outfile_.is_open()) {
-        std::stringstream s;
-        s << "Failed to open file: " << std::strerror(errno);
-        throw InternalError(s.str());
-      }
+  bool is_end() const { return is_end_; }
 
-      // 缓存记录
-      do {
-        current_tuple_ = std::make_unique<RmRecord>(len_);
-        outfile_.read(current_tuple_->data, current_tuple_->size);
-        if (outfile_.gcount() == 0) {
-          break;
-        }
-        records_.emplace_back(std::move(current_tuple_));
-      } while (records_.size() < MAX_CHUNK_SIZE);
-
-      if (!records_.empty()) {
-        current_tuple_ = std::move(records_.front());
-        records_.pop_front();
-      } else {
-        is_end_ = true;
-        current_tuple_ = nullptr;
-        outfile_.close();
-      }
-      return;
+  // 上层只要前limit条时改为Top-N排序；排序要读完全部输入，不再下推
+  void set_limit(int limit) override {
+    if (limit >= 0 && (limit_ < 0 || limit < limit_)) {
+      limit_ = limit;
     }
+  }
+
+  // 排序不改变记录的格式，上层读取的字段加上排序键继续告诉儿子
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    std::vector<ColMeta> read_cols = cols;
+    read_cols.push_back(cols_);
+    prev_->set_read_cols(read_cols);
+  }
+
+  const std::vector<ColMeta>& cols() const override { return prev_->cols(); }
+
+  size_t tupleLen() const override { return prev_->tupleLen(); }
+
+  std::string getType() { return "SortExecutor"; }
+
+ private:
+  const char* current() const {
+    return external_ ? readers_[tree_[0]].row() : order_[pos_];
+  }
 
-    is_end_ = false;
+  // 内存中每条记录的开销：记录本身、排好序的指针和两份排序键
+  size_t row_bytes() const { return len_ + sizeof(const char*) + 2 * sizeof(SortKey); }
 
-    // ios::in 需要文件存在，ios::out文件不存在则创建
-    // 两者同时存在且文件不存在时，会打开失败（文件不存在）
-    // outfile_.open(filename_, std::ios::out | std::ios::app);
-    // if (!outfile_.is_open()) {
-    //     std::stringstream s;
-    //     s << "Failed to open file: " << std::strerror(errno);
-    //     throw InternalError(s.str());
-    // }
+  // a是否应该排在b前面
+  bool before(const char* a, const char* b) const {
+    int cmp = compare(a + cols_.offset, b + cols_.offset, cols_.len, cols_.type);
+    return is_desc_ ? cmp > 0 : cmp < 0;
+  }
 
-    // 内存中可能放不下，实现外部排序
-    for (prev_->beginTuple(); !prev_->is_end(); prev_->nextTuple()) {
-      records_.emplace_back(prev_->Next());
-      if (records_.size() >= MAX_CHUNK_SIZE) {
-        sortAndSaveChunk();
+  // Top-N：rows_中固定limit_个槽位，order_是以最靠后的记录为堆顶的堆，
+  // 新记录比堆顶靠前时替换堆顶，最后把堆排成有序
+  void top_n() {
+    size_t n = static_cast<size_t>(limit_);
+    rows_.resize(n * len_);
+    order_.reserve(n);
+    auto cmp = [&](const char* l, const char* r) { return before(l, r); };
+    TupleBatch batch;
+    for (prev_->beginTuple(); n > 0 && prev_->NextBatch(batch);) {
+      check_cancel();
+      for (size_t r = 0; r < batch.size(); ++r) {
+        const char* row = batch.row(r);
+        if (order_.size() < n) {
+          char* slot = rows_.data() + order_.size() * len_;
+          memcpy(slot, row, len_);
+          order_.push_back(slot);
+          std::push_heap(order_.begin(), order_.end(), cmp);
+        } else if (before(row, order_.front())) {
+          std::pop_heap(order_.begin(), order_.end(), cmp);
+          memcpy(const_cast<char*>(order_.back()), row, len_);
+          std::push_heap(order_.begin(), order_.end(), cmp);
+        }
       }
     }
+    std::sort_heap(order_.begin(), order_.end(), cmp);
+  }
 
-    // 剩下未满最大值的记录们也写入磁盘
-    if (!records_.empty()) {
-      sortAndSaveChunk();
+  // 编码后的排序字段的前8个字节按大端读成整数，不足8个字节时低位补0
+  uint64_t sort_prefix(const char* row) const {
+    char encoded[sizeof(uint64_t)] = {};
+    const char* field = row + cols_.offset;
+    if (cols_.type == TYPE_STRING) {
+      memcpy(encoded, field, std::min<size_t>(cols_.len, sizeof(encoded)));
+    } else {
+      ix_encode_key(field, encoded, key_types_, key_lens_);
     }
+    uint64_t prefix;
+    memcpy(&prefix, encoded, sizeof(prefix));
+    prefix = __builtin_bswap64(prefix);
+    return is_desc_ ? ~prefix : prefix;
+  }
 
-    // 空表
-    if (temp_files_.empty()) {
-      is_end_ = true;
-      return;
+  // 对rows_中的记录排序，结果放在order_中。记录很多时在morsel调度器上并行排序
+  void sort_rows() {
+    size_t n = rows_.size() / std::max<size_t>(1, len_);
+    keys_.resize(n);
+    keys_tmp_.resize(n);
+    if (n >= SORT_PARALLEL_MIN_ROWS && MorselScheduler::instance().num_workers() > 1) {
+      parallel_sort_keys();
+    } else {
+      fill_keys(0, n);
+      sort_keys(keys_.data(), keys_tmp_.data(), n);
+    }
+    order_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      order_[i] = keys_[i].row;
     }
+  }
 
-    // 合并所有块
-    mergeSortedChunks();
+  // 为rows_中第begin到end条记录生成排序键
+  void fill_keys(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const char* row = rows_.data() + i * len_;
+      keys_[i] = {sort_prefix(row), row};
+    }
+  }
 
-    // 读模式
-    outfile_.open(filename_, std::ios::in | std::ios::binary);
+  // 排序键的先后：先比较前缀，排序键只是字段的前8个字节时再按整个字段比较
+  bool key_less(const SortKey& l, const SortKey& r) const {
+    if (l.prefix != r.prefix) {
+      return l.prefix < r.prefix;
+    }
+    return long_key_ && before(l.row, r.row);
+  }
 
-    // 缓存记录
-    do {
-      current_tuple_ = std::make_unique<RmRecord>(len_);
-      outfile_.read(current_tuple_->data, current_tuple_->size);
-      if (outfile_.gcount() == 0) {
-        break;
+  // 在当前线程中排序keys中的n个排序键，tmp是同样大小的临时空间
+  void sort_keys(SortKey* keys, SortKey* tmp, size_t n) {
+    if (n < SORT_RADIX_MIN_ROWS) {
+      std::sort(keys, keys + n, [](const SortKey& l, const SortKey& r) { return l.prefix < r.prefix; });
+    } else {
+      radix_sort(keys, tmp, n);
+    }
+    // 前缀相同的一段再按整个字段排序
+    if (long_key_) {
+      for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && keys[j].prefix == keys[i].prefix) {
+          ++j;
+        }
+        if (j - i > 1) {
+          std::sort(keys + i, keys + j,
+                    [&](const SortKey& l, const SortKey& r) { return before(l.row, r.row); });
+        }
+        i = j;
       }
-      records_.emplace_back(std::move(current_tuple_));
-    } while (records_.size() < MAX_CHUNK_SIZE);
+    }
+  }
 
-    if (!records_.empty()) {
-      current_tuple_ = std::move(records_.front());
-      records_.pop_front();
-    } else {
-      is_end_ = true;
-      current_tuple_ = nullptr;
-      outfile_.close();
+  // 按排序键的8个字节从低到高做LSD基数排序，每趟按一个字节分桶；所有键在某个字节上都相同时跳过这一趟
+  // （int和float字段编码后只有4个字节，低位的4趟都会跳过）。每趟都是稳定的，键相同的记录保持输入顺序
+  void radix_sort(SortKey* keys, SortKey* tmp, size_t n) {
+    std::vector<std::array<size_t, 256>> counts(sizeof(uint64_t));
+    for (auto& count : counts) {
+      count.fill(0);
     }
-#else
-    // 假设索引扫出来的记录数量比较少，直接在内存中排序
-    for (prev_->beginTuple(); !prev_->is_end(); prev_->nextTuple()) {
-      records_.emplace_back(prev_->Next());
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t b = 0; b < sizeof(uint64_t); ++b) {
+        ++counts[b][(keys[i].prefix >> (8 * b)) & 0xff];
+      }
+    }
+    SortKey* src = keys;
+    SortKey* dst = tmp;
+    for (size_t b = 0; b < sizeof(uint64_t); ++b) {
+      auto& count = counts[b];
+      if (count[(src[0].prefix >> (8 * b)) & 0xff] == n) {
+        continue;
+      }
+      size_t offset = 0;
+      for (auto& c : count) {
+        size_t num = c;
+        c = offset;
+        offset += num;
+      }
+      for (size_t i = 0; i < n; ++i) {
+        dst[count[(src[i].prefix >> (8 * b)) & 0xff]++] = src[i];
+      }
+      std::swap(src, dst);
+    }
+    if (src != keys) {
+      std::copy(src, src + n, keys);
     }
-    if (records_.empty()) {
-      is_end_ = true;
-    } else {
-      std::sort(records_.begin(), records_.end(),
-                [&](const std::unique_ptr<RmRecord>& l_rec,
-                    const std::unique_ptr<RmRecord>& r_rec) {
-                  auto&& lhs = l_rec->data + cols_.offset;
-                  auto&& rhs = r_rec->data + cols_.offset;
-                  return is_desc_
-                             ? compare(lhs, rhs, cols_.len, cols_.type) > 0
-                             : compare(lhs, rhs, cols_.len, cols_.type) < 0;
-                });
-    }
-#endif
   }
 
-  void nextTuple() override {
-    if (!records_.empty()) {
-      current_tuple_ = std::move(records_.front());
-      records_.pop_front();
-      return;
+  // 并行排序：keys_切成和参与者一样多的段，各自生成排序键并排序；再从各段中等间隔取样选出分界键，
+  // 按分界键把输出切成同样多的分区，每个分区把各段中落在其中的部分复制到keys_tmp_中两两归并
+  void parallel_sort_keys() {
+    auto& scheduler = MorselScheduler::instance();
+    size_t n = keys_.size();
+    size_t parts = scheduler.num_workers();
+    std::vector<size_t> bounds(parts + 1);
+    for (size_t p = 0; p <= parts; ++p) {
+      bounds[p] = n * p / parts;
+    }
+    scheduler.run(parts, [&](size_t p, size_t) {
+      fill_keys(bounds[p], bounds[p + 1]);
+      sort_keys(keys_.data() + bounds[p], keys_tmp_.data() + bounds[p], bounds[p + 1] - bounds[p]);
+    });
+
+    auto less = [this](const SortKey& l, const SortKey& r) { return key_less(l, r); };
+    std::vector<SortKey> samples;
+    for (size_t p = 0; p < parts; ++p) {
+      size_t len = bounds[p + 1] - bounds[p];
+      for (size_t s = 1; s <= parts && len > 0; ++s) {
+        samples.push_back(keys_[bounds[p] + len * s / (parts + 1)]);
+      }
     }
-#ifdef SORT_EXTERNAL
-    do {
-      current_tuple_ = std::make_unique<RmRecord>(len_);
-      outfile_.read(current_tuple_->data, current_tuple_->size);
-      if (outfile_.gcount() == 0) {
-        break;
+    std::sort(samples.begin(), samples.end(), less);
+    // cut[p][j]：段p中第一个不小于第j个分界键的位置，cut[p][0]和cut[p][parts]是段的两端
+    std::vector<std::vector<size_t>> cut(parts, std::vector<size_t>(parts + 1));
+    for (size_t p = 0; p < parts; ++p) {
+      cut[p][0] = bounds[p];
+      cut[p][parts] = bounds[p + 1];
+      for (size_t j = 1; j < parts; ++j) {
+        const SortKey& splitter = samples[samples.size() * j / parts];
+        cut[p][j] = std::lower_bound(keys_.begin() + cut[p][j - 1], keys_.begin() + bounds[p + 1], splitter, less) -
+                    keys_.begin();
       }
-      records_.emplace_back(std::move(current_tuple_));
-    } while (records_.size() < MAX_CHUNK_SIZE);
+    }
+    // 分区j在输出中的起点是前面各分区在所有段中的元素个数之和
+    std::vector<size_t> out(parts + 1, 0);
+    for (size_t j = 0; j < parts; ++j) {
+      out[j + 1] = out[j];
+      for (size_t p = 0; p < parts; ++p) {
+        out[j + 1] += cut[p][j + 1] - cut[p][j];
+      }
+    }
+    scheduler.run(parts, [&](size_t j, size_t) {
+      SortKey* dst = keys_tmp_.data() + out[j];
+      std::vector<size_t> pieces{0};
+      for (size_t p = 0; p < parts; ++p) {
+        std::copy(keys_.begin() + cut[p][j], keys_.begin() + cut[p][j + 1], dst + pieces.back());
+        pieces.push_back(pieces.back() + cut[p][j + 1] - cut[p][j]);
+      }
+      // 相邻的有序片段两两归并，log(parts)轮后只剩一段
+      while (pieces.size() > 2) {
+        std::vector<size_t> merged{0};
+        for (size_t i = 0; i + 2 < pieces.size(); i += 2) {
+          std::inplace_merge(dst + pieces[i], dst + pieces[i + 1], dst + pieces[i + 2], less);
+          merged.push_back(pieces[i + 2]);
+        }
+        if ((pieces.size() - 1) % 2 == 1) {
+          merged.push_back(pieces.back());
+        }
+        pieces = std::move(merged);
+      }
+    });
+    keys_.swap(keys_tmp_);
+  }
 
-    if (!records_.empty()) {
-      current_tuple_ = std::move(records_.front());
-      records_.pop_front();
-    } else {
-      is_end_ = true;
-      current_tuple_ = nullptr;
-      outfile_.close();
+  // 把rows_排好序后写成一个run
+  void spill_run() {
+    sort_rows();
+    Run run;
+    for (const char* row : order_) {
+      run.file.append(row, len_);
     }
-#else
-    is_end_ = true;
-#endif
+    run.file.finish();
+    run.num_rows = order_.size();
+    runs_.push_back(std::move(run));
+    rows_.clear();
+    order_.clear();
   }
 
-  std::unique_ptr<RmRecord> Next() override {
-    return std::move(current_tuple_);
+  // 读入reader的下一块
+  void refill(RunReader& reader) {
+    size_t n = std::min(reader.run->num_rows - reader.read_rows,
+                        reader.buf.size() / len_);
+    reader.run->file.read(reader.buf.data(), n * len_, reader.read_rows * len_);
+    reader.read_rows += n;
+    reader.buf_rows = n;
+    reader.pos = 0;
   }
 
-  Rid& rid() override { return _abstract_rid; }
+  void advance(RunReader& reader) {
+    if (++reader.pos == reader.buf_rows &&
+        reader.read_rows < reader.run->num_rows) {
+      refill(reader);
+    }
+  }
 
-  bool is_end() const { return is_end_; }
+  // 胜者：读完的run排在最后，key相同时下标小的在前，保持run的先后顺序
+  bool wins(int a, int b) const {
+    if (readers_[a].exhausted()) {
+      return false;
+    }
+    if (readers_[b].exhausted()) {
+      return true;
+    }
+    if (before(readers_[a].row(), readers_[b].row())) {
+      return true;
+    }
+    return !before(readers_[b].row(), readers_[a].row()) && a < b;
+  }
 
-  const std::vector<ColMeta>& cols() const override { return prev_->cols(); }
+  // 叶子s的记录变化后，从s到根重新比赛
+  void adjust(int s) {
+    int k = static_cast<int>(readers_.size());
+    for (int t = (s + k) / 2; t > 0; t /= 2) {
+      if (wins(tree_[t], s)) {
+        std::swap(s, tree_[t]);
+      }
+    }
+    tree_[0] = s;
+  }
 
-  size_t tupleLen() const override { return prev_->tupleLen(); }
+  // 为runs建立读缓冲区和败者树
+  void start_merge(const std::vector<Run>& runs) {
+    int k = static_cast<int>(runs.size());
+    readers_.clear();
+    readers_.resize(k);
+    size_t buf_rows = std::max<size_t>(1, SORT_IO_BUFFER / std::max<size_t>(1, len_));
+    for (int i = 0; i < k; ++i) {
+      readers_[i].run = &runs[i];
+      readers_[i].len = len_;
+      readers_[i].buf.resize(buf_rows * len_);
+      refill(readers_[i]);
+    }
+    // 自底向上比赛：winner[k + i]是叶子i，内部结点t的孩子是2t和2t+1
+    std::vector<int> winner(2 * k);
+    tree_.assign(std::max(k, 1), 0);
+    for (int i = 0; i < k; ++i) {
+      winner[k + i] = i;
+    }
+    for (int t = k - 1; t > 0; --t) {
+      int a = winner[2 * t], b = winner[2 * t + 1];
+      bool a_wins = wins(a, b);
+      winner[t] = a_wins ? a : b;
+      tree_[t] = a_wins ? b : a;
+    }
+    tree_[0] = k > 1 ? winner[1] : 0;
+  }
 
-  std::string getType() { return "SortExecutor"; }
+  // 把group中的run归并成一个新的run
+  Run merge_runs(const std::vector<Run>& group) {
+    start_merge(group);
+    Run out_run;
+    while (!readers_[tree_[0]].exhausted()) {
+      check_cancel();
+      int winner = tree_[0];
+      out_run.file.append(readers_[winner].row(), len_);
+      ++out_run.num_rows;
+      advance(readers_[winner]);
+      adjust(winner);
+    }
+    out_run.file.finish();
+    readers_.clear();
+    return out_run;
+  }
 };
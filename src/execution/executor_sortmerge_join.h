@@ -4,7 +4,12 @@
 #include "execution_manager.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "join_columns.h"
 
+/**
+ * @description: 排序归并连接。两侧输入都要按连接字段升序，由规划器保证：
+ * 以连接字段开头的B+树索引上的扫描直接使用，其余输入在下面加排序算子
+ */
 class SortMergeJoinExecutor : public AbstractExecutor {
  private:
   std::unique_ptr<AbstractExecutor>
@@ -14,7 +19,8 @@ class SortMergeJoinExecutor : public AbstractExecutor {
   size_t len_;                        // join后获得的每条记录的长度
   std::vector<ColMeta> cols_;         // join后获得的记录的字段
   std::vector<Condition> fed_conds_;  // join条件
-  std::unique_ptr<RmRecord> rm_record_;
+  RmRecord join_record_;   // 当前的连接结果，每次匹配时复用
+  JoinColumns join_cols_;  // 拼接结果时只拷贝上层需要的字段
   std::unique_ptr<RmRecord> lhs_rec_;
   std::shared_ptr<RmRecord> rhs_rec_;  // 共享指针，避免拷贝开销
   bool is_right_empty_;
@@ -26,7 +32,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
   size_t rollback_cnts_;  // 回滚后需要返回的元组数量
   std::shared_ptr<RmRecord> prev_rhs_rec_;
 
-  // for index scan
+  // 调试用，ENABLE_SORTMERGE_DEBUG_OUTPUT打开时把两侧的输入写到文件中，会把两侧各读一遍
   void write_sorted_results() {
     // 以期望格式写入 sorted_results.txt
     auto out_expected_file =
@@ -41,6 +47,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
 
     // 右表先开始
     for (right_->beginTuple(); !right_->is_end(); right_->nextTuple()) {
+      check_cancel();
       rhs_rec_ = right_->Next();
       // 打印记录
       std::vector<std::string> columns;
@@ -77,6 +84,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
 
     // 再左表
     for (left_->beginTuple(); !left_->is_end(); left_->nextTuple()) {
+      check_cancel();
       lhs_rec_ = left_->Next();
       // 打印记录
       std::vector<std::string> columns;
@@ -122,6 +130,8 @@ class SortMergeJoinExecutor : public AbstractExecutor {
     }
     cols_.insert(cols_.end(), right_cols.begin(), right_cols.end());
     last_cond_ = fed_conds_[0];
+    join_record_ = RmRecord(len_);
+    join_cols_.init(left_->tupleLen(), right_->tupleLen());
   }
 
   void beginTuple() override {
@@ -131,6 +141,10 @@ class SortMergeJoinExecutor : public AbstractExecutor {
     is_rollback_ = false;
     rollback_cnts_ = 0;
 
+    if (ENABLE_SORTMERGE_DEBUG_OUTPUT) {
+      write_sorted_results();
+    }
+
     // 为了 sort_results.txt 文件内容与测试一致，右算子先开始
     right_->beginTuple();
     // 右表为空时直接返回
@@ -152,11 +166,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
       while (!right_->is_end()) {
         // 如果找到匹配的直接 return
         if (cmp_conds(lhs_rec_.get(), rhs_rec_.get(), fed_conds_, cols_)) {
-          rm_record_ = std::make_unique<RmRecord>(len_);
-          // 拷贝左右元组
-          memcpy(rm_record_->data, lhs_rec_->data, left_->tupleLen());
-          memcpy(rm_record_->data + left_->tupleLen(), rhs_rec_->data,
-                 right_->tupleLen());
+          join_current(rhs_rec_.get());
           // 第一次匹配，拷贝一份
           if (++match_cnts_ == 1) {
             prev_rhs_rec_ = rhs_rec_;
@@ -264,11 +274,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
     if (is_rollback_ && rollback_cnts_ > 0) {
       --rollback_cnts_;
       // is_rollback_ = --rollback_cnts_ > 0;
-      rm_record_ = std::make_unique<RmRecord>(len_);
-      // 拷贝左右元组
-      memcpy(rm_record_->data, lhs_rec_->data, left_->tupleLen());
-      memcpy(rm_record_->data + left_->tupleLen(), prev_rhs_rec_->data,
-             right_->tupleLen());
+      join_current(prev_rhs_rec_.get());
       return;
     }
 
@@ -285,11 +291,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
       while (!right_->is_end()) {
         // 如果找到匹配的直接 return
         if (cmp_conds(lhs_rec_.get(), rhs_rec_.get(), fed_conds_, cols_)) {
-          rm_record_ = std::make_unique<RmRecord>(len_);
-          // 拷贝左右元组
-          memcpy(rm_record_->data, lhs_rec_->data, left_->tupleLen());
-          memcpy(rm_record_->data + left_->tupleLen(), rhs_rec_->data,
-                 right_->tupleLen());
+          join_current(rhs_rec_.get());
           // 第一次匹配，拷贝一份
           if (++match_cnts_ == 1) {
             prev_rhs_rec_ = rhs_rec_;
@@ -318,11 +320,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
                 is_rollback_ = true;
                 // is_rollback_ = --rollback_cnts_ > 0;
                 --rollback_cnts_;
-                rm_record_ = std::make_unique<RmRecord>(len_);
-                // 拷贝左右元组
-                memcpy(rm_record_->data, lhs_rec_->data, left_->tupleLen());
-                memcpy(rm_record_->data + left_->tupleLen(),
-                       prev_rhs_rec_->data, right_->tupleLen());
+                join_current(prev_rhs_rec_.get());
                 return;
               }
               match_cnts_ = 0;
@@ -425,11 +423,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
           rollback_cnts_ = match_cnts_;
           is_rollback_ = true;
           --rollback_cnts_;
-          rm_record_ = std::make_unique<RmRecord>(len_);
-          // 拷贝左右元组
-          memcpy(rm_record_->data, lhs_rec_->data, left_->tupleLen());
-          memcpy(rm_record_->data + left_->tupleLen(), prev_rhs_rec_->data,
-                 right_->tupleLen());
+          join_current(prev_rhs_rec_.get());
           return;
         }
         // assert(false);
@@ -450,7 +444,25 @@ class SortMergeJoinExecutor : public AbstractExecutor {
     } while (!left_->is_end());
   }
 
-  std::unique_ptr<RmRecord> Next() override { return std::move(rm_record_); }
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(len_);
+    memcpy(record->data, join_record_.data, len_);
+    return record;
+  }
+
+  const RmRecord* next_view() override { return &join_record_; }
+
+  // 条件在左右记录上分别读取，拼接时不需要拷贝条件的字段
+  void set_read_cols(const std::vector<ColMeta>& cols) override {
+    std::vector<ColMeta> cond_cols;
+    for (auto& cond : fed_conds_) {
+      cond_cols.push_back(*get_col(cols_, cond.lhs_col));
+      if (!cond.is_rhs_val) {
+        cond_cols.push_back(*get_col(cols_, cond.rhs_col));
+      }
+    }
+    join_cols_.set_read_cols(cols, cond_cols, left_.get(), right_.get());
+  }
 
   Rid& rid() override { return _abstract_rid; }
 
@@ -462,6 +474,11 @@ class SortMergeJoinExecutor : public AbstractExecutor {
 
   size_t tupleLen() const override { return len_; }
 
+  // 把左表当前记录和rhs拼接到join_record_中
+  void join_current(const RmRecord* rhs) {
+    join_cols_.copy(join_record_.data, lhs_rec_->data, rhs->data);
+  }
+
   static inline int compare(const char* a, const char* b, int col_len,
                             ColType col_type) {
     switch (col_type) {
@@ -497,7 +514,7 @@ class SortMergeJoinExecutor : public AbstractExecutor {
     // 常值
     if (cond.is_rhs_val) {
       rhs_type = cond.rhs_val.type;
-      rhs_data = cond.rhs_val.raw->data;
+      rhs_data = cond.rhs_val.raw.data();
     } else {
       // 列值
       const auto& rhs_col_meta = get_col(rec_cols, cond.rhs_col);
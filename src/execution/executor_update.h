@@ -9,12 +9,15 @@ MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
 See the Mulan PSL v2 for more details. */
 
 #pragma once
+#include <algorithm>
+#include <unordered_set>
 #include <utility>
 
 #include "execution_defs.h"
 #include "execution_manager.h"
 #include "executor_abstract.h"
 #include "index/ix.h"
+#include "mat_view.h"
 #include "system/sm.h"
 
 class UpdateExecutor : public AbstractExecutor {
@@ -27,142 +30,289 @@ class UpdateExecutor : public AbstractExecutor {
   RmFileHandle* fh_;
   std::vector<Rid> rids_;
   std::vector<std::vector<ColMeta>::iterator> set_cols_;
-  bool is_set_index_key_;
+  // key中有被set的列的索引，其他索引的key不会变，不需要维护
+  struct SetIndex {
+    const std::string* name;
+    const IndexMeta* index;
+    IxIndexHandle* ih;
+  };
+  std::vector<SetIndex> set_indexes_;
+  // 所有set都是不在索引中的字段加减常量：只加递增锁，增量推迟到提交时应用，见defer_increments
+  bool escrow_ = false;
+  // 表上有用到被set的字段的物化视图时维护它们
+  std::unique_ptr<MatViewMaintainer> mat_views_;
+  // set_indexes_中每个索引在这条语句中要删除的旧key，以及要插入的新key和它指向的记录
+  struct IndexBatch {
+    std::vector<char> old_keys;
+    std::vector<char> new_keys;
+    std::vector<Rid> rids;
+    std::unordered_set<int64_t> old_rids;  // 旧key还留在索引中、之后要删除的记录，见rid_key
+  };
+
+  static int64_t rid_key(const Rid& rid) {
+    return (static_cast<int64_t>(rid.page_no) << 32) |
+           static_cast<uint32_t>(rid.slot_no);
+  }
+
+  // 第i个set子句（is_incr）加到字段上的增量，减法取相反数
+  IncrementDelta make_delta(size_t i) const {
+    IncrementDelta delta{set_cols_[i]->offset, set_cols_[i]->type, {}};
+    memcpy(delta.value, set_clauses_[i].rhs.raw.data(), sizeof(delta.value));
+    if (set_clauses_[i].is_sub) {
+      if (delta.type == TYPE_INT) {
+        int value;
+        memcpy(&value, delta.value, sizeof(int));
+        value = -value;
+        memcpy(delta.value, &value, sizeof(int));
+      } else {
+        float value;
+        memcpy(&value, delta.value, sizeof(float));
+        value = -value;
+        memcpy(delta.value, &value, sizeof(float));
+      }
+    }
+    return delta;
+  }
+
+  // 从记录中取出index的key
+  static void make_key(const IndexMeta& index, const char* record, char* key) {
+    int offset = 0;
+    for (auto& col : index.cols) {
+      memcpy(key + offset, record + col.offset, col.len);
+      offset += col.len;
+    }
+  }
+
+  // 每个索引先批量删除旧key再批量插入新key，key排好序后落在同一个叶子中的不用每次从根下降。
+  // 返回新key已经存在的索引的名字，都插入了时返回nullptr
+  const std::string* apply_index_batches(
+      const std::vector<IndexBatch>& batches) {
+    const std::string* duplicate = nullptr;
+    std::vector<const char*> keys;
+    for (size_t i = 0; i < set_indexes_.size(); ++i) {
+      auto& batch = batches[i];
+      auto* ih = set_indexes_[i].ih;
+      int key_len = set_indexes_[i].index->col_tot_len;
+      if (batch.rids.empty()) {
+        continue;
+      }
+      keys.clear();
+      for (size_t pos = 0; pos < batch.old_keys.size(); pos += key_len) {
+        keys.push_back(batch.old_keys.data() + pos);
+      }
+      ih->delete_entries(keys, context_->txn_);
+      keys.clear();
+      for (size_t pos = 0; pos < batch.new_keys.size(); pos += key_len) {
+        keys.push_back(batch.new_keys.data() + pos);
+      }
+      if (ih->insert_entries(keys, batch.rids, context_->txn_) > 0 &&
+          duplicate == nullptr) {
+        duplicate = set_indexes_[i].name;
+      }
+    }
+    return duplicate;
+  }
 
  public:
   UpdateExecutor(SmManager* sm_manager, std::string tab_name,
                  std::vector<SetClause> set_clauses, std::vector<Rid> rids,
-                 bool is_set_index_key, bool is_index_scan, Context* context)
+                 Context* context)
       : sm_manager_(sm_manager),
         tab_name_(std::move(tab_name)),
         set_clauses_(std::move(set_clauses)),
         tab_(sm_manager_->db_.get_table(tab_name_)) {
-    fh_ = sm_manager_->fhs_[tab_name_].get();
+    fh_ = sm_manager_->get_fh(tab_.id);
     // conds_ = std::move(conds);
     // 已经通过扫描算子找到了满足谓词条件的 rids
     // 不如同时把 records 也给我
     rids_ = std::move(rids);
-    is_set_index_key_ = is_set_index_key;
     context_ = context;
+    // 先加表上的 IX 锁再看表上有哪些索引：在线建索引发布新索引前要加表 X 锁，
+    // 拿到 IX 锁之后看到的索引列表在语句结束前不会再多出索引
+    context_->lock_mgr_->lock_IX_on_table(context_->txn_, fh_->GetFd());
 
     set_cols_.reserve(set_clauses_.size());
     for (auto& set : set_clauses_) {
-      set_cols_.emplace_back(tab_.get_col(set.lhs.col_name));
+      set_cols_.emplace_back(tab_.get_col(set.lhs));
     }
-
-    // X 锁
-    if (!is_index_scan && !rids_.empty() && context_ != nullptr) {
-      context_->lock_mgr_->lock_exclusive_on_table(context_->txn_,
-                                                   fh_->GetFd());
-      for (auto& [ix_name, index_meta] : tab_.indexes) {
-        auto predicate_manager = PredicateManager(index_meta);
-        auto gap = Gap(predicate_manager.getIndexConds());
-        context_->lock_mgr_->lock_exclusive_on_gap(context_->txn_, index_meta,
-                                                   gap, fh_->GetFd());
+    for (auto& [ix_name, index] : tab_.indexes) {
+      for (auto& col : index.cols) {
+        if (std::any_of(set_clauses_.begin(), set_clauses_.end(),
+                        [&](const SetClause& set) {
+                          return set.lhs.col_name == col.name;
+                        })) {
+          set_indexes_.push_back(
+              {&ix_name, &index, sm_manager_->get_ih(index.id)});
+          break;
+        }
+      }
+    }
+    // 不加表 X 锁：扫描算子已经用表 S 锁或索引上的间隙锁挡住了幻读，
+    // 这里只给要修改的记录加行 X 锁
+    if (!tab_.mat_views.empty()) {
+      std::vector<std::string> set_col_names;
+      for (auto& set : set_clauses_) {
+        set_col_names.push_back(set.lhs.col_name);
+      }
+      mat_views_ = std::make_unique<MatViewMaintainer>(sm_manager_, tab_, context_, &set_col_names);
+      if (mat_views_->empty()) {
+        mat_views_.reset();
       }
     }
+    // 乐观并发控制按版本字验证写过的记录，不推迟递增；物化视图要在语句中看到修改后的值，也不推迟
+    escrow_ = context_ != nullptr && set_indexes_.empty() && mat_views_ == nullptr &&
+              !context_->txn_->get_occ_state().enabled &&
+              std::all_of(set_clauses_.begin(), set_clauses_.end(),
+                          [](const SetClause& set) { return set.is_incr; });
   }
 
-  // 这里 next 只会被调用一次
+  // 这里 next 只会被调用一次。记录逐条更新，索引的修改攒到最后按索引批量进行：
+  // 查重仍然在修改之前逐条进行，语句内几条记录改成同一个key时批量插入才会发现
   std::unique_ptr<RmRecord> Next() override {
+    if (escrow_) {
+      defer_increments();
+      fh_->note_rows_modified(rids_.size());
+      return nullptr;
+    }
+    std::vector<IndexBatch> batches(set_indexes_.size());
+    try {
+      update_records(&batches);
+    } catch (...) {
+      // 已经更新的记录的索引也要改完，回滚时按新旧记录恢复索引
+      apply_index_batches(batches);
+      throw;
+    }
+    if (auto* name = apply_index_batches(batches)) {
+      throw NonUniqueIndexError("", {*name});
+    }
+    if (mat_views_ != nullptr) {
+      mat_views_->apply();
+    }
+    fh_->note_rows_modified(rids_.size());
+    return nullptr;
+  }
+
+  Rid& rid() override { return _abstract_rid; }
+
+ private:
+  // 热点计数器上的 col = col + 常量：给记录加递增锁，把增量记到事务中，不读也不改记录。
+  // 递增锁之间相容，多个事务同时递增同一条记录时互不等待，提交时按提交顺序依次加到记录上
+  void defer_increments() {
+    std::vector<IncrementDelta> deltas;
+    for (size_t i = 0; i < set_clauses_.size(); ++i) {
+      deltas.push_back(make_delta(i));
+    }
+    auto& pending = context_->txn_->get_pending_increments();
     for (auto& rid : rids_) {
-      auto old_record = fh_->get_record(rid, context_);
+      context_->lock_mgr_->lock_increment_on_record(context_->txn_, rid,
+                                                    fh_->GetFd());
+      pending.push_back({tab_name_, tab_.id, fh_->GetFd(), rid, deltas});
+    }
+  }
+
+  void update_records(std::vector<IndexBatch>* batches) {
+    std::vector<char> old_key;
+    std::vector<char> new_key;
+    for (auto& rid : rids_) {
+      // 先加行 X 锁再读，避免先加 S 锁再升级时两个事务互相等待
+      if (context_ != nullptr) {
+        context_->lock_mgr_->lock_exclusive_on_record(context_->txn_, rid,
+                                                      fh_->GetFd());
+      }
+      auto old_record = fh_->get_record(rid, context_, RM_LOCK_TABLE);
       auto updated_record = std::make_unique<RmRecord>(*old_record);
 
       for (size_t i = 0; i < set_clauses_.size(); ++i) {
         auto& col_meta = set_cols_[i];
         if (set_clauses_[i].is_incr) {
-          add(updated_record->data + col_meta->offset,
-              set_clauses_[i].rhs.raw->data, col_meta->type);
+          auto delta = make_delta(i);
+          apply_increment(updated_record->data + col_meta->offset, delta.value,
+                          col_meta->type);
         } else {
           memcpy(updated_record->data + col_meta->offset,
-                 set_clauses_[i].rhs.raw->data, col_meta->len);
+                 set_clauses_[i].rhs.raw.data(), col_meta->len);
         }
       }
 
-      if (is_set_index_key_) {
-        auto** old_keys = new char*[tab_.indexes.size()];
-        auto** new_keys = new char*[tab_.indexes.size()];
-        auto** ihs = new IxIndexHandle*[tab_.indexes.size()];
-
-        int i = 0;
-        // 索引查重
-        for (auto& [ix_name, index] : tab_.indexes) {
-          ihs[i] = sm_manager_->ihs_[ix_name].get();
-          old_keys[i] = new char[index.col_tot_len];
-          new_keys[i] = new char[index.col_tot_len];
-          for (auto& [index_offset, col_meta] : index.cols) {
-            memcpy(old_keys[i] + index_offset,
-                   old_record->data + col_meta.offset, col_meta.len);
-            memcpy(new_keys[i] + index_offset,
-                   updated_record->data + col_meta.offset, col_meta.len);
-          }
-          if (!ihs[i]->is_unique(new_keys[i], _abstract_rid, context_->txn_) &&
-              _abstract_rid != rid) {
-            for (int j = 0; j <= i; ++j) {
-              delete[] old_keys[j];
-              delete[] new_keys[j];
-            }
-            delete[] old_keys;
-            delete[] new_keys;
-            delete[] ihs;
-            throw NonUniqueIndexError("", {ix_name});
-          }
-          ++i;
+      // 只维护key真的变了的索引，set的值和原来相同时也跳过
+      std::vector<size_t> changed;  // 在set_indexes_中的下标
+      std::vector<char> keys;  // 依次存放changed中每个索引的旧key和新key
+      for (size_t i = 0; i < set_indexes_.size(); ++i) {
+        auto& set_index = set_indexes_[i];
+        auto* index = set_index.index;
+        auto* ih = set_index.ih;
+        old_key.resize(index->col_tot_len);
+        new_key.resize(index->col_tot_len);
+        make_key(*index, old_record->data, old_key.data());
+        make_key(*index, updated_record->data, new_key.data());
+        if (old_key == new_key) {
+          continue;
         }
-
-        // Unique Index -> Insert into index
-        for (int j = 0; j < i; ++j) {
-          // TODO
-          // 如果不涉及索引建的变化，直接原地更新记录，不需要维护索引，避免B+树分裂重组的不必要耗时
-          ihs[j]->delete_entry(old_keys[j], context_->txn_);
-          ihs[j]->insert_entry(new_keys[j], rid, context_->txn_);
-          delete[] old_keys[j];
-          delete[] new_keys[j];
+        // 索引查重：key属于这条语句中已经更新、旧key还没有删除的记录时不算重复
+        if (!ih->is_unique(new_key.data(), _abstract_rid, context_->txn_) &&
+            _abstract_rid != rid &&
+            (*batches)[i].old_rids.count(rid_key(_abstract_rid)) == 0) {
+          throw NonUniqueIndexError("", {*set_index.name});
         }
+        changed.push_back(i);
+        keys.insert(keys.end(), old_key.begin(), old_key.end());
+        keys.insert(keys.end(), new_key.begin(), new_key.end());
+      }
 
-        // 插入完成，释放内存
-        delete[] old_keys;
-        delete[] new_keys;
-        delete[] ihs;
+      if (!changed.empty()) {
+        fh_->save_version(rid, *old_record, context_);
+        size_t pos = 0;
+        for (size_t i : changed) {
+          auto* ih = set_indexes_[i].ih;
+          const char* new_data = keys.data() + pos + set_indexes_[i].index->col_tot_len;
+          pos += 2 * set_indexes_[i].index->col_tot_len;
+          // 新key和插入一样要先取得所在间隙的插入意向锁，不能插进其他事务扫描过的区间
+          context_->lock_mgr_->lock_insert_on_gap(
+              context_->txn_, ih->fd_, ih->next_key_rid(new_data));
+        }
       }
 
-      // 再检查是否有间隙锁
-      // TPCC 测试中 update 不会涉及键的变化，在 index scan
-      // 算子加了写间隙锁后就不用再检查了 for (auto &[index_name, index]:
-      // tab_.indexes) {
-      //     RmRecord rm_record(index.col_tot_len);
-      //     for (auto &[index_offset, col_meta]: index.cols) {
-      //         memcpy(rm_record.data + index_offset, updated_record->data +
-      //         col_meta.offset, col_meta.len);
-      //     }
-      //     context_->lock_mgr_->isSafeInGap(context_->txn_, index, rm_record);
-      // }
-
-#ifdef ENABLE_LOGGING
-      auto* update_log_record =
-          new UpdateLogRecord(context_->txn_->get_transaction_id(), *old_record,
-                              *updated_record, rid, tab_name_);
-      update_log_record->prev_lsn_ = context_->txn_->get_prev_lsn();
-      context_->txn_->set_prev_lsn(
-          context_->log_mgr_->add_log_to_buffer(update_log_record));
-      auto&& page = fh_->fetch_page_handle(rid.page_no).page;
-      page->set_page_lsn(context_->txn_->get_prev_lsn());
-      sm_manager_->get_bpm()->unpin_page(page->get_page_id(), true);
-      delete update_log_record;
-#endif
-
-      fh_->update_record(rid, updated_record->data, context_);
+      // 更新日志由 RmFileHandle 在页面 pin 住时写入并标记页面 lsn
+      auto new_rid = fh_->update_record(rid, updated_record->data, context_);
+      if (mat_views_ != nullptr) {
+        mat_views_->add(old_record->data, -1);
+        mat_views_->add(updated_record->data, 1);
+      }
+      size_t pos = 0;
+      for (size_t i : changed) {
+        int key_len = set_indexes_[i].index->col_tot_len;
+        auto& batch = (*batches)[i];
+        batch.old_keys.insert(batch.old_keys.end(), keys.data() + pos,
+                              keys.data() + pos + key_len);
+        batch.new_keys.insert(batch.new_keys.end(), keys.data() + pos + key_len,
+                              keys.data() + pos + 2 * key_len);
+        batch.rids.push_back(new_rid);
+        batch.old_rids.insert(rid_key(rid));
+        pos += 2 * key_len;
+      }
+      // 变长格式中记录变长后被移到了其他页面，索引指向新的位置；
+      // key变了的索引在批量插入新key时已经指向新的位置
+      if (new_rid != rid) {
+        for (auto& [ix_name, index] : tab_.indexes) {
+          if (std::any_of(changed.begin(), changed.end(), [&](size_t i) {
+                return set_indexes_[i].index == &index;
+              })) {
+            continue;
+          }
+          auto* ih = sm_manager_->get_ih(index.id);
+          new_key.resize(index.col_tot_len);
+          make_key(index, updated_record->data, new_key.data());
+          ih->delete_entry(new_key.data(), context_->txn_);
+          ih->insert_entry(new_key.data(), new_rid, context_->txn_);
+        }
+      }
 
       // 防止 double throw
       // 写入事务写集
       auto* write_record =
-          new WriteRecord(WType::UPDATE_TUPLE, tab_name_, rid, *old_record,
-                          *updated_record, is_set_index_key_);
+          new WriteRecord(WType::UPDATE_TUPLE, tab_name_, new_rid, *old_record,
+                          *updated_record, !changed.empty());
       context_->txn_->append_write_record(write_record);
     }
-    return nullptr;
   }
-
-  Rid& rid() override { return _abstract_rid; }
 };
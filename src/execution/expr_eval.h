@@ -0,0 +1,342 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "common/expression.h"
+#include "errors.h"
+#include "system/sm_meta.h"
+
+/* 一批记录上一个中间结果的值，按类型只用其中一个数组 */
+struct ExprReg {
+  std::vector<int> ints;
+  std::vector<float> floats;
+
+  template <typename T>
+  T* data() {
+    if constexpr (std::is_same_v<T, int>) {
+      return ints.data();
+    } else {
+      return floats.data();
+    }
+  }
+};
+
+/* 计算表达式用的临时空间，每个线程一份，反复使用不再分配 */
+struct ExprScratch {
+  std::vector<ExprReg> regs;
+  std::vector<const char*> rows;  // 还没有被筛掉的记录
+  std::vector<size_t> idx;        // rows中的记录在输入中的下标
+  std::vector<uint8_t> passed;
+};
+
+/**
+ * @description: 编译好的表达式。绑定时已经确定了每个结点的类型，这里把表达式树按后序展开成一串步骤，
+ * 每一步是按运算符和类型特化的函数，一次处理一批记录的一个结点，循环体里没有分支，编译器可以向量化。
+ * 每个结点的结果放在一个寄存器（一批值的数组）中
+ */
+class ExprProgram {
+ public:
+  // 编译expr，结果转成as类型（只能从int转成float），返回结果所在的寄存器。字段在cols中按表名和列名查找
+  int add(const Expression& expr, const std::vector<ColMeta>& cols,
+          ColType as) {
+    int reg = compile(expr, cols);
+    if (expr.type == TYPE_INT && as == TYPE_FLOAT) {
+      reg = push({to_float, new_reg(TYPE_FLOAT), reg});
+    }
+    return reg;
+  }
+
+  // 对n条记录依次执行各个步骤
+  void run(const char* const* rows, size_t n, ExprScratch& scratch) const {
+    scratch.regs.resize(reg_types_.size());
+    for (size_t i = 0; i < reg_types_.size(); ++i) {
+      if (reg_types_[i] == TYPE_INT) {
+        scratch.regs[i].ints.resize(n);
+      } else {
+        scratch.regs[i].floats.resize(n);
+      }
+    }
+    for (auto& step : steps_) {
+      step.fn(step, rows, n, scratch.regs.data());
+    }
+  }
+
+ private:
+  struct Step;
+  using StepFn = void (*)(const Step&, const char* const*, size_t, ExprReg*);
+
+  struct Step {
+    StepFn fn;
+    int dst;
+    int lhs = -1;
+    int rhs = -1;
+    int offset = 0;  // 读取字段时字段的偏移
+    int int_val = 0;
+    float float_val = 0;
+  };
+
+  int new_reg(ColType type) {
+    reg_types_.push_back(type);
+    return static_cast<int>(reg_types_.size()) - 1;
+  }
+
+  int push(const Step& step) {
+    steps_.push_back(step);
+    return step.dst;
+  }
+
+  int compile(const Expression& expr, const std::vector<ColMeta>& cols) {
+    if (expr.type == TYPE_STRING) {
+      throw InternalError("Unexpected data type！");
+    }
+    if (expr.kind == Expression::COL) {
+      for (auto& col : cols) {
+        if (col.tab_name == expr.col.tab_name && col.name == expr.col.col_name) {
+          Step step{expr.type == TYPE_INT ? load_col<int> : load_col<float>,
+                    new_reg(expr.type)};
+          step.offset = col.offset;
+          return push(step);
+        }
+      }
+      throw ColumnNotFoundError(expr.col.col_name);
+    }
+    if (expr.kind == Expression::CONST) {
+      Step step{expr.type == TYPE_INT ? load_const<int> : load_const<float>,
+                new_reg(expr.type)};
+      step.int_val = expr.val.int_val;
+      step.float_val = expr.val.float_val;
+      return push(step);
+    }
+    int lhs = add(*expr.lhs, cols, expr.type);
+    int rhs = add(*expr.rhs, cols, expr.type);
+    StepFn fn = expr.type == TYPE_INT ? select_arith<int>(expr.op)
+                                      : select_arith<float>(expr.op);
+    Step step{fn, new_reg(expr.type), lhs, rhs};
+    return push(step);
+  }
+
+  template <typename T>
+  static void load_col(const Step& step, const char* const* rows, size_t n,
+                       ExprReg* regs) {
+    T* dst = regs[step.dst].data<T>();
+    for (size_t i = 0; i < n; ++i) {
+      memcpy(dst + i, rows[i] + step.offset, sizeof(T));
+    }
+  }
+
+  template <typename T>
+  static void load_const(const Step& step, const char* const*, size_t n,
+                         ExprReg* regs) {
+    T* dst = regs[step.dst].data<T>();
+    T val;
+    if constexpr (std::is_same_v<T, int>) {
+      val = step.int_val;
+    } else {
+      val = step.float_val;
+    }
+    std::fill(dst, dst + n, val);
+  }
+
+  static void to_float(const Step& step, const char* const*, size_t n,
+                       ExprReg* regs) {
+    float* dst = regs[step.dst].floats.data();
+    const int* src = regs[step.lhs].ints.data();
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+
+  // int的加减乘和聚合一样按32位回绕，不会有有符号溢出；除数为0时报错
+  template <ArithOp op, typename T>
+  static void arith(const Step& step, const char* const*, size_t n,
+                    ExprReg* regs) {
+    T* dst = regs[step.dst].data<T>();
+    const T* a = regs[step.lhs].data<T>();
+    const T* b = regs[step.rhs].data<T>();
+    if constexpr (op == ARITH_DIV) {
+      for (size_t i = 0; i < n; ++i) {
+        if (b[i] == 0) {
+          throw DivisionByZeroError();
+        }
+      }
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if constexpr (std::is_same_v<T, int> && op != ARITH_DIV) {
+        unsigned x = static_cast<unsigned>(a[i]);
+        unsigned y = static_cast<unsigned>(b[i]);
+        unsigned res = op == ARITH_ADD ? x + y : op == ARITH_SUB ? x - y : x * y;
+        dst[i] = static_cast<int>(res);
+      } else if constexpr (std::is_same_v<T, int>) {
+        // INT_MIN / -1 也按回绕处理
+        dst[i] = b[i] == -1 ? static_cast<int>(0u - static_cast<unsigned>(a[i]))
+                            : a[i] / b[i];
+      } else if constexpr (op == ARITH_ADD) {
+        dst[i] = a[i] + b[i];
+      } else if constexpr (op == ARITH_SUB) {
+        dst[i] = a[i] - b[i];
+      } else if constexpr (op == ARITH_MUL) {
+        dst[i] = a[i] * b[i];
+      } else {
+        dst[i] = a[i] / b[i];
+      }
+    }
+  }
+
+  template <typename T>
+  static StepFn select_arith(ArithOp op) {
+    switch (op) {
+      case ARITH_ADD:
+        return arith<ARITH_ADD, T>;
+      case ARITH_SUB:
+        return arith<ARITH_SUB, T>;
+      case ARITH_MUL:
+        return arith<ARITH_MUL, T>;
+      default:
+        return arith<ARITH_DIV, T>;
+    }
+  }
+
+  std::vector<Step> steps_;
+  std::vector<ColType> reg_types_;
+};
+
+/**
+ * @description: 一张表上的表达式条件。每个条件编译成一个ExprProgram，两边有float时都按float比较。
+ * 批量计算时按条件的顺序逐个计算，每个条件只在前面的条件都满足的记录上计算，
+ * 这样 a - b <> 0 AND c / (a - b) > 1 不会在被前一个条件筛掉的记录上除以0
+ */
+class ExprFilter {
+ public:
+  ExprFilter() = default;
+
+  ExprFilter(const std::vector<ExprCond>& conds, const std::vector<ColMeta>& cols) {
+    for (auto& cond : conds) {
+      bool is_float = cond.lhs->type == TYPE_FLOAT || cond.rhs->type == TYPE_FLOAT;
+      ColType type = is_float ? TYPE_FLOAT : TYPE_INT;
+      Compiled compiled;
+      compiled.lhs = compiled.program.add(*cond.lhs, cols, type);
+      compiled.rhs = compiled.program.add(*cond.rhs, cols, type);
+      compiled.cmp = is_float ? select_cmp<float>(cond.op) : select_cmp<int>(cond.op);
+      conds_.push_back(std::move(compiled));
+      cond.lhs->collect_cols(ref_cols_);
+      cond.rhs->collect_cols(ref_cols_);
+    }
+  }
+
+  bool empty() const { return conds_.empty(); }
+
+  // 条件中用到的字段，可能有重复
+  const std::vector<TabCol>& ref_cols() const { return ref_cols_; }
+
+  // 计算n条记录，passed[i]在第i条记录不满足条件时清零
+  void eval(const char* const* rows, size_t n, uint8_t* passed,
+            ExprScratch& scratch) const {
+    auto& idx = scratch.idx;
+    idx.clear();
+    scratch.rows.clear();
+    for (size_t i = 0; i < n; ++i) {
+      if (passed[i]) {
+        idx.push_back(i);
+        scratch.rows.push_back(rows[i]);
+      }
+    }
+    for (auto& cond : conds_) {
+      if (scratch.rows.empty()) {
+        return;
+      }
+      size_t m = scratch.rows.size();
+      cond.program.run(scratch.rows.data(), m, scratch);
+      scratch.passed.assign(m, 1);
+      cond.cmp(scratch.regs[cond.lhs], scratch.regs[cond.rhs], m,
+               scratch.passed.data());
+      size_t k = 0;
+      for (size_t j = 0; j < m; ++j) {
+        if (scratch.passed[j]) {
+          idx[k] = idx[j];
+          scratch.rows[k++] = scratch.rows[j];
+        } else {
+          passed[idx[j]] = 0;
+        }
+      }
+      idx.resize(k);
+      scratch.rows.resize(k);
+    }
+  }
+
+  // 计算一条记录
+  bool eval(const char* row, ExprScratch& scratch) const {
+    uint8_t passed = 1;
+    eval(&row, 1, &passed, scratch);
+    return passed != 0;
+  }
+
+ private:
+  using CmpFn = void (*)(ExprReg&, ExprReg&, size_t, uint8_t*);
+
+  struct Compiled {
+    ExprProgram program;
+    int lhs;
+    int rhs;
+    CmpFn cmp;
+  };
+
+  template <CompOp op, typename T>
+  static void cmp(ExprReg& lhs, ExprReg& rhs, size_t n, uint8_t* passed) {
+    const T* a = lhs.data<T>();
+    const T* b = rhs.data<T>();
+    for (size_t i = 0; i < n; ++i) {
+      bool res;
+      if constexpr (op == OP_EQ) {
+        res = a[i] == b[i];
+      } else if constexpr (op == OP_NE) {
+        res = a[i] != b[i];
+      } else if constexpr (op == OP_LT) {
+        res = a[i] < b[i];
+      } else if constexpr (op == OP_GT) {
+        res = a[i] > b[i];
+      } else if constexpr (op == OP_LE) {
+        res = a[i] <= b[i];
+      } else {
+        res = a[i] >= b[i];
+      }
+      passed[i] &= static_cast<uint8_t>(res);
+    }
+  }
+
+  template <typename T>
+  static CmpFn select_cmp(CompOp op) {
+    switch (op) {
+      case OP_EQ:
+        return cmp<OP_EQ, T>;
+      case OP_NE:
+        return cmp<OP_NE, T>;
+      case OP_LT:
+        return cmp<OP_LT, T>;
+      case OP_GT:
+        return cmp<OP_GT, T>;
+      case OP_LE:
+        return cmp<OP_LE, T>;
+      case OP_GE:
+        return cmp<OP_GE, T>;
+      default:
+        throw InternalError("Unexpected op type！");
+    }
+  }
+
+  std::vector<Compiled> conds_;
+  std::vector<TabCol> ref_cols_;
+};
@@ -0,0 +1,110 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "executor_abstract.h"
+
+/**
+ * @description: 连接结果的延迟物化。连接结果中左记录在前、右记录在后，
+ * 上层算子通过set_read_cols声明只读取部分字段后，拼接时只拷贝这些字段（按偏移合并成连续的段），
+ * 其余字段的内容不确定；需要的字段连同连接自己计算条件用到的字段再告诉左右儿子，一直传到扫描。
+ * 宽表连接后只投影出少数几列时，省掉绝大部分拷贝
+ */
+class JoinColumns {
+ public:
+  void init(size_t left_len, size_t right_len) {
+    left_len_ = left_len;
+    right_len_ = right_len;
+    all_ = true;
+    left_segs_.clear();
+    right_segs_.clear();
+  }
+
+  /**
+   * @description: 上层只读取cols中的字段
+   * @param {vector<ColMeta>&} cols 拼接时拷贝的字段：上层读取的字段，以及在拼接好的结果上计算的条件的字段
+   * @param {vector<ColMeta>&} cond_cols 连接直接在左右记录上计算条件时读取的字段，拼接时不拷贝
+   * 两者的偏移都是连接结果中的偏移。索引嵌套循环连接的内表不是算子，right为nullptr
+   */
+  void set_read_cols(const std::vector<ColMeta>& cols,
+                     const std::vector<ColMeta>& cond_cols,
+                     AbstractExecutor* left, AbstractExecutor* right) {
+    all_ = false;
+    left_segs_ = segments(cols, 0, left_len_);
+    right_segs_ = segments(cols, left_len_, left_len_ + right_len_);
+
+    std::vector<ColMeta> left_cols;
+    std::vector<ColMeta> right_cols;
+    for (auto* list : {&cols, &cond_cols}) {
+      for (auto& col : *list) {
+        if (static_cast<size_t>(col.offset) < left_len_) {
+          left_cols.push_back(col);
+        } else {
+          right_cols.push_back(col);
+          right_cols.back().offset -= static_cast<int>(left_len_);
+        }
+      }
+    }
+    left->set_read_cols(left_cols);
+    if (right != nullptr) {
+      right->set_read_cols(right_cols);
+    }
+  }
+
+  // 把左右记录拼接到dest中，只拷贝上层需要的字段
+  void copy(char* dest, const char* left, const char* right) const {
+    if (all_) {
+      memcpy(dest, left, left_len_);
+      memcpy(dest + left_len_, right, right_len_);
+      return;
+    }
+    for (auto& [offset, len] : left_segs_) {
+      memcpy(dest + offset, left + offset, len);
+    }
+    for (auto& [offset, len] : right_segs_) {
+      memcpy(dest + left_len_ + offset, right + offset, len);
+    }
+  }
+
+ private:
+  // cols中落在[begin, end)中的字段，按偏移排序后合并相邻和重叠的部分，偏移相对于begin
+  static std::vector<std::pair<size_t, size_t>> segments(
+      const std::vector<ColMeta>& cols, size_t begin, size_t end) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (auto& col : cols) {
+      size_t offset = static_cast<size_t>(col.offset);
+      if (offset >= begin && offset < end) {
+        ranges.emplace_back(offset - begin, offset - begin + col.len);
+      }
+    }
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<size_t, size_t>> segs;
+    for (auto& [lo, hi] : ranges) {
+      if (!segs.empty() && lo <= segs.back().first + segs.back().second) {
+        size_t seg_end = std::max(segs.back().first + segs.back().second, hi);
+        segs.back().second = seg_end - segs.back().first;
+      } else {
+        segs.emplace_back(lo, hi - lo);
+      }
+    }
+    return segs;
+  }
+
+  size_t left_len_ = 0;
+  size_t right_len_ = 0;
+  bool all_ = true;  // 上层没有声明读取的字段，拷贝整条记录
+  std::vector<std::pair<size_t, size_t>> left_segs_;   // (偏移, 长度)
+  std::vector<std::pair<size_t, size_t>> right_segs_;
+};
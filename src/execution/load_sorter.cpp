@@ -0,0 +1,166 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "load_sorter.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+#include "index/ix_index_handle.h"
+
+/* 归并时顺序读一个run：内存中的run直接指向数据，临时文件中的run每次读入一块 */
+struct LoadSorter::Cursor {
+  const char* cur = nullptr;
+  const char* end = nullptr;
+  const SpillFile* file = nullptr;
+  size_t offset = 0;  // 文件中下一块的偏移
+  std::vector<char> buf;
+
+  // 读入文件中的下一块，读完时返回false
+  bool refill(int entry_len) {
+    if (file == nullptr || offset == file->size()) {
+      return false;
+    }
+    size_t len = std::min(file->size() - offset,
+                          std::max<size_t>(1, SORT_IO_BUFFER / entry_len) *
+                              entry_len);
+    buf.resize(len);
+    file->read(buf.data(), len, offset);
+    offset += len;
+    cur = buf.data();
+    end = cur + len;
+    return true;
+  }
+
+  bool advance(int entry_len) {
+    cur += entry_len;
+    return cur != end || refill(entry_len);
+  }
+};
+
+LoadSorter::LoadSorter(const IndexMeta& index, int record_len,
+                       size_t memory_budget)
+    : key_cols_(index.cols),
+      key_len_(index.col_tot_len),
+      record_len_(record_len),
+      entry_len_(index.col_tot_len + record_len),
+      memory_budget_(memory_budget) {
+  for (auto& col : key_cols_) {
+    key_types_.push_back(col.type);
+    key_lens_.push_back(col.len);
+  }
+}
+
+LoadSorter::~LoadSorter() = default;
+
+void LoadSorter::sort_chunk(std::vector<char>* records, int num_records) const {
+  std::vector<char> keys(static_cast<size_t>(num_records) * key_len_);
+  std::vector<char> raw(key_len_);
+  for (int i = 0; i < num_records; ++i) {
+    const char* record = records->data() + static_cast<size_t>(i) * record_len_;
+    int offset = 0;
+    for (auto& col : key_cols_) {
+      memcpy(raw.data() + offset, record + col.offset, col.len);
+      offset += col.len;
+    }
+    ix_encode_key(raw.data(), keys.data() + static_cast<size_t>(i) * key_len_,
+                  key_types_, key_lens_);
+  }
+  std::vector<uint32_t> order(num_records);
+  std::iota(order.begin(), order.end(), 0);
+  // 稳定排序，key相同的记录保持文件中的顺序
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return memcmp(keys.data() + static_cast<size_t>(a) * key_len_,
+                  keys.data() + static_cast<size_t>(b) * key_len_,
+                  key_len_) < 0;
+  });
+  std::vector<char> entries(static_cast<size_t>(num_records) * entry_len_);
+  char* entry = entries.data();
+  for (uint32_t idx : order) {
+    memcpy(entry, keys.data() + static_cast<size_t>(idx) * key_len_, key_len_);
+    memcpy(entry + key_len_,
+           records->data() + static_cast<size_t>(idx) * record_len_,
+           record_len_);
+    entry += entry_len_;
+  }
+  records->swap(entries);
+}
+
+void LoadSorter::add_run(std::vector<char>&& entries) {
+  if (entries.empty()) {
+    return;
+  }
+  mem_bytes_ += entries.size();
+  mem_runs_.push_back(std::move(entries));
+  if (mem_bytes_ > memory_budget_) {
+    spill();
+  }
+}
+
+void LoadSorter::merge(std::vector<Cursor>& cursors,
+                       const std::function<void(const char*)>& emit) const {
+  auto greater = [&](size_t a, size_t b) {
+    int cmp = memcmp(cursors[a].cur, cursors[b].cur, key_len_);
+    return cmp > 0 || (cmp == 0 && a > b);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+      greater);
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    if (cursors[i].cur != cursors[i].end || cursors[i].refill(entry_len_)) {
+      heap.push(i);
+    }
+  }
+  while (!heap.empty()) {
+    size_t i = heap.top();
+    heap.pop();
+    emit(cursors[i].cur);
+    if (cursors[i].advance(entry_len_)) {
+      heap.push(i);
+    }
+  }
+}
+
+/**
+ * @description: 内存中的run超过预算时把它们归并成一个更长的run写到临时文件，之后的run接在它后面
+ */
+void LoadSorter::spill() {
+  std::vector<Cursor> cursors(mem_runs_.size());
+  for (size_t i = 0; i < mem_runs_.size(); ++i) {
+    cursors[i].cur = mem_runs_[i].data();
+    cursors[i].end = cursors[i].cur + mem_runs_[i].size();
+  }
+  auto file = std::make_unique<SpillFile>(SORT_IO_BUFFER);
+  merge(cursors, [&](const char* entry) { file->append(entry, entry_len_); });
+  file->finish();
+  file_runs_.push_back(std::move(file));
+  mem_runs_.clear();
+  mem_bytes_ = 0;
+}
+
+/**
+ * @description: 把临时文件中的run和内存中剩下的run一起归并，按key的顺序输出记录。
+ * 临时文件的run都比内存中的run靠前，排在前面
+ */
+void LoadSorter::finish(const std::function<void(const char*)>& emit) {
+  std::vector<Cursor> cursors(file_runs_.size() + mem_runs_.size());
+  for (size_t i = 0; i < file_runs_.size(); ++i) {
+    cursors[i].file = file_runs_[i].get();
+  }
+  for (size_t i = 0; i < mem_runs_.size(); ++i) {
+    auto& cursor = cursors[file_runs_.size() + i];
+    cursor.cur = mem_runs_[i].data();
+    cursor.end = cursor.cur + mem_runs_[i].size();
+  }
+  merge(cursors, [&](const char* entry) { emit(entry + key_len_); });
+  file_runs_.clear();
+  mem_runs_.clear();
+  mem_bytes_ = 0;
+}
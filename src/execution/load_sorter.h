@@ -0,0 +1,68 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "spill_file.h"
+#include "system/sm_meta.h"
+
+/**
+ * @description: LOAD时按聚簇索引的key对解析好的记录做外部排序，表按key的顺序写入，聚簇索引的叶子可以顺序填满。
+ * 每个表项是编码后的key（可以直接memcmp）紧跟记录。解析线程各自用sort_chunk把自己解析出的一块记录排成有序run，
+ * 导入线程按文件中的顺序add_run，内存中的run超过预算时归并成一个临时文件；finish时把所有run多路归并，
+ * 按key的顺序依次输出记录。key相同的记录保持文件中的顺序
+ */
+class LoadSorter {
+ public:
+  LoadSorter(const IndexMeta& index, int record_len,
+             size_t memory_budget = LOAD_SORT_MEMORY);
+
+  ~LoadSorter();
+
+  LoadSorter(const LoadSorter&) = delete;
+  LoadSorter& operator=(const LoadSorter&) = delete;
+
+  // 可以被多个线程同时调用：把records中连续存放的num_records条记录换成按key排好序的表项
+  void sort_chunk(std::vector<char>* records, int num_records) const;
+
+  // 按文件中的顺序依次加入sort_chunk的结果
+  void add_run(std::vector<char>&& entries);
+
+  // 按key的顺序对每条记录调用一次emit
+  void finish(const std::function<void(const char*)>& emit);
+
+ private:
+  struct Cursor;
+
+  // 归并cursors，相同的key先取下标小的（文件中靠前的）run
+  void merge(std::vector<Cursor>& cursors,
+             const std::function<void(const char*)>& emit) const;
+
+  // 把内存中的run归并成一个临时文件
+  void spill();
+
+  std::vector<ColMeta> key_cols_;
+  std::vector<ColType> key_types_;
+  std::vector<int> key_lens_;
+  int key_len_;
+  int record_len_;
+  int entry_len_;
+  size_t memory_budget_;
+
+  // 内存中的有序run和它们的总字节数
+  std::vector<std::vector<char>> mem_runs_;
+  size_t mem_bytes_ = 0;
+  // 写到临时文件的有序run，都比mem_runs_中的run靠前
+  std::vector<std::unique_ptr<SpillFile>> file_runs_;
+};
@@ -0,0 +1,279 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "mat_view.h"
+
+#include <algorithm>
+
+#include "execution_defs.h"
+#include "record/rm_scan.h"
+
+namespace {
+
+// value按sign加到（或者减出）state上
+void add_value(char* state, const char* value, ColType type, int sign) {
+  if (type == TYPE_INT) {
+    int sum;
+    int v;
+    memcpy(&sum, state, sizeof(int));
+    memcpy(&v, value, sizeof(int));
+    sum += sign * v;
+    memcpy(state, &sum, sizeof(int));
+  } else {
+    float sum;
+    float v;
+    memcpy(&sum, state, sizeof(float));
+    memcpy(&v, value, sizeof(float));
+    sum += static_cast<float>(sign) * v;
+    memcpy(state, &sum, sizeof(float));
+  }
+}
+
+// value比state更接近agg_type要的极值时，或者state还没有值时，替换state
+void fold_extreme(AggType agg_type, const ColMeta& col, char* state,
+                  const char* value, bool is_new) {
+  int cmp = is_new ? 0 : compare(value, state, col.len, col.type);
+  if (is_new || (agg_type == AGG_MIN ? cmp < 0 : cmp > 0)) {
+    memcpy(state, value, col.len);
+  }
+}
+
+}  // namespace
+
+MatViewMaintainer::MatViewMaintainer(SmManager* sm_manager, const TabMeta& base,
+                                     Context* context,
+                                     const std::vector<std::string>* changed_cols)
+    : sm_manager_(sm_manager),
+      base_(base),
+      base_fh_(sm_manager->get_fh(base.id)),
+      context_(context) {
+  for (auto& view_name : base.mat_views) {
+    auto& view = sm_manager_->db_.get_table(view_name);
+    if (changed_cols != nullptr &&
+        std::none_of(view.mat_view.cols.begin(), view.mat_view.cols.end(),
+                     [&](const MatViewCol& col) {
+                       return std::find(changed_cols->begin(), changed_cols->end(),
+                                        col.src_col) != changed_cols->end();
+                     })) {
+      continue;
+    }
+    add_view(view);
+  }
+}
+
+MatViewMaintainer::MatViewMaintainer(SmManager* sm_manager, const TabMeta& base,
+                                     const std::string& view, Context* context)
+    : sm_manager_(sm_manager),
+      base_(base),
+      base_fh_(sm_manager->get_fh(base.id)),
+      context_(context) {
+  add_view(sm_manager_->db_.get_table(view));
+}
+
+void MatViewMaintainer::add_view(TabMeta& view) {
+  auto& v = views_.emplace_back();
+  v.meta = &view;
+  v.fh = sm_manager_->get_fh(view.id);
+  v.ih = sm_manager_->get_ih(view.get_index_meta(view.mat_view_group_cols()).id);
+  context_->lock_mgr_->lock_exclusive_on_table(context_->txn_, v.fh->GetFd());
+  for (size_t i = 0; i < view.mat_view.cols.size(); ++i) {
+    auto& col = view.mat_view.cols[i];
+    auto src = std::find_if(base_.cols.begin(), base_.cols.end(),
+                            [&](const ColMeta& base_col) { return base_col.name == col.src_col; });
+    v.src.push_back(src == base_.cols.end() ? nullptr : &*src);
+    if (col.agg_type == AGG_COL) {
+      v.key_cols.push_back(static_cast<int>(i));
+      v.key_len += view.cols[i].len;
+    }
+  }
+}
+
+void MatViewMaintainer::make_key(const View& view, const char* record,
+                                 std::string* key) const {
+  key->resize(view.key_len);
+  size_t offset = 0;
+  for (int i : view.key_cols) {
+    memcpy(key->data() + offset, record + view.src[i]->offset, view.src[i]->len);
+    offset += view.src[i]->len;
+  }
+}
+
+void MatViewMaintainer::add(const char* record, int sign) {
+  std::string key;
+  for (auto& view : views_) {
+    make_key(view, record, &key);
+    auto [it, is_new] = view.groups.try_emplace(key);
+    auto& delta = it->second;
+    auto& cols = view.meta->cols;
+    if (is_new) {
+      delta.row.assign(view.fh->get_file_hdr().record_size, 0);
+      delta.deleted.assign(delta.row.size(), 0);
+      for (int i : view.key_cols) {
+        memcpy(delta.row.data() + cols[i].offset, record + view.src[i]->offset,
+               cols[i].len);
+      }
+    }
+    delta.count += sign;
+    for (size_t i = 0; i < cols.size(); ++i) {
+      AggType agg_type = view.meta->mat_view.cols[i].agg_type;
+      const char* value = view.src[i] == nullptr ? nullptr : record + view.src[i]->offset;
+      if (agg_type == AGG_SUM) {
+        add_value(delta.row.data() + cols[i].offset, value, cols[i].type, sign);
+      } else if ((agg_type == AGG_MIN || agg_type == AGG_MAX) && sign > 0) {
+        fold_extreme(agg_type, cols[i], delta.row.data() + cols[i].offset, value,
+                     !delta.inserted);
+      } else if (agg_type == AGG_MIN || agg_type == AGG_MAX) {
+        fold_extreme(agg_type, cols[i], delta.deleted.data() + cols[i].offset, value,
+                     !delta.has_deleted);
+      }
+    }
+    if (sign > 0) {
+      delta.inserted = true;
+    } else {
+      delta.has_deleted = true;
+    }
+  }
+}
+
+void MatViewMaintainer::apply() {
+  std::vector<Rid> rids;
+  for (auto& view : views_) {
+    auto& cols = view.meta->cols;
+    auto& def = view.meta->mat_view.cols;
+    std::vector<PendingRow> recompute;
+    size_t changed = 0;
+    for (auto& [key, delta] : view.groups) {
+      rids.clear();
+      if (!view.ih->get_value(key.data(), &rids, context_->txn_)) {
+        if (delta.count < 0) {
+          throw InternalError("Materialized view " + view.meta->name + " is out of date");
+        }
+        if (delta.count == 0) {
+          continue;
+        }
+        for (size_t i = 0; i < cols.size(); ++i) {
+          if (def[i].agg_type == AGG_COUNT) {
+            memcpy(delta.row.data() + cols[i].offset, &delta.count, sizeof(int));
+          }
+        }
+        insert_row(view, key, delta.row.data());
+        ++changed;
+        continue;
+      }
+      PendingRow row{&key, rids.front(), view.fh->get_record(rids.front(), context_, RM_LOCK_TABLE), {}};
+      row.new_record = *row.old_record;
+      char* data = row.new_record.data;
+      int count = 0;
+      bool stale_extreme = false;
+      for (size_t i = 0; i < cols.size(); ++i) {
+        char* state = data + cols[i].offset;
+        switch (def[i].agg_type) {
+          case AGG_COUNT:
+            memcpy(&count, state, sizeof(int));
+            count += delta.count;
+            memcpy(state, &count, sizeof(int));
+            break;
+          case AGG_SUM:
+            add_value(state, delta.row.data() + cols[i].offset, cols[i].type, 1);
+            break;
+          case AGG_MIN:
+          case AGG_MAX:
+            // 删掉的值比视图中的极值更极端是不可能的，相等时这个极值可能已经不在了
+            if (delta.has_deleted &&
+                compare(delta.deleted.data() + cols[i].offset, state, cols[i].len,
+                        cols[i].type) == 0) {
+              stale_extreme = true;
+            } else if (delta.inserted) {
+              fold_extreme(def[i].agg_type, cols[i], state,
+                           delta.row.data() + cols[i].offset, false);
+            }
+            break;
+          default:
+            break;
+        }
+      }
+      if (count < 0) {
+        throw InternalError("Materialized view " + view.meta->name + " is out of date");
+      }
+      ++changed;
+      if (count == 0) {
+        delete_row(view, key, row.rid, *row.old_record);
+      } else if (stale_extreme) {
+        recompute.push_back(std::move(row));
+      } else {
+        update_row(view, row);
+      }
+    }
+    if (!recompute.empty()) {
+      recompute_extremes(view, recompute);
+      for (auto& row : recompute) {
+        update_row(view, row);
+      }
+    }
+    view.groups.clear();
+    view.fh->note_rows_modified(changed);
+  }
+}
+
+void MatViewMaintainer::recompute_extremes(View& view, std::vector<PendingRow>& rows) {
+  auto& cols = view.meta->cols;
+  auto& def = view.meta->mat_view.cols;
+  std::unordered_map<std::string, std::pair<PendingRow*, bool>> by_key;  // 分组 -> （行，已经有值）
+  for (auto& row : rows) {
+    by_key.emplace(*row.key, std::make_pair(&row, false));
+  }
+  // 其他写这个基表的事务都在视图的表 X 锁上等待，基表中的记录就是本事务看到的记录，不用再加锁
+  std::string key;
+  for (RmScan scan(base_fh_); !scan.is_end(); scan.next()) {
+    auto record = base_fh_->get_record(scan.rid(), context_, RM_LOCK_TABLE);
+    make_key(view, record->data, &key);
+    auto it = by_key.find(key);
+    if (it == by_key.end()) {
+      continue;
+    }
+    auto& [row, has_value] = it->second;
+    for (size_t i = 0; i < cols.size(); ++i) {
+      if (def[i].agg_type == AGG_MIN || def[i].agg_type == AGG_MAX) {
+        fold_extreme(def[i].agg_type, cols[i], row->new_record.data + cols[i].offset,
+                     record->data + view.src[i]->offset, !has_value);
+      }
+    }
+    has_value = true;
+  }
+}
+
+void MatViewMaintainer::insert_row(View& view, const std::string& key, char* row) {
+  Rid rid = view.fh->insert_record(row, context_);
+  view.ih->insert_entry(key.data(), rid, context_->txn_);
+  RmRecord record(view.fh->get_file_hdr().record_size, row);
+  context_->txn_->append_write_record(
+      new WriteRecord(WType::INSERT_TUPLE, rid, record, view.meta->name, view.meta->id));
+}
+
+void MatViewMaintainer::update_row(View& view, PendingRow& row) {
+  Rid new_rid = view.fh->update_record(row.rid, row.new_record.data, context_);
+  // 变长格式中记录被移到了其他页面
+  if (new_rid != row.rid) {
+    view.ih->delete_entry(row.key->data(), context_->txn_);
+    view.ih->insert_entry(row.key->data(), new_rid, context_->txn_);
+  }
+  context_->txn_->append_write_record(new WriteRecord(WType::UPDATE_TUPLE, view.meta->name, new_rid,
+                                                      *row.old_record, row.new_record, false,
+                                                      view.meta->id));
+}
+
+void MatViewMaintainer::delete_row(View& view, const std::string& key, const Rid& rid,
+                                   const RmRecord& record) {
+  view.fh->save_version(rid, record, context_);
+  view.fh->delete_record(rid, context_, RM_LOCK_TABLE);
+  view.ih->delete_entry(key.data(), context_->txn_);
+  context_->txn_->append_write_record(
+      new WriteRecord(WType::DELETE_TUPLE, view.meta->name, rid, record, view.meta->id));
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "system/sm.h"
+
+/**
+ * @description: 增量维护一个基表上的聚合物化视图。写算子改完基表后，对插入的每条记录调用add(record, 1)，
+ * 删除的每条记录调用add(record, -1)，更新拆成删除旧记录和插入新记录；语句结束前调用apply。
+ * 同一个分组的增量先在内存中合并，apply时每个分组按视图的分组索引找到一行，只读写一次：COUNT和SUM加上增量，
+ * MIN/MAX和插入的值比较，COUNT减到0时删除这一行。删除的值正好是视图中的MIN/MAX时从基表重新计算，
+ * 一次apply最多扫描一次基表。视图的修改和普通的写操作一样记日志、进入事务的写集，回滚时一起撤销
+ */
+class MatViewMaintainer {
+ public:
+  // 维护base上的所有物化视图。changed_cols不为nullptr时只维护用到了其中某个字段的视图，UPDATE没有改到的视图不用动。
+  // 视图上加表 X 锁：视图的一行汇总了一个分组的所有记录，写同一个基表的事务在视图上排队
+  MatViewMaintainer(SmManager* sm_manager, const TabMeta& base, Context* context,
+                    const std::vector<std::string>* changed_cols = nullptr);
+
+  // 只维护view，建视图时用它填入基表中已有的记录
+  MatViewMaintainer(SmManager* sm_manager, const TabMeta& base, const std::string& view, Context* context);
+
+  bool empty() const { return views_.empty(); }
+
+  // record是基表的记录，sign为1时插入，为-1时删除
+  void add(const char* record, int sign);
+
+  // 把攒下的增量写入视图，之后还可以继续add
+  void apply();
+
+ private:
+  // 一个分组在这次apply之前攒下的增量
+  struct GroupDelta {
+    int count = 0;
+    // 视图记录的格式：分组字段取自基表记录，SUM是和的增量，MIN/MAX是插入的值中的极值
+    std::vector<char> row;
+    bool inserted = false;  // row中已经有插入的值
+    // 删除的值中的极值，格式同row，用来判断视图中的MIN/MAX有没有被删掉
+    std::vector<char> deleted;
+    bool has_deleted = false;
+  };
+
+  // 写回视图之前的一行：MIN/MAX需要重新计算的行先攒下来，扫描基表之后再写
+  struct PendingRow {
+    const std::string* key;
+    Rid rid;
+    std::unique_ptr<RmRecord> old_record;
+    RmRecord new_record;
+  };
+
+  struct View {
+    TabMeta* meta;
+    RmFileHandle* fh;
+    IxIndexHandle* ih;
+    std::vector<int> key_cols;  // 分组字段在视图中的下标，依次拼成分组索引的key
+    int key_len = 0;
+    std::vector<const ColMeta*> src;  // 和视图的字段一一对应，基表中的源字段，COUNT(*)为nullptr
+    std::unordered_map<std::string, GroupDelta> groups;  // 分组索引的key -> 增量
+  };
+
+  void add_view(TabMeta& view);
+
+  // 从基表记录中取出view的分组索引的key
+  void make_key(const View& view, const char* record, std::string* key) const;
+
+  // 扫描一次基表，重新计算rows中每一行的MIN/MAX
+  void recompute_extremes(View& view, std::vector<PendingRow>& rows);
+
+  void insert_row(View& view, const std::string& key, char* row);
+  void update_row(View& view, PendingRow& row);
+  void delete_row(View& view, const std::string& key, const Rid& rid, const RmRecord& record);
+
+  SmManager* sm_manager_;
+  const TabMeta& base_;
+  RmFileHandle* base_fh_;
+  Context* context_;
+  std::vector<View> views_;
+};
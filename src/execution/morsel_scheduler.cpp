@@ -0,0 +1,156 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "morsel_scheduler.h"
+
+#include <algorithm>
+
+#include "common/config.h"
+
+MorselScheduler& MorselScheduler::instance() {
+  static MorselScheduler scheduler(
+      static_cast<size_t>(std::max(MORSEL_WORKER_THREADS, 0)));
+  return scheduler;
+}
+
+MorselScheduler::MorselScheduler(size_t num_threads) {
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this, i] { worker_loop(i); });
+  }
+}
+
+MorselScheduler::~MorselScheduler() {
+  {
+    std::lock_guard lock(latch_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+MorselScheduler::Job::Job(const MorselFn* f, size_t num_morsels,
+                          size_t num_workers)
+    : fn(f), ranges(num_workers), remaining(num_morsels) {
+  for (size_t w = 0; w < num_workers; ++w) {
+    ranges[w].begin = num_morsels * w / num_workers;
+    ranges[w].end = num_morsels * (w + 1) / num_workers;
+  }
+}
+
+bool MorselScheduler::Job::pop(size_t worker, size_t* morsel) {
+  auto& range = ranges[worker];
+  std::lock_guard lock(range.latch);
+  if (range.begin == range.end) {
+    return false;
+  }
+  *morsel = range.begin++;
+  return true;
+}
+
+bool MorselScheduler::Job::steal(size_t worker, size_t* morsel) {
+  size_t n = ranges.size();
+  for (size_t i = 1; i < n; ++i) {
+    auto& victim = ranges[(worker + i) % n];
+    size_t begin, end;
+    {
+      std::lock_guard lock(victim.latch);
+      if (victim.begin == victim.end) {
+        continue;
+      }
+      end = victim.end;
+      begin = end - (end - victim.begin + 1) / 2;
+      victim.end = begin;
+    }
+    *morsel = begin;
+    if (begin + 1 < end) {
+      auto& own = ranges[worker];
+      std::lock_guard lock(own.latch);
+      own.begin = begin + 1;
+      own.end = end;
+    }
+    return true;
+  }
+  return false;
+}
+
+void MorselScheduler::execute(Job& job, size_t worker) {
+  size_t morsel;
+  while (job.pop(worker, &morsel) || job.steal(worker, &morsel)) {
+    bool failed;
+    {
+      std::lock_guard lock(job.latch);
+      failed = job.error != nullptr;
+    }
+    if (!failed) {
+      try {
+        (*job.fn)(morsel, worker);
+      } catch (...) {
+        std::lock_guard lock(job.latch);
+        if (job.error == nullptr) {
+          job.error = std::current_exception();
+        }
+      }
+    }
+    std::lock_guard lock(job.latch);
+    if (--job.remaining == 0) {
+      job.done.notify_all();
+    }
+  }
+}
+
+void MorselScheduler::worker_loop(size_t worker) {
+  std::unique_lock lock(latch_);
+  while (true) {
+    cv_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+    if (stop_) {
+      return;
+    }
+    auto job = jobs_.front();
+    lock.unlock();
+    execute(*job, worker);
+    lock.lock();
+    // 任务中已经没有可以取的morsel，不再分给其他工作线程
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end()) {
+      jobs_.erase(it);
+    }
+  }
+}
+
+void MorselScheduler::run(size_t num_morsels, const MorselFn& fn) {
+  size_t self = threads_.size();
+  if (threads_.empty() || num_morsels <= 1) {
+    for (size_t m = 0; m < num_morsels; ++m) {
+      fn(m, self);
+    }
+    return;
+  }
+  auto job = std::make_shared<Job>(&fn, num_morsels, num_workers());
+  {
+    std::lock_guard lock(latch_);
+    jobs_.push_back(job);
+  }
+  cv_.notify_all();
+  execute(*job, self);
+  {
+    std::lock_guard lock(latch_);
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end()) {
+      jobs_.erase(it);
+    }
+  }
+  std::unique_lock lock(job->latch);
+  job->done.wait(lock, [&] { return job->remaining == 0; });
+  if (job->error != nullptr) {
+    std::rethrow_exception(job->error);
+  }
+}
@@ -0,0 +1,87 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @description: morsel驱动的并行调度器。整个进程共享一组工作线程，一个任务被切成若干morsel
+ * （例如表中连续的MORSEL_PAGES个页面），每个morsel上跑完整的一段流水线（扫描、过滤、投影、局部聚合等）。
+ * 提交任务时morsel按编号平均分给各个参与者，参与者从自己的区间头部取，取完后从其他参与者的区间尾部偷一半。
+ * 提交任务的线程也作为一个参与者执行morsel，工作线程都在忙其他任务时任务也能完成
+ */
+class MorselScheduler {
+ public:
+  // morsel函数：fn(morsel, worker)，worker是参与者编号，小于num_workers()，同一时刻不会有两个morsel使用同一个编号
+  using MorselFn = std::function<void(size_t, size_t)>;
+
+  // 进程中共享的调度器，第一次使用时启动MORSEL_WORKER_THREADS个工作线程
+  static MorselScheduler& instance();
+
+  explicit MorselScheduler(size_t num_threads);
+
+  ~MorselScheduler();
+
+  MorselScheduler(const MorselScheduler&) = delete;
+  MorselScheduler& operator=(const MorselScheduler&) = delete;
+
+  // 参与者个数：工作线程加上提交任务的线程
+  size_t num_workers() const { return threads_.size() + 1; }
+
+  /**
+   * @description: 并行执行[0, num_morsels)中的所有morsel，全部完成后返回。
+   * 某个morsel抛出异常时跳过还没有开始的morsel，返回前在调用线程中重新抛出第一个异常
+   */
+  void run(size_t num_morsels, const MorselFn& fn);
+
+ private:
+  // 一个参与者还没有执行的morsel：[begin, end)，自己从头部取，其他参与者从尾部偷
+  struct Range {
+    std::mutex latch;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  struct Job {
+    const MorselFn* fn;
+    std::vector<Range> ranges;  // 下标是参与者编号
+    size_t remaining;           // 还没有完成的morsel数
+    std::exception_ptr error;
+    std::mutex latch;  // 保护remaining和error
+    std::condition_variable done;
+
+    Job(const MorselFn* f, size_t num_morsels, size_t num_workers);
+
+    // 从worker自己的区间取一个morsel
+    bool pop(size_t worker, size_t* morsel);
+
+    // 从其他参与者的区间尾部偷一半放到worker的区间中，再取一个
+    bool steal(size_t worker, size_t* morsel);
+  };
+
+  // worker不断取得morsel并执行，直到任务中没有可以取的morsel
+  void execute(Job& job, size_t worker);
+
+  void worker_loop(size_t worker);
+
+  std::vector<std::thread> threads_;
+  std::mutex latch_;  // 保护jobs_和stop_
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<Job>> jobs_;  // 还有morsel没有被取走的任务
+  bool stop_ = false;
+};
@@ -0,0 +1,91 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "record/rm_defs.h"
+#include "system/sm_meta.h"
+
+/**
+ * @description: 扫描的投影下推。查询只用到表中的部分字段时，扫描输出只含这些字段的窄记录，
+ * 字段按在表中的顺序紧挨着存放，cols()给出重新计算过偏移的字段元数据（col_id、字段名和表名不变，上层照常按它们查找）；
+ * 连接、排序、去重搬动和落盘的都是窄记录。扫描自己的条件仍然在整条记录上计算，只在交给上层时投影
+ */
+class ScanProjection {
+ public:
+  /**
+   * @param {vector<ColMeta>&} out_cols 输出的字段，偏移是窄记录中的偏移，由优化器算好；为空时不投影，输出整条记录
+   */
+  void init(const std::vector<ColMeta>& out_cols, TabMeta& tab) {
+    segs_.clear();
+    if (out_cols.empty()) {
+      cols_ = tab.cols;
+      len_ = cols_.back().offset + cols_.back().len;
+      return;
+    }
+    cols_ = out_cols;
+    for (auto& col : cols_) {
+      int src = tab.get_col(col.name)->offset;
+      // 在两边都连续的字段合并成一段
+      if (!segs_.empty() && segs_.back().src + segs_.back().len == src &&
+          segs_.back().dest + segs_.back().len == col.offset) {
+        segs_.back().len += col.len;
+      } else {
+        segs_.push_back({src, col.offset, col.len});
+      }
+    }
+    len_ = cols_.back().offset + cols_.back().len;
+    record_ = std::make_unique<RmRecord>(len_);
+  }
+
+  bool active() const { return !segs_.empty(); }
+
+  const std::vector<ColMeta>& cols() const { return cols_; }
+
+  size_t len() const { return len_; }
+
+  // 把整条记录src投影到内部的缓冲区中，下次投影前有效；不投影时直接返回src
+  const RmRecord* project(const RmRecord* src) {
+    if (!active()) {
+      return src;
+    }
+    for (auto& seg : segs_) {
+      memcpy(record_->data + seg.dest, src->data + seg.src, seg.len);
+    }
+    return record_.get();
+  }
+
+  // 把整条记录src投影到dest（至少len()字节），不投影时拷贝整条记录
+  void project_into(const char* src, char* dest) const {
+    if (!active()) {
+      memcpy(dest, src, len_);
+      return;
+    }
+    for (auto& seg : segs_) {
+      memcpy(dest + seg.dest, src + seg.src, seg.len);
+    }
+  }
+
+ private:
+  struct Segment {
+    int src;   // 在整条记录中的偏移
+    int dest;  // 在窄记录中的偏移
+    int len;
+  };
+
+  std::vector<ColMeta> cols_;
+  size_t len_ = 0;
+  std::vector<Segment> segs_;
+  std::unique_ptr<RmRecord> record_;
+};
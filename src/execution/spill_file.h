@@ -0,0 +1,107 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "common/config.h"
+#include "errors.h"
+
+/**
+ * @description: 算子溢出用的临时文件，排序的run、哈希连接和聚合的分区都用它。
+ * 建立在当前目录（数据库目录）下，创建后立即unlink，关闭时由文件系统回收，服务崩溃也不会残留。
+ * 只能在末尾追加，追加的数据先攒在写缓冲区中，读之前要finish()
+ */
+class SpillFile {
+ public:
+  explicit SpillFile(size_t buffer_size = SPILL_IO_BUFFER)
+      : buffer_size_(buffer_size) {
+    char path[] = "spill_XXXXXX";
+    fd_ = mkstemp(path);
+    if (fd_ == -1) {
+      throw UnixError();
+    }
+    unlink(path);
+  }
+
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  SpillFile(SpillFile&& other) noexcept
+      : fd_(std::exchange(other.fd_, -1)),
+        buffer_size_(other.buffer_size_),
+        buf_(std::move(other.buf_)),
+        size_(other.size_) {}
+
+  SpillFile& operator=(SpillFile&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    std::swap(buffer_size_, other.buffer_size_);
+    std::swap(buf_, other.buf_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~SpillFile() {
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  void append(const char* data, size_t len) {
+    buf_.insert(buf_.end(), data, data + len);
+    size_ += len;
+    if (buf_.size() >= buffer_size_) {
+      finish();
+    }
+  }
+
+  // 把写缓冲区中的数据写到文件中
+  void finish() {
+    const char* data = buf_.data();
+    size_t len = buf_.size();
+    while (len > 0) {
+      ssize_t n = write(fd_, data, len);
+      if (n < 0) {
+        throw UnixError();
+      }
+      data += n;
+      len -= n;
+    }
+    buf_.clear();
+  }
+
+  // 从offset处读出len字节
+  void read(char* data, size_t len, size_t offset) const {
+    while (len > 0) {
+      ssize_t n = pread(fd_, data, len, static_cast<off_t>(offset));
+      if (n <= 0) {
+        throw UnixError();
+      }
+      data += n;
+      len -= n;
+      offset += n;
+    }
+  }
+
+  // 已经追加的字节数，包括还在写缓冲区中的
+  size_t size() const { return size_; }
+
+ private:
+  int fd_ = -1;
+  size_t buffer_size_;
+  std::vector<char> buf_;
+  size_t size_ = 0;
+};
@@ -0,0 +1,74 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+
+/**
+ * @description: 批量执行时算子之间传递的一批记录，行存：第i条记录在data_中偏移i*tuple_len_处。
+ * sel_是有效记录的下标（选择向量），筛选时只改写sel_而不移动记录。
+ * 数据归batch所有，在下一次reset之前一直有效，不依赖子算子的页面或缓冲区
+ */
+class TupleBatch {
+ public:
+  static constexpr size_t CAPACITY = 1024;
+
+  // 开始填充新的一批，每条记录tuple_len字节；缓冲区只在第一次或记录变长时重新分配
+  void reset(size_t tuple_len) {
+    tuple_len_ = tuple_len;
+    if (data_.size() < CAPACITY * tuple_len) {
+      data_.resize(CAPACITY * tuple_len);
+    }
+    rids_.clear();
+    sel_.clear();
+  }
+
+  bool full() const { return rids_.size() == CAPACITY; }
+
+  // 追加一条有效记录，返回它在缓冲区中的位置，由调用者写入tuple_len字节
+  char* append(const Rid& rid) {
+    size_t idx = rids_.size();
+    sel_.push_back(static_cast<uint16_t>(idx));
+    rids_.push_back(rid);
+    return data_.data() + idx * tuple_len_;
+  }
+
+  // 有效记录的数量
+  size_t size() const { return sel_.size(); }
+
+  size_t tuple_len() const { return tuple_len_; }
+
+  // 第i条有效记录
+  const char* row(size_t i) const {
+    return data_.data() + sel_[i] * tuple_len_;
+  }
+
+  const Rid& rid(size_t i) const { return rids_[sel_[i]]; }
+
+  // 只保留前n条有效记录，用于LIMIT
+  void truncate(size_t n) {
+    if (n < sel_.size()) {
+      sel_.resize(n);
+    }
+  }
+
+  // 选择向量，筛选算子可以原地改写，只能删去下标不能新增
+  std::vector<uint16_t>& sel() { return sel_; }
+
+ private:
+  size_t tuple_len_ = 0;
+  std::vector<char> data_;
+  std::vector<Rid> rids_;
+  std::vector<uint16_t> sel_;
+};
@@ -10,5 +10,6 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include "ix_bulk_loader.h"
 #include "ix_manager.h"
 #include "ix_scan.h"
@@ -0,0 +1,562 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "ix_art_index.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+
+#include "transaction/txn_defs.h"
+
+IxArtIndex::IxArtIndex(int key_len) : key_len_(key_len) {}
+
+IxArtIndex::~IxArtIndex() { free_tree(root_); }
+
+IxArtIndex::Leaf* IxArtIndex::make_leaf(const uint8_t* key,
+                                        const Rid& rid) const {
+  auto* leaf = static_cast<Leaf*>(
+      ::operator new(offsetof(Leaf, key) + static_cast<size_t>(key_len_)));
+  leaf->rid = rid;
+  memcpy(leaf->key, key, key_len_);
+  return leaf;
+}
+
+void IxArtIndex::free_leaf(Leaf* leaf) const { ::operator delete(leaf); }
+
+void IxArtIndex::free_tree(Node* node) {
+  if (node == nullptr) {
+    return;
+  }
+  if (is_leaf(node)) {
+    free_leaf(as_leaf(node));
+    return;
+  }
+  for_each_child(node, 0, [this](uint8_t, Node* child) {
+    free_tree(child);
+    return true;
+  });
+  switch (node->type) {
+    case NODE4:
+      delete static_cast<Node4*>(node);
+      break;
+    case NODE16:
+      delete static_cast<Node16*>(node);
+      break;
+    case NODE48:
+      delete static_cast<Node48*>(node);
+      break;
+    case NODE256:
+      delete static_cast<Node256*>(node);
+      break;
+  }
+}
+
+const IxArtIndex::Leaf* IxArtIndex::min_leaf(const Node* node) {
+  while (!is_leaf(node)) {
+    for_each_child(node, 0, [&node](uint8_t, Node* child) {
+      node = child;
+      return false;
+    });
+  }
+  return as_leaf(node);
+}
+
+uint32_t IxArtIndex::prefix_mismatch(const Node* node, const uint8_t* key,
+                                     uint32_t depth) const {
+  uint32_t stored = std::min<uint32_t>(node->prefix_len, IX_ART_PREFIX);
+  for (uint32_t i = 0; i < stored; ++i) {
+    if (node->prefix[i] != key[depth + i]) {
+      return i;
+    }
+  }
+  if (node->prefix_len > IX_ART_PREFIX) {
+    const uint8_t* full = min_leaf(node)->key + depth;
+    for (uint32_t i = IX_ART_PREFIX; i < node->prefix_len; ++i) {
+      if (full[i] != key[depth + i]) {
+        return i;
+      }
+    }
+  }
+  return node->prefix_len;
+}
+
+IxArtIndex::Node** IxArtIndex::find_child(Node* node, uint8_t byte) {
+  switch (node->type) {
+    case NODE4: {
+      auto* n = static_cast<Node4*>(node);
+      for (int i = 0; i < n->count; ++i) {
+        if (n->keys[i] == byte) {
+          return &n->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case NODE16: {
+      auto* n = static_cast<Node16*>(node);
+      for (int i = 0; i < n->count; ++i) {
+        if (n->keys[i] == byte) {
+          return &n->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case NODE48: {
+      auto* n = static_cast<Node48*>(node);
+      return n->index[byte] == 0 ? nullptr : &n->children[n->index[byte] - 1];
+    }
+    case NODE256: {
+      auto* n = static_cast<Node256*>(node);
+      return n->children[byte] == nullptr ? nullptr : &n->children[byte];
+    }
+  }
+  return nullptr;
+}
+
+template <typename F>
+bool IxArtIndex::for_each_child(const Node* node, uint8_t from, F&& visit) {
+  switch (node->type) {
+    case NODE4: {
+      auto* n = static_cast<const Node4*>(node);
+      for (int i = 0; i < n->count; ++i) {
+        if (n->keys[i] >= from && !visit(n->keys[i], n->children[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case NODE16: {
+      auto* n = static_cast<const Node16*>(node);
+      for (int i = 0; i < n->count; ++i) {
+        if (n->keys[i] >= from && !visit(n->keys[i], n->children[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case NODE48: {
+      auto* n = static_cast<const Node48*>(node);
+      for (int b = from; b < 256; ++b) {
+        if (n->index[b] != 0 &&
+            !visit(static_cast<uint8_t>(b), n->children[n->index[b] - 1])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case NODE256: {
+      auto* n = static_cast<const Node256*>(node);
+      for (int b = from; b < 256; ++b) {
+        if (n->children[b] != nullptr &&
+            !visit(static_cast<uint8_t>(b), n->children[b])) {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  return true;
+}
+
+void IxArtIndex::copy_header(Node* dest, const Node* src) {
+  dest->count = src->count;
+  dest->prefix_len = src->prefix_len;
+  memcpy(dest->prefix, src->prefix, IX_ART_PREFIX);
+}
+
+void IxArtIndex::add_child(Node** ref, Node* node, uint8_t byte, Node* child) {
+  switch (node->type) {
+    case NODE4: {
+      auto* n = static_cast<Node4*>(node);
+      if (n->count < 4) {
+        int pos = 0;
+        while (pos < n->count && n->keys[pos] < byte) {
+          ++pos;
+        }
+        memmove(n->keys + pos + 1, n->keys + pos, n->count - pos);
+        memmove(n->children + pos + 1, n->children + pos,
+                (n->count - pos) * sizeof(Node*));
+        n->keys[pos] = byte;
+        n->children[pos] = child;
+        ++n->count;
+        return;
+      }
+      auto* bigger = new Node16();
+      copy_header(bigger, n);
+      memcpy(bigger->keys, n->keys, 4);
+      memcpy(bigger->children, n->children, 4 * sizeof(Node*));
+      *ref = bigger;
+      delete n;
+      add_child(ref, bigger, byte, child);
+      return;
+    }
+    case NODE16: {
+      auto* n = static_cast<Node16*>(node);
+      if (n->count < 16) {
+        int pos = 0;
+        while (pos < n->count && n->keys[pos] < byte) {
+          ++pos;
+        }
+        memmove(n->keys + pos + 1, n->keys + pos, n->count - pos);
+        memmove(n->children + pos + 1, n->children + pos,
+                (n->count - pos) * sizeof(Node*));
+        n->keys[pos] = byte;
+        n->children[pos] = child;
+        ++n->count;
+        return;
+      }
+      auto* bigger = new Node48();
+      copy_header(bigger, n);
+      for (int i = 0; i < 16; ++i) {
+        bigger->children[i] = n->children[i];
+        bigger->index[n->keys[i]] = static_cast<uint8_t>(i + 1);
+      }
+      *ref = bigger;
+      delete n;
+      add_child(ref, bigger, byte, child);
+      return;
+    }
+    case NODE48: {
+      auto* n = static_cast<Node48*>(node);
+      if (n->count < 48) {
+        // 删除孩子时把最后一个挪到空位上，children的前count个总是占满的
+        n->children[n->count] = child;
+        n->index[byte] = static_cast<uint8_t>(++n->count);
+        return;
+      }
+      auto* bigger = new Node256();
+      copy_header(bigger, n);
+      for (int b = 0; b < 256; ++b) {
+        if (n->index[b] != 0) {
+          bigger->children[b] = n->children[n->index[b] - 1];
+        }
+      }
+      *ref = bigger;
+      delete n;
+      add_child(ref, bigger, byte, child);
+      return;
+    }
+    case NODE256: {
+      auto* n = static_cast<Node256*>(node);
+      n->children[byte] = child;
+      ++n->count;
+      return;
+    }
+  }
+}
+
+void IxArtIndex::remove_child(Node** ref, Node* node, uint8_t byte) {
+  switch (node->type) {
+    case NODE4: {
+      auto* n = static_cast<Node4*>(node);
+      int pos = 0;
+      while (n->keys[pos] != byte) {
+        ++pos;
+      }
+      memmove(n->keys + pos, n->keys + pos + 1, n->count - pos - 1);
+      memmove(n->children + pos, n->children + pos + 1,
+              (n->count - pos - 1) * sizeof(Node*));
+      --n->count;
+      if (n->count > 1) {
+        return;
+      }
+      // 只剩一个孩子：结点的前缀、孩子的字节和孩子的前缀连成孩子的新前缀
+      Node* child = n->children[0];
+      if (!is_leaf(child)) {
+        uint8_t prefix[IX_ART_PREFIX];
+        uint32_t len = std::min<uint32_t>(n->prefix_len, IX_ART_PREFIX);
+        memcpy(prefix, n->prefix, len);
+        if (len < IX_ART_PREFIX) {
+          prefix[len++] = n->keys[0];
+        }
+        uint32_t rest = std::min<uint32_t>(child->prefix_len, IX_ART_PREFIX - len);
+        memcpy(prefix + len, child->prefix, rest);
+        memcpy(child->prefix, prefix, len + rest);
+        child->prefix_len += n->prefix_len + 1;
+      }
+      *ref = child;
+      delete n;
+      return;
+    }
+    case NODE16: {
+      auto* n = static_cast<Node16*>(node);
+      int pos = 0;
+      while (n->keys[pos] != byte) {
+        ++pos;
+      }
+      memmove(n->keys + pos, n->keys + pos + 1, n->count - pos - 1);
+      memmove(n->children + pos, n->children + pos + 1,
+              (n->count - pos - 1) * sizeof(Node*));
+      --n->count;
+      if (n->count > 3) {
+        return;
+      }
+      auto* smaller = new Node4();
+      copy_header(smaller, n);
+      memcpy(smaller->keys, n->keys, n->count);
+      memcpy(smaller->children, n->children, n->count * sizeof(Node*));
+      *ref = smaller;
+      delete n;
+      return;
+    }
+    case NODE48: {
+      auto* n = static_cast<Node48*>(node);
+      int pos = n->index[byte] - 1;
+      n->index[byte] = 0;
+      --n->count;
+      // 最后一个孩子挪到空出的位置
+      if (pos != n->count) {
+        n->children[pos] = n->children[n->count];
+        for (int b = 0; b < 256; ++b) {
+          if (n->index[b] == n->count + 1) {
+            n->index[b] = static_cast<uint8_t>(pos + 1);
+            break;
+          }
+        }
+      }
+      n->children[n->count] = nullptr;
+      if (n->count > 12) {
+        return;
+      }
+      auto* smaller = new Node16();
+      copy_header(smaller, n);
+      int i = 0;
+      for (int b = 0; b < 256; ++b) {
+        if (n->index[b] != 0) {
+          smaller->keys[i] = static_cast<uint8_t>(b);
+          smaller->children[i++] = n->children[n->index[b] - 1];
+        }
+      }
+      *ref = smaller;
+      delete n;
+      return;
+    }
+    case NODE256: {
+      auto* n = static_cast<Node256*>(node);
+      n->children[byte] = nullptr;
+      --n->count;
+      if (n->count > 37) {
+        return;
+      }
+      auto* smaller = new Node48();
+      copy_header(smaller, n);
+      int i = 0;
+      for (int b = 0; b < 256; ++b) {
+        if (n->children[b] != nullptr) {
+          smaller->children[i] = n->children[b];
+          smaller->index[b] = static_cast<uint8_t>(++i);
+        }
+      }
+      *ref = smaller;
+      delete n;
+      return;
+    }
+  }
+}
+
+bool IxArtIndex::insert(Node** ref, const uint8_t* key, uint32_t depth,
+                        Leaf* leaf) {
+  Node* node = *ref;
+  if (node == nullptr) {
+    *ref = tag_leaf(leaf);
+    return true;
+  }
+  if (is_leaf(node)) {
+    const uint8_t* old_key = as_leaf(node)->key;
+    if (memcmp(old_key, key, key_len_) == 0) {
+      return false;
+    }
+    // 两个key从depth开始的公共部分作为新结点的前缀，key定长，一定在某个字节上分开
+    uint32_t split = depth;
+    while (old_key[split] == key[split]) {
+      ++split;
+    }
+    auto* n = new Node4();
+    n->prefix_len = split - depth;
+    memcpy(n->prefix, key + depth, std::min<uint32_t>(n->prefix_len, IX_ART_PREFIX));
+    Node* inner = n;
+    add_child(&inner, n, old_key[split], node);
+    add_child(&inner, n, key[split], tag_leaf(leaf));
+    *ref = inner;
+    return true;
+  }
+  if (node->prefix_len > 0) {
+    uint32_t p = prefix_mismatch(node, key, depth);
+    if (p < node->prefix_len) {
+      // 前缀在p处分开：新的Node4取前p个字节，原结点留下p之后的部分
+      const uint8_t* full = node->prefix_len > IX_ART_PREFIX
+                                ? min_leaf(node)->key + depth
+                                : node->prefix;
+      uint8_t node_byte = full[p];
+      uint8_t rest[IX_ART_PREFIX];
+      uint32_t rest_len = node->prefix_len - p - 1;
+      memcpy(rest, full + p + 1, std::min<uint32_t>(rest_len, IX_ART_PREFIX));
+      auto* n = new Node4();
+      n->prefix_len = p;
+      memcpy(n->prefix, key + depth, std::min<uint32_t>(p, IX_ART_PREFIX));
+      node->prefix_len = rest_len;
+      memcpy(node->prefix, rest, std::min<uint32_t>(rest_len, IX_ART_PREFIX));
+      Node* inner = n;
+      add_child(&inner, n, node_byte, node);
+      add_child(&inner, n, key[depth + p], tag_leaf(leaf));
+      *ref = inner;
+      return true;
+    }
+    depth += node->prefix_len;
+  }
+  Node** child = find_child(node, key[depth]);
+  if (child != nullptr) {
+    return insert(child, key, depth + 1, leaf);
+  }
+  add_child(ref, node, key[depth], tag_leaf(leaf));
+  return true;
+}
+
+bool IxArtIndex::erase(Node** ref, const uint8_t* key, uint32_t depth) {
+  Node* node = *ref;
+  if (node == nullptr) {
+    return false;
+  }
+  if (is_leaf(node)) {
+    if (memcmp(as_leaf(node)->key, key, key_len_) != 0) {
+      return false;
+    }
+    free_leaf(as_leaf(node));
+    *ref = nullptr;
+    return true;
+  }
+  // 不检查前缀，到叶子时比较完整的key
+  depth += node->prefix_len;
+  Node** child = find_child(node, key[depth]);
+  if (child == nullptr) {
+    return false;
+  }
+  if (!is_leaf(*child)) {
+    return erase(child, key, depth + 1);
+  }
+  Leaf* leaf = as_leaf(*child);
+  if (memcmp(leaf->key, key, key_len_) != 0) {
+    return false;
+  }
+  free_leaf(leaf);
+  remove_child(ref, node, key[depth]);
+  return true;
+}
+
+template <typename F>
+bool IxArtIndex::walk(const Node* node, uint32_t depth, const uint8_t* lower,
+                      bool on_lower, F& visit) const {
+  if (is_leaf(node)) {
+    return visit(as_leaf(node), on_lower);
+  }
+  if (on_lower && node->prefix_len > 0) {
+    const uint8_t* full = node->prefix_len > IX_ART_PREFIX
+                              ? min_leaf(node)->key + depth
+                              : node->prefix;
+    int cmp = memcmp(full, lower + depth, node->prefix_len);
+    if (cmp < 0) {
+      return true;  // 整棵子树都小于lower
+    }
+    on_lower = cmp == 0;
+  }
+  depth += node->prefix_len;
+  uint8_t from = on_lower ? lower[depth] : 0;
+  return for_each_child(node, from, [&](uint8_t byte, Node* child) {
+    return walk(child, depth + 1, lower, on_lower && byte == from, visit);
+  });
+}
+
+bool IxArtIndex::get_value(const char* key, Rid* rid) {
+  std::shared_lock lock(latch_);
+  auto* k = reinterpret_cast<const uint8_t*>(key);
+  Node* node = root_;
+  uint32_t depth = 0;
+  // 路上不比较前缀，最后和叶子中完整的key比较
+  while (node != nullptr && !is_leaf(node)) {
+    depth += node->prefix_len;
+    Node** child = find_child(node, k[depth]);
+    node = child == nullptr ? nullptr : *child;
+    ++depth;
+  }
+  if (node == nullptr || memcmp(as_leaf(node)->key, k, key_len_) != 0) {
+    return false;
+  }
+  *rid = as_leaf(node)->rid;
+  return true;
+}
+
+bool IxArtIndex::insert_entry(const char* key, const Rid& rid) {
+  auto* k = reinterpret_cast<const uint8_t*>(key);
+  Leaf* leaf = make_leaf(k, rid);
+  std::unique_lock lock(latch_);
+  if (!insert(&root_, k, 0, leaf)) {
+    free_leaf(leaf);
+    return false;
+  }
+  return true;
+}
+
+bool IxArtIndex::delete_entry(const char* key) {
+  std::unique_lock lock(latch_);
+  return erase(&root_, reinterpret_cast<const uint8_t*>(key), 0);
+}
+
+bool IxArtIndex::is_empty() {
+  std::shared_lock lock(latch_);
+  return root_ == nullptr;
+}
+
+Rid IxArtIndex::scan(const char* lower, bool lower_inclusive,
+                     const char* upper, bool upper_inclusive,
+                     std::vector<Rid>* rids) {
+  std::shared_lock lock(latch_);
+  Rid next = GAP_SUPREMUM;
+  auto* lo = reinterpret_cast<const uint8_t*>(lower);
+  auto visit = [&](const Leaf* leaf, bool on_lower) {
+    if (on_lower) {
+      int cmp = memcmp(leaf->key, lo, key_len_);
+      if (cmp < 0 || (cmp == 0 && !lower_inclusive)) {
+        return true;
+      }
+    }
+    if (upper != nullptr) {
+      int cmp = memcmp(leaf->key, upper, key_len_);
+      if (cmp > 0 || (cmp == 0 && !upper_inclusive)) {
+        next = leaf->rid;
+        return false;
+      }
+    }
+    rids->push_back(leaf->rid);
+    return true;
+  };
+  if (root_ != nullptr) {
+    walk(root_, 0, lo, lo != nullptr, visit);
+  }
+  return next;
+}
+
+Rid IxArtIndex::next_rid(const char* key) {
+  std::shared_lock lock(latch_);
+  Rid next = GAP_SUPREMUM;
+  auto* k = reinterpret_cast<const uint8_t*>(key);
+  auto visit = [&](const Leaf* leaf, bool on_lower) {
+    if (on_lower && memcmp(leaf->key, k, key_len_) <= 0) {
+      return true;
+    }
+    next = leaf->rid;
+    return false;
+  };
+  if (root_ != nullptr) {
+    walk(root_, 0, k, true, visit);
+  }
+  return next;
+}
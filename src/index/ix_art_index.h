@@ -0,0 +1,155 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+#include "storage/rwlatch.h"
+
+/**
+ * @description: 自适应基数树（ART），只在内存中的索引，和B+树索引一样key不能重复。
+ * key是ix_encode_key编码后的定长字节串，按字节逐层分支，内部结点按孩子数取Node4、Node16、Node48、Node256四种大小，
+ * 路径压缩：只有一个孩子的路径合并到结点的前缀中，前缀只在结点中存前IX_ART_PREFIX个字节，更长时从子树的叶子中取。
+ * 叶子存完整的key和rid，编码后的key按memcmp有序，中序遍历就是key的顺序，支持区间扫描。
+ * 不经过缓冲池，也不写文件：打开数据库时从表中重建，崩溃后和B+树一样由恢复重建。
+ * 读操作持有latch_的读锁，插入删除持有写锁，没有B+树那样的逐层加锁
+ */
+class IxArtIndex {
+ public:
+  explicit IxArtIndex(int key_len);
+
+  ~IxArtIndex();
+
+  IxArtIndex(const IxArtIndex&) = delete;
+  IxArtIndex& operator=(const IxArtIndex&) = delete;
+
+  // 以下key都是ix_encode_key编码后的形式
+
+  bool get_value(const char* key, Rid* rid);
+
+  // key已经存在时不插入，返回false
+  bool insert_entry(const char* key, const Rid& rid);
+
+  bool delete_entry(const char* key);
+
+  bool is_empty();
+
+  /**
+   * 按key升序把区间中的rid追加到rids，lower或upper为nullptr表示这一侧没有边界。
+   * 返回区间之后第一个条目的rid，作为键区间锁的间隙；区间延伸到最后时返回GAP_SUPREMUM
+   */
+  Rid scan(const char* lower, bool lower_inclusive, const char* upper,
+           bool upper_inclusive, std::vector<Rid>* rids);
+
+  // 第一个大于key的条目的rid，没有时返回GAP_SUPREMUM
+  Rid next_rid(const char* key);
+
+ private:
+  static constexpr int IX_ART_PREFIX = 8;
+
+  enum NodeType : uint8_t { NODE4, NODE16, NODE48, NODE256 };
+
+  struct Node {
+    NodeType type;
+    uint16_t count = 0;       // 孩子数
+    uint32_t prefix_len = 0;  // 压缩的路径长度，只有前IX_ART_PREFIX个字节存在prefix中
+    uint8_t prefix[IX_ART_PREFIX];
+
+    explicit Node(NodeType t) : type(t) {}
+  };
+
+  // Node4和Node16的孩子按字节有序存放
+  struct Node4 : Node {
+    uint8_t keys[4];
+    Node* children[4];
+    Node4() : Node(NODE4) {}
+  };
+
+  struct Node16 : Node {
+    uint8_t keys[16];
+    Node* children[16];
+    Node16() : Node(NODE16) {}
+  };
+
+  // index[b]为字节b的孩子在children中的下标加一，0表示没有
+  struct Node48 : Node {
+    uint8_t index[256] = {};
+    Node* children[48] = {};
+    Node48() : Node(NODE48) {}
+  };
+
+  struct Node256 : Node {
+    Node* children[256] = {};
+    Node256() : Node(NODE256) {}
+  };
+
+  // 叶子的指针最低位置1，和内部结点区分；key紧跟在rid之后
+  struct Leaf {
+    Rid rid;
+    uint8_t key[1];
+  };
+
+  static bool is_leaf(const Node* node) {
+    return (reinterpret_cast<uintptr_t>(node) & 1) != 0;
+  }
+
+  static Leaf* as_leaf(const Node* node) {
+    return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(node) & ~uintptr_t{1});
+  }
+
+  static Node* tag_leaf(Leaf* leaf) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(leaf) | 1);
+  }
+
+  Leaf* make_leaf(const uint8_t* key, const Rid& rid) const;
+
+  void free_leaf(Leaf* leaf) const;
+
+  void free_tree(Node* node);
+
+  // 子树中key最小的叶子，用来取出超过IX_ART_PREFIX的前缀
+  static const Leaf* min_leaf(const Node* node);
+
+  // 结点前缀和key从depth开始的部分第一个不同的位置，全部相同时返回prefix_len
+  uint32_t prefix_mismatch(const Node* node, const uint8_t* key, uint32_t depth) const;
+
+  static Node** find_child(Node* node, uint8_t byte);
+
+  // 按字节升序访问字节不小于from的孩子，visit返回false时停止并返回false
+  template <typename F>
+  static bool for_each_child(const Node* node, uint8_t from, F&& visit);
+
+  // 加入孩子，结点满时换成大一号的结点并更新*ref
+  static void add_child(Node** ref, Node* node, uint8_t byte, Node* child);
+
+  // 去掉孩子，孩子太少时换成小一号的结点，Node4只剩一个孩子时把它和前缀合并后直接挂到*ref上
+  static void remove_child(Node** ref, Node* node, uint8_t byte);
+
+  static void copy_header(Node* dest, const Node* src);
+
+  bool insert(Node** ref, const uint8_t* key, uint32_t depth, Leaf* leaf);
+
+  bool erase(Node** ref, const uint8_t* key, uint32_t depth);
+
+  /**
+   * 按key升序遍历子树中的叶子。on_lower表示到这个结点为止的路径和lower相同，这时跳过小于lower的孩子；
+   * visit(leaf, on_lower)返回false时停止遍历并返回false
+   */
+  template <typename F>
+  bool walk(const Node* node, uint32_t depth, const uint8_t* lower, bool on_lower,
+            F& visit) const;
+
+  int key_len_;
+  Node* root_ = nullptr;
+  RWLatch latch_;
+};
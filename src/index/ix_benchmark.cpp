@@ -0,0 +1,181 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+/**
+ * 索引的微基准：在临时目录中建一个int列上的索引，依次测插入、点查、范围扫描和删除的吞吐。
+ * 用法：ix_benchmark [key数量] [seq|rand] [btree|hash]，默认100万个随机顺序的key、B+树索引
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "index/ix.h"
+#include "storage/buffer_pool_manager.h"
+#include "storage/disk_manager.h"
+
+namespace {
+
+class Timer {
+ public:
+  Timer() : start_(std::chrono::steady_clock::now()) {}
+
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start_)
+        .count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+void report(const char* name, size_t ops, double seconds) {
+  printf("%-12s %10zu ops %8.3f s %12.0f ops/s\n", name, ops, seconds,
+         seconds > 0 ? ops / seconds : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_keys = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  bool sequential = argc > 2 && std::string(argv[2]) == "seq";
+  IndexType index_type =
+      argc > 3 && std::string(argv[3]) == "hash" ? INDEX_HASH : INDEX_BTREE;
+
+  char dir_template[] = "/tmp/ix_benchmark_XXXXXX";
+  if (mkdtemp(dir_template) == nullptr || chdir(dir_template) != 0) {
+    perror("ix_benchmark");
+    return 1;
+  }
+
+  auto disk_manager = std::make_unique<DiskManager>();
+  auto buffer_pool_manager =
+      std::make_unique<BufferPoolManager>(BUFFER_POOL_SIZE, disk_manager.get());
+  auto ix_manager =
+      std::make_unique<IxManager>(disk_manager.get(), buffer_pool_manager.get());
+
+  const std::string ix_name = "bench.idx";
+  ColMeta col{.tab_name = "bench",
+              .name = "k",
+              .type = TYPE_INT,
+              .len = sizeof(int),
+              .offset = 0,
+              .index = true};
+  ix_manager->create_index(ix_name, {col}, index_type);
+  auto ih = ix_manager->open_index(ix_name);
+
+  std::vector<int> keys(num_keys);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937 rng(42);
+  if (!sequential) {
+    std::shuffle(keys.begin(), keys.end(), rng);
+  }
+
+  {
+    Timer timer;
+    for (int i = 0; i < num_keys; ++i) {
+      Rid rid{.page_no = i / 256, .slot_no = i % 256};
+      ih->insert_entry(reinterpret_cast<const char*>(&keys[i]), rid, nullptr);
+    }
+    report("insert", num_keys, timer.seconds());
+  }
+
+  // 点查按另一个随机顺序，避免沿用插入时留在缓存里的路径
+  std::shuffle(keys.begin(), keys.end(), rng);
+  {
+    Timer timer;
+    size_t found = 0;
+    std::vector<Rid> result;
+    for (int key : keys) {
+      result.clear();
+      found += ih->get_value(reinterpret_cast<const char*>(&key), &result,
+                             nullptr);
+    }
+    report("lookup", num_keys, timer.seconds());
+    if (found != keys.size()) {
+      fprintf(stderr, "lookup found %zu of %zu keys\n", found, keys.size());
+    }
+  }
+
+  // 批量点查：和索引连接一样每批交给get_values，一半的key不存在
+  {
+    constexpr int batch = 256;
+    std::vector<int> batch_keys(batch);
+    std::vector<const char*> key_ptrs(batch);
+    std::vector<std::optional<Rid>> result;
+    size_t found = 0;
+    size_t probes = 0;
+    Timer timer;
+    for (int i = 0; i + batch <= num_keys; i += batch) {
+      for (int j = 0; j < batch; ++j) {
+        batch_keys[j] = j % 2 == 0 ? keys[i + j] : num_keys + keys[i + j];
+        key_ptrs[j] = reinterpret_cast<const char*>(&batch_keys[j]);
+      }
+      ih->get_values(key_ptrs, &result, nullptr);
+      for (auto& rid : result) {
+        found += rid.has_value();
+      }
+      probes += batch;
+    }
+    report("batch lookup", probes, timer.seconds());
+    if (found != probes / 2) {
+      fprintf(stderr, "batch lookup found %zu of %zu keys\n", found,
+              probes / 2);
+    }
+  }
+
+  if (!ih->is_hash()) {
+    // 每次扫描100个连续的key
+    constexpr int scan_len = 100;
+    int num_scans = std::max(1, num_keys / scan_len / 10);
+    Timer timer;
+    size_t scanned = 0;
+    for (int i = 0; i < num_scans; ++i) {
+      int lower = static_cast<int>(rng() % std::max(1, num_keys - scan_len));
+      int upper = lower + scan_len;
+      IxScan scan(ih.get(), ih->lower_bound(reinterpret_cast<const char*>(&lower)),
+                  ih->lower_bound(reinterpret_cast<const char*>(&upper)),
+                  buffer_pool_manager.get());
+      // 按叶子整段取出rid
+      while (!scan.is_end()) {
+        const Rid* rids;
+        int n = scan.leaf_rids(&rids);
+        scanned += n;
+        scan.advance(std::max(n, 1));
+      }
+    }
+    report("range scan", scanned, timer.seconds());
+  }
+
+  std::shuffle(keys.begin(), keys.end(), rng);
+  {
+    Timer timer;
+    for (int key : keys) {
+      ih->delete_entry(reinterpret_cast<const char*>(&key), nullptr);
+    }
+    report("delete", num_keys, timer.seconds());
+  }
+
+  ix_manager->close_index(ih.get());
+  ih.reset();
+  ix_manager->destroy_index(ix_name);
+  if (chdir("..") == 0) {
+    rmdir(dir_template);
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "ix_bloom_filter.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string_view>
+
+#include "common/config.h"
+
+namespace {
+
+// 双重哈希：第i个位置为h1 + i * h2，h2取奇数保证和2的幂次的位数互素
+template <typename F>
+inline bool for_each_bit(uint64_t h, size_t mask, F&& f) {
+  uint64_t h1 = h;
+  uint64_t h2 = ((h >> 32) | (h << 32)) * 0x9E3779B97F4A7C15ULL | 1;
+  for (int i = 0; i < IX_BLOOM_NUM_HASHES; ++i) {
+    if (!f((h1 + i * h2) & mask)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+IxBloomFilter::Layer::Layer(size_t capacity) : capacity(capacity), num_keys(0) {
+  size_t num_bits = 64;
+  while (num_bits < capacity * IX_BLOOM_BITS_PER_KEY) {
+    num_bits <<= 1;
+  }
+  mask = num_bits - 1;
+  bits = std::make_unique<std::atomic<uint64_t>[]>(num_bits / 64);
+  for (size_t i = 0; i < num_bits / 64; ++i) {
+    bits[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+IxBloomFilter::IxBloomFilter(int key_len, size_t expected_keys)
+    : key_len_(key_len) {
+  layers_.push_back(std::make_unique<Layer>(
+      std::max(expected_keys, static_cast<size_t>(IX_BLOOM_INIT_KEYS))));
+}
+
+uint64_t IxBloomFilter::hash(const char* key) const {
+  return std::hash<std::string_view>{}(std::string_view(key, key_len_));
+}
+
+void IxBloomFilter::add(const char* key) {
+  uint64_t h = hash(key);
+  std::shared_lock lock(latch_);
+  Layer* layer = layers_.back().get();
+  if (layer->num_keys.load(std::memory_order_relaxed) >= layer->capacity) {
+    lock.unlock();
+    {
+      std::unique_lock grow(latch_);
+      if (layers_.back()->num_keys.load(std::memory_order_relaxed) >=
+          layers_.back()->capacity) {
+        layers_.push_back(
+            std::make_unique<Layer>(layers_.back()->capacity * 2));
+      }
+    }
+    lock.lock();
+    layer = layers_.back().get();
+  }
+  for_each_bit(h, layer->mask, [layer](uint64_t bit) {
+    layer->bits[bit / 64].fetch_or(1ULL << (bit % 64),
+                                   std::memory_order_relaxed);
+    return true;
+  });
+  layer->num_keys.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool IxBloomFilter::might_contain(const char* key) const {
+  uint64_t h = hash(key);
+  std::shared_lock lock(latch_);
+  for (auto& layer : layers_) {
+    Layer* l = layer.get();
+    if (for_each_bit(h, l->mask, [l](uint64_t bit) {
+          return (l->bits[bit / 64].load(std::memory_order_relaxed) >>
+                  (bit % 64)) & 1;
+        })) {
+      return true;
+    }
+  }
+  return false;
+}
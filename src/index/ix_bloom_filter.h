@@ -0,0 +1,48 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+/**
+ * @description: 内存中的布隆过滤器，插入前查重时先问它，回答不存在就不用查B+树。
+ * 只会误报不会漏报；删除不从过滤器中去掉key，被删除的key以后只是多一次误报。
+ * 一层装满后追加一层容量翻倍的，查询检查所有层，这样不用知道索引最终有多大。
+ * 不持久化，打开索引时扫描叶子重建
+ */
+class IxBloomFilter {
+ public:
+  // key都是ix_encode_key编码后的形式
+  IxBloomFilter(int key_len, size_t expected_keys);
+
+  void add(const char* key);
+
+  bool might_contain(const char* key) const;
+
+ private:
+  struct Layer {
+    explicit Layer(size_t capacity);
+
+    size_t capacity;              // 按IX_BLOOM_BITS_PER_KEY能放下的key数量
+    std::atomic<size_t> num_keys;
+    size_t mask;                  // 位数组的长度是2的幂，取下标用与
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;
+  };
+
+  uint64_t hash(const char* key) const;
+
+  int key_len_;
+  mutable std::shared_mutex latch_;  // 追加新层时持有写锁，其余持有读锁，位数组本身用原子操作
+  std::vector<std::unique_ptr<Layer>> layers_;
+};
@@ -0,0 +1,353 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "ix_bulk_loader.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+#include "errors.h"
+
+namespace {
+void write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      throw UnixError();
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+void pread_all(int fd, char* data, size_t len, off_t offset) {
+  while (len > 0) {
+    ssize_t n = pread(fd, data, len, offset);
+    if (n <= 0) {
+      throw UnixError();
+    }
+    data += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+inline int common_prefix_len(const char* a, const char* b, int len) {
+  int i = 0;
+  while (i < len && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+}  // namespace
+
+/* 一个排好序的临时文件，归并时分块读入 */
+struct IxBulkLoader::Run {
+  int fd = -1;
+  size_t num_entries = 0;  // 文件中的表项数
+  size_t next_entry = 0;   // 下一个要读入缓冲区的表项
+  std::vector<char> buf;
+  size_t buf_pos = 0;  // 以表项为单位
+  size_t buf_len = 0;
+
+  ~Run() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  const char* current(int entry_len) const {
+    return buf.data() + buf_pos * entry_len;
+  }
+
+  // 读入下一块，文件读完时返回false
+  bool refill(int entry_len) {
+    size_t capacity = std::max<size_t>(1, IX_BULK_MERGE_BUFFER / entry_len);
+    size_t n = std::min(capacity, num_entries - next_entry);
+    if (n == 0) {
+      return false;
+    }
+    buf.resize(n * entry_len);
+    pread_all(fd, buf.data(), n * entry_len,
+              static_cast<off_t>(next_entry * entry_len));
+    next_entry += n;
+    buf_pos = 0;
+    buf_len = n;
+    return true;
+  }
+
+  bool advance(int entry_len) {
+    return ++buf_pos < buf_len || refill(entry_len);
+  }
+};
+
+IxBulkLoader::IxBulkLoader(IxIndexHandle* ih, size_t memory_budget)
+    : ih_(ih),
+      key_len_(ih->file_hdr_->col_tot_len_),
+      entry_len_(key_len_ + static_cast<int>(sizeof(Rid))) {
+  max_entries_ = std::min<size_t>(
+      std::max<size_t>(1, memory_budget / entry_len_), UINT32_MAX);
+}
+
+IxBulkLoader::~IxBulkLoader() {
+  if (prev_leaf_ != nullptr) {
+    ih_->buffer_pool_manager_->unpin_page(prev_leaf_->page, true);
+  }
+}
+
+void IxBulkLoader::add(const char* key, const Rid& rid) {
+  // 哈希索引没有顺序可言，ART索引在内存中，都逐条插入
+  if (ih_->hash_ != nullptr || ih_->art_ != nullptr) {
+    if (ih_->insert_entry(key, rid, nullptr) == IX_NO_PAGE) {
+      has_duplicate_ = true;
+    }
+    return;
+  }
+  if (num_entries_ == max_entries_) {
+    spill_run();
+  }
+  buf_.resize((num_entries_ + 1) * entry_len_);
+  char* entry = buf_.data() + num_entries_ * entry_len_;
+  ix_encode_key(key, entry, ih_->file_hdr_->col_types_,
+                ih_->file_hdr_->col_lens_);
+  memcpy(entry + key_len_, &rid, sizeof(Rid));
+  ++num_entries_;
+}
+
+void IxBulkLoader::add_sorted(const char* key, const Rid& rid) {
+  if (ih_->hash_ != nullptr || ih_->art_ != nullptr) {
+    add(key, rid);
+    return;
+  }
+  char encoded[IX_MAX_COL_LEN];
+  ix_encode_key(key, encoded, ih_->file_hdr_->col_types_,
+                ih_->file_hdr_->col_lens_);
+  append(encoded, rid);
+}
+
+/**
+ * @description: 排序并建树。只有一批表项时直接在内存中排序，否则把最后一批也写到临时文件，多路归并
+ * @return {bool} 是否没有重复的key
+ */
+bool IxBulkLoader::finish() {
+  if (ih_->hash_ != nullptr || ih_->art_ != nullptr) {
+    return !has_duplicate_;
+  }
+  if (runs_.empty()) {
+    for (uint32_t idx : sort_entries()) {
+      const char* entry = buf_.data() + static_cast<size_t>(idx) * entry_len_;
+      Rid rid;
+      memcpy(&rid, entry + key_len_, sizeof(Rid));
+      append(entry, rid);
+    }
+  } else {
+    if (num_entries_ > 0) {
+      spill_run();
+    }
+    std::vector<char>().swap(buf_);
+    // key相同时先取前面的文件，保证重复的key留下的是第一次add的
+    auto greater = [this](size_t a, size_t b) {
+      int cmp = memcmp(runs_[a]->current(entry_len_),
+                       runs_[b]->current(entry_len_), key_len_);
+      return cmp > 0 || (cmp == 0 && a > b);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(
+        greater);
+    for (size_t i = 0; i < runs_.size(); ++i) {
+      if (runs_[i]->refill(entry_len_)) {
+        heap.push(i);
+      }
+    }
+    while (!heap.empty()) {
+      size_t i = heap.top();
+      heap.pop();
+      const char* entry = runs_[i]->current(entry_len_);
+      Rid rid;
+      memcpy(&rid, entry + key_len_, sizeof(Rid));
+      append(entry, rid);
+      if (runs_[i]->advance(entry_len_)) {
+        heap.push(i);
+      }
+    }
+    runs_.clear();
+  }
+
+  if (!leaf_rids_.empty()) {
+    flush_leaf();
+  }
+  build_upper_levels();
+  return !has_duplicate_;
+}
+
+std::vector<uint32_t> IxBulkLoader::sort_entries() const {
+  std::vector<uint32_t> order(num_entries_);
+  std::iota(order.begin(), order.end(), 0);
+  // 稳定排序，重复的key中先add的排在前面
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return memcmp(buf_.data() + static_cast<size_t>(a) * entry_len_,
+                  buf_.data() + static_cast<size_t>(b) * entry_len_,
+                  key_len_) < 0;
+  });
+  return order;
+}
+
+/**
+ * @description: 把内存中的表项排好序写到一个临时文件，临时文件建立在当前目录（数据库目录）下，
+ * 创建后立即unlink，关闭时由文件系统回收
+ */
+void IxBulkLoader::spill_run() {
+  auto run = std::make_unique<Run>();
+  char path[] = "ix_sort_XXXXXX";
+  run->fd = mkstemp(path);
+  if (run->fd == -1) {
+    throw UnixError();
+  }
+  unlink(path);
+
+  std::vector<char> out;
+  out.reserve(IX_BULK_MERGE_BUFFER);
+  for (uint32_t idx : sort_entries()) {
+    if (out.size() + entry_len_ > IX_BULK_MERGE_BUFFER) {
+      write_all(run->fd, out.data(), out.size());
+      out.clear();
+    }
+    const char* entry = buf_.data() + static_cast<size_t>(idx) * entry_len_;
+    out.insert(out.end(), entry, entry + entry_len_);
+  }
+  write_all(run->fd, out.data(), out.size());
+  run->num_entries = num_entries_;
+  runs_.push_back(std::move(run));
+  num_entries_ = 0;
+  buf_.clear();
+}
+
+/**
+ * @description: 按key的顺序接收一个表项，放进正在填充的叶子；叶子的前缀随key变短，
+ * 加上这个key后按前缀算出的容量放不下时先写出叶子
+ * @param {char*} key 编码后的key
+ */
+void IxBulkLoader::append(const char* key, const Rid& rid) {
+  size_t num_keys = leaf_rids_.size();
+  if (num_keys > 0 || !level_pages_.empty()) {
+    // 刚写出叶子时上一个key是当前层最后一个结点的最后一个key，放在prev_leaf_中
+    char last_buf[IX_MAX_COL_LEN];
+    const char* last =
+        num_keys > 0 ? leaf_keys_.data() + (num_keys - 1) * key_len_
+                     : prev_leaf_->get_last_key(last_buf);
+    if (memcmp(last, key, key_len_) == 0) {
+      has_duplicate_ = true;
+      return;
+    }
+  }
+  if (num_keys > 0) {
+    int prefix_len = common_prefix_len(leaf_keys_.data(), key, key_len_);
+    int slots = ih_->file_hdr_->node_slots_[prefix_len];
+    // 至少留一个空位，结点满了就要分裂
+    int capacity = std::max(1, std::min(slots - 1, slots * fill_percent_ / 100));
+    if (static_cast<int>(num_keys) + 1 > capacity) {
+      flush_leaf();
+    }
+  }
+  leaf_keys_.insert(leaf_keys_.end(), key, key + key_len_);
+  leaf_rids_.push_back(rid);
+  if (ih_->bloom_ != nullptr) {
+    ih_->bloom_->add(key);
+  }
+}
+
+/**
+ * @description: 把正在填充的叶子写到页面中。第一个叶子使用空索引原来的根结点，
+ * 之后的叶子依次新建，接在上一个叶子后面
+ */
+void IxBulkLoader::flush_leaf() {
+  bool is_first = prev_leaf_ == nullptr;
+  auto leaf = is_first ? ih_->fetch_node(IX_INIT_ROOT_PAGE) : ih_->create_node();
+  leaf->page_hdr->num_key = 0;
+  leaf->page_hdr->is_leaf = true;
+  leaf->page_hdr->parent = IX_NO_PAGE;
+  leaf->page_hdr->prefix_len = 0;
+  leaf->page_hdr->prev_leaf =
+      is_first ? IX_LEAF_HEADER_PAGE : prev_leaf_->get_page_no();
+  leaf->page_hdr->next_leaf = IX_LEAF_HEADER_PAGE;
+  leaf->insert_pairs(0, leaf_keys_.data(), leaf_rids_.data(),
+                     static_cast<int>(leaf_rids_.size()));
+  if (!is_first) {
+    prev_leaf_->set_next_leaf(leaf->get_page_no());
+    ih_->buffer_pool_manager_->unpin_page(prev_leaf_->page, true);
+  }
+  level_keys_.insert(level_keys_.end(), leaf_keys_.begin(),
+                     leaf_keys_.begin() + key_len_);
+  level_pages_.push_back(leaf->get_page_no());
+  prev_leaf_ = std::move(leaf);
+  leaf_keys_.clear();
+  leaf_rids_.clear();
+}
+
+/**
+ * @description: 叶子写完后维护叶子链表的头结点，然后逐层建立内部结点：
+ * 每层把下层结点平均分到尽量少的结点中，每个结点的key是各个孩子的第一个key，直到只剩一个结点作为根
+ */
+void IxBulkLoader::build_upper_levels() {
+  if (level_pages_.empty()) {
+    return;
+  }
+  auto* file_hdr = ih_->file_hdr_;
+  auto* bpm = ih_->buffer_pool_manager_;
+  file_hdr->last_leaf_ = prev_leaf_->get_page_no();
+  bpm->unpin_page(prev_leaf_->page, true);
+  prev_leaf_.reset();
+  auto leaf_header = ih_->fetch_node(IX_LEAF_HEADER_PAGE);
+  leaf_header->set_next_leaf(level_pages_.front());
+  leaf_header->set_prev_leaf(file_hdr->last_leaf_);
+  bpm->unpin_page(leaf_header->page, true);
+
+  size_t capacity = std::max(
+      2, std::min(file_hdr->btree_order_,
+                  (file_hdr->btree_order_ + 1) * fill_percent_ / 100));
+  std::vector<Rid> rids;
+  while (level_pages_.size() > 1) {
+    size_t num_children = level_pages_.size();
+    size_t num_nodes = (num_children + capacity - 1) / capacity;
+    std::vector<char> upper_keys;
+    std::vector<page_id_t> upper_pages;
+    size_t pos = 0;
+    for (size_t i = 0; i < num_nodes; ++i) {
+      size_t n = num_children / num_nodes + (i < num_children % num_nodes);
+      auto node = ih_->create_node();
+      node->page_hdr->num_key = 0;
+      node->page_hdr->is_leaf = false;
+      node->page_hdr->parent = IX_NO_PAGE;
+      node->page_hdr->prefix_len = 0;
+      node->page_hdr->prev_leaf = node->page_hdr->next_leaf = IX_NO_PAGE;
+      rids.clear();
+      for (size_t k = pos; k < pos + n; ++k) {
+        rids.push_back({level_pages_[k], -1});
+      }
+      node->insert_pairs(0, level_keys_.data() + pos * key_len_, rids.data(),
+                         static_cast<int>(n));
+      for (int k = 0; k < static_cast<int>(n); ++k) {
+        ih_->maintain_child(node, k);
+      }
+      upper_keys.insert(upper_keys.end(), level_keys_.begin() + pos * key_len_,
+                        level_keys_.begin() + (pos + 1) * key_len_);
+      upper_pages.push_back(node->get_page_no());
+      bpm->unpin_page(node->page, true);
+      pos += n;
+    }
+    level_keys_.swap(upper_keys);
+    level_pages_.swap(upper_pages);
+  }
+  file_hdr->root_page_ = level_pages_.front();
+  level_keys_.clear();
+  level_pages_.clear();
+}
@@ -0,0 +1,75 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "ix_index_handle.h"
+
+/**
+ * @description: 在空索引上自底向上地批量建B+树。
+ * add收集(key, rid)，内存中的部分超过预算时排好序写到临时文件；finish时多路归并，
+ * 按key的顺序依次写满叶子结点，再逐层建立内部结点。
+ * 建树期间索引不能被其他线程访问。哈希索引直接逐条插入
+ */
+class IxBulkLoader {
+ public:
+  explicit IxBulkLoader(IxIndexHandle* ih,
+                        size_t memory_budget = IX_BULK_SORT_MEMORY);
+
+  ~IxBulkLoader();
+
+  IxBulkLoader(const IxBulkLoader&) = delete;
+  IxBulkLoader& operator=(const IxBulkLoader&) = delete;
+
+  // key为原始格式
+  void add(const char* key, const Rid& rid);
+
+  // 调用者保证key按编码后的顺序依次给出（例如LOAD按这个索引排好序写入表），直接放进叶子，不再排序。不能和add混用
+  void add_sorted(const char* key, const Rid& rid);
+
+  // 建树，重复的key只保留第一次add的那个；返回是否没有重复的key
+  bool finish();
+
+ private:
+  struct Run;
+
+  // 按key排序buf_中的表项，返回表项下标的顺序
+  std::vector<uint32_t> sort_entries() const;
+
+  void spill_run();
+
+  // 以下按key的顺序接收表项，建立B+树
+  void append(const char* key, const Rid& rid);
+
+  void flush_leaf();
+
+  void build_upper_levels();
+
+  IxIndexHandle* ih_;
+  int key_len_;
+  int entry_len_;  // 每个表项为编码后的key紧跟rid
+  size_t max_entries_;
+  std::vector<char> buf_;  // 内存中还没写出去的表项
+  size_t num_entries_ = 0;
+  std::vector<std::unique_ptr<Run>> runs_;
+
+  bool has_duplicate_ = false;
+  int fill_percent_ = IX_BULK_FILL_PERCENT;
+  // 正在填充的叶子：完整的key和rid，写出之前还不知道前缀多长、能放多少
+  std::vector<char> leaf_keys_;
+  std::vector<Rid> leaf_rids_;
+  std::shared_ptr<IxNodeHandle> prev_leaf_;  // 上一个写出的叶子，等下一个叶子确定后再填next_leaf
+  // 当前层每个结点的第一个key和页号，用来建上一层
+  std::vector<char> level_keys_;
+  std::vector<page_id_t> level_pages_;
+};
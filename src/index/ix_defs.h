@@ -40,7 +40,14 @@ class IxFileHdr {
       first_leaf_;  // 首叶节点对应的页号，在上层IxManager的open函数进行初始化，初始化为root
                     // page_no
   page_id_t last_leaf_;  // 尾叶节点对应的页号
+  IndexType index_type_ = INDEX_BTREE;  // 哈希索引不使用上面B+树相关的字段
+  int global_depth_ = 0;                // 哈希索引目录的全局深度，目录有2^global_depth_个槽位
+  std::vector<page_id_t> dir_pages_;    // 哈希索引目录所在的页面，flush/close时写入
   int tot_len_;          // 记录结构体的整体长度
+  // 不写入文件，打开索引时由init_node_layout计算：下标为结点中key共同前缀的长度，
+  // 值为这种前缀长度下结点的槽位数，以及rid数组相对页面开头的偏移
+  std::vector<int> node_slots_;
+  std::vector<int> rids_offset_;
 
   IxFileHdr() { tot_len_ = col_num_ = 0; }
 
@@ -59,10 +66,31 @@ class IxFileHdr {
     tot_len_ = 0;
   }
 
+  /* 结点的页面布局：|lsn|IxPageHdr|前缀(col_tot_len字节)|keys|rids|，key只存放去掉前缀后的部分。
+   * 前缀越长，每个key越短，结点能放下的键值对越多 */
+  static int keys_offset(int col_tot_len);
+
+  static int node_slots(int col_tot_len, int prefix_len) {
+    return (PAGE_SIZE - keys_offset(col_tot_len) - (alignof(Rid) - 1)) /
+           (col_tot_len - prefix_len + static_cast<int>(sizeof(Rid)));
+  }
+
+  void init_node_layout() {
+    node_slots_.resize(col_tot_len_ + 1);
+    rids_offset_.resize(col_tot_len_ + 1);
+    for (int prefix_len = 0; prefix_len <= col_tot_len_; ++prefix_len) {
+      int slots = node_slots(col_tot_len_, prefix_len);
+      int end = keys_offset(col_tot_len_) + slots * (col_tot_len_ - prefix_len);
+      node_slots_[prefix_len] = slots;
+      rids_offset_[prefix_len] = (end + alignof(Rid) - 1) / alignof(Rid) * alignof(Rid);
+    }
+  }
+
   void update_tot_len() {
     tot_len_ = 0;
     tot_len_ += sizeof(page_id_t) * 4 + sizeof(int) * 6;
     tot_len_ += sizeof(ColType) * col_num_ + sizeof(int) * col_num_;
+    tot_len_ += sizeof(IndexType) + sizeof(int) * 2 + sizeof(page_id_t) * dir_pages_.size();
   }
 
   void serialize(char* dest) {
@@ -95,6 +123,17 @@ class IxFileHdr {
     offset += sizeof(page_id_t);
     memcpy(dest + offset, &last_leaf_, sizeof(page_id_t));
     offset += sizeof(page_id_t);
+    memcpy(dest + offset, &index_type_, sizeof(IndexType));
+    offset += sizeof(IndexType);
+    memcpy(dest + offset, &global_depth_, sizeof(int));
+    offset += sizeof(int);
+    int num_dir_pages = dir_pages_.size();
+    memcpy(dest + offset, &num_dir_pages, sizeof(int));
+    offset += sizeof(int);
+    for (int i = 0; i < num_dir_pages; ++i) {
+      memcpy(dest + offset, &dir_pages_[i], sizeof(page_id_t));
+      offset += sizeof(page_id_t);
+    }
     assert(offset == tot_len_);
   }
 
@@ -133,6 +172,16 @@ class IxFileHdr {
     offset += sizeof(page_id_t);
     last_leaf_ = *reinterpret_cast<const page_id_t*>(src + offset);
     offset += sizeof(page_id_t);
+    index_type_ = *reinterpret_cast<const IndexType*>(src + offset);
+    offset += sizeof(IndexType);
+    global_depth_ = *reinterpret_cast<const int*>(src + offset);
+    offset += sizeof(int);
+    int num_dir_pages = *reinterpret_cast<const int*>(src + offset);
+    offset += sizeof(int);
+    for (int i = 0; i < num_dir_pages; ++i) {
+      dir_pages_.push_back(*reinterpret_cast<const page_id_t*>(src + offset));
+      offset += sizeof(page_id_t);
+    }
     assert(offset == tot_len_);
   }
 };
@@ -148,8 +197,13 @@ class IxPageHdr {
                         // is_leaf is true
   page_id_t next_leaf;  // next leaf node's page_no, effective only when is_leaf
                         // is true
+  int prefix_len;       // 叶子结点中所有key共同前缀的长度，内部结点总是0
 };
 
+inline int IxFileHdr::keys_offset(int col_tot_len) {
+  return Page::OFFSET_PAGE_HDR + static_cast<int>(sizeof(IxPageHdr)) + col_tot_len;
+}
+
 class Iid {
  public:
   int page_no;
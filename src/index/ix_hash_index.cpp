@@ -0,0 +1,327 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "ix_hash_index.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string_view>
+
+namespace {
+
+constexpr int IX_HASH_DIR_ENTRIES_PER_PAGE =
+    (PAGE_SIZE - Page::OFFSET_PAGE_HDR) / sizeof(page_id_t);
+
+}  // namespace
+
+IxHashIndex::IxHashIndex(BufferPoolManager* buffer_pool_manager, int fd,
+                         IxFileHdr* file_hdr)
+    : buffer_pool_manager_(buffer_pool_manager),
+      fd_(fd),
+      file_hdr_(file_hdr),
+      key_len_(file_hdr->col_tot_len_) {
+  keys_offset_ = Page::OFFSET_PAGE_HDR + sizeof(IxHashBucketHdr);
+  bucket_slots_ = (PAGE_SIZE - keys_offset_ - (alignof(Rid) - 1)) /
+                  (key_len_ + static_cast<int>(sizeof(Rid)));
+  int keys_end = keys_offset_ + bucket_slots_ * key_len_;
+  rids_offset_ = (keys_end + alignof(Rid) - 1) / alignof(Rid) * alignof(Rid);
+
+  // 新建的索引还没有写过目录，只有一个桶
+  dir_.assign(static_cast<size_t>(1) << file_hdr_->global_depth_,
+              IX_HASH_INIT_BUCKET_PAGE);
+  size_t loaded = 0;
+  for (page_id_t dir_page : file_hdr_->dir_pages_) {
+    Page* page = buffer_pool_manager_->fetch_page({fd_, dir_page});
+    size_t n = std::min<size_t>(dir_.size() - loaded,
+                                IX_HASH_DIR_ENTRIES_PER_PAGE);
+    memcpy(dir_.data() + loaded, page->get_data() + Page::OFFSET_PAGE_HDR,
+           n * sizeof(page_id_t));
+    loaded += n;
+    buffer_pool_manager_->unpin_page(page, false);
+  }
+}
+
+uint64_t IxHashIndex::hash(const char* key) const {
+  return std::hash<std::string_view>{}(std::string_view(key, key_len_));
+}
+
+int IxHashIndex::bucket_find(Page* page, const char* key) const {
+  int num_key = bucket_hdr(page)->num_key;
+  for (int i = 0; i < num_key; ++i) {
+    if (memcmp(bucket_key(page, i), key, key_len_) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void IxHashIndex::bucket_append(Page* page, const char* key, const Rid& rid) {
+  auto* hdr = bucket_hdr(page);
+  memcpy(bucket_key(page, hdr->num_key), key, key_len_);
+  *bucket_rid(page, hdr->num_key) = rid;
+  ++hdr->num_key;
+}
+
+// 桶内无序，用最后一个键值对填上空位
+void IxHashIndex::bucket_erase(Page* page, int slot) {
+  auto* hdr = bucket_hdr(page);
+  int last = --hdr->num_key;
+  if (slot != last) {
+    memcpy(bucket_key(page, slot), bucket_key(page, last), key_len_);
+    *bucket_rid(page, slot) = *bucket_rid(page, last);
+  }
+}
+
+/**
+ * @description: 分配一个空桶页面，持有dir_latch_的写锁时调用
+ * @note 返回的页面需要在外面unpin
+ */
+Page* IxHashIndex::create_bucket(int local_depth) {
+  ++file_hdr_->num_pages_;
+  PageId new_page_id = {.fd = fd_, .page_no = INVALID_PAGE_ID};
+  Page* page = buffer_pool_manager_->new_page(&new_page_id);
+  *bucket_hdr(page) = {
+      .local_depth = local_depth,
+      .num_key = 0,
+      .next_overflow = IX_NO_PAGE,
+  };
+  return page;
+}
+
+bool IxHashIndex::get_value(const char* key, std::vector<Rid>* result) {
+  std::shared_lock<std::shared_mutex> dir_guard(dir_latch_);
+  page_id_t page_no = dir_[hash(key) & (dir_.size() - 1)];
+  while (page_no != IX_NO_PAGE) {
+    Page* page = buffer_pool_manager_->fetch_page({fd_, page_no});
+    page->RLatch();
+    int slot = bucket_find(page, key);
+    if (slot >= 0) {
+      result->emplace_back(*bucket_rid(page, slot));
+    }
+    page_no = bucket_hdr(page)->next_overflow;
+    page->RUnlatch();
+    buffer_pool_manager_->unpin_page(page, false);
+    if (slot >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @description: 先只持有目录的读锁，桶中放得下时直接插入；放不下时换成目录的写锁，分裂桶后再插入
+ */
+page_id_t IxHashIndex::insert_entry(const char* key, const Rid& value,
+                                    Transaction* transaction) {
+  {
+    std::shared_lock<std::shared_mutex> dir_guard(dir_latch_);
+    page_id_t page_no = dir_[hash(key) & (dir_.size() - 1)];
+    Page* page = buffer_pool_manager_->fetch_page({fd_, page_no});
+    page->WLatch();
+    // 没有溢出页的桶才能在读锁下插入，有溢出页时要检查整条链上的key是否重复
+    auto* hdr = bucket_hdr(page);
+    if (hdr->next_overflow == IX_NO_PAGE) {
+      if (bucket_find(page, key) >= 0) {
+        page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page, false);
+        return IX_NO_PAGE;
+      }
+      if (hdr->num_key < bucket_slots_) {
+        bucket_append(page, key, value);
+        stamp_lsn(page, transaction);
+        page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page, true);
+        return page_no;
+      }
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page, false);
+  }
+  std::unique_lock<std::shared_mutex> dir_guard(dir_latch_);
+  return insert_exclusive(key, value, transaction);
+}
+
+page_id_t IxHashIndex::insert_exclusive(const char* key, const Rid& value,
+                                        Transaction* transaction) {
+  uint64_t key_hash = hash(key);
+  while (true) {
+    page_id_t page_no = dir_[key_hash & (dir_.size() - 1)];
+    Page* bucket = buffer_pool_manager_->fetch_page({fd_, page_no});
+    int local_depth = bucket_hdr(bucket)->local_depth;
+    if (local_depth < IX_HASH_MAX_GLOBAL_DEPTH) {
+      // 局部深度没到上限的桶没有溢出页
+      if (bucket_find(bucket, key) >= 0) {
+        buffer_pool_manager_->unpin_page(bucket, false);
+        return IX_NO_PAGE;
+      }
+      if (bucket_hdr(bucket)->num_key < bucket_slots_) {
+        bucket_append(bucket, key, value);
+        stamp_lsn(bucket, transaction);
+        buffer_pool_manager_->unpin_page(bucket, true);
+        return page_no;
+      }
+      // 分裂后key可能仍然落在满的桶里，重新查目录
+      split_bucket(bucket, key_hash);
+      continue;
+    }
+
+    // 局部深度到了上限，在溢出链上找空位，都满了就在链尾挂新页
+    Page* free_page = nullptr;
+    Page* page = bucket;
+    while (true) {
+      if (bucket_find(page, key) >= 0) {
+        if (free_page != nullptr && free_page != page) {
+          buffer_pool_manager_->unpin_page(free_page, false);
+        }
+        buffer_pool_manager_->unpin_page(page, false);
+        return IX_NO_PAGE;
+      }
+      page_id_t next = bucket_hdr(page)->next_overflow;
+      if (free_page == nullptr && bucket_hdr(page)->num_key < bucket_slots_) {
+        free_page = page;
+      }
+      if (next == IX_NO_PAGE) {
+        break;
+      }
+      if (page != free_page) {
+        buffer_pool_manager_->unpin_page(page, false);
+      }
+      page = buffer_pool_manager_->fetch_page({fd_, next});
+    }
+    bool page_dirty = false;
+    if (free_page == nullptr) {
+      free_page = create_bucket(local_depth);
+      bucket_hdr(page)->next_overflow = free_page->get_page_id().page_no;
+      page_dirty = true;
+    }
+    bucket_append(free_page, key, value);
+    stamp_lsn(free_page, transaction);
+    page_id_t inserted = free_page->get_page_id().page_no;
+    if (page != free_page) {
+      buffer_pool_manager_->unpin_page(page, page_dirty);
+    }
+    buffer_pool_manager_->unpin_page(free_page, true);
+    return inserted;
+  }
+}
+
+/**
+ * @description: 按哈希值的第local_depth位把桶中的键值对分到两个桶中，目录中对应的一半槽位改指向新桶
+ * @param bucket 要分裂的桶，函数中unpin
+ */
+void IxHashIndex::split_bucket(Page* bucket, uint64_t key_hash) {
+  auto* hdr = bucket_hdr(bucket);
+  int local_depth = hdr->local_depth;
+  if (local_depth == file_hdr_->global_depth_) {
+    size_t old_size = dir_.size();
+    dir_.resize(old_size * 2);
+    std::copy(dir_.begin(), dir_.begin() + old_size, dir_.begin() + old_size);
+    ++file_hdr_->global_depth_;
+  }
+  Page* new_bucket = create_bucket(local_depth + 1);
+  hdr->local_depth = local_depth + 1;
+  uint64_t high_bit = static_cast<uint64_t>(1) << local_depth;
+
+  for (int slot = 0; slot < hdr->num_key;) {
+    if (hash(bucket_key(bucket, slot)) & high_bit) {
+      bucket_append(new_bucket, bucket_key(bucket, slot),
+                    *bucket_rid(bucket, slot));
+      bucket_erase(bucket, slot);
+    } else {
+      ++slot;
+    }
+  }
+  page_id_t old_page_no = bucket->get_page_id().page_no;
+  page_id_t new_page_no = new_bucket->get_page_id().page_no;
+  for (size_t i = (key_hash & (high_bit - 1)); i < dir_.size();
+       i += high_bit) {
+    assert(dir_[i] == old_page_no);
+    if (i & high_bit) {
+      dir_[i] = new_page_no;
+    }
+  }
+  // 桶页面的内容重新分配过，lsn沿用旧桶的，保证淘汰时日志先于它们落盘
+  new_bucket->set_page_lsn(bucket->get_page_lsn());
+  buffer_pool_manager_->unpin_page(bucket, true);
+  buffer_pool_manager_->unpin_page(new_bucket, true);
+}
+
+bool IxHashIndex::delete_entry(const char* key, Transaction* transaction) {
+  std::shared_lock<std::shared_mutex> dir_guard(dir_latch_);
+  page_id_t page_no = dir_[hash(key) & (dir_.size() - 1)];
+  while (page_no != IX_NO_PAGE) {
+    Page* page = buffer_pool_manager_->fetch_page({fd_, page_no});
+    page->WLatch();
+    int slot = bucket_find(page, key);
+    if (slot >= 0) {
+      bucket_erase(page, slot);
+      stamp_lsn(page, transaction);
+    }
+    page_no = bucket_hdr(page)->next_overflow;
+    page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page, slot >= 0);
+    if (slot >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IxHashIndex::is_empty() {
+  std::shared_lock<std::shared_mutex> dir_guard(dir_latch_);
+  // 目录中相邻的槽位经常指向同一个桶，跳过刚检查过的
+  page_id_t last_checked = IX_NO_PAGE;
+  for (page_id_t bucket : dir_) {
+    if (bucket == last_checked) {
+      continue;
+    }
+    last_checked = bucket;
+    page_id_t page_no = bucket;
+    while (page_no != IX_NO_PAGE) {
+      Page* page = buffer_pool_manager_->fetch_page({fd_, page_no});
+      page->RLatch();
+      bool empty = bucket_hdr(page)->num_key == 0;
+      page_no = bucket_hdr(page)->next_overflow;
+      page->RUnlatch();
+      buffer_pool_manager_->unpin_page(page, false);
+      if (!empty) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void IxHashIndex::write_directory() {
+  std::unique_lock<std::shared_mutex> dir_guard(dir_latch_);
+  size_t num_dir_pages =
+      (dir_.size() + IX_HASH_DIR_ENTRIES_PER_PAGE - 1) /
+      IX_HASH_DIR_ENTRIES_PER_PAGE;
+  size_t written = 0;
+  for (size_t i = 0; i < num_dir_pages; ++i) {
+    Page* page;
+    if (i < file_hdr_->dir_pages_.size()) {
+      page = buffer_pool_manager_->fetch_page({fd_, file_hdr_->dir_pages_[i]});
+    } else {
+      ++file_hdr_->num_pages_;
+      PageId new_page_id = {.fd = fd_, .page_no = INVALID_PAGE_ID};
+      page = buffer_pool_manager_->new_page(&new_page_id);
+      file_hdr_->dir_pages_.push_back(new_page_id.page_no);
+    }
+    size_t n = std::min<size_t>(dir_.size() - written,
+                                IX_HASH_DIR_ENTRIES_PER_PAGE);
+    memcpy(page->get_data() + Page::OFFSET_PAGE_HDR, dir_.data() + written,
+           n * sizeof(page_id_t));
+    written += n;
+    buffer_pool_manager_->unpin_page(page, true);
+  }
+  file_hdr_->update_tot_len();
+}
@@ -0,0 +1,106 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <shared_mutex>
+#include <vector>
+
+#include "ix_defs.h"
+#include "transaction/transaction.h"
+
+constexpr int IX_HASH_INIT_BUCKET_PAGE = 1;
+constexpr int IX_HASH_INIT_NUM_PAGES = 2;
+
+/* 哈希桶页面的头部，紧跟页面lsn */
+class IxHashBucketHdr {
+ public:
+  int local_depth;          // 目录中低local_depth位相同的槽位都指向这个桶
+  int num_key;              // 桶中的键值对数量
+  page_id_t next_overflow;  // 溢出页，只有局部深度到达IX_HASH_MAX_GLOBAL_DEPTH的桶才会有
+};
+
+/**
+ * @description: 可扩展哈希索引，只支持等值查找，和B+树索引一样key不能重复。
+ * 桶页面的布局：|lsn|IxHashBucketHdr|keys|rids|，桶内的键值对无序。
+ * 目录常驻内存，打开索引时从file_hdr_->dir_pages_读入，flush/close时调用write_directory写回；
+ * 和B+树的根结点页号一样，崩溃后由恢复重建索引。
+ * 查找、删除和桶中放得下的插入持有dir_latch_的读锁，再给桶页面加页面锁；
+ * 分裂桶、扩大目录和挂溢出页持有dir_latch_的写锁，这时没有其他操作在访问桶页面
+ */
+class IxHashIndex {
+ public:
+  IxHashIndex(BufferPoolManager* buffer_pool_manager, int fd,
+              IxFileHdr* file_hdr);
+
+  // 以下key都是ix_encode_key编码后的形式
+
+  bool get_value(const char* key, std::vector<Rid>* result);
+
+  // key已经存在时不插入，返回IX_NO_PAGE；否则返回插入到的页面
+  page_id_t insert_entry(const char* key, const Rid& value,
+                         Transaction* transaction);
+
+  bool delete_entry(const char* key, Transaction* transaction);
+
+  bool is_empty();
+
+  // 把目录写到目录页面中，目录页面不够时分配新的，并记录到file_hdr_->dir_pages_
+  void write_directory();
+
+ private:
+  uint64_t hash(const char* key) const;
+
+  IxHashBucketHdr* bucket_hdr(Page* page) const {
+    return reinterpret_cast<IxHashBucketHdr*>(page->get_data() +
+                                              Page::OFFSET_PAGE_HDR);
+  }
+
+  char* bucket_key(Page* page, int slot) const {
+    return page->get_data() + keys_offset_ + slot * key_len_;
+  }
+
+  Rid* bucket_rid(Page* page, int slot) const {
+    return reinterpret_cast<Rid*>(page->get_data() + rids_offset_) + slot;
+  }
+
+  // 桶中key所在的槽位，没有时返回-1
+  int bucket_find(Page* page, const char* key) const;
+
+  void bucket_append(Page* page, const char* key, const Rid& rid);
+
+  void bucket_erase(Page* page, int slot);
+
+  Page* create_bucket(int local_depth);
+
+  // 持有dir_latch_的写锁时调用：在key所在的桶中插入，放不下时分裂或挂溢出页，直到插入为止
+  page_id_t insert_exclusive(const char* key, const Rid& value,
+                             Transaction* transaction);
+
+  // 把bucket分成两个局部深度加一的桶，必要时先把目录扩大一倍
+  void split_bucket(Page* bucket, uint64_t key_hash);
+
+  void stamp_lsn(Page* page, Transaction* transaction) {
+    if (transaction != nullptr &&
+        transaction->get_prev_lsn() > page->get_page_lsn()) {
+      page->set_page_lsn(transaction->get_prev_lsn());
+    }
+  }
+
+  BufferPoolManager* buffer_pool_manager_;
+  int fd_;
+  IxFileHdr* file_hdr_;
+  int key_len_;
+  int bucket_slots_;  // 每个桶页面能放下的键值对数量
+  int keys_offset_;
+  int rids_offset_;
+  std::shared_mutex dir_latch_;
+  std::vector<page_id_t> dir_;  // 下标为key哈希值的低global_depth_位，值为桶的页号
+};
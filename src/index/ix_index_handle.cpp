@@ -10,26 +10,107 @@ See the Mulan PSL v2 for more details. */
 
 #include "ix_index_handle.h"
 
+#include <numeric>
+#include <string_view>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "ix_scan.h"
 
+namespace {
+inline int common_prefix_len(const char* a, const char* b, int len) {
+  int i = 0;
+  while (i < len && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+inline uint32_t load_key32(const char* key) {
+  uint32_t bits;
+  memcpy(&bits, key, sizeof(bits));
+  return __builtin_bswap32(bits);
+}
+
+inline uint64_t load_key64(const char* key) {
+  uint64_t bits;
+  memcpy(&bits, key, sizeof(bits));
+  return __builtin_bswap64(bits);
+}
+
+/**
+ * @description: 无分支的二分查找：返回[0, n)中第一个before(i)为false的位置，before对i单调（先真后假）。
+ * 每轮只根据比较结果选择下一段的起点，编译成条件传送，不会因为分支预测失败而停顿
+ * @param {int} n 查找范围的大小，结束时剩余的范围不超过window
+ */
+template <typename Before>
+inline int branchless_search(int& n, int window, Before&& before) {
+  int base = 0;
+  while (n > window) {
+    int half = n >> 1;
+    base = before(base + half - 1) ? base + half : base;
+    n -= half;
+  }
+  return base;
+}
+
+#ifdef __AVX2__
+/**
+ * @description: 统计从key开始的n个4字节key中小于target（upper为true时小于等于）的个数，n<=16。
+ * 一次读取16个key，调用者保证越过n读取的部分仍在页面内，多读的部分被掩码去掉
+ */
+template <bool upper>
+inline int count_before32(const char* key, int n, uint32_t target) {
+  const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                         3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  // AVX2只有有符号比较，翻转符号位后有符号比较的结果等于无符号比较
+  const __m256i sign = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+  __m256i t = _mm256_set1_epi32(static_cast<int>(target ^ 0x80000000u));
+  __m256i lo = _mm256_xor_si256(
+      _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)), bswap), sign);
+  __m256i hi = _mm256_xor_si256(
+      _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + 32)), bswap), sign);
+  unsigned mask;
+  if (upper) {
+    mask = ~(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lo, t)))) |
+             static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(hi, t)))) << 8);
+  } else {
+    mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t, lo)))) |
+           static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t, hi)))) << 8;
+  }
+  return __builtin_popcount(mask & ((1u << n) - 1));
+}
+#endif
+}  // namespace
+
 void IxIndexHandle::release_all_index_latch_page(Transaction* transaction) {
   if (transaction != nullptr) {
     for (auto& page : *transaction->get_index_latch_page_set()) {
       page->WUnlatch();
-      buffer_pool_manager_->unpin_page(page->get_page_id(), false);
+      buffer_pool_manager_->unpin_page(page, false);
     }
     // 清空
     transaction->get_index_latch_page_set()->clear();
   }
 }
 
-bool IxNodeHandle::isSafe(Operation operation) {
+bool IxNodeHandle::isSafe(Operation operation, const char* key) {
   int min_size = 2;
   if (!is_root_page()) {
     min_size = get_min_size();
   }
+  // key落在第0个位置时maintain_parent会改动父结点的key，父结点的写锁不能提前释放
+  if (operation == Operation::INSERT || operation == Operation::DELETE) {
+    int pos = is_leaf_page() ? lower_bound(key) : upper_bound(key) - 1;
+    if (pos <= 0) {
+      return false;
+    }
+  }
   if (operation == Operation::INSERT) {
-    return get_size() + 1 < get_max_size();
+    // key不带有叶子的前缀时插入会缩短前缀，按缩短后的容量判断
+    return get_size() + 1 < file_hdr->node_slots_[common_prefix(key)];
   }
   if (operation == Operation::DELETE) {
     return get_size() > min_size;
@@ -50,17 +131,7 @@ int IxNodeHandle::lower_bound(const char* target) const {
   // 查找当前节点中第一个大于等于target的key，并返回key的位置给上层
   // 提示:
   // 可以采用多种查找方式，如顺序遍历、二分查找等；使用ix_compare()函数进行比较
-  int l = 0, r = page_hdr->num_key;
-  while (l < r) {
-    int mid = (l + r) >> 1;
-    int cmp = Compare(target, get_key(mid));
-    if (cmp <= 0) {
-      r = mid;
-    } else {
-      l = mid + 1;
-    }
-  }
-  return l;
+  return search<false>(target, 0);
 }
 
 /**
@@ -75,18 +146,67 @@ int IxNodeHandle::upper_bound(const char* target) const {
   // 查找当前节点中第一个大于target的key，并返回key的位置给上层
   // 提示:
   // 可以采用多种查找方式：顺序遍历、二分查找等；使用ix_compare()函数进行比较
-  int l = 1, r = page_hdr->num_key;
-  while (l < r) {
-    int mid = (l + r) >> 1;
-    int cmp = Compare(target, get_key(mid));
-    if (cmp < 0) {
-      r = mid;
-    } else {
-      l = mid + 1;
+  // 解决空树，返回 0
+  if (page_hdr->num_key <= 1) {
+    return page_hdr->num_key;
+  }
+  return search<true>(target, 1);
+}
+
+/**
+ * @brief 结点内的查找：先和前缀比较，前缀不同时target在所有key之前或之后；前缀相同时只比较后缀。
+ * 先无分支地二分缩小范围，4字节的后缀最后不超过16个时用AVX2一次比较完，
+ * 其余情况二分到底。4字节和8字节的后缀直接按整数比较，不调用memcmp
+ */
+template <bool upper>
+int IxNodeHandle::search(const char* target, int begin) const {
+  int n = page_hdr->num_key - begin;
+  if (n <= 0) {
+    return begin;
+  }
+  int prefix_len = page_hdr->prefix_len;
+  if (prefix_len > 0) {
+    int cmp = memcmp(target, prefix, prefix_len);
+    if (cmp != 0) {
+      return cmp < 0 ? begin : page_hdr->num_key;
+    }
+    target += prefix_len;
+  }
+  const char* first = get_suffix(begin);
+  int len = suffix_len();
+  switch (len) {
+    case sizeof(uint32_t): {
+      uint32_t t = load_key32(target);
+      auto before = [first, t](int i) {
+        uint32_t k = load_key32(first + i * sizeof(uint32_t));
+        return upper ? k <= t : k < t;
+      };
+#ifdef __AVX2__
+      int base = branchless_search(n, 16, before);
+      return begin + base + count_before32<upper>(first + base * sizeof(uint32_t), n, t);
+#else
+      int base = branchless_search(n, 1, before);
+      return begin + base + before(base);
+#endif
+    }
+    case sizeof(uint64_t): {
+      uint64_t t = load_key64(target);
+      auto before = [first, t](int i) {
+        uint64_t k = load_key64(first + i * sizeof(uint64_t));
+        return upper ? k <= t : k < t;
+      };
+      int base = branchless_search(n, 1, before);
+      return begin + base + before(base);
+    }
+    default: {
+      auto before = [first, target, len](int i) {
+        int cmp = memcmp(first + i * len, target, len);
+        return upper ? cmp <= 0 : cmp < 0;
+      };
+      int base = branchless_search(n, 1, before);
+      return begin + base + before(base);
     }
   }
-  // 解决空树，返回 0
-  return r;
 }
 
 /**
@@ -104,7 +224,7 @@ bool IxNodeHandle::leaf_lookup(const char* key, Rid** value) {
   // 3. 如果存在，获取key对应的Rid，并赋值给传出参数value
   // 提示：可以调用lower_bound()和get_rid()函数。
   int pos = lower_bound(key);
-  if (pos == page_hdr->num_key || Compare(key, get_key(pos))) {
+  if (pos == page_hdr->num_key || compare_key(key, pos)) {
     return false;
   }
   *value = get_rid(pos);
@@ -150,21 +270,49 @@ void IxNodeHandle::insert_pairs(int pos, const char* key, const Rid* rid,
   if (pos < 0 || pos > page_hdr->num_key) {
     throw IndexEntryNotFoundError();
   }
+  if (n <= 0) {
+    return;
+  }
 
-  // 获取当前键和 RID 的指针
-  auto&& cur_key = get_key(pos);
-  auto&& cur_rid = get_rid(pos);
   auto&& num_keys = page_hdr->num_key;
   auto&& cols_len = file_hdr->col_tot_len_;
+  const char* last_key = key + (n - 1) * cols_len;
+  // 叶子结点维护前缀：空结点的前缀取这批key的公共前缀；否则这批key不带有原来的前缀时缩短前缀。
+  // key有序，第一个和最后一个key的公共前缀就是这批key的公共前缀
+  if (is_leaf_page()) {
+    if (num_keys == 0) {
+      page_hdr->prefix_len = common_prefix_len(key, last_key, cols_len);
+      memcpy(prefix, key, page_hdr->prefix_len);
+    } else {
+      int prefix_len = std::min(common_prefix(key), common_prefix(last_key));
+      if (prefix_len < page_hdr->prefix_len) {
+        set_prefix_len(prefix_len);
+      }
+    }
+  }
+  // 调用者保证插入后放得下
+  assert(num_keys + n <= get_max_size());
+
+  // 获取当前键和 RID 的指针
+  auto&& prefix_len = page_hdr->prefix_len;
+  auto&& key_len = suffix_len();
+  auto&& cur_key = get_suffix(pos);
+  auto&& cur_rid = get_rid(pos);
 
   // 腾出 (num_keys - pos) 个空间
   if (pos < num_keys) {
-    memmove(cur_key + n * cols_len, cur_key, (num_keys - pos) * cols_len);
+    memmove(cur_key + n * key_len, cur_key, (num_keys - pos) * key_len);
     memmove(cur_rid + n, cur_rid, (num_keys - pos) * sizeof(Rid));
   }
 
-  // 拷贝 n 个键值对
-  memcpy(cur_key, key, n * cols_len);
+  // 拷贝 n 个键值对，key去掉前缀
+  if (prefix_len == 0) {
+    memcpy(cur_key, key, n * cols_len);
+  } else {
+    for (int i = 0; i < n; ++i) {
+      memcpy(cur_key + i * key_len, key + i * cols_len + prefix_len, key_len);
+    }
+  }
   memcpy(cur_rid, rid, n * sizeof(Rid));
 
   // 更新键数量
@@ -185,7 +333,7 @@ std::pair<int, int> IxNodeHandle::insert(const char* key, const Rid& value) {
   // 3. 如果key不重复则插入键值对
   // 4. 返回完成插入操作之后的键值对数量
   auto&& pos = lower_bound(key);
-  if (pos < page_hdr->num_key && Compare(key, get_key(pos)) == 0) {
+  if (pos < page_hdr->num_key && compare_key(key, pos) == 0) {
     return {page_hdr->num_key, -1};
   }
   insert_pair(pos, key, value);
@@ -207,19 +355,50 @@ void IxNodeHandle::erase_pair(int pos) {
   }
 
   // 获取当前键和 RID 的指针
-  auto&& cur_key = get_key(pos);
+  auto&& cur_key = get_suffix(pos);
   auto&& cur_rid = get_rid(pos);
   auto&& num_keys = page_hdr->num_key;
-  auto&& cols_len = file_hdr->col_tot_len_;
+  auto&& key_len = suffix_len();
 
-  // 腾出 1 个空间
-  memmove(cur_key, cur_key + cols_len, (num_keys - pos - 1) * cols_len);
+  // 腾出 1 个空间，前缀不变
+  memmove(cur_key, cur_key + key_len, (num_keys - pos - 1) * key_len);
   memmove(cur_rid, cur_rid + 1, (num_keys - pos - 1) * sizeof(Rid));
 
   // 更新键数量
   --page_hdr->num_key;
 }
 
+/**
+ * @brief 修改叶子结点的前缀长度，按新的前缀重新排列所有key和rid
+ * 缩短前缀时调用者保证结点在新的容量下放得下；加长前缀时调用者保证所有key都带有新的前缀
+ *
+ * @param prefix_len 新的前缀长度
+ */
+void IxNodeHandle::set_prefix_len(int prefix_len) {
+  int num_keys = page_hdr->num_key;
+  int cols_len = file_hdr->col_tot_len_;
+  std::vector<char> keys_buf(static_cast<size_t>(num_keys) * cols_len);
+  std::vector<Rid> rids_buf(get_rid(0), get_rid(0) + num_keys);
+  for (int i = 0; i < num_keys; ++i) {
+    char* dest = keys_buf.data() + i * cols_len;
+    const char* key = get_key(i, dest);
+    if (key != dest) {
+      memcpy(dest, key, cols_len);
+    }
+  }
+
+  page_hdr->prefix_len = prefix_len;
+  assert(num_keys <= get_max_size());
+  if (num_keys > 0) {
+    memcpy(prefix, keys_buf.data(), prefix_len);
+  }
+  int key_len = suffix_len();
+  for (int i = 0; i < num_keys; ++i) {
+    memcpy(get_suffix(i), keys_buf.data() + i * cols_len + prefix_len, key_len);
+  }
+  memcpy(get_rid(0), rids_buf.data(), num_keys * sizeof(Rid));
+}
+
 /**
  * @brief 用于在结点中删除指定key的键值对。函数返回删除后的键值对数量
  *
@@ -232,7 +411,7 @@ std::pair<int, int> IxNodeHandle::remove(const char* key) {
   // 2. 如果要删除的键值对存在，删除键值对
   // 3. 返回完成删除操作后的键值对数量
   auto&& pos = lower_bound(key);
-  if (pos < page_hdr->num_key && Compare(key, get_key(pos)) == 0) {
+  if (pos < page_hdr->num_key && compare_key(key, pos) == 0) {
     erase_pair(pos);
   }
   return {page_hdr->num_key, pos};
@@ -252,10 +431,19 @@ IxIndexHandle::IxIndexHandle(DiskManager* disk_manager,
   file_hdr_ = new IxFileHdr();
   file_hdr_->deserialize(buf);
   delete[] buf;
+  file_hdr_->init_node_layout();
 
   // disk_manager管理的fd对应的文件中，设置从file_hdr_->num_pages开始分配page_no
   // int now_page_no = disk_manager_->get_fd2pageno(fd);
   disk_manager_->set_fd2pageno(fd, file_hdr_->num_pages_);
+  if (file_hdr_->index_type_ == INDEX_HASH) {
+    hash_ = std::make_unique<IxHashIndex>(buffer_pool_manager_, fd_, file_hdr_);
+  } else if (file_hdr_->index_type_ == INDEX_ART) {
+    // 内容只在内存中，打开后是空的，由SmManager从表中重建
+    art_ = std::make_unique<IxArtIndex>(file_hdr_->col_tot_len_);
+  } else if (ENABLE_IX_BLOOM_FILTER) {
+    build_bloom_filter();
+  }
 }
 
 /**
@@ -274,20 +462,46 @@ std::pair<std::shared_ptr<IxNodeHandle>, bool> IxIndexHandle::find_leaf_page(
   // 1. 获取根节点
   // 2. 从根节点开始不断向下查找目标key
   // 3. 找到包含该key值的叶子结点停止查找，并返回叶子节点
-  // 因为根有可能被删除 获取根节点前先加根锁
-  root_latch_.lock();
+  // 读操作先乐观地下降，多次失败（并发的分裂、合并太多）才退回逐层加读锁
+  // 写操作也先乐观地下降，只给叶子加写锁；叶子不会分裂、合并，也不需要更新父结点中的第一个key时
+  // 直接在叶子上完成，否则退回从根开始的锁耦合
+  if (operation == Operation::FIND) {
+    for (int i = 0; i < OPTIMISTIC_READ_RETRIES; ++i) {
+      if (auto&& leaf = find_leaf_page_optimistic(key, find_first)) {
+        return {leaf, false};
+      }
+    }
+  } else if (!find_first) {
+    if (operation == Operation::INSERT) {
+      if (auto&& leaf = find_rightmost_leaf(key)) {
+        return {leaf, false};
+      }
+    }
+    for (int i = 0; i < OPTIMISTIC_WRITE_RETRIES; ++i) {
+      if (auto&& leaf = find_leaf_page_optimistic(key, false, operation)) {
+        return {leaf, false};
+      }
+    }
+  }
+
+  // 因为根有可能被删除 获取根节点前先加根锁。读操作只需要根不变，加共享锁，读者之间不互斥
+  if (operation == Operation::FIND) {
+    root_latch_.RLock();
+  } else {
+    root_latch_.WLock();
+  }
   bool is_root_locked = true;
   auto&& node = fetch_node(file_hdr_->root_page_);
   if (operation == Operation::FIND) {
     // 读操作
     node->page->RLatch();
-    root_latch_.unlock();
+    root_latch_.RUnlock();
     is_root_locked = false;
   } else {
     // 写操作
     node->page->WLatch();
-    if (node->isSafe(operation)) {
-      root_latch_.unlock();
+    if (node->isSafe(operation, key)) {
+      root_latch_.WUnlock();
       is_root_locked = false;
     }
   }
@@ -298,14 +512,14 @@ std::pair<std::shared_ptr<IxNodeHandle>, bool> IxIndexHandle::find_leaf_page(
     if (operation == Operation::FIND) {
       child_node->page->RLatch();
       node->page->RUnlatch();
-      buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+      buffer_pool_manager_->unpin_page(node->page, false);
     } else {
       child_node->page->WLatch();
       // !TODO 支持并发事务
       transaction->append_index_latch_page_set(node->page);
-      if (child_node->isSafe(operation)) {
+      if (child_node->isSafe(operation, key)) {
         if (is_root_locked) {
-          root_latch_.unlock();
+          root_latch_.WUnlock();
           is_root_locked = false;
         }
         // 释放所有父节点写锁
@@ -318,6 +532,110 @@ std::pair<std::shared_ptr<IxNodeHandle>, bool> IxIndexHandle::find_leaf_page(
   return {node, is_root_locked};
 }
 
+/**
+ * @brief 乐观地查找key所在的叶子结点：不加根锁，内部结点不加读锁，只记下版本号，
+ * 读出孩子页号后检查父结点的版本号没有变化；只有叶子结点加锁
+ * @param key 要查找的目标key值
+ * @param find_first 是否查找最左边的叶子结点
+ * @param operation 为INSERT/DELETE时叶子加写锁，并且只有这次操作改动不到叶子以外的结点时才返回：
+ * 叶子对该操作是安全的（不会分裂或合并），key也不在叶子的第0个位置（不需要maintain_parent）
+ * @return 加了锁的叶子结点，期间有写者修改了路径上的结点或者写操作需要改动父结点时返回nullptr
+ * @note 分裂和合并改变根结点时都持有旧根结点的写锁，旧根的版本号因此一定会变化
+ */
+std::shared_ptr<IxNodeHandle> IxIndexHandle::find_leaf_page_optimistic(
+    const char* key, bool find_first, Operation operation) {
+  page_id_t root_page_no =
+      __atomic_load_n(&file_hdr_->root_page_, __ATOMIC_ACQUIRE);
+  auto node = fetch_node(root_page_no);
+  uint64_t version = node->page->get_version();
+  if ((version & 1) != 0 ||
+      __atomic_load_n(&file_hdr_->root_page_, __ATOMIC_ACQUIRE) !=
+          root_page_no) {
+    buffer_pool_manager_->unpin_page(node->page, false);
+    return nullptr;
+  }
+
+  for (int level = 0;; ++level) {
+    bool is_leaf = node->is_leaf_page();
+    if (!node->page->validate_version(version)) {
+      break;
+    }
+    if (is_leaf) {
+      // 加读锁后版本号不变，说明乐观读到的"是叶子"以及到达这里的路径仍然成立
+      if (operation == Operation::FIND) {
+        node->page->RLatch();
+        if (node->page->validate_version(version)) {
+          return node;
+        }
+        node->page->RUnlatch();
+        break;
+      }
+      // 加写锁本身会把版本号加一
+      node->page->WLatch();
+      if (node->page->validate_version(version + 1) &&
+          node->isSafe(operation, key)) {
+        return node;
+      }
+      node->page->WUnlatch();
+      break;
+    }
+    page_id_t child_page_no =
+        find_first ? node->value_at(0) : node->internal_lookup(key);
+    // 页号可能是读到一半的结果，先确认父结点没有变化再去获取孩子
+    if (!node->page->validate_version(version)) {
+      break;
+    }
+    auto child = fetch_node(child_page_no);
+    uint64_t child_version = child->page->get_version();
+    // 孩子版本号在父结点仍然有效时读出，之后孩子的分裂合并都会被发现
+    if ((child_version & 1) != 0 || !node->page->validate_version(version)) {
+      buffer_pool_manager_->unpin_page(child->page, false);
+      break;
+    }
+    pin_upper_node(node->page, level);
+    buffer_pool_manager_->unpin_page(node->page, false);
+    node = std::move(child);
+    version = child_version;
+  }
+  buffer_pool_manager_->unpin_page(node->page, false);
+  return nullptr;
+}
+
+/**
+ * @brief 单调递增插入（新的订单号、时间等）的快速路径：key大于最右叶子的最后一个key时一定插入到最右叶子的末尾，
+ * 不用从根下降，直接给最右叶子加写锁。和乐观下降一样，只有插入后叶子不用分裂时才返回；
+ * 要分裂时由find_leaf_page从根加锁，insert_entry把追加到最右叶子的分裂偏向右边
+ * @param key 编码后的key
+ * @return 加了写锁的最右叶子，key不是追加或者叶子要分裂时返回nullptr
+ * @note last_leaf_只在持有原最右叶子写锁时修改，加锁后再检查一次就能确定它仍是最右叶子
+ */
+std::shared_ptr<IxNodeHandle> IxIndexHandle::find_rightmost_leaf(
+    const char* key) {
+  if (key_prefix(key) < rightmost_hint_.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  page_id_t page_no =
+      __atomic_load_n(&file_hdr_->last_leaf_, __ATOMIC_ACQUIRE);
+  auto node = fetch_node(page_no);
+  node->page->WLatch();
+  if (file_hdr_->last_leaf_ == page_no && node->is_leaf_page() &&
+      node->get_size() > 0) {
+    char last_buf[IX_MAX_COL_LEN];
+    const char* last = node->get_last_key(last_buf);
+    if (Compare(key, last) > 0) {
+      if (node->isSafe(Operation::INSERT, key)) {
+        return node;
+      }
+    } else {
+      // 不是追加，记下最右叶子现在的最大key，之后更小的key不再来加锁
+      rightmost_hint_.store(key_prefix(last), std::memory_order_relaxed);
+    }
+  }
+  node->page->WUnlatch();
+  buffer_pool_manager_->unpin_page(node->page, false);
+  return nullptr;
+}
+
 /**
  * @brief 用于查找指定键在叶子结点中的对应的值result
  *
@@ -333,30 +651,262 @@ bool IxIndexHandle::get_value(const char* key, std::vector<Rid>* result,
   // 2. 在叶子节点中查找目标key值的位置，并读取key对应的rid
   // 3. 把rid存入result参数中
   // 提示：使用完buffer_pool提供的page之后，记得unpin page；记得处理并发的上锁
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
+  if (hash_ != nullptr) {
+    return hash_->get_value(key, result);
+  }
+  if (art_ != nullptr) {
+    Rid rid;
+    if (art_->get_value(key, &rid)) {
+      result->emplace_back(rid);
+      return true;
+    }
+    return false;
+  }
+  // 查找次数到阈值后才启用自适应哈希索引，之后不再计数
+  uint64_t hash = 0;
+  if (ahi_lookups_.load(std::memory_order_relaxed) < IX_AHI_MIN_LOOKUPS) {
+    ahi_lookups_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    hash = ahi_hash(key);
+    Rid rid;
+    if (ahi_lookup(key, hash, &rid)) {
+      result->emplace_back(rid);
+      return true;
+    }
+  }
   auto&& leaf_node =
       find_leaf_page(key, Operation::FIND, transaction, false).first;
-  Rid* rid;
-  if (leaf_node->leaf_lookup(key, &rid)) {
+  int pos = leaf_node->lower_bound(key);
+  if (pos < leaf_node->get_size() && leaf_node->compare_key(key, pos) == 0) {
+    // rid指向页面内部，放开读锁之前拷贝出来
+    result->emplace_back(*leaf_node->get_rid(pos));
+    if (hash != 0) {
+      ahi_remember(hash, *leaf_node, pos);
+    }
     leaf_node->page->RUnlatch();
-    buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
-    result->emplace_back(*rid);
+    buffer_pool_manager_->unpin_page(leaf_node->page, false);
     return true;
   }
   leaf_node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
+  buffer_pool_manager_->unpin_page(leaf_node->page, false);
   return false;
 }
 
+/**
+ * @brief 从叶子链表头开始顺序读所有叶子，把key加入新建的过滤器。
+ * 在构造函数中调用，这时索引还没有被其他线程使用，不用加锁
+ */
+void IxIndexHandle::build_bloom_filter() {
+  // 按每个结点装满估计key的数量，最多多分配一倍左右的位
+  size_t expected_keys =
+      static_cast<size_t>(file_hdr_->num_pages_) * file_hdr_->btree_order_;
+  bloom_ = std::make_unique<IxBloomFilter>(file_hdr_->col_tot_len_, expected_keys);
+  auto leaf_header = fetch_node(IX_LEAF_HEADER_PAGE);
+  page_id_t page_no = leaf_header->get_next_leaf();
+  buffer_pool_manager_->unpin_page(leaf_header->page, false);
+  char buf[IX_MAX_COL_LEN];
+  while (page_no != IX_LEAF_HEADER_PAGE && page_no != IX_NO_PAGE) {
+    auto leaf = fetch_node(page_no);
+    for (int i = 0; i < leaf->get_size(); ++i) {
+      bloom_->add(leaf->get_key(i, buf));
+    }
+    page_no = leaf->get_next_leaf();
+    buffer_pool_manager_->unpin_page(leaf->page, false);
+  }
+}
+
+/**
+ * @brief 批量等值查找。按编码后key的顺序处理，落在同一个叶子中的key沿用这个叶子，
+ * 并从上一个key的位置继续查找；key大于叶子中最后一个key时才放开叶子，重新从根下降
+ * @param keys 原始格式的key，不要求有序，可以重复
+ * @param result (*result)[i]为keys[i]对应的rid，不存在时为std::nullopt
+ */
+void IxIndexHandle::get_values(const std::vector<const char*>& keys,
+                               std::vector<std::optional<Rid>>* result,
+                               Transaction* transaction) {
+  result->assign(keys.size(), std::nullopt);
+  int key_len = file_hdr_->col_tot_len_;
+  std::vector<char> encoded(keys.size() * key_len);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    encode_key(keys[i], encoded.data() + i * key_len);
+  }
+  if (hash_ != nullptr) {
+    std::vector<Rid> rids;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      rids.clear();
+      if (hash_->get_value(encoded.data() + i * key_len, &rids)) {
+        (*result)[i] = rids.front();
+      }
+    }
+    return;
+  }
+  if (art_ != nullptr) {
+    Rid rid;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (art_->get_value(encoded.data() + i * key_len, &rid)) {
+        (*result)[i] = rid;
+      }
+    }
+    return;
+  }
+
+  std::vector<uint32_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return memcmp(encoded.data() + static_cast<size_t>(a) * key_len,
+                  encoded.data() + static_cast<size_t>(b) * key_len,
+                  key_len) < 0;
+  });
+
+  std::shared_ptr<IxNodeHandle> leaf_node;
+  int pos = 0;
+  char last_buf[IX_MAX_COL_LEN];
+  // 叶子加着读锁不会变；key不小于上一个key，不大于叶子的最后一个key，就一定在这个叶子的范围内
+  auto in_leaf = [&](const char* key) {
+    return leaf_node != nullptr && (leaf_node->get_size() == 0 ||
+                                    Compare(key, leaf_node->get_last_key(last_buf)) <= 0);
+  };
+  auto release_leaf = [&] {
+    if (leaf_node != nullptr) {
+      leaf_node->page->RUnlatch();
+      buffer_pool_manager_->unpin_page(leaf_node->page, false);
+      leaf_node = nullptr;
+    }
+  };
+  auto probe = [&](uint32_t idx, const char* key) {
+    pos = leaf_node->search<false>(key, pos);
+    if (pos < leaf_node->get_size() && leaf_node->compare_key(key, pos) == 0) {
+      (*result)[idx] = *leaf_node->get_rid(pos);
+    }
+  };
+  auto key_at = [&](size_t i) {
+    return encoded.data() + static_cast<size_t>(order[i]) * key_len;
+  };
+
+  // 落在当前叶子中的key直接查；之后的IX_PROBE_GROUP个key交错下降，相邻的key落在同一个叶子时共用
+  const char* group_keys[IX_PROBE_GROUP];
+  std::shared_ptr<IxNodeHandle> group_leaves[IX_PROBE_GROUP];
+  uint64_t group_versions[IX_PROBE_GROUP];
+  size_t i = 0;
+  while (i < order.size()) {
+    for (; i < order.size() && in_leaf(key_at(i)); ++i) {
+      probe(order[i], key_at(i));
+    }
+    release_leaf();
+    int n = static_cast<int>(std::min<size_t>(IX_PROBE_GROUP, order.size() - i));
+    for (int j = 0; j < n; ++j) {
+      group_keys[j] = key_at(i + j);
+    }
+    find_leaves_interleaved(group_keys, n, group_leaves, group_versions);
+    for (int j = 0; j < n; ++j, ++i) {
+      auto& leaf = group_leaves[j];
+      if (in_leaf(group_keys[j])) {
+        if (leaf != nullptr) {
+          buffer_pool_manager_->unpin_page(leaf->page, false);
+          leaf = nullptr;
+        }
+        probe(order[i], group_keys[j]);
+        continue;
+      }
+      release_leaf();
+      if (leaf != nullptr) {
+        leaf->page->RLatch();
+        if (!leaf->page->validate_version(group_versions[j])) {
+          leaf->page->RUnlatch();
+          buffer_pool_manager_->unpin_page(leaf->page, false);
+          leaf = nullptr;
+        }
+      }
+      leaf_node = leaf != nullptr
+                      ? std::move(leaf)
+                      : find_leaf_page(group_keys[j], Operation::FIND,
+                                       transaction, false)
+                            .first;
+      leaf = nullptr;
+      pos = 0;
+      probe(order[i], group_keys[j]);
+    }
+  }
+  release_leaf();
+}
+
+void IxIndexHandle::find_leaves_interleaved(
+    const char* const* keys, int n, std::shared_ptr<IxNodeHandle>* leaves,
+    uint64_t* versions) {
+  page_id_t root_page_no =
+      __atomic_load_n(&file_hdr_->root_page_, __ATOMIC_ACQUIRE);
+  for (int i = 0; i < n; ++i) {
+    leaves[i] = fetch_node(root_page_no);
+    versions[i] = leaves[i]->page->get_version();
+  }
+  if ((versions[0] & 1) != 0 ||
+      __atomic_load_n(&file_hdr_->root_page_, __ATOMIC_ACQUIRE) !=
+          root_page_no) {
+    for (int i = 0; i < n; ++i) {
+      buffer_pool_manager_->unpin_page(leaves[i]->page, false);
+      leaves[i] = nullptr;
+    }
+    return;
+  }
+  // B+树是平衡的，所有下降同时到达叶子；每一轮每个下降走一层，和find_leaf_page_optimistic一样校验版本号
+  for (int level = 0;; ++level) {
+    bool descended = false;
+    for (int i = 0; i < n; ++i) {
+      auto& node = leaves[i];
+      if (node == nullptr || (node->page->validate_version(versions[i]) &&
+                              node->is_leaf_page())) {
+        continue;
+      }
+      std::shared_ptr<IxNodeHandle> child;
+      page_id_t child_page_no = node->page->validate_version(versions[i])
+                                    ? node->internal_lookup(keys[i])
+                                    : IX_NO_PAGE;
+      // 页号可能是读到一半的结果，先确认父结点没有变化再去获取孩子
+      if (child_page_no != IX_NO_PAGE &&
+          node->page->validate_version(versions[i])) {
+        child = fetch_node(child_page_no);
+        uint64_t child_version = child->page->get_version();
+        if ((child_version & 1) != 0 ||
+            !node->page->validate_version(versions[i])) {
+          buffer_pool_manager_->unpin_page(child->page, false);
+          child = nullptr;
+        } else {
+          versions[i] = child_version;
+          child->prefetch();
+        }
+      }
+      if (child != nullptr) {
+        pin_upper_node(node->page, level);
+      }
+      buffer_pool_manager_->unpin_page(node->page, false);
+      node = std::move(child);
+      descended = true;
+    }
+    if (!descended) {
+      break;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    if (leaves[i] != nullptr && !leaves[i]->page->validate_version(versions[i])) {
+      buffer_pool_manager_->unpin_page(leaves[i]->page, false);
+      leaves[i] = nullptr;
+    }
+  }
+}
+
 /**
  * @brief  将传入的一个node拆分(Split)成两个结点，在node的右边生成一个新结点new
  * node
  * @param node 需要拆分的结点
+ * @param split_point [split_point, num_key)的键值对移到new node，叶子结点可以是0或num_key
  * @return 拆分得到的new_node
  * @note need to unpin the new node outside
  * 注意：本函数执行完毕后，原node和new node都需要在函数外面进行unpin
  */
 std::shared_ptr<IxNodeHandle> IxIndexHandle::split(
-    std::shared_ptr<IxNodeHandle>& node) {
+    std::shared_ptr<IxNodeHandle>& node, int split_point) {
   // Todo:
   // 1. 将原结点的键值对平均分配，右半部分分裂为新的右兄弟结点
   //    需要初始化新节点的page_hdr内容
@@ -366,7 +916,6 @@ std::shared_ptr<IxNodeHandle> IxIndexHandle::split(
   // 如果新的右兄弟结点不是叶子结点，更新该结点的所有孩子结点的父节点信息(使用IxIndexHandle::maintain_child())
   auto new_sibling_node = create_node();
   new_sibling_node->page->WLatch();
-  auto&& split_point = node->get_min_size();
   if (node->is_leaf_page()) {
     // 更新左右叶子节点关系
     new_sibling_node->set_prev_leaf(node->get_page_no());
@@ -378,18 +927,38 @@ std::shared_ptr<IxNodeHandle> IxIndexHandle::split(
     next_leaf->page->WLatch();
     next_leaf->set_prev_leaf(new_sibling_node->get_page_no());
     next_leaf->page->WUnlatch();
-    buffer_pool_manager_->unpin_page(next_leaf->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(next_leaf->page, true);
   }
   // 记得维护节点元信息
   new_sibling_node->page_hdr->num_key = 0;
   new_sibling_node->page_hdr->is_leaf = node->is_leaf_page();
   new_sibling_node->page_hdr->parent = node->get_parent_page_no();
-  // 插入到右兄弟节点
-  new_sibling_node->insert_pairs(0, node->get_key(split_point),
-                                 node->get_rid(split_point),
-                                 node->page_hdr->num_key - split_point);
+  new_sibling_node->page_hdr->prefix_len = 0;
+  // 插入到右兄弟节点，叶子结点的key带有前缀，先拼成完整的key
+  int num_moved = node->get_size() - split_point;
+  int cols_len = file_hdr_->col_tot_len_;
+  std::vector<char> keys_buf(static_cast<size_t>(num_moved) * cols_len);
+  for (int i = 0; i < num_moved; ++i) {
+    char* dest = keys_buf.data() + i * cols_len;
+    const char* key = node->get_key(split_point + i, dest);
+    if (key != dest) {
+      memcpy(dest, key, cols_len);
+    }
+  }
+  new_sibling_node->insert_pairs(0, keys_buf.data(), node->get_rid(split_point),
+                                 num_moved);
   // 这里直接设置 size，软移除
   node->set_size(split_point);
+  // 剩下的key范围变小，前缀可能变长
+  if (node->is_leaf_page() && split_point > 0) {
+    char first_buf[IX_MAX_COL_LEN];
+    char last_buf[IX_MAX_COL_LEN];
+    int prefix_len = common_prefix_len(node->get_key(0, first_buf),
+                                       node->get_last_key(last_buf), cols_len);
+    if (prefix_len > node->get_prefix_len()) {
+      node->set_prefix_len(prefix_len);
+    }
+  }
 
   // ！如果是内部节点，还需要维护孩子节点关系
   if (new_sibling_node->is_internal_page()) {
@@ -410,15 +979,17 @@ std::shared_ptr<IxNodeHandle> IxIndexHandle::split(
  * @param (old_node, new_node)
  * 原结点为old_node，old_node被分裂之后产生了新的右兄弟结点new_node
  * @param key 要插入parent的key
+ * @param rightmost new_node是否是这一层最右的结点（追加到最右叶子引起的分裂），是时父结点分裂也偏向右边
  * @note
  * 一个结点插入了键值对之后需要分裂，分裂后左半部分的键值对保留在原结点，在参数中称为old_node，
  * 右半部分的键值对分裂为新的右兄弟节点，在参数中称为new_node（参考Split函数来理解old_node和new_node）
- * @note 本函数执行完毕后，new node和old node都需要在函数外面进行unpin
+ * @note 本函数执行完毕后，new node和old node都需要在函数外面进行unpin；根锁也由调用者放开
  */
 void IxIndexHandle::insert_into_parent(std::shared_ptr<IxNodeHandle>& old_node,
                                        const char* key,
                                        std::shared_ptr<IxNodeHandle>& new_node,
-                                       Transaction* transaction) {
+                                       Transaction* transaction,
+                                       bool rightmost) {
   // Todo:
   // 1. 分裂前的结点（原结点,
   // old_node）是否为根结点，如果为根结点需要分配新的root
@@ -433,7 +1004,9 @@ void IxIndexHandle::insert_into_parent(std::shared_ptr<IxNodeHandle>& old_node,
     new_root->page_hdr->num_key = 0;
     new_root->page_hdr->is_leaf = false;
     new_root->page_hdr->prev_leaf = new_root->page_hdr->next_leaf = IX_NO_PAGE;
-    new_root->insert_pair(0, old_node->get_key(0),
+    new_root->page_hdr->prefix_len = 0;
+    char first_buf[IX_MAX_COL_LEN];
+    new_root->insert_pair(0, old_node->get_key(0, first_buf),
                           {old_node->get_page_no(), -1});
     new_root->insert_pair(1, key, {new_node->get_page_no(), -1});
 
@@ -441,29 +1014,33 @@ void IxIndexHandle::insert_into_parent(std::shared_ptr<IxNodeHandle>& old_node,
     old_node->set_parent_page_no(new_root->get_page_no());
     new_node->set_parent_page_no(new_root->get_page_no());
 
-    // 成为新的根节点
-    file_hdr_->root_page_ = new_root->get_page_no();
+    // 成为新的根节点，乐观读不加根锁读取root_page_，新根的内容要先于页号可见
+    __atomic_store_n(&file_hdr_->root_page_, new_root->get_page_no(),
+                     __ATOMIC_RELEASE);
 
-    // 维护完毕，释放根锁
-    root_latch_.unlock();
-    buffer_pool_manager_->unpin_page(new_root->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(new_root->page, true);
     release_all_index_latch_page(transaction);
   } else {
     // 获取原结点（old_node）的父亲结点
     auto&& parent_node = fetch_node(old_node->get_parent_page_no());
     // 将新右兄弟节点头记录信息插入
-    parent_node->insert_pair(parent_node->find_child(old_node) + 1, key,
-                             {new_node->get_page_no(), -1});
+    int child_pos = parent_node->find_child(old_node) + 1;
+    parent_node->insert_pair(child_pos, key, {new_node->get_page_no(), -1});
     // 插入后满了
     if (parent_node->isFull()) {
-      auto&& new_sibling_node = split(parent_node);
-      insert_into_parent(parent_node, new_sibling_node->get_key(0),
-                         new_sibling_node, transaction);
+      // 新结点是这一层最右的结点时父结点也是最右的，同样只把新结点分到右边
+      bool append = rightmost && child_pos == parent_node->get_size() - 1;
+      auto&& new_sibling_node =
+          split(parent_node, append ? parent_node->get_size() - 1
+                                    : parent_node->get_size() / 2);
+      char first_buf[IX_MAX_COL_LEN];
+      insert_into_parent(parent_node, new_sibling_node->get_key(0, first_buf),
+                         new_sibling_node, transaction, append);
       new_sibling_node->page->WUnlatch();
-      buffer_pool_manager_->unpin_page(new_sibling_node->get_page_id(), true);
+      buffer_pool_manager_->unpin_page(new_sibling_node->page, true);
     }
     release_all_index_latch_page(transaction);
-    buffer_pool_manager_->unpin_page(parent_node->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(parent_node->page, true);
   }
 }
 
@@ -471,23 +1048,39 @@ void IxIndexHandle::insert_into_parent(std::shared_ptr<IxNodeHandle>& old_node,
 bool IxIndexHandle::is_unique(const char* key, Rid& value,
                               Transaction* transaction) {
   // 操作应该为insert
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
+  // 单调递增的新key几乎都在这里返回，不用下降
+  if (bloom_ != nullptr && !bloom_->might_contain(key)) {
+    return true;
+  }
+  if (hash_ != nullptr) {
+    std::vector<Rid> rids;
+    if (hash_->get_value(key, &rids)) {
+      value = rids.front();
+      return false;
+    }
+    return true;
+  }
+  if (art_ != nullptr) {
+    return !art_->get_value(key, &value);
+  }
   auto&& [leaf_node, is_root_locked] =
       find_leaf_page(key, Operation::FIND, transaction, false);
   if (is_root_locked) {
-    root_latch_.unlock();
+    root_latch_.WUnlock();
   }
   int pos = leaf_node->lower_bound(key);
-  if (pos == leaf_node->page_hdr->num_key ||
-      Compare(key, leaf_node->get_key(pos))) {
+  if (pos == leaf_node->page_hdr->num_key || leaf_node->compare_key(key, pos)) {
     // 释放写锁
     leaf_node->page->RUnlatch();
-    buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
+    buffer_pool_manager_->unpin_page(leaf_node->page, false);
     return true;
   }
   value = *leaf_node->get_rid(pos);
   // 释放写锁
   leaf_node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
+  buffer_pool_manager_->unpin_page(leaf_node->page, false);
   return false;
 }
 
@@ -505,22 +1098,42 @@ page_id_t IxIndexHandle::insert_entry(const char* key, const Rid& value,
   // 3. 如果结点已满，分裂结点，并把新结点的相关信息插入父节点
   // 提示：记得unpin
   // page；若当前叶子节点是最右叶子节点，则需要更新file_hdr_.last_leaf；记得处理并发的上锁
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
+  if (hash_ != nullptr) {
+    return hash_->insert_entry(key, value, transaction);
+  }
+  // ART索引没有页面，插入成功时返回文件头的页号
+  if (art_ != nullptr) {
+    return art_->insert_entry(key, value) ? IX_FILE_HDR_PAGE : IX_NO_PAGE;
+  }
+  // 先于插入树中加入过滤器，并发的is_unique不会在key已经进树后还得到不存在
+  if (bloom_ != nullptr) {
+    bloom_->add(key);
+  }
   auto&& [leaf_node, is_root_locked] =
       find_leaf_page(key, Operation::INSERT, transaction, false);
   int old_size = leaf_node->get_size();
+  // key不带有叶子的前缀，缩短前缀后叶子放不下：这时key一定在叶子所有key之前或之后，
+  // 不平分叶子，而是在这一侧分出只有key的新结点，叶子原来的key和前缀都不用动
+  if (!leaf_node->has_room_for(key)) {
+    return insert_at_boundary(leaf_node, key, value, transaction,
+                              is_root_locked);
+  }
   // key 重复
   const auto& [new_size, pos] = leaf_node->insert(key, value);
   if (new_size == old_size) {
     if (is_root_locked) {
-      root_latch_.unlock();
+      root_latch_.WUnlock();
     }
     // 处理事务
     release_all_index_latch_page(transaction);
     // 解锁和 unpin
     leaf_node->page->WUnlatch();
-    buffer_pool_manager_->unpin_page(leaf_node->page->get_page_id(), false);
+    buffer_pool_manager_->unpin_page(leaf_node->page, false);
     return IX_NO_PAGE;
   }
+  leaf_node->stamp_lsn(transaction);
 
   // 优化，只有插入在第一个key位置时，才需要在父节点中向上更新node的第一个key
   if (pos == 0) {
@@ -530,33 +1143,173 @@ page_id_t IxIndexHandle::insert_entry(const char* key, const Rid& value,
   page_id_t return_page_id = INVALID_PAGE_ID;
   // 如果结点已满，分裂结点，并把新结点的相关信息插入父节点
   if (leaf_node->isFull()) {
-    auto&& new_sibling_node = split(leaf_node);
+    // 追加到最右叶子的末尾时只把新key分到右边，左边的叶子保持满的，单调递增插入的叶子不会只填一半
+    bool append = leaf_node->get_page_no() == file_hdr_->last_leaf_ &&
+                  pos == leaf_node->get_size() - 1;
+    auto&& new_sibling_node =
+        split(leaf_node, append ? leaf_node->get_size() - 1
+                                : leaf_node->get_size() / 2);
     // 分裂完成后兄弟叶子节点关系已经维护好了
     // 维护最右的叶子节点
     if (leaf_node->get_page_no() == file_hdr_->last_leaf_) {
-      file_hdr_->last_leaf_ = new_sibling_node->get_page_no();
+      __atomic_store_n(&file_hdr_->last_leaf_, new_sibling_node->get_page_no(),
+                       __ATOMIC_RELEASE);
+    }
+    char first_buf[IX_MAX_COL_LEN];
+    insert_into_parent(leaf_node, new_sibling_node->get_key(0, first_buf),
+                       new_sibling_node, transaction, append);
+    if (is_root_locked) {
+      root_latch_.WUnlock();
     }
-    insert_into_parent(leaf_node, new_sibling_node->get_key(0),
-                       new_sibling_node, transaction);
     leaf_node->page->WUnlatch();
     // 如果分裂后插入的key在兄弟叶子节点
-    if (Compare(new_sibling_node->get_key(new_sibling_node->lower_bound(key)),
-                key) == 0) {
+    if (new_sibling_node->compare_key(key, 0) >= 0) {
       return_page_id = new_sibling_node->get_page_no();
     } else {
       return_page_id = leaf_node->get_page_no();
     }
     new_sibling_node->page->WUnlatch();
-    buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), true);
-    buffer_pool_manager_->unpin_page(new_sibling_node->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(leaf_node->page, true);
+    buffer_pool_manager_->unpin_page(new_sibling_node->page, true);
     return return_page_id;
   }
 
+  // 不分裂时key落在第0个位置也会让叶子不安全，根锁和祖先的写锁要在这里放开
+  if (is_root_locked) {
+    root_latch_.WUnlock();
+  }
+  release_all_index_latch_page(transaction);
   // 先解写锁 写锁不影响 pageId
   leaf_node->page->WUnlatch();
   // unpin 之后page可能会被替换 拷贝下页id
   return_page_id = leaf_node->get_page_no();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(leaf_node->page, true);
+  return return_page_id;
+}
+
+/**
+ * @brief 批量插入。和get_values一样按编码后key的顺序处理并沿用当前加着写锁的叶子：
+ * key落在叶子的范围内，插入后叶子不用分裂，也不在第0个位置（不用改父结点）时直接插入；
+ * 否则放开叶子，这个key按insert_entry的方式插入，下一个key再乐观地找叶子
+ * @param keys 原始格式的key，不要求有序
+ * @param rids rids[i]为keys[i]的值
+ * @return int 已经存在、没有插入的key的数量
+ */
+int IxIndexHandle::insert_entries(const std::vector<const char*>& keys,
+                                  const std::vector<Rid>& rids,
+                                  Transaction* transaction) {
+  int key_len = file_hdr_->col_tot_len_;
+  std::vector<char> encoded(keys.size() * key_len);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    encode_key(keys[i], encoded.data() + i * key_len);
+  }
+  int num_existing = 0;
+  if (hash_ != nullptr) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (hash_->insert_entry(encoded.data() + i * key_len, rids[i],
+                              transaction) == IX_NO_PAGE) {
+        ++num_existing;
+      }
+    }
+    return num_existing;
+  }
+  if (art_ != nullptr) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (!art_->insert_entry(encoded.data() + i * key_len, rids[i])) {
+        ++num_existing;
+      }
+    }
+    return num_existing;
+  }
+
+  std::vector<uint32_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return memcmp(encoded.data() + static_cast<size_t>(a) * key_len,
+                  encoded.data() + static_cast<size_t>(b) * key_len,
+                  key_len) < 0;
+  });
+
+  std::shared_ptr<IxNodeHandle> leaf_node;
+  char last_buf[IX_MAX_COL_LEN];
+  for (uint32_t idx : order) {
+    const char* key = encoded.data() + static_cast<size_t>(idx) * key_len;
+    if (bloom_ != nullptr) {
+      bloom_->add(key);
+    }
+    // key不小于叶子的最后一个key时可能属于右边的叶子，只有最右的叶子可以直接插入
+    if (leaf_node != nullptr &&
+        (!leaf_node->isSafe(Operation::INSERT, key) ||
+         (Compare(key, leaf_node->get_last_key(last_buf)) >= 0 &&
+          leaf_node->get_page_no() != file_hdr_->last_leaf_))) {
+      leaf_node->page->WUnlatch();
+      buffer_pool_manager_->unpin_page(leaf_node->page, true);
+      leaf_node = nullptr;
+    }
+    if (leaf_node == nullptr) {
+      leaf_node = find_rightmost_leaf(key);
+    }
+    if (leaf_node == nullptr) {
+      leaf_node = find_leaf_page_optimistic(key, false, Operation::INSERT);
+      if (leaf_node == nullptr) {
+        if (insert_entry(keys[idx], rids[idx], transaction) == IX_NO_PAGE) {
+          ++num_existing;
+        }
+        continue;
+      }
+    }
+    int old_size = leaf_node->get_size();
+    if (leaf_node->insert(key, rids[idx]).first == old_size) {
+      ++num_existing;
+    } else {
+      leaf_node->stamp_lsn(transaction);
+    }
+  }
+  if (leaf_node != nullptr) {
+    leaf_node->page->WUnlatch();
+    buffer_pool_manager_->unpin_page(leaf_node->page, true);
+  }
+  return num_existing;
+}
+
+/**
+ * @brief insert_entry中key放不进叶子时调用：key小于叶子的第一个key时，叶子原有的键值对整体移到右边的新结点，
+ * key留在叶子中；否则key放到右边的新结点中
+ * @param leaf_node 加了写锁的叶子结点，函数中解锁并unpin
+ * @param (key, value) 要插入的键值对，key已编码
+ * @param is_root_locked 是否持有根锁，函数中放开
+ * @return page_id_t 插入到的叶结点的page_no
+ */
+page_id_t IxIndexHandle::insert_at_boundary(
+    std::shared_ptr<IxNodeHandle>& leaf_node, const char* key,
+    const Rid& value, Transaction* transaction, bool is_root_locked) {
+  bool key_first = leaf_node->compare_key(key, 0) < 0;
+  auto&& new_sibling_node =
+      split(leaf_node, key_first ? 0 : leaf_node->get_size());
+  auto& target_node = key_first ? leaf_node : new_sibling_node;
+  target_node->insert_pair(0, key, value);
+  leaf_node->stamp_lsn(transaction);
+  new_sibling_node->stamp_lsn(transaction);
+  if (key_first) {
+    maintain_parent(leaf_node);
+  }
+  bool append = false;
+  if (leaf_node->get_page_no() == file_hdr_->last_leaf_) {
+    append = !key_first;
+    __atomic_store_n(&file_hdr_->last_leaf_, new_sibling_node->get_page_no(),
+                     __ATOMIC_RELEASE);
+  }
+  char first_buf[IX_MAX_COL_LEN];
+  insert_into_parent(leaf_node, new_sibling_node->get_key(0, first_buf),
+                     new_sibling_node, transaction, append);
+  if (is_root_locked) {
+    root_latch_.WUnlock();
+  }
+  page_id_t return_page_id = target_node->get_page_no();
+  leaf_node->page->WUnlatch();
+  new_sibling_node->page->WUnlatch();
+  buffer_pool_manager_->unpin_page(leaf_node->page, true);
+  buffer_pool_manager_->unpin_page(new_sibling_node->page, true);
   return return_page_id;
 }
 
@@ -573,6 +1326,14 @@ bool IxIndexHandle::delete_entry(const char* key, Transaction* transaction) {
   // 如果删除成功需要调用CoalesceOrRedistribute来进行合并或重分配操作，并根据函数返回结果判断是否有结点需要删除
   // 4.
   // 如果需要并发，并且需要删除叶子结点，则需要在事务的delete_page_set中添加删除结点的对应页面；记得处理并发的上锁
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
+  if (hash_ != nullptr) {
+    return hash_->delete_entry(key, transaction);
+  }
+  if (art_ != nullptr) {
+    return art_->delete_entry(key);
+  }
   auto&& [leaf_node, is_root_locked] =
       find_leaf_page(key, Operation::DELETE, transaction, false);
   int old_size = leaf_node->get_size();
@@ -580,15 +1341,16 @@ bool IxIndexHandle::delete_entry(const char* key, Transaction* transaction) {
   const auto& [new_size, pos] = leaf_node->remove(key);
   if (new_size == old_size) {
     if (is_root_locked) {
-      root_latch_.unlock();
+      root_latch_.WUnlock();
     }
     // 处理事务
     release_all_index_latch_page(transaction);
     // 解锁和 unpin
     leaf_node->page->WUnlatch();
-    buffer_pool_manager_->unpin_page(leaf_node->page->get_page_id(), false);
+    buffer_pool_manager_->unpin_page(leaf_node->page, false);
     return false;
   }
+  leaf_node->stamp_lsn(transaction);
 
   // 优化，只有删除在第一个key位置时，才需要在父节点中向上更新node的第一个key
   if (pos == 0) {
@@ -599,11 +1361,11 @@ bool IxIndexHandle::delete_entry(const char* key, Transaction* transaction) {
   bool is_delete =
       coalesce_or_redistribute(leaf_node, transaction, &is_root_locked);
   if (is_root_locked) {
-    root_latch_.unlock();
+    root_latch_.WUnlock();
   }
   release_all_index_latch_page(transaction);
   leaf_node->page->WUnlatch();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(leaf_node->page, true);
   if (is_delete) {
     // assert(buffer_pool_manager_->delete_page(leaf_node->get_page_id()));
   }
@@ -617,6 +1379,80 @@ bool IxIndexHandle::delete_entry(const char* key, Transaction* transaction) {
   return true;
 }
 
+/**
+ * @brief 批量删除。按编码后key的顺序处理并沿用当前加着写锁的叶子：key不大于叶子的最后一个key，
+ * 删除后叶子不少于半满，也不在第0个位置时直接删除，合并和重分配推迟到叶子真的不够半满时；
+ * 否则放开叶子，这个key按delete_entry的方式删除并调整树，下一个key再乐观地找叶子
+ * @param keys 原始格式的key，不要求有序
+ * @return int 删除的key的数量
+ */
+int IxIndexHandle::delete_entries(const std::vector<const char*>& keys,
+                                  Transaction* transaction) {
+  int key_len = file_hdr_->col_tot_len_;
+  std::vector<char> encoded(keys.size() * key_len);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    encode_key(keys[i], encoded.data() + i * key_len);
+  }
+  int num_deleted = 0;
+  if (hash_ != nullptr) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (hash_->delete_entry(encoded.data() + i * key_len, transaction)) {
+        ++num_deleted;
+      }
+    }
+    return num_deleted;
+  }
+  if (art_ != nullptr) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (art_->delete_entry(encoded.data() + i * key_len)) {
+        ++num_deleted;
+      }
+    }
+    return num_deleted;
+  }
+
+  std::vector<uint32_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return memcmp(encoded.data() + static_cast<size_t>(a) * key_len,
+                  encoded.data() + static_cast<size_t>(b) * key_len,
+                  key_len) < 0;
+  });
+
+  std::shared_ptr<IxNodeHandle> leaf_node;
+  char last_buf[IX_MAX_COL_LEN];
+  for (uint32_t idx : order) {
+    const char* key = encoded.data() + static_cast<size_t>(idx) * key_len;
+    // 大于叶子最后一个key的key可能在右边的叶子中
+    if (leaf_node != nullptr &&
+        (!leaf_node->isSafe(Operation::DELETE, key) ||
+         Compare(key, leaf_node->get_last_key(last_buf)) > 0)) {
+      leaf_node->page->WUnlatch();
+      buffer_pool_manager_->unpin_page(leaf_node->page, true);
+      leaf_node = nullptr;
+    }
+    if (leaf_node == nullptr) {
+      leaf_node = find_leaf_page_optimistic(key, false, Operation::DELETE);
+      if (leaf_node == nullptr) {
+        if (delete_entry(keys[idx], transaction)) {
+          ++num_deleted;
+        }
+        continue;
+      }
+    }
+    int old_size = leaf_node->get_size();
+    if (leaf_node->remove(key).first != old_size) {
+      leaf_node->stamp_lsn(transaction);
+      ++num_deleted;
+    }
+  }
+  if (leaf_node != nullptr) {
+    leaf_node->page->WUnlatch();
+    buffer_pool_manager_->unpin_page(leaf_node->page, true);
+  }
+  return num_deleted;
+}
+
 /**
  * @brief 用于当根结点被删除了一个键值对之后的处理
  * @param old_root_node 原根节点
@@ -639,11 +1475,13 @@ bool IxIndexHandle::adjust_root(std::shared_ptr<IxNodeHandle>& old_root_node) {
   }
   if (old_root_node->is_internal_page() && old_root_node->get_size() == 1) {
     // 内部结点且大小为1，更新根结点为唯一子结点
-    file_hdr_->root_page_ = old_root_node->remove_and_return_only_child();
+    __atomic_store_n(&file_hdr_->root_page_,
+                     old_root_node->remove_and_return_only_child(),
+                     __ATOMIC_RELEASE);
     // 获取新的根结点并更新其父结点信息
     auto new_root_node = fetch_node(file_hdr_->root_page_);
     new_root_node->set_parent_page_no(IX_NO_PAGE);
-    buffer_pool_manager_->unpin_page(new_root_node->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(new_root_node->page, true);
     // 先不管删除
     // buffer_pool_manager_->delete_page(old_root_node->get_page_id());
     // 释放旧的根结点
@@ -682,23 +1520,24 @@ void IxIndexHandle::redistribute(std::shared_ptr<IxNodeHandle>& neighbor_node,
   // 注意：neighbor_node的位置不同，需要移动的键值对不同，需要分类讨论
   // 因为node节点被删除，缺一个，兄弟节点给出一个
   // node(left) neighbor(right)
+  char key_buf[IX_MAX_COL_LEN];
   if (index == 0) {
-    node->insert_pair(node->get_size(), neighbor_node->get_key(0),
+    node->insert_pair(node->get_size(), neighbor_node->get_key(0, key_buf),
                       neighbor_node->get_rid(0));
     neighbor_node->erase_pair(0);
     // 更新父节点 index + 1 对应为右兄弟节点的第一个 key
     // 以满足小于 index + 1 的 key 指向 node，大于等于 index + 1 的 key 指向
     // neighbor
-    parent->set_key(index + 1, neighbor_node->get_key(0));
+    parent->set_key(index + 1, neighbor_node->get_key(0, key_buf));
     // maintain_parent(neighbor_node);
     // 叶子节点才需要更新孩子节点的父节点信息
     maintain_child(node, node->get_size() - 1);
   } else {
     // neighbor(left) node(right)
-    node->insert_pair(0, neighbor_node->get_last_key(),
+    node->insert_pair(0, neighbor_node->get_last_key(key_buf),
                       neighbor_node->get_last_rid());
     neighbor_node->erase_pair(neighbor_node->get_size() - 1);
-    parent->set_key(index, node->get_key(0));
+    parent->set_key(index, node->get_key(0, key_buf));
     // maintain_parent(node);
     // 叶子节点才需要更新孩子节点的父节点信息
     maintain_child(node, 0);
@@ -747,8 +1586,19 @@ bool IxIndexHandle::coalesce(std::shared_ptr<IxNodeHandle>* neighbor_node,
   auto& node_ = *node;
   auto& neighbor_node_ = *neighbor_node;
   auto&& prev_size = neighbor_node_->get_size();
-  neighbor_node_->insert_pairs(prev_size, node_->keys, node_->rids,
-                               node_->get_size());
+  // 两个结点的键值对数量之和小于没有前缀时的容量，合并后无论前缀多长都放得下
+  int num_moved = node_->get_size();
+  int cols_len = file_hdr_->col_tot_len_;
+  std::vector<char> keys_buf(static_cast<size_t>(num_moved) * cols_len);
+  for (int i = 0; i < num_moved; ++i) {
+    char* dest = keys_buf.data() + i * cols_len;
+    const char* key = node_->get_key(i, dest);
+    if (key != dest) {
+      memcpy(dest, key, cols_len);
+    }
+  }
+  neighbor_node_->insert_pairs(prev_size, keys_buf.data(), node_->get_rid(0),
+                               num_moved);
 
   // 非叶子节点才需要维护node结点孩子结点的父节点信息
   if (node_->is_internal_page()) {
@@ -760,7 +1610,8 @@ bool IxIndexHandle::coalesce(std::shared_ptr<IxNodeHandle>* neighbor_node,
     erase_leaf(node_);
     if (node_->get_page_no() == file_hdr_->last_leaf_) {
       // 如果是叶子结点且为最右叶子结点，需要更新file_hdr_.last_leaf
-      file_hdr_->last_leaf_ = neighbor_node_->get_page_no();
+      __atomic_store_n(&file_hdr_->last_leaf_, neighbor_node_->get_page_no(),
+                       __ATOMIC_RELEASE);
     }
   }
 
@@ -803,7 +1654,7 @@ bool IxIndexHandle::coalesce_or_redistribute(
     // 函数来进行处理，返回根节点是否需要被删除
     bool is_delete = adjust_root(node);
     if (*root_is_latched) {
-      root_latch_.unlock();
+      root_latch_.WUnlock();
       *root_is_latched = false;
     }
     // !TODO 完善并发事务
@@ -829,14 +1680,14 @@ bool IxIndexHandle::coalesce_or_redistribute(
                                                           << 1) {
     // 可以提前释放根锁了
     if (*root_is_latched) {
-      root_latch_.unlock();
+      root_latch_.WUnlock();
       *root_is_latched = false;
     }
     redistribute(neighbor_node, node, parent_node, index);
     release_all_index_latch_page(transaction);
-    buffer_pool_manager_->unpin_page(parent_node->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(parent_node->page, true);
     neighbor_node->page->WUnlatch();
-    buffer_pool_manager_->unpin_page(neighbor_node->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(neighbor_node->page, true);
     return false;
   }
 
@@ -849,9 +1700,9 @@ bool IxIndexHandle::coalesce_or_redistribute(
     }
   }
 
-  buffer_pool_manager_->unpin_page(parent_node->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(parent_node->page, true);
   neighbor_node->page->WUnlatch();
-  buffer_pool_manager_->unpin_page(neighbor_node->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(neighbor_node->page, true);
   return true;
 }
 
@@ -874,7 +1725,7 @@ Rid IxIndexHandle::get_rid(const Iid& iid) const {
   }
   auto rid = *node->get_rid(iid.slot_no);
   // node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(node->get_page_id(), false);  // unpin it!
+  buffer_pool_manager_->unpin_page(node->page, false);  // unpin it!
   return rid;
 }
 
@@ -883,10 +1734,14 @@ Rid IxIndexHandle::get_rid(const Iid& iid) const {
  *
  * @param key
  * @return Iid
- * @note 上层传入的key本来是int类型，通过(const char *)&key进行了转换
- * 可用*(int *)key转换回去
+ * @note key为原始格式，先编码再查找
  */
 Iid IxIndexHandle::lower_bound(const char* key) {
+  if (hash_ != nullptr || art_ != nullptr) {
+    throw InternalError("Only B+ tree indexes support leaf positions");
+  }
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
   auto&& leaf_node = find_leaf_page(key, Operation::FIND, nullptr, false).first;
   auto&& pos = leaf_node->lower_bound(key);
   Iid iid{};
@@ -902,7 +1757,7 @@ Iid IxIndexHandle::lower_bound(const char* key) {
     iid = {leaf_node->get_page_no(), pos};
   }
   leaf_node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
+  buffer_pool_manager_->unpin_page(leaf_node->page, false);
   return iid;
 }
 
@@ -913,11 +1768,16 @@ Iid IxIndexHandle::lower_bound(const char* key) {
  * @return Iid
  */
 Iid IxIndexHandle::upper_bound(const char* key) {
+  if (hash_ != nullptr || art_ != nullptr) {
+    throw InternalError("Only B+ tree indexes support leaf positions");
+  }
+  char encoded[IX_MAX_COL_LEN];
+  key = encode_key(key, encoded);
   auto&& leaf_node = find_leaf_page(key, Operation::FIND, nullptr, false).first;
   auto&& pos = leaf_node->upper_bound(key);
   Iid iid{};
   // 如果第一个比他大的在第 0 个 key
-  if (pos == 1 && Compare(key, leaf_node->get_key(0)) < 0) {
+  if (pos == 1 && leaf_node->compare_key(key, 0) < 0) {
     --pos;
   }
   if (pos == leaf_node->get_size()) {
@@ -932,10 +1792,250 @@ Iid IxIndexHandle::upper_bound(const char* key) {
     iid = {leaf_node->get_page_no(), pos};
   }
   leaf_node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(leaf_node->get_page_id(), false);
+  buffer_pool_manager_->unpin_page(leaf_node->page, false);
   return iid;
 }
 
+/**
+ * @brief 把[lower, upper)切成首尾相接的若干段。从根开始逐层读出和区间相交的孩子，
+ * 严格落在区间两端条目的key之间的分隔key够多、或者下一层是叶子时停下，从中均匀取max_parts-1个，
+ * 每个用lower_bound定位成切分点
+ *
+ * @param max_parts 最多切成的段数
+ * @return 切分点，第一个是lower、最后一个是upper
+ * @note 逐个结点加读锁，不和并发的分裂、合并互斥：读到过时的分隔key只会让各段大小不均，
+ * 切分点按key排序后由lower_bound得到，仍然有序
+ */
+std::vector<Iid> IxIndexHandle::split_range(const Iid& lower, const Iid& upper,
+                                            int max_parts) {
+  if (hash_ != nullptr || art_ != nullptr) {
+    throw InternalError("Only B+ tree indexes support leaf positions");
+  }
+  std::vector<Iid> bounds{lower};
+  int len = file_hdr_->col_tot_len_;
+  char buf[IX_MAX_COL_LEN];
+  // 区间两端条目编码后的key，upper在最后一个叶子末尾时没有上端
+  auto entry_key = [&](const Iid& iid, std::string* key) {
+    auto node = fetch_node(iid.page_no);
+    node->page->RLatch();
+    bool valid = node->is_leaf_page() && iid.slot_no < node->get_size();
+    if (valid) {
+      key->assign(node->get_key(iid.slot_no, buf), len);
+    }
+    node->page->RUnlatch();
+    buffer_pool_manager_->unpin_page(node->page, false);
+    return valid;
+  };
+  std::string lo_key;
+  std::string hi_key;
+  if (max_parts < 2 || lower == upper || !entry_key(lower, &lo_key)) {
+    bounds.push_back(upper);
+    return bounds;
+  }
+  bool has_hi = entry_key(upper, &hi_key);
+
+  root_latch_.RLock();
+  std::vector<page_id_t> level{file_hdr_->root_page_};
+  root_latch_.RUnlock();
+  std::vector<std::string> seps;
+  while (static_cast<int>(seps.size()) < max_parts - 1) {
+    std::vector<std::string> level_seps;
+    std::vector<page_id_t> children;
+    bool leaves = false;
+    for (page_id_t page_no : level) {
+      auto node = fetch_node(page_no);
+      node->page->RLatch();
+      leaves = node->is_leaf_page();
+      int size = leaves ? 0 : node->get_size();
+      for (int i = 0; i < size; ++i) {
+        // 第i个孩子中的key在[key_i, key_{i+1})中
+        const char* key = node->get_key(i, buf);
+        bool before_hi = !has_hi || memcmp(key, hi_key.data(), len) < 0;
+        if (before_hi && memcmp(key, lo_key.data(), len) > 0) {
+          level_seps.emplace_back(key, len);
+        }
+        if ((i + 1 == size ||
+             memcmp(node->get_key(i + 1, buf), lo_key.data(), len) > 0) &&
+            (before_hi || i == 0)) {
+          children.push_back(node->value_at(i));
+        }
+      }
+      node->page->RUnlatch();
+      buffer_pool_manager_->unpin_page(node->page, false);
+      if (leaves) {
+        break;
+      }
+    }
+    if (leaves || children.empty()) {
+      break;
+    }
+    seps = std::move(level_seps);
+    level = std::move(children);
+  }
+
+  std::sort(seps.begin(), seps.end());
+  seps.erase(std::unique(seps.begin(), seps.end()), seps.end());
+  size_t n = seps.size();
+  size_t parts = std::min(n + 1, static_cast<size_t>(max_parts));
+  char raw[IX_MAX_COL_LEN];
+  for (size_t j = 1; j < parts; ++j) {
+    ix_decode_key(seps[j * (n + 1) / parts - 1].data(), raw,
+                  file_hdr_->col_types_, file_hdr_->col_lens_);
+    Iid iid = lower_bound(raw);
+    if (!(iid == bounds.back()) && !(iid == upper)) {
+      bounds.push_back(iid);
+    }
+  }
+  bounds.push_back(upper);
+  return bounds;
+}
+
+/**
+ * @brief 以iid上的条目为上界的间隙。iid在叶子末尾时上界是下一个叶子的第一个条目，最后一个叶子末尾之后是GAP_SUPREMUM
+ */
+Rid IxIndexHandle::gap_rid(const Iid& iid) const {
+  auto node = fetch_node(iid.page_no);
+  Rid rid = GAP_SUPREMUM;
+  page_id_t next_leaf = IX_NO_PAGE;
+  if (iid.slot_no < node->get_size()) {
+    rid = *node->get_rid(iid.slot_no);
+  } else if (node->get_page_no() != file_hdr_->last_leaf_) {
+    next_leaf = node->get_next_leaf();
+  }
+  buffer_pool_manager_->unpin_page(node->page, false);
+  if (next_leaf != IX_NO_PAGE) {
+    return gap_rid({next_leaf, 0});
+  }
+  return rid;
+}
+
+/**
+ * @brief key所在的间隙，插入之前在这里申请插入意向锁
+ * @note key为原始格式
+ */
+Rid IxIndexHandle::next_key_rid(const char* key) {
+  if (hash_ != nullptr) {
+    size_t hash = std::hash<std::string_view>()(
+        std::string_view(key, file_hdr_->col_tot_len_));
+    return {-2, static_cast<int>(hash & 0x7FFFFFFF)};
+  }
+  if (art_ != nullptr) {
+    char encoded[IX_MAX_COL_LEN];
+    return art_->next_rid(encode_key(key, encoded));
+  }
+  return gap_rid(upper_bound(key));
+}
+
+/**
+ * @brief ART索引的区间扫描，按key升序取出rid，返回区间之后第一个条目的rid作为间隙
+ * @note key为原始格式，lower或upper为nullptr表示这一侧没有边界
+ */
+Rid IxIndexHandle::art_scan(const char* lower, bool lower_inclusive,
+                            const char* upper, bool upper_inclusive,
+                            std::vector<Rid>* rids) {
+  char lower_buf[IX_MAX_COL_LEN];
+  char upper_buf[IX_MAX_COL_LEN];
+  if (lower != nullptr) {
+    lower = encode_key(lower, lower_buf);
+  }
+  if (upper != nullptr) {
+    upper = encode_key(upper, upper_buf);
+  }
+  return art_->scan(lower, lower_inclusive, upper, upper_inclusive, rids);
+}
+
+// 槽位中的哈希和rid分两次读写，并发覆盖时可能配错，调用方的检查会发现；哈希为0表示空槽
+static uint64_t row_hint_hash(const char* key, int len) {
+  return std::hash<std::string_view>()(std::string_view(key, len)) | 1;
+}
+
+bool IxIndexHandle::get_row_hint(const char* key, Rid* rid) const {
+  uint64_t hash = row_hint_hash(key, file_hdr_->col_tot_len_);
+  const auto& slot = row_hints_[hash % IX_ROW_HINT_SLOTS];
+  if (slot.hash.load(std::memory_order_acquire) != hash) {
+    return false;
+  }
+  uint64_t packed = slot.rid.load(std::memory_order_relaxed);
+  rid->page_no = static_cast<int>(packed >> 32);
+  rid->slot_no = static_cast<int>(static_cast<uint32_t>(packed));
+  return true;
+}
+
+uint64_t IxIndexHandle::ahi_hash(const char* key) const {
+  return row_hint_hash(key, file_hdr_->col_tot_len_);
+}
+
+// 位置打包成一个64位整数，一次原子读写：高20位是epoch的低位，中间28位是页面号，低16位是槽位号
+static constexpr int AHI_PAGE_BITS = 28;
+static constexpr int AHI_POS_BITS = 16;
+static constexpr int AHI_EPOCH_SHIFT = AHI_PAGE_BITS + AHI_POS_BITS;
+
+static uint64_t ahi_pack(uint32_t epoch, int page_no, int pos) {
+  return (static_cast<uint64_t>(epoch) << AHI_EPOCH_SHIFT) |
+         (static_cast<uint64_t>(page_no) << AHI_POS_BITS) | static_cast<uint64_t>(pos);
+}
+
+static bool ahi_same_epoch(uint64_t loc, uint32_t epoch) {
+  return (loc >> AHI_EPOCH_SHIFT) ==
+         (epoch & ((1U << (64 - AHI_EPOCH_SHIFT)) - 1));
+}
+
+/**
+ * @brief 按自适应哈希索引中记下的位置直接读叶子：加读锁后epoch没变（位置所在的结点没有被释放）、
+ * 结点仍是叶子且pos上的key就是要找的key时，它的rid就是结果，否则由调用方从根下降
+ * @param key 编码后的key
+ */
+bool IxIndexHandle::ahi_lookup(const char* key, uint64_t hash, Rid* rid) const {
+  const auto& slot = ahi_[hash % IX_AHI_SLOTS];
+  if (slot.hash.load(std::memory_order_acquire) != hash) {
+    return false;
+  }
+  uint64_t loc = slot.loc.load(std::memory_order_acquire);
+  if (loc == 0 || !ahi_same_epoch(loc, ahi_epoch_.load(std::memory_order_acquire))) {
+    return false;
+  }
+  int page_no = static_cast<int>((loc >> AHI_POS_BITS) & ((1U << AHI_PAGE_BITS) - 1));
+  int pos = static_cast<int>(loc & ((1U << AHI_POS_BITS) - 1));
+  auto node = fetch_node(page_no);
+  node->page->RLatch();
+  // 释放结点的一方持有结点的写锁时给epoch加一，读锁之后再看一次
+  bool hit = ahi_same_epoch(loc, ahi_epoch_.load(std::memory_order_acquire)) &&
+             node->is_leaf_page() && pos < node->get_size() &&
+             node->compare_key(key, pos) == 0;
+  if (hit) {
+    *rid = *node->get_rid(pos);
+  }
+  node->page->RUnlatch();
+  buffer_pool_manager_->unpin_page(node->page, false);
+  return hit;
+}
+
+void IxIndexHandle::ahi_remember(uint64_t hash, IxNodeHandle& leaf, int pos) const {
+  int page_no = leaf.get_page_no();
+  if (page_no >= (1 << AHI_PAGE_BITS) || pos >= (1 << AHI_POS_BITS)) {
+    return;
+  }
+  auto& slot = ahi_[hash % IX_AHI_SLOTS];
+  if (slot.hash.load(std::memory_order_relaxed) != hash) {
+    // 第一次查找这个key，或者槽位被别的key占着：只记下哈希，同一个key再次查找时才填入位置
+    slot.loc.store(0, std::memory_order_relaxed);
+    slot.hash.store(hash, std::memory_order_release);
+    return;
+  }
+  // 调用方持有叶子的读锁，这时读到的epoch之后叶子才可能被释放
+  slot.loc.store(ahi_pack(ahi_epoch_.load(std::memory_order_acquire), page_no, pos),
+                 std::memory_order_release);
+}
+
+void IxIndexHandle::set_row_hint(const char* key, const Rid& rid) const {
+  uint64_t hash = row_hint_hash(key, file_hdr_->col_tot_len_);
+  auto& slot = row_hints_[hash % IX_ROW_HINT_SLOTS];
+  slot.rid.store((static_cast<uint64_t>(static_cast<uint32_t>(rid.page_no)) << 32) |
+                     static_cast<uint32_t>(rid.slot_no),
+                 std::memory_order_relaxed);
+  slot.hash.store(hash, std::memory_order_release);
+}
+
 /**
  * @brief 指向最后一个叶子的最后一个结点的后一个
  * 用处在于可以作为IxScan的最后一个
@@ -943,11 +2043,14 @@ Iid IxIndexHandle::upper_bound(const char* key) {
  * @return Iid
  */
 Iid IxIndexHandle::leaf_end() const {
+  if (hash_ != nullptr || art_ != nullptr) {
+    throw InternalError("Only B+ tree indexes support leaf positions");
+  }
   auto node = fetch_node(file_hdr_->last_leaf_);
   node->page->RLatch();
   Iid iid = {.page_no = file_hdr_->last_leaf_, .slot_no = node->get_size()};
   node->page->RUnlatch();
-  buffer_pool_manager_->unpin_page(node->get_page_id(), false);  // unpin it!
+  buffer_pool_manager_->unpin_page(node->page, false);  // unpin it!
   return iid;
 }
 
@@ -962,6 +2065,32 @@ Iid IxIndexHandle::leaf_begin() const {
   return iid;
 }
 
+/**
+ * @brief 读第一个叶子的第一个key或最后一个叶子的最后一个key。空叶子会被删除，
+ * 只有索引为空时根结点才是没有key的叶子
+ *
+ * @param is_max 是否取最大的key
+ * @param buf 输出原始格式的key，至少col_tot_len字节
+ * @return 索引不为空
+ */
+bool IxIndexHandle::get_boundary_key(bool is_max, char* buf) const {
+  if (hash_ != nullptr || art_ != nullptr) {
+    throw InternalError("Only B+ tree indexes support leaf positions");
+  }
+  page_id_t page_no = is_max ? file_hdr_->last_leaf_ : file_hdr_->first_leaf_;
+  auto node = fetch_node(page_no);
+  node->page->RLatch();
+  int size = node->get_size();
+  if (size > 0) {
+    char key_buf[IX_MAX_COL_LEN];
+    ix_decode_key(node->get_key(is_max ? size - 1 : 0, key_buf), buf,
+                  file_hdr_->col_types_, file_hdr_->col_lens_);
+  }
+  node->page->RUnlatch();
+  buffer_pool_manager_->unpin_page(node->page, false);
+  return size > 0;
+}
+
 /**
  * @brief 获取一个指定结点
  *
@@ -970,10 +2099,31 @@ Iid IxIndexHandle::leaf_begin() const {
  * @note pin the page, remember to unpin it outside!
  */
 std::shared_ptr<IxNodeHandle> IxIndexHandle::fetch_node(int page_no) const {
-  auto* page = buffer_pool_manager_->fetch_page({fd_, page_no});
+  Page* page = swizzled_[page_no % IX_SWIZZLE_SLOTS].load(std::memory_order_acquire);
+  if (page == nullptr || page->get_page_id().page_no != page_no) {
+    page = buffer_pool_manager_->fetch_page({fd_, page_no});
+  }
   return std::make_shared<IxNodeHandle>(file_hdr_, page);
 }
 
+/**
+ * @brief 从根开始前IX_PINNED_LEVELS层的内部结点改为常驻并记到swizzled_中，之后的下降直接定位，不再查页表。
+ * 这些结点很少，几乎不会被换出，常驻只是省掉每次下降的页表查找和pin计数
+ * @param page 调用者pin住的内部结点
+ * @param level 结点所在的层，根为0
+ */
+void IxIndexHandle::pin_upper_node(Page* page, int level) const {
+  if (level >= IX_PINNED_LEVELS) {
+    return;
+  }
+  auto& slot = swizzled_[page->get_page_id().page_no % IX_SWIZZLE_SLOTS];
+  if (slot.load(std::memory_order_relaxed) == page) {
+    return;
+  }
+  BufferPoolManager::pin_in_memory(page);
+  slot.store(page, std::memory_order_release);
+}
+
 /**
  * @brief 创建一个新结点
  *
@@ -1004,16 +2154,19 @@ void IxIndexHandle::maintain_parent(std::shared_ptr<IxNodeHandle>& node) {
     // Load its parent
     auto parent = fetch_node(curr->get_parent_page_no());
     int rank = parent->find_child(curr);
-    char* parent_key = parent->get_key(rank);
-    char* child_first_key = curr->get_key(0);
-    if (memcmp(parent_key, child_first_key, file_hdr_->col_tot_len_) == 0) {
-      assert(buffer_pool_manager_->unpin_page(parent->get_page_id(), true));
+    char first_buf[IX_MAX_COL_LEN];
+    const char* child_first_key = curr->get_key(0, first_buf);
+    if (parent->compare_key(child_first_key, rank) == 0) {
+      assert(buffer_pool_manager_->unpin_page(parent->page, true));
       break;
     }
-    memcpy(parent_key, child_first_key,
-           file_hdr_->col_tot_len_);  // 修改了parent node
+    parent->set_key(rank, child_first_key);  // 修改了parent node
     curr = parent;
-    assert(buffer_pool_manager_->unpin_page(parent->get_page_id(), true));
+    assert(buffer_pool_manager_->unpin_page(parent->page, true));
+    // parent的第一个key没有变，不用再访问（也没有锁住）更上层的结点
+    if (rank != 0) {
+      break;
+    }
   }
 }
 
@@ -1028,11 +2181,11 @@ void IxIndexHandle::erase_leaf(std::shared_ptr<IxNodeHandle>& leaf) {
 
   auto prev = fetch_node(leaf->get_prev_leaf());
   prev->set_next_leaf(leaf->get_next_leaf());
-  buffer_pool_manager_->unpin_page(prev->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(prev->page, true);
 
   auto next = fetch_node(leaf->get_next_leaf());
   next->set_prev_leaf(leaf->get_prev_leaf());  // 注意此处是SetPrevLeaf()
-  buffer_pool_manager_->unpin_page(next->get_page_id(), true);
+  buffer_pool_manager_->unpin_page(next->page, true);
 }
 
 /**
@@ -1042,6 +2195,8 @@ void IxIndexHandle::erase_leaf(std::shared_ptr<IxNodeHandle>& leaf) {
  */
 void IxIndexHandle::release_node_handle(IxNodeHandle& node) {
   --file_hdr_->num_pages_;
+  // 被释放的结点可能还有自适应哈希索引指向它，之后还可能被重新分配，作废所有位置
+  ahi_epoch_.fetch_add(1, std::memory_order_release);
 }
 
 /**
@@ -1055,170 +2210,39 @@ void IxIndexHandle::maintain_child(std::shared_ptr<IxNodeHandle>& node,
     int child_page_no = node->value_at(child_idx);
     auto child = fetch_node(child_page_no);
     child->set_parent_page_no(node->get_page_no());
-    buffer_pool_manager_->unpin_page(child->get_page_id(), true);
+    buffer_pool_manager_->unpin_page(child->page, true);
+  }
+}
+
+bool IxIndexHandle::is_empty() {
+  if (hash_ != nullptr) {
+    return hash_->is_empty();
+  }
+  if (art_ != nullptr) {
+    return art_->is_empty();
   }
+  auto root = fetch_node(file_hdr_->root_page_);
+  root->page->RLatch();
+  bool empty = root->is_leaf_page() && root->get_size() == 0;
+  root->page->RUnlatch();
+  buffer_pool_manager_->unpin_page(root->page, false);
+  return empty;
 }
 
 RmRecord IxIndexHandle::get_key(const Iid& iid) const {
   auto node = fetch_node(iid.page_no);
   if (iid.slot_no >= node->get_size()) {
-    buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+    buffer_pool_manager_->unpin_page(node->page, false);
     throw IndexEntryNotFoundError();
   }
-  RmRecord record(node->get_key(iid.slot_no), file_hdr_->col_tot_len_);
-  buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+  RmRecord record(file_hdr_->col_tot_len_);
+  char key_buf[IX_MAX_COL_LEN];
+  ix_decode_key(node->get_key(iid.slot_no, key_buf), record.data,
+                file_hdr_->col_types_, file_hdr_->col_lens_);
+  buffer_pool_manager_->unpin_page(node->page, false);
   return record;
 }
 
-void IxIndexHandle::create_upper_parent_nodes(char* key, Rid* rid,
-                                              int first_parent_page_no,
-                                              int sum) {
-  // 初始化第一个父亲节点
-  int pos = 0;
-
-  auto node = create_node();
-  node->page_hdr->is_leaf = false;
-  char* node_key = node->get_key(0);
-  Rid* node_rid = node->get_rid(0);
-  int tot_len = file_hdr_->col_tot_len_;
-
-  int block = 0;
-  // 计算叶子结点的个数和每块应装入的元组条数
-  // max_size * 0.7 大小 尽可能避免分裂重组
-  int expected_leaf_num = static_cast<int>((file_hdr_->btree_order_ + 1) * 0.9);
-  int blocks = sum / expected_leaf_num + (sum % expected_leaf_num ? 1 : 0);
-  // 调整块数量，确保每个叶子节点半满
-  if (blocks > 1 && (file_hdr_->btree_order_ + 1) / 2 > sum / blocks) {
-    // assert(0);
-    --blocks;
-  }
-
-  // 实际每个叶子上的元组数量
-  int actual_leaf_num = sum / blocks;
-  // 多出来的元组
-  int remaining_leaf_num = sum % blocks;
-
-  int upper_expected_parent_num =
-      static_cast<int>((file_hdr_->btree_order_ + 1) * 0.9);
-  int upper_blocks = blocks / upper_expected_parent_num +
-                     (blocks % upper_expected_parent_num ? 1 : 0);
-  // 调整块数量，确保每个叶子节点半满
-  if (upper_blocks > 1 &&
-      (file_hdr_->btree_order_ + 1) / 2 > blocks / upper_blocks) {
-    --upper_blocks;
-  }
-
-  // 实际每个父亲节点上的元组数量
-  int actual_upper_parent_num = blocks / upper_blocks;
-  // 多出来的元组
-  int remaining_upper_parent_num = blocks % upper_blocks;
-
-  // 第一个父亲节点页号
-  int parent_page_no = first_parent_page_no + blocks;
-
-  // 只能构成一个节点，即为根节点
-  if (blocks == 1) {
-    node->set_parent_page_no(INVALID_PAGE_ID);
-    file_hdr_->root_page_ = node->get_page_no();
-  } else {
-    // 否则叶子节点指向父亲节点
-    node->set_parent_page_no(parent_page_no);
-  }
-
-  // 设置叶子节点大小
-  node->set_size(actual_leaf_num);
-
-  // 对于父亲节点，孩子节点数量
-  int child_pos = 0;
-
-  // 把每个索引块的第一个元组拷贝，用于父亲节点生成
-  char* key_temp = nullptr;
-  char* key_temp_head = nullptr;
-  Rid* rid_temp = nullptr;
-  Rid* rid_temp_head = nullptr;
-
-  // 只有有父亲节点才需要
-  if (blocks > 1) {
-    key_temp = new char[blocks * tot_len];
-    key_temp_head = key_temp;
-    rid_temp = new Rid[blocks];
-    rid_temp_head = rid_temp;
-  }
-
-  auto* src_key = key;
-  auto* src_rid = rid;
-
-  for (int i = 0; i < sum; i++) {
-    if (pos == actual_leaf_num) {
-      pos = 0;
-      // unpin
-      buffer_pool_manager_->unpin_page(node->get_page_id(), true);
-      // 建立新节点
-      node = create_node();
-      node->page_hdr->is_leaf = false;
-
-      node_key = node->get_key(0);
-      node_rid = node->get_rid(0);
-
-      // 一样的操作
-      if (++block + remaining_leaf_num == blocks) {
-        ++actual_leaf_num;
-      }
-
-      // 设置大小
-      node->set_size(actual_leaf_num);
-
-      // 对于父亲节点，孩子节点数量 + 1
-      if (++child_pos >= actual_upper_parent_num) {
-        // 孩子节点数量设置为 0
-        child_pos = 0;
-        // 父亲节点 + 1
-        // 注意这里的2和起始节点页号有关，parent_page_no - blocks -
-        // first_parent_page_no 才是实际父节点块数
-        if (++parent_page_no - blocks - first_parent_page_no ==
-            upper_blocks - remaining_upper_parent_num) {
-          ++actual_upper_parent_num;
-        }
-      }
-      // 指向父亲节点
-      node->set_parent_page_no(parent_page_no);
-    }
-
-    // 注意如果一个叶子节点放满了，跳到下一个叶子头也得拷贝
-    if (pos == 0 && blocks > 1) {
-      // 将每个索引块的第一个元组拷贝一份到临时数组中
-      memcpy(key_temp_head, src_key, tot_len);
-      Rid rid{.page_no = node->get_page_no(), .slot_no = -1};
-      memcpy(rid_temp_head, &rid, sizeof(Rid));
-      key_temp_head += tot_len;
-      // 加一个 rid
-      ++rid_temp_head;
-    }
-
-    // 初始化键值对
-    memcpy(node_key, src_key, tot_len);
-    memcpy(node_rid, src_rid, sizeof(Rid));
-    src_key += tot_len;
-    node_key += tot_len;
-    ++src_rid;
-    ++node_rid;
-    ++pos;
-  }
-
-  delete[] key;
-  delete[] rid;
-
-  // 没有到根节点，继续递归
-  if (blocks > 1) {
-    buffer_pool_manager_->unpin_page(node->get_page_id(), true);
-    create_upper_parent_nodes(key_temp, rid_temp, first_parent_page_no + blocks,
-                              blocks);
-  } else {
-    file_hdr_->root_page_ = node->get_page_no();
-    buffer_pool_manager_->unpin_page(node->get_page_id(), true);
-  }
-}
-
 void ToGraph(const IxIndexHandle* ih, IxNodeHandle* node,
              BufferPoolManager* bpm, std::ofstream& out) {
   std::string leaf_prefix("LEAF_");
@@ -1240,7 +2264,7 @@ void ToGraph(const IxIndexHandle* ih, IxNodeHandle* node,
         << ",min_size=" << leaf->get_min_size() << "</TD></TR>\n";
     out << "<TR>";
     for (int i = 0; i < leaf->get_size(); i++) {
-      out << "<TD>" << *reinterpret_cast<int*>(leaf->get_key(i)) << "</TD>\n";
+      out << "<TD>" << leaf->key_at(i) << "</TD>\n";
     }
     out << "</TR>";
     // Print table end
@@ -12,9 +12,14 @@ See the Mulan PSL v2 for more details. */
 
 #include <readline/readline.h>
 
+#include <array>
+#include <atomic>
 #include <optional>
 
 #include "ix_defs.h"
+#include "ix_bloom_filter.h"
+#include "ix_art_index.h"
+#include "ix_hash_index.h"
 #include "transaction/transaction.h"
 
 enum class Operation {
@@ -23,8 +28,6 @@ enum class Operation {
   DELETE
 };  // 三种操作：查找、插入、删除
 
-static const bool binary_search = false;
-
 inline int ix_compare(const char* a, const char* b, ColType type, int col_len) {
   switch (type) {
     case TYPE_INT: {
@@ -56,41 +59,150 @@ inline int ix_compare(const char* a, const char* b,
   return 0;
 }
 
-/* 管理B+树中的每个节点 */
+/**
+ * @description: 把字段原本的存储格式编码成可以直接memcmp比较的形式，B+树中的key都以这种形式存放。
+ * 整数翻转符号位后按大端存放；浮点数非负时翻转符号位、负数时按位取反后按大端存放（-0.0编码成+0.0）；
+ * 字符串原样存放
+ */
+inline void ix_encode_key(const char* src, char* dest,
+                          const std::vector<ColType>& col_types,
+                          const std::vector<int>& col_lens) {
+  int offset = 0;
+  for (size_t i = 0; i < col_types.size(); ++i) {
+    uint32_t bits;
+    switch (col_types[i]) {
+      case TYPE_INT:
+        memcpy(&bits, src + offset, sizeof(bits));
+        bits ^= 0x80000000u;
+        break;
+      case TYPE_FLOAT:
+        memcpy(&bits, src + offset, sizeof(bits));
+        if (bits == 0x80000000u) {
+          bits = 0;
+        }
+        bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        break;
+      default:
+        memcpy(dest + offset, src + offset, col_lens[i]);
+        offset += col_lens[i];
+        continue;
+    }
+    bits = __builtin_bswap32(bits);
+    memcpy(dest + offset, &bits, sizeof(bits));
+    offset += col_lens[i];
+  }
+}
+
+/* ix_encode_key的逆过程，-0.0解码为+0.0 */
+inline void ix_decode_key(const char* src, char* dest,
+                          const std::vector<ColType>& col_types,
+                          const std::vector<int>& col_lens) {
+  int offset = 0;
+  for (size_t i = 0; i < col_types.size(); ++i) {
+    uint32_t bits;
+    switch (col_types[i]) {
+      case TYPE_INT:
+        memcpy(&bits, src + offset, sizeof(bits));
+        bits = __builtin_bswap32(bits) ^ 0x80000000u;
+        break;
+      case TYPE_FLOAT:
+        memcpy(&bits, src + offset, sizeof(bits));
+        bits = __builtin_bswap32(bits);
+        bits = (bits & 0x80000000u) ? (bits & 0x7fffffffu) : ~bits;
+        break;
+      default:
+        memcpy(dest + offset, src + offset, col_lens[i]);
+        offset += col_lens[i];
+        continue;
+    }
+    memcpy(dest + offset, &bits, sizeof(bits));
+    offset += col_lens[i];
+  }
+}
+
+/* 管理B+树中的每个节点，结点中的key都是ix_encode_key编码后的形式。
+ * 叶子结点的key去掉共同前缀后存放，前缀在结点中只存一份；内部结点不压缩。
+ * 索引都是唯一索引（建索引时遇到重复key报错，插入前用is_unique检查），叶子中每个key只对应一个rid，
+ * 不需要重复key的rid列表；前几个字段取值很少的联合索引，重复的部分由叶子的公共前缀压缩 */
 class IxNodeHandle {
   friend class IxIndexHandle;
   friend class IxScan;
+  friend class IxBulkLoader;
 
  private:
   const IxFileHdr* file_hdr;  // 节点所在文件的头部信息
   Page* page;                 // 存储节点的页面
   IxPageHdr*
-      page_hdr;  // page->data的第一部分，指针指向首地址，长度为sizeof(IxPageHdr)
+      page_hdr;  // page->data中紧跟页面lsn的第一部分，长度为sizeof(IxPageHdr)
+  char* prefix;  // page->data的第二部分，长度为file_hdr->col_tot_len，前page_hdr->prefix_len字节有效
   char*
-      keys;  // page->data的第二部分，指针指向首地址，长度为file_hdr->keys_size，每个key的长度为file_hdr->col_len
-  Rid* rids;  // page->data的第三部分，指针指向首地址
+      keys;  // page->data的第三部分，指针指向首地址，每个key去掉前缀后的长度为suffix_len()
+  // rid数组的位置随前缀长度变化，见get_rid()
 
  public:
   IxNodeHandle() = default;
 
   IxNodeHandle(const IxFileHdr* file_hdr_, Page* page_)
       : file_hdr(file_hdr_), page(page_) {
-    page_hdr = reinterpret_cast<IxPageHdr*>(page->get_data());
-    keys = page->get_data() + sizeof(IxPageHdr);
-    rids = reinterpret_cast<Rid*>(keys + file_hdr->keys_size_);
+    // 与表数据页面一致，页面开头的 Page::OFFSET_PAGE_HDR 字节存放页面 lsn
+    page_hdr = reinterpret_cast<IxPageHdr*>(page->get_data() +
+                                            Page::OFFSET_PAGE_HDR);
+    prefix = page->get_data() + Page::OFFSET_PAGE_HDR + sizeof(IxPageHdr);
+    keys = prefix + file_hdr->col_tot_len_;
   }
 
-  inline bool isSafe(Operation operation);
+  // key为这次操作的key，叶子结点插入key时判断前缀会不会被缩短；
+  // key落在结点第0个位置时不安全，maintain_parent要改动父结点
+  inline bool isSafe(Operation operation, const char* key);
 
   inline int get_size() { return page_hdr->num_key; }
 
   inline void set_size(int size) { page_hdr->num_key = size; }
 
-  int get_max_size() { return file_hdr->btree_order_ + 1; }
+  inline int get_prefix_len() const { return page_hdr->prefix_len; }
+
+  inline int suffix_len() const {
+    return file_hdr->col_tot_len_ - page_hdr->prefix_len;
+  }
+
+  // 结点能放下的键值对数量，前缀越长越多；内部结点前缀总是0，等于btree_order+1
+  int get_max_size() const { return file_hdr->node_slots_[page_hdr->prefix_len]; }
+
+  // 按没有前缀时的容量计算，合并的两个结点无论合并后前缀多长都放得下
+  int get_min_size() const { return file_hdr->node_slots_[0] / 2; }
+
+  // key与结点前缀的公共前缀长度，不超过get_prefix_len()
+  int common_prefix(const char* key) const {
+    int len = 0;
+    while (len < page_hdr->prefix_len && key[len] == prefix[len]) {
+      ++len;
+    }
+    return len;
+  }
+
+  // 插入key之后结点是否还放得下
+  bool has_room_for(const char* key) const {
+    return page_hdr->num_key + 1 <= file_hdr->node_slots_[common_prefix(key)];
+  }
+
+  void set_prefix_len(int prefix_len);
 
-  int get_min_size() { return get_max_size() / 2; }
+  // 只用于画图：第i个key的第一个字段按整数解码
+  int key_at(int i) const {
+    char buf[IX_MAX_COL_LEN];
+    uint32_t bits;
+    memcpy(&bits, get_key(i, buf), sizeof(bits));
+    return static_cast<int>(__builtin_bswap32(bits) ^ 0x80000000u);
+  }
 
-  int key_at(int i) { return *(int*)get_key(i); }
+  // 批量查找交错下降时，在读结点之前预取页头和二分查找先访问的几处key
+  void prefetch() const {
+    __builtin_prefetch(page_hdr);
+    size_t span = static_cast<size_t>(file_hdr->node_slots_[0]) * file_hdr->col_tot_len_;
+    for (size_t i = 1; i < 4; ++i) {
+      __builtin_prefetch(keys + span * i / 4);
+    }
+  }
 
   /* 得到第i个孩子结点的page_no */
   page_id_t value_at(int i) { return get_rid(i)->page_no; }
@@ -99,6 +211,14 @@ class IxNodeHandle {
 
   inline PageId get_page_id() { return page->get_page_id(); }
 
+  /* 用事务最近一条日志的lsn标记页面，淘汰时缓冲池先把日志刷到该lsn */
+  inline void stamp_lsn(Transaction* transaction) {
+    if (transaction != nullptr &&
+        transaction->get_prev_lsn() > page->get_page_lsn()) {
+      page->set_page_lsn(transaction->get_prev_lsn());
+    }
+  }
+
   page_id_t get_next_leaf() { return page_hdr->next_leaf; }
 
   page_id_t get_prev_leaf() { return page_hdr->prev_leaf; }
@@ -125,27 +245,63 @@ class IxNodeHandle {
 
   inline void set_is_leaf_page(bool val) { page_hdr->is_leaf = val; }
 
-  inline char* get_key(int key_idx) const {
-    return keys + key_idx * file_hdr->col_tot_len_;
+  // 第key_idx个key去掉前缀后的部分
+  inline char* get_suffix(int key_idx) const {
+    return keys + key_idx * suffix_len();
+  }
+
+  /* 得到完整的第key_idx个key：没有前缀时直接返回页面中的地址，否则拼接到buf中返回buf，
+   * buf至少col_tot_len字节 */
+  inline const char* get_key(int key_idx, char* buf) const {
+    int prefix_len = page_hdr->prefix_len;
+    if (prefix_len == 0) {
+      return get_suffix(key_idx);
+    }
+    memcpy(buf, prefix, prefix_len);
+    memcpy(buf + prefix_len, get_suffix(key_idx), suffix_len());
+    return buf;
   }
 
-  inline Rid* get_rid(int rid_idx) const { return &rids[rid_idx]; }
+  inline Rid* get_rid(int rid_idx) const {
+    return reinterpret_cast<Rid*>(page->get_data() +
+                                  file_hdr->rids_offset_[page_hdr->prefix_len]) +
+           rid_idx;
+  }
 
-  inline char* get_last_key() { return get_key(get_size() - 1); }
+  inline const char* get_last_key(char* buf) const {
+    return get_key(page_hdr->num_key - 1, buf);
+  }
 
   inline Rid* get_last_rid() { return get_rid(get_size() - 1); }
 
+  // 只用于内部结点，内部结点没有前缀
   void set_key(int key_idx, const char* key) {
-    memcpy(keys + key_idx * file_hdr->col_tot_len_, key,
-           file_hdr->col_tot_len_);
+    assert(page_hdr->prefix_len == 0);
+    memcpy(get_suffix(key_idx), key, file_hdr->col_tot_len_);
   }
 
-  void set_rid(int rid_idx, const Rid& rid) { rids[rid_idx] = rid; }
+  void set_rid(int rid_idx, const Rid& rid) { *get_rid(rid_idx) = rid; }
+
+  // 比较完整的key和第key_idx个key，相当于Compare(key, get_key(key_idx))
+  inline int compare_key(const char* key, int key_idx) const {
+    int prefix_len = page_hdr->prefix_len;
+    if (prefix_len > 0) {
+      int cmp = memcmp(key, prefix, prefix_len);
+      if (cmp != 0) {
+        return cmp;
+      }
+    }
+    return memcmp(key + prefix_len, get_suffix(key_idx), suffix_len());
+  }
 
   int lower_bound(const char* target) const;
 
   int upper_bound(const char* target) const;
 
+  // 在[begin, num_key)中查找第一个>=target（upper为true时>target）的key_idx
+  template <bool upper>
+  int search(const char* target, int begin) const;
+
   void insert_pairs(int pos, const char* key, const Rid* rid, int n);
 
   page_id_t internal_lookup(const char* key);
@@ -201,27 +357,53 @@ class IxNodeHandle {
   }
 
   inline int Compare(const char* a, const char* b) const {
-    return ix_compare(a, b, file_hdr->col_types_, file_hdr->col_lens_);
+    return memcmp(a, b, file_hdr->col_tot_len_);
   }
 
   inline bool isFull() { return page_hdr->num_key == get_max_size(); }
 };
 
-/* B+树 */
+/* B+树；哈希索引和ART索引也用这个句柄打开，get_value、is_unique、insert_entry、delete_entry和is_empty
+ * 转给hash_或art_，ART索引的区间扫描用art_scan，其余只属于B+树的操作不能用于这两种索引 */
 class IxIndexHandle {
   friend class IxScan;
   friend class IxManager;
+  friend class IxBulkLoader;
 
  public:
   int fd_;  // 存储B+树的文件
-  RWLatch rw_latch_;
 
  private:
   DiskManager* disk_manager_;
   BufferPoolManager* buffer_pool_manager_;
   // IxFileHdr *file_hdr_; //
   // 存了root_page，但其初始化为2（第0页存FILE_HDR_PAGE，第1页存LEAF_HEADER_PAGE）
-  std::mutex root_latch_;
+  ScalableRWLatch root_latch_;  // 读操作加共享锁，可能修改根的写操作加排他锁
+  std::unique_ptr<IxHashIndex> hash_;  // 只有哈希索引才有
+  std::unique_ptr<IxArtIndex> art_;    // 只有ART索引才有，内容只在内存中
+  std::unique_ptr<IxBloomFilter> bloom_;  // is_unique的旁路，只有B+树索引才有
+  // 最右叶子最后一个key的前8个字节（见key_prefix），只是提示：前缀比它小的key一定不是追加，不去碰最右叶子
+  std::atomic<uint64_t> rightmost_hint_{0};
+  // 常驻的上层结点，按页面号取模直接映射到缓冲池中的页面，命中时fetch_node不查页表也不pin。
+  // 常驻页面不会换出，页面号不会改变，槽位被同模的结点覆盖时那个结点退回查页表
+  mutable std::array<std::atomic<Page*>, IX_SWIZZLE_SLOTS> swizzled_{};
+  // 完整key的等值查找上次找到的rid，按key的哈希直接映射。只是提示，不随增删改维护：
+  // 调用方加锁读出记录、检查key相等后才使用，对不上就退回下降B+树
+  struct RowHint {
+    std::atomic<uint64_t> hash{0};
+    std::atomic<uint64_t> rid{0};
+  };
+  mutable std::array<RowHint, IX_ROW_HINT_SLOTS> row_hints_{};
+  // 自适应哈希索引：get_value的等值查找足够多以后，把反复查找的完整key直接映射到叶子中的位置，命中时不再从根下降。
+  // 槽位按key的哈希直接映射，第一次查找只记下哈希，再次查找才填入位置；用位置前加读锁核对key，
+  // 分裂、重分配、删除移走了key时核对失败，退回下降；合并和降低树高释放结点时ahi_epoch_加一，之前的位置全部作废
+  struct AdaptiveHashSlot {
+    std::atomic<uint64_t> hash{0};
+    std::atomic<uint64_t> loc{0};  // epoch、叶子页面号和槽位号，见ahi_pack；0表示还没有位置
+  };
+  mutable std::array<AdaptiveHashSlot, IX_AHI_SLOTS> ahi_{};
+  std::atomic<uint32_t> ahi_epoch_{1};
+  std::atomic<uint64_t> ahi_lookups_{0};  // 到IX_AHI_MIN_LOOKUPS为止的等值查找次数
 
   // class Context {
   // public:
@@ -249,6 +431,16 @@ class IxIndexHandle {
 
   void release_all_index_latch_page(Transaction*);
 
+  void pin_upper_node(Page* page, int level) const;
+
+  // 自适应哈希索引中（编码后的）key的位置仍然有效时返回它的rid，否则返回false
+  bool ahi_lookup(const char* key, uint64_t hash, Rid* rid) const;
+
+  // 记下key在加着读锁的叶子中的位置pos
+  void ahi_remember(uint64_t hash, IxNodeHandle& leaf, int pos) const;
+
+  uint64_t ahi_hash(const char* key) const;
+
  public:
   IxIndexHandle(DiskManager* disk_manager,
                 BufferPoolManager* buffer_pool_manager, int fd);
@@ -265,40 +457,79 @@ class IxIndexHandle {
   // for get/create node
   std::shared_ptr<IxNodeHandle> fetch_node(int page_no) const;
 
-  void create_upper_parent_nodes(char* key, Rid* rid, int first_parent_page_no,
-                                 int sum);
-
   // for safe look empty table
   bool is_empty();
 
-  // for gap lock
+  bool is_hash() const { return hash_ != nullptr; }
+
+  bool is_art() const { return art_ != nullptr; }
+
+  // for gap lock，返回解码后的原始格式
   RmRecord get_key(const Iid& iid) const;
 
+  // get_value、is_unique、insert_entry、delete_entry、lower_bound和upper_bound的key都是原始格式，
+  // 在这里编码一次；find_leaf_page和结点上的操作使用编码后的key
+
   // for search
   bool get_value(const char* key, std::vector<Rid>* result,
                  Transaction* transaction);
 
+  // 批量查找，用于索引连接和IN列表；keys不要求有序，(*result)[i]对应keys[i]
+  void get_values(const std::vector<const char*>& keys,
+                  std::vector<std::optional<Rid>>* result,
+                  Transaction* transaction);
+
   std::pair<std::shared_ptr<IxNodeHandle>, bool> find_leaf_page(
       const char* key, Operation operation, Transaction* transaction,
       bool find_first = false);
 
+  std::shared_ptr<IxNodeHandle> find_leaf_page_optimistic(
+      const char* key, bool find_first,
+      Operation operation = Operation::FIND);
+
+  // 批量查找：n个（编码后的）key按层交错地乐观下降，每层先取出所有孩子并发出预取，再逐个读，
+  // 一个下降等缓存未命中时其他下降的结点已经在路上。leaves[i]是pin住、没有加锁的叶子，
+  // versions[i]是读到它时的版本号，调用方加读锁后校验；下降中途失败的为nullptr
+  void find_leaves_interleaved(const char* const* keys, int n,
+                               std::shared_ptr<IxNodeHandle>* leaves,
+                               uint64_t* versions);
+
+  // 大于所有已有key的插入直接给最右叶子加写锁，插入后不用分裂时返回它，否则返回nullptr
+  std::shared_ptr<IxNodeHandle> find_rightmost_leaf(const char* key);
+
   // check unique
   bool is_unique(const char* key, Rid& value, Transaction* transaction);
 
+  // 扫描所有叶子，把已有的key加入bloom_
+  void build_bloom_filter();
+
   // for insert
   page_id_t insert_entry(const char* key, const Rid& value,
                          Transaction* transaction);
 
-  std::shared_ptr<IxNodeHandle> split(std::shared_ptr<IxNodeHandle>& node);
+  // 批量插入，keys[i]对应rids[i]；返回已经存在、没有插入的key的数量
+  int insert_entries(const std::vector<const char*>& keys,
+                     const std::vector<Rid>& rids, Transaction* transaction);
+
+  page_id_t insert_at_boundary(std::shared_ptr<IxNodeHandle>& leaf_node,
+                               const char* key, const Rid& value,
+                               Transaction* transaction, bool is_root_locked);
+
+  std::shared_ptr<IxNodeHandle> split(std::shared_ptr<IxNodeHandle>& node,
+                                      int split_point);
 
   void insert_into_parent(std::shared_ptr<IxNodeHandle>& old_node,
                           const char* key,
                           std::shared_ptr<IxNodeHandle>& new_node,
-                          Transaction* transaction);
+                          Transaction* transaction, bool rightmost = false);
 
   // for delete
   bool delete_entry(const char* key, Transaction* transaction);
 
+  // 批量删除，返回删除的key的数量
+  int delete_entries(const std::vector<const char*>& keys,
+                     Transaction* transaction);
+
   bool coalesce_or_redistribute(std::shared_ptr<IxNodeHandle>& node,
                                 Transaction* transaction = nullptr,
                                 bool* root_is_latched = nullptr);
@@ -318,10 +549,34 @@ class IxIndexHandle {
 
   Iid upper_bound(const char* key);
 
+  // 按内部结点中的分隔key把[lower, upper)切成至多max_parts段，用于并行扫描。
+  // 返回的切分点首尾是lower和upper，相邻两个构成一段；区间太小时只有这两个
+  std::vector<Iid> split_range(const Iid& lower, const Iid& upper,
+                               int max_parts);
+
+  // 键区间锁用的间隙：iid上的条目作为间隙的上界，iid在最后一个叶子末尾时为GAP_SUPREMUM
+  Rid gap_rid(const Iid& iid) const;
+
+  // 插入或等值查找key时所在的间隙：第一个大于key的条目。
+  // 哈希索引没有顺序，用key的哈希值代替，同一个key的查找和插入落在同一个间隙上
+  Rid next_key_rid(const char* key);
+
+  // ART索引按key升序取出区间中的rid，返回区间之后第一个条目的rid；lower或upper为nullptr表示没有边界
+  Rid art_scan(const char* lower, bool lower_inclusive, const char* upper,
+               bool upper_inclusive, std::vector<Rid>* rids);
+
+  // 完整key（原始格式）上次找到的rid，没有提示时返回false；结果可能已经过时，使用前要检查记录
+  bool get_row_hint(const char* key, Rid* rid) const;
+
+  void set_row_hint(const char* key, const Rid& rid) const;
+
   Iid leaf_end() const;
 
   Iid leaf_begin() const;
 
+  // 最小（is_max为false）或最大的key，只读第一个或最后一个叶子；解码成原始格式写到buf中，索引为空时返回false
+  bool get_boundary_key(bool is_max, char* buf) const;
+
   // for index test
   Rid get_rid(const Iid& iid) const;
 
@@ -341,6 +596,20 @@ class IxIndexHandle {
   void maintain_child(std::shared_ptr<IxNodeHandle>& node, int child_idx);
 
   inline int Compare(const char* a, const char* b) const {
-    return ix_compare(a, b, file_hdr_->col_types_, file_hdr_->col_lens_);
+    return memcmp(a, b, file_hdr_->col_tot_len_);
+  }
+
+  // 编码后key的前8个字节按大端读成整数，两个key的前缀比较结果和memcmp一致（前缀相同时不确定）
+  inline uint64_t key_prefix(const char* key) const {
+    uint64_t prefix = 0;
+    memcpy(&prefix, key,
+           std::min<size_t>(file_hdr_->col_tot_len_, sizeof(prefix)));
+    return __builtin_bswap64(prefix);
+  }
+
+  // 把调用者传入的原始格式的key编码到buf中，buf至少IX_MAX_COL_LEN字节
+  inline const char* encode_key(const char* key, char* buf) const {
+    ix_encode_key(key, buf, file_hdr_->col_types_, file_hdr_->col_lens_);
+    return buf;
   }
 };
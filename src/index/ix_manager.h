@@ -67,16 +67,25 @@ class IxManager {
   }
 
   void create_index(const std::string& ix_name,
-                    const std::vector<ColMeta>& index_cols) {
+                    const std::vector<ColMeta>& index_cols,
+                    IndexType index_type = INDEX_BTREE) {
+    if (index_type == INDEX_HASH) {
+      create_hash_index(ix_name, index_cols);
+      return;
+    }
+    if (index_type == INDEX_ART) {
+      create_art_index(ix_name, index_cols);
+      return;
+    }
     // Create index file
     disk_manager_->create_file(ix_name);
     // Open index file
     int fd = disk_manager_->open_file(ix_name);
 
     // Create file header and write to file
-    // Theoretically we have: |page_hdr| + (|attr| + |rid|) * n <= PAGE_SIZE
+    // Theoretically we have: |lsn| + |page_hdr| + |prefix| + (|attr| + |rid|) * n <= PAGE_SIZE
     // but we reserve one slot for convenient inserting and deleting, i.e.
-    // |page_hdr| + (|attr| + |rid|) * (n + 1) <= PAGE_SIZE
+    // |lsn| + |page_hdr| + |prefix| + (|attr| + |rid|) * (n + 1) <= PAGE_SIZE
     int col_tot_len = 0;
     int col_num = index_cols.size();
     for (auto& col : index_cols) {
@@ -85,11 +94,11 @@ class IxManager {
     if (col_tot_len > IX_MAX_COL_LEN) {
       throw InvalidColLengthError(col_tot_len);
     }
-    // 根据 |page_hdr| + (|attr| + |rid|) * (n + 1) <= PAGE_SIZE
+    // 根据 |lsn| + |page_hdr| + |prefix| + (|attr| + |rid|) * (n + 1) <= PAGE_SIZE
     // 求得n的最大值btree_order 即 n <=
     // btree_order，那么btree_order就是每个结点最多可插入的键值对数量（实际还多留了一个空位，但其不可插入）
-    int btree_order = static_cast<int>(
-        (PAGE_SIZE - sizeof(IxPageHdr)) / (col_tot_len + sizeof(Rid)) - 1);
+    // 这是没有共同前缀时的槽位数，内部结点总是这么多；叶子结点的key有共同前缀时能放下更多
+    int btree_order = IxFileHdr::node_slots(col_tot_len, 0) - 1;
     assert(btree_order > 2);
 
     // Create file header and write to file
@@ -118,7 +127,8 @@ class IxManager {
     // node Create leaf list header page and write to file
     {
       memset(page_buf, 0, PAGE_SIZE);
-      auto phdr = reinterpret_cast<IxPageHdr*>(page_buf);
+      auto phdr =
+          reinterpret_cast<IxPageHdr*>(page_buf + Page::OFFSET_PAGE_HDR);
       *phdr = {
           .next_free_page_no = IX_NO_PAGE,
           .parent = IX_NO_PAGE,
@@ -126,6 +136,7 @@ class IxManager {
           .is_leaf = true,
           .prev_leaf = IX_INIT_ROOT_PAGE,
           .next_leaf = IX_INIT_ROOT_PAGE,
+          .prefix_len = 0,
       };
       disk_manager_->write_page(fd, IX_LEAF_HEADER_PAGE, page_buf, PAGE_SIZE);
     }
@@ -133,7 +144,8 @@ class IxManager {
     // header Create root node and write to file
     {
       memset(page_buf, 0, PAGE_SIZE);
-      auto phdr = reinterpret_cast<IxPageHdr*>(page_buf);
+      auto phdr =
+          reinterpret_cast<IxPageHdr*>(page_buf + Page::OFFSET_PAGE_HDR);
       *phdr = {
           .next_free_page_no = IX_NO_PAGE,
           .parent = IX_NO_PAGE,
@@ -141,6 +153,7 @@ class IxManager {
           .is_leaf = true,
           .prev_leaf = IX_LEAF_HEADER_PAGE,
           .next_leaf = IX_LEAF_HEADER_PAGE,
+          .prefix_len = 0,
       };
       // Must write PAGE_SIZE here in case of future fetch_node()
       disk_manager_->write_page(fd, IX_INIT_ROOT_PAGE, page_buf, PAGE_SIZE);
@@ -152,6 +165,76 @@ class IxManager {
     disk_manager_->close_file(fd);
   }
 
+  /* 哈希索引文件：第0页是文件头，第1页是唯一的空桶，目录在第一次flush/close时才分配页面 */
+  void create_hash_index(const std::string& ix_name,
+                         const std::vector<ColMeta>& index_cols) {
+    disk_manager_->create_file(ix_name);
+    int fd = disk_manager_->open_file(ix_name);
+
+    int col_tot_len = 0;
+    int col_num = index_cols.size();
+    for (auto& col : index_cols) {
+      col_tot_len += col.len;
+    }
+    if (col_tot_len > IX_MAX_COL_LEN) {
+      throw InvalidColLengthError(col_tot_len);
+    }
+    IxFileHdr fhdr(IX_NO_PAGE, IX_HASH_INIT_NUM_PAGES, IX_NO_PAGE, col_num,
+                   col_tot_len, 0, 0, IX_NO_PAGE, IX_NO_PAGE);
+    fhdr.index_type_ = INDEX_HASH;
+    for (int i = 0; i < col_num; ++i) {
+      fhdr.col_types_.emplace_back(index_cols[i].type);
+      fhdr.col_lens_.emplace_back(index_cols[i].len);
+    }
+    fhdr.update_tot_len();
+    std::vector<char> data(fhdr.tot_len_);
+    fhdr.serialize(data.data());
+    disk_manager_->write_page(fd, IX_FILE_HDR_PAGE, data.data(),
+                              fhdr.tot_len_);
+
+    char page_buf[PAGE_SIZE];
+    memset(page_buf, 0, PAGE_SIZE);
+    *reinterpret_cast<IxHashBucketHdr*>(page_buf + Page::OFFSET_PAGE_HDR) = {
+        .local_depth = 0,
+        .num_key = 0,
+        .next_overflow = IX_NO_PAGE,
+    };
+    disk_manager_->write_page(fd, IX_HASH_INIT_BUCKET_PAGE, page_buf,
+                              PAGE_SIZE);
+    disk_manager_->set_fd2pageno(fd, IX_HASH_INIT_NUM_PAGES - 1);
+    disk_manager_->close_file(fd);
+  }
+
+  /* ART索引的内容只在内存中，文件只有第0页的文件头，记录key的格式和索引类型 */
+  void create_art_index(const std::string& ix_name,
+                        const std::vector<ColMeta>& index_cols) {
+    disk_manager_->create_file(ix_name);
+    int fd = disk_manager_->open_file(ix_name);
+
+    int col_tot_len = 0;
+    int col_num = index_cols.size();
+    for (auto& col : index_cols) {
+      col_tot_len += col.len;
+    }
+    if (col_tot_len > IX_MAX_COL_LEN) {
+      throw InvalidColLengthError(col_tot_len);
+    }
+    IxFileHdr fhdr(IX_NO_PAGE, 1, IX_NO_PAGE, col_num, col_tot_len, 0, 0,
+                   IX_NO_PAGE, IX_NO_PAGE);
+    fhdr.index_type_ = INDEX_ART;
+    for (int i = 0; i < col_num; ++i) {
+      fhdr.col_types_.emplace_back(index_cols[i].type);
+      fhdr.col_lens_.emplace_back(index_cols[i].len);
+    }
+    fhdr.update_tot_len();
+    std::vector<char> data(fhdr.tot_len_);
+    fhdr.serialize(data.data());
+    disk_manager_->write_page(fd, IX_FILE_HDR_PAGE, data.data(),
+                              fhdr.tot_len_);
+    disk_manager_->set_fd2pageno(fd, 0);
+    disk_manager_->close_file(fd);
+  }
+
   void destroy_index(const std::string& index_name) {
     disk_manager_->destroy_file(index_name);
   }
@@ -173,6 +256,7 @@ class IxManager {
       const std::string& filename, const std::vector<ColMeta>& index_cols) {
     std::string ix_name = get_index_name(filename, index_cols);
     int fd = disk_manager_->open_file(ix_name);
+    disk_manager_->set_file_extent(fd, INDEX_FILE_EXTENT_PAGES);
     return std::make_unique<IxIndexHandle>(disk_manager_, buffer_pool_manager_,
                                            fd);
   }
@@ -181,6 +265,7 @@ class IxManager {
       const std::string& filename, const std::vector<std::string>& index_cols) {
     std::string ix_name = get_index_name(filename, index_cols);
     int fd = disk_manager_->open_file(ix_name);
+    disk_manager_->set_file_extent(fd, INDEX_FILE_EXTENT_PAGES);
     return std::make_unique<IxIndexHandle>(disk_manager_, buffer_pool_manager_,
                                            fd);
   }
@@ -192,6 +277,9 @@ class IxManager {
   }
 
   void close_index(const IxIndexHandle* ih) {
+    if (ih->hash_ != nullptr) {
+      ih->hash_->write_directory();
+    }
     char* data = new char[ih->file_hdr_->tot_len_];
     ih->file_hdr_->serialize(data);
     disk_manager_->write_page(ih->fd_, IX_FILE_HDR_PAGE, data,
@@ -204,7 +292,16 @@ class IxManager {
     delete[] data;
   }
 
+  // 关闭将要删除或被替换的索引文件，缓冲池中的页面直接丢弃，不再写回
+  void discard_index(const IxIndexHandle* ih) {
+    buffer_pool_manager_->delete_all_pages(ih->fd_);
+    disk_manager_->close_file(ih->fd_);
+  }
+
   void flush_index(const IxIndexHandle* ih) {
+    if (ih->hash_ != nullptr) {
+      ih->hash_->write_directory();
+    }
     char* data = new char[ih->file_hdr_->tot_len_];
     ih->file_hdr_->serialize(data);
     disk_manager_->write_page(ih->fd_, IX_FILE_HDR_PAGE, data,
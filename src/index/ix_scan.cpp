@@ -15,6 +15,10 @@ See the Mulan PSL v2 for more details. */
  * @todo 加上读锁（需要使用缓冲池得到page）
  */
 void IxScan::next() {
+  if (reverse_) {
+    prev();
+    return;
+  }
   // assert(!is_end());
   // cur_node_handle_ = ih_->fetch_node(iid_.page_no);
   // assert(node->is_leaf_page());
@@ -27,15 +31,117 @@ void IxScan::next() {
     iid_.slot_no = 0;
     iid_.page_no = cur_node_handle_->get_next_leaf();
     cur_node_handle_->page->RUnlatch();
-    bpm_->unpin_page(cur_node_handle_->page->get_page_id(), false);
+    bpm_->unpin_page(cur_node_handle_->page, false);
     cur_node_handle_ = ih_->fetch_node(iid_.page_no);
     cur_node_handle_->page->RLatch();
+    --prefetch_ahead_;
+    if (prefetch_ahead_ <=
+        (prefetch_parent_exhausted_ ? 0 : SCAN_PREFETCH_PAGES / 2)) {
+      prefetch_leaves();
+    }
   }
   // unpin page! 否则多次大量扫描读会出问题
   // bpm_->unpin_page(node->page->get_page_id(), false);
 }
 
-Rid IxScan::rid() const { return ih_->get_rid(iid_); }
+/**
+ * @brief 反向遍历移到前一个条目。当前叶子的条目用完后先放开它再取前一个叶子，
+ * 不同时持有两个叶子的读锁，和正向遍历一样不会与插入删除死锁；空叶子直接跳过
+ */
+void IxScan::prev() {
+  while (true) {
+    if (iid_.page_no == end_.page_no && iid_.slot_no <= end_.slot_no) {
+      reverse_done_ = true;
+      return;
+    }
+    if (iid_.slot_no > 0) {
+      --iid_.slot_no;
+      return;
+    }
+    if (iid_.page_no == ih_->file_hdr_->first_leaf_) {
+      reverse_done_ = true;
+      return;
+    }
+    page_id_t prev_leaf = cur_node_handle_->get_prev_leaf();
+    cur_node_handle_->page->RUnlatch();
+    bpm_->unpin_page(cur_node_handle_->page, false);
+    cur_node_handle_ = ih_->fetch_node(prev_leaf);
+    cur_node_handle_->page->RLatch();
+    iid_ = {prev_leaf, cur_node_handle_->get_size()};
+  }
+}
+
+/**
+ * @brief 预读当前叶子之后的叶子：叶子的页号不连续，从父结点中取出当前叶子之后的兄弟页号，
+ * 最多SCAN_PREFETCH_PAGES个，到end_所在叶子为止
+ * @note 父结点只用TryRLatch，拿不到就放弃本次预读，不会和自顶向下加写锁的插入删除死锁；
+ * 父结点指针只是提示，要确认它是内部结点且确实包含当前叶子
+ */
+void IxScan::prefetch_leaves() {
+  prefetch_ahead_ = 0;
+  prefetch_parent_exhausted_ = false;
+  if (iid_.page_no == end_.page_no || cur_node_handle_->is_root_page()) {
+    return;
+  }
+  page_id_t parent_no = cur_node_handle_->get_parent_page_no();
+  if (parent_no < 0 || parent_no >= ih_->file_hdr_->num_pages_) {
+    return;
+  }
+  auto parent = ih_->fetch_node(parent_no);
+  if (!parent->page->TryRLatch()) {
+    bpm_->unpin_page(parent->page, false);
+    return;
+  }
+  std::vector<PageId> page_ids;
+  if (!parent->is_leaf_page()) {
+    int size = parent->get_size();
+    int idx = 0;
+    while (idx < size && parent->value_at(idx) != iid_.page_no) {
+      ++idx;
+    }
+    for (++idx;
+         idx < size && static_cast<int>(page_ids.size()) < SCAN_PREFETCH_PAGES;
+         ++idx) {
+      page_id_t child = parent->value_at(idx);
+      if (child < 0 || child >= ih_->file_hdr_->num_pages_) {
+        break;
+      }
+      page_ids.push_back({ih_->fd_, child});
+      if (child == end_.page_no) {
+        break;
+      }
+    }
+    prefetch_parent_exhausted_ = idx >= size;
+  }
+  parent->page->RUnlatch();
+  bpm_->unpin_page(parent->page, false);
+
+  bpm_->prefetch_pages(page_ids);
+  prefetch_ahead_ = page_ids.size();
+}
+
+Rid IxScan::rid() const {
+  if (iid_.slot_no >= cur_node_handle_->get_size()) {
+    throw IndexEntryNotFoundError();
+  }
+  return *cur_node_handle_->get_rid(iid_.slot_no);
+}
+
+int IxScan::leaf_rids(const Rid** rids) const {
+  int end = iid_.page_no == end_.page_no ? end_.slot_no
+                                         : cur_node_handle_->get_size();
+  *rids = cur_node_handle_->get_rid(iid_.slot_no);
+  return std::max(end - iid_.slot_no, 0);
+}
+
+void IxScan::advance(int n) {
+  if (n <= 0) {
+    return;
+  }
+  // 最后一步交给next()，走到叶子末尾时由它换到下一个叶子
+  iid_.slot_no += n - 1;
+  next();
+}
 
 // Iid IxScan::prev_iid() {
 //     auto slot = iid_.slot_no;
@@ -60,26 +166,51 @@ Iid IxScan::prev_iid(const Iid& iid) {
   if (--slot >= 0) {
     return {iid.page_no, slot};
   }
-  auto node = ih_->fetch_node(iid.page_no);
-  node->page->RLatch();
+  // iid在当前叶子上时，当前叶子已经pin住并加了读锁，只需要取前一个叶子
+  std::shared_ptr<IxNodeHandle> node = cur_node_handle_;
+  bool is_cur = iid.page_no == iid_.page_no;
+  if (!is_cur) {
+    node = ih_->fetch_node(iid.page_no);
+    node->page->RLatch();
+  }
   assert(node->is_leaf_page());
+  Iid iidd = {-1, -1};
   if (node->get_page_no() != ih_->file_hdr_->first_leaf_) {
     auto prev_node = ih_->fetch_node(node->get_prev_leaf());
     prev_node->page->RLatch();
-    Iid iidd = {prev_node->get_page_no(), prev_node->get_size() - 1};
-    node->page->RUnlatch();
+    iidd = {prev_node->get_page_no(), prev_node->get_size() - 1};
     prev_node->page->RUnlatch();
-    bpm_->unpin_page(prev_node->get_page_id(), false);
-    bpm_->unpin_page(node->get_page_id(), false);
-    return iidd;
+    bpm_->unpin_page(prev_node->page, false);
+  } else {
+    // 不可能到这里
+    assert(0);
+  }
+  if (!is_cur) {
+    node->page->RUnlatch();
+    bpm_->unpin_page(node->page, false);
+  }
+  return iidd;
+}
+
+Rid IxScan::prev_rid(const Iid& iid) {
+  Iid prev = prev_iid(iid);
+  if (prev.page_no == iid_.page_no) {
+    if (prev.slot_no >= cur_node_handle_->get_size()) {
+      throw IndexEntryNotFoundError();
+    }
+    return *cur_node_handle_->get_rid(prev.slot_no);
   }
-  // 不可能到这里
-  assert(0);
-  node->page->RUnlatch();
-  bpm_->unpin_page(node->get_page_id(), false);
-  return {-1, -1};
+  return ih_->get_rid(prev);
 }
 
-Rid IxScan::prev_rid(const Iid& iid) { return ih_->get_rid(prev_iid(iid)); }
+RmRecord IxScan::get_key() const {
+  RmRecord record(ih_->file_hdr_->col_tot_len_);
+  get_key(record.data);
+  return record;
+}
 
-RmRecord IxScan::get_key() { return ih_->get_key(iid_); }
+void IxScan::get_key(char* dest) const {
+  char key_buf[IX_MAX_COL_LEN];
+  ix_decode_key(cur_node_handle_->get_key(iid_.slot_no, key_buf), dest,
+                ih_->file_hdr_->col_types_, ih_->file_hdr_->col_lens_);
+}
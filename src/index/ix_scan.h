@@ -18,32 +18,64 @@ See the Mulan PSL v2 for more details. */
 // 用于遍历叶子结点
 // 用于直接遍历叶子结点，而不用findleafpage来得到叶子结点
 // TODO：对page遍历时，要加上读锁
+// reverse为true时从upper之前的条目开始沿get_prev_leaf反向遍历到lower，不预读叶子
 class IxScan : public RecScan {
   const IxIndexHandle* ih_;
-  Iid iid_;  // 初始为lower（用于遍历的指针）
-  Iid end_;  // 初始为upper
+  Iid iid_;  // 初始为lower（用于遍历的指针）；反向时为当前条目
+  Iid end_;  // 初始为upper；反向时为lower
   BufferPoolManager* bpm_;
   std::shared_ptr<IxNodeHandle> cur_node_handle_;
+  int prefetch_ahead_ = 0;  // 当前叶子之后已经预读的叶子个数
+  bool prefetch_parent_exhausted_ = false;  // 父结点中剩余的叶子已经全部预读
+  bool reverse_ = false;
+  bool reverse_done_ = false;  // 反向遍历已经越过lower
+
+  void prefetch_leaves();
+
+  // 反向遍历：移到前一个条目，越过end_时置reverse_done_
+  void prev();
 
  public:
   IxScan(const IxIndexHandle* ih, const Iid& lower, const Iid& upper,
-         BufferPoolManager* bpm)
-      : ih_(ih), iid_(lower), end_(upper), bpm_(bpm) {
+         BufferPoolManager* bpm, bool reverse = false)
+      : ih_(ih),
+        iid_(reverse ? upper : lower),
+        end_(reverse ? lower : upper),
+        bpm_(bpm),
+        reverse_(reverse) {
     cur_node_handle_ = ih_->fetch_node(iid_.page_no);
     cur_node_handle_->page->RLatch();
+    if (reverse_) {
+      prev();
+    } else {
+      prefetch_leaves();
+    }
   }
 
   ~IxScan() override {
     cur_node_handle_->page->RUnlatch();
-    bpm_->unpin_page(cur_node_handle_->get_page_id(), false);
+    bpm_->unpin_page(cur_node_handle_->page, false);
   }
 
   void next() override;
 
-  bool is_end() const override { return iid_ == end_; }
+  bool is_end() const override {
+    return reverse_ ? reverse_done_ : iid_ == end_;
+  }
 
+  // 当前位置的rid，直接读已经加了读锁的当前叶子，不经过缓冲池
   Rid rid() const override;
 
+  /**
+   * @description: 当前叶子中从当前位置开始、到叶子末尾或end_为止的所有rid，一次取出整段，
+   * 取完后用advance跳过。*rids指向叶子页面中的数组，只在离开当前叶子之前有效。只用于正向遍历
+   * @return {int} rid的个数
+   */
+  int leaf_rids(const Rid** rids) const;
+
+  // 向后移动n个条目，n不超过leaf_rids返回的个数
+  void advance(int n);
+
   const Iid& iid() const { return iid_; }
 
   Iid prev_iid();
@@ -52,5 +84,8 @@ class IxScan : public RecScan {
 
   Rid prev_rid(const Iid& iid);
 
-  RmRecord get_key();
+  RmRecord get_key() const;
+
+  // 把当前位置的key解码成原始格式写到dest（col_tot_len字节），直接读已经加了读锁的当前叶子
+  void get_key(char* dest) const;
 };
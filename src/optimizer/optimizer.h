@@ -35,7 +35,7 @@ class Optimizer {
         // 重新组织if-else条件判断顺序
         if (auto x = std::dynamic_pointer_cast<ast::SetStmt>(query->parse)) {
             // Set Knob Plan
-            return std::make_shared<SetKnobPlan>(x->set_knob_type_, x->bool_val_);
+            return std::make_shared<SetKnobPlan>(x->set_knob_type_, x->bool_val_, x->int_val_);
         } else if (auto x = std::dynamic_pointer_cast<ast::TxnRollback>(query->parse)) {
             // rollback;
             return std::make_shared<OtherPlan>(T_Transaction_rollback, std::string());
@@ -46,8 +46,9 @@ class Optimizer {
             // abort;
             return std::make_shared<OtherPlan>(T_Transaction_abort, std::string());
         } else if (auto x = std::dynamic_pointer_cast<ast::TxnBegin>(query->parse)) {
-            // begin;
-            return std::make_shared<OtherPlan>(T_Transaction_begin, std::string());
+            // begin; begin read only;
+            return std::make_shared<OtherPlan>(x->read_only ? T_Transaction_begin_read_only : T_Transaction_begin,
+                                               std::string());
         } else if (auto x = std::dynamic_pointer_cast<ast::DescTable>(query->parse)) {
             // desc table;
             return std::make_shared<OtherPlan>(T_DescTable, x->tab_name);
@@ -57,6 +58,42 @@ class Optimizer {
         } else if (auto x = std::dynamic_pointer_cast<ast::ShowTables>(query->parse)) {
             // show tables;
             return std::make_shared<OtherPlan>(T_ShowTable, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowBufferStatus>(query->parse)) {
+            // show buffer status;
+            return std::make_shared<OtherPlan>(T_ShowBufferStatus, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowLocks>(query->parse)) {
+            // show locks;
+            return std::make_shared<OtherPlan>(T_ShowLocks, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowLockStatus>(query->parse)) {
+            // show lock status;
+            return std::make_shared<OtherPlan>(T_ShowLockStatus, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowStatus>(query->parse)) {
+            // show status;
+            return std::make_shared<OtherPlan>(T_ShowStatus, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowMemory>(query->parse)) {
+            // show memory;
+            return std::make_shared<OtherPlan>(T_ShowMemory, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::ShowSessions>(query->parse)) {
+            // show sessions;
+            return std::make_shared<OtherPlan>(T_ShowSessions, std::string());
+        } else if (auto x = std::dynamic_pointer_cast<ast::KillSession>(query->parse)) {
+            // kill session;
+            return std::make_shared<KillPlan>(x->session_id);
+        } else if (auto x = std::dynamic_pointer_cast<ast::VacuumTable>(query->parse)) {
+            // vacuum table;
+            return std::make_shared<OtherPlan>(T_Vacuum, x->tab_name);
+        } else if (auto x = std::dynamic_pointer_cast<ast::TruncateTable>(query->parse)) {
+            // truncate table;
+            return std::make_shared<OtherPlan>(T_Truncate, x->tab_name);
+        } else if (auto x = std::dynamic_pointer_cast<ast::AnalyzeTable>(query->parse)) {
+            // analyze table;
+            return std::make_shared<OtherPlan>(T_Analyze, x->tab_name);
+        } else if (auto x = std::dynamic_pointer_cast<ast::CopyTo>(query->parse)) {
+            // copy table to 'file';
+            return std::make_shared<CopyPlan>(x->tab_name, x->file_name, x->binary);
+        } else if (auto x = std::dynamic_pointer_cast<ast::Backup>(query->parse)) {
+            // backup to 'dir';
+            return std::make_shared<BackupPlan>(x->dir);
         } else if (auto x = std::dynamic_pointer_cast<ast::Help>(query->parse)) {
             // help;
             return std::make_shared<OtherPlan>(T_Help, std::string());
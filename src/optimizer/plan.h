@@ -19,20 +19,35 @@ See the Mulan PSL v2 for more details. */
 #include "parser/parser.h"
 #include "plan_tree.h"
 #include "common/common.h"
+#include "common/expression.h"
 #include "system/sm.h"
 
 // 重新排列枚举顺序
 typedef enum PlanTag{
     T_Invalid = 1,
     T_Transaction_begin,
+    T_Transaction_begin_read_only,  // BEGIN READ ONLY
     T_Transaction_commit,
     T_Transaction_abort,
     T_Transaction_rollback,
     T_Help,
     T_ShowTable,
     T_ShowIndex,
+    T_ShowBufferStatus,
+    T_ShowLocks,
+    T_ShowLockStatus,
+    T_ShowStatus,
+    T_ShowMemory,
+    T_ShowSessions,
+    T_Kill,
+    T_Vacuum,
+    T_Truncate,
+    T_Analyze,
+    T_CopyTo,
+    T_Backup,
     T_DescTable,
     T_CreateTable,
+    T_CreateMatView,  // CREATE MATERIALIZED VIEW
     T_DropTable,
     T_CreateIndex,
     T_DropIndex,
@@ -44,11 +59,19 @@ typedef enum PlanTag{
     T_Explain,       // EXPLAIN语句
     T_SeqScan,
     T_IndexScan,
+    T_BitmapScan,   // 几路索引扫描的rid取并集或交集，按rid顺序回表
     T_NestLoop,
     T_SortMerge,    // sort merge join
+    T_HashJoin,     // hash join
+    T_IndexNestLoop, // index nested loop join
+    T_SemiJoin,     // IN子查询改写成的哈希半连接，右儿子是子查询的计划
+    T_AntiJoin,     // NOT IN子查询改写成的哈希反连接
     T_Sort,
     T_Filter,       // WHERE条件过滤
-    T_Projection
+    T_Projection,
+    T_Aggregate,    // 聚合函数、GROUP BY和HAVING
+    T_Distinct,     // SELECT DISTINCT去重
+    T_Limit         // LIMIT/OFFSET
 } PlanTag;
 
 // 查询执行计划
@@ -59,6 +82,12 @@ public:
     virtual ~Plan() = default;
 };
 
+// 位图扫描中的一路索引扫描
+struct BitmapArm {
+    std::vector<std::string> index_col_names;
+    std::vector<Condition> conds;  // 用来确定区间的条件，顺序和IndexScan的conds_相同
+};
+
 class ScanPlan : public Plan
 {
     public:
@@ -82,6 +111,20 @@ class ScanPlan : public Plan
         size_t len_;                               
         std::vector<Condition> fed_conds_;
         std::vector<std::string> index_col_names_;
+        // 只涉及这张表的表达式条件，扫描时和conds_一起计算。表达式中的常量不代入参数，有常量时计划不会被缓存
+        std::vector<ExprCond> expr_conds_;
+        // 只涉及这张表的OR条件组，扫描时和conds_一起计算
+        std::vector<OrCond> or_conds_;
+        // BitmapScan的各路索引扫描，bitmap_and_时取各路rid的交集，否则取并集
+        std::vector<BitmapArm> bitmap_arms_;
+        bool bitmap_and_ = false;
+        bool covering_ = false;  // IndexScan用到的列都在索引中，不需要回表
+        bool rid_sorted_ = false;  // IndexScan先取出区间中所有rid，按页面排序后回表，输出不按索引字段有序
+        bool desc_ = false;  // IndexScan反向遍历区间，按索引字段降序输出
+        bool skip_scan_ = false;  // IndexScan跳过索引的第一个字段，逐个取它的不同值扫描
+        bool always_false_ = false;  // WHERE条件恒为假，不读表
+        // SeqScan和IndexScan只输出这些字段，偏移是在窄记录中的偏移；为空时输出整条记录
+        std::vector<ColMeta> out_cols_;
     
 };
 
@@ -103,6 +146,10 @@ class JoinPlan : public Plan
         std::shared_ptr<Plan> right_;
         // 连接条件
         std::vector<Condition> conds_;
+        // 哈希连接时在左儿子上建哈希表，否则在右儿子上建
+        bool build_left_ = false;
+        // 索引嵌套循环连接时右儿子是内表的ScanPlan，用内表上的这个索引查找
+        std::vector<std::string> index_col_names_;
         // future TODO: 后续可以支持的连接类型
         JoinType type;
 };
@@ -119,6 +166,67 @@ class ProjectionPlan : public Plan
         ~ProjectionPlan(){}
         std::shared_ptr<Plan> subplan_;
         std::vector<TabCol> sel_cols_;
+        std::vector<std::shared_ptr<const Expression>> exprs_;  // 和sel_cols_一一对应，计算列的表达式，普通的列为空
+        std::vector<std::string> alias_;  // 和sel_cols_一一对应，非空时作为结果的列名
+        
+};
+
+// 分组聚合：输出的每一列依次对应选取列表中的一项，分组列原样输出，聚合值的列名见agg_col_name
+class AggregatePlan : public Plan
+{
+    public:
+        AggregatePlan(PlanTag tag, std::shared_ptr<Plan> subplan, std::vector<TabCol> sel_cols,
+                      std::vector<AggType> agg_types, std::vector<TabCol> group_bys, std::vector<Condition> havings,
+                      bool sorted)
+        {
+            Plan::tag = tag;
+            subplan_ = std::move(subplan);
+            sel_cols_ = std::move(sel_cols);
+            agg_types_ = std::move(agg_types);
+            group_bys_ = std::move(group_bys);
+            havings_ = std::move(havings);
+            sorted_ = sorted;
+        }
+        ~AggregatePlan(){}
+        std::shared_ptr<Plan> subplan_;
+        std::vector<TabCol> sel_cols_;      // 聚合函数的参数列，COUNT(*)时为空；分组列是列本身
+        std::vector<AggType> agg_types_;    // 和sel_cols_一一对应
+        std::vector<TabCol> group_bys_;
+        std::vector<Condition> havings_;
+        bool sorted_;   // 输入中分组key相同的记录相邻，流式聚合，不建哈希表
+        
+};
+
+// LIMIT n OFFSET m：跳过前offset_条，之后最多输出limit_条
+class LimitPlan : public Plan
+{
+    public:
+        LimitPlan(PlanTag tag, std::shared_ptr<Plan> subplan, int limit, int offset)
+        {
+            Plan::tag = tag;
+            subplan_ = std::move(subplan);
+            limit_ = limit;
+            offset_ = offset;
+        }
+        ~LimitPlan(){}
+        std::shared_ptr<Plan> subplan_;
+        int limit_;     // -1表示没有LIMIT，只有OFFSET
+        int offset_;
+        
+};
+
+class DistinctPlan : public Plan
+{
+    public:
+        DistinctPlan(PlanTag tag, std::shared_ptr<Plan> subplan, bool sorted)
+        {
+            Plan::tag = tag;
+            subplan_ = std::move(subplan);
+            sorted_ = sorted;
+        }
+        ~DistinctPlan(){}
+        std::shared_ptr<Plan> subplan_;
+        bool sorted_;   // 输入中相同的记录相邻，只和上一条比较，不建哈希表
         
 };
 
@@ -136,6 +244,7 @@ class SortPlan : public Plan
         std::shared_ptr<Plan> subplan_;
         TabCol sel_col_;
         bool is_desc_;
+        int limit_ = -1;    // 只需要前limit_条，不为-1时用有界堆做Top-N排序
         
 };
 
@@ -191,6 +300,13 @@ class DDLPlan : public Plan
         std::string tab_name_;
         std::vector<std::string> tab_col_names_;
         std::vector<ColDef> cols_;
+        RmFormat format_ = RM_FORMAT_FIXED;  // create table: 数据文件的页面格式
+        TabPersistence persistence_ = TAB_PERMANENT;  // create table: 普通表、不写日志的表或临时表
+        bool in_memory_ = false;  // create table: 数据页常驻缓冲池
+        bool compressed_ = false;  // create table: 数据文件和索引文件的页面压缩存储
+        IndexType index_type_ = INDEX_BTREE;  // create index: 索引的组织方式
+        MatViewDef mat_view_;  // create materialized view: 视图的定义，cols_是视图表的字段
+        PartitionDef partition_;  // create table: 分区表的分区字段和分区数，不分区时为空
 };
 
 // help; show tables; desc tables; begin; abort; commit; rollback语句对应的plan
@@ -206,17 +322,58 @@ class OtherPlan : public Plan
         std::string tab_name_;
 };
 
+// COPY table TO 'file' Plan
+class CopyPlan : public Plan
+{
+    public:
+        CopyPlan(std::string tab_name, std::string file_name, bool binary)
+        {
+            Plan::tag = T_CopyTo;
+            tab_name_ = std::move(tab_name);
+            file_name_ = std::move(file_name);
+            binary_ = binary;
+        }
+        ~CopyPlan(){}
+        std::string tab_name_;
+        std::string file_name_;
+        bool binary_;  // 二进制格式，否则为CSV
+};
+
+// BACKUP TO 'dir' Plan
+class BackupPlan : public Plan
+{
+    public:
+        explicit BackupPlan(std::string dir) {
+            Plan::tag = T_Backup;
+            dir_ = std::move(dir);
+        }
+    std::string dir_;
+};
+
+// KILL Plan
+class KillPlan : public Plan
+{
+    public:
+        explicit KillPlan(uint64_t session_id) {
+            Plan::tag = T_Kill;
+            session_id_ = session_id;
+        }
+    uint64_t session_id_;
+};
+
 // Set Knob Plan
 class SetKnobPlan : public Plan
 {
     public:
-        SetKnobPlan(ast::SetKnobType knob_type, bool bool_value) {
+        SetKnobPlan(ast::SetKnobType knob_type, bool bool_value, int int_value = 0) {
             Plan::tag = T_SetKnob;
             set_knob_type_ = knob_type;
             bool_value_ = bool_value;
+            int_value_ = int_value;
         }
     ast::SetKnobType set_knob_type_;
     bool bool_value_;
+    int int_value_;
 };
 
 // EXPLAIN语句对应的plan
@@ -228,9 +385,18 @@ public:
         Plan::tag = tag;
         plan_tree_ = std::move(plan_tree);
     }
+    // EXPLAIN ANALYZE
+    ExplainPlan(PlanTag tag, std::shared_ptr<Plan> subplan)
+    {
+        Plan::tag = tag;
+        subplan_ = std::move(subplan);
+        analyze_ = true;
+    }
     ~ExplainPlan(){}
     
     std::shared_ptr<PlanTreeNode> plan_tree_;
+    std::shared_ptr<Plan> subplan_;  // EXPLAIN ANALYZE执行的计划
+    bool analyze_ = false;
 };
 
 class plannerInfo{
@@ -0,0 +1,542 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "plan_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "errors.h"
+
+namespace {
+
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+std::string to_upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::toupper(c); });
+    return s;
+}
+
+bool is_dml(const std::string &word) {
+    return word == "SELECT" || word == "INSERT" || word == "UPDATE" || word == "DELETE";
+}
+
+/**
+ * @description: 按词法分析器的规则识别pos处的字面量：{sign}?{digit}+、{sign}?{digit}+\.({digit}+)?、'([^']|\\')*'
+ * @return {size_t} 识别出时把值放到val中，返回字面量之后的位置；不是字面量时返回pos
+ */
+size_t scan_literal(const std::string &sql, size_t pos, Value *val) {
+    size_t n = sql.size();
+    size_t i = pos;
+    if (sql[i] == '\'') {
+        // 最长匹配：在第一个前面不是反斜杠的引号处结束，没有这样的引号时在最后一个引号处结束
+        size_t end = std::string::npos;
+        for (++i; i < n; ++i) {
+            if (sql[i] == '\'') {
+                end = i;
+                if (sql[i - 1] != '\\') {
+                    break;
+                }
+            }
+        }
+        if (end == std::string::npos) {
+            return pos;
+        }
+        val->set_str(sql.substr(pos + 1, end - pos - 1));
+        return end + 1;
+    }
+    if (sql[i] == '+' || sql[i] == '-') {
+        ++i;
+    }
+    if (i == n || !is_digit(sql[i])) {
+        return pos;
+    }
+    while (i < n && is_digit(sql[i])) {
+        ++i;
+    }
+    if (i < n && sql[i] == '.') {
+        for (++i; i < n && is_digit(sql[i]); ++i) {
+        }
+        val->set_float(static_cast<float>(atof(sql.substr(pos, i - pos).c_str())));
+    } else {
+        val->set_int(atoi(sql.substr(pos, i - pos).c_str()));
+    }
+    return i;
+}
+
+// 跳过空白后读pos处的一个单词，没有时返回空串
+std::string next_word(const std::string &sql, size_t *pos) {
+    size_t i = *pos;
+    while (i < sql.size() && is_space(sql[i])) {
+        ++i;
+    }
+    size_t end = i;
+    while (end < sql.size() && (is_alpha(sql[end]) || is_digit(sql[end]) || sql[end] == '_')) {
+        ++end;
+    }
+    *pos = end;
+    return sql.substr(i, end - i);
+}
+
+// 跳过空白后pos处是c时跳过它并返回true
+bool skip_char(const std::string &sql, size_t *pos, char c) {
+    size_t i = *pos;
+    while (i < sql.size() && is_space(sql[i])) {
+        ++i;
+    }
+    if (i < sql.size() && sql[i] == c) {
+        *pos = i + 1;
+        return true;
+    }
+    return false;
+}
+
+// pos之后只剩下可选的分号和空白
+bool at_end(const std::string &sql, size_t pos) {
+    skip_char(sql, &pos, ';');
+    while (pos < sql.size() && is_space(sql[pos])) {
+        ++pos;
+    }
+    return pos == sql.size();
+}
+
+/**
+ * @description: 找出语句中字符串以外的$n。args为nullptr时只统计参数个数（最大的n），否则把$n换成args[n-1]
+ */
+std::string substitute_params(const std::string &sql, const std::vector<std::string> *args, int *num_params) {
+    std::string res;
+    *num_params = 0;
+    for (size_t i = 0; i < sql.size();) {
+        Value val;
+        size_t end = sql[i] == '\'' ? scan_literal(sql, i, &val) : i;
+        if (end != i) {
+            res.append(sql, i, end - i);
+            i = end;
+            continue;
+        }
+        if (sql[i] != '$') {
+            res.push_back(sql[i++]);
+            continue;
+        }
+        for (end = i + 1; end < sql.size() && is_digit(sql[end]); ++end) {
+        }
+        int n = atoi(sql.substr(i + 1, end - i - 1).c_str());
+        if (n <= 0) {
+            throw RMDBError("invalid parameter placeholder in prepared statement");
+        }
+        *num_params = std::max(*num_params, n);
+        if (args != nullptr) {
+            res.append(args->at(n - 1));
+        }
+        i = end;
+    }
+    return res;
+}
+
+/**
+ * @description: 把val换成第val.param个参数。类型按语义分析时的规则转换（UPDATE给float字段赋int值），
+ * val在语义分析时初始化过raw的，按原来的长度重新初始化，字符串太长时和分析时一样抛出StringOverflowError
+ */
+bool bind_value(Value &val, const std::vector<Value> &params, std::vector<bool> *bound) {
+    if (val.param < 0) {
+        return true;
+    }
+    if (val.param >= static_cast<int>(params.size())) {
+        return false;
+    }
+    const Value &param = params[val.param];
+    Value res = param;
+    res.raw.reset();
+    res.param = val.param;
+    if (val.type != param.type) {
+        if (val.type != TYPE_FLOAT || param.type != TYPE_INT) {
+            return false;
+        }
+        res.set_float(static_cast<float>(param.int_val));
+    }
+    if (!val.raw.empty()) {
+        res.init_raw(val.raw.size());
+    }
+    val = std::move(res);
+    (*bound)[val.param] = true;
+    return true;
+}
+
+bool bind_conds(std::vector<Condition> &conds, const std::vector<Value> &params, std::vector<bool> *bound) {
+    for (auto &cond : conds) {
+        if (cond.is_rhs_val && !bind_value(cond.rhs_val, params, bound)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @description: 深拷贝计划树，同时把params代入拷贝中的值。计划中有不认识的结点时返回false，这样的计划不缓存
+ */
+bool copy_plan(const std::shared_ptr<Plan> &plan, const std::vector<Value> &params, std::vector<bool> *bound,
+               std::shared_ptr<Plan> *out) {
+    if (plan == nullptr) {
+        *out = nullptr;
+        return true;
+    }
+    if (auto x = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        // 条件恒为假是按这次的字面量判断的，换了参数不一定成立
+        if (x->always_false_) {
+            return false;
+        }
+        auto copy = std::make_shared<ScanPlan>(*x);
+        *out = copy;
+        for (auto &or_cond : copy->or_conds_) {
+            if (!bind_conds(or_cond.conds, params, bound)) {
+                return false;
+            }
+        }
+        for (auto &arm : copy->bitmap_arms_) {
+            if (!bind_conds(arm.conds, params, bound)) {
+                return false;
+            }
+        }
+        return bind_conds(copy->conds_, params, bound) && bind_conds(copy->fed_conds_, params, bound);
+    }
+    if (auto x = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        auto copy = std::make_shared<JoinPlan>(*x);
+        *out = copy;
+        return bind_conds(copy->conds_, params, bound) && copy_plan(x->left_, params, bound, &copy->left_) &&
+               copy_plan(x->right_, params, bound, &copy->right_);
+    }
+    if (auto x = std::dynamic_pointer_cast<FilterPlan>(plan)) {
+        auto copy = std::make_shared<FilterPlan>(*x);
+        *out = copy;
+        return bind_conds(copy->filter_conds_, params, bound) && copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<ProjectionPlan>(plan)) {
+        auto copy = std::make_shared<ProjectionPlan>(*x);
+        *out = copy;
+        return copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        auto copy = std::make_shared<SortPlan>(*x);
+        *out = copy;
+        return copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<AggregatePlan>(plan)) {
+        auto copy = std::make_shared<AggregatePlan>(*x);
+        *out = copy;
+        return bind_conds(copy->havings_, params, bound) && copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<DistinctPlan>(plan)) {
+        auto copy = std::make_shared<DistinctPlan>(*x);
+        *out = copy;
+        return copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<LimitPlan>(plan)) {
+        auto copy = std::make_shared<LimitPlan>(*x);
+        *out = copy;
+        return copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    if (auto x = std::dynamic_pointer_cast<DMLPlan>(plan)) {
+        auto copy = std::make_shared<DMLPlan>(*x);
+        *out = copy;
+        for (auto &val : copy->values_) {
+            if (!bind_value(val, params, bound)) {
+                return false;
+            }
+        }
+        for (auto &set_clause : copy->set_clauses_) {
+            if (!bind_value(set_clause.rhs, params, bound)) {
+                return false;
+            }
+        }
+        return bind_conds(copy->conds_, params, bound) && copy_plan(x->subplan_, params, bound, &copy->subplan_);
+    }
+    // DDL、事务控制、EXPLAIN等语句不缓存
+    return false;
+}
+
+}  // namespace
+
+bool normalize_sql(const std::string &sql, std::string *key, std::vector<Value> *params) {
+    key->clear();
+    params->clear();
+    std::string prev_word;  // 上一个单词的大写，判断数字是不是LIMIT/OFFSET的参数
+    size_t n = sql.size();
+    for (size_t i = 0; i < n;) {
+        char c = sql[i];
+        if (is_space(c)) {
+            while (i < n && is_space(sql[i])) {
+                ++i;
+            }
+            if (!key->empty() && i < n) {
+                key->push_back(' ');
+            }
+            continue;
+        }
+        if (is_alpha(c)) {
+            size_t end = i;
+            std::string word = next_word(sql, &end);
+            prev_word = to_upper(word);
+            if (key->empty() && !is_dml(prev_word)) {
+                return false;
+            }
+            key->append(word);
+            i = end;
+            continue;
+        }
+        if (key->empty()) {
+            return false;
+        }
+        Value val;
+        size_t end = scan_literal(sql, i, &val);
+        if (end != i) {
+            if (val.type == TYPE_INT && (prev_word == "LIMIT" || prev_word == "OFFSET")) {
+                key->append(sql, i, end - i);
+            } else {
+                key->append(val.type == TYPE_INT ? "?i" : val.type == TYPE_FLOAT ? "?f" : "?s");
+                params->push_back(std::move(val));
+            }
+        } else if (c != '\0' && strchr(";(),*=><.", c) != nullptr) {
+            // 词法分析器的运算符，<=、>=、<>中间没有空白，原样保留就不会和分开写的混淆
+            key->push_back(c);
+            end = i + 1;
+        } else {
+            // 注释、单独的+、-和词法分析器不认识的字符
+            return false;
+        }
+        prev_word.clear();
+        i = end;
+    }
+    return !key->empty();
+}
+
+std::shared_ptr<Plan> PlanCache::get(const std::string &key, const std::vector<Value> &params, uint64_t version) {
+    std::shared_ptr<Plan> plan = find(key, version);
+    if (plan == nullptr && parent_ != nullptr) {
+        plan = parent_->find(key, version);
+        if (plan != nullptr) {
+            insert(key, plan, version);
+        }
+    }
+    if (plan == nullptr) {
+        return nullptr;
+    }
+    std::vector<bool> bound(params.size(), false);
+    std::shared_ptr<Plan> copy;
+    if (!copy_plan(plan, params, &bound, &copy)) {
+        return nullptr;
+    }
+    return copy;
+}
+
+void PlanCache::put(const std::string &key, const std::shared_ptr<Plan> &plan, const std::vector<Value> &params,
+                    uint64_t version) {
+    // 缓存一份拷贝，传入的计划接下来会被Portal拆掉
+    std::vector<bool> bound(params.size(), false);
+    std::shared_ptr<Plan> copy;
+    if (!copy_plan(plan, params, &bound, &copy) || std::find(bound.begin(), bound.end(), false) != bound.end()) {
+        return;
+    }
+    insert(key, copy, version);
+    if (parent_ != nullptr) {
+        parent_->insert(key, copy, version);
+    }
+}
+
+std::shared_ptr<Plan> PlanCache::find(const std::string &key, uint64_t version) {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    if (it->second.version != version) {
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.plan;
+}
+
+void PlanCache::insert(const std::string &key, const std::shared_ptr<Plan> &plan, uint64_t version) {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        // 优化期间发生了DDL的线程不能用旧版本的计划覆盖新的
+        if (it->second.version <= version) {
+            it->second.plan = plan;
+            it->second.version = version;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return;
+    }
+    if (entries_.size() >= capacity_) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{plan, version, lru_.begin()});
+}
+
+void ResultCache::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> guard(latch_);
+    enabled_.store(enabled);
+    if (!enabled) {
+        entries_.clear();
+        lru_.clear();
+        size_ = 0;
+    }
+}
+
+std::string ResultCache::make_key(const std::string &shape, const std::vector<Value> &params) {
+    std::string key = shape;
+    for (const auto &param : params) {
+        key.push_back('\0');
+        key.push_back(static_cast<char>(param.type));
+        if (param.type == TYPE_INT) {
+            key.append(reinterpret_cast<const char *>(&param.int_val), sizeof(param.int_val));
+        } else if (param.type == TYPE_FLOAT) {
+            key.append(reinterpret_cast<const char *>(&param.float_val), sizeof(param.float_val));
+        } else {
+            // 字符串前面加上长度，包含'\0'的字符串不会和后面的参数混淆
+            uint32_t len = static_cast<uint32_t>(param.str_val.size());
+            key.append(reinterpret_cast<const char *>(&len), sizeof(len));
+            key.append(param.str_val);
+        }
+    }
+    return key;
+}
+
+bool ResultCache::get(const std::string &key, uint64_t version, const std::function<uint64_t(int)> &change_count,
+                      std::string *result) {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    const Tag &tag = it->second.tag;
+    bool valid = tag.version == version;
+    for (size_t i = 0; valid && i < tag.tables.size(); ++i) {
+        valid = change_count(tag.tables[i].first) == tag.tables[i].second;
+    }
+    if (!valid) {
+        erase(it);
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    *result = it->second.result;
+    return true;
+}
+
+void ResultCache::put(const std::string &key, Tag tag, std::string result) {
+    if (result.size() > capacity_ / 2) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(latch_);
+    if (!enabled_.load()) {
+        return;
+    }
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        erase(it);
+    }
+    while (!lru_.empty() && size_ + result.size() > capacity_) {
+        erase(entries_.find(lru_.back()));
+    }
+    size_ += result.size();
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{std::move(tag), std::move(result), lru_.begin()});
+}
+
+void ResultCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    size_ -= it->second.result.size();
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+bool PreparedStatements::handle(std::string &sql) {
+    size_t pos = 0;
+    std::string cmd = to_upper(next_word(sql, &pos));
+    if (cmd == "PREPARE") {
+        std::string name = next_word(sql, &pos);
+        if (name.empty() || to_upper(next_word(sql, &pos)) != "AS") {
+            throw RMDBError("expected PREPARE name AS statement");
+        }
+        while (pos < sql.size() && is_space(sql[pos])) {
+            ++pos;
+        }
+        Stmt stmt{sql.substr(pos), 0};
+        size_t start = 0;
+        if (!is_dml(to_upper(next_word(stmt.sql, &start)))) {
+            throw RMDBError("only SELECT, INSERT, UPDATE and DELETE can be prepared");
+        }
+        substitute_params(stmt.sql, nullptr, &stmt.num_params);
+        if (!stmts_.emplace(name, std::move(stmt)).second) {
+            throw RMDBError("prepared statement " + name + " already exists");
+        }
+        return true;
+    }
+    if (cmd == "EXECUTE") {
+        std::string name = next_word(sql, &pos);
+        auto it = stmts_.find(name);
+        if (it == stmts_.end()) {
+            throw RMDBError("prepared statement " + name + " does not exist");
+        }
+        std::vector<std::string> args;
+        if (skip_char(sql, &pos, '(')) {
+            do {
+                while (pos < sql.size() && is_space(sql[pos])) {
+                    ++pos;
+                }
+                Value val;
+                size_t end = pos < sql.size() ? scan_literal(sql, pos, &val) : pos;
+                if (end == pos) {
+                    throw RMDBError("parameters of EXECUTE must be literals");
+                }
+                args.push_back(sql.substr(pos, end - pos));
+                pos = end;
+            } while (skip_char(sql, &pos, ','));
+            if (!skip_char(sql, &pos, ')')) {
+                throw RMDBError("expected EXECUTE name (value, ...)");
+            }
+        }
+        if (!at_end(sql, pos)) {
+            throw RMDBError("expected EXECUTE name (value, ...)");
+        }
+        if (static_cast<int>(args.size()) != it->second.num_params) {
+            throw RMDBError("prepared statement " + name + " expects " + std::to_string(it->second.num_params) +
+                            " parameters");
+        }
+        int num_params;
+        sql = substitute_params(it->second.sql, &args, &num_params);
+        return false;
+    }
+    if (cmd == "DEALLOCATE") {
+        std::string name = next_word(sql, &pos);
+        if (to_upper(name) == "PREPARE") {
+            name = next_word(sql, &pos);
+        }
+        if (name.empty() || !at_end(sql, pos)) {
+            throw RMDBError("expected DEALLOCATE [PREPARE] name | ALL");
+        }
+        if (to_upper(name) == "ALL") {
+            stmts_.clear();
+        } else if (stmts_.erase(name) == 0) {
+            throw RMDBError("prepared statement " + name + " does not exist");
+        }
+        return true;
+    }
+    return false;
+}
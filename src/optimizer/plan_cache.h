@@ -0,0 +1,139 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "plan.h"
+
+/**
+ * @description: 把SQL文本规范化成计划缓存的key，只处理SELECT/INSERT/UPDATE/DELETE语句。
+ * 连续的空白换成一个空格；int/float/string字面量换成?i、?f、?s，值按出现的顺序放到params中，
+ * 这个顺序和语法分析时给字面量的编号（ast::Value::param）一致；LIMIT/OFFSET后面的数字决定计划的形状，留在key中。
+ * 含有注释或词法分析器不认识的字符时不缓存，返回false
+ */
+bool normalize_sql(const std::string &sql, std::string *key, std::vector<Value> *params);
+
+/**
+ * @description: 计划缓存，key是normalize_sql得到的语句形状。缓存的计划是只读的原件，
+ * Portal会把计划中的条件和值移动到算子中，所以每次取出时深拷贝一份，再把新语句的参数代入带有参数编号的值。
+ * 条目记录放入时SmManager的目录版本，DDL、ANALYZE和修改连接算法的开关会让版本加一，旧条目在查找时丢弃。
+ * 每个连接有一个私有的缓存，parent_是所有连接共享的全局缓存，私有缓存未命中时再查全局缓存
+ */
+class PlanCache {
+   public:
+    explicit PlanCache(size_t capacity, PlanCache *parent = nullptr) : capacity_(capacity), parent_(parent) {}
+
+    // 命中时返回代入params后的计划，未命中或者参数代入不了时返回nullptr
+    std::shared_ptr<Plan> get(const std::string &key, const std::vector<Value> &params, uint64_t version);
+
+    // 缓存刚生成的计划，params是这条语句的参数。计划中有参数没有代入的位置时（比如优化器合并掉了条件），换了参数计划就不对了，不缓存
+    void put(const std::string &key, const std::shared_ptr<Plan> &plan, const std::vector<Value> &params,
+             uint64_t version);
+
+   private:
+    struct Entry {
+        std::shared_ptr<Plan> plan;  // 只读
+        uint64_t version;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::shared_ptr<Plan> find(const std::string &key, uint64_t version);
+
+    void insert(const std::string &key, const std::shared_ptr<Plan> &plan, uint64_t version);
+
+    size_t capacity_;
+    PlanCache *parent_;
+    std::mutex latch_;
+    std::list<std::string> lru_;  // 最近用过的在前
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+/**
+ * @description: 查询结果缓存，默认关闭，set result_cache = true 打开。key是语句的形状加上参数的值，
+ * 值是一条自动提交的SELECT发给客户端的结果。条目记下执行之前的目录版本和用到的每个表的修改计数
+ * （RmFileHandle::change_count），查找时有一个对不上就丢弃。所有结果加起来不超过capacity_字节，按LRU淘汰
+ */
+class ResultCache {
+   public:
+    // 结果依赖的状态：目录版本，以及用到的表的ID和修改计数
+    struct Tag {
+        uint64_t version;
+        std::vector<std::pair<int, uint64_t>> tables;
+    };
+
+    explicit ResultCache(size_t capacity) : capacity_(capacity) {}
+
+    // 所有连接共享的结果缓存
+    static ResultCache &instance() {
+        static ResultCache cache(RESULT_CACHE_SIZE);
+        return cache;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // 关闭时清空所有条目
+    void set_enabled(bool enabled);
+
+    // normalize_sql得到的形状和参数拼成key，参数按类型和原始字节编码，不同的值得到不同的key
+    static std::string make_key(const std::string &shape, const std::vector<Value> &params);
+
+    // 命中时把结果放到result中。change_count给出表现在的修改计数
+    bool get(const std::string &key, uint64_t version, const std::function<uint64_t(int)> &change_count,
+             std::string *result);
+
+    // 超过容量的一半的结果不缓存
+    void put(const std::string &key, Tag tag, std::string result);
+
+   private:
+    struct Entry {
+        Tag tag;
+        std::string result;
+        std::list<std::string>::iterator lru;
+    };
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+
+    size_t capacity_;
+    size_t size_ = 0;  // 所有结果的字节数
+    std::atomic<bool> enabled_{false};
+    std::mutex latch_;
+    std::list<std::string> lru_;  // 最近用过的在前
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+/**
+ * @description: 一个连接上用PREPARE定义的语句，参数写成$1、$2……：
+ *   PREPARE name AS statement;
+ *   EXECUTE name [(value, ...)];
+ *   DEALLOCATE [PREPARE] name | ALL;
+ * 在文本层面处理，EXECUTE把参数代入语句后按普通语句执行，解析和优化由计划缓存省掉
+ */
+class PreparedStatements {
+   public:
+    // sql是PREPARE/DEALLOCATE时处理完返回true；是EXECUTE时把sql换成代入参数后的语句，返回false；其他语句不变，返回false
+    bool handle(std::string &sql);
+
+   private:
+    struct Stmt {
+        std::string sql;
+        int num_params;
+    };
+
+    std::unordered_map<std::string, Stmt> stmts_;
+};
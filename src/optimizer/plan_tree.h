@@ -6,6 +6,17 @@
 #include <algorithm>
 #include <iostream>
 
+#include "common/common.h"
+
+// 绑定好的谓词：优化过程中一直带着原来的条件，不再转成字符串再解析回来。
+// tables是条件引用的表在查询的表列表中的位集，columns是引用的"表名.列名"，text只用于输出计划
+struct Predicate {
+    Condition cond;
+    uint64_t tables = 0;
+    std::vector<std::string> columns;
+    std::string text;
+};
+
 // 查询计划树节点基类
 class PlanTreeNode {
 public:
@@ -43,10 +54,10 @@ public:
 class FilterNode : public PlanTreeNode {
 private:
     std::shared_ptr<PlanTreeNode> child_;
-    std::vector<std::string> conditions_;
+    std::vector<Predicate> conditions_;
     
 public:
-    FilterNode(std::shared_ptr<PlanTreeNode> child, std::vector<std::string> conditions)
+    FilterNode(std::shared_ptr<PlanTreeNode> child, std::vector<Predicate> conditions)
         : child_(std::move(child)), conditions_(std::move(conditions)) {}
     
     NodeType getType() const override { return FILTER; }
@@ -56,8 +67,7 @@ public:
         std::string result = spaces + "Filter(condition=[";
         
         // 按字典序排序条件
-        auto sorted_conditions = conditions_;
-        std::sort(sorted_conditions.begin(), sorted_conditions.end());
+        auto sorted_conditions = getConditionTexts();
         
         size_t i = 0;
         while (i < sorted_conditions.size()) {
@@ -76,7 +86,16 @@ public:
     
     const std::shared_ptr<PlanTreeNode>& getChild() const { return child_; }
     void setChild(std::shared_ptr<PlanTreeNode> child) { child_ = std::move(child); }
-    const std::vector<std::string>& getConditions() const { return conditions_; }
+    const std::vector<Predicate>& getConditions() const { return conditions_; }
+
+    std::vector<std::string> getConditionTexts() const {
+        std::vector<std::string> texts;
+        for (const auto& pred : conditions_) {
+            texts.push_back(pred.text);
+        }
+        std::sort(texts.begin(), texts.end());
+        return texts;
+    }
 };
 
 // Project节点：Project(columns=[表名1.列名1,表名2.列名2,...])
@@ -131,11 +150,11 @@ class JoinNode : public PlanTreeNode {
 private:
     std::shared_ptr<PlanTreeNode> left_;
     std::shared_ptr<PlanTreeNode> right_;
-    std::vector<std::string> conditions_;
+    std::vector<Predicate> conditions_;
     
 public:
     JoinNode(std::shared_ptr<PlanTreeNode> left, std::shared_ptr<PlanTreeNode> right, 
-             std::vector<std::string> conditions)
+             std::vector<Predicate> conditions)
         : left_(std::move(left)), right_(std::move(right)), conditions_(std::move(conditions)) {}
     
     NodeType getType() const override { return JOIN; }
@@ -157,7 +176,10 @@ public:
         result += "],condition=[";
         
         // 排序连接条件
-        auto sorted_conditions = conditions_;
+        std::vector<std::string> sorted_conditions;
+        for (const auto& pred : conditions_) {
+            sorted_conditions.push_back(pred.text);
+        }
         std::sort(sorted_conditions.begin(), sorted_conditions.end());
         
         i = 0;
@@ -195,7 +217,7 @@ public:
     const std::shared_ptr<PlanTreeNode>& getRight() const { return right_; }
     void setLeft(std::shared_ptr<PlanTreeNode> left) { left_ = std::move(left); }
     void setRight(std::shared_ptr<PlanTreeNode> right) { right_ = std::move(right); }
-    const std::vector<std::string>& getConditions() const { return conditions_; }
+    const std::vector<Predicate>& getConditions() const { return conditions_; }
     
 private:
     bool shouldLeftFirst() const {
@@ -209,10 +231,8 @@ private:
                 auto left_filter = std::dynamic_pointer_cast<FilterNode>(left_);
                 auto right_filter = std::dynamic_pointer_cast<FilterNode>(right_);
                 if (left_filter && right_filter) {
-                    auto left_conditions = left_filter->getConditions();
-                    auto right_conditions = right_filter->getConditions();
-                    std::sort(left_conditions.begin(), left_conditions.end());
-                    std::sort(right_conditions.begin(), right_conditions.end());
+                    auto left_conditions = left_filter->getConditionTexts();
+                    auto right_conditions = right_filter->getConditionTexts();
                     
                     if (!left_conditions.empty() && !right_conditions.empty()) {
                         return left_conditions[0] < right_conditions[0];
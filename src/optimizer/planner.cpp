@@ -10,6 +10,9 @@ See the Mulan PSL v2 for more details. */
 
 #include "planner.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <memory>
 #include <set>
 
@@ -24,126 +27,370 @@ See the Mulan PSL v2 for more details. */
 #include "record_printer.h"
 #include "query_optimizer.h"
 
-// TOBEDONE
-// 目前的索引匹配规则为：完全匹配索引字段，且全部为单点查询，不会自动调整where条件的顺序
-bool Planner::get_index_cols(std::string &tab_name, std::vector<Condition> &curr_conds,
-                             std::vector<std::string> &index_col_names) {
-    // index_col_names.clear();
-    // for (auto &cond: curr_conds) {
-    //     if (cond.is_rhs_val && cond.op == OP_EQ && cond.lhs_col.tab_name == tab_name)
-    //         index_col_names.push_back(cond.lhs_col.col_name);
-    // }
+// curr_conds中下标不在used里、和值比较、op是ops之一、可以用来确定索引字段col上的扫描区间的第一个条件，没有时返回-1。
+// 值的类型要和字段相同：int和float混合比较时值的格式和key不同，不能拼进key
+static int find_index_cond(const std::vector<Condition> &conds, const std::vector<bool> &used,
+                           const std::string &tab_name, const ColMeta &col, std::initializer_list<CompOp> ops) {
+    for (size_t i = 0; i < conds.size(); ++i) {
+        auto &cond = conds[i];
+        if (!used[i] && cond.is_rhs_val && cond.lhs_col.tab_name == tab_name && cond.lhs_col.col_name == col.name &&
+            cond.rhs_val.type == col.type && std::find(ops.begin(), ops.end(), cond.op) != ops.end()) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// 从索引的第first个字段开始，conds中能用的条件的下标放进index_conds，返回它们的选择率；哈希索引用不上时返回-1
+double Planner::index_selectivity(const std::string &tab_name, double rows, const IndexMeta &index, size_t first,
+                                  const std::vector<Condition> &conds, std::vector<int> &index_conds) {
+    TabMeta &tab = sm_manager_->db_.get_table(tab_name);
+    std::vector<bool> used(conds.size(), false);
+    double sel = 1;
+    size_t eq_count = first;
+    for (; eq_count < index.cols.size(); ++eq_count) {
+        auto &col = index.cols[eq_count];
+        int c = find_index_cond(conds, used, tab_name, col, {OP_EQ});
+        if (c < 0) {
+            break;
+        }
+        used[c] = true;
+        index_conds.push_back(c);
+        if (tab.get_col_stats(col.name) != nullptr) {
+            sel *= sm_manager_->getSelectivity(tab_name, col.name, OP_EQ, conds[c].rhs_val);
+        } else {
+            // 没有统计信息时认为每个字段的等值条件筛掉同样多的记录，全部字段都相等时恰好剩一条
+            sel *= std::pow(rows, -1.0 / index.cols.size());
+        }
+    }
+    if (eq_count == index.cols.size()) {
+        if (first == 0) {
+            sel = std::min(sel, 1 / rows);  // 索引唯一
+        }
+    } else if (index.type == INDEX_HASH) {
+        return -1.0;
+    } else {
+        auto &col = index.cols[eq_count];
+        int lo = find_index_cond(conds, used, tab_name, col, {OP_GT, OP_GE});
+        int hi = find_index_cond(conds, used, tab_name, col, {OP_LT, OP_LE});
+        double lo_sel = 1, hi_sel = 1;
+        if (lo >= 0) {
+            index_conds.push_back(lo);
+            lo_sel = sm_manager_->getSelectivity(tab_name, col.name, conds[lo].op, conds[lo].rhs_val);
+        }
+        if (hi >= 0) {
+            index_conds.push_back(hi);
+            hi_sel = sm_manager_->getSelectivity(tab_name, col.name, conds[hi].op, conds[hi].rhs_val);
+        }
+        // 有直方图时上下界不独立，区间的选择率是两侧选择率之和减一，区间可能为空，至少留一点；
+        // 没有统计信息时两侧都是默认值，当作独立的条件
+        if (lo >= 0 && hi >= 0 && tab.get_col_stats(col.name) != nullptr) {
+            sel *= std::max(lo_sel + hi_sel - 1, 0.005);
+        } else {
+            sel *= lo_sel * hi_sel;
+        }
+    }
+    return sel;
+}
 
+/**
+ * @brief 按代价从表上的索引中选出扫描用的索引。每个索引能用的条件是：从第一个字段开始连续的等值条件，
+ * 加上紧接着的字段上的至多一个下界和一个上界；哈希索引要求全部字段都有等值条件。
+ * 索引扫描的代价 = 从根往下找的代价 + 命中的索引项数 * (读索引项 + 检查条件 + 回表)，覆盖索引不用回表；
+ * 全表扫描的代价 = 页数 + 记录数 * 检查条件。命中的记录数用ANALYZE的统计信息估计，没有统计信息时
+ * 等值条件按索引key唯一估计。没有比全表扫描便宜的索引时返回false，小表除外（见下）。
+ * 允许按rid排序回表时，还比较先取出区间中所有rid、按页面排序后每个数据页只读一次的代价：
+ * 从根往下找 + 命中数 * (读索引项 + 检查条件) + 排序rid + min(命中数, 页数)，中等选择率的区间用它更便宜。
+ * 允许跳跃扫描时，第一个字段上没有条件的B+树索引也可以用后面字段上的条件，代价按第一个字段的不同值个数计算
+ *
+ * @param tab_name 表名
+ * @param curr_conds 表上的条件，选中索引时重排成：前缀上的等值条件（按索引字段顺序）、下一个字段上的范围条件、其余条件
+ * @param index_col_names 选中的索引的字段
+ * @param used_cols 查询还要读取的字段，都在索引中时是覆盖索引扫描；为nullptr时不考虑覆盖
+ * @param rid_sorted 输出按rid排序回表是否更便宜；为nullptr时不考虑（上层依赖索引扫描的输出顺序）
+ * @param skip_scan 输出选中的索引是否跳过第一个字段（跳跃扫描）；为nullptr时不考虑
+ */
+bool Planner::get_index_cols(std::string &tab_name, std::vector<Condition> &curr_conds,
+                             std::vector<std::string> &index_col_names, const std::vector<TabCol> *used_cols,
+                             bool *rid_sorted, bool *skip_scan) {
+    if (rid_sorted != nullptr) {
+        *rid_sorted = false;
+    }
+    if (skip_scan != nullptr) {
+        *skip_scan = false;
+    }
     if (curr_conds.empty()) {
         return false;
     }
 
     TabMeta &tab = sm_manager_->db_.get_table(tab_name);
-    // TODO 优化：减少索引文件名长度，提高匹配效率
-    // conds重复去重
-
-    std::set<std::string> index_set; // 快速查找
-    std::unordered_map<std::string, int> conds_map; // 列名 -> Cond
-    std::unordered_map<std::string, int> repelicate_conds_map;
-    
-    // 改用while循环
-    std::size_t i = 0;
-    while (i < curr_conds.size()) {
-        auto &col_name = curr_conds[i].lhs_col.col_name;
-        if (index_set.count(col_name) == 0) {
-            index_set.emplace(col_name);
-            conds_map.emplace(col_name, i);
-        } else {
-            repelicate_conds_map.emplace(col_name, i);
-        }
-        ++i;
+    if (tab.indexes.empty()) {
+        return false;
     }
+    double rows = std::max<size_t>(sm_manager_->getTableRowCount(tab_name), 1);
+    double pages = 1;
+    auto fh = sm_manager_->fhs_.find(tab_name);
+    if (fh != sm_manager_->fhs_.end()) {
+        pages = std::max(fh->second->get_file_hdr().num_pages, 1);
+    }
+    double seq_cost = pages + rows * CPU_TUPLE_COST;
 
-    int max_len = 0, max_equals = 0, cur_len = 0, cur_equals = 0;
-    for (auto &[index_name, index] : tab.indexes) {
-        cur_len = cur_equals = 0;
-        auto &cols = index.cols;
+    auto in_index = [](const IndexMeta &index, const std::string &col_name) {
         for (auto &col : index.cols) {
-            if (index_set.count(col.name) == 0) {
-                break;
+            if (col.name == col_name) {
+                return true;
             }
-            if (curr_conds[conds_map[col.name]].op == OP_EQ) {
-                ++cur_equals;
+        }
+        return false;
+    };
+    // 条件和查询读取的字段都在索引中时不用回表
+    auto covers = [&](const IndexMeta &index) {
+        if (used_cols == nullptr || index.type != INDEX_BTREE) {
+            return false;
+        }
+        for (auto &col : *used_cols) {
+            if ((!col.tab_name.empty() && col.tab_name != tab_name) || !in_index(index, col.col_name)) {
+                return false;
             }
-            ++cur_len;
-        }
-        // 如果有 where a = 1, b = 1, c > 1;
-        // index(a, b, c), index(a, b, c, d);
-        // 应该匹配最合适的，避免索引查询中带来的额外拷贝开销
-        if (cur_len == curr_conds.size()) {
-            max_len = cur_len;
-            // 最长前缀相等选择等号多的
-            if (index_col_names.empty()) {
-                int j = 0;
-                while (j < index.cols.size()) {
-                    index_col_names.emplace_back(index.cols[j].name);
-                    ++j;
-                }
-            } else if (cur_equals > max_equals) {
-                max_equals = cur_equals;
-                // cur_len >= cur_equals;
-                index_col_names.clear();
-                int j = 0;
-                while (j < index.cols.size()) {
-                    index_col_names.emplace_back(index.cols[j].name);
-                    ++j;
-                }
-                // for (int i = 0; i < cur_len; ++i) {
-                //     index_col_names.emplace_back(index.cols[i].name);
-                // }
+        }
+        for (auto &cond : curr_conds) {
+            if (!in_index(index, cond.lhs_col.col_name) || (!cond.is_rhs_val && !in_index(index, cond.rhs_col.col_name))) {
+                return false;
             }
-        } else if (cur_len > max_len && cur_len < curr_conds.size()) {
-            // 匹配最长的
-            max_len = cur_len;
-            index_col_names.clear();
-            int j = 0;
-            while (j < index.cols.size()) {
-                index_col_names.emplace_back(index.cols[j].name);
-                ++j;
+        }
+        return true;
+    };
+
+
+    const IndexMeta *best = nullptr;
+    std::vector<int> best_conds;  // 选中的索引用到的条件的下标，按重排后的顺序
+    double best_cost = 0;
+    bool best_rid_sorted = false;
+    bool best_skip = false;
+    for (auto &[index_name, index] : tab.indexes) {
+        std::vector<int> index_conds;
+        double sel = index_selectivity(tab_name, rows, index, 0, curr_conds, index_conds);
+        if (sel < 0) {
+            continue;
+        }
+        // 第一个字段上没有条件时考虑跳跃扫描：ANALYZE得到第一个字段有ndv个不同的值，
+        // 逐个取出这些值，和后面字段上的条件一起拼成key各扫描一个区间
+        bool skip = false;
+        double ndv = 0;
+        if (index_conds.empty()) {
+            const ColStats *lead = tab.get_col_stats(index.cols[0].name);
+            if (skip_scan == nullptr || index.type != INDEX_BTREE || index.cols.size() < 2 || lead == nullptr ||
+                lead->ndv == 0) {
+                continue;
+            }
+            sel = index_selectivity(tab_name, rows, index, 1, curr_conds, index_conds);
+            if (index_conds.empty()) {
+                continue;
             }
+            skip = true;
+            ndv = lead->ndv;
+        }
+        double matched = std::max(rows * sel, 1.0);
+        double descent = index.type != INDEX_BTREE ? 0 : std::log2(rows + 2) * INDEX_TUPLE_COST;
+        // 跳跃扫描的每个值要下降三次（找下一个值、区间的两端），至少读一个叶子
+        double seek = skip ? ndv * (3 * descent + 1) : descent;
+        bool covering = covers(index);
+        double cost = seek + matched * (INDEX_TUPLE_COST + CPU_TUPLE_COST + (covering ? 0 : INDEX_FETCH_COST));
+        bool sorted_fetch = false;
+        if (rid_sorted != nullptr && !covering && !skip && index.type != INDEX_HASH) {
+            double sorted_cost = descent + matched * (INDEX_TUPLE_COST + CPU_TUPLE_COST) +
+                                 matched * std::log2(matched + 2) * CPU_TUPLE_COST + std::min(matched, pages);
+            if (sorted_cost < cost) {
+                cost = sorted_cost;
+                sorted_fetch = true;
+            }
+        }
+        // 代价相同时选用到的条件多的，再相同时选字段少的（key短，一页放得下更多项）
+        if (best == nullptr || cost < best_cost ||
+            (cost == best_cost && (index_conds.size() > best_conds.size() ||
+                                   (index_conds.size() == best_conds.size() && index.cols.size() < best->cols.size())))) {
+            best = &index;
+            best_conds = std::move(index_conds);
+            best_cost = cost;
+            best_rid_sorted = sorted_fetch;
+            best_skip = skip;
         }
     }
-
-    // 没有索引
-    if (index_col_names.empty()) {
+    // 全表扫描要加表上的S锁，索引扫描只锁条件对应的间隙；不超过两个页面的小表两者读的页面差不多，仍然走索引
+    if (best == nullptr || (best_cost > seq_cost && pages > 2)) {
         return false;
     }
 
-    std::vector<Condition> fed_conds; // 理想谓词
-
-    // 连接剩下的非索引列
-    // 先清除已经在set中的
-    for (auto &index_name : index_col_names) {
-        if (index_set.count(index_name)) {
-            index_set.erase(index_name);
-            fed_conds.emplace_back(std::move(curr_conds[conds_map[index_name]]));
+    index_col_names.clear();
+    for (auto &col : best->cols) {
+        index_col_names.push_back(col.name);
+    }
+    if (rid_sorted != nullptr) {
+        *rid_sorted = best_rid_sorted;
+    }
+    if (skip_scan != nullptr) {
+        *skip_scan = best_skip;
+    }
+    std::vector<bool> used(curr_conds.size(), false);
+    std::vector<Condition> fed_conds;  // 理想谓词
+    fed_conds.reserve(curr_conds.size());
+    for (int c : best_conds) {
+        used[c] = true;
+        fed_conds.push_back(std::move(curr_conds[c]));
+    }
+    for (size_t c = 0; c < curr_conds.size(); ++c) {
+        if (!used[c]) {
+            fed_conds.push_back(std::move(curr_conds[c]));
         }
     }
+    curr_conds = std::move(fed_conds);
+    return true;
+}
 
-    // 连接 set 中剩下的
-    for (auto &index_name : index_set) {
-        fed_conds.emplace_back(std::move(curr_conds[conds_map[index_name]]));
+/**
+ * @brief 表上的条件用不上比全表扫描便宜的索引时，考虑位图扫描：几路索引扫描只取出rid，取并集或交集后排序，
+ * 按页面顺序回表，每个数据页只读一次，回表后检查全部条件。
+ * 并集：某个OR组中的每个条件都能用上索引，每个条件各扫描一个索引；
+ * 交集：几个索引各自用上conds_中的一部分条件（互不重叠），按选择率从小到大加入，直到再加一路不再更便宜。
+ * 一路的代价 = 从根往下找 + 命中数 * (读索引项 + 检查条件)；回表的代价 = 排序rid + min(rid数, 页数) + rid数 * 检查条件，
+ * 并集的rid数按各路命中数之和估计，交集按各路选择率独立估计。比全表扫描便宜时改写scan并返回true
+ *
+ * @param scan 单表查询的全表扫描计划，已经放好了conds_和or_conds_
+ */
+bool Planner::get_bitmap_arms(const std::shared_ptr<ScanPlan> &scan) {
+    TabMeta &tab = sm_manager_->db_.get_table(scan->tab_name_);
+    if (tab.indexes.empty()) {
+        return false;
     }
-
-    // 连接重复的，如果有
-    for (auto &[index_name, idx] : repelicate_conds_map) {
-        fed_conds.emplace_back(std::move(curr_conds[repelicate_conds_map[index_name]]));
+    double rows = std::max<size_t>(sm_manager_->getTableRowCount(scan->tab_name_), 1);
+    double pages = 1;
+    auto fh = sm_manager_->fhs_.find(scan->tab_name_);
+    if (fh != sm_manager_->fhs_.end()) {
+        pages = std::max(fh->second->get_file_hdr().num_pages, 1);
     }
+    double seq_cost = pages + rows * CPU_TUPLE_COST;
 
-    curr_conds = std::move(fed_conds);
+    struct Arm {
+        const IndexMeta *index;
+        std::vector<int> conds;  // 用到的条件的下标，按IndexScan要求的顺序
+        double matched;
+        double cost;
+    };
+    auto make_arm = [&](const IndexMeta &index, const std::vector<Condition> &conds, Arm &arm) {
+        std::vector<int> index_conds;
+        double sel = index_selectivity(scan->tab_name_, rows, index, 0, conds, index_conds);
+        if (sel < 0 || index_conds.empty()) {
+            return false;
+        }
+        double descent = index.type != INDEX_BTREE ? 0 : std::log2(rows + 2) * INDEX_TUPLE_COST;
+        double matched = std::max(rows * sel, 1.0);
+        arm = {&index, std::move(index_conds), matched, descent + matched * (INDEX_TUPLE_COST + CPU_TUPLE_COST)};
+        return true;
+    };
+    auto fetch_cost = [&](double matched) {
+        return matched * std::log2(matched + 2) * CPU_TUPLE_COST + std::min(matched, pages) + matched * CPU_TUPLE_COST;
+    };
 
-    // 检查正确与否
-    // for (auto &index_name : index_col_names) {
-    //     std::cout << index_name << ",";
-    // }
-    // std::cout << "\n";
+    double best_cost = seq_cost;
+    std::vector<BitmapArm> best_arms;
+    bool best_and = false;
+    auto to_bitmap_arm = [](const Arm &arm, const std::vector<Condition> &conds) {
+        BitmapArm res;
+        for (auto &col : arm.index->cols) {
+            res.index_col_names.push_back(col.name);
+        }
+        for (int c : arm.conds) {
+            res.conds.push_back(conds[c]);
+        }
+        return res;
+    };
 
-    // if (tab.is_index(index_col_names)) return true;
+    // 并集：OR组的每个条件各选一个最便宜的索引
+    for (auto &or_cond : scan->or_conds_) {
+        std::vector<BitmapArm> arms;
+        double cost = 0;
+        double matched = 0;
+        for (auto &cond : or_cond.conds) {
+            std::vector<Condition> conds{cond};
+            Arm best_arm;
+            bool found = false;
+            for (auto &[index_name, index] : tab.indexes) {
+                Arm arm;
+                if (make_arm(index, conds, arm) && (!found || arm.cost < best_arm.cost)) {
+                    best_arm = std::move(arm);
+                    found = true;
+                }
+            }
+            if (!found) {
+                arms.clear();
+                break;
+            }
+            cost += best_arm.cost;
+            matched += best_arm.matched;
+            arms.push_back(to_bitmap_arm(best_arm, conds));
+        }
+        if (arms.empty()) {
+            continue;
+        }
+        cost += fetch_cost(std::min(matched, rows));
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_arms = std::move(arms);
+            best_and = false;
+        }
+    }
+
+    // 交集：每个索引用上conds_中能用的条件，按命中数从小到大贪心地加入
+    std::vector<Arm> candidates;
+    for (auto &[index_name, index] : tab.indexes) {
+        Arm arm;
+        if (make_arm(index, scan->conds_, arm)) {
+            candidates.push_back(std::move(arm));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Arm &a, const Arm &b) { return a.matched < b.matched; });
+    std::vector<const Arm *> chosen;
+    std::vector<bool> used(scan->conds_.size(), false);
+    double arms_cost = 0;
+    double sel = 1;
+    double chosen_cost = 0;
+    for (auto &arm : candidates) {
+        bool overlap = false;
+        for (int c : arm.conds) {
+            overlap = overlap || used[c];
+        }
+        if (overlap) {
+            continue;
+        }
+        double cost = arms_cost + arm.cost + arm.matched * std::log2(arm.matched + 2) * CPU_TUPLE_COST;
+        double next_sel = sel * arm.matched / rows;
+        double total = cost + fetch_cost(std::max(rows * next_sel, 1.0));
+        if (!chosen.empty() && total >= chosen_cost) {
+            break;
+        }
+        chosen.push_back(&arm);
+        for (int c : arm.conds) {
+            used[c] = true;
+        }
+        arms_cost = cost;
+        sel = next_sel;
+        chosen_cost = total;
+    }
+    if (chosen.size() >= 2 && chosen_cost < best_cost) {
+        best_cost = chosen_cost;
+        best_arms.clear();
+        for (auto arm : chosen) {
+            best_arms.push_back(to_bitmap_arm(*arm, scan->conds_));
+        }
+        best_and = true;
+    }
+
+    if (best_arms.empty()) {
+        return false;
+    }
+    scan->tag = T_BitmapScan;
+    scan->bitmap_arms_ = std::move(best_arms);
+    scan->bitmap_and_ = best_and;
     return true;
 }
 
@@ -246,13 +493,391 @@ std::shared_ptr<Plan> Planner::physical_optimization(std::shared_ptr<Query> quer
     std::shared_ptr<Plan> plan = make_one_rel(query);
     
     // 其他物理优化
+    // IN / NOT IN 子查询在排序之前过滤
+    plan = make_semi_joins(query, std::move(plan), context);
 
-    // 处理orderby
+    // 处理orderby，聚合查询的排序和聚合一起处理
+    if (!query->agg_types.empty()) {
+        return make_aggregate_plan(query, std::move(plan));
+    }
     plan = generate_sort_plan(query, std::move(plan)); 
 
     return plan;
 }
 
+/**
+ * @brief 在plan之上加分组聚合。只按一列分组并且按这一列排序时，先把输入按这一列排好序（或者用索引的顺序），
+ * 同一分组相邻，流式聚合的输出也已经有序；否则输入恰好按分组列有序时流式聚合，ORDER BY在聚合之上排序
+ */
+std::shared_ptr<Plan> Planner::make_aggregate_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan)
+{
+    auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse);
+    bool sort_below = false;
+    if (x->has_sort && query->group_bys.size() == 1) {
+        auto &order = x->order->cols;
+        auto &group_by = query->group_bys[0];
+        sort_below = order->col_name == group_by.col_name &&
+                     (order->tab_name.empty() || order->tab_name == group_by.tab_name);
+    }
+    bool sorted = sort_below;
+    if (sort_below) {
+        plan = generate_sort_plan(query, std::move(plan), true);
+    } else {
+        sorted = grouped_input(plan, query->group_bys);
+    }
+    plan = std::make_shared<AggregatePlan>(T_Aggregate, std::move(plan), query->cols, query->agg_types,
+                                           query->group_bys, query->havings, sorted);
+    if (!sort_below) {
+        plan = generate_sort_plan(query, std::move(plan));
+    }
+    return plan;
+}
+
+/**
+ * @brief 分组key相同的记录在plan的输出中是否相邻，这时聚合可以流式进行：B+树和ART索引扫描按key的顺序输出，
+ * key的前几列恰好是全部分组列时同一分组连续出现。按rid排序的索引扫描不算
+ */
+bool Planner::grouped_input(const std::shared_ptr<Plan> &plan, const std::vector<TabCol> &group_bys) {
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(plan);
+    if (group_bys.empty() || scan == nullptr || scan->tag != T_IndexScan || scan->rid_sorted_) {
+        return false;
+    }
+    auto index = sm_manager_->db_.get_table(scan->tab_name_).get_index_meta(scan->index_col_names_);
+    if (index.type == INDEX_HASH || index.cols.size() < group_bys.size()) {
+        return false;
+    }
+    // 分组列两两不同并且都在key的前group_bys.size()列中
+    auto prefix_end = index.cols.begin() + group_bys.size();
+    for (size_t i = 0; i < group_bys.size(); ++i) {
+        auto &col = group_bys[i];
+        if (col.tab_name != scan->tab_name_ ||
+            std::none_of(index.cols.begin(), prefix_end, [&](const ColMeta &c) { return c.name == col.col_name; }) ||
+            std::any_of(group_bys.begin(), group_bys.begin() + i,
+                        [&](const TabCol &c) { return c.col_name == col.col_name; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 子树输出的所有表，半连接的右儿子（子查询）不输出
+static void collect_tables(const std::shared_ptr<Plan> &plan, std::set<std::string> &tables) {
+    if (auto scan = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        tables.insert(scan->tab_name_);
+    } else if (auto join = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        collect_tables(join->left_, tables);
+        if (join->tag != T_SemiJoin && join->tag != T_AntiJoin) {
+            collect_tables(join->right_, tables);
+        }
+    } else if (auto filter = std::dynamic_pointer_cast<FilterPlan>(plan)) {
+        collect_tables(filter->subplan_, tables);
+    } else if (auto sort = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        collect_tables(sort->subplan_, tables);
+    }
+}
+
+/**
+ * @brief 把plan中输出tables中全部表的最低的子树换成wrap(子树)，plan不输出全部的表时返回false。
+ * INLJ的内表由连接算子直接按索引探测，不能换成别的计划，这时换掉整个连接
+ */
+static bool attach_semi_join(std::shared_ptr<Plan> &plan, const std::set<std::string> &tables,
+                             const std::function<std::shared_ptr<Plan>(std::shared_ptr<Plan>)> &wrap)
+{
+    std::set<std::string> plan_tables;
+    collect_tables(plan, plan_tables);
+    if (!std::includes(plan_tables.begin(), plan_tables.end(), tables.begin(), tables.end())) {
+        return false;
+    }
+    if (auto join = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        bool right_output = join->tag != T_SemiJoin && join->tag != T_AntiJoin && join->tag != T_IndexNestLoop;
+        if (attach_semi_join(join->left_, tables, wrap) ||
+            (right_output && attach_semi_join(join->right_, tables, wrap))) {
+            return true;
+        }
+    } else if (auto filter = std::dynamic_pointer_cast<FilterPlan>(plan)) {
+        if (attach_semi_join(filter->subplan_, tables, wrap)) {
+            return true;
+        }
+    } else if (auto sort = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        if (attach_semi_join(sort->subplan_, tables, wrap)) {
+            return true;
+        }
+    }
+    plan = wrap(std::move(plan));
+    return true;
+}
+
+/**
+ * @brief 把 col IN (SELECT ...) 和 EXISTS (SELECT ...) 改写成外层计划和子查询计划的哈希半连接，
+ * NOT IN / NOT EXISTS 改写成反连接。关联条件已经在分析时变成了连接条件，子查询只执行一次，
+ * 结果只建一次哈希表，外层每条记录查一次。半连接接在含有连接条件中全部外层表的最低的子树上，先过滤再连接
+ */
+std::shared_ptr<Plan> Planner::make_semi_joins(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan,
+                                               Context *context)
+{
+    for (auto &sub_cond : query->sub_conds) {
+        std::set<std::string> outer_tables;
+        for (auto &cond : sub_cond.conds) {
+            outer_tables.insert(cond.lhs_col.tab_name);
+        }
+        std::shared_ptr<Plan> sub_plan = generate_select_plan(sub_cond.query, context);
+        attach_semi_join(plan, outer_tables, [&](std::shared_ptr<Plan> outer) -> std::shared_ptr<Plan> {
+            return std::make_shared<JoinPlan>(sub_cond.anti ? T_AntiJoin : T_SemiJoin, std::move(outer),
+                                              std::move(sub_plan), std::move(sub_cond.conds));
+        });
+    }
+    return plan;
+}
+
+bool Planner::get_join_index(const std::shared_ptr<Plan> &outer, const std::shared_ptr<ScanPlan> &inner,
+                             const std::vector<Condition> &conds, std::vector<std::string> &index_col_names)
+{
+    // 连接算子直接探测内表的索引，不计算内表上的表达式条件
+    if (!inner->expr_conds_.empty() || !inner->or_conds_.empty()) {
+        return false;
+    }
+    std::set<std::string> outer_tables;
+    collect_tables(outer, outer_tables);
+    TabMeta &tab = sm_manager_->db_.get_table(inner->tab_name_);
+    for (auto &[index_name, index_meta] : tab.indexes) {
+        bool usable = true;
+        for (auto &col : index_meta.cols) {
+            // 找 inner.col = outer.x，两侧类型和长度相同才能直接拼成key
+            bool found = false;
+            for (auto &cond : conds) {
+                if (cond.is_rhs_val || cond.op != OP_EQ) {
+                    continue;
+                }
+                const TabCol *inner_col = &cond.lhs_col, *outer_col = &cond.rhs_col;
+                if (inner_col->tab_name != inner->tab_name_) {
+                    std::swap(inner_col, outer_col);
+                }
+                if (inner_col->tab_name != inner->tab_name_ || inner_col->col_name != col.name ||
+                    outer_tables.count(outer_col->tab_name) == 0) {
+                    continue;
+                }
+                auto outer_meta = sm_manager_->db_.get_table(outer_col->tab_name).get_col(outer_col->col_name);
+                if (outer_meta->type == col.type && outer_meta->len == col.len) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                usable = false;
+                break;
+            }
+        }
+        if (usable) {
+            index_col_names.clear();
+            for (auto &col : index_meta.cols) {
+                index_col_names.push_back(col.name);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<Plan> Planner::make_sorted_input(std::shared_ptr<Plan> plan, const TabCol &key) {
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(plan);
+    if (scan != nullptr && scan->tab_name_ == key.tab_name) {
+        TabMeta &tab = sm_manager_->db_.get_table(scan->tab_name_);
+        // 以key开头的B+树索引上的扫描按key升序输出
+        auto ordered_by_key = [&](const IndexMeta &index) {
+            return index.type != INDEX_HASH && index.cols[0].name == key.col_name;
+        };
+        if (scan->tag == T_IndexScan && !scan->rid_sorted_ && ordered_by_key(tab.get_index_meta(scan->index_col_names_))) {
+            return plan;
+        }
+        // 没有条件的顺序扫描换成整个索引上的扫描；有条件时索引扫描会把条件当作key的范围，不能直接换
+        if (scan->tag == T_SeqScan && scan->conds_.empty()) {
+            for (auto &[index_name, index] : tab.indexes) {
+                if (ordered_by_key(index)) {
+                    scan->tag = T_IndexScan;
+                    scan->index_col_names_.clear();
+                    for (auto &col : index.cols) {
+                        scan->index_col_names_.push_back(col.name);
+                    }
+                    return plan;
+                }
+            }
+        }
+    }
+    return std::make_shared<SortPlan>(T_Sort, std::move(plan), key, false);
+}
+
+bool Planner::join_allowed(PlanTag tag) const {
+    JoinKnob knob = tag == T_HashJoin    ? enable_hash_join
+                    : tag == T_SortMerge ? enable_sortmerge_join
+                                         : enable_nestedloop_join;
+    if (knob != JoinKnob::AUTO) {
+        return knob == JoinKnob::ON;
+    }
+    return enable_hash_join != JoinKnob::ON && enable_sortmerge_join != JoinKnob::ON &&
+           enable_nestedloop_join != JoinKnob::ON;
+}
+
+// 子树输出的一条记录的长度，按其中各表记录长度之和估计
+static double estimate_width(SmManager *sm_manager, const std::shared_ptr<Plan> &plan) {
+    std::set<std::string> tables;
+    collect_tables(plan, tables);
+    double width = 0;
+    for (auto &tab_name : tables) {
+        auto &cols = sm_manager->db_.get_table(tab_name).cols;
+        width += cols.back().offset + cols.back().len;
+    }
+    return std::max(width, 1.0);
+}
+
+// 执行一遍子树的代价：扫描是读页面加检查记录，其他子树按输出的记录数估计
+static double estimate_input_cost(SmManager *sm_manager, const std::shared_ptr<Plan> &plan, double rows) {
+    if (auto scan = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        auto it = sm_manager->fhs_.find(scan->tab_name_);
+        if (it != sm_manager->fhs_.end()) {
+            return it->second->get_file_hdr().num_pages +
+                   sm_manager->getTableRowCount(scan->tab_name_) * CPU_TUPLE_COST;
+        }
+    }
+    return rows * CPU_TUPLE_COST;
+}
+
+// 以key开头的B+树索引上的扫描已经按key升序，排序归并连接不用再排序
+static bool sorted_on(SmManager *sm_manager, const std::shared_ptr<Plan> &plan, const TabCol &key) {
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(plan);
+    if (scan == nullptr || scan->tag != T_IndexScan || scan->rid_sorted_ || scan->tab_name_ != key.tab_name) {
+        return false;
+    }
+    auto index = sm_manager->db_.get_table(scan->tab_name_).get_index_meta(scan->index_col_names_);
+    return index.type != INDEX_HASH && index.cols[0].name == key.col_name;
+}
+
+// 排序rows条、总共bytes字节的记录的代价，超过内存时切成run写到临时文件再读回
+static double estimate_sort_cost(double rows, double bytes) {
+    double cost = rows * std::log2(rows + 2) * CPU_TUPLE_COST;
+    if (bytes > SORT_MEMORY) {
+        cost += 2 * bytes / PAGE_SIZE;
+    }
+    return cost;
+}
+
+std::shared_ptr<Plan> Planner::make_join_plan(std::shared_ptr<Plan> left, std::shared_ptr<Plan> right,
+                                              std::vector<Condition> conds)
+{
+    const Condition *equi = nullptr;
+    for (auto &cond : conds) {
+        if (!cond.is_rhs_val && cond.op == OP_EQ) {
+            equi = &cond;
+            break;
+        }
+    }
+
+    QueryOptimizer optimizer(sm_manager_, this);
+    double left_rows = optimizer.estimatePlanRows(left);
+    double right_rows = optimizer.estimatePlanRows(right);
+    double out_rows = optimizer.estimateJoinRows(left_rows, right_rows, conds);
+    double left_bytes = left_rows * estimate_width(sm_manager_, left);
+    double right_bytes = right_rows * estimate_width(sm_manager_, right);
+    double left_cost = estimate_input_cost(sm_manager_, left, left_rows);
+    double right_cost = estimate_input_cost(sm_manager_, right, right_rows);
+
+    // 候选的算法和代价，代价都包含执行两侧子树的代价，索引嵌套循环不执行内表的扫描
+    struct Candidate {
+        PlanTag tag;
+        double cost;
+        bool swap = false;  // 交换左右儿子，让有索引的一侧做内表
+        std::vector<std::string> index_col_names{};
+    };
+    std::vector<Candidate> candidates;
+
+    // 块嵌套循环：左表每块NLJ_BLOCK_MEMORY字节重新扫描一遍右表
+    double rescans = std::max(1.0, std::ceil(left_bytes / NLJ_BLOCK_MEMORY));
+    candidates.push_back({T_NestLoop, left_cost + rescans * right_cost + left_rows * right_rows * CPU_TUPLE_COST});
+
+    if (equi != nullptr) {
+        // 索引嵌套循环：外表每条记录在内表的索引上找一次，索引唯一，最多回表一次
+        auto index_nlj_cost = [&](double outer_rows, double outer_cost, const std::shared_ptr<ScanPlan> &inner) {
+            double inner_rows = std::max<size_t>(sm_manager_->getTableRowCount(inner->tab_name_), 1);
+            double fetch = std::min(1.0, out_rows / outer_rows) * INDEX_FETCH_COST;
+            return outer_cost + outer_rows * (std::log2(inner_rows + 2) * INDEX_TUPLE_COST + fetch + CPU_TUPLE_COST);
+        };
+        std::vector<std::string> index_col_names;
+        auto right_scan = std::dynamic_pointer_cast<ScanPlan>(right);
+        auto left_scan = std::dynamic_pointer_cast<ScanPlan>(left);
+        if (right_scan != nullptr && get_join_index(left, right_scan, conds, index_col_names)) {
+            candidates.push_back({T_IndexNestLoop, index_nlj_cost(left_rows, left_cost, right_scan), false,
+                                  std::move(index_col_names)});
+        }
+        if (left_scan != nullptr && get_join_index(right, left_scan, conds, index_col_names)) {
+            candidates.push_back({T_IndexNestLoop, index_nlj_cost(right_rows, right_cost, left_scan), true,
+                                  std::move(index_col_names)});
+        }
+
+        // 哈希连接：在较小的一侧建表，超过内存时两侧都分区写到临时文件再读回
+        double hash_cost = left_cost + right_cost + (left_rows + right_rows) * 2 * CPU_TUPLE_COST;
+        if (std::min(left_bytes, right_bytes) > HASH_JOIN_MEMORY) {
+            hash_cost += 2 * (left_bytes + right_bytes) / PAGE_SIZE;
+        }
+        candidates.push_back({T_HashJoin, hash_cost});
+
+        // 排序归并连接按第一个条件归并，只用于单个等值条件的连接
+        if (conds.size() == 1) {
+            std::set<std::string> left_tables;
+            collect_tables(left, left_tables);
+            bool lhs_left = left_tables.count(equi->lhs_col.tab_name) != 0;
+            double merge_cost = left_cost + right_cost + (left_rows + right_rows) * CPU_TUPLE_COST;
+            if (!sorted_on(sm_manager_, left, lhs_left ? equi->lhs_col : equi->rhs_col)) {
+                merge_cost += estimate_sort_cost(left_rows, left_bytes);
+            }
+            if (!sorted_on(sm_manager_, right, lhs_left ? equi->rhs_col : equi->lhs_col)) {
+                merge_cost += estimate_sort_cost(right_rows, right_bytes);
+            }
+            candidates.push_back({T_SortMerge, merge_cost});
+        }
+    }
+
+    // 开关允许的算法中选代价最小的；都不允许时退回没有被关掉的算法
+    const Candidate *best = nullptr;
+    for (int pass = 0; pass < 2 && best == nullptr; ++pass) {
+        for (auto &candidate : candidates) {
+            bool usable = pass == 0 ? join_allowed(candidate.tag)
+                                    : (candidate.tag == T_HashJoin    ? enable_hash_join
+                                       : candidate.tag == T_SortMerge ? enable_sortmerge_join
+                                                                      : enable_nestedloop_join) != JoinKnob::OFF;
+            if (usable && (best == nullptr || candidate.cost < best->cost)) {
+                best = &candidate;
+            }
+        }
+    }
+    if (best == nullptr) {
+        throw RMDBError("No join executor selected!");
+    }
+
+    if (best->tag == T_IndexNestLoop) {
+        // 交换左右儿子时上层算子按表名和列名取字段，不依赖字段的顺序
+        auto join = best->swap
+                        ? std::make_shared<JoinPlan>(T_IndexNestLoop, std::move(right), std::move(left), std::move(conds))
+                        : std::make_shared<JoinPlan>(T_IndexNestLoop, std::move(left), std::move(right), std::move(conds));
+        join->index_col_names_ = best->index_col_names;
+        return join;
+    }
+    if (best->tag == T_SortMerge) {
+        // 排序归并连接要求两侧都按连接字段升序
+        std::set<std::string> left_tables;
+        collect_tables(left, left_tables);
+        const Condition &cond = conds[0];
+        bool lhs_left = left_tables.count(cond.lhs_col.tab_name) != 0;
+        left = make_sorted_input(std::move(left), lhs_left ? cond.lhs_col : cond.rhs_col);
+        right = make_sorted_input(std::move(right), lhs_left ? cond.rhs_col : cond.lhs_col);
+        return std::make_shared<JoinPlan>(T_SortMerge, std::move(left), std::move(right), std::move(conds));
+    }
+    if (best->tag == T_HashJoin) {
+        auto join = std::make_shared<JoinPlan>(T_HashJoin, std::move(left), std::move(right), std::move(conds));
+        join->build_left_ = left_bytes < right_bytes;
+        return join;
+    }
+    return std::make_shared<JoinPlan>(T_NestLoop, std::move(left), std::move(right), std::move(conds));
+}
+
 // **多表查询**
 // SELECT * FROM A, B, C WHERE A.id = B.id AND B.x = C.x AND A.y > 10;
 // 对每个表生成ScanPlan，并把相关条件分配给对应的ScanPlan，A.y > 10分配给A，B和C没有单表条件
@@ -262,10 +887,93 @@ std::shared_ptr<Plan> Planner::physical_optimization(std::shared_ptr<Query> quer
 // 再处理下一个连接条件 B.x == C.x，发现C还没参与连接，pop_scan 找到 C 的 ScanPlan，标记 scantbl[2]=1，joined_tables = [A, B, C]
 // 生成 JoinPlan2 = JoinPlan(JoinPlan1, ScanPlan(C, []), [B.x = C.x])
 // 检查是否有未加入 join 的表，scantbl = [1, 1, 1]，所有表都已加入 join，无需补全。
+// 从conds中取出连接left_tables和right_tables的列-列条件，左列属于left_tables，需要时交换两侧
+static std::vector<Condition> take_join_conds(std::vector<Condition> &conds, const std::vector<std::string> &left_tables,
+                                              const std::vector<std::string> &right_tables) {
+    static const std::map<CompOp, CompOp> swap_op = {
+        {OP_EQ, OP_EQ}, {OP_NE, OP_NE}, {OP_LT, OP_GT}, {OP_GT, OP_LT}, {OP_LE, OP_GE}, {OP_GE, OP_LE},
+    };
+    auto in = [](const std::vector<std::string> &tables, const std::string &table) {
+        return std::find(tables.begin(), tables.end(), table) != tables.end();
+    };
+    std::vector<Condition> taken;
+    auto it = conds.begin();
+    while (it != conds.end()) {
+        if (!it->is_rhs_val) {
+            if (in(left_tables, it->rhs_col.tab_name) && in(right_tables, it->lhs_col.tab_name)) {
+                std::swap(it->lhs_col, it->rhs_col);
+                it->op = swap_op.at(it->op);
+            }
+            if (in(left_tables, it->lhs_col.tab_name) && in(right_tables, it->rhs_col.tab_name)) {
+                taken.push_back(*it);
+                it = conds.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+    return taken;
+}
+
+std::shared_ptr<Plan> Planner::make_join_tree(const std::shared_ptr<PlanTreeNode> &node,
+                                              const std::vector<std::string> &tables,
+                                              std::vector<std::shared_ptr<Plan>> &table_scan_executors,
+                                              std::vector<Condition> &where_conds)
+{
+    if (auto scan = std::dynamic_pointer_cast<ScanNode>(node)) {
+        // 同一张表出现多次时依次取还没有用过的扫描计划
+        size_t i = 0;
+        while (tables[i] != scan->getTableName() || table_scan_executors[i] == nullptr) {
+            ++i;
+        }
+        return std::move(table_scan_executors[i]);
+    }
+    auto join = std::dynamic_pointer_cast<JoinNode>(node);
+    auto left = make_join_tree(join->getLeft(), tables, table_scan_executors, where_conds);
+    auto right = make_join_tree(join->getRight(), tables, table_scan_executors, where_conds);
+    auto conds = take_join_conds(where_conds, join->getLeft()->getOutputTables(), join->getRight()->getOutputTables());
+    return make_join_plan(std::move(left), std::move(right), std::move(conds));
+}
+
+// 选取列表、表达式条件和OR条件读取的字段，计算列换成表达式中的字段
+static std::vector<TabCol> query_used_cols(const Query &query) {
+    std::vector<TabCol> used_cols;
+    for (size_t i = 0; i < query.cols.size(); ++i) {
+        if (i < query.col_exprs.size() && query.col_exprs[i] != nullptr) {
+            query.col_exprs[i]->collect_cols(used_cols);
+        } else if (!query.cols[i].col_name.empty()) {
+            // COUNT(*)不用任何字段
+            used_cols.push_back(query.cols[i]);
+        }
+    }
+    used_cols.insert(used_cols.end(), query.group_bys.begin(), query.group_bys.end());
+    for (auto &cond : query.havings) {
+        if (!cond.lhs_col.col_name.empty()) {
+            used_cols.push_back(cond.lhs_col);
+        }
+    }
+    for (auto &cond : query.expr_conds) {
+        cond.lhs->collect_cols(used_cols);
+        cond.rhs->collect_cols(used_cols);
+    }
+    for (auto &or_cond : query.or_conds) {
+        for (auto &cond : or_cond.conds) {
+            used_cols.push_back(cond.lhs_col);
+        }
+    }
+    return used_cols;
+}
+
 std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
 {
     auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse);
     std::vector<std::string> tables = query->tables;
+    std::vector<Condition> all_conds = query->conds;  // 选择连接顺序时估算单表条件过滤后的记录数
+    // 单表查询读取的字段，都在索引中时可以用覆盖索引扫描
+    std::vector<TabCol> used_cols = query_used_cols(*query);
+    if (x->has_sort) {
+        used_cols.push_back({x->order->cols->tab_name, x->order->cols->col_name});
+    }
     
     // 生成表扫描计划，只处理能推下去的WHERE条件（单表条件）
     std::vector<std::shared_ptr<Plan>> table_scan_executors(tables.size());
@@ -273,21 +981,45 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
     while (i < tables.size()) {
         auto curr_conds = pop_conds(query->conds, tables[i]);
         std::vector<std::string> index_col_names;
-        bool index_exist = get_index_cols(tables[i], curr_conds, index_col_names);
+        // 多表查询的索引扫描可能被归并连接当作有序输入，只有单表查询按rid排序回表
+        bool rid_sorted = false;
+        bool skip_scan = false;
+        bool index_exist = get_index_cols(tables[i], curr_conds, index_col_names, tables.size() == 1 ? &used_cols : nullptr,
+                                          tables.size() == 1 ? &rid_sorted : nullptr, &skip_scan);
         
         if (index_exist) {
-            table_scan_executors[i] =
-                std::make_shared<ScanPlan>(T_IndexScan, sm_manager_, tables[i], curr_conds, index_col_names);
+            auto scan = std::make_shared<ScanPlan>(T_IndexScan, sm_manager_, tables[i], curr_conds, index_col_names);
+            scan->rid_sorted_ = rid_sorted;
+            scan->skip_scan_ = skip_scan;
+            table_scan_executors[i] = std::move(scan);
         } else {
             index_col_names.clear();
             table_scan_executors[i] = 
                 std::make_shared<ScanPlan>(T_SeqScan, sm_manager_, tables[i], curr_conds, index_col_names);
         }
+        std::static_pointer_cast<ScanPlan>(table_scan_executors[i])->always_false_ = query->always_false;
         ++i;
     }
+    // 表达式条件放到它涉及的那张表的扫描中
+    for (auto &cond : query->expr_conds) {
+        std::vector<TabCol> cols;
+        cond.lhs->collect_cols(cols);
+        cond.rhs->collect_cols(cols);
+        size_t t = cols.empty() ? 0 : std::find(tables.begin(), tables.end(), cols[0].tab_name) - tables.begin();
+        std::static_pointer_cast<ScanPlan>(table_scan_executors[t])->expr_conds_.push_back(cond);
+    }
+    // OR条件只涉及一张表，同样放到那张表的扫描中
+    for (auto &or_cond : query->or_conds) {
+        size_t t = std::find(tables.begin(), tables.end(), or_cond.conds[0].lhs_col.tab_name) - tables.begin();
+        std::static_pointer_cast<ScanPlan>(table_scan_executors[t])->or_conds_.push_back(or_cond);
+    }
     
-    // 如果只有一个表，直接返回扫描计划
+    // 如果只有一个表，直接返回扫描计划；没有合适的索引时看几个索引的rid取并集或交集是否更便宜
     if(tables.size() == 1) {
+        auto scan = std::static_pointer_cast<ScanPlan>(table_scan_executors[0]);
+        if (scan->tag == T_SeqScan && !scan->always_false_) {
+            get_bitmap_arms(scan);
+        }
         return table_scan_executors[0];
     }
     
@@ -299,73 +1031,11 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
     
     // 处理JOIN操作
     if (join_conds.size() < 1) {
-        // 没有JOIN ON条件，但有多个表，需要从WHERE条件中提取连接条件
-        result_plan = table_scan_executors[0];
-        std::vector<std::string> joined_tables = {tables[0]};
-        
-        size_t i = 1;
-        while (i < tables.size()) {
-            // 为当前要加入的表查找连接条件
-            std::vector<Condition> current_join_conds;
-            auto it = where_conds.begin();
-            while (it != where_conds.end()) {
-                if (!it->is_rhs_val) { // 只考虑列-列比较
-                    bool left_in_joined = false, right_in_new = false;
-                    
-                    // 检查左列是否在已连接的表中
-                    for (const auto& joined_table : joined_tables) {
-                        if (it->lhs_col.tab_name == joined_table) {
-                            left_in_joined = true;
-                            break;
-                        }
-                    }
-                    
-                    // 检查右列是否是新加入的表
-                    if (it->rhs_col.tab_name == tables[i]) {
-                        right_in_new = true;
-                    }
-
-                    // 如果条件连接已连接的表和新表，则是连接条件
-                    if (left_in_joined && right_in_new) {
-                        current_join_conds.push_back(*it);
-                        it = where_conds.erase(it);
-                        continue;
-                    }
-                    
-                    // 反向检查：右列在已连接表中，左列是新表
-                    bool right_in_joined = false, left_in_new = false;
-                    for (const auto& joined_table : joined_tables) {
-                        if (it->rhs_col.tab_name == joined_table) {
-                            right_in_joined = true;
-                            break;
-                        }
-                    }
-                    if (it->lhs_col.tab_name == tables[i]) {
-                        left_in_new = true;
-                    }
-                    
-                    if (right_in_joined && left_in_new) {
-                        // 需要交换左右列的顺序
-                        std::map<CompOp, CompOp> swap_op = {
-                            {OP_EQ, OP_EQ}, {OP_NE, OP_NE}, {OP_LT, OP_GT}, 
-                            {OP_GT, OP_LT}, {OP_LE, OP_GE}, {OP_GE, OP_LE},
-                        };
-                        std::swap(it->lhs_col, it->rhs_col);
-                        it->op = swap_op.at(it->op);
-                        current_join_conds.push_back(*it);
-                        it = where_conds.erase(it);
-                        continue;
-                    }
-                }
-                ++it;
-            }
-            
-            // 创建连接（可能是空条件的笛卡尔积）
-            result_plan = std::make_shared<JoinPlan>(T_NestLoop, std::move(result_plan), 
-                                                    std::move(table_scan_executors[i]), current_join_conds);
-            joined_tables.push_back(tables[i]);
-            ++i;
-        }
+        // 没有JOIN ON条件，连接条件都在WHERE中：按代价选出连接树（可以是bushy树），再自底向上生成连接计划，
+        // 每个连接从WHERE条件中取出连接它两侧的条件
+        QueryOptimizer optimizer(sm_manager_, this);
+        auto join_tree = optimizer.buildOptimalJoinOrder(tables, {}, all_conds);
+        result_plan = make_join_tree(join_tree, tables, table_scan_executors, where_conds);
     } else {
         // 有JOIN ON条件，按照JOIN条件构建连接
         int scantbl[tables.size()];
@@ -386,15 +1056,7 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
         std::vector<Condition> single_join_cond{*it};
         
         // 创建第一个JOIN
-        if(!enable_nestedloop_join && !enable_sortmerge_join) {
-            throw RMDBError("No join executor selected!");
-        } else if(enable_sortmerge_join) {
-            result_plan = std::make_shared<JoinPlan>(T_SortMerge, std::move(left), std::move(right), single_join_cond);
-        } else if(enable_nestedloop_join) {
-            result_plan = std::make_shared<JoinPlan>(T_NestLoop, std::move(left), std::move(right), single_join_cond);
-        } else if(enable_nestedloop_join && enable_sortmerge_join) {
-            result_plan = std::make_shared<JoinPlan>(T_NestLoop, std::move(left), std::move(right), single_join_cond);
-        }
+        result_plan = make_join_plan(std::move(left), std::move(right), single_join_cond);
 
         it = join_conds.erase(it);
         
@@ -417,7 +1079,7 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
             
             if (next_table != nullptr) {
                 std::vector<Condition> next_join_cond{*it};
-                result_plan = std::make_shared<JoinPlan>(T_NestLoop, std::move(next_table), std::move(result_plan), next_join_cond);
+                result_plan = make_join_plan(std::move(next_table), std::move(result_plan), next_join_cond);
             }
             
             it = join_conds.erase(it);
@@ -443,7 +1105,27 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query)
 }
 
 
-std::shared_ptr<Plan> Planner::generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan)
+// 索引扫描的输出是否按col_name有序：它是B+树索引的字段，之前的字段都有和值比较的等值条件
+static bool index_ordered_on(const IndexMeta &index, const std::vector<Condition> &conds, const std::string &col_name) {
+    if (index.type == INDEX_HASH) {
+        return false;
+    }
+    for (auto &col : index.cols) {
+        if (col.name == col_name) {
+            return true;
+        }
+        bool fixed = std::any_of(conds.begin(), conds.end(), [&](const Condition &cond) {
+            return cond.is_rhs_val && cond.op == OP_EQ && cond.lhs_col.col_name == col.name;
+        });
+        if (!fixed) {
+            return false;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<Plan> Planner::generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan,
+                                                 bool below_agg)
 {
     auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse);
     if(!x->has_sort) {
@@ -461,11 +1143,162 @@ std::shared_ptr<Plan> Planner::generate_sort_plan(std::shared_ptr<Query> query,
         if(col.name.compare(x->order->cols->col_name) == 0 )
         sel_col = {.tab_name = col.tab_name, .col_name = col.name};
     }
-    return std::make_shared<SortPlan>(T_Sort, std::move(plan), sel_col, 
-                                    x->order->orderby_dir == ast::OrderBy_DESC);
+    bool desc = x->order->orderby_dir == ast::OrderBy_DESC;
+    // 单表扫描能按排序字段的顺序输出时不用排序，降序时反向遍历索引。按rid排序回表的扫描只在有LIMIT时
+    // 改回按索引顺序，只读前几条；没有条件的全表扫描也只在有LIMIT时换成整个索引上的扫描
+    bool top_n = x->limit >= 0 && !x->distinct && !below_agg;
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(plan);
+    if (scan != nullptr && scan->tab_name_ == sel_col.tab_name) {
+        TabMeta &tab = sm_manager_->db_.get_table(scan->tab_name_);
+        if (scan->tag == T_IndexScan && (!scan->rid_sorted_ || top_n) && (!desc || !scan->skip_scan_) &&
+            index_ordered_on(tab.get_index_meta(scan->index_col_names_), scan->conds_, sel_col.col_name)) {
+            scan->rid_sorted_ = false;
+            scan->desc_ = desc;
+            return plan;
+        }
+        if (scan->tag == T_SeqScan && scan->conds_.empty() && top_n) {
+            for (auto &[index_name, index] : tab.indexes) {
+                if (index_ordered_on(index, scan->conds_, sel_col.col_name)) {
+                    scan->tag = T_IndexScan;
+                    scan->index_col_names_.clear();
+                    for (auto &col : index.cols) {
+                        scan->index_col_names_.push_back(col.name);
+                    }
+                    scan->desc_ = desc;
+                    return plan;
+                }
+            }
+        }
+    }
+    auto sort = std::make_shared<SortPlan>(T_Sort, std::move(plan), sel_col, desc);
+    // ORDER BY ... LIMIT n OFFSET m 只保留前n+m条；DISTINCT时去重之后、在聚合之下排序时聚合之后才知道哪些是前n+m条
+    sort->limit_ = x->limit < 0 || x->distinct || below_agg ? -1 : x->limit + x->offset;
+    return sort;
 }
 
 
+/**
+ * @brief 单表查询中，选取、排序和过滤用到的列都在索引中时，把IndexScan标记为覆盖索引扫描，
+ * 直接用叶子中的key生成记录，不再读表的数据文件
+ *
+ * @param sel_cols select plan 选取的列，计算列和表达式条件换成其中的列
+ * @param plan 投影之下的计划，只处理Sort和Scan，遇到连接等其他计划直接返回
+ */
+void Planner::mark_covering_scan(const std::vector<TabCol> &sel_cols, const std::shared_ptr<Plan> &plan) {
+    std::vector<const TabCol *> used_cols;
+    std::shared_ptr<Plan> cur = plan;
+    while (true) {
+        if (auto x = std::dynamic_pointer_cast<SortPlan>(cur)) {
+            used_cols.push_back(&x->sel_col_);
+            cur = x->subplan_;
+        } else if (auto x = std::dynamic_pointer_cast<AggregatePlan>(cur)) {
+            // 聚合用到的字段都在sel_cols中
+            cur = x->subplan_;
+        } else {
+            break;
+        }
+    }
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(cur);
+    if (scan == nullptr || scan->tag != T_IndexScan) {
+        return;
+    }
+    // 只有B+树索引能从叶子中读出key，哈希索引和ART索引总要回表
+    if (sm_manager_->db_.get_table(scan->tab_name_).get_index_meta(scan->index_col_names_).type != INDEX_BTREE) {
+        return;
+    }
+    for (auto &sel_col : sel_cols) {
+        used_cols.push_back(&sel_col);
+    }
+    for (auto &cond : scan->conds_) {
+        used_cols.push_back(&cond.lhs_col);
+        if (!cond.is_rhs_val) {
+            used_cols.push_back(&cond.rhs_col);
+        }
+    }
+    for (auto &or_cond : scan->or_conds_) {
+        for (auto &cond : or_cond.conds) {
+            used_cols.push_back(&cond.lhs_col);
+        }
+    }
+    std::set<std::string> index_cols(scan->index_col_names_.begin(), scan->index_col_names_.end());
+    for (auto col : used_cols) {
+        if (col->tab_name != scan->tab_name_ || index_cols.count(col->col_name) == 0) {
+            return;
+        }
+    }
+    scan->covering_ = true;
+    scan->rid_sorted_ = false;
+}
+
+// 扫描之上的算子读取的字段（连接、过滤条件和排序的字段），以及可以投影的扫描。
+// 半连接的右儿子是子查询，有自己的投影；索引嵌套循环连接的内表由连接算子直接读整条记录，不投影
+static void collect_scan_projection(const std::shared_ptr<Plan> &plan, std::vector<TabCol> &used_cols,
+                                    std::vector<std::shared_ptr<ScanPlan>> &scans) {
+    auto add_conds = [&](const std::vector<Condition> &conds) {
+        for (auto &cond : conds) {
+            used_cols.push_back(cond.lhs_col);
+            if (!cond.is_rhs_val) {
+                used_cols.push_back(cond.rhs_col);
+            }
+        }
+    };
+    if (auto scan = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        if (scan->tag == T_SeqScan || scan->tag == T_IndexScan) {
+            scans.push_back(scan);
+        }
+    } else if (auto join = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        add_conds(join->conds_);
+        collect_scan_projection(join->left_, used_cols, scans);
+        if (join->tag != T_SemiJoin && join->tag != T_AntiJoin && join->tag != T_IndexNestLoop) {
+            collect_scan_projection(join->right_, used_cols, scans);
+        }
+    } else if (auto filter = std::dynamic_pointer_cast<FilterPlan>(plan)) {
+        add_conds(filter->filter_conds_);
+        collect_scan_projection(filter->subplan_, used_cols, scans);
+    } else if (auto sort = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        used_cols.push_back(sort->sel_col_);
+        collect_scan_projection(sort->subplan_, used_cols, scans);
+    } else if (auto agg = std::dynamic_pointer_cast<AggregatePlan>(plan)) {
+        collect_scan_projection(agg->subplan_, used_cols, scans);
+    }
+}
+
+/**
+ * @brief 投影下推到扫描：SeqScan和IndexScan只输出选取列表和上层算子用到的字段，
+ * 字段按在表中的顺序紧挨着存放，上层的连接、排序和去重搬动的都是窄记录。扫描自己的条件在整条记录上计算，不算在内
+ *
+ * @param sel_cols select plan 选取的列，计算列换成其中的列
+ * @param plan 投影之下的计划
+ */
+void Planner::mark_scan_projection(const std::vector<TabCol> &sel_cols, const std::shared_ptr<Plan> &plan) {
+    std::vector<TabCol> used_cols = sel_cols;
+    std::vector<std::shared_ptr<ScanPlan>> scans;
+    collect_scan_projection(plan, used_cols, scans);
+    for (auto &scan : scans) {
+        std::set<std::string> names;
+        for (auto &col : used_cols) {
+            if (col.tab_name == scan->tab_name_) {
+                names.insert(col.col_name);
+            }
+        }
+        TabMeta &tab = sm_manager_->db_.get_table(scan->tab_name_);
+        if (names.size() >= tab.cols.size()) {
+            continue;
+        }
+        // 一个字段都不用时（如COUNT(*)）输出第一个字段，记录不能为空
+        std::vector<ColMeta> out_cols;
+        int offset = 0;
+        for (auto &col : tab.cols) {
+            if (names.count(col.name) > 0 || (names.empty() && out_cols.empty())) {
+                out_cols.push_back(col);
+                out_cols.back().offset = offset;
+                offset += col.len;
+            }
+        }
+        scan->out_cols_ = std::move(out_cols);
+    }
+}
+
 /**
  * @brief select plan 生成
  *
@@ -481,17 +1314,41 @@ std::shared_ptr<Plan> Planner::generate_select_plan(std::shared_ptr<Query> query
     //物理优化
     auto sel_cols = query->cols;
     std::shared_ptr<Plan> plannerRoot = physical_optimization(query, context);
-    plannerRoot = std::make_shared<ProjectionPlan>(T_Projection, std::move(plannerRoot), 
-                                                        std::move(sel_cols));
-
-    return plannerRoot;
+    mark_covering_scan(query_used_cols(*query), plannerRoot);
+    mark_scan_projection(query_used_cols(*query), plannerRoot);
+    auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse);
+    // 聚合查询投影聚合的输出，聚合值按列名取出
+    for (size_t i = 0; i < query->agg_types.size(); ++i) {
+        if (query->agg_types[i] != AGG_COL) {
+            sel_cols[i] = {.tab_name = "", .col_name = agg_col_name(query->agg_types[i], sel_cols[i])};
+        }
+    }
+    // 只输出一列并且按这一列排序时，相同的记录相邻，可以流式去重
+    bool sorted = x->has_sort && sel_cols.size() == 1 && sel_cols[0].col_name == x->order->cols->col_name &&
+                  (x->order->cols->tab_name.empty() || sel_cols[0].tab_name == x->order->cols->tab_name);
+    auto projection_plan = std::make_shared<ProjectionPlan>(T_Projection, std::move(plannerRoot), std::move(sel_cols));
+    projection_plan->exprs_ = query->col_exprs;
+    projection_plan->alias_ = query->alias;
+    std::shared_ptr<Plan> projection = std::move(projection_plan);
+    if (x->distinct) {
+        projection = std::make_shared<DistinctPlan>(T_Distinct, std::move(projection), sorted);
+    }
+    if (x->limit >= 0 || x->offset > 0) {
+        // 执行时由Limit算子把需要的行数下推到投影和扫描，够了就不再往下扫描
+        return std::make_shared<LimitPlan>(T_Limit, std::move(projection), x->limit, x->offset);
+    }
+    return projection;
 }
 
 // 生成DDL语句和DML语句的查询执行计划
 std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context *context)
 {
     std::shared_ptr<Plan> plannerRoot;
-    if (auto x = std::dynamic_pointer_cast<ast::ExplainStmt>(query->parse)) {
+    if (auto x = std::dynamic_pointer_cast<ast::ExplainStmt>(query->parse); x != nullptr && x->analyze) {
+        // EXPLAIN ANALYZE生成语句真正的执行计划，由Portal执行并统计各算子
+        query->parse = x->stmt;
+        plannerRoot = std::make_shared<ExplainPlan>(T_Explain, do_planner(std::move(query), context));
+    } else if (auto x = std::dynamic_pointer_cast<ast::ExplainStmt>(query->parse)) {
         // 处理EXPLAIN语句
         QueryOptimizer optimizer(sm_manager_, this);
         auto optimized_plan_tree = optimizer.optimize(query);
@@ -521,6 +1378,9 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
             table_scan_executors = 
                 std::make_shared<ScanPlan>(T_SeqScan, sm_manager_, x->tab_name, query->conds, index_col_names);
         }
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->always_false_ = query->always_false;
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->expr_conds_ = query->expr_conds;
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->or_conds_ = query->or_conds;
         plannerRoot = std::make_shared<DMLPlan>(T_Update, table_scan_executors, x->tab_name,
                                                      std::vector<Value>(), query->conds, 
                                                      query->set_clauses);
@@ -541,6 +1401,9 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
             table_scan_executors = 
                 std::make_shared<ScanPlan>(T_SeqScan, sm_manager_, x->tab_name, query->conds, index_col_names);
         }
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->always_false_ = query->always_false;
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->expr_conds_ = query->expr_conds;
+        std::static_pointer_cast<ScanPlan>(table_scan_executors)->or_conds_ = query->or_conds;
 
         plannerRoot = std::make_shared<DMLPlan>(T_Delete, table_scan_executors, x->tab_name,  
                                                 std::vector<Value>(), query->conds, std::vector<SetClause>());
@@ -553,10 +1416,18 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
         plannerRoot = std::make_shared<DDLPlan>(T_DropIndex, x->tab_name, x->col_names, std::vector<ColDef>());
     } else if (auto x = std::dynamic_pointer_cast<ast::CreateIndex>(query->parse)) {
         // create index;
-        plannerRoot = std::make_shared<DDLPlan>(T_CreateIndex, x->tab_name, x->col_names, std::vector<ColDef>());
+        auto ddl_plan = std::make_shared<DDLPlan>(T_CreateIndex, x->tab_name, x->col_names, std::vector<ColDef>());
+        ddl_plan->index_type_ = x->hash ? INDEX_HASH : x->art ? INDEX_ART : INDEX_BTREE;
+        plannerRoot = ddl_plan;
     } else if (auto x = std::dynamic_pointer_cast<ast::DropTable>(query->parse)) {
         // drop table;
         plannerRoot = std::make_shared<DDLPlan>(T_DropTable, x->tab_name, std::vector<std::string>(), std::vector<ColDef>());
+    } else if (auto x = std::dynamic_pointer_cast<ast::CreateMatView>(query->parse)) {
+        // create materialized view;
+        auto ddl_plan = std::make_shared<DDLPlan>(T_CreateMatView, x->view_name, std::vector<std::string>(),
+                                                  query->mat_view_cols);
+        ddl_plan->mat_view_ = query->mat_view;
+        plannerRoot = ddl_plan;
     } else if (auto x = std::dynamic_pointer_cast<ast::CreateTable>(query->parse)) {
         // create table;
         std::vector<ColDef> col_defs;
@@ -564,13 +1435,27 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
             if (auto sv_col_def = std::dynamic_pointer_cast<ast::ColDef>(field)) {
                 ColDef col_def = {.name = sv_col_def->col_name,
                                   .type = interp_sv_type(sv_col_def->type_len->type),
-                                  .len = sv_col_def->type_len->len};
+                                  .len = sv_col_def->type_len->len,
+                                  .dictionary = sv_col_def->dictionary};
                 col_defs.push_back(col_def);
             } else {
                 throw InternalError("Unexpected field type");
             }
         }
-        plannerRoot = std::make_shared<DDLPlan>(T_CreateTable, x->tab_name, std::vector<std::string>(), col_defs);
+        auto ddl_plan = std::make_shared<DDLPlan>(T_CreateTable, x->tab_name, std::vector<std::string>(), col_defs);
+        ddl_plan->format_ = x->row_format == ast::ROW_FORMAT_DYNAMIC ? RM_FORMAT_SLOTTED
+                            : x->row_format == ast::ROW_FORMAT_PAX   ? RM_FORMAT_PAX
+                                                                     : RM_FORMAT_FIXED;
+        ddl_plan->persistence_ = x->persistence == ast::TABLE_TEMPORARY  ? TAB_TEMPORARY
+                                 : x->persistence == ast::TABLE_UNLOGGED ? TAB_UNLOGGED
+                                                                         : TAB_PERMANENT;
+        ddl_plan->in_memory_ = x->in_memory;
+        ddl_plan->compressed_ = x->compressed;
+        if (x->partition_by != nullptr) {
+            ddl_plan->partition_.col = x->partition_by->col_name;
+            ddl_plan->partition_.num = x->partition_by->num_partitions;
+        }
+        plannerRoot = ddl_plan;
     } else {
         throw InternalError("Unexpected AST root");
     }
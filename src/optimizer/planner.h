@@ -26,12 +26,18 @@ See the Mulan PSL v2 for more details. */
 #include "common/common.h"
 #include "analyze/analyze.h"
 
+class PlanTreeNode;
+
 class Planner {
    private:
     SmManager *sm_manager_;
 
-    bool enable_sortmerge_join = false;
-    bool enable_nestedloop_join = true;
+    // 连接算法的开关只是覆盖：默认都不设置，优化器为每个连接按代价选择；SET关掉的算法不再使用，
+    // SET打开了某些算法时只在打开的算法中选择
+    enum class JoinKnob { AUTO, ON, OFF };
+    JoinKnob enable_sortmerge_join = JoinKnob::AUTO;
+    JoinKnob enable_nestedloop_join = JoinKnob::AUTO;
+    JoinKnob enable_hash_join = JoinKnob::AUTO;
 
    public:
     Planner(SmManager *sm_manager) : sm_manager_(sm_manager) {}
@@ -39,21 +45,65 @@ class Planner {
 
     std::shared_ptr<Plan> do_planner(std::shared_ptr<Query> query, Context *context);
 
-    void set_enable_sortmerge_join(bool set_val) { enable_sortmerge_join = set_val; }
+    void set_enable_sortmerge_join(bool set_val) { enable_sortmerge_join = set_val ? JoinKnob::ON : JoinKnob::OFF; }
     
-    void set_enable_nestedloop_join(bool set_val) { enable_nestedloop_join = set_val; }
+    void set_enable_nestedloop_join(bool set_val) { enable_nestedloop_join = set_val ? JoinKnob::ON : JoinKnob::OFF; }
+
+    void set_enable_hash_join(bool set_val) { enable_hash_join = set_val ? JoinKnob::ON : JoinKnob::OFF; }
+
+    // 开关是否允许使用tag对应的连接算法，IndexNestLoop跟随嵌套循环连接的开关
+    bool join_allowed(PlanTag tag) const;
+
+    bool hash_join_enabled() const { return join_allowed(T_HashJoin); }
+
+    // 为一个连接选择算法：按两侧的估计记录数、记录长度和内存预算，比较嵌套循环、索引嵌套循环（一侧是有可用索引的基表）、
+    // 哈希连接和排序归并连接（已经按连接字段有序的一侧不用排序）的代价，在开关允许的算法中选最便宜的
+    std::shared_ptr<Plan> make_join_plan(std::shared_ptr<Plan> left, std::shared_ptr<Plan> right,
+                                         std::vector<Condition> conds);
     
-    // 公共方法：供QueryOptimizer使用
-    bool get_index_cols(std::string &tab_name, std::vector<Condition> &curr_conds, std::vector<std::string> &index_col_names);
+    // 公共方法：供QueryOptimizer使用。按代价选择索引，没有比全表扫描便宜的索引时返回false
+    bool get_index_cols(std::string &tab_name, std::vector<Condition> &curr_conds, std::vector<std::string> &index_col_names,
+                        const std::vector<TabCol> *used_cols = nullptr, bool *rid_sorted = nullptr,
+                        bool *skip_scan = nullptr);
     
    private:
+    // 从索引的第first个字段开始，conds中能用的条件的下标放进index_conds，返回它们的选择率；哈希索引用不上时返回-1
+    double index_selectivity(const std::string &tab_name, double rows, const IndexMeta &index, size_t first,
+                             const std::vector<Condition> &conds, std::vector<int> &index_conds);
+
+    // 条件用不上比全表扫描便宜的索引时，按代价选择几路索引扫描的rid取并集（OR组）或交集，改写成位图扫描
+    bool get_bitmap_arms(const std::shared_ptr<ScanPlan> &scan);
+
+    // inner上是否有索引的每个字段都和outer等值连接，有时返回索引字段
+    bool get_join_index(const std::shared_ptr<Plan> &outer, const std::shared_ptr<ScanPlan> &inner,
+                        const std::vector<Condition> &conds, std::vector<std::string> &index_col_names);
+
+    // 排序归并连接的输入：已经按key有序的索引扫描直接使用，否则在上面加排序
+    std::shared_ptr<Plan> make_sorted_input(std::shared_ptr<Plan> plan, const TabCol &key);
+
     std::shared_ptr<Plan> generate_select_plan(std::shared_ptr<Query> query, Context *context);
 
-    std::shared_ptr<Plan> generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan);
+    // below_agg: 在聚合之下排序，输入要全部保留，不做top-N
+    std::shared_ptr<Plan> generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan,
+                                             bool below_agg = false);
+
+    std::shared_ptr<Plan> make_aggregate_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan);
+
+    bool grouped_input(const std::shared_ptr<Plan> &plan, const std::vector<TabCol> &group_bys);
     
     std::shared_ptr<Plan> make_one_rel(std::shared_ptr<Query> query);
 
+    // 按QueryOptimizer选出的连接树生成连接计划，叶子是各表的扫描计划，每个连接从where_conds中取出连接它两侧的条件
+    std::shared_ptr<Plan> make_join_tree(const std::shared_ptr<PlanTreeNode> &node, const std::vector<std::string> &tables,
+                                         std::vector<std::shared_ptr<Plan>> &table_scan_executors,
+                                         std::vector<Condition> &where_conds);
+
+    void mark_covering_scan(const std::vector<TabCol> &sel_cols, const std::shared_ptr<Plan> &plan);
+
+    void mark_scan_projection(const std::vector<TabCol> &sel_cols, const std::shared_ptr<Plan> &plan);
+
     std::shared_ptr<Plan> physical_optimization(std::shared_ptr<Query> query, Context *context);
+    std::shared_ptr<Plan> make_semi_joins(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan, Context *context);
     std::shared_ptr<Query> logical_optimization(std::shared_ptr<Query> query, Context *context);
 
    private:
@@ -2,12 +2,14 @@
 #include <algorithm>
 #include <set>
 #include <sstream>
-#include <regex>
 #include <map>
 #include <climits>
+#include <cmath>
+#include <functional>
+#include <limits>
 #include <iomanip>
 #include <cstdio>
-#include <cctype>
+#include "common/cardinality_feedback.h"
 #include "record/rm_scan.h"
 #include "plan.h"
 #include "planner.h"
@@ -15,6 +17,10 @@
 std::shared_ptr<PlanTreeNode> QueryOptimizer::optimize(std::shared_ptr<Query> query) {
 
     alias_to_table_map_ = query->alias_to_table;
+    table_bits_.clear();
+    for (const auto& table : query->tables) {
+        tableBit(table);
+    }
     
     std::shared_ptr<PlanTreeNode> plan;
     
@@ -38,7 +44,7 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::optimize(std::shared_ptr<Query> qu
             filter_conditions = query->conds;
         }
         
-        plan = buildOptimalJoinOrder(query->tables, join_conditions);
+        plan = buildOptimalJoinOrder(query->tables, join_conditions, filter_conditions);
         
         plan = applyPredicatePushdown(plan, filter_conditions);
     }
@@ -83,20 +89,188 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::optimize(std::shared_ptr<Query> qu
 }
 
 std::shared_ptr<PlanTreeNode> QueryOptimizer::optimizeJoinOrder(std::shared_ptr<Query> query) {
-    return buildOptimalJoinOrder(query->tables, query->join_conds);
+    return buildOptimalJoinOrder(query->tables, query->join_conds, query->conds);
 }
 
 std::shared_ptr<PlanTreeNode> QueryOptimizer::buildOptimalJoinOrder(
-    const std::vector<std::string>& tables, const std::vector<Condition>& conditions) {
+    const std::vector<std::string>& tables, const std::vector<Condition>& conditions,
+    const std::vector<Condition>& filters) {
     
     if (tables.empty()) return nullptr;
     if (tables.size() == 1) {
         return std::make_shared<ScanNode>(tables[0]);
     }
+    // 动态规划按表名区分子集，同一张表出现多次时只能贪心
+    std::set<std::string> distinct_tables(tables.begin(), tables.end());
+    if (tables.size() <= JOIN_DP_MAX_TABLES && distinct_tables.size() == tables.size()) {
+        return buildDPJoinOrder(tables, conditions, filters);
+    }
+    return buildGreedyJoinOrder(tables, conditions, filters);
+}
+
+/**
+ * @description: 动态规划枚举连接顺序（DPsize）。子集按编号从小到大处理，它的真子集都已经算好；
+ * 对每个子集枚举所有划分成两个非空子集的方式（可以是bushy树），优先只考虑有连接条件相连的划分，没有时才做笛卡尔积。
+ * 子集连接结果的记录数与划分方式无关：各表过滤后的记录数之积乘以子集内部连接条件的选择率。
+ * 代价是Planner::make_join_plan实际会选的算法的代价：内表有索引时是索引嵌套循环连接，只扫描外表并逐条探测索引；
+ * 有等值条件且开启了哈希连接时是哈希连接，两侧各读一遍、较小的一侧建表；否则是嵌套循环连接，代价是两侧记录数之积。
+ * 扫描基表的代价是表的记录数，所有连接都加上输出的记录数
+ */
+std::shared_ptr<PlanTreeNode> QueryOptimizer::buildDPJoinOrder(
+    const std::vector<std::string>& tables, const std::vector<Condition>& conditions,
+    const std::vector<Condition>& filters) {
+
+    size_t n = tables.size();
+    size_t full = (static_cast<size_t>(1) << n) - 1;
+    auto table_bit = [&](const std::string& table) -> size_t {
+        auto it = std::find(tables.begin(), tables.end(), table);
+        return it == tables.end() ? 0 : static_cast<size_t>(1) << (it - tables.begin());
+    };
+    auto is_single = [](size_t s) { return (s & (s - 1)) == 0; };
+    auto table_index = [](size_t s) {
+        size_t i = 0;
+        while ((s >> i) != 1) ++i;
+        return i;
+    };
+
+    // 连接两张不同的表的列-列条件
+    struct JoinEdge {
+        size_t lhs;
+        size_t rhs;
+        const Condition* cond;
+    };
+    std::vector<JoinEdge> edges;
+    std::vector<double> edge_selectivity;
+    for (auto* list : {&conditions, &filters}) {
+        for (const auto& cond : *list) {
+            size_t lhs = table_bit(cond.lhs_col.tab_name), rhs = table_bit(cond.rhs_col.tab_name);
+            if (cond.is_rhs_val || lhs == 0 || rhs == 0 || lhs == rhs) {
+                continue;
+            }
+            edges.push_back({lhs, rhs, &cond});
+            edge_selectivity.push_back(getJoinSelectivity(cond));
+        }
+    }
+
+    // 每个子集连接结果的记录数
+    std::vector<double> base_rows(n);
+    std::vector<double> filtered_rows(n);
+    for (size_t i = 0; i < n; ++i) {
+        base_rows[i] = static_cast<double>(getTableCardinality(tables[i]));
+        filtered_rows[i] = static_cast<double>(getFilteredCardinality(tables[i], filters));
+    }
+    std::vector<double> rows(full + 1, 1.0);
+    for (size_t s = 1; s <= full; ++s) {
+        for (size_t i = 0; i < n; ++i) {
+            if ((s >> i) & 1) {
+                rows[s] *= filtered_rows[i];
+            }
+        }
+        for (size_t e = 0; e < edges.size(); ++e) {
+            if ((s & edges[e].lhs) && (s & edges[e].rhs)) {
+                rows[s] *= edge_selectivity[e];
+            }
+        }
+        rows[s] = std::max(rows[s], 1.0);
+    }
+
+    // inner是单张表时，它是否有索引的每个字段都和outer中的表等值连接，和Planner::get_join_index一致
+    auto has_join_index = [&](size_t inner, size_t outer) {
+        const std::string& inner_table = tables[table_index(inner)];
+        for (auto& [index_name, index_meta] : sm_manager_->db_.get_table(inner_table).indexes) {
+            bool usable = true;
+            for (auto& col : index_meta.cols) {
+                bool found = false;
+                for (const auto& edge : edges) {
+                    if (edge.cond->op != OP_EQ) {
+                        continue;
+                    }
+                    if ((edge.lhs == inner && (edge.rhs & outer) && edge.cond->lhs_col.col_name == col.name) ||
+                        (edge.rhs == inner && (edge.lhs & outer) && edge.cond->rhs_col.col_name == col.name)) {
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) {
+                    usable = false;
+                    break;
+                }
+            }
+            if (usable) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> cost(full + 1, inf);
+    std::vector<size_t> split(full + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        cost[static_cast<size_t>(1) << i] = base_rows[i];
+    }
+    bool hash_join = planner_ == nullptr || planner_->hash_join_enabled();
+    for (size_t s = 1; s <= full; ++s) {
+        if (is_single(s)) {
+            continue;
+        }
+        for (int pass = 0; pass < 2 && cost[s] == inf; ++pass) {
+            for (size_t l = (s - 1) & s; l > 0; l = (l - 1) & s) {
+                size_t r = s ^ l;
+                if (cost[l] == inf || cost[r] == inf) {
+                    continue;
+                }
+                bool connected = false, equi = false;
+                for (const auto& edge : edges) {
+                    if (((edge.lhs & l) && (edge.rhs & r)) || ((edge.lhs & r) && (edge.rhs & l))) {
+                        connected = true;
+                        equi = equi || edge.cond->op == OP_EQ;
+                    }
+                }
+                if (pass == 0 && !connected) {
+                    continue;
+                }
+                double c;
+                if (equi && is_single(r) && has_join_index(r, l)) {
+                    c = cost[l] + rows[l] * std::log2(base_rows[table_index(r)] + 2);
+                } else if (equi && is_single(l) && has_join_index(l, r)) {
+                    c = cost[r] + rows[r] * std::log2(base_rows[table_index(l)] + 2);
+                } else if (equi && hash_join) {
+                    c = cost[l] + cost[r] + rows[l] + rows[r] + std::min(rows[l], rows[r]);
+                } else {
+                    c = cost[l] + cost[r] + rows[l] * rows[r];
+                }
+                c += rows[s];
+                if (c < cost[s]) {
+                    cost[s] = c;
+                    split[s] = l;
+                }
+            }
+        }
+    }
+
+    // 按记录下的划分自顶向下建立连接树
+    std::function<std::shared_ptr<PlanTreeNode>(size_t)> build = [&](size_t s) -> std::shared_ptr<PlanTreeNode> {
+        if (is_single(s)) {
+            return std::make_shared<ScanNode>(tables[table_index(s)]);
+        }
+        auto left = build(split[s]);
+        auto right = build(s ^ split[s]);
+        auto join_conditions = extractJoinConditions(conditions, left->getOutputTables(), right->getOutputTables());
+        return std::make_shared<JoinNode>(left, right, join_conditions);
+    };
+    return build(full);
+}
+
+// 贪心：从过滤后记录数最少的表开始，每次加入连接结果估计最小的表，只生成左深树
+std::shared_ptr<PlanTreeNode> QueryOptimizer::buildGreedyJoinOrder(
+    const std::vector<std::string>& tables, const std::vector<Condition>& conditions,
+    const std::vector<Condition>& filters) {
     
+    // 单表条件过滤后的记录数
     std::map<std::string, size_t> table_cardinalities;
     for (const auto& table : tables) {
-        table_cardinalities[table] = getTableCardinality(table);
+        table_cardinalities[table] = getFilteredCardinality(table, filters);
     }
     
     std::vector<std::string> sorted_tables = tables;
@@ -104,133 +278,152 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::buildOptimalJoinOrder(
               [&](const std::string& a, const std::string& b) {
                   return table_cardinalities[a] < table_cardinalities[b];
               });
+
+    // WHERE中的列-列比较也能连接两张表，估算时一起考虑
+    std::vector<Condition> all_conditions = conditions;
+    for (const auto& cond : filters) {
+        if (!cond.is_rhs_val) {
+            all_conditions.push_back(cond);
+        }
+    }
     
     std::shared_ptr<PlanTreeNode> result = std::make_shared<ScanNode>(sorted_tables[0]);
+    size_t result_size = table_cardinalities[sorted_tables[0]];
     
     size_t i = 1;
     while (i < sorted_tables.size()) {
+        auto current_tables = result->getOutputTables();
+
+        // 贪心：在能和已连接的表相连的表中选连接结果估计最小的；都不能相连时按记录数从小到大做笛卡尔积
+        size_t best = i;
+        size_t best_size = estimateJoinResultSize(result_size, current_tables, sorted_tables[i],
+                                                  table_cardinalities[sorted_tables[i]], {});
+        bool found_connectable = false;
+        for (size_t j = i; j < sorted_tables.size(); ++j) {
+            std::vector<std::string> candidate_tables = {sorted_tables[j]};
+            if (extractJoinConditions(all_conditions, current_tables, candidate_tables).empty()) {
+                continue;
+            }
+            size_t size = estimateJoinResultSize(result_size, current_tables, sorted_tables[j],
+                                                 table_cardinalities[sorted_tables[j]], all_conditions);
+            if (!found_connectable || size < best_size) {
+                best = j;
+                best_size = size;
+                found_connectable = true;
+            }
+        }
+        std::swap(sorted_tables[i], sorted_tables[best]);
+
         std::string next_table = sorted_tables[i];
         auto next_scan = std::make_shared<ScanNode>(next_table);
-        
-        auto current_tables = result->getOutputTables();
         std::vector<std::string> next_tables = {next_table};
         auto join_conditions = extractJoinConditions(conditions, current_tables, next_tables);
         
-        if (join_conditions.empty() && i < sorted_tables.size() - 1) {
-            bool found_connectable = false;
-            size_t j = i + 1;
-            while (j < sorted_tables.size()) {
-                std::string candidate_table = sorted_tables[j];
-                std::vector<std::string> candidate_tables = {candidate_table};
-                auto candidate_conditions = extractJoinConditions(conditions, current_tables, candidate_tables);
-                
-                if (!candidate_conditions.empty()) {
-                    std::swap(sorted_tables[i], sorted_tables[j]);
-                    next_table = sorted_tables[i];
-                    next_scan = std::make_shared<ScanNode>(next_table);
-                    next_tables = {next_table};
-                    join_conditions = candidate_conditions;
-                    found_connectable = true;
-                    break;
-                }
-                ++j;
-            }
-        }
-        
         result = std::make_shared<JoinNode>(result, next_scan, join_conditions);
+        result_size = std::max<size_t>(best_size, 1);
         ++i;
     }
     
     return result;
 }
 
-size_t QueryOptimizer::estimateJoinResultSize(std::shared_ptr<PlanTreeNode> left, const std::string& right_table) {
-    size_t left_size = 1;
-    auto left_tables = left->getOutputTables();
-    for (const auto& table : left_tables) {
-        left_size *= getTableCardinality(table);
+// 左侧（已连接的表）和right_table连接的结果大小：两侧记录数之积乘以连接两侧的每个条件的选择率
+size_t QueryOptimizer::estimateJoinResultSize(size_t left_size, const std::vector<std::string>& left_tables,
+                                              const std::string& right_table, size_t right_size,
+                                              const std::vector<Condition>& conditions) {
+    auto in_left = [&](const std::string& table) {
+        return std::find(left_tables.begin(), left_tables.end(), table) != left_tables.end();
+    };
+    double size = static_cast<double>(left_size) * static_cast<double>(right_size);
+    for (const auto& cond : conditions) {
+        if (cond.is_rhs_val) {
+            continue;
+        }
+        if ((in_left(cond.lhs_col.tab_name) && cond.rhs_col.tab_name == right_table) ||
+            (in_left(cond.rhs_col.tab_name) && cond.lhs_col.tab_name == right_table)) {
+            size *= getJoinSelectivity(cond);
+        }
     }
-    
-    size_t right_size = getTableCardinality(right_table);
-    
-    double selectivity = 0.1; 
-    try {
-        size_t max_size = std::max(left_size, right_size);
-        if (max_size > 0) {
-            selectivity = std::min(0.5, 100.0 / max_size); // 自适应选择性
+    return static_cast<size_t>(std::clamp(size, 1.0, 1e18));
+}
+
+double QueryOptimizer::estimateJoinRows(double left_rows, double right_rows, const std::vector<Condition>& conds) {
+    double rows = left_rows * right_rows;
+    for (const auto& cond : conds) {
+        if (!cond.is_rhs_val) {
+            rows *= getJoinSelectivity(cond);
         }
-    } catch (...) {
-        selectivity = 0.1; // 回退到默认值
     }
-    
+    return std::clamp(rows, 1.0, 1e18);
+}
 
-    size_t estimated_size = static_cast<size_t>((left_size * right_size) * selectivity);
-    
-    return std::max(estimated_size, std::max(left_size, right_size));
+double QueryOptimizer::estimatePlanRows(const std::shared_ptr<Plan>& plan) {
+    if (auto scan = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        return static_cast<double>(getFilteredCardinality(scan->tab_name_, scan->conds_));
+    }
+    if (auto join = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        double left = estimatePlanRows(join->left_);
+        if (join->tag == T_SemiJoin || join->tag == T_AntiJoin) {
+            return std::max(left * 0.5, 1.0);
+        }
+        return estimateJoinRows(left, estimatePlanRows(join->right_), join->conds_);
+    }
+    if (auto filter = std::dynamic_pointer_cast<FilterPlan>(plan)) {
+        double rows = estimatePlanRows(filter->subplan_);
+        for (const auto& cond : filter->filter_conds_) {
+            rows *= cond.is_rhs_val ? 0.33 : getJoinSelectivity(cond);
+        }
+        return std::max(rows, 1.0);
+    }
+    if (auto sort = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        return estimatePlanRows(sort->subplan_);
+    }
+    return 1000;
+}
+
+// 表经过conditions中它的单表条件过滤后的估计记录数，ANALYZE过的字段按直方图和常见值估算选择率
+size_t QueryOptimizer::getFilteredCardinality(const std::string& table_name,
+                                              const std::vector<Condition>& conditions) {
+    double rows = static_cast<double>(getTableCardinality(table_name)) *
+                  sm_manager_->getSelectivity(table_name, conditions);
+    // 之前的扫描实际得到的记录数和估计有偏差时，按基数反馈的修正系数调整
+    rows *= CardinalityFeedback::instance().correction(CardinalityFeedback::key(table_name, conditions));
+    return std::max(static_cast<size_t>(rows + 0.5), static_cast<size_t>(1));
 }
 
 std::shared_ptr<PlanTreeNode> QueryOptimizer::applyPredicatePushdown(
     std::shared_ptr<PlanTreeNode> root, const std::vector<Condition>& conditions) {
     
-    std::vector<std::string> condition_strings;
+    std::vector<Predicate> predicates;
     for (const auto& cond : conditions) {
-        condition_strings.push_back(conditionToString(cond));
+        predicates.push_back(bindPredicate(cond));
     }
     
-    auto result = pushPredicatesDown(root, condition_strings);
+    auto result = pushPredicatesDown(root, predicates);
     
-    if (!condition_strings.empty()) {
-        result = std::make_shared<FilterNode>(result, condition_strings);
+    if (!predicates.empty()) {
+        result = std::make_shared<FilterNode>(result, predicates);
     }
     
     return result;
 }
 
+// 谓词引用的表都在一侧时下推到这一侧，用表的位集判断
 std::shared_ptr<PlanTreeNode> QueryOptimizer::pushPredicatesDown(
-    std::shared_ptr<PlanTreeNode> node, std::vector<std::string>& remaining_conditions) {
+    std::shared_ptr<PlanTreeNode> node, std::vector<Predicate>& remaining_conditions) {
     
     if (auto join = std::dynamic_pointer_cast<JoinNode>(node)) {
-        auto left_tables = join->getLeft()->getOutputTables();
-        auto right_tables = join->getRight()->getOutputTables();
+        uint64_t left_mask = tableMask(join->getLeft()->getOutputTables());
+        uint64_t right_mask = tableMask(join->getRight()->getOutputTables());
 
-        std::vector<std::string> left_conditions, right_conditions;
+        std::vector<Predicate> left_conditions, right_conditions;
         auto it = remaining_conditions.begin();
         while (it != remaining_conditions.end()) {
-            auto condition_tables = getTablesInCondition(*it);
-            
-            bool left_only = true;
-            bool right_only = true;
-            
-            for (const auto& cond_table : condition_tables) {
-                bool in_left = false, in_right = false;
-                
-                for (const auto& left_tab : left_tables) {
-                    if (cond_table == left_tab || 
-                        (alias_to_table_map_.find(cond_table) != alias_to_table_map_.end() && alias_to_table_map_.at(cond_table) == left_tab) ||
-                        (cond_table.length() == 1 && left_tab.substr(0, 1) == cond_table)) {
-                        in_left = true;
-                        break;
-                    }
-                }
-                
-                for (const auto& right_tab : right_tables) {
-                    if (cond_table == right_tab || 
-                        (alias_to_table_map_.find(cond_table) != alias_to_table_map_.end() && alias_to_table_map_.at(cond_table) == right_tab) ||
-                        (cond_table.length() == 1 && right_tab.substr(0, 1) == cond_table)) {
-                        in_right = true;
-                        break;
-                    }
-                }
-                
-                if (!in_left) left_only = false;
-                if (!in_right) right_only = false;
-            }
-            
-            if (left_only && !condition_tables.empty()) {
-                left_conditions.push_back(*it);
+            if (it->tables != 0 && (it->tables & ~left_mask) == 0) {
+                left_conditions.push_back(std::move(*it));
                 it = remaining_conditions.erase(it);
-            } else if (right_only && !condition_tables.empty()) {
-                right_conditions.push_back(*it);
+            } else if (it->tables != 0 && (it->tables & ~right_mask) == 0) {
+                right_conditions.push_back(std::move(*it));
                 it = remaining_conditions.erase(it);
             } else {
                 ++it;
@@ -247,13 +440,13 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::pushPredicatesDown(
         
         return new_join;
     } else if (auto scan = std::dynamic_pointer_cast<ScanNode>(node)) {
-        std::vector<std::string> applicable_conditions;
-        auto node_tables = scan->getOutputTables();
+        std::vector<Predicate> applicable_conditions;
+        uint64_t scan_mask = tableMask(scan->getOutputTables());
         
         auto it = remaining_conditions.begin();
         while (it != remaining_conditions.end()) {
-            if (conditionAppliesTo(*it, node_tables)) {
-                applicable_conditions.push_back(*it);
+            if (it->tables != 0 && (it->tables & ~scan_mask) == 0) {
+                applicable_conditions.push_back(std::move(*it));
                 it = remaining_conditions.erase(it);
             } else {
                 ++it;
@@ -275,34 +468,16 @@ void QueryOptimizer::collectColumnsFromNode(std::shared_ptr<PlanTreeNode> node,
         collectColumnsFromNode(project->getChild(), required_cols);
     } else if (auto filter = std::dynamic_pointer_cast<FilterNode>(node)) {
 
-        for (const auto& condition : filter->getConditions()) {
-            std::regex col_regex(R"((\w+)\.(\w+))");
-            std::sregex_iterator iter(condition.begin(), condition.end(), col_regex);
-            std::sregex_iterator end;
-            
-            while (iter != end) {
-                std::string prefix = iter->str(1);     // 表名或别名
-                std::string col_name = iter->str(2);   // 列名
-                required_cols.insert(prefix + "." + col_name);
-                ++iter;
-            }
+        for (const auto& pred : filter->getConditions()) {
+            required_cols.insert(pred.columns.begin(), pred.columns.end());
         }
         
 
         collectColumnsFromNode(filter->getChild(), required_cols);
     } else if (auto join = std::dynamic_pointer_cast<JoinNode>(node)) {
 
-        for (const auto& condition : join->getConditions()) {
-            std::regex col_regex(R"((\w+)\.(\w+))");
-            std::sregex_iterator iter(condition.begin(), condition.end(), col_regex);
-            std::sregex_iterator end;
-            
-            while (iter != end) {
-                std::string prefix = iter->str(1);     // 表名或别名
-                std::string col_name = iter->str(2);   // 列名
-                required_cols.insert(prefix + "." + col_name);
-                ++iter;
-            }
+        for (const auto& pred : join->getConditions()) {
+            required_cols.insert(pred.columns.begin(), pred.columns.end());
         }
         
 
@@ -356,19 +531,13 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::pushProjectionsDown(
             }
         }
         
-        for (const auto& condition : join->getConditions()) {
-            std::regex col_regex(R"((\w+)\.(\w+))");
-            std::sregex_iterator iter(condition.begin(), condition.end(), col_regex);
-            std::sregex_iterator end;
-            
-            while (iter != end) {
-                std::string full_col = iter->str();
+        for (const auto& pred : join->getConditions()) {
+            for (const auto& full_col : pred.columns) {
                 if (belongsToTables(full_col, left_tables)) {
                     left_required.insert(full_col);
                 } else if (belongsToTables(full_col, right_tables)) {
                     right_required.insert(full_col);
                 }
-                ++iter;
             }
         }
         
@@ -455,16 +624,8 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::pushProjectionsDown(
         } else {
             std::set<std::string> child_needed_cols = required_cols;
             
-            for (const auto& condition : filter->getConditions()) {
-                std::regex col_regex(R"((\w+)\.(\w+))");
-                std::sregex_iterator iter(condition.begin(), condition.end(), col_regex);
-                std::sregex_iterator end;
-                
-                while (iter != end) {
-                    std::string full_col = iter->str();
-                    child_needed_cols.insert(full_col);
-                    ++iter;
-                }
+            for (const auto& pred : filter->getConditions()) {
+                child_needed_cols.insert(pred.columns.begin(), pred.columns.end());
             }
             
             auto child = pushProjectionsDown(filter->getChild(), child_needed_cols, false);
@@ -496,63 +657,32 @@ std::shared_ptr<PlanTreeNode> QueryOptimizer::pushProjectionsDown(
 
 size_t QueryOptimizer::getTableCardinality(const std::string& table_name) {
     try {
-        auto& table_meta = sm_manager_->db_.get_table(table_name);
-        auto fh = sm_manager_->fhs_.at(table_name).get();
-        
-        size_t record_count = 0;
-        for (RmScan scan(fh); !scan.is_end(); scan.next()) {
-            record_count++;
-        }
-        
+        // 记录数由RmFileHandle在插入删除时维护，不用扫描表；分区表是各个分区的记录数之和
+        size_t record_count = sm_manager_->getTableRowCount(table_name);
         return std::max(record_count, static_cast<size_t>(1));
     } catch (...) {
         return 1000; // 默认中等大小
     }
 }
 
-std::vector<std::string> QueryOptimizer::extractJoinConditions(
+// 一侧引用left_tables、另一侧引用right_tables的列-列比较是这两部分之间的连接条件
+std::vector<Predicate> QueryOptimizer::extractJoinConditions(
     const std::vector<Condition>& conditions,
     const std::vector<std::string>& left_tables,
     const std::vector<std::string>& right_tables) {
     
-    std::vector<std::string> join_conditions;
+    uint64_t left_mask = tableMask(left_tables);
+    uint64_t right_mask = tableMask(right_tables);
+    std::vector<Predicate> join_conditions;
     
     for (const auto& cond : conditions) {
-        if (!cond.is_rhs_val) { // 只有列-列比较才可能是连接条件
-            bool left_has_table = false, right_has_table = false;
-            
-            // 检查左操作数
-            for (const auto& table : left_tables) {
-                if (cond.lhs_col.tab_name == table) {
-                    left_has_table = true;
-                    break;
-                }
-            }
-            
-            // 检查右操作数
-            for (const auto& table : right_tables) {
-                if (cond.rhs_col.tab_name == table) {
-                    right_has_table = true;
-                    break;
-                }
-            }
-            if (!left_has_table && !right_has_table) {
-                for (const auto& table : left_tables) {
-                    if (cond.rhs_col.tab_name == table) {
-                        left_has_table = true;
-                        break;
-                    }
-                }
-                for (const auto& table : right_tables) {
-                    if (cond.lhs_col.tab_name == table) {
-                        right_has_table = true;
-                        break;
-                    }
-                }
-            }
-            if (left_has_table && right_has_table) {
-                join_conditions.push_back(conditionToString(cond));
-            }
+        if (cond.is_rhs_val) { // 只有列-列比较才可能是连接条件
+            continue;
+        }
+        uint64_t lhs = tableBit(cond.lhs_col.tab_name);
+        uint64_t rhs = tableBit(cond.rhs_col.tab_name);
+        if (((lhs & left_mask) && (rhs & right_mask)) || ((rhs & left_mask) && (lhs & right_mask))) {
+            join_conditions.push_back(bindPredicate(cond));
         }
     }
     
@@ -619,122 +749,40 @@ std::string QueryOptimizer::conditionToString(const Condition& cond) {
     return result;
 }
 
-bool QueryOptimizer::conditionAppliesTo(const std::string& condition, 
-                                        const std::vector<std::string>& tables) {
-    std::set<std::string> condition_tables = getTablesInCondition(condition);
-    
-    if (condition_tables.count("__ANY_TABLE__")) {
-        std::regex col_regex(R"(^(\w+)[<>=!]+)");
-        std::smatch match;
-        if (std::regex_search(condition, match, col_regex)) {
-            std::string col_name = match.str(1);
-            for (const auto& table : tables) {
-                try {
-                    auto& table_meta = sm_manager_->db_.get_table(table);
-                    if (table_meta.is_col(col_name)) {
-                        return true;
-                    }
-                } catch (...) {
-                    continue;
-                }
-            }
-        }
-        return false;
+// 表在查询的表列表中的位，别名按它指向的表算；不在列表中的表（例如子查询中的表）依次分配新的位
+uint64_t QueryOptimizer::tableBit(const std::string& table) {
+    auto alias = alias_to_table_map_.find(table);
+    const std::string& name = alias == alias_to_table_map_.end() ? table : alias->second;
+    auto it = table_bits_.find(name);
+    if (it != table_bits_.end()) {
+        return it->second;
     }
+    uint64_t bit = table_bits_.size() < 64 ? static_cast<uint64_t>(1) << table_bits_.size() : 0;
+    table_bits_.emplace(name, bit);
+    return bit;
+}
 
-    for (const auto& cond_table : condition_tables) {
-        bool found = false;
-        for (const auto& table : tables) {
-            if (cond_table == table) {
-                found = true;
-                break;
-            }
-            if (alias_to_table_map_.find(cond_table) != alias_to_table_map_.end() &&
-                alias_to_table_map_.at(cond_table) == table) {
-                found = true;
-                break;
-            }
-            if (cond_table.length() == 1 && table.substr(0, 1) == cond_table) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            return false; 
-        }
+uint64_t QueryOptimizer::tableMask(const std::vector<std::string>& tables) {
+    uint64_t mask = 0;
+    for (const auto& table : tables) {
+        mask |= tableBit(table);
     }
-
-    return !condition_tables.empty();
+    return mask;
 }
 
-std::set<std::string> QueryOptimizer::getTablesInCondition(const std::string& condition) {
-    std::set<std::string> tables;
-
-    size_t pos = 0;
-    while (pos < condition.length()) {
-
-        size_t dot_pos = condition.find('.', pos);
-        if (dot_pos == std::string::npos) break;
-        
-        size_t start = dot_pos;
-        while (start > 0 && (std::isalnum(condition[start-1]) || condition[start-1] == '_')) {
-            start--;
-        }
-        
-        size_t end = dot_pos + 1;
-        while (end < condition.length() && (std::isalnum(condition[end]) || condition[end] == '_')) {
-            end++;
-        }
-        
-        if (start < dot_pos && end > dot_pos + 1) {
-            std::string prefix = condition.substr(start, dot_pos - start);
-            std::string suffix = condition.substr(dot_pos + 1, end - dot_pos - 1);
-            
-            bool prefix_is_table = false;
-            if (!prefix.empty() && !std::isdigit(prefix[0])) {
-                bool all_digits = true;
-                for (char c : prefix) {
-                    if (!std::isdigit(c)) {
-                        all_digits = false;
-                        break;
-                    }
-                }
-                if (!all_digits) {
-                    prefix_is_table = true;
-                }
-            }
-            
-            bool suffix_is_column = false;
-            if (!suffix.empty() && !std::isdigit(suffix[0])) {
-                bool all_digits = true;
-                for (char c : suffix) {
-                    if (!std::isdigit(c)) {
-                        all_digits = false;
-                        break;
-                    }
-                }
-                if (!all_digits) {
-                    suffix_is_column = true;
-                }
-            }
-            
-            if (prefix_is_table && suffix_is_column) {
-                tables.insert(prefix);
-            }
+Predicate QueryOptimizer::bindPredicate(const Condition& cond) {
+    Predicate pred;
+    pred.cond = cond;
+    pred.text = conditionToString(cond);
+    for (const TabCol* col : {&cond.lhs_col, &cond.rhs_col}) {
+        if (col == &cond.rhs_col && cond.is_rhs_val) {
+            break;
         }
-        
-        pos = dot_pos + 1;
+        pred.tables |= tableBit(col->tab_name);
+        std::string prefix = !col->alias.empty() ? col->alias : col->tab_name;
+        pred.columns.push_back(prefix.empty() ? col->col_name : prefix + "." + col->col_name);
     }
-    
-    if (tables.empty()) {
-        std::regex col_regex(R"(^(\w+)[<>=!]+)");
-        std::smatch match;
-        if (std::regex_search(condition, match, col_regex)) {
-            tables.insert("__ANY_TABLE__");
-        }
-    }
-    
-    return tables;
+    return pred;
 }
 
 std::shared_ptr<Plan> QueryOptimizer::convertToExecutionPlan(std::shared_ptr<PlanTreeNode> plan_tree, 
@@ -787,13 +835,19 @@ std::shared_ptr<Plan> QueryOptimizer::convertPlanTreeNodeToPlan(std::shared_ptr<
         // 转换Join节点
         auto left_plan = convertPlanTreeNodeToPlan(join_node->getLeft(), all_conditions);
         auto right_plan = convertPlanTreeNodeToPlan(join_node->getRight(), all_conditions);
-        auto join_conditions = parseConditionStrings(join_node->getConditions(), all_conditions);
+        std::vector<Condition> join_conditions;
+        for (const auto& pred : join_node->getConditions()) {
+            join_conditions.push_back(pred.cond);
+        }
         
         return std::make_shared<JoinPlan>(T_NestLoop, left_plan, right_plan, join_conditions);
     } else if (auto filter_node = std::dynamic_pointer_cast<FilterNode>(node)) {
         // 转换Filter节点
         auto child_plan = convertPlanTreeNodeToPlan(filter_node->getChild(), all_conditions);
-        auto filter_conditions = parseConditionStrings(filter_node->getConditions(), all_conditions);
+        std::vector<Condition> filter_conditions;
+        for (const auto& pred : filter_node->getConditions()) {
+            filter_conditions.push_back(pred.cond);
+        }
         
         return std::make_shared<FilterPlan>(T_Filter, child_plan, filter_conditions);
     } else if (auto scan_node = std::dynamic_pointer_cast<ScanNode>(node)) {
@@ -806,8 +860,12 @@ std::shared_ptr<Plan> QueryOptimizer::convertPlanTreeNodeToPlan(std::shared_ptr<
         bool index_exist = false;
         
         if (planner_) {
-            auto temp_conditions = table_conditions;  
+            // get_index_cols把索引能用的条件排到前面，索引扫描按这个顺序拼key
+            auto temp_conditions = table_conditions;
             index_exist = planner_->get_index_cols(const_cast<std::string&>(table_name), temp_conditions, index_col_names);
+            if (index_exist) {
+                table_conditions = std::move(temp_conditions);
+            }
         } else {
             for (const auto& cond : table_conditions) {
                 if (cond.is_rhs_val && cond.op == OP_EQ) {
@@ -866,102 +924,47 @@ std::vector<Condition> QueryOptimizer::findConditionsForTables(const std::vector
     return result;
 }
 
-std::vector<Condition> QueryOptimizer::parseConditionStrings(const std::vector<std::string>& condition_strings,
-                                                            const std::vector<Condition>& all_conditions) {
-    std::vector<Condition> result;
-    
-    for (const auto& cond_str : condition_strings) {
-        bool found = false;
-        
-        for (const auto& cond : all_conditions) {
-            if (conditionToString(cond) == cond_str) {
-                result.push_back(cond);
-                found = true;
-                break;
+size_t QueryOptimizer::getTableRowCount(const std::string& table_name) {
+    return getTableCardinality(table_name);  
+}
+
+double QueryOptimizer::getJoinSelectivity(const Condition& condition) {
+
+    // ANALYZE过的字段：等值连接的结果约为两侧记录数之积除以较大的不同值个数
+    if (condition.op == OP_EQ && !condition.is_rhs_val) {
+        const ColStats *stats[2] = {nullptr, nullptr};
+        size_t ndv = 0;
+        int k = 0;
+        for (auto *col : {&condition.lhs_col, &condition.rhs_col}) {
+            if (sm_manager_->db_.is_table(col->tab_name)) {
+                stats[k] = sm_manager_->db_.get_table(col->tab_name).get_col_stats(col->col_name);
+                if (stats[k] != nullptr) {
+                    ndv = std::max(ndv, stats[k]->ndv);
+                }
             }
+            ++k;
         }
-        
-        if (!found) {
-            std::regex cond_regex(R"((?:(\w+)\.)?(\w+)([<>=!]+)(.+))");
-            std::smatch match;
-            if (std::regex_match(cond_str, match, cond_regex)) {
-                std::string table_prefix = match.str(1);  // 可能为空
-                std::string col_name = match.str(2);
-                std::string op_str = match.str(3);
-                std::string value_str = match.str(4);
-                
-                // 转换操作符字符串为CompOp
-                CompOp target_op;
-                if (op_str == ">=") target_op = OP_GE;
-                else if (op_str == "<=") target_op = OP_LE;
-                else if (op_str == ">") target_op = OP_GT;
-                else if (op_str == "<") target_op = OP_LT;
-                else if (op_str == "<>") target_op = OP_NE;
-                else if (op_str == "=") target_op = OP_EQ;
-                else continue;  // 不支持的操作符
-                
-                for (const auto& cond : all_conditions) {
-                    // 匹配列名、操作符和值
-                    if (cond.lhs_col.col_name == col_name && cond.op == target_op && cond.is_rhs_val) {
-                        // 如果条件字符串有表前缀，检查表名是否匹配
-                        bool table_matches = true;
-                        if (!table_prefix.empty()) {
-                            table_matches = (cond.lhs_col.tab_name == table_prefix || 
-                                           (!cond.lhs_col.alias.empty() && cond.lhs_col.alias == table_prefix) ||
-                                           (table_prefix.length() == 1 && cond.lhs_col.tab_name.substr(0, 1) == table_prefix));
-                        }
-                        
-                        if (table_matches) {
-                            // 检查值是否匹配
-                            bool value_matches = false;
-                            switch (cond.rhs_val.type) {
-                                case TYPE_STRING: {
-                                    value_matches = (cond.rhs_val.str_val == value_str);
-                                    break;
-                                }
-                                case TYPE_FLOAT: {
-                                    try {
-                                        float parsed_val = std::stof(value_str);
-                                        // 使用小的容差比较浮点数
-                                        value_matches = (std::abs(cond.rhs_val.float_val - parsed_val) < 1e-6);
-                                    } catch (...) {
-                                        value_matches = false;
-                                    }
-                                    break;
-                                }
-                                case TYPE_INT: {
-                                    try {
-                                        int parsed_val = std::stoi(value_str);
-                                        value_matches = (cond.rhs_val.int_val == parsed_val);
-                                    } catch (...) {
-                                        value_matches = false;
-                                    }
-                                    break;
-                                }
-                            }
-                            
-                            if (value_matches) {
-                                result.push_back(cond);
-                                found = true;
-                                break;
-                            }
-                        }
+        // 两侧都有常见值时先逐个匹配：同一个常见值连接出两侧比例之积，其余的记录再按较大的不同值个数均匀匹配
+        if (stats[0] != nullptr && stats[1] != nullptr && ndv > 0) {
+            double matched = 0, lhs_mass = 0, rhs_mass = 0;
+            size_t num_matched = 0;
+            for (auto &[lhs_hash, lhs_freq] : stats[0]->mcv) {
+                for (auto &[rhs_hash, rhs_freq] : stats[1]->mcv) {
+                    if (lhs_hash == rhs_hash) {
+                        matched += lhs_freq * rhs_freq;
+                        lhs_mass += lhs_freq;
+                        rhs_mass += rhs_freq;
+                        ++num_matched;
                     }
                 }
-                
-                if (found) break;
             }
+            double rest = static_cast<double>(std::max<size_t>(ndv - std::min(ndv, num_matched), 1));
+            return std::min(1.0, matched + std::max(0.0, 1.0 - lhs_mass) * std::max(0.0, 1.0 - rhs_mass) / rest);
+        }
+        if (ndv > 0) {
+            return 1.0 / ndv;
         }
     }
-    
-    return result;
-}
-
-size_t QueryOptimizer::getTableRowCount(const std::string& table_name) {
-    return getTableCardinality(table_name);  
-}
-
-double QueryOptimizer::getJoinSelectivity(const Condition& condition) {
 
     if (condition.op == OP_EQ) {
         // 等值连接的选择性
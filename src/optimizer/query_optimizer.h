@@ -19,6 +19,7 @@ private:
     SmManager* sm_manager_;
     Planner* planner_;
     std::map<std::string, std::string> alias_to_table_map_;  // 别名到表名的映射
+    std::map<std::string, uint64_t> table_bits_;             // 表在谓词表位集中的位
     
 public:
     QueryOptimizer(SmManager* sm_manager, Planner* planner = nullptr) 
@@ -30,6 +31,17 @@ public:
     // 新增：PlanTreeNode到执行计划的转换
     std::shared_ptr<Plan> convertToExecutionPlan(std::shared_ptr<PlanTreeNode> plan_tree, 
                                                   std::shared_ptr<Query> query);
+
+    // 按代价选择连接顺序：表不多于JOIN_DP_MAX_TABLES张时动态规划，否则贪心。
+    // conditions是JOIN ON条件，会标在连接节点上；filters是WHERE条件，用来估算过滤后的记录数和连接的选择率
+    std::shared_ptr<PlanTreeNode> buildOptimalJoinOrder(const std::vector<std::string>& tables,
+                                                        const std::vector<Condition>& conditions,
+                                                        const std::vector<Condition>& filters);
+
+    // 计划输出的估计记录数：扫描按单表条件的选择率，连接按连接条件的选择率，过滤按条件的选择率，其他计划和儿子相同
+    double estimatePlanRows(const std::shared_ptr<Plan>& plan);
+    // 两侧分别有left_rows和right_rows条记录，按conds连接后的估计记录数
+    double estimateJoinRows(double left_rows, double right_rows, const std::vector<Condition>& conds);
     
 private:
     // 辅助方法 - 统计信息
@@ -37,6 +49,7 @@ private:
     size_t getTableRowCount(const std::string& table_name);  // 新增
     std::vector<std::string> getTablesFromNode(std::shared_ptr<PlanTreeNode> node);
     size_t getTableCardinality(const std::string& table_name);
+    size_t getFilteredCardinality(const std::string& table_name, const std::vector<Condition>& conditions);
     
     // 三大优化策略
     std::shared_ptr<PlanTreeNode> optimizeJoinOrder(std::shared_ptr<Query> query);
@@ -52,23 +65,24 @@ private:
     std::string conditionToString(const Condition& cond);
     std::vector<std::string> extractFilterConditions(const std::vector<Condition>& conditions,
                                                      const std::vector<std::string>& available_tables);
-    std::vector<std::string> extractJoinConditions(const std::vector<Condition>& conditions,
-                                                   const std::vector<std::string>& left_tables,
-                                                   const std::vector<std::string>& right_tables);
+    std::vector<Predicate> extractJoinConditions(const std::vector<Condition>& conditions,
+                                                 const std::vector<std::string>& left_tables,
+                                                 const std::vector<std::string>& right_tables);
+
+    // 谓词绑定：条件引用的表转成位集，优化过程中按位集判断谓词能否下推
+    uint64_t tableBit(const std::string& table);
+    uint64_t tableMask(const std::vector<std::string>& tables);
+    Predicate bindPredicate(const Condition& cond);
     
     // 转换相关的辅助方法
-    std::vector<Condition> parseConditionStrings(const std::vector<std::string>& condition_strings,
-                                                 const std::vector<Condition>& all_conditions);
     std::vector<Condition> findConditionsForTables(const std::vector<Condition>& all_conditions,
                                                    const std::vector<std::string>& tables);
     std::shared_ptr<Plan> convertPlanTreeNodeToPlan(std::shared_ptr<PlanTreeNode> node,
                                                     const std::vector<Condition>& all_conditions);
     
     // 谓词下推相关
-    std::set<std::string> getTablesInCondition(const std::string& condition);
-    bool conditionAppliesTo(const std::string& condition, const std::vector<std::string>& tables);
     std::shared_ptr<PlanTreeNode> pushPredicatesDown(std::shared_ptr<PlanTreeNode> node, 
-                                                     std::vector<std::string>& remaining_conditions);
+                                                     std::vector<Predicate>& remaining_conditions);
     
     // 投影下推相关
     bool belongsToSingleTable(const std::string& column, const std::string& table_name);
@@ -88,9 +102,15 @@ private:
         std::vector<std::string> join_conditions;
     };
     
-    size_t estimateJoinResultSize(std::shared_ptr<PlanTreeNode> left, const std::string& right_table);
-    std::shared_ptr<PlanTreeNode> buildOptimalJoinOrder(const std::vector<std::string>& tables,
-                                                        const std::vector<Condition>& conditions);
+    size_t estimateJoinResultSize(size_t left_size, const std::vector<std::string>& left_tables,
+                                  const std::string& right_table, size_t right_size,
+                                  const std::vector<Condition>& conditions);
+    std::shared_ptr<PlanTreeNode> buildGreedyJoinOrder(const std::vector<std::string>& tables,
+                                                       const std::vector<Condition>& conditions,
+                                                       const std::vector<Condition>& filters);
+    std::shared_ptr<PlanTreeNode> buildDPJoinOrder(const std::vector<std::string>& tables,
+                                                   const std::vector<Condition>& conditions,
+                                                   const std::vector<Condition>& filters);
     
     // 工具方法
     std::vector<std::string> conditionsToStringList(const std::vector<Condition>& conditions);
@@ -11,6 +11,8 @@ See the Mulan PSL v2 for more details. */
 
 namespace ast {
 
-std::shared_ptr<TreeNode> parse_tree;
+thread_local std::shared_ptr<TreeNode> parse_tree;
+
+thread_local int num_params = 0;
 
 }
@@ -12,6 +12,7 @@ See the Mulan PSL v2 for more details. */
 #include <vector>
 #include <string>
 #include <memory>
+#include <utility>
 
 enum JoinType {
     INNER_JOIN, LEFT_JOIN, RIGHT_JOIN, FULL_JOIN
@@ -23,7 +24,19 @@ enum SvType {
 };
 
 enum SvCompOp {
-    SV_OP_EQ, SV_OP_NE, SV_OP_LT, SV_OP_GT, SV_OP_LE, SV_OP_GE
+    SV_OP_EQ, SV_OP_NE, SV_OP_LT, SV_OP_GT, SV_OP_LE, SV_OP_GE,
+    SV_OP_IN, SV_OP_NOT_IN,        // 右边是子查询
+    SV_OP_EXISTS, SV_OP_NOT_EXISTS,  // 右边是子查询，没有左边的列
+    SV_OP_OR                         // 两边都为空，disjuncts中是用OR连接的条件
+};
+
+enum SvArithOp {
+    SV_ARITH_ADD, SV_ARITH_SUB, SV_ARITH_MUL, SV_ARITH_DIV
+};
+
+// 选取列表和HAVING中的聚合函数，SV_AGG_NONE表示普通的列
+enum SvAggFunc {
+    SV_AGG_NONE, SV_AGG_COUNT, SV_AGG_SUM, SV_AGG_MIN, SV_AGG_MAX
 };
 
 enum OrderByDir {
@@ -32,8 +45,17 @@ enum OrderByDir {
     OrderBy_DESC
 };
 
+enum RowFormat {
+    ROW_FORMAT_FIXED, ROW_FORMAT_DYNAMIC, ROW_FORMAT_PAX
+};
+
+// UNLOGGED: 不写日志，崩溃后清空；TEMPORARY: 只对创建它的会话可见，会话结束时删除
+enum TablePersistence {
+    TABLE_PERMANENT, TABLE_UNLOGGED, TABLE_TEMPORARY
+};
+
 enum SetKnobType {
-    EnableNestLoop, EnableSortMerge
+    EnableNestLoop, EnableSortMerge, EnableHashJoin, BufferPoolSize, SynchronousCommit, EnableResultCache, Workload, StatementTimeout
 };
 
 // Base class for tree nodes
@@ -41,12 +63,136 @@ struct TreeNode {
     virtual ~TreeNode() = default;  // enable polymorphism
 };
 
+static constexpr size_t AST_NODE_ALIGN = 16;
+static constexpr size_t AST_NODE_MAX_SIZE = 256;    // 更大的块直接使用operator new
+static constexpr size_t AST_NODE_POOL_SIZE = 1024;  // 每个线程每种大小缓存的空闲块数，超过时还给系统
+
+// AstAllocator的空闲链表，每个线程每种大小一个，所有类型共用
+struct AstFreePool {
+    static constexpr size_t NUM_CLASSES = AST_NODE_MAX_SIZE / AST_NODE_ALIGN;
+
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    FreeNode *heads[NUM_CLASSES] = {};
+    size_t sizes[NUM_CLASSES] = {};
+
+    ~AstFreePool() {
+        for (auto &head : heads) {
+            while (head != nullptr) {
+                FreeNode *next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+
+    static AstFreePool &local() {
+        thread_local AstFreePool pool;
+        return pool;
+    }
+};
+
+/* AST结点的分配器。一条语句的AST在语义分析之后整体释放，下一条语句又分配同样大小的结点，
+ * 释放的块按AST_NODE_ALIGN取整后的大小放在本线程的空闲链表中，下次分配时直接取出，
+ * 解析每条语句不再为每个结点（连同shared_ptr的控制块）调用malloc/free。
+ * 块可以在别的线程释放，释放后归那个线程所有 */
+template <typename T>
+class AstAllocator {
+   public:
+    using value_type = T;
+
+    AstAllocator() = default;
+
+    template <typename U>
+    AstAllocator(const AstAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        size_t cls = size_class(n);
+        if (cls < NUM_CLASSES) {
+            auto &pool = free_pool();
+            if (pool.heads[cls] != nullptr) {
+                FreeNode *node = pool.heads[cls];
+                pool.heads[cls] = node->next;
+                --pool.sizes[cls];
+                return reinterpret_cast<T *>(node);
+            }
+            return static_cast<T *>(::operator new((cls + 1) * AST_NODE_ALIGN));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        size_t cls = size_class(n);
+        if (cls < NUM_CLASSES) {
+            auto &pool = free_pool();
+            if (pool.sizes[cls] < AST_NODE_POOL_SIZE) {
+                auto node = reinterpret_cast<FreeNode *>(p);
+                node->next = pool.heads[cls];
+                pool.heads[cls] = node;
+                ++pool.sizes[cls];
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+    friend bool operator==(const AstAllocator &, const AstAllocator &) { return true; }
+    friend bool operator!=(const AstAllocator &, const AstAllocator &) { return false; }
+
+   private:
+    static constexpr size_t NUM_CLASSES = AstFreePool::NUM_CLASSES;
+    using FreeNode = AstFreePool::FreeNode;
+
+    // 不能放进空闲链表（过大或对齐要求过高）时返回NUM_CLASSES
+    static size_t size_class(size_t n) {
+        if (alignof(T) > AST_NODE_ALIGN || n == 0 || n * sizeof(T) > AST_NODE_MAX_SIZE) {
+            return NUM_CLASSES;
+        }
+        return (n * sizeof(T) - 1) / AST_NODE_ALIGN;
+    }
+
+    static AstFreePool &free_pool() { return AstFreePool::local(); }
+};
+
+// 分配AST结点，解析器中代替std::make_shared
+template <typename T, typename... Args>
+std::shared_ptr<T> make_node(Args &&...args) {
+    return std::allocate_shared<T>(AstAllocator<T>(), std::forward<Args>(args)...);
+}
+
 struct Help : public TreeNode {
 };
 
 struct ShowTables : public TreeNode {
 };
 
+struct ShowBufferStatus : public TreeNode {
+};
+
+struct ShowLocks : public TreeNode {
+};
+
+struct ShowLockStatus : public TreeNode {
+};
+
+struct ShowStatus : public TreeNode {
+};
+
+struct ShowMemory : public TreeNode {
+};
+
+struct ShowSessions : public TreeNode {
+};
+
+// KILL session，取消会话上正在执行的语句，语句所在的事务回滚
+struct KillSession : public TreeNode {
+    int session_id;
+
+    KillSession(int session_id_) : session_id(session_id_) {}
+};
+
 struct ShowIndexes : public TreeNode {
     std::string tab_name;
     ShowIndexes(std::string tab_name_) : tab_name(std::move(tab_name_)) {
@@ -54,6 +200,9 @@ struct ShowIndexes : public TreeNode {
 };
 
 struct TxnBegin : public TreeNode {
+    bool read_only;  // BEGIN READ ONLY
+
+    explicit TxnBegin(bool read_only_ = false) : read_only(read_only_) {}
 };
 
 struct TxnCommit : public TreeNode {
@@ -78,17 +227,36 @@ struct Field : public TreeNode {
 struct ColDef : public Field {
     std::string col_name;
     std::shared_ptr<TypeLen> type_len;
+    bool dictionary;  // 字典编码
 
-    ColDef(std::string col_name_, std::shared_ptr<TypeLen> type_len_) :
-            col_name(std::move(col_name_)), type_len(std::move(type_len_)) {}
+    ColDef(std::string col_name_, std::shared_ptr<TypeLen> type_len_, bool dictionary_ = false) :
+            col_name(std::move(col_name_)), type_len(std::move(type_len_)), dictionary(dictionary_) {}
+};
+
+// PARTITION BY HASH(col_name) PARTITIONS num_partitions
+struct PartitionBy : public TreeNode {
+    std::string col_name;
+    int num_partitions;
+
+    PartitionBy(std::string col_name_, int num_partitions_) :
+            col_name(std::move(col_name_)), num_partitions(num_partitions_) {}
 };
 
 struct CreateTable : public TreeNode {
     std::string tab_name;
     std::vector<std::shared_ptr<Field>> fields;
+    RowFormat row_format;
+    TablePersistence persistence;
+    bool in_memory;  // STORAGE = MEMORY
+    bool compressed;  // COMPRESSION = LZ4
+    std::shared_ptr<PartitionBy> partition_by;  // 不分区时为nullptr
 
-    CreateTable(std::string tab_name_, std::vector<std::shared_ptr<Field>> fields_) :
-            tab_name(std::move(tab_name_)), fields(std::move(fields_)) {}
+    CreateTable(std::string tab_name_, std::vector<std::shared_ptr<Field>> fields_,
+                RowFormat row_format_ = ROW_FORMAT_FIXED, TablePersistence persistence_ = TABLE_PERMANENT,
+                bool in_memory_ = false, bool compressed_ = false, std::shared_ptr<PartitionBy> partition_by_ = nullptr) :
+            tab_name(std::move(tab_name_)), fields(std::move(fields_)), row_format(row_format_),
+            persistence(persistence_), in_memory(in_memory_), compressed(compressed_),
+            partition_by(std::move(partition_by_)) {}
 };
 
 struct DropTable : public TreeNode {
@@ -103,12 +271,51 @@ struct DescTable : public TreeNode {
     DescTable(std::string tab_name_) : tab_name(std::move(tab_name_)) {}
 };
 
+struct VacuumTable : public TreeNode {
+    std::string tab_name;
+
+    VacuumTable(std::string tab_name_) : tab_name(std::move(tab_name_)) {}
+};
+
+// TRUNCATE TABLE table，换上空的数据文件和索引文件清空表
+struct TruncateTable : public TreeNode {
+    std::string tab_name;
+
+    TruncateTable(std::string tab_name_) : tab_name(std::move(tab_name_)) {}
+};
+
+// ANALYZE table，收集字段的统计信息
+struct AnalyzeTable : public TreeNode {
+    std::string tab_name;
+
+    AnalyzeTable(std::string tab_name_) : tab_name(std::move(tab_name_)) {}
+};
+
+// COPY table TO 'file' [BINARY]，把整张表导出到服务端的文件中
+struct CopyTo : public TreeNode {
+    std::string tab_name;
+    std::string file_name;
+    bool binary;
+
+    CopyTo(std::string tab_name_, std::string file_name_, bool binary_)
+        : tab_name(std::move(tab_name_)), file_name(std::move(file_name_)), binary(binary_) {}
+};
+
+// BACKUP TO 'dir'，不停止写入把数据库目录复制到服务端的目录dir中
+struct Backup : public TreeNode {
+    std::string dir;
+
+    Backup(std::string dir_) : dir(std::move(dir_)) {}
+};
+
 struct CreateIndex : public TreeNode {
     std::string tab_name;
     std::vector<std::string> col_names;
+    bool hash;  // CREATE INDEX ... USING HASH
+    bool art;   // CREATE INDEX ... USING ART
 
-    CreateIndex(std::string tab_name_, std::vector<std::string> col_names_) :
-            tab_name(std::move(tab_name_)), col_names(std::move(col_names_)) {}
+    CreateIndex(std::string tab_name_, std::vector<std::string> col_names_, bool hash_ = false, bool art_ = false) :
+            tab_name(std::move(tab_name_)), col_names(std::move(col_names_)), hash(hash_), art(art_) {}
 };
 
 struct DropIndex : public TreeNode {
@@ -123,6 +330,7 @@ struct Expr : public TreeNode {
 };
 
 struct Value : public Expr {
+    int param = -1;  // 语句中第几个int/float/string字面量，计划缓存据此把新语句的值代入缓存的计划
 };
 
 struct IntLit : public Value {
@@ -152,23 +360,52 @@ struct BoolLit : public Value {
 struct Col : public Expr {
     std::string tab_name;
     std::string col_name;
+    std::shared_ptr<Expr> expr;  // 选取列表中的计算列，这时tab_name和col_name为空
+    SvAggFunc agg = SV_AGG_NONE;  // 聚合函数的参数，COUNT(*)时tab_name和col_name为空
+    std::string alias;            // 选取列表中AS给出的列名
 
     Col(std::string tab_name_, std::string col_name_) :
             tab_name(std::move(tab_name_)), col_name(std::move(col_name_)) {}
 };
 
+// 四则运算，出现在where条件和选取列表中
+struct ArithExpr : public Expr {
+    std::shared_ptr<Expr> lhs;
+    SvArithOp op;
+    std::shared_ptr<Expr> rhs;
+
+    ArithExpr(std::shared_ptr<Expr> lhs_, SvArithOp op_, std::shared_ptr<Expr> rhs_) :
+            lhs(std::move(lhs_)), op(op_), rhs(std::move(rhs_)) {}
+};
+
+struct SelectStmt;
+
+// col [NOT] IN (SELECT ...) / [NOT] EXISTS (SELECT ...) 右边的子查询。IN的子查询只能选取一列；
+// 子查询的where中可以用等值条件引用外层的列（关联子查询）
+struct SubqueryExpr : public Expr {
+    std::shared_ptr<SelectStmt> select;
+
+    SubqueryExpr(std::shared_ptr<SelectStmt> select_) : select(std::move(select_)) {}
+};
+
 struct SetClause : public TreeNode {
     std::string col_name;
     std::shared_ptr<Value> val;
+    std::string incr_col;  // col = incr_col + val或col = incr_col - val，为空时是col = val
+    bool is_sub = false;
 
-    SetClause(std::string col_name_, std::shared_ptr<Value> val_) :
-            col_name(std::move(col_name_)), val(std::move(val_)) {}
+    SetClause(std::string col_name_, std::shared_ptr<Value> val_, std::string incr_col_ = "",
+              bool is_sub_ = false) :
+            col_name(std::move(col_name_)), val(std::move(val_)), incr_col(std::move(incr_col_)),
+            is_sub(is_sub_) {}
 };
 
 struct BinaryExpr : public TreeNode {
-    std::shared_ptr<Col> lhs;
+    std::shared_ptr<Col> lhs;  // EXISTS时为空
     SvCompOp op;
     std::shared_ptr<Expr> rhs;
+    std::shared_ptr<Expr> lhs_expr;  // 左边是计算表达式或常量，或者右边是计算表达式时非空，这时lhs为空
+    std::vector<std::shared_ptr<BinaryExpr>> disjuncts;  // SV_OP_OR时至少有一个成立的条件
 
     BinaryExpr(std::shared_ptr<Col> lhs_, SvCompOp op_, std::shared_ptr<Expr> rhs_) :
             lhs(std::move(lhs_)), op(op_), rhs(std::move(rhs_)) {}
@@ -184,9 +421,9 @@ struct OrderBy : public TreeNode
 
 struct InsertStmt : public TreeNode {
     std::string tab_name;
-    std::vector<std::shared_ptr<Value>> vals;
+    std::vector<std::vector<std::shared_ptr<Value>>> vals;  // 每个元素是一行
 
-    InsertStmt(std::string tab_name_, std::vector<std::shared_ptr<Value>> vals_) :
+    InsertStmt(std::string tab_name_, std::vector<std::vector<std::shared_ptr<Value>>> vals_) :
             tab_name(std::move(tab_name_)), vals(std::move(vals_)) {}
 };
 
@@ -229,25 +466,51 @@ struct SelectStmt : public TreeNode {
     
     bool has_sort;
     std::shared_ptr<OrderBy> order;
+    int limit;  // LIMIT n，没有时为-1
+    int offset;  // OFFSET m，没有时为0
+    bool distinct = false;  // SELECT DISTINCT
+    std::vector<std::shared_ptr<Col>> group_bys;  // GROUP BY的列
+    std::vector<std::shared_ptr<BinaryExpr>> havings;  // HAVING条件，左边是聚合函数，右边是常量，用AND连接
 
 
     SelectStmt(std::vector<std::shared_ptr<Col>> cols_,
                std::vector<std::string> tabs_,
                std::vector<std::shared_ptr<BinaryExpr>> conds_,
-               std::shared_ptr<OrderBy> order_) :
+               std::shared_ptr<OrderBy> order_, int limit_ = -1, int offset_ = 0) :
             cols(std::move(cols_)), tabs(std::move(tabs_)), conds(std::move(conds_)), 
-            order(std::move(order_)) {
+            order(std::move(order_)), limit(limit_), offset(offset_) {
                 has_sort = (bool)order;
             }
 };
 
-// set enable_nestloop
+// CREATE MATERIALIZED VIEW view AS select，单表上的GROUP BY聚合查询，结果存在表view中并增量维护
+struct CreateMatView : public TreeNode {
+    std::string view_name;
+    std::shared_ptr<SelectStmt> query;
+
+    CreateMatView(std::string view_name_, std::shared_ptr<SelectStmt> query_) :
+            view_name(std::move(view_name_)), query(std::move(query_)) {}
+};
+
+// EXPLAIN select / EXPLAIN ANALYZE dml。ANALYZE时执行语句，返回带有各算子运行统计的计划树
+struct ExplainStmt : public TreeNode {
+    std::shared_ptr<TreeNode> stmt;
+    bool analyze;
+
+    ExplainStmt(std::shared_ptr<TreeNode> stmt_, bool analyze_) : stmt(std::move(stmt_)), analyze(analyze_) {}
+};
+
+// set enable_nestloop / set buffer_pool_size
 struct SetStmt : public TreeNode {
     SetKnobType set_knob_type_;
-    bool bool_val_;
+    bool bool_val_ = false;
+    int int_val_ = 0;
 
     SetStmt(SetKnobType &type, bool bool_value) : 
         set_knob_type_(type), bool_val_(bool_value) { }
+
+    SetStmt(SetKnobType type, int int_value) :
+        set_knob_type_(type), int_val_(int_value) { }
 };
 
 // Semantic value
@@ -272,6 +535,7 @@ struct SemValue {
 
     std::shared_ptr<Value> sv_val;
     std::vector<std::shared_ptr<Value>> sv_vals;
+    std::vector<std::vector<std::shared_ptr<Value>>> sv_val_lists;
 
     std::shared_ptr<Col> sv_col;
     std::vector<std::shared_ptr<Col>> sv_cols;
@@ -287,7 +551,11 @@ struct SemValue {
     SetKnobType sv_setKnobType;
 };
 
-extern std::shared_ptr<ast::TreeNode> parse_tree;
+// 最近一次yyparse的结果，每个工作线程一个
+extern thread_local std::shared_ptr<ast::TreeNode> parse_tree;
+
+// 当前语句已经解析出的字面量个数，每次yyparse开始时清零
+extern thread_local int num_params;
 
 }
 
@@ -18,4 +18,6 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 
 YY_BUFFER_STATE yy_scan_string(const char *str);
 
+YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size);
+
 void yy_delete_buffer(YY_BUFFER_STATE buffer);
@@ -29,6 +29,8 @@ int main() {
         "select * from tb;",
         "select * from tb where x <> 2 and y >= 3. and z <= '123' and b < tb.a;",
         "select x.a, y.b from x, y where x.a = y.b and c = d;",
+        "select * from tb where a = 1 or b = 2 or c > 'x';",
+        "select * from tb where x > 0 and (a = 1 or b < 2.5) and (c = 'y');",
         "select x.a, y.b from x join y where x.a = y.b and c = d;",
         "select a.*, b.name from a inner join b on a.id = b.a_id;",
         "select * from t1 left join t2 on t1.id = t2.t1_id where t1.age > 18;",
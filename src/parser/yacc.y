@@ -1,6 +1,9 @@
 %{
 #include "ast.h"
+#include "defs.h"
 #include "yacc.tab.h"
+#include <strings.h>
+
 #include <iostream>
 #include <memory>
 
@@ -19,10 +22,12 @@ using namespace ast;
 %locations
 // enable verbose syntax error message
 %define parse.error verbose
+// literals are numbered from 0 in each statement
+%initial-action { ast::num_params = 0; };
 
 // keywords
-%token SHOW TABLES CREATE TABLE DROP DESC INSERT INTO VALUES DELETE FROM ASC ORDER BY
-WHERE UPDATE SET SELECT INT CHAR FLOAT INDEX AND JOIN EXIT HELP TXN_BEGIN TXN_COMMIT TXN_ABORT TXN_ROLLBACK ORDER_BY ENABLE_NESTLOOP ENABLE_SORTMERGE
+%token SHOW TABLES CREATE TABLE DROP DESC INSERT INTO VALUES DELETE FROM ASC ORDER BY LIMIT OFFSET
+WHERE UPDATE SET SELECT INT CHAR FLOAT INDEX AND OR IN NOT DISTINCT JOIN EXIT HELP TXN_BEGIN TXN_COMMIT TXN_ABORT TXN_ROLLBACK ORDER_BY ENABLE_NESTLOOP ENABLE_SORTMERGE ENABLE_HASHJOIN KNOB_BUFFER_POOL_SIZE SYNCHRONOUS_COMMIT RESULT_CACHE WORKLOAD_CLASS STATEMENT_TIMEOUT BUFFER_STATUS SHOW_LOCKS SHOW_STATUS SHOW_MEMORY SHOW_SESSIONS KILL LOCK_STATUS ROW_FORMAT STORAGE COMPRESSION DICTIONARY VACUUM ANALYZE USING EXPLAIN EXISTS COPY TO BINARY BACKUP TRUNCATE TEMPORARY UNLOGGED COUNT SUM MIN MAX GROUP HAVING AS MATERIALIZED VIEW PARTITION PARTITIONS
 // non-keywords
 %token LEQ NEQ GEQ T_EOF
 
@@ -32,8 +37,12 @@ WHERE UPDATE SET SELECT INT CHAR FLOAT INDEX AND JOIN EXIT HELP TXN_BEGIN TXN_CO
 %token <sv_float> VALUE_FLOAT
 %token <sv_bool> VALUE_BOOL
 
+// arithmetic operators, '*' and '/' bind tighter than '+' and '-'
+%left '+' '-'
+%left '*' '/'
+
 // specify types for non-terminal symbol
-%type <sv_node> stmt dbStmt ddl dml txnStmt setStmt
+%type <sv_node> stmt dbStmt ddl dml txnStmt setStmt selectStmt explainStmt opt_partition
 %type <sv_field> field
 %type <sv_fields> fieldList
 %type <sv_type_len> type
@@ -41,17 +50,22 @@ WHERE UPDATE SET SELECT INT CHAR FLOAT INDEX AND JOIN EXIT HELP TXN_BEGIN TXN_CO
 %type <sv_expr> expr
 %type <sv_val> value
 %type <sv_vals> valueList
+%type <sv_val_lists> valueLists
 %type <sv_str> tbName colName
 %type <sv_strs> tableList colNameList
 %type <sv_joins> joinList
 %type <sv_col> col
-%type <sv_cols> colList selector
+%type <sv_col> selItem aggCall
+%type <sv_cols> selector selList groupList opt_group_clause
 %type <sv_set_clause> setClause
 %type <sv_set_clauses> setClauses
-%type <sv_cond> condition
-%type <sv_conds> whereClause optWhereClause
+%type <sv_cond> condition andTerm orList topOrList havingCond
+%type <sv_conds> whereClause optWhereClause havingList opt_having_clause
 %type <sv_orderby>  order_clause opt_order_clause
 %type <sv_orderby_dir> opt_asc_desc
+%type <sv_int> opt_limit opt_offset opt_persistence
+%type <sv_str> opt_alias
+%type <sv_bool> opt_distinct opt_storage opt_compression
 %type <sv_setKnobType> set_knob_type
 
 %%
@@ -63,7 +77,7 @@ start:
     }
     |   HELP
     {
-        parse_tree = std::make_shared<Help>();
+        parse_tree = make_node<Help>();
         YYACCEPT;
     }
     |   EXIT
@@ -84,81 +98,238 @@ stmt:
     |   dml
     |   txnStmt
     |   setStmt
+    |   explainStmt
+    ;
+
+explainStmt:
+        EXPLAIN selectStmt
+    {
+        $$ = make_node<ExplainStmt>($2, false);
+    }
+    |   EXPLAIN ANALYZE dml
+    {
+        $$ = make_node<ExplainStmt>($3, true);
+    }
     ;
 
 txnStmt:
         TXN_BEGIN
     {
-        $$ = std::make_shared<TxnBegin>();
+        $$ = make_node<TxnBegin>();
+    }
+    |   TXN_BEGIN IDENTIFIER IDENTIFIER
+    {
+        // BEGIN READ ONLY：在快照上读、不加锁不写日志的只读事务
+        if (strcasecmp($2.c_str(), "READ") != 0 || strcasecmp($3.c_str(), "ONLY") != 0) {
+            yyerror(&@$, "expected BEGIN READ ONLY");
+            YYABORT;
+        }
+        $$ = make_node<TxnBegin>(true);
+    }
+    |   IDENTIFIER IDENTIFIER
+    {
+        // START TRANSACTION，和BEGIN相同。READ、ONLY、START等不作为关键字，表名和字段名仍然可以用它们
+        if (strcasecmp($1.c_str(), "START") != 0 || strcasecmp($2.c_str(), "TRANSACTION") != 0) {
+            yyerror(&@$, "syntax error");
+            YYABORT;
+        }
+        $$ = make_node<TxnBegin>();
+    }
+    |   IDENTIFIER IDENTIFIER IDENTIFIER IDENTIFIER
+    {
+        if (strcasecmp($1.c_str(), "START") != 0 || strcasecmp($2.c_str(), "TRANSACTION") != 0 ||
+            strcasecmp($3.c_str(), "READ") != 0 || strcasecmp($4.c_str(), "ONLY") != 0) {
+            yyerror(&@$, "expected START TRANSACTION READ ONLY");
+            YYABORT;
+        }
+        $$ = make_node<TxnBegin>(true);
     }
     |   TXN_COMMIT
     {
-        $$ = std::make_shared<TxnCommit>();
+        $$ = make_node<TxnCommit>();
     }
     |   TXN_ABORT
     {
-        $$ = std::make_shared<TxnAbort>();
+        $$ = make_node<TxnAbort>();
     }
     | TXN_ROLLBACK
     {
-        $$ = std::make_shared<TxnRollback>();
+        $$ = make_node<TxnRollback>();
     }
     ;
 
 dbStmt:
         SHOW TABLES
     {
-        $$ = std::make_shared<ShowTables>();
+        $$ = make_node<ShowTables>();
+    }
+    |   SHOW BUFFER_STATUS
+    {
+        $$ = make_node<ShowBufferStatus>();
+    }
+    |   SHOW_LOCKS
+    {
+        $$ = make_node<ShowLocks>();
+    }
+    |   SHOW LOCK_STATUS
+    {
+        $$ = make_node<ShowLockStatus>();
+    }
+    |   SHOW_STATUS
+    {
+        $$ = make_node<ShowStatus>();
+    }
+    |   SHOW_MEMORY
+    {
+        $$ = make_node<ShowMemory>();
+    }
+    |   SHOW_SESSIONS
+    {
+        $$ = make_node<ShowSessions>();
+    }
+    |   KILL VALUE_INT
+    {
+        $$ = make_node<KillSession>($2);
+    }
+    |   VACUUM tbName
+    {
+        $$ = make_node<VacuumTable>($2);
+    }
+    |   ANALYZE tbName
+    {
+        $$ = make_node<AnalyzeTable>($2);
+    }
+    |   TRUNCATE TABLE tbName
+    {
+        $$ = make_node<TruncateTable>($3);
+    }
+    |   COPY tbName TO VALUE_STRING
+    {
+        $$ = make_node<CopyTo>($2, $4, false);
+    }
+    |   COPY tbName TO VALUE_STRING BINARY
+    {
+        $$ = make_node<CopyTo>($2, $4, true);
+    }
+    |   BACKUP TO VALUE_STRING
+    {
+        $$ = make_node<Backup>($3);
     }
     ;
 
 setStmt:
         SET set_knob_type '=' VALUE_BOOL
     {
-        $$ = std::make_shared<SetStmt>($2, $4);
+        $$ = make_node<SetStmt>($2, $4);
+    }
+    |   SET KNOB_BUFFER_POOL_SIZE '=' VALUE_INT
+    {
+        $$ = make_node<SetStmt>(BufferPoolSize, $4);
+    }
+    |   SET STATEMENT_TIMEOUT '=' VALUE_INT
+    {
+        $$ = make_node<SetStmt>(StatementTimeout, $4);
+    }
+    |   SET WORKLOAD_CLASS '=' IDENTIFIER
+    {
+        // OLTP: 默认；ANALYTICS: 报表等长语句，和OLTP的请求分开调度
+        WorkloadClass workload;
+        if (strcasecmp($4.c_str(), "OLTP") == 0) {
+            workload = WORKLOAD_OLTP;
+        } else if (strcasecmp($4.c_str(), "ANALYTICS") == 0) {
+            workload = WORKLOAD_ANALYTICS;
+        } else {
+            yyerror(&@$, "WORKLOAD_CLASS must be OLTP or ANALYTICS");
+            YYABORT;
+        }
+        $$ = make_node<SetStmt>(Workload, static_cast<int>(workload));
     }
     ;
 
 ddl:
-        CREATE TABLE tbName '(' fieldList ')'
-    {
-        $$ = std::make_shared<CreateTable>($3, $5);
+        CREATE opt_persistence TABLE tbName '(' fieldList ')' opt_storage opt_compression opt_partition
+    {
+        $$ = make_node<CreateTable>($4, $6, ROW_FORMAT_FIXED, static_cast<TablePersistence>($2), $8, $9,
+                                    std::static_pointer_cast<PartitionBy>($10));
+    }
+    |   CREATE opt_persistence TABLE tbName '(' fieldList ')' ROW_FORMAT '=' IDENTIFIER opt_storage opt_compression opt_partition
+    {
+        // DYNAMIC: 字符串按实际长度存储的变长格式；PAX: 页面内按列存放的列存格式；FIXED: 默认的定长格式
+        RowFormat row_format;
+        if (strcasecmp($10.c_str(), "DYNAMIC") == 0) {
+            row_format = ROW_FORMAT_DYNAMIC;
+        } else if (strcasecmp($10.c_str(), "PAX") == 0) {
+            row_format = ROW_FORMAT_PAX;
+        } else if (strcasecmp($10.c_str(), "FIXED") == 0) {
+            row_format = ROW_FORMAT_FIXED;
+        } else {
+            yyerror(&@$, "ROW_FORMAT must be DYNAMIC, PAX or FIXED");
+            YYABORT;
+        }
+        $$ = make_node<CreateTable>($4, $6, row_format, static_cast<TablePersistence>($2), $11, $12,
+                                    std::static_pointer_cast<PartitionBy>($13));
     }
     |   DROP TABLE tbName
     {
-        $$ = std::make_shared<DropTable>($3);
+        $$ = make_node<DropTable>($3);
+    }
+    |   CREATE MATERIALIZED VIEW tbName AS selectStmt
+    {
+        $$ = make_node<CreateMatView>($4, std::static_pointer_cast<SelectStmt>($6));
     }
     |   DESC tbName
     {
-        $$ = std::make_shared<DescTable>($2);
+        $$ = make_node<DescTable>($2);
     }
     |   CREATE INDEX tbName '(' colNameList ')'
     {
-        $$ = std::make_shared<CreateIndex>($3, $5);
+        $$ = make_node<CreateIndex>($3, $5);
+    }
+    |   CREATE INDEX tbName '(' colNameList ')' USING IDENTIFIER
+    {
+        // HASH: 只支持等值查找的哈希索引；ART: 只在内存中的自适应基数树索引；BTREE: 默认的B+树索引
+        bool hash = false;
+        bool art = false;
+        if (strcasecmp($8.c_str(), "HASH") == 0) {
+            hash = true;
+        } else if (strcasecmp($8.c_str(), "ART") == 0) {
+            art = true;
+        } else if (strcasecmp($8.c_str(), "BTREE") != 0) {
+            yyerror(&@$, "USING must be HASH, ART or BTREE");
+            YYABORT;
+        }
+        $$ = make_node<CreateIndex>($3, $5, hash, art);
     }
     |   DROP INDEX tbName '(' colNameList ')'
     {
-        $$ = std::make_shared<DropIndex>($3, $5);
+        $$ = make_node<DropIndex>($3, $5);
     }
     ;
 
 dml:
-        INSERT INTO tbName VALUES '(' valueList ')'
+        INSERT INTO tbName VALUES valueLists
     {
-        $$ = std::make_shared<InsertStmt>($3, $6);
+        $$ = make_node<InsertStmt>($3, $5);
     }
     |   DELETE FROM tbName optWhereClause
     {
-        $$ = std::make_shared<DeleteStmt>($3, $4);
+        $$ = make_node<DeleteStmt>($3, $4);
     }
     |   UPDATE tbName SET setClauses optWhereClause
     {
-        $$ = std::make_shared<UpdateStmt>($2, $4, $5);
+        $$ = make_node<UpdateStmt>($2, $4, $5);
     }
-    |   SELECT selector FROM tableList joinList optWhereClause opt_order_clause
+    |   selectStmt
     {
-        std::vector<std::string> tabs = $4;
-        std::vector<std::shared_ptr<JoinExpr>> joins = $5;
+        $$ = $1;
+    }
+    ;
+
+selectStmt:
+        SELECT opt_distinct selector FROM tableList joinList optWhereClause opt_group_clause opt_having_clause opt_order_clause opt_limit opt_offset
+    {
+        std::vector<std::string> tabs = $5;
+        std::vector<std::shared_ptr<JoinExpr>> joins = $6;
 
         if (!joins.empty()) {
             if (tabs.empty()) {
@@ -180,11 +351,20 @@ dml:
             }
         }
 
-        $$ = std::make_shared<SelectStmt>($2, tabs, $6, $7);
-        $$->jointree = joins;
+        auto select = make_node<SelectStmt>($3, tabs, $7, $10, $11, $12);
+        select->distinct = $2;
+        select->group_bys = $8;
+        select->havings = $9;
+        select->jointree = joins;
+        $$ = select;
     }
     ;
 
+opt_distinct:
+        /* epsilon */ { $$ = false; }
+    |   DISTINCT { $$ = true; }
+    ;
+
 fieldList:
         field
     {
@@ -210,22 +390,27 @@ colNameList:
 field:
         colName type
     {
-        $$ = std::make_shared<ColDef>($1, $2);
+        $$ = make_node<ColDef>($1, $2);
+    }
+    |   colName type DICTIONARY
+    {
+        // 字典编码：每条记录只存字符串在字典中的编码
+        $$ = make_node<ColDef>($1, $2, true);
     }
     ;
 
 type:
         INT
     {
-        $$ = std::make_shared<TypeLen>(SV_TYPE_INT, sizeof(int));
+        $$ = make_node<TypeLen>(SV_TYPE_INT, sizeof(int));
     }
     |   CHAR '(' VALUE_INT ')'
     {
-        $$ = std::make_shared<TypeLen>(SV_TYPE_STRING, $3);
+        $$ = make_node<TypeLen>(SV_TYPE_STRING, $3);
     }
     |   FLOAT
     {
-        $$ = std::make_shared<TypeLen>(SV_TYPE_FLOAT, sizeof(float));
+        $$ = make_node<TypeLen>(SV_TYPE_FLOAT, sizeof(float));
     }
     ;
 
@@ -240,29 +425,95 @@ valueList:
     }
     ;
 
+valueLists:
+        '(' valueList ')'
+    {
+        $$ = std::vector<std::vector<std::shared_ptr<Value>>>{$2};
+    }
+    |   valueLists ',' '(' valueList ')'
+    {
+        $$.push_back($4);
+    }
+    ;
+
 value:
         VALUE_INT
     {
-        $$ = std::make_shared<IntLit>($1);
+        $$ = make_node<IntLit>($1);
+        $$->param = num_params++;
     }
     |   VALUE_FLOAT
     {
-        $$ = std::make_shared<FloatLit>($1);
+        $$ = make_node<FloatLit>($1);
+        $$->param = num_params++;
+    }
+    |   '-' VALUE_INT
+    {
+        $$ = make_node<IntLit>(static_cast<int>(-static_cast<int64_t>($2)));
+        $$->param = num_params++;
+    }
+    |   '-' VALUE_FLOAT
+    {
+        $$ = make_node<FloatLit>(-$2);
+        $$->param = num_params++;
+    }
+    |   '+' VALUE_INT
+    {
+        $$ = make_node<IntLit>($2);
+        $$->param = num_params++;
+    }
+    |   '+' VALUE_FLOAT
+    {
+        $$ = make_node<FloatLit>($2);
+        $$->param = num_params++;
     }
     |   VALUE_STRING
     {
-        $$ = std::make_shared<StringLit>($1);
+        $$ = make_node<StringLit>($1);
+        $$->param = num_params++;
     }
     |   VALUE_BOOL
     {
-        $$ = std::make_shared<BoolLit>($1);
+        $$ = make_node<BoolLit>($1);
     }
     ;
 
 condition:
-        col op expr
+        expr op expr
+    {
+        auto lhs_col = std::dynamic_pointer_cast<Col>($1);
+        auto rhs_col = std::dynamic_pointer_cast<Col>($3);
+        bool rhs_arith = std::dynamic_pointer_cast<ArithExpr>($3) != nullptr;
+        if (lhs_col != nullptr && !rhs_arith) {
+            $$ = make_node<BinaryExpr>(lhs_col, $2, $3);
+        } else if (rhs_col != nullptr && std::dynamic_pointer_cast<Value>($1) != nullptr) {
+            // 常量在左边时交换两边，仍然是列和常量的比较
+            static const SvCompOp swapped[] = {SV_OP_EQ, SV_OP_NE, SV_OP_GT, SV_OP_LT, SV_OP_GE, SV_OP_LE};
+            $$ = make_node<BinaryExpr>(rhs_col, swapped[$2], $1);
+        } else {
+            $$ = make_node<BinaryExpr>(nullptr, $2, $3);
+            $$->lhs_expr = $1;
+        }
+    }
+    |   col IN '(' selectStmt ')'
+    {
+        auto sub = make_node<SubqueryExpr>(std::static_pointer_cast<SelectStmt>($4));
+        $$ = make_node<BinaryExpr>($1, SV_OP_IN, sub);
+    }
+    |   col NOT IN '(' selectStmt ')'
     {
-        $$ = std::make_shared<BinaryExpr>($1, $2, $3);
+        auto sub = make_node<SubqueryExpr>(std::static_pointer_cast<SelectStmt>($5));
+        $$ = make_node<BinaryExpr>($1, SV_OP_NOT_IN, sub);
+    }
+    |   EXISTS '(' selectStmt ')'
+    {
+        auto sub = make_node<SubqueryExpr>(std::static_pointer_cast<SelectStmt>($3));
+        $$ = make_node<BinaryExpr>(nullptr, SV_OP_EXISTS, sub);
+    }
+    |   NOT EXISTS '(' selectStmt ')'
+    {
+        auto sub = make_node<SubqueryExpr>(std::static_pointer_cast<SelectStmt>($4));
+        $$ = make_node<BinaryExpr>(nullptr, SV_OP_NOT_EXISTS, sub);
     }
     ;
 
@@ -272,38 +523,65 @@ optWhereClause:
     {
         $$ = $2;
     }
+    |   WHERE topOrList
+    {
+        $$ = std::vector<std::shared_ptr<BinaryExpr>>{$2};
+    }
     ;
 
+// AND连接的条件，OR要放在括号中：a = 1 AND (b = 2 OR c = 3)
 whereClause:
-        condition 
+        andTerm
     {
         $$ = std::vector<std::shared_ptr<BinaryExpr>>{$1};
     }
-    |   whereClause AND condition
+    |   whereClause AND andTerm
     {
         $$.push_back($3);
     }
     ;
 
-col:
-        tbName '.' colName
+andTerm:
+        condition
+    |   '(' orList ')'
     {
-        $$ = std::make_shared<Col>($1, $3);
+        $$ = $2->disjuncts.size() == 1 ? $2->disjuncts[0] : $2;
     }
-    |   colName
+    ;
+
+orList:
+        condition
+    {
+        $$ = make_node<BinaryExpr>(nullptr, SV_OP_OR, nullptr);
+        $$->disjuncts.push_back($1);
+    }
+    |   orList OR condition
     {
-        $$ = std::make_shared<Col>("", $1);
+        $$->disjuncts.push_back($3);
     }
     ;
 
-colList:
-        col
+// 整个WHERE只有OR连接的条件时可以不加括号；OR和AND混用时必须加括号，避免和AND的优先级混淆
+topOrList:
+        condition OR condition
     {
-        $$ = std::vector<std::shared_ptr<Col>>{$1};
+        $$ = make_node<BinaryExpr>(nullptr, SV_OP_OR, nullptr);
+        $$->disjuncts = {$1, $3};
     }
-    |   colList ',' col
+    |   topOrList OR condition
     {
-        $$.push_back($3);
+        $$->disjuncts.push_back($3);
+    }
+    ;
+
+col:
+        tbName '.' colName
+    {
+        $$ = make_node<Col>($1, $3);
+    }
+    |   colName
+    {
+        $$ = make_node<Col>("", $1);
     }
     ;
 
@@ -343,6 +621,26 @@ expr:
     {
         $$ = std::static_pointer_cast<Expr>($1);
     }
+    |   expr '+' expr
+    {
+        $$ = make_node<ArithExpr>($1, SV_ARITH_ADD, $3);
+    }
+    |   expr '-' expr
+    {
+        $$ = make_node<ArithExpr>($1, SV_ARITH_SUB, $3);
+    }
+    |   expr '*' expr
+    {
+        $$ = make_node<ArithExpr>($1, SV_ARITH_MUL, $3);
+    }
+    |   expr '/' expr
+    {
+        $$ = make_node<ArithExpr>($1, SV_ARITH_DIV, $3);
+    }
+    |   '(' expr ')'
+    {
+        $$ = $2;
+    }
     ;
 
 setClauses:
@@ -359,7 +657,15 @@ setClauses:
 setClause:
         colName '=' value
     {
-        $$ = std::make_shared<SetClause>($1, $3);
+        $$ = make_node<SetClause>($1, $3);
+    }
+    |   colName '=' colName '+' value
+    {
+        $$ = make_node<SetClause>($1, $5, $3, false);
+    }
+    |   colName '=' colName '-' value
+    {
+        $$ = make_node<SetClause>($1, $5, $3, true);
     }
     ;
 
@@ -368,7 +674,117 @@ selector:
     {
         $$ = {};
     }
-    |   colList
+    |   selList
+    ;
+
+selList:
+        selItem
+    {
+        $$ = std::vector<std::shared_ptr<Col>>{$1};
+    }
+    |   selList ',' selItem
+    {
+        $$.push_back($3);
+    }
+    ;
+
+// 选取列表中的一项：列，计算列，或者聚合函数，都可以用AS命名
+selItem:
+        expr opt_alias
+    {
+        $$ = std::dynamic_pointer_cast<Col>($1);
+        if ($$ == nullptr) {
+            $$ = make_node<Col>("", "");
+            $$->expr = $1;
+        }
+        $$->alias = $2;
+    }
+    |   aggCall opt_alias
+    {
+        $$ = $1;
+        $$->alias = $2;
+    }
+    ;
+
+aggCall:
+        COUNT '(' '*' ')'
+    {
+        $$ = make_node<Col>("", "");
+        $$->agg = SV_AGG_COUNT;
+    }
+    |   COUNT '(' col ')'
+    {
+        $$ = $3;
+        $$->agg = SV_AGG_COUNT;
+    }
+    |   SUM '(' col ')'
+    {
+        $$ = $3;
+        $$->agg = SV_AGG_SUM;
+    }
+    |   MIN '(' col ')'
+    {
+        $$ = $3;
+        $$->agg = SV_AGG_MIN;
+    }
+    |   MAX '(' col ')'
+    {
+        $$ = $3;
+        $$->agg = SV_AGG_MAX;
+    }
+    ;
+
+opt_alias:
+        AS IDENTIFIER
+    {
+        $$ = $2;
+    }
+    |   /* epsilon */ { $$ = ""; }
+    ;
+
+opt_group_clause:
+        GROUP BY groupList
+    {
+        $$ = $3;
+    }
+    |   /* epsilon */ { $$ = {}; }
+    ;
+
+groupList:
+        col
+    {
+        $$ = std::vector<std::shared_ptr<Col>>{$1};
+    }
+    |   groupList ',' col
+    {
+        $$.push_back($3);
+    }
+    ;
+
+opt_having_clause:
+        HAVING havingList
+    {
+        $$ = $2;
+    }
+    |   /* epsilon */ { $$ = {}; }
+    ;
+
+havingList:
+        havingCond
+    {
+        $$ = std::vector<std::shared_ptr<BinaryExpr>>{$1};
+    }
+    |   havingList AND havingCond
+    {
+        $$.push_back($3);
+    }
+    ;
+
+havingCond:
+        aggCall op value
+    {
+        $$ = make_node<BinaryExpr>($1, $2, $3);
+    }
     ;
 
 tableList:
@@ -386,17 +802,17 @@ joinList:
     /* empty */ { $$ = {}; }
     |   joinList INNER JOIN tbName ON whereClause
     {
-        auto join = std::make_shared<JoinExpr>("", $4, $6, INNER_JOIN);
+        auto join = make_node<JoinExpr>("", $4, $6, INNER_JOIN);
         $$.push_back(join);
     }
     |   joinList LEFT JOIN tbName ON whereClause
     {
-        auto join = std::make_shared<JoinExpr>("", $4, $6, LEFT_JOIN);
+        auto join = make_node<JoinExpr>("", $4, $6, LEFT_JOIN);
         $$.push_back(join);
     }
     |   joinList RIGHT JOIN tbName ON whereClause
     {
-        auto join = std::make_shared<JoinExpr>("", $4, $6, RIGHT_JOIN);
+        auto join = make_node<JoinExpr>("", $4, $6, RIGHT_JOIN);
         $$.push_back(join);
     }
     ;
@@ -409,10 +825,77 @@ opt_order_clause:
     |   /* epsilon */ { /* ignore*/ }
     ;
 
+opt_limit:
+    LIMIT VALUE_INT
+    {
+        $$ = $2;
+    }
+    |   /* epsilon */ { $$ = -1; }
+    ;
+
+opt_offset:
+    OFFSET VALUE_INT
+    {
+        $$ = $2;
+    }
+    |   /* epsilon */ { $$ = 0; }
+    ;
+
+opt_persistence:
+    TEMPORARY { $$ = TABLE_TEMPORARY; }
+    |   UNLOGGED { $$ = TABLE_UNLOGGED; }
+    |   /* epsilon */ { $$ = TABLE_PERMANENT; }
+    ;
+
+opt_storage:
+    STORAGE '=' IDENTIFIER
+    {
+        // MEMORY: 数据页常驻缓冲池；DISK: 默认，数据页和其他表一样换入换出
+        if (strcasecmp($3.c_str(), "MEMORY") == 0) {
+            $$ = true;
+        } else if (strcasecmp($3.c_str(), "DISK") == 0) {
+            $$ = false;
+        } else {
+            yyerror(&@$, "STORAGE must be MEMORY or DISK");
+            YYABORT;
+        }
+    }
+    |   /* epsilon */ { $$ = false; }
+    ;
+
+opt_compression:
+    COMPRESSION '=' IDENTIFIER
+    {
+        // LZ4: 数据页和索引页压缩后写入磁盘；NONE: 默认，不压缩
+        if (strcasecmp($3.c_str(), "LZ4") == 0) {
+            $$ = true;
+        } else if (strcasecmp($3.c_str(), "NONE") == 0) {
+            $$ = false;
+        } else {
+            yyerror(&@$, "COMPRESSION must be LZ4 or NONE");
+            YYABORT;
+        }
+    }
+    |   /* epsilon */ { $$ = false; }
+    ;
+
+opt_partition:
+    PARTITION BY IDENTIFIER '(' colName ')' PARTITIONS VALUE_INT
+    {
+        // 只支持HASH：按分区字段的哈希值把记录分到各个分区
+        if (strcasecmp($3.c_str(), "HASH") != 0) {
+            yyerror(&@$, "PARTITION BY must be HASH");
+            YYABORT;
+        }
+        $$ = make_node<PartitionBy>($5, $8);
+    }
+    |   /* epsilon */ { $$ = nullptr; }
+    ;
+
 order_clause:
       col  opt_asc_desc 
     { 
-        $$ = std::make_shared<OrderBy>($1, $2);
+        $$ = make_node<OrderBy>($1, $2);
     }
     ;   
 
@@ -425,6 +908,9 @@ opt_asc_desc:
 set_knob_type:
     ENABLE_NESTLOOP { $$ = EnableNestLoop; }
     |   ENABLE_SORTMERGE { $$ = EnableSortMerge; }
+    |   ENABLE_HASHJOIN { $$ = EnableHashJoin; }
+    |   SYNCHRONOUS_COMMIT { $$ = SynchronousCommit; }
+    |   RESULT_CACHE { $$ = EnableResultCache; }
     ;
 
 tbName: IDENTIFIER;
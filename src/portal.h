@@ -14,13 +14,23 @@ See the Mulan PSL v2 for more details. */
 #include <string>
 
 #include "common/common.h"
+#include "common/trace.h"
 #include "execution/executor_abstract.h"
 #include "execution/executor_aggregate.h"
+#include "execution/executor_bitmap_scan.h"
 #include "execution/executor_delete.h"
+#include "execution/executor_distinct.h"
+#include "execution/executor_empty.h"
+#include "execution/executor_explain.h"
+#include "execution/executor_hash_join.h"
+#include "execution/executor_index_nestedloop_join.h"
 #include "execution/executor_index_scan.h"
 #include "execution/executor_insert.h"
+#include "execution/executor_limit.h"
 #include "execution/executor_nestedloop_join.h"
+#include "execution/executor_partition_scan.h"
 #include "execution/executor_projection.h"
+#include "execution/executor_semi_join.h"
 #include "execution/executor_seq_scan.h"
 #include "execution/executor_sort.h"
 #include "execution/executor_sortmerge_join.h"
@@ -32,7 +42,8 @@ typedef enum portalTag {
   PORTAL_ONE_SELECT,
   PORTAL_DML_WITHOUT_SELECT,
   PORTAL_MULTI_QUERY,
-  PORTAL_CMD_UTILITY
+  PORTAL_CMD_UTILITY,
+  PORTAL_EXPLAIN
 } portalTag;
 
 struct PortalStmt {
@@ -41,6 +52,8 @@ struct PortalStmt {
   std::vector<TabCol> sel_cols;
   std::unique_ptr<AbstractExecutor> root;
   std::shared_ptr<Plan> plan;
+  // EXPLAIN ANALYZE：root是被统计的算子树，explain是其中根算子的统计
+  std::shared_ptr<ExplainNode> explain;
 
   PortalStmt(portalTag tag_, std::vector<TabCol> sel_cols_,
              std::unique_ptr<AbstractExecutor> root_,
@@ -54,15 +67,38 @@ struct PortalStmt {
 class Portal {
  private:
   SmManager* sm_manager_;
+  // EXPLAIN ANALYZE或者慢查询日志生成算子树时为true，每个算子都包上ExplainAnalyzeExecutor。
+  // explain_nodes_中是已经生成、还没有挂到上层算子下的统计节点。
+  // 所有工作线程共用一个Portal，生成算子树的状态每个线程一份
+  inline static thread_local bool explain_ = false;
+  inline static thread_local std::vector<std::shared_ptr<ExplainNode>>
+      explain_nodes_;
 
  public:
   explicit Portal(SmManager* sm_manager) : sm_manager_(sm_manager) {}
 
   ~Portal() = default;
 
-  // 将查询执行计划转换成对应的算子树
+  // 将查询执行计划转换成对应的算子树。profile为true时DML的每个算子都包上统计，
+  // 根算子的统计放在PortalStmt::explain中，供慢查询日志输出
   std::shared_ptr<PortalStmt> start(std::shared_ptr<Plan> plan,
-                                    Context* context) {
+                                    Context* context, bool profile = false) {
+    if (auto x = std::dynamic_pointer_cast<ExplainPlan>(plan)) {
+      if (!x->analyze_) {
+        return std::make_shared<PortalStmt>(
+            PORTAL_EXPLAIN, std::vector<TabCol>(),
+            std::unique_ptr<AbstractExecutor>(), plan);
+      }
+      auto stmt = start_instrumented(x->subplan_, context);
+      auto res = std::make_shared<PortalStmt>(
+          PORTAL_EXPLAIN, std::vector<TabCol>(), std::move(stmt->root), plan);
+      res->explain = std::move(stmt->explain);
+      return res;
+    }
+    if (profile && !explain_ &&
+        std::dynamic_pointer_cast<DMLPlan>(plan) != nullptr) {
+      return start_instrumented(plan, context);
+    }
     if (auto x = std::dynamic_pointer_cast<StaticCheckpointPlan>(plan)) {
       return std::make_shared<PortalStmt>(
           PORTAL_CMD_UTILITY, std::vector<TabCol>(),
@@ -74,6 +110,21 @@ class Portal {
           PORTAL_CMD_UTILITY, std::vector<TabCol>(),
           std::unique_ptr<AbstractExecutor>(), plan);
     }
+    if (auto x = std::dynamic_pointer_cast<CopyPlan>(plan)) {
+      return std::make_shared<PortalStmt>(
+          PORTAL_CMD_UTILITY, std::vector<TabCol>(),
+          std::unique_ptr<AbstractExecutor>(), plan);
+    }
+    if (auto x = std::dynamic_pointer_cast<BackupPlan>(plan)) {
+      return std::make_shared<PortalStmt>(
+          PORTAL_CMD_UTILITY, std::vector<TabCol>(),
+          std::unique_ptr<AbstractExecutor>(), plan);
+    }
+    if (auto x = std::dynamic_pointer_cast<KillPlan>(plan)) {
+      return std::make_shared<PortalStmt>(
+          PORTAL_CMD_UTILITY, std::vector<TabCol>(),
+          std::unique_ptr<AbstractExecutor>(), plan);
+    }
     if (auto x = std::dynamic_pointer_cast<SetKnobPlan>(plan)) {
       return std::make_shared<PortalStmt>(
           PORTAL_CMD_UTILITY, std::vector<TabCol>(),
@@ -85,12 +136,21 @@ class Portal {
           std::unique_ptr<AbstractExecutor>(), plan);
     }
     if (auto x = std::dynamic_pointer_cast<DMLPlan>(plan)) {
+      size_t explain_mark = explain_nodes_.size();
+      std::string explain_detail = " on " + x->tab_name_;
       switch (x->tag) {
         case T_select: {
+          // 有LIMIT/OFFSET时投影在Limit之下，有DISTINCT时在去重之下
+          auto limit = std::dynamic_pointer_cast<LimitPlan>(x->subplan_);
+          std::shared_ptr<Plan> below =
+              limit != nullptr ? limit->subplan_ : x->subplan_;
+          if (auto distinct = std::dynamic_pointer_cast<DistinctPlan>(below)) {
+            below = distinct->subplan_;
+          }
           std::shared_ptr<ProjectionPlan> p =
-              std::dynamic_pointer_cast<ProjectionPlan>(x->subplan_);
+              std::dynamic_pointer_cast<ProjectionPlan>(below);
           std::unique_ptr<AbstractExecutor> root =
-              convert_plan_executor(p, context);
+              convert_plan_executor(x->subplan_, context);
           std::vector<TabCol> show_cols = p->sel_cols_;
           for (std::size_t i = 0; i < p->alias_.size(); ++i) {
             if (!p->alias_[i].empty()) {
@@ -103,56 +163,44 @@ class Portal {
         }
         case T_Update: {
           std::unique_ptr<AbstractExecutor> scan =
-              convert_plan_executor(x->subplan_, context, true);
+              convert_plan_executor(x->subplan_, context);
           std::vector<Rid> rids;
           for (scan->beginTuple(); !scan->is_end(); scan->nextTuple()) {
+            check_cancel();
             rids.emplace_back(scan->rid());
           }
-          // TODO update 算子优化，如果更新值不涉及索引键，则不需要维护索引
-          bool is_set_index_key = true;
-          if (scan->getType() == "IndexScanExecutor") {
-            auto* index_scan = dynamic_cast<IndexScanExecutor*>(scan.get());
-            auto& map = index_scan->get_index_meta().cols_map;
-            // 查找 set 值是否是 key
-            int i = 0;
-            for (; i < x->set_clauses_.size(); ++i) {
-              if (map.count(x->set_clauses_[i].lhs.col_name) > 0) {
-                break;
-              }
-            }
-            if (i == x->set_clauses_.size()) {
-              is_set_index_key = false;
-            }
-          }
           std::unique_ptr<AbstractExecutor> root =
-              std::make_unique<UpdateExecutor>(
-                  sm_manager_, std::move(x->tab_name_),
-                  std::move(x->set_clauses_), std::move(rids), is_set_index_key,
-                  scan->getType() == "IndexScanExecutor", context);
+              new_executor<UpdateExecutor>(
+                  context, sm_manager_, std::move(x->tab_name_),
+                  std::move(x->set_clauses_), std::move(rids), context);
+          root = instrument(std::move(root), explain_mark, explain_detail);
           return std::make_shared<PortalStmt>(PORTAL_DML_WITHOUT_SELECT,
                                               std::vector<TabCol>(),
                                               std::move(root), plan);
         }
         case T_Delete: {
           std::unique_ptr<AbstractExecutor> scan =
-              convert_plan_executor(x->subplan_, context, true);
+              convert_plan_executor(x->subplan_, context);
           std::vector<Rid> rids;
           for (scan->beginTuple(); !scan->is_end(); scan->nextTuple()) {
+            check_cancel();
             rids.emplace_back(scan->rid());
           }
           std::unique_ptr<AbstractExecutor> root =
-              std::make_unique<DeleteExecutor>(
-                  sm_manager_, std::move(x->tab_name_), std::move(rids),
+              new_executor<DeleteExecutor>(
+                  context, sm_manager_, std::move(x->tab_name_), std::move(rids),
                   context, scan->getType() == "IndexScanExecutor");
+          root = instrument(std::move(root), explain_mark, explain_detail);
           return std::make_shared<PortalStmt>(PORTAL_DML_WITHOUT_SELECT,
                                               std::vector<TabCol>(),
                                               std::move(root), plan);
         }
         case T_Insert: {
           std::unique_ptr<AbstractExecutor> root =
-              std::make_unique<InsertExecutor>(sm_manager_,
-                                               std::move(x->tab_name_),
-                                               std::move(x->values_), context);
+              new_executor<InsertExecutor>(context, sm_manager_,
+                                           std::move(x->tab_name_),
+                                           std::move(x->values_), context);
+          root = instrument(std::move(root), explain_mark, explain_detail);
           return std::make_shared<PortalStmt>(PORTAL_DML_WITHOUT_SELECT,
                                               std::vector<TabCol>(),
                                               std::move(root), std::move(plan));
@@ -167,6 +215,7 @@ class Portal {
   // 遍历算子树并执行算子生成执行结果
   static void run(std::shared_ptr<PortalStmt>& portal, QlManager* ql,
                   txn_id_t* txn_id, Context* context) {
+    RMDB_PROBE(executor__open, static_cast<int>(portal->tag), portal->root.get());
     switch (portal->tag) {
       case PORTAL_ONE_SELECT: {
         ql->select_from(portal->root, portal->sel_cols, context);
@@ -184,62 +233,197 @@ class Portal {
         ql->run_cmd_utility(portal->plan, txn_id, context);
         break;
       }
+      case PORTAL_EXPLAIN: {
+        ql->explain(portal->plan, portal->root, portal->explain, context);
+        break;
+      }
       default: {
         throw InternalError("Unexpected field type");
       }
     }
+    RMDB_PROBE(executor__close, static_cast<int>(portal->tag), portal->root.get());
   }
 
   // 清空资源
   static void drop() {}
 
   std::unique_ptr<AbstractExecutor> convert_plan_executor(
-      const std::shared_ptr<Plan>& plan, Context* context,
-      bool gap_mode = false) {
+      const std::shared_ptr<Plan>& plan, Context* context) {
+    if (!explain_) {
+      return make_executor(plan, context);
+    }
+    // 儿子在make_executor中先生成，它们的统计节点排在explain_mark之后
+    size_t explain_mark = explain_nodes_.size();
+    std::string detail = explain_detail(plan);
+    return instrument(make_executor(plan, context), explain_mark, detail);
+  }
+
+ private:
+  // 生成包上统计的算子树
+  std::shared_ptr<PortalStmt> start_instrumented(
+      const std::shared_ptr<Plan>& plan, Context* context) {
+    explain_ = true;
+    explain_nodes_.clear();
+    std::shared_ptr<PortalStmt> stmt;
+    try {
+      stmt = start(plan, context);
+    } catch (...) {
+      explain_ = false;
+      throw;
+    }
+    explain_ = false;
+    stmt->explain = explain_nodes_.empty() ? nullptr : explain_nodes_.back();
+    explain_nodes_.clear();
+    return stmt;
+  }
+
+  // EXPLAIN ANALYZE时把executor包上统计，explain_mark之后的统计节点是它的儿子
+  std::unique_ptr<AbstractExecutor> instrument(
+      std::unique_ptr<AbstractExecutor> executor, size_t explain_mark,
+      const std::string& detail) {
+    if (!explain_) {
+      return executor;
+    }
+    auto node = std::make_shared<ExplainNode>();
+    node->label = executor->getType() + detail;
+    node->children.assign(explain_nodes_.begin() + explain_mark,
+                          explain_nodes_.end());
+    explain_nodes_.resize(explain_mark);
+    explain_nodes_.push_back(node);
+    return std::make_unique<ExplainAnalyzeExecutor>(std::move(executor),
+                                                    std::move(node));
+  }
+
+  static AbstractExecutor* unwrap(AbstractExecutor* executor) {
+    auto* explain = dynamic_cast<ExplainAnalyzeExecutor*>(executor);
+    return explain != nullptr ? explain->inner() : executor;
+  }
+
+  // 统计行中算子类型后面的说明：扫描的表和索引，索引嵌套循环连接探测的表
+  static std::string explain_detail(const std::shared_ptr<Plan>& plan) {
+    if (auto x = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+      std::string detail = " on " + x->tab_name_;
+      if (x->tag == T_IndexScan) {
+        detail += " using (";
+        for (size_t i = 0; i < x->index_col_names_.size(); ++i) {
+          detail += (i > 0 ? ", " : "") + x->index_col_names_[i];
+        }
+        detail += ")";
+      } else if (x->tag == T_BitmapScan) {
+        // 每一路用到的索引，用OR或AND连接
+        detail += " using ";
+        for (size_t i = 0; i < x->bitmap_arms_.size(); ++i) {
+          auto& names = x->bitmap_arms_[i].index_col_names;
+          detail += i > 0 ? (x->bitmap_and_ ? " AND (" : " OR (") : "(";
+          for (size_t j = 0; j < names.size(); ++j) {
+            detail += (j > 0 ? ", " : "") + names[j];
+          }
+          detail += ")";
+        }
+      }
+      return detail;
+    }
+    if (auto x = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+      if (x->tag == T_IndexNestLoop) {
+        return " probing " +
+               std::dynamic_pointer_cast<ScanPlan>(x->right_)->tab_name_;
+      }
+    }
+    return "";
+  }
+
+  // 算子放在语句的Arena中，语句结束时和Arena一起释放；没有context时放在堆上
+  template <typename T, typename... Args>
+  static std::unique_ptr<AbstractExecutor> new_executor(Context* context,
+                                                        Args&&... args) {
+    Arena* arena = context != nullptr ? &context->arena_ : nullptr;
+    return std::unique_ptr<AbstractExecutor>(
+        new (arena) T(std::forward<Args>(args)...));
+  }
+
+  std::unique_ptr<AbstractExecutor> make_executor(
+      const std::shared_ptr<Plan>& plan, Context* context) {
+    if (auto x = std::dynamic_pointer_cast<LimitPlan>(plan)) {
+      return new_executor<LimitExecutor>(
+          context, convert_plan_executor(x->subplan_, context), x->limit_, x->offset_);
+    }
+    if (auto x = std::dynamic_pointer_cast<DistinctPlan>(plan)) {
+      return new_executor<DistinctExecutor>(
+          context, convert_plan_executor(x->subplan_, context), x->sorted_, context);
+    }
     if (auto x = std::dynamic_pointer_cast<ProjectionPlan>(plan)) {
-      return std::make_unique<ProjectionExecutor>(
-          convert_plan_executor(x->subplan_, context), std::move(x->sel_cols_),
-          x->limit_);
+      return new_executor<ProjectionExecutor>(
+          context, convert_plan_executor(x->subplan_, context), std::move(x->sel_cols_),
+          x->exprs_);
     }
     if (auto x = std::dynamic_pointer_cast<ScanPlan>(plan)) {
-      // TODO 为每个子查询生成算子
-      // for (auto &cond: x->conds_) {
-      //     if (cond.is_sub_query && cond.sub_query_plan != nullptr) {
-      //         assert(0);
-      //         cond.prev = convert_plan_executor(cond.sub_query_plan,
-      //         context);
-      //         // 在算子执行之前就处理异常情况，否则会错误输出表头
-      //         // 子查询为空抛错处理
-      //         cond.prev->beginTuple();
-      //         if (cond.prev->is_end()) {
-      //             throw InternalError("Empty sub query!");
-      //         }
-      //         // 比较运算符的子查询，只能有一个元素
-      //         if (cond.op != OP_IN) {
-      //             cond.prev->nextTuple();
-      //             if (!cond.prev->is_end()) {
-      //                 throw InternalError("Subquery returns more than 1
-      //                 row!");
-      //             }
-      //         }
-      //     }
-      // }
+      if (x->always_false_) {
+        // 和SeqScan、IndexScan一样，投影时输出窄记录的字段
+        return new_executor<EmptyExecutor>(
+            context, x->out_cols_.empty() ? x->cols_ : x->out_cols_, context);
+      }
+      if (x->tag == T_SeqScan &&
+          sm_manager_->db_.get_table(x->tab_name_).partition.is_partitioned()) {
+        // 分区表上不能建索引，总是顺序扫描，由它依次扫描未被剪掉的分区
+        return new_executor<PartitionScanExecutor>(
+            context, sm_manager_, std::move(x->tab_name_), std::move(x->conds_),
+            context, std::move(x->expr_conds_), std::move(x->or_conds_),
+            x->out_cols_);
+      }
       if (x->tag == T_SeqScan) {
-        return std::make_unique<SeqScanExecutor>(
-            sm_manager_, std::move(x->tab_name_), std::move(x->conds_), context,
-            gap_mode);
+        return new_executor<SeqScanExecutor>(
+            context, sm_manager_, std::move(x->tab_name_), std::move(x->conds_),
+            context, std::move(x->expr_conds_), std::move(x->or_conds_),
+            x->out_cols_);
+      }
+      if (x->tag == T_BitmapScan) {
+        // 每一路只取rid：B+树索引从叶子中取，哈希索引和ART索引本来就要回表
+        TabMeta& tab = sm_manager_->db_.get_table(x->tab_name_);
+        std::vector<std::unique_ptr<AbstractExecutor>> arms;
+        for (auto& arm : x->bitmap_arms_) {
+          bool covering =
+              tab.get_index_meta(arm.index_col_names).type == INDEX_BTREE;
+          arms.push_back(new_executor<IndexScanExecutor>(
+              context, sm_manager_, x->tab_name_, std::move(arm.conds),
+              std::move(arm.index_col_names), context, covering));
+        }
+        return new_executor<BitmapScanExecutor>(
+            context, sm_manager_, std::move(x->tab_name_), std::move(x->conds_),
+            std::move(x->or_conds_), std::move(x->expr_conds_), std::move(arms),
+            x->bitmap_and_, context);
       }
-      return std::make_unique<IndexScanExecutor>(
-          sm_manager_, std::move(x->tab_name_), std::move(x->conds_),
-          std::move(x->index_col_names_), context, gap_mode, x->asc_);
+      return new_executor<IndexScanExecutor>(
+          context, sm_manager_, std::move(x->tab_name_), std::move(x->conds_),
+          std::move(x->index_col_names_), context, x->covering_,
+          std::move(x->expr_conds_), x->rid_sorted_, x->desc_, x->skip_scan_,
+          std::move(x->or_conds_), x->out_cols_);
     }
     if (auto x = std::dynamic_pointer_cast<AggregatePlan>(plan)) {
-      return std::make_unique<AggregateExecutor>(
-          convert_plan_executor(x->subplan_, context), std::move(x->sel_cols_),
+      return new_executor<AggregateExecutor>(
+          context, convert_plan_executor(x->subplan_, context), std::move(x->sel_cols_),
           std::move(x->agg_types_), std::move(x->group_bys_),
-          std::move(x->havings_), context);
+          std::move(x->havings_), x->sorted_, context);
     }
     if (auto x = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+      if (x->tag == T_IndexNestLoop && context != nullptr &&
+          context->txn_->is_snapshot()) {
+        // 快照读的索引扫描每次都要合并版本存储，不适合被反复探测：改为扫描一次内表，用外表建哈希表
+        auto inner = std::dynamic_pointer_cast<ScanPlan>(x->right_);
+        return new_executor<HashJoinExecutor>(
+            context, convert_plan_executor(x->left_, context),
+            new_executor<SeqScanExecutor>(context, sm_manager_,
+                                          inner->tab_name_,
+                                          std::move(inner->conds_), context),
+            std::move(x->conds_), true, context);
+      }
+      if (x->tag == T_IndexNestLoop) {
+        // 内表不生成扫描算子，由连接算子直接探测内表的索引
+        auto inner = std::dynamic_pointer_cast<ScanPlan>(x->right_);
+        return new_executor<IndexNestedLoopJoinExecutor>(
+            context, sm_manager_, convert_plan_executor(x->left_, context),
+            inner->tab_name_, std::move(inner->conds_), std::move(x->conds_),
+            std::move(x->index_col_names_), context);
+      }
       std::unique_ptr<AbstractExecutor> left =
           convert_plan_executor(x->left_, context);
       std::unique_ptr<AbstractExecutor> right =
@@ -258,16 +442,26 @@ class Portal {
       // std::unique_ptr<AbstractExecutor> right = right_future.get();
 
       if (x->tag == T_NestLoop) {
-        return std::make_unique<NestedLoopJoinExecutor>(
-            std::move(left), std::move(right), std::move(x->conds_));
+        return new_executor<NestedLoopJoinExecutor>(
+            context, std::move(left), std::move(right), std::move(x->conds_));
+      }
+      if (x->tag == T_SemiJoin || x->tag == T_AntiJoin) {
+        return new_executor<HashSemiJoinExecutor>(
+            context, std::move(left), std::move(right), x->conds_,
+            x->tag == T_AntiJoin, context);
+      }
+      if (x->tag == T_HashJoin) {
+        return new_executor<HashJoinExecutor>(
+            context, std::move(left), std::move(right), std::move(x->conds_),
+            x->build_left_, context);
       }
-      return std::make_unique<SortMergeJoinExecutor>(
-          std::move(left), std::move(right), std::move(x->conds_));
+      return new_executor<SortMergeJoinExecutor>(
+          context, std::move(left), std::move(right), std::move(x->conds_));
     }
     if (auto x = std::dynamic_pointer_cast<SortPlan>(plan)) {
-      return std::make_unique<SortExecutor>(
-          convert_plan_executor(x->subplan_, context), std::move(x->sel_col_),
-          x->is_desc_);
+      return new_executor<SortExecutor>(
+          context, convert_plan_executor(x->subplan_, context), std::move(x->sel_col_),
+          x->is_desc_, x->limit_, context);
     }
     return nullptr;
   }
@@ -10,6 +10,7 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstring>
 
@@ -51,6 +52,37 @@ public:
     // 找第一个为0 or 1的位
     static int first_bit(bool bit, const char *bm, int max_n) { return next_bit(bit, bm, max_n, -1); }
 
+    /**
+     * @brief 找出[0, max_n)中所有为1的位。每次按大端读取8个字节，使第0位落在最高位，再用clz依次取出最高的1，
+     * 全0的字直接跳过
+     * @param bm 要找的起始地址为bm
+     * @param max_n 位的个数
+     * @param out 输出，升序写入所有为1的位，至少能容纳max_n个
+     * @return 为1的位的个数
+     */
+    static int collect_set_bits(const char *bm, int max_n, int *out) {
+        int num = 0;
+        int num_bytes = (max_n + BITMAP_WIDTH - 1) / BITMAP_WIDTH;
+        for (int i = 0; i < num_bytes; i += 8) {
+            // 末尾不足8个字节时只读剩下的，不越过bitmap
+            uint64_t word = 0;
+            memcpy(&word, bm + i, std::min(8, num_bytes - i));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            int base = i * BITMAP_WIDTH;
+            while (word != 0) {
+                int lz = __builtin_clzll(word);
+                if (base + lz >= max_n) {
+                    break;
+                }
+                out[num++] = base + lz;
+                word &= ~(1ULL << (63 - lz));
+            }
+        }
+        return num;
+    }
+
     // for example:
     // rid_.slot_no = Bitmap::next_bit(true, page_handle.bitmap, file_handle_->file_hdr_.num_records_per_page,
     // rid_.slot_no); int slot_no = Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page);
@@ -17,14 +17,51 @@ constexpr int RM_NO_PAGE = -1;
 constexpr int RM_FILE_HDR_PAGE = 0;
 constexpr int RM_FIRST_RECORD_PAGE = 1;
 constexpr int RM_MAX_RECORD_SIZE = 512;
+constexpr int RM_MAX_VAR_COLS = 32;
+constexpr int RM_MAX_PAX_COLS = 64;
+constexpr int RM_MAX_DICT_COLS = 16;
+constexpr int RM_DICT_CODE_SIZE = 2; // 字典编码的字段在记录中占用的字节数
+constexpr int RM_MAX_DICT_CODES = 1 << (RM_DICT_CODE_SIZE * 8);
+static const std::string RM_DICT_FILE_SUFFIX = ".dict"; // 字典文件名为表数据文件名加上这个后缀
+
+/* 表数据文件的页面格式 */
+enum RmFormat {
+    RM_FORMAT_FIXED = 0, // 定长格式：每条记录占用一个record_size大小的槽位
+    RM_FORMAT_SLOTTED = 1, // 变长格式：页面带槽位目录，字符串字段按实际长度存储
+    RM_FORMAT_PAX = 2 // 列存格式（PAX）：页面内按列分成多个mini page，同一列的值连续存放
+};
+
+/* 读取记录的调用者已经持有的锁粒度。已经持有表锁时记录层不再加行级锁，省去每条记录一次的锁管理器调用 */
+enum RmLockGranularity {
+    RM_LOCK_ROW = 0, // 调用者没有覆盖该记录的锁，由记录层加行级 S 锁
+    RM_LOCK_TABLE = 1 // 调用者已经持有表级 S 锁或 X 锁，或者该记录的行级 X 锁
+};
+
+/* 变长格式中按实际长度存储的字段 */
+struct RmVarCol {
+    int offset; // 字段在记录中的偏移
+    int len; // 字段声明的长度
+};
 
 /* 文件头，记录表数据文件的元信息，写入磁盘中文件的第0号页面 */
 struct RmFileHdr {
-    int record_size; // 表中每条记录的大小，由于不包含变长字段，因此当前字段初始化后保持不变
+    int record_size; // 表中每条记录的大小，变长格式中是记录解码后的大小，初始化后保持不变
     int num_pages; // 文件中分配的页面个数（初始化为1）
     int num_records_per_page; // 每个页面最多能存储的元组个数
     int first_free_page_no; // 文件中当前第一个包含空闲空间的页面号（初始化为-1）
     int bitmap_size; // 每个页面bitmap大小
+    int table_id; // 表ID，创建表时分配且不会复用，日志中用它代替表名标识记录所在的表
+    // 以下字段是后加的，旧的数据文件中为0，即定长格式
+    int format; // 页面格式，见RmFormat
+    int max_tuple_size; // 变长格式中一条记录编码后的最大长度
+    int num_var_cols; // 变长格式中按实际长度存储的字段个数
+    RmVarCol var_cols[RM_MAX_VAR_COLS]; // 按offset递增排列
+    int num_pax_cols; // 列存格式中每页的mini page个数
+    RmVarCol pax_cols[RM_MAX_PAX_COLS]; // 每个mini page存放的字段，按offset递增排列且首尾相接覆盖整条记录
+    int slot_size; // 定长格式中每个槽位的大小，字典编码的字段只存编码；旧的数据文件中为0，即record_size
+    int num_dict_cols; // 定长格式中字典编码的字段个数
+    RmVarCol dict_cols[RM_MAX_DICT_COLS]; // 字典编码的字段，按offset递增排列
+    int in_memory; // STORAGE = MEMORY的表，数据页读入缓冲池后常驻，不会被换出
 };
 
 /* 表数据文件中每个页面的页头，记录每个页面的元信息 */
@@ -33,6 +70,21 @@ struct RmPageHdr {
     int num_records; // 当前页面中当前已经存储的记录个数（初始化为0）
 };
 
+constexpr int RM_PAGE_HDR_SIZE = Page::OFFSET_PAGE_HDR + sizeof(RmPageHdr);
+
+/* 变长格式的页面紧跟在RmPageHdr之后的页头。
+ * 页面依次存放页头、槽位目录、bitmap，记录从页尾向前存放，中间是空闲空间 */
+struct RmSlottedPageHdr {
+    int free_end; // 空闲空间的末尾，即最靠前的一条记录的偏移（初始化为PAGE_SIZE）
+    int used_bytes; // 记录占用的字节数，删除和变短留下的空洞不计入，空闲空间不连续时整理页面回收
+};
+
+/* 变长格式的槽位目录项，offset相对于页面起始地址，空槽位的len为0 */
+struct RmSlot {
+    uint16_t offset;
+    uint16_t len;
+};
+
 /* 表中的记录 */
 struct RmRecord {
     char *data; // 记录的数据
@@ -49,6 +101,12 @@ struct RmRecord {
     };
 
     RmRecord &operator=(const RmRecord &other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (allocated_) {
+            delete[] data;
+        }
         size = other.size;
         data = new char[size];
         memcpy(data, other.data, size);
@@ -56,6 +114,26 @@ struct RmRecord {
         return *this;
     };
 
+    // 移动只转移数据的所有权，不分配也不拷贝
+    RmRecord(RmRecord &&other) noexcept : data(other.data), size(other.size), allocated_(other.allocated_) {
+        other.data = nullptr;
+        other.allocated_ = false;
+    }
+
+    RmRecord &operator=(RmRecord &&other) noexcept {
+        if (this != &other) {
+            if (allocated_) {
+                delete[] data;
+            }
+            data = other.data;
+            size = other.size;
+            allocated_ = other.allocated_;
+            other.data = nullptr;
+            other.allocated_ = false;
+        }
+        return *this;
+    }
+
     RmRecord(int size_) {
         size = size_;
         data = new char[size_];
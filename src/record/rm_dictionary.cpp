@@ -0,0 +1,180 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "rm_dictionary.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "errors.h"
+
+RmDictionary::~RmDictionary() {
+    for (int i = 0; i < num_cols_; ++i) {
+        for (auto &chunk : cols_[i].chunks) {
+            delete[] chunk.load();
+        }
+    }
+    if (fd_ != -1) {
+        ::close(fd_);
+    }
+}
+
+/**
+ * @description: 打开字典文件，按追加的顺序重放其中的值。文件由一条条[字段下标(int)][字段长度的值]组成
+ * @param {string&} path 字典文件的路径
+ * @param {RmFileHdr&} file_hdr 数据文件的文件头，提供字典编码的字段
+ */
+void RmDictionary::open(const std::string &path, const RmFileHdr &file_hdr) {
+    path_ = path;
+    record_size_ = file_hdr.record_size;
+    num_cols_ = file_hdr.num_dict_cols;
+    int code_offset = 0;
+    int prev_end = 0;
+    for (int i = 0; i < num_cols_; ++i) {
+        Column &column = cols_[i];
+        column.offset = file_hdr.dict_cols[i].offset;
+        column.len = file_hdr.dict_cols[i].len;
+        code_offset += column.offset - prev_end;
+        column.code_offset = code_offset;
+        code_offset += RM_DICT_CODE_SIZE;
+        prev_end = column.offset + column.len;
+        for (auto &chunk : column.chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (fd_ == -1) {
+        throw UnixError();
+    }
+    off_t size = lseek(fd_, 0, SEEK_END);
+    std::vector<char> data(size);
+    if (size > 0 && pread(fd_, data.data(), size, 0) != size) {
+        throw UnixError();
+    }
+    std::lock_guard lock(latch_);
+    size_t pos = 0;
+    while (pos + sizeof(int) <= data.size()) {
+        int col;
+        memcpy(&col, data.data() + pos, sizeof(int));
+        if (col < 0 || col >= num_cols_ || pos + sizeof(int) + cols_[col].len > data.size()) {
+            // 追加到一半时进程退出，丢掉不完整的最后一条；之后追加的值会接在它后面，截掉残留的部分
+            break;
+        }
+        add_value(col, data.data() + pos + sizeof(int), false);
+        pos += sizeof(int) + cols_[col].len;
+    }
+    if (pos < data.size() && ftruncate(fd_, static_cast<off_t>(pos)) == -1) {
+        throw UnixError();
+    }
+}
+
+void RmDictionary::add_values(const char *record) {
+    std::lock_guard lock(latch_);
+    for (int i = 0; i < num_cols_; ++i) {
+        std::string value(record + cols_[i].offset, cols_[i].len);
+        if (cols_[i].codes.count(value) == 0) {
+            add_value(i, value.data(), true);
+        }
+    }
+}
+
+void RmDictionary::encode_record(const char *record, char *slot) {
+    int pos = 0;
+    char *out = slot;
+    for (int i = 0; i < num_cols_; ++i) {
+        Column &column = cols_[i];
+        memcpy(out, record + pos, column.offset - pos);
+        out += column.offset - pos;
+        uint16_t code;
+        {
+            std::lock_guard lock(latch_);
+            auto it = column.codes.find(std::string(record + column.offset, column.len));
+            // add_values已经分配了编号，只有故障恢复重做时字典文件缺少最后几条才会走到这里
+            code = it != column.codes.end() ? it->second
+                                            : static_cast<uint16_t>(add_value(i, record + column.offset, true));
+        }
+        memcpy(out, &code, RM_DICT_CODE_SIZE);
+        out += RM_DICT_CODE_SIZE;
+        pos = column.offset + column.len;
+    }
+    memcpy(out, record + pos, record_size_ - pos);
+}
+
+void RmDictionary::decode_record(const char *slot, char *record) const {
+    int pos = 0;
+    const char *in = slot;
+    for (int i = 0; i < num_cols_; ++i) {
+        const Column &column = cols_[i];
+        memcpy(record + pos, in, column.offset - pos);
+        in += column.offset - pos;
+        uint16_t code;
+        memcpy(&code, in, RM_DICT_CODE_SIZE);
+        memcpy(record + column.offset, get_value(column, code), column.len);
+        in += RM_DICT_CODE_SIZE;
+        pos = column.offset + column.len;
+    }
+    memcpy(record + pos, in, record_size_ - pos);
+}
+
+int RmDictionary::get_code_offset(int offset, int *col) const {
+    for (int i = 0; i < num_cols_; ++i) {
+        if (cols_[i].offset == offset) {
+            *col = i;
+            return cols_[i].code_offset;
+        }
+    }
+    return -1;
+}
+
+void RmDictionary::sync() {
+    if (fd_ != -1 && fdatasync(fd_) == -1) {
+        throw UnixError();
+    }
+}
+
+int RmDictionary::lookup(int col, const char *value) {
+    std::lock_guard lock(latch_);
+    auto it = cols_[col].codes.find(std::string(value, cols_[col].len));
+    return it == cols_[col].codes.end() ? -1 : it->second;
+}
+
+/**
+ * @description: 在latch_下为value分配下一个编号
+ * @param {int} col 字段下标
+ * @param {char*} value 字段长度的值
+ * @param {bool} persist 是否追加到字典文件，打开时重放已有的值为false
+ * @return {int} 分配的编号
+ */
+int RmDictionary::add_value(int col, const char *value, bool persist) {
+    Column &column = cols_[col];
+    if (column.size == RM_MAX_DICT_CODES) {
+        throw DictionaryFullError(path_);
+    }
+    if (persist) {
+        std::vector<char> entry(sizeof(int) + column.len);
+        memcpy(entry.data(), &col, sizeof(int));
+        memcpy(entry.data() + sizeof(int), value, column.len);
+        if (write(fd_, entry.data(), entry.size()) != static_cast<ssize_t>(entry.size())) {
+            throw UnixError();
+        }
+    }
+    int code = column.size++;
+    auto &chunk = column.chunks[code / CHUNK_CODES];
+    if (chunk.load(std::memory_order_relaxed) == nullptr) {
+        chunk.store(new char[CHUNK_CODES * column.len], std::memory_order_release);
+    }
+    memcpy(chunk.load(std::memory_order_relaxed) + code % CHUNK_CODES * column.len, value, column.len);
+    column.codes.emplace(std::string(value, column.len), static_cast<uint16_t>(code));
+    return code;
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "rm_defs.h"
+
+/* 定长格式中字典编码字段的字典。每个字段的不同值按第一次出现的顺序编号，槽位中只存RM_DICT_CODE_SIZE字节的编号。
+ * 字典保存在数据文件旁边的<表名>.dict文件中，新值分配编号时立即追加写入，早于任何引用该编号的页面写回；
+ * 按编号取值不加锁，值分块存放，分配新编号不会移动已有的值 */
+class RmDictionary {
+public:
+    RmDictionary() = default;
+
+    ~RmDictionary();
+
+    RmDictionary(const RmDictionary &) = delete;
+    RmDictionary &operator=(const RmDictionary &) = delete;
+
+    // 打开字典文件并读出已有的值，文件不存在时创建
+    void open(const std::string &path, const RmFileHdr &file_hdr);
+
+    // 保证记录中字典字段的值都已经有编号，字典满时抛出DictionaryFullError。调用者在修改页面之前调用
+    void add_values(const char *record);
+
+    // 把record_size大小的记录编码为slot_size大小的槽位
+    void encode_record(const char *record, char *slot);
+
+    // 把槽位解码为record_size大小的记录
+    void decode_record(const char *slot, char *record) const;
+
+    // 记录中offset处的字段在槽位中编号的偏移，col输出字段在字典中的下标；不是字典字段时返回-1
+    int get_code_offset(int offset, int *col) const;
+
+    // 把字典文件刷到磁盘，写回页面之前调用
+    void sync();
+
+    // 第col个字段中value（长度为字段长度）的编号，字典中没有该值时返回-1
+    int lookup(int col, const char *value);
+
+private:
+    static constexpr int CHUNK_CODES = 256; // 每块存放的值的个数
+
+    struct Column {
+        int offset; // 字段在记录中的偏移
+        int len; // 字段长度
+        int code_offset; // 编号在槽位中的偏移
+        std::unordered_map<std::string, uint16_t> codes; // 值到编号，只在latch_下访问
+        std::atomic<char *> chunks[RM_MAX_DICT_CODES / CHUNK_CODES]; // 第code个值位于chunks[code / CHUNK_CODES]中
+        int size = 0; // 已分配的编号个数，只在latch_下访问
+    };
+
+    const char *get_value(const Column &column, int code) const {
+        return column.chunks[code / CHUNK_CODES].load(std::memory_order_acquire) + code % CHUNK_CODES * column.len;
+    }
+
+    int add_value(int col, const char *value, bool persist);
+
+    std::string path_;
+    int fd_ = -1;
+    int record_size_ = 0;
+    int num_cols_ = 0;
+    Column cols_[RM_MAX_DICT_COLS];
+    std::mutex latch_;
+};
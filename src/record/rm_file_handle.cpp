@@ -10,29 +10,317 @@ See the Mulan PSL v2 for more details. */
 
 #include "rm_file_handle.h"
 
+#include <algorithm>
+
+#include "transaction/transaction_manager.h"
+#include "transaction/version_store.h"
+
+namespace {
+// 字符串字段去掉末尾的'\0'后的长度，后面全是0，解码时补回
+inline int trimmed_len(const char *col, int len) {
+    while (len > 0 && col[len - 1] == '\0') {
+        --len;
+    }
+    return len;
+}
+
+// 变长格式中记录编码后的长度：定长字段原样存放，每个变长字段存为2字节长度加实际内容
+int encoded_size(const RmFileHdr *file_hdr, const char *buf) {
+    int size = file_hdr->record_size;
+    for (int i = 0; i < file_hdr->num_var_cols; ++i) {
+        auto &col = file_hdr->var_cols[i];
+        size += static_cast<int>(sizeof(uint16_t)) + trimmed_len(buf + col.offset, col.len) - col.len;
+    }
+    return size;
+}
+
+void encode_record(const RmFileHdr *file_hdr, const char *buf, char *out) {
+    int pos = 0;
+    for (int i = 0; i < file_hdr->num_var_cols; ++i) {
+        auto &col = file_hdr->var_cols[i];
+        memcpy(out, buf + pos, col.offset - pos);
+        out += col.offset - pos;
+        uint16_t len = trimmed_len(buf + col.offset, col.len);
+        memcpy(out, &len, sizeof(len));
+        memcpy(out + sizeof(len), buf + col.offset, len);
+        out += sizeof(len) + len;
+        pos = col.offset + col.len;
+    }
+    memcpy(out, buf + pos, file_hdr->record_size - pos);
+}
+
+void decode_record(const RmFileHdr *file_hdr, const char *in, char *buf) {
+    int pos = 0;
+    for (int i = 0; i < file_hdr->num_var_cols; ++i) {
+        auto &col = file_hdr->var_cols[i];
+        memcpy(buf + pos, in, col.offset - pos);
+        in += col.offset - pos;
+        uint16_t len;
+        memcpy(&len, in, sizeof(len));
+        memcpy(buf + col.offset, in + sizeof(len), len);
+        memset(buf + col.offset + len, 0, col.len - len);
+        in += sizeof(len) + len;
+        pos = col.offset + col.len;
+    }
+    memcpy(buf + pos, in, file_hdr->record_size - pos);
+}
+}  // namespace
+
+void RmPageHandle::init() {
+    page_hdr->num_records = 0;
+    page_hdr->next_free_page_no = RM_NO_PAGE;
+    Bitmap::init(bitmap, file_hdr->bitmap_size);
+    if (slotted_hdr != nullptr) {
+        slotted_hdr->free_end = PAGE_SIZE;
+        slotted_hdr->used_bytes = 0;
+        memset(slot_dir, 0, sizeof(RmSlot) * file_hdr->num_records_per_page);
+    }
+}
+
+void RmPageHandle::read_columns(int slot_no, const std::vector<int> &cols, char *buf) const {
+    for (int col : cols) {
+        const RmVarCol &pax_col = file_hdr->pax_cols[col];
+        memcpy(buf + pax_col.offset, get_column(col) + slot_no * pax_col.len, pax_col.len);
+    }
+}
+
+const char *RmPageHandle::get_record(int slot_no, char *buf) const {
+    if (file_hdr->format == RM_FORMAT_PAX) {
+        for (int col = 0; col < file_hdr->num_pax_cols; ++col) {
+            const RmVarCol &pax_col = file_hdr->pax_cols[col];
+            memcpy(buf + pax_col.offset, get_column(col) + slot_no * pax_col.len, pax_col.len);
+        }
+        return buf;
+    }
+    if (slotted_hdr == nullptr) {
+        if (file_hdr->num_dict_cols > 0) {
+            dict->decode_record(get_slot(slot_no), buf);
+            return buf;
+        }
+        return get_slot(slot_no);
+    }
+    decode_record(file_hdr, page->get_data() + slot_dir[slot_no].offset, buf);
+    return buf;
+}
+
+bool RmPageHandle::can_write_record(int slot_no, const char *buf) const {
+    if (slotted_hdr == nullptr) {
+        return true;
+    }
+    int size = encoded_size(file_hdr, buf);
+    return size <= slot_dir[slot_no].len || size <= free_bytes() + slot_dir[slot_no].len;
+}
+
+bool RmPageHandle::write_record(int slot_no, const char *buf) {
+    if (file_hdr->format == RM_FORMAT_PAX) {
+        for (int col = 0; col < file_hdr->num_pax_cols; ++col) {
+            const RmVarCol &pax_col = file_hdr->pax_cols[col];
+            memcpy(get_column(col) + slot_no * pax_col.len, buf + pax_col.offset, pax_col.len);
+        }
+        return true;
+    }
+    if (slotted_hdr == nullptr) {
+        if (file_hdr->num_dict_cols > 0) {
+            dict->encode_record(buf, get_slot(slot_no));
+        } else {
+            memcpy(get_slot(slot_no), buf, file_hdr->record_size);
+        }
+        return true;
+    }
+    int size = encoded_size(file_hdr, buf);
+    RmSlot &slot = slot_dir[slot_no];
+    // 变短或不变时原地写，多出来的空间留到整理页面时回收
+    if (size <= slot.len) {
+        encode_record(file_hdr, buf, page->get_data() + slot.offset);
+        slotted_hdr->used_bytes -= slot.len - size;
+        slot.len = size;
+        return true;
+    }
+    if (size > free_bytes() + slot.len) {
+        return false;
+    }
+    erase_record(slot_no);
+    if (slotted_hdr->free_end - data_begin() < size) {
+        compact();
+    }
+    slotted_hdr->free_end -= size;
+    encode_record(file_hdr, buf, page->get_data() + slotted_hdr->free_end);
+    slot.offset = slotted_hdr->free_end;
+    slot.len = size;
+    slotted_hdr->used_bytes += size;
+    return true;
+}
+
+void RmPageHandle::erase_record(int slot_no) {
+    if (slotted_hdr == nullptr) {
+        return;
+    }
+    RmSlot &slot = slot_dir[slot_no];
+    if (slot.offset == slotted_hdr->free_end) {
+        slotted_hdr->free_end += slot.len;
+    }
+    slotted_hdr->used_bytes -= slot.len;
+    slot.offset = 0;
+    slot.len = 0;
+}
+
+int RmPageHandle::free_records() const {
+    int free_slots = file_hdr->num_records_per_page - page_hdr->num_records;
+    if (slotted_hdr == nullptr || free_slots <= 0) {
+        return std::max(free_slots, 0);
+    }
+    int free_space = free_bytes() - PAGE_SIZE * SLOTTED_PAGE_FREE_PERCENT / 100;
+    return free_space < 0 ? 0 : std::min(free_slots, free_space / file_hdr->max_tuple_size);
+}
+
+/**
+ * @description: 整理变长格式的页面，把所有记录移到页尾连续存放，消除删除和变短留下的空洞
+ */
+void RmPageHandle::compact() {
+    std::vector<int> slot_nos;
+    for (int i = 0; i < file_hdr->num_records_per_page; ++i) {
+        if (slot_dir[i].len > 0) {
+            slot_nos.push_back(i);
+        }
+    }
+    // 从最靠后的记录开始往页尾移动，目标位置不会覆盖还没有移动的记录
+    std::sort(slot_nos.begin(), slot_nos.end(),
+              [this](int a, int b) { return slot_dir[a].offset > slot_dir[b].offset; });
+    int end = PAGE_SIZE;
+    for (int slot_no : slot_nos) {
+        RmSlot &slot = slot_dir[slot_no];
+        end -= slot.len;
+        memmove(page->get_data() + end, page->get_data() + slot.offset, slot.len);
+        slot.offset = end;
+    }
+    slotted_hdr->free_end = end;
+    slotted_hdr->used_bytes = PAGE_SIZE - end;
+}
+
 /**
  * @description: 获取当前表中记录号为rid的记录
  * @param {Rid&} rid 记录号，指定记录的位置
  * @param {Context*} context
+ * @param {RmLockGranularity} held 调用者已经持有的锁粒度，持有表锁时不再加行级锁
  * @return {unique_ptr<RmRecord>} rid对应的记录对象指针
  */
-std::unique_ptr<RmRecord> RmFileHandle::get_record(const Rid &rid, Context *context) const {
+std::unique_ptr<RmRecord> RmFileHandle::get_record(const Rid &rid, Context *context, RmLockGranularity held) const {
     // Todo:
     // 1. 获取指定记录所在的page handle
     // 2. 初始化一个指向RmRecord的指针（赋值其内部的data和size）
     // 行级 S 锁
-    if (context != nullptr && context->lock_mgr_ != nullptr) {
+    if (held == RM_LOCK_ROW && context != nullptr && context->lock_mgr_ != nullptr) {
         context->lock_mgr_->lock_shared_on_record(context->txn_, rid, fd_);
     }
     auto &&page_handle = fetch_page_handle(rid.page_no);
     if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
         throw RecordNotFoundError(rid.page_no, rid.slot_no);
     }
-    auto &&record = std::make_unique<RmRecord>(file_hdr_.record_size, page_handle.get_slot(rid.slot_no));
-    buffer_pool_manager_->unpin_page(page_handle.page->get_page_id(), false);
+    auto &&record = std::make_unique<RmRecord>(file_hdr_.record_size);
+    // 变长格式整理页面时会移动记录，读的时候持有页面的读latch
+    if (page_handle.slotted_hdr != nullptr) {
+        page_handle.page->RLatch();
+        page_handle.read_record(rid.slot_no, record->data);
+        page_handle.page->RUnlatch();
+    } else {
+        page_handle.read_record(rid.slot_no, record->data);
+    }
+    buffer_pool_manager_->unpin_page(page_handle.page, false);
     return std::move(record);
 }
 
+/**
+ * @description: 获取记录号为rid的记录的只读视图，不拷贝记录。rid和视图当前指向同一页面时复用已有的pin
+ * @param {Rid&} rid 记录号，指定记录的位置
+ * @param {RmRecordView&} view 输出，指向rid对应的槽位
+ * @param {Context*} context
+ * @param {RmLockGranularity} held 调用者已经持有的锁粒度，持有表锁时不再加行级锁
+ */
+void RmFileHandle::get_record_view(const Rid &rid, RmRecordView &view, Context *context,
+                                   RmLockGranularity held) const {
+    // 行级 S 锁
+    if (held == RM_LOCK_ROW && context != nullptr && context->lock_mgr_ != nullptr) {
+        context->lock_mgr_->lock_shared_on_record(context->txn_, rid, fd_);
+    }
+    if (view.page_ == nullptr || view.page_->get_page_id().page_no != rid.page_no) {
+        view.reset();
+        // 先转交给guard，之后抛出异常时也能放掉pin
+        view.page_ = fetch_page_handle(rid.page_no).page;
+        view.guard_ = BasicPageGuard(buffer_pool_manager_, view.page_);
+    }
+    RmPageHandle page_handle(&file_hdr_, view.page_, &dictionary_);
+    if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+        throw RecordNotFoundError(rid.page_no, rid.slot_no);
+    }
+    if (page_handle.slotted_hdr != nullptr) {
+        page_handle.page->RLatch();
+        view.record_.data = const_cast<char *>(page_handle.get_record(rid.slot_no, view.buf_));
+        page_handle.page->RUnlatch();
+    } else if (file_hdr_.format == RM_FORMAT_PAX) {
+        // 只拼接上层需要的列，其余列的mini page不会被访问
+        if (view.all_columns_) {
+            page_handle.get_record(rid.slot_no, view.buf_);
+        } else {
+            page_handle.read_columns(rid.slot_no, view.columns_, view.buf_);
+        }
+        view.record_.data = view.buf_;
+    } else {
+        view.record_.data = const_cast<char *>(page_handle.get_record(rid.slot_no, view.buf_));
+    }
+    view.record_.size = file_hdr_.record_size;
+}
+
+/**
+ * @description: 列存格式中查找单独存放一个字段的mini page
+ * @param {int} offset 字段在记录中的偏移
+ * @param {int} len 字段长度
+ * @return {int} mini page号，不是列存格式或该字段和其他字段共用mini page时返回-1
+ */
+int RmFileHandle::get_pax_column(int offset, int len) const {
+    if (file_hdr_.format != RM_FORMAT_PAX) {
+        return -1;
+    }
+    for (int col = 0; col < file_hdr_.num_pax_cols; ++col) {
+        if (file_hdr_.pax_cols[col].offset == offset && file_hdr_.pax_cols[col].len == len) {
+            return col;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @description: 扫描第一次读取页面时建立页面的区域映射摘要。插入和更新持有页面写latch时维护摘要，
+ * 这里在读latch下重新取bitmap并读取所有记录，不会漏掉并发写入的记录
+ * @param {RmPageHandle&} page_handle 扫描的页面
+ */
+void RmFileHandle::build_zone(const RmPageHandle &page_handle) const {
+    char buf[RM_MAX_RECORD_SIZE];
+    int page_no = page_handle.page->get_page_id().page_no;
+    page_handle.page->RLatch();
+    zone_map_.reset_zone(page_no);
+    for (int slot_no = Bitmap::first_bit(true, page_handle.bitmap, file_hdr_.num_records_per_page);
+         slot_no < file_hdr_.num_records_per_page;
+         slot_no = Bitmap::next_bit(true, page_handle.bitmap, file_hdr_.num_records_per_page, slot_no)) {
+        zone_map_.update(page_no, page_handle.get_record(slot_no, buf));
+    }
+    page_handle.page->RUnlatch();
+}
+
+std::vector<int> RmFileHandle::get_pax_columns(const std::vector<std::pair<int, int>> &fields) const {
+    std::vector<int> cols;
+    for (int col = 0; col < file_hdr_.num_pax_cols; ++col) {
+        int begin = file_hdr_.pax_cols[col].offset;
+        int end = begin + file_hdr_.pax_cols[col].len;
+        for (auto &[offset, len] : fields) {
+            if (offset < end && offset + len > begin) {
+                cols.push_back(col);
+                break;
+            }
+        }
+    }
+    return cols;
+}
+
 /**
  * @description: 在当前表中插入一条记录，不指定插入位置
  * @param {char*} buf 要插入的记录的数据
@@ -47,73 +335,244 @@ Rid RmFileHandle::insert_record(char *buf, Context *context) {
     // 4. 更新page_handle.page_hdr中的数据结构
     // 注意考虑插入一条记录后页面已满的情况，需要更新file_hdr_.first_free_page_no
     // TODO 不需要加行级写锁？
-    // TODO 这里实际上是以一个页面放一个记录，太占用空间了！
-    auto &&page_handle = create_page_handle();
-    auto &&slot_no = Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page);
-
-    // 行级 X 锁
-    if (context != nullptr) {
-        context->lock_mgr_->lock_exclusive_on_record(context->txn_, {page_handle.page->get_page_id().page_no, slot_no},
-                                                     fd_);
+    // 新的字典值在修改页面之前分配编码，字典满时不会留下写了一半的页面
+    if (file_hdr_.num_dict_cols > 0) {
+        dictionary_.add_values(buf);
     }
+    // 空闲空间映射可能已经过时，或者同一页面上的其他插入抢先用掉了槽位，这时换一个页面重试
+    while (true) {
+        auto &&page_handle = create_page_handle();
+        int page_no = page_handle.page->get_page_id().page_no;
+        page_handle.page->WLatch();
+        int slot_no = page_handle.has_free_space()
+                          ? Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page)
+                          : -1;
+        page_handle.page->WUnlatch();
+        if (slot_no == -1) {
+            free_space_map_.update(page_no, 0);
+            buffer_pool_manager_->unpin_page(page_handle.page, false);
+            continue;
+        }
+        Rid rid{page_no, slot_no};
 
-    memcpy(page_handle.get_slot(slot_no), buf, file_hdr_.record_size);
-    Bitmap::set(page_handle.bitmap, slot_no);
+        // 行级 X 锁，等锁时不持有页面latch
+        if (context != nullptr) {
+            try {
+                context->lock_mgr_->lock_exclusive_on_record(context->txn_, rid, fd_);
+            } catch (...) {
+                buffer_pool_manager_->unpin_page(page_handle.page, false);
+                throw;
+            }
+        }
 
-    if (++page_handle.page_hdr->num_records == file_hdr_.num_records_per_page) {
-        file_hdr_.first_free_page_no = page_handle.page_hdr->next_free_page_no;
+        page_handle.page->WLatch();
+        if (Bitmap::is_set(page_handle.bitmap, slot_no) || !page_handle.has_free_space()) {
+            page_handle.page->WUnlatch();
+            buffer_pool_manager_->unpin_page(page_handle.page, false);
+            continue;
+        }
+        // 有空闲空间的页面至少能放下一条最长的记录
+        log_change(page_handle, slot_no, false);
+        save_slot_version(page_handle, slot_no, context);
+        page_handle.write_record(slot_no, buf);
+        Bitmap::set(page_handle.bitmap, slot_no);
+        ++page_handle.page_hdr->num_records;
+        ++num_rows_;
+        zone_map_.update(page_no, buf);
+#ifdef ENABLE_LOGGING
+        if (context != nullptr && context->log_mgr_ != nullptr && !unlogged_) {
+            InsertLogRecord insert_log_record(context->txn_->get_transaction_id(), buf, file_hdr_.record_size, rid,
+                                              file_hdr_.table_id);
+            append_log(&insert_log_record, page_handle.page, context);
+        }
+#endif
+        free_space_map_.update(page_no, page_handle.free_records());
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, true);
+        return rid;
     }
+}
 
-    Rid rid{page_handle.page->get_page_id().page_no, slot_no};
-    buffer_pool_manager_->unpin_page(page_handle.page->get_page_id(), true);
-    return rid;
+/**
+ * @description: 在当前表中批量插入记录。每个页面先在latch下挑出这一批要用的空闲槽位，
+ * 放开latch加行级锁，再在一次WLatch内写入，页面只pin和unpin一次
+ * @param {vector<char*>&} bufs 要插入的记录的数据
+ * @param {Context*} context
+ * @return {vector<Rid>} 与bufs一一对应的记录号
+ */
+std::vector<Rid> RmFileHandle::insert_records(const std::vector<char *> &bufs, Context *context) {
+    if (file_hdr_.num_dict_cols > 0) {
+        for (char *buf : bufs) {
+            dictionary_.add_values(buf);
+        }
+    }
+    std::vector<Rid> rids;
+    rids.reserve(bufs.size());
+    std::vector<int> slots;
+    while (rids.size() < bufs.size()) {
+        auto &&page_handle = create_page_handle();
+        int page_no = page_handle.page->get_page_id().page_no;
+        slots.clear();
+        page_handle.page->WLatch();
+        int num_slots = std::min(page_handle.free_records(), static_cast<int>(bufs.size() - rids.size()));
+        for (int slot_no = Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page);
+             slot_no < file_hdr_.num_records_per_page && static_cast<int>(slots.size()) < num_slots;
+             slot_no = Bitmap::next_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page, slot_no)) {
+            slots.push_back(slot_no);
+        }
+        page_handle.page->WUnlatch();
+        if (slots.empty()) {
+            free_space_map_.update(page_no, 0);
+            buffer_pool_manager_->unpin_page(page_handle.page, false);
+            continue;
+        }
+
+        if (context != nullptr) {
+            try {
+                for (int slot_no : slots) {
+                    context->lock_mgr_->lock_exclusive_on_record(context->txn_, {page_no, slot_no}, fd_);
+                }
+            } catch (...) {
+                buffer_pool_manager_->unpin_page(page_handle.page, false);
+                throw;
+            }
+        }
+
+        // 放开latch期间被其他插入用掉的槽位跳过，剩下的记录换一个页面继续
+        size_t num_written = rids.size();
+#ifdef ENABLE_LOGGING
+        bool logged = context != nullptr && context->log_mgr_ != nullptr && !unlogged_;
+        std::vector<InsertLogRecord> insert_logs;
+        insert_logs.reserve(logged ? slots.size() : 0);
+#endif
+        page_handle.page->WLatch();
+        for (int slot_no : slots) {
+            if (!page_handle.has_free_space()) {
+                break;
+            }
+            if (Bitmap::is_set(page_handle.bitmap, slot_no)) {
+                continue;
+            }
+            char *buf = bufs[rids.size()];
+            Rid rid{page_no, slot_no};
+            log_change(page_handle, slot_no, false);
+            save_slot_version(page_handle, slot_no, context);
+            page_handle.write_record(slot_no, buf);
+            Bitmap::set(page_handle.bitmap, slot_no);
+            ++page_handle.page_hdr->num_records;
+            ++num_rows_;
+            zone_map_.update(page_no, buf);
+#ifdef ENABLE_LOGGING
+            if (logged) {
+                insert_logs.emplace_back(context->txn_->get_transaction_id(), buf, file_hdr_.record_size, rid,
+                                         file_hdr_.table_id);
+            }
+#endif
+            rids.push_back(rid);
+        }
+#ifdef ENABLE_LOGGING
+        // 同一个页面上的插入日志一次追加
+        if (!insert_logs.empty()) {
+            std::vector<LogRecord *> log_records;
+            log_records.reserve(insert_logs.size());
+            for (auto &insert_log : insert_logs) {
+                log_records.push_back(&insert_log);
+            }
+            append_logs(log_records, page_handle.page, context);
+        }
+#endif
+        free_space_map_.update(page_no, page_handle.free_records());
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, rids.size() != num_written);
+    }
+    return rids;
 }
 
 /**
  * @description: 在当前表中的指定位置插入一条记录
  * @param {Rid&} rid 要插入记录的位置
  * @param {char*} buf 要插入记录的数据
+ * @param {Context*} context 不为空时记录插入日志
+ * @return {Rid} 记录实际插入的位置，变长格式中rid所在页面放不下时插入到其他页面
  */
-void RmFileHandle::insert_record(const Rid &rid, char *buf) {
+Rid RmFileHandle::insert_record(const Rid &rid, char *buf, Context *context) {
     // TODO 不需要加行级写锁？
     // 行级 X 锁
     // if (context != nullptr) {
     //     context->lock_mgr_->lock_exclusive_on_record(context->txn_, {page_handle.page->get_page_id().page_no, slot_no}, fd_);
     // }
+    if (file_hdr_.num_dict_cols > 0) {
+        dictionary_.add_values(buf);
+    }
     auto &&page_handle = fetch_page_handle(rid.page_no);
+    page_handle.page->WLatch();
+    if (!page_handle.can_write_record(rid.slot_no, buf)) {
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+        return insert_record(buf, context);
+    }
+    log_change(page_handle, rid.slot_no, Bitmap::is_set(page_handle.bitmap, rid.slot_no));
+    save_slot_version(page_handle, rid.slot_no, context);
+    page_handle.write_record(rid.slot_no, buf);
     if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
         Bitmap::set(page_handle.bitmap, rid.slot_no);
-        if (++page_handle.page_hdr->num_records == file_hdr_.num_records_per_page) {
-            file_hdr_.first_free_page_no = page_handle.page_hdr->next_free_page_no;
-        }
+        ++page_handle.page_hdr->num_records;
+        ++num_rows_;
     }
-    memcpy(page_handle.get_slot(rid.slot_no), buf, file_hdr_.record_size);
-    buffer_pool_manager_->unpin_page(page_handle.page->get_page_id(), true);
+    zone_map_.update(rid.page_no, buf);
+#ifdef ENABLE_LOGGING
+    if (context != nullptr && context->log_mgr_ != nullptr && !unlogged_) {
+        InsertLogRecord insert_log_record(context->txn_->get_transaction_id(), buf, file_hdr_.record_size, rid,
+                                          file_hdr_.table_id);
+        append_log(&insert_log_record, page_handle.page, context);
+    }
+#endif
+    free_space_map_.update(rid.page_no, page_handle.free_records());
+    page_handle.page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+    return rid;
 }
 
 /**
  * @description: 删除记录文件中记录号为rid的记录
  * @param {Rid&} rid 要删除的记录的记录号（位置）
  * @param {Context*} context
+ * @param {RmLockGranularity} held 调用者已经持有的锁粒度，持有表级X锁时不再加行级锁
  */
-void RmFileHandle::delete_record(const Rid &rid, Context *context) {
+void RmFileHandle::delete_record(const Rid &rid, Context *context, RmLockGranularity held) {
     // Todo:
     // 1. 获取指定记录所在的page handle
     // 2. 更新page_handle.page_hdr中的数据结构
-    // 注意考虑删除一条记录后页面未满的情况，需要调用release_page_handle()
+    // 注意考虑删除一条记录后页面未满的情况，需要更新空闲空间映射
     // 行级 X 锁
-    if (context != nullptr) {
+    if (held == RM_LOCK_ROW && context != nullptr) {
         context->lock_mgr_->lock_exclusive_on_record(context->txn_, rid, fd_);
     }
     auto &&page_handle = fetch_page_handle(rid.page_no);
+    page_handle.page->WLatch();
     if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
         throw RecordNotFoundError(rid.page_no, rid.slot_no);
     }
-    Bitmap::reset(page_handle.bitmap, rid.slot_no);
-    if (page_handle.page_hdr->num_records-- == file_hdr_.num_records_per_page) {
-        release_page_handle(page_handle);
+#ifdef ENABLE_LOGGING
+    if (context != nullptr && context->log_mgr_ != nullptr && !unlogged_) {
+        char buf[RM_MAX_RECORD_SIZE];
+        DeleteLogRecord delete_log_record(context->txn_->get_transaction_id(),
+                                          const_cast<char *>(page_handle.get_record(rid.slot_no, buf)),
+                                          file_hdr_.record_size, rid, file_hdr_.table_id);
+        append_log(&delete_log_record, page_handle.page, context);
     }
-    buffer_pool_manager_->unpin_page(page_handle.page->get_page_id(), true);
+#endif
+    log_change(page_handle, rid.slot_no, true);
+    save_slot_version(page_handle, rid.slot_no, context);
+    page_handle.erase_record(rid.slot_no);
+    Bitmap::reset(page_handle.bitmap, rid.slot_no);
+    --page_handle.page_hdr->num_records;
+    --num_rows_;
+    free_space_map_.update(rid.page_no, page_handle.free_records());
+    page_handle.page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
 }
 
 /**
@@ -121,8 +580,9 @@ void RmFileHandle::delete_record(const Rid &rid, Context *context) {
  * @param {Rid&} rid 要更新的记录的记录号（位置）
  * @param {char*} buf 新记录的数据
  * @param {Context*} context
+ * @return {Rid} 更新后记录的位置，变长格式中记录变长后原页面放不下时，删除原记录再插入到其他页面
  */
-void RmFileHandle::update_record(const Rid &rid, char *buf, Context *context) {
+Rid RmFileHandle::update_record(const Rid &rid, char *buf, Context *context) {
     // Todo:
     // 1. 获取指定记录所在的page handle
     // 2. 更新记录
@@ -130,12 +590,131 @@ void RmFileHandle::update_record(const Rid &rid, char *buf, Context *context) {
     if (context != nullptr) {
         context->lock_mgr_->lock_exclusive_on_record(context->txn_, rid, fd_);
     }
+    if (file_hdr_.num_dict_cols > 0) {
+        dictionary_.add_values(buf);
+    }
     auto &&page_handle = fetch_page_handle(rid.page_no);
+    page_handle.page->WLatch();
     if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
         throw RecordNotFoundError(rid.page_no, rid.slot_no);
     }
-    memcpy(page_handle.get_slot(rid.slot_no), buf, file_hdr_.record_size);
-    buffer_pool_manager_->unpin_page(page_handle.page->get_page_id(), true);
+    if (!page_handle.can_write_record(rid.slot_no, buf)) {
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+        delete_record(rid, context);
+        return insert_record(buf, context);
+    }
+#ifdef ENABLE_LOGGING
+    if (context != nullptr && context->log_mgr_ != nullptr && !unlogged_) {
+        char old_buf[RM_MAX_RECORD_SIZE];
+        UpdateLogRecord update_log_record(context->txn_->get_transaction_id(),
+                                          const_cast<char *>(page_handle.get_record(rid.slot_no, old_buf)), buf,
+                                          file_hdr_.record_size, rid, file_hdr_.table_id);
+        append_log(&update_log_record, page_handle.page, context);
+    }
+#endif
+    log_change(page_handle, rid.slot_no, true);
+    save_slot_version(page_handle, rid.slot_no, context);
+    page_handle.write_record(rid.slot_no, buf);
+    zone_map_.update(rid.page_no, buf);
+    free_space_map_.update(rid.page_no, page_handle.free_records());
+    page_handle.page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+    return rid;
+}
+
+void RmFileHandle::increment_record(const Rid &rid, const std::vector<IncrementDelta> &deltas, Context *context,
+                                    RmRecord &old_record, RmRecord &new_record) {
+    auto &&page_handle = fetch_page_handle(rid.page_no);
+    page_handle.page->WLatch();
+    if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+        page_handle.page->WUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+        throw RecordNotFoundError(rid.page_no, rid.slot_no);
+    }
+    page_handle.read_record(rid.slot_no, old_record.data);
+    memcpy(new_record.data, old_record.data, file_hdr_.record_size);
+    for (auto &delta : deltas) {
+        apply_increment(new_record.data + delta.offset, delta.value, delta.type);
+    }
+#ifdef ENABLE_LOGGING
+    if (context != nullptr && context->log_mgr_ != nullptr && !unlogged_) {
+        UpdateLogRecord update_log_record(context->txn_->get_transaction_id(), old_record.data, new_record.data,
+                                          file_hdr_.record_size, rid, file_hdr_.table_id);
+        append_log(&update_log_record, page_handle.page, context);
+    }
+#endif
+    log_change(page_handle, rid.slot_no, true);
+    save_slot_version(page_handle, rid.slot_no, context);
+    page_handle.write_record(rid.slot_no, new_record.data);
+    zone_map_.update(rid.page_no, new_record.data);
+    page_handle.page->WUnlatch();
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+}
+
+void RmFileHandle::save_version(const Rid &rid, const RmRecord &record, Context *context) const {
+    if (context != nullptr && context->txn_ != nullptr) {
+        VersionStore::instance().save(context->txn_, fd_, rid, record.data, record.size);
+    }
+}
+
+/**
+ * @description: 在线建索引期间把要修改的槽位记到change_log_。调用者持有页面写latch，
+ * 建索引的扫描读到的是修改前还是修改后的记录，都能由日志中的记录号重新读取补齐
+ * @param {bool} had_record 槽位上原来是否有记录，有时把原来的记录一起记下
+ */
+void RmFileHandle::log_change(const RmPageHandle &page_handle, int slot_no, bool had_record) const {
+    if (change_log_.load() == nullptr) {
+        return;
+    }
+    std::shared_lock log_lock(change_log_latch_);
+    RmChangeLog *log = change_log_.load();
+    if (log == nullptr) {
+        return;
+    }
+    char buf[RM_MAX_RECORD_SIZE];
+    const char *old_record = had_record ? page_handle.get_record(slot_no, buf) : nullptr;
+    std::lock_guard lock(log->latch);
+    log->rids.push_back({page_handle.page->get_page_id().page_no, slot_no});
+    log->has_old.push_back(had_record);
+    if (had_record) {
+        log->old_records.insert(log->old_records.end(), old_record, old_record + file_hdr_.record_size);
+    }
+}
+
+/**
+ * @description: 写者先保存版本再修改页面，快照读先读页面再查版本，读到的未提交修改一定能在版本存储中找到。
+ * 没有事务的写入（故障恢复、批量导入）不保存版本
+ */
+void RmFileHandle::save_slot_version(const RmPageHandle &page_handle, int slot_no, Context *context) const {
+    if (context == nullptr || context->txn_ == nullptr) {
+        return;
+    }
+    char buf[RM_MAX_RECORD_SIZE];
+    const char *before =
+        Bitmap::is_set(page_handle.bitmap, slot_no) ? page_handle.get_record(slot_no, buf) : nullptr;
+    VersionStore::instance().save(context->txn_, fd_, {page_handle.page->get_page_id().page_no, slot_no}, before,
+                                  file_hdr_.record_size);
+}
+
+/**
+ * @description: 故障恢复时回滚的记录在原位置放不下，写到文件末尾的新页面上。恢复时空闲空间映射还没有重建，不能经过映射
+ * @param {char*} buf 记录的数据
+ * @return {Rid} 记录的新位置
+ */
+Rid RmFileHandle::append_record(const char *buf) {
+    auto &&page_handle = create_new_page_handle();
+    page_handle.write_record(0, buf);
+    Bitmap::set(page_handle.bitmap, 0);
+    page_handle.page_hdr->num_records = 1;
+    ++num_rows_;
+    Rid rid{page_handle.page->get_page_id().page_no, 0};
+    zone_map_.update(rid.page_no, buf);
+    free_space_map_.update(rid.page_no, page_handle.free_records());
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+    return rid;
 }
 
 /**
@@ -144,20 +723,187 @@ void RmFileHandle::update_record(const Rid &rid, char *buf, Context *context) {
 /**
  * @description: 获取指定页面的页面句柄
  * @param {int} page_no 页面号
+ * @param {BufferAccessStrategy*} strategy 缓冲池访问策略，大表扫描时使用环形缓冲区
  * @return {RmPageHandle} 指定页面的句柄
  */
-RmPageHandle RmFileHandle::fetch_page_handle(int page_no) const {
+RmPageHandle RmFileHandle::fetch_page_handle(int page_no, BufferAccessStrategy *strategy) const {
     // Todo:
     // 使用缓冲池获取指定页面，并生成page_handle返回给上层
     // if page_no is invalid, throw PageNotExistError exception
-    if (page_no >= file_hdr_.num_pages || page_no < 0) {
+    // 其他线程可能正在新建页面，num_pages用原子操作读写
+    if (page_no >= __atomic_load_n(&file_hdr_.num_pages, __ATOMIC_ACQUIRE) || page_no < 0) {
         throw PageNotExistError(disk_manager_->get_file_name(fd_), page_no);
     }
-    auto &&page = buffer_pool_manager_->fetch_page({fd_, page_no});
+    // 常驻表的页面不经过访问策略，取到常驻页面后记下地址，调用者之后的unpin不起作用
+    if (memory_pages_ != nullptr && page_no < RM_MEMORY_MAX_PAGES) {
+        Page *page = memory_pages_[page_no].load(std::memory_order_acquire);
+        if (page == nullptr) {
+            page = buffer_pool_manager_->fetch_page({fd_, page_no});
+            if (page == nullptr) {
+                throw PageNotExistError(disk_manager_->get_file_name(fd_), page_no);
+            }
+            // 设置常驻之前已经在缓冲池中的页面照常pin和unpin，不能记下
+            if (page->is_in_memory()) {
+                memory_pages_[page_no].store(page, std::memory_order_release);
+            }
+        }
+        return {&file_hdr_, page, &dictionary_};
+    }
+    auto &&page = buffer_pool_manager_->fetch_page({fd_, page_no}, strategy);
     if (page == nullptr) {
         throw PageNotExistError(disk_manager_->get_file_name(fd_), page_no);
     }
-    return {&file_hdr_, page};
+    return {&file_hdr_, page, &dictionary_};
+}
+
+/**
+ * @description: 批量导入一页记录，页面不存在时在文件末尾新建。导入不记日志，页面通过访问策略的环形缓冲区写回，
+ * 不会把共享缓冲池中的页面挤出去。变长格式中一批记录可能占用多个页面，最后一个页面没满时下一批接着写入
+ * @param {int} page_no 页面号
+ * @param {char*} data 连续存放的记录
+ * @param {int} num_records 记录条数，不超过每页的记录数
+ * @param {int} size data的字节数
+ * @param {BufferAccessStrategy*} strategy 缓冲池访问策略
+ * @param {vector<Rid>*} rids 不为空时输出每条记录的位置
+ * @return {int} 下一批记录应写入的页面号
+ */
+int RmFileHandle::load_record(int page_no, const char *data, int num_records, int size,
+                              BufferAccessStrategy *strategy, std::vector<Rid> *rids) {
+    if (num_records > file_hdr_.num_records_per_page || size != num_records * file_hdr_.record_size) {
+        throw InternalError("RmFileHandle::load_record: invalid record batch");
+    }
+    for (int i = 0; i < num_records && file_hdr_.num_dict_cols > 0; ++i) {
+        dictionary_.add_values(data + i * file_hdr_.record_size);
+    }
+    auto load_page = [&](int page_no) {
+        if (page_no < file_hdr_.num_pages) {
+            return fetch_page_handle(page_no, strategy);
+        }
+        PageId page_id{fd_, INVALID_PAGE_ID};
+        Page *page = buffer_pool_manager_->new_page(&page_id, strategy);
+        if (page == nullptr || page_id.page_no != page_no) {
+            throw PageNotExistError(disk_manager_->get_file_name(fd_), page_no);
+        }
+        ++file_hdr_.num_pages;
+        RmPageHandle page_handle{&file_hdr_, page, &dictionary_};
+        page_handle.init();
+        zone_map_.reset_zone(page_no);
+        return page_handle;
+    };
+    if (rids != nullptr) {
+        rids->clear();
+    }
+    if (file_hdr_.format == RM_FORMAT_SLOTTED) {
+        auto &&page_handle = load_page(page_no);
+        for (int i = 0; i < num_records; ++i) {
+            if (!page_handle.has_free_space()) {
+                buffer_pool_manager_->unpin_page(page_handle.page, true);
+                page_handle = load_page(++page_no);
+            }
+            int slot_no = Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page);
+            ++page_handle.page_hdr->num_records;
+            ++num_rows_;
+            page_handle.write_record(slot_no, data + i * file_hdr_.record_size);
+            Bitmap::set(page_handle.bitmap, slot_no);
+            zone_map_.update(page_no, data + i * file_hdr_.record_size);
+            if (rids != nullptr) {
+                rids->push_back({page_no, slot_no});
+            }
+        }
+        // 没满的页面登记到空闲空间映射，下一批接着写入
+        int free_records = page_handle.free_records();
+        free_space_map_.update(page_no, free_records);
+        buffer_pool_manager_->unpin_page(page_handle.page, true);
+        return free_records > 0 ? page_no : page_no + 1;
+    }
+    auto &&page_handle = load_page(page_no);
+    fill_loaded_page(page_handle, page_no, data, num_records, size, rids);
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+    return page_no + 1;
+}
+
+/**
+ * @description: 批量导入一页记录，页面镜像在page_buf中组装好后直接写到文件末尾，不经过缓冲池，也不记日志。
+ * 只用于定长和列存格式，每次正好写一个新页面。调用者导入结束后调用sync_loaded_pages让这些页面落盘，
+ * 再写批量导入日志发布它们；文件头中的页面数只在检查点和关闭文件时写回，发布之前崩溃时这些页面不会出现在表中
+ * @param {int} page_no 页面号，必须是文件当前的页面数
+ * @param {char*} data 连续存放的记录
+ * @param {int} num_records 记录条数，不超过每页的记录数
+ * @param {int} size data的字节数
+ * @param {char*} page_buf PAGE_SIZE字节的页面镜像缓冲区
+ * @param {vector<Rid>*} rids 不为空时输出每条记录的位置
+ * @return {int} 下一批记录应写入的页面号
+ */
+int RmFileHandle::load_record_direct(int page_no, const char *data, int num_records, int size, char *page_buf,
+                                     std::vector<Rid> *rids) {
+    if (num_records > file_hdr_.num_records_per_page || size != num_records * file_hdr_.record_size ||
+        file_hdr_.format == RM_FORMAT_SLOTTED) {
+        throw InternalError("RmFileHandle::load_record_direct: invalid record batch");
+    }
+    for (int i = 0; i < num_records && file_hdr_.num_dict_cols > 0; ++i) {
+        dictionary_.add_values(data + i * file_hdr_.record_size);
+    }
+    {
+        std::lock_guard lock(extend_latch_);
+        if (page_no != file_hdr_.num_pages || disk_manager_->allocate_page(fd_) != page_no) {
+            throw PageNotExistError(disk_manager_->get_file_name(fd_), page_no);
+        }
+        __atomic_store_n(&file_hdr_.num_pages, file_hdr_.num_pages + 1, __ATOMIC_RELEASE);
+    }
+    memset(page_buf, 0, PAGE_SIZE);
+    Page page(page_buf);
+    RmPageHandle page_handle{&file_hdr_, &page, &dictionary_};
+    page_handle.init();
+    page.set_page_lsn(INVALID_LSN);
+    if (rids != nullptr) {
+        rids->clear();
+    }
+    fill_loaded_page(page_handle, page_no, data, num_records, size, rids);
+    disk_manager_->write_page(fd_, page_no, page_buf, PAGE_SIZE);
+    return page_no + 1;
+}
+
+/**
+ * @description: 把一批记录写满整个页面，重建页面的摘要并登记空闲空间
+ */
+void RmFileHandle::fill_loaded_page(RmPageHandle &page_handle, int page_no, const char *data, int num_records,
+                                    int size, std::vector<Rid> *rids) {
+    // 覆盖已有页面时页面上原来的记录不再存在
+    num_rows_ += num_records - page_handle.page_hdr->num_records;
+    page_handle.page_hdr->num_records = num_records;
+    page_handle.page_hdr->next_free_page_no = RM_NO_PAGE;
+    Bitmap::init(page_handle.bitmap, file_hdr_.bitmap_size);
+    for (int i = 0; i < num_records; ++i) {
+        Bitmap::set(page_handle.bitmap, i);
+    }
+    if (file_hdr_.format == RM_FORMAT_PAX || file_hdr_.num_dict_cols > 0) {
+        for (int i = 0; i < num_records; ++i) {
+            page_handle.write_record(i, data + i * file_hdr_.record_size);
+        }
+    } else {
+        memcpy(page_handle.slots, data, size);
+    }
+    // 整个页面被这一批记录覆盖，摘要也重新建立
+    zone_map_.reset_zone(page_no);
+    for (int i = 0; i < num_records; ++i) {
+        zone_map_.update(page_no, data + i * file_hdr_.record_size);
+    }
+    free_space_map_.update(page_no, page_handle.free_records());
+    if (rids != nullptr) {
+        for (int i = 0; i < num_records; ++i) {
+            rids->push_back({page_no, i});
+        }
+    }
+}
+
+/**
+ * @description: 直接写盘的批量导入结束后调用：把导入的页面和字典强制落盘，之后才能写日志发布这些页面
+ */
+void RmFileHandle::sync_loaded_pages() {
+    if (file_hdr_.num_dict_cols > 0) {
+        dictionary_.sync();
+    }
+    disk_manager_->sync_file(fd_);
 }
 
 /**
@@ -170,18 +916,23 @@ RmPageHandle RmFileHandle::create_new_page_handle() {
     // 2.更新page handle中的相关信息
     // 3.更新file_hdr_
     PageId page_id{fd_, INVALID_PAGE_ID};
-    auto &&page = buffer_pool_manager_->new_page(&page_id);
-    if (page == nullptr) {
-        throw PageNotExistError(disk_manager_->get_file_name(fd_), page_id.page_no);
+    Page *page;
+    {
+        // 并发插入可能同时新建页面，保证num_pages覆盖所有已分配的页面号
+        std::lock_guard lock(extend_latch_);
+        page = buffer_pool_manager_->new_page(&page_id);
+        if (page == nullptr) {
+            throw PageNotExistError(disk_manager_->get_file_name(fd_), page_id.page_no);
+        }
+        __atomic_store_n(&file_hdr_.num_pages, file_hdr_.num_pages + 1, __ATOMIC_RELEASE);
     }
-    RmPageHandle rm_page_handle{&file_hdr_, page};
+    RmPageHandle rm_page_handle{&file_hdr_, page, &dictionary_};
     // 重置元信息
-    rm_page_handle.page_hdr->num_records = 0;
-    rm_page_handle.page_hdr->next_free_page_no = RM_NO_PAGE;
-    Bitmap::init(rm_page_handle.bitmap, file_hdr_.bitmap_size);
-    // 新增空闲页面
-    ++file_hdr_.num_pages;
-    file_hdr_.first_free_page_no = page->get_page_id().page_no;
+    rm_page_handle.init();
+    // 空页面的摘要为空，之后每次插入扩大范围
+    zone_map_.reset_zone(page_id.page_no);
+    // 新增空闲页面，作为当前线程的插入目标
+    free_space_map_.add_page(page_id.page_no, rm_page_handle.free_records());
     return rm_page_handle;
 }
 
@@ -197,20 +948,265 @@ RmPageHandle RmFileHandle::create_page_handle() {
     //     1.1 没有空闲页：使用缓冲池来创建一个新page；可直接调用create_new_page_handle()
     //     1.2 有空闲页：直接获取第一个空闲页
     // 2. 生成page handle并返回给上层
-    if (file_hdr_.first_free_page_no == INVALID_PAGE_ID) {
+    // 空闲页面从空闲空间映射中按线程分配，不再都从链表头部取，映射可能已经过时，调用者需要再检查
+    int page_no = free_space_map_.get_insert_page();
+    if (page_no == RM_NO_PAGE) {
         return create_new_page_handle();
     }
-    return fetch_page_handle(file_hdr_.first_free_page_no);
+    return fetch_page_handle(page_no);
 }
 
 /**
- * @description: 当一个页面从没有空闲空间的状态变为有空闲空间状态时，更新文件头和页头中空闲页面相关的元数据
+ * @description: 从文件头中的空闲页面链表建立空闲空间映射，链表之外的页面都视为已满
  */
-void RmFileHandle::release_page_handle(RmPageHandle &page_handle) {
-    // Todo:
-    // 当page从已满变成未满，考虑如何更新：
-    // 1. page_handle.page_hdr->next_free_page_no
-    // 2. file_hdr_.first_free_page_no
-    page_handle.page_hdr->next_free_page_no = file_hdr_.first_free_page_no;
-    file_hdr_.first_free_page_no = page_handle.page->get_page_id().page_no;
+void RmFileHandle::load_free_space_map() {
+    int page_no = file_hdr_.first_free_page_no;
+    // 链表只在关闭文件和检查点时写回，最多遍历num_pages个页面，防止异常的链表成环
+    for (int i = 0; page_no != RM_NO_PAGE && i < file_hdr_.num_pages; ++i) {
+        auto &&page_handle = fetch_page_handle(page_no);
+        free_space_map_.update(page_no, page_handle.free_records());
+        int next_page_no = page_handle.page_hdr->next_free_page_no;
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+        page_no = next_page_no;
+    }
+}
+
+/**
+ * @description: 把空闲空间映射中有空闲空间的页面按页面号递增串成链表，写入页头和文件头，下次打开文件时据此重建映射。
+ * 在关闭文件和检查点写回文件头之前调用，next_free_page_no没有变化的页面不会被弄脏
+ */
+void RmFileHandle::write_free_list() {
+    auto &&free_pages = free_space_map_.get_free_pages();
+    int next_page_no = RM_NO_PAGE;
+    for (auto it = free_pages.rbegin(); it != free_pages.rend(); ++it) {
+        auto &&page_handle = fetch_page_handle(*it);
+        bool dirty = page_handle.page_hdr->next_free_page_no != next_page_no;
+        if (dirty) {
+            page_handle.page->WLatch();
+            page_handle.page_hdr->next_free_page_no = next_page_no;
+            page_handle.page->WUnlatch();
+        }
+        buffer_pool_manager_->unpin_page(page_handle.page, dirty);
+        next_page_no = *it;
+    }
+    file_hdr_.first_free_page_no = next_page_no;
+}
+
+std::vector<int> RmFileHandle::get_page_records(BufferAccessStrategy *strategy) const {
+    std::vector<int> records(__atomic_load_n(&file_hdr_.num_pages, __ATOMIC_ACQUIRE), 0);
+    for (int page_no = RM_FIRST_RECORD_PAGE; page_no < static_cast<int>(records.size()); ++page_no) {
+        auto &&page_handle = fetch_page_handle(page_no, strategy);
+        page_handle.page->RLatch();
+        records[page_no] = page_handle.page_hdr->num_records;
+        page_handle.page->RUnlatch();
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+    }
+    return records;
+}
+
+/**
+ * @description: 整理文件。从文件末尾往前，把记录数低于每页槽位数VACUUM_FILL_PERCENT%的页面上的记录，
+ * 从文件开头往后依次移到有空闲槽位的页面上，两边相遇时停止；最后截掉文件末尾的空页面。
+ * 移动由insert_record和delete_record完成，照常写日志，故障恢复时按日志重做或回滚
+ * @param {Context*} context 调用者的上下文，调用者已经持有表级X锁
+ * @param {int} min_pages 估计腾空的页面少于这个数时不整理
+ * @param {function} on_move 每移动一条记录调用一次，参数为原位置、新位置和记录
+ * @return {int} 腾空的页面数
+ */
+int RmFileHandle::vacuum(Context *context, int min_pages,
+                         const std::function<void(const Rid &, const Rid &, const RmRecord &)> &on_move) {
+    auto &&records = get_page_records();
+    // 腾不出足够的页面时不移动
+    if (estimate_vacuum(records) < min_pages) {
+        return 0;
+    }
+    int num_pages = static_cast<int>(records.size());
+    int per_page = file_hdr_.num_records_per_page;
+    int emptied = 0;
+    int dst = RM_FIRST_RECORD_PAGE;
+    int dst_slot = -1;
+    for (int src = num_pages - 1; src > dst; --src) {
+        if (!is_sparse_page(records[src])) {
+            continue;
+        }
+        std::vector<int> slots;
+        {
+            auto &&page_handle = fetch_page_handle(src);
+            for (int slot_no = Bitmap::first_bit(true, page_handle.bitmap, per_page); slot_no < per_page;
+                 slot_no = Bitmap::next_bit(true, page_handle.bitmap, per_page, slot_no)) {
+                slots.push_back(slot_no);
+            }
+            buffer_pool_manager_->unpin_page(page_handle.page, false);
+        }
+        for (int slot_no : slots) {
+            while (dst < src && (dst_slot = get_free_slot(dst)) == -1) {
+                ++dst;
+            }
+            if (dst >= src) {
+                break;
+            }
+            Rid rid{src, slot_no};
+            auto &&record = get_record(rid, context, RM_LOCK_TABLE);
+            // 目标页面有空闲空间时一定能放下这条记录，变长格式中也不会换到其他页面
+            Rid new_rid = insert_record({dst, dst_slot}, record->data, context);
+            delete_record(rid, context, RM_LOCK_TABLE);
+            on_move(rid, new_rid, *record);
+            --records[src];
+            ++records[new_rid.page_no];
+        }
+        emptied += records[src] == 0;
+    }
+
+    int new_num_pages = num_pages;
+    while (new_num_pages > RM_FIRST_RECORD_PAGE && records[new_num_pages - 1] == 0) {
+        --new_num_pages;
+    }
+    if (new_num_pages < num_pages) {
+        truncate(new_num_pages);
+    }
+    return emptied;
+}
+
+/**
+ * @description: 按每个页面的记录数模拟一遍vacuum，估计能腾空的页面数。变长格式按槽位数估计
+ * @param {vector<int>} records get_page_records的结果
+ * @return {int} 估计腾空的页面数
+ */
+int RmFileHandle::estimate_vacuum(std::vector<int> records) const {
+    int per_page = file_hdr_.num_records_per_page;
+    int emptied = 0;
+    for (int src = static_cast<int>(records.size()) - 1, dst = RM_FIRST_RECORD_PAGE; src > dst; --src) {
+        if (!is_sparse_page(records[src])) {
+            continue;
+        }
+        while (records[src] > 0 && dst < src) {
+            int n = std::min(per_page - records[dst], records[src]);
+            records[dst] += n;
+            records[src] -= n;
+            if (records[dst] == per_page) {
+                ++dst;
+            }
+        }
+        emptied += records[src] == 0;
+    }
+    return emptied;
+}
+
+// 页面page_no上的一个空闲槽位，页面没有空闲空间时返回-1
+int RmFileHandle::get_free_slot(int page_no) const {
+    auto &&page_handle = fetch_page_handle(page_no);
+    int slot_no = page_handle.has_free_space()
+                      ? Bitmap::first_bit(false, page_handle.bitmap, file_hdr_.num_records_per_page)
+                      : -1;
+    buffer_pool_manager_->unpin_page(page_handle.page, false);
+    return slot_no;
+}
+
+/**
+ * @description: 截掉页面号不小于num_pages的空页面。被截掉的页面不会再被访问，直接从缓冲池中丢弃
+ * @param {int} num_pages 保留的页面个数
+ */
+void RmFileHandle::truncate(int num_pages) {
+    std::lock_guard lock(extend_latch_);
+    free_space_map_.truncate(num_pages);
+    for (int page_no = num_pages; page_no < file_hdr_.num_pages; ++page_no) {
+        if (memory_pages_ != nullptr && page_no < RM_MEMORY_MAX_PAGES) {
+            memory_pages_[page_no].store(nullptr, std::memory_order_relaxed);
+        }
+        buffer_pool_manager_->delete_page({fd_, page_no});
+    }
+    __atomic_store_n(&file_hdr_.num_pages, num_pages, __ATOMIC_RELEASE);
+    disk_manager_->truncate_file(fd_, num_pages);
+}
+
+/**
+ * @description: 把数据操作日志写入日志缓冲区，并用该日志的lsn标记页面
+ * 调用时页面仍被pin住，保证页面在带上lsn之前不会被淘汰写盘，淘汰时缓冲池据此先把日志刷到该lsn
+ * @param {LogRecord*} log_record 数据操作日志
+ * @param {Page*} page 被修改的页面
+ * @param {Context*} context
+ */
+void RmFileHandle::append_log(LogRecord *log_record, Page *page, Context *context) {
+    TransactionManager::log_begin(context->txn_, context->log_mgr_);
+    log_record->prev_lsn_ = context->txn_->get_prev_lsn();
+    // 先于分配lsn设置recLSN，保证并发的检查点看到的recLSN不大于页面上第一条未落盘修改的lsn
+    page->update_rec_lsn(context->log_mgr_->get_next_lsn());
+    lsn_t lsn = context->log_mgr_->add_log_to_buffer(log_record);
+    context->txn_->set_prev_lsn(lsn);
+    page->set_page_lsn(lsn);
+}
+
+/**
+ * @description: 把同一个页面上的一批数据操作日志一次写入日志缓冲区，页面标记为最后一条日志的lsn
+ * @param {vector<LogRecord*>&} log_records 数据操作日志
+ * @param {Page*} page 被修改的页面
+ * @param {Context*} context
+ */
+void RmFileHandle::append_logs(std::vector<LogRecord *> &log_records, Page *page, Context *context) {
+    TransactionManager::log_begin(context->txn_, context->log_mgr_);
+    page->update_rec_lsn(context->log_mgr_->get_next_lsn());
+    lsn_t lsn = context->log_mgr_->add_logs_to_buffer(log_records.data(), static_cast<int>(log_records.size()),
+                                                       context->txn_->get_prev_lsn());
+    context->txn_->set_prev_lsn(lsn);
+    page->set_page_lsn(lsn);
+}
+
+/**
+ * @description: 故障恢复时保证页面page_no存在。文件头只在关闭表时写回，崩溃后其中的num_pages可能落后于磁盘上实际的页面数，
+ * 而日志中可能还记录了从未落盘的新页面，这些页面需要重新分配出来
+ * @param {int} page_no 日志中涉及的页面号
+ */
+void RmFileHandle::extend_to_page(int page_no) {
+    if (page_no < file_hdr_.num_pages) {
+        return;
+    }
+    int disk_pages = disk_manager_->get_file_size(disk_manager_->get_file_name(fd_)) / PAGE_SIZE;
+    if (disk_pages > file_hdr_.num_pages) {
+        file_hdr_.num_pages = disk_pages;
+        disk_manager_->set_fd2pageno(fd_, file_hdr_.num_pages);
+    }
+    // 不经过create_new_page_handle，避免修改空闲空间映射，映射在恢复结束后统一重建
+    while (page_no >= file_hdr_.num_pages) {
+        PageId page_id{fd_, INVALID_PAGE_ID};
+        auto &&page = buffer_pool_manager_->new_page(&page_id);
+        if (page == nullptr) {
+            throw PageNotExistError(disk_manager_->get_file_name(fd_), page_id.page_no);
+        }
+        RmPageHandle rm_page_handle{&file_hdr_, page, &dictionary_};
+        rm_page_handle.init();
+        page->set_page_lsn(INVALID_LSN);
+        ++file_hdr_.num_pages;
+        buffer_pool_manager_->unpin_page(page, true);
+    }
+}
+
+/**
+ * @description: 故障恢复使用：日志中发布过的批量导入页面在写日志之前已经落盘，把文件的页面数推进到end_page，
+ * 不新建也不初始化页面
+ * @param {int} end_page 导入的最后一个页面号加一
+ */
+void RmFileHandle::recover_loaded_pages(int end_page) {
+    if (end_page <= file_hdr_.num_pages) {
+        return;
+    }
+    file_hdr_.num_pages = end_page;
+    disk_manager_->set_fd2pageno(fd_, end_page);
+}
+
+/**
+ * @description: 故障恢复结束后根据每个页面的空闲空间重建空闲空间映射和空闲页面链表，并重新统计记录数
+ */
+void RmFileHandle::rebuild_free_list() {
+    // 恢复直接修改页面，没有维护区域映射和记录数
+    zone_map_.clear();
+    free_space_map_.clear();
+    int64_t num_rows = 0;
+    for (int page_no = RM_FIRST_RECORD_PAGE; page_no < file_hdr_.num_pages; ++page_no) {
+        auto &&page_handle = fetch_page_handle(page_no);
+        free_space_map_.update(page_no, page_handle.free_records());
+        num_rows += page_handle.page_hdr->num_records;
+        buffer_pool_manager_->unpin_page(page_handle.page, false);
+    }
+    num_rows_.store(num_rows);
+    write_free_list();
 }
@@ -12,11 +12,20 @@ See the Mulan PSL v2 for more details. */
 
 #include <assert.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 #include "bitmap.h"
 #include "common/context.h"
 #include "rm_defs.h"
+#include "rm_dictionary.h"
+#include "rm_free_space_map.h"
+#include "rm_zone_map.h"
+#include "storage/page_guard.h"
 
 class RmManager;
 
@@ -26,18 +35,110 @@ struct RmPageHandle {
     Page *page; // 页面的实际数据，包括页面存储的数据、元信息等
     RmPageHdr *page_hdr; // page->data的第一部分，存储页面元信息，指针指向首地址，长度为sizeof(RmPageHdr)
     char *bitmap; // page->data的第二部分，存储页面的bitmap，指针指向首地址，长度为file_hdr->bitmap_size
-    char *slots; // page->data的第三部分，存储表的记录，指针指向首地址，每个slot的长度为file_hdr->record_size
+    char *slots; // page->data的第三部分，存储表的记录，指针指向首地址，每个slot的长度为file_hdr->slot_size；列存格式中依次存放各个mini page
+    RmSlottedPageHdr *slotted_hdr = nullptr; // 仅变长格式：RmPageHdr之后的页头
+    RmSlot *slot_dir = nullptr; // 仅变长格式：槽位目录，位于bitmap之前
+    RmDictionary *dict; // 定长格式中有字典编码的字段时，读写记录经过它编码和解码
 
-    RmPageHandle(const RmFileHdr *fhdr_, Page *page_) : file_hdr(fhdr_), page(page_) {
+    RmPageHandle(const RmFileHdr *fhdr_, Page *page_, RmDictionary *dict_ = nullptr)
+        : file_hdr(fhdr_), page(page_), dict(dict_) {
         page_hdr = reinterpret_cast<RmPageHdr *>(page->get_data() + page->OFFSET_PAGE_HDR);
-        bitmap = page->get_data() + sizeof(RmPageHdr) + page->OFFSET_PAGE_HDR;
-        slots = bitmap + file_hdr->bitmap_size;
+        if (file_hdr->format == RM_FORMAT_SLOTTED) {
+            slotted_hdr = reinterpret_cast<RmSlottedPageHdr *>(page->get_data() + RM_PAGE_HDR_SIZE);
+            slot_dir = reinterpret_cast<RmSlot *>(slotted_hdr + 1);
+            bitmap = reinterpret_cast<char *>(slot_dir + file_hdr->num_records_per_page);
+            slots = nullptr;
+        } else {
+            bitmap = page->get_data() + sizeof(RmPageHdr) + page->OFFSET_PAGE_HDR;
+            slots = bitmap + file_hdr->bitmap_size;
+        }
     }
 
-    // 返回指定slot_no的slot存储收地址
+    // 返回指定slot_no的slot存储收地址，只用于定长格式
     char *get_slot(int slot_no) const {
-        return slots + slot_no * file_hdr->record_size; // slots的首地址 + slot个数 * 每个slot的大小(每个record的大小)
+        return slots + slot_no * file_hdr->slot_size; // slots的首地址 + slot个数 * 每个slot的大小
     }
+
+    // 列存格式：第col个mini page的首地址，第slot_no条记录的值位于其后slot_no * file_hdr->pax_cols[col].len处
+    char *get_column(int col) const {
+        return slots + file_hdr->num_records_per_page * file_hdr->pax_cols[col].offset;
+    }
+
+    // 列存格式：只把cols中的mini page上slot_no的值拷贝到buf中对应的偏移处，buf中其他字段不变
+    void read_columns(int slot_no, const std::vector<int> &cols, char *buf) const;
+
+    // 以下接口对所有格式通用，记录都是record_size大小的解码后的形式
+
+    // 初始化新页面的页头、bitmap和槽位目录
+    void init();
+
+    // 返回slot_no上的记录：定长格式直接指向槽位，变长格式、字典编码解码和列存格式拼接到buf（至少record_size字节）中并返回buf
+    const char *get_record(int slot_no, char *buf) const;
+
+    void read_record(int slot_no, char *buf) const { memcpy(buf, get_record(slot_no, buf), file_hdr->record_size); }
+
+    // 变长格式中页面能否把slot_no上的记录写成buf，定长格式总是可以
+    bool can_write_record(int slot_no, const char *buf) const;
+
+    // 把buf写到slot_no上，覆盖原有的记录；变长格式页面空间不够时返回false且不修改页面。不修改bitmap
+    bool write_record(int slot_no, const char *buf);
+
+    // 释放slot_no上记录占用的空间，不修改bitmap
+    void erase_record(int slot_no);
+
+    // 还能插入的记录数：空槽位数，变长格式还受去掉预留空间后能放下的最长记录数限制
+    int free_records() const;
+
+    // 能否再插入一条记录
+    bool has_free_space() const { return free_records() > 0; }
+
+private:
+    // 变长格式：槽位目录和bitmap之后，记录区的起始偏移
+    int data_begin() const { return static_cast<int>(bitmap + file_hdr->bitmap_size - page->get_data()); }
+
+    int free_bytes() const { return PAGE_SIZE - data_begin() - slotted_hdr->used_bytes; }
+
+    void compact();
+};
+
+/* 记录的只读视图，data直接指向缓冲池页面中的槽位，不分配内存也不拷贝数据。
+ * 视图持有所在页面的pin，同一页面上的后续记录复用这个pin；视图只在下一次get_record_view之前有效，
+ * 需要保留记录时（排序、连接的外表等）用to_record拷贝一份 */
+class RmRecordView {
+    friend class RmFileHandle;
+
+    BasicPageGuard guard_; // 当前页面的pin
+    Page *page_ = nullptr;
+    RmRecord record_; // 不拥有数据，allocated_为false
+    char buf_[RM_MAX_RECORD_SIZE]; // 变长格式和字典编码的记录解码到这里，列存格式的记录拼接到这里
+    std::vector<int> columns_; // 列存格式中只读取这些mini page
+    bool all_columns_ = true; // 列存格式中读取整条记录
+
+public:
+    const RmRecord *get() const { return &record_; }
+
+    // 列存格式的表只读取columns中的mini page，其余字段的内容不确定；其他格式忽略
+    void set_columns(std::vector<int> columns) {
+        columns_ = std::move(columns);
+        all_columns_ = false;
+    }
+
+    std::unique_ptr<RmRecord> to_record() const { return std::make_unique<RmRecord>(record_.size, record_.data); }
+
+    // 放掉页面的pin
+    void reset() {
+        guard_.Drop();
+        page_ = nullptr;
+        record_.data = nullptr;
+    }
+};
+
+/* 在线建索引期间表上被修改过的记录：依次是记录号和修改前的记录，插入到空槽位的修改没有修改前的记录 */
+struct RmChangeLog {
+    std::mutex latch;
+    std::vector<Rid> rids;
+    std::vector<bool> has_old;
+    std::vector<char> old_records;  // 有修改前记录的修改各占record_size字节，按顺序存放
 };
 
 /* 每个RmFileHandle对应一个表的数据文件，里面有多个page，每个page的数据封装在RmPageHandle中 */
@@ -50,6 +151,20 @@ private:
     BufferPoolManager *buffer_pool_manager_;
     int fd_; // 打开文件后产生的文件句柄
     RmFileHdr file_hdr_; // 文件头，维护当前表文件的元数据
+    RmFreeSpaceMap free_space_map_; // 每个页面的空闲空间，插入时据此选择页面，代替并发插入时的空闲页面链表
+    std::mutex extend_latch_; // 新建页面时保护file_hdr_.num_pages
+    mutable RmZoneMap zone_map_; // 每个页面数值字段的最小值和最大值，扫描时跳过页面，只读的扫描也会建立摘要
+    mutable RmDictionary dictionary_; // 定长格式中字典编码字段的字典，没有这样的字段时为空
+    std::atomic<int64_t> num_rows_{0}; // 表中的记录数，插入删除（包括回滚）和导入时维护，打开表时由SmManager从DbMeta中设置，恢复后重新统计
+    std::atomic<uint64_t> change_count_{0}; // 修改计数，写过这个表的事务提交或回滚后以及导入后加一，结果缓存据此判断结果是否过期
+    std::atomic<uint64_t> rows_modified_{0}; // 上次ANALYZE之后DML插入、删除和更新的记录数，后台据此判断统计信息是否过期
+    std::atomic<RmChangeLog *> change_log_{nullptr}; // 不为空时插入、删除和更新都记到这里，在线建索引使用
+    mutable std::shared_mutex change_log_latch_;     // 写者使用change_log_时持有共享锁，换掉change_log_时持有排他锁
+    std::atomic<int> sync_scans_{0};     // 正在进行的同步扫描数
+    std::atomic<int> sync_scan_page_{RM_NO_PAGE}; // 同步扫描最近报告的页面
+    bool unlogged_ = false; // 不写日志的表（UNLOGGED和临时表），修改不产生日志记录，打开表时由SmManager设置
+    // STORAGE = MEMORY的表：常驻页面第一次访问后记下地址，之后按页面号直接定位，不查页表也不pin
+    std::unique_ptr<std::atomic<Page *>[]> memory_pages_;
 
 public:
     RmFileHandle(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager, int fd)
@@ -58,12 +173,83 @@ public:
         // 这里实际就是初始化file_hdr，只不过是从磁盘中读出进行初始化
         // init file_hdr_
         disk_manager_->read_page(fd, RM_FILE_HDR_PAGE, (char *) &file_hdr_, sizeof(file_hdr_));
+        if (file_hdr_.slot_size == 0) {
+            file_hdr_.slot_size = file_hdr_.record_size;
+        }
+        // 要在数据页进入缓冲池之前设置
+        if (file_hdr_.in_memory) {
+            disk_manager_->set_file_in_memory(fd, true);
+            memory_pages_.reset(new std::atomic<Page *>[RM_MEMORY_MAX_PAGES]());
+        }
+        if (file_hdr_.num_dict_cols > 0) {
+            dictionary_.open(disk_manager_->get_file_name(fd) + RM_DICT_FILE_SUFFIX, file_hdr_);
+        }
         // disk_manager管理的fd对应的文件中，设置从file_hdr_.num_pages开始分配page_no
         disk_manager_->set_fd2pageno(fd, file_hdr_.num_pages);
+        load_free_space_map();
     }
 
     RmFileHdr get_file_hdr() { return file_hdr_; }
     int GetFd() { return fd_; }
+    int get_table_id() const { return file_hdr_.table_id; }
+
+    /* 表中的记录数，给优化器估算代价用。保存在DbMeta中，崩溃后可能和实际有偏差，ANALYZE时校准 */
+    size_t get_num_rows() const { return static_cast<size_t>(std::max<int64_t>(num_rows_.load(), 0)); }
+    void set_num_rows(size_t num_rows) { num_rows_.store(static_cast<int64_t>(num_rows)); }
+
+    /* 修改计数。在修改对新的快照可见之后调用note_change，读到的计数没有变时，之后开始的快照中表的内容也没有变 */
+    uint64_t change_count() const { return change_count_.load(); }
+    void note_change() { change_count_.fetch_add(1); }
+
+    /* 上次ANALYZE之后修改的记录数，DML算子执行完时累加，ANALYZE开始时清零 */
+    uint64_t rows_modified() const { return rows_modified_.load(); }
+    void note_rows_modified(uint64_t rows) { rows_modified_.fetch_add(rows); }
+    void reset_rows_modified() { rows_modified_.store(0); }
+
+    /* 在线建索引：之后经过记录层的插入、删除和更新（包括回滚）都记到log中，传nullptr时停止记录。
+     * 停止时调用者要保证没有并发的修改，一般持有表X锁 */
+    // 返回后不再有写者使用原来的change_log_
+    void set_change_log(RmChangeLog *log) {
+        std::unique_lock lock(change_log_latch_);
+        change_log_.store(log);
+    }
+    bool is_logging_changes() const { return change_log_.load() != nullptr; }
+
+    void set_unlogged(bool unlogged) { unlogged_ = unlogged; }
+    bool is_unlogged() const { return unlogged_; }
+
+    bool is_in_memory() const { return memory_pages_ != nullptr; }
+
+    /* 同步扫描：大表上新开始的全表扫描从正在进行的扫描最近报告的页面开始，和它一起读之后的页面
+     * （落后的一方在缓冲池中命中领先一方刚读入的页面），到文件末尾后再从头扫到开始的页面。
+     * begin_sync_scan返回开始的页面，没有正在进行的扫描时从第一个数据页开始；和end_sync_scan配对 */
+    int begin_sync_scan() {
+        int page_no = sync_scan_page_.load(std::memory_order_relaxed);
+        bool active = sync_scans_.fetch_add(1) > 0;
+        return active && page_no > RM_FIRST_RECORD_PAGE && page_no < file_hdr_.num_pages ? page_no
+                                                                                          : RM_FIRST_RECORD_PAGE;
+    }
+    void report_sync_scan(int page_no) { sync_scan_page_.store(page_no, std::memory_order_relaxed); }
+    void end_sync_scan() { sync_scans_.fetch_sub(1); }
+
+    /* 设置区域映射记录最小值和最大值的数值字段，打开表时由SmManager设置 */
+    void set_zone_cols(std::vector<RmZoneCol> cols) { zone_map_.set_cols(std::move(cols)); }
+
+    /* offset处的字段在区域映射中的下标，没有记录该字段时返回-1 */
+    int get_zone_col(int offset) const { return zone_map_.get_col(offset); }
+
+    /* 定长格式：offset处的字段在槽位中编码的偏移，col输出字段在字典中的下标；不是字典编码的字段时返回-1 */
+    int get_dict_code_offset(int offset, int *col) const {
+        return file_hdr_.num_dict_cols > 0 ? dictionary_.get_code_offset(offset, col) : -1;
+    }
+
+    /* 第col个字典编码字段中value的编码，字典中没有该值时返回-1，即没有记录的该字段等于value */
+    int get_dict_code(int col, const char *value) const { return dictionary_.lookup(col, value); }
+
+    /* 定长格式：视图当前所在页面上slot_no的槽位，字典编码的字段还没有解码，在视图换页或reset之前有效 */
+    const char *get_slot(const RmRecordView &view, int slot_no) const {
+        return RmPageHandle(&file_hdr_, view.page_, &dictionary_).get_slot(slot_no);
+    }
 
     /* 判断指定位置上是否已经存在一条记录，通过Bitmap来判断 */
     bool is_record(const Rid &rid) const {
@@ -71,22 +257,114 @@ public:
         return Bitmap::is_set(page_handle.bitmap, rid.slot_no); // page的slot_no位置上是否有record
     }
 
-    std::unique_ptr<RmRecord> get_record(const Rid &rid, Context *context) const;
+    std::unique_ptr<RmRecord> get_record(const Rid &rid, Context *context,
+                                         RmLockGranularity held = RM_LOCK_ROW) const;
+
+    void get_record_view(const Rid &rid, RmRecordView &view, Context *context,
+                         RmLockGranularity held = RM_LOCK_ROW) const;
+
+    /* 列存格式：存放[offset, offset + len)字段的mini page号，该字段不单独占一个mini page时返回-1 */
+    int get_pax_column(int offset, int len) const;
+
+    /* 列存格式：覆盖fields中所有字段（偏移，长度）的mini page号，升序且不重复 */
+    std::vector<int> get_pax_columns(const std::vector<std::pair<int, int>> &fields) const;
+
+    /* 列存格式：视图当前所在页面上第col个mini page的首地址，在视图换页或reset之前有效 */
+    const char *get_column(const RmRecordView &view, int col) const {
+        return RmPageHandle(&file_hdr_, view.page_, &dictionary_).get_column(col);
+    }
 
     Rid insert_record(char *buf, Context *context);
 
-    void insert_record(const Rid &rid, char *buf);
+    Rid insert_record(const Rid &rid, char *buf, Context *context = nullptr);
+
+    /* 批量插入：尽量把多条记录放进同一个页面，每个页面只pin一次，返回每条记录的位置 */
+    std::vector<Rid> insert_records(const std::vector<char *> &bufs, Context *context);
+
+    void delete_record(const Rid &rid, Context *context, RmLockGranularity held = RM_LOCK_ROW);
+
+    /* 变长格式中记录变长后原页面放不下时，记录会被移到其他页面，返回新的记录号，调用者需要据此更新索引 */
+    Rid update_record(const Rid &rid, char *buf, Context *context);
 
-    void delete_record(const Rid &rid, Context *context);
+    /* 提交时应用推迟的递增：在页面latch下读出当前的记录，加上deltas后写回，和update_record一样记日志、保存版本。
+     * 不加锁，调用者已经保证提交顺序；记录长度不变，不会移动。old_record和new_record至少记录长度 */
+    void increment_record(const Rid &rid, const std::vector<IncrementDelta> &deltas, Context *context,
+                          RmRecord &old_record, RmRecord &new_record);
 
-    void update_record(const Rid &rid, char *buf, Context *context);
+    /* 删除和更新在修改索引之前调用，把rid上原来的记录放进版本存储。
+     * 插入、删除和更新修改页面之前也会保存，这里提前到修改索引之前，快照读沿着索引找不到这条记录时也能读到原来的版本 */
+    void save_version(const Rid &rid, const RmRecord &record, Context *context) const;
+
+    /* 故障恢复使用：把记录写到文件末尾的新页面上，不记日志，索引在恢复结束后重建 */
+    Rid append_record(const char *buf);
 
     RmPageHandle create_new_page_handle();
 
-    RmPageHandle fetch_page_handle(int page_no) const;
+    RmPageHandle fetch_page_handle(int page_no, BufferAccessStrategy *strategy = nullptr) const;
+
+    /* 批量导入使用：把num_records条连续存放的记录从页面page_no开始直接写入，不记日志，返回下一批记录应写入的页面号。
+     * rids不为空时输出每条记录的位置 */
+    int load_record(int page_no, const char *data, int num_records, int size,
+                    BufferAccessStrategy *strategy = nullptr, std::vector<Rid> *rids = nullptr);
+
+    /* 批量导入使用：定长和列存格式中把一页记录在page_buf中组装好，直接写到文件末尾的新页面page_no上，不经过缓冲池 */
+    int load_record_direct(int page_no, const char *data, int num_records, int size, char *page_buf,
+                           std::vector<Rid> *rids = nullptr);
+
+    /* 直接写盘的导入结束后让页面和字典落盘，之后调用者写批量导入日志发布这些页面 */
+    void sync_loaded_pages();
+
+    void set_first_free_page_no(int page_no) { file_hdr_.first_free_page_no = page_no; }
+
+    /* 故障恢复使用：保证页面page_no存在，并在恢复结束后重建空闲页面链表 */
+    void extend_to_page(int page_no);
+
+    /* 故障恢复使用：把日志中发布过的批量导入页面接回文件，页面数推进到end_page */
+    void recover_loaded_pages(int end_page);
+
+    void rebuild_free_list();
+
+    /* 每个页面上的记录数，下标为页面号 */
+    std::vector<int> get_page_records(BufferAccessStrategy *strategy = nullptr) const;
+
+    /* 整理文件：把稀疏页面上的记录移到前面有空闲空间的页面，截掉文件末尾的空页面，其他腾空的页面留给之后的插入。
+     * 调用者持有表级X锁，每移动一条记录调用一次on_move(原位置, 新位置, 记录)，据此更新索引。
+     * 估计腾空的页面少于min_pages时不移动，返回腾空的页面数 */
+    int vacuum(Context *context, int min_pages,
+               const std::function<void(const Rid &, const Rid &, const RmRecord &)> &on_move);
+
+    /* 根据get_page_records的结果估计vacuum能腾空的页面数，不需要持有表锁 */
+    int estimate_vacuum(std::vector<int> records) const;
+
+    /* 关闭文件和检查点使用：把空闲空间映射写回空闲页面链表，之后再写回文件头 */
+    void write_free_list();
 
 private:
     RmPageHandle create_page_handle();
 
-    void release_page_handle(RmPageHandle &page_handle);
+    void load_free_space_map();
+
+    void build_zone(const RmPageHandle &page_handle) const;
+
+    void fill_loaded_page(RmPageHandle &page_handle, int page_no, const char *data, int num_records, int size,
+                          std::vector<Rid> *rids);
+
+    // 记录数低于每页槽位数VACUUM_FILL_PERCENT%的非空页面，vacuum把其中的记录移走
+    bool is_sparse_page(int num_records) const {
+        return num_records > 0 && num_records * 100 < file_hdr_.num_records_per_page * VACUUM_FILL_PERCENT;
+    }
+
+    int get_free_slot(int page_no) const;
+
+    void truncate(int num_pages);
+
+    void append_log(LogRecord *log_record, Page *page, Context *context);
+
+    void append_logs(std::vector<LogRecord *> &log_records, Page *page, Context *context);
+
+    // 修改slot_no上的记录之前记到change_log_，调用者持有页面写latch
+    void log_change(const RmPageHandle &page_handle, int slot_no, bool had_record) const;
+
+    // 修改slot_no上的记录之前把原来的记录放进版本存储，调用者持有页面写latch
+    void save_slot_version(const RmPageHandle &page_handle, int slot_no, Context *context) const;
 };
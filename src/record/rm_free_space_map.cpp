@@ -0,0 +1,123 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "rm_free_space_map.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include "rm_defs.h"
+
+RmFreeSpaceMap::RmFreeSpaceMap() { std::fill(targets_, targets_ + RM_INSERT_TARGETS, RM_NO_PAGE); }
+
+/**
+ * @description: 设置页面还能插入的记录条数，页面号超出映射范围时扩展映射
+ * @param {int} page_no 页面号
+ * @param {int} free_records 页面还能插入的记录条数
+ */
+void RmFreeSpaceMap::update(int page_no, int free_records) {
+    uint8_t value = static_cast<uint8_t>(std::clamp(free_records, 0, UINT8_MAX));
+    std::lock_guard lock(latch_);
+    if (page_no >= static_cast<int>(free_.size())) {
+        if (value == 0) {
+            return;
+        }
+        free_.resize(page_no + 1, 0);
+    }
+    num_free_pages_ += (value != 0) - (free_[page_no] != 0);
+    free_[page_no] = value;
+}
+
+/**
+ * @description: 为当前线程选一个可以插入的页面。当前目标页面还有空间时直接返回，
+ * 否则从映射中找一个有空闲空间且没有被其他目标占用的页面作为新的目标
+ * @return {int} 页面号，没有可用的页面时返回RM_NO_PAGE
+ */
+int RmFreeSpaceMap::get_insert_page() {
+    std::lock_guard lock(latch_);
+    int &target = current_target();
+    if (has_free_space(target)) {
+        return target;
+    }
+    target = RM_NO_PAGE;
+    // 有空闲空间的页面都被其他目标占用时不用查找，直接让调用者新建页面
+    int occupied = 0;
+    for (int page_no : targets_) {
+        occupied += has_free_space(page_no);
+    }
+    if (num_free_pages_ <= occupied) {
+        return RM_NO_PAGE;
+    }
+    int size = static_cast<int>(free_.size());
+    for (int i = 0; i < size; ++i, cursor_ = (cursor_ + 1) % size) {
+        if (free_[cursor_] != 0 && !is_target(cursor_)) {
+            target = cursor_;
+            return target;
+        }
+    }
+    return RM_NO_PAGE;
+}
+
+/**
+ * @description: 登记新建的页面，并作为当前线程的插入目标
+ * @param {int} page_no 新页面的页面号
+ * @param {int} free_records 新页面能插入的记录条数
+ */
+void RmFreeSpaceMap::add_page(int page_no, int free_records) {
+    update(page_no, free_records);
+    std::lock_guard lock(latch_);
+    current_target() = page_no;
+}
+
+std::vector<int> RmFreeSpaceMap::get_free_pages() {
+    std::lock_guard lock(latch_);
+    std::vector<int> pages;
+    pages.reserve(num_free_pages_);
+    for (int page_no = 0; page_no < static_cast<int>(free_.size()); ++page_no) {
+        if (free_[page_no] != 0) {
+            pages.push_back(page_no);
+        }
+    }
+    return pages;
+}
+
+void RmFreeSpaceMap::clear() {
+    std::lock_guard lock(latch_);
+    free_.clear();
+    num_free_pages_ = 0;
+    cursor_ = 0;
+    std::fill(targets_, targets_ + RM_INSERT_TARGETS, RM_NO_PAGE);
+}
+
+void RmFreeSpaceMap::truncate(int num_pages) {
+    std::lock_guard lock(latch_);
+    for (int page_no = num_pages; page_no < static_cast<int>(free_.size()); ++page_no) {
+        num_free_pages_ -= free_[page_no] != 0;
+    }
+    if (num_pages < static_cast<int>(free_.size())) {
+        free_.resize(num_pages);
+    }
+    for (int &target : targets_) {
+        if (target >= num_pages) {
+            target = RM_NO_PAGE;
+        }
+    }
+    cursor_ = 0;
+}
+
+int &RmFreeSpaceMap::current_target() {
+    size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return targets_[hash % RM_INSERT_TARGETS];
+}
+
+bool RmFreeSpaceMap::is_target(int page_no) const {
+    return std::find(targets_, targets_ + RM_INSERT_TARGETS, page_no) != targets_ + RM_INSERT_TARGETS;
+}
@@ -0,0 +1,58 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "common/config.h"
+
+/* 表数据文件的空闲空间映射，只在内存中维护。每个页面一个字节，记录该页面还能插入的记录条数（超过255记为255），0表示已满。
+ * 插入的线程按线程号分到RM_INSERT_TARGETS个插入目标上，每个目标各自占用一个有空闲空间的页面，
+ * 并发插入分散在不同页面上；目标页面满了再从映射中找一个没有被其他目标占用的页面 */
+class RmFreeSpaceMap {
+public:
+    RmFreeSpaceMap();
+
+    // 设置页面page_no还能插入的记录条数
+    void update(int page_no, int free_records);
+
+    // 为当前线程选一个可以插入的页面，没有时返回RM_NO_PAGE，调用者新建页面后用add_page登记
+    int get_insert_page();
+
+    // 登记新建的页面，并作为当前线程的插入目标
+    void add_page(int page_no, int free_records);
+
+    // 所有有空闲空间的页面，按页面号递增排列
+    std::vector<int> get_free_pages();
+
+    // 清空映射，故障恢复重建空闲页面信息时使用
+    void clear();
+
+    // 去掉页面号不小于num_pages的页面，截断文件时使用
+    void truncate(int num_pages);
+
+private:
+    int &current_target();
+
+    bool is_target(int page_no) const;
+
+    bool has_free_space(int page_no) const {
+        return page_no >= 0 && page_no < static_cast<int>(free_.size()) && free_[page_no] != 0;
+    }
+
+    std::mutex latch_;
+    std::vector<uint8_t> free_; // 每个页面还能插入的记录条数
+    int num_free_pages_ = 0; // free_中不为0的页面个数
+    int cursor_ = 0; // 查找有空闲空间页面的起点，每次从上次找到的位置往后找
+    int targets_[RM_INSERT_TARGETS]; // 每个插入目标当前占用的页面号
+};
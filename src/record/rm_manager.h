@@ -12,6 +12,9 @@ See the Mulan PSL v2 for more details. */
 
 #include <assert.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "bitmap.h"
 #include "rm_defs.h"
 #include "rm_file_handle.h"
@@ -31,8 +34,14 @@ public:
      * @description: 创建表的数据文件并初始化相关信息
      * @param {string&} filename 要创建的文件名称
      * @param {int} record_size 表中记录的大小
+     * @param {RmFormat} format 页面格式
+     * @param {vector<RmVarCol>&} cols 变长格式中按实际长度存储的字符串字段，为空时退回定长格式；列存格式中表的所有字段
+     * @param {vector<RmVarCol>&} dict_cols 定长格式中字典编码的字段，槽位中只存编码
+     * @param {bool} in_memory 数据页常驻缓冲池
      */
-    void create_file(const std::string &filename, int record_size) {
+    void create_file(const std::string &filename, int record_size, int table_id = 0,
+                     RmFormat format = RM_FORMAT_FIXED, const std::vector<RmVarCol> &cols = {},
+                     const std::vector<RmVarCol> &dict_cols = {}, bool in_memory = false) {
         if (record_size < 1 || record_size > RM_MAX_RECORD_SIZE) {
             throw InvalidRecordSizeError(record_size);
         }
@@ -44,9 +53,24 @@ public:
         file_hdr.record_size = record_size;
         file_hdr.num_pages = 1;
         file_hdr.first_free_page_no = RM_NO_PAGE;
-        // We have: sizeof(hdr) + (n + 7) / 8 + n * record_size <= PAGE_SIZE
-        file_hdr.num_records_per_page =
-                (BITMAP_WIDTH * (PAGE_SIZE - 1 - (int) sizeof(RmFileHdr)) + 1) / (1 + record_size * BITMAP_WIDTH);
+        file_hdr.table_id = table_id;
+        file_hdr.slot_size = record_size;
+        file_hdr.in_memory = in_memory;
+        if (format == RM_FORMAT_SLOTTED && !cols.empty()) {
+            init_slotted_hdr(file_hdr, cols);
+        } else {
+            // 列存格式每页的记录数和定长格式相同，只是页面内按列排列
+            file_hdr.format = format == RM_FORMAT_PAX ? RM_FORMAT_PAX : RM_FORMAT_FIXED;
+            if (file_hdr.format == RM_FORMAT_FIXED && !dict_cols.empty()) {
+                init_dict_hdr(file_hdr, dict_cols);
+            }
+            // We have: sizeof(hdr) + (n + 7) / 8 + n * slot_size <= PAGE_SIZE
+            file_hdr.num_records_per_page =
+                    (BITMAP_WIDTH * (PAGE_SIZE - 1 - RM_PAGE_HDR_SIZE) + 1) / (1 + file_hdr.slot_size * BITMAP_WIDTH);
+            if (file_hdr.format == RM_FORMAT_PAX) {
+                init_pax_hdr(file_hdr, cols);
+            }
+        }
         file_hdr.bitmap_size = (file_hdr.num_records_per_page + BITMAP_WIDTH - 1) / BITMAP_WIDTH;
 
         // 将file header写入磁盘文件（名为file name，文件描述符为fd）中的第0页
@@ -55,11 +79,114 @@ public:
         disk_manager_->close_file(fd);
     }
 
+private:
+    /**
+     * @description: 初始化变长格式的文件头。每页的槽位数按字符串平均占声明长度的SLOTTED_PAGE_STRING_FILL%估算，
+     * 同时保证空页面去掉预留空间后能放下一条最长的记录
+     */
+    static void init_slotted_hdr(RmFileHdr &file_hdr, const std::vector<RmVarCol> &var_cols) {
+        file_hdr.format = RM_FORMAT_SLOTTED;
+        file_hdr.num_var_cols = std::min(static_cast<int>(var_cols.size()), RM_MAX_VAR_COLS);
+        std::copy(var_cols.begin(), var_cols.begin() + file_hdr.num_var_cols, file_hdr.var_cols);
+        std::sort(file_hdr.var_cols, file_hdr.var_cols + file_hdr.num_var_cols,
+                  [](const RmVarCol &a, const RmVarCol &b) { return a.offset < b.offset; });
+        int var_bytes = 0;
+        for (int i = 0; i < file_hdr.num_var_cols; ++i) {
+            var_bytes += file_hdr.var_cols[i].len;
+        }
+        int len_bytes = file_hdr.num_var_cols * static_cast<int>(sizeof(uint16_t));
+        file_hdr.max_tuple_size = file_hdr.record_size + len_bytes;
+        int estimated_size = file_hdr.record_size - var_bytes + len_bytes + var_bytes * SLOTTED_PAGE_STRING_FILL / 100;
+
+        int reserve = PAGE_SIZE * SLOTTED_PAGE_FREE_PERCENT / 100;
+        int avail = PAGE_SIZE - RM_PAGE_HDR_SIZE - static_cast<int>(sizeof(RmSlottedPageHdr));
+        // 每个槽位占用一个目录项、bitmap中的一位和估算的记录长度
+        int n = BITMAP_WIDTH * (avail - reserve) /
+                (BITMAP_WIDTH * (static_cast<int>(sizeof(RmSlot)) + estimated_size) + 1);
+        auto empty_page_free = [&](int n) {
+            return avail - n * static_cast<int>(sizeof(RmSlot)) - (n + BITMAP_WIDTH - 1) / BITMAP_WIDTH;
+        };
+        while (n > 1 && empty_page_free(n) - reserve < file_hdr.max_tuple_size) {
+            --n;
+        }
+        file_hdr.num_records_per_page = std::max(n, 1);
+    }
+
+    /**
+     * @description: 初始化列存格式的文件头，每个字段一个mini page。字段数超过RM_MAX_PAX_COLS时，
+     * 剩下的字段合并到最后一个mini page中；cols没有覆盖的字节也归入相邻的mini page，保证mini page首尾相接
+     */
+    static void init_pax_hdr(RmFileHdr &file_hdr, std::vector<RmVarCol> cols) {
+        std::sort(cols.begin(), cols.end(), [](const RmVarCol &a, const RmVarCol &b) { return a.offset < b.offset; });
+        int n = 0;
+        int end = 0;
+        for (auto &col : cols) {
+            if (n == RM_MAX_PAX_COLS || col.offset < end || col.len <= 0) {
+                continue;
+            }
+            // 第一个mini page从记录开头开始，之后每个mini page延伸到下一个字段之前
+            int offset = 0;
+            if (n > 0) {
+                offset = col.offset;
+                file_hdr.pax_cols[n - 1].len = offset - file_hdr.pax_cols[n - 1].offset;
+            }
+            file_hdr.pax_cols[n++] = {offset, col.len};
+            end = col.offset + col.len;
+        }
+        if (n == 0) {
+            file_hdr.pax_cols[n++] = {0, file_hdr.record_size};
+        }
+        file_hdr.pax_cols[n - 1].len = file_hdr.record_size - file_hdr.pax_cols[n - 1].offset;
+        file_hdr.num_pax_cols = n;
+    }
+
+    /**
+     * @description: 初始化字典编码字段，超过RM_MAX_DICT_COLS个或和前一个字段重叠的字段不编码。
+     * 编码比值短的字段才值得编码，每个字段在槽位中省下len - RM_DICT_CODE_SIZE字节
+     */
+    static void init_dict_hdr(RmFileHdr &file_hdr, std::vector<RmVarCol> cols) {
+        std::sort(cols.begin(), cols.end(), [](const RmVarCol &a, const RmVarCol &b) { return a.offset < b.offset; });
+        int n = 0;
+        int end = 0;
+        for (auto &col : cols) {
+            if (n == RM_MAX_DICT_COLS || col.offset < end || col.len <= RM_DICT_CODE_SIZE) {
+                continue;
+            }
+            file_hdr.dict_cols[n++] = col;
+            file_hdr.slot_size -= col.len - RM_DICT_CODE_SIZE;
+            end = col.offset + col.len;
+        }
+        file_hdr.num_dict_cols = n;
+    }
+
+public:
+    /**
+     * @description: 按已有表的文件头创建一个空的数据文件，TRUNCATE用它生成替换原文件的新文件。
+     * 页面格式和字典编码的字段保持不变，字典文件继续使用
+     * @param {string&} filename 要创建的文件名称
+     * @param {RmFileHdr} file_hdr 原文件的文件头
+     * @param {int} table_id 新文件的表ID
+     */
+    void create_empty_file(const std::string &filename, RmFileHdr file_hdr, int table_id) {
+        disk_manager_->create_file(filename);
+        int fd = disk_manager_->open_file(filename);
+        file_hdr.num_pages = 1;
+        file_hdr.first_free_page_no = RM_NO_PAGE;
+        file_hdr.table_id = table_id;
+        disk_manager_->write_page(fd, RM_FILE_HDR_PAGE, (char *) &file_hdr, sizeof(file_hdr));
+        disk_manager_->close_file(fd);
+    }
+
     /**
-     * @description: 删除表的数据文件
+     * @description: 删除表的数据文件，有字典文件时一起删除
      * @param {string&} filename 要删除的文件名称
      */
-    void destroy_file(const std::string &filename) { disk_manager_->destroy_file(filename); }
+    void destroy_file(const std::string &filename) {
+        disk_manager_->destroy_file(filename);
+        if (disk_manager_->is_file(filename + RM_DICT_FILE_SUFFIX)) {
+            disk_manager_->destroy_file(filename + RM_DICT_FILE_SUFFIX);
+        }
+    }
 
     // 注意这里打开文件，创建并返回了record file handle的指针
     /**
@@ -69,6 +196,7 @@ public:
      */
     std::unique_ptr<RmFileHandle> open_file(const std::string &filename) {
         int fd = disk_manager_->open_file(filename);
+        disk_manager_->set_file_extent(fd, HEAP_FILE_EXTENT_PAGES);
         return std::make_unique<RmFileHandle>(disk_manager_, buffer_pool_manager_, fd);
     }
 
@@ -76,7 +204,10 @@ public:
      * @description: 关闭表的数据文件
      * @param {RmFileHandle*} file_handle 要关闭文件的句柄
      */
-    void close_file(const RmFileHandle *file_handle) {
+    void close_file(RmFileHandle *file_handle) {
+        file_handle->write_free_list();
+        // 字典先于引用其中编码的页面落盘
+        file_handle->dictionary_.sync();
         disk_manager_->write_page(file_handle->fd_, RM_FILE_HDR_PAGE, (char *) &file_handle->file_hdr_,
                                   sizeof(file_handle->file_hdr_));
         // 缓冲区的所有页刷到磁盘，注意这句话必须写在close_file前面
@@ -86,11 +217,23 @@ public:
         disk_manager_->close_file(file_handle->fd_);
     }
 
+    /**
+     * @description: 关闭将要删除或被替换的数据文件，缓冲池中的页面直接丢弃，不再写回
+     * @param {RmFileHandle*} file_handle 要关闭文件的句柄
+     */
+    void discard_file(RmFileHandle *file_handle) {
+        buffer_pool_manager_->delete_all_pages(file_handle->fd_);
+        disk_manager_->close_file(file_handle->fd_);
+    }
+
     /**
      * @description: 刷盘表的数据文件
      * @param {RmFileHandle*} file_handle 要关闭文件的句柄
      */
-    void flush_file(const RmFileHandle *file_handle) {
+    void flush_file(RmFileHandle *file_handle) {
+        file_handle->write_free_list();
+        // 字典先于引用其中编码的页面落盘
+        file_handle->dictionary_.sync();
         disk_manager_->write_page(file_handle->fd_, RM_FILE_HDR_PAGE, (char *) &file_handle->file_hdr_,
                                   sizeof(file_handle->file_hdr_));
         // 缓冲区的所有页刷到磁盘，注意这句话必须写在close_file前面
@@ -14,13 +14,18 @@ See the Mulan PSL v2 for more details. */
 /**
  * @brief 初始化file_handle和rid
  * @param file_handle
+ * @param strategy 缓冲池访问策略，为nullptr时使用共享缓冲池
+ * @param zone_filters 扫描的条件，不为nullptr时跳过区域映射表明没有满足条件记录的页面，需要在扫描期间保持有效
+ * @param start_page 第一个扫描的页面
+ * @param end_page 扫描到这个页面之前为止，为-1时扫描到文件末尾
  */
-RmScan::RmScan(const RmFileHandle *file_handle) : file_handle_(file_handle) {
+RmScan::RmScan(const RmFileHandle *file_handle, BufferAccessStrategy *strategy,
+               const std::vector<RmZoneFilter> *zone_filters, int start_page, int end_page)
+    : file_handle_(file_handle), strategy_(strategy), zone_filters_(zone_filters), page_no_(start_page - 1),
+      end_page_(end_page), prefetch_end_(start_page) {
     // Todo:
     // 初始化file_handle和rid（指向第一个存放了记录的位置）
-    rid_ = {RM_FIRST_RECORD_PAGE, -1};
-    // 这里设置-1，Bit::next_bit即是0，直接设置为0，会少判断0
-    next();
+    next_page();
 }
 
 /**
@@ -29,19 +34,61 @@ RmScan::RmScan(const RmFileHandle *file_handle) : file_handle_(file_handle) {
 void RmScan::next() {
     // Todo:
     // 找到文件中下一个存放了记录的非空闲位置，用rid_来指向这个位置
-    while (rid_.page_no < file_handle_->file_hdr_.num_pages) {
-        auto &&rm_page_handle = file_handle_->fetch_page_handle(rid_.page_no);
-        rid_.slot_no = Bitmap::next_bit(true, rm_page_handle.bitmap, file_handle_->file_hdr_.num_records_per_page,
-                                        rid().slot_no);
-        // 一定要 unpin，否则多次 scan 以后所有页面都会无法替换！
-        file_handle_->buffer_pool_manager_->unpin_page(rm_page_handle.page->get_page_id(), false);
-        if (rid_.slot_no < file_handle_->file_hdr_.num_records_per_page) {
-            return;
+    // 当前页面的槽位在进入页面时已经一次取出，同一页面内移动不需要访问缓冲池
+    if (++slot_pos_ < slots_.size()) {
+        rid_.slot_no = slots_[slot_pos_];
+        return;
+    }
+    next_page();
+}
+
+/**
+ * @brief 跳到下一个存放了记录的页面：每个页面只fetch一次，用Bitmap::collect_set_bits取出所有记录的槽位，
+ * 页面保持pin直到离开该页面。有条件时先查区域映射，跳过的页面不会被读取；没有摘要的页面读取后建立摘要
+ * @return 是否还有存放了记录的页面
+ */
+bool RmScan::next_page() {
+    // 一定要 unpin，否则多次 scan 以后所有页面都会无法替换！
+    guard_.Drop();
+    int num_records_per_page = file_handle_->file_hdr_.num_records_per_page;
+    int end_page = end_page_ < 0 ? file_handle_->file_hdr_.num_pages
+                                 : std::min(end_page_, file_handle_->file_hdr_.num_pages);
+    while (++page_no_ < end_page) {
+        if (zone_filters_ != nullptr && !file_handle_->zone_map_.may_match(page_no_, *zone_filters_)) {
+            continue;
+        }
+        prefetch();
+        auto &&rm_page_handle = file_handle_->fetch_page_handle(page_no_, strategy_);
+        BasicPageGuard guard(file_handle_->buffer_pool_manager_, rm_page_handle.page);
+        slots_.resize(num_records_per_page);
+        slots_.resize(Bitmap::collect_set_bits(rm_page_handle.bitmap, num_records_per_page, slots_.data()));
+        if (zone_filters_ != nullptr && !file_handle_->zone_map_.has_zone(page_no_)) {
+            file_handle_->build_zone(rm_page_handle);
+        }
+        if (!slots_.empty()) {
+            guard_ = std::move(guard);
+            slot_pos_ = 0;
+            rid_ = {page_no_, slots_[0]};
+            return true;
         }
-        ++rid_.page_no;
-        rid_.slot_no = -1;
     }
+    slots_.clear();
     rid_.page_no = RM_NO_PAGE;
+    return false;
+}
+
+/**
+ * @brief 顺序预读：当前页离已预读范围的末尾不足一半窗口时，把后面SCAN_PREFETCH_PAGES个页面一次性读入缓冲池
+ */
+void RmScan::prefetch() {
+    if (page_no_ + SCAN_PREFETCH_PAGES / 2 < prefetch_end_) {
+        return;
+    }
+    int start = std::max(page_no_, prefetch_end_);
+    int end_page = end_page_ < 0 ? file_handle_->file_hdr_.num_pages
+                                 : std::min(end_page_, file_handle_->file_hdr_.num_pages);
+    prefetch_end_ = std::min(page_no_ + SCAN_PREFETCH_PAGES, end_page);
+    file_handle_->buffer_pool_manager_->prefetch_pages(file_handle_->fd_, start, prefetch_end_, strategy_);
 }
 
 /**
@@ -10,19 +10,42 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <vector>
+
 #include "rm_defs.h"
+#include "rm_zone_map.h"
+#include "storage/page_guard.h"
 
 class RmFileHandle;
 
 class RmScan : public RecScan {
     const RmFileHandle *file_handle_;
+    BufferAccessStrategy *strategy_;  // 大表扫描使用环形缓冲区，不占用共享缓冲池
+    const std::vector<RmZoneFilter> *zone_filters_;  // 不为空时跳过区域映射表明不可能满足条件的页面
     Rid rid_;
+    int page_no_;  // 当前页面号
+    int end_page_;  // 只扫描end_page_之前的页面，为-1时扫描到文件末尾
+    int prefetch_end_;  // [page_no_, prefetch_end_)范围内的页面已经预读过
+    BasicPageGuard guard_;  // 当前页面在扫描期间一直pin住
+    std::vector<int> slots_;  // 当前页面中所有存有记录的槽位号
+    size_t slot_pos_ = 0;  // rid_在slots_中的位置
+
+    void prefetch();
 
 public:
-    RmScan(const RmFileHandle *file_handle);
+    // 只扫描[start_page, end_page)中的页面，并行扫描时每个morsel各用一个RmScan；end_page为-1时扫描到文件末尾
+    RmScan(const RmFileHandle *file_handle, BufferAccessStrategy *strategy = nullptr,
+           const std::vector<RmZoneFilter> *zone_filters = nullptr, int start_page = RM_FIRST_RECORD_PAGE,
+           int end_page = -1);
 
     void next() override;
 
+    // 按页批量扫描：跳到下一个存有记录的页面，返回false表示扫描结束
+    bool next_page();
+
+    // 当前页面中所有存有记录的槽位号，升序，下一次next_page之前有效
+    const std::vector<int> &slots() const { return slots_; }
+
     bool is_end() const override;
 
     Rid rid() const override;
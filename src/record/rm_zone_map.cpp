@@ -0,0 +1,111 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "rm_zone_map.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+void RmZoneMap::set_cols(std::vector<RmZoneCol> cols) {
+    std::lock_guard lock(latch_);
+    cols_ = std::move(cols);
+    valid_.clear();
+    bounds_.clear();
+}
+
+int RmZoneMap::get_col(int offset) const {
+    for (size_t i = 0; i < cols_.size(); ++i) {
+        if (cols_[i].offset == offset) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool RmZoneMap::has_zone(int page_no) {
+    std::lock_guard lock(latch_);
+    return page_no < static_cast<int>(valid_.size()) && valid_[page_no];
+}
+
+/**
+ * @description: 把页面的摘要重置为空范围并标记为有效，页面号超出范围时扩展映射
+ * @param {int} page_no 页面号
+ */
+void RmZoneMap::reset_zone(int page_no) {
+    std::lock_guard lock(latch_);
+    if (cols_.empty()) {
+        return;
+    }
+    if (page_no >= static_cast<int>(valid_.size())) {
+        valid_.resize(page_no + 1, 0);
+        bounds_.resize(valid_.size() * cols_.size() * 2);
+    }
+    double *bounds = &bounds_[page_no * cols_.size() * 2];
+    for (size_t i = 0; i < cols_.size(); ++i) {
+        bounds[i * 2] = std::numeric_limits<double>::infinity();
+        bounds[i * 2 + 1] = -std::numeric_limits<double>::infinity();
+    }
+    valid_[page_no] = 1;
+}
+
+/**
+ * @description: 页面上写入了一条记录，页面有摘要时把记录的值并入摘要；没有摘要时什么都不做，扫描时总会读取该页面
+ * @param {int} page_no 页面号
+ * @param {char*} record 写入的记录
+ */
+void RmZoneMap::update(int page_no, const char *record) {
+    std::lock_guard lock(latch_);
+    if (page_no >= static_cast<int>(valid_.size()) || !valid_[page_no]) {
+        return;
+    }
+    double *bounds = &bounds_[page_no * cols_.size() * 2];
+    for (size_t i = 0; i < cols_.size(); ++i) {
+        double value = get_value(record, static_cast<int>(i));
+        bounds[i * 2] = std::min(bounds[i * 2], value);
+        bounds[i * 2 + 1] = std::max(bounds[i * 2 + 1], value);
+    }
+}
+
+/**
+ * @description: 判断页面上是否可能有满足所有条件的记录，没有摘要的页面总是返回true
+ * @param {int} page_no 页面号
+ * @param {vector<RmZoneFilter>&} filters 扫描的条件
+ */
+bool RmZoneMap::may_match(int page_no, const std::vector<RmZoneFilter> &filters) {
+    std::lock_guard lock(latch_);
+    if (page_no >= static_cast<int>(valid_.size()) || !valid_[page_no]) {
+        return true;
+    }
+    const double *bounds = &bounds_[page_no * cols_.size() * 2];
+    for (auto &filter : filters) {
+        if (bounds[filter.col * 2 + 1] < filter.lo || bounds[filter.col * 2] > filter.hi) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RmZoneMap::clear() {
+    std::lock_guard lock(latch_);
+    valid_.clear();
+    bounds_.clear();
+}
+
+double RmZoneMap::get_value(const char *record, int col) const {
+    if (cols_[col].type == TYPE_INT) {
+        int value;
+        memcpy(&value, record + cols_[col].offset, sizeof(int));
+        return value;
+    }
+    float value;
+    memcpy(&value, record + cols_[col].offset, sizeof(float));
+    return value;
+}
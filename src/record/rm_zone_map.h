@@ -0,0 +1,67 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "defs.h"
+
+/* 区域映射中记录最小值和最大值的数值字段 */
+struct RmZoneCol {
+    int offset; // 字段在记录中的偏移
+    ColType type; // TYPE_INT或TYPE_FLOAT
+};
+
+/* 扫描时用区域映射跳过页面的条件：第col个字段的值落在[lo, hi]中 */
+struct RmZoneFilter {
+    int col;
+    double lo;
+    double hi;
+};
+
+/* 表数据文件的区域映射（zone map），只在内存中维护。每个页面记录各个数值字段的最小值和最大值，
+ * 扫描据此跳过不可能满足条件的页面。摘要第一次扫描到页面时建立，之后写入记录时扩大范围，删除记录时不缩小；
+ * 没有摘要的页面总是需要读取。调用者在修改页面或建立摘要时持有页面的latch，保证摘要和页面内容一致 */
+class RmZoneMap {
+public:
+    // 设置需要记录的字段，清空已有的摘要
+    void set_cols(std::vector<RmZoneCol> cols);
+
+    // offset处的字段在区域映射中的下标，没有记录该字段时返回-1
+    int get_col(int offset) const;
+
+    bool empty() const { return cols_.empty(); }
+
+    // 页面是否已经有摘要
+    bool has_zone(int page_no);
+
+    // 把页面的摘要重置为空，之后用update加入页面上的每条记录
+    void reset_zone(int page_no);
+
+    // 页面上写入一条记录，已有摘要时扩大范围
+    void update(int page_no, const char *record);
+
+    // 页面上是否可能有满足所有filters的记录
+    bool may_match(int page_no, const std::vector<RmZoneFilter> &filters);
+
+    // 清空所有摘要，故障恢复直接修改页面之后使用
+    void clear();
+
+private:
+    double get_value(const char *record, int col) const;
+
+    std::mutex latch_;
+    std::vector<RmZoneCol> cols_;
+    std::vector<uint8_t> valid_; // 每个页面是否有摘要
+    std::vector<double> bounds_; // 页面page_no第col个字段的最小值、最大值位于(page_no * cols_.size() + col) * 2处
+};
@@ -14,6 +14,7 @@ See the Mulan PSL v2 for more details. */
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <string_view>
 
 #include "common/config.h"
 #include "common/context.h"
@@ -23,63 +24,33 @@ See the Mulan PSL v2 for more details. */
 class RecordPrinter {
   static constexpr size_t COL_WIDTH = 16;
   size_t num_cols;
+  std::string separator_;  // 分隔行只在构造时拼一次
+  std::string row_;        // begin_row到end_row之间的当前行，各行复用同一块空间
 
  public:
   RecordPrinter(size_t num_cols_) : num_cols(num_cols_) {
     assert(num_cols_ > 0);
-  }
-
-  void print_separator(Context* context) const {
+    separator_.reserve(row_length());
     for (size_t i = 0; i < num_cols; i++) {
-      // std::cout << '+' << std::string(COL_WIDTH + 2, '-');
-      std::string str = "+" + std::string(COL_WIDTH + 2, '-');
-      if (context->ellipsis_ == false &&
-          *context->offset_ + RECORD_COUNT_LENGTH + str.length() <
-              BUFFER_LENGTH) {
-        memcpy(context->data_send_ + *(context->offset_), str.c_str(),
-               str.length());
-        *(context->offset_) = *(context->offset_) + str.length();
-      } else {
-        context->ellipsis_ = true;
-      }
-    }
-    std::string str = "+\n";
-    if (context->ellipsis_ == false &&
-        *context->offset_ + RECORD_COUNT_LENGTH + str.length() <
-            BUFFER_LENGTH) {
-      memcpy(context->data_send_ + *(context->offset_), str.c_str(),
-             str.length());
-      *(context->offset_) = *(context->offset_) + str.length();
-    } else {
-      context->ellipsis_ = true;
+      separator_ += '+';
+      separator_.append(COL_WIDTH + 2, '-');
     }
+    separator_ += "+\n";
+    row_.reserve(row_length());
   }
 
+  void print_separator(Context* context) const { append(separator_, context); }
+
   void print_record(const std::vector<std::string>& rec_str,
                     Context* context) const {
     assert(rec_str.size() == num_cols);
-    std::stringstream ss;
-
-    for (auto col : rec_str) {
-      if (col.size() > COL_WIDTH) {
-        col = col.substr(0, COL_WIDTH - 3) + "...";
-      }
-      ss << "| " << std::setw(COL_WIDTH) << col << " ";
-    }
-    ss << "|\n";
-
-    std::string output = ss.str();
-    size_t output_length = output.length();
-
-    if (context->ellipsis_ == false &&
-        *context->offset_ + RECORD_COUNT_LENGTH + output_length <
-            BUFFER_LENGTH) {
-      memcpy(context->data_send_ + *(context->offset_), output.c_str(),
-             output_length);
-      *(context->offset_) += output_length;
-    } else {
-      context->ellipsis_ = true;
+    std::string output;
+    output.reserve(row_length());
+    for (auto& col : rec_str) {
+      append_column(output, col);
     }
+    output += "|\n";
+    append(output, context);
 
     // assert(rec_str.size() == num_cols);
     // for (auto col: rec_str) {
@@ -109,6 +80,19 @@ class RecordPrinter {
     // }
   }
 
+  /**
+   * @description: 逐列输出一行：begin_row后对每一列调用add_column，最后end_row。
+   * 列值直接写进复用的行缓冲区，不需要为每行每列构造std::string
+   */
+  void begin_row() { row_.clear(); }
+
+  void add_column(std::string_view col) { append_column(row_, col); }
+
+  void end_row(Context* context) {
+    row_ += "|\n";
+    append(row_, context);
+  }
+
   void print_indexs(const std::vector<std::string>& indexs,
                     Context* context) const {
     assert(indexs.size() == num_cols);
@@ -146,6 +130,45 @@ class RecordPrinter {
     }
   }
 
+  /**
+   * @description: 把一段结果追加到data_send_中。放不下时先把已有的结果发给客户端再追加，
+   * 大结果边执行边分块发送，服务端只占用一个BUFFER_LENGTH；
+   * 不能发送时（没有客户端连接）保持原来的行为，丢弃后面的结果并在末尾打印省略号
+   */
+  static void append(const std::string& str, Context* context) {
+    if (context->ellipsis_) {
+      return;
+    }
+    if (*context->offset_ + RECORD_COUNT_LENGTH + str.length() >=
+            BUFFER_LENGTH &&
+        !context->flush_send()) {
+      context->ellipsis_ = true;
+      return;
+    }
+    if (*context->offset_ + RECORD_COUNT_LENGTH + str.length() >=
+        BUFFER_LENGTH) {
+      // 单独一行就超过了缓冲区
+      context->ellipsis_ = true;
+      return;
+    }
+    memcpy(context->data_send_ + *(context->offset_), str.c_str(),
+           str.length());
+    *(context->offset_) += str.length();
+  }
+
+  // 不经过stringstream和setw：每列右对齐到COL_WIDTH，超长的截断成"..."结尾
+  static void append_column(std::string& out, std::string_view col) {
+    out += "| ";
+    if (col.size() > COL_WIDTH) {
+      out.append(col.data(), COL_WIDTH - 3);
+      out += "...";
+    } else {
+      out.append(COL_WIDTH - col.size(), ' ');
+      out.append(col.data(), col.size());
+    }
+    out += ' ';
+  }
+
   static void print_record_count(size_t num_rec, Context* context) {
     // std::cout << "Total record(s): " << num_rec << '\n';
     std::string str = "";
@@ -157,4 +180,7 @@ class RecordPrinter {
            str.length());
     *(context->offset_) = *(context->offset_) + str.length();
   }
+
+ private:
+  size_t row_length() const { return num_cols * (COL_WIDTH + 3) + 2; }
 };
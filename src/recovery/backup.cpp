@@ -0,0 +1,281 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "backup.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/statement_cancel.h"
+#include "record/rm_defs.h"
+#include "storage/buffer_access_strategy.h"
+
+static std::mutex backup_mutex;  // 同一时刻只有一个备份
+
+/* 备份目录中新建的一个文件，析构时关闭 */
+class BackupFile {
+   public:
+    explicit BackupFile(const std::string& path) {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd_ == -1) {
+            throw UnixError();
+        }
+    }
+
+    ~BackupFile() { close(fd_); }
+
+    BackupFile(const BackupFile&) = delete;
+    BackupFile& operator=(const BackupFile&) = delete;
+
+    int fd() const { return fd_; }
+
+    void write(const char* data, size_t len, off_t offset) {
+        while (len > 0) {
+            ssize_t n = pwrite(fd_, data, len, offset);
+            if (n <= 0) {
+                throw UnixError();
+            }
+            data += n;
+            len -= n;
+            offset += n;
+        }
+    }
+
+    // 备份结束前每个文件都要落盘
+    void sync() {
+        if (fsync(fd_) == -1) {
+            throw UnixError();
+        }
+    }
+
+   private:
+    int fd_;
+};
+
+/* 按BACKUP_MAX_BYTES_PER_SEC限速：复制得比限速快时睡到平均速度回到限速以下，前台的读写不会被备份挤占 */
+class BackupThrottle {
+   public:
+    void consume(size_t bytes) {
+        if (BACKUP_MAX_BYTES_PER_SEC == 0) {
+            return;
+        }
+        bytes_ += bytes;
+        auto due = start_ + std::chrono::microseconds(bytes_ * 1000000 / BACKUP_MAX_BYTES_PER_SEC);
+        if (due > std::chrono::steady_clock::now()) {
+            std::this_thread::sleep_until(due);
+        }
+    }
+
+   private:
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    uint64_t bytes_ = 0;
+};
+
+/**
+ * @description: 逐页复制一个数据文件或索引文件。文件头页由文件句柄直接读写磁盘，从磁盘读；
+ * 其余页面经过缓冲池，在读latch下复制，得到的是页面当前的版本，不在缓冲池中的页面通过环形缓冲区读入，不挤掉热点页面
+ */
+static void copy_paged_file(SmManager* sm_manager, int fd, const std::string& path, BufferAccessStrategy* strategy,
+                            BackupThrottle* throttle) {
+    DiskManager* disk_manager = sm_manager->get_disk_manager();
+    BufferPoolManager* bpm = sm_manager->get_bpm();
+    BackupFile out(path);
+    page_id_t num_pages = disk_manager->get_fd2pageno(fd);
+    std::vector<char> batch(static_cast<size_t>(BACKUP_BATCH_PAGES) * PAGE_SIZE);
+    page_id_t batch_start = 0;
+    int batch_pages = 0;
+    for (page_id_t page_no = 0; page_no < num_pages; ++page_no) {
+        char* dest = batch.data() + static_cast<size_t>(batch_pages) * PAGE_SIZE;
+        if (page_no == 0) {
+            disk_manager->read_page(fd, page_no, dest, PAGE_SIZE);
+        } else {
+            Page* page = bpm->fetch_page({fd, page_no}, strategy);
+            if (page == nullptr) {
+                throw PageNotExistError(disk_manager->get_file_name(fd), page_no);
+            }
+            page->RLatch();
+            memcpy(dest, page->get_data(), PAGE_SIZE);
+            page->RUnlatch();
+            BufferPoolManager::unpin_page(page, false);
+        }
+        if (++batch_pages == BACKUP_BATCH_PAGES || page_no + 1 == num_pages) {
+            out.write(batch.data(), static_cast<size_t>(batch_pages) * PAGE_SIZE,
+                      static_cast<off_t>(batch_start) * PAGE_SIZE);
+            throttle->consume(static_cast<size_t>(batch_pages) * PAGE_SIZE);
+            check_cancel();
+            batch_start = page_no + 1;
+            batch_pages = 0;
+        }
+    }
+    out.sync();
+}
+
+/**
+ * @description: 整个复制一个不经过缓冲池的文件（db.meta、字典文件）。
+ * 先用copy_file_range在内核中复制，支持的文件系统上共享数据块（reflink）；跨文件系统等不支持的情况读出来再写
+ */
+static void copy_whole_file(const std::string& src, const std::string& dest) {
+    int in = open(src.c_str(), O_RDONLY);
+    if (in == -1) {
+        throw UnixError();
+    }
+    try {
+        BackupFile out(dest);
+        bool fallback = false;
+        while (true) {
+            ssize_t n = copy_file_range(in, nullptr, out.fd(), nullptr, 1 << 30, 0);
+            if (n == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                fallback = true;
+                break;
+            }
+            if (n == -1) {
+                throw UnixError();
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        // 两个文件的读写位置都停在copy_file_range复制到的地方，从这里接着复制
+        std::vector<char> buf(static_cast<size_t>(BACKUP_BATCH_PAGES) * PAGE_SIZE);
+        while (fallback) {
+            ssize_t n = read(in, buf.data(), buf.size());
+            if (n == -1) {
+                throw UnixError();
+            }
+            if (n == 0) {
+                break;
+            }
+            for (ssize_t done = 0; done < n;) {
+                ssize_t written = ::write(out.fd(), buf.data() + done, n - done);
+                if (written <= 0) {
+                    throw UnixError();
+                }
+                done += written;
+            }
+        }
+        out.sync();
+    } catch (...) {
+        close(in);
+        throw;
+    }
+    close(in);
+}
+
+/**
+ * @description: 把日志[begin, end)复制到dir中，段号和段内偏移和原来一样，恢复时按段文件名找到它们
+ */
+static void copy_log(DiskManager* disk_manager, int64_t begin, int64_t end, const std::string& dir) {
+    std::vector<char> buf(static_cast<size_t>(BACKUP_BATCH_PAGES) * PAGE_SIZE);
+    std::unique_ptr<BackupFile> out;
+    int64_t segment = -1;
+    for (int64_t offset = begin; offset < end;) {
+        if (offset / LOG_SEGMENT_SIZE != segment) {
+            if (out != nullptr) {
+                out->sync();
+            }
+            segment = offset / LOG_SEGMENT_SIZE;
+            out = std::make_unique<BackupFile>(dir + "/" + DiskManager::log_segment_name(segment));
+        }
+        int n = static_cast<int>(std::min<int64_t>({static_cast<int64_t>(buf.size()), end - offset,
+                                                     LOG_SEGMENT_SIZE - offset % LOG_SEGMENT_SIZE}));
+        if (disk_manager->read_log(buf.data(), n, offset) != n) {
+            throw InternalError("backup_database: log before the backup end is missing");
+        }
+        out->write(buf.data(), n, offset % LOG_SEGMENT_SIZE);
+        offset += n;
+    }
+    if (out != nullptr) {
+        out->sync();
+    }
+}
+
+static void sync_backup_dir(const std::string& dir) {
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) {
+        throw UnixError();
+    }
+    int rc = fsync(dir_fd);
+    close(dir_fd);
+    if (rc == -1) {
+        throw UnixError();
+    }
+}
+
+void backup_database(const std::string& dir, SmManager* sm_manager, TransactionManager* txn_manager,
+                     LogManager* log_manager, Context* context) {
+#ifndef ENABLE_LOGGING
+    // 没有日志时复制出的页面无法恢复到一致的状态
+    throw RMDBError("BACKUP requires write-ahead logging");
+#else
+    std::unique_lock backup_lock(backup_mutex, std::try_to_lock);
+    if (!backup_lock.owns_lock()) {
+        throw RMDBError("Another backup is in progress");
+    }
+    if (mkdir(dir.c_str(), 0755) == -1) {
+        throw RMDBError("Cannot create backup directory " + dir + ": " + strerror(errno));
+    }
+    DiskManager* disk_manager = sm_manager->get_disk_manager();
+
+    // 要复制的数据文件和索引文件，临时表不备份。IS锁让DDL等到备份结束，不影响读写
+    std::vector<std::pair<std::string, int>> files;
+    std::vector<std::string> dict_files;
+    for (auto& [tab_name, fh] : sm_manager->fhs_) {
+        TabMeta& tab = sm_manager->db_.get_table(tab_name);
+        if (tab.persistence == TAB_TEMPORARY) {
+            continue;
+        }
+        context->lock_mgr_->lock_IS_on_table(context->txn_, fh->GetFd());
+        files.emplace_back(tab_name, fh->GetFd());
+        if (disk_manager->is_file(tab_name + RM_DICT_FILE_SUFFIX)) {
+            dict_files.push_back(tab_name + RM_DICT_FILE_SUFFIX);
+        }
+        for (auto& [index_name, index] : tab.indexes) {
+            files.emplace_back(index_name, sm_manager->ihs_.at(index_name)->fd_);
+        }
+    }
+
+    // 检查点之前pin住日志：检查点和之后的日志都会留到备份结束
+    int64_t log_begin = disk_manager->pin_log();
+    try {
+        // 检查点写回脏页并重写db.meta，恢复从这个检查点开始
+        txn_manager->create_fuzzy_checkpoint(log_manager);
+        copy_whole_file(DB_META_NAME, dir + "/" + DB_META_NAME);
+
+        BufferAccessStrategy strategy(BULK_READ_RING_PAGES);
+        BackupThrottle throttle;
+        for (auto& [name, fd] : files) {
+            copy_paged_file(sm_manager, fd, dir + "/" + name, &strategy, &throttle);
+        }
+        // 字典只追加，在数据页之后复制，复制出的页面中用到的编码都在其中
+        for (auto& name : dict_files) {
+            copy_whole_file(name, dir + "/" + name);
+        }
+
+        // 复制出的页面上的修改都已经写进了日志缓冲区，刷盘后复制到日志尾，恢复时重做到这里
+        log_manager->flush_log_to_disk();
+        copy_log(disk_manager, log_begin, disk_manager->get_log_end(), dir);
+        sync_backup_dir(dir);
+    } catch (...) {
+        disk_manager->unpin_log();
+        throw;
+    }
+    disk_manager->unpin_log();
+#endif
+}
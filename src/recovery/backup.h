@@ -0,0 +1,27 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <string>
+
+#include "common/context.h"
+#include "log_manager.h"
+#include "system/sm_manager.h"
+#include "transaction/transaction_manager.h"
+
+/* 在线热备份：不停止写入，把数据库目录复制到dir（dir不能已经存在，相对路径相对于数据库目录）。
+ * 先pin住日志段不让检查点回收，做一次模糊检查点并复制db.meta，再经过缓冲池逐页复制各表的数据文件和索引文件，
+ * 复制期间写入照常进行，复制出的页面可能新旧不一；最后把pin住的段到日志尾的日志复制过去。
+ * 备份目录就是一个崩溃后的数据库目录：以它启动时，恢复从检查点重做到备份结束时的日志尾并回滚未完成的事务，
+ * 得到备份结束时已提交的数据。备份期间给各表加IS锁，只和DDL冲突，备份开始后新建的表不在备份中。
+ * 同一时刻只能有一个备份；失败时dir中的内容不完整，需要删除后重新备份 */
+void backup_database(const std::string& dir, SmManager* sm_manager, TransactionManager* txn_manager,
+                     LogManager* log_manager, Context* context);
@@ -17,7 +17,6 @@ See the Mulan PSL v2 for more details. */
 #include <atomic>
 #include <chrono>
 
-static constexpr std::chrono::duration<int64_t> FLUSH_TIMEOUT = std::chrono::seconds(3);
 // the offset of log_type_ in log header
 static constexpr int OFFSET_LOG_TYPE = 0;
 // the offset of lsn_ in log header
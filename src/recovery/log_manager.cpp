@@ -10,6 +10,10 @@ See the Mulan PSL v2 for more details. */
 
 #include <cstring>
 #include "log_manager.h"
+#include "common/trace.h"
+
+// 刷盘线程至少每隔这么久刷一次盘，启动时用 -l <毫秒> 修改
+std::chrono::milliseconds log_timeout{200};
 
 /**
  * @description: 添加日志记录到日志缓冲区中，并返回日志记录号
@@ -17,12 +21,242 @@ See the Mulan PSL v2 for more details. */
  * @return {lsn_t} 返回该日志的日志记录号
  */
 lsn_t LogManager::add_log_to_buffer(LogRecord* log_record) {
-  
+    return add_logs_to_buffer(&log_record, 1, log_record->prev_lsn_);
+}
+
+/**
+ * @description: 一次预留空间追加同一个事务的一批日志，这批日志的lsn连续，依次串成prev_lsn链。
+ * 多行语句用它代替逐条追加，整批只做一次fetch_add，缓冲区满的等待也只有一次
+ * @param {LogRecord**} log_records 要写入缓冲区的日志记录
+ * @param {int} num 日志记录的条数
+ * @param {lsn_t} prev_lsn 第一条日志的prev_lsn，即事务之前的最后一条日志
+ * @return {lsn_t} 返回最后一条日志的日志记录号
+ */
+lsn_t LogManager::add_logs_to_buffer(LogRecord** log_records, int num, lsn_t prev_lsn) {
+    int64_t len = 0;
+    int count = 0;
+    for (; count < num && len + log_records[count]->log_tot_len_ <= LOG_BUFFER_SIZE; ++count) {
+        len += log_records[count]->log_tot_len_;
+    }
+    if (count == 0) {
+        throw InternalError("LogManager::add_log_to_buffer: log record too large");
+    }
+    // 一个缓冲区放不下整批时拆成几批
+    if (count < num) {
+        prev_lsn = add_logs_to_buffer(log_records, count, prev_lsn);
+        return add_logs_to_buffer(log_records + count, num - count, prev_lsn);
+    }
+    const uint64_t delta = (static_cast<uint64_t>(num) << RESERVE_LSN_SHIFT) + len;
+    while (true) {
+        // 一次 fetch_add 同时分配 lsn 和缓冲区空间
+        uint64_t old_state = reserve_state_.fetch_add(delta);
+        auto lsn = static_cast<lsn_t>(old_state >> RESERVE_LSN_SHIFT);
+        int idx = static_cast<int>((old_state >> RESERVE_IDX_SHIFT) & 1);
+        auto pos = static_cast<int64_t>(old_state & RESERVE_OFFSET_MASK);
+        LogBuffer& buffer = log_buffers_[idx];
+        if (pos + len <= LOG_BUFFER_SIZE) {
+            char* dest = buffer.buffer_ + pos;
+            for (int i = 0; i < num; ++i) {
+                log_records[i]->lsn_ = lsn + i;
+                log_records[i]->prev_lsn_ = i == 0 ? prev_lsn : lsn + i - 1;
+                log_records[i]->serialize(dest);
+                dest += log_records[i]->log_tot_len_;
+            }
+            buffer.finish(len);
+            return lsn + num - 1;
+        }
+
+        // 缓冲区已满，本次预留的空间和 lsn 作废，偏移单调递增，因此只有第一个失败者满足 pos <= LOG_BUFFER_SIZE
+        if (pos <= LOG_BUFFER_SIZE) {
+            buffer.used_ = static_cast<int>(pos);
+        }
+        buffer.finish(len);
+
+        if (flush_thread_running_) {
+            // 等待刷盘线程切换缓冲区；切换后当前缓冲区编号改变，或偏移从0重新增长
+            std::unique_lock lock(latch_);
+            flush_requested_ = true;
+            flush_cv_.notify_one();
+            buffer_cv_.wait(lock, [this, idx, pos, len] {
+                uint64_t state = reserve_state_.load();
+                return static_cast<int>((state >> RESERVE_IDX_SHIFT) & 1) != idx ||
+                       static_cast<int64_t>(state & RESERVE_OFFSET_MASK) < pos + len || !flush_thread_running_;
+            });
+        } else {
+            flush_buffer();
+        }
+    }
 }
 
 /**
- * @description: 把日志缓冲区的内容刷到磁盘中，由于目前只设置了一个缓冲区，因此需要阻塞其他日志操作
+ * @description: 把日志缓冲区的内容刷到磁盘中，返回时所有已经写入缓冲区的日志都已持久化
  */
 void LogManager::flush_log_to_disk() {
+    wait_for_flush(get_next_lsn() - 1);
+}
+
+/**
+ * @description: 阻塞直到lsn及其之前的日志都已经持久化，提交事务用它等待自己的commit日志落盘
+ * @param {lsn_t} lsn 需要持久化的日志号
+ */
+void LogManager::wait_for_flush(lsn_t lsn) {
+    if (lsn == INVALID_LSN || persist_lsn_ >= lsn) {
+        return;
+    }
+    // 没有后台线程时（如未开启日志或退出阶段）由调用者自己刷盘
+    if (!flush_thread_running_) {
+        flush_buffer();
+        return;
+    }
+    std::unique_lock lock(latch_);
+    flush_requested_ = true;
+    flush_cv_.notify_one();
+    persist_cv_.wait(lock, [this, lsn] { return persist_lsn_ >= lsn || !flush_thread_running_; });
+    if (persist_lsn_ < lsn) {
+        lock.unlock();
+        flush_buffer();
+    }
+}
+
+/**
+ * @description: 等待持久化的日志越过offset，最多等待timeout，日志传输用它等主库产生新的日志
+ * @param {int64_t} offset 已经发送到的逻辑偏移
+ * @param {milliseconds} timeout 最长等待时间
+ * @return {int64_t} 已经持久化的日志尾的逻辑偏移
+ */
+int64_t LogManager::wait_for_persist_offset(int64_t offset, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(latch_);
+    persist_cv_.wait_for(lock, timeout, [this, offset] { return persist_offset_ > offset || !flush_thread_running_; });
+    return persist_offset_;
+}
+
+/**
+ * @description: 启动后台组提交刷盘线程
+ */
+void LogManager::start_flush_thread() {
+    if (flush_thread_running_.exchange(true)) {
+        return;
+    }
+    {
+        std::lock_guard lock(latch_);
+        persist_offset_ = disk_manager_->get_log_end();
+    }
+    flush_thread_ = std::thread(&LogManager::flush_thread_func, this);
+}
 
+/**
+ * @description: 停止后台刷盘线程，停止前把缓冲区中剩余的日志全部刷盘
+ */
+void LogManager::stop_flush_thread() {
+    {
+        std::lock_guard lock(latch_);
+        if (!flush_thread_running_) {
+            return;
+        }
+        flush_thread_running_ = false;
+        flush_cv_.notify_one();
+        buffer_cv_.notify_all();
+        persist_cv_.notify_all();
+    }
+    if (flush_thread_.joinable()) {
+        flush_thread_.join();
+    }
+    flush_buffer();
+}
+
+/**
+ * @description: 刷盘线程主循环，有人请求刷盘或超时后把积攒的一批日志一次性落盘
+ * 异步提交的事务不请求刷盘，它们的commit日志靠超时刷盘在log_timeout内持久化
+ */
+void LogManager::flush_thread_func() {
+    while (flush_thread_running_) {
+        {
+            std::unique_lock lock(latch_);
+            flush_cv_.wait_for(lock, log_timeout, [this] { return flush_requested_ || !flush_thread_running_; });
+            flush_requested_ = false;
+        }
+        flush_buffer();
+    }
+}
+
+/**
+ * @description: 封存当前接收日志的缓冲区并切换到另一个缓冲区，等待在途的写者拷贝完成后写盘并fsync，最后推进persist_lsn_
+ * 切换后新的日志写入另一个缓冲区，写盘期间追加日志不受阻塞
+ */
+void LogManager::flush_buffer() {
+    std::lock_guard flush_guard(flush_latch_);
+    // 另一个缓冲区在上一次刷盘结束时已经清空，可以直接切换过去
+    uint64_t state = reserve_state_.load();
+    uint64_t new_state;
+    do {
+        if ((state & RESERVE_OFFSET_MASK) == 0) {
+            return;
+        }
+        new_state = (state & ~RESERVE_OFFSET_MASK) ^ (1ULL << RESERVE_IDX_SHIFT);
+    } while (!reserve_state_.compare_exchange_weak(state, new_state));
+    {
+        std::lock_guard lock(latch_);
+        buffer_cv_.notify_all();
+    }
+
+    LogBuffer& buffer = log_buffers_[(state >> RESERVE_IDX_SHIFT) & 1];
+    auto reserved = static_cast<int64_t>(state & RESERVE_OFFSET_MASK);
+    // 等待所有在封存前已经预留空间的写者完成
+    while (buffer.finished() != reserved) {
+        std::this_thread::yield();
+    }
+    int size = reserved <= LOG_BUFFER_SIZE ? static_cast<int>(reserved) : buffer.used_;
+    RMDB_PROBE(log__flush__start, size);
+    if (size > 0) {
+        // 封存点之前的日志都已落盘，这批日志的lsn从persist_lsn_ + 1开始
+        segment_first_lsn_.emplace(disk_manager_->get_log_end() / LOG_SEGMENT_SIZE, persist_lsn_ + 1);
+        disk_manager_->write_log(buffer.buffer_, size);
+        disk_manager_->sync_log();
+    }
+    buffer.reset_finished();
+    buffer.used_ = 0;
+
+    // 封存点之前分配的 lsn 要么在本缓冲区中，要么已经作废
+    auto last_lsn = static_cast<lsn_t>((state >> RESERVE_LSN_SHIFT) - 1);
+    int64_t persist_offset = disk_manager_->get_log_end();
+    {
+        std::lock_guard lock(latch_);
+        persist_lsn_ = last_lsn;
+        persist_offset_ = persist_offset;
+    }
+    RMDB_PROBE(log__flush__done, size, last_lsn);
+    persist_cv_.notify_all();
+}
+
+/**
+ * @description: 回收只含有lsn之前日志的段。在段T中开始写盘的日志都在T之前各段中的日志之后，
+ * 所以T中第一批日志的lsn不超过lsn时，T之前的段都可以回收
+ * @param {lsn_t} lsn 恢复时需要的最早的日志
+ */
+void LogManager::recycle_log(lsn_t lsn) {
+    int64_t segment = -1;
+    {
+        std::lock_guard flush_guard(flush_latch_);
+        for (auto it = segment_first_lsn_.begin(); it != segment_first_lsn_.end() && it->second <= lsn; ++it) {
+            segment = it->first;
+        }
+        if (segment < 0) {
+            return;
+        }
+        segment_first_lsn_.erase(segment_first_lsn_.begin(), segment_first_lsn_.find(segment));
+    }
+    disk_manager_->recycle_log(segment);
+}
+
+/**
+ * @description: 故障恢复后设置下一个要分配的lsn，使新日志的lsn接在日志文件中已有日志之后，只能在没有日志写入时调用
+ * @param {lsn_t} lsn 下一个要分配的lsn
+ */
+void LogManager::set_next_lsn(lsn_t lsn) {
+    std::lock_guard flush_guard(flush_latch_);
+    if ((reserve_state_.load() & RESERVE_OFFSET_MASK) != 0) {
+        throw InternalError("LogManager::set_next_lsn: log buffer is not empty");
+    }
+    reserve_state_ = static_cast<uint64_t>(lsn) << RESERVE_LSN_SHIFT;
+    persist_lsn_ = lsn - 1;
 }
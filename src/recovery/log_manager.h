@@ -10,9 +10,14 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 #include <vector>
 #include <iostream>
+#include <map>
 #include "log_defs.h"
 #include "common/config.h"
 #include "record/rm_defs.h"
@@ -24,7 +29,10 @@ enum LogType: int {
     DELETE,
     begin,
     commit,
-    ABORT
+    ABORT,
+    BEGIN_CHECKPOINT,
+    END_CHECKPOINT,
+    BULK_LOAD
 };
 static std::string LogTypeStr[] = {
     "UPDATE",
@@ -32,7 +40,10 @@ static std::string LogTypeStr[] = {
     "DELETE",
     "BEGIN",
     "COMMIT",
-    "ABORT"
+    "ABORT",
+    "BEGIN_CHECKPOINT",
+    "END_CHECKPOINT",
+    "BULK_LOAD"
 };
 
 class LogRecord {
@@ -98,19 +109,61 @@ public:
 };
 
 /**
- * TODO: commit操作的日志记录
+ * commit操作的日志记录，只有日志头
 */
 class CommitLogRecord: public LogRecord {
-
+public:
+    CommitLogRecord() {
+        log_type_ = LogType::commit;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+    }
+    CommitLogRecord(txn_id_t txn_id) : CommitLogRecord() {
+        log_tid_ = txn_id;
+    }
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+    }
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+    }
+    virtual void format_print() override {
+        LogRecord::format_print();
+    }
 };
 
 /**
- * TODO: abort操作的日志记录
+ * abort操作的日志记录，只有日志头
 */
 class AbortLogRecord: public LogRecord {
-
+public:
+    AbortLogRecord() {
+        log_type_ = LogType::ABORT;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+    }
+    AbortLogRecord(txn_id_t txn_id) : AbortLogRecord() {
+        log_tid_ = txn_id;
+    }
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+    }
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+    }
+    virtual void format_print() override {
+        LogRecord::format_print();
+    }
 };
 
+/**
+ * insert操作的日志记录
+ * | header | size | insert_value | rid | table_id |
+*/
 class InsertLogRecord: public LogRecord {
 public:
     InsertLogRecord() {
@@ -119,20 +172,15 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        table_name_ = nullptr;
+        table_id_ = -1;
     }
-    InsertLogRecord(txn_id_t txn_id, RmRecord& insert_value, Rid& rid, std::string table_name) 
+    InsertLogRecord(txn_id_t txn_id, const char* insert_value, int size, const Rid& rid, int table_id)
         : InsertLogRecord() {
         log_tid_ = txn_id;
-        insert_value_ = insert_value;
+        insert_value_.Deserialize(insert_value, size);
         rid_ = rid;
-        log_tot_len_ += sizeof(int);
-        log_tot_len_ += insert_value_.size;
-        log_tot_len_ += sizeof(Rid);
-        table_name_size_ = table_name.length();
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, table_name.c_str(), table_name_size_);
-        log_tot_len_ += sizeof(size_t) + table_name_size_;
+        table_id_ = table_id;
+        log_tot_len_ += sizeof(int) + insert_value_.size + sizeof(Rid) + sizeof(int);
     }
 
     // 把insert日志记录序列化到dest中
@@ -145,9 +193,7 @@ public:
         offset += insert_value_.size;
         memcpy(dest + offset, &rid_, sizeof(Rid));
         offset += sizeof(Rid);
-        memcpy(dest + offset, &table_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, table_name_, table_name_size_);
+        memcpy(dest + offset, &table_id_, sizeof(int));
     }
     // 从src中反序列化出一条Insert日志记录
     void deserialize(const char* src) override {
@@ -156,40 +202,362 @@ public:
         int offset = OFFSET_LOG_DATA + insert_value_.size + sizeof(int);
         rid_ = *reinterpret_cast<const Rid*>(src + offset);
         offset += sizeof(Rid);
-        table_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, src + offset, table_name_size_);
+        table_id_ = *reinterpret_cast<const int*>(src + offset);
     }
     void format_print() override {
         printf("insert record\n");
         LogRecord::format_print();
         printf("insert_value: %s\n", insert_value_.data);
         printf("insert rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("table name: %s\n", table_name_);
+        printf("table id: %d\n", table_id_);
     }
 
     RmRecord insert_value_;     // 插入的记录
     Rid rid_;                   // 记录插入的位置
-    char* table_name_;          // 插入记录的表名称
-    size_t table_name_size_;    // 表名称的大小
+    int table_id_;              // 插入记录的表ID，见RmFileHdr::table_id
 };
 
 /**
- * TODO: delete操作的日志记录
+ * delete操作的日志记录
+ * | header | size | delete_value | rid | table_id |
 */
 class DeleteLogRecord: public LogRecord {
+public:
+    DeleteLogRecord() {
+        log_type_ = LogType::DELETE;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        table_id_ = -1;
+    }
+    DeleteLogRecord(txn_id_t txn_id, const char* delete_value, int size, const Rid& rid, int table_id)
+        : DeleteLogRecord() {
+        log_tid_ = txn_id;
+        delete_value_.Deserialize(delete_value, size);
+        rid_ = rid;
+        table_id_ = table_id;
+        log_tot_len_ += sizeof(int) + delete_value_.size + sizeof(Rid) + sizeof(int);
+    }
 
+    // 把delete日志记录序列化到dest中
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        int offset = OFFSET_LOG_DATA;
+        memcpy(dest + offset, &delete_value_.size, sizeof(int));
+        offset += sizeof(int);
+        memcpy(dest + offset, delete_value_.data, delete_value_.size);
+        offset += delete_value_.size;
+        memcpy(dest + offset, &rid_, sizeof(Rid));
+        offset += sizeof(Rid);
+        memcpy(dest + offset, &table_id_, sizeof(int));
+    }
+    // 从src中反序列化出一条Delete日志记录
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        delete_value_.Deserialize(src + OFFSET_LOG_DATA);
+        int offset = OFFSET_LOG_DATA + delete_value_.size + sizeof(int);
+        rid_ = *reinterpret_cast<const Rid*>(src + offset);
+        offset += sizeof(Rid);
+        table_id_ = *reinterpret_cast<const int*>(src + offset);
+    }
+    void format_print() override {
+        printf("delete record\n");
+        LogRecord::format_print();
+        printf("delete rid: %d, %d\n", rid_.page_no, rid_.slot_no);
+        printf("table id: %d\n", table_id_);
+    }
+
+    RmRecord delete_value_;     // 被删除的记录
+    Rid rid_;                   // 被删除记录的位置
+    int table_id_;              // 删除记录的表ID
+};
+
+/* update日志中的一段变化的字节区间，区间的前像和后像依次存放在UpdateLogRecord::delta_data_中 */
+struct UpdateDelta {
+    uint16_t offset_;           // 区间在记录中的起始偏移
+    uint16_t len_;              // 区间长度
 };
 
 /**
- * TODO: update操作的日志记录
+ * update操作的日志记录，只记录前后像不同的字节区间
+ * | header | rid | table_id | delta_num | (offset, len, old_bytes, new_bytes) * delta_num |
 */
 class UpdateLogRecord: public LogRecord {
+public:
+    // 两段变化区间之间相同的字节数不超过一个区间头的大小时合并成一段，合并反而更省空间
+    static constexpr int DELTA_MERGE_GAP = sizeof(UpdateDelta);
+
+    UpdateLogRecord() {
+        log_type_ = LogType::UPDATE;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        table_id_ = -1;
+    }
+    UpdateLogRecord(txn_id_t txn_id, const char* old_value, const char* new_value, int size, const Rid& rid,
+                    int table_id)
+        : UpdateLogRecord() {
+        log_tid_ = txn_id;
+        rid_ = rid;
+        table_id_ = table_id;
+        int pos = 0;
+        while (pos < size) {
+            if (old_value[pos] == new_value[pos]) {
+                ++pos;
+                continue;
+            }
+            int begin = pos;
+            int end = pos + 1;
+            // 向后扩展区间，直到遇到一段足够长的相同字节
+            for (int same = 0, i = end; i < size && same <= DELTA_MERGE_GAP; ++i) {
+                if (old_value[i] == new_value[i]) {
+                    ++same;
+                } else {
+                    same = 0;
+                    end = i + 1;
+                }
+            }
+            deltas_.push_back({static_cast<uint16_t>(begin), static_cast<uint16_t>(end - begin)});
+            delta_data_.append(old_value + begin, end - begin);
+            delta_data_.append(new_value + begin, end - begin);
+            pos = end;
+        }
+        log_tot_len_ += sizeof(Rid) + sizeof(int) + sizeof(int);
+        log_tot_len_ += deltas_.size() * sizeof(UpdateDelta) + delta_data_.size();
+    }
+
+    // 把update日志记录序列化到dest中
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        int offset = OFFSET_LOG_DATA;
+        memcpy(dest + offset, &rid_, sizeof(Rid));
+        offset += sizeof(Rid);
+        memcpy(dest + offset, &table_id_, sizeof(int));
+        offset += sizeof(int);
+        int delta_num = deltas_.size();
+        memcpy(dest + offset, &delta_num, sizeof(int));
+        offset += sizeof(int);
+        const char* data = delta_data_.data();
+        for (auto& delta : deltas_) {
+            memcpy(dest + offset, &delta, sizeof(UpdateDelta));
+            offset += sizeof(UpdateDelta);
+            memcpy(dest + offset, data, 2 * delta.len_);
+            offset += 2 * delta.len_;
+            data += 2 * delta.len_;
+        }
+    }
+    // 从src中反序列化出一条Update日志记录
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        int offset = OFFSET_LOG_DATA;
+        rid_ = *reinterpret_cast<const Rid*>(src + offset);
+        offset += sizeof(Rid);
+        table_id_ = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        int delta_num = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        deltas_.clear();
+        delta_data_.clear();
+        for (int i = 0; i < delta_num; ++i) {
+            UpdateDelta delta;
+            memcpy(&delta, src + offset, sizeof(UpdateDelta));
+            offset += sizeof(UpdateDelta);
+            deltas_.push_back(delta);
+            delta_data_.append(src + offset, 2 * delta.len_);
+            offset += 2 * delta.len_;
+        }
+    }
+    void format_print() override {
+        printf("update record\n");
+        LogRecord::format_print();
+        printf("update rid: %d, %d\n", rid_.page_no, rid_.slot_no);
+        printf("table id: %d, delta num: %zu\n", table_id_, deltas_.size());
+    }
+
+    // 在记录上重放更新，写入后像
+    void redo(char* record) const { apply(record, true); }
+
+    // 在记录上回滚更新，写回前像
+    void undo(char* record) const { apply(record, false); }
 
+    Rid rid_;                           // 更新记录的位置
+    int table_id_;                      // 更新记录的表ID
+    std::vector<UpdateDelta> deltas_;   // 变化的字节区间
+    std::string delta_data_;            // 每个区间依次存放前像和后像
+
+private:
+    void apply(char* record, bool is_redo) const {
+        const char* data = delta_data_.data();
+        for (auto& delta : deltas_) {
+            memcpy(record + delta.offset_, is_redo ? data + delta.len_ : data, delta.len_);
+            data += 2 * delta.len_;
+        }
+    }
 };
 
-/* 日志缓冲区，只有一个buffer，因此需要阻塞地去把日志写入缓冲区中 */
+/**
+ * 模糊检查点开始的日志记录，只有日志头
+*/
+class BeginCheckpointLogRecord: public LogRecord {
+public:
+    BeginCheckpointLogRecord() {
+        log_type_ = LogType::BEGIN_CHECKPOINT;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+    }
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+    }
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+    }
+};
+
+/* 检查点脏页表中的一项：表中的一个脏页面及其recLSN */
+struct CheckpointDirtyPage {
+    int table_id_;
+    int page_no_;
+    lsn_t rec_lsn_;
+};
+
+/**
+ * 模糊检查点结束的日志记录，记录检查点开始时的活跃事务表和脏页表
+ * | header | begin_lsn | att_num | (txn_id, last_lsn) * att_num | dpt_num | (table_id, page_no, rec_lsn) * dpt_num |
+*/
+class EndCheckpointLogRecord: public LogRecord {
+public:
+    EndCheckpointLogRecord() {
+        log_type_ = LogType::END_CHECKPOINT;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        begin_lsn_ = INVALID_LSN;
+    }
+    EndCheckpointLogRecord(lsn_t begin_lsn, std::vector<std::pair<txn_id_t, lsn_t>> active_txns,
+                           std::vector<CheckpointDirtyPage> dirty_pages)
+        : EndCheckpointLogRecord() {
+        begin_lsn_ = begin_lsn;
+        active_txns_ = std::move(active_txns);
+        dirty_pages_ = std::move(dirty_pages);
+        log_tot_len_ += sizeof(lsn_t) + sizeof(int) + active_txns_.size() * (sizeof(txn_id_t) + sizeof(lsn_t));
+        log_tot_len_ += sizeof(int);
+        log_tot_len_ += dirty_pages_.size() * (sizeof(int) + sizeof(int) + sizeof(lsn_t));
+    }
+
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        int offset = OFFSET_LOG_DATA;
+        memcpy(dest + offset, &begin_lsn_, sizeof(lsn_t));
+        offset += sizeof(lsn_t);
+        int att_num = active_txns_.size();
+        memcpy(dest + offset, &att_num, sizeof(int));
+        offset += sizeof(int);
+        for (auto& [txn_id, last_lsn] : active_txns_) {
+            memcpy(dest + offset, &txn_id, sizeof(txn_id_t));
+            offset += sizeof(txn_id_t);
+            memcpy(dest + offset, &last_lsn, sizeof(lsn_t));
+            offset += sizeof(lsn_t);
+        }
+        int dpt_num = dirty_pages_.size();
+        memcpy(dest + offset, &dpt_num, sizeof(int));
+        offset += sizeof(int);
+        for (auto& dirty_page : dirty_pages_) {
+            memcpy(dest + offset, &dirty_page.table_id_, sizeof(int));
+            offset += sizeof(int);
+            memcpy(dest + offset, &dirty_page.page_no_, sizeof(int));
+            offset += sizeof(int);
+            memcpy(dest + offset, &dirty_page.rec_lsn_, sizeof(lsn_t));
+            offset += sizeof(lsn_t);
+        }
+    }
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        int offset = OFFSET_LOG_DATA;
+        begin_lsn_ = *reinterpret_cast<const lsn_t*>(src + offset);
+        offset += sizeof(lsn_t);
+        int att_num = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        active_txns_.clear();
+        for (int i = 0; i < att_num; ++i) {
+            auto txn_id = *reinterpret_cast<const txn_id_t*>(src + offset);
+            offset += sizeof(txn_id_t);
+            auto last_lsn = *reinterpret_cast<const lsn_t*>(src + offset);
+            offset += sizeof(lsn_t);
+            active_txns_.emplace_back(txn_id, last_lsn);
+        }
+        int dpt_num = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        dirty_pages_.clear();
+        for (int i = 0; i < dpt_num; ++i) {
+            CheckpointDirtyPage dirty_page;
+            dirty_page.table_id_ = *reinterpret_cast<const int*>(src + offset);
+            offset += sizeof(int);
+            dirty_page.page_no_ = *reinterpret_cast<const int*>(src + offset);
+            offset += sizeof(int);
+            dirty_page.rec_lsn_ = *reinterpret_cast<const lsn_t*>(src + offset);
+            offset += sizeof(lsn_t);
+            dirty_pages_.emplace_back(std::move(dirty_page));
+        }
+    }
+
+    lsn_t begin_lsn_;                                           // 对应的begin checkpoint日志的lsn
+    std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;       // 检查点开始时的活跃事务 -> 最后一条日志的lsn
+    std::vector<CheckpointDirtyPage> dirty_pages_;              // 检查点开始时缓冲池中的脏页
+};
+
+/**
+ * 批量导入发布页面的日志记录：表中[first_page, end_page)的页面已经不经过缓冲池写入并落盘，
+ * 恢复时看到这条日志才把文件的页面数推进到end_page，并重建表上的空闲页面链表和索引
+ * | header | table_id | first_page | end_page |
+*/
+class BulkLoadLogRecord: public LogRecord {
+public:
+    BulkLoadLogRecord() {
+        log_type_ = LogType::BULK_LOAD;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE + 3 * sizeof(int);
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        table_id_ = 0;
+        first_page_ = 0;
+        end_page_ = 0;
+    }
+    BulkLoadLogRecord(int table_id, int first_page, int end_page) : BulkLoadLogRecord() {
+        table_id_ = table_id;
+        first_page_ = first_page;
+        end_page_ = end_page;
+    }
+
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        int offset = OFFSET_LOG_DATA;
+        memcpy(dest + offset, &table_id_, sizeof(int));
+        offset += sizeof(int);
+        memcpy(dest + offset, &first_page_, sizeof(int));
+        offset += sizeof(int);
+        memcpy(dest + offset, &end_page_, sizeof(int));
+    }
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        int offset = OFFSET_LOG_DATA;
+        table_id_ = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        first_page_ = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
+        end_page_ = *reinterpret_cast<const int*>(src + offset);
+    }
+
+    int table_id_;      // 导入的表
+    int first_page_;    // 导入开始时文件的页面数，即第一个新页面
+    int end_page_;      // 导入结束时文件的页面数
+};
+
+/* 日志缓冲区。LogManager 中有两个缓冲区轮流使用：一个接收追加的日志，另一个被刷盘线程写盘 */
 
 class LogBuffer {
 public:
@@ -204,24 +572,103 @@ public:
         return false;
     }
 
+    // 当前线程完成一次预留（拷贝完毕或预留失败）后计入自己的分片
+    void finish(int64_t len) {
+        finished_[finish_stripe()].count.fetch_add(len, std::memory_order_release);
+    }
+
+    // 各分片之和，只会增长，等于封存时的预留量说明没有写者在拷贝
+    int64_t finished() {
+        int64_t sum = 0;
+        for (auto& stripe : finished_) {
+            sum += stripe.count.load(std::memory_order_acquire);
+        }
+        return sum;
+    }
+
+    void reset_finished() {
+        for (auto& stripe : finished_) {
+            stripe.count.store(0, std::memory_order_relaxed);
+        }
+    }
+
     char buffer_[LOG_BUFFER_SIZE+1];
     int offset_;    // 写入log的offset
+    int used_{0};                   // 缓冲区满时第一个预留失败者记录的有效日志长度
+
+private:
+    // 线程第一次追加日志时轮流分配分片
+    static size_t finish_stripe() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % LOG_FINISH_STRIPES;
+        return stripe;
+    }
+
+    // 已经完成的预留字节数按线程分片计数，并发追加日志的线程除了分配lsn外不写同一个缓存行
+    struct alignas(64) FinishStripe {
+        std::atomic<int64_t> count{0};
+    };
+    std::array<FinishStripe, LOG_FINISH_STRIPES> finished_{};
 };
 
-/* 日志管理器，负责把日志写入日志缓冲区，以及把日志缓冲区中的内容写入磁盘中 */
+/* 日志管理器，负责把日志写入日志缓冲区，以及把日志缓冲区中的内容写入磁盘中
+ * 采用组提交：后台刷盘线程每轮把缓冲区中积攒的日志一次性写盘并 fsync，
+ * 提交的事务只需等待自己的 commit 日志被持久化，而不是各自 fsync 一次
+ * 追加日志不加锁：lsn、当前缓冲区编号和缓冲区内偏移打包在 reserve_state_ 中，
+ * 写者通过一次 fetch_add 同时拿到 lsn 和空间，保证缓冲区中日志按 lsn 顺序排列 */
 class LogManager {
 public:
     LogManager(DiskManager* disk_manager) { disk_manager_ = disk_manager; }
+
+    ~LogManager() { stop_flush_thread(); }
     
     lsn_t add_log_to_buffer(LogRecord* log_record);
+    lsn_t add_logs_to_buffer(LogRecord** log_records, int num, lsn_t prev_lsn);
     void flush_log_to_disk();
 
-    LogBuffer* get_log_buffer() { return &log_buffer_; }
+    void wait_for_flush(lsn_t lsn);
+
+    void start_flush_thread();
+    void stop_flush_thread();
+
+    lsn_t get_persist_lsn() { return persist_lsn_.load(); }
+
+    void recycle_log(lsn_t lsn);
+
+    int64_t wait_for_persist_offset(int64_t offset, std::chrono::milliseconds timeout);
+
+    void set_next_lsn(lsn_t lsn);
+
+    /* 下一条日志将被分配的lsn */
+    lsn_t get_next_lsn() { return static_cast<lsn_t>(reserve_state_.load() >> RESERVE_LSN_SHIFT); }
+
+    LogBuffer* get_log_buffer() { return &log_buffers_[(reserve_state_.load() >> RESERVE_IDX_SHIFT) & 1]; }
 
 private:    
-    std::atomic<lsn_t> global_lsn_{0};  // 全局lsn，递增，用于为每条记录分发lsn
-    std::mutex latch_;                  // 用于对log_buffer_的互斥访问
-    LogBuffer log_buffer_;              // 日志缓冲区
-    lsn_t persist_lsn_;                 // 记录已经持久化到磁盘中的最后一条日志的日志号
+    void flush_buffer();
+    void flush_thread_func();
+
+    // reserve_state_ 的布局：[63..33] 下一个lsn，[32] 当前接收日志的缓冲区编号，[31..0] 缓冲区内已预留的偏移
+    static constexpr int RESERVE_LSN_SHIFT = 33;
+    static constexpr int RESERVE_IDX_SHIFT = 32;
+    static constexpr uint64_t RESERVE_OFFSET_MASK = 0xffffffffULL;
+
+    // 全局lsn和空间预留状态，递增，用于为每条记录分发lsn和缓冲区位置；独占一个缓存行，
+    // 提交时等待刷盘的事务加latch_不会让追加日志的线程缓存行失效
+    alignas(64) std::atomic<uint64_t> reserve_state_{0};
+    alignas(64) std::mutex latch_;      // 只用于条件变量的等待和唤醒，追加日志的快路径不持有
+    LogBuffer log_buffers_[2];          // 双缓冲，一个接收日志时另一个可以同时写盘
+    std::mutex flush_latch_;            // 保证同一时刻只有一个刷盘者，写盘顺序与lsn顺序一致
+    std::atomic<lsn_t> persist_lsn_{INVALID_LSN};    // 记录已经持久化到磁盘中的最后一条日志的日志号
+    int64_t persist_offset_{0};                     // 已经持久化的日志尾的逻辑偏移，受latch_保护，发给备库的日志不超过它
+    // 段号 -> 第一批从这个段中开始写盘的日志的第一个lsn，受flush_latch_保护
+    std::map<int64_t, lsn_t> segment_first_lsn_;
     DiskManager* disk_manager_;
-}; 
+
+    std::thread flush_thread_;                          // 后台组提交刷盘线程
+    std::atomic<bool> flush_thread_running_{false};
+    bool flush_requested_{false};                       // 有事务在等待刷盘或缓冲区已满
+    std::condition_variable flush_cv_;                  // 唤醒刷盘线程
+    std::condition_variable persist_cv_;                // persist_lsn_推进后唤醒等待的事务
+    std::condition_variable buffer_cv_;                 // 缓冲区切换后唤醒等待空间的写日志者
+};
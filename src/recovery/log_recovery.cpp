@@ -10,23 +10,437 @@ See the Mulan PSL v2 for more details. */
 
 #include "log_recovery.h"
 
+#include <queue>
+#include <thread>
+
+#include "record/bitmap.h"
+
+/**
+ * @description: 根据日志头中的类型从src中反序列化出一条日志记录
+ * @return {unique_ptr<LogRecord>} 日志记录，类型未知时返回nullptr
+ * @param {char*} src 日志记录的起始地址
+ */
+std::unique_ptr<LogRecord> RecoveryManager::parse_log_record(const char* src) {
+    std::unique_ptr<LogRecord> log_record;
+    switch (*reinterpret_cast<const LogType*>(src + OFFSET_LOG_TYPE)) {
+        case LogType::begin:
+            log_record = std::make_unique<BeginLogRecord>();
+            break;
+        case LogType::commit:
+            log_record = std::make_unique<CommitLogRecord>();
+            break;
+        case LogType::ABORT:
+            log_record = std::make_unique<AbortLogRecord>();
+            break;
+        case LogType::INSERT:
+            log_record = std::make_unique<InsertLogRecord>();
+            break;
+        case LogType::DELETE:
+            log_record = std::make_unique<DeleteLogRecord>();
+            break;
+        case LogType::UPDATE:
+            log_record = std::make_unique<UpdateLogRecord>();
+            break;
+        case LogType::BEGIN_CHECKPOINT:
+            log_record = std::make_unique<BeginCheckpointLogRecord>();
+            break;
+        case LogType::END_CHECKPOINT:
+            log_record = std::make_unique<EndCheckpointLogRecord>();
+            break;
+        case LogType::BULK_LOAD:
+            log_record = std::make_unique<BulkLoadLogRecord>();
+            break;
+        default:
+            return nullptr;
+    }
+    log_record->deserialize(src);
+    return log_record;
+}
+
+/**
+ * @description: 获取数据操作日志涉及的表ID和记录位置
+ * @return {bool} 是否为数据操作日志
+ */
+bool RecoveryManager::get_record_target(LogRecord* log_record, int& table_id, Rid& rid) {
+    switch (log_record->log_type_) {
+        case LogType::INSERT: {
+            auto* insert_log = static_cast<InsertLogRecord*>(log_record);
+            table_id = insert_log->table_id_;
+            rid = insert_log->rid_;
+            return true;
+        }
+        case LogType::DELETE: {
+            auto* delete_log = static_cast<DeleteLogRecord*>(log_record);
+            table_id = delete_log->table_id_;
+            rid = delete_log->rid_;
+            return true;
+        }
+        case LogType::UPDATE: {
+            auto* update_log = static_cast<UpdateLogRecord*>(log_record);
+            table_id = update_log->table_id_;
+            rid = update_log->rid_;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * @description: 从最早保留的段开始顺序读取日志，每条完整的日志交给fn。检查点回收过的段不再存在
+ * @return {int64_t} 最后一条完整日志之后的偏移，即日志尾
+ */
+int64_t RecoveryManager::scan_log(const std::function<void(std::unique_ptr<LogRecord>)>& fn) {
+    int64_t file_offset = disk_manager_->get_log_begin();
+    while (true) {
+        int bytes = disk_manager_->read_log(buffer_.buffer_, LOG_BUFFER_SIZE, file_offset);
+        if (bytes <= 0) {
+            break;
+        }
+        int pos = 0;
+        while (pos + LOG_HEADER_SIZE <= bytes) {
+            auto len = *reinterpret_cast<const uint32_t*>(buffer_.buffer_ + pos + OFFSET_LOG_TOT_LEN);
+            if (len < static_cast<uint32_t>(LOG_HEADER_SIZE) || pos + len > static_cast<uint32_t>(bytes)) {
+                break;
+            }
+            auto log_record = parse_log_record(buffer_.buffer_ + pos);
+            if (log_record == nullptr) {
+                break;
+            }
+            pos += len;
+            fn(std::move(log_record));
+        }
+        // 剩余内容不足一条完整日志，说明是崩溃时写了一半的日志尾
+        if (pos == 0) {
+            break;
+        }
+        file_offset += pos;
+    }
+    return file_offset;
+}
+
+/**
+ * @description: 只找出日志尾，不做恢复。备库用它接着已有的日志接收主库发来的日志
+ */
+void RecoveryManager::find_log_end() {
+    disk_manager_->set_log_end(scan_log([](std::unique_ptr<LogRecord>) {}));
+}
+
 /**
  * @description: analyze阶段，需要获得脏页表（DPT）和未完成的事务列表（ATT）
+ * 顺序读取整个日志文件，同时按页面把需要redo的日志分组。
+ * 存在完整的模糊检查点时，检查点之前的日志只重做检查点脏页表中、且不早于该页recLSN的部分，
+ * 其余页面在检查点时已经是干净的；回滚仍然需要失败事务的完整日志链，因此整个日志文件都要读入
  */
 void RecoveryManager::analyze() {
- 
+    for (auto& [table_name, fh] : sm_manager_->fhs_) {
+        table_names_[fh->get_table_id()] = table_name;
+    }
+
+    // 之后的日志接着最后一条完整日志写，覆盖写了一半的日志尾
+    disk_manager_->set_log_end(scan_log([this](std::unique_ptr<LogRecord> log_record) {
+        lsn2idx_[log_record->lsn_] = logs_.size();
+        logs_.emplace_back(std::move(log_record));
+    }));
+
+    // 找到最后一个完整的检查点（end checkpoint已经落盘）
+    lsn_t checkpoint_lsn = INVALID_LSN;
+    std::map<std::pair<int, int>, lsn_t> checkpoint_dpt;
+    for (auto it = logs_.rbegin(); it != logs_.rend(); ++it) {
+        if ((*it)->log_type_ == LogType::END_CHECKPOINT) {
+            auto* end_checkpoint = static_cast<EndCheckpointLogRecord*>(it->get());
+            checkpoint_lsn = end_checkpoint->begin_lsn_;
+            for (auto& dirty_page : end_checkpoint->dirty_pages_) {
+                checkpoint_dpt.emplace(std::make_pair(dirty_page.table_id_, dirty_page.page_no_), dirty_page.rec_lsn_);
+            }
+            break;
+        }
+    }
+
+    for (auto& log_record : logs_) {
+        max_lsn_ = std::max(max_lsn_, log_record->lsn_);
+        max_txn_id_ = std::max(max_txn_id_, log_record->log_tid_);
+        switch (log_record->log_type_) {
+            case LogType::commit:
+            case LogType::ABORT:
+                active_txns_.erase(log_record->log_tid_);
+                break;
+            case LogType::BEGIN_CHECKPOINT:
+            case LogType::END_CHECKPOINT:
+                break;
+            case LogType::BULK_LOAD: {
+                // 导入的页面在日志之前已经落盘，不需要重做，只把它们接回文件
+                auto* bulk_load = static_cast<BulkLoadLogRecord*>(log_record.get());
+                auto table_name = table_names_.find(bulk_load->table_id_);
+                if (table_name != table_names_.end()) {
+                    sm_manager_->fhs_[table_name->second]->recover_loaded_pages(bulk_load->end_page_);
+                    touched_tables_.insert(bulk_load->table_id_);
+                }
+                break;
+            }
+            default:
+                active_txns_[log_record->log_tid_] = log_record->lsn_;
+                break;
+        }
+
+        int table_id;
+        Rid rid{};
+        if (!get_record_target(log_record.get(), table_id, rid)) {
+            continue;
+        }
+        auto table_name = table_names_.find(table_id);
+        // 表已经被删除，日志无需处理
+        if (table_name == table_names_.end()) {
+            continue;
+        }
+        touched_tables_.insert(table_id);
+        auto page_key = std::make_pair(table_id, rid.page_no);
+        if (log_record->lsn_ < checkpoint_lsn) {
+            auto rec_lsn = checkpoint_dpt.find(page_key);
+            if (rec_lsn == checkpoint_dpt.end() || log_record->lsn_ < rec_lsn->second) {
+                continue;
+            }
+        }
+        dirty_pages_.emplace(page_key, log_record->lsn_);
+        auto& redo_logs = redo_pages_[page_key];
+        redo_logs.table_file_ = sm_manager_->fhs_[table_name->second].get();
+        redo_logs.page_no_ = rid.page_no;
+        redo_logs.redo_logs_.push_back(log_record->lsn_);
+    }
 }
 
 /**
  * @description: 重做所有未落盘的操作
+ * 不同页面之间的redo互不影响，按页面分组后由多个线程并行重放，同一页面内按lsn顺序重放
  */
 void RecoveryManager::redo() {
+    if (redo_pages_.empty()) {
+        return;
+    }
+    // 先串行地把日志中涉及、但文件中还不存在的页面分配出来，页面分配必须按页面号顺序进行
+    std::unordered_map<RmFileHandle*, int> max_page_no;
+    for (auto& [page_key, redo_logs] : redo_pages_) {
+        auto& page_no = max_page_no[redo_logs.table_file_];
+        page_no = std::max(page_no, redo_logs.page_no_);
+    }
+    for (auto& [fh, page_no] : max_page_no) {
+        fh->extend_to_page(page_no);
+    }
 
+    std::vector<RedoLogsInPage*> tasks;
+    tasks.reserve(redo_pages_.size());
+    for (auto& [page_key, redo_logs] : redo_pages_) {
+        tasks.push_back(&redo_logs);
+    }
+    std::atomic<size_t> next_task{0};
+    size_t worker_num = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), tasks.size());
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(worker_num);
+    workers.reserve(worker_num);
+    for (size_t i = 0; i < worker_num; ++i) {
+        workers.emplace_back([this, &tasks, &next_task, &errors, i] {
+            try {
+                for (size_t task = next_task++; task < tasks.size(); task = next_task++) {
+                    redo_page(*tasks[task]);
+                }
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/**
+ * @description: 在一个页面上按lsn顺序重放日志，页面lsn不小于日志lsn说明该操作已经落盘，跳过
+ * 直接修改页面而不经过RmFileHandle，避免多个线程同时修改同一个表的文件头
+ */
+void RecoveryManager::redo_page(RedoLogsInPage& redo_logs) {
+    auto* fh = redo_logs.table_file_;
+    auto&& page_handle = fh->fetch_page_handle(redo_logs.page_no_);
+    char buf[RM_MAX_RECORD_SIZE];
+    bool dirty = false;
+    for (auto lsn : redo_logs.redo_logs_) {
+        if (page_handle.page->get_page_lsn() >= lsn) {
+            continue;
+        }
+        auto* log_record = logs_[lsn2idx_[lsn]].get();
+        switch (log_record->log_type_) {
+            case LogType::INSERT: {
+                auto* insert_log = static_cast<InsertLogRecord*>(log_record);
+                int slot_no = insert_log->rid_.slot_no;
+                // 按日志顺序重放，变长格式的页面空间和当初一样够用
+                if (!page_handle.write_record(slot_no, insert_log->insert_value_.data)) {
+                    throw InternalError("RecoveryManager::redo_page: no space for record");
+                }
+                if (!Bitmap::is_set(page_handle.bitmap, slot_no)) {
+                    Bitmap::set(page_handle.bitmap, slot_no);
+                    ++page_handle.page_hdr->num_records;
+                }
+                break;
+            }
+            case LogType::DELETE: {
+                auto* delete_log = static_cast<DeleteLogRecord*>(log_record);
+                int slot_no = delete_log->rid_.slot_no;
+                if (Bitmap::is_set(page_handle.bitmap, slot_no)) {
+                    page_handle.erase_record(slot_no);
+                    Bitmap::reset(page_handle.bitmap, slot_no);
+                    --page_handle.page_hdr->num_records;
+                }
+                break;
+            }
+            case LogType::UPDATE: {
+                auto* update_log = static_cast<UpdateLogRecord*>(log_record);
+                int slot_no = update_log->rid_.slot_no;
+                page_handle.read_record(slot_no, buf);
+                update_log->redo(buf);
+                if (!page_handle.write_record(slot_no, buf)) {
+                    throw InternalError("RecoveryManager::redo_page: no space for record");
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        page_handle.page->set_page_lsn(lsn);
+        dirty = true;
+    }
+    buffer_pool_manager_->unpin_page(page_handle.page, dirty);
 }
 
 /**
  * @description: 回滚未完成的事务
+ * 每次从所有未完成事务中取lsn最大的一条日志回滚，再沿prev_lsn_找到该事务的前一条日志
  */
 void RecoveryManager::undo() {
+    std::priority_queue<lsn_t> undo_lsns;
+    for (auto& [txn_id, last_lsn] : active_txns_) {
+        undo_lsns.push(last_lsn);
+    }
+    while (!undo_lsns.empty()) {
+        lsn_t lsn = undo_lsns.top();
+        undo_lsns.pop();
+        auto idx = lsn2idx_.find(lsn);
+        if (idx == lsn2idx_.end()) {
+            continue;
+        }
+        auto* log_record = logs_[idx->second].get();
+        undo_log(log_record);
+        if (log_record->prev_lsn_ != INVALID_LSN && log_record->log_type_ != LogType::begin) {
+            undo_lsns.push(log_record->prev_lsn_);
+        }
+    }
+    finish_recovery();
+}
 
-}
\ No newline at end of file
+/**
+ * @description: 回滚一条数据操作日志
+ */
+void RecoveryManager::undo_log(LogRecord* log_record) {
+    int table_id;
+    Rid rid{};
+    if (!get_record_target(log_record, table_id, rid) || table_names_.count(table_id) == 0) {
+        return;
+    }
+    auto* fh = sm_manager_->fhs_[table_names_[table_id]].get();
+    auto&& page_handle = fh->fetch_page_handle(rid.page_no);
+    char buf[RM_MAX_RECORD_SIZE];
+    // 变长格式中前像在原位置放不下时（页面空间被其他事务的记录占用），从原位置删除并写到文件末尾的新页面
+    const char* relocated = nullptr;
+    switch (log_record->log_type_) {
+        case LogType::INSERT: {
+            if (Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+                page_handle.erase_record(rid.slot_no);
+                Bitmap::reset(page_handle.bitmap, rid.slot_no);
+                --page_handle.page_hdr->num_records;
+            }
+            break;
+        }
+        case LogType::DELETE: {
+            auto* delete_log = static_cast<DeleteLogRecord*>(log_record);
+            if (!page_handle.write_record(rid.slot_no, delete_log->delete_value_.data)) {
+                relocated = delete_log->delete_value_.data;
+            } else if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+                Bitmap::set(page_handle.bitmap, rid.slot_no);
+                ++page_handle.page_hdr->num_records;
+            }
+            break;
+        }
+        case LogType::UPDATE: {
+            auto* update_log = static_cast<UpdateLogRecord*>(log_record);
+            // 记录已经在回滚之后的日志时被移走
+            if (!Bitmap::is_set(page_handle.bitmap, rid.slot_no)) {
+                break;
+            }
+            page_handle.read_record(rid.slot_no, buf);
+            update_log->undo(buf);
+            if (!page_handle.write_record(rid.slot_no, buf)) {
+                page_handle.erase_record(rid.slot_no);
+                Bitmap::reset(page_handle.bitmap, rid.slot_no);
+                --page_handle.page_hdr->num_records;
+                relocated = buf;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    buffer_pool_manager_->unpin_page(page_handle.page, true);
+    if (relocated != nullptr) {
+        fh->append_record(relocated);
+    }
+}
+
+/**
+ * @description: 恢复收尾：重建空闲页面链表和索引（索引页面不记日志），把恢复结果落盘后为回滚的事务写abort日志，
+ * 最后续接lsn和事务ID
+ */
+void RecoveryManager::finish_recovery() {
+    Transaction recovery_txn(INVALID_TXN_ID);
+    Context context(nullptr, nullptr, &recovery_txn);
+    for (auto table_id : touched_tables_) {
+        auto& table_name = table_names_[table_id];
+        auto* fh = sm_manager_->fhs_[table_name].get();
+        fh->rebuild_free_list();
+        // 重建该表上的所有索引
+        std::vector<IndexMeta> indexes;
+        for (auto& [index_name, index_meta] : sm_manager_->db_.get_table(table_name).indexes) {
+            indexes.push_back(index_meta);
+        }
+        for (auto& index : indexes) {
+            std::vector<std::string> col_names;
+            col_names.reserve(index.cols.size());
+            for (auto& col : index.cols) {
+                col_names.push_back(col.name);
+            }
+            sm_manager_->drop_index(table_name, index.cols, &context);
+            sm_manager_->create_index(table_name, col_names, &context, index.type);
+        }
+        buffer_pool_manager_->flush_all_pages(fh->GetFd());
+    }
+
+    log_manager_->set_next_lsn(max_lsn_ + 1);
+    // 回滚结果已经落盘，写abort日志，再次崩溃时这些事务不会被重复回滚
+    for (auto& [txn_id, last_lsn] : active_txns_) {
+        AbortLogRecord abort_log_record(txn_id);
+        abort_log_record.prev_lsn_ = last_lsn;
+        log_manager_->add_log_to_buffer(&abort_log_record);
+    }
+    log_manager_->flush_log_to_disk();
+    txn_manager_->set_next_txn_id(max_txn_id_ + 1);
+
+    logs_.clear();
+    lsn2idx_.clear();
+    active_txns_.clear();
+    dirty_pages_.clear();
+    redo_pages_.clear();
+    touched_tables_.clear();
+    table_names_.clear();
+}
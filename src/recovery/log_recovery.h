@@ -10,33 +10,63 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include "log_manager.h"
 #include "storage/disk_manager.h"
 #include "system/sm_manager.h"
+#include "transaction/transaction_manager.h"
 
 class RedoLogsInPage {
 public:
     RedoLogsInPage() { table_file_ = nullptr; }
     RmFileHandle* table_file_;
+    int page_no_;
     std::vector<lsn_t> redo_logs_;   // 在该page上需要redo的操作的lsn
 };
 
 class RecoveryManager {
 public:
-    RecoveryManager(DiskManager* disk_manager, BufferPoolManager* buffer_pool_manager, SmManager* sm_manager) {
+    RecoveryManager(DiskManager* disk_manager, BufferPoolManager* buffer_pool_manager, SmManager* sm_manager,
+                    LogManager* log_manager, TransactionManager* txn_manager) {
         disk_manager_ = disk_manager;
         buffer_pool_manager_ = buffer_pool_manager;
         sm_manager_ = sm_manager;
+        log_manager_ = log_manager;
+        txn_manager_ = txn_manager;
     }
 
     void analyze();
     void redo();
     void undo();
+    void find_log_end();
 private:
+    static std::unique_ptr<LogRecord> parse_log_record(const char* src);
+    static bool get_record_target(LogRecord* log_record, int& table_id, Rid& rid);
+
+    int64_t scan_log(const std::function<void(std::unique_ptr<LogRecord>)>& fn);
+
+    void redo_page(RedoLogsInPage& redo_logs);
+    void undo_log(LogRecord* log_record);
+    void finish_recovery();
+
     LogBuffer buffer_;                                              // 读入日志
     DiskManager* disk_manager_;                                     // 用来读写文件
     BufferPoolManager* buffer_pool_manager_;                        // 对页面进行读写
     SmManager* sm_manager_;                                         // 访问数据库元数据
+    LogManager* log_manager_;                                       // 恢复结束后续接lsn、写abort日志
+    TransactionManager* txn_manager_;                               // 恢复结束后续接事务ID
+
+    std::vector<std::unique_ptr<LogRecord>> logs_;                  // 日志文件中的全部日志，按lsn递增排列
+    std::unordered_map<lsn_t, size_t> lsn2idx_;                     // lsn -> 日志在logs_中的下标
+    std::unordered_map<txn_id_t, lsn_t> active_txns_;               // ATT：未完成事务 -> 该事务最后一条日志的lsn
+    std::unordered_map<int, std::string> table_names_;              // 表ID -> 表名，日志中只记录表ID
+    std::map<std::pair<int, int>, lsn_t> dirty_pages_;              // DPT：(表ID, 页面号) -> recLSN
+    std::map<std::pair<int, int>, RedoLogsInPage> redo_pages_;      // 按页面划分的redo日志
+    std::unordered_set<int> touched_tables_;                        // 日志涉及的表，恢复结束后需要重建空闲链表和索引
+    lsn_t max_lsn_ = INVALID_LSN;
+    txn_id_t max_txn_id_ = INVALID_TXN_ID;
 };
\ No newline at end of file
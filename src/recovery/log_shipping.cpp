@@ -0,0 +1,153 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "log_shipping.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+static constexpr auto LOG_SHIPPING_POLL = std::chrono::milliseconds(100);  // 没有新日志时多久检查一次连接
+static constexpr auto LOG_SHIPPING_RETRY = std::chrono::seconds(1);        // 备库重连主库的间隔
+
+static bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * @description: 给一个备库发送日志，从备库报告的日志尾开始，每次把已经持久化的新日志读出来发送。
+ * 备库需要的段已经被检查点回收时断开连接，备库要重新从主库的目录拷贝初始目录
+ */
+static void send_log(int fd, LogManager* log_manager, DiskManager* disk_manager) {
+    uint64_t start;
+    if (!recv_all(fd, reinterpret_cast<char*>(&start), sizeof(start))) {
+        close(fd);
+        return;
+    }
+    auto offset = static_cast<int64_t>(be64toh(start));
+    auto buf = std::make_unique<char[]>(LOG_BUFFER_SIZE);
+    while (true) {
+        int64_t persist = log_manager->wait_for_persist_offset(offset, LOG_SHIPPING_POLL);
+        if (persist <= offset) {
+            // 没有新日志，顺便检查备库是否已经断开
+            char c;
+            if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                break;
+            }
+            continue;
+        }
+        int size = static_cast<int>(std::min<int64_t>(persist - offset, LOG_BUFFER_SIZE));
+        int bytes = disk_manager->read_log(buf.get(), size, offset);
+        if (bytes <= 0) {
+            std::cerr << "log shipping: log at offset " << offset << " has been recycled" << std::endl;
+            break;
+        }
+        if (!send_all(fd, buf.get(), bytes)) {
+            break;
+        }
+        offset += bytes;
+    }
+    close(fd);
+}
+
+void start_log_sender(int port, LogManager* log_manager, DiskManager* disk_manager) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        throw UnixError();
+    }
+    int val = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr)) == -1 || listen(listen_fd, SOMAXCONN) == -1) {
+        throw UnixError();
+    }
+    std::thread([listen_fd, log_manager, disk_manager] {
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd == -1) {
+                continue;
+            }
+            std::thread(send_log, fd, log_manager, disk_manager).detach();
+        }
+    }).detach();
+}
+
+static int connect_primary(const std::string& host, int port) {
+    struct addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd != -1 && connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+void run_log_receiver(const std::string& host, int port, DiskManager* disk_manager) {
+    auto buf = std::make_unique<char[]>(LOG_BUFFER_SIZE);
+    while (true) {
+        int fd = connect_primary(host, port);
+        if (fd == -1) {
+            std::this_thread::sleep_for(LOG_SHIPPING_RETRY);
+            continue;
+        }
+        uint64_t start = htobe64(static_cast<uint64_t>(disk_manager->get_log_end()));
+        if (send_all(fd, reinterpret_cast<const char*>(&start), sizeof(start))) {
+            // 每收到一批就写盘并fdatasync，备库的日志尾随时都是主库已持久化日志的前缀
+            ssize_t n;
+            while ((n = recv(fd, buf.get(), LOG_BUFFER_SIZE, 0)) > 0) {
+                disk_manager->write_log(buf.get(), static_cast<int>(n));
+                disk_manager->sync_log();
+            }
+        }
+        close(fd);
+        std::cerr << "log shipping: disconnected from " << host << ":" << port << ", received up to offset "
+                  << disk_manager->get_log_end() << std::endl;
+        std::this_thread::sleep_for(LOG_SHIPPING_RETRY);
+    }
+}
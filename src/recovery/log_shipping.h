@@ -0,0 +1,27 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <string>
+
+#include "log_manager.h"
+#include "storage/disk_manager.h"
+
+/* 日志传输：主库把已经持久化的日志按逻辑偏移原样发给备库，备库写进自己的日志段，两边的段号和偏移完全一致。
+ * 协议很简单：备库连上后发送8字节（大端）的日志尾偏移，主库从这个偏移开始不停地发送日志字节流。
+ * 备库的初始目录是主库停机后的数据库目录的拷贝；备库只保存日志，不执行查询，
+ * 提升为主库时去掉 -f 重新启动，按正常的故障恢复重放收到的日志 */
+
+// 主库：在port上接受备库的连接，每个备库一个发送线程
+void start_log_sender(int port, LogManager* log_manager, DiskManager* disk_manager);
+
+// 备库：连接主库并把收到的日志写盘，连接断开后隔一段时间重连，不返回
+void run_log_receiver(const std::string& host, int port, DiskManager* disk_manager);
@@ -0,0 +1,149 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+
+#include "lru_k_replacer.h"
+
+LRUKReplacer::LRUKReplacer(size_t num_pages, size_t k) : k_(k), frames_(num_pages) {
+  for (auto& info : frames_) {
+    info.history_.resize(k_);
+  }
+}
+
+/**
+ * @description: 计算帧在淘汰顺序中的位置，访问不足k次的按最早一次访问排序，否则按倒数第k次访问排序
+ * @param {frame_id_t} frame_id
+ */
+LRUKReplacer::Key LRUKReplacer::make_key(frame_id_t frame_id) const {
+  auto& info = frames_[frame_id];
+  if (info.num_accesses_ == 0) {
+    return {false, info.unpin_ts_, frame_id};
+  }
+  return {info.num_accesses_ >= k_, info.history_[info.head_], frame_id};
+}
+
+void LRUKReplacer::reset(FrameInfo& info) {
+  info.head_ = 0;
+  info.num_accesses_ = 0;
+}
+
+/**
+ * @description: 淘汰倒数第k次访问最早的帧，淘汰后清空它的访问记录
+ * @param {frame_id_t*} frame_id 被移除的frame的id
+ * @return {bool} 如果成功淘汰了一个页面则返回true，否则返回false
+ */
+bool LRUKReplacer::victim(frame_id_t* frame_id) {
+  std::scoped_lock lock{latch_};
+  if (evictable_.empty()) {
+    return false;
+  }
+  *frame_id = std::get<2>(*evictable_.begin());
+  evictable_.erase(evictable_.begin());
+  auto& info = frames_[*frame_id];
+  info.evictable_ = false;
+  reset(info);
+  return true;
+}
+
+/**
+ * @description: 固定指定的frame，即该页面无法被淘汰
+ * @param {frame_id_t} 需要固定的frame的id
+ */
+void LRUKReplacer::pin(frame_id_t frame_id) {
+  std::scoped_lock lock{latch_};
+  auto& info = frames_[frame_id];
+  if (++info.pin_count_ == 1 && info.evictable_) {
+    evictable_.erase(make_key(frame_id));
+    info.evictable_ = false;
+  }
+}
+
+/**
+ * @description: 取消固定一个frame，代表该页面可以被淘汰
+ * @param {frame_id_t} frame_id 取消固定的frame的id
+ */
+void LRUKReplacer::unpin(frame_id_t frame_id) {
+  std::scoped_lock lock{latch_};
+  auto& info = frames_[frame_id];
+  if (info.pin_count_ > 0 && --info.pin_count_ > 0) {
+    return;
+  }
+  if (!info.evictable_) {
+    info.unpin_ts_ = current_ts_;
+    info.evictable_ = true;
+    evictable_.insert(make_key(frame_id));
+  }
+}
+
+/**
+ * @description: 记录一次访问。与上一次访问间隔不超过LRUK_CORRELATED_PERIOD的访问视为同一次，只更新最后一次的时间，
+ * 这样扫描逐条记录反复获取同一页不会让页面看起来很热
+ * @param {frame_id_t} frame_id 被访问的frame的id
+ */
+void LRUKReplacer::record_access(frame_id_t frame_id) {
+  std::scoped_lock lock{latch_};
+  auto& info = frames_[frame_id];
+  if (info.evictable_) {
+    evictable_.erase(make_key(frame_id));
+  }
+  uint64_t ts = ++current_ts_;
+  if (info.num_accesses_ > 0) {
+    size_t last = (info.head_ + info.num_accesses_ - 1) % k_;
+    if (ts - info.history_[last] <= static_cast<uint64_t>(LRUK_CORRELATED_PERIOD)) {
+      info.history_[last] = ts;
+    } else if (info.num_accesses_ < k_) {
+      info.history_[(last + 1) % k_] = ts;
+      ++info.num_accesses_;
+    } else {
+      info.history_[info.head_] = ts;
+      info.head_ = (info.head_ + 1) % k_;
+    }
+  } else {
+    info.history_[info.head_] = ts;
+    info.num_accesses_ = 1;
+  }
+  if (info.evictable_) {
+    evictable_.insert(make_key(frame_id));
+  }
+}
+
+/**
+ * @description: 页面被删除、帧回到空闲链表，移出可淘汰集合并清空访问记录
+ * @param {frame_id_t} frame_id 被删除页面所在的frame的id
+ */
+void LRUKReplacer::remove(frame_id_t frame_id) {
+  std::scoped_lock lock{latch_};
+  auto& info = frames_[frame_id];
+  if (info.evictable_) {
+    evictable_.erase(make_key(frame_id));
+    info.evictable_ = false;
+  }
+  info.pin_count_ = 0;
+  reset(info);
+}
+
+/**
+ * @description: 下一个将被淘汰的帧之前的位置，后台写页线程从其后开始扫描
+ */
+int LRUKReplacer::get_pointer() const {
+  std::scoped_lock lock{latch_};
+  if (evictable_.empty()) {
+    return 0;
+  }
+  return std::get<2>(*evictable_.begin()) - 1;
+}
+
+/**
+ * @description: 获取当前replacer中可以被淘汰的页面数量
+ */
+size_t LRUKReplacer::Size() {
+  std::scoped_lock lock{latch_};
+  return evictable_.size();
+}
@@ -0,0 +1,73 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+
+#pragma once
+
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "common/config.h"
+#include "replacer/replacer.h"
+
+/*
+LRUKReplacer实现了LRU-K替换策略：淘汰倒数第K次访问最早的帧，访问不足K次的帧优先淘汰（按最早一次访问排序）。
+大表扫描的页面只被访问一次，会先于被反复访问的热点页面淘汰，不会把整个缓冲池冲掉
+*/
+class LRUKReplacer : public Replacer {
+ public:
+  /**
+   * @description: 创建一个新的LRUKReplacer
+   * @param {size_t} num_pages LRUKReplacer最多需要存储的page数量
+   * @param {size_t} k 按倒数第k次访问的时间淘汰
+   */
+  explicit LRUKReplacer(size_t num_pages, size_t k = LRUK_K);
+
+  ~LRUKReplacer() override = default;
+
+  bool victim(frame_id_t* frame_id) override;
+
+  void pin(frame_id_t frame_id) override;
+
+  void unpin(frame_id_t frame_id) override;
+
+  size_t Size() override;
+
+  void record_access(frame_id_t frame_id) override;
+
+  void remove(frame_id_t frame_id) override;
+
+  int get_pointer() const override;
+
+ private:
+  // 淘汰顺序：{访问次数是否达到k, 排序时间戳, frame_id}，越小越先淘汰
+  using Key = std::tuple<bool, uint64_t, frame_id_t>;
+
+  struct FrameInfo {
+    std::vector<uint64_t> history_;  // 最近k次访问的时间戳，环形存放
+    size_t head_ = 0;                // 最早一次访问在history_中的位置
+    size_t num_accesses_ = 0;        // 记录的访问次数，最多k
+    uint64_t unpin_ts_ = 0;          // 最近一次变为可淘汰的时间，没有访问记录时用它排序
+    int pin_count_ = 0;
+    bool evictable_ = false;
+  };
+
+  Key make_key(frame_id_t frame_id) const;
+
+  void reset(FrameInfo& info);
+
+  mutable std::mutex latch_;
+  size_t k_;
+  uint64_t current_ts_ = 0;      // 逻辑时钟，每次访问加一
+  std::vector<FrameInfo> frames_;
+  std::set<Key> evictable_;      // 可淘汰的帧
+};
@@ -12,7 +12,7 @@ See the Mulan PSL v2 for more details. */
 
 #include <unistd.h>
 
-LRUReplacer::LRUReplacer(size_t num_pages) { max_size_ = num_pages; }
+LRUReplacer::LRUReplacer(size_t num_pages) : pin_count_(num_pages, 0) { max_size_ = num_pages; }
 
 LRUReplacer::~LRUReplacer() = default;
 
@@ -49,6 +49,7 @@ void LRUReplacer::pin(frame_id_t frame_id) {
   // Todo:
   // 固定指定id的frame
   // 在数据结构中移除该frame
+  ++pin_count_[frame_id];
   auto&& it = LRUhash_.find(frame_id);
   if (it != LRUhash_.end()) {
     LRUlist_.erase(it->second);
@@ -66,6 +67,11 @@ void LRUReplacer::unpin(frame_id_t frame_id) {
   //  选择一个frame取消固定
   std::scoped_lock lock{latch_};
 
+  // 不持有缓冲池latch_的unpin可能晚于另一个线程的pin到达，pin计数归零才可以淘汰
+  if (pin_count_[frame_id] > 0 && --pin_count_[frame_id] > 0) {
+    return;
+  }
+
   // 满了
   if (LRUlist_.size() >= max_size_) {
     return;
@@ -77,6 +83,20 @@ void LRUReplacer::unpin(frame_id_t frame_id) {
   }
 }
 
+/**
+ * @description: 页面被删除、帧回到空闲链表，移出LRU链表并清空pin计数
+ * @param {frame_id_t} frame_id 被删除页面所在的frame的id
+ */
+void LRUReplacer::remove(frame_id_t frame_id) {
+  std::scoped_lock lock{latch_};
+  pin_count_[frame_id] = 0;
+  auto&& it = LRUhash_.find(frame_id);
+  if (it != LRUhash_.end()) {
+    LRUlist_.erase(it->second);
+    LRUhash_.erase(it);
+  }
+}
+
 /**
  * @description: 获取当前replacer中可以被淘汰的页面数量
  */
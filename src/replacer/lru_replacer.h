@@ -10,7 +10,9 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <atomic>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -37,6 +39,8 @@ class LRUReplacer : public Replacer {
 
   void unpin(frame_id_t frame_id);
 
+  void remove(frame_id_t frame_id) override;
+
   size_t Size();
 
  private:
@@ -45,48 +49,72 @@ class LRUReplacer : public Replacer {
                                    // id，首部表示最近被访问
   std::unordered_map<frame_id_t, std::list<frame_id_t>::iterator>
       LRUhash_;      // frame_id_t -> unpinned pages的frame id
+  std::vector<int> pin_count_;  // 每个frame被pin的次数，unpin到0才可以淘汰
   size_t max_size_;  // 最大容量（与缓冲池的容量相同）
 };
 
+/*
+ClockReplacer实现了时钟替换策略。pin计数和访问位都是原子变量，pin/unpin可以在不持有缓冲池latch_的情况下调用；
+victim只由持有latch_的线程调用，时钟指针不需要原子
+*/
 class ClockReplacer : public Replacer {
  public:
   /**
-   * @description: 创建一个新的LRUReplacer
-   * @param {size_t} num_pages LRUReplacer最多需要存储的page数量
+   * @description: 创建一个新的ClockReplacer
+   * @param {size_t} num_pages ClockReplacer需要管理的frame数量
    */
-  explicit ClockReplacer() {}
+  explicit ClockReplacer(size_t num_pages)
+      : num_pages_(num_pages),
+        pin_counter_(std::make_unique<std::atomic<int>[]>(num_pages)),
+        ref_(std::make_unique<std::atomic<bool>[]>(num_pages)) {
+    for (size_t i = 0; i < num_pages_; ++i) {
+      pin_counter_[i].store(0, std::memory_order_relaxed);
+      ref_[i].store(false, std::memory_order_relaxed);
+    }
+  }
 
-  ~ClockReplacer() {}
+  ~ClockReplacer() override = default;
 
   bool victim(frame_id_t* frame_id) override {
-    int steps = 0;
-    do {
-      pointer_ = (pointer_ + 1) % BUFFER_POOL_INSTANCE_SIZE;
-      if (pin_counter_[pointer_] == 0 && pin_[pointer_] == 0) {
+    for (size_t steps = 0; steps < 2 * num_pages_; ++steps) {
+      pointer_ = (pointer_ + 1) % static_cast<int>(num_pages_);
+      if (pin_counter_[pointer_].load(std::memory_order_acquire) != 0) {
+        continue;
+      }
+      // 访问位为false时淘汰，否则清除访问位给它第二次机会
+      if (!ref_[pointer_].exchange(false, std::memory_order_relaxed)) {
         *frame_id = pointer_;
         return true;
       }
-      if (pin_counter_[pointer_] == 0) {
-        pin_[pointer_] = false;
-      }
-      ++steps;
-    } while (steps < 2 * BUFFER_POOL_INSTANCE_SIZE);
+    }
     return false;
   }
 
   void pin(frame_id_t frame_id) override {
-    ++pin_counter_[frame_id];
-    if (pin_counter_[frame_id] == 1) pin_[frame_id] = true;
+    if (pin_counter_[frame_id].fetch_add(1, std::memory_order_acq_rel) == 0) {
+      ref_[frame_id].store(true, std::memory_order_relaxed);
+    }
+  }
+
+  void unpin(frame_id_t frame_id) override {
+    pin_counter_[frame_id].fetch_sub(1, std::memory_order_acq_rel);
   }
 
-  void unpin(frame_id_t frame_id) override { --pin_counter_[frame_id]; }
+  void remove(frame_id_t frame_id) override {
+    pin_counter_[frame_id].store(0, std::memory_order_release);
+    ref_[frame_id].store(false, std::memory_order_relaxed);
+  }
 
   int get_pin_count(frame_id_t frame_id) { return pin_counter_[frame_id]; }
 
-  size_t Size() override { return BUFFER_POOL_INSTANCE_SIZE; }
+  // 时钟指针当前位置，下一次victim从它之后开始查找
+  int get_pointer() const override { return pointer_; }
+
+  size_t Size() override { return num_pages_; }
 
  private:
-  int pin_counter_[BUFFER_POOL_INSTANCE_SIZE];
-  bool pin_[BUFFER_POOL_INSTANCE_SIZE];
+  size_t num_pages_;
+  std::unique_ptr<std::atomic<int>[]> pin_counter_;
+  std::unique_ptr<std::atomic<bool>[]> ref_;  // 访问位
   int pointer_ = 0;
 };
@@ -0,0 +1,34 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+
+#include "replacer/replacer.h"
+
+#include "errors.h"
+#include "replacer/lru_k_replacer.h"
+#include "replacer/lru_replacer.h"
+
+/**
+ * @description: 按名字创建置换策略
+ * @param {string&} type "CLOCK"、"LRU"或"LRU-K"
+ * @param {size_t} num_pages 置换策略需要管理的帧数
+ */
+Replacer* create_replacer(const std::string& type, size_t num_pages) {
+  if (type == "CLOCK") {
+    return new ClockReplacer(num_pages);
+  }
+  if (type == "LRU") {
+    return new LRUReplacer(num_pages);
+  }
+  if (type == "LRU-K") {
+    return new LRUKReplacer(num_pages);
+  }
+  throw InternalError("Unknown replacer type: " + type);
+}
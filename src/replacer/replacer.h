@@ -10,6 +10,8 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <string>
+
 #include "common/config.h"
 
 /**
@@ -43,4 +45,32 @@ class Replacer {
 
   /** @return the number of elements in the replacer that can be victimized */
   virtual size_t Size() = 0;
+
+  /**
+   * Records that the page held by a frame was accessed by a user. Pins taken by
+   * background work (page writer, prefetch) are not accesses.
+   * @param frame_id the id of the accessed frame
+   */
+  virtual void record_access(frame_id_t /*frame_id*/) {}
+
+  /**
+   * Forgets a frame whose page has been removed from the buffer pool and whose
+   * frame went back to the free list. The frame is neither pinned nor
+   * evictable afterwards.
+   * @param frame_id the id of the removed frame
+   */
+  virtual void remove(frame_id_t /*frame_id*/) {}
+
+  /**
+   * @return the frame right before the next likely victim, the page writer
+   * starts scanning for dirty pages after it
+   */
+  virtual int get_pointer() const { return 0; }
 };
+
+/**
+ * Creates the replacer named by type ("CLOCK", "LRU" or "LRU-K").
+ * @param type the replacement policy
+ * @param num_pages the number of frames the replacer tracks
+ */
+Replacer* create_replacer(const std::string& type, size_t num_pages);
@@ -15,78 +15,229 @@ See the Mulan PSL v2 for more details. */
 #include <readline/readline.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <strings.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <future>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "analyze/analyze.h"
+#include "common/output_writer.h"
+#include "common/wire_protocol.h"
 #include "errors.h"
+#include "execution/load_sorter.h"
+#include "execution/morsel_scheduler.h"
 #include "optimizer/optimizer.h"
 #include "optimizer/plan.h"
+#include "optimizer/plan_cache.h"
 #include "optimizer/planner.h"
 #include "portal.h"
 #include "recovery/log_recovery.h"
+#include "recovery/log_shipping.h"
 
 #define SOCK_PORT 8765
-#define MAX_CONN_LIMIT 8
 
 // 是否开启 std::cout
 // #define ENABLE_COUT
 
 static bool should_exit = false;
 
-// 构建全局所需的管理器对象
-auto disk_manager = std::make_unique<DiskManager>();
-auto log_manager = std::make_unique<LogManager>(disk_manager.get());
-auto buffer_pool_manager = std::make_unique<BufferPoolManager>(
-    BUFFER_POOL_SIZE, disk_manager.get(), log_manager.get());
-auto rm_manager =
-    std::make_unique<RmManager>(disk_manager.get(), buffer_pool_manager.get());
-auto ix_manager =
-    std::make_unique<IxManager>(disk_manager.get(), buffer_pool_manager.get());
-auto sm_manager =
-    std::make_unique<SmManager>(disk_manager.get(), buffer_pool_manager.get(),
-                                rm_manager.get(), ix_manager.get());
-auto lock_manager = std::make_unique<LockManager>();
-auto txn_manager =
-    std::make_unique<TransactionManager>(lock_manager.get(), sm_manager.get());
-auto planner = std::make_unique<Planner>(sm_manager.get());
-auto optimizer = std::make_unique<Optimizer>(sm_manager.get(), planner.get());
-auto ql_manager = std::make_unique<QlManager>(sm_manager.get(),
-                                              txn_manager.get(), planner.get());
-auto recovery = std::make_unique<RecoveryManager>(
-    disk_manager.get(), buffer_pool_manager.get(), sm_manager.get(),
-    log_manager.get(), txn_manager.get());
-auto portal = std::make_unique<Portal>(sm_manager.get());
-auto analyze = std::make_unique<Analyze>(sm_manager.get());
-// pthread_mutex_t *buffer_mutex;
-pthread_mutex_t* sockfd_mutex;
+// 置换策略默认为REPLACER_TYPE，可以在启动时用环境变量RMDB_REPLACER指定
+static std::string get_replacer_type() {
+  const char* type = std::getenv("RMDB_REPLACER");
+  return type != nullptr ? type : REPLACER_TYPE;
+}
+
+// 默认两阶段封锁，环境变量RMDB_CONCURRENCY为occ时使用乐观并发控制
+static ConcurrencyMode get_concurrency_mode() {
+  const char* mode = std::getenv("RMDB_CONCURRENCY");
+  return mode != nullptr && std::string(mode) == "occ"
+             ? ConcurrencyMode::OPTIMISTIC
+             : ConcurrencyMode::TWO_PHASE_LOCKING;
+}
 
+// 全局所需的管理器对象，缓冲池的大小由启动参数决定，在main中按依赖顺序构建
+std::unique_ptr<DiskManager> disk_manager;
+std::unique_ptr<LogManager> log_manager;
+std::unique_ptr<BufferPoolManager> buffer_pool_manager;
+std::unique_ptr<RmManager> rm_manager;
+std::unique_ptr<IxManager> ix_manager;
+std::unique_ptr<SmManager> sm_manager;
+std::unique_ptr<LockManager> lock_manager;
+std::unique_ptr<TransactionManager> txn_manager;
+std::unique_ptr<Planner> planner;
+std::unique_ptr<Optimizer> optimizer;
+std::unique_ptr<QlManager> ql_manager;
+std::unique_ptr<RecoveryManager> recovery;
+std::unique_ptr<Portal> portal;
+std::unique_ptr<Analyze> analyze;
+std::unique_ptr<PlanCache> plan_cache;  // 所有连接共享的计划缓存
+
+/**
+ * @description: 构建全局所需的管理器对象
+ * @param {size_t} pool_size 缓冲池的帧数
+ * @param {size_t} num_instances 缓冲池实例个数
+ * @param {size_t} max_pool_size 缓冲池在线扩容的上限，为0时使用默认值
+ * @param {DeadlockPolicy} deadlock_policy 锁管理器处理死锁的方式
+ */
+static void init_managers(size_t pool_size, size_t num_instances,
+                          size_t max_pool_size,
+                          DeadlockPolicy deadlock_policy) {
+  disk_manager = std::make_unique<DiskManager>();
+  log_manager = std::make_unique<LogManager>(disk_manager.get());
+  buffer_pool_manager = std::make_unique<BufferPoolManager>(
+      pool_size, disk_manager.get(), log_manager.get(), get_replacer_type(),
+      num_instances, max_pool_size);
+  rm_manager = std::make_unique<RmManager>(disk_manager.get(),
+                                           buffer_pool_manager.get());
+  ix_manager = std::make_unique<IxManager>(disk_manager.get(),
+                                           buffer_pool_manager.get());
+  sm_manager =
+      std::make_unique<SmManager>(disk_manager.get(), buffer_pool_manager.get(),
+                                  rm_manager.get(), ix_manager.get());
+  lock_manager = std::make_unique<LockManager>(deadlock_policy);
+  sm_manager->set_lock_manager(lock_manager.get());
+  txn_manager = std::make_unique<TransactionManager>(
+      lock_manager.get(), sm_manager.get(), get_concurrency_mode());
+  lock_manager->set_increment_flusher(
+      [](Transaction* txn, int fd, const Rid* rid) {
+        txn_manager->apply_increments(txn, log_manager.get(), fd, rid);
+      });
+  planner = std::make_unique<Planner>(sm_manager.get());
+  optimizer = std::make_unique<Optimizer>(sm_manager.get(), planner.get());
+  ql_manager = std::make_unique<QlManager>(sm_manager.get(), txn_manager.get(),
+                                           planner.get());
+  recovery = std::make_unique<RecoveryManager>(
+      disk_manager.get(), buffer_pool_manager.get(), sm_manager.get(),
+      log_manager.get(), txn_manager.get());
+  portal = std::make_unique<Portal>(sm_manager.get());
+  plan_cache = std::make_unique<PlanCache>(PLAN_CACHE_SIZE);
+  analyze = std::make_unique<Analyze>(sm_manager.get());
+}
 // 定义线程池大小
 // constexpr int MAX_THREAD_POOL_SIZE = 2;
 std::list<std::thread> load_thread_pool;
 std::deque<std::future<void> > futures;
 std::mutex pool_mutex;
 
-// file_name -> command
-std::unordered_map<std::string, std::string> sort_map = {
-    {"warehouse", "none"},
-    {"item", "none"},
-    {"stock", "sort -n -t, -k2,2 -k1,1 "},
-    {"district", "sort -n -t, -k2,2 -k1,1 "},
-    {"customer", "sort -n -t, -k3,3 -k2,2 -k1,1 "},
-    {"history", "none"},
-    {"orders", "sort -n -t, -k3,3 -k2,2 -k1,1 "},
-    {"new_orders", "sort -n -t, -k3,3 -k2,2 -k1,1 "},
-    {"order_line", "sort -n -t, -k3,3 -k2,2 -k1,1 -k4,4 "}};
-
 void load_data(std::string filename, std::string tabname);
 
 int fast_count_star(std::string& tabname, Context* context);
 
+bool fast_min_max(std::string& tabname, const TabCol& col, bool is_max,
+                  Context* context, std::string* value);
+
+// 慢查询日志的阈值（微秒），启动时用 -s <毫秒> 开启，0表示不记录
+int64_t slow_query_us = 0;
+
+// 后台清理线程，启动时用 -a <秒> 开启
+std::thread vacuum_thread;
+std::mutex vacuum_mutex;
+std::condition_variable vacuum_cv;
+bool vacuum_stop = false;
+
+/**
+ * @description: 启动后台清理线程，每隔interval秒检查一遍所有表，能腾空至少VACUUM_MIN_PAGES个页面的表在单独的事务中整理。
+ * 表锁和客户端事务冲突时放弃这一轮，等下次再试
+ * @param {int} interval 检查的间隔秒数
+ */
+static void start_vacuum_worker(int interval) {
+  vacuum_thread = std::thread([interval] {
+    std::unique_lock lock(vacuum_mutex);
+    while (!vacuum_cv.wait_for(lock, std::chrono::seconds(interval),
+                               [] { return vacuum_stop; })) {
+      lock.unlock();
+      std::vector<std::string> tab_names;
+      for (auto& [tab_name, _] : sm_manager->fhs_) {
+        tab_names.push_back(tab_name);
+      }
+      for (auto& tab_name : tab_names) {
+        Context context(lock_manager.get(), log_manager.get(),
+                        txn_manager->begin(nullptr, log_manager.get()));
+        try {
+          sm_manager->vacuum_table(tab_name, &context, VACUUM_MIN_PAGES);
+          txn_manager->commit(context.txn_, log_manager.get());
+        } catch (TransactionAbortException&) {
+          txn_manager->abort(context.txn_, log_manager.get());
+        } catch (RMDBError&) {
+          // 表在检查期间被删除等情况，跳过这张表
+          txn_manager->abort(context.txn_, log_manager.get());
+        }
+        txn_manager->recycle(context.txn_);
+      }
+      lock.lock();
+    }
+  });
+}
+
+static void stop_vacuum_worker() {
+  {
+    std::lock_guard lock(vacuum_mutex);
+    vacuum_stop = true;
+  }
+  vacuum_cv.notify_all();
+  if (vacuum_thread.joinable()) {
+    vacuum_thread.join();
+  }
+}
+
+// 后台自动ANALYZE线程，AUTO_ANALYZE_INTERVAL_SEC为0时不开启
+std::thread analyze_thread;
+std::mutex analyze_mutex;
+std::condition_variable analyze_cv;
+bool analyze_stop = false;
+
+/**
+ * @description: 启动后台自动ANALYZE线程，每隔AUTO_ANALYZE_INTERVAL_SEC秒找出上次ANALYZE之后修改了足够多记录的表，
+ * 逐个在单独的事务中重新收集统计信息，大表按块抽样。表锁和客户端事务冲突时放弃，修改计数不清零，下次再试
+ */
+static void start_analyze_worker() {
+  analyze_thread = std::thread([] {
+    std::unique_lock lock(analyze_mutex);
+    while (!analyze_cv.wait_for(lock, std::chrono::seconds(AUTO_ANALYZE_INTERVAL_SEC),
+                                [] { return analyze_stop; })) {
+      lock.unlock();
+      for (auto& tab_name : sm_manager->stale_stats_tables()) {
+        Context context(lock_manager.get(), log_manager.get(),
+                        txn_manager->begin(nullptr, log_manager.get()));
+        try {
+          sm_manager->analyze_table(tab_name, &context);
+          txn_manager->commit(context.txn_, log_manager.get());
+        } catch (TransactionAbortException&) {
+          txn_manager->abort(context.txn_, log_manager.get());
+        } catch (RMDBError&) {
+          // 表在检查期间被删除等情况，跳过这张表
+          txn_manager->abort(context.txn_, log_manager.get());
+        }
+        txn_manager->recycle(context.txn_);
+      }
+      lock.lock();
+    }
+  });
+}
+
+static void stop_analyze_worker() {
+  {
+    std::lock_guard lock(analyze_mutex);
+    analyze_stop = true;
+  }
+  analyze_cv.notify_all();
+  if (analyze_thread.joinable()) {
+    analyze_thread.join();
+  }
+}
+
 static jmp_buf jmpbuf;
 
 void sigint_handler(int signo) {
@@ -107,250 +258,887 @@ void SetTransaction(txn_id_t* txn_id, Context* context) {
     context->txn_ = txn_manager->begin(nullptr, context->log_mgr_);
     *txn_id = context->txn_->get_transaction_id();
     context->txn_->set_txn_mode(false);
+    if (context->synchronous_commit_ != nullptr) {
+      context->txn_->set_synchronous_commit(*context->synchronous_commit_);
+    }
   }
 }
 
-void* client_handler(void* sock_fd) {
-  int fd = *((int*)sock_fd);
-  free(sock_fd);
-  pthread_mutex_unlock(sockfd_mutex);
-
-  int i_recvBytes;
-  // 接收客户端发送的请求
-  char data_recv[BUFFER_LENGTH];
-  // 需要返回给客户端的结果
-  char* data_send = new char[BUFFER_LENGTH];
-  // 需要返回给客户端的结果的长度
-  int offset = 0;
-  // 记录客户端当前正在执行的事务ID
-  txn_id_t txn_id = INVALID_TXN_ID;
-  // 每个 client 分配一个词法分析器解析 SQL 语句
-  yyscan_t scanner;
-  yylex_init(&scanner);
-
-#ifdef ENABLE_COUT
-  std::string output =
-      "establish client connection, sockfd: " + std::to_string(fd) + "\n";
-  std::cout << output;
-#endif
-
-  while (true) {
-#ifdef ENABLE_COUT
-    // std::cout << "Waiting for request..." << std::endl;
-#endif
-    memset(data_recv, 0, BUFFER_LENGTH);
-
-    i_recvBytes = recv(fd, data_recv, BUFFER_LENGTH, 0);
+/* 一个客户端连接。连接上同一时刻最多有一条语句在执行，相邻的两条语句可以在不同的工作线程上执行 */
+struct Session {
+  inline static std::atomic<uint64_t> next_id{1};
+  uint64_t id = next_id.fetch_add(1);  // 会话编号，临时表属于创建它的会话
+  StatementCancel cancel{id};  // KILL和statement_timeout通过它取消正在执行的语句
+  int fd;
+  int epoll_fd;                      // 负责这个连接的I/O线程的epoll
+  txn_id_t txn_id = INVALID_TXN_ID;  // 记录客户端当前正在执行的事务ID
+  yyscan_t scanner;                  // 每个连接分配一个词法分析器解析 SQL 语句
+  std::string scan_buf;  // 词法分析器扫描的缓冲区，在连接的所有语句间重复使用
+  // 连接私有的计划缓存和PREPARE的语句
+  PlanCache session_cache{PLAN_CACHE_SESSION_SIZE, plan_cache.get()};
+  PreparedStatements prepared_stmts;
+  char* data_send = new char[BUFFER_LENGTH];  // 需要返回给客户端的结果
+  // 第一次收到数据时确定协议：以WIRE_MAGIC开头时使用分帧协议，否则是以'\0'结尾的文本协议
+  bool framed = false;
+  bool detected = false;
+  bool synchronous_commit = true;  // set synchronous_commit = false 后会话的事务异步提交
+  // set workload_class = analytics 后会话的请求按分析类调度
+  WorkloadClass workload_class = WORKLOAD_OLTP;
+  // 会话正处在显式事务中，由执行语句的工作线程在重新监听连接之前更新，I/O线程据此决定请求的类别
+  bool in_txn = false;
+  std::string in_buf;  // 分帧协议中还没有收完的帧，只由I/O线程访问
+  MemoryCharge charge{MemTag::CONNECTION, sizeof(Session) + BUFFER_LENGTH};
+
+  Session(int fd_, int epoll_fd_) : fd(fd_), epoll_fd(epoll_fd_) {
+    yylex_init(&scanner);
+  }
 
-    if (i_recvBytes == 0) {
-#ifdef ENABLE_COUT
-      std::cout << "Maybe the client has closed" << std::endl;
-#endif
-      break;
+  // 连接断开时回滚会话中还没有结束的事务，事务对象放回事务池
+  void abort_txn() {
+    Transaction* txn = txn_manager->get_transaction(txn_id);
+    if (txn != nullptr) {
+      txn_manager->abort(txn, log_manager.get());
+      txn_manager->recycle(txn);
     }
+    txn_id = INVALID_TXN_ID;
+  }
 
-    if (i_recvBytes == -1) {
-#ifdef ENABLE_COUT
-      std::cout << "Client read error!" << std::endl;
-#endif
-      break;
+  ~Session() {
+    try {
+      abort_txn();
+    } catch (std::exception& e) {
+      std::cerr << "failed to abort transaction: " << e.what() << std::endl;
+    }
+    // 会话的临时表随会话一起删除
+    try {
+      sm_manager->drop_temp_tables(id);
+    } catch (std::exception& e) {
+      std::cerr << "failed to drop temporary tables: " << e.what() << std::endl;
     }
+    yylex_destroy(scanner);
+    delete[] data_send;
+    close(fd);
+  }
+};
+
+/* I/O线程收到、等待工作线程执行的语句。分帧协议中一次收到的多条语句由同一个工作线程依次执行 */
+struct Request {
+  Session* session;
+  std::vector<std::pair<uint32_t, std::string>> statements;  // 语句编号和语句
+  bool analytics = false;  // 按分析类调度
+};
+
+// 工作线程池：I/O线程把收到的语句放进队列，工作线程取出执行并回复客户端。
+// 队列满时I/O线程停止接收，语句留在内核的socket缓冲区中。
+// 分析类会话的请求放在单独的队列中：工作线程总是先取OLTP的请求，同时执行的分析类请求不超过analytics_limit个，
+// 报表查询再多也只占一部分工作线程，短的OLTP语句不用排在它们后面。显式事务中的请求按OLTP调度，
+// 否则事务的COMMIT可能排在分析类队列中，而正在执行的分析类语句又在等这个事务的锁
+std::mutex request_mutex;
+std::condition_variable request_cv;    // 队列中有可以执行的语句
+std::condition_variable admission_cv;  // 队列有空位
+std::deque<Request> requests;
+std::deque<Request> analytics_requests;
+size_t analytics_running = 0;  // 正在执行的分析类请求数
+size_t analytics_limit = 1;
+size_t num_workers = 0;
+uint64_t num_dispatched = 0;  // 被工作线程取走的语句数
+
+// 调用者持有request_mutex
+static bool has_runnable_request() {
+  return !requests.empty() ||
+         (!analytics_requests.empty() && analytics_running < analytics_limit);
+}
 
-#ifdef ENABLE_COUT
-    // printf("i_recvBytes: %d \n ", i_recvBytes);
-#endif
+// 发送语句结果的最后一部分：文本协议带上结尾的'\0'（data[len]），客户端据此判断回复结束；分帧协议是一个RESULT_END
+static bool send_reply(Session* session, uint32_t stmt_id, const char* data,
+                       size_t len) {
+  Metrics::instance().add(MetricCounter::BYTES_SENT, len);
+  if (session->framed) {
+    return send_wire_frame(session->fd, WireType::RESULT_END, stmt_id, data,
+                           len);
+  }
+  return send(session->fd, data, len + 1, 0) != -1;
+}
 
-    if (strcmp(data_recv, "exit") == 0) {
-      std::cout << "Client exit." << std::endl;
-      break;
+// 按分号把一次请求拆成多条语句，引号中的分号不算；只有一条语句（或者没有分号）时就是请求本身
+static std::vector<std::string> split_batch(const char* data_recv) {
+  std::vector<std::string> stmts;
+  std::string cur;
+  bool in_quote = false;
+  for (const char* p = data_recv; *p != '\0'; ++p) {
+    if (cur.empty() && isspace(static_cast<unsigned char>(*p))) {
+      continue;
     }
-
-    if (strcmp(data_recv, "crash") == 0) {
-      std::cout << "Server crash" << std::endl;
-      delete[] data_send;
-      for (auto& [_, txn] : txn_manager->txn_map) {
-        std::ignore = _;
-        delete txn;
-      }
-      exit(1);
+    cur.push_back(*p);
+    if (*p == '\'') {
+      in_quote = !in_quote;
+    } else if (*p == ';' && !in_quote) {
+      stmts.push_back(std::move(cur));
+      cur.clear();
     }
+  }
+  if (!cur.empty() || stmts.empty()) {
+    stmts.push_back(std::move(cur));
+  }
+  if (stmts.size() == 1) {
+    stmts[0] = data_recv;
+  }
+  return stmts;
+}
 
-    // 处理数据
-    if (strncmp(data_recv, "load", 4) == 0 ||
-        strncmp(data_recv, "LOAD", 4) == 0) {
-      std::string str(data_recv);
-      std::stringstream ss(str);
-      std::string load_keyword, path, into_keyword, table_name;
-      ss >> load_keyword >> path >> into_keyword >> table_name;
+// 语句是否是BEGIN/COMMIT/ABORT/ROLLBACK
+static bool is_txn_control(const std::string& sql) {
+  for (const char* word : {"begin", "commit", "abort", "rollback"}) {
+    size_t len = strlen(word);
+    if (strncasecmp(sql.c_str(), word, len) == 0 &&
+        (sql.size() == len || !isalnum(static_cast<unsigned char>(sql[len])))) {
+      return true;
+    }
+  }
+  return false;
+}
 
-      table_name.pop_back();
+// 按语句的第一个单词分类，用于按语句类型统计延迟
+static StmtKind stmt_kind(const std::string& sql) {
+  static const std::pair<const char*, StmtKind> words[] = {
+      {"select", StmtKind::SELECT},   {"insert", StmtKind::INSERT},
+      {"update", StmtKind::UPDATE},   {"delete", StmtKind::DELETE},
+      {"create", StmtKind::DDL},      {"drop", StmtKind::DDL},
+      {"alter", StmtKind::DDL},       {"truncate", StmtKind::DDL},
+      {"begin", StmtKind::TXN},       {"commit", StmtKind::TXN},
+      {"abort", StmtKind::TXN},       {"rollback", StmtKind::TXN}};
+  size_t begin = 0;
+  while (begin < sql.size() && isspace(static_cast<unsigned char>(sql[begin]))) {
+    ++begin;
+  }
+  for (auto& [word, kind] : words) {
+    size_t len = strlen(word);
+    if (strncasecmp(sql.c_str() + begin, word, len) == 0 &&
+        (sql.size() == begin + len ||
+         !isalnum(static_cast<unsigned char>(sql[begin + len])))) {
+      return kind;
+    }
+  }
+  return StmtKind::OTHER;
+}
 
-      // if (futures.size() >= 2) {
-      //     futures.front().get();
-      //     futures.pop_front();
-      // }
+/**
+ * @description: 把一条超过阈值的语句写进慢查询日志：语句、耗时、本线程上等待锁的时间和读取的页面，
+ * 以及和EXPLAIN ANALYZE一样的每个算子的记录数和耗时。日志由后台线程写入，不阻塞语句
+ * @param {ExecStats&} stats 语句执行期间本线程上的统计，并行扫描的工作线程上的不计入
+ * @param {ExplainNode*} profile 根算子的统计，不生成算子树的语句为空
+ */
+static void log_slow_query(const Session* session, const std::string& sql,
+                           uint64_t us, bool ok, const ExecStats& stats,
+                           size_t mem_peak, const ExplainNode* profile) {
+  char time_buf[32];
+  time_t now = time(nullptr);
+  struct tm tm_now{};
+  localtime_r(&now, &tm_now);
+  strftime(time_buf, sizeof(time_buf), "%Y-%m-%dT%H:%M:%S", &tm_now);
+  char header[512];
+  snprintf(header, sizeof(header),
+           "# Time: %s Session: %lu Txn: %ld Status: %s\n"
+           "# Query_time: %.3fms Lock_wait: %.3fms Lock_waits: %lu "
+           "Pages: %lu Hits: %lu Misses: %lu Mem_peak: %luKB\n",
+           time_buf, static_cast<unsigned long>(session->id),
+           static_cast<long>(session->txn_id), ok ? "ok" : "failed", us / 1e3,
+           stats.lock_wait_us / 1e3,
+           static_cast<unsigned long>(stats.lock_waits),
+           static_cast<unsigned long>(stats.page_fetches),
+           static_cast<unsigned long>(stats.buffer_hits),
+           static_cast<unsigned long>(stats.buffer_misses),
+           static_cast<unsigned long>(mem_peak / 1024));
+  std::string entry = header;
+  entry += sql;
+  if (entry.back() != ';') {
+    entry += ';';
+  }
+  entry += '\n';
+  if (profile != nullptr) {
+    std::vector<std::string> lines;
+    profile->format(lines);
+    for (auto& line : lines) {
+      entry += "#   " + line + "\n";
+    }
+  }
+  OutputWriter::slow_query_log().append(std::move(entry));
+}
 
-      // 将任务加入线程池
-      futures.emplace_back(std::async(std::launch::async, load_data,
-                                      std::move(path), std::move(table_name)));
+// 语句出错时把结果换成错误信息：这条语句已经写进缓冲区的结果丢掉，之前的语句的结果保留
+static void reply_error(Context* context, int stmt_begin, const char* msg,
+                        size_t len) {
+  int& offset = *context->offset_;
+  offset = context->flushed_ ? 0 : stmt_begin;
+  if (offset + len + 1 > BUFFER_LENGTH) {
+    context->flush_send();
+  }
+  memcpy(context->data_send_ + offset, msg, len);
+  offset += len;
+  context->data_send_[offset] = '\0';
+}
 
-      std::string s = "l\n";
-      if (write(fd, s.c_str(), s.length()) == -1) {
-        throw UnixError();
-      }
-      continue;
-    }
+// 结果缓存中的结果接在缓冲区中已有的结果后面，放不下时先发送已有的部分
+static void reply_cached_result(Context* context, const std::string& result) {
+  int& offset = *context->offset_;
+  if (offset + result.size() + 1 > BUFFER_LENGTH) {
+    context->flush_send();
+  }
+  memcpy(context->data_send_ + offset, result.data(), result.size());
+  offset += result.size();
+  context->data_send_[offset] = '\0';
+}
 
-    pool_mutex.lock();
-    for (auto& future : futures) {
-      future.get();
+// 语句和子查询用到的表和它们现在的修改计数
+static void collect_result_tables(const Query& query, ResultCache::Tag* tag) {
+  for (auto& tab_name : query.tables) {
+    auto& tab = sm_manager->db_.get_table(tab_name);
+    // 分区表的记录在各个分区中，分区的修改才让结果过期
+    std::vector<int> tab_ids = {tab.id};
+    for (auto& partition_name : tab.partition_names()) {
+      tab_ids.push_back(sm_manager->db_.get_table(partition_name).id);
     }
-    if (!futures.empty()) {
-      for (auto& [_, fh] : sm_manager->fhs_) {
-        std::ignore = _;
-        buffer_pool_manager->flush_all_pages(fh->GetFd());
-      }
-      for (auto& [_, ih] : sm_manager->ihs_) {
-        std::ignore = _;
-        buffer_pool_manager->flush_all_pages(ih->fd_);
+    for (int tab_id : tab_ids) {
+      if (std::none_of(tag->tables.begin(), tag->tables.end(),
+                       [tab_id](const auto& t) { return t.first == tab_id; })) {
+        tag->tables.emplace_back(tab_id,
+                                 sm_manager->get_fh(tab_id)->change_count());
       }
     }
-    futures.clear();
-    pool_mutex.unlock();
-#ifdef ENABLE_COUT
-    std::cout << "Read from client " << fd << ": " << data_recv << std::endl;
-#endif
-    memset(data_send, '\0', BUFFER_LENGTH);
-    offset = 0;
+  }
+  for (auto& sub : query.sub_conds) {
+    collect_result_tables(*sub.query, tag);
+  }
+}
 
-    // 开启事务，初始化系统所需的上下文信息（包括事务对象指针、锁管理器指针、日志管理器指针、存放结果的buffer、记录结果长度的变量）
-    Context* context = new Context(lock_manager.get(), log_manager.get(),
-                                   nullptr, data_send, &offset);
-    SetTransaction(&txn_id, context);
-
-    // 用于判断是否已经调用了 yy_delete_buffer 来删除 buf
-    bool finish_analyze = false;
-    // pthread_mutex_lock(buffer_mutex);
-    YY_BUFFER_STATE buf = yy_scan_string(data_recv, scanner);
-    if (yyparse(scanner) == 0) {
-      if (ast::parse_tree != nullptr) {
-        try {
+/**
+ * @description: 执行一条语句，结果接在context的缓冲区中已有的结果后面
+ * @return {bool} 语句是否成功，出错或者事务回滚时返回false
+ */
+static bool execute_statement(Session* session, uint32_t stmt_id,
+                              std::string sql, Context* context) {
+  txn_id_t& txn_id = session->txn_id;
+  yyscan_t scanner = session->scanner;
+  auto& session_cache = session->session_cache;
+  auto& prepared_stmts = session->prepared_stmts;
+  int stmt_begin = *context->offset_;
+  auto stmt_start = std::chrono::steady_clock::now();
+  StmtKind kind = StmtKind::OTHER;
+  ExecStats stats_start = thread_exec_stats();
+  std::shared_ptr<ExplainNode> profile;  // 开启慢查询日志时各算子的统计
+  // 结果超过data_send时分块发送，最后一块以'\0'结尾
+  context->sock_fd_ = session->fd;
+  context->framed_ = session->framed;
+  context->stmt_id_ = stmt_id;
+  context->session_id_ = session->id;
+  context->synchronous_commit_ = &session->synchronous_commit;
+  context->workload_class_ = &session->workload_class;
+  context->cancel_ = &session->cancel;
+  SetTransaction(&txn_id, context);
+  // 语句执行期间（包括出错后的回滚）本线程的当前语句是它，KILL和超时在执行器的循环和锁等待中生效
+  StatementCancelScope cancel_scope(&session->cancel, txn_id, sql);
+
+  // 未删除的词法分析缓冲区，为nullptr时表示没有解析或者已经删除
+  YY_BUFFER_STATE buf = nullptr;
+  bool parse_failed = false;
+  bool ok = true;
+  // 执行成功后结果放进结果缓存，结果分块发送过时不放
+  bool result_cacheable = false;
+  std::string result_key;
+  ResultCache::Tag result_tag{};
+  try {
+    // PREPARE/DEALLOCATE到此为止，EXECUTE换成代入参数后的语句
+    if (!prepared_stmts.handle(sql)) {
+      kind = stmt_kind(sql);
+      // 先按语句的形状查计划缓存，命中时跳过解析、语义分析和优化。
+      // 版本在优化之前读取，优化期间发生DDL时放入的计划已经过期
+      std::string key;
+      std::vector<Value> params;
+      bool cacheable = normalize_sql(sql, &key, &params);
+      uint64_t version = sm_manager->catalog_version();
+      // 结果缓存只用于自动提交的SELECT；输出到文件时结果还要写进output.txt，不用结果缓存。
+      // 未命中时不查计划缓存，要从语法树得到语句用到的表，并且在快照开始之前读出它们的修改计数
+      auto& result_cache = ResultCache::instance();
+      result_cacheable = cacheable && kind == StmtKind::SELECT &&
+                         result_cache.enabled() &&
+                         !context->txn_->get_txn_mode() &&
+                         !planner->enable_output_file;
+      bool result_hit = false;
+      if (result_cacheable) {
+        result_key = ResultCache::make_key(key, params);
+        std::string result;
+        result_hit = result_cache.get(
+            result_key, version,
+            [](int tab_id) { return sm_manager->get_fh(tab_id)->change_count(); },
+            &result);
+        if (result_hit) {
+          reply_cached_result(context, result);
+          Metrics::instance().add(MetricCounter::RESULT_CACHE_HITS);
+          result_cacheable = false;
+        }
+      }
+      std::shared_ptr<Plan> plan = cacheable && !result_cacheable && !result_hit
+                                       ? session_cache.get(key, params, version)
+                                       : nullptr;
+      if (plan == nullptr && !result_hit) {
+        // pthread_mutex_lock(buffer_mutex);
+        // 语句放进连接的扫描缓冲区后原地扫描，末尾两个'\0'是flex要求的结束标记，
+        // 不像yy_scan_string那样为每条语句分配并复制一个缓冲区
+        auto& scan_buf = session->scan_buf;
+        scan_buf.assign(sql);
+        scan_buf.append(2, '\0');
+        buf = yy_scan_buffer(scan_buf.data(), scan_buf.size(), scanner);
+        auto phase_start = std::chrono::steady_clock::now();
+        int parse_res = yyparse(scanner);
+        Metrics::instance().record_phase(StmtPhase::PARSE,
+                                         elapsed_us(phase_start));
+        if (parse_res != 0) {
+          parse_failed = true;
+        } else if (ast::parse_tree != nullptr) {
           // analyze and rewrite
           // 查询计划生成
+          phase_start = std::chrono::steady_clock::now();
           std::shared_ptr<Query> query =
-              analyze->do_analyze(std::move(ast::parse_tree));
+              analyze->do_analyze(std::move(ast::parse_tree), session->id);
           yy_delete_buffer(buf, scanner);
-          finish_analyze = true;
+          buf = nullptr;
           // pthread_mutex_unlock(buffer_mutex);
-          // 全表 count 走 fast_count
-          if (query->agg_types.size() == 1 &&
-              query->agg_types[0] == AGG_COUNT && query->conds.empty()) {
-            // 后续支持笛卡尔积 count，这里先简化只有单个表
+          // 字面量的编号和规范化时找到的对不上时不缓存，用到临时表的计划只属于这个会话
+          cacheable = cacheable && !query->uses_temp_table &&
+                      ast::num_params == static_cast<int>(params.size());
+          result_cacheable = result_cacheable && cacheable;
+          if (result_cacheable) {
+            result_tag.version = version;
+            collect_result_tables(*query, &result_tag);
+          }
+          // 全表 count 走 fast_count，索引第一个字段上的全表 min/max 读索引两端的叶子，
+          // EXPLAIN要生成计划
+          bool whole_table =
+              query->agg_types.size() == 1 && query->tables.size() == 1 &&
+              query->group_bys.empty() && query->havings.empty() &&
+              query->conds.empty() && query->sub_conds.empty() &&
+              query->expr_conds.empty() && query->or_conds.empty() &&
+              std::dynamic_pointer_cast<ast::ExplainStmt>(query->parse) ==
+                  nullptr;
+          bool is_min_max = whole_table &&
+                            (query->agg_types[0] == AGG_MIN ||
+                             query->agg_types[0] == AGG_MAX);
+          std::string min_max;
+          if (whole_table && query->agg_types[0] == AGG_COUNT) {
             auto& col_name = query->alias.empty() ? query->cols[0].col_name
                                                   : query->alias[0];
             ql_manager->select_fast_count_star(
-                fast_count_star(query->tables[0], context), col_name, context);
+                fast_count_star(query->tables[0], context), col_name,
+                context);
+          } else if (is_min_max &&
+                     fast_min_max(query->tables[0], query->cols[0],
+                                  query->agg_types[0] == AGG_MAX, context,
+                                  &min_max)) {
+            auto& col_name = query->alias.empty() ? query->cols[0].col_name
+                                                  : query->alias[0];
+            ql_manager->select_single_value(col_name, std::move(min_max),
+                                            context);
           } else {
             // 优化器
-            std::shared_ptr<Plan> plan = optimizer->plan_query(query, context);
-            // portal
-            std::shared_ptr<PortalStmt> portalStmt =
-                portal->start(plan, context);
-            portal->run(portalStmt, ql_manager.get(), &txn_id, context);
-            portal->drop();
+            plan = optimizer->plan_query(query, context);
+            Metrics::instance().record_phase(StmtPhase::PLAN,
+                                             elapsed_us(phase_start));
+            if (cacheable) {
+              session_cache.put(key, plan, params, version);
+            }
           }
-        } catch (TransactionAbortException& e) {
-          // 事务需要回滚，需要把abort信息返回给客户端并写入output.txt文件中
-          std::string str = "abort\n";
-          memcpy(data_send, str.c_str(), str.length());
-          data_send[str.length()] = '\0';
-          offset = str.length();
-
-          // 回滚事务
-          txn_manager->abort(context->txn_, log_manager.get());
+        }
+      }
+      if (plan != nullptr) {
+        // 自动提交的单条SELECT（包括EXPLAIN ANALYZE中的）是只读事务：在快照上读，不加锁，不写日志
+        auto select = plan;
+        if (auto x = std::dynamic_pointer_cast<ExplainPlan>(plan);
+            x != nullptr && x->analyze_) {
+          select = x->subplan_;
+        }
+        auto dml = std::dynamic_pointer_cast<DMLPlan>(select);
+        if (context->txn_->is_read_only() &&
+            ((dml != nullptr && dml->tag != T_select) ||
+             std::dynamic_pointer_cast<DDLPlan>(select) != nullptr)) {
+          throw RMDBError("cannot modify data in a read-only transaction");
+        }
+        if (!context->txn_->get_txn_mode() && dml != nullptr &&
+            dml->tag == T_select) {
+          txn_manager->begin_read_only(context->txn_);
+        }
+        // portal
+        auto exec_start = std::chrono::steady_clock::now();
+        std::shared_ptr<PortalStmt> portalStmt =
+            portal->start(plan, context, slow_query_us > 0);
+        profile = portalStmt->explain;
+        portal->run(portalStmt, ql_manager.get(), &txn_id, context);
+        portal->drop();
+        Metrics::instance().record_phase(StmtPhase::EXECUTE,
+                                         elapsed_us(exec_start));
+      }
+    }
+  } catch (TransactionAbortException& e) {
+    // 事务需要回滚，需要把abort信息返回给客户端并写入output.txt文件中
+    std::string str = "abort\n";
+    reply_error(context, stmt_begin, str.c_str(), str.length());
+
+    // 回滚事务
+    txn_manager->abort(context->txn_, log_manager.get());
+    Metrics::instance().add_abort_reason(static_cast<int>(e.GetAbortReason()));
 #ifdef ENABLE_COUT
-          std::cout << e.GetInfo() << std::endl;
+    std::cout << e.GetInfo() << std::endl;
 #endif
 
-          if (planner->enable_output_file) {
-            std::fstream outfile;
-            outfile.open("output.txt", std::ios::out | std::ios::app);
-            outfile << str;
-            outfile.close();
-          }
-        } catch (RMDBError& e) {
-          // 遇到异常，需要打印failure到output.txt文件中，并发异常信息返回给客户端
+    if (planner->enable_output_file) {
+      OutputWriter::instance().append(str);
+    }
+    ok = false;
+  } catch (RMDBError& e) {
+    // 遇到异常，需要打印failure到output.txt文件中，并发异常信息返回给客户端
 #ifdef ENABLE_COUT
-          std::cerr << e.what() << std::endl;
+    std::cerr << e.what() << std::endl;
 #endif
 
-          memcpy(data_send, e.what(), e.get_msg_len());
-          data_send[e.get_msg_len()] = '\n';
-          data_send[e.get_msg_len() + 1] = '\0';
-          offset = e.get_msg_len() + 1;
-
-          // 将报错信息写入output.txt
-          if (planner->enable_output_file) {
-            std::fstream outfile;
-            outfile.open("output.txt", std::ios::out | std::ios::app);
-            outfile << "failure\n";
-            outfile.close();
-          }
-        }
+    std::string str = std::string(e.what(), e.get_msg_len()) + "\n";
+    reply_error(context, stmt_begin, str.c_str(), str.length());
+
+    // 将报错信息写入output.txt
+    if (planner->enable_output_file) {
+      OutputWriter::instance().append("failure\n");
+    }
+    ok = false;
+  }
+  if (parse_failed) {
+    // 遇到异常，需要打印failure到output.txt文件中，并发异常信息返回给客户端
+    // std::string str = "语法层解析错误";
+    // std::cerr << str << std::endl;
+
+    // memcpy(data_send, str.c_str(), str.size());
+    // data_send[str.size()] = '\n';
+    // data_send[str.size() + 1] = '\0';
+    // offset = str.size() + 1;
+
+    // 将报错信息写入output.txt
+    if (planner->enable_output_file) {
+      OutputWriter::instance().append("failure\n");
+    }
+    ok = false;
+  }
+  if (ok && result_cacheable && !context->flushed_) {
+    ResultCache::instance().put(
+        result_key, std::move(result_tag),
+        std::string(context->data_send_ + stmt_begin,
+                    *context->offset_ - stmt_begin));
+  }
+  if (buf != nullptr) {
+    yy_delete_buffer(buf, scanner);
+    // pthread_mutex_unlock(buffer_mutex);
+  }
+  // 算子树已经析构，这条语句从Arena分配的内存一起归还
+  context->arena_.reset();
+  uint64_t stmt_us = elapsed_us(stmt_start);
+  Metrics::instance().record_statement(kind, stmt_us);
+  if (!ok) {
+    Metrics::instance().add(MetricCounter::STATEMENT_ERRORS);
+  }
+  if (slow_query_us > 0 && stmt_us >= static_cast<uint64_t>(slow_query_us)) {
+    // 内存预算由一次请求中的所有语句共用，峰值是请求开始到这条语句结束的最大值
+    log_slow_query(session, sql, stmt_us, ok,
+                   thread_exec_stats() - stats_start, context->memory_.peak(),
+                   profile.get());
+  }
+  return ok;
+}
+
+// 提交事务，乐观并发控制下验证失败时回滚，从stmt_begin开始的结果换成abort
+static bool commit_txn(Transaction* txn, Context* context, int stmt_begin) {
+  try {
+    txn_manager->commit(txn, log_manager.get());
+    return true;
+  } catch (TransactionAbortException& e) {
+    std::string str = "abort\n";
+    reply_error(context, stmt_begin, str.c_str(), str.length());
+    txn_manager->abort(txn, log_manager.get());
+    Metrics::instance().add_abort_reason(static_cast<int>(e.GetAbortReason()));
+    if (planner->enable_output_file) {
+      OutputWriter::instance().append(str);
+    }
+    return false;
+  }
+}
+
+// 语句的结果发送之前调用：如果是单挑语句，需要按照一个完整的事务来执行，所以执行完当前语句后，自动提交事务。
+// 同步提交时commit等到commit日志落盘才返回，客户端收到结果时事务已经持久化
+static void finish_statement(Context* context, int stmt_begin) {
+  if (context == nullptr) {
+    return;
+  }
+  if (context->txn_->get_txn_mode() == false &&
+      context->txn_->get_state() != TransactionState::ABORTED) {
+    commit_txn(context->txn_, context, stmt_begin);
+  }
+  delete context;
+}
+
+/**
+ * @description: 执行客户端发来的一条请求，请求可以是以分号分隔的多条语句，所有语句的结果作为一个回复发回客户端
+ * @param {uint32_t} stmt_id 分帧协议中语句的编号，文本协议中为0
+ * @return {bool} 连接是否继续，客户端退出或者发送失败时返回false
+ */
+static bool handle_request(Session* session, uint32_t stmt_id,
+                           const char* data_recv) {
+  int fd = session->fd;
+  char* data_send = session->data_send;
+  txn_id_t& txn_id = session->txn_id;
+  // 需要返回给客户端的结果的长度
+  int offset = 0;
+
+  if (strcmp(data_recv, "exit") == 0) {
+    std::cout << "Client exit." << std::endl;
+    return false;
+  }
+
+  if (strcmp(data_recv, "crash") == 0) {
+    std::cout << "Server crash" << std::endl;
+    OutputWriter::instance().flush();
+    txn_manager->delete_all_transactions();
+    exit(1);
+  }
+
+  // 处理数据
+  if (strncmp(data_recv, "load", 4) == 0 ||
+      strncmp(data_recv, "LOAD", 4) == 0) {
+    std::string str(data_recv);
+    std::stringstream ss(str);
+    std::string load_keyword, path, into_keyword, table_name;
+    ss >> load_keyword >> path >> into_keyword >> table_name;
+
+    table_name.pop_back();
+
+    // if (futures.size() >= 2) {
+    //     futures.front().get();
+    //     futures.pop_front();
+    // }
+
+    // 将任务加入线程池
+    futures.emplace_back(std::async(std::launch::async, load_data,
+                                    std::move(path), std::move(table_name)));
+
+    std::string s = "l\n";
+    if (!send_reply(session, stmt_id, s.c_str(), s.length())) {
+      throw UnixError();
+    }
+    return true;
+  }
+
+  pool_mutex.lock();
+  for (auto& future : futures) {
+    future.get();
+  }
+  if (!futures.empty()) {
+    for (auto& [_, fh] : sm_manager->fhs_) {
+      std::ignore = _;
+      buffer_pool_manager->flush_all_pages(fh->GetFd());
+    }
+    for (auto& [_, ih] : sm_manager->ihs_) {
+      std::ignore = _;
+      buffer_pool_manager->flush_all_pages(ih->fd_);
+    }
+  }
+  futures.clear();
+  pool_mutex.unlock();
+#ifdef ENABLE_COUT
+  std::cout << "Read from client " << fd << ": " << data_recv << std::endl;
+#endif
+  memset(data_send, '\0', BUFFER_LENGTH);
+  offset = 0;
+
+  std::vector<std::string> stmts = split_batch(data_recv);
+  // 整批语句包在一个事务中：已经在显式事务中或者批中有自己控制事务的语句时不包
+  Transaction* running = txn_manager->get_transaction(txn_id);
+  bool in_txn = running != nullptr && running->get_txn_mode() &&
+                running->get_state() != TransactionState::COMMITTED &&
+                running->get_state() != TransactionState::ABORTED;
+  bool implicit_txn = SERVER_BATCH_IMPLICIT_TXN && stmts.size() > 1 &&
+                      !in_txn &&
+                      std::none_of(stmts.begin(), stmts.end(), is_txn_control);
+  if (implicit_txn) {
+    Transaction* txn = txn_manager->begin(nullptr, log_manager.get());
+    txn->set_txn_mode(true);
+    txn->set_synchronous_commit(session->synchronous_commit);
+    txn_id = txn->get_transaction_id();
+  }
+
+  // 批中的语句在这个工作线程上依次执行，结果接在一起作为一个回复发送
+  Context* context = nullptr;
+  bool failed = false;
+  int stmt_begin = 0;  // 当前语句的结果在缓冲区中的起始位置
+  for (size_t i = 0; i < stmts.size() && !(implicit_txn && failed); ++i) {
+    finish_statement(context, stmt_begin);
+    stmt_begin = offset;
+    // 开启事务，初始化系统所需的上下文信息（包括事务对象指针、锁管理器指针、日志管理器指针、存放结果的buffer、记录结果长度的变量）
+    context = new Context(lock_manager.get(), log_manager.get(), nullptr,
+                          data_send, &offset);
+    failed = !execute_statement(session, stmt_id, stmts[i], context);
+  }
+  // 整批的事务中有语句出错时回滚整批，事务已经因为死锁等原因回滚时不再回滚
+  Transaction* batch_txn =
+      implicit_txn ? txn_manager->get_transaction(txn_id) : nullptr;
+  if (batch_txn != nullptr && failed &&
+      batch_txn->get_state() != TransactionState::ABORTED) {
+    txn_manager->abort(batch_txn, log_manager.get());
+  }
+  // 整批的事务在回复之前提交，提交失败时整批的结果换成abort
+  if (batch_txn != nullptr && !failed) {
+    commit_txn(batch_txn, context, 0);
+  }
+  finish_statement(context, stmt_begin);
+
+  // future TODO: 格式化 sql_handler.result, 传给客户端
+  // send result with fixed format, use protobuf in the future
+  // 分块发送过之后缓冲区中可能残留上一块的内容
+  data_send[offset] = '\0';
+  if (!send_reply(session, stmt_id, data_send, offset)) {
+    perror("Send failed");
+    // 连接已经不可用，回滚会话中还没有结束的事务
+    session->abort_txn();
+    return false;
+  }
+  return true;
+}
+
+// 继续监听连接上的下一条请求，EPOLLONESHOT保证同一个连接不会同时有两条语句在执行
+static void rearm_session(Session* session) {
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.ptr = session;
+  if (epoll_ctl(session->epoll_fd, EPOLL_CTL_MOD, session->fd, &event) == -1) {
+    delete session;
+  }
+}
+
+static void worker_loop() {
+  while (true) {
+    Request request;
+    {
+      std::unique_lock lock(request_mutex);
+      request_cv.wait(lock, has_runnable_request);
+      auto& queue = requests.empty() ? analytics_requests : requests;
+      request = std::move(queue.front());
+      queue.pop_front();
+      if (request.analytics) {
+        ++analytics_running;
       }
-    } else {
-      // 遇到异常，需要打印failure到output.txt文件中，并发异常信息返回给客户端
-      // std::string str = "语法层解析错误";
-      // std::cerr << str << std::endl;
-
-      // memcpy(data_send, str.c_str(), str.size());
-      // data_send[str.size()] = '\n';
-      // data_send[str.size() + 1] = '\0';
-      // offset = str.size() + 1;
-
-      // 将报错信息写入output.txt
-      if (planner->enable_output_file) {
-        std::fstream outfile;
-        outfile.open("output.txt", std::ios::out | std::ios::app);
-        outfile << "failure\n";
-        outfile.close();
+      ++num_dispatched;
+    }
+    admission_cv.notify_one();
+    if (request.analytics) {
+      DiskManager::set_thread_io_priority(ANALYTICS_IO_PRIORITY);
+    }
+    bool keep = true;
+    for (auto& [stmt_id, sql] : request.statements) {
+      if (!handle_request(request.session, stmt_id, sql.c_str())) {
+        keep = false;
+        break;
       }
     }
-    if (finish_analyze == false) {
-      yy_delete_buffer(buf, scanner);
-      // pthread_mutex_unlock(buffer_mutex);
+    if (request.analytics) {
+      DiskManager::set_thread_io_priority(-1);
+      {
+        std::lock_guard lock(request_mutex);
+        --analytics_running;
+      }
+      request_cv.notify_one();
     }
-    // future TODO: 格式化 sql_handler.result, 传给客户端
-    // send result with fixed format, use protobuf in the future
-    if (send(fd, data_send, offset + 1, 0) == -1) {
-      perror("Send failed");
-      break;
+    if (keep) {
+      Transaction* txn = txn_manager->get_transaction(request.session->txn_id);
+      request.session->in_txn =
+          txn != nullptr && txn->get_txn_mode() &&
+          txn->get_state() != TransactionState::COMMITTED &&
+          txn->get_state() != TransactionState::ABORTED;
+      rearm_session(request.session);
+    } else {
+#ifdef ENABLE_COUT
+      std::cout << "Terminating current client_connection..." << std::endl;
+#endif
+      delete request.session;
     }
-    // 如果是单挑语句，需要按照一个完整的事务来执行，所以执行完当前语句后，自动提交事务
-    if (context->txn_->get_txn_mode() == false) {
-      txn_manager->commit(context->txn_, context->log_mgr_);
+  }
+}
+
+// 调用者持有request_mutex
+static void add_worker() {
+  ++num_workers;
+  std::thread(worker_loop).detach();
+}
+
+/**
+ * @description: 工作线程都在等锁等时，持有锁的事务的下一条语句（例如COMMIT）可能排在队列中没有线程执行。
+ * 每隔SERVER_STALL_MS检查一次，期间有可以执行的语句却没有语句被取走时增加一个工作线程，最多SERVER_MAX_WORKERS个。
+ * 只是因为分析类请求到了上限而排队时不算，增加工作线程也不会执行它们
+ */
+static void stall_monitor() {
+  uint64_t last_dispatched = 0;
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(SERVER_STALL_MS));
+    std::lock_guard lock(request_mutex);
+    if (has_runnable_request() && num_dispatched == last_dispatched &&
+        num_workers < SERVER_MAX_WORKERS) {
+      add_worker();
     }
-    delete context;
+    last_dispatched = num_dispatched;
   }
+}
 
-  // release memory
-  delete[] data_send;
+/**
+ * @description: 从连接收到的数据中取出所有完整的帧，语句放进request，没有收完的帧留在in_buf中
+ * @return {bool} 帧是否合法，收到不认识的消息或者超长的帧时返回false，调用者关闭连接
+ */
+static bool parse_frames(Session* session, Request* request) {
+  auto& in_buf = session->in_buf;
+  size_t pos = 0;
+  while (in_buf.size() - pos >= WIRE_HEADER_SIZE) {
+    WireHeader header = decode_wire_header(in_buf.data() + pos);
+    if (header.type != WireType::QUERY || header.length > WIRE_MAX_PAYLOAD) {
+      return false;
+    }
+    if (in_buf.size() - pos - WIRE_HEADER_SIZE < header.length) {
+      break;
+    }
+    request->statements.emplace_back(
+        header.stmt_id,
+        in_buf.substr(pos + WIRE_HEADER_SIZE, header.length));
+    pos += WIRE_HEADER_SIZE + header.length;
+  }
+  in_buf.erase(0, pos);
+  return true;
+}
 
-  // Clear
+/**
+ * @description: I/O线程：等待分给自己的连接上有请求到达，读出请求放进队列；客户端断开时关闭连接
+ * @param {int} epoll_fd 这个I/O线程的epoll
+ */
+static void io_loop(int epoll_fd) {
+  // 接收客户端发送的请求
+  char data_recv[BUFFER_LENGTH];
+  epoll_event events[SERVER_EPOLL_EVENTS];
+  while (true) {
+    int n = epoll_wait(epoll_fd, events, SERVER_EPOLL_EVENTS, -1);
+    for (int i = 0; i < n; ++i) {
+      auto* session = static_cast<Session*>(events[i].data.ptr);
+      memset(data_recv, 0, BUFFER_LENGTH);
+      int i_recvBytes = recv(session->fd, data_recv, BUFFER_LENGTH, 0);
+      if (i_recvBytes <= 0) {
 #ifdef ENABLE_COUT
-  std::cout << "Terminating current client_connection..." << std::endl;
+        std::cout << "Maybe the client has closed" << std::endl;
 #endif
-  close(fd);           // close a file descriptor.
-  pthread_exit(NULL);  // terminate calling thread!
+        delete session;
+        continue;
+      }
+      Request request{session, {}};
+      if (!session->detected &&
+          (!session->in_buf.empty() || data_recv[0] == '\0')) {
+        session->in_buf.append(data_recv, i_recvBytes);
+        if (session->in_buf.size() < sizeof(WIRE_MAGIC)) {
+          rearm_session(session);
+          continue;
+        }
+        if (memcmp(session->in_buf.data(), WIRE_MAGIC, sizeof(WIRE_MAGIC)) !=
+            0) {
+          delete session;
+          continue;
+        }
+        session->detected = true;
+        session->framed = true;
+        session->in_buf.erase(0, sizeof(WIRE_MAGIC));
+      } else if (session->framed) {
+        session->in_buf.append(data_recv, i_recvBytes);
+      } else {
+        // 文本协议：一次recv就是一条完整的语句
+        session->detected = true;
+        request.statements.emplace_back(0, std::string(data_recv));
+      }
+      if (session->framed && !parse_frames(session, &request)) {
+        delete session;
+        continue;
+      }
+      if (request.statements.empty()) {
+        // 帧还没有收完
+        rearm_session(session);
+        continue;
+      }
+      {
+        std::unique_lock lock(request_mutex);
+        admission_cv.wait(lock, [] {
+          return requests.size() + analytics_requests.size() <
+                 SERVER_QUEUE_LIMIT;
+        });
+        request.analytics =
+            session->workload_class == WORKLOAD_ANALYTICS && !session->in_txn;
+        (request.analytics ? analytics_requests : requests)
+            .push_back(std::move(request));
+      }
+      request_cv.notify_one();
+    }
+  }
 }
 
-void start_server() {
-  // init mutex
-  // buffer_mutex = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
-  sockfd_mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-  // pthread_mutex_init(buffer_mutex, nullptr);
-  pthread_mutex_init(sockfd_mutex, nullptr);
+/**
+ * @description: 在port上启动指标端点，不管请求的路径，总是以Prometheus文本格式返回SHOW STATUS中的所有指标。
+ * 请求很少，由一个线程依次处理，每个请求一个短连接
+ * @param {int} port 监听的端口，启动时用 -p <端口> 开启
+ */
+static void start_metrics_server(int port) {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd == -1) {
+    throw UnixError();
+  }
+  int val = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+  struct sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr)) == -1 ||
+      listen(listen_fd, SOMAXCONN) == -1) {
+    throw UnixError();
+  }
+  std::thread([listen_fd] {
+    char request[4096];
+    while (!should_exit) {
+      int fd = accept(listen_fd, nullptr, nullptr);
+      if (fd == -1) {
+        continue;
+      }
+      // 只读一次，请求的内容不影响返回的结果
+      if (recv(fd, request, sizeof(request), 0) > 0) {
+        std::vector<MetricSample> samples;
+        sm_manager->get_status(lock_manager.get(), samples);
+        std::string body = format_prometheus(samples);
+        std::string response =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " +
+            std::to_string(body.size()) +
+            "\r\n"
+            "Connection: close\r\n\r\n" +
+            body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+          ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                           MSG_NOSIGNAL);
+          if (n <= 0) {
+            break;
+          }
+          sent += n;
+        }
+      }
+      close(fd);
+    }
+  }).detach();
+}
 
+void start_server() {
   int sockfd_server;
   int fd_temp;
   struct sockaddr_in s_addr_in{};
@@ -373,49 +1161,72 @@ void start_server() {
     exit(1);
   }
 
-  fd_temp = listen(sockfd_server, MAX_CONN_LIMIT);
+  fd_temp = listen(sockfd_server, SOMAXCONN);
   if (fd_temp == -1) {
     std::cout << "Listen error!" << std::endl;
     exit(1);
   }
 
+  // 少量I/O线程等待所有连接上的请求，固定数量的工作线程执行语句
+  std::vector<int> epoll_fds;
+  for (int i = 0; i < SERVER_IO_THREADS; ++i) {
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+      throw UnixError();
+    }
+    epoll_fds.push_back(epoll_fd);
+    std::thread(io_loop, epoll_fd).detach();
+  }
+  {
+    std::lock_guard lock(request_mutex);
+    size_t workers = SERVER_WORKER_THREADS > 0
+                         ? SERVER_WORKER_THREADS
+                         : std::max(1u, std::thread::hardware_concurrency());
+    while (num_workers < workers) {
+      add_worker();
+    }
+    analytics_limit = SERVER_ANALYTICS_WORKERS > 0
+                          ? SERVER_ANALYTICS_WORKERS
+                          : std::max<size_t>(1, workers / 2);
+  }
+  std::thread(stall_monitor).detach();
+
+  size_t next_io_thread = 0;
   while (!should_exit) {
 #ifdef ENABLE_COUT
     std::cout << "Waiting for new connection..." << std::endl;
 #endif
-    // 解决局部变量析构问题
-    int* sockfd = (int*)malloc(sizeof(int));
-
-    pthread_t thread_id;
     struct sockaddr_in s_addr_client{};
     int client_length = sizeof(s_addr_client);
 
     if (setjmp(jmpbuf)) {
-      free(sockfd);
       std::cout << "Break from Server Listen Loop\n";
       break;
     }
 
     // Block here. Until server accepts a new connection.
-    pthread_mutex_lock(sockfd_mutex);
-    *sockfd = accept(sockfd_server, (struct sockaddr*)(&s_addr_client),
-                     (socklen_t*)(&client_length));
-    if (*sockfd == -1) {
-      free(sockfd);
+    int sockfd = accept(sockfd_server, (struct sockaddr*)(&s_addr_client),
+                        (socklen_t*)(&client_length));
+    if (sockfd == -1) {
       std::cout << "Accept error!" << std::endl;
       continue;  // ignore current socket ,continue while loop.
     }
+#ifdef ENABLE_COUT
+    std::string output =
+        "establish client connection, sockfd: " + std::to_string(sockfd) + "\n";
+    std::cout << output;
+#endif
 
-    // 和客户端建立连接，并开启一个线程负责处理客户端请求
-    if (pthread_create(&thread_id, nullptr, &client_handler, (void*)(sockfd)) !=
-        0) {
-      free(sockfd);
-      std::cout << "Create thread fail!" << std::endl;
-      break;  // break while loop
+    // 连接轮流分给各个I/O线程
+    int epoll_fd = epoll_fds[next_io_thread++ % epoll_fds.size()];
+    auto* session = new Session(sockfd, epoll_fd);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = session;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event) == -1) {
+      delete session;
+      std::cout << "Register connection fail!" << std::endl;
     }
-
-    // 将线程设置为分离状态，自动回收资源
-    pthread_detach(thread_id);
   }
 
   buffer_pool_manager->ouput_info();
@@ -429,14 +1240,14 @@ void start_server() {
     printf("%s\n", strerror(errno));
   }
   //    assert(ret != -1);
+  stop_vacuum_worker();
+  stop_analyze_worker();
+  OutputWriter::instance().flush();
+  OutputWriter::slow_query_log().flush();
   std::cout << "before close db: " << std::endl;
   sm_manager->close_db();
   std::cout << "before delete txn: " << std::endl;
-  for (auto& [_, txn] : txn_manager->txn_map) {
-    std::ignore = _;
-    delete txn;
-  }
-  txn_manager->txn_map.clear();
+  txn_manager->delete_all_transactions();
 
 #ifdef ENABLE_COUT
   std::cout << " DB has been closed.\n";
@@ -444,11 +1255,101 @@ void start_server() {
 #endif
 }
 
+static void usage(const char* prog) {
+  std::cerr << "Usage: " << prog
+            << " [-b <buffer pool MB>] [-n <buffer pool instances>]"
+               " [-m <max buffer pool MB>] [-a <auto vacuum seconds>]"
+               " [-d <deadlock detection interval ms>]"
+               " [-l <log flush interval ms>] [-w <log archive dir>]"
+               " [-r <log shipping port>] [-f <primary host:port>]"
+               " [-p <metrics port>] [-s <slow query ms>] <database>"
+            << std::endl;
+  exit(1);
+}
+
 int main(int argc, char** argv) {
-  if (argc != 2) {
+  // 缓冲池大小以MB为单位，运行时可以用 set buffer_pool_size = <MB> 在[实例个数, 上限]页之间调整
+  size_t pool_size = BUFFER_POOL_SIZE;
+  size_t num_instances = BUFFER_POOL_INSTANCES;
+  size_t max_pool_size = 0;
+  int vacuum_interval = 0;  // 后台清理的间隔秒数，0表示不开启
+  // 默认wait-die，用 -d <毫秒> 改为每隔这么久检查一次等待图
+  auto deadlock_policy = DeadlockPolicy::WAIT_DIE;
+  int metrics_port = 0;  // Prometheus指标端点的端口，0表示不开启
+  std::filesystem::path archive_dir;  // 回收日志段之前复制到这个目录，为空时不归档
+  int log_shipping_port = 0;  // 主库向备库发送日志的端口，0表示不开启
+  std::string primary_host;   // 不为空时作为备库运行，只接收这个主库的日志
+  int primary_port = 0;
+  constexpr size_t PAGES_PER_MB = 1024 * 1024 / PAGE_SIZE;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:n:m:a:d:l:p:s:w:r:f:")) != -1) {
+    if (opt == 'w') {
+      // 之后会切换到数据库目录，先转成绝对路径
+      archive_dir = std::filesystem::absolute(optarg);
+      continue;
+    }
+    if (opt == 'f') {
+      std::string primary = optarg;
+      size_t colon = primary.rfind(':');
+      if (colon == std::string::npos) {
+        usage(argv[0]);
+      }
+      primary_host = primary.substr(0, colon);
+      primary_port = std::atoi(primary.c_str() + colon + 1);
+      continue;
+    }
+    long value = optarg != nullptr ? std::atol(optarg) : 0;
+    if (value <= 0) {
+      usage(argv[0]);
+    }
+    switch (opt) {
+      case 'b':
+        pool_size = static_cast<size_t>(value) * PAGES_PER_MB;
+        break;
+      case 'n':
+        num_instances = static_cast<size_t>(value);
+        break;
+      case 'm':
+        max_pool_size = static_cast<size_t>(value) * PAGES_PER_MB;
+        break;
+      case 'a':
+        vacuum_interval = static_cast<int>(value);
+        break;
+      case 'd':
+        deadlock_policy = DeadlockPolicy::DETECTION;
+        cycle_detection_interval = std::chrono::milliseconds(value);
+        break;
+      case 'l':
+        log_timeout = std::chrono::milliseconds(value);
+        break;
+      case 'p':
+        metrics_port = static_cast<int>(value);
+        break;
+      case 'r':
+        log_shipping_port = static_cast<int>(value);
+        break;
+      case 's':
+        slow_query_us = value * 1000;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
     // 需要指定数据库名称
-    std::cerr << "Usage: " << argv[0] << " <database>" << std::endl;
-    exit(1);
+    usage(argv[0]);
+  }
+  init_managers(pool_size, num_instances, max_pool_size, deadlock_policy);
+  if (!archive_dir.empty()) {
+    disk_manager->set_log_archiver([archive_dir](const std::string& segment) {
+      std::error_code ec;
+      std::filesystem::copy_file(segment, archive_dir / segment,
+                                 std::filesystem::copy_options::overwrite_existing, ec);
+      if (ec) {
+        std::cerr << "failed to archive " << segment << ": " << ec.message() << std::endl;
+      }
+      return !ec;
+    });
   }
 
   signal(SIGINT, sigint_handler);
@@ -468,7 +1369,7 @@ int main(int argc, char** argv) {
                  "\n";
 #endif
     // Database name is passed by args
-    std::string db_name = argv[1];
+    std::string db_name = argv[optind];
     if (!sm_manager->is_dir(db_name)) {
       // Database not found, create a new one
       sm_manager->create_db(db_name);
@@ -476,15 +1377,39 @@ int main(int argc, char** argv) {
     // Open database
     sm_manager->open_db(db_name);
 
+    if (!primary_host.empty()) {
+      // 备库不做恢复也不接受连接，只把主库的日志接在已有日志之后，被信号直接终止
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      recovery->find_log_end();
+      run_log_receiver(primary_host, primary_port, disk_manager.get());
+    }
+
     // recovery database
 #ifdef ENABLE_LOGGING
     recovery->analyze();
     recovery->redo();
     recovery->undo();
+    // 恢复完成后启动组提交刷盘线程
+    log_manager->start_flush_thread();
 #endif
+    // 恢复会重建索引，之后再按上次关闭或检查点时的缓冲池内容在后台预热
+    sm_manager->start_buffer_pool_warmup();
+    // 后台写页线程提前写回即将被淘汰的脏页
+    buffer_pool_manager->start_page_writer();
 
-    // 静态 map 预留空间
-    TransactionManager::Initialize(20);
+    if (vacuum_interval > 0) {
+      start_vacuum_worker(vacuum_interval);
+    }
+    if (AUTO_ANALYZE_INTERVAL_SEC > 0) {
+      start_analyze_worker();
+    }
+    if (metrics_port > 0) {
+      start_metrics_server(metrics_port);
+    }
+    if (log_shipping_port > 0) {
+      start_log_sender(log_shipping_port, log_manager.get(), disk_manager.get());
+    }
     // 开启服务端，开始接受客户端连接
     start_server();
   } catch (RMDBError& e) {
@@ -494,54 +1419,117 @@ int main(int argc, char** argv) {
   return 0;
 }
 
-std::string doSort(const std::string& filename, const std::string& tabname) {
-  if (sort_map[tabname] == "none") {
-    return filename;
-  }
-  std::string actual_filename = "sorted_" + tabname + ".csv";
-  std::string command = sort_map[tabname] + filename + " > " + actual_filename;
-  // Open the pipe
-  std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"),
-                                                pclose);
-  if (!pipe) {
-    throw std::runtime_error("popen() failed!");
+// 把 CSV 中的字符串字段拷贝到记录中，只拷贝字段本身，剩余部分补 0
+static void copy_string_field(char* dst, int len, const char* begin,
+                              const char* end) {
+  if (end > begin && end[-1] == '\r') {
+    --end;
   }
-  return actual_filename;
+  int n = std::min(static_cast<int>(end - begin), len);
+  memcpy(dst, begin, n);
+  memset(dst + n, 0, len - n);
 }
 
-// 使用命令wc -l < file.csv 得到行数
-int getFileLineCount(const std::string& filename) {
-  std::string command = "wc -l < " + filename;
-  std::array<char, 128> buffer{};
-  std::string result;
-
-  // Open the pipe
-  std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"),
-                                                pclose);
-  if (!pipe) {
-    throw std::runtime_error("popen() failed!");
+/* LOAD的数据文件被切成以换行结尾的块，每块大约LOAD_CHUNK_SIZE字节，各块并行解析成记录 */
+struct LoadChunk {
+  const char* begin;
+  const char* end;
+  std::vector<char> records{};  // 解析出的记录，每条record_size字节
+  int num_records = 0;
+};
+
+// 解析数字字段：和atoi/atof一样允许前导空格和'+'，不是数字时为0
+template <typename T>
+static T parse_number(const char* begin, const char* end) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) {
+    ++begin;
   }
-
-  // Read the output
-  while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-    result += buffer.data();
+  if (begin < end && *begin == '+') {
+    ++begin;
   }
+  T value{};
+  std::from_chars(begin, end, value);
+  return value;
+}
 
-  // Extract the number of lines from the result string
-  // 记得减去表头
-  return std::stoi(result) - 1;
+// 把块中的每一行解析成一条记录，空行跳过。换行和分隔符用memchr（glibc中用SIMD实现）查找，
+// 数字用from_chars解析；最后一列取到行尾
+static void parse_load_chunk(LoadChunk* chunk, const std::vector<ColMeta>& cols,
+                             int record_size) {
+  const char* p = chunk->begin;
+  while (p < chunk->end) {
+    auto* eol =
+        static_cast<const char*>(memchr(p, '\n', chunk->end - p));
+    if (eol == nullptr) {
+      eol = chunk->end;
+    }
+    const char* line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+    if (line_end > p) {
+      size_t need = static_cast<size_t>(chunk->num_records + 1) * record_size;
+      if (chunk->records.size() < need) {
+        chunk->records.resize(std::max(need, chunk->records.size() * 2));
+      }
+      char* record =
+          chunk->records.data() +
+          static_cast<size_t>(chunk->num_records) * record_size;
+      const char* field = p;
+      for (size_t c = 0; c < cols.size(); ++c) {
+        const char* field_end =
+            c + 1 < cols.size()
+                ? static_cast<const char*>(memchr(field, ',', line_end - field))
+                : nullptr;
+        if (field_end == nullptr) {
+          field_end = line_end;
+        }
+        switch (cols[c].type) {
+          case TYPE_INT: {
+            int value = parse_number<int>(field, field_end);
+            memcpy(record + cols[c].offset, &value, sizeof(value));
+            break;
+          }
+          case TYPE_FLOAT: {
+            float value = parse_number<float>(field, field_end);
+            memcpy(record + cols[c].offset, &value, sizeof(value));
+            break;
+          }
+          case TYPE_STRING: {
+            copy_string_field(record + cols[c].offset, cols[c].len, field,
+                              field_end);
+            break;
+          }
+          default:
+            break;
+        }
+        field = field_end < line_end ? field_end + 1 : line_end;
+      }
+      ++chunk->num_records;
+    }
+    p = eol + 1;
+  }
 }
 
 void load_data(std::string filename, std::string tabname) {
-  // 如果使用 bulkloading 算法索引载入，必须先 sort 表文件
-  // filename = doSort(filename, tabname);
-
   // 获取 table
   auto& tab_ = sm_manager->db_.get_table(tabname);
   auto&& fh = sm_manager->fhs_[tabname].get();
 
   int& record_len_ = fh->get_file_hdr().record_size;
   int& max_nums_ = fh->get_file_hdr().num_records_per_page;
+  // LOAD直接组装页面，修改不经过记录接口，不能和表上正在进行的在线建索引同时进行
+  if (fh->is_logging_changes()) {
+    std::cerr << "Error loading " << tabname << ": an index is being created on the table\n";
+    return;
+  }
+  // 物化视图由事务中的写算子维护，导入的记录不经过它们
+  if (!tab_.mat_views.empty() || tab_.mat_view.is_view()) {
+    std::cerr << "Error loading " << tabname << ": the table is or has a materialized view\n";
+    return;
+  }
+  // 导入直接写表的数据文件，不按分区字段把记录分到各个分区
+  if (tab_.partition.is_partitioned()) {
+    std::cerr << "Error loading " << tabname << ": the table is partitioned\n";
+    return;
+  }
 
   int fd = open(filename.c_str(), O_RDONLY);
   if (fd == -1) {
@@ -578,372 +1566,225 @@ void load_data(std::string filename, std::string tabname) {
 
   // 按页刷入
   auto page_size = max_nums_ * record_len_;
-  // 先试试不乘 2
   char* data = new char[page_size];
   char* cur = data;
   // 从第一页开始放数据
   int page_no = 1;
-
-  int row = 0;
+  // 导入的页面在环形缓冲区中写回，不把共享缓冲池中的页面挤出去；
+  // 定长和列存格式中文件末尾之后的新页面在page_buf中组装后直接写盘，完全不经过缓冲池
+  BufferAccessStrategy strategy(BULK_WRITE_RING_PAGES);
+  bool direct = LOAD_DIRECT_WRITE &&
+                fh->get_file_hdr().format != RM_FORMAT_SLOTTED;
+  std::unique_ptr<char, decltype(&free)> page_buf(
+      static_cast<char*>(aligned_alloc(PAGE_SIZE, PAGE_SIZE)), &free);
+  [[maybe_unused]] int first_new_page = fh->get_file_hdr().num_pages;
   int nums_record = 0;
 
-  // 读取到 data 中
-  int col_idx = 0;
-  auto& cols_meta = tab_.cols;
-
-  // int index_pages = 0;
-  // int ih_fd = -1;
-
-  // 支持正常索引载入与 bulkloading 批量载入
-  // bulkloading
-  // 算法参考了开源实现，并修复了两处实现缺陷，完美适应了本项目实现的 B+ 树引擎
-  if (!tab_.indexes.empty()) {
-    // 只有一个索引
-    //        int num_lines = getFileLineCount(filename);
-    //
-    //        auto &ix_name = tab_.indexes.begin()->first;
-    //        auto &ih = sm_manager->ihs_[ix_name];
-    //        // ih_fd = ih->fd_;
-    //
-    //        auto &index_meta = tab_.indexes.begin()->second;
-    //        int &tot_len = index_meta.col_tot_len;
-    //
-    //        // 直接设置开始分配的页面号
-    //        // disk_manager->set_fd2pageno(ih->fd_, 2);
-    //
-    //        // 创建第一个叶子结点
-    //        int pos = 0;
-    //        auto node = ih->fetch_node(ih->file_hdr_->root_page_);
-    //        // ih->file_hdr_->first_leaf_ = node->get_page_no();
-    //        // node->set_is_leaf_page(true);
-    //
-    //        char *node_key = node->get_key(0);
-    //        Rid *node_rid = node->get_rid(0);
-    //
-    //        int block = 0;
-    //        // 计算叶子结点的个数和每块应装入的元组条数
-    //        // max_size * 0.7 大小 尽可能避免分裂重组
-    //        int expected_leaf_num =
-    //        static_cast<int>((ih->file_hdr_->btree_order_ + 1) * 0.7); int
-    //        blocks = num_lines / expected_leaf_num + (num_lines %
-    //        expected_leaf_num ? 1 : 0);
-    //        // 调整块数量，确保每个叶子节点半满
-    //        if (blocks > 1 && (ih->file_hdr_->btree_order_ + 1) / 2 >
-    //        num_lines / blocks) {
-    //            // 可能执行到这里
-    //            --blocks;
-    //        }
-    //
-    //        // 实际每个叶子上的元组数量
-    //        int actual_leaf_num = num_lines / blocks;
-    //        // 多出来的元组
-    //        int remaining_leaf_num = num_lines % blocks;
-    //
-    //        // max_size * 0.9 大小 让父节点尽可能放入更多的元组
-    //        int upper_expected_parent_num =
-    //        static_cast<int>((ih->file_hdr_->btree_order_ + 1) * 0.9); int
-    //        upper_blocks = blocks / upper_expected_parent_num + (num_lines %
-    //        upper_expected_parent_num ? 1 : 0);
-    //        // 调整块数量，确保每个叶子节点半满
-    //        if (upper_blocks > 1 && (ih->file_hdr_->btree_order_ + 1) / 2 >
-    //        blocks / upper_blocks) {
-    //            --upper_blocks;
-    //        }
-    //
-    //        // 实际每个父亲节点上的元组数量
-    //        int actual_upper_parent_num = blocks / upper_blocks;
-    //        // 多出来的元组
-    //        int remaining_upper_parent_num = blocks % upper_blocks;
-    //
-    //        // 第一个父亲节点页号
-    //        int parent_page_no = blocks + 2;
-    //
-    //        // 只能构成一个节点，即为根节点
-    //        if (blocks == 1) {
-    //            node->set_parent_page_no(INVALID_PAGE_ID);
-    //            ih->file_hdr_->root_page_ = node->get_page_no();
-    //        } else {
-    //            // 否则叶子节点指向父亲节点
-    //            node->set_parent_page_no(parent_page_no);
-    //        }
-    //
-    //        // 设置叶子节点大小
-    //        node->set_size(actual_leaf_num);
-    //
-    //        // 对于父亲节点，孩子节点数量
-    //        int child_pos = 0;
-    //
-    //        // 把每个索引块的第一个元组拷贝，用于父亲节点生成
-    //        char *key_temp = nullptr;
-    //        char *key_temp_head = nullptr;
-    //        Rid *rid_temp = nullptr;
-    //        Rid *rid_temp_head = nullptr;
-    //
-    //        // 只有有父亲节点才需要
-    //        if (blocks > 1) {
-    //            key_temp = new char[blocks * tot_len];
-    //            key_temp_head = key_temp;
-    //            rid_temp = new Rid[blocks];
-    //            rid_temp_head = rid_temp;
-    //        }
-    //
-    // char *key = new char[tot_len];
-    auto* txn = new Transaction(666);
-
-    // i 慢指针，j 快指针
-    for (std::size_t j = i; j < file_size; ++j) {
-      if (file_content[j] == ',') {
-        switch (cols_meta[col_idx].type) {
-          case TYPE_INT: {
-            *(int*)(cur + cols_meta[col_idx].offset) =
-                std::atoi(file_content + i);
-            break;
-          }
-          case TYPE_FLOAT: {
-            *(float*)(cur + cols_meta[col_idx].offset) =
-                std::atof(file_content + i);
-            break;
-          }
-          case TYPE_STRING: {
-            memcpy(cur + cols_meta[col_idx].offset, file_content + i,
-                   cols_meta[col_idx].len);
-            break;
-          }
-          default:
-            break;
-        }
-        ++col_idx;
-        i = j + 1;
-      } else if (file_content[j] == '\n' || j == file_size - 1) {
-        switch (cols_meta[col_idx].type) {
-          case TYPE_INT: {
-            *(int*)(cur + cols_meta[col_idx].offset) =
-                std::atoi(file_content + i);
-            break;
-          }
-          case TYPE_FLOAT: {
-            *(float*)(cur + cols_meta[col_idx].offset) =
-                std::atof(file_content + i);
-            break;
-          }
-          case TYPE_STRING: {
-            memcpy(cur + cols_meta[col_idx].offset, file_content + i,
-                   cols_meta[col_idx].len);
-            break;
-          }
-          default:
-            break;
-        }
-        col_idx = 0;
-        i = j + 1;
-
-        // 得到索引键
-        //                for (auto &[index_offset, col]: index_meta.cols) {
-        //                    memcpy(key + index_offset, cur + col.offset,
-        //                    col.len);
-        //                }
-
-        // 正常索引载入用这个
-        for (auto& [index_name, index] : tab_.indexes) {
-          auto& ih = sm_manager->ihs_[index_name];
-          char* key = new char[index.col_tot_len];
-          for (auto& [index_offset, col_meta] : index.cols) {
-            memcpy(key + index_offset, cur + col_meta.offset, col_meta.len);
-          }
-          ih->insert_entry(key, {page_no, row % max_nums_}, txn);
-          delete[] key;
-        }
-
-        // 一个叶子节点放满了
-        //                if (pos == actual_leaf_num) {
-        //                    pos = 0;
-        //
-        //                    auto new_node = ih->create_node();
-        //                    // 设置叶子节点前后关系
-        //                    new_node->set_prev_leaf(node->get_page_no());
-        //                    new_node->set_next_leaf(node->get_next_leaf());
-        //                    node->set_next_leaf(new_node->get_page_no());
-        //
-        //                    // unpin
-        //                    buffer_pool_manager->unpin_page(node->get_page_id(),
-        //                    true);
-        //
-        //                    node = std::move(new_node);
-        //                    node->set_is_leaf_page(true);
-        //                    node_key = node->get_key(0);
-        //                    node_rid = node->get_rid(0);
-        //
-        //                    if (++block + remaining_leaf_num == blocks) {
-        //                        // assert(0);
-        //                        ++actual_leaf_num;
-        //                    }
-        //
-        //                    // 设置大小
-        //                    node->set_size(actual_leaf_num);
-        //
-        //                    // 对于父亲节点，孩子节点数量 + 1
-        //                    if (++child_pos >= actual_upper_parent_num) {
-        //                        // 父亲节点 + 1
-        //                        // 孩子节点数量设置为 0
-        //                        child_pos = 0;
-        //                        //
-        //                        注意这里的2和起始节点页号有关，parent_page_no
-        //                        - blocks - 2 才是实际父节点块数 if
-        //                        (++parent_page_no - blocks - 2 == upper_blocks
-        //                        - remaining_upper_parent_num) {
-        //                            ++actual_upper_parent_num;
-        //                        }
-        //                    }
-        //                    // 指向父亲节点
-        //                    node->set_parent_page_no(parent_page_no);
-        //                }
-        //
-        //                //
-        //                注意如果一个叶子节点放满了，跳到下一个叶子头也得拷贝
-        //                if (pos == 0 && blocks > 1) {
-        //                    // 将每个索引块的第一个元组拷贝一份到临时数组中
-        //                    memcpy(key_temp_head, key, tot_len);
-        //                    Rid rid{.page_no = node->get_page_no(), .slot_no =
-        //                    0}; memcpy(rid_temp_head, &rid, sizeof(Rid));
-        //                    key_temp_head += tot_len;
-        //                    // 加一个 rid
-        //                    ++rid_temp_head;
-        //                }
-
-        // 初始化键值对
-        //                Rid rid{page_no, row % max_nums_};
-        //                memcpy(node_key, key, tot_len);
-        //                memcpy(node_rid, &rid, sizeof(Rid));
-        //                node_key += tot_len;
-        //                ++node_rid;
-        //                ++pos;
-
-        cur += record_len_;
-        // 满足一页或者读到最后了，刷进去
-        if ((row + 1) % max_nums_ == 0 || j == file_size - 1) {
-          nums_record = (row + 1) % max_nums_ == 0 ? (row == 0 ? 1 : max_nums_)
-                                                   : (row + 1) % max_nums_;
-          fh->load_record(page_no, data, nums_record, cur - data);
-          ++page_no;
-          cur = data;
-        }
-
-        ++row;
+  // 导入前为空的索引先收集所有键，导入完成后排序并自底向上建树；
+  // 已经有数据的索引逐条插入
+  auto* txn = new Transaction(666);
+  std::vector<Rid> rids;
+  std::unordered_map<std::string, std::unique_ptr<IxBulkLoader>> loaders;
+  size_t max_key_len = 0;
+  for (auto& [index_name, index] : tab_.indexes) {
+    auto& ih = sm_manager->ihs_[index_name];
+    if (ih->is_empty()) {
+      loaders[index_name] = std::make_unique<IxBulkLoader>(ih.get());
+    }
+    max_key_len = std::max<size_t>(max_key_len, index.col_tot_len);
+  }
+  std::vector<char> key(max_key_len);
+  // 按主索引排序后写入表：主索引取导入前为空的B+树索引中字段最少的一个，
+  // 记录按它的key的顺序写入，它的叶子不再排序、直接顺序填满
+  std::string cluster_index;
+  std::unique_ptr<LoadSorter> sorter;
+  if (LOAD_CLUSTER_BY_INDEX) {
+    for (auto& [index_name, index] : tab_.indexes) {
+      if (loaders.count(index_name) == 0 || index.type != INDEX_BTREE) {
+        continue;
+      }
+      if (cluster_index.empty() ||
+          std::tie(index.col_num, index.col_tot_len, index_name) <
+              std::tie(tab_.indexes.at(cluster_index).col_num,
+                       tab_.indexes.at(cluster_index).col_tot_len,
+                       cluster_index)) {
+        cluster_index = index_name;
       }
     }
-
-    // delete []key;
-
-    // 设置最后一个叶子节点
-    //        ih->file_hdr_->last_leaf_ = node->get_page_no();
-    //        // unpin
-    //        buffer_pool_manager->unpin_page(node->get_page_id(), true);
-    //
-    //        // 需要建立父亲节点
-    //        if (blocks > 1) {
-    //            ih->create_upper_parent_nodes(key_temp, rid_temp, blocks + 2,
-    //            blocks);
-    //        }
-
-    // index_pages = ih->file_hdr_->num_pages_;
-
-    delete txn;
-
-    // ih->Draw(buffer_pool_manager.get(), "dis_Graph.dot");
-  } else {
-    // i 慢指针，j 快指针
-    for (std::size_t j = i; j < file_size; ++j) {
-      if (file_content[j] == ',') {
-        switch (cols_meta[col_idx].type) {
-          case TYPE_INT: {
-            *(int*)(cur + cols_meta[col_idx].offset) =
-                std::atoi(file_content + i);
-            break;
-          }
-          case TYPE_FLOAT: {
-            *(float*)(cur + cols_meta[col_idx].offset) =
-                std::atof(file_content + i);
-            break;
-          }
-          case TYPE_STRING: {
-            memcpy(cur + cols_meta[col_idx].offset, file_content + i,
-                   cols_meta[col_idx].len);
-            break;
-          }
-          default:
-            break;
-        }
-        ++col_idx;
-        i = j + 1;
-      } else if (file_content[j] == '\n' || j == file_size - 1) {
-        switch (cols_meta[col_idx].type) {
-          case TYPE_INT: {
-            *(int*)(cur + cols_meta[col_idx].offset) =
-                std::atoi(file_content + i);
-            break;
-          }
-          case TYPE_FLOAT: {
-            *(float*)(cur + cols_meta[col_idx].offset) =
-                std::atof(file_content + i);
-            break;
-          }
-          case TYPE_STRING: {
-            memcpy(cur + cols_meta[col_idx].offset, file_content + i,
-                   cols_meta[col_idx].len);
-            break;
-          }
-          default:
-            break;
-        }
-        col_idx = 0;
-        i = j + 1;
-
-        cur += record_len_;
-        // 满足一页或者读到最后了，刷进去
-        if ((row + 1) % max_nums_ == 0 || j == file_size - 1) {
-          nums_record = (row + 1) % max_nums_ == 0 ? (row == 0 ? 1 : max_nums_)
-                                                   : (row + 1) % max_nums_;
-          fh->load_record(page_no, data, nums_record, cur - data);
-          ++page_no;
-          cur = data;
-        }
-
-        ++row;
+    if (!cluster_index.empty()) {
+      sorter = std::make_unique<LoadSorter>(tab_.indexes.at(cluster_index),
+                                            record_len_);
+    }
+  }
+  auto insert_index_entries = [&](const char* record, const Rid& rid) {
+    for (auto& [index_name, index] : tab_.indexes) {
+      for (auto& [index_offset, col_meta] : index.cols) {
+        memcpy(key.data() + index_offset, record + col_meta.offset,
+               col_meta.len);
+      }
+      auto loader = loaders.find(index_name);
+      if (loader != loaders.end() && index_name == cluster_index) {
+        loader->second->add_sorted(key.data(), rid);
+      } else if (loader != loaders.end()) {
+        loader->second->add(key.data(), rid);
+      } else {
+        sm_manager->ihs_[index_name]->insert_entry(key.data(), rid, txn);
       }
     }
+  };
+  // 把data中攒满（或者最后没满）的一页记录写入表文件，记录的位置由load_record给出
+  auto flush_page = [&]() {
+    nums_record = (cur - data) / record_len_;
+    auto* out_rids = tab_.indexes.empty() ? nullptr : &rids;
+    if (direct && page_no >= fh->get_file_hdr().num_pages) {
+      page_no = fh->load_record_direct(page_no, data, nums_record, cur - data,
+                                       page_buf.get(), out_rids);
+    } else {
+      page_no = fh->load_record(page_no, data, nums_record, cur - data,
+                                &strategy, out_rids);
+    }
+    for (std::size_t k = 0; k < rids.size(); ++k) {
+      insert_index_entries(data + k * record_len_, rids[k]);
+    }
+    cur = data;
+  };
+  auto append_record = [&](const char* record) {
+    memcpy(cur, record, record_len_);
+    cur += record_len_;
+    if (cur == data + page_size) {
+      flush_page();
+    }
+  };
+
+  // 表头之后的内容切成以换行结尾的块，每一轮由morsel调度器并行解析一批块，
+  // 再在本线程按文件中的顺序写满页面，页面号和空闲空间映射只由本线程分配；
+  // 按主索引排序时解析线程顺便把自己的块排成有序run，全部解析完后归并写入
+  std::vector<LoadChunk> chunks;
+  for (size_t begin = i; begin < file_size;) {
+    size_t end = std::min(begin + LOAD_CHUNK_SIZE, file_size);
+    if (end < file_size) {
+      auto* newline = static_cast<const char*>(
+          memchr(file_content + end, '\n', file_size - end));
+      end = newline == nullptr ? file_size : newline - file_content + 1;
+    }
+    chunks.push_back({file_content + begin, file_content + end});
+    begin = end;
+  }
+  auto& scheduler = MorselScheduler::instance();
+  size_t round = scheduler.num_workers();
+  for (size_t first = 0; first < chunks.size(); first += round) {
+    size_t num = std::min(round, chunks.size() - first);
+    scheduler.run(num, [&](size_t morsel, size_t) {
+      auto& chunk = chunks[first + morsel];
+      parse_load_chunk(&chunk, tab_.cols, record_len_);
+      if (sorter != nullptr) {
+        sorter->sort_chunk(&chunk.records, chunk.num_records);
+      }
+    });
+    for (size_t c = first; c < first + num; ++c) {
+      auto& chunk = chunks[c];
+      if (sorter != nullptr) {
+        sorter->add_run(std::move(chunk.records));
+        continue;
+      }
+      for (int r = 0; r < chunk.num_records; ++r) {
+        append_record(chunk.records.data() + r * record_len_);
+      }
+      std::vector<char>().swap(chunk.records);
+    }
+  }
+  if (sorter != nullptr) {
+    sorter->finish(append_record);
+  }
+  if (cur != data) {
+    flush_page();
   }
 
+  for (auto& [index_name, loader] : loaders) {
+    loader->finish();
+  }
+  delete txn;
+
   // Unmap the file and close the file descriptor
   if (munmap(file_content, file_size) == -1) {
     perror("Error unmapping file");
   }
   close(fd);
 
-  if (nums_record < max_nums_) {
+  // 变长格式由 load_record 把最后一个没满的页面放进空闲页面链表
+  if (fh->get_file_hdr().format == RM_FORMAT_FIXED && nums_record < max_nums_) {
     fh->set_first_free_page_no(page_no - 1);
   }
 
+  // 发布导入的页面：数据页面全部落盘之后才写一条批量导入日志并等它持久化。文件头只在检查点和关闭时写回，
+  // 导入到一半崩溃时磁盘上的页面数没有变，恢复时没有这条日志，写了一半的页面不会出现在表中，之后的插入会覆盖它们。
+  // 不写日志的表崩溃后会被清空，不需要这条日志
+#ifdef ENABLE_LOGGING
+  if (!fh->is_unlogged()) {
+    buffer_pool_manager->flush_all_pages(fh->GetFd());
+    fh->sync_loaded_pages();
+    BulkLoadLogRecord bulk_load_log(fh->get_table_id(), first_new_page,
+                                    fh->get_file_hdr().num_pages);
+    log_manager->add_log_to_buffer(&bulk_load_log);
+    log_manager->flush_log_to_disk();
+  }
+#endif
+
   // printf("table: %s, fd: %d, used table pages: %d\n", tabname.c_str(),
   // fh->GetFd(), page_no - 1); printf("table: %s, fd: %d, used index pages:
   // %d\n", tabname.c_str(), ih_fd, index_pages);
 
+  // 导入的记录不经过事务，在这里让结果缓存中读过这个表的结果过期
+  fh->note_change();
+
   // 释放内存
   delete[] data;
 }
 
 int fast_count_star(std::string& tabname, Context* context) {
+  // 分区表的记录数是各个分区的记录数之和
+  auto& tab = sm_manager->db_.get_table(tabname);
+  if (tab.partition.is_partitioned()) {
+    int count = 0;
+    for (auto& partition_name : tab.partition_names()) {
+      count += fast_count_star(partition_name, context);
+    }
+    return count;
+  }
   auto& fh = sm_manager->fhs_[tabname];
+  // 表级 S 锁挡住了其他事务未提交的插入和删除，RmFileHandle维护的记录数
+  // 只多出本事务自己的修改，正是本事务应该看到的记录数，不用读任何页面
   context->lock_mgr_->lock_shared_on_table(context->txn_, fh->GetFd());
+  return static_cast<int>(fh->get_num_rows());
+}
 
-  int count = 0;
-  auto first_page = RM_FIRST_RECORD_PAGE;
-  auto& total_pages = fh->get_file_hdr().num_pages;
-  while (first_page < total_pages) {
-    auto&& page_handle = fh->fetch_page_handle(first_page++);
-    count += page_handle.page_hdr->num_records;
-    // TODO 记得 unpin
-    buffer_pool_manager->unpin_page(page_handle.page->get_page_id(), false);
+/**
+ * @description: 没有条件的MIN(col)/MAX(col)：col是某个B+树索引的第一个字段时，
+ * 持有表级 S 锁读索引第一个叶子的第一个key或最后一个叶子的最后一个key
+ * @return {bool} 找到了这样的索引并且表不为空，否则由优化器生成计划
+ */
+bool fast_min_max(std::string& tabname, const TabCol& col, bool is_max,
+                  Context* context, std::string* value) {
+  auto& tab = sm_manager->db_.get_table(tabname);
+  for (auto& [index_name, index] : tab.indexes) {
+    if (index.type != INDEX_BTREE || index.cols[0].name != col.col_name) {
+      continue;
+    }
+    auto& fh = sm_manager->fhs_[tabname];
+    context->lock_mgr_->lock_shared_on_table(context->txn_, fh->GetFd());
+    std::vector<char> key(index.col_tot_len);
+    if (!sm_manager->ihs_[index_name]->get_boundary_key(is_max, key.data())) {
+      return false;
+    }
+    auto& key_col = index.cols[0];
+    if (key_col.type == TYPE_INT) {
+      *value = std::to_string(*reinterpret_cast<int*>(key.data()));
+    } else if (key_col.type == TYPE_FLOAT) {
+      *value = std::to_string(*reinterpret_cast<float*>(key.data()));
+    } else {
+      value->assign(key.data(), strnlen(key.data(), key_col.len));
+    }
+    return true;
   }
-
-  return count;
+  return false;
 }
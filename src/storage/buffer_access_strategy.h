@@ -0,0 +1,59 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "common/config.h"
+#include "storage/page.h"
+
+/* 一个缓冲池实例中的环形缓冲区：访问策略在这个实例上用过的帧，以及每个帧当时装入的页面 */
+struct BufferRing {
+  std::vector<std::pair<frame_id_t, PageId>> slots_;
+  size_t capacity_ = 0;
+  size_t next_ = 0;  // 下一个尝试复用的槽位
+};
+
+/**
+ * @description: 缓冲池访问策略。大表扫描和批量导入在一个小的私有环形缓冲区中循环复用帧，
+ * 而不是不断从共享缓冲池中淘汰页面，OLTP的热点页面因此可以常驻。
+ * 环中的帧被其他线程pin住或已经被共享缓冲池换走时，从共享缓冲池另取一帧补进环中。
+ * 一个策略对象只能被一个线程使用
+ */
+class BufferAccessStrategy {
+ public:
+  /**
+   * @param {size_t} ring_pages 环形缓冲区的总页数，平均分到各个缓冲池实例
+   */
+  explicit BufferAccessStrategy(size_t ring_pages) : ring_pages_(ring_pages) {}
+
+  /**
+   * @description: 获取策略在一个缓冲池实例上的环形缓冲区，第一次调用时按实例个数划分容量
+   * @param {size_t} instance_no 缓冲池实例编号
+   * @param {size_t} num_instances 缓冲池实例个数
+   */
+  BufferRing* get_ring(size_t instance_no, size_t num_instances) {
+    if (rings_.empty()) {
+      rings_.resize(num_instances);
+      for (auto& ring : rings_) {
+        ring.capacity_ = std::max<size_t>(1, ring_pages_ / num_instances);
+        ring.slots_.reserve(ring.capacity_);
+      }
+    }
+    return &rings_[instance_no];
+  }
+
+ private:
+  size_t ring_pages_;
+  std::vector<BufferRing> rings_;
+};
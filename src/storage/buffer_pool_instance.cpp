@@ -1,7 +1,56 @@
 #include "buffer_pool_instance.h"
 
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+#include "common/exec_stats.h"
+#include "common/memory_tracker.h"
+#include "common/trace.h"
 #include "recovery/log_manager.h"
 
+BufferPoolInstance::BufferPoolInstance(size_t pool_size,
+                                       DiskManager* disk_manager,
+                                       LogManager* log_manager,
+                                       const std::string& replacer_type,
+                                       size_t max_pool_size, int numa_node)
+    : pool_size_(0),
+      max_pool_size_(std::max<size_t>({pool_size, max_pool_size, 1})),
+      numa_node_(numa_node),
+      // 按最大容量预留连续的地址空间，扩缩容不需要移动页面，Page*在整个生命周期内有效
+      page_arena_(max_pool_size_ * sizeof(Page), numa_node),
+      data_arena_(max_pool_size_ * PAGE_SIZE, numa_node, ENABLE_HUGE_PAGES),
+      pages_(reinterpret_cast<Page*>(page_arena_.data())),
+      page_data_(data_arena_.data()),
+      page_table_(pool_size),
+      disk_manager_(disk_manager),
+      log_manager_(log_manager) {
+  replacer_ = create_replacer(replacer_type, max_pool_size_);
+  // 当前容量之外的帧在replacer中一直pin住，不会被淘汰；add_frames把帧放进free_list_时清除
+  for (size_t i = 0; i < max_pool_size_; ++i) {
+    replacer_->pin(static_cast<frame_id_t>(i));
+  }
+  // 初始化时，所有的page都在free_list_中
+  add_frames(pool_size);
+  page_writer_buffer_ = static_cast<char*>(
+      std::aligned_alloc(PAGE_SIZE, PAGE_WRITER_BATCH_SIZE * PAGE_SIZE));
+  MemoryAccounting::instance().alloc(MemTag::BUFFER_POOL,
+                                     PAGE_WRITER_BATCH_SIZE * PAGE_SIZE);
+}
+
+BufferPoolInstance::~BufferPoolInstance() {
+  stop_page_writer();
+  std::free(page_writer_buffer_);
+  MemoryAccounting::instance().free(
+      MemTag::BUFFER_POOL,
+      PAGE_WRITER_BATCH_SIZE * PAGE_SIZE + pool_size_ * FRAME_BYTES,
+      1 + static_cast<int64_t>(pool_size_));
+  for (size_t i = 0; i < num_constructed_; ++i) {
+    pages_[i].~Page();
+  }
+  delete replacer_;
+}
+
 /**
  * @description: 从free_list或replacer中得到可淘汰帧页的 *frame_id
  * @return {bool} true: 可替换帧查找成功 , false: 可替换帧查找失败
@@ -13,17 +62,114 @@ bool BufferPoolInstance::find_victim_page(frame_id_t* frame_id) {
   // 1.1 未满获得frame
   // 1.2 已满使用lru_replacer中的方法选择淘汰页面
   if (free_list_.empty()) {
-    return replacer_->victim(frame_id);
+    // 命中路径不持有latch_，在页表分区写锁内确认没有被重新pin后才取消映射，否则换一个
+    while (replacer_->victim(frame_id)) {
+      // 被重新pin住的帧，以及unpin_page晚到而进入replacer的空闲帧（页表中没有映射）都跳过
+      auto& page = pages_[*frame_id];
+      if (page_table_.erase_if(page.id_, *frame_id, [&page](frame_id_t) {
+            return page.pin_count_ == 0;
+          })) {
+        return true;
+      }
+    }
+    return false;
   }
   *frame_id = free_list_.front();
   free_list_.pop_front();
   return true;
 }
 
+/**
+ * @description: 获取latch_并把等待时间计入统计。先try_lock，没有竞争时不读时钟
+ * @return {unique_lock} 持有latch_的锁
+ */
+std::unique_lock<std::mutex> BufferPoolInstance::lock_latch() {
+  std::unique_lock lock(latch_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    latch_wait_hist_[0].fetch_add(1, std::memory_order_relaxed);
+    return lock;
+  }
+  auto start = std::chrono::steady_clock::now();
+  lock.lock();
+  uint64_t wait_us = elapsed_us(start);
+  wait_time.fetch_add(wait_us, std::memory_order_relaxed);
+  int bucket = 1;
+  while (bucket < LATCH_WAIT_BUCKETS - 1 &&
+         wait_us >= LATCH_WAIT_BOUNDS_US[bucket - 1]) {
+    ++bucket;
+  }
+  latch_wait_hist_[bucket].fetch_add(1, std::memory_order_relaxed);
+  return lock;
+}
+
+/**
+ * @description: 批量读盘并把读盘时间计入统计
+ */
+void BufferPoolInstance::read_pages(PageIoRequest* requests, int num) {
+  if (num == 0) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  disk_manager_->read_pages(requests, num);
+  read_time.fetch_add(elapsed_us(start), std::memory_order_relaxed);
+  thread_exec_stats().buffer_misses += num;
+}
+
+/**
+ * @description: 命中时pin住页面，调用者持有页面所在页表分区的读锁
+ * @param {frame_id_t} frame_id 页面所在的帧
+ */
+void BufferPoolInstance::pin_hit(frame_id_t frame_id) {
+  // 常驻页面一直被常驻pin住，不再计数，也不用通知replacer
+  if (pages_[frame_id].in_memory_) {
+    return;
+  }
+  if (++pages_[frame_id].pin_count_ == 1) {
+    replacer_->pin(frame_id);
+  }
+  replacer_->record_access(frame_id);
+}
+
+/**
+ * @description: 为访问策略的环形缓冲区找一帧：环未满时从共享缓冲池取一帧加入环中；
+ * 环满后复用下一个槽位的帧，该帧被pin住或已被共享缓冲池换成别的页面时，从共享缓冲池另取一帧替换这个槽位
+ * @return {bool} true: 可替换帧查找成功 , false: 可替换帧查找失败
+ * @param {BufferRing*} ring 访问策略在本实例上的环形缓冲区
+ * @param {PageId} page_id 将要装入的页面
+ * @param {frame_id_t*} frame_id 帧页id指针,返回成功找到的可替换帧id
+ */
+bool BufferPoolInstance::find_ring_victim(BufferRing* ring, PageId page_id,
+                                          frame_id_t* frame_id) {
+  if (ring->slots_.size() < ring->capacity_) {
+    if (!find_victim_page(frame_id)) {
+      return false;
+    }
+    ring->slots_.emplace_back(*frame_id, page_id);
+    return true;
+  }
+  auto& [ring_frame, ring_page] = ring->slots_[ring->next_];
+  ring->next_ = (ring->next_ + 1) % ring->slots_.size();
+  auto& page = pages_[ring_frame];
+  if (page.id_ == ring_page &&
+      page_table_.erase_if(ring_page, ring_frame, [&page](frame_id_t) {
+        return page.pin_count_ == 0;
+      })) {
+    // 帧仍在replacer中等待淘汰，先移出，调用者随后pin
+    replacer_->remove(ring_frame);
+    *frame_id = ring_frame;
+  } else if (!find_victim_page(frame_id)) {
+    return false;
+  }
+  ring_frame = *frame_id;
+  ring_page = page_id;
+  return true;
+}
+
 /**
  * @description: 更新页面数据,
  * 如果为脏页则需写入磁盘，再更新为新页面，更新page元数据(data, is_dirty,
- * page_id)和page table
+ * page_id)。旧页面的映射已经在find_victim_page中删除，新页面的映射由调用者在数据读入后插入，
+ * 避免不持有latch_的命中路径看到还没读完的页面
  * @param {Page*} page 写回页指针
  * @param {PageId} new_page_id 新的page_id
  * @param {frame_id_t} new_frame_id 新的帧frame_id
@@ -34,27 +180,55 @@ void BufferPoolInstance::update_page(Page* page, PageId new_page_id,
   // 1 如果是脏页，写回磁盘，并且把dirty置为false
   // 2 更新page table
   // 3 重置page的data，更新page id
+  RMDB_PROBE(buffer__evict, page->id_.fd, page->id_.page_no, page->is_dirty());
   if (page->is_dirty()) {
-    // ++cnt_update;
+    cnt_update.fetch_add(1, std::memory_order_relaxed);
+    // 前台仍然需要同步写脏页，说明时钟指针前方的干净页不够，唤醒后台写页线程
+    page_writer_requested_ = true;
+    page_writer_cv_.notify_one();
 #ifdef ENABLE_LOGGING
-    // 置换出脏页且 lsn 大于 persist 时需要刷日志回磁盘
-    // if (log_manager_ != nullptr && page->get_page_lsn() >
-    // log_manager_->get_persist_lsn()) {
-    //     log_manager_->flush_log_to_disk();
-    // }
+    // WAL：置换出的脏页 lsn 大于 persist 时，先把日志刷到该页面的 lsn
+    if (log_manager_ != nullptr &&
+        page->get_page_lsn() > log_manager_->get_persist_lsn()) {
+      log_manager_->wait_for_flush(page->get_page_lsn());
+    }
 #endif
     disk_manager_->write_page(page->get_page_id().fd,
                               page->get_page_id().page_no, page->get_data(),
                               PAGE_SIZE);
     page->is_dirty_ = false;
+    page->clear_rec_lsn();
   }
 
-  page_table_.erase(page->get_page_id());
-  page_table_[new_page_id] = new_frame_id;
-
   // page->reset_memory();
+  unlink_frame(page->id_, new_frame_id);
   page->id_ = new_page_id;
   page->pin_count_ = 0;
+  page->in_memory_ = false;
+  link_frame(new_page_id, new_frame_id);
+}
+
+/**
+ * @description: 把帧记到页面所在文件的帧集合中，调用者持有latch_
+ */
+void BufferPoolInstance::link_frame(const PageId& page_id,
+                                    frame_id_t frame_id) {
+  file_frames_[page_id.fd].insert(frame_id);
+}
+
+/**
+ * @description: 帧不再存放page_id时把它从文件的帧集合中去掉，调用者持有latch_
+ */
+void BufferPoolInstance::unlink_frame(const PageId& page_id,
+                                      frame_id_t frame_id) {
+  auto it = file_frames_.find(page_id.fd);
+  if (it == file_frames_.end()) {
+    return;
+  }
+  it->second.erase(frame_id);
+  if (it->second.empty()) {
+    file_frames_.erase(it);
+  }
 }
 
 /**
@@ -64,8 +238,9 @@ void BufferPoolInstance::update_page(Page* page, PageId new_page_id,
  * page，将其替换为磁盘中读取的page，pin_count置1。
  * @return {Page*} 若获得了需要的页则将其返回，否则返回nullptr
  * @param {PageId} page_id 需要获取的页的PageId
+ * @param {BufferRing*} ring 访问策略的环形缓冲区，为nullptr时使用共享缓冲池
  */
-Page* BufferPoolInstance::fetch_page(PageId page_id) {
+Page* BufferPoolInstance::fetch_page(PageId page_id, BufferRing* ring) {
   // Todo:
   //  1.     从page_table_中搜寻目标页
   //  1.1 若目标页有被page_table_记录，则将其所在frame固定(pin)，并返回目标页。
@@ -75,51 +250,147 @@ Page* BufferPoolInstance::fetch_page(PageId page_id) {
   //  3.     调用disk_manager_的read_page读取目标页到frame
   //  4.     固定目标页，更新pin_count_
   //  5.     返回目标页
-  //  auto wait_start = std::chrono::high_resolution_clock::now();
-  std::unique_lock lk(latch_);
-  // auto wait_end = std::chrono::high_resolution_clock::now();
-  // wait_time += std::chrono::duration_cast<std::chrono::microseconds>(wait_end
-  // - wait_start).count();
-
-  // auto start = std::chrono::high_resolution_clock::now();  // 开始计时
+  cnt_fetch.fetch_add(1, std::memory_order_relaxed);
+  auto& stats = thread_exec_stats();
+  ++stats.page_fetches;
+  frame_id_t frame_id = INVALID_FRAME_ID;
+  // 命中只需要页表分区的读锁
+  if (page_table_.find(page_id, [this, &frame_id](frame_id_t frame) {
+        pin_hit(frame);
+        frame_id = frame;
+      })) {
+    cnt_hit.fetch_add(1, std::memory_order_relaxed);
+    ++stats.buffer_hits;
+    return &pages_[frame_id];
+  }
 
-  // ++cnt_fetch;
+  RMDB_PROBE(buffer__miss, page_id.fd, page_id.page_no);
+  auto start = std::chrono::steady_clock::now();
+  auto lk = lock_latch();
 
-  frame_id_t frame_id = INVALID_FRAME_ID;
-  auto&& it = page_table_.find(page_id);
-  if (it == page_table_.end()) {
-    // ++cnt_vitcm;
-    if (find_victim_page(&frame_id)) {
+  // 等待latch_期间页面可能已经被其他线程读入
+  if (!page_table_.find(page_id, [this, &frame_id](frame_id_t frame) {
+        pin_hit(frame);
+        frame_id = frame;
+      })) {
+    cnt_vitcm.fetch_add(1, std::memory_order_relaxed);
+    if (ring != nullptr ? find_ring_victim(ring, page_id, &frame_id)
+                        : find_victim_page(&frame_id)) {
       update_page(&pages_[frame_id], page_id, frame_id);
-      // lk.unlock();
-      // auto startt = std::chrono::high_resolution_clock::now();  // 开始计时
+      auto read_start = std::chrono::steady_clock::now();
       disk_manager_->read_page(page_id.fd, page_id.page_no,
                                pages_[frame_id].get_data(), PAGE_SIZE);
-      // auto end = std::chrono::high_resolution_clock::now();  // 结束计时
-      // read_time += std::chrono::duration_cast<std::chrono::microseconds>(end
-      // - startt).count();
+      read_time.fetch_add(elapsed_us(read_start), std::memory_order_relaxed);
+      ++stats.buffer_misses;
       // 不知道是从freelist还是replacer来的，都pin一下，待优化
       replacer_->pin(frame_id);
+      replacer_->record_access(frame_id);
       pages_[frame_id].pin_count_ = 1;
-      // end = std::chrono::high_resolution_clock::now();  // 结束计时
-      // fetch_time += std::chrono::duration_cast<std::chrono::microseconds>(end
-      // - start).count();
+      // 常驻文件的页面：调用者的pin就作为常驻pin留下，之后调用者的unpin不再计数
+      pages_[frame_id].in_memory_ = disk_manager_->is_file_in_memory(page_id.fd);
+      page_table_.insert(page_id, frame_id);
+      fetch_time.fetch_add(elapsed_us(start), std::memory_order_relaxed);
+      RMDB_PROBE(buffer__miss__done, page_id.fd, page_id.page_no);
       return &pages_[frame_id];
     }
     return nullptr;
   }
-  frame_id = it->second;
-  // lk.unlock();
 
-  // 如果已经在页表中，只有第一次使用需要pin
-  if (++pages_[frame_id].pin_count_ == 1) {
+  cnt_hit.fetch_add(1, std::memory_order_relaxed);
+  ++stats.buffer_hits;
+  fetch_time.fetch_add(elapsed_us(start), std::memory_order_relaxed);
+  return &pages_[frame_id];
+}
+
+/**
+ * @description: 一次获取多个页面，所有未命中的页面合并成一批读请求提交并一起等待完成
+ * @param {PageId*} page_ids 需要获取的页面
+ * @param {int} num 页面个数
+ * @param {Page**} pages 输出，第i个页面无法获取（缓冲池已满）时为nullptr
+ */
+void BufferPoolInstance::fetch_pages(const PageId* page_ids, int num,
+                                     Page** pages) {
+  auto lock = lock_latch();
+  cnt_fetch.fetch_add(num, std::memory_order_relaxed);
+  auto& stats = thread_exec_stats();
+  stats.page_fetches += num;
+
+  std::vector<PageIoRequest> requests;
+  std::vector<std::pair<PageId, frame_id_t>> loaded;
+  for (int i = 0; i < num; ++i) {
+    auto& page_id = page_ids[i];
+    if (page_table_.find(page_id, [this, pages, i](frame_id_t frame) {
+          pin_hit(frame);
+          pages[i] = &pages_[frame];
+        })) {
+      cnt_hit.fetch_add(1, std::memory_order_relaxed);
+      ++stats.buffer_hits;
+      continue;
+    }
+    cnt_vitcm.fetch_add(1, std::memory_order_relaxed);
+    frame_id_t frame_id = INVALID_FRAME_ID;
+    if (!find_victim_page(&frame_id)) {
+      pages[i] = nullptr;
+      continue;
+    }
+    update_page(&pages_[frame_id], page_id, frame_id);
     replacer_->pin(frame_id);
+    replacer_->record_access(frame_id);
+    pages_[frame_id].pin_count_ = 1;
+    pages_[frame_id].in_memory_ = disk_manager_->is_file_in_memory(page_id.fd);
+    pages[i] = &pages_[frame_id];
+    loaded.emplace_back(page_id, frame_id);
+    requests.push_back({page_id.fd, page_id.page_no,
+                        pages_[frame_id].get_data(), PAGE_SIZE});
+  }
+  read_pages(requests.data(), requests.size());
+  for (auto& [page_id, frame_id] : loaded) {
+    page_table_.insert(page_id, frame_id);
   }
+}
 
-  // auto end = std::chrono::high_resolution_clock::now();  // 结束计时
-  // fetch_time += std::chrono::duration_cast<std::chrono::microseconds>(end -
-  // start).count();
-  return &pages_[frame_id];
+/**
+ * @description: 预读：把不在缓冲池中的页面批量读入，读入后不pin，随后的fetch_page直接命中。
+ * 没有可用的帧时停止预读，不会影响正常的页面获取
+ * @param {PageId*} page_ids 需要预读的页面
+ * @param {int} num 页面个数
+ * @param {BufferRing*} ring 访问策略的环形缓冲区，为nullptr时使用共享缓冲池
+ */
+void BufferPoolInstance::prefetch_pages(const PageId* page_ids, int num,
+                                        BufferRing* ring) {
+  auto lock = lock_latch();
+
+  std::vector<PageIoRequest> requests;
+  std::vector<std::pair<PageId, frame_id_t>> frames;
+  for (int i = 0; i < num; ++i) {
+    auto& page_id = page_ids[i];
+    if (page_table_.contains(page_id)) {
+      continue;
+    }
+    frame_id_t frame_id = INVALID_FRAME_ID;
+    if (ring != nullptr ? !find_ring_victim(ring, page_id, &frame_id)
+                        : !find_victim_page(&frame_id)) {
+      break;
+    }
+    update_page(&pages_[frame_id], page_id, frame_id);
+    // 读盘期间一直持有latch_，读完再放开
+    replacer_->pin(frame_id);
+    frames.emplace_back(page_id, frame_id);
+    requests.push_back({page_id.fd, page_id.page_no,
+                        pages_[frame_id].get_data(), PAGE_SIZE});
+  }
+  read_pages(requests.data(), requests.size());
+  for (auto& [page_id, frame_id] : frames) {
+    // 常驻文件的页面读入后就留下常驻pin
+    if (disk_manager_->is_file_in_memory(page_id.fd)) {
+      pages_[frame_id].pin_count_ = 1;
+      pages_[frame_id].in_memory_ = true;
+    }
+    page_table_.insert(page_id, frame_id);
+    if (!pages_[frame_id].in_memory_) {
+      replacer_->unpin(frame_id);
+    }
+  }
 }
 
 /**
@@ -139,21 +410,48 @@ bool BufferPoolInstance::unpin_page(PageId page_id, bool is_dirty) {
   // 2.2.1 若自减后等于0，则调用replacer_的Unpin
   // 3 根据参数is_dirty，更改P的is_dirty_
   // 缓冲池够用 没必要 unpin，决赛不行了
-  // std::lock_guard lock(latch_);
-  // ++cnt_unpin;
+  // 按PageId要查页表，持有Page*的调用者用unpin_page(Page*, bool)。
+  // 在页表分区读锁内放掉pin，页面没有被pin住时（调用者用错了）也不会放掉换进同一帧的其他页面的pin
+  bool unpinned = false;
+  if (!page_table_.find(page_id, [this, is_dirty, &unpinned](frame_id_t frame) {
+        unpinned = unpin_page(&pages_[frame], is_dirty);
+      })) {
+    cnt_unpin.fetch_add(1, std::memory_order_relaxed);
+  }
+  return unpinned;
+}
 
-  auto&& it = page_table_.find(page_id);
-  // 不在页表中
-  if (it == page_table_.end()) {
-    return false;
+/**
+ * @description: 放掉调用者持有的页面的pin。页面被pin住时不会被换出，帧就是页面所在的帧，
+ * 不需要查页表也不需要任何锁，只有pin计数的原子操作，pin归零时再通知replacer
+ * @return {bool} pin计数已经为0时返回false
+ * @param {Page*} page 调用者pin住的页面
+ * @param {bool} is_dirty 若目标page应该被标记为dirty则为true，否则为false
+ */
+bool BufferPoolInstance::unpin_page(Page* page, bool is_dirty) {
+  // 常驻页面的pin计数保持为常驻pin，只记下脏标记
+  if (page->in_memory_) {
+    if (is_dirty) {
+      page->is_dirty_ = true;
+    }
+    return true;
   }
-  if (pages_[it->second].pin_count_ == 0) {
-    return false;
+  cnt_unpin.fetch_add(1, std::memory_order_relaxed);
+  // 脏标记要在放掉pin之前设置，淘汰者看到pin为0时一定也能看到脏标记
+  if (is_dirty) {
+    page->is_dirty_ = true;
   }
-  if (--pages_[it->second].pin_count_ == 0) {
-    replacer_->unpin(it->second);
+  int pin_count = page->pin_count_.load();
+  do {
+    if (pin_count == 0) {
+      return false;
+    }
+  } while (!page->pin_count_.compare_exchange_weak(pin_count, pin_count - 1));
+  if (pin_count == 1) {
+    // 不持有页表分区锁，这里的replacer_->unpin可能晚于页面被删除、帧回到free_list_，
+    // find_victim_page只接受还映射着页面的帧，多出来的候选会被丢掉
+    replacer_->unpin(page->frame_id_);
   }
-  pages_[it->second].is_dirty_ |= is_dirty;
   return true;
 }
 
@@ -171,22 +469,25 @@ bool BufferPoolInstance::flush_page(PageId page_id) {
   // 3. 更新P的is_dirty_
   std::lock_guard lock(latch_);
 
-  auto&& it = page_table_.find(page_id);
+  frame_id_t frame_id = INVALID_FRAME_ID;
   // 不在页表中
-  if (it == page_table_.end()) {
+  if (!page_table_.find(page_id, &frame_id)) {
     return false;
   }
 
-  auto& page = pages_[it->second];
+  auto& page = pages_[frame_id];
+  std::lock_guard io_lock(io_latch_);
+  // 先清脏标记再写盘，写盘期间命中路径的修改会在unpin时重新置脏
+  page.is_dirty_ = false;
+  page.clear_rec_lsn();
 #ifdef ENABLE_LOGGING
   if (log_manager_ != nullptr &&
       page.get_page_lsn() > log_manager_->get_persist_lsn()) {
-    log_manager_->flush_log_to_disk();
+    log_manager_->wait_for_flush(page.get_page_lsn());
   }
 #endif
   disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
                             PAGE_SIZE);
-  page.is_dirty_ = false;
   return true;
 }
 
@@ -195,23 +496,28 @@ bool BufferPoolInstance::flush_page(PageId page_id) {
  * 创建一个新的page，即从磁盘中移动一个新建的空page到缓冲池某个位置。
  * @return {Page*} 返回新创建的page，若创建失败则返回nullptr
  * @param {PageId*} page_id 当成功创建一个新的page时存储其page_id
+ * @param {BufferRing*} ring 访问策略的环形缓冲区，为nullptr时使用共享缓冲池
  */
-Page* BufferPoolInstance::new_page(PageId* page_id) {
+Page* BufferPoolInstance::new_page(PageId* page_id, BufferRing* ring) {
   // 1.   获得一个可用的frame，若无法获得则返回nullptr
   // 2.   在fd对应的文件分配一个新的page_id
   // 3.   将frame的数据写回磁盘
   // 4.   固定frame，更新pin_count_
   // 5.   返回获得的page
-  std::lock_guard lock(latch_);
+  auto lock = lock_latch();
 
   frame_id_t frame_id = -1;
-  if (find_victim_page(&frame_id)) {
+  if (ring != nullptr ? find_ring_victim(ring, *page_id, &frame_id)
+                      : find_victim_page(&frame_id)) {
     // page_id->page_no = disk_manager_->allocate_page(page_id->fd);
     update_page(&pages_[frame_id], *page_id, frame_id);
     pages_[frame_id].reset_memory();
     // 不知道是从freelist还是replacer来的，都pin一下，待优化
     replacer_->pin(frame_id);
+    replacer_->record_access(frame_id);
     pages_[frame_id].pin_count_ = 1;
+    pages_[frame_id].in_memory_ = disk_manager_->is_file_in_memory(page_id->fd);
+    page_table_.insert(*page_id, frame_id);
     return &pages_[frame_id];
   }
   return nullptr;
@@ -230,13 +536,17 @@ bool BufferPoolInstance::delete_page(PageId page_id) {
   // 将目标页数据写回磁盘，从页表中删除目标页，重置其元数据，将其加入free_list_，返回true
   std::lock_guard lock(latch_);
 
-  auto&& it = page_table_.find(page_id);
-  if (it == page_table_.end()) {
+  frame_id_t frame_id = INVALID_FRAME_ID;
+  if (!page_table_.find(page_id, &frame_id)) {
     return true;
   }
 
-  auto& page = pages_[it->second];
-  if (page.pin_count_ > 0) {
+  auto& page = pages_[frame_id];
+  // 在页表分区写锁内检查pin计数并删除映射，之后命中路径就找不到这个页面了。
+  // 常驻页面只剩常驻pin时可以删除，调用者保证没有其他线程在使用它
+  if (!page_table_.erase_if(page_id, frame_id, [&page](frame_id_t) {
+        return page.pin_count_ == (page.in_memory_ ? 1 : 0);
+      })) {
     return false;
   }
 
@@ -244,86 +554,397 @@ bool BufferPoolInstance::delete_page(PageId page_id) {
 #ifdef ENABLE_LOGGING
     if (log_manager_ != nullptr &&
         page.get_page_lsn() > log_manager_->get_persist_lsn()) {
-      log_manager_->flush_log_to_disk();
+      log_manager_->wait_for_flush(page.get_page_lsn());
     }
 #endif
     disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
                               PAGE_SIZE);
     page.is_dirty_ = false;
+    page.clear_rec_lsn();
   }
 
   // 记得把页框还回去
-  free_list_.push_back(it->second);
-  page_table_.erase(page.id_);
+  unlink_frame(page_id, frame_id);
+  replacer_->remove(frame_id);
+  free_list_.push_back(frame_id);
 
   page.reset_memory();
   return true;
 }
 
 /**
- * @description: 将buffer_pool中的所有页写回到磁盘
+ * @description: 收集文件在这个实例中要写回的页面：脏页，检查点时还有lsn要清零的页面。
+ * 先清脏标记，再把页面的帧追加到requests，由调用者和其他实例中的页面一起按页号合并写回。
+ * latch_和io_latch_放到locks中，调用者写完后才放开，期间页面不会被换出，后台写页线程也不会写旧副本
  * @param {int} fd 文件句柄
+ * @param {bool} for_checkpoint 为创建检查点调用：日志随后被清空，页面的lsn恢复初始状态
+ * @return {lsn_t} 收集到的页面中最大的lsn
  */
-void BufferPoolInstance::flush_all_pages(int fd) {
-  std::lock_guard lock(latch_);
+lsn_t BufferPoolInstance::collect_file_pages(
+    int fd, bool for_checkpoint, std::vector<PageIoRequest>& requests,
+    std::vector<std::unique_lock<std::mutex>>& locks) {
+  locks.emplace_back(latch_);
+  locks.emplace_back(io_latch_);
 
-  for (auto& [pageId, frameId] : page_table_) {
-    if (pageId.fd == fd && frameId != INVALID_FRAME_ID) {
-      auto& page = pages_[frameId];
+  lsn_t max_lsn = INVALID_LSN;
+  auto it = file_frames_.find(fd);
+  if (it == file_frames_.end()) {
+    return max_lsn;
+  }
+  for (frame_id_t frameId : it->second) {
+    auto& page = pages_[frameId];
+    if (for_checkpoint && page.get_page_lsn() != INVALID_LSN) {
+      // 日志清空了，lsn 设置为初始状态
+      page.set_page_lsn(INVALID_LSN);
+    } else if (!page.is_dirty_) {
+      continue;
+    }
+    page.is_dirty_ = false;
+    page.clear_rec_lsn();
+    max_lsn = std::max(max_lsn, page.get_page_lsn());
+    requests.push_back({fd, page.id_.page_no, page.data_, PAGE_SIZE});
+  }
 #ifdef ENABLE_LOGGING
-      if (log_manager_ != nullptr &&
-          page.get_page_lsn() > log_manager_->get_persist_lsn()) {
-        log_manager_->flush_log_to_disk();
-      }
+  // WAL：页面写回前日志要刷到它们的lsn
+  if (log_manager_ != nullptr && max_lsn > log_manager_->get_persist_lsn()) {
+    log_manager_->wait_for_flush(max_lsn);
+  }
 #endif
-      disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
-                                PAGE_SIZE);
-      page.is_dirty_ = false;
+  return max_lsn;
+}
+
+/**
+ * @description: 丢弃buffer_pool中文件的所有页面，不写回磁盘。只访问这个文件的帧集合，不扫描整个页表
+ * @param {int} fd 文件句柄
+ */
+void BufferPoolInstance::delete_all_pages(int fd) {
+  std::lock_guard lock(latch_);
+  // 等待后台写页线程写完，之后文件可能被关闭
+  std::lock_guard io_lock(io_latch_);
+
+  auto it = file_frames_.find(fd);
+  if (it == file_frames_.end()) {
+    return;
+  }
+  std::unordered_set<frame_id_t> frames = std::move(it->second);
+  file_frames_.erase(it);
+  for (frame_id_t frameId : frames) {
+    page_table_.erase(pages_[frameId].id_, frameId);
+    // 清页面
+    auto& page = pages_[frameId];
+    page.reset_memory();
+    page.is_dirty_ = false;
+    page.clear_rec_lsn();
+    page.pin_count_ = 0;
+    page.in_memory_ = false;
+    page.id_.page_no = INVALID_PAGE_ID;
+    // 记得把页框还回去
+    replacer_->remove(frameId);
+    free_list_.push_back(frameId);
+  }
+}
+
+/**
+ * @description: 收集缓冲池中所有脏页及其recLSN，供模糊检查点写入脏页表
+ * @param {vector<pair<PageId, lsn_t>>&} dirty_pages 输出的脏页及其recLSN
+ */
+void BufferPoolInstance::get_dirty_pages(
+    std::vector<std::pair<PageId, lsn_t>>& dirty_pages) {
+  std::lock_guard lock(latch_);
+
+  page_table_.for_each(
+      [this, &dirty_pages](const PageId& pageId, frame_id_t frameId) {
+        lsn_t rec_lsn = pages_[frameId].get_rec_lsn();
+        if (rec_lsn != INVALID_LSN) {
+          dirty_pages.emplace_back(pageId, rec_lsn);
+        }
+      });
+}
+
+/**
+ * @description: 收集缓冲池中所有页面的PageId，供关闭数据库和检查点时保存，重启后预热
+ * @param {vector<PageId>&} page_ids 输出的页面
+ */
+/**
+ * @description: 获取统计计数器的快照，脏页数和空闲帧数在latch_内统计
+ * @return {BufferPoolStatus} 本实例的统计
+ */
+BufferPoolStatus BufferPoolInstance::get_status() {
+  BufferPoolStatus status;
+  {
+    std::lock_guard lock(latch_);
+    status.pool_size = pool_size_;
+    status.free_frames = free_list_.size();
+    for (size_t i = 0; i < pool_size_; ++i) {
+      status.dirty_pages += pages_[i].is_dirty();
     }
   }
+  status.fetches = cnt_fetch.load(std::memory_order_relaxed);
+  status.hits = cnt_hit.load(std::memory_order_relaxed);
+  status.write_backs = cnt_update.load(std::memory_order_relaxed);
+  status.unpins = cnt_unpin.load(std::memory_order_relaxed);
+  status.read_us = read_time.load(std::memory_order_relaxed);
+  status.fetch_us = fetch_time.load(std::memory_order_relaxed);
+  status.wait_us = wait_time.load(std::memory_order_relaxed);
+  for (int i = 0; i < LATCH_WAIT_BUCKETS; ++i) {
+    status.latch_waits[i] = latch_wait_hist_[i].load(std::memory_order_relaxed);
+  }
+  return status;
 }
 
-/** 为创建检查点调用
- * @description: 将buffer_pool中的所有页写回到磁盘
- * @param {int} fd 文件句柄
+void BufferPoolInstance::get_resident_pages(std::vector<PageId>& page_ids) {
+  std::lock_guard lock(latch_);
+
+  page_table_.for_each([&page_ids](const PageId& pageId, frame_id_t) {
+    page_ids.push_back(pageId);
+  });
+}
+
+/**
+ * @description: 模糊检查点的后台刷脏：把recLSN小于lsn的脏页写回磁盘，
+ * 被pin住的页面可能正在被修改，直接跳过留给下一次检查点
+ * @param {lsn_t} lsn 检查点开始时的lsn
  */
-void BufferPoolInstance::flush_all_pages_for_checkpoint(int fd) {
+void BufferPoolInstance::flush_dirty_pages_before(lsn_t lsn) {
   std::lock_guard lock(latch_);
 
-  for (auto& [pageId, frameId] : page_table_) {
-    if (pageId.fd == fd) {
-      auto& page = pages_[frameId];
-      // 日志清空了，lsn 设置为初始状态
-      page.set_page_lsn(INVALID_LSN);
-      disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
-                                PAGE_SIZE);
-      page.is_dirty_ = false;
+  page_table_.for_each([this, lsn](const PageId&, frame_id_t frameId) {
+    auto& page = pages_[frameId];
+    lsn_t rec_lsn = page.get_rec_lsn();
+    if (!page.is_dirty_ || page.pin_count_ > 0 || rec_lsn == INVALID_LSN ||
+        rec_lsn >= lsn) {
+      return;
     }
+    // 命中路径可能在检查之后pin住页面并修改，先清脏标记，修改会在unpin时重新置脏
+    page.is_dirty_ = false;
+    page.clear_rec_lsn();
+#ifdef ENABLE_LOGGING
+    if (log_manager_ != nullptr &&
+        page.get_page_lsn() > log_manager_->get_persist_lsn()) {
+      log_manager_->wait_for_flush(page.get_page_lsn());
+    }
+#endif
+    disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
+                              PAGE_SIZE);
+  });
+}
+
+/**
+ * @description: 启动后台写页线程
+ */
+void BufferPoolInstance::start_page_writer() {
+  if (page_writer_running_.exchange(true)) {
+    return;
   }
+  page_writer_ = std::thread(&BufferPoolInstance::page_writer_func, this);
 }
 
 /**
- * @description: 将buffer_pool中的所有页写回到磁盘
- * @param {int} fd 文件句柄
+ * @description: 停止后台写页线程
  */
-void BufferPoolInstance::delete_all_pages(int fd) {
+void BufferPoolInstance::stop_page_writer() {
+  {
+    std::lock_guard lock(latch_);
+    if (!page_writer_running_) {
+      return;
+    }
+    page_writer_running_ = false;
+    page_writer_cv_.notify_one();
+  }
+  if (page_writer_.joinable()) {
+    page_writer_.join();
+  }
+}
+
+/**
+ * @description: 后台写页线程主循环，定期或被前台唤醒后写回时钟指针前方的脏页
+ */
+void BufferPoolInstance::page_writer_func() {
+  // 写页线程只访问本实例的帧，放在帧内存所在的节点上
+  if (numa_node_ >= 0) {
+    bind_thread_to_numa_node(numa_node_);
+  }
+  while (page_writer_running_) {
+    {
+      std::unique_lock lock(latch_);
+      page_writer_cv_.wait_for(lock, PAGE_WRITER_INTERVAL, [this] {
+        return page_writer_requested_ || !page_writer_running_;
+      });
+      page_writer_requested_ = false;
+    }
+    write_dirty_victims();
+  }
+}
+
+/**
+ * @description: 从时钟指针之后开始扫描即将被淘汰的帧，直到凑够PAGE_WRITER_CLEAN_TARGET个干净帧，
+ * 遇到未pin的脏页就在latch_内拷贝一份并清除脏标记，在latch_外写盘。
+ * 写盘期间这些页面保持pin住，不会被淘汰后又从磁盘读到旧数据；期间的新修改会重新置脏，由下一轮写回
+ */
+void BufferPoolInstance::write_dirty_victims() {
+  std::vector<std::pair<frame_id_t, PageId>> frames;
+  lsn_t max_lsn = INVALID_LSN;
+  std::unique_lock lock(latch_);
+  size_t clean = free_list_.size();
+  int start = replacer_->get_pointer();
+  for (size_t step = 1; step <= pool_size_ &&
+                        clean < static_cast<size_t>(PAGE_WRITER_CLEAN_TARGET) &&
+                        frames.size() < static_cast<size_t>(PAGE_WRITER_BATCH_SIZE);
+       ++step) {
+    auto frame_id = static_cast<frame_id_t>((start + step) % pool_size_);
+    auto& page = pages_[frame_id];
+    frame_id_t mapped = INVALID_FRAME_ID;
+    if (page.pin_count_ > 0 || !page_table_.find(page.id_, &mapped) ||
+        mapped != frame_id) {
+      continue;
+    }
+    ++clean;
+    if (!page.is_dirty_) {
+      continue;
+    }
+    // 命中路径不持有latch_，此时可能有人pin住页面并修改：先pin住、清脏标记，再拷贝；
+    // 拷贝之后的修改会在unpin时重新置脏，lsn以拷贝中的为准
+    ++page.pin_count_;
+    replacer_->pin(frame_id);
+    page.is_dirty_ = false;
+    page.clear_rec_lsn();
+    char* copy = page_writer_buffer_ + frames.size() * PAGE_SIZE;
+    memcpy(copy, page.data_, PAGE_SIZE);
+    lsn_t page_lsn;
+    memcpy(&page_lsn, copy + Page::OFFSET_LSN, sizeof(lsn_t));
+    max_lsn = std::max(max_lsn, page_lsn);
+    frames.emplace_back(frame_id, page.id_);
+  }
+  if (frames.empty()) {
+    return;
+  }
+
+  // 先拿io_latch_再放latch_，其他写盘路径在此之后只能等本轮写完
+  std::unique_lock io_lock(io_latch_);
+  lock.unlock();
+#ifdef ENABLE_LOGGING
+  if (log_manager_ != nullptr && max_lsn > log_manager_->get_persist_lsn()) {
+    log_manager_->wait_for_flush(max_lsn);
+  }
+#endif
+  std::vector<PageIoRequest> requests;
+  requests.reserve(frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    auto& page_id = frames[i].second;
+    requests.push_back({page_id.fd, page_id.page_no,
+                        page_writer_buffer_ + i * PAGE_SIZE, PAGE_SIZE});
+  }
+  disk_manager_->write_pages(requests.data(), requests.size());
+  io_lock.unlock();
+
+  lock.lock();
+  for (auto& [frame_id, page_id] : frames) {
+    frame_id_t mapped = INVALID_FRAME_ID;
+    // 写盘期间页面可能随表一起被清出缓冲池
+    if (!page_table_.find(page_id, &mapped) || mapped != frame_id ||
+        pages_[frame_id].pin_count_ == 0) {
+      continue;
+    }
+    if (--pages_[frame_id].pin_count_ == 0) {
+      replacer_->unpin(frame_id);
+    }
+  }
+}
+
+/**
+ * @description: 在线调整缓冲池实例的帧数。扩容把新的帧加入free_list_；
+ * 缩容从最高的帧开始释放，脏页先写回磁盘，遇到被pin住的页面时停止，释放的帧的物理内存还给操作系统
+ * @return {size_t} 调整后实际的帧数，缩容遇到被pin住的页面时大于pool_size
+ * @param {size_t} pool_size 目标帧数，不能为0，也不能超过max_pool_size_
+ */
+size_t BufferPoolInstance::resize(size_t pool_size) {
+  if (pool_size == 0 || pool_size > max_pool_size_) {
+    throw InternalError("BufferPoolInstance::resize: pool size out of range");
+  }
   std::lock_guard lock(latch_);
+  if (pool_size > pool_size_) {
+    add_frames(pool_size);
+  } else if (pool_size < pool_size_) {
+    // 缩容期间可能写回脏页，与后台写页线程互斥
+    std::lock_guard io_lock(io_latch_);
+    remove_frames(pool_size);
+  }
+  return pool_size_;
+}
 
-  for (auto it = page_table_.begin(); it != page_table_.end();) {
-    if (it->first.fd == fd && it->second != INVALID_FRAME_ID) {
-      // 清页面
-      auto& page = pages_[it->second];
-      page.reset_memory();
-      page.is_dirty_ = false;
-      page.pin_count_ = 0;
+/**
+ * @description: 把[pool_size_, pool_size)范围内的帧加入缓冲池，第一次使用的帧先构造Page对象。
+ * 调用者持有latch_或者在构造函数中
+ * @param {size_t} pool_size 扩容后的帧数
+ */
+void BufferPoolInstance::add_frames(size_t pool_size) {
+  for (; num_constructed_ < pool_size; ++num_constructed_) {
+    new (&pages_[num_constructed_]) Page();
+    pages_[num_constructed_].data_ = page_data_ + num_constructed_ * PAGE_SIZE;
+    pages_[num_constructed_].pool_ = this;
+    pages_[num_constructed_].frame_id_ = static_cast<frame_id_t>(num_constructed_);
+  }
+  for (size_t i = pool_size_; i < pool_size; ++i) {
+    auto frame_id = static_cast<frame_id_t>(i);
+    pages_[i].reset_memory();
+    replacer_->remove(frame_id);
+    free_list_.push_back(frame_id);
+  }
+  MemoryAccounting::instance().alloc(MemTag::BUFFER_POOL,
+                                     (pool_size - pool_size_) * FRAME_BYTES,
+                                     static_cast<int64_t>(pool_size - pool_size_));
+  pool_size_ = pool_size;
+}
+
+/**
+ * @description: 从最高的帧开始释放到只剩pool_size个帧，遇到被pin住的页面时停止。
+ * 调用者持有latch_和io_latch_
+ * @param {size_t} pool_size 缩容后的帧数
+ */
+void BufferPoolInstance::remove_frames(size_t pool_size) {
+  size_t new_size = pool_size_;
+  while (new_size > pool_size) {
+    auto frame_id = static_cast<frame_id_t>(new_size - 1);
+    auto& page = pages_[frame_id];
+    frame_id_t mapped = INVALID_FRAME_ID;
+    if (page_table_.find(page.id_, &mapped) && mapped == frame_id) {
+      // 和淘汰一样在页表分区写锁内确认没有被pin住，之后命中路径就找不到这个页面了
+      if (!page_table_.erase_if(page.id_, frame_id, [&page](frame_id_t) {
+            return page.pin_count_ == 0;
+          })) {
+        break;
+      }
+      if (page.is_dirty_) {
+        page.is_dirty_ = false;
+        page.clear_rec_lsn();
+#ifdef ENABLE_LOGGING
+        if (log_manager_ != nullptr &&
+            page.get_page_lsn() > log_manager_->get_persist_lsn()) {
+          log_manager_->wait_for_flush(page.get_page_lsn());
+        }
+#endif
+        disk_manager_->write_page(page.id_.fd, page.id_.page_no, page.data_,
+                                  PAGE_SIZE);
+      }
+      unlink_frame(page.id_, frame_id);
       page.id_.page_no = INVALID_PAGE_ID;
-      // 记得把页框还回去
-      free_list_.push_back(it->second);
-      it = page_table_.erase(it);
-    } else {
-      ++it;
     }
+    replacer_->remove(frame_id);
+    replacer_->pin(frame_id);
+    --new_size;
+  }
+  if (new_size == pool_size_) {
+    return;
   }
+  free_list_.remove_if([new_size](frame_id_t frame_id) {
+    return static_cast<size_t>(frame_id) >= new_size;
+  });
+  data_arena_.release(new_size * PAGE_SIZE,
+                      (pool_size_ - new_size) * PAGE_SIZE);
+  MemoryAccounting::instance().free(MemTag::BUFFER_POOL,
+                                    (pool_size_ - new_size) * FRAME_BYTES,
+                                    static_cast<int64_t>(pool_size_ - new_size));
+  pool_size_ = new_size;
 }
 
 // auto BufferPoolInstance::FetchPageBasic(PageId page_id) -> BasicPageGuard {
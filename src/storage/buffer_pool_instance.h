@@ -4,57 +4,101 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdlib>
 #include <list>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "buffer_access_strategy.h"
 #include "disk_manager.h"
+#include "memory_arena.h"
 #include "page.h"
+#include "page_table.h"
 #include "replacer/lru_replacer.h"
 #include "replacer/replacer.h"
 
 class LogManager;
 
+// 等待latch_时间的直方图分桶上界（微秒）：没有等待、<10us、<100us、<1ms、<10ms、>=10ms
+static constexpr int LATCH_WAIT_BUCKETS = 6;
+static constexpr uint64_t LATCH_WAIT_BOUNDS_US[LATCH_WAIT_BUCKETS - 2] = {
+    10, 100, 1000, 10000};
+
+/* 一个缓冲池实例的运行统计，由SHOW BUFFER STATUS输出 */
+struct BufferPoolStatus {
+  size_t pool_size = 0;    // 帧数
+  size_t free_frames = 0;  // 空闲帧数
+  size_t dirty_pages = 0;  // 脏页数
+  uint64_t fetches = 0;     // fetch_page/fetch_pages请求的页面数
+  uint64_t hits = 0;        // 其中命中缓冲池的页面数
+  uint64_t write_backs = 0;  // 前台淘汰时同步写回的脏页数
+  uint64_t unpins = 0;
+  uint64_t read_us = 0;   // 读盘时间
+  uint64_t fetch_us = 0;  // 未命中时fetch_page的总时间
+  uint64_t wait_us = 0;   // 等待latch_的时间
+  uint64_t latch_waits[LATCH_WAIT_BUCKETS] = {};  // 等待latch_时间的直方图
+
+  double hit_ratio() const {
+    return fetches == 0 ? 0 : static_cast<double>(hits) / fetches;
+  }
+};
+
 class BufferPoolInstance {
  public:
-  size_t pool_size_;  // buffer_pool中可容纳页面的个数，即帧的个数
+  // 一个帧占用的内存，按帧数记入MemTag::BUFFER_POOL
+  static constexpr size_t FRAME_BYTES = PAGE_SIZE + sizeof(Page);
+
+  size_t pool_size_;  // buffer_pool中可容纳页面的个数，即帧的个数，resize时在latch_内修改
+  size_t max_pool_size_;  // 预留的最大帧数，pool_size_只能在[1, max_pool_size_]内调整
+  size_t num_constructed_ = 0;  // pages_中已经构造过的Page对象个数
+  int numa_node_;  // 帧内存所在的NUMA节点，-1表示不绑定
+  MemoryArena page_arena_;  // Page对象数组的内存
+  MemoryArena data_arena_;  // 所有页面数据的内存，一整块连续的大页
   Page*
-      pages_;  // buffer_pool中的Page对象数组，在构造空间中申请内存空间，在析构函数中释放，大小为BUFFER_POOL_SIZE
-  std::unordered_map<PageId, frame_id_t>
-      page_table_;  // 帧号和页面号的映射哈希表，用于根据页面的PageId定位该页面的帧编号
+      pages_;  // buffer_pool中的Page对象数组，按max_pool_size_预留地址空间，扩容时才构造，在析构函数中释放
+  char* page_data_;  // 所有页面的数据，按PAGE_SIZE对齐，同样按max_pool_size_预留
+  PageTable page_table_;  // 帧号和页面号的映射哈希表，用于根据页面的PageId定位该页面的帧编号，命中时不需要latch_
   std::list<frame_id_t> free_list_;  // 空闲帧编号的链表
+  std::unordered_map<int, std::unordered_set<frame_id_t>>
+      file_frames_;  // 每个文件的页面所在的帧，在latch_内维护，刷盘和删除一个文件的页面时不用扫描整个页表
   DiskManager* disk_manager_;
-  ClockReplacer* replacer_;  // buffer_pool的置换策略，当前赛题中为LRU置换策略
+  Replacer* replacer_;  // buffer_pool的置换策略，由REPLACER_TYPE或启动参数选择
   LogManager* log_manager_;
   std::mutex latch_;  // 用于共享数据结构的并发控制
-  int cnt_fetch = 0;
-  int cnt_vitcm = 0;
-  int cnt_update = 0;
-  int cnt_unpin = 0;
-  int read_time = 0;
-  int fetch_time = 0;
-  int wait_time = 0;
+  std::mutex io_latch_;  // 后台写页线程写盘期间持有，其他写盘路径在latch_之后获取，保证同一页面不会被旧副本覆盖
+  std::thread page_writer_;                      // 后台写页线程
+  std::atomic<bool> page_writer_running_{false};
+  bool page_writer_requested_ = false;           // 前台淘汰了脏页，唤醒后台写页线程
+  std::condition_variable page_writer_cv_;
+  char* page_writer_buffer_;                     // 后台写页线程的页面副本
+  // 统计计数器，只用relaxed原子操作累加；时间单位为微秒，64位不会溢出
+  std::atomic<uint64_t> cnt_fetch{0};
+  std::atomic<uint64_t> cnt_hit{0};
+  std::atomic<uint64_t> cnt_vitcm{0};
+  std::atomic<uint64_t> cnt_update{0};
+  std::atomic<uint64_t> cnt_unpin{0};
+  std::atomic<uint64_t> read_time{0};
+  std::atomic<uint64_t> fetch_time{0};
+  std::atomic<uint64_t> wait_time{0};
+  std::atomic<uint64_t> latch_wait_hist_[LATCH_WAIT_BUCKETS]{};
 
  public:
+  /**
+   * @param {size_t} pool_size 初始的帧数
+   * @param {size_t} max_pool_size 在线扩容的上限，小于pool_size时取pool_size
+   * @param {int} numa_node 帧内存和后台写页线程所在的NUMA节点，-1表示不绑定
+   */
   BufferPoolInstance(size_t pool_size, DiskManager* disk_manager,
-                     LogManager* log_manager = nullptr)
-      : pool_size_(pool_size),
-        disk_manager_(disk_manager),
-        log_manager_(log_manager) {
-    // 为buffer pool分配一块连续的内存空间
-    pages_ = new Page[pool_size_];
-    replacer_ = new ClockReplacer();
-    // 初始化时，所有的page都在free_list_中
-    for (size_t i = 0; i < pool_size_; ++i) {
-      free_list_.emplace_back(
-          static_cast<frame_id_t>(i));  // static_cast转换数据类型
-    }
-    page_table_.reserve(20000);
-  }
+                     LogManager* log_manager = nullptr,
+                     const std::string& replacer_type = REPLACER_TYPE,
+                     size_t max_pool_size = 0, int numa_node = -1);
 
-  ~BufferPoolInstance() {
-    delete[] pages_;
-    delete replacer_;
-  }
+  ~BufferPoolInstance();
 
   /**
    * @description: 将目标页面标记为脏页
@@ -62,23 +106,51 @@ class BufferPoolInstance {
    */
   static void mark_dirty(Page* page) { page->is_dirty_ = true; }
 
+  /**
+   * @description: 把调用者pin住的页面改为常驻：调用者的这个pin留下作为常驻pin，之后的unpin（包括调用者的）不再计数。
+   * 和pin_hit、unpin_page并发时可能多留下几个pin，常驻页面本来就不会被换出
+   * @param {Page*} page 调用者pin住的页面
+   */
+  static void pin_in_memory(Page* page) { page->in_memory_ = true; }
+
  public:
-  Page* fetch_page(PageId page_id);
+  Page* fetch_page(PageId page_id, BufferRing* ring = nullptr);
+
+  void fetch_pages(const PageId* page_ids, int num, Page** pages);
+
+  void prefetch_pages(const PageId* page_ids, int num,
+                      BufferRing* ring = nullptr);
 
   bool unpin_page(PageId page_id, bool is_dirty);
 
+  bool unpin_page(Page* page, bool is_dirty);
+
   bool flush_page(PageId page_id);
 
-  Page* new_page(PageId* page_id);
+  Page* new_page(PageId* page_id, BufferRing* ring = nullptr);
 
   bool delete_page(PageId page_id);
 
-  void flush_all_pages(int fd);
-
-  void flush_all_pages_for_checkpoint(int fd);
+  lsn_t collect_file_pages(int fd, bool for_checkpoint,
+                           std::vector<PageIoRequest>& requests,
+                           std::vector<std::unique_lock<std::mutex>>& locks);
 
   void delete_all_pages(int fd);
 
+  void get_dirty_pages(std::vector<std::pair<PageId, lsn_t>>& dirty_pages);
+
+  void get_resident_pages(std::vector<PageId>& page_ids);
+
+  void flush_dirty_pages_before(lsn_t lsn);
+
+  void start_page_writer();
+
+  void stop_page_writer();
+
+  size_t resize(size_t pool_size);
+
+  BufferPoolStatus get_status();
+
   // auto FetchPageBasic(PageId page_id) -> BasicPageGuard;
   //
   // auto FetchPageRead(PageId page_id) -> ReadPageGuard;
@@ -88,7 +160,27 @@ class BufferPoolInstance {
   // auto NewPageGuarded(PageId *page_id) -> BasicPageGuard;
 
  private:
+  std::unique_lock<std::mutex> lock_latch();
+
+  void read_pages(PageIoRequest* requests, int num);
+
   bool find_victim_page(frame_id_t* frame_id);
 
+  void pin_hit(frame_id_t frame_id);
+
+  bool find_ring_victim(BufferRing* ring, PageId page_id, frame_id_t* frame_id);
+
   void update_page(Page* page, PageId new_page_id, frame_id_t new_frame_id);
+
+  void link_frame(const PageId& page_id, frame_id_t frame_id);
+
+  void unlink_frame(const PageId& page_id, frame_id_t frame_id);
+
+  void add_frames(size_t pool_size);
+
+  void remove_frames(size_t pool_size);
+
+  void page_writer_func();
+
+  void write_dirty_victims();
 };
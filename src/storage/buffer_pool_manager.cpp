@@ -7,9 +7,73 @@
  * page，将其替换为磁盘中读取的page，pin_count置1。
  * @return {Page*} 若获得了需要的页则将其返回，否则返回nullptr
  * @param {PageId} page_id 需要获取的页的PageId
+ * @param {BufferAccessStrategy*} strategy 访问策略，为nullptr时使用共享缓冲池
  */
-Page* BufferPoolManager::fetch_page(PageId page_id) {
-  return instances_[get_instance_no(page_id)]->fetch_page(page_id);
+Page* BufferPoolManager::fetch_page(PageId page_id,
+                                    BufferAccessStrategy* strategy) {
+  auto instance_no = get_instance_no(page_id);
+  return instances_[instance_no]->fetch_page(page_id,
+                                             get_ring(strategy, instance_no));
+}
+
+/**
+ * @description: 批量获取页面，按缓冲池实例分组，每个实例的未命中页面一起提交读请求
+ * @param {vector<PageId>&} page_ids 需要获取的页面
+ * @param {vector<Page*>&} pages 输出，与page_ids一一对应，无法获取的页面为nullptr
+ */
+void BufferPoolManager::fetch_pages(const std::vector<PageId>& page_ids,
+                                    std::vector<Page*>& pages) {
+  pages.assign(page_ids.size(), nullptr);
+  std::vector<Page*> group_pages;
+  for_each_instance_group(
+      page_ids, [&](BufferPoolInstance* instance,
+                    const std::vector<PageId>& group_ids,
+                    const std::vector<size_t>& group_idx) {
+        group_pages.resize(group_ids.size());
+        instance->fetch_pages(group_ids.data(), group_ids.size(),
+                              group_pages.data());
+        for (size_t i = 0; i < group_idx.size(); ++i) {
+          pages[group_idx[i]] = group_pages[i];
+        }
+      });
+}
+
+/**
+ * @description: 预读一批页面，读入缓冲池但不pin
+ * @param {vector<PageId>&} page_ids 需要预读的页面
+ * @param {BufferAccessStrategy*} strategy 访问策略，为nullptr时使用共享缓冲池
+ */
+void BufferPoolManager::prefetch_pages(const std::vector<PageId>& page_ids,
+                                       BufferAccessStrategy* strategy) {
+  for_each_instance_group(
+      page_ids, [this, strategy](BufferPoolInstance* instance,
+                                 const std::vector<PageId>& group_ids,
+                                 const std::vector<size_t>&) {
+        instance->prefetch_pages(
+            group_ids.data(), group_ids.size(),
+            get_ring(strategy, get_instance_no(group_ids[0])));
+      });
+}
+
+/**
+ * @description: 预读文件中[start_page_no, end_page_no)范围内的页面
+ * @param {int} fd 文件句柄
+ * @param {page_id_t} start_page_no 起始页面号
+ * @param {page_id_t} end_page_no 结束页面号（不包含）
+ * @param {BufferAccessStrategy*} strategy 访问策略，为nullptr时使用共享缓冲池
+ */
+void BufferPoolManager::prefetch_pages(int fd, page_id_t start_page_no,
+                                       page_id_t end_page_no,
+                                       BufferAccessStrategy* strategy) {
+  if (start_page_no >= end_page_no) {
+    return;
+  }
+  std::vector<PageId> page_ids;
+  page_ids.reserve(end_page_no - start_page_no);
+  for (page_id_t page_no = start_page_no; page_no < end_page_no; ++page_no) {
+    page_ids.push_back({fd, page_no});
+  }
+  prefetch_pages(page_ids, strategy);
 }
 
 /**
@@ -36,10 +100,14 @@ bool BufferPoolManager::flush_page(PageId page_id) {
  * 创建一个新的page，即从磁盘中移动一个新建的空page到缓冲池某个位置。
  * @return {Page*} 返回新创建的page，若创建失败则返回nullptr
  * @param {PageId*} page_id 当成功创建一个新的page时存储其page_id
+ * @param {BufferAccessStrategy*} strategy 访问策略，为nullptr时使用共享缓冲池
  */
-Page* BufferPoolManager::new_page(PageId* page_id) {
+Page* BufferPoolManager::new_page(PageId* page_id,
+                                  BufferAccessStrategy* strategy) {
   *page_id = {page_id->fd, disk_manager_->allocate_page(page_id->fd)};
-  return instances_[get_instance_no(*page_id)]->new_page(page_id);
+  auto instance_no = get_instance_no(*page_id);
+  return instances_[instance_no]->new_page(page_id,
+                                           get_ring(strategy, instance_no));
 }
 
 /**
@@ -56,19 +124,81 @@ bool BufferPoolManager::delete_page(PageId page_id) {
  * @description: 将buffer_pool中的所有页写回到磁盘
  * @param {int} fd 文件句柄
  */
-void BufferPoolManager::flush_all_pages(int fd) {
-  for (auto& instance : instances_) {
-    instance->flush_all_pages(fd);
-  }
-}
+void BufferPoolManager::flush_all_pages(int fd) { flush_file_pages(fd, false); }
 
 /** 为创建检查点调用
  * @description: 将buffer_pool中的所有页写回到磁盘
  * @param {int} fd 文件句柄
  */
 void BufferPoolManager::flush_all_pages_for_checkpoint(int fd) {
+  flush_file_pages(fd, true);
+}
+
+/**
+ * @description: 文件中相邻的页面按哈希分散在不同的实例中，依次锁住所有实例收集要写回的页面，
+ * 按页号排序后把连续的页面合并成一次写，全部写完再放开各个实例，最后同步一次文件。
+ * 关闭数据库和检查点时的写回因此基本是顺序I/O
+ * @param {int} fd 文件句柄
+ * @param {bool} for_checkpoint 为创建检查点调用
+ */
+void BufferPoolManager::flush_file_pages(int fd, bool for_checkpoint) {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  std::vector<PageIoRequest> requests;
+  for (auto& instance : instances_) {
+    instance->collect_file_pages(fd, for_checkpoint, requests, locks);
+  }
+  disk_manager_->write_page_runs(fd, requests.data(),
+                                 static_cast<int>(requests.size()));
+  locks.clear();
+  disk_manager_->sync_file(fd);
+}
+
+/**
+ * @description: 收集所有缓冲池实例中的脏页及其recLSN
+ * @param {vector<pair<PageId, lsn_t>>&} dirty_pages 输出的脏页及其recLSN
+ */
+void BufferPoolManager::get_dirty_pages(
+    std::vector<std::pair<PageId, lsn_t>>& dirty_pages) {
+  for (auto& instance : instances_) {
+    instance->get_dirty_pages(dirty_pages);
+  }
+}
+
+/**
+ * @description: 收集所有缓冲池实例中的页面
+ * @param {vector<PageId>&} page_ids 输出的页面
+ */
+void BufferPoolManager::get_resident_pages(std::vector<PageId>& page_ids) {
+  for (auto& instance : instances_) {
+    instance->get_resident_pages(page_ids);
+  }
+}
+
+/**
+ * @description: 把所有缓冲池实例中recLSN小于lsn的未pin脏页写回磁盘
+ * @param {lsn_t} lsn 检查点开始时的lsn
+ */
+void BufferPoolManager::flush_dirty_pages_before(lsn_t lsn) {
+  for (auto& instance : instances_) {
+    instance->flush_dirty_pages_before(lsn);
+  }
+}
+
+/**
+ * @description: 为每个缓冲池实例启动后台写页线程
+ */
+void BufferPoolManager::start_page_writer() {
+  for (auto& instance : instances_) {
+    instance->start_page_writer();
+  }
+}
+
+/**
+ * @description: 停止所有缓冲池实例的后台写页线程
+ */
+void BufferPoolManager::stop_page_writer() {
   for (auto& instance : instances_) {
-    instance->flush_all_pages_for_checkpoint(fd);
+    instance->stop_page_writer();
   }
 }
 
@@ -82,6 +212,27 @@ void BufferPoolManager::delete_all_pages(int fd) {
   }
 }
 
+/**
+ * @description: 在线调整缓冲池的总帧数，平均分给各个实例。缩容时被pin住的页面不会被释放，
+ * 实际的帧数可能大于pool_size
+ * @return {size_t} 调整后实际的总帧数
+ * @param {size_t} pool_size 目标总帧数，不能超过max_pool_size_
+ */
+size_t BufferPoolManager::resize(size_t pool_size) {
+  if (pool_size < num_instances_ || pool_size > max_pool_size_) {
+    throw InternalError("BufferPoolManager::resize: pool size must be in [" +
+                        std::to_string(num_instances_) + ", " +
+                        std::to_string(max_pool_size_) + "] pages");
+  }
+  std::lock_guard lock(resize_latch_);
+  size_t total = 0;
+  for (auto& instance : instances_) {
+    total += instance->resize(pool_size / num_instances_);
+  }
+  pool_size_ = total;
+  return total;
+}
+
 // auto BufferPoolManager::FetchPageBasic(PageId page_id) -> BasicPageGuard {
 //     auto *page = fetch_page(page_id);
 //     return {this, page};
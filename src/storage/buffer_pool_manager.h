@@ -10,6 +10,8 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -22,8 +24,11 @@ class LogManager;
 
 class BufferPoolManager {
  private:
-  size_t pool_size_;  // buffer_pool中可容纳页面的个数，即帧的个数
-  BufferPoolInstance* instances_[BUFFER_POOL_INSTANCES]{};  // 缓冲池实例
+  std::atomic<size_t> pool_size_;  // buffer_pool中可容纳页面的个数，即帧的个数，可以在线调整
+  size_t max_pool_size_;  // 在线扩容的上限
+  size_t num_instances_;  // 缓冲池实例个数，启动后不再改变
+  std::vector<BufferPoolInstance*> instances_;  // 缓冲池实例
+  std::mutex resize_latch_;  // 串行化resize
   std::hash<PageId> hasher_;
   // Page *pages_; //
   // buffer_pool中的Page对象数组，在构造空间中申请内存空间，在析构函数中释放，大小为BUFFER_POOL_SIZE
@@ -36,17 +41,33 @@ class BufferPoolManager {
   // std::mutex latch_; // 用于共享数据结构的并发控制
 
  public:
+  /**
+   * @param {size_t} pool_size 初始的总帧数，平均分给各个实例
+   * @param {size_t} num_instances 缓冲池实例个数
+   * @param {size_t} max_pool_size 在线扩容的上限，为0时取pool_size的BUFFER_POOL_MAX_GROWTH倍
+   */
   BufferPoolManager(size_t pool_size, DiskManager* disk_manager,
-                    LogManager* log_manager = nullptr)
-      : pool_size_(pool_size),
+                    LogManager* log_manager = nullptr,
+                    const std::string& replacer_type = REPLACER_TYPE,
+                    size_t num_instances = BUFFER_POOL_INSTANCES,
+                    size_t max_pool_size = 0)
+      : max_pool_size_(max_pool_size != 0 ? std::max(max_pool_size, pool_size)
+                                          : pool_size * BUFFER_POOL_MAX_GROWTH),
+        num_instances_(std::max<size_t>(num_instances, 1)),
         disk_manager_(disk_manager),
         log_manager_(log_manager) {
     // 共享lru
     // replacer_ = new LRUReplacer(pool_size_);
-    for (auto& instance : instances_) {
-      instance = new BufferPoolInstance(pool_size / BUFFER_POOL_INSTANCES,
-                                        disk_manager_, log_manager_);
+    // 多个NUMA节点时实例轮流分配到各个节点上
+    int num_nodes = ENABLE_NUMA_BINDING ? get_numa_nodes() : 1;
+    instances_.resize(num_instances_);
+    for (size_t i = 0; i < num_instances_; ++i) {
+      instances_[i] = new BufferPoolInstance(
+          pool_size / num_instances_, disk_manager_, log_manager_,
+          replacer_type, max_pool_size_ / num_instances_,
+          num_nodes > 1 ? static_cast<int>(i % num_nodes) : -1);
     }
+    pool_size_ = pool_size / num_instances_ * num_instances_;
   }
 
   ~BufferPoolManager() {
@@ -57,19 +78,42 @@ class BufferPoolManager {
   }
 
   /**
-   * @description: 将目标页面标记为脏页
+   * @description: 将目标页面标记为脏页，调用者pin住了该页面
    * @param {Page*} page 脏页
    */
-  // static void mark_dirty(Page *page) { page->is_dirty_ = true; }
+  static void mark_dirty(Page* page) { BufferPoolInstance::mark_dirty(page); }
+
+  /**
+   * @description: 把调用者pin住的页面改为常驻，之后不会被换出，直到所在文件的页面被清出缓冲池
+   * @param {Page*} page 调用者pin住的页面
+   */
+  static void pin_in_memory(Page* page) { BufferPoolInstance::pin_in_memory(page); }
 
  public:
-  Page* fetch_page(PageId page_id);
+  Page* fetch_page(PageId page_id, BufferAccessStrategy* strategy = nullptr);
+
+  void fetch_pages(const std::vector<PageId>& page_ids,
+                   std::vector<Page*>& pages);
+
+  void prefetch_pages(const std::vector<PageId>& page_ids,
+                      BufferAccessStrategy* strategy = nullptr);
+
+  void prefetch_pages(int fd, page_id_t start_page_no, page_id_t end_page_no,
+                      BufferAccessStrategy* strategy = nullptr);
 
   bool unpin_page(PageId page_id, bool is_dirty);
 
+  /**
+   * @description: 放掉调用者pin住的页面，直接用页面所在的实例和帧，不计算哈希也不查页表
+   * @return {bool} pin计数已经为0时返回false
+   */
+  static bool unpin_page(Page* page, bool is_dirty) {
+    return page->get_pool()->unpin_page(page, is_dirty);
+  }
+
   bool flush_page(PageId page_id);
 
-  Page* new_page(PageId* page_id);
+  Page* new_page(PageId* page_id, BufferAccessStrategy* strategy = nullptr);
 
   bool delete_page(PageId page_id);
 
@@ -79,18 +123,47 @@ class BufferPoolManager {
 
   void delete_all_pages(int fd);
 
+  void get_dirty_pages(std::vector<std::pair<PageId, lsn_t>>& dirty_pages);
+
+  void get_resident_pages(std::vector<PageId>& page_ids);
+
+  void flush_dirty_pages_before(lsn_t lsn);
+
+  void start_page_writer();
+
+  void stop_page_writer();
+
+  size_t resize(size_t pool_size);
+
+  size_t get_pool_size() const { return pool_size_; }
+
+  size_t get_max_pool_size() const { return max_pool_size_; }
+
+  size_t get_num_instances() const { return num_instances_; }
+
+  /**
+   * @description: 获取每个缓冲池实例的统计
+   * @param {vector<BufferPoolStatus>&} status 输出，第i项为第i个实例的统计
+   */
+  void get_status(std::vector<BufferPoolStatus>& status) {
+    for (auto& instance : instances_) {
+      status.push_back(instance->get_status());
+    }
+  }
+
   void ouput_info() {
     // printf("page2instance size: %lu\n", page2instance_.size());
     for (auto& instance : instances_) {
+      auto status = instance->get_status();
       printf("bpm size: %lu\n", instance->page_table_.size());
-      printf("free list size: %lu\n", instance->free_list_.size());
-      printf("fetch cnt: %d\n", instance->cnt_fetch);
-      printf("vitcm cnt: %d\n", instance->cnt_vitcm);
-      printf("update cnt: %d\n", instance->cnt_update);
-      printf("unpin cnt: %d\n", instance->cnt_unpin);
-      printf("read seconds: %lf\n", instance->read_time / 1e6);
-      printf("fetch seconds: %lf\n", instance->fetch_time / 1e6);
-      printf("wait seconds: %lf\n", instance->wait_time / 1e6);
+      printf("free list size: %lu\n", status.free_frames);
+      printf("fetch cnt: %lu\n", status.fetches);
+      printf("hit ratio: %lf\n", status.hit_ratio());
+      printf("update cnt: %lu\n", status.write_backs);
+      printf("unpin cnt: %lu\n", status.unpins);
+      printf("read seconds: %lf\n", status.read_us / 1e6);
+      printf("fetch seconds: %lf\n", status.fetch_us / 1e6);
+      printf("wait seconds: %lf\n", status.wait_us / 1e6);
     }
   }
 
@@ -103,7 +176,40 @@ class BufferPoolManager {
   // auto NewPageGuarded(PageId *page_id) -> BasicPageGuard;
 
  private:
+  void flush_file_pages(int fd, bool for_checkpoint);
+
   inline std::size_t get_instance_no(const PageId& page_id) {
-    return hasher_(page_id) % BUFFER_POOL_INSTANCES;
+    return hasher_(page_id) % num_instances_;
+  }
+
+  inline BufferRing* get_ring(BufferAccessStrategy* strategy,
+                              std::size_t instance_no) {
+    return strategy != nullptr ? strategy->get_ring(instance_no, num_instances_)
+                               : nullptr;
+  }
+
+  /**
+   * @description: 把一批页面按所属的缓冲池实例分组，对每个非空分组调用func(instance, group_ids, group_idx)，
+   * group_idx[i]是group_ids[i]在page_ids中的下标
+   */
+  template <typename Func>
+  void for_each_instance_group(const std::vector<PageId>& page_ids,
+                               Func&& func) {
+    std::vector<PageId> group_ids;
+    std::vector<size_t> group_idx;
+    for (size_t instance_no = 0; instance_no < num_instances_;
+         ++instance_no) {
+      group_ids.clear();
+      group_idx.clear();
+      for (size_t i = 0; i < page_ids.size(); ++i) {
+        if (get_instance_no(page_ids[i]) == instance_no) {
+          group_ids.push_back(page_ids[i]);
+          group_idx.push_back(i);
+        }
+      }
+      if (!group_ids.empty()) {
+        func(instances_[instance_no], group_ids, group_idx);
+      }
+    }
   }
 };
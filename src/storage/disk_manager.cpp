@@ -10,18 +10,188 @@ See the Mulan PSL v2 for more details. */
 
 #include "storage/disk_manager.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
 #include <assert.h>    // for assert
 #include <string.h>    // for memset
 #include <sys/stat.h>  // for stat
+#include <sys/syscall.h>  // for SYS_ioprio_set
+#include <sys/uio.h>   // for pwritev
 #include <unistd.h>    // for lseek
 
 #include "defs.h"
+#include "common/trace.h"
+#include "storage/page_compressor.h"
+
+/* 压缩文件的页面映射。第0页是文件头，由文件句柄按字节直接读写，不压缩，留在文件开头；其余页面压缩后存放在
+ * PAGE_COMPRESS_SLOT_SIZE对齐的槽位中，压缩后省不出一个槽位的页面原样存放。页号到槽位的映射保存在文件旁的
+ * path + COMPRESS_MAP_SUFFIX中，sync_file先让槽位中的数据落盘，再整体替换映射文件。页面重写时总是写到新的槽位，
+ * 旧槽位在映射文件不再引用它之后才复用，所以崩溃后按映射文件读到的是最近一次sync_file时的页面，和不压缩的文件一样
+ * 由检查点之后的日志重做。映射文件记下数据文件的inode，数据文件被别的文件改名替换后，旧的映射不再对应它 */
+struct DiskManager::CompressedFile {
+  struct Slot {
+    uint64_t offset = 0;
+    uint32_t len = 0;    // 压缩后的长度，0表示页面还没有写过，PAGE_SIZE表示没有压缩
+    uint32_t units = 0;  // 槽位占的PAGE_COMPRESS_SLOT_SIZE的个数
+  };
+  static_assert(sizeof(Slot) == 16, "Slot is written to the map file as is");
+
+  static constexpr uint32_t MAX_UNITS = PAGE_SIZE / PAGE_COMPRESS_SLOT_SIZE;
+  static constexpr uint64_t MAP_MAGIC = 0x50414d43424d4452;  // "RDMBCMAP"
+
+  std::string map_path;
+  uint64_t inode = 0;                                // 数据文件的inode
+  std::mutex latch;                                  // 保护以下的映射和空闲槽位
+  std::vector<Slot> pages;                           // 当前的映射，下标为页号，至少有第0页一项
+  std::vector<Slot> durable;                         // 映射文件中的映射
+  std::vector<Slot> syncing;                         // 正在写入映射文件的映射，不在落盘时为空
+  std::vector<std::pair<page_id_t, Slot>> retired;   // 被替换下来、仍被durable或syncing引用的槽位
+  std::vector<std::vector<uint64_t>> free_slots;     // 空闲槽位的偏移，按占的单位个数分类
+  uint64_t end = PAGE_SIZE;                          // 槽位区域的末尾，之后的空间没有被使用
+  bool dirty = false;                                // 映射在上一次落盘之后改变过
+  std::mutex sync_latch;                             // 串行化映射文件的写入
+
+  CompressedFile() : free_slots(MAX_UNITS + 1) {}
+
+  static bool references(const std::vector<Slot>& map, page_id_t page_no, const Slot& slot) {
+    return page_no < static_cast<page_id_t>(map.size()) && map[page_no].len != 0 &&
+           map[page_no].offset == slot.offset;
+  }
+
+  // 分配units个单位的槽位：先找同样大小的空闲槽位，再切分更大的，都没有时追加到末尾
+  uint64_t allocate(uint32_t units) {
+    for (uint32_t u = units; u <= MAX_UNITS; ++u) {
+      if (free_slots[u].empty()) {
+        continue;
+      }
+      uint64_t offset = free_slots[u].back();
+      free_slots[u].pop_back();
+      if (u > units) {
+        free_slots[u - units].push_back(offset + static_cast<uint64_t>(units) * PAGE_COMPRESS_SLOT_SIZE);
+      }
+      return offset;
+    }
+    uint64_t offset = end;
+    end += static_cast<uint64_t>(units) * PAGE_COMPRESS_SLOT_SIZE;
+    return offset;
+  }
+
+  // 页面page_no原来的槽位slot被替换下来，映射文件还引用它时留到之后再复用
+  void release(page_id_t page_no, const Slot& slot) {
+    if (references(durable, page_no, slot) || references(syncing, page_no, slot)) {
+      retired.emplace_back(page_no, slot);
+    } else {
+      free_slots[slot.units].push_back(slot.offset);
+    }
+  }
+
+  // 把[begin, limit)切成整页大小的槽位和余下的一个槽位加入空闲槽位
+  void add_free_range(uint64_t begin, uint64_t limit) {
+    while (begin + PAGE_COMPRESS_SLOT_SIZE <= limit) {
+      auto units = static_cast<uint32_t>(std::min<uint64_t>(MAX_UNITS, (limit - begin) / PAGE_COMPRESS_SLOT_SIZE));
+      free_slots[units].push_back(begin);
+      begin += static_cast<uint64_t>(units) * PAGE_COMPRESS_SLOT_SIZE;
+    }
+  }
+
+  // 打开文件时按映射重建空闲槽位，已用槽位之间的空隙都是空闲的；空闲槽位之后不再合并
+  void rebuild_free_slots() {
+    std::vector<std::pair<uint64_t, uint64_t>> used;
+    for (auto& slot : pages) {
+      if (slot.len != 0) {
+        used.emplace_back(slot.offset, slot.offset + static_cast<uint64_t>(slot.units) * PAGE_COMPRESS_SLOT_SIZE);
+      }
+    }
+    std::sort(used.begin(), used.end());
+    uint64_t pos = PAGE_SIZE;
+    for (auto& [begin, limit] : used) {
+      add_free_range(pos, begin);
+      pos = std::max(pos, limit);
+    }
+    end = pos;
+  }
+
+  // 读入映射文件，映射属于别的文件（inode不同）时返回false
+  bool load(uint64_t file_inode) {
+    int fd = open(map_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw UnixError();
+    }
+    struct stat st;
+    std::vector<char> buf;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+      buf.resize(st.st_size);
+      ok = pread(fd, buf.data(), buf.size(), 0) == static_cast<ssize_t>(buf.size());
+    }
+    close(fd);
+    uint64_t header[3] = {0, 0, 0};
+    if (ok && buf.size() >= sizeof(header)) {
+      memcpy(header, buf.data(), sizeof(header));
+    }
+    if (!ok || header[0] != MAP_MAGIC || header[2] == 0 || buf.size() != sizeof(header) + header[2] * sizeof(Slot)) {
+      throw InternalError("DiskManager::open_file: corrupt page map " + map_path);
+    }
+    if (header[1] != file_inode) {
+      return false;
+    }
+    inode = file_inode;
+    pages.resize(header[2]);
+    memcpy(pages.data(), buf.data() + sizeof(header), pages.size() * sizeof(Slot));
+    durable = pages;
+    rebuild_free_slots();
+    return true;
+  }
+
+  // 把map写到临时文件落盘后改名替换映射文件，调用者再让目录落盘
+  void save(const std::vector<Slot>& map) const {
+    std::string tmp_path = map_path + ".tmp";
+    std::vector<char> buf(3 * sizeof(uint64_t) + map.size() * sizeof(Slot));
+    uint64_t header[3] = {MAP_MAGIC, inode, map.size()};
+    memcpy(buf.data(), header, sizeof(header));
+    memcpy(buf.data() + sizeof(header), map.data(), map.size() * sizeof(Slot));
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      throw UnixError();
+    }
+    bool ok = pwrite(fd, buf.data(), buf.size(), 0) == static_cast<ssize_t>(buf.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || std::rename(tmp_path.c_str(), map_path.c_str()) == -1) {
+      throw UnixError();
+    }
+  }
+};
 
 DiskManager::DiskManager() {
   memset(fd2pageno_, 0,
          MAX_FD * (sizeof(std::atomic<page_id_t>) / sizeof(char)));
 }
 
+DiskManager::~DiskManager() = default;
+
+namespace {
+// O_DIRECT要求缓冲区地址、读写长度和文件偏移都按块对齐，文件头等不足一页或未对齐的读写经由该缓冲区中转
+alignas(PAGE_SIZE) thread_local char direct_io_buffer[PAGE_SIZE];
+
+inline bool is_page_aligned(const char* data, int num_bytes) {
+  return reinterpret_cast<uintptr_t>(data) % PAGE_SIZE == 0 &&
+         num_bytes == PAGE_SIZE;
+}
+
+// io_uring的提交和完成队列不是线程安全的，每个线程使用自己的实例
+IoUring* get_thread_io_uring() {
+  thread_local IoUring io_uring(IO_URING_ENTRIES);
+  return io_uring.is_valid() ? &io_uring : nullptr;
+}
+}  // namespace
+
 /**
  * @description: 将数据写入文件的指定磁盘页面中
  * @param {int} fd 磁盘文件的文件句柄
@@ -31,21 +201,23 @@ DiskManager::DiskManager() {
  */
 void DiskManager::write_page(int fd, page_id_t page_no, const char* data,
                              int num_bytes) {
-  // Todo:
-  // 1.lseek()定位到文件头，通过(fd,page_no)可以定位指定页面及其在磁盘文件中的偏移量
-  // 2.调用write()函数
-  // 注意write返回值与num_bytes不等时 throw
-  // InternalError("DiskManager::write_page Error");
-  off_t offset = page_no * PAGE_SIZE;
+  // 使用pwrite按页面偏移写入，不修改共享fd的文件偏移，多个线程可以同时读写同一个文件
+  off_t offset = static_cast<off_t>(page_no) * PAGE_SIZE;
+  RMDB_PROBE(disk__write__start, fd, page_no, num_bytes);
 
-  if (lseek(fd, offset, SEEK_SET) == -1) {
-    perror("DiskManager::write_page");
-    throw InternalError("DiskManager::write_page: lSeek Error");
-  }
-
-  if (write(fd, data, num_bytes) != num_bytes) {
+  if (page_no != 0 && compressed_[fd] != nullptr) {
+    write_compressed_page(fd, page_no, data, num_bytes);
+  } else if (direct_fd_[fd] && !is_page_aligned(data, num_bytes)) {
+    // 文件头只占页面开头的一部分，页面其余部分补0后整页写入
+    memset(direct_io_buffer, 0, PAGE_SIZE);
+    memcpy(direct_io_buffer, data, num_bytes);
+    if (pwrite(fd, direct_io_buffer, PAGE_SIZE, offset) != PAGE_SIZE) {
+      throw InternalError("DiskManager::write_page: Write Error");
+    }
+  } else if (pwrite(fd, data, num_bytes, offset) != num_bytes) {
     throw InternalError("DiskManager::write_page: Write Error");
   }
+  RMDB_PROBE(disk__write__done, fd, page_no, num_bytes);
 }
 
 /**
@@ -57,21 +229,227 @@ void DiskManager::write_page(int fd, page_id_t page_no, const char* data,
  */
 void DiskManager::read_page(int fd, page_id_t page_no, char* data,
                             int num_bytes) {
-  // Todo:
-  // 1.lseek()定位到文件头，通过(fd,page_no)可以定位指定页面及其在磁盘文件中的偏移量
-  // 2.调用read()函数
-  // 注意read返回值与num_bytes不等时，throw
-  // InternalError("DiskManager::read_page Error");
-  off_t offset = page_no * PAGE_SIZE;
+  off_t offset = static_cast<off_t>(page_no) * PAGE_SIZE;
+  RMDB_PROBE(disk__read__start, fd, page_no, num_bytes);
+
+  if (page_no != 0 && compressed_[fd] != nullptr) {
+    read_compressed_page(fd, page_no, data, num_bytes);
+  } else if (direct_fd_[fd] && !is_page_aligned(data, num_bytes)) {
+    if (pread(fd, direct_io_buffer, PAGE_SIZE, offset) < num_bytes) {
+      throw InternalError("DiskManager::read_page: Read Error");
+    }
+    memcpy(data, direct_io_buffer, num_bytes);
+  } else if (pread(fd, data, num_bytes, offset) != num_bytes) {
+    throw InternalError("DiskManager::read_page: Read Error");
+  }
+  RMDB_PROBE(disk__read__done, fd, page_no, num_bytes);
+}
 
-  if (lseek(fd, offset, SEEK_SET) == -1) {
-    perror("DiskManager::read_page");
-    throw InternalError("DiskManager::read_page: lSeek Error");
+/**
+ * @description: 把页面压缩后写到一个新的槽位，写完后再让页号指向它；压缩后省不出一个槽位时原样写入
+ */
+void DiskManager::write_compressed_page(int fd, page_id_t page_no, const char* data, int num_bytes) {
+  thread_local char page[PAGE_SIZE];
+  thread_local char packed[PAGE_SIZE];
+  CompressedFile* file = compressed_[fd].get();
+  if (num_bytes < PAGE_SIZE) {
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, data, num_bytes);
+    data = page;
+  }
+  CompressedFile::Slot slot;
+  int len = page_compress(data, PAGE_SIZE, packed, PAGE_SIZE - PAGE_COMPRESS_SLOT_SIZE);
+  if (len < 0) {
+    len = PAGE_SIZE;
+  } else {
+    data = packed;
+  }
+  slot.len = len;
+  slot.units = (len + PAGE_COMPRESS_SLOT_SIZE - 1) / PAGE_COMPRESS_SLOT_SIZE;
+  {
+    std::lock_guard<std::mutex> lock(file->latch);
+    slot.offset = file->allocate(slot.units);
+  }
+  if (pwrite(fd, data, len, static_cast<off_t>(slot.offset)) != len) {
+    std::lock_guard<std::mutex> lock(file->latch);
+    file->free_slots[slot.units].push_back(slot.offset);
+    throw InternalError("DiskManager::write_page: Write Error");
   }
+  std::lock_guard<std::mutex> lock(file->latch);
+  if (page_no >= static_cast<page_id_t>(file->pages.size())) {
+    file->pages.resize(page_no + 1);
+  }
+  CompressedFile::Slot old = file->pages[page_no];
+  file->pages[page_no] = slot;
+  file->dirty = true;
+  if (old.len != 0) {
+    file->release(page_no, old);
+  }
+}
 
-  if (read(fd, data, num_bytes) != num_bytes) {
+/**
+ * @description: 按映射找到页面的槽位，读出后解压
+ */
+void DiskManager::read_compressed_page(int fd, page_id_t page_no, char* data, int num_bytes) {
+  thread_local char page[PAGE_SIZE];
+  thread_local char packed[PAGE_SIZE];
+  CompressedFile* file = compressed_[fd].get();
+  CompressedFile::Slot slot;
+  {
+    std::lock_guard<std::mutex> lock(file->latch);
+    if (page_no < static_cast<page_id_t>(file->pages.size())) {
+      slot = file->pages[page_no];
+    }
+  }
+  // 没有写过的页面和不压缩的文件读到文件末尾之后一样报错
+  if (slot.len == 0) {
     throw InternalError("DiskManager::read_page: Read Error");
   }
+  char* dest = num_bytes == PAGE_SIZE ? data : page;
+  auto offset = static_cast<off_t>(slot.offset);
+  if (slot.len == PAGE_SIZE) {
+    if (pread(fd, dest, PAGE_SIZE, offset) != PAGE_SIZE) {
+      throw InternalError("DiskManager::read_page: Read Error");
+    }
+  } else if (pread(fd, packed, slot.len, offset) != static_cast<ssize_t>(slot.len) ||
+             page_decompress(packed, slot.len, dest, PAGE_SIZE) != PAGE_SIZE) {
+    throw InternalError("DiskManager::read_page: Read Error");
+  }
+  if (dest != data) {
+    memcpy(data, page, num_bytes);
+  }
+}
+
+/**
+ * @description: 批量读取多个页面，使用io_uring时一次系统调用提交一批请求并等待全部完成
+ * @param {PageIoRequest*} requests 读请求数组
+ * @param {int} num 请求个数
+ */
+void DiskManager::read_pages(PageIoRequest* requests, int num) {
+  submit_pages(requests, num, false);
+}
+
+/**
+ * @description: 批量写入多个页面
+ * @param {PageIoRequest*} requests 写请求数组
+ * @param {int} num 请求个数
+ */
+void DiskManager::write_pages(PageIoRequest* requests, int num) {
+  submit_pages(requests, num, true);
+}
+
+/**
+ * @description: 写回一个文件的一批页面：按页号排序，页号连续的整页合并成一次pwritev（至多IOV_MAX页），
+ * 缓冲池关闭文件和检查点时整个文件的脏页因此基本顺序写入。压缩文件的页面和O_DIRECT下未对齐的页面逐个写
+ * @param {int} fd 文件句柄
+ * @param {PageIoRequest*} requests 写请求数组，会被排序
+ * @param {int} num 请求个数
+ */
+void DiskManager::write_page_runs(int fd, PageIoRequest* requests, int num) {
+  std::sort(requests, requests + num,
+            [](const PageIoRequest& a, const PageIoRequest& b) {
+              return a.page_no < b.page_no;
+            });
+  auto vectored = [&](const PageIoRequest& request) {
+    return compressed_[fd] == nullptr && request.num_bytes == PAGE_SIZE &&
+           (!direct_fd_[fd] || is_page_aligned(request.data, PAGE_SIZE));
+  };
+  std::vector<iovec> iov;
+  for (int i = 0; i < num;) {
+    if (!vectored(requests[i])) {
+      write_page(fd, requests[i].page_no, requests[i].data,
+                 requests[i].num_bytes);
+      ++i;
+      continue;
+    }
+    iov.clear();
+    int end = i;
+    while (end < num && end - i < IOV_MAX &&
+           requests[end].page_no == requests[i].page_no + (end - i) &&
+           vectored(requests[end])) {
+      iov.push_back({requests[end].data, PAGE_SIZE});
+      ++end;
+    }
+    off_t offset = static_cast<off_t>(requests[i].page_no) * PAGE_SIZE;
+    RMDB_PROBE(disk__write__start, fd, requests[i].page_no,
+               (end - i) * PAGE_SIZE);
+    // 写了一部分时跳过已经写完的页面，从中断的位置接着写
+    size_t first = 0;
+    while (first < iov.size()) {
+      ssize_t n = pwritev(fd, iov.data() + first,
+                          static_cast<int>(iov.size() - first), offset);
+      if (n <= 0) {
+        if (n == -1 && errno == EINTR) {
+          continue;
+        }
+        throw InternalError("DiskManager::write_page_runs: Write Error");
+      }
+      offset += n;
+      while (n > 0 && static_cast<size_t>(n) >= iov[first].iov_len) {
+        n -= static_cast<ssize_t>(iov[first].iov_len);
+        ++first;
+      }
+      if (n > 0) {
+        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+        iov[first].iov_len -= n;
+      }
+    }
+    RMDB_PROBE(disk__write__done, fd, requests[i].page_no,
+               (end - i) * PAGE_SIZE);
+    i = end;
+  }
+}
+
+/**
+ * @description: 页面读写都由发起的线程同步完成（pread或线程自己的io_uring，请求继承线程的I/O优先级），
+ * 内核的I/O调度器按线程的优先级排队，所以I/O优先级按线程设置。ioprio_set没有glibc封装，编码见linux/ioprio.h；
+ * 默认类（0）跟随线程的nice值。内核不支持或被禁止时忽略
+ * @param {int} level best-effort类中的级别，0最高7最低，-1恢复默认
+ */
+void DiskManager::set_thread_io_priority(int level) {
+  constexpr int IOPRIO_WHO_PROCESS = 1;
+  constexpr int IOPRIO_CLASS_SHIFT = 13;
+  constexpr int IOPRIO_CLASS_BE = 2;
+  int ioprio = level < 0 ? 0 : (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | level;
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio);  // 0表示当前线程
+}
+
+void DiskManager::submit_pages(PageIoRequest* requests, int num,
+                               bool is_write) {
+  IoUring* io_uring = ENABLE_IO_URING ? get_thread_io_uring() : nullptr;
+  bool batchable = io_uring != nullptr;
+  for (int i = 0; i < num && batchable; ++i) {
+    // O_DIRECT下未对齐的请求需要中转，压缩文件的页面要压缩和解压，只能逐个同步读写
+    batchable = compressed_[requests[i].fd] == nullptr &&
+                (!direct_fd_[requests[i].fd] ||
+                 is_page_aligned(requests[i].data, requests[i].num_bytes));
+  }
+  if (!batchable) {
+    for (int i = 0; i < num; ++i) {
+      auto& request = requests[i];
+      if (is_write) {
+        write_page(request.fd, request.page_no, request.data,
+                   request.num_bytes);
+      } else {
+        read_page(request.fd, request.page_no, request.data,
+                  request.num_bytes);
+      }
+      request.res_ = request.num_bytes;
+    }
+    return;
+  }
+
+  int batch = static_cast<int>(io_uring->get_entries());
+  for (int start = 0; start < num; start += batch) {
+    io_uring->submit_and_wait(requests + start, std::min(batch, num - start),
+                              is_write);
+  }
+  for (int i = 0; i < num; ++i) {
+    if (requests[i].res_ != requests[i].num_bytes) {
+      throw InternalError(is_write ? "DiskManager::write_pages: Write Error"
+                                   : "DiskManager::read_pages: Read Error");
+    }
+  }
 }
 
 /**
@@ -82,7 +460,42 @@ void DiskManager::read_page(int fd, page_id_t page_no, char* data,
 page_id_t DiskManager::allocate_page(int fd) {
   // 简单的自增分配策略，指定文件的页面编号加1
   assert(fd >= 0 && fd < MAX_FD);
-  return fd2pageno_[fd]++;
+  page_id_t page_no = fd2pageno_[fd]++;
+  // 压缩文件的页面不按页号存放，不预分配
+  if (compressed_[fd] == nullptr &&
+      extent_pages_[fd].load(std::memory_order_relaxed) > 0 &&
+      page_no >= extent_end_[fd].load(std::memory_order_acquire)) {
+    extend_file(fd, page_no);
+  }
+  return page_no;
+}
+
+/**
+ * @description: 从page_no开始为文件预分配一段磁盘空间。使用FALLOC_FL_KEEP_SIZE，文件大小不变，
+ * 恢复时仍能用文件大小判断哪些页面真正写过；之后写入这段范围只需把块标记为已写，不再逐页分配块
+ * @param {int} fd 文件对应的句柄
+ * @param {page_id_t} page_no 刚分配出去、超出预分配范围的页号
+ */
+void DiskManager::extend_file(int fd, page_id_t page_no) {
+  std::lock_guard<std::mutex> lock(extent_latch_);
+  page_id_t end = extent_end_[fd].load(std::memory_order_relaxed);
+  if (page_no < end) {
+    return;
+  }
+  // 文件越大每次预分配越多，批量导入时fallocate的次数随文件大小对数增长
+  int extent = std::max(extent_pages_[fd].load(std::memory_order_relaxed),
+                        std::min(page_no / 8, FILE_EXTENT_MAX_PAGES));
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE,
+                static_cast<off_t>(page_no) * PAGE_SIZE,
+                static_cast<off_t>(extent) * PAGE_SIZE) == -1) {
+    if (errno == EOPNOTSUPP || errno == ENOSYS) {
+      // 文件系统不支持预分配，之后按原来的方式在写入时分配
+      extent_pages_[fd] = 0;
+    }
+    // 空间不足等错误留给之后的write_page报告
+    return;
+  }
+  extent_end_[fd].store(page_no + extent, std::memory_order_release);
 }
 
 void DiskManager::deallocate_page(__attribute__((unused)) page_id_t page_id) {}
@@ -164,6 +577,10 @@ void DiskManager::destroy_file(const std::string& path) {
   if (unlink(path.c_str()) == -1) {
     throw InternalError("DiskManager::destroy_file: Unlink Error");
   }
+  std::string map_path = path + COMPRESS_MAP_SUFFIX;
+  if (is_file(map_path) && unlink(map_path.c_str()) == -1) {
+    throw InternalError("DiskManager::destroy_file: Unlink Error");
+  }
 }
 
 /**
@@ -184,10 +601,38 @@ int DiskManager::open_file(const std::string& path) {
     throw FileNotClosedError(path);
   }
 
-  int fd = open(path.c_str(), O_RDWR);
+  // 有映射文件的是压缩文件。TRUNCATE在改名之间崩溃后，改名过来的不压缩的文件旁边可能留着原来文件的映射，丢弃它
+  std::unique_ptr<CompressedFile> compressed;
+  std::string map_path = path + COMPRESS_MAP_SUFFIX;
+  struct stat st;
+  if (is_file(map_path) && stat(path.c_str(), &st) == 0) {
+    compressed = std::make_unique<CompressedFile>();
+    compressed->map_path = map_path;
+    if (!compressed->load(st.st_ino)) {
+      compressed.reset();
+      unlink(map_path.c_str());
+    }
+  }
+
+  int fd = -1;
+  bool direct = false;
+  // 日志按字节追加写，压缩文件中的页面长度不按块对齐，都不使用O_DIRECT；文件系统不支持O_DIRECT（如tmpfs）时退回普通读写
+  if (ENABLE_DIRECT_IO && path != LOG_FILE_NAME && compressed == nullptr) {
+    fd = open(path.c_str(), O_RDWR | O_DIRECT);
+    direct = fd != -1;
+  }
+  if (fd == -1) {
+    fd = open(path.c_str(), O_RDWR);
+  }
   if (fd == -1) {
     throw InternalError("DiskManager::open_file: Open Error");
   }
+  direct_fd_[fd] = direct;
+  // fd可能被之前关闭的文件用过
+  extent_pages_[fd] = 0;
+  extent_end_[fd] = 0;
+  in_memory_fd_[fd] = false;
+  compressed_[fd] = std::move(compressed);
 
   path2fd_[path] = fd;
   fd2path_[fd] = path;
@@ -205,6 +650,11 @@ void DiskManager::close_file(int fd) {
   if (fd2path_.count(fd) == 0) {
     throw FileNotOpenError(fd);
   }
+  // 压缩文件关闭前映射落盘，重新打开后能读到写回的所有页面
+  if (compressed_[fd] != nullptr) {
+    sync_compressed_file(fd);
+    compressed_[fd].reset();
+  }
 
   path2fd_.erase(fd2path_[fd]);
   fd2path_.erase(fd);
@@ -214,17 +664,174 @@ void DiskManager::close_file(int fd) {
   }
 }
 
+/**
+ * @description: 把文件截断为num_pages个页面，之后从num_pages开始分配页面编号。
+ * 调用者保证被截掉的页面不在缓冲池中
+ * @param {int} fd 打开的文件的文件句柄
+ * @param {page_id_t} num_pages 保留的页面个数
+ */
+void DiskManager::truncate_file(int fd, page_id_t num_pages) {
+  if (compressed_[fd] != nullptr) {
+    // 压缩文件只从映射中去掉截掉的页面，它们的槽位之后复用
+    CompressedFile* file = compressed_[fd].get();
+    std::lock_guard<std::mutex> lock(file->latch);
+    auto keep = static_cast<size_t>(std::max<page_id_t>(num_pages, 1));
+    for (size_t page_no = keep; page_no < file->pages.size(); ++page_no) {
+      if (file->pages[page_no].len != 0) {
+        file->release(static_cast<page_id_t>(page_no), file->pages[page_no]);
+      }
+    }
+    if (file->pages.size() > keep) {
+      file->pages.resize(keep);
+      file->dirty = true;
+    }
+    fd2pageno_[fd] = num_pages;
+    return;
+  }
+  if (ftruncate(fd, static_cast<off_t>(num_pages) * PAGE_SIZE) == -1) {
+    throw UnixError();
+  }
+  fd2pageno_[fd] = num_pages;
+  // 预分配的空间随截断一起释放，之后写入新页面时重新预分配
+  std::lock_guard<std::mutex> lock(extent_latch_);
+  if (extent_end_[fd].load(std::memory_order_relaxed) > num_pages) {
+    extent_end_[fd].store(num_pages, std::memory_order_release);
+  }
+}
+
+/**
+ * @description: 把文件在内核中的缓存强制落盘，不经过缓冲池直接写入的页面用它保证持久化
+ * @param {int} fd 打开的文件的文件句柄
+ */
+void DiskManager::sync_file(int fd) {
+  if (compressed_[fd] != nullptr) {
+    sync_compressed_file(fd);
+    return;
+  }
+  if (fdatasync(fd) == -1) {
+    throw UnixError();
+  }
+}
+
+/**
+ * @description: 压缩文件的落盘：先让槽位中的数据落盘，再写入此刻的映射。落盘期间页面照常写入，
+ * 写入时被替换下来的槽位如果还被正在写入的映射引用，留到映射落盘之后再复用
+ * @param {int} fd 打开的压缩文件的文件句柄
+ */
+void DiskManager::sync_compressed_file(int fd) {
+  CompressedFile* file = compressed_[fd].get();
+  std::lock_guard<std::mutex> sync_lock(file->sync_latch);
+  bool save_map;
+  {
+    std::lock_guard<std::mutex> lock(file->latch);
+    save_map = file->dirty;
+    if (save_map) {
+      file->syncing = file->pages;
+      file->dirty = false;
+    }
+  }
+  try {
+    if (fdatasync(fd) == -1) {
+      throw UnixError();
+    }
+    if (save_map) {
+      file->save(file->syncing);
+      sync_dir();
+    }
+  } catch (...) {
+    if (save_map) {
+      std::lock_guard<std::mutex> lock(file->latch);
+      file->syncing.clear();
+      file->dirty = true;
+    }
+    throw;
+  }
+  if (!save_map) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(file->latch);
+  file->durable = std::move(file->syncing);
+  file->syncing.clear();
+  auto& retired = file->retired;
+  for (size_t i = 0; i < retired.size();) {
+    if (CompressedFile::references(file->durable, retired[i].first, retired[i].second)) {
+      ++i;
+    } else {
+      file->free_slots[retired[i].second.units].push_back(retired[i].second.offset);
+      retired[i] = retired.back();
+      retired.pop_back();
+    }
+  }
+}
+
+/**
+ * @description: 把一个已经关闭的文件改为压缩存储，文件中已有的页面登记为不压缩的槽位
+ * @param {string&} path 文件路径
+ */
+void DiskManager::compress_file(const std::string& path) {
+  if (path2fd_.count(path)) {
+    throw FileNotClosedError(path);
+  }
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd == -1) {
+    throw FileNotFoundError(path);
+  }
+  // 映射引用的页面要先落盘
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && fdatasync(fd) == 0;
+  close(fd);
+  if (!ok) {
+    throw UnixError();
+  }
+  CompressedFile file;
+  file.map_path = path + COMPRESS_MAP_SUFFIX;
+  file.inode = st.st_ino;
+  auto num_pages = std::max<page_id_t>(1, static_cast<page_id_t>(st.st_size / PAGE_SIZE));
+  file.pages.resize(num_pages);
+  for (page_id_t page_no = 1; page_no < num_pages; ++page_no) {
+    file.pages[page_no] = {static_cast<uint64_t>(page_no) * PAGE_SIZE, PAGE_SIZE, CompressedFile::MAX_UNITS};
+  }
+  file.save(file.pages);
+  sync_dir();
+}
+
 /**
  * @description: 获得文件的大小
  * @return {int} 文件的大小
  * @param {string} &file_name 文件名
  */
 int DiskManager::get_file_size(const std::string& file_name) {
+  auto it = path2fd_.find(file_name);
+  if (it != path2fd_.end() && compressed_[it->second] != nullptr) {
+    // 压缩文件按映射中的页面个数计算，和不压缩时的文件大小一致
+    CompressedFile* file = compressed_[it->second].get();
+    std::lock_guard<std::mutex> lock(file->latch);
+    return static_cast<int>(file->pages.size()) * PAGE_SIZE;
+  }
   struct stat stat_buf;
   int rc = stat(file_name.c_str(), &stat_buf);
   return rc == 0 ? stat_buf.st_size : -1;
 }
 
+/**
+ * @description: 改名一个已经关闭的文件。先改名压缩文件的映射：在两次改名之间崩溃时old_path还在，调用者重新改名即可；
+ * 改名后new_path原来的映射和inode对不上，打开时丢弃
+ * @param {string&} old_path 原来的路径
+ * @param {string&} new_path 新的路径，已经存在时被替换
+ */
+void DiskManager::rename_file(const std::string& old_path, const std::string& new_path) {
+  if (path2fd_.count(old_path)) {
+    throw FileNotClosedError(old_path);
+  }
+  std::string old_map = old_path + COMPRESS_MAP_SUFFIX;
+  if (is_file(old_map) && std::rename(old_map.c_str(), (new_path + COMPRESS_MAP_SUFFIX).c_str()) < 0) {
+    throw UnixError();
+  }
+  if (std::rename(old_path.c_str(), new_path.c_str()) < 0) {
+    throw UnixError();
+  }
+}
+
 /**
  * @description: 根据文件句柄获得文件名
  * @return {string} 文件句柄对应文件的文件名
@@ -250,45 +857,279 @@ int DiskManager::get_file_fd(const std::string& file_name) {
 }
 
 /**
- * @description:  读取日志文件内容
- * @return {int} 返回读取的数据量，若为-1说明读取数据的起始位置超过了文件大小
+ * @description: 段文件的名称，段号补零到8位，按名称排序即按段号排序
+ * @param {int64_t} segment 段号
+ */
+std::string DiskManager::log_segment_name(int64_t segment) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%08lld", static_cast<long long>(segment));
+  return LOG_FILE_NAME + suffix;
+}
+
+/**
+ * @description: 第一次使用日志时扫描当前目录，找出已有的段。调用者持有log_latch_
+ */
+void DiskManager::open_log() {
+  if (log_opened_) {
+    return;
+  }
+  log_opened_ = true;
+  log_first_segment_ = 0;
+  log_last_segment_ = -1;
+  bool found = false;
+  std::string prefix = LOG_FILE_NAME + ".";
+  for (auto& entry : std::filesystem::directory_iterator(".")) {
+    std::string name = entry.path().filename().string();
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        !std::all_of(name.begin() + prefix.size(), name.end(), ::isdigit)) {
+      continue;
+    }
+    int64_t segment = std::stoll(name.substr(prefix.size()));
+    log_first_segment_ = found ? std::min(log_first_segment_, segment) : segment;
+    log_last_segment_ = found ? std::max(log_last_segment_, segment) : segment;
+    found = true;
+  }
+  log_end_ = log_first_segment_ * LOG_SEGMENT_SIZE;
+}
+
+/**
+ * @description: 切换到segment段，段文件不存在时创建并预分配LOG_SEGMENT_SIZE字节。
+ * 预分配后文件大小不再变化，每次写盘后的fdatasync不需要同步文件大小等元数据；
+ * 没有写过的部分读出来都是0，恢复时读到0就认为到了日志尾。调用者持有log_latch_
+ * @param {int64_t} segment 段号
+ */
+void DiskManager::switch_log_segment(int64_t segment) {
+  if (log_fd_segment_ == segment) {
+    return;
+  }
+  if (log_fd_ != -1) {
+    // 离开的段中可能还有没有fdatasync的日志
+    if (fdatasync(log_fd_) < 0) {
+      throw UnixError();
+    }
+    close(log_fd_);
+    log_fd_ = -1;
+    log_fd_segment_ = -1;
+  }
+  std::string name = log_segment_name(segment);
+  int fd = open(name.c_str(), O_RDWR);
+  if (fd == -1) {
+    fd = open(name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+      throw UnixError();
+    }
+    int rc = posix_fallocate(fd, 0, LOG_SEGMENT_SIZE);
+    if (rc == EOPNOTSUPP || rc == EINVAL) {
+      // 文件系统不支持预分配时用ftruncate定下文件大小，读出来同样是0
+      rc = ftruncate(fd, LOG_SEGMENT_SIZE) == -1 ? errno : 0;
+    }
+    if (rc != 0 || fsync(fd) == -1) {
+      close(fd);
+      throw UnixError();
+    }
+    sync_dir();
+    log_last_segment_ = std::max(log_last_segment_, segment);
+  }
+  log_fd_ = fd;
+  log_fd_segment_ = segment;
+}
+
+/**
+ * @description: 把当前目录落盘，段文件的创建、改名和删除在崩溃后仍然可见
+ */
+void DiskManager::sync_dir() {
+  int dir_fd = open(".", O_RDONLY | O_DIRECTORY);
+  if (dir_fd == -1) {
+    throw UnixError();
+  }
+  int rc = fsync(dir_fd);
+  close(dir_fd);
+  if (rc == -1) {
+    throw UnixError();
+  }
+}
+
+/**
+ * @description:  读取日志内容，读取范围可以跨越多个段
+ * @return {int} 返回读取的数据量，若为-1说明读取数据的起始位置早于最早保留的段
  * @param {char} *log_data 读取内容到log_data中
  * @param {int} size 读取的数据量大小
- * @param {int} offset 读取的内容在文件中的位置
+ * @param {int64_t} offset 读取的内容在日志中的逻辑偏移
  */
-int DiskManager::read_log(char* log_data, int size, int offset) {
-  // read log file from the previous end
-  if (log_fd_ == -1) {
-    log_fd_ = open_file(LOG_FILE_NAME);
-  }
-  int file_size = get_file_size(LOG_FILE_NAME);
-  if (offset > file_size) {
+int DiskManager::read_log(char* log_data, int size, int64_t offset) {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  if (offset < log_first_segment_ * LOG_SEGMENT_SIZE) {
     return -1;
   }
-
   // 得到实际读取的 size
-  size = std::min(size, file_size - offset);
-  if (size == 0) return 0;
-  lseek(log_fd_, offset, SEEK_SET);
-  ssize_t bytes_read = read(log_fd_, log_data, size);
-  assert(bytes_read == size);
-  return bytes_read;
+  int64_t limit = (log_last_segment_ + 1) * LOG_SEGMENT_SIZE;
+  size = static_cast<int>(std::min<int64_t>(size, std::max<int64_t>(limit - offset, 0)));
+  int done = 0;
+  while (done < size) {
+    int64_t segment = (offset + done) / LOG_SEGMENT_SIZE;
+    int64_t segment_offset = (offset + done) % LOG_SEGMENT_SIZE;
+    int n = static_cast<int>(std::min<int64_t>(size - done, LOG_SEGMENT_SIZE - segment_offset));
+    int fd = open(log_segment_name(segment).c_str(), O_RDONLY);
+    if (fd == -1) {
+      break;
+    }
+    ssize_t bytes_read = pread(fd, log_data + done, n, segment_offset);
+    close(fd);
+    if (bytes_read <= 0) {
+      break;
+    }
+    done += static_cast<int>(bytes_read);
+  }
+  return done;
 }
 
 /**
- * @description: 写日志内容
+ * @description: 在日志尾写日志内容，写到段尾时切换到下一个段
  * @param {char} *log_data 要写入的日志内容
  * @param {int} size 要写入的内容大小
  */
 void DiskManager::write_log(char* log_data, int size) {
-  if (log_fd_ == -1) {
-    log_fd_ = open_file(LOG_FILE_NAME);
+  std::lock_guard lock(log_latch_);
+  open_log();
+  int done = 0;
+  while (done < size) {
+    switch_log_segment(log_end_ / LOG_SEGMENT_SIZE);
+    int64_t segment_offset = log_end_ % LOG_SEGMENT_SIZE;
+    int n = static_cast<int>(std::min<int64_t>(size - done, LOG_SEGMENT_SIZE - segment_offset));
+    ssize_t bytes_write = pwrite(log_fd_, log_data + done, n, segment_offset);
+    if (bytes_write != n) {
+      throw UnixError();
+    }
+    done += n;
+    log_end_ += n;
   }
+}
 
-  // write from the file_end
-  lseek(log_fd_, 0, SEEK_END);
-  ssize_t bytes_write = write(log_fd_, log_data, size);
-  if (bytes_write != size) {
+/**
+ * @description: 把日志文件在内核中的缓存强制落盘，保证已写入的日志持久化
+ */
+void DiskManager::sync_log() {
+  std::lock_guard lock(log_latch_);
+  if (log_fd_ == -1) {
+    return;
+  }
+  if (fdatasync(log_fd_) < 0) {
     throw UnixError();
   }
 }
+
+/**
+ * @description: 最早保留的段的起始偏移，恢复从这里开始读日志
+ */
+int64_t DiskManager::get_log_begin() {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  return log_first_segment_ * LOG_SEGMENT_SIZE;
+}
+
+int64_t DiskManager::get_log_end() {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  return log_end_;
+}
+
+/**
+ * @description: 恢复时找到最后一条完整日志之后设置日志尾，之后的日志从这里开始写，覆盖崩溃时写了一半的内容
+ * @param {int64_t} end 日志尾的逻辑偏移
+ */
+void DiskManager::set_log_end(int64_t end) {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  log_end_ = end;
+}
+
+/**
+ * @description: 回收segment之前的段，调用者保证这些段中的日志恢复时都不再需要。
+ * 设置了归档函数时先把段交给它；空闲的段不超过LOG_SPARE_SEGMENTS个时把段清零后改名为之后的段号重复使用，
+ * 清零只把块标记为未写（FALLOC_FL_ZERO_RANGE），不实际写盘；否则删除
+ * @param {int64_t} segment 第一个保留的段号
+ */
+void DiskManager::recycle_log(int64_t segment) {
+  std::vector<int64_t> segments;
+  {
+    std::lock_guard lock(log_latch_);
+    open_log();
+    segment = std::min({segment, log_end_ / LOG_SEGMENT_SIZE, log_pin_segment_});
+    for (int64_t s = log_first_segment_; s < segment; ++s) {
+      segments.push_back(s);
+    }
+    log_first_segment_ = std::max(log_first_segment_, segment);
+  }
+  for (int64_t s : segments) {
+    std::string name = log_segment_name(s);
+    if (log_archiver_ && !log_archiver_(name)) {
+      // 归档失败，这个段和之后的段留到下一次回收
+      std::lock_guard lock(log_latch_);
+      log_first_segment_ = s;
+      break;
+    }
+    std::lock_guard lock(log_latch_);
+    bool recycled = false;
+    if (log_last_segment_ - log_end_ / LOG_SEGMENT_SIZE < LOG_SPARE_SEGMENTS) {
+      // 先改成不是段文件的名称再清零，崩溃时不会留下内容过时的段
+      std::string spare = LOG_FILE_NAME + ".recycle";
+      int fd = rename(name.c_str(), spare.c_str()) == 0 ? open(spare.c_str(), O_RDWR) : -1;
+      if (fd != -1) {
+        recycled = fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, LOG_SEGMENT_SIZE) == 0 && fdatasync(fd) == 0;
+        close(fd);
+        if (recycled) {
+          recycled = rename(spare.c_str(), log_segment_name(log_last_segment_ + 1).c_str()) == 0;
+        }
+        if (recycled) {
+          ++log_last_segment_;
+        } else {
+          unlink(spare.c_str());
+        }
+      }
+    }
+    if (!recycled) {
+      unlink(name.c_str());
+    }
+  }
+  if (!segments.empty()) {
+    std::lock_guard lock(log_latch_);
+    sync_dir();
+  }
+}
+
+/**
+ * @description: 在线备份开始时调用：之后的回收不再删除当前最早保留的段及之后的段，备份可以复制从这里开始的全部日志
+ * @return {int64_t} 被pin住的第一个段的起始偏移
+ */
+int64_t DiskManager::pin_log() {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  log_pin_segment_ = log_first_segment_;
+  return log_first_segment_ * LOG_SEGMENT_SIZE;
+}
+
+void DiskManager::unpin_log() {
+  std::lock_guard lock(log_latch_);
+  log_pin_segment_ = INT64_MAX;
+}
+
+/**
+ * @description: 删除全部日志段，之后的日志从偏移0重新开始。调用者保证日志缓冲区为空且数据页都已写回
+ */
+void DiskManager::truncate_log() {
+  std::lock_guard lock(log_latch_);
+  open_log();
+  if (log_fd_ != -1) {
+    close(log_fd_);
+    log_fd_ = -1;
+    log_fd_segment_ = -1;
+  }
+  for (int64_t s = log_first_segment_; s <= log_last_segment_; ++s) {
+    unlink(log_segment_name(s).c_str());
+  }
+  log_first_segment_ = 0;
+  log_last_segment_ = -1;
+  log_end_ = 0;
+  sync_dir();
+}
@@ -16,12 +16,16 @@ See the Mulan PSL v2 for more details. */
 
 #include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
 #include "common/config.h"
 #include "errors.h"
+#include "storage/io_uring.h"
 
 /**
  * @description: DiskManager的作用主要是根据上层的需要对磁盘文件进行操作
@@ -30,12 +34,22 @@ class DiskManager {
  public:
   explicit DiskManager();
 
-  ~DiskManager() = default;
+  ~DiskManager();
 
   void write_page(int fd, page_id_t page_no, const char* offset, int num_bytes);
 
   void read_page(int fd, page_id_t page_no, char* offset, int num_bytes);
 
+  void read_pages(PageIoRequest* requests, int num);
+
+  void write_pages(PageIoRequest* requests, int num);
+
+  // 把同一个文件的一批页面按页号排序，连续的整页合并成一次pwritev写入
+  void write_page_runs(int fd, PageIoRequest* requests, int num);
+
+  // 设置当前线程读写的I/O优先级，level为best-effort类中的级别（0最高7最低），-1恢复默认
+  static void set_thread_io_priority(int level);
+
   page_id_t allocate_page(int fd);
 
   void deallocate_page(page_id_t page_id);
@@ -58,20 +72,50 @@ class DiskManager {
 
   void close_file(int fd);
 
+  void truncate_file(int fd, page_id_t num_pages);
+
+  void sync_file(int fd);
+
   int get_file_size(const std::string& file_name);
 
+  // 改名一个已经关闭的文件，压缩文件的页面映射一起改名
+  void rename_file(const std::string& old_path, const std::string& new_path);
+
   std::string get_file_name(int fd);
 
   int get_file_fd(const std::string& file_name);
 
   /*日志操作*/
-  int read_log(char* log_data, int size, int offset);
+  // 日志在逻辑上是一个连续的字节流，按LOG_SEGMENT_SIZE切成预分配好的段文件db.log.<段号>，
+  // 逻辑偏移offset位于第offset / LOG_SEGMENT_SIZE段的offset % LOG_SEGMENT_SIZE处
+  int read_log(char* log_data, int size, int64_t offset);
 
   void write_log(char* log_data, int size);
 
-  void SetLogFd(int log_fd) { log_fd_ = log_fd; }
+  void sync_log();
+
+  int64_t get_log_begin();
+
+  int64_t get_log_end();
+
+  void set_log_end(int64_t end);
+
+  void recycle_log(int64_t segment);
 
-  int GetLogFd() { return log_fd_; }
+  void truncate_log();
+
+  // 在线备份期间不回收当前最早保留的段及之后的段，返回这个段的起始偏移；unpin_log后恢复回收
+  int64_t pin_log();
+
+  void unpin_log();
+
+  // 第segment段的文件名
+  static std::string log_segment_name(int64_t segment);
+
+  // 段被回收之前调用，参数为段文件名，可以用来把段复制到归档目录；返回false时段保留到下一次回收
+  void set_log_archiver(std::function<bool(const std::string&)> archiver) {
+    log_archiver_ = std::move(archiver);
+  }
 
   /**
    * @description: 设置文件已经分配的页面个数
@@ -91,16 +135,79 @@ class DiskManager {
    */
   page_id_t get_fd2pageno(int fd) { return fd2pageno_[fd]; }
 
+  /**
+   * @description: 设置文件每次预分配的页数，allocate_page越过已预分配的范围时用fallocate一次为文件预留一段连续空间
+   * @param {int} fd 文件对应的句柄
+   * @param {int} extent_pages 每次预分配的页数，0表示不预分配
+   */
+  void set_file_extent(int fd, int extent_pages) {
+    extent_pages_[fd] = extent_pages;
+  }
+
+  /**
+   * @description: 设置文件的页面是否常驻缓冲池：常驻文件的页面读入后一直pin住，不会被换出，pin和unpin不再修改pin计数。
+   * 要在文件的页面进入缓冲池之前设置，之前已经在缓冲池中的页面不受影响
+   * @param {int} fd 文件对应的句柄
+   * @param {bool} in_memory 是否常驻
+   */
+  void set_file_in_memory(int fd, bool in_memory) { in_memory_fd_[fd] = in_memory; }
+
+  bool is_file_in_memory(int fd) const {
+    return in_memory_fd_[fd].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @description: 把一个已经关闭的文件改为压缩存储：之后write_page把页面压缩后写入变长的槽位，read_page解压，
+   * 缓冲池中仍然是未压缩的页面。文件中已有的页面原样登记为不压缩的槽位，重写时才压缩
+   * @param {string&} path 文件路径
+   */
+  void compress_file(const std::string& path);
+
+  bool is_file_compressed(int fd) const { return compressed_[fd] != nullptr; }
+
   static constexpr int MAX_FD = 8192;
 
  private:
+  void submit_pages(PageIoRequest* requests, int num, bool is_write);
+
+  void extend_file(int fd, page_id_t page_no);
+
+  void open_log();
+
+  void switch_log_segment(int64_t segment);
+
+  void sync_dir();
+
+  struct CompressedFile;
+
+  void write_compressed_page(int fd, page_id_t page_no, const char* data, int num_bytes);
+
+  void read_compressed_page(int fd, page_id_t page_no, char* data, int num_bytes);
+
+  void sync_compressed_file(int fd);
+
   // 文件打开列表，用于记录文件是否被打开
   std::unordered_map<std::string, int>
       path2fd_;  //<Page文件磁盘路径,Page fd>哈希表
   std::unordered_map<int, std::string>
       fd2path_;  //<Page fd,Page文件磁盘路径>哈希表
 
-  int log_fd_ = -1;  // WAL日志文件的文件句柄，默认为-1，代表未打开日志文件
+  std::mutex log_latch_;              // 保护日志段的状态，写盘由LogManager串行化，只和回收段互斥
+  bool log_opened_ = false;           // 是否已经扫描过已有的段
+  int log_fd_ = -1;                   // 当前写入的段文件的文件句柄，-1代表未打开
+  int64_t log_fd_segment_ = -1;       // log_fd_对应的段号
+  int64_t log_first_segment_ = 0;     // 最早保留的段号
+  int64_t log_last_segment_ = -1;     // 已经创建的最大段号，日志尾之后可能有回收来的空闲段
+  int64_t log_end_ = 0;               // 日志尾的逻辑偏移，下一次写日志的位置
+  int64_t log_pin_segment_ = INT64_MAX;  // 在线备份pin住的第一个段，回收不越过它，INT64_MAX表示没有备份
+  std::function<bool(const std::string&)> log_archiver_;  // 归档函数，为空时不归档
+  bool direct_fd_[MAX_FD]{};  // 文件是否以O_DIRECT方式打开
   std::atomic<page_id_t>
       fd2pageno_[MAX_FD]{};  // 文件中已经分配的页面个数，初始值为0
+  std::atomic<int> extent_pages_[MAX_FD]{};  // 文件每次预分配的页数，0表示不预分配
+  std::atomic<bool> in_memory_fd_[MAX_FD]{};  // 文件的页面是否常驻缓冲池
+  std::atomic<page_id_t>
+      extent_end_[MAX_FD]{};  // 文件已预分配到的页号（不含），之前的页面写入时不需要再分配磁盘块
+  std::mutex extent_latch_;   // 串行化fallocate，避免多个线程重复预分配同一段
+  std::unique_ptr<CompressedFile> compressed_[MAX_FD];  // 压缩文件的页面映射，不压缩的文件为nullptr
 };
@@ -0,0 +1,174 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "storage/io_uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "errors.h"
+
+namespace {
+inline int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+inline int io_uring_enter(int ring_fd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+inline unsigned load_acquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void store_release(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+}  // namespace
+
+/**
+ * @description: 创建io_uring并映射提交队列、完成队列和SQE数组，失败时保持is_valid()为false
+ * @param {unsigned} entries 提交队列的大小
+ */
+IoUring::IoUring(unsigned entries) {
+  io_uring_params params{};
+  int fd = io_uring_setup(entries, &params);
+  if (fd < 0) {
+    return;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    close(fd);
+    return;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = nullptr;
+      close(fd);
+      return;
+    }
+  }
+  void* sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = cq_ring_ = nullptr;
+    close(fd);
+    return;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  auto* sq = static_cast<char*>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  auto* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  sq_entries_ = params.sq_entries;
+  ring_fd_ = fd;
+}
+
+IoUring::~IoUring() {
+  if (ring_fd_ == -1) {
+    return;
+  }
+  munmap(sqes_, sq_entries_ * sizeof(io_uring_sqe));
+  if (cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  munmap(sq_ring_, sq_ring_size_);
+  close(ring_fd_);
+}
+
+/**
+ * @description: 把一批请求一次性放入提交队列，一次io_uring_enter提交并等待全部完成
+ * @param {PageIoRequest*} requests 请求数组，完成后填写每个请求的res_
+ * @param {int} num 请求个数
+ * @param {bool} is_write true为写，false为读
+ */
+void IoUring::submit_and_wait(PageIoRequest* requests, int num,
+                              bool is_write) {
+  if (num <= 0) {
+    return;
+  }
+  if (static_cast<unsigned>(num) > sq_entries_) {
+    throw InternalError("IoUring::submit_and_wait: too many requests");
+  }
+
+  unsigned tail = *sq_tail_;
+  unsigned mask = *sq_mask_;
+  for (int i = 0; i < num; ++i) {
+    unsigned index = (tail + i) & mask;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = requests[i].fd;
+    sqe->addr = reinterpret_cast<uint64_t>(requests[i].data);
+    sqe->len = requests[i].num_bytes;
+    sqe->off = static_cast<uint64_t>(requests[i].page_no) * PAGE_SIZE;
+    sqe->user_data = static_cast<uint64_t>(i);
+    sq_array_[index] = index;
+  }
+  store_release(sq_tail_, tail + num);
+
+  int submitted = 0;
+  int completed = 0;
+  while (completed < num) {
+    int ret = io_uring_enter(ring_fd_, num - submitted, 1,
+                             IORING_ENTER_GETEVENTS);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw UnixError();
+    }
+    submitted += ret;
+
+    unsigned head = *cq_head_;
+    unsigned cq_tail = load_acquire(cq_tail_);
+    for (; head != cq_tail; ++head) {
+      io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      requests[cqe->user_data].res_ = cqe->res;
+      ++completed;
+    }
+    store_release(cq_head_, head);
+  }
+}
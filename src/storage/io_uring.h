@@ -0,0 +1,67 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include "common/config.h"
+
+/* 一次页面读写请求，提交后由内核异步完成，完成后res_为读写的字节数或-errno */
+struct PageIoRequest {
+  int fd;
+  page_id_t page_no;
+  char* data;
+  int num_bytes;
+  int res_ = 0;
+};
+
+/**
+ * @description: 直接基于io_uring系统调用的最小封装，不依赖liburing。
+ * 一个IoUring只能被一个线程使用，DiskManager为每个线程准备一个
+ */
+class IoUring {
+ public:
+  explicit IoUring(unsigned entries);
+
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // 内核不支持或被禁止（如容器seccomp）时为false，调用者应退回同步读写
+  bool is_valid() const { return ring_fd_ != -1; }
+
+  unsigned get_entries() const { return sq_entries_; }
+
+  // 批量提交读/写请求并等待全部完成，请求数不能超过get_entries()
+  void submit_and_wait(PageIoRequest* requests, int num, bool is_write);
+
+ private:
+  int ring_fd_ = -1;
+  unsigned sq_entries_ = 0;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+};
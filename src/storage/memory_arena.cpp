@@ -0,0 +1,142 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "storage/memory_arena.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <new>
+#include <string>
+
+namespace {
+inline size_t round_up(size_t n, size_t align) {
+  return (n + align - 1) / align * align;
+}
+
+// 解析 "0-3,8,10-11" 形式的列表，对其中每个数调用func
+template <typename Func>
+void parse_list(const std::string& list, Func&& func) {
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    size_t dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      for (int i = first; i <= last; ++i) {
+        func(i);
+      }
+    } catch (std::exception&) {
+      return;
+    }
+    pos = end + 1;
+  }
+}
+
+std::string read_first_line(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+}  // namespace
+
+/**
+ * @description: 预留size字节的匿名内存
+ * @param {size_t} size 需要的字节数
+ * @param {int} numa_node 优先分配内存的NUMA节点，-1表示不绑定
+ * @param {bool} huge_pages 是否使用大页
+ */
+MemoryArena::MemoryArena(size_t size, int numa_node, bool huge_pages) {
+  if (huge_pages && ENABLE_HUGETLB) {
+    // 不能带MAP_NORESERVE：大页不够时应该在这里失败退回普通页，而不是在访问时收到SIGBUS
+    size_ = round_up(size, HUGE_PAGE_SIZE);
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+      data_ = static_cast<char*>(addr);
+      huge_tlb_ = true;
+    }
+  }
+  if (data_ == nullptr) {
+    size_ = round_up(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    data_ = static_cast<char*>(addr);
+    // 透明大页只是建议，内核不支持时忽略
+    if (huge_pages) {
+      madvise(data_, size_, MADV_HUGEPAGE);
+    }
+  }
+  // 在第一次访问之前设置内存策略，物理页才会分配在该节点上；
+  // 用PREFERRED而不是BIND，节点内存不足时可以退到其他节点
+  if (numa_node >= 0 &&
+      numa_node < static_cast<int>(sizeof(unsigned long) * 8)) {
+    unsigned long node_mask = 1UL << numa_node;
+    syscall(SYS_mbind, data_, size_, MPOL_PREFERRED, &node_mask,
+            sizeof(node_mask) * 8, 0);
+  }
+}
+
+MemoryArena::~MemoryArena() { munmap(data_, size_); }
+
+void MemoryArena::release(size_t offset, size_t len) {
+  // MAP_HUGETLB的映射只能按整个大页释放
+  size_t granularity = huge_tlb_ ? HUGE_PAGE_SIZE
+                                 : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t begin = round_up(offset, granularity);
+  size_t end = (offset + len) / granularity * granularity;
+  if (begin < end) {
+    madvise(data_ + begin, end - begin, MADV_DONTNEED);
+  }
+}
+
+int get_numa_nodes() {
+  static const int num_nodes = [] {
+    int max_node = -1;
+    parse_list(read_first_line("/sys/devices/system/node/online"),
+               [&max_node](int node) { max_node = std::max(max_node, node); });
+    return max_node < 0 ? 1 : max_node + 1;
+  }();
+  return num_nodes;
+}
+
+void bind_thread_to_numa_node(int numa_node) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  bool found = false;
+  parse_list(read_first_line("/sys/devices/system/node/node" +
+                             std::to_string(numa_node) + "/cpulist"),
+             [&cpus, &found](int cpu) {
+               if (cpu < CPU_SETSIZE) {
+                 CPU_SET(cpu, &cpus);
+                 found = true;
+               }
+             });
+  if (found) {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+}
@@ -0,0 +1,51 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/config.h"
+
+/**
+ * @description: 一段用mmap预留的连续匿名内存，只有被访问过的页才占用物理内存。
+ * huge_pages为true时先尝试MAP_HUGETLB，失败（系统没有预留大页）时退回普通页并建议内核使用透明大页；
+ * numa_node不为-1时把这段内存优先分配在该NUMA节点上
+ */
+class MemoryArena {
+ public:
+  MemoryArena(size_t size, int numa_node = -1, bool huge_pages = false);
+
+  ~MemoryArena();
+
+  MemoryArena(const MemoryArena&) = delete;
+  MemoryArena& operator=(const MemoryArena&) = delete;
+
+  char* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  // 是否使用了MAP_HUGETLB的大页
+  bool is_huge_tlb() const { return huge_tlb_; }
+
+  // 把[offset, offset + len)中完整的页还给操作系统，之后读到的是全0
+  void release(size_t offset, size_t len);
+
+ private:
+  char* data_ = nullptr;
+  size_t size_ = 0;  // 映射的大小，按页面粒度向上取整
+  bool huge_tlb_ = false;
+};
+
+// 系统中NUMA节点的个数，无法获取时为1
+int get_numa_nodes();
+
+// 把当前线程绑定到numa_node的CPU上，失败时保持原样
+void bind_thread_to_numa_node(int numa_node);
@@ -10,11 +10,14 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 
 #include "common/config.h"
 #include "rwlatch.h"
 
+class BufferPoolInstance;
+
 /**
  * @description: 存储层每个Page的id的声明
  */
@@ -72,7 +75,11 @@ class Page {
   friend class BufferPoolInstance;
 
  public:
-  Page() { reset_memory(); }
+  // 页面数据由BufferPoolInstance统一分配在按页对齐的连续内存中，绑定data_后才能使用
+  Page() = default;
+
+  // 缓冲池之外的页面镜像（如批量导入直接写盘的页面），data由调用者分配
+  explicit Page(char* data) : data_(data) {}
 
   ~Page() = default;
 
@@ -82,6 +89,8 @@ class Page {
 
   inline bool is_dirty() const { return is_dirty_; }
 
+  // 表数据页面和索引页面的前 4 个字节都存放页面 lsn（最后一次修改该页面的日志号），
+  // 页头从 OFFSET_PAGE_HDR 开始；淘汰或刷盘前缓冲池保证日志已经持久化到该 lsn
   static constexpr size_t OFFSET_PAGE_START = 0;
   static constexpr size_t OFFSET_LSN = 0;
   static constexpr size_t OFFSET_PAGE_HDR = 4;
@@ -94,38 +103,94 @@ class Page {
     memcpy(get_data() + OFFSET_LSN, &page_lsn, sizeof(lsn_t));
   }
 
-  inline void WLatch() { rwlatch_.WLock(); }
+  // recLSN：页面从干净变脏时的第一条日志号，模糊检查点据此记录脏页表，恢复时从最小的recLSN开始重做
+  inline lsn_t get_rec_lsn() const { return rec_lsn_.load(); }
+
+  inline void update_rec_lsn(lsn_t lsn) {
+    lsn_t expected = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(expected, lsn);
+  }
+
+  inline void clear_rec_lsn() { rec_lsn_.store(INVALID_LSN); }
 
-  inline void WUnlatch() { rwlatch_.WUnlock(); }
+  // 写锁的加锁和解锁各把版本号加一，持有写锁期间版本号为奇数
+  inline void WLatch() {
+    rwlatch_.WLock();
+    version_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  inline void WUnlatch() {
+    version_.fetch_add(1, std::memory_order_release);
+    rwlatch_.WUnlock();
+  }
 
   inline void RLatch() { rwlatch_.RLock(); }
 
   inline void RUnlatch() { rwlatch_.RUnlock(); }
 
+  inline bool TryRLatch() { return rwlatch_.TryRLock(); }
+
+  /**
+   * @description: 乐观读：不加锁，记下当前版本号，读完后用validate_version检查期间没有写者
+   * @return {uint64_t} 当前版本号，为奇数时说明有写者正持有写锁，调用者应该重试或者加读锁
+   */
+  inline uint64_t get_version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  // 乐观读结束时调用，版本号没有变化说明读到的是一致的页面内容
+  inline bool validate_version(uint64_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
   inline int get_pin_count() const { return pin_count_; }
 
+  // 常驻页面：所在文件被设置为常驻，读入缓冲池时留下一个不会放掉的pin，之后的pin和unpin都不再修改pin计数
+  inline bool is_in_memory() const { return in_memory_.load(std::memory_order_relaxed); }
+
+  // 页面所在的缓冲池实例和帧，缓冲池之外的页面镜像为空
+  inline BufferPoolInstance* get_pool() const { return pool_; }
+
+  inline frame_id_t get_frame_id() const { return frame_id_; }
+
  private:
   void reset_memory() {
     // 将 data_ 的 PAGE_SIZE 个字节填充为 0
     memset(data_, OFFSET_PAGE_START, PAGE_SIZE);
     // 设置初始 lsn
     set_page_lsn(INVALID_LSN);
+    clear_rec_lsn();
   }
 
   /** page的唯一标识符 */
   PageId id_;
 
   /** The actual data that is stored within a page.
-   *  该页面在bufferPool中的偏移地址
+   *  该页面在bufferPool中的偏移地址，按PAGE_SIZE对齐，可以直接用于O_DIRECT读写
    */
-  char data_[PAGE_SIZE] = {};
+  char* data_ = nullptr;
+
+  /** 脏页判断，unpin_page不持有缓冲池latch_时设置 */
+  std::atomic<bool> is_dirty_{false};
+
+  /** 页面变脏后第一条修改日志的lsn，写回磁盘后清空 */
+  std::atomic<lsn_t> rec_lsn_{INVALID_LSN};
 
-  /** 脏页判断 */
-  bool is_dirty_ = false;
+  /** The pin count of this page. unpin_page不持有缓冲池latch_，用原子操作递减 */
+  std::atomic<int> pin_count_{0};
 
-  /** The pin count of this page. */
-  int pin_count_ = 0;
+  /** 常驻页面，常驻文件的页面在插入页表之前设置，B+树的上层结点在被pin住时设置，帧被回收时清除 */
+  std::atomic<bool> in_memory_{false};
 
   /** 页读写锁 */
   RWLatch rwlatch_;
+
+  /** 乐观读的版本号，每次加写锁和解写锁时加一 */
+  std::atomic<uint64_t> version_{0};
+
+  /** 所在的缓冲池实例和帧号，构造帧时设置，之后不再改变。持有pin的调用者据此放掉pin，不用再查页表 */
+  BufferPoolInstance* pool_ = nullptr;
+  frame_id_t frame_id_ = INVALID_FRAME_ID;
 };
@@ -0,0 +1,161 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "storage/page_compressor.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+constexpr int MIN_MATCH = 4;
+constexpr int LAST_LITERALS = 5;  // 结尾的几个字节总是作为字面量输出，匹配不会延伸到末尾
+constexpr int MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 12;
+
+inline uint32_t read32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t hash4(uint32_t v) { return (v * 2654435761U) >> (32 - HASH_BITS); }
+
+// 写出长度的扩展字节，返回写完后的位置，空间不足时返回-1
+inline int put_length(char* dest, int op, int capacity, int len) {
+  while (len >= 255) {
+    if (op >= capacity) {
+      return -1;
+    }
+    dest[op++] = static_cast<char>(255);
+    len -= 255;
+  }
+  if (op >= capacity) {
+    return -1;
+  }
+  dest[op++] = static_cast<char>(len);
+  return op;
+}
+
+/**
+ * @description: 输出一个序列：literals开始的lit_len个字面量，之后是距离offset、长度match_len的匹配，match_len为0时没有匹配
+ * @return {int} 写完后的位置，空间不足时返回-1
+ */
+int put_sequence(char* dest, int op, int capacity, const char* literals, int lit_len, int offset, int match_len) {
+  if (op >= capacity) {
+    return -1;
+  }
+  int token_pos = op++;
+  int match_code = match_len == 0 ? 0 : match_len - MIN_MATCH;
+  dest[token_pos] = static_cast<char>(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+  if (lit_len >= 15 && (op = put_length(dest, op, capacity, lit_len - 15)) < 0) {
+    return -1;
+  }
+  if (op + lit_len > capacity) {
+    return -1;
+  }
+  memcpy(dest + op, literals, lit_len);
+  op += lit_len;
+  if (match_len == 0) {
+    return op;
+  }
+  if (op + 2 > capacity) {
+    return -1;
+  }
+  dest[op++] = static_cast<char>(offset & 0xff);
+  dest[op++] = static_cast<char>(offset >> 8);
+  if (match_code >= 15 && (op = put_length(dest, op, capacity, match_code - 15)) < 0) {
+    return -1;
+  }
+  return op;
+}
+
+// 读出长度的扩展字节累加到len上，数据不完整时返回false
+inline bool get_length(const unsigned char* src, int& ip, int len, int& value) {
+  unsigned char byte;
+  do {
+    if (ip >= len) {
+      return false;
+    }
+    byte = src[ip++];
+    value += byte;
+  } while (byte == 255);
+  return true;
+}
+}  // namespace
+
+int page_compress(const char* src, int len, char* dest, int capacity) {
+  int table[1 << HASH_BITS];
+  memset(table, -1, sizeof(table));
+  int ip = 0;
+  int anchor = 0;
+  int op = 0;
+  int match_limit = len - LAST_LITERALS;
+  while (ip + MIN_MATCH <= match_limit) {
+    uint32_t value = read32(src + ip);
+    uint32_t h = hash4(value);
+    int candidate = table[h];
+    table[h] = ip;
+    if (candidate < 0 || ip - candidate > MAX_OFFSET || read32(src + candidate) != value) {
+      ++ip;
+      continue;
+    }
+    int match_len = MIN_MATCH;
+    while (ip + match_len < match_limit && src[candidate + match_len] == src[ip + match_len]) {
+      ++match_len;
+    }
+    op = put_sequence(dest, op, capacity, src + anchor, ip - anchor, ip - candidate, match_len);
+    if (op < 0) {
+      return -1;
+    }
+    ip += match_len;
+    anchor = ip;
+  }
+  return put_sequence(dest, op, capacity, src + anchor, len - anchor, 0, 0);
+}
+
+int page_decompress(const char* src, int len, char* dest, int capacity) {
+  const auto* in = reinterpret_cast<const unsigned char*>(src);
+  int ip = 0;
+  int op = 0;
+  while (ip < len) {
+    int token = in[ip++];
+    int lit_len = token >> 4;
+    if (lit_len == 15 && !get_length(in, ip, len, lit_len)) {
+      return -1;
+    }
+    if (lit_len > len - ip || lit_len > capacity - op) {
+      return -1;
+    }
+    memcpy(dest + op, src + ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == len) {
+      break;  // 最后一个序列只有字面量
+    }
+    if (ip + 2 > len) {
+      return -1;
+    }
+    int offset = in[ip] | (in[ip + 1] << 8);
+    ip += 2;
+    int match_len = token & 15;
+    if (match_len == 15 && !get_length(in, ip, len, match_len)) {
+      return -1;
+    }
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > op || match_len > capacity - op) {
+      return -1;
+    }
+    // 匹配可以和自己重叠（距离小于长度时重复前面的字节），逐字节复制
+    for (int i = 0; i < match_len; ++i, ++op) {
+      dest[op] = dest[op - offset];
+    }
+  }
+  return op;
+}
@@ -0,0 +1,31 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+/**
+ * @description: 页面压缩用的LZ压缩算法，编码沿用LZ4的块格式：每个序列是一个token（高4位字面量长度，低4位匹配长度减4，
+ * 取15时后面跟着255累加的扩展字节）、字面量、2字节小端的匹配距离和匹配长度的扩展字节，最后一个序列只有字面量。
+ * 只用一张4096项的哈希表找匹配，压缩一个4KB页面的开销很小，适合空槽位、定长字符串补齐的0和重复值多的数据页
+ */
+
+/**
+ * @description: 压缩src中的len个字节
+ * @return {int} 压缩后的长度，压缩结果超过capacity时返回-1
+ * @param {char*} dest 压缩结果，至少capacity个字节
+ */
+int page_compress(const char* src, int len, char* dest, int capacity);
+
+/**
+ * @description: 解压page_compress的结果
+ * @return {int} 解压后的长度，数据损坏或者解压结果超过capacity时返回-1
+ * @param {char*} dest 解压结果，至少capacity个字节
+ */
+int page_decompress(const char* src, int len, char* dest, int capacity);
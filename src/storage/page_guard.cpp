@@ -33,7 +33,7 @@ auto BasicPageGuard::operator=(BasicPageGuard&& that) noexcept
 
 void BasicPageGuard::Drop() {
   if (bpm_ && page_) {
-    bpm_->unpin_page(page_->get_page_id(), is_dirty_);
+    bpm_->unpin_page(page_, is_dirty_);
   }
 
   bpm_ = nullptr;
@@ -61,6 +61,14 @@ auto BasicPageGuard::UpgradeWrite() -> WritePageGuard {
   return write_page_guard;
 }
 
+auto BasicPageGuard::UpgradeOptimistic() -> OptimisticReadPageGuard {
+  OptimisticReadPageGuard optimistic_guard(bpm_, page_);
+  bpm_ = nullptr;
+  page_ = nullptr;
+  is_dirty_ = false;
+  return optimistic_guard;
+}
+
 ReadPageGuard::ReadPageGuard(ReadPageGuard&& that) noexcept = default;
 
 auto ReadPageGuard::operator=(ReadPageGuard&& that) noexcept -> ReadPageGuard& {
@@ -10,6 +10,7 @@
 class BufferPoolManager;
 class ReadPageGuard;
 class WritePageGuard;
+class OptimisticReadPageGuard;
 
 class BasicPageGuard {
  public:
@@ -34,6 +35,8 @@ class BasicPageGuard {
 
   auto UpgradeWrite() -> WritePageGuard;
 
+  auto UpgradeOptimistic() -> OptimisticReadPageGuard;
+
   auto GetPageId() const -> PageId { return page_->get_page_id(); }
   auto GetData() const -> const char* { return page_->get_data(); }
 
@@ -55,6 +58,7 @@ class BasicPageGuard {
  private:
   friend ReadPageGuard;
   friend WritePageGuard;
+  friend OptimisticReadPageGuard;
   BufferPoolManager* bpm_{nullptr};
   Page* page_{nullptr};
   bool is_dirty_{false};
@@ -128,4 +132,48 @@ class WritePageGuard {
  private:
   BasicPageGuard guard_;
 };
+/**
+ * 乐观读：只pin住页面，不加读锁。构造时记下页面版本号，读到的内容要在Validate()返回true之后才能使用；
+ * 返回false说明读的过程中有写者修改了页面，需要重新读或者改用ReadPageGuard
+ */
+class OptimisticReadPageGuard {
+ public:
+  OptimisticReadPageGuard() = default;
+
+  OptimisticReadPageGuard(BufferPoolManager* bpm, Page* page)
+      : guard_(bpm, page), version_(page->get_version()) {}
+
+  OptimisticReadPageGuard(const OptimisticReadPageGuard&) = delete;
+  auto operator=(const OptimisticReadPageGuard&)
+      -> OptimisticReadPageGuard& = delete;
+
+  OptimisticReadPageGuard(OptimisticReadPageGuard&& that) noexcept = default;
+
+  auto operator=(OptimisticReadPageGuard&& that) noexcept
+      -> OptimisticReadPageGuard& = default;
+
+  void Drop() { guard_.Drop(); }
+
+  auto GetPageId() const -> PageId { return guard_.GetPageId(); }
+
+  auto GetData() const -> const char* { return guard_.GetData(); }
+
+  template <class T>
+  auto As() -> const T* {
+    return guard_.As<T>();
+  }
+
+  // 开始读时有写者持有写锁
+  auto IsLocked() const -> bool { return (version_ & 1) != 0; }
+
+  // 从构造到现在页面没有被修改过
+  auto Validate() const -> bool {
+    return !IsLocked() && guard_.page_->validate_version(version_);
+  }
+
+ private:
+  BasicPageGuard guard_;
+  uint64_t version_{0};
+};
+
 #endif  // PAGE_GUARD_H
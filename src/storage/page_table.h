@@ -0,0 +1,120 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "common/config.h"
+#include "storage/page.h"
+#include "storage/rwlatch.h"
+
+/**
+ * @description: 缓冲池实例的页表，PageId -> frame_id。按PageId的哈希分成PAGE_TABLE_PARTITIONS个分区，
+ * 每个分区一把读写锁：命中路径只拿分区的读锁，插入删除拿分区的写锁。
+ * 插入删除只在持有BufferPoolInstance::latch_时进行，所以持有latch_的线程遍历页表不会看到结构变化
+ */
+class PageTable {
+ public:
+  explicit PageTable(size_t capacity) : partitions_(new Partition[PAGE_TABLE_PARTITIONS]) {
+    for (size_t i = 0; i < PAGE_TABLE_PARTITIONS; ++i) {
+      partitions_[i].map_.reserve(capacity / PAGE_TABLE_PARTITIONS + 1);
+    }
+  }
+
+  /**
+   * @description: 在分区读锁内查找page_id，找到时调用func(frame_id)
+   * @return {bool} 是否找到
+   */
+  template <typename Func>
+  bool find(const PageId& page_id, Func&& func) const {
+    auto& partition = get_partition(page_id);
+    std::shared_lock lock(partition.latch_);
+    auto it = partition.map_.find(page_id);
+    if (it == partition.map_.end()) {
+      return false;
+    }
+    func(it->second);
+    return true;
+  }
+
+  bool find(const PageId& page_id, frame_id_t* frame_id) const {
+    return find(page_id, [frame_id](frame_id_t frame) { *frame_id = frame; });
+  }
+
+  bool contains(const PageId& page_id) const {
+    return find(page_id, [](frame_id_t) {});
+  }
+
+  void insert(const PageId& page_id, frame_id_t frame_id) {
+    auto& partition = get_partition(page_id);
+    std::unique_lock lock(partition.latch_);
+    partition.map_[page_id] = frame_id;
+  }
+
+  /**
+   * @description: 在分区写锁内，page_id映射到frame_id且pred(frame_id)为true时删除映射。
+   * 命中路径在读锁内pin页面，淘汰者在写锁内检查pin计数，两者不会交错
+   * @return {bool} 是否删除
+   */
+  template <typename Pred>
+  bool erase_if(const PageId& page_id, frame_id_t frame_id, Pred&& pred) {
+    auto& partition = get_partition(page_id);
+    std::unique_lock lock(partition.latch_);
+    auto it = partition.map_.find(page_id);
+    if (it == partition.map_.end() || it->second != frame_id || !pred(frame_id)) {
+      return false;
+    }
+    partition.map_.erase(it);
+    return true;
+  }
+
+  bool erase(const PageId& page_id, frame_id_t frame_id) {
+    return erase_if(page_id, frame_id, [](frame_id_t) { return true; });
+  }
+
+  /**
+   * @description: 遍历所有映射，调用者必须持有latch_，func中不能修改页表
+   */
+  template <typename Func>
+  void for_each(Func&& func) const {
+    for (size_t i = 0; i < PAGE_TABLE_PARTITIONS; ++i) {
+      for (auto& [page_id, frame_id] : partitions_[i].map_) {
+        func(page_id, frame_id);
+      }
+    }
+  }
+
+  size_t size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < PAGE_TABLE_PARTITIONS; ++i) {
+      std::shared_lock lock(partitions_[i].latch_);
+      size += partitions_[i].map_.size();
+    }
+    return size;
+  }
+
+ private:
+  struct alignas(64) Partition {
+    mutable RWLatch latch_;
+    std::unordered_map<PageId, frame_id_t> map_;
+  };
+
+  Partition& get_partition(const PageId& page_id) const {
+    // 低位已经被用来选择缓冲池实例，打散后取高位
+    uint64_t h = std::hash<PageId>{}(page_id) * 0x9E3779B97F4A7C15ULL;
+    return partitions_[(h >> 32) % PAGE_TABLE_PARTITIONS];
+  }
+
+  std::unique_ptr<Partition[]> partitions_;
+};
@@ -5,20 +5,261 @@
 #ifndef RWLATCH_H
 #define RWLATCH_H
 
-#include <shared_mutex>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#include "common/config.h"
+
+// 在addr上睡眠，直到被唤醒或者*addr不再等于val
+inline void futex_wait(std::atomic<uint32_t>* addr, uint32_t val) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, val,
+          nullptr, nullptr, 0);
+}
+
+inline void futex_wake_all(std::atomic<uint32_t>* addr) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE,
+          INT_MAX, nullptr, nullptr, 0);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+/**
+ * @description: 先自旋再睡眠的互斥锁，用于很短的临界区：临界区比一次睡眠唤醒短时，自旋等待的线程不用进内核。
+ * 状态0为空闲，1为被持有，2为被持有且可能有线程在futex上睡眠，解锁时只有状态为2才唤醒
+ */
+class HybridMutex {
+ public:
+  void lock() {
+    uint32_t s = 0;
+    if (state_.compare_exchange_strong(s, 1, std::memory_order_acquire)) {
+      return;
+    }
+    for (int i = 0; i < LATCH_SPIN_LIMIT; ++i) {
+      cpu_relax();
+      s = 0;
+      if (state_.load(std::memory_order_relaxed) == 0 &&
+          state_.compare_exchange_weak(s, 1, std::memory_order_acquire)) {
+        return;
+      }
+    }
+    // 睡眠前把状态改为2，醒来后也按2获取，因为可能还有其他线程在睡眠
+    while (state_.exchange(2, std::memory_order_acquire) != 0) {
+      futex_wait(&state_, 2);
+    }
+  }
+
+  bool try_lock() {
+    uint32_t s = 0;
+    return state_.compare_exchange_strong(s, 1, std::memory_order_acquire);
+  }
+
+  void unlock() {
+    if (state_.exchange(0, std::memory_order_release) == 2) {
+      futex_wake_all(&state_);
+    }
+  }
+
+ private:
+  std::atomic<uint32_t> state_{0};
+};
+
+/**
+ * @description: 页面的读写锁，只占一个32位字：低位是读者个数，另有写者持有、写者等待和有线程睡眠三个标志位。
+ * 写者优先：有写者在等待时新的读者不再进入，避免写者被源源不断的读者饿死。
+ * 拿不到锁时先自旋LATCH_SPIN_LIMIT次，之后在这个字上用futex睡眠；只有睡眠标志被置位时解锁才进内核唤醒。
+ * 临界区很短的小锁（例如页表的分区锁）也用它代替std::shared_mutex
+ */
 class RWLatch {
  public:
-  void WLock() { mutex_.lock(); }
+  void WLock() {
+    int spins = 0;
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    while (true) {
+      if ((s & (WRITER_HELD | READER_MASK)) == 0) {
+        // 拿到锁时清掉等待标志，其他还在等待的写者会重新设置
+        if (state_.compare_exchange_weak(s, (s & PARKED) | WRITER_HELD,
+                                         std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      if ((s & WRITER_WAITING) == 0) {
+        if (!state_.compare_exchange_weak(s, s | WRITER_WAITING,
+                                          std::memory_order_relaxed)) {
+          continue;
+        }
+        s |= WRITER_WAITING;
+      }
+      s = backoff(s, spins);
+    }
+  }
+
+  void WUnlock() {
+    uint32_t s =
+        state_.fetch_and(~(WRITER_HELD | PARKED), std::memory_order_release);
+    if (s & PARKED) {
+      futex_wake_all(&state_);
+    }
+  }
+
+  void RLock() {
+    int spins = 0;
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    while (true) {
+      if ((s & (WRITER_HELD | WRITER_WAITING)) == 0) {
+        if (state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      s = backoff(s, spins);
+    }
+  }
 
-  void WUnlock() { mutex_.unlock(); }
+  void RUnlock() {
+    uint32_t s = state_.fetch_sub(1, std::memory_order_release) - 1;
+    // 最后一个读者离开时唤醒等待的写者
+    if ((s & READER_MASK) == 0 && (s & PARKED) &&
+        (state_.fetch_and(~PARKED, std::memory_order_relaxed) & PARKED)) {
+      futex_wake_all(&state_);
+    }
+  }
 
-  void RLock() { mutex_.lock_shared(); }
+  bool TryRLock() {
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    while ((s & (WRITER_HELD | WRITER_WAITING)) == 0) {
+      if (state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+        return true;
+      }
+    }
+    return false;
+  }
 
-  void RUnlock() { mutex_.unlock_shared(); }
+  // 标准库的Lockable/SharedLockable接口，可以配合std::unique_lock和std::shared_lock使用
+  void lock() { WLock(); }
+  void unlock() { WUnlock(); }
+  void lock_shared() { RLock(); }
+  void unlock_shared() { RUnlock(); }
+  bool try_lock_shared() { return TryRLock(); }
 
  private:
-  std::shared_mutex mutex_;
+  static constexpr uint32_t WRITER_HELD = 1u << 31;
+  static constexpr uint32_t WRITER_WAITING = 1u << 30;
+  static constexpr uint32_t PARKED = 1u << 29;
+  static constexpr uint32_t READER_MASK = PARKED - 1;
+
+  // 等待状态从s发生变化：先自旋，之后置睡眠标志并在futex上睡眠，返回新的状态
+  uint32_t backoff(uint32_t s, int& spins) {
+    if (spins < LATCH_SPIN_LIMIT) {
+      ++spins;
+      cpu_relax();
+      return state_.load(std::memory_order_relaxed);
+    }
+    if ((s & PARKED) == 0 &&
+        !state_.compare_exchange_weak(s, s | PARKED,
+                                      std::memory_order_relaxed)) {
+      return s;
+    }
+    futex_wait(&state_, s | PARKED);
+    return state_.load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint32_t> state_{0};
+};
+
+/**
+ * @description: 读多写少的热点读写锁：读者按线程分散在RWLATCH_READER_SLOTS个独占缓存行的槽上计数，
+ * 加读锁只写自己槽所在的缓存行，不同槽上的读者互不干扰，读锁的吞吐随核数线性增长。
+ * 写者先用HybridMutex互斥，再置写者标志并等待所有槽上的读者离开，代价和槽数成正比；
+ * 读者看到写者标志时撤回计数并等待（写者优先）。占用RWLATCH_READER_SLOTS个缓存行，只用于少数热点锁，
+ * 每个页面一把的锁用RWLatch
+ */
+class ScalableRWLatch {
+ public:
+  void RLock() {
+    auto& slot = slots_[reader_slot()].readers;
+    while (true) {
+      // 先计数再检查写者标志，和写者的先置标志再检查计数配对，都用seq_cst
+      slot.fetch_add(1, std::memory_order_seq_cst);
+      if (writer_.load(std::memory_order_seq_cst) == 0) {
+        return;
+      }
+      slot.fetch_sub(1, std::memory_order_release);
+      wait_writer();
+    }
+  }
+
+  void RUnlock() {
+    slots_[reader_slot()].readers.fetch_sub(1, std::memory_order_release);
+  }
+
+  void WLock() {
+    writer_mutex_.lock();
+    writer_.store(1, std::memory_order_seq_cst);
+    for (auto& slot : slots_) {
+      for (int spins = 0; slot.readers.load(std::memory_order_acquire) != 0;
+           ++spins) {
+        if (spins < LATCH_SPIN_LIMIT) {
+          cpu_relax();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  void WUnlock() {
+    writer_.store(0, std::memory_order_seq_cst);
+    if (parked_.load(std::memory_order_seq_cst) != 0) {
+      futex_wake_all(&writer_);
+    }
+    writer_mutex_.unlock();
+  }
+
+ private:
+  // 当前线程的读者槽，线程第一次加读锁时轮流分配。加锁和解锁必须在同一个线程上
+  static size_t reader_slot() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t slot =
+        next.fetch_add(1, std::memory_order_relaxed) % RWLATCH_READER_SLOTS;
+    return slot;
+  }
+
+  void wait_writer() {
+    for (int i = 0; i < LATCH_SPIN_LIMIT; ++i) {
+      if (writer_.load(std::memory_order_acquire) == 0) {
+        return;
+      }
+      cpu_relax();
+    }
+    parked_.fetch_add(1, std::memory_order_seq_cst);
+    while (writer_.load(std::memory_order_seq_cst) != 0) {
+      futex_wait(&writer_, 1);
+    }
+    parked_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  struct alignas(64) Slot {
+    std::atomic<uint32_t> readers{0};
+  };
+
+  std::array<Slot, RWLATCH_READER_SLOTS> slots_{};
+  alignas(64) std::atomic<uint32_t> writer_{0};  // 有写者持有或者正在等待读者离开
+  std::atomic<uint32_t> parked_{0};  // 在writer_上睡眠的读者数
+  HybridMutex writer_mutex_;
 };
 
 #endif  // RWLATCH_H
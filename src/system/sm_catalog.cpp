@@ -0,0 +1,444 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "sm_catalog.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "common/config.h"
+#include "errors.h"
+
+namespace {
+constexpr char CATALOG_MAGIC[8] = {'R', 'M', 'D', 'B', 'C', 'A', 'T', '\0'};
+constexpr uint32_t CATALOG_VERSION = 4;  // 2: tables carry their persistence, 3: materialized views, 4: partitions
+constexpr size_t CATALOG_HEADER_SIZE = 16;  // Magic, version, reserved
+constexpr size_t RECORD_HEADER_SIZE = 9;    // Payload length, CRC32 of type and payload, type
+
+uint32_t crc32(const char* data, size_t len, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/* Serializes metadata in host byte order, strings and arrays are prefixed with their length */
+class CatalogWriter {
+   public:
+    void put_u8(uint8_t v) { buf_.push_back(static_cast<char>(v)); }
+    void put_u32(uint32_t v) { put(&v, sizeof(v)); }
+    void put_i32(int32_t v) { put(&v, sizeof(v)); }
+    void put_u64(uint64_t v) { put(&v, sizeof(v)); }
+    void put_f64(double v) { put(&v, sizeof(v)); }
+
+    void put_str(const std::string& s) {
+        put_u32(static_cast<uint32_t>(s.size()));
+        buf_.append(s);
+    }
+
+    void put_col(const ColMeta& col) {
+        put_str(col.tab_name);
+        put_str(col.name);
+        put_i32(col.type);
+        put_i32(col.len);
+        put_i32(col.offset);
+        put_u8(col.index);
+    }
+
+    void put_tab(const TabMeta& tab) {
+        put_str(tab.name);
+        put_u32(static_cast<uint32_t>(tab.cols.size()));
+        for (auto& col : tab.cols) {
+            put_col(col);
+        }
+        put_u32(static_cast<uint32_t>(tab.indexes.size()));
+        for (auto& [index_name, index] : tab.indexes) {
+            put_str(index_name);
+            put_str(index.tab_name);
+            put_i32(index.col_tot_len);
+            put_u32(static_cast<uint32_t>(index.cols.size()));
+            for (auto& col : index.cols) {
+                put_col(col);
+            }
+            put_i32(index.type);
+        }
+        put_u64(tab.num_rows);
+        put_u32(static_cast<uint32_t>(tab.col_stats.size()));
+        for (auto& stats : tab.col_stats) {
+            put_u64(stats.ndv);
+            put_f64(stats.min_val);
+            put_f64(stats.max_val);
+            put_u32(static_cast<uint32_t>(stats.bounds.size()));
+            for (double bound : stats.bounds) {
+                put_f64(bound);
+            }
+            put_u32(static_cast<uint32_t>(stats.mcv.size()));
+            for (auto& [hash, freq] : stats.mcv) {
+                put_u64(hash);
+                put_f64(freq);
+            }
+        }
+        put_u8(tab.persistence);
+        put_str(tab.mat_view.base_tab);
+        put_u32(static_cast<uint32_t>(tab.mat_view.cols.size()));
+        for (auto& col : tab.mat_view.cols) {
+            put_i32(col.agg_type);
+            put_str(col.src_col);
+        }
+        put_str(tab.partition.col);
+        put_i32(tab.partition.num);
+        put_str(tab.partition.parent);
+    }
+
+    std::string& str() { return buf_; }
+
+   private:
+    void put(const void* p, size_t n) { buf_.append(static_cast<const char*>(p), n); }
+
+    std::string buf_;
+};
+
+/* Reads what CatalogWriter wrote. The record passed its CRC check, running past its end means a format bug */
+class CatalogReader {
+   public:
+    CatalogReader(const char* data, size_t len, uint32_t version) : pos_(data), end_(data + len), version_(version) {}
+
+    uint8_t get_u8() { return static_cast<uint8_t>(*take(1)); }
+    uint32_t get_u32() { return get<uint32_t>(); }
+    int32_t get_i32() { return get<int32_t>(); }
+    uint64_t get_u64() { return get<uint64_t>(); }
+    double get_f64() { return get<double>(); }
+
+    std::string get_str() {
+        uint32_t len = get_u32();
+        return std::string(take(len), len);
+    }
+
+    ColMeta get_col() {
+        ColMeta col;
+        col.tab_name = get_str();
+        col.name = get_str();
+        col.type = static_cast<ColType>(get_i32());
+        col.len = get_i32();
+        col.offset = get_i32();
+        col.index = get_u8() != 0;
+        return col;
+    }
+
+    TabMeta get_tab() {
+        TabMeta tab;
+        tab.name = get_str();
+        tab.cols.resize(get_u32());
+        for (auto& col : tab.cols) {
+            col = get_col();
+        }
+        tab.bind_col_ids();
+        for (uint32_t n = get_u32(); n > 0; --n) {
+            std::string index_name = get_str();
+            IndexMeta index;
+            index.tab_name = get_str();
+            index.col_tot_len = get_i32();
+            index.cols.resize(get_u32());
+            for (auto& col : index.cols) {
+                col = get_col();
+            }
+            index.col_num = static_cast<int>(index.cols.size());
+            index.type = static_cast<IndexType>(get_i32());
+            tab.indexes.emplace(std::move(index_name), std::move(index));
+        }
+        tab.num_rows = get_u64();
+        tab.col_stats.resize(get_u32());
+        for (auto& stats : tab.col_stats) {
+            stats.ndv = get_u64();
+            stats.min_val = get_f64();
+            stats.max_val = get_f64();
+            stats.bounds.resize(get_u32());
+            for (auto& bound : stats.bounds) {
+                bound = get_f64();
+            }
+            stats.mcv.resize(get_u32());
+            for (auto& [hash, freq] : stats.mcv) {
+                hash = get_u64();
+                freq = get_f64();
+            }
+        }
+        if (version_ >= 2) {
+            tab.persistence = static_cast<TabPersistence>(get_u8());
+        }
+        if (version_ >= 3) {
+            tab.mat_view.base_tab = get_str();
+            tab.mat_view.cols.resize(get_u32());
+            for (auto& col : tab.mat_view.cols) {
+                col.agg_type = static_cast<AggType>(get_i32());
+                col.src_col = get_str();
+            }
+        }
+        if (version_ >= 4) {
+            tab.partition.col = get_str();
+            tab.partition.num = get_i32();
+            tab.partition.parent = get_str();
+        }
+        return tab;
+    }
+
+   private:
+    const char* take(size_t n) {
+        if (static_cast<size_t>(end_ - pos_) < n) {
+            throw InternalError("Corrupted catalog record");
+        }
+        const char* p = pos_;
+        pos_ += n;
+        return p;
+    }
+
+    template <typename T>
+    T get() {
+        T v;
+        memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+
+    const char* pos_;
+    const char* end_;
+    uint32_t version_;  // Format version of the file the record was read from
+};
+
+std::string encode_record(CatalogRecordType type, const std::string& payload) {
+    std::string rec(RECORD_HEADER_SIZE, '\0');
+    rec[8] = static_cast<char>(type);
+    rec += payload;
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    uint32_t crc = crc32(rec.data() + 8, rec.size() - 8);
+    memcpy(&rec[0], &len, sizeof(len));
+    memcpy(&rec[4], &crc, sizeof(crc));
+    return rec;
+}
+
+void write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw UnixError();
+        }
+        done += n;
+    }
+}
+
+/**
+ * @description: Apply one catalog record to the members of a DbMeta
+ * @return {bool} Whether the record was a snapshot
+ */
+bool apply_record(CatalogRecordType type, CatalogReader& reader, std::string& name, int& next_table_id,
+                  std::map<std::string, TabMeta>& tabs) {
+    switch (type) {
+        case CatalogRecordType::SNAPSHOT: {
+            name = reader.get_str();
+            next_table_id = reader.get_i32();
+            tabs.clear();
+            for (uint32_t n = reader.get_u32(); n > 0; --n) {
+                TabMeta tab = reader.get_tab();
+                tabs[tab.name] = tab;
+            }
+            return true;
+        }
+        case CatalogRecordType::PUT_TABLE: {
+            next_table_id = reader.get_i32();
+            TabMeta tab = reader.get_tab();
+            tabs[tab.name] = tab;
+            return false;
+        }
+        case CatalogRecordType::DROP_TABLE: {
+            next_table_id = reader.get_i32();
+            tabs.erase(reader.get_str());
+            return false;
+        }
+        default:
+            throw InternalError("Unknown catalog record type " + std::to_string(static_cast<int>(type)));
+    }
+}
+}  // namespace
+
+/**
+ * @description: Write a catalog holding only a snapshot of db. The new file is synced under a temporary name and
+ * renamed over path, a crash leaves either the old or the new catalog
+ * @param {string&} path Catalog file name
+ * @param {DbMeta&} db Metadata to write
+ */
+void CatalogFile::write_snapshot(const std::string& path, const DbMeta& db) {
+    CatalogWriter writer;
+    writer.put_str(db.name_);
+    writer.put_i32(db.next_table_id_);
+    // Temporary tables live only in memory
+    writer.put_u32(static_cast<uint32_t>(std::count_if(db.tabs_.begin(), db.tabs_.end(), [](const auto& entry) {
+        return entry.second.persistence != TAB_TEMPORARY;
+    })));
+    for (auto& [tab_name, tab] : db.tabs_) {
+        if (tab.persistence != TAB_TEMPORARY) {
+            writer.put_tab(tab);
+        }
+    }
+
+    std::string data(CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    uint32_t header[2] = {CATALOG_VERSION, 0};
+    data.append(reinterpret_cast<const char*>(header), sizeof(header));
+    data += encode_record(CatalogRecordType::SNAPSHOT, writer.str());
+
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw UnixError();
+    }
+    write_all(fd, data);
+    if (fsync(fd) < 0) {
+        ::close(fd);
+        throw UnixError();
+    }
+    ::close(fd);
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        throw UnixError();
+    }
+}
+
+/**
+ * @description: Read the catalog into db by loading the snapshot and replaying the journal, and keep the file open
+ * for appends. A record whose length or CRC does not check out ends the journal and is cut off
+ * @param {string&} path Catalog file name
+ * @param {DbMeta&} db Metadata to fill
+ */
+void CatalogFile::open(const std::string& path, DbMeta& db) {
+    close();
+    std::ifstream ifs(path, std::ios::binary);
+    if (ifs.fail()) {
+        throw InternalError("Failed to open database metadata file: " + path);
+    }
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    path_ = path;
+    journal_records_ = 0;
+
+    if (data.size() < sizeof(CATALOG_MAGIC) || memcmp(data.data(), CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0) {
+        // Text catalog written by older versions, convert it
+        std::istringstream iss(data);
+        iss >> db;
+        write_snapshot(path, db);
+    } else {
+        uint32_t version = 0;
+        if (data.size() >= CATALOG_HEADER_SIZE) {
+            memcpy(&version, data.data() + sizeof(CATALOG_MAGIC), sizeof(version));
+        }
+        if (version == 0 || version > CATALOG_VERSION) {
+            throw InternalError("Unsupported catalog version " + std::to_string(version) + " in " + path);
+        }
+        bool has_snapshot = false;
+        size_t pos = CATALOG_HEADER_SIZE;
+        while (data.size() - pos >= RECORD_HEADER_SIZE) {
+            uint32_t len;
+            uint32_t crc;
+            memcpy(&len, data.data() + pos, sizeof(len));
+            memcpy(&crc, data.data() + pos + 4, sizeof(crc));
+            if (len > data.size() - pos - RECORD_HEADER_SIZE || crc32(data.data() + pos + 8, len + 1) != crc) {
+                break;
+            }
+            auto type = static_cast<CatalogRecordType>(data[pos + 8]);
+            CatalogReader reader(data.data() + pos + RECORD_HEADER_SIZE, len, version);
+            if (apply_record(type, reader, db.name_, db.next_table_id_, db.tabs_)) {
+                has_snapshot = true;
+                journal_records_ = 0;
+            } else {
+                ++journal_records_;
+            }
+            pos += RECORD_HEADER_SIZE + len;
+        }
+        if (!has_snapshot) {
+            throw InternalError("Database metadata file has no snapshot: " + path);
+        }
+        if (version < CATALOG_VERSION) {
+            // Records are appended in the current format, rewrite an older catalog first
+            write_snapshot(path, db);
+            journal_records_ = 0;
+        } else if (pos != data.size() && truncate(path.c_str(), static_cast<off_t>(pos)) < 0) {
+            // Drop the torn tail so that new records follow the last complete one
+            throw UnixError();
+        }
+    }
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd_ < 0) {
+        throw UnixError();
+    }
+}
+
+void CatalogFile::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void CatalogFile::log_put_table(const DbMeta& db, const TabMeta& tab) {
+    CatalogWriter writer;
+    writer.put_i32(db.next_table_id_);
+    writer.put_tab(tab);
+    append(db, CatalogRecordType::PUT_TABLE, writer.str());
+}
+
+void CatalogFile::log_drop_table(const DbMeta& db, const std::string& tab_name) {
+    CatalogWriter writer;
+    writer.put_i32(db.next_table_id_);
+    writer.put_str(tab_name);
+    append(db, CatalogRecordType::DROP_TABLE, writer.str());
+}
+
+void CatalogFile::compact(const DbMeta& db) {
+    close();
+    write_snapshot(path_, db);
+    journal_records_ = 0;
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND);
+    if (fd_ < 0) {
+        throw UnixError();
+    }
+}
+
+void CatalogFile::append(const DbMeta& db, CatalogRecordType type, const std::string& payload) {
+    if (fd_ < 0) {
+        throw InternalError("Database metadata file is not open");
+    }
+    write_all(fd_, encode_record(type, payload));
+    if (fdatasync(fd_) < 0) {
+        throw UnixError();
+    }
+    if (++journal_records_ >= CATALOG_COMPACT_RECORDS) {
+        compact(db);
+    }
+}
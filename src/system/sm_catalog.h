@@ -0,0 +1,67 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "sm_meta.h"
+
+/* Kinds of records in the catalog file */
+enum class CatalogRecordType : uint8_t {
+    SNAPSHOT = 1,    // The whole DbMeta, always the first record
+    PUT_TABLE = 2,   // Create or replace the metadata of one table
+    DROP_TABLE = 3   // Remove one table
+};
+
+/**
+ * @description: The binary catalog file (db.meta). It starts with a magic number and a format version, followed by
+ * a snapshot of the whole DbMeta and a journal of per-table changes. DDL appends one journal record and syncs it
+ * before returning instead of rewriting the file; once the journal is long enough the snapshot is rewritten to a
+ * temporary file and renamed over the old one. Every record carries a CRC32, a torn record at the tail left by a
+ * crash during an append is cut off when the catalog is opened
+ */
+class CatalogFile {
+   public:
+    CatalogFile() = default;
+
+    ~CatalogFile() { close(); }
+
+    CatalogFile(const CatalogFile&) = delete;
+    CatalogFile& operator=(const CatalogFile&) = delete;
+
+    // Write a catalog holding only a snapshot of db, replacing path atomically
+    static void write_snapshot(const std::string& path, const DbMeta& db);
+
+    // Read path into db and keep it open for appends. A text catalog written by older versions is converted
+    void open(const std::string& path, DbMeta& db);
+
+    void close();
+
+    // Journal the current metadata of tab
+    void log_put_table(const DbMeta& db, const TabMeta& tab);
+
+    // Journal that tab_name was dropped
+    void log_drop_table(const DbMeta& db, const std::string& tab_name);
+
+    // Rewrite the snapshot from db and start an empty journal
+    void compact(const DbMeta& db);
+
+    bool is_open() const { return fd_ >= 0; }
+
+   private:
+    // Append one record and sync it, compacting when the journal has grown past CATALOG_COMPACT_RECORDS
+    void append(const DbMeta& db, CatalogRecordType type, const std::string& payload);
+
+    std::string path_;
+    int fd_ = -1;
+    size_t journal_records_ = 0;  // Records after the snapshot
+};
@@ -13,13 +13,112 @@ See the Mulan PSL v2 for more details. */
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <random>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
 
+#include "common/cardinality_feedback.h"
+#include "common/output_writer.h"
 #include "index/ix.h"
 #include "record/rm.h"
 #include "record_printer.h"
 #include "record/rm_scan.h"
 
+namespace {
+/**
+ * @description: Name of the table or index behind each open file, for lock views
+ */
+std::unordered_map<int, std::string> file_names(SmManager* sm_manager) {
+    std::unordered_map<int, std::string> names;
+    for (auto& [tab_name, fh] : sm_manager->fhs_) {
+        names[fh->GetFd()] = tab_name;
+    }
+    for (auto& [index_name, ih] : sm_manager->ihs_) {
+        names[ih->fd_] = index_name;
+    }
+    return names;
+}
+
+const char* lock_type_name(LockDataType type) {
+    switch (type) {
+        case LockDataType::TABLE:
+            return "TABLE";
+        case LockDataType::RECORD:
+            return "RECORD";
+        default:
+            return "GAP";
+    }
+}
+
+/**
+ * @description: Track per-page min/max of the table's int and float columns so that scans can skip pages
+ */
+void set_zone_cols(RmFileHandle* fh, const TabMeta& tab) {
+    std::vector<RmZoneCol> zone_cols;
+    for (auto& col : tab.cols) {
+        if (col.type == TYPE_INT || col.type == TYPE_FLOAT) {
+            zone_cols.push_back({col.offset, col.type});
+        }
+    }
+    fh->set_zone_cols(std::move(zone_cols));
+}
+
+void make_index_key(const std::vector<ColMeta>& cols, const char* record, char* key) {
+    int pos = 0;
+    for (auto& col : cols) {
+        memcpy(key + pos, record + col.offset, col.len);
+        pos += col.len;
+    }
+}
+
+/**
+ * @description: Apply the changes a table logged while one of its indexes was being built. Entries of the old
+ * records are removed if they still point at the same rid, then the current record of every touched rid (and of
+ * every rid left in pending) is put into the index. Rids whose key is held by another rid are left in pending:
+ * the other rid may have changed too and will be applied in a later round
+ */
+void apply_index_changes(RmFileHandle* fh, IxIndexHandle* ih, const std::vector<ColMeta>& cols, int key_len,
+                         RmChangeLog& log, std::vector<Rid>& pending) {
+    int record_size = fh->get_file_hdr().record_size;
+    std::vector<char> key(key_len);
+    std::vector<Rid> found;
+    size_t old_pos = 0;
+    for (size_t i = 0; i < log.rids.size(); ++i) {
+        if (!log.has_old[i]) {
+            continue;
+        }
+        make_index_key(cols, log.old_records.data() + old_pos, key.data());
+        old_pos += record_size;
+        found.clear();
+        if (ih->get_value(key.data(), &found, nullptr) && found[0] == log.rids[i]) {
+            ih->delete_entry(key.data(), nullptr);
+        }
+    }
+    std::vector<Rid> rids = std::move(pending);
+    pending.clear();
+    rids.insert(rids.end(), log.rids.begin(), log.rids.end());
+    for (auto& rid : rids) {
+        std::unique_ptr<RmRecord> record;
+        try {
+            record = fh->get_record(rid, nullptr, RM_LOCK_TABLE);
+        } catch (RecordNotFoundError&) {
+            continue;
+        }
+        make_index_key(cols, record->data, key.data());
+        found.clear();
+        if (!ih->get_value(key.data(), &found, nullptr)) {
+            ih->insert_entry(key.data(), rid, nullptr);
+        } else if (!(found[0] == rid)) {
+            pending.push_back(rid);
+        }
+    }
+}
+}  // namespace
+
 /**
  * @description: Check if it's a directory
  * @return {bool} Return whether it's a directory
@@ -48,16 +147,12 @@ void SmManager::create_db(const std::string& db_name) {
         DbMeta *new_db = new DbMeta();
         new_db->name_ = db_name;
 
-        // Note: ofstream creates and opens a file named DB_META_NAME in the current directory
-        std::ofstream ofs(DB_META_NAME);
-
-        // Write information from new_db to the DB_META_NAME file using the defined operator<<
-        ofs << *new_db;  // Note: operator<< is overloaded here
+        // Write a binary catalog holding the empty database
+        CatalogFile::write_snapshot(DB_META_NAME, *new_db);
 
         delete new_db;
 
-        // Create log file
-        disk_manager_->create_file(LOG_FILE_NAME);
+        // Log segments are created on the first log write
 
         // Return to root directory
         if (chdir("..") < 0) {
@@ -95,25 +190,46 @@ void SmManager::open_db(const std::string& db_name) {
                 throw InternalError("Failed to change directory to " + db_name);
             }
 
-            // Load database metadata
-            std::ifstream ifs(DB_META_NAME);
-            if (!ifs.fail()) {
-                ifs >> db_;  // Note: operator>> is overloaded here, reading DB_META_NAME file content into db_
-
-                // Load table metadata
-                for (auto &t : db_.tabs_) {
-                    auto &tab = t.second;
-                    // Load table file to fhs_
-                    fhs_.emplace(tab.name, rm_manager_->open_file(tab.name));
-
-                    // Load index files to ihs_
-                    for (auto &index : tab.indexes) {
-                        const std::string &index_name = index.first;
-                        ihs_.emplace(index_name, ix_manager_->open_index(index_name));
+            // Load database metadata: the snapshot in DB_META_NAME plus the DDL journaled after it
+            catalog_.open(DB_META_NAME, db_);
+            remove_leftover_temp_files();
+            // Without the marker left by close_db the last run crashed, unlogged tables may be torn
+            bool clean_shutdown = disk_manager_->is_file(CLEAN_SHUTDOWN_NAME);
+            if (clean_shutdown) {
+                disk_manager_->destroy_file(CLEAN_SHUTDOWN_NAME);
+            }
+            // Only views record their base table, rebuild the list of views kept by each base table
+            for (auto &[tab_name, tab] : db_.tabs_) {
+                if (tab.mat_view.is_view()) {
+                    db_.get_table(tab.mat_view.base_tab).mat_views.push_back(tab_name);
+                }
+            }
+            // Load table metadata
+            for (auto &t : db_.tabs_) {
+                auto &tab = t.second;
+                finish_truncate(tab);
+                // Load table file to fhs_
+                fhs_.emplace(tab.name, rm_manager_->open_file(tab.name));
+                set_zone_cols(fhs_.at(tab.name).get(), tab);
+                fhs_.at(tab.name)->set_num_rows(tab.num_rows);
+                bind_table(tab);
+
+                // Load index files to ihs_
+                for (auto &index : tab.indexes) {
+                    const std::string &index_name = index.first;
+                    ihs_.emplace(index_name, ix_manager_->open_index(index_name));
+                    bind_index(index.second, ihs_.at(index_name).get());
+                    if (index.second.type == INDEX_ART) {
+                        load_art_index(index.second, ihs_.at(index_name).get());
+                    }
+                }
+            }
+            if (!clean_shutdown) {
+                for (auto &[tab_name, tab] : db_.tabs_) {
+                    if (tab.persistence == TAB_UNLOGGED) {
+                        truncate_files(tab);
                     }
                 }
-            } else {
-                throw InternalError("Failed to open database metadata file: " + DB_META_NAME);
             }
         } else {
             throw DatabaseExistsError(db_name);
@@ -123,27 +239,190 @@ void SmManager::open_db(const std::string& db_name) {
     }
 }
 
+/**
+ * @description: Fill an ART index from the rows of its table. Its entries live only in memory, so this runs every
+ * time the index is opened; recovery rebuilds it again like any other index of a table it touched
+ * @param {IndexMeta&} index Index metadata, its table must already be in fhs_
+ * @param {IxIndexHandle*} ih The opened, empty index
+ */
+void SmManager::load_art_index(const IndexMeta& index, IxIndexHandle* ih) {
+    RmFileHandle* fh = fhs_.at(index.tab_name).get();
+    std::vector<char> key(index.col_tot_len);
+    for (RmScan scan(fh); !scan.is_end(); scan.next()) {
+        auto record = fh->get_record(scan.rid(), nullptr, RM_LOCK_TABLE);
+        make_index_key(index.cols, record->data, key.data());
+        ih->insert_entry(key.data(), scan.rid(), nullptr);
+    }
+}
+
+/**
+ * @description: Register an opened table under its table id, so that executors can find its metadata and file
+ * handle without hashing the table name. Also binds the position of every column
+ * @param {TabMeta&} tab Table metadata, its file handle must already be in fhs_
+ */
+void SmManager::bind_table(TabMeta& tab) {
+    RmFileHandle* fh = fhs_.at(tab.name).get();
+    tab.id = fh->get_table_id();
+    tab.bind_col_ids();
+    if (tab.id >= static_cast<int>(fh_ids_.size())) {
+        fh_ids_.resize(tab.id + 1, nullptr);
+        db_.tab_ids_.resize(tab.id + 1, nullptr);
+    }
+    fh_ids_[tab.id] = fh;
+    db_.tab_ids_[tab.id] = &tab;
+    fh->set_unlogged(tab.persistence != TAB_PERMANENT);
+}
+
+/**
+ * @description: Give an opened index the next dense id. Ids are not reused within one open database
+ * @param {IndexMeta&} index Index metadata stored in its table
+ * @param {IxIndexHandle*} ih Index file handle
+ */
+void SmManager::bind_index(IndexMeta& index, IxIndexHandle* ih) {
+    index.id = static_cast<int>(ih_ids_.size());
+    ih_ids_.push_back(ih);
+}
+
 /**
  * @description: Flush database-related metadata to disk
  */
 void SmManager::flush_meta() {
-    // Clear file by default
-    std::ofstream ofs(DB_META_NAME);
-    ofs << db_;
+    // Row counts are maintained by the file handles, take a snapshot of them
+    for (auto &[tab_name, fh] : fhs_) {
+        if (db_.is_table(tab_name)) {
+            db_.get_table(tab_name).num_rows = fh->get_num_rows();
+        }
+    }
+    // Rewrite the snapshot, which also empties the DDL journal
+    catalog_.compact(db_);
+}
+
+/**
+ * @description: Journal the metadata of one table after a DDL instead of rewriting the whole catalog
+ * @param {TabMeta&} tab Table metadata
+ */
+void SmManager::log_table_meta(TabMeta& tab) {
+    // Temporary tables never reach the catalog
+    if (tab.persistence == TAB_TEMPORARY) {
+        return;
+    }
+    auto it = fhs_.find(tab.name);
+    if (it != fhs_.end()) {
+        tab.num_rows = it->second->get_num_rows();
+    }
+    catalog_.log_put_table(db_, tab);
+}
+
+/**
+ * @description: Write the PageIds of all resident table and index pages to BUFFER_POOL_DUMP_NAME as
+ * "<file name> <page no>" lines. File descriptors change across restarts, file names do not
+ */
+void SmManager::dump_buffer_pool() {
+    std::unordered_map<int, std::string> fd2name;
+    for (auto &[name, fh] : fhs_) {
+        fd2name[fh->GetFd()] = name;
+    }
+    for (auto &[name, ih] : ihs_) {
+        fd2name[ih->fd_] = name;
+    }
+    std::vector<PageId> page_ids;
+    buffer_pool_manager_->get_resident_pages(page_ids);
+
+    // Write to a temporary file first so a crash never leaves a truncated dump behind
+    std::string tmp_name = BUFFER_POOL_DUMP_NAME + ".tmp";
+    {
+        std::ofstream ofs(tmp_name, std::ios::trunc);
+        for (auto &page_id : page_ids) {
+            auto it = fd2name.find(page_id.fd);
+            if (it != fd2name.end()) {
+                ofs << it->second << ' ' << page_id.page_no << '\n';
+            }
+        }
+        if (!ofs) {
+            return;
+        }
+    }
+    std::rename(tmp_name.c_str(), BUFFER_POOL_DUMP_NAME.c_str());
+}
+
+/**
+ * @description: Read the buffer pool dump and load the pages back in a background thread, sorted by file and
+ * page number and in batches of BUFFER_POOL_WARMUP_BATCH. Must be called after recovery, which rebuilds indexes
+ */
+void SmManager::start_buffer_pool_warmup() {
+    std::ifstream ifs(BUFFER_POOL_DUMP_NAME);
+    if (ifs.fail()) {
+        return;
+    }
+    std::unordered_map<std::string, int> name2fd;
+    for (auto &[name, fh] : fhs_) {
+        name2fd[name] = fh->GetFd();
+    }
+    for (auto &[name, ih] : ihs_) {
+        name2fd[name] = ih->fd_;
+    }
+
+    std::vector<PageId> page_ids;
+    std::string name;
+    page_id_t page_no;
+    size_t max_pages = buffer_pool_manager_->get_pool_size();
+    while (page_ids.size() < max_pages && ifs >> name >> page_no) {
+        auto it = name2fd.find(name);
+        // Skip pages of dropped files and pages beyond the end of a file
+        if (it != name2fd.end() && page_no >= 0 && page_no < disk_manager_->get_fd2pageno(it->second)) {
+            page_ids.push_back({it->second, page_no});
+        }
+    }
+    std::sort(page_ids.begin(), page_ids.end(), [](const PageId &a, const PageId &b) {
+        return a.fd != b.fd ? a.fd < b.fd : a.page_no < b.page_no;
+    });
+
+    stop_buffer_pool_warmup();
+    warmup_stop_ = false;
+    warmup_thread_ = std::thread([this, page_ids = std::move(page_ids)] {
+        for (size_t i = 0; i < page_ids.size() && !warmup_stop_; i += BUFFER_POOL_WARMUP_BATCH) {
+            std::vector<PageId> batch(page_ids.begin() + i,
+                                      page_ids.begin() + std::min(page_ids.size(), i + BUFFER_POOL_WARMUP_BATCH));
+            try {
+                buffer_pool_manager_->prefetch_pages(batch);
+            } catch (RMDBError &) {
+                // Warm-up is best effort
+                return;
+            }
+        }
+    });
+}
+
+/**
+ * @description: Stop the warm-up thread, called before files are closed or dropped
+ */
+void SmManager::stop_buffer_pool_warmup() {
+    warmup_stop_ = true;
+    if (warmup_thread_.joinable()) {
+        warmup_thread_.join();
+    }
 }
 
 /**
  * @description: Close database and persist data
  */
 void SmManager::close_db() {
+    stop_buffer_pool_warmup();
+    drop_temp_tables(0);
     // Flush all dirty pages
     for (auto &rm_file : fhs_) {
         buffer_pool_manager_->flush_all_pages(rm_file.second->GetFd());
     }
     // Refresh metadata
     flush_meta();
+    catalog_.close();
+    // Remember which pages were resident so the next start can warm up the pool
+    dump_buffer_pool();
     db_.name_.clear();
     db_.tabs_.clear();
+    db_.tab_ids_.clear();
+    fh_ids_.clear();
+    ih_ids_.clear();
 
     // Close all table files
     for (auto &tab_file : fhs_) {
@@ -156,6 +435,8 @@ void SmManager::close_db() {
         ix_manager_->close_index(index_file.second.get());
     }
     ihs_.clear();
+    // Everything is on disk, unlogged tables can be kept at the next open
+    std::ofstream(CLEAN_SHUTDOWN_NAME).close();
 
     // Return to root directory
     if (chdir("..") < 0) {
@@ -168,20 +449,280 @@ void SmManager::close_db() {
  * @param {Context*} context 
  */
 void SmManager::show_tables(Context* context) {
-    std::fstream outfile;
-    outfile.open("output.txt", std::ios::out | std::ios::app);
-    outfile << "| Tables |\n";
+    std::string outfile = "| Tables |\n";
     RecordPrinter printer(1);
     printer.print_separator(context);
     printer.print_record({"Tables"}, context);
     printer.print_separator(context);
     for (auto &entry : db_.tabs_) {
         auto &tab = entry.second;
+        // Partitions are listed through their partitioned table
+        if (!tab.is_visible_to(context->session_id_) || !tab.partition.parent.empty()) {
+            continue;
+        }
         printer.print_record({tab.name}, context);
-        outfile << "| " << tab.name << " |\n";
+        outfile += "| " + tab.name + " |\n";
+    }
+    printer.print_separator(context);
+    OutputWriter::instance().append(std::move(outfile));
+}
+
+/**
+ * @description: Show buffer pool statistics, one row per instance followed by the total
+ * @param {Context*} context
+ */
+void SmManager::show_buffer_status(Context* context) {
+    std::vector<BufferPoolStatus> instances;
+    buffer_pool_manager_->get_status(instances);
+
+    std::vector<std::string> captions = {"Instance", "Pages", "Free", "Dirty", "Fetches", "Hit ratio",
+                                         "Write backs", "Read ms", "Latch wait ms", "No wait", "Wait <10us",
+                                         "Wait <100us", "Wait <1ms", "Wait <10ms", "Wait >=10ms"};
+    RecordPrinter printer(captions.size());
+    auto print_status = [&printer, context](const std::string &name, const BufferPoolStatus &status) {
+        char hit_ratio[32];
+        snprintf(hit_ratio, sizeof(hit_ratio), "%.2f%%", status.hit_ratio() * 100);
+        std::vector<std::string> row = {name,
+                                        std::to_string(status.pool_size),
+                                        std::to_string(status.free_frames),
+                                        std::to_string(status.dirty_pages),
+                                        std::to_string(status.fetches),
+                                        hit_ratio,
+                                        std::to_string(status.write_backs),
+                                        std::to_string(status.read_us / 1000),
+                                        std::to_string(status.wait_us / 1000)};
+        for (auto count : status.latch_waits) {
+            row.push_back(std::to_string(count));
+        }
+        printer.print_record(row, context);
+    };
+
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    BufferPoolStatus total;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        auto &status = instances[i];
+        print_status(std::to_string(i), status);
+        total.pool_size += status.pool_size;
+        total.free_frames += status.free_frames;
+        total.dirty_pages += status.dirty_pages;
+        total.fetches += status.fetches;
+        total.hits += status.hits;
+        total.write_backs += status.write_backs;
+        total.unpins += status.unpins;
+        total.read_us += status.read_us;
+        total.fetch_us += status.fetch_us;
+        total.wait_us += status.wait_us;
+        for (int j = 0; j < LATCH_WAIT_BUCKETS; ++j) {
+            total.latch_waits[j] += status.latch_waits[j];
+        }
+    }
+    printer.print_separator(context);
+    print_status("total", total);
+    printer.print_separator(context);
+}
+
+/**
+ * @description: Show every lock request in the lock table, granted holders and waiters alike
+ * @param {Context*} context
+ */
+void SmManager::show_locks(Context* context) {
+    std::vector<LockManager::LockInfo> locks;
+    context->lock_mgr_->get_locks(locks);
+    std::sort(locks.begin(), locks.end(), [](const LockManager::LockInfo& a, const LockManager::LockInfo& b) {
+        return std::make_tuple(a.id.fd_, a.id.type_, a.id.rid_.page_no, a.id.rid_.slot_no, !a.granted, a.txn_id) <
+               std::make_tuple(b.id.fd_, b.id.type_, b.id.rid_.page_no, b.id.rid_.slot_no, !b.granted, b.txn_id);
+    });
+    auto names = file_names(this);
+
+    std::vector<std::string> captions = {"Object", "Type", "Rid", "Txn", "Mode", "Status"};
+    RecordPrinter printer(captions.size());
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    for (auto& lock : locks) {
+        auto name = names.find(lock.id.fd_);
+        std::string rid;
+        if (lock.id.type_ == LockDataType::GAP && lock.id.rid_ == GAP_SUPREMUM) {
+            rid = "supremum";
+        } else if (lock.id.type_ != LockDataType::TABLE) {
+            rid = "(" + std::to_string(lock.id.rid_.page_no) + "," + std::to_string(lock.id.rid_.slot_no) + ")";
+        }
+        printer.print_record({name != names.end() ? name->second : "fd " + std::to_string(lock.id.fd_),
+                              lock_type_name(lock.id.type_), rid, std::to_string(lock.txn_id), lock.mode,
+                              lock.granted ? "GRANTED" : "WAITING"},
+                             context);
+    }
+    printer.print_separator(context);
+}
+
+/**
+ * @description: Show lock wait counts and time, wait-die and deadlock aborts per file and lock type.
+ * Gap locks are reported under the index they protect
+ * @param {Context*} context
+ */
+void SmManager::show_lock_status(Context* context) {
+    std::vector<std::pair<std::pair<int, LockDataType>, LockManager::LockWaitStats>> stats;
+    context->lock_mgr_->get_wait_stats(stats);
+    auto names = file_names(this);
+
+    std::vector<std::string> captions = {"Object", "Type", "Waits", "Wait ms", "Avg wait us", "Wait-die aborts",
+                                         "Deadlock aborts"};
+    RecordPrinter printer(captions.size());
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    for (auto& [key, stat] : stats) {
+        auto name = names.find(key.first);
+        printer.print_record({name != names.end() ? name->second : "fd " + std::to_string(key.first),
+                              lock_type_name(key.second), std::to_string(stat.waits),
+                              std::to_string(stat.wait_us / 1000),
+                              std::to_string(stat.waits == 0 ? 0 : stat.wait_us / stat.waits),
+                              std::to_string(stat.dies), std::to_string(stat.deadlocks)},
+                             context);
+    }
+    printer.print_separator(context);
+}
+
+/**
+ * @description: Collect server metrics, buffer pool totals and lock wait totals per lock type
+ * as Prometheus samples. Shared by SHOW STATUS and the metrics endpoint
+ * @param {LockManager*} lock_manager
+ * @param {vector<MetricSample>&} samples Samples are appended here
+ */
+void SmManager::get_status(LockManager* lock_manager, std::vector<MetricSample>& samples) {
+    Metrics::instance().collect(samples);
+
+    std::vector<BufferPoolStatus> instances;
+    buffer_pool_manager_->get_status(instances);
+    BufferPoolStatus total;
+    for (auto& status : instances) {
+        total.pool_size += status.pool_size;
+        total.free_frames += status.free_frames;
+        total.dirty_pages += status.dirty_pages;
+        total.fetches += status.fetches;
+        total.hits += status.hits;
+        total.write_backs += status.write_backs;
+        total.read_us += status.read_us;
+        total.fetch_us += status.fetch_us;
+        total.wait_us += status.wait_us;
+    }
+    samples.push_back({"rmdb_buffer_pool_pages", "", static_cast<double>(total.pool_size), "gauge"});
+    samples.push_back({"rmdb_buffer_pool_free_pages", "", static_cast<double>(total.free_frames), "gauge"});
+    samples.push_back({"rmdb_buffer_pool_dirty_pages", "", static_cast<double>(total.dirty_pages), "gauge"});
+    samples.push_back({"rmdb_buffer_pool_fetches_total", "", static_cast<double>(total.fetches), "counter"});
+    samples.push_back({"rmdb_buffer_pool_hits_total", "", static_cast<double>(total.hits), "counter"});
+    samples.push_back({"rmdb_buffer_pool_write_backs_total", "", static_cast<double>(total.write_backs), "counter"});
+    samples.push_back({"rmdb_buffer_pool_read_us_total", "", static_cast<double>(total.read_us), "counter"});
+    samples.push_back({"rmdb_buffer_pool_miss_us_total", "", static_cast<double>(total.fetch_us), "counter"});
+    samples.push_back({"rmdb_buffer_pool_latch_wait_us_total", "", static_cast<double>(total.wait_us), "counter"});
+
+    auto& accounting = MemoryAccounting::instance();
+    for (const char* name : {"rmdb_memory_bytes", "rmdb_memory_objects"}) {
+        bool bytes = name == std::string("rmdb_memory_bytes");
+        for (int i = 0; i < static_cast<int>(MemTag::NUM); ++i) {
+            auto usage = accounting.usage(static_cast<MemTag>(i));
+            samples.push_back({name, std::string("subsystem=\"") + MemoryAccounting::name(static_cast<MemTag>(i)) + "\"",
+                               static_cast<double>(bytes ? usage.bytes : usage.objects), i == 0 ? "gauge" : nullptr});
+        }
+    }
+    samples.push_back({"rmdb_query_memory_peak_bytes", "", static_cast<double>(accounting.query_peak()), "gauge"});
+
+    std::vector<std::pair<std::pair<int, LockDataType>, LockManager::LockWaitStats>> stats;
+    lock_manager->get_wait_stats(stats);
+    constexpr int num_types = 3;
+    static const char* const type_names[num_types] = {"table", "record", "gap"};
+    LockManager::LockWaitStats by_type[num_types];
+    for (auto& [key, stat] : stats) {
+        auto& sum = by_type[static_cast<int>(key.second)];
+        sum.waits += stat.waits;
+        sum.wait_us += stat.wait_us;
+        sum.dies += stat.dies;
+        sum.deadlocks += stat.deadlocks;
+    }
+    auto add_lock_samples = [&samples, &by_type](const char* name,
+                                                 uint64_t LockManager::LockWaitStats::*field) {
+        for (int i = 0; i < num_types; ++i) {
+            samples.push_back({name, std::string("type=\"") + type_names[i] + "\"",
+                               static_cast<double>(by_type[i].*field), i == 0 ? "counter" : nullptr});
+        }
+    };
+    add_lock_samples("rmdb_lock_waits_total", &LockManager::LockWaitStats::waits);
+    add_lock_samples("rmdb_lock_wait_us_total", &LockManager::LockWaitStats::wait_us);
+    add_lock_samples("rmdb_lock_wait_die_aborts_total", &LockManager::LockWaitStats::dies);
+    add_lock_samples("rmdb_lock_deadlock_aborts_total", &LockManager::LockWaitStats::deadlocks);
+}
+
+/**
+ * @description: Show server metrics: statement latency percentiles by statement type, phase times,
+ * commits and aborts by reason, bytes sent, buffer pool and lock totals. Latencies are in microseconds
+ * @param {Context*} context
+ */
+void SmManager::show_status(Context* context) {
+    std::vector<MetricSample> samples;
+    get_status(context->lock_mgr_, samples);
+
+    std::vector<std::string> captions = {"Variable_name", "Value"};
+    RecordPrinter printer(captions.size());
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    char value[64];
+    for (auto& sample : samples) {
+        snprintf(value, sizeof(value), "%.17g", sample.value);
+        printer.print_record({sample.labels.empty() ? sample.name : sample.name + "{" + sample.labels + "}", value},
+                             context);
+    }
+    printer.print_separator(context);
+}
+
+/**
+ * @description: Show memory accounted per subsystem: bytes and live objects (allocations not yet freed) of the
+ * buffer pool, lock table, transactions, write sets, statement memory budgets in use and connections,
+ * followed by the largest memory budget used by a single request since startup
+ * @param {Context*} context
+ */
+void SmManager::show_memory(Context* context) {
+    auto& accounting = MemoryAccounting::instance();
+    std::vector<std::string> captions = {"Subsystem", "Bytes", "Objects"};
+    RecordPrinter printer(captions.size());
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    int64_t total = 0;
+    for (int i = 0; i < static_cast<int>(MemTag::NUM); ++i) {
+        auto tag = static_cast<MemTag>(i);
+        auto usage = accounting.usage(tag);
+        total += usage.bytes;
+        printer.print_record({MemoryAccounting::name(tag), std::to_string(usage.bytes), std::to_string(usage.objects)},
+                             context);
+    }
+    printer.print_record({"total", std::to_string(total), ""}, context);
+    printer.print_record({"query_peak", std::to_string(accounting.query_peak()), ""}, context);
+    printer.print_separator(context);
+}
+
+/**
+ * @description: Show every connected session with the transaction and running time of its current statement.
+ * Idle sessions have an empty statement; the session number is what KILL takes
+ * @param {Context*} context
+ */
+void SmManager::show_sessions(Context* context) {
+    std::vector<StatementCancel::Info> infos;
+    StatementCancel::list(infos);
+    std::vector<std::string> captions = {"Session", "Txn", "Time ms", "Statement"};
+    RecordPrinter printer(captions.size());
+    printer.print_separator(context);
+    printer.print_record(captions, context);
+    printer.print_separator(context);
+    for (auto& info : infos) {
+        bool running = !info.sql.empty();
+        printer.print_record({std::to_string(info.session_id), running ? std::to_string(info.txn_id) : "",
+                              running ? std::to_string(info.running_us / 1000) : "", info.sql},
+                             context);
     }
     printer.print_separator(context);
-    outfile.close();
 }
 
 /**
@@ -212,14 +753,38 @@ void SmManager::desc_table(const std::string& tab_name, Context* context) {
  * @param {string&} tab_name Table name
  * @param {vector<ColDef>&} col_defs Table fields
  * @param {Context*} context 
+ * @param {RmFormat} format Page format of the record file: RM_FORMAT_SLOTTED stores string columns at their
+ * actual length (ROW_FORMAT = DYNAMIC), RM_FORMAT_PAX groups values column by column inside each page (ROW_FORMAT = PAX).
+ * String columns declared DICTIONARY are dictionary-encoded in fixed-format tables and stored as-is otherwise
+ * @param {TabPersistence} persistence TAB_UNLOGGED tables write no log records and are emptied after a crash.
+ * TAB_TEMPORARY tables are also kept out of the catalog, need no locks and belong to the session in context
+ * @param {bool} in_memory STORAGE = MEMORY: data pages stay pinned in the buffer pool once read and are located by
+ * page number without a page-table lookup. The flag is kept in the file header, logging and checkpoints are unchanged
+ * @param {bool} compressed COMPRESSION = LZ4: pages of the data file, and of the indexes later created on the table,
+ * are compressed on their way to disk; the buffer pool keeps them uncompressed. See DiskManager::compress_file
  */
-void SmManager::create_table(const std::string& tab_name, const std::vector<ColDef>& col_defs, Context* context) {
+void SmManager::create_table(const std::string& tab_name, const std::vector<ColDef>& col_defs, Context* context,
+                             RmFormat format, TabPersistence persistence, bool in_memory, bool compressed) {
     if (!db_.is_table(tab_name)) {
         // Create table meta
         int curr_offset = 0;
         TabMeta tab;
         tab.name = tab_name;
+        tab.persistence = persistence;
+        if (persistence == TAB_TEMPORARY) {
+            tab.owner_session = context != nullptr ? context->session_id_ : 0;
+            add_temp_file(tab_name);
+        }
+        // Slotted tables list their string columns, PAX tables list every column
+        std::vector<RmVarCol> rm_cols;
+        std::vector<RmVarCol> dict_cols;
         for (auto &col_def : col_defs) {
+            if (format == RM_FORMAT_PAX || (format == RM_FORMAT_SLOTTED && col_def.type == TYPE_STRING)) {
+                rm_cols.push_back({curr_offset, col_def.len});
+            }
+            if (format == RM_FORMAT_FIXED && col_def.dictionary && col_def.type == TYPE_STRING) {
+                dict_cols.push_back({curr_offset, col_def.len});
+            }
             ColMeta col = {.tab_name = tab_name,
                            .name = col_def.name,
                            .type = col_def.type,
@@ -231,11 +796,21 @@ void SmManager::create_table(const std::string& tab_name, const std::vector<ColD
         }
         // Create & open record file
         int record_size = curr_offset;  // record_size is the size occupied by col meta
-        rm_manager_->create_file(tab_name, record_size);
+        // Without string columns the slotted format saves nothing, keep the table fixed-size
+        rm_manager_->create_file(tab_name, record_size, db_.next_table_id_++, format, rm_cols, dict_cols, in_memory);
+        if (compressed) {
+            disk_manager_->compress_file(tab_name);
+        }
         db_.tabs_[tab_name] = tab;
         fhs_.emplace(tab_name, rm_manager_->open_file(tab_name));
+        set_zone_cols(fhs_.at(tab_name).get(), tab);
+        bind_table(db_.tabs_[tab_name]);
+        if (persistence == TAB_TEMPORARY) {
+            set_lock_free(db_.tabs_[tab_name], true);
+        }
 
-        flush_meta();
+        invalidate_plans();
+        log_table_meta(db_.tabs_[tab_name]);
     } else {
         throw TableExistsError(tab_name);
     }
@@ -248,26 +823,347 @@ void SmManager::create_table(const std::string& tab_name, const std::vector<ColD
  */
 void SmManager::drop_table(const std::string& tab_name, Context* context) {
     if (db_.is_table(tab_name)) {
+        TabMeta &tab = db_.get_table(tab_name);
+        if (!tab.mat_views.empty()) {
+            throw RMDBError("Cannot drop table " + tab_name + ": materialized view " + tab.mat_views.front() +
+                            " depends on it");
+        }
+        // The partitions hold the records of a partitioned table and go with it
+        for (auto &partition_name : tab.partition_names()) {
+            drop_table(partition_name, context);
+        }
+        stop_buffer_pool_warmup();
+        if (tab.mat_view.is_view()) {
+            auto &views = db_.get_table(tab.mat_view.base_tab).mat_views;
+            views.erase(std::remove(views.begin(), views.end(), tab_name), views.end());
+        }
         // Delete table file
-        rm_manager_->close_file(fhs_[tab_name].get());
+        bool temporary = tab.persistence == TAB_TEMPORARY;
+        if (temporary) {
+            set_lock_free(tab, false);
+        }
+        // The files are deleted, their buffered pages are dropped without being written back
+        for (auto &[index_name, index] : tab.indexes) {
+            ih_ids_[index.id] = nullptr;
+            ix_manager_->discard_index(ihs_.at(index_name).get());
+            ix_manager_->destroy_index(index_name);
+            ihs_.erase(index_name);
+            if (temporary) {
+                remove_temp_file(index_name);
+            }
+        }
+        fh_ids_[tab.id] = nullptr;
+        db_.tab_ids_[tab.id] = nullptr;
+        rm_manager_->discard_file(fhs_[tab_name].get());
         rm_manager_->destroy_file(tab_name);
         fhs_.erase(tab_name);  // Remove corresponding file handle
         db_.tabs_.erase(tab_name);
 
         // Update metadata
-        flush_meta();
+        invalidate_plans();
+        if (temporary) {
+            remove_temp_file(tab_name);
+        } else {
+            catalog_.log_drop_table(db_, tab_name);
+        }
     } else {
         throw TableNotFoundError(tab_name);
     }
 }
 
+/**
+ * @description: Empty a table by swapping in fresh data and index files instead of deleting it row by row. The
+ * empty files are created next to the old ones with TRUNCATE_FILE_SUFFIX, the data file last, and renamed over
+ * the old ones in the same order; open_db finishes a swap interrupted by a crash once the new data file
+ * exists. The new data file gets a new table id, so redo skips the log records of the old rows. Buffered pages
+ * of the old files are dropped without being written back
+ * @param {string&} tab_name Table name
+ * @param {Context*} context
+ */
+void SmManager::truncate_table(const std::string& tab_name, Context* context) {
+    if (!db_.is_table(tab_name)) {
+        throw TableNotFoundError(tab_name);
+    }
+    TabMeta &tab = db_.get_table(tab_name);
+    if (tab.mat_view.is_view()) {
+        throw RMDBError("Cannot truncate materialized view " + tab_name);
+    }
+    RmFileHandle* fh = fhs_.at(tab_name).get();
+    context->lock_mgr_->lock_exclusive_on_table(context->txn_, fh->GetFd());
+    if (fh->is_logging_changes()) {
+        throw RMDBError("TRUNCATE cannot run while an index is being created on " + tab_name);
+    }
+    // Every view groups the base table, so an empty base table leaves its views empty as well
+    for (auto &view_name : tab.mat_views) {
+        context->lock_mgr_->lock_exclusive_on_table(context->txn_, fhs_.at(view_name)->GetFd());
+    }
+    // The records of a partitioned table are in its partitions
+    auto partitions = tab.partition_names();
+    for (auto &partition_name : partitions) {
+        context->lock_mgr_->lock_exclusive_on_table(context->txn_, fhs_.at(partition_name)->GetFd());
+    }
+    // Dropped pages must not be read back in by the warm-up thread
+    stop_buffer_pool_warmup();
+    truncate_files(tab);
+    for (auto &view_name : tab.mat_views) {
+        truncate_files(db_.get_table(view_name));
+    }
+    for (auto &partition_name : partitions) {
+        truncate_files(db_.get_table(partition_name));
+    }
+}
+
+/**
+ * @description: Create an aggregate materialized view: a table with col_defs, a unique index on its group columns
+ * and the view definition, which makes the insert, delete and update executors of the base table maintain it. The
+ * base table is S locked until the transaction ends, writers that started before the view existed finish first.
+ * The view is created empty, the caller fills it from the base table
+ * @param {string&} view_name Name of the view table
+ * @param {vector<ColDef>&} col_defs Columns of the view, one for each column of def
+ * @param {MatViewDef&} def View definition, checked by the analyzer
+ * @param {Context*} context
+ */
+void SmManager::create_mat_view(const std::string& view_name, const std::vector<ColDef>& col_defs,
+                                const MatViewDef& def, Context* context) {
+    if (db_.is_table(view_name)) {
+        throw TableExistsError(view_name);
+    }
+    TabMeta &base = db_.get_table(def.base_tab);
+    if (base.persistence != TAB_PERMANENT) {
+        throw RMDBError("Materialized views can only be created on permanent tables");
+    }
+    if (base.partition.is_partitioned()) {
+        throw RMDBError("Materialized views cannot be created on partitioned tables");
+    }
+    context->lock_mgr_->lock_shared_on_table(context->txn_, fhs_.at(base.name)->GetFd());
+    create_table(view_name, col_defs, context);
+    TabMeta &view = db_.get_table(view_name);
+    view.mat_view = def;
+    create_index(view_name, view.mat_view_group_cols(), context);
+    base.mat_views.push_back(view_name);
+    invalidate_plans();
+    log_table_meta(view);
+}
+
+/**
+ * @description: Create a hash partitioned table. The table itself keeps no records, each of its def.num partitions
+ * is an ordinary table with the same columns, named by PartitionDef::partition_name. Inserts go to the partition
+ * chosen by the hash of def.col, scans read the partitions that an equality condition on def.col leaves
+ * @param {string&} tab_name Table name
+ * @param {vector<ColDef>&} col_defs Columns of the table and of every partition
+ * @param {PartitionDef&} def Partition column and number of partitions
+ * @param {Context*} context
+ */
+void SmManager::create_partitioned_table(const std::string& tab_name, const std::vector<ColDef>& col_defs,
+                                         const PartitionDef& def, Context* context, RmFormat format,
+                                         TabPersistence persistence, bool in_memory, bool compressed) {
+    if (db_.is_table(tab_name)) {
+        throw TableExistsError(tab_name);
+    }
+    // Temporary tables are dropped one by one when their session ends, the partitions would go before their table
+    if (persistence != TAB_PERMANENT) {
+        throw RMDBError("Only permanent tables can be partitioned");
+    }
+    auto col = std::find_if(col_defs.begin(), col_defs.end(),
+                            [&](const ColDef &col_def) { return col_def.name == def.col; });
+    if (col == col_defs.end()) {
+        throw ColumnNotFoundError(def.col);
+    }
+    // Equal floats can differ in their bytes (0.0 and -0.0) and would hash to different partitions
+    if (col->type == TYPE_FLOAT) {
+        throw RMDBError("Cannot partition by FLOAT column " + def.col);
+    }
+    if (def.num < 2 || def.num > MAX_TABLE_PARTITIONS) {
+        throw RMDBError("PARTITIONS must be between 2 and " + std::to_string(MAX_TABLE_PARTITIONS));
+    }
+    for (int i = 0; i < def.num; ++i) {
+        std::string partition_name = PartitionDef::partition_name(tab_name, i);
+        // Left behind by a crash before an earlier CREATE TABLE of the same name finished
+        if (db_.is_table(partition_name)) {
+            drop_table(partition_name, context);
+        }
+        create_table(partition_name, col_defs, context, format, persistence, in_memory, compressed);
+        TabMeta &partition = db_.get_table(partition_name);
+        partition.partition.parent = tab_name;
+        log_table_meta(partition);
+    }
+    // The table is created last, a crash in between leaves no partitioned table with missing partitions
+    create_table(tab_name, col_defs, context, format, persistence, in_memory, compressed);
+    TabMeta &tab = db_.get_table(tab_name);
+    tab.partition.col = def.col;
+    tab.partition.num = def.num;
+    invalidate_plans();
+    log_table_meta(tab);
+}
+
+/**
+ * @description: Swap empty files in for the data and index files of tab, see truncate_table. The caller keeps
+ * other users away from the table, open_db uses it to empty unlogged tables after a crash
+ * @param {TabMeta&} tab Table metadata, its files must be open
+ */
+void SmManager::truncate_files(TabMeta& tab) {
+    const std::string &tab_name = tab.name;
+    RmFileHandle* fh = fhs_.at(tab_name).get();
+    bool temporary = tab.persistence == TAB_TEMPORARY;
+    bool compressed = disk_manager_->is_file_compressed(fh->GetFd());
+    for (auto &[index_name, index] : tab.indexes) {
+        std::string tmp_name = index_name + TRUNCATE_FILE_SUFFIX;
+        if (disk_manager_->is_file(tmp_name)) {
+            disk_manager_->destroy_file(tmp_name);
+        }
+        ix_manager_->create_index(tmp_name, index.cols, index.type);
+        if (compressed) {
+            disk_manager_->compress_file(tmp_name);
+        }
+    }
+    // Journal the new table id before any file carries it, so that it is never handed out again
+    int table_id = db_.next_table_id_++;
+    log_table_meta(tab);
+    std::string tmp_name = tab_name + TRUNCATE_FILE_SUFFIX;
+    if (disk_manager_->is_file(tmp_name)) {
+        disk_manager_->destroy_file(tmp_name);
+    }
+    rm_manager_->create_empty_file(tmp_name, fh->get_file_hdr(), table_id);
+    if (compressed) {
+        disk_manager_->compress_file(tmp_name);
+    }
+
+    if (temporary) {
+        set_lock_free(tab, false);
+    }
+    for (auto &[index_name, index] : tab.indexes) {
+        ix_manager_->discard_index(ihs_.at(index_name).get());
+    }
+    rm_manager_->discard_file(fh);
+    finish_truncate(tab);
+
+    for (auto &[index_name, index] : tab.indexes) {
+        ihs_[index_name] = ix_manager_->open_index(index_name);
+        ih_ids_[index.id] = ihs_[index_name].get();
+    }
+    fh_ids_[tab.id] = nullptr;
+    db_.tab_ids_[tab.id] = nullptr;
+    fhs_[tab_name] = rm_manager_->open_file(tab_name);
+    set_zone_cols(fhs_.at(tab_name).get(), tab);
+    bind_table(tab);
+    if (temporary) {
+        set_lock_free(tab, true);
+    }
+    tab.col_stats.clear();
+
+    invalidate_plans();
+    log_table_meta(tab);
+}
+
+/**
+ * @description: Rename the empty files left by TRUNCATE over the files of tab, indexes first. Index files
+ * without a new data file belong to a TRUNCATE that did not get to the swap and are removed
+ * @param {TabMeta&} tab Table metadata, its files must be closed
+ */
+void SmManager::finish_truncate(const TabMeta& tab) {
+    bool swap = disk_manager_->is_file(tab.name + TRUNCATE_FILE_SUFFIX);
+    for (auto &[index_name, index] : tab.indexes) {
+        std::string tmp_name = index_name + TRUNCATE_FILE_SUFFIX;
+        if (!disk_manager_->is_file(tmp_name)) {
+            continue;
+        }
+        if (!swap) {
+            disk_manager_->destroy_file(tmp_name);
+        } else {
+            disk_manager_->rename_file(tmp_name, index_name);
+        }
+    }
+    if (swap) {
+        disk_manager_->rename_file(tab.name + TRUNCATE_FILE_SUFFIX, tab.name);
+    }
+}
+
+/**
+ * @description: Drop temporary tables when their session ends, or all of them when the database is closed
+ * @param {uint64_t} session_id Owner session, 0 for every session
+ */
+void SmManager::drop_temp_tables(uint64_t session_id) {
+    std::vector<std::string> tab_names;
+    for (auto &[tab_name, tab] : db_.tabs_) {
+        if (tab.persistence == TAB_TEMPORARY && (session_id == 0 || tab.owner_session == session_id)) {
+            tab_names.push_back(tab_name);
+        }
+    }
+    for (auto &tab_name : tab_names) {
+        drop_table(tab_name, nullptr);
+    }
+}
+
+/**
+ * @description: Only the owner session uses a temporary table, so its data and index files skip the lock
+ * manager. The marks are keyed by file descriptor and must be cleared before the files are closed
+ * @param {TabMeta&} tab Temporary table, its files must be open
+ * @param {bool} lock_free Mark or unmark
+ */
+void SmManager::set_lock_free(const TabMeta& tab, bool lock_free) {
+    if (lock_mgr_ == nullptr) {
+        return;
+    }
+    lock_mgr_->set_lock_free(fhs_.at(tab.name)->GetFd(), lock_free);
+    for (auto &[index_name, index] : tab.indexes) {
+        auto it = ihs_.find(index_name);
+        if (it != ihs_.end()) {
+            lock_mgr_->set_lock_free(it->second->fd_, lock_free);
+        }
+    }
+}
+
+/**
+ * @description: Temporary tables are not in the catalog, their files are listed in TEMP_FILES_NAME before they
+ * are created so that a crash cannot leave them behind unnoticed
+ * @param {string&} name Data or index file name
+ */
+void SmManager::add_temp_file(const std::string& name) {
+    temp_files_.insert(name);
+    std::ofstream ofs(TEMP_FILES_NAME, std::ios::trunc);
+    for (auto &file : temp_files_) {
+        ofs << file << '\n';
+    }
+}
+
+void SmManager::remove_temp_file(const std::string& name) {
+    temp_files_.erase(name);
+    std::ofstream ofs(TEMP_FILES_NAME, std::ios::trunc);
+    for (auto &file : temp_files_) {
+        ofs << file << '\n';
+    }
+}
+
+/**
+ * @description: Remove the files listed in TEMP_FILES_NAME by a previous run that did not drop its temporary
+ * tables, skipping names that now belong to tables in the catalog
+ */
+void SmManager::remove_leftover_temp_files() {
+    temp_files_.clear();
+    std::ifstream ifs(TEMP_FILES_NAME);
+    std::string name;
+    while (std::getline(ifs, name)) {
+        if (!name.empty() && !db_.is_table(name) && disk_manager_->is_file(name)) {
+            disk_manager_->destroy_file(name);
+        }
+    }
+    ifs.close();
+    std::remove(TEMP_FILES_NAME.c_str());
+}
+
 /**
  * @description: Create index
  * @param {string&} tab_name Table name
  * @param {vector<string>&} col_names Column names included in index
  * @param {Context*} context
+ * @param {IndexType} index_type B+ tree, hash or ART
  */
-void SmManager::create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context) {
+void SmManager::create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context,
+                             IndexType index_type) {
+    // Scans of a partitioned table read its partitions sequentially, an index would never be used
+    if (db_.is_table(tab_name) && db_.get_table(tab_name).partition.is_partitioned()) {
+        throw RMDBError("Cannot create an index on partitioned table " + tab_name);
+    }
     std::string index_name = ix_manager_->get_index_name(tab_name, col_names);
     // Throw exception if index file doesn't exist
     if (!disk_manager_->is_file(index_name)) {
@@ -293,49 +1189,104 @@ void SmManager::create_index(const std::string& tab_name, const std::vector<std:
             }
 
             // Create index metadata
-            ix_manager_->create_index(index_name, cols);
+            bool temporary = tab.persistence == TAB_TEMPORARY;
+            if (temporary) {
+                add_temp_file(index_name);
+            }
+            ix_manager_->create_index(index_name, cols, index_type);
+            // Indexes of a compressed table are compressed as well
+            if (disk_manager_->is_file_compressed(fhs_[tab_name]->GetFd())) {
+                disk_manager_->compress_file(index_name);
+            }
             std::unique_ptr<IxIndexHandle> ix_handle = ix_manager_->open_index(index_name);
             RmFileHandle* file_handle = fhs_[tab_name].get();
 
-            // Index is ordered storage structure for records, using B+ tree
-            // Unique index prevents duplicate insertion
-            // Allocate index key space
-            char* key = new char[len];
-            // Use previously implemented RmScan to scan table records
-            int pos = 0;
-            auto scan = std::make_unique<RmScan>(file_handle);
-            while (!scan->is_end()) {
-                auto rid = scan->rid();
-                auto record = file_handle->get_record(rid, context);
-                pos = 0;
-                for (const auto &col_meta: cols) {
-                    memcpy(key + pos, record->data + col_meta.offset, col_meta.len);
-                    pos += col_meta.len;
+            // The index is built online: writers keep running and log the slots they change while the table is
+            // scanned without locks, the log is then applied in rounds until it is short enough to be drained
+            // under a brief table X lock, after which the index is published
+            RmChangeLog change_log;
+            file_handle->set_change_log(&change_log);
+            try {
+                std::vector<char> key(len);
+                // Build the B+ tree bottom-up from the sorted keys instead of inserting row by row,
+                // a hash index is filled row by row by the loader
+                bool unique = true;
+                {
+                    IxBulkLoader loader(ix_handle.get());
+                    RmScan scan(file_handle);
+                    while (!scan.is_end()) {
+                        auto rid = scan.rid();
+                        try {
+                            auto record = file_handle->get_record(rid, nullptr, RM_LOCK_TABLE);
+                            make_index_key(cols, record->data, key.data());
+                            loader.add(key.data(), rid);
+                        } catch (RecordNotFoundError&) {
+                            // Deleted after the scan found it, the delete is in the log
+                        }
+                        scan.next();
+                    }
+                    unique = loader.finish();
+                }
+                if (!unique) {
+                    throw InternalError("Duplicate key found when creating unique index: " + index_name);
+                }
+
+                // Catch up with the writers
+                RmChangeLog batch;
+                std::vector<Rid> pending;
+                for (int round = 0; round < ONLINE_INDEX_CATCHUP_ROUNDS; ++round) {
+                    {
+                        std::lock_guard lock(change_log.latch);
+                        std::swap(batch.rids, change_log.rids);
+                        std::swap(batch.has_old, change_log.has_old);
+                        std::swap(batch.old_records, change_log.old_records);
+                    }
+                    size_t changes = batch.rids.size();
+                    apply_index_changes(file_handle, ix_handle.get(), cols, len, batch, pending);
+                    batch.rids.clear();
+                    batch.has_old.clear();
+                    batch.old_records.clear();
+                    if (changes < ONLINE_INDEX_FINAL_CHANGES) {
+                        break;
+                    }
                 }
 
-                // Insert B+ tree index
-                page_id_t result = ix_handle->insert_entry(key, rid, context->txn_);
-                if (result == IX_NO_PAGE) {
-                    delete[] key;  // Free key memory
-                    ix_manager_->close_index(ix_handle.get());
-                    ix_manager_->destroy_index(index_name);
+                // Writers take the table IX lock before they look at the index list, so once the X lock is held
+                // no writer can miss the new index; drain what is left and publish it
+                if (context != nullptr && context->lock_mgr_ != nullptr) {
+                    context->lock_mgr_->lock_exclusive_on_table(context->txn_, file_handle->GetFd());
+                }
+                file_handle->set_change_log(nullptr);
+                apply_index_changes(file_handle, ix_handle.get(), cols, len, change_log, pending);
+                if (!pending.empty()) {
                     throw InternalError("Duplicate key found when creating unique index: " + index_name);
                 }
-                scan->next();
+            } catch (...) {
+                file_handle->set_change_log(nullptr);
+                ix_manager_->close_index(ix_handle.get());
+                ix_manager_->destroy_index(index_name);
+                if (temporary) {
+                    remove_temp_file(index_name);
+                }
+                throw;
             }
-
-            delete [] key;  // Free key memory
             // Update table index information
             tab.indexes[index_name] = IndexMeta {
                 tab_name,
                 len,
                 static_cast<int>(col_names.size()),
-                cols
+                cols,
+                index_type
             };
+            bind_index(tab.indexes[index_name], ix_handle.get());
 
             ihs_.emplace(index_name, std::move(ix_handle));  
             // Store index handle in ihs_ for unified management
-            flush_meta();
+            if (temporary) {
+                set_lock_free(tab, true);
+            }
+            invalidate_plans();
+            log_table_meta(tab);
         }
     } else {
         throw IndexExistsError(tab_name, col_names);
@@ -358,18 +1309,19 @@ std::string format_index_cols(const std::vector<ColMeta>& cols) {
 }
 
 void SmManager::show_indexes(const std::string &table_name, Context *context) {
-    std::ofstream outfile("output.txt", std::ios::out | std::ios::app);
+    std::string outfile;
     RecordPrinter printer(3);
     std::vector<std::string> rec_str{table_name, "unique", ""};
 
     for (const auto &[_, index]: db_.tabs_[table_name].indexes) {
         std::string cols_str = format_index_cols(index.cols);
         // File output
-        outfile << "| " << table_name << " | unique | " << cols_str << " |\n";
+        outfile += "| " + table_name + " | unique | " + cols_str + " |\n";
         // Buffer output
         rec_str[2] = cols_str;
         printer.print_indexes(rec_str, context);
     }
+    OutputWriter::instance().append(std::move(outfile));
 }
 
 /**
@@ -380,17 +1332,31 @@ void SmManager::show_indexes(const std::string &table_name, Context *context) {
  */
 void SmManager::drop_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context) {
     TabMeta &tab = db_.get_table(tab_name);
+    // Views find the row of a group through the index on their group columns
+    if (tab.mat_view.is_view() && col_names == tab.mat_view_group_cols()) {
+        throw RMDBError("Cannot drop the group index of materialized view " + tab_name);
+    }
     // Get table metadata
     std::string index_name = ix_manager_->get_index_name(tab_name, col_names);
     // Can delete existing index file
     if (disk_manager_->is_file(index_name)) {
+        stop_buffer_pool_warmup();
+        bool temporary = tab.persistence == TAB_TEMPORARY;
+        if (temporary && lock_mgr_ != nullptr) {
+            lock_mgr_->set_lock_free(ihs_[index_name]->fd_, false);
+        }
+        ih_ids_[tab.indexes.at(index_name).id] = nullptr;
         ix_manager_->close_index(ihs_[index_name].get());
         ix_manager_->destroy_index(index_name);
+        if (temporary) {
+            remove_temp_file(index_name);
+        }
         ihs_.erase(index_name);  
         // Remove index file handle from ihs_
         tab.indexes.erase(index_name);  
         // Remove index info from table metadata
-        flush_meta();
+        invalidate_plans();
+        log_table_meta(tab);
     } else {
         throw IndexNotFoundError(tab_name, col_names);
     }
@@ -408,13 +1374,23 @@ void SmManager::drop_index(const std::string& tab_name, const std::vector<ColMet
     std::string index_name = ix_manager_->get_index_name(tab_name, cols);
     // Can delete existing index file
     if (disk_manager_->is_file(index_name)) {
+        stop_buffer_pool_warmup();
+        bool temporary = tab.persistence == TAB_TEMPORARY;
+        if (temporary && lock_mgr_ != nullptr) {
+            lock_mgr_->set_lock_free(ihs_[index_name]->fd_, false);
+        }
+        ih_ids_[tab.indexes.at(index_name).id] = nullptr;
         ix_manager_->close_index(ihs_[index_name].get());
         ix_manager_->destroy_index(index_name);
+        if (temporary) {
+            remove_temp_file(index_name);
+        }
         ihs_.erase(index_name);
         // Remove index file handle from ihs_
         tab.indexes.erase(index_name);  
         // Remove index info from table metadata
-        flush_meta();
+        invalidate_plans();
+        log_table_meta(tab);
     } else {
         std::vector<std::string> col_names;
         col_names.reserve(cols.size());
@@ -425,33 +1401,205 @@ void SmManager::drop_index(const std::string& tab_name, const std::vector<ColMet
     }
 }
 
-// Statistics-related method implementations
-size_t SmManager::getTableRowCount(const std::string& tab_name) {
-    if (db_.is_table(tab_name)) {
-        auto it = fhs_.find(tab_name);
-        if (it != fhs_.end()) {
-            RmFileHandle* fh = it->second.get();
-            size_t row_count = 0;
-            
-            // Scan entire table to count rows
-            try {
-                auto scan = std::make_unique<RmScan>(fh);
-                while (!scan->is_end()) {
-                    row_count++;
-                    scan->next();
+/**
+ * @description: Vacuum a table: move the records of sparse pages into free slots of earlier pages, point the
+ * indexes at the new rids and truncate the empty pages at the end of the data file
+ * @param {string&} tab_name Table name
+ * @param {Context*} context
+ * @param {int} min_pages Leave the table alone unless at least this many pages can be emptied
+ * @return {int} Number of pages emptied
+ */
+int SmManager::vacuum_table(const std::string& tab_name, Context* context, int min_pages) {
+    if (!db_.is_table(tab_name)) {
+        throw TableNotFoundError(tab_name);
+    }
+    TabMeta &tab = db_.get_table(tab_name);
+    if (tab.partition.is_partitioned()) {
+        int emptied = 0;
+        for (auto &partition_name : tab.partition_names()) {
+            emptied += vacuum_table(partition_name, context, min_pages);
+        }
+        return emptied;
+    }
+    RmFileHandle* fh = fhs_.at(tab_name).get();
+    // The background worker checks page headers without locking first, so idle tables are never locked
+    if (min_pages > 1) {
+        BufferAccessStrategy strategy(BULK_READ_RING_PAGES);
+        if (fh->estimate_vacuum(fh->get_page_records(&strategy)) < min_pages) {
+            return 0;
+        }
+    }
+    // Moved records change their rids, no other transaction may hold any of them
+    context->lock_mgr_->lock_exclusive_on_table(context->txn_, fh->GetFd());
+    // An online index build does not hold the table lock while it scans, records must stay where it found them
+    if (fh->is_logging_changes()) {
+        return 0;
+    }
+    // Truncated pages must not be read back in by the warm-up thread
+    stop_buffer_pool_warmup();
+    std::vector<char> key;
+    return fh->vacuum(context, min_pages, [&](const Rid& rid, const Rid& new_rid, const RmRecord& record) {
+        for (auto &[index_name, index] : tab.indexes) {
+            auto ih = get_ih(index.id);
+            key.resize(index.col_tot_len);
+            int offset = 0;
+            for (auto &col : index.cols) {
+                memcpy(key.data() + offset, record.data + col.offset, col.len);
+                offset += col.len;
+            }
+            ih->delete_entry(key.data(), context->txn_);
+            ih->insert_entry(key.data(), new_rid, context->txn_);
+        }
+        // Rolled back in reverse order: the copy is removed first, then the record is put back at its old rid
+        context->txn_->append_write_record(new WriteRecord(WType::DELETE_TUPLE, tab_name, rid, record, tab.id));
+        context->txn_->append_write_record(new WriteRecord(WType::INSERT_TUPLE, new_rid, record, tab_name, tab.id));
+    });
+}
+
+/**
+ * @description: Collect per-column statistics of a table: number of distinct values, most common values and,
+ * for numeric columns, min/max and an equi-depth histogram. Tables of at most ANALYZE_SAMPLE_PAGES pages are read
+ * completely and their row count is recalibrated; larger tables are block-sampled, i.e. ANALYZE_SAMPLE_PAGES
+ * random pages are read in file order and every record on them is used. The statistics are persisted in the
+ * database metadata
+ * @param {string&} tab_name Table name
+ * @param {Context*} context
+ */
+void SmManager::analyze_table(const std::string& tab_name, Context* context) {
+    if (!db_.is_table(tab_name)) {
+        throw TableNotFoundError(tab_name);
+    }
+    TabMeta &tab = db_.get_table(tab_name);
+    if (tab.partition.is_partitioned()) {
+        for (auto &partition_name : tab.partition_names()) {
+            analyze_table(partition_name, context);
+        }
+        return;
+    }
+    RmFileHandle* fh = fhs_.at(tab_name).get();
+    if (context != nullptr && context->lock_mgr_ != nullptr) {
+        context->lock_mgr_->lock_shared_on_table(context->txn_, fh->GetFd());
+    }
+    // Modifications from here on count towards the next automatic ANALYZE
+    fh->reset_rows_modified();
+
+    // Pick the pages to read. Selection sampling keeps them in file order; the fixed seed makes
+    // repeated ANALYZE of an unchanged table produce the same statistics
+    int num_pages = fh->get_file_hdr().num_pages;
+    std::vector<int> pages;
+    int candidates = num_pages - RM_FIRST_RECORD_PAGE;
+    bool sampled = candidates > ANALYZE_SAMPLE_PAGES;
+    if (sampled) {
+        std::mt19937_64 rng(0x5eed);
+        int needed = ANALYZE_SAMPLE_PAGES;
+        for (int page_no = RM_FIRST_RECORD_PAGE; page_no < num_pages && needed > 0; ++page_no) {
+            int remaining = num_pages - page_no;
+            if (static_cast<int>(rng() % remaining) < needed) {
+                pages.push_back(page_no);
+                --needed;
+            }
+        }
+    }
+
+    // Distinct values are counted by their 64-bit hashes, collisions are negligible for estimation
+    std::vector<std::unordered_map<uint64_t, size_t>> counts(tab.cols.size());
+    std::vector<std::vector<double>> numbers(tab.cols.size());
+    size_t sample_rows = 0;
+    RmRecordView view;
+    auto collect = [&](RmScan &scan) {
+        for (; !scan.is_end(); scan.next()) {
+            fh->get_record_view(scan.rid(), view, context, RM_LOCK_TABLE);
+            const char* data = view.get()->data;
+            for (size_t i = 0; i < tab.cols.size(); ++i) {
+                const ColMeta &col = tab.cols[i];
+                const char* value = data + col.offset;
+                if (col.type == TYPE_STRING) {
+                    ++counts[i][ColStats::hash_value(std::string_view(value, col.len))];
+                    continue;
                 }
-            } catch (...) {
-                // Return 0 if scan fails
-                return 0;
+                double v = col.type == TYPE_INT ? *reinterpret_cast<const int*>(value)
+                                                : *reinterpret_cast<const float*>(value);
+                ++counts[i][ColStats::hash_value(v)];
+                numbers[i].push_back(v);
             }
-            
-            return row_count;
-        } else {
-            return 0;
+            ++sample_rows;
+        }
+    };
+    if (sampled) {
+        for (int page_no : pages) {
+            RmScan scan(fh, nullptr, nullptr, page_no, page_no + 1);
+            collect(scan);
         }
     } else {
+        RmScan scan(fh);
+        collect(scan);
+    }
+    view.reset();
+
+    size_t num_rows = sampled ? std::max(fh->get_num_rows(), sample_rows) : sample_rows;
+    std::vector<ColStats> stats(tab.cols.size());
+    for (size_t i = 0; i < tab.cols.size() && sample_rows > 0; ++i) {
+        ColStats &st = stats[i];
+        double n = static_cast<double>(sample_rows);
+        size_t distinct = counts[i].size();
+        size_t singles = 0;
+        for (auto &[hash, count] : counts[i]) {
+            singles += count == 1;
+        }
+        // Haas-Stokes (Duj1) estimator scales the sampled distinct count to the whole table;
+        // it is exact when the whole table was read
+        double ndv = n * distinct / (n - singles + singles * n / static_cast<double>(num_rows));
+        st.ndv = std::max<size_t>(distinct, std::min<size_t>(num_rows, static_cast<size_t>(ndv + 0.5)));
+
+        // Most common values: repeated values more frequent than the average one
+        std::vector<std::pair<uint64_t, size_t>> common;
+        for (auto &[hash, count] : counts[i]) {
+            if (count > 1 && count * distinct > sample_rows) {
+                common.emplace_back(hash, count);
+            }
+        }
+        size_t keep = std::min(common.size(), ANALYZE_MCV_COUNT);
+        std::partial_sort(common.begin(), common.begin() + keep, common.end(),
+                          [](auto &a, auto &b) { return a.second > b.second; });
+        for (size_t k = 0; k < keep; ++k) {
+            st.mcv.emplace_back(common[k].first, common[k].second / n);
+        }
+
+        // Equi-depth histogram: bucket boundaries at evenly spaced ranks of the sorted sample
+        auto &vals = numbers[i];
+        if (!vals.empty()) {
+            std::sort(vals.begin(), vals.end());
+            st.min_val = vals.front();
+            st.max_val = vals.back();
+            size_t buckets = std::min(ANALYZE_HIST_BUCKETS, vals.size() - 1);
+            for (size_t k = 0; k <= buckets && buckets > 0; ++k) {
+                st.bounds.push_back(vals[k * (vals.size() - 1) / buckets]);
+            }
+        }
+    }
+    tab.col_stats = std::move(stats);
+    fh->set_num_rows(num_rows);
+    // Corrections learned against the old statistics no longer apply
+    CardinalityFeedback::instance().reset_table(tab_name);
+    invalidate_plans();
+    log_table_meta(tab);
+}
+
+// Statistics-related method implementations
+size_t SmManager::getTableRowCount(const std::string& tab_name) {
+    if (!db_.is_table(tab_name)) {
         throw TableNotFoundError(tab_name);
     }
+    auto &tab = db_.get_table(tab_name);
+    if (tab.partition.is_partitioned()) {
+        size_t rows = 0;
+        for (auto &partition_name : tab.partition_names()) {
+            rows += getTableRowCount(partition_name);
+        }
+        return rows;
+    }
+    auto it = fhs_.find(tab_name);
+    return it == fhs_.end() ? 0 : it->second->get_num_rows();
 }
 
 std::vector<size_t> SmManager::getColumnCardinalities(const std::string& tab_name) {
@@ -464,12 +1612,15 @@ std::vector<size_t> SmManager::getColumnCardinalities(const std::string& tab_nam
             // Initialize cardinalities to 0 for each column
             cardinalities.resize(tab.cols.size(), 0);
             
-            // In actual implementation, more precise statistics should be maintained
-            // Here simplified to return estimated values based on table row count
+            // Use the statistics collected by ANALYZE, otherwise estimate from the row count
             size_t row_count = getTableRowCount(tab_name);
             for (size_t i = 0; i < cardinalities.size(); i++) {
-                // Assume each column's cardinality is about 70% of row count (estimated)
-                cardinalities[i] = static_cast<size_t>(row_count * 0.7);
+                if (i < tab.col_stats.size()) {
+                    cardinalities[i] = tab.col_stats[i].ndv;
+                } else {
+                    // Assume each column's cardinality is about 70% of row count (estimated)
+                    cardinalities[i] = static_cast<size_t>(row_count * 0.7);
+                }
             }
         } else {
             // Return empty cardinality info if table file doesn't exist
@@ -486,6 +1637,11 @@ double SmManager::getSelectivity(const std::string& tab_name, const std::string&
     if (db_.is_table(tab_name)) {
         TabMeta& tab = db_.get_table(tab_name);
         if (tab.is_col(col_name)) {
+            // With ANALYZE statistics an equality matches 1/NDV of the rows
+            const ColStats *stats = tab.get_col_stats(col_name);
+            if (stats != nullptr && stats->ndv > 0 && (op == OP_EQ || op == OP_NE)) {
+                return op == OP_EQ ? 1.0 / stats->ndv : 1.0 - 1.0 / stats->ndv;
+            }
             // Simplified selectivity estimation
             switch (op) {
                 case OP_EQ:
@@ -506,4 +1662,104 @@ double SmManager::getSelectivity(const std::string& tab_name, const std::string&
     } else {
         throw TableNotFoundError(tab_name);
     }
+}
+
+/**
+ * @description: Selectivity of "col op val". With ANALYZE statistics equality uses the most common values
+ * (or spreads the remaining rows evenly over the other distinct values) and numeric ranges are read off the
+ * equi-depth histogram; otherwise falls back to the value-independent estimate
+ */
+double SmManager::getSelectivity(const std::string& tab_name, const std::string& col_name, CompOp op,
+                                 const Value& val) {
+    if (!db_.is_table(tab_name)) {
+        throw TableNotFoundError(tab_name);
+    }
+    const ColStats *stats = db_.get_table(tab_name).get_col_stats(col_name);
+    if (stats == nullptr || stats->ndv == 0) {
+        return getSelectivity(tab_name, col_name, op);
+    }
+    double v = val.type == TYPE_INT ? val.int_val : val.float_val;
+    uint64_t hash = val.type == TYPE_STRING ? ColStats::hash_value(std::string_view(val.str_val))
+                                            : ColStats::hash_value(v);
+    double below = -1;
+    switch (op) {
+        case OP_EQ:
+            return stats->eq_fraction(hash);
+        case OP_NE:
+            return 1.0 - stats->eq_fraction(hash);
+        case OP_LT:
+        case OP_GE:
+            below = val.type == TYPE_STRING ? -1 : stats->below_fraction(v, false);
+            break;
+        case OP_LE:
+        case OP_GT:
+            below = val.type == TYPE_STRING ? -1 : stats->below_fraction(v, true);
+            break;
+        default:
+            break;
+    }
+    if (below < 0) {
+        return getSelectivity(tab_name, col_name, op);
+    }
+    return op == OP_LT || op == OP_LE ? below : 1.0 - below;
+}
+
+double SmManager::getSelectivity(const std::string& tab_name, const std::vector<Condition>& conds) {
+    double sel = 1.0;
+    for (auto& cond : conds) {
+        if (!cond.is_rhs_val || cond.lhs_col.tab_name != tab_name) {
+            continue;
+        }
+        try {
+            sel *= getSelectivity(tab_name, cond.lhs_col.col_name, cond.op, cond.rhs_val);
+        } catch (RMDBError&) {
+            // No statistics to go by (e.g. an aliased table name); the condition is left out of the estimate
+        }
+    }
+    return sel;
+}
+
+/**
+ * @description: Compare the rows a complete scan actually returned with the estimate from the statistics
+ * and record the correction in CardinalityFeedback. When the correction moved by 2x or more, cached plans
+ * built with the old one are invalidated. Called from scan destructors, so it never throws
+ */
+void SmManager::observe_scan_rows(const std::string& tab_name, const std::vector<Condition>& conds, size_t rows) {
+    try {
+        // Column-column conditions also filter the scan but are not part of the estimate
+        for (auto& cond : conds) {
+            if (!cond.is_rhs_val) {
+                return;
+            }
+        }
+        std::string key = CardinalityFeedback::key(tab_name, conds);
+        if (key.empty() || !db_.is_table(tab_name)) {
+            return;
+        }
+        double estimated = static_cast<double>(std::max<size_t>(getTableRowCount(tab_name), 1)) *
+                           getSelectivity(tab_name, conds);
+        if (CardinalityFeedback::instance().observe(key, estimated, static_cast<double>(rows))) {
+            invalidate_plans();
+        }
+    } catch (...) {
+        // Feedback is best effort; a failed observation is simply dropped
+    }
+}
+
+/**
+ * @description: Tables whose rows modified since the last ANALYZE exceed
+ * AUTO_ANALYZE_MIN_ROWS + AUTO_ANALYZE_SCALE * row count. Temporary tables are private to a session and skipped
+ */
+std::vector<std::string> SmManager::stale_stats_tables() {
+    std::vector<std::string> tables;
+    for (auto& [tab_name, fh] : fhs_) {
+        if (db_.get_table(tab_name).persistence == TAB_TEMPORARY) {
+            continue;
+        }
+        double threshold = AUTO_ANALYZE_MIN_ROWS + AUTO_ANALYZE_SCALE * static_cast<double>(fh->get_num_rows());
+        if (static_cast<double>(fh->rows_modified()) > threshold) {
+            tables.push_back(tab_name);
+        }
+    }
+    return tables;
 }
\ No newline at end of file
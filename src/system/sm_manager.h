@@ -10,12 +10,18 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <atomic>
+#include <set>
+#include <thread>
+
 #include "index/ix.h"
 #include "record/rm_file_handle.h"
 #include "sm_defs.h"
+#include "sm_catalog.h"
 #include "sm_meta.h"
 #include "common/context.h"
 #include "common/common.h"
+#include "common/metrics.h"
 
 class Context;
 
@@ -23,6 +29,7 @@ struct ColDef {
     std::string name;  // Column name
     ColType type;      // Type of column
     int len;           // Length of column
+    bool dictionary = false;  // Dictionary-encode the column (string columns of fixed-format tables)
 };
 
 /* System manager, responsible for metadata management and DDL statement execution */
@@ -32,10 +39,18 @@ class SmManager {
     std::unordered_map<std::string, std::unique_ptr<RmFileHandle>> fhs_;    // file name -> record file handle, data files for each table in current database
     std::unordered_map<std::string, std::unique_ptr<IxIndexHandle>> ihs_;   // file name -> index file handle, files for each index in current database
    private:
+    std::vector<RmFileHandle*> fh_ids_;      // Table id -> record file handle, nullptr for dropped tables
+    std::vector<IxIndexHandle*> ih_ids_;     // IndexMeta::id -> index file handle, nullptr for dropped indexes
+    CatalogFile catalog_;                    // db.meta of the open database, DDL appends to its journal
     DiskManager* disk_manager_;
     BufferPoolManager* buffer_pool_manager_;
     RmManager* rm_manager_;
     IxManager* ix_manager_;
+    std::thread warmup_thread_;              // Background thread reading the buffer pool dump back in
+    std::atomic<bool> warmup_stop_{false};
+    std::atomic<uint64_t> catalog_version_{0};  // Bumped whenever cached plans may be out of date
+    LockManager* lock_mgr_ = nullptr;        // Told which files belong to temporary tables
+    std::set<std::string> temp_files_;       // Data and index files of temporary tables, mirrored in TEMP_FILES_NAME
 
    public:
     SmManager(DiskManager* disk_manager, BufferPoolManager* buffer_pool_manager, RmManager* rm_manager,
@@ -45,14 +60,28 @@ class SmManager {
           rm_manager_(rm_manager),
           ix_manager_(ix_manager) {}
 
-    ~SmManager() {}
+    ~SmManager() { stop_buffer_pool_warmup(); }
 
     BufferPoolManager* get_bpm() { return buffer_pool_manager_; }
 
+    DiskManager* get_disk_manager() { return disk_manager_; }
+
     RmManager* get_rm_manager() { return rm_manager_; }  
 
     IxManager* get_ix_manager() { return ix_manager_; }  
 
+    void set_lock_manager(LockManager* lock_mgr) { lock_mgr_ = lock_mgr; }
+
+    // Handles by the dense ids bound when files are opened; executors use these instead of the name-keyed maps
+    RmFileHandle* get_fh(int tab_id) const { return fh_ids_.at(tab_id); }
+
+    IxIndexHandle* get_ih(int index_id) const { return ih_ids_.at(index_id); }
+
+    // Version checked by the plan cache: DDL, ANALYZE and join knob changes bump it
+    uint64_t catalog_version() const { return catalog_version_.load(); }
+
+    void invalidate_plans() { catalog_version_.fetch_add(1); }
+
     bool is_dir(const std::string& db_name);
 
     void create_db(const std::string& db_name);
@@ -65,21 +94,63 @@ class SmManager {
 
     void flush_meta();
 
+    void dump_buffer_pool();
+
+    void start_buffer_pool_warmup();
+
+    void stop_buffer_pool_warmup();
+
     void show_tables(Context* context);
 
+    void show_buffer_status(Context* context);
+
+    void show_locks(Context* context);
+
+    void show_lock_status(Context* context);
+
+    void get_status(LockManager* lock_manager, std::vector<MetricSample>& samples);
+
+    void show_status(Context* context);
+
+    void show_memory(Context* context);
+
+    void show_sessions(Context* context);
+
     void desc_table(const std::string& tab_name, Context* context);
 
-    void create_table(const std::string& tab_name, const std::vector<ColDef>& col_defs, Context* context);
+    void create_table(const std::string& tab_name, const std::vector<ColDef>& col_defs, Context* context,
+                      RmFormat format = RM_FORMAT_FIXED, TabPersistence persistence = TAB_PERMANENT,
+                      bool in_memory = false, bool compressed = false);
 
     void show_indexes(const std::string& tab_name, Context* context);
 
     void drop_table(const std::string& tab_name, Context* context);
 
-    void create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context);
+    void truncate_table(const std::string& tab_name, Context* context);
+
+    // Create an empty aggregate materialized view over def.base_tab, which its writers then keep up to date
+    void create_mat_view(const std::string& view_name, const std::vector<ColDef>& col_defs, const MatViewDef& def,
+                         Context* context);
+
+    // Create a hash partitioned table and its def.num empty partitions, records go to the partition of their def.col
+    void create_partitioned_table(const std::string& tab_name, const std::vector<ColDef>& col_defs,
+                                  const PartitionDef& def, Context* context, RmFormat format = RM_FORMAT_FIXED,
+                                  TabPersistence persistence = TAB_PERMANENT, bool in_memory = false,
+                                  bool compressed = false);
+
+    // Drop the temporary tables of one session, or of every session when session_id is 0
+    void drop_temp_tables(uint64_t session_id);
+
+    void create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context,
+                      IndexType index_type = INDEX_BTREE);
 
     void drop_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context);
     
     void drop_index(const std::string& tab_name, const std::vector<ColMeta>& col_names, Context* context);
+
+    int vacuum_table(const std::string& tab_name, Context* context, int min_pages = 1);
+
+    void analyze_table(const std::string& tab_name, Context* context);
     
     // Statistics-related methods
     size_t getTableRowCount(const std::string& tab_name);
@@ -87,4 +158,44 @@ class SmManager {
     std::vector<size_t> getColumnCardinalities(const std::string& tab_name);
     
     double getSelectivity(const std::string& tab_name, const std::string& col_name, CompOp op);
+
+    double getSelectivity(const std::string& tab_name, const std::string& col_name, CompOp op, const Value& val);
+
+    // Combined selectivity of the conditions comparing a column of tab_name with a constant
+    double getSelectivity(const std::string& tab_name, const std::vector<Condition>& conds);
+
+    // A complete scan of tab_name under conds returned rows records: feed it back to CardinalityFeedback
+    void observe_scan_rows(const std::string& tab_name, const std::vector<Condition>& conds, size_t rows);
+
+    // Tables modified enough since their last ANALYZE that their statistics are considered stale
+    std::vector<std::string> stale_stats_tables();
+
+   private:
+    // Register an opened table (its file handle must be in fhs_) under its table id
+    void bind_table(TabMeta& tab);
+
+    // Give an opened index the next dense id
+    void bind_index(IndexMeta& index, IxIndexHandle* ih);
+
+    // Fill an opened ART index, which keeps its entries only in memory, from its table
+    void load_art_index(const IndexMeta& index, IxIndexHandle* ih);
+
+    // Swap empty files in for the data and index files of tab, without locking
+    void truncate_files(TabMeta& tab);
+
+    // Rename the empty files left by TRUNCATE over the files of tab, or remove them if the swap never started
+    void finish_truncate(const TabMeta& tab);
+
+    // Mark or unmark the open files of a temporary table as needing no locks
+    void set_lock_free(const TabMeta& tab, bool lock_free);
+
+    // Add or remove a file of a temporary table and rewrite TEMP_FILES_NAME
+    void add_temp_file(const std::string& name);
+    void remove_temp_file(const std::string& name);
+
+    // Remove the files of temporary tables left behind by a crash
+    void remove_leftover_temp_files();
+
+    // Journal the metadata of one table after a DDL, with its current row count
+    void log_table_meta(TabMeta& tab);
 };
\ No newline at end of file
@@ -11,12 +11,15 @@ See the Mulan PSL v2 for more details. */
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "common/common.h"
 #include "errors.h"
 #include "sm_defs.h"
 
@@ -28,6 +31,7 @@ struct ColMeta {
     int len;                // 字段长度
     int offset;             // 字段位于记录中的偏移量
     bool index;             /** unused */
+    int col_id = -1;        // 字段在表中的下标，不写入元数据文件，由TabMeta::bind_col_ids填入
 
     friend std::ostream &operator<<(std::ostream &os, const ColMeta &col) {
         // ColMeta中有各个基本类型的变量，然后调用重载的这些变量的操作符<<（具体实现逻辑在defs.h）
@@ -46,9 +50,11 @@ struct IndexMeta {
     int col_tot_len;                // 索引字段长度总和
     int col_num;                    // 索引字段数量
     std::vector<ColMeta> cols;      // 索引包含的字段
+    IndexType type = INDEX_BTREE;   // B+树、哈希或ART
+    int id = -1;                    // 索引句柄在SmManager::ih_ids_中的下标，打开索引时分配，不写入元数据文件
 
     friend std::ostream &operator<<(std::ostream &os, const IndexMeta &index) {
-        os << index.tab_name << " " << index.col_tot_len << " " << index.col_num;
+        os << index.tab_name << " " << index.col_tot_len << " " << index.col_num << " " << index.type;
         for(auto& col: index.cols) {
             os << "\n" << col;
         }
@@ -56,7 +62,7 @@ struct IndexMeta {
     }
 
     friend std::istream &operator>>(std::istream &is, IndexMeta &index) {
-        is >> index.tab_name >> index.col_tot_len >> index.col_num;
+        is >> index.tab_name >> index.col_tot_len >> index.col_num >> index.type;
         for(int i = 0; i < index.col_num; ++i) {
             ColMeta col;
             is >> col;
@@ -66,18 +72,195 @@ struct IndexMeta {
     }
 };
 
+/* ANALYZE收集的字段统计信息 */
+struct ColStats {
+    size_t ndv = 0;         // 不同值的个数
+    double min_val = 0;     // 数值字段的最小值，字符串字段不收集
+    double max_val = 0;     // 数值字段的最大值
+    std::vector<double> bounds;     // 数值字段的等深直方图，相邻两个边界之间的记录数相同，字符串字段为空
+    std::vector<std::pair<uint64_t, double>> mcv;   // 最常见的值（值的哈希）和它占记录数的比例，按比例从大到小
+
+    /* 统计信息中的值按哈希比较，ANALYZE收集和估算选择率时用同样的哈希 */
+    static uint64_t hash_value(double v) {
+        return std::hash<double>{}(v == 0 ? 0 : v);  // -0.0和0.0是同一个值
+    }
+
+    static uint64_t hash_value(std::string_view s) {
+        return std::hash<std::string_view>{}(s.substr(0, s.find('\0')));
+    }
+
+    /* 等于哈希为hash的值的记录所占比例：是常见值时直接用它的比例，否则在其余的值中平均分配 */
+    double eq_fraction(uint64_t hash) const {
+        double mcv_total = 0;
+        for (auto &[h, freq] : mcv) {
+            if (h == hash) {
+                return freq;
+            }
+            mcv_total += freq;
+        }
+        if (ndv <= mcv.size()) {
+            return 0;
+        }
+        return std::max(0.0, 1.0 - mcv_total) / static_cast<double>(ndv - mcv.size());
+    }
+
+    /* 小于（inclusive为true时小于等于）v的记录所占比例，在v所在的桶内按线性分布插值；没有直方图时返回负数 */
+    double below_fraction(double v, bool inclusive) const {
+        if (bounds.size() < 2) {
+            return -1;
+        }
+        if (v < bounds.front() || (!inclusive && v == bounds.front())) {
+            return 0;
+        }
+        if (v > bounds.back() || (inclusive && v == bounds.back())) {
+            return 1;
+        }
+        size_t buckets = bounds.size() - 1;
+        size_t i = std::upper_bound(bounds.begin(), bounds.end(), v) - bounds.begin() - 1;
+        i = std::min(i, buckets - 1);
+        double lo = bounds[i], hi = bounds[i + 1];
+        double in_bucket = hi > lo ? (v - lo) / (hi - lo) : (inclusive ? 1.0 : 0.0);
+        return (i + in_bucket) / buckets;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const ColStats &stats) {
+        auto precision = os.precision(17);
+        os << stats.ndv << ' ' << stats.min_val << ' ' << stats.max_val << ' ' << stats.bounds.size();
+        for (double bound : stats.bounds) {
+            os << ' ' << bound;
+        }
+        os << ' ' << stats.mcv.size();
+        for (auto &[hash, freq] : stats.mcv) {
+            os << ' ' << hash << ' ' << freq;
+        }
+        os.precision(precision);
+        return os;
+    }
+
+    friend std::istream &operator>>(std::istream &is, ColStats &stats) {
+        size_t n;
+        is >> stats.ndv >> stats.min_val >> stats.max_val >> n;
+        stats.bounds.resize(n);
+        for (auto &bound : stats.bounds) {
+            is >> bound;
+        }
+        is >> n;
+        stats.mcv.resize(n);
+        for (auto &[hash, freq] : stats.mcv) {
+            is >> hash >> freq;
+        }
+        return is;
+    }
+};
+
+/* 表的持久性：UNLOGGED表不写日志，非正常关闭后清空；TEMPORARY表只属于创建它的会话，元数据不落盘，会话结束时删除 */
+enum TabPersistence { TAB_PERMANENT = 0, TAB_UNLOGGED = 1, TAB_TEMPORARY = 2 };
+
+/* 物化视图的一个字段：基表的分组字段（AGG_COL），或者基表字段上的聚合，COUNT(*)时src_col为空 */
+struct MatViewCol {
+    AggType agg_type;
+    std::string src_col;
+};
+
+/* 增量维护的聚合物化视图的定义。视图表的字段和cols一一对应，分组字段上建有唯一索引，
+ * 基表的插入、删除和更新在同一个事务中把增量合并到视图表中 */
+struct MatViewDef {
+    std::string base_tab;           // 基表，为空时不是物化视图
+    std::vector<MatViewCol> cols;
+
+    bool is_view() const { return !base_tab.empty(); }
+};
+
+/* 哈希分区表的定义。分区表本身不存记录，每条记录按分区字段的哈希值放进一个分区；
+ * 分区是名为 表名$p<i> 的普通表，有自己的数据文件和表ID，语句中写不出这样的表名 */
+struct PartitionDef {
+    std::string col;                // 分区字段，为空时不是分区表
+    int num = 0;                    // 分区数
+    std::string parent;             // 表是一个分区时，它所属的分区表
+
+    bool is_partitioned() const { return !col.empty(); }
+
+    /* 分区表tab_name的第i个分区的表名 */
+    static std::string partition_name(const std::string &tab_name, int i) {
+        return tab_name + "$p" + std::to_string(i);
+    }
+
+    /* 分区字段的值（记录中的格式）所在的分区。分区方式写在元数据中，哈希要在重启之后保持不变，不用std::hash */
+    int partition_of(const char *value, int len) const {
+        uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+        for (int i = 0; i < len; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(value[i])) * 1099511628211ULL;
+        }
+        return static_cast<int>(hash % static_cast<uint64_t>(num));
+    }
+};
+
 /* 表元数据 */
 struct TabMeta {
     std::string name;                   // 表名称
+    int id = -1;                        // 表ID，和数据文件头中的table_id相同，打开数据文件时填入
     std::vector<ColMeta> cols;          // 表包含的字段
     // std::vector<IndexMeta> indexes;     // 表上建立的索引
     std::unordered_map<std::string, IndexMeta> indexes; // 表上建立的索引，使用unordered_map以便快速查找
+    size_t num_rows = 0;                // 表中的记录数，运行时由RmFileHandle维护，写元数据时从中取出
+    std::vector<ColStats> col_stats;    // 和cols一一对应，没有ANALYZE过时为空
+    TabPersistence persistence = TAB_PERMANENT;
+    uint64_t owner_session = 0;         // 临时表所属的会话
+    MatViewDef mat_view;                // 表是物化视图时它的定义
+    std::vector<std::string> mat_views; // 建在这张表上的物化视图，不写进元数据，打开数据库时由视图的定义重建
+    PartitionDef partition;             // 表是分区表或者分区时的定义
 
     TabMeta(){}
 
     TabMeta(const TabMeta &other) {
         name = other.name;
+        id = other.id;
         for(auto col : other.cols) cols.push_back(col);
+        indexes = other.indexes;
+        num_rows = other.num_rows;
+        col_stats = other.col_stats;
+        persistence = other.persistence;
+        owner_session = other.owner_session;
+        mat_view = other.mat_view;
+        mat_views = other.mat_views;
+        partition = other.partition;
+    }
+
+    TabMeta &operator=(const TabMeta &other) = default;
+
+    /* 物化视图中分组字段的名字，视图表在这些字段上有唯一索引 */
+    std::vector<std::string> mat_view_group_cols() const {
+        std::vector<std::string> group_cols;
+        for (size_t i = 0; i < mat_view.cols.size() && i < cols.size(); ++i) {
+            if (mat_view.cols[i].agg_type == AGG_COL) {
+                group_cols.push_back(cols[i].name);
+            }
+        }
+        return group_cols;
+    }
+
+    /* 分区表的各个分区的表名，不是分区表时为空 */
+    std::vector<std::string> partition_names() const {
+        std::vector<std::string> names;
+        for (int i = 0; i < partition.num; ++i) {
+            names.push_back(PartitionDef::partition_name(name, i));
+        }
+        return names;
+    }
+
+    /* 表只对session_id可见：其他会话的临时表不可见 */
+    bool is_visible_to(uint64_t session_id) const {
+        return persistence != TAB_TEMPORARY || owner_session == session_id;
+    }
+
+    /* 字段col_name的统计信息，没有ANALYZE过时返回nullptr */
+    const ColStats *get_col_stats(const std::string &col_name) const {
+        for (size_t i = 0; i < col_stats.size() && i < cols.size(); ++i) {
+            if (cols[i].name == col_name) {
+                return &col_stats[i];
+            }
+        }
+        return nullptr;
     }
 
     /* 判断当前表中是否存在名为col_name的字段 */
@@ -121,6 +304,21 @@ struct TabMeta {
         return pos;
     }
 
+    /* 获取分析阶段绑定过的字段的元数据，按下标直接定位，没有绑定时按名称查找 */
+    std::vector<ColMeta>::iterator get_col(const TabCol &col) {
+        if (col.col_id >= 0 && col.col_id < static_cast<int>(cols.size())) {
+            return cols.begin() + col.col_id;
+        }
+        return get_col(col.col_name);
+    }
+
+    /* 给每个字段填入它在表中的下标 */
+    void bind_col_ids() {
+        for (size_t i = 0; i < cols.size(); ++i) {
+            cols[i].col_id = static_cast<int>(i);
+        }
+    }
+
     friend std::ostream &operator<<(std::ostream &os, const TabMeta &tab) {
         os << tab.name << '\n' << tab.cols.size() << '\n';
         for (auto &col : tab.cols) {
@@ -134,6 +332,10 @@ struct TabMeta {
             os << index_name << '\n';
             os << index << "\n";
         }
+        os << tab.num_rows << '\n' << tab.col_stats.size() << '\n';
+        for (auto &stats : tab.col_stats) {
+            os << stats << '\n';
+        }
         return os;
     }
 
@@ -145,6 +347,7 @@ struct TabMeta {
             is >> col;
             tab.cols.push_back(col);
         }
+        tab.bind_col_ids();
         is >> n;
         // for(size_t i = 0; i < n; ++i) {
         //     IndexMeta index;
@@ -158,6 +361,11 @@ struct TabMeta {
             is >> index;
             tab.indexes.emplace(index_name, index);
         }
+        is >> tab.num_rows >> n;
+        tab.col_stats.resize(n);
+        for (auto &stats : tab.col_stats) {
+            is >> stats;
+        }
         return is;
     }
 };
@@ -166,10 +374,13 @@ struct TabMeta {
 /* 数据库元数据 */
 class DbMeta {
     friend class SmManager;
+    friend class CatalogFile;
 
    private:
     std::string name_;                      // 数据库名称
     std::map<std::string, TabMeta> tabs_;   // 数据库中包含的表
+    int next_table_id_ = 0;                 // 下一个新建表的表ID，单调递增，删除表后不复用
+    std::vector<TabMeta *> tab_ids_;        // 表ID -> 表的元数据，已删除的表为nullptr，由SmManager在打开数据文件时填入
 
    public:
     // DbMeta(std::string name) : name_(name) {}
@@ -191,9 +402,17 @@ class DbMeta {
         return pos->second;
     }
 
+    /* 按表ID获取表的元数据，执行阶段用它代替按表名查找 */
+    TabMeta &get_table(int tab_id) {
+        if (tab_id < 0 || tab_id >= static_cast<int>(tab_ids_.size()) || tab_ids_[tab_id] == nullptr) {
+            throw InternalError("Table id not found: " + std::to_string(tab_id));
+        }
+        return *tab_ids_[tab_id];
+    }
+
     // 重载操作符 <<
     friend std::ostream &operator<<(std::ostream &os, const DbMeta &db_meta) {
-        os << db_meta.name_ << '\n' << db_meta.tabs_.size() << '\n';
+        os << db_meta.name_ << '\n' << db_meta.next_table_id_ << '\n' << db_meta.tabs_.size() << '\n';
         for (auto &entry : db_meta.tabs_) {
             os << entry.second << '\n';
         }
@@ -202,7 +421,7 @@ class DbMeta {
 
     friend std::istream &operator>>(std::istream &is, DbMeta &db_meta) {
         size_t n;
-        is >> db_meta.name_ >> n;
+        is >> db_meta.name_ >> db_meta.next_table_id_ >> n;
         for (size_t i = 0; i < n; i++) {
             TabMeta tab;
             is >> tab;
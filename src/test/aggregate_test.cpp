@@ -0,0 +1,340 @@
+// 聚合和去重算子的测试。儿子算子是内存中的一张表t(a int, b int, f float)，
+// 结果和逐条计算的期望值比较；多线程、溢出等路径用足够大的输入触发
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "execution/executor_aggregate.h"
+#include "execution/executor_distinct.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr int ROW_LEN = 3 * sizeof(int);
+
+// 按顺序输出内存中记录的儿子算子
+class VectorExecutor : public AbstractExecutor {
+ public:
+  VectorExecutor() {
+    cols_ = {{"t", "a", TYPE_INT, sizeof(int), 0, false, 0},
+             {"t", "b", TYPE_INT, sizeof(int), sizeof(int), false, 1},
+             {"t", "f", TYPE_FLOAT, sizeof(float), 2 * sizeof(int), false, 2}};
+    context_ = nullptr;
+  }
+
+  void add(int a, int b, float f) {
+    size_t off = data_.size();
+    data_.resize(off + ROW_LEN);
+    memcpy(data_.data() + off, &a, sizeof(int));
+    memcpy(data_.data() + off + sizeof(int), &b, sizeof(int));
+    memcpy(data_.data() + off + 2 * sizeof(int), &f, sizeof(float));
+  }
+
+  size_t rows() const { return data_.size() / ROW_LEN; }
+
+  size_t tupleLen() const override { return ROW_LEN; }
+
+  const std::vector<ColMeta>& cols() const override { return cols_; }
+
+  std::string getType() override { return "VectorExecutor"; }
+
+  void beginTuple() override { pos_ = 0; }
+
+  void nextTuple() override { ++pos_; }
+
+  bool is_end() const override { return pos_ >= rows(); }
+
+  Rid& rid() override {
+    rid_ = {static_cast<int>(pos_), 0};
+    return rid_;
+  }
+
+  std::unique_ptr<RmRecord> Next() override {
+    auto record = std::make_unique<RmRecord>(ROW_LEN);
+    memcpy(record->data, data_.data() + pos_ * ROW_LEN, ROW_LEN);
+    return record;
+  }
+
+ private:
+  std::vector<ColMeta> cols_;
+  std::vector<char> data_;
+  size_t pos_ = 0;
+  Rid rid_;
+};
+
+TabCol col(const std::string& name) { return {.tab_name = "t", .col_name = name}; }
+
+int int_at(const RmRecord& record, const ColMeta& col) {
+  int v;
+  memcpy(&v, record.data + col.offset, sizeof(int));
+  return v;
+}
+
+// 读出算子的全部输出，每条记录的int字段按输出顺序排成一行
+std::vector<std::vector<int>> drain(AbstractExecutor& exec) {
+  std::vector<std::vector<int>> res;
+  for (exec.beginTuple(); !exec.is_end(); exec.nextTuple()) {
+    auto record = exec.Next();
+    std::vector<int> row;
+    for (auto& c : exec.cols()) {
+      row.push_back(int_at(*record, c));
+    }
+    res.push_back(std::move(row));
+  }
+  return res;
+}
+
+}  // namespace
+
+TEST(AggregateHashTableTest, FindOrInsert) {
+  AggregateHashTable ht;
+  ht.init(sizeof(int), sizeof(int));
+  // 插入足够多的key触发多次扩容，条目下标按插入顺序分配，扩容后不变
+  constexpr int N = 10000;
+  for (int k = 0; k < N; ++k) {
+    bool is_new = false;
+    size_t i = ht.find_or_insert(reinterpret_cast<const char*>(&k), &is_new);
+    ASSERT_TRUE(is_new);
+    ASSERT_EQ(i, static_cast<size_t>(k));
+    memcpy(ht.state(i), &k, sizeof(int));
+  }
+  ASSERT_EQ(ht.size(), static_cast<size_t>(N));
+  for (int k = 0; k < N; ++k) {
+    bool is_new = true;
+    size_t i = ht.find_or_insert(reinterpret_cast<const char*>(&k), &is_new);
+    ASSERT_FALSE(is_new);
+    ASSERT_EQ(memcmp(ht.key(i), &k, sizeof(int)), 0);
+    int state;
+    memcpy(&state, ht.state(i), sizeof(int));
+    ASSERT_EQ(state, k);
+    ASSERT_TRUE(ht.contains(reinterpret_cast<const char*>(&k), ht.hash(i)));
+  }
+  int missing = N;
+  ASSERT_FALSE(ht.contains(reinterpret_cast<const char*>(&missing),
+                           ht.hash_key(reinterpret_cast<const char*>(&missing))));
+  ht.clear();
+  ASSERT_EQ(ht.size(), 0u);
+}
+
+// SELECT a, COUNT(*), SUM(b), MIN(b), MAX(b) FROM t GROUP BY a，输出按select的顺序
+TEST(AggregateExecutorTest, HashGroupBy) {
+  auto child = std::make_unique<VectorExecutor>();
+  std::map<int, std::tuple<int, int, int, int>> expected;
+  for (int i = 0; i < 5000; ++i) {
+    int a = i % 37;
+    int b = (i * 7919) % 1000 - 500;
+    child->add(a, b, 0);
+    auto it = expected.find(a);
+    if (it == expected.end()) {
+      expected[a] = {1, b, b, b};
+    } else {
+      auto& [cnt, sum, mn, mx] = it->second;
+      ++cnt;
+      sum += b;
+      mn = std::min(mn, b);
+      mx = std::max(mx, b);
+    }
+  }
+  AggregateExecutor agg(std::move(child), {col("a"), TabCol{}, col("b"), col("b"), col("b")},
+                        {AGG_COL, AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX}, {col("a")}, {}, false, nullptr);
+  ASSERT_EQ(agg.cols()[0].name, "a");
+  ASSERT_EQ(agg.cols()[1].name, "COUNT(*)");
+  ASSERT_EQ(agg.cols()[2].name, "SUM(b)");
+  auto rows = drain(agg);
+  ASSERT_EQ(rows.size(), expected.size());
+  for (auto& row : rows) {
+    auto& [cnt, sum, mn, mx] = expected.at(row[0]);
+    ASSERT_EQ(row, (std::vector<int>{row[0], cnt, sum, mn, mx}));
+  }
+}
+
+// GROUP BY在空输入上没有分组，不输出；不分组时COUNT输出一行0
+TEST(AggregateExecutorTest, EmptyInput) {
+  AggregateExecutor grouped(std::make_unique<VectorExecutor>(), {col("a"), TabCol{}}, {AGG_COL, AGG_COUNT}, {col("a")},
+                            {}, false, nullptr);
+  ASSERT_TRUE(drain(grouped).empty());
+  AggregateExecutor ungrouped(std::make_unique<VectorExecutor>(), {TabCol{}}, {AGG_COUNT}, {}, {}, false, nullptr);
+  ASSERT_EQ(drain(ungrouped), (std::vector<std::vector<int>>{{0}}));
+}
+
+// 输入超过AGG_PARALLEL_MIN_BATCHES批时转为并行聚合，分组数多到每个线程的局部表都有所有分区，
+// 合并后的结果和逐条计算的一样
+TEST(AggregateExecutorTest, ParallelGroupBy) {
+  constexpr int GROUPS = 20000;
+  const int rows = static_cast<int>((AGG_PARALLEL_MIN_BATCHES + 64) * TupleBatch::CAPACITY);
+  auto child = std::make_unique<VectorExecutor>();
+  std::vector<std::tuple<int, int, int, int>> expected(GROUPS);  // COUNT, SUM, MIN, MAX
+  for (int i = 0; i < rows; ++i) {
+    int a = static_cast<int>((i * 2654435761u) % GROUPS);
+    int b = i % 1013;
+    child->add(a, b, 0);
+    auto& [cnt, sum, mn, mx] = expected[a];
+    sum += b;
+    mn = cnt == 0 ? b : std::min(mn, b);
+    mx = cnt == 0 ? b : std::max(mx, b);
+    ++cnt;
+  }
+  AggregateExecutor agg(std::move(child), {col("a"), TabCol{}, col("b"), col("b"), col("b")},
+                        {AGG_COL, AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX}, {col("a")}, {}, false, nullptr);
+  auto rows_out = drain(agg);
+  ASSERT_EQ(rows_out.size(), static_cast<size_t>(GROUPS));
+  std::vector<bool> seen(GROUPS);
+  for (auto& row : rows_out) {
+    ASSERT_FALSE(seen[row[0]]);
+    seen[row[0]] = true;
+    auto& [cnt, sum, mn, mx] = expected[row[0]];
+    ASSERT_EQ(row, (std::vector<int>{row[0], cnt, sum, mn, mx}));
+  }
+  // 再执行一次，并行的局部表不能残留上次的状态
+  ASSERT_EQ(drain(agg).size(), static_cast<size_t>(GROUPS));
+}
+
+// 内核和逐个计算的结果相同，长度覆盖不足一个向量和有尾部的情况
+TEST(AggKernelsTest, MatchScalar) {
+  std::vector<int> ints;
+  std::vector<float> floats;
+  for (int i = 0; i < 1000; ++i) {
+    ints.push_back((i * 7919) % 2001 - 1000);
+    floats.push_back(static_cast<float>((i * 31) % 200) * 0.5f - 50);
+  }
+  for (size_t n : {1, 7, 8, 9, 64, 1000}) {
+    int sum = 0;
+    float fsum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sum += ints[i];
+      fsum += floats[i];
+    }
+    ASSERT_EQ(agg_kernels::sum(ints.data(), n), sum);
+    ASSERT_EQ(agg_kernels::min(ints.data(), n), *std::min_element(ints.begin(), ints.begin() + n));
+    ASSERT_EQ(agg_kernels::max(ints.data(), n), *std::max_element(ints.begin(), ints.begin() + n));
+    // 这些float和都是精确的，相加的顺序不影响结果
+    ASSERT_EQ(agg_kernels::sum(floats.data(), n), fsum);
+    ASSERT_EQ(agg_kernels::min(floats.data(), n), *std::min_element(floats.begin(), floats.begin() + n));
+    ASSERT_EQ(agg_kernels::max(floats.data(), n), *std::max_element(floats.begin(), floats.begin() + n));
+  }
+}
+
+// SELECT COUNT(b), SUM(b), MIN(f), MAX(f), SUM(f) FROM t走按批的内核
+TEST(AggregateExecutorTest, VectorizedUngrouped) {
+  auto child = std::make_unique<VectorExecutor>();
+  int sum = 0;
+  float fmin = 0, fmax = 0, fsum = 0;
+  constexpr int N = 50000;
+  for (int i = 0; i < N; ++i) {
+    int b = i % 977 - 300;
+    float f = static_cast<float>((i * 13) % 101) * 0.5f - 20;
+    child->add(0, b, f);
+    sum += b;
+    fmin = i == 0 ? f : std::min(fmin, f);
+    fmax = i == 0 ? f : std::max(fmax, f);
+    fsum += f;
+  }
+  AggregateExecutor agg(std::move(child), {col("b"), col("b"), col("f"), col("f"), col("f")},
+                        {AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX, AGG_SUM}, {}, {}, false, nullptr);
+  agg.beginTuple();
+  ASSERT_FALSE(agg.is_end());
+  auto record = agg.Next();
+  auto& cols = agg.cols();
+  ASSERT_EQ(cols[0].type, TYPE_INT);
+  ASSERT_EQ(cols[2].type, TYPE_FLOAT);
+  auto float_at = [&](size_t i) {
+    float v;
+    memcpy(&v, record->data + cols[i].offset, sizeof(float));
+    return v;
+  };
+  ASSERT_EQ(int_at(*record, cols[0]), N);
+  ASSERT_EQ(int_at(*record, cols[1]), sum);
+  ASSERT_EQ(float_at(2), fmin);
+  ASSERT_EQ(float_at(3), fmax);
+  ASSERT_EQ(float_at(4), fsum);
+  agg.nextTuple();
+  ASSERT_TRUE(agg.is_end());
+}
+
+// 哈希去重比较整条记录，-0和0是同一个float值
+TEST(DistinctExecutorTest, Hash) {
+  auto child = std::make_unique<VectorExecutor>();
+  std::set<std::pair<int, int>> expected;
+  for (int i = 0; i < 10000; ++i) {
+    child->add(i % 50, i % 7, (i / 350) % 2 == 0 ? 0.0f : -0.0f);
+    expected.emplace(i % 50, i % 7);
+  }
+  DistinctExecutor distinct(std::move(child), false, nullptr);
+  std::set<std::pair<int, int>> seen;
+  for (auto& row : drain(distinct)) {
+    ASSERT_TRUE(seen.emplace(row[0], row[1]).second);
+  }
+  ASSERT_EQ(seen, expected);
+}
+
+// 输入有序时流式去重，只和上一条比较
+TEST(DistinctExecutorTest, Sorted) {
+  auto child = std::make_unique<VectorExecutor>();
+  for (int i = 0; i < 3000; ++i) {
+    child->add(i / 3, 0, 0);
+  }
+  DistinctExecutor distinct(std::move(child), true, nullptr);
+  auto rows = drain(distinct);
+  ASSERT_EQ(rows.size(), 1000u);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    ASSERT_EQ(rows[i][0], static_cast<int>(i));
+  }
+}
+
+// SELECT DISTINCT COUNT(*) FROM t GROUP BY a：去重在聚合的输出上进行
+TEST(DistinctExecutorTest, OverAggregate) {
+  auto child = std::make_unique<VectorExecutor>();
+  for (int i = 0; i < 1000; ++i) {
+    child->add(i % 10 < 5 ? i % 10 : i % 100, 0, 0);
+  }
+  auto agg = std::make_unique<AggregateExecutor>(std::move(child), std::vector<TabCol>{TabCol{}},
+                                                 std::vector<AggType>{AGG_COUNT}, std::vector<TabCol>{col("a")},
+                                                 std::vector<Condition>{}, false, nullptr);
+  DistinctExecutor distinct(std::move(agg), false, nullptr);
+  std::set<int> counts;
+  for (auto& row : drain(distinct)) {
+    ASSERT_TRUE(counts.insert(row[0]).second);
+  }
+  // a=0..4各100条，其余50个值各10条
+  ASSERT_EQ(counts, (std::set<int>{10, 100}));
+}
+
+// SELECT a, SUM(b) FROM t GROUP BY a HAVING COUNT(*) > 3：输入按a有序时流式聚合，和哈希聚合的结果相同
+TEST(AggregateExecutorTest, StreamingMatchesHash) {
+  auto make_child = [] {
+    auto child = std::make_unique<VectorExecutor>();
+    for (int i = 0; i < 5000; ++i) {
+      // 每组4条，去掉一部分记录，使部分分组只有3条
+      if (i % 13 != 0) {
+        child->add(i / 4, i % 11, 0);
+      }
+    }
+    return child;
+  };
+  auto make_having = [] {
+    Condition cond;
+    cond.agg_type = AGG_COUNT;
+    cond.op = OP_GT;
+    cond.is_rhs_val = true;
+    cond.rhs_val.set_int(3);
+    cond.rhs_val.init_raw(sizeof(int));
+    return std::vector<Condition>{cond};
+  };
+  std::vector<TabCol> sel_cols = {col("a"), col("b")};
+  std::vector<AggType> agg_types = {AGG_COL, AGG_SUM};
+  AggregateExecutor hashed(make_child(), sel_cols, agg_types, {col("a")}, make_having(), false, nullptr);
+  AggregateExecutor streamed(make_child(), sel_cols, agg_types, {col("a")}, make_having(), true, nullptr);
+  auto expected = drain(hashed);
+  auto rows = drain(streamed);
+  ASSERT_FALSE(rows.empty());
+  // 流式聚合按a的顺序输出
+  ASSERT_TRUE(std::is_sorted(rows.begin(), rows.end()));
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(rows, expected);
+}
@@ -0,0 +1,351 @@
+// 索引的测试：key的保序编码，B+树叶子的前缀压缩
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "index/ix.h"
+#include "storage/buffer_pool_manager.h"
+#include "storage/disk_manager.h"
+
+namespace {
+
+int sign(int x) { return (x > 0) - (x < 0); }
+
+// 编码后memcmp的结果和按原格式逐字段比较的结果一致，解码得到原来的key
+void check_encoding(const std::vector<std::vector<char>>& keys, const std::vector<ColType>& types,
+                    const std::vector<int>& lens) {
+  int tot_len = 0;
+  for (int len : lens) {
+    tot_len += len;
+  }
+  std::vector<std::vector<char>> encoded;
+  for (auto& key : keys) {
+    std::vector<char> enc(tot_len);
+    std::vector<char> dec(tot_len);
+    ix_encode_key(key.data(), enc.data(), types, lens);
+    ix_decode_key(enc.data(), dec.data(), types, lens);
+    EXPECT_EQ(ix_compare(key.data(), dec.data(), types, lens), 0);
+    encoded.push_back(std::move(enc));
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    for (size_t j = 0; j < keys.size(); ++j) {
+      ASSERT_EQ(sign(memcmp(encoded[i].data(), encoded[j].data(), tot_len)),
+                sign(ix_compare(keys[i].data(), keys[j].data(), types, lens)))
+          << "keys " << i << " and " << j;
+    }
+  }
+}
+
+template <typename T>
+std::vector<char> bytes_of(T value) {
+  std::vector<char> bytes(sizeof(T));
+  memcpy(bytes.data(), &value, sizeof(T));
+  return bytes;
+}
+
+TEST(IxKeyEncodingTest, Int) {
+  std::vector<int> values = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min() + 1, -65536, -256,
+                             -255, -1, 0, 1, 255, 256, 65536, std::numeric_limits<int>::max() - 1,
+                             std::numeric_limits<int>::max()};
+  std::mt19937 rng(1);
+  for (int i = 0; i < 100; ++i) {
+    values.push_back(static_cast<int>(rng()));
+  }
+  std::vector<std::vector<char>> keys;
+  for (int value : values) {
+    keys.push_back(bytes_of(value));
+  }
+  check_encoding(keys, {TYPE_INT}, {sizeof(int)});
+}
+
+// 负数、非规格化数、无穷大都保序，-0.0和+0.0编码相同
+TEST(IxKeyEncodingTest, Float) {
+  std::vector<float> values = {-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::lowest(),
+                               -1e10f, -1.5f, -1.0f, -std::numeric_limits<float>::min(),
+                               -std::numeric_limits<float>::denorm_min(), -0.0f, 0.0f,
+                               std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::min(), 1.0f,
+                               1.5f, 1e10f, std::numeric_limits<float>::max(),
+                               std::numeric_limits<float>::infinity()};
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> dist(-1e6f, 1e6f);
+  for (int i = 0; i < 100; ++i) {
+    values.push_back(dist(rng));
+  }
+  std::vector<std::vector<char>> keys;
+  for (float value : values) {
+    keys.push_back(bytes_of(value));
+  }
+  check_encoding(keys, {TYPE_FLOAT}, {sizeof(float)});
+
+  char neg_zero[sizeof(float)];
+  char pos_zero[sizeof(float)];
+  float zero = -0.0f;
+  ix_encode_key(reinterpret_cast<const char*>(&zero), neg_zero, {TYPE_FLOAT}, {sizeof(float)});
+  zero = 0.0f;
+  ix_encode_key(reinterpret_cast<const char*>(&zero), pos_zero, {TYPE_FLOAT}, {sizeof(float)});
+  EXPECT_EQ(memcmp(neg_zero, pos_zero, sizeof(float)), 0);
+  float decoded;
+  ix_decode_key(neg_zero, reinterpret_cast<char*>(&decoded), {TYPE_FLOAT}, {sizeof(float)});
+  EXPECT_FALSE(std::signbit(decoded));
+}
+
+// 联合索引：前面的字段相等时才比较后面的字段，字符串原样存放
+TEST(IxKeyEncodingTest, Composite) {
+  constexpr int STR_LEN = 6;
+  std::vector<ColType> types = {TYPE_INT, TYPE_FLOAT, TYPE_STRING};
+  std::vector<int> lens = {sizeof(int), sizeof(float), STR_LEN};
+  std::vector<int> ints = {std::numeric_limits<int>::min(), -1, 0, 1, 256};
+  std::vector<float> floats = {-2.5f, -0.0f, 1.0f, 3.25f};
+  std::vector<std::string> strs = {std::string(STR_LEN, '\0'), "a", "ab", "b", std::string(STR_LEN, '\xff')};
+  std::vector<std::vector<char>> keys;
+  for (int i : ints) {
+    for (float f : floats) {
+      for (auto& s : strs) {
+        std::vector<char> key(sizeof(int) + sizeof(float) + STR_LEN, 0);
+        memcpy(key.data(), &i, sizeof(int));
+        memcpy(key.data() + sizeof(int), &f, sizeof(float));
+        memcpy(key.data() + sizeof(int) + sizeof(float), s.data(), std::min<size_t>(s.size(), STR_LEN));
+        keys.push_back(std::move(key));
+      }
+    }
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(3));
+  check_encoding(keys, types, lens);
+}
+
+// 在临时目录中建B+树索引
+class IndexTest : public ::testing::Test {
+ protected:
+  static constexpr size_t POOL_SIZE = 4096;
+  const std::string IX_NAME = "t.idx";
+
+  void SetUp() override {
+    char dir[] = "/tmp/index_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    old_dir_ = std::filesystem::current_path();
+    std::filesystem::current_path(dir_);
+    disk_manager_ = std::make_unique<DiskManager>();
+    buffer_pool_manager_ = std::make_unique<BufferPoolManager>(POOL_SIZE, disk_manager_.get());
+    ix_manager_ = std::make_unique<IxManager>(disk_manager_.get(), buffer_pool_manager_.get());
+  }
+
+  void TearDown() override {
+    if (ih_ != nullptr) {
+      ix_manager_->close_index(ih_.get());
+      ih_.reset();
+    }
+    ix_manager_.reset();
+    buffer_pool_manager_.reset();
+    disk_manager_.reset();
+    std::filesystem::current_path(old_dir_);
+    std::filesystem::remove_all(dir_);
+  }
+
+  // 字段依次紧挨着存放
+  void create(const std::vector<std::pair<ColType, int>>& types) {
+    std::vector<ColMeta> cols;
+    int offset = 0;
+    for (auto& [type, len] : types) {
+      cols.push_back({"t", "c" + std::to_string(cols.size()), type, len, offset, true});
+      offset += len;
+    }
+    ix_manager_->create_index(IX_NAME, cols, INDEX_BTREE);
+    ih_ = ix_manager_->open_index(IX_NAME);
+  }
+
+  // 关闭索引把结点写回磁盘，再从磁盘读回来
+  void reopen() {
+    ix_manager_->close_index(ih_.get());
+    ih_ = ix_manager_->open_index(IX_NAME);
+  }
+
+  // 从第一个叶子顺着next_leaf走到最后一个叶子，返回各个叶子的前缀长度
+  std::vector<int> leaf_prefix_lens() {
+    std::vector<int> lens;
+    page_id_t last = ih_->leaf_end().page_no;
+    for (page_id_t page_no = ih_->leaf_begin().page_no;;) {
+      auto node = ih_->fetch_node(page_no);
+      EXPECT_TRUE(node->is_leaf_page());
+      lens.push_back(node->get_prefix_len());
+      page_id_t next = node->get_next_leaf();
+      buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+      if (page_no == last) {
+        break;
+      }
+      page_no = next;
+    }
+    return lens;
+  }
+
+  std::filesystem::path dir_;
+  std::filesystem::path old_dir_;
+  std::unique_ptr<DiskManager> disk_manager_;
+  std::unique_ptr<BufferPoolManager> buffer_pool_manager_;
+  std::unique_ptr<IxManager> ix_manager_;
+  std::unique_ptr<IxIndexHandle> ih_;
+};
+
+// (a, b)两个int字段的key，rid由key算出来
+struct IntPair {
+  int a;
+  int b;
+
+  bool operator<(const IntPair& other) const { return a != other.a ? a < other.a : b < other.b; }
+
+  Rid rid() const { return {a, b}; }
+};
+
+class PrefixCompressionTest : public IndexTest {
+ protected:
+  void SetUp() override {
+    IndexTest::SetUp();
+    create({{TYPE_INT, sizeof(int)}, {TYPE_INT, sizeof(int)}});
+  }
+
+  void insert(const IntPair& key) {
+    ASSERT_NE(ih_->insert_entry(reinterpret_cast<const char*>(&key), key.rid(), &txn_), -1);
+    keys_.emplace(key.a, key.b);
+  }
+
+  void remove(const IntPair& key) {
+    ASSERT_TRUE(ih_->delete_entry(reinterpret_cast<const char*>(&key), &txn_));
+    keys_.erase({key.a, key.b});
+  }
+
+  // 顺序扫描解码出的key和rid与插入的完全一致，每个key都能点查到，删掉的key查不到
+  void verify(const std::vector<IntPair>& removed) {
+    std::vector<std::pair<int, int>> scanned;
+    {
+      IxScan scan(ih_.get(), ih_->leaf_begin(), ih_->leaf_end(), buffer_pool_manager_.get());
+      for (; !scan.is_end(); scan.next()) {
+        IntPair key;
+        scan.get_key(reinterpret_cast<char*>(&key));
+        EXPECT_EQ(scan.rid(), key.rid());
+        scanned.emplace_back(key.a, key.b);
+      }
+    }
+    std::vector<std::pair<int, int>> expected(keys_.begin(), keys_.end());
+    ASSERT_EQ(scanned, expected);
+    for (auto& [a, b] : keys_) {
+      IntPair key{a, b};
+      std::vector<Rid> rids;
+      ASSERT_TRUE(ih_->get_value(reinterpret_cast<const char*>(&key), &rids, nullptr)) << a << " " << b;
+      EXPECT_EQ(rids, std::vector<Rid>{key.rid()});
+    }
+    for (auto& key : removed) {
+      std::vector<Rid> rids;
+      EXPECT_FALSE(ih_->get_value(reinterpret_cast<const char*>(&key), &rids, nullptr)) << key.a << " " << key.b;
+    }
+  }
+
+  std::set<std::pair<int, int>> keys_;
+  Transaction txn_{0};  // 分裂、合并时记下加了写锁的结点
+};
+
+// 第一个字段相同的key挤在同一批叶子中，前缀至少是第一个字段的4个字节；再在两端插入第一个字段不同的key，
+// 删除一半key触发重分配和合并。每一步之后、以及关闭再打开索引之后，读出的key都和写入的一致
+TEST_F(PrefixCompressionTest, RoundTrip) {
+  constexpr int N = 20000;
+  std::vector<IntPair> keys;
+  for (int b = 0; b < N; ++b) {
+    keys.push_back({5, b});
+  }
+  std::mt19937 rng(4);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  for (auto& key : keys) {
+    insert(key);
+  }
+  verify({});
+  auto lens = leaf_prefix_lens();
+  ASSERT_GT(lens.size(), 1u);
+  for (int len : lens) {
+    EXPECT_GE(len, static_cast<int>(sizeof(int)));
+  }
+
+  std::vector<IntPair> more;
+  for (int b = 0; b < N / 10; ++b) {
+    more.push_back({4, b * 7});
+    more.push_back({6, -b});
+  }
+  std::shuffle(more.begin(), more.end(), rng);
+  for (auto& key : more) {
+    insert(key);
+  }
+  verify({});
+
+  std::vector<IntPair> removed;
+  for (auto& key : keys) {
+    if (key.b % 2 == 0) {
+      removed.push_back(key);
+    }
+  }
+  for (size_t i = 0; i < more.size(); i += 3) {
+    removed.push_back(more[i]);
+  }
+  for (auto& key : removed) {
+    remove(key);
+  }
+  verify(removed);
+
+  reopen();
+  verify(removed);
+}
+
+// 插入的key和叶子的前缀不同时，叶子原地缩短前缀，已有的key不变
+TEST_F(PrefixCompressionTest, PrefixShrinks) {
+  for (int b = 0; b < 10; ++b) {
+    insert({5, b});
+  }
+  // 只有一个叶子，key编码后只有最后一个字节不同
+  EXPECT_EQ(leaf_prefix_lens(), std::vector<int>{2 * static_cast<int>(sizeof(int)) - 1});
+
+  insert({4, 100});
+  // 两个第一个字段编码后只有最后一个字节不同
+  EXPECT_EQ(leaf_prefix_lens(), std::vector<int>{static_cast<int>(sizeof(int)) - 1});
+  verify({});
+
+  remove({4, 100});
+  remove({5, 0});
+  verify({{4, 100}, {5, 0}});
+  reopen();
+  verify({{4, 100}, {5, 0}});
+}
+
+// 两个线程都按降序插入，每个key都落在最左叶子的第0个位置，要沿着父结点向上改分隔key。
+// 两个线程的key交错，分裂和改父结点同时发生，都要能完成，结果中一个key都不少
+TEST_F(PrefixCompressionTest, ConcurrentDescendingInserts) {
+  constexpr int THREADS = 2;
+  constexpr int N = 20000;  // 每个线程插入的key数
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([this, t] {
+      Transaction txn(t + 1);
+      for (int i = N - 1; i >= 0; --i) {
+        IntPair key{0, i * THREADS + t};
+        ih_->insert_entry(reinterpret_cast<const char*>(&key), key.rid(), &txn);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int b = 0; b < N * THREADS; ++b) {
+    keys_.emplace(0, b);
+  }
+  verify({});
+}
+
+}  // namespace
@@ -0,0 +1,290 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+// 锁管理器和事务管理器的并发压测：N个线程不停地begin、加锁、commit，不读写数据，
+// 只测加锁、等待、死锁处理和放锁本身，在可控的冲突程度下比较锁管理器的改动。
+// 参数（都有默认值）：
+//   --threads=N      线程数
+//   --seconds=S      运行时间
+//   --keys=K         记录数，每个事务在其中按zipfian分布选记录
+//   --theta=T        zipfian的倾斜度，0为均匀分布，越接近1冲突越集中
+//   --ops=M          每个事务加锁的次数
+//   --write=P        加排他锁（间隙上为插入意向锁）的百分比
+//   --table=P        加表锁的百分比
+//   --gap=P          加间隙锁的百分比，其余加行锁
+//   --policy=wait-die|detection  死锁处理方式
+//   --occ            显式事务按乐观并发控制执行
+// 输出每秒提交的事务数、回滚率，以及每次加锁调用耗时（包括等待）的分位数
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transaction/concurrency/lock_manager.h"
+#include "transaction/transaction_manager.h"
+
+namespace {
+
+constexpr int TAB_FD = 1;  // 压测用的表和索引，不对应真实的文件
+constexpr int IX_FD = 2;
+constexpr int SLOTS_PER_PAGE = 64;
+
+struct Options {
+  int threads = 8;
+  double seconds = 5;
+  int keys = 100000;
+  double theta = 0.99;
+  int ops = 10;
+  int write = 50;
+  int table = 0;
+  int gap = 0;
+  DeadlockPolicy policy = DeadlockPolicy::WAIT_DIE;
+  bool occ = false;
+};
+
+/**
+ * @description: [0, n)上的zipfian分布，按Gray等人的方法（YCSB也用这种）只在构造时计算一次zeta，
+ * 之后每次取样是O(1)的。theta为0时退化为均匀分布
+ */
+class ZipfGenerator {
+ public:
+  ZipfGenerator(int n, double theta) : n_(n), theta_(theta) {
+    double zeta2 = zeta(2, theta);
+    zetan_ = zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+  }
+
+  int next(std::mt19937_64& rng) const {
+    if (theta_ == 0) {
+      return static_cast<int>(rng() % n_);
+    }
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * zetan_;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    int res = static_cast<int>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    return std::min(res, n_ - 1);
+  }
+
+ private:
+  static double zeta(int n, double theta) {
+    double sum = 0;
+    for (int i = 1; i <= n; ++i) {
+      sum += 1 / std::pow(i, theta);
+    }
+    return sum;
+  }
+
+  int n_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+// 每个线程各自统计，结束后汇总
+struct WorkerStats {
+  uint64_t commits = 0;
+  uint64_t aborts = 0;
+  std::vector<uint32_t> lock_ns;  // 每次加锁调用的耗时
+};
+
+bool parse_int(const char* arg, const char* name, int& val) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
+  val = atoi(arg + len + 1);
+  return true;
+}
+
+bool parse_double(const char* arg, const char* name, double& val) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
+  val = atof(arg + len + 1);
+  return true;
+}
+
+Options parse_options(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (parse_int(arg, "--threads", opts.threads) ||
+        parse_double(arg, "--seconds", opts.seconds) ||
+        parse_int(arg, "--keys", opts.keys) ||
+        parse_double(arg, "--theta", opts.theta) ||
+        parse_int(arg, "--ops", opts.ops) ||
+        parse_int(arg, "--write", opts.write) ||
+        parse_int(arg, "--table", opts.table) ||
+        parse_int(arg, "--gap", opts.gap)) {
+      continue;
+    }
+    if (strcmp(arg, "--policy=wait-die") == 0) {
+      opts.policy = DeadlockPolicy::WAIT_DIE;
+    } else if (strcmp(arg, "--policy=detection") == 0) {
+      opts.policy = DeadlockPolicy::DETECTION;
+    } else if (strcmp(arg, "--occ") == 0) {
+      opts.occ = true;
+    } else {
+      fprintf(stderr, "unknown option: %s\n", arg);
+      exit(1);
+    }
+  }
+  if (opts.threads <= 0 || opts.keys <= 1 || opts.ops <= 0 ||
+      opts.theta < 0 || opts.theta >= 1) {
+    fprintf(stderr, "invalid options\n");
+    exit(1);
+  }
+  return opts;
+}
+
+// 一次加锁，返回false表示事务要回滚
+bool lock_one(LockManager& lock_manager, Transaction* txn, const Options& opts,
+              const ZipfGenerator& zipf, std::mt19937_64& rng) {
+  int kind = static_cast<int>(rng() % 100);
+  bool write = static_cast<int>(rng() % 100) < opts.write;
+  if (kind < opts.table) {
+    return write ? lock_manager.lock_exclusive_on_table(txn, TAB_FD)
+                 : lock_manager.lock_shared_on_table(txn, TAB_FD);
+  }
+  int key = zipf.next(rng);
+  Rid rid{key / SLOTS_PER_PAGE + 1, key % SLOTS_PER_PAGE};
+  if (kind < opts.table + opts.gap) {
+    return write ? lock_manager.lock_insert_on_gap(txn, IX_FD, rid)
+                 : lock_manager.lock_shared_on_gap(txn, IX_FD, rid);
+  }
+  return write ? lock_manager.lock_exclusive_on_record(txn, rid, TAB_FD)
+               : lock_manager.lock_shared_on_record(txn, rid, TAB_FD);
+}
+
+void run_worker(int id, const Options& opts, const ZipfGenerator& zipf,
+                LockManager& lock_manager, TransactionManager& txn_manager,
+                std::atomic<bool>& stop, WorkerStats& stats) {
+  std::mt19937_64 rng(id + 1);
+  while (!stop.load(std::memory_order_relaxed)) {
+    Transaction* txn = txn_manager.begin(nullptr, nullptr);
+    txn->set_txn_mode(true);
+    bool ok = true;
+    try {
+      for (int i = 0; i < opts.ops && ok; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        ok = lock_one(lock_manager, txn, opts, zipf, rng);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        stats.lock_ns.push_back(static_cast<uint32_t>(
+            std::min<int64_t>(ns, std::numeric_limits<uint32_t>::max())));
+      }
+      if (ok) {
+        txn_manager.commit(txn, nullptr);
+        ++stats.commits;
+      }
+    } catch (TransactionAbortException&) {
+      ok = false;
+    }
+    if (!ok) {
+      txn_manager.abort(txn, nullptr);
+      ++stats.aborts;
+    }
+    txn_manager.recycle(txn);
+  }
+}
+
+double percentile_us(const std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = std::min(sorted.size() - 1,
+                      static_cast<size_t>(p / 100 * sorted.size()));
+  return sorted[i] / 1000.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts = parse_options(argc, argv);
+  ZipfGenerator zipf(opts.keys, opts.theta);
+  LockManager lock_manager(opts.policy);
+  TransactionManager txn_manager(&lock_manager, nullptr,
+                                 opts.occ ? ConcurrencyMode::OPTIMISTIC
+                                          : ConcurrencyMode::TWO_PHASE_LOCKING);
+
+  std::atomic<bool> stop{false};
+  std::vector<WorkerStats> stats(opts.threads);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < opts.threads; ++i) {
+    workers.emplace_back(run_worker, i, std::cref(opts), std::cref(zipf),
+                         std::ref(lock_manager), std::ref(txn_manager),
+                         std::ref(stop), std::ref(stats[i]));
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.seconds));
+  stop.store(true);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  uint64_t commits = 0;
+  uint64_t aborts = 0;
+  std::vector<uint32_t> lock_ns;
+  for (auto& s : stats) {
+    commits += s.commits;
+    aborts += s.aborts;
+    lock_ns.insert(lock_ns.end(), s.lock_ns.begin(), s.lock_ns.end());
+  }
+  std::sort(lock_ns.begin(), lock_ns.end());
+
+  printf("threads=%d keys=%d theta=%.2f ops=%d write=%d%% table=%d%% gap=%d%% "
+         "policy=%s mode=%s\n",
+         opts.threads, opts.keys, opts.theta, opts.ops, opts.write, opts.table,
+         opts.gap,
+         opts.policy == DeadlockPolicy::WAIT_DIE ? "wait-die" : "detection",
+         opts.occ ? "occ" : "2pl");
+  printf("throughput: %.0f txn/s, abort rate: %.2f%%\n", commits / elapsed,
+         commits + aborts == 0 ? 0.0 : 100.0 * aborts / (commits + aborts));
+  printf("lock latency (us): p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f max=%.2f\n",
+         percentile_us(lock_ns, 50), percentile_us(lock_ns, 90),
+         percentile_us(lock_ns, 99), percentile_us(lock_ns, 99.9),
+         lock_ns.empty() ? 0.0 : lock_ns.back() / 1000.0);
+
+  // 锁管理器自己记录的真正阻塞的等待
+  std::vector<std::pair<std::pair<int, LockDataType>, LockManager::LockWaitStats>>
+      wait_stats;
+  lock_manager.get_wait_stats(wait_stats);
+  for (auto& [key, s] : wait_stats) {
+    static const char* const types[] = {"table", "record", "gap"};
+    printf("%s waits: %lu, avg wait: %.2f us, dies: %lu, deadlocks: %lu\n",
+           types[static_cast<int>(key.second)],
+           static_cast<unsigned long>(s.waits),
+           s.waits == 0 ? 0.0 : static_cast<double>(s.wait_us) / s.waits,
+           static_cast<unsigned long>(s.dies),
+           static_cast<unsigned long>(s.deadlocks));
+  }
+  return 0;
+}
@@ -0,0 +1,230 @@
+// 日志管理器的测试。日志写到临时目录中，结束后按日志头逐条读回，检查lsn、prev_lsn链和内容
+
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+
+namespace {
+
+// 日志中读回的一条插入日志
+struct ParsedLog {
+  lsn_t lsn;
+  lsn_t prev_lsn;
+  txn_id_t txn_id;
+  int seq;  // 记录内容的前4个字节
+};
+
+class LogManagerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/log_manager_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    old_dir_ = std::filesystem::current_path();
+    std::filesystem::current_path(dir_);
+    disk_manager_ = std::make_unique<DiskManager>();
+    log_manager_ = std::make_unique<LogManager>(disk_manager_.get());
+  }
+
+  void TearDown() override {
+    log_manager_.reset();
+    disk_manager_.reset();
+    std::filesystem::current_path(old_dir_);
+    std::filesystem::remove_all(dir_);
+  }
+
+  // 内容的前4个字节是seq，其余用txn_id填满
+  static std::unique_ptr<InsertLogRecord> make_log(txn_id_t txn_id, int seq, int size) {
+    std::vector<char> value(size, static_cast<char>(txn_id));
+    memcpy(value.data(), &seq, sizeof(int));
+    return std::make_unique<InsertLogRecord>(txn_id, value.data(), size, Rid{seq, 0}, 0);
+  }
+
+  // 从头读出已经写盘的所有日志，读到长度为0的日志头时停止
+  std::vector<ParsedLog> read_all() {
+    int64_t end = disk_manager_->get_log_end();
+    std::vector<char> data(end);
+    if (end > 0) {
+      EXPECT_EQ(disk_manager_->read_log(data.data(), static_cast<int>(end), 0), end);
+    }
+    std::vector<ParsedLog> logs;
+    for (int64_t offset = 0; offset + LOG_HEADER_SIZE <= end;) {
+      LogRecord header;
+      header.deserialize(data.data() + offset);
+      if (header.log_tot_len_ == 0) {
+        break;
+      }
+      EXPECT_EQ(header.log_type_, LogType::INSERT);
+      InsertLogRecord log;
+      log.deserialize(data.data() + offset);
+      int seq;
+      memcpy(&seq, log.insert_value_.data, sizeof(int));
+      // 内容没有被其他线程的日志覆盖
+      for (int i = sizeof(int); i < log.insert_value_.size; ++i) {
+        EXPECT_EQ(log.insert_value_.data[i], static_cast<char>(log.log_tid_));
+      }
+      EXPECT_EQ(log.rid_.page_no, seq);
+      logs.push_back({log.lsn_, log.prev_lsn_, log.log_tid_, seq});
+      offset += header.log_tot_len_;
+    }
+    return logs;
+  }
+
+  std::filesystem::path dir_;
+  std::filesystem::path old_dir_;
+  std::unique_ptr<DiskManager> disk_manager_;
+  std::unique_ptr<LogManager> log_manager_;
+};
+
+// 多个线程并发追加，日志总量是几个缓冲区，刷盘线程在追加过程中切换缓冲区。
+// 每条日志恰好出现一次，文件中的lsn递增，每个线程的日志按顺序串成prev_lsn链
+TEST_F(LogManagerTest, ConcurrentAppendKeepsEveryRecord) {
+  constexpr int THREADS = 8;
+  constexpr int LOGS_PER_THREAD = 1500;
+  constexpr int VALUE_SIZE = 1000;
+  static_assert(THREADS * LOGS_PER_THREAD * VALUE_SIZE > 2 * LOG_BUFFER_SIZE);
+
+  log_manager_->start_flush_thread();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([this, t] {
+      txn_id_t txn_id = t + 1;
+      lsn_t prev_lsn = INVALID_LSN;
+      for (int seq = 0; seq < LOGS_PER_THREAD;) {
+        // 一半线程逐条追加，另一半一次追加一批
+        if (t % 2 == 0) {
+          auto log = make_log(txn_id, seq++, VALUE_SIZE);
+          log->prev_lsn_ = prev_lsn;
+          prev_lsn = log_manager_->add_log_to_buffer(log.get());
+          continue;
+        }
+        std::vector<std::unique_ptr<InsertLogRecord>> batch;
+        std::vector<LogRecord*> ptrs;
+        for (int i = 0; i < 4 && seq < LOGS_PER_THREAD; ++i) {
+          batch.push_back(make_log(txn_id, seq++, VALUE_SIZE));
+          ptrs.push_back(batch.back().get());
+        }
+        lsn_t last = log_manager_->add_logs_to_buffer(ptrs.data(), static_cast<int>(ptrs.size()), prev_lsn);
+        EXPECT_EQ(last, batch.back()->lsn_);
+        prev_lsn = last;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  lsn_t last_lsn = log_manager_->get_next_lsn() - 1;
+  log_manager_->flush_log_to_disk();
+  EXPECT_GE(log_manager_->get_persist_lsn(), last_lsn);
+  log_manager_->stop_flush_thread();
+
+  auto logs = read_all();
+  ASSERT_EQ(logs.size(), static_cast<size_t>(THREADS * LOGS_PER_THREAD));
+  std::vector<lsn_t> last(THREADS + 1, INVALID_LSN);
+  std::vector<int> next_seq(THREADS + 1, 0);
+  for (size_t i = 0; i < logs.size(); ++i) {
+    if (i > 0) {
+      EXPECT_LT(logs[i - 1].lsn, logs[i].lsn);
+    }
+    auto& log = logs[i];
+    ASSERT_GE(log.txn_id, 1);
+    ASSERT_LE(log.txn_id, THREADS);
+    EXPECT_EQ(log.seq, next_seq[log.txn_id]++);
+    EXPECT_EQ(log.prev_lsn, last[log.txn_id]);
+    last[log.txn_id] = log.lsn;
+  }
+}
+
+// 缓冲区放不下时，这次预留的lsn作废：已写入的日志原样刷盘，不包含作废的空间，
+// 这条日志在另一个缓冲区中用下一个lsn重新追加
+TEST_F(LogManagerTest, FullBufferAbandonsReservation) {
+  constexpr int VALUE_SIZE = 3000;
+  const int log_len = static_cast<int>(make_log(1, 0, VALUE_SIZE)->log_tot_len_);
+  const int fit = LOG_BUFFER_SIZE / log_len;
+
+  lsn_t prev_lsn = INVALID_LSN;
+  for (int seq = 0; seq < fit; ++seq) {
+    auto log = make_log(1, seq, VALUE_SIZE);
+    log->prev_lsn_ = prev_lsn;
+    prev_lsn = log_manager_->add_log_to_buffer(log.get());
+  }
+  ASSERT_EQ(prev_lsn, fit - 1);
+  EXPECT_EQ(disk_manager_->get_log_end(), 0);
+
+  // 没有刷盘线程时由追加者自己刷盘
+  auto log = make_log(1, fit, VALUE_SIZE);
+  log->prev_lsn_ = prev_lsn;
+  lsn_t lsn = log_manager_->add_log_to_buffer(log.get());
+  EXPECT_EQ(lsn, fit + 1);
+  EXPECT_EQ(log->prev_lsn_, fit - 1);
+  EXPECT_EQ(log_manager_->get_persist_lsn(), fit);
+  EXPECT_EQ(disk_manager_->get_log_end(), static_cast<int64_t>(fit) * log_len);
+
+  log_manager_->flush_log_to_disk();
+  EXPECT_EQ(log_manager_->get_persist_lsn(), fit + 1);
+  auto logs = read_all();
+  ASSERT_EQ(logs.size(), static_cast<size_t>(fit + 1));
+  for (int i = 0; i < fit; ++i) {
+    EXPECT_EQ(logs[i].lsn, i);
+    EXPECT_EQ(logs[i].seq, i);
+  }
+  EXPECT_EQ(logs[fit].lsn, fit + 1);
+  EXPECT_EQ(logs[fit].prev_lsn, fit - 1);
+  EXPECT_EQ(logs[fit].seq, fit);
+}
+
+// 一批日志超过一个缓冲区时拆成几批追加，lsn仍然连续地串成一条链
+TEST_F(LogManagerTest, OversizedBatchIsSplit) {
+  constexpr int VALUE_SIZE = 3000;
+  const int log_len = static_cast<int>(make_log(1, 0, VALUE_SIZE)->log_tot_len_);
+  const int num = LOG_BUFFER_SIZE / log_len * 2 + 10;
+
+  std::vector<std::unique_ptr<InsertLogRecord>> batch;
+  std::vector<LogRecord*> ptrs;
+  for (int seq = 0; seq < num; ++seq) {
+    batch.push_back(make_log(1, seq, VALUE_SIZE));
+    ptrs.push_back(batch.back().get());
+  }
+  lsn_t last = log_manager_->add_logs_to_buffer(ptrs.data(), num, INVALID_LSN);
+  EXPECT_EQ(last, batch.back()->lsn_);
+  log_manager_->flush_log_to_disk();
+
+  auto logs = read_all();
+  ASSERT_EQ(logs.size(), static_cast<size_t>(num));
+  EXPECT_EQ(logs[0].prev_lsn, INVALID_LSN);
+  for (int i = 0; i < num; ++i) {
+    EXPECT_EQ(logs[i].seq, i);
+    if (i > 0) {
+      EXPECT_EQ(logs[i].prev_lsn, logs[i - 1].lsn);
+    }
+  }
+
+  // 一条日志本身比缓冲区大时无法追加
+  auto huge = make_log(1, 0, LOG_BUFFER_SIZE);
+  EXPECT_THROW(log_manager_->add_log_to_buffer(huge.get()), InternalError);
+}
+
+// 等待刷盘的事务在刷盘线程推进persist_lsn_后返回
+TEST_F(LogManagerTest, WaitForFlush) {
+  log_manager_->start_flush_thread();
+  lsn_t prev_lsn = INVALID_LSN;
+  for (int seq = 0; seq < 100; ++seq) {
+    auto log = make_log(1, seq, 100);
+    log->prev_lsn_ = prev_lsn;
+    prev_lsn = log_manager_->add_log_to_buffer(log.get());
+    log_manager_->wait_for_flush(prev_lsn);
+    EXPECT_GE(log_manager_->get_persist_lsn(), prev_lsn);
+  }
+  log_manager_->stop_flush_thread();
+  EXPECT_EQ(read_all().size(), 100u);
+}
+
+}  // namespace
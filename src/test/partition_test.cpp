@@ -0,0 +1,231 @@
+// 哈希分区表的测试：插入的记录按分区字段落到各自的分区，分区表本身不存记录；
+// 扫描输出所有分区的并集，分区字段上的等值条件只扫描一个分区；分区定义在重新打开数据库后还在
+
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "execution/executor_insert.h"
+#include "execution/executor_partition_scan.h"
+#include "execution/executor_seq_scan.h"
+#include "gtest/gtest.h"
+#include "system/sm.h"
+#include "transaction/transaction_manager.h"
+
+namespace {
+
+const std::string DB_NAME = "partition_test_db";
+const std::string TAB_NAME = "t";
+constexpr int NUM_PARTITIONS = 4;
+constexpr int NUM_ROWS = 200;
+constexpr size_t POOL_SIZE = 256;
+
+class PartitionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/partition_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    old_dir_ = std::filesystem::current_path();
+    std::filesystem::current_path(dir_);
+    start();
+    PartitionDef def;
+    def.col = "a";
+    def.num = NUM_PARTITIONS;
+    sm_manager_->create_partitioned_table(TAB_NAME, {{"a", TYPE_INT, sizeof(int)}, {"b", TYPE_INT, sizeof(int)}},
+                                          def, context_.get());
+  }
+
+  void TearDown() override {
+    if (sm_manager_ != nullptr) {
+      stop();
+    }
+    std::filesystem::current_path(old_dir_);
+    std::filesystem::remove_all(dir_);
+  }
+
+  void start() {
+    disk_manager_ = std::make_unique<DiskManager>();
+    log_manager_ = std::make_unique<LogManager>(disk_manager_.get());
+    buffer_pool_manager_ = std::make_unique<BufferPoolManager>(POOL_SIZE, disk_manager_.get(), log_manager_.get());
+    rm_manager_ = std::make_unique<RmManager>(disk_manager_.get(), buffer_pool_manager_.get());
+    ix_manager_ = std::make_unique<IxManager>(disk_manager_.get(), buffer_pool_manager_.get());
+    sm_manager_ = std::make_unique<SmManager>(disk_manager_.get(), buffer_pool_manager_.get(), rm_manager_.get(),
+                                              ix_manager_.get());
+    lock_manager_ = std::make_unique<LockManager>();
+    txn_manager_ = std::make_unique<TransactionManager>(lock_manager_.get(), sm_manager_.get());
+    if (!sm_manager_->is_dir(DB_NAME)) {
+      sm_manager_->create_db(DB_NAME);
+    }
+    sm_manager_->open_db(DB_NAME);
+    txn_ = txn_manager_->begin(nullptr, log_manager_.get());
+    context_ = std::make_unique<Context>(lock_manager_.get(), log_manager_.get(), txn_);
+  }
+
+  void stop() {
+    txn_manager_->commit(txn_, log_manager_.get());
+    context_.reset();
+    sm_manager_->close_db();
+    txn_manager_.reset();
+    lock_manager_.reset();
+    sm_manager_.reset();
+    ix_manager_.reset();
+    rm_manager_.reset();
+    buffer_pool_manager_.reset();
+    log_manager_.reset();
+    disk_manager_.reset();
+  }
+
+  static Value int_value(int v) {
+    Value value;
+    value.set_int(v);
+    return value;
+  }
+
+  // 一条语句插入(i, i * 10)，0 <= i < NUM_ROWS
+  void insert_rows() {
+    std::vector<Value> values;
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      values.push_back(int_value(i));
+      values.push_back(int_value(i * 10));
+    }
+    InsertExecutor insert(sm_manager_.get(), TAB_NAME, std::move(values), context_.get());
+    insert.Next();
+  }
+
+  static Condition cond(const std::string& col_name, CompOp op, int v) {
+    Condition cond;
+    cond.lhs_col = {TAB_NAME, col_name};
+    cond.op = op;
+    cond.is_rhs_val = true;
+    cond.rhs_val = int_value(v);
+    cond.rhs_val.init_raw(sizeof(int));
+    return cond;
+  }
+
+  // 扫描输出的(a, b)
+  static std::vector<std::pair<int, int>> collect(AbstractExecutor& scan) {
+    std::vector<std::pair<int, int>> rows;
+    for (scan.beginTuple(); !scan.is_end(); scan.nextTuple()) {
+      auto record = scan.Next();
+      int a, b;
+      memcpy(&a, record->data, sizeof(int));
+      memcpy(&b, record->data + sizeof(int), sizeof(int));
+      rows.emplace_back(a, b);
+    }
+    return rows;
+  }
+
+  static int partition_of(const TabMeta& tab, int a) {
+    return tab.partition.partition_of(reinterpret_cast<const char*>(&a), sizeof(int));
+  }
+
+  std::string dir_;
+  std::filesystem::path old_dir_;
+  std::unique_ptr<DiskManager> disk_manager_;
+  std::unique_ptr<LogManager> log_manager_;
+  std::unique_ptr<BufferPoolManager> buffer_pool_manager_;
+  std::unique_ptr<RmManager> rm_manager_;
+  std::unique_ptr<IxManager> ix_manager_;
+  std::unique_ptr<SmManager> sm_manager_;
+  std::unique_ptr<LockManager> lock_manager_;
+  std::unique_ptr<TransactionManager> txn_manager_;
+  Transaction* txn_ = nullptr;
+  std::unique_ptr<Context> context_;
+};
+
+TEST_F(PartitionTest, InsertRoutesRowsByHash) {
+  insert_rows();
+  auto& tab = sm_manager_->db_.get_table(TAB_NAME);
+  EXPECT_EQ(sm_manager_->fhs_.at(TAB_NAME)->get_num_rows(), 0u);
+  EXPECT_EQ(sm_manager_->getTableRowCount(TAB_NAME), static_cast<size_t>(NUM_ROWS));
+  std::set<int> seen;
+  for (int i = 0; i < NUM_PARTITIONS; ++i) {
+    SeqScanExecutor scan(sm_manager_.get(), PartitionDef::partition_name(TAB_NAME, i), {}, context_.get());
+    auto rows = collect(scan);
+    // 200条记录分到4个分区，每个分区都不会是空的
+    EXPECT_FALSE(rows.empty());
+    for (auto& [a, b] : rows) {
+      EXPECT_EQ(partition_of(tab, a), i);
+      EXPECT_EQ(b, a * 10);
+      EXPECT_TRUE(seen.insert(a).second);
+    }
+  }
+  EXPECT_EQ(seen.size(), static_cast<size_t>(NUM_ROWS));
+}
+
+TEST_F(PartitionTest, ScanReturnsUnionOfPartitions) {
+  insert_rows();
+  PartitionScanExecutor scan(sm_manager_.get(), TAB_NAME, {}, context_.get());
+  auto rows = collect(scan);
+  ASSERT_EQ(rows.size(), static_cast<size_t>(NUM_ROWS));
+  std::set<int> keys;
+  for (auto& [a, b] : rows) {
+    EXPECT_EQ(b, a * 10);
+    keys.insert(a);
+  }
+  EXPECT_EQ(keys.size(), static_cast<size_t>(NUM_ROWS));
+
+  // 不是分区字段上的条件要扫描所有分区
+  PartitionScanExecutor by_b(sm_manager_.get(), TAB_NAME, {cond("b", OP_GE, 1500)}, context_.get());
+  EXPECT_EQ(collect(by_b).size(), static_cast<size_t>(NUM_ROWS - 150));
+}
+
+TEST_F(PartitionTest, EqualityOnPartitionKeyScansOnePartition) {
+  insert_rows();
+  auto& tab = sm_manager_->db_.get_table(TAB_NAME);
+  constexpr int key = 42;
+  // 在别的分区中放一条a = key的记录：只扫描key所在的分区时看不到它，扫描所有分区时能看到
+  int other = (partition_of(tab, key) + 1) % NUM_PARTITIONS;
+  int row[2] = {key, -1};
+  auto* fh = sm_manager_->fhs_.at(PartitionDef::partition_name(TAB_NAME, other)).get();
+  fh->insert_record(reinterpret_cast<char*>(row), context_.get());
+
+  PartitionScanExecutor pruned(sm_manager_.get(), TAB_NAME, {cond("a", OP_EQ, key)}, context_.get());
+  auto rows = collect(pruned);
+  ASSERT_EQ(rows.size(), 1u);
+  EXPECT_EQ(rows[0], std::make_pair(key, key * 10));
+
+  PartitionScanExecutor full(sm_manager_.get(), TAB_NAME, {cond("a", OP_GE, key), cond("a", OP_LE, key)},
+                             context_.get());
+  EXPECT_EQ(collect(full).size(), 2u);
+}
+
+TEST_F(PartitionTest, LimitStopsAcrossPartitions) {
+  insert_rows();
+  PartitionScanExecutor scan(sm_manager_.get(), TAB_NAME, {}, context_.get());
+  scan.set_limit(NUM_ROWS / NUM_PARTITIONS + 7);
+  EXPECT_EQ(collect(scan).size(), static_cast<size_t>(NUM_ROWS / NUM_PARTITIONS + 7));
+
+  PartitionScanExecutor batched(sm_manager_.get(), TAB_NAME, {}, context_.get());
+  TupleBatch batch;
+  size_t total = 0;
+  batched.beginTuple();
+  while (batched.NextBatch(batch)) {
+    total += batch.size();
+  }
+  EXPECT_EQ(total, static_cast<size_t>(NUM_ROWS));
+}
+
+TEST_F(PartitionTest, DefinitionSurvivesReopen) {
+  insert_rows();
+  stop();
+  start();
+  auto& tab = sm_manager_->db_.get_table(TAB_NAME);
+  EXPECT_EQ(tab.partition.col, "a");
+  EXPECT_EQ(tab.partition.num, NUM_PARTITIONS);
+  for (auto& partition_name : tab.partition_names()) {
+    EXPECT_EQ(sm_manager_->db_.get_table(partition_name).partition.parent, TAB_NAME);
+  }
+  PartitionScanExecutor scan(sm_manager_.get(), TAB_NAME, {cond("a", OP_EQ, 7)}, context_.get());
+  auto rows = collect(scan);
+  ASSERT_EQ(rows.size(), 1u);
+  EXPECT_EQ(rows[0], std::make_pair(7, 70));
+}
+
+}  // namespace
@@ -0,0 +1,50 @@
+#!/bin/bash
+# TPC-C 回归性能测试：在一个新建的数据库上启动 rmdb，建表、LOAD table_data 中的数据并建索引（分别计时），
+# 然后用固定的种子让每个终端执行固定数量的事务，吞吐、延迟和加载耗时写成 JSON，用来比较不同提交的性能。
+#
+# 用法（在仓库根目录下）：src/test/performance_test/run_tpcc.sh [结果文件]
+# 环境变量：
+#   RMDB        服务端程序，默认 build/bin/rmdb
+#   TPCC_BENCH  压测客户端，默认 rmdb_client/build/tpcc_bench
+#   TERMINALS   终端数，默认 1（单终端时事务序列完全确定）
+#   TXNS        每个终端的事务数，默认 2000
+#   SEED        随机种子，默认 42
+
+set -e
+
+ROOT=$(pwd)
+DATA_DIR=$(cd "$(dirname "$0")" && pwd)/table_data
+RESULT=$(realpath -m "${1:-tpcc_result.json}")
+RMDB=$(realpath "${RMDB:-build/bin/rmdb}")
+TPCC_BENCH=$(realpath "${TPCC_BENCH:-rmdb_client/build/tpcc_bench}")
+TERMINALS=${TERMINALS:-1}
+TXNS=${TXNS:-2000}
+SEED=${SEED:-42}
+
+# 数据库建在临时目录中，每次都从空库开始
+WORK_DIR=$(mktemp -d)
+SERVER_PID=
+cleanup() {
+  if [ -n "$SERVER_PID" ]; then
+    kill -INT "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+  fi
+  rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+cd "$WORK_DIR"
+"$RMDB" tpcc_regress > server.log 2>&1 &
+SERVER_PID=$!
+cd "$ROOT"
+
+# 等服务端开始监听
+for _ in $(seq 50); do
+  if (echo > /dev/tcp/127.0.0.1/8765) 2>/dev/null; then
+    break
+  fi
+  sleep 0.1
+done
+
+"$TPCC_BENCH" -l -D "$DATA_DIR" -t "$TERMINALS" -n "$TXNS" -s "$SEED" -o "$RESULT"
+echo "results written to $RESULT"
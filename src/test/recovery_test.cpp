@@ -0,0 +1,249 @@
+// 故障恢复的测试。崩溃前只有日志落盘，数据文件中只有表头：提交的事务要由redo重建，
+// 未提交的事务在redo之后被undo。恢复后再恢复一次，结果不变
+
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "index/ix.h"
+#include "record/rm.h"
+#include "record/rm_scan.h"
+#include "recovery/log_recovery.h"
+#include "system/sm.h"
+#include "transaction/transaction_manager.h"
+
+namespace {
+
+const std::string DB_NAME = "recovery_test_db";
+const std::string TAB_NAME = "t";
+constexpr size_t POOL_SIZE = 256;
+
+class RecoveryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/recovery_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    old_dir_ = std::filesystem::current_path();
+    std::filesystem::current_path(dir_);
+  }
+
+  void TearDown() override {
+    if (sm_manager_ != nullptr) {
+      stop();
+    }
+    std::filesystem::current_path(old_dir_);
+    std::filesystem::remove_all(dir_);
+  }
+
+  // 和rmdb启动时一样创建各个管理器并打开数据库，数据库不存在时先创建
+  void start() {
+    disk_manager_ = std::make_unique<DiskManager>();
+    log_manager_ = std::make_unique<LogManager>(disk_manager_.get());
+    buffer_pool_manager_ = std::make_unique<BufferPoolManager>(POOL_SIZE, disk_manager_.get(), log_manager_.get());
+    rm_manager_ = std::make_unique<RmManager>(disk_manager_.get(), buffer_pool_manager_.get());
+    ix_manager_ = std::make_unique<IxManager>(disk_manager_.get(), buffer_pool_manager_.get());
+    sm_manager_ = std::make_unique<SmManager>(disk_manager_.get(), buffer_pool_manager_.get(), rm_manager_.get(),
+                                              ix_manager_.get());
+    txn_manager_ = std::make_unique<TransactionManager>(nullptr, sm_manager_.get());
+    if (!sm_manager_->is_dir(DB_NAME)) {
+      sm_manager_->create_db(DB_NAME);
+    }
+    sm_manager_->open_db(DB_NAME);
+  }
+
+  void stop() {
+    sm_manager_->close_db();
+    txn_manager_.reset();
+    sm_manager_.reset();
+    ix_manager_.reset();
+    rm_manager_.reset();
+    buffer_pool_manager_.reset();
+    log_manager_.reset();
+    disk_manager_.reset();
+  }
+
+  void recover() {
+    RecoveryManager recovery(disk_manager_.get(), buffer_pool_manager_.get(), sm_manager_.get(), log_manager_.get(),
+                             txn_manager_.get());
+    recovery.analyze();
+    recovery.redo();
+    recovery.undo();
+  }
+
+  RmFileHandle* table() { return sm_manager_->fhs_.at(TAB_NAME).get(); }
+
+  // 第i条记录放在第i个槽位上
+  Rid rid_of(int i) { return {RM_FIRST_RECORD_PAGE + i / per_page_, i % per_page_}; }
+
+  static std::vector<char> row(int a, int b) {
+    std::vector<char> data(2 * sizeof(int));
+    memcpy(data.data(), &a, sizeof(int));
+    memcpy(data.data() + sizeof(int), &b, sizeof(int));
+    return data;
+  }
+
+  // 一个事务写日志，prev_lsn串成链，第一条是begin日志
+  struct TxnLog {
+    txn_id_t id;
+    lsn_t last = INVALID_LSN;
+  };
+
+  void append(TxnLog& txn, LogRecord* log_record) {
+    log_record->prev_lsn_ = txn.last;
+    txn.last = log_manager_->add_log_to_buffer(log_record);
+  }
+
+  void begin(TxnLog& txn) {
+    BeginLogRecord log_record(txn.id);
+    append(txn, &log_record);
+  }
+
+  void insert(TxnLog& txn, int i, int b) {
+    auto data = row(i, b);
+    InsertLogRecord log_record(txn.id, data.data(), static_cast<int>(data.size()), rid_of(i), table_id_);
+    append(txn, &log_record);
+  }
+
+  void update(TxnLog& txn, int i, int old_b, int new_b) {
+    auto old_data = row(i, old_b);
+    auto new_data = row(i, new_b);
+    UpdateLogRecord log_record(txn.id, old_data.data(), new_data.data(), static_cast<int>(old_data.size()),
+                               rid_of(i), table_id_);
+    append(txn, &log_record);
+  }
+
+  void erase(TxnLog& txn, int i, int b) {
+    auto data = row(i, b);
+    DeleteLogRecord log_record(txn.id, data.data(), static_cast<int>(data.size()), rid_of(i), table_id_);
+    append(txn, &log_record);
+  }
+
+  void commit(TxnLog& txn) {
+    CommitLogRecord log_record(txn.id);
+    append(txn, &log_record);
+  }
+
+  // 表中的全部记录 a -> b，并检查索引中恰好有这些key
+  std::map<int, int> read_table(int max_key) {
+    std::map<int, int> rows;
+    auto* fh = table();
+    for (RmScan scan(fh); !scan.is_end(); scan.next()) {
+      auto record = fh->get_record(scan.rid(), nullptr, RM_LOCK_TABLE);
+      int a;
+      int b;
+      memcpy(&a, record->data, sizeof(int));
+      memcpy(&b, record->data + sizeof(int), sizeof(int));
+      EXPECT_TRUE(rows.emplace(a, b).second) << "duplicate key " << a;
+    }
+    auto& tab = sm_manager_->db_.get_table(TAB_NAME);
+    auto* ih = sm_manager_->get_ih(tab.get_index_meta({"a"}).id);
+    for (int a = 0; a <= max_key; ++a) {
+      std::vector<Rid> rids;
+      bool found = ih->get_value(reinterpret_cast<const char*>(&a), &rids, nullptr);
+      EXPECT_EQ(found, rows.count(a) == 1) << "key " << a;
+    }
+    return rows;
+  }
+
+  std::filesystem::path dir_;
+  std::filesystem::path old_dir_;
+  std::unique_ptr<DiskManager> disk_manager_;
+  std::unique_ptr<LogManager> log_manager_;
+  std::unique_ptr<BufferPoolManager> buffer_pool_manager_;
+  std::unique_ptr<RmManager> rm_manager_;
+  std::unique_ptr<IxManager> ix_manager_;
+  std::unique_ptr<SmManager> sm_manager_;
+  std::unique_ptr<TransactionManager> txn_manager_;
+  int per_page_ = 0;
+  int table_id_ = -1;
+};
+
+// txn1插入N条记录后提交；txn2和txn3交替执行，txn2改写和删除一部分记录后提交，txn3改写、删除另一部分记录，
+// 再插入20条新记录，没有提交；txn4在txn3之后插入10条记录并提交，和txn3的记录在同一个页面上。
+// 日志是直接写的，没有改动数据页面，相当于崩溃时数据页面一页都没有写盘
+TEST_F(RecoveryTest, RedoWinnersUndoLosers) {
+  start();
+  sm_manager_->create_table(TAB_NAME, {{"a", TYPE_INT, sizeof(int)}, {"b", TYPE_INT, sizeof(int)}}, nullptr);
+  sm_manager_->create_index(TAB_NAME, {"a"}, nullptr);
+  per_page_ = table()->get_file_hdr().num_records_per_page;
+  table_id_ = table()->get_table_id();
+  // 跨过几个页面，最后一页不满
+  const int n = 2 * per_page_ + per_page_ / 2;
+
+  TxnLog txn1{1};
+  begin(txn1);
+  for (int i = 0; i < n; ++i) {
+    insert(txn1, i, i);
+  }
+  commit(txn1);
+
+  // 两个事务改写的记录不相交
+  TxnLog txn2{2};
+  TxnLog txn3{3};
+  begin(txn2);
+  begin(txn3);
+  for (int i = 0; i < n; ++i) {
+    switch (i % 4) {
+      case 0:
+        update(txn2, i, i, -i);
+        break;
+      case 1:
+        erase(txn2, i, i);
+        break;
+      case 2:
+        update(txn3, i, i, 1000 + i);
+        update(txn3, i, 1000 + i, 2000 + i);
+        break;
+      default:
+        if (i % 8 == 3) {
+          erase(txn3, i, i);
+        }
+        break;
+    }
+  }
+  commit(txn2);
+  for (int i = n; i < n + 20; ++i) {
+    insert(txn3, i, i);
+  }
+  TxnLog txn4{4};
+  begin(txn4);
+  for (int i = n + 20; i < n + 30; ++i) {
+    insert(txn4, i, i);
+  }
+  commit(txn4);
+  lsn_t last_lsn = txn4.last;
+  log_manager_->flush_log_to_disk();
+  stop();
+
+  std::map<int, int> expected;
+  for (int i = 0; i < n; ++i) {
+    if (i % 4 == 0) {
+      expected[i] = -i;
+    } else if (i % 4 != 1) {
+      expected[i] = i;
+    }
+  }
+  for (int i = n + 20; i < n + 30; ++i) {
+    expected[i] = i;
+  }
+
+  start();
+  recover();
+  EXPECT_GT(log_manager_->get_next_lsn(), last_lsn);
+  EXPECT_EQ(read_table(n + 30), expected);
+  stop();
+
+  // 回滚的结果已经落盘并写了abort日志，再恢复一次时txn3的修改重做时被页面lsn跳过，也不会再回滚
+  start();
+  recover();
+  EXPECT_EQ(read_table(n + 30), expected);
+}
+
+}  // namespace
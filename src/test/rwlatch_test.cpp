@@ -1,3 +1,206 @@
 //
 // Created by Koschei on 2024/5/21.
 //
+
+// 读写锁的正确性测试和读锁扩展性测试。
+// ScalingTest打印1、2、4……到核数个线程只加读锁时std::shared_mutex、RWLatch和ScalableRWLatch的吞吐，
+// 不做断言，用来比较读锁的扩展性
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "storage/rwlatch.h"
+
+namespace {
+
+constexpr int THREADS = 8;
+constexpr int ITERATIONS = 20000;
+
+// 读锁内检查没有写者，写锁内检查没有其他读者和写者
+template <typename Latch>
+void check_exclusion(Latch& latch, void (Latch::*rlock)(), void (Latch::*runlock)(), void (Latch::*wlock)(),
+                     void (Latch::*wunlock)()) {
+  std::atomic<int> readers{0};
+  std::atomic<int> writers{0};
+  std::atomic<bool> failed{false};
+  uint64_t counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < ITERATIONS; ++i) {
+        if ((i + t) % 8 == 0) {
+          (latch.*wlock)();
+          if (writers.fetch_add(1) != 0 || readers.load() != 0) {
+            failed = true;
+          }
+          ++counter;
+          writers.fetch_sub(1);
+          (latch.*wunlock)();
+        } else {
+          (latch.*rlock)();
+          readers.fetch_add(1);
+          if (writers.load() != 0) {
+            failed = true;
+          }
+          readers.fetch_sub(1);
+          (latch.*runlock)();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_FALSE(failed.load());
+  // 每个线程加写锁ITERATIONS / 8次，计数不丢说明写锁互斥
+  EXPECT_EQ(counter, static_cast<uint64_t>(THREADS) * ITERATIONS / 8);
+}
+
+// 读者不停地加读锁时，写者仍然能在有限时间内拿到写锁
+template <typename Latch>
+void check_writer_preference(Latch& latch, void (Latch::*rlock)(), void (Latch::*runlock)(), void (Latch::*wlock)(),
+                             void (Latch::*wunlock)()) {
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        (latch.*rlock)();
+        (latch.*runlock)();
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  for (int i = 0; i < 100; ++i) {
+    (latch.*wlock)();
+    (latch.*wunlock)();
+  }
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+// threads个线程在latch上加读锁，返回每秒加锁的总次数
+template <typename Latch, typename RLock, typename RUnlock>
+double read_throughput(Latch& latch, int threads, RLock rlock, RUnlock runlock) {
+  constexpr int OPS = 1000000;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      ready.fetch_add(1);
+      while (!go.load()) {
+      }
+      for (int i = 0; i < OPS; ++i) {
+        rlock(latch);
+        runlock(latch);
+      }
+    });
+  }
+  while (ready.load() != threads) {
+  }
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return static_cast<double>(OPS) * threads / seconds;
+}
+
+}  // namespace
+
+TEST(RWLatchTest, MutualExclusion) {
+  RWLatch latch;
+  check_exclusion(latch, &RWLatch::RLock, &RWLatch::RUnlock, &RWLatch::WLock, &RWLatch::WUnlock);
+}
+
+TEST(RWLatchTest, TryRLock) {
+  RWLatch latch;
+  EXPECT_TRUE(latch.TryRLock());
+  EXPECT_TRUE(latch.TryRLock());
+  latch.RUnlock();
+  latch.RUnlock();
+  latch.WLock();
+  EXPECT_FALSE(latch.TryRLock());
+  latch.WUnlock();
+  EXPECT_TRUE(latch.TryRLock());
+  latch.RUnlock();
+}
+
+TEST(RWLatchTest, WriterPreference) {
+  RWLatch latch;
+  check_writer_preference(latch, &RWLatch::RLock, &RWLatch::RUnlock, &RWLatch::WLock, &RWLatch::WUnlock);
+}
+
+TEST(RWLatchTest, StdInterface) {
+  RWLatch latch;
+  {
+    std::shared_lock lock1(latch);
+    std::shared_lock lock2(latch);
+    EXPECT_TRUE(latch.try_lock_shared());
+    latch.unlock_shared();
+  }
+  std::unique_lock lock(latch);
+  EXPECT_FALSE(latch.try_lock_shared());
+}
+
+TEST(ScalableRWLatchTest, MutualExclusion) {
+  ScalableRWLatch latch;
+  check_exclusion(latch, &ScalableRWLatch::RLock, &ScalableRWLatch::RUnlock, &ScalableRWLatch::WLock,
+                  &ScalableRWLatch::WUnlock);
+}
+
+TEST(ScalableRWLatchTest, WriterPreference) {
+  ScalableRWLatch latch;
+  check_writer_preference(latch, &ScalableRWLatch::RLock, &ScalableRWLatch::RUnlock, &ScalableRWLatch::WLock,
+                          &ScalableRWLatch::WUnlock);
+}
+
+TEST(HybridMutexTest, MutualExclusion) {
+  HybridMutex mutex;
+  uint64_t counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < ITERATIONS; ++i) {
+        std::lock_guard lock(mutex);
+        ++counter;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter, static_cast<uint64_t>(THREADS) * ITERATIONS);
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(RWLatchScalingTest, ReadThroughput) {
+  int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  printf("%8s %16s %16s %16s  (read locks/s)\n", "threads", "shared_mutex", "RWLatch", "ScalableRWLatch");
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    std::shared_mutex shared_mutex;
+    RWLatch latch;
+    ScalableRWLatch scalable;
+    double a = read_throughput(
+        shared_mutex, threads, [](std::shared_mutex& m) { m.lock_shared(); },
+        [](std::shared_mutex& m) { m.unlock_shared(); });
+    double b = read_throughput(
+        latch, threads, [](RWLatch& l) { l.RLock(); }, [](RWLatch& l) { l.RUnlock(); });
+    double c = read_throughput(
+        scalable, threads, [](ScalableRWLatch& l) { l.RLock(); }, [](ScalableRWLatch& l) { l.RUnlock(); });
+    printf("%8d %16.0f %16.0f %16.0f\n", threads, a, b, c);
+  }
+}
@@ -0,0 +1,295 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+// 存储层热路径的微基准，作为修改缓冲池等模块前后对比的基线：
+// 缓冲池命中和未命中时的fetch/unpin（1~64线程）、时钟替换器在不同pin比例下的victim、
+// 磁盘读写、记录文件的插入/读取/扫描，以及位图的next_bit
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "record/bitmap.h"
+#include "record/rm.h"
+#include "replacer/lru_replacer.h"
+#include "storage/buffer_pool_manager.h"
+#include "storage/disk_manager.h"
+
+namespace {
+
+constexpr int HOT_PAGES = 1024;       // 命中测试的页面数，全部放得进缓冲池
+constexpr int COLD_PAGES = 16384;     // 未命中测试的页面数，远大于缓冲池
+constexpr size_t MISS_POOL_SIZE = 512;
+constexpr int DISK_PAGES = 1024;
+constexpr int RECORD_SIZE = 64;
+constexpr int NUM_RECORDS = 100000;
+
+// 预先写好num_pages个页面的数据文件，进程退出时删除
+class PageFile {
+ public:
+  PageFile(DiskManager* disk_manager, const std::string& name, int num_pages)
+      : disk_manager_(disk_manager), name_(name) {
+    if (disk_manager_->is_file(name_)) {
+      disk_manager_->destroy_file(name_);
+    }
+    disk_manager_->create_file(name_);
+    fd_ = disk_manager_->open_file(name_);
+    std::vector<char> page(PAGE_SIZE, 0);
+    for (int page_no = 0; page_no < num_pages; ++page_no) {
+      memcpy(page.data(), &page_no, sizeof(page_no));
+      disk_manager_->write_page(fd_, page_no, page.data(), PAGE_SIZE);
+    }
+    disk_manager_->set_fd2pageno(fd_, num_pages);
+  }
+
+  ~PageFile() {
+    disk_manager_->close_file(fd_);
+    disk_manager_->destroy_file(name_);
+  }
+
+  int fd() const { return fd_; }
+
+ private:
+  DiskManager* disk_manager_;
+  std::string name_;
+  int fd_;
+};
+
+// 一个缓冲池和它上面的一个数据文件，所有线程共用
+struct PoolFixture {
+  std::unique_ptr<DiskManager> disk_manager;
+  std::unique_ptr<BufferPoolManager> bpm;
+  std::unique_ptr<PageFile> file;
+  int num_pages;
+
+  PoolFixture(size_t pool_size, const std::string& name, int pages)
+      : disk_manager(std::make_unique<DiskManager>()),
+        bpm(std::make_unique<BufferPoolManager>(pool_size, disk_manager.get())),
+        file(std::make_unique<PageFile>(disk_manager.get(), name, pages)),
+        num_pages(pages) {}
+
+  ~PoolFixture() {
+    bpm->delete_all_pages(file->fd());
+    bpm.reset();
+    file.reset();
+  }
+};
+
+PoolFixture& hit_fixture() {
+  static PoolFixture fixture(BUFFER_POOL_SIZE, "bench_bpm_hit", HOT_PAGES);
+  return fixture;
+}
+
+PoolFixture& miss_fixture() {
+  static PoolFixture fixture(MISS_POOL_SIZE, "bench_bpm_miss", COLD_PAGES);
+  return fixture;
+}
+
+// 每个线程在fixture的页面中随机fetch再unpin
+void fetch_unpin(benchmark::State& state, PoolFixture& fixture) {
+  std::mt19937 rng(state.thread_index() + 1);
+  std::uniform_int_distribution<int> dist(0, fixture.num_pages - 1);
+  int fd = fixture.file->fd();
+  for (auto _ : state) {
+    PageId page_id{fd, dist(rng)};
+    Page* page = fixture.bpm->fetch_page(page_id);
+    if (page != nullptr) {
+      benchmark::DoNotOptimize(page->get_data()[0]);
+      fixture.bpm->unpin_page(page_id, false);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BufferPoolFetchHit(benchmark::State& state) {
+  auto& fixture = hit_fixture();
+  if (state.thread_index() == 0) {
+    // 先把所有页面读进缓冲池
+    for (int page_no = 0; page_no < fixture.num_pages; ++page_no) {
+      PageId page_id{fixture.file->fd(), page_no};
+      fixture.bpm->fetch_page(page_id);
+      fixture.bpm->unpin_page(page_id, false);
+    }
+  }
+  fetch_unpin(state, fixture);
+}
+BENCHMARK(BM_BufferPoolFetchHit)->ThreadRange(1, 64)->UseRealTime();
+
+void BM_BufferPoolFetchMiss(benchmark::State& state) {
+  fetch_unpin(state, miss_fixture());
+}
+BENCHMARK(BM_BufferPoolFetchMiss)->ThreadRange(1, 64)->UseRealTime();
+
+// 参数是被pin住的frame的百分比，每次淘汰后把frame pin再unpin一次，模拟缓冲池复用它
+void BM_ClockReplacerVictim(benchmark::State& state) {
+  constexpr size_t num_frames = 4096;
+  ClockReplacer replacer(num_frames);
+  size_t pinned = num_frames * state.range(0) / 100;
+  std::vector<frame_id_t> order(num_frames);
+  for (size_t i = 0; i < num_frames; ++i) {
+    order[i] = static_cast<frame_id_t>(i);
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+  for (size_t i = 0; i < pinned; ++i) {
+    replacer.pin(order[i]);
+  }
+  for (auto _ : state) {
+    frame_id_t frame_id;
+    if (!replacer.victim(&frame_id)) {
+      state.SkipWithError("no victim");
+      break;
+    }
+    replacer.pin(frame_id);
+    replacer.unpin(frame_id);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClockReplacerVictim)->Arg(0)->Arg(50)->Arg(90)->Arg(99);
+
+DiskManager& bench_disk_manager() {
+  static DiskManager disk_manager;
+  return disk_manager;
+}
+
+PageFile& disk_file() {
+  static PageFile file(&bench_disk_manager(), "bench_disk", DISK_PAGES);
+  return file;
+}
+
+void BM_DiskManagerRead(benchmark::State& state) {
+  int fd = disk_file().fd();
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, DISK_PAGES - 1);
+  std::vector<char> buf(PAGE_SIZE);
+  for (auto _ : state) {
+    bench_disk_manager().read_page(fd, dist(rng), buf.data(), PAGE_SIZE);
+  }
+  state.SetBytesProcessed(state.iterations() * PAGE_SIZE);
+}
+BENCHMARK(BM_DiskManagerRead);
+
+void BM_DiskManagerWrite(benchmark::State& state) {
+  int fd = disk_file().fd();
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, DISK_PAGES - 1);
+  std::vector<char> buf(PAGE_SIZE, 'x');
+  for (auto _ : state) {
+    bench_disk_manager().write_page(fd, dist(rng), buf.data(), PAGE_SIZE);
+  }
+  state.SetBytesProcessed(state.iterations() * PAGE_SIZE);
+}
+BENCHMARK(BM_DiskManagerWrite);
+
+// 一个定长记录的数据文件，每个基准各建一个
+struct RecordFixture {
+  std::unique_ptr<DiskManager> disk_manager;
+  std::unique_ptr<BufferPoolManager> bpm;
+  std::unique_ptr<RmManager> rm_manager;
+  std::unique_ptr<RmFileHandle> fh;
+  std::string name;
+
+  explicit RecordFixture(const std::string& name_)
+      : disk_manager(std::make_unique<DiskManager>()),
+        bpm(std::make_unique<BufferPoolManager>(BUFFER_POOL_SIZE,
+                                                disk_manager.get())),
+        rm_manager(std::make_unique<RmManager>(disk_manager.get(), bpm.get())),
+        name(name_) {
+    if (disk_manager->is_file(name)) {
+      rm_manager->destroy_file(name);
+    }
+    rm_manager->create_file(name, RECORD_SIZE);
+    fh = rm_manager->open_file(name);
+  }
+
+  ~RecordFixture() {
+    rm_manager->close_file(fh.get());
+    rm_manager->destroy_file(name);
+  }
+
+  std::vector<Rid> fill(int num_records) {
+    std::vector<Rid> rids;
+    char buf[RECORD_SIZE] = {};
+    for (int i = 0; i < num_records; ++i) {
+      memcpy(buf, &i, sizeof(i));
+      rids.push_back(fh->insert_record(buf, nullptr));
+    }
+    return rids;
+  }
+};
+
+void BM_RmFileInsert(benchmark::State& state) {
+  RecordFixture fixture("bench_rm_insert");
+  char buf[RECORD_SIZE] = {};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.fh->insert_record(buf, nullptr));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RmFileInsert);
+
+void BM_RmFileGet(benchmark::State& state) {
+  RecordFixture fixture("bench_rm_get");
+  auto rids = fixture.fill(NUM_RECORDS);
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> dist(0, rids.size() - 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.fh->get_record(rids[dist(rng)], nullptr));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RmFileGet);
+
+// 每次迭代扫描整个文件
+void BM_RmFileScan(benchmark::State& state) {
+  RecordFixture fixture("bench_rm_scan");
+  fixture.fill(NUM_RECORDS);
+  for (auto _ : state) {
+    size_t count = 0;
+    for (RmScan scan(fixture.fh.get()); !scan.is_end(); scan.next_page()) {
+      count += scan.slots().size();
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_RECORDS);
+}
+BENCHMARK(BM_RmFileScan);
+
+// 参数是位图中置1的位的百分比，每次迭代用next_bit找出所有的1
+void BM_BitmapNextBit(benchmark::State& state) {
+  constexpr int num_bits = 4096;
+  std::vector<char> bm(num_bits / BITMAP_WIDTH);
+  Bitmap::init(bm.data(), static_cast<int>(bm.size()));
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, 99);
+  for (int i = 0; i < num_bits; ++i) {
+    if (dist(rng) < state.range(0)) {
+      Bitmap::set(bm.data(), i);
+    }
+  }
+  for (auto _ : state) {
+    int count = 0;
+    for (int i = Bitmap::first_bit(true, bm.data(), num_bits); i < num_bits;
+         i = Bitmap::next_bit(true, bm.data(), num_bits, i)) {
+      ++count;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * num_bits);
+}
+BENCHMARK(BM_BitmapNextBit)->Arg(1)->Arg(50)->Arg(99);
+
+}  // namespace
+
+BENCHMARK_MAIN();
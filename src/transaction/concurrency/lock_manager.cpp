@@ -10,644 +10,609 @@ See the Mulan PSL v2 for more details. */
 
 #include "lock_manager.h"
 
-#include "execution/predicate_manager.h"
-
-// 加锁阶段检查
-static inline bool check_lock(Transaction* txn) {
-  auto& txn_state = txn->get_state();
-  // 事务结束，不能再获取锁
-  if (txn_state == TransactionState::COMMITTED ||
-      txn_state == TransactionState::ABORTED) {
-    return false;
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "common/exec_stats.h"
+#include "common/statement_cancel.h"
+#include "common/trace.h"
+#include "occ_manager.h"
+
+std::chrono::milliseconds cycle_detection_interval{50};
+
+LockManager::LockManager(DeadlockPolicy policy) : policy_(policy) {
+  for (auto& shard : shards_) {
+    shard.lock_table_.reserve(256);
   }
-  // 两阶段锁，收缩阶段不允许加锁
-  if (txn_state == TransactionState::SHRINKING) {
-    throw TransactionAbortException(txn->get_transaction_id(),
-                                    AbortReason::LOCK_ON_SHIRINKING);
+  if (policy_ == DeadlockPolicy::DETECTION) {
+    detector_ = std::thread([this] {
+      std::unique_lock lock(detector_latch_);
+      while (!detector_cv_.wait_for(lock, cycle_detection_interval,
+                                    [this] { return stop_detector_; })) {
+        detect_deadlocks();
+      }
+    });
   }
-  // 没加过锁，更新事务为增长状态，开始两阶段锁第一阶段
-  if (txn_state == TransactionState::DEFAULT) {
-    txn_state = TransactionState::GROWING;
+}
+
+LockManager::~LockManager() {
+  if (detector_.joinable()) {
+    {
+      std::lock_guard lock(detector_latch_);
+      stop_detector_ = true;
+    }
+    detector_cv_.notify_all();
+    detector_.join();
   }
-  return true;
 }
 
 /**
- * @description: 申请间隙锁
- * @return {bool} 加锁是否成功
- * @param {Transaction*} txn 要申请锁的事务对象指针
- * @param {Rmcord&} rid 加锁的间隙下限记录
- * @param {Rmcord&} rid 加锁的间隙上限记录
- * @param {int} tab_fd
+ * @description: 已经授予的锁held是否允许再授予requested。间隙上的SHARED和插入意向锁
+ * INTENTION_EXCLUSIVE同种相容、不同种互斥，也符合这张表
  */
-bool LockManager::lock_shared_on_gap(Transaction* txn, IndexMeta& index_meta,
-                                     Gap& gap, int tab_fd) {
-  std::lock_guard lock(latch_);
+bool LockManager::compatible(LockMode held, LockMode requested) {
+  static constexpr bool matrix[5][5] = {
+      // IS     IX     S      SIX    X
+      {true, true, true, true, false},       // IS
+      {true, true, false, false, false},     // IX
+      {true, false, true, false, false},     // S
+      {true, false, false, false, false},    // SIX
+      {false, false, false, false, false}};  // X
+  return matrix[static_cast<int>(held)][static_cast<int>(requested)];
+}
 
-  if (!check_lock(txn)) {
-    return false;
-  }
+bool LockManager::is_victim(txn_id_t txn_id) {
+  std::lock_guard lock(victim_latch_);
+  return victims_.count(txn_id) != 0;
+}
 
-  LockDataId lock_data_id(tab_fd, index_meta, gap, LockDataType::GAP);
-  auto&& it = gap_lock_table_.find(index_meta);
-  if (it == gap_lock_table_.end()) {
-    // 新建
-    it =
-        gap_lock_table_
-            .emplace(std::piecewise_construct,
-                     std::forward_as_tuple(index_meta), std::forward_as_tuple())
-            .first;
-    it->second.reserve(80);
-  }
+// 清除牺牲者标记，返回事务是否被选中过
+bool LockManager::take_victim(txn_id_t txn_id) {
+  std::lock_guard lock(victim_latch_);
+  return victims_.erase(txn_id) != 0;
+}
 
-  if (it->second.find(lock_data_id) != it->second.end()) {
-    auto& lock_request_queue = it->second.at(lock_data_id);
-    for (auto& lock_request : lock_request_queue.request_queue_) {
-      // 如果锁请求队列上该事务已经有共享锁或更高级别的锁（X）了，加锁成功
-      // 得到锁，S 或 X 且不存在间隙冲突 通过
-      // 没得到锁，阻塞，不可能执行到这里
-      if (lock_request.txn_id_ == txn->get_transaction_id()) {
-        // 事务能执行到这里，要么第一次申请，要么等待结束了，拿到锁了
-        assert(lock_request.granted_);
-        return true;
+/**
+ * @description: 在队列的cv上等待pred成立，真正阻塞时把次数和时间记到本线程的执行统计和lock_data_id的等待统计中。
+ * 检测死锁时被选为牺牲者的事务放弃等待：撤销自己在队列中的请求后抛出异常回滚。
+ * 醒来时pred已经成立的牺牲者照常拿到锁，它不再等待，环已经不存在了。
+ * 等待的语句被KILL或者超时时同样撤销请求后抛出异常，每隔LOCK_WAIT_CANCEL_POLL_MS检查一次
+ * @param {unique_lock&} ul 持有队列所在分片的latch，抛出异常前release，latch由调用者的lock_guard释放
+ */
+template <typename Pred>
+void LockManager::wait_for_lock(Transaction* txn,
+                                const LockDataId& lock_data_id,
+                                LockRequestQueue& queue,
+                                std::unique_lock<std::mutex>& ul, Pred pred) {
+  if (pred()) {
+    return;
+  }
+  txn_id_t txn_id = txn->get_transaction_id();
+  auto start = std::chrono::steady_clock::now();
+  RMDB_PROBE(lock__wait__start, txn_id, static_cast<int>(lock_data_id.type_));
+  ++num_waiting_;
+  auto woken = [&]() { return pred() || is_victim(txn_id); };
+  StatementCancel* statement = StatementCancel::current();
+  AbortReason reason = AbortReason::DEADLOCK_DETECTED;
+  bool cancelled = false;
+  if (statement == nullptr) {
+    queue.cv_.wait(ul, woken);
+  } else {
+    while (!queue.cv_.wait_for(
+        ul, std::chrono::milliseconds(LOCK_WAIT_CANCEL_POLL_MS), woken)) {
+      if (statement->cancelled(&reason)) {
+        cancelled = true;
+        break;
       }
     }
+  }
+  --num_waiting_;
+  uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  RMDB_PROBE(lock__wait__done, txn_id, static_cast<int>(lock_data_id.type_), wait_us);
+  auto& stats = thread_exec_stats();
+  ++stats.lock_waits;
+  stats.lock_wait_us += wait_us;
+  bool victim = take_victim(txn_id);
+  if (pred() || (!victim && !cancelled)) {
+    add_wait_stats(lock_data_id, {1, wait_us, 0, 0});
+    return;
+  }
+  add_wait_stats(lock_data_id, {1, wait_us, 0, victim ? 1u : 0u});
 
-    // 发生冲突
-    if (lock_request_queue.group_lock_mode_ == GroupLockMode::X) {
-      // delete 算子
-      // 阻塞等待
+  auto& request_queue = queue.request_queue_;
+  for (auto it = request_queue.begin(); it != request_queue.end(); ++it) {
+    if (it->txn_id_ == txn_id && !it->granted_) {
+      request_queue.erase(it);
+      break;
+    }
+  }
+  refresh_queue(queue);
+  queue.cv_.notify_all();
+  ul.release();
+  throw TransactionAbortException(
+      txn_id, victim ? AbortReason::DEADLOCK_DETECTED : reason);
+}
 
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
-        throw TransactionAbortException(txn->get_transaction_id(),
-                                        AbortReason::DEADLOCK_PREVENTION);
+void LockManager::add_wait_stats(const LockDataId& lock_data_id,
+                                 const LockWaitStats& delta) {
+  std::lock_guard lock(stats_latch_);
+  auto& stats = wait_stats_[{lock_data_id.fd_, lock_data_id.type_}];
+  stats.waits += delta.waits;
+  stats.wait_us += delta.wait_us;
+  stats.dies += delta.dies;
+  stats.deadlocks += delta.deadlocks;
+}
+
+void LockManager::get_locks(std::vector<LockInfo>& locks) {
+  locks.clear();
+  for (auto& shard : shards_) {
+    std::lock_guard lock(shard.latch_);
+    for (auto& [lock_data_id, queue] : shard.lock_table_) {
+      for (auto& request : queue.request_queue_) {
+        locks.push_back(
+            {lock_data_id, request.txn_id_,
+             GroupLockModeStr[static_cast<int>(request.lock_mode_) + 1].c_str(),
+             request.granted_});
       }
+    }
+  }
+}
 
-      lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
-      lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                     LockMode::SHARED);
-      std::unique_lock ul(latch_, std::adopt_lock);
-      auto cur = lock_request_queue.request_queue_.begin();
-      // 通过条件：当前请求队列只有共享间隙锁且相交区间不存在 X 锁
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur, &it,
-                                       &lock_data_id]() {
-        for (auto it_ = lock_request_queue.request_queue_.begin();
-             it_ != lock_request_queue.request_queue_.end(); ++it_) {
-          if (it_->txn_id_ != txn->get_transaction_id()) {
-            if (it_->lock_mode_ == LockMode::EXCLUSIVE && it_->granted_) {
-              return false;
-            }
-          } else {
-            cur = it_;
-          }
-        }
+void LockManager::get_wait_stats(
+    std::vector<std::pair<std::pair<int, LockDataType>, LockWaitStats>>&
+        stats) {
+  std::lock_guard lock(stats_latch_);
+  stats.assign(wait_stats_.begin(), wait_stats_.end());
+}
 
-        bool contain_X = false;
-        for (auto& [data_id, queue] : it->second) {
-          if (queue.group_lock_mode_ == GroupLockMode::X &&
-              lock_data_id.gap_.isCoincide(data_id.gap_)) {
-            bool is_only_txn = true;
-            for (auto& req : queue.request_queue_) {
-              if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-                is_only_txn = false;
-                break;
-              }
-            }
-            if (!is_only_txn) {
-              contain_X = true;
-              break;
-            }
-          }
+/**
+ * @description: 检查等待图中的环。同时持有所有分片的latch，得到锁表在同一时刻的等待关系：
+ * 等待中的请求指向同一队列中排在它前面、或者已经授予的不相容的请求。
+ * 按事务id从小到大深度优先找环，回滚环中最年轻（id最大）的事务，从图中删去后继续找，直到没有环
+ */
+void LockManager::detect_deadlocks() {
+  if (num_waiting_.load() == 0) {
+    return;
+  }
+  std::vector<std::unique_lock<std::mutex>> latches;
+  latches.reserve(shards_.size());
+  for (auto& shard : shards_) {
+    latches.emplace_back(shard.latch_);
+  }
+
+  std::map<txn_id_t, std::vector<txn_id_t>> waits_for;
+  std::unordered_map<txn_id_t, LockRequestQueue*> waiting_on;
+  for (auto& shard : shards_) {
+    for (auto& [lock_data_id, queue] : shard.lock_table_) {
+      auto& request_queue = queue.request_queue_;
+      for (auto waiter = request_queue.begin(); waiter != request_queue.end();
+           ++waiter) {
+        if (waiter->granted_) {
+          continue;
         }
-        return !contain_X;
-      });
-      cur->granted_ = true;
-      lock_request_queue.group_lock_mode_ = GroupLockMode::S;
-      ++lock_request_queue.shared_lock_num_;
-      txn->get_lock_set()->emplace(lock_data_id);
-      lock_request_queue.cv_.notify_all();
-      ul.release();
-      return true;
-    }
-  } else {
-    bool contain_X = false;
-    for (auto& [data_id, queue] : it->second) {
-      if (queue.group_lock_mode_ == GroupLockMode::X &&
-          lock_data_id.gap_.isCoincide(data_id.gap_)) {
-        bool is_only_txn = true;
-        for (auto& req : queue.request_queue_) {
-          if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-            is_only_txn = false;
-            break;
+        waiting_on[waiter->txn_id_] = &queue;
+        auto& edges = waits_for[waiter->txn_id_];
+        bool before = true;
+        for (auto holder = request_queue.begin();
+             holder != request_queue.end(); ++holder) {
+          if (holder == waiter) {
+            before = false;
+            continue;
           }
-        }
-        if (!is_only_txn) {
-          // wait-die 策略死锁预防，否则会死锁，而且题八会卡在幻读4测试点
-          if (txn->get_transaction_id() > queue.oldest_txn_id_) {
-            throw TransactionAbortException(txn->get_transaction_id(),
-                                            AbortReason::DEADLOCK_PREVENTION);
+          if (holder->txn_id_ != waiter->txn_id_ &&
+              (before || holder->granted_) &&
+              !compatible(holder->lock_mode_, waiter->lock_mode_)) {
+            edges.push_back(holder->txn_id_);
           }
-          contain_X = true;
-          break;
         }
       }
     }
+  }
 
-    it->second.emplace(std::piecewise_construct,
-                       std::forward_as_tuple(lock_data_id),
-                       std::forward_as_tuple());
-
-    if (contain_X) {
-      auto& lock_request_queue = it->second.at(lock_data_id);
-      lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
-      lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                     LockMode::SHARED);
-      std::unique_lock ul(latch_, std::adopt_lock);
-      auto cur = lock_request_queue.request_queue_.begin();
-      // 通过条件：当前请求队列只有共享间隙锁且相交区间不存在 X 锁
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur, &it,
-                                       &lock_data_id]() {
-        for (auto it_ = lock_request_queue.request_queue_.begin();
-             it_ != lock_request_queue.request_queue_.end(); ++it_) {
-          if (it_->txn_id_ != txn->get_transaction_id()) {
-            if (it_->lock_mode_ == LockMode::EXCLUSIVE && it_->granted_) {
-              return false;
-            }
-          } else {
-            cur = it_;
+  while (true) {
+    // 0: 未访问，1: 在当前路径上，2: 从它出发没有环
+    std::unordered_map<txn_id_t, int> state;
+    std::vector<txn_id_t> path;
+    txn_id_t victim = INVALID_TXN_ID;
+    std::function<bool(txn_id_t)> dfs = [&](txn_id_t txn_id) {
+      state[txn_id] = 1;
+      path.push_back(txn_id);
+      auto it = waits_for.find(txn_id);
+      if (it != waits_for.end()) {
+        auto next = it->second;
+        std::sort(next.begin(), next.end());
+        for (txn_id_t to : next) {
+          if (state[to] == 1) {
+            // 环是路径上从to开始的部分
+            auto begin = std::find(path.begin(), path.end(), to);
+            victim = *std::max_element(begin, path.end());
+            return true;
           }
-        }
-
-        bool contain_X = false;
-        for (auto& [data_id, queue] : it->second) {
-          if (queue.group_lock_mode_ == GroupLockMode::X &&
-              lock_data_id.gap_.isCoincide(data_id.gap_)) {
-            bool is_only_txn = true;
-            for (auto& req : queue.request_queue_) {
-              if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-                is_only_txn = false;
-                break;
-              }
-            }
-            if (!is_only_txn) {
-              contain_X = true;
-              break;
-            }
+          if (state[to] == 0 && dfs(to)) {
+            return true;
           }
         }
-        return !contain_X;
-      });
-      cur->granted_ = true;
-      lock_request_queue.group_lock_mode_ = GroupLockMode::S;
-      ++lock_request_queue.shared_lock_num_;
-      txn->get_lock_set()->emplace(lock_data_id);
-      lock_request_queue.cv_.notify_all();
-      ul.release();
-      return true;
+      }
+      state[txn_id] = 2;
+      path.pop_back();
+      return false;
+    };
+    for (auto& [txn_id, edges] : waits_for) {
+      if (state[txn_id] == 0 && dfs(txn_id)) {
+        break;
+      }
+    }
+    if (victim == INVALID_TXN_ID) {
+      break;
     }
+    waits_for.erase(victim);
+    for (auto& [txn_id, edges] : waits_for) {
+      edges.erase(std::remove(edges.begin(), edges.end(), victim), edges.end());
+    }
+    {
+      std::lock_guard lock(victim_latch_);
+      victims_.insert(victim);
+    }
+    waiting_on[victim]->cv_.notify_all();
   }
+}
 
-  auto& lock_request_queue = it->second.at(lock_data_id);
-
-  // 每次事务申请锁都要更新最老事务id
-  if (txn->get_transaction_id() < lock_request_queue.oldest_txn_id_) {
-    lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
+// 加锁阶段检查
+static inline bool check_lock(Transaction* txn) {
+  auto& txn_state = txn->get_state();
+  // 事务结束，不能再获取锁
+  if (txn_state == TransactionState::COMMITTED ||
+      txn_state == TransactionState::ABORTED) {
+    return false;
+  }
+  // 两阶段锁，收缩阶段不允许加锁
+  if (txn_state == TransactionState::SHRINKING) {
+    throw TransactionAbortException(txn->get_transaction_id(),
+                                    AbortReason::LOCK_ON_SHIRINKING);
+  }
+  // 没加过锁，更新事务为增长状态，开始两阶段锁第一阶段
+  if (txn_state == TransactionState::DEFAULT) {
+    txn_state = TransactionState::GROWING;
   }
-
-  // 将当前事务锁请求加到锁请求队列中
-  lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                 LockMode::SHARED, true);
-  // 更新锁请求队列锁模式为共享锁
-  lock_request_queue.group_lock_mode_ = GroupLockMode::S;
-  ++lock_request_queue.shared_lock_num_;
-  txn->get_lock_set()->emplace(lock_data_id);
   return true;
 }
-
-// insert 和 delete 算子会调用
 /**
- * @description: 申请间隙锁
+ * @description: 申请索引上的键区间锁。间隙用它上界的索引条目（next key）的rid标识，和行锁一样在分片的锁表中按哈希查找。
+ * 扫描锁住间隙用SHARED，插入之前对新key后面的间隙申请插入意向锁INTENTION_EXCLUSIVE：
+ * 同种之间相容（多个扫描、多个插入可以同时进行），扫描和插入互斥，冲突时按wait-die等待或回滚
  * @return {bool} 加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
- * @param {Rmcord&} rid 加锁的间隙下限记录
- * @param {Rmcord&} rid 加锁的间隙上限记录
- * @param {int} tab_fd
+ * @param {LockDataId&} lock_data_id 间隙
+ * @param {LockMode} lock_mode SHARED或INTENTION_EXCLUSIVE
  */
-bool LockManager::lock_exclusive_on_gap(Transaction* txn, IndexMeta& index_meta,
-                                        Gap& gap, int tab_fd) {
-  std::lock_guard lock(latch_);
+bool LockManager::lock_on_gap(Transaction* txn, const LockDataId& lock_data_id,
+                              LockMode lock_mode) {
+  if (is_lock_free(lock_data_id.fd_)) {
+    return true;
+  }
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
 
   if (!check_lock(txn)) {
     return false;
   }
 
-  LockDataId lock_data_id(tab_fd, index_meta, gap, LockDataType::GAP);
-  auto it = gap_lock_table_.find(index_meta);
-  if (it == gap_lock_table_.end()) {
-    // 新建
-    it =
-        gap_lock_table_
-            .emplace(std::piecewise_construct,
-                     std::forward_as_tuple(index_meta), std::forward_as_tuple())
-            .first;
-    it->second.reserve(80);
-  }
-
-  bool contain = false;
-  // 检查索引上是否存在互斥的相交区间
-  // 独占锁只要有区间相交就得等待
-  for (auto& [data_id, queue] : it->second) {
-    if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-      // 注意参数里的 gap 已经被移动了，是 lock_data_id.gap_
-      if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-        bool is_only_txn = true;
-        for (auto& req : queue.request_queue_) {
-          if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-            is_only_txn = false;
-            break;
-          }
-        }
-        if (!is_only_txn) {
-          // TODO 如果不过题八，不必回滚提高并发度
-          if (txn->get_transaction_id() > queue.oldest_txn_id_) {
-            throw TransactionAbortException(txn->get_transaction_id(),
-                                            AbortReason::DEADLOCK_PREVENTION);
-          }
-          contain = true;
-          break;
-        }
-      }
-    }
+  auto it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
+             .emplace(std::piecewise_construct,
+                      std::forward_as_tuple(lock_data_id),
+                      std::forward_as_tuple())
+             .first;
   }
+  auto& lock_request_queue = it->second;
+  txn_id_t txn_id = txn->get_transaction_id();
 
-  if (it->second.find(lock_data_id) != it->second.end()) {
-    auto& lock_request_queue = it->second.at(lock_data_id);
-    for (auto& lock_request : lock_request_queue.request_queue_) {
-      // 如果锁请求队列上该事务已经有共享锁或更高级别的锁（X）了，加锁成功
-      if (lock_request.txn_id_ == txn->get_transaction_id()) {
-        assert(lock_request.granted_);
-        // 有间隙 X 锁
-        if (lock_request.lock_mode_ == LockMode::EXCLUSIVE) {
-          return true;
-        }
-
-        assert(lock_request.lock_mode_ == LockMode::SHARED);
-
-        // 有间隙 S 锁，且队列中只有自己拿到 X 锁
-        if (lock_request_queue.shared_lock_num_ == 1 && !contain) {
-          lock_request.lock_mode_ = LockMode::EXCLUSIVE;
-          lock_request_queue.shared_lock_num_ = 0;
-          lock_request_queue.group_lock_mode_ = GroupLockMode::X;
-          return true;
-        }
-
-        // throw TransactionAbortException(txn->get_transaction_id(),
-        // AbortReason::DEADLOCK_PREVENTION);
-
-        if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
-          throw TransactionAbortException(txn->get_transaction_id(),
-                                          AbortReason::DEADLOCK_PREVENTION);
-        }
-
-        lock_request.granted_ = false;
-        lock_request.lock_mode_ = LockMode::EXCLUSIVE;
-
-        lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
-        // lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-        // LockMode::EXCLUSIVE);
-
-        std::unique_lock ul(latch_, std::adopt_lock);
-        auto cur = lock_request_queue.request_queue_.begin();
-        // 通过条件：当前请求之前没有任何已授权的请求并且不存在相交区间
-        lock_request_queue.cv_.wait(
-            ul, [&lock_request_queue, txn, &cur, &it, &lock_data_id]() {
-              for (auto it_ = lock_request_queue.request_queue_.begin();
-                   it_ != lock_request_queue.request_queue_.end(); ++it_) {
-                if (it_->txn_id_ != txn->get_transaction_id()) {
-                  if (it_->granted_) {
-                    return false;
-                  }
-                } else {
-                  cur = it_;
-                }
-              }
-
-              bool contain = false;
-              for (auto& [data_id, queue] : it->second) {
-                if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-                  if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-                    bool is_only_txn = true;
-                    for (auto& req : queue.request_queue_) {
-                      if (req.txn_id_ != txn->get_transaction_id() &&
-                          req.granted_) {
-                        is_only_txn = false;
-                        break;
-                      }
-                    }
-                    if (!is_only_txn) {
-                      contain = true;
-                      break;
-                    }
-                  }
-                }
-              }
-              return !contain;
-            });
-        cur->granted_ = true;
-        lock_request_queue.group_lock_mode_ = GroupLockMode::X;
-        txn->get_lock_set()->emplace(lock_data_id);
-        ul.release();
+  // 其他事务已经拿到的另一种锁
+  auto conflicts = [&lock_request_queue, txn_id, lock_mode]() {
+    for (auto& request : lock_request_queue.request_queue_) {
+      if (request.txn_id_ != txn_id && request.granted_ &&
+          request.lock_mode_ != lock_mode) {
         return true;
       }
     }
+    return false;
+  };
 
-    if (lock_request_queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-      // insert/delete 算子
-      // 阻塞等待
-
-      // throw TransactionAbortException(txn->get_transaction_id(),
-      // AbortReason::DEADLOCK_PREVENTION);
-
-      // TODO 间隙相交的队列要检查吗？不检查过不了题八
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
-        throw TransactionAbortException(txn->get_transaction_id(),
-                                        AbortReason::DEADLOCK_PREVENTION);
-      }
-
-      lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
-      lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                     LockMode::EXCLUSIVE);
-
-      std::unique_lock ul(latch_, std::adopt_lock);
-      auto cur = lock_request_queue.request_queue_.begin();
-      // 通过条件：当前请求之前没有任何已授权的请求并且不存在相交区间
-      // 后面没有通过的 S 锁
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur, &it,
-                                       &lock_data_id]() {
-        for (auto it_ = lock_request_queue.request_queue_.begin();
-             it_ != lock_request_queue.request_queue_.end(); ++it_) {
-          if (it_->txn_id_ != txn->get_transaction_id()) {
-            if (it_->granted_) {
-              return false;
-            }
-          } else {
-            cur = it_;
-          }
-        }
-
-        bool contain = false;
-        for (auto& [data_id, queue] : it->second) {
-          if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-            if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-              bool is_only_txn = true;
-              for (auto& req : queue.request_queue_) {
-                if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-                  is_only_txn = false;
-                  break;
-                }
-              }
-              if (!is_only_txn) {
-                contain = true;
-                break;
-              }
-            }
-          }
-        }
-        return !contain;
-      });
-      cur->granted_ = true;
-      lock_request_queue.group_lock_mode_ = GroupLockMode::X;
-      txn->get_lock_set()->emplace(lock_data_id);
-      ul.release();
+  for (auto& request : lock_request_queue.request_queue_) {
+    if (request.txn_id_ == txn_id && request.lock_mode_ == lock_mode) {
+      assert(request.granted_);
       return true;
     }
-  } else {
-    it->second.emplace(std::piecewise_construct,
-                       std::forward_as_tuple(lock_data_id),
-                       std::forward_as_tuple());
-    if (contain) {
-      auto& lock_request_queue = it->second.at(lock_data_id);
-      lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
-      lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                     LockMode::EXCLUSIVE);
-      std::unique_lock ul(latch_, std::adopt_lock);
-      auto cur = lock_request_queue.request_queue_.begin();
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur, &it,
-                                       &lock_data_id]() {
-        for (auto it_ = lock_request_queue.request_queue_.begin();
-             it_ != lock_request_queue.request_queue_.end(); ++it_) {
-          if (it_->txn_id_ != txn->get_transaction_id()) {
-            if (it_->granted_) {
-              return false;
-            }
-          } else {
-            cur = it_;
-          }
-        }
+  }
 
-        bool contain = false;
-        for (auto& [data_id, queue] : it->second) {
-          if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-            if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-              bool is_only_txn = true;
-              for (auto& req : queue.request_queue_) {
-                if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-                  is_only_txn = false;
-                  break;
-                }
-              }
-              if (!is_only_txn) {
-                contain = true;
-                break;
-              }
-            }
-          }
-        }
-        return !contain;
-      });
-      cur->granted_ = true;
-      lock_request_queue.group_lock_mode_ = GroupLockMode::X;
-      txn->get_lock_set()->emplace(lock_data_id);
-      ul.release();
-      return true;
+  if (!conflicts()) {
+    lock_request_queue.request_queue_.emplace_back(txn_id, lock_mode, true);
+  } else {
+    if (should_die(txn_id, lock_data_id, lock_request_queue)) {
+      throw TransactionAbortException(txn_id, AbortReason::DEADLOCK_PREVENTION);
     }
+    lock_request_queue.request_queue_.emplace_back(txn_id, lock_mode);
+    auto cur = std::prev(lock_request_queue.request_queue_.end());
+    std::unique_lock ul(shard.latch_, std::adopt_lock);
+    wait_for_lock(txn, lock_data_id, lock_request_queue, ul,
+                  [&conflicts]() { return !conflicts(); });
+    cur->granted_ = true;
+    ul.release();
   }
 
-  auto& lock_request_queue = it->second.at(lock_data_id);
-
-  // 每次事务申请锁都要更新最老事务id
-  if (txn->get_transaction_id() < lock_request_queue.oldest_txn_id_) {
-    lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
+  // 拿到锁之后再计数，等待中的请求不计入
+  if (txn_id < lock_request_queue.oldest_txn_id_) {
+    lock_request_queue.oldest_txn_id_ = txn_id;
   }
-
-  // 将当前事务锁请求加到锁请求队列中
-  lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                 LockMode::EXCLUSIVE, true);
-  // 更新锁请求队列锁模式为 X 锁
-  lock_request_queue.group_lock_mode_ = GroupLockMode::X;
+  if (lock_mode == LockMode::SHARED) {
+    ++lock_request_queue.shared_lock_num_;
+  } else {
+    ++lock_request_queue.IX_lock_num_;
+  }
+  lock_request_queue.group_lock_mode_ = static_cast<GroupLockMode>(
+      std::max(static_cast<int>(lock_mode) + 1,
+               static_cast<int>(lock_request_queue.group_lock_mode_)));
   txn->get_lock_set()->emplace(lock_data_id);
   return true;
 }
 
-// insert 算子会调用，但是上行锁
 /**
- * @description: 申请间隙锁
+ * @description: 扫描索引时锁住next_rid对应条目之前的间隙
+ * @param {int} ix_fd 索引文件的fd
+ * @param {Rid&} next_rid 间隙上界的索引条目的rid，扫描到索引末尾时为GAP_SUPREMUM
+ */
+bool LockManager::lock_shared_on_gap(Transaction* txn, int ix_fd,
+                                     const Rid& next_rid) {
+  return lock_on_gap(txn, LockDataId(ix_fd, next_rid, LockDataType::GAP),
+                     LockMode::SHARED);
+}
+
+/**
+ * @description: 插入key之前申请它所在间隙（next_rid对应条目之前）的插入意向锁，持有到事务结束
+ * @param {int} ix_fd 索引文件的fd
+ * @param {Rid&} next_rid 第一个比key大的索引条目的rid，没有时为GAP_SUPREMUM
+ */
+bool LockManager::lock_insert_on_gap(Transaction* txn, int ix_fd,
+                                     const Rid& next_rid) {
+  return lock_on_gap(txn, LockDataId(ix_fd, next_rid, LockDataType::GAP),
+                     LockMode::INTENTION_EXCLUSIVE);
+}
+
+/**
+ * @description: 申请行级共享锁。先在表上加 IS 锁，表上的锁已经由锁升级换成 S 或 X 时不再加行锁；
+ * 事务在表上的行锁达到阈值时尝试升级为表锁
  * @return {bool} 加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
- * @param {Rmcord&} rid 加锁的间隙下限记录
- * @param {Rmcord&} rid 加锁的间隙上限记录
- * @param {int} tab_fd
+ * @param {Rid&} rid 加锁的目标记录ID
+ * @param {int} tab_fd 记录所在的表的fd
  */
-bool LockManager::isSafeInGap(Transaction* txn, IndexMeta& index_meta,
-                              RmRecord& record, int tab_fd) {
-  std::lock_guard lock(latch_);
-
-  // if (!check_lock(txn)) {
-  //     return false;
-  // }
+bool LockManager::lock_shared_on_record(Transaction* txn, const Rid& rid,
+                                        int tab_fd) {
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
+  auto& table = txn->get_table_locks()[tab_fd];
+  if (table.shared || table.exclusive) {
+    flush_increments(txn, tab_fd, &rid);
+    return true;
+  }
+  if (!table.intention_shared) {
+    if (!lock_IS_on_table(txn, tab_fd)) {
+      return false;
+    }
+    table.intention_shared = true;
+  }
+  // 乐观并发控制下显式事务读记录不加行锁，记下版本字到提交时验证；单条语句的事务在提交前已经返回了结果，照常加锁
+  auto& occ = txn->get_occ_state();
+  if (occ.enabled && txn->get_txn_mode() &&
+      OccManager::instance().read(txn, tab_fd, rid)) {
+    return true;
+  }
+  size_t num_locks = txn->get_lock_set()->size();
+  if (!request_shared_on_record(txn, rid, tab_fd)) {
+    return false;
+  }
+  if (txn->get_lock_set()->size() != num_locks &&
+      ++table.rows >= table.next_escalation) {
+    escalate(txn, tab_fd, table);
+  }
+  flush_increments(txn, tab_fd, &rid);
+  return true;
+}
 
-  auto it = gap_lock_table_.find(index_meta);
+/**
+ * @description: 申请行级排他锁。先在表上加 IX 锁，表上的锁已经由锁升级换成 X 时不再加行锁；
+ * 事务在表上的行锁达到阈值时尝试升级为表锁
+ * @return {bool} 加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {Rid&} rid 加锁的目标记录ID
+ * @param {int} tab_fd 记录所在的表的fd
+ */
+bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
+                                           int tab_fd) {
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
+  auto& table = txn->get_table_locks()[tab_fd];
+  if (table.exclusive) {
+    flush_increments(txn, tab_fd, &rid);
+    return true;
+  }
+  if (!table.intention_exclusive) {
+    if (!lock_IX_on_table(txn, tab_fd)) {
+      return false;
+    }
+    table.intention_shared = table.intention_exclusive = true;
+  }
+  size_t num_locks = txn->get_lock_set()->size();
+  if (!request_exclusive_on_record(txn, rid, tab_fd)) {
+    return false;
+  }
+  table.has_exclusive_rows = true;
+  if (txn->get_occ_state().enabled) {
+    OccManager::instance().write(txn, tab_fd, rid);
+  }
+  if (txn->get_lock_set()->size() != num_locks &&
+      ++table.rows >= table.next_escalation) {
+    escalate(txn, tab_fd, table);
+  }
+  flush_increments(txn, tab_fd, &rid);
+  return true;
+}
 
-  int wait = 0;
-  while (true) {
-    wait = 0;
-    if (it != gap_lock_table_.end()) {
-      // 独占锁只要有区间相交就得等待
-      for (auto& [data_id, queue] : it->second) {
-        if (data_id.gap_.isInGap(record)) {
-          bool is_only_txn = true;
-          for (auto& req : queue.request_queue_) {
-            if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-              is_only_txn = false;
-              break;
-            }
-          }
-          // 队列中没有其他事务取得锁，则当前事务一定拿到了锁（如果没拿到锁阻塞也不可能执行到这里），那么就可以插入
-          if (is_only_txn) {
-            continue;
-          }
+/**
+ * @description: 申请行级递增锁（记录上的IX），col = col + 常量的更新用。递增锁之间相容，和S、X互斥：
+ * 多个事务可以同时递增同一条记录，递增推迟到提交时才应用，见TransactionManager::apply_increments。
+ * 先在表上加 IX 锁，表上的锁已经由锁升级换成 X 时不再加行锁
+ * @return {bool} 加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {Rid&} rid 加锁的目标记录ID
+ * @param {int} tab_fd 记录所在的表的fd
+ */
+bool LockManager::lock_increment_on_record(Transaction* txn, const Rid& rid,
+                                           int tab_fd) {
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
+  auto& table = txn->get_table_locks()[tab_fd];
+  if (table.exclusive) {
+    return true;
+  }
+  if (!table.intention_exclusive) {
+    if (!lock_IX_on_table(txn, tab_fd)) {
+      return false;
+    }
+    table.intention_shared = table.intention_exclusive = true;
+  }
+  size_t num_locks = txn->get_lock_set()->size();
+  if (!lock_on_gap(txn, LockDataId(tab_fd, rid, LockDataType::RECORD),
+                   LockMode::INTENTION_EXCLUSIVE)) {
+    return false;
+  }
+  // 锁升级时换成表 X 锁
+  table.has_exclusive_rows = true;
+  if (txn->get_lock_set()->size() != num_locks &&
+      ++table.rows >= table.next_escalation) {
+    escalate(txn, tab_fd, table);
+  }
+  return true;
+}
 
-          // wait-die
-          if (txn->get_transaction_id() > queue.oldest_txn_id_) {
-            throw TransactionAbortException(txn->get_transaction_id(),
-                                            AbortReason::DEADLOCK_PREVENTION);
-          }
+/**
+ * @description: 快照读不加锁，也就不会触发应用推迟的递增。读之前给有递增的记录加 X 锁，
+ * 等其他事务在这些记录上的递增提交之后应用自己的递增，快照读才能看到自己的修改
+ * @param {int} tab_fd 要读的表的fd
+ */
+void LockManager::settle_increments(Transaction* txn, int tab_fd) {
+  std::vector<Rid> rids;
+  for (auto& pending : txn->get_pending_increments()) {
+    if (pending.fd == tab_fd) {
+      rids.push_back(pending.rid);
+    }
+  }
+  for (auto& rid : rids) {
+    lock_exclusive_on_record(txn, rid, tab_fd);
+  }
+}
 
-          ++wait;
-          std::unique_lock ul(latch_, std::adopt_lock);
-          auto&& cur = queue.request_queue_.begin();
-          // 通过条件：当前请求之前没有任何已授权的请求并且不存在相交区间
-          queue.cv_.wait(ul, [&queue, txn, &cur, &it, &record]() {
-            for (auto& req : queue.request_queue_) {
-              if (req.txn_id_ != txn->get_transaction_id() && req.granted_) {
-                return false;
-              }
-            }
-            return true;
-          });
-          ul.release();
-          break;
-        }
-      }
+/**
+ * @description: 锁升级：把事务在表上的意向锁换成表锁（持有过行 X 锁时为 X，否则为 S，原来是 IX 时为 SIX），
+ * 再释放表上的行锁。只在其他事务的锁都和新的表锁相容时升级，不等待也不回滚；
+ * 不能升级时等行锁再多一个阈值时重试
+ * @param {TableLockState&} table 事务在表上的锁
+ */
+void LockManager::escalate(Transaction* txn, int tab_fd,
+                           TableLockState& table) {
+  txn_id_t txn_id = txn->get_transaction_id();
+  LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
+  {
+    auto& shard = get_shard(lock_data_id);
+    std::lock_guard lock(shard.latch_);
+    auto it = shard.lock_table_.find(lock_data_id);
+    if (it == shard.lock_table_.end()) {
+      return;
     }
-    if (wait == 0) {
-      auto predicate_manager = PredicateManager(index_meta);
-
-      // 手动写个 cond index_col = val
-      std::vector<Condition> conds(index_meta.cols.size());
-      int idx = 0;
-      for (auto& [index_offset, col_meta] : index_meta.cols) {
-        Value v;
-        v.raw = std::make_shared<RmRecord>(record.data + col_meta.offset,
-                                           col_meta.len);
-        switch (col_meta.type) {
-          case TYPE_INT: {
-            v.set_int(*reinterpret_cast<int*>(v.raw->data));
-            break;
-          }
-          case TYPE_FLOAT: {
-            v.set_float(*reinterpret_cast<float*>(v.raw->data));
-            break;
-          }
-          case TYPE_STRING: {
-            std::string s(v.raw->data, v.raw->size);
-            v.set_str(s);
-            break;
-          }
-        }
-        conds[idx].op = OP_EQ;
-        conds[idx].lhs_col = {"", col_meta.name};
-        conds[idx].rhs_val = std::move(v);
-        ++idx;
-      }
-      for (auto& cond : conds) {
-        predicate_manager.addPredicate(cond.lhs_col.col_name, cond);
+    auto& queue = it->second;
+    LockRequest* own = nullptr;
+    for (auto& request : queue.request_queue_) {
+      if (request.txn_id_ == txn_id && request.granted_) {
+        own = &request;
+        break;
       }
-
-      auto gap = Gap(predicate_manager.getIndexConds());
-
-      LockDataId lock_data_id(tab_fd, index_meta, gap, LockDataType::GAP);
-      auto it_ = gap_lock_table_.find(index_meta);
-      if (it_ == gap_lock_table_.end()) {
-        // 新建
-        it_ = gap_lock_table_
-                  .emplace(std::piecewise_construct,
-                           std::forward_as_tuple(index_meta),
-                           std::forward_as_tuple())
-                  .first;
-        it_->second.reserve(80);
+    }
+    if (own == nullptr) {
+      return;
+    }
+    LockMode old_mode = own->lock_mode_;
+    LockMode mode = LockMode::SHARED;
+    if (old_mode == LockMode::EXCLUSIVE || table.has_exclusive_rows) {
+      mode = LockMode::EXCLUSIVE;
+    } else if (old_mode == LockMode::INTENTION_EXCLUSIVE ||
+               old_mode == LockMode::S_IX) {
+      mode = LockMode::S_IX;
+    }
+    for (auto& request : queue.request_queue_) {
+      if (request.txn_id_ != txn_id && !compatible(request.lock_mode_, mode)) {
+        table.next_escalation += LOCK_ESCALATION_THRESHOLD;
+        return;
       }
-
-      // 这里实际上是加了一层唯一索引校验，如果两个事务同时插入一样的数据，即使过了第一层校验，也有可能两事务同时拿到这行的间隙锁
-      // 那么其中另外一个应该不满足索引一致性而抛出异常，其实也可以先申请行间隙锁，再校验唯一索引，但是这样如果不满足唯一索引不能立即返回了
-      // 按照 mysql 8.0 的实现，抛出异常
-      if (!it_->second
-               .emplace(std::piecewise_construct,
-                        std::forward_as_tuple(lock_data_id),
-                        std::forward_as_tuple())
-               .second) {
-        return false;
-        // throw NonUniqueIndexError(index_meta.tab_name, {});
+    }
+    own->lock_mode_ = mode;
+    // 和unlock对各种模式的计数保持一致
+    auto count = [&queue](LockMode lock_mode, int delta) {
+      if (lock_mode == LockMode::SHARED || lock_mode == LockMode::S_IX) {
+        queue.shared_lock_num_ += delta;
       }
-
-      auto& lock_request_queue = it_->second.at(lock_data_id);
-
-      // 每次事务申请锁都要更新最老事务id
-      if (txn->get_transaction_id() < lock_request_queue.oldest_txn_id_) {
-        lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
+      if (lock_mode == LockMode::INTENTION_EXCLUSIVE ||
+          lock_mode == LockMode::S_IX) {
+        queue.IX_lock_num_ += delta;
       }
+    };
+    count(old_mode, -1);
+    count(own->lock_mode_, 1);
+    refresh_queue(queue);
+    table.shared = true;
+    table.exclusive = own->lock_mode_ == LockMode::EXCLUSIVE;
+  }
 
-      // 将当前事务锁请求加到锁请求队列中
-      lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
-                                                     LockMode::EXCLUSIVE, true);
-      // 更新锁请求队列锁模式为 X 锁
-      lock_request_queue.group_lock_mode_ = GroupLockMode::X;
-      txn->get_lock_set()->emplace(lock_data_id);
-      break;
+  auto& lock_set = *txn->get_lock_set();
+  for (auto it = lock_set.begin(); it != lock_set.end();) {
+    if (it->type_ == LockDataType::RECORD && it->fd_ == tab_fd) {
+      release(txn_id, *it);
+      it = lock_set.erase(it);
+    } else {
+      ++it;
     }
   }
-  return true;
+  table.rows = 0;
 }
 
 /**
- * @description: 申请行级共享锁
+ * @description: 在锁表中申请行级共享锁
  * @return {bool} 加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
  * @param {Rid&} rid 加锁的目标记录ID 记录所在的表的fd
  * @param {int} tab_fd
  */
-bool LockManager::lock_shared_on_record(Transaction* txn, const Rid& rid,
-                                        int tab_fd) {
-  std::lock_guard lock(latch_);
+bool LockManager::request_shared_on_record(Transaction* txn, const Rid& rid,
+                                           int tab_fd) {
+  LockDataId lock_data_id(tab_fd, rid, LockDataType::RECORD);
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
 
   if (!check_lock(txn)) {
     return false;
   }
 
-  LockDataId lock_data_id(tab_fd, rid, LockDataType::RECORD);
-  auto&& it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto&& it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
@@ -655,8 +620,10 @@ bool LockManager::lock_shared_on_record(Transaction* txn, const Rid& rid,
   } else {
     auto& lock_request_queue = it->second;
     for (auto& lock_request : lock_request_queue.request_queue_) {
-      // 如果锁请求队列上该事务已经有共享锁或更高级别的锁（X）了，加锁成功
-      if (lock_request.txn_id_ == txn->get_transaction_id()) {
+      // 如果锁请求队列上该事务已经有共享锁或更高级别的锁（X）了，加锁成功；
+      // 只有递增锁（IX）时还要等其他事务的递增结束，读到的才是已提交的值
+      if (lock_request.txn_id_ == txn->get_transaction_id() &&
+          lock_request.lock_mode_ != LockMode::INTENTION_EXCLUSIVE) {
         // 事务能执行到这里，要么第一次申请，要么等待结束了，拿到锁了
         assert(lock_request.granted_);
         return true;
@@ -672,33 +639,30 @@ bool LockManager::lock_shared_on_record(Transaction* txn, const Rid& rid,
     //     AbortReason::DEADLOCK_PREVENTION);
     // }
 
-    // 第一次申请，检查锁队列中有没有冲突的事务
+    // 第一次申请，检查锁队列中有没有冲突的事务：X锁，以及其他事务的递增锁（IX）。
+    // 自己也有递增锁时队列的锁模式是IX，不能只看锁模式
     // Check for conflicting locks and apply wait-die logic
-    if (lock_request_queue.group_lock_mode_ == GroupLockMode::X ||
-        lock_request_queue.group_lock_mode_ == GroupLockMode::IX ||
-        lock_request_queue.group_lock_mode_ == GroupLockMode::SIX) {
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+    auto conflicts = [&lock_request_queue, txn]() {
+      for (auto& request : lock_request_queue.request_queue_) {
+        if (request.txn_id_ != txn->get_transaction_id() && request.granted_ &&
+            !compatible(request.lock_mode_, LockMode::SHARED)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    if (conflicts()) {
+      if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
         throw TransactionAbortException(txn->get_transaction_id(),
                                         AbortReason::DEADLOCK_PREVENTION);
       }
       lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
       lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                      LockMode::SHARED);
-      std::unique_lock ul(latch_, std::adopt_lock);
-      auto cur = lock_request_queue.request_queue_.begin();
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
-        for (auto it = lock_request_queue.request_queue_.begin();
-             it != lock_request_queue.request_queue_.end(); ++it) {
-          if (it->txn_id_ != txn->get_transaction_id()) {
-            if (it->lock_mode_ == LockMode::EXCLUSIVE && it->granted_) {
-              return false;
-            }
-          } else {
-            cur = it;
-          }
-        }
-        return true;
-      });
+      std::unique_lock ul(shard.latch_, std::adopt_lock);
+      auto cur = std::prev(lock_request_queue.request_queue_.end());
+      wait_for_lock(txn, lock_data_id, lock_request_queue, ul,
+                    [&conflicts]() { return !conflicts(); });
       cur->granted_ = true;
       lock_request_queue.group_lock_mode_ = static_cast<GroupLockMode>(
           std::max(static_cast<int>(GroupLockMode::S),
@@ -721,60 +685,67 @@ bool LockManager::lock_shared_on_record(Transaction* txn, const Rid& rid,
   // 将当前事务锁请求加到锁请求队列中
   lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                  LockMode::SHARED, true);
-  // 更新锁请求队列锁模式为共享锁
-  lock_request_queue.group_lock_mode_ = GroupLockMode::S;
+  // 更新锁请求队列锁模式，至少为共享锁
+  lock_request_queue.group_lock_mode_ = static_cast<GroupLockMode>(
+      std::max(static_cast<int>(GroupLockMode::S),
+               static_cast<int>(lock_request_queue.group_lock_mode_)));
   ++lock_request_queue.shared_lock_num_;
   txn->get_lock_set()->emplace(lock_data_id);
   return true;
 }
 
 /**
- * @description: 申请行级排他锁
+ * @description: 在锁表中申请行级排他锁
  * @return {bool} 加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
  * @param {Rid&} rid 加锁的目标记录ID
  * @param {int} tab_fd 记录所在的表的fd
  */
-bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
-                                           int tab_fd) {
-  std::lock_guard lock(latch_);
+bool LockManager::request_exclusive_on_record(Transaction* txn, const Rid& rid,
+                                              int tab_fd) {
+  LockDataId lock_data_id(tab_fd, rid, LockDataType::RECORD);
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
 
   if (!check_lock(txn)) {
     return false;
   }
 
-  LockDataId lock_data_id(tab_fd, rid, LockDataType::RECORD);
-  auto&& it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto&& it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
              .first;
   } else {
     auto& lock_request_queue = it->second;
+    // 该事务上的锁请求队列上已经有互斥锁了，加锁成功
     for (auto& lock_request : lock_request_queue.request_queue_) {
-      // 该事务上的锁请求队列上已经有互斥锁了，加锁成功
+      if (lock_request.txn_id_ == txn->get_transaction_id() &&
+          lock_request.lock_mode_ == LockMode::EXCLUSIVE) {
+        assert(lock_request.granted_);
+        return true;
+      }
+    }
+    for (auto& lock_request : lock_request_queue.request_queue_) {
+      // 已经有共享锁或递增锁（IX），升级写锁
       if (lock_request.txn_id_ == txn->get_transaction_id()) {
         assert(lock_request.granted_);
-        if (lock_request.lock_mode_ == LockMode::EXCLUSIVE) {
-          return true;
-        }
-        // 如果当前记录没有其他事务在读，升级写锁
-        if (lock_request.lock_mode_ == LockMode::SHARED &&
-            lock_request_queue.request_queue_.size() == 1) {
+        // 如果当前记录没有其他事务在读或递增，直接升级
+        if (lock_request_queue.request_queue_.size() == 1) {
           lock_request.lock_mode_ = LockMode::EXCLUSIVE;
           lock_request_queue.group_lock_mode_ = GroupLockMode::X;
           lock_request_queue.shared_lock_num_ = 0;
+          lock_request_queue.IX_lock_num_ = 0;
           return true;
         }
 
-        assert(lock_request.lock_mode_ == LockMode::SHARED);
         // 整个队列的时间戳不一定严格降序，需比较其中最老的事务id，用一个
         // oldest_txn_id_
         // 变量来维护，且等待队列中的处于等待的当前事务不可能还会申请其他锁了（阻塞）
         // 无论有没有得到锁都要先进入等待队列，得到锁后 granted_ 置真
-        if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+        if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
           // Younger transaction requests the lock, abort the current
           // transaction
           throw TransactionAbortException(txn->get_transaction_id(),
@@ -784,19 +755,13 @@ bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
         lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
         lock_request_queue.request_queue_.emplace_back(
             txn->get_transaction_id(), LockMode::EXCLUSIVE);
-        std::unique_lock ul(latch_, std::adopt_lock);
-        auto cur = lock_request_queue.request_queue_.begin();
-        // 通过条件：当前请求之前没有任何已授权的请求
-        lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
-          for (auto it = lock_request_queue.request_queue_.begin();
-               it != lock_request_queue.request_queue_.end(); ++it) {
-            if (it->txn_id_ != txn->get_transaction_id()) {
-              if (it->granted_) {
-                return false;
-              }
-            } else {
-              cur = it;
-              break;
+        std::unique_lock ul(shard.latch_, std::adopt_lock);
+        auto cur = std::prev(lock_request_queue.request_queue_.end());
+        // 通过条件：其他事务都没有已授权的请求。自己原来的锁排在前面，不能只看当前请求之前
+        wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn]() {
+          for (auto& request : lock_request_queue.request_queue_) {
+            if (request.txn_id_ != txn->get_transaction_id() && request.granted_) {
+              return false;
             }
           }
           return true;
@@ -811,7 +776,7 @@ bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
 
     // 如果其他事务有其他锁，加锁失败（no-wait）
     if (lock_request_queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+      if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
         // Younger transaction requests the lock, abort the current transaction
         throw TransactionAbortException(txn->get_transaction_id(),
                                         AbortReason::DEADLOCK_PREVENTION);
@@ -820,10 +785,10 @@ bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
       lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
       lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                      LockMode::EXCLUSIVE);
-      std::unique_lock ul(latch_, std::adopt_lock);
+      std::unique_lock ul(shard.latch_, std::adopt_lock);
       auto cur = lock_request_queue.request_queue_.begin();
       // 通过条件：当前请求之前没有任何已授权的请求
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+      wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
         for (auto it = lock_request_queue.request_queue_.begin();
              it != lock_request_queue.request_queue_.end(); ++it) {
           if (it->txn_id_ != txn->get_transaction_id()) {
@@ -862,22 +827,34 @@ bool LockManager::lock_exclusive_on_record(Transaction* txn, const Rid& rid,
 }
 
 /**
- * @description: 申请表级读锁
+ * @description: 申请表级读锁，拿到锁之后应用事务在表上推迟的递增（要读写页面，在分片的latch之外进行）
  * @return {bool} 返回加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_shared_on_table(Transaction* txn, int tab_fd) {
-  std::lock_guard lock(latch_);
+  if (!request_shared_on_table(txn, tab_fd)) {
+    return false;
+  }
+  flush_increments(txn, tab_fd, nullptr);
+  return true;
+}
+
+bool LockManager::request_shared_on_table(Transaction* txn, int tab_fd) {
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
+  LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
 
   if (!check_lock(txn)) {
     return false;
   }
 
-  LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
-  auto&& it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto&& it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
@@ -892,8 +869,44 @@ bool LockManager::lock_shared_on_table(Transaction* txn, int tab_fd) {
             lock_request.lock_mode_ == LockMode::EXCLUSIVE) {
           return true;
         }
-        // wait-die 不可能执行到这里
-        assert(0);
+        // 加行锁时持有的意向锁升级：IS 升级为 S，IX 升级为 SIX，等到其他事务的锁都和它相容
+        LockMode target = lock_request.lock_mode_ == LockMode::INTENTION_SHARED
+                              ? LockMode::SHARED
+                              : LockMode::S_IX;
+        txn_id_t txn_id = txn->get_transaction_id();
+        auto others_compatible = [&lock_request_queue, txn_id, target]() {
+          for (auto& request : lock_request_queue.request_queue_) {
+            if (request.txn_id_ != txn_id && request.granted_ &&
+                !compatible(request.lock_mode_, target)) {
+              return false;
+            }
+          }
+          return true;
+        };
+        if (!others_compatible()) {
+          if (should_die(txn_id, lock_data_id, lock_request_queue)) {
+            throw TransactionAbortException(txn_id,
+                                            AbortReason::DEADLOCK_PREVENTION);
+          }
+          LockMode old_mode = lock_request.lock_mode_;
+          lock_request.granted_ = false;
+          lock_request.lock_mode_ = target;
+          std::unique_lock ul(shard.latch_, std::adopt_lock);
+          wait_for_lock(txn, lock_data_id, lock_request_queue, ul, others_compatible);
+          ul.release();
+          lock_request.granted_ = true;
+          lock_request.lock_mode_ = old_mode;
+        }
+        if (lock_request.lock_mode_ == LockMode::INTENTION_EXCLUSIVE) {
+          --lock_request_queue.IX_lock_num_;
+        }
+        lock_request.lock_mode_ = target;
+        ++lock_request_queue.shared_lock_num_;
+        if (target == LockMode::S_IX) {
+          ++lock_request_queue.IX_lock_num_;
+        }
+        refresh_queue(lock_request_queue);
+        return true;
       }
     }
 
@@ -906,7 +919,7 @@ bool LockManager::lock_shared_on_table(Transaction* txn, int tab_fd) {
       // AbortReason::DEADLOCK_PREVENTION);
 
       // Check for conflicting locks and apply wait-die logic
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+      if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
         // Younger transaction requests the lock, abort the current transaction
         throw TransactionAbortException(txn->get_transaction_id(),
                                         AbortReason::DEADLOCK_PREVENTION);
@@ -914,9 +927,9 @@ bool LockManager::lock_shared_on_table(Transaction* txn, int tab_fd) {
       lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
       lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                      LockMode::SHARED);
-      std::unique_lock ul(latch_, std::adopt_lock);
+      std::unique_lock ul(shard.latch_, std::adopt_lock);
       auto cur = lock_request_queue.request_queue_.begin();
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+      wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
         for (auto it = lock_request_queue.request_queue_.begin();
              it != lock_request_queue.request_queue_.end(); ++it) {
           if (it->txn_id_ != txn->get_transaction_id()) {
@@ -965,23 +978,34 @@ bool LockManager::lock_shared_on_table(Transaction* txn, int tab_fd) {
 }
 
 /**
- * @description: 申请表级写锁
+ * @description: 申请表级写锁，拿到锁之后应用事务在表上推迟的递增
  * @return {bool} 返回加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
-  std::lock_guard lock(latch_);
-
-  if (!check_lock(txn)) {
+  if (!request_exclusive_on_table(txn, tab_fd)) {
     return false;
   }
+  flush_increments(txn, tab_fd, nullptr);
+  return true;
+}
 
+bool LockManager::request_exclusive_on_table(Transaction* txn, int tab_fd) {
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
   LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
+
+  if (!check_lock(txn)) {
+    return false;
+  }
 
-  auto it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
@@ -1005,7 +1029,7 @@ bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
         // AbortReason::DEADLOCK_PREVENTION);
 
         // 判断回滚还是等待
-        if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+        if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
           // 不会执行到这里
           // Younger transaction requests the lock, abort the current
           // transaction
@@ -1020,10 +1044,10 @@ bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
         lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
         // lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
         // LockMode::EXCLUSIVE);
-        std::unique_lock ul(latch_, std::adopt_lock);
+        std::unique_lock ul(shard.latch_, std::adopt_lock);
         auto cur = lock_request_queue.request_queue_.begin();
         // 当前请求前面没有任何已授权的请求
-        lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+        wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
           for (auto it = lock_request_queue.request_queue_.begin();
                it != lock_request_queue.request_queue_.end(); ++it) {
             if (it->txn_id_ != txn->get_transaction_id()) {
@@ -1051,7 +1075,7 @@ bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
       // AbortReason::DEADLOCK_PREVENTION);
 
       // 判断回滚还是等待
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+      if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
         // Younger transaction requests the lock, abort the current transaction
         throw TransactionAbortException(txn->get_transaction_id(),
                                         AbortReason::DEADLOCK_PREVENTION);
@@ -1059,10 +1083,10 @@ bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
       lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
       lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                      LockMode::EXCLUSIVE);
-      std::unique_lock ul(latch_, std::adopt_lock);
+      std::unique_lock ul(shard.latch_, std::adopt_lock);
       auto cur = lock_request_queue.request_queue_.begin();
       // 当前请求前面没有任何已授权的请求
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+      wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
         for (auto it = lock_request_queue.request_queue_.begin();
              it != lock_request_queue.request_queue_.end(); ++it) {
           if (it->txn_id_ != txn->get_transaction_id()) {
@@ -1106,16 +1130,20 @@ bool LockManager::lock_exclusive_on_table(Transaction* txn, int tab_fd) {
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_IS_on_table(Transaction* txn, int tab_fd) {
-  std::lock_guard lock(latch_);
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
+  LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
 
   if (!check_lock(txn)) {
     return false;
   }
 
-  LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
-  auto&& it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto&& it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
@@ -1135,7 +1163,7 @@ bool LockManager::lock_IS_on_table(Transaction* txn, int tab_fd) {
   // 如果其他事务持有 X 锁，加锁失败（no-wait）
   if (lock_request_queue.group_lock_mode_ == GroupLockMode::X) {
     // 判断回滚还是等待
-    if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+    if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
       // Younger transaction requests the lock, abort the current transaction
       throw TransactionAbortException(txn->get_transaction_id(),
                                       AbortReason::DEADLOCK_PREVENTION);
@@ -1143,10 +1171,10 @@ bool LockManager::lock_IS_on_table(Transaction* txn, int tab_fd) {
     lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
     lock_request_queue.request_queue_.emplace_back(txn->get_transaction_id(),
                                                    LockMode::INTENTION_SHARED);
-    std::unique_lock<std::mutex> ul(latch_, std::adopt_lock);
+    std::unique_lock<std::mutex> ul(shard.latch_, std::adopt_lock);
     auto&& cur = lock_request_queue.request_queue_.begin();
     // 当前请求前面没有任何已授权的请求
-    lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+    wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
       for (auto&& it = lock_request_queue.request_queue_.begin();
            it != lock_request_queue.request_queue_.end(); ++it) {
         if (it->txn_id_ != txn->get_transaction_id()) {
@@ -1196,12 +1224,16 @@ bool LockManager::lock_IS_on_table(Transaction* txn, int tab_fd) {
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
-  std::lock_guard lock(latch_);
-
+  if (is_lock_free(tab_fd)) {
+    return true;
+  }
   LockDataId lock_data_id(tab_fd, LockDataType::TABLE);
-  auto&& it = lock_table_.find(lock_data_id);
-  if (it == lock_table_.end()) {
-    it = lock_table_
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
+
+  auto&& it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    it = shard.lock_table_
              .emplace(std::piecewise_construct,
                       std::forward_as_tuple(lock_data_id),
                       std::forward_as_tuple())
@@ -1237,7 +1269,7 @@ bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
       }
 
       // 判断回滚还是等待
-      if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+      if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
         // Younger transaction requests the lock, abort the current transaction
         throw TransactionAbortException(txn->get_transaction_id(),
                                         AbortReason::DEADLOCK_PREVENTION);
@@ -1245,10 +1277,10 @@ bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
       lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
       lock_request_queue.request_queue_.emplace_back(
           txn->get_transaction_id(), LockMode::INTENTION_EXCLUSIVE);
-      std::unique_lock<std::mutex> ul(latch_, std::adopt_lock);
+      std::unique_lock<std::mutex> ul(shard.latch_, std::adopt_lock);
       auto&& cur = lock_request_queue.request_queue_.begin();
       // 当前请求前面没有任何已授权的请求
-      lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+      wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
         for (auto&& it = lock_request_queue.request_queue_.begin();
              it != lock_request_queue.request_queue_.end(); ++it) {
           if (it->txn_id_ != txn->get_transaction_id()) {
@@ -1283,7 +1315,7 @@ bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
       lock_request_queue.group_lock_mode_ == GroupLockMode::S ||
       lock_request_queue.group_lock_mode_ == GroupLockMode::SIX) {
     // 判断回滚还是等待
-    if (txn->get_transaction_id() > lock_request_queue.oldest_txn_id_) {
+    if (should_die(txn->get_transaction_id(), lock_data_id, lock_request_queue)) {
       // Younger transaction requests the lock, abort the current transaction
       throw TransactionAbortException(txn->get_transaction_id(),
                                       AbortReason::DEADLOCK_PREVENTION);
@@ -1291,10 +1323,10 @@ bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
     lock_request_queue.oldest_txn_id_ = txn->get_transaction_id();
     lock_request_queue.request_queue_.emplace_back(
         txn->get_transaction_id(), LockMode::INTENTION_EXCLUSIVE);
-    std::unique_lock<std::mutex> ul(latch_, std::adopt_lock);
+    std::unique_lock<std::mutex> ul(shard.latch_, std::adopt_lock);
     auto&& cur = lock_request_queue.request_queue_.begin();
     // 当前请求前面没有任何已授权的请求
-    lock_request_queue.cv_.wait(ul, [&lock_request_queue, txn, &cur]() {
+    wait_for_lock(txn, lock_data_id, lock_request_queue, ul, [&lock_request_queue, txn, &cur]() {
       for (auto&& it = lock_request_queue.request_queue_.begin();
            it != lock_request_queue.request_queue_.end(); ++it) {
         if (it->txn_id_ != txn->get_transaction_id()) {
@@ -1344,8 +1376,6 @@ bool LockManager::lock_IX_on_table(Transaction* txn, int tab_fd) {
  * @param {LockDataId} lock_data_id 要释放的锁ID
  */
 bool LockManager::unlock(Transaction* txn, const LockDataId& lock_data_id) {
-  std::lock_guard lock(latch_);
-
   auto& txn_state = txn->get_state();
   // 事务结束，不能再解锁
   if (txn_state == TransactionState::COMMITTED ||
@@ -1357,43 +1387,29 @@ bool LockManager::unlock(Transaction* txn, const LockDataId& lock_data_id) {
     txn_state = TransactionState::SHRINKING;
   }
 
-  std::unordered_map<LockDataId, LockRequestQueue>::iterator it;
-  std::unordered_map<
-      IndexMeta, std::unordered_map<LockDataId, LockRequestQueue> >::iterator
-      ii;
+  release(txn->get_transaction_id(), lock_data_id);
+  return true;
+}
 
-  if (lock_data_id.type_ == LockDataType::GAP) {
-    ii = gap_lock_table_.find(lock_data_id.index_meta_);
-    if (ii == gap_lock_table_.end()) {
-      return true;
-    }
-    it = ii->second.find(lock_data_id);
-    if (it == ii->second.end()) {
-      return true;
-    }
-  } else {
-    it = lock_table_.find(lock_data_id);
-    if (it == lock_table_.end()) {
-      return true;
-    }
+void LockManager::release(txn_id_t txn_id, const LockDataId& lock_data_id) {
+  auto& shard = get_shard(lock_data_id);
+  std::lock_guard lock(shard.latch_);
+
+  auto it = shard.lock_table_.find(lock_data_id);
+  if (it == shard.lock_table_.end()) {
+    return;
   }
 
   auto& lock_request_queue = it->second;
   auto& request_queue = lock_request_queue.request_queue_;
 
-  auto request = request_queue.begin();
-  for (; request != request_queue.end(); ++request) {
-    if (request->txn_id_ == txn->get_transaction_id()) {
-      break;
-    }
-  }
-
-  if (request == request_queue.end()) {
-    return true;
-  }
-
   // 一个事务可能对某个记录持有多个锁，S，IX
-  do {
+  bool found = false;
+  for (auto request = request_queue.begin(); request != request_queue.end();) {
+    if (request->txn_id_ != txn_id) {
+      ++request;
+      continue;
+    }
     // 维护锁请求队列
     if (request->lock_mode_ == LockMode::SHARED ||
         request->lock_mode_ == LockMode::S_IX) {
@@ -1404,67 +1420,33 @@ bool LockManager::unlock(Transaction* txn, const LockDataId& lock_data_id) {
       --lock_request_queue.IX_lock_num_;
     }
     // 删除该锁请求
-    request_queue.erase(request);
-
-    request = request_queue.begin();
-    for (; request != request_queue.end(); ++request) {
-      if (request->txn_id_ == txn->get_transaction_id()) {
-        break;
-      }
-    }
-  } while (request != request_queue.end());
+    request = request_queue.erase(request);
+    found = true;
+  }
+  if (!found) {
+    return;
+  }
 
-  // 维护队列锁模式，为空则无锁
-  // TODO 擦除锁表
+  // 队列为空时擦除锁表中的这一项
   if (request_queue.empty()) {
-    // lock_request_queue.group_lock_mode_ = GroupLockMode::NON_LOCK;
-    // lock_request_queue.oldest_txn_id_ = INT32_MAX;
-    // 唤醒等待的事务
-    // lock_request_queue.cv_.notify_all();
-
-    if (lock_data_id.type_ == LockDataType::GAP) {
-      // 相交的间隙锁也得唤醒
-      for (auto& [data_id, queue] : ii->second) {
-        // if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-        // if (data_id != lock_data_id) {
-        if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-          queue.cv_.notify_all();
-        }
-        // }
-        // }
-      }
-      ii->second.erase(it);
-    } else {
-      lock_table_.erase(it);
-    }
-
-    return true;
+    shard.lock_table_.erase(it);
+    return;
   }
 
   // 否则找到级别最高的锁和时间戳最小的事务
-  auto max_lock_mode = LockMode::INTENTION_SHARED;
-  for (auto& request : request_queue) {
-    max_lock_mode = std::max(max_lock_mode, request.lock_mode_);
-    if (request.txn_id_ < lock_request_queue.oldest_txn_id_) {
-      lock_request_queue.oldest_txn_id_ = request.txn_id_;
-    }
-  }
-
-  lock_request_queue.group_lock_mode_ =
-      static_cast<GroupLockMode>(static_cast<int>(max_lock_mode) + 1);
+  refresh_queue(lock_request_queue);
 
   // 唤醒等待的事务
   lock_request_queue.cv_.notify_all();
+}
 
-  if (lock_data_id.type_ == LockDataType::GAP) {
-    // 相交的锁表也得唤醒
-    for (auto& [data_id, queue] : ii->second) {
-      // if (queue.group_lock_mode_ != GroupLockMode::NON_LOCK) {
-      if (lock_data_id.gap_.isCoincide(data_id.gap_)) {
-        queue.cv_.notify_all();
-      }
-      // }
-    }
+void LockManager::refresh_queue(LockRequestQueue& queue) {
+  auto max_lock_mode = static_cast<int>(GroupLockMode::NON_LOCK);
+  queue.oldest_txn_id_ = INT32_MAX;
+  for (auto& request : queue.request_queue_) {
+    max_lock_mode =
+        std::max(max_lock_mode, static_cast<int>(request.lock_mode_) + 1);
+    queue.oldest_txn_id_ = std::min(queue.oldest_txn_id_, request.txn_id_);
   }
-  return true;
+  queue.group_lock_mode_ = static_cast<GroupLockMode>(max_lock_mode);
 }
@@ -10,14 +10,104 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
 #include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "transaction/transaction.h"
 
 static const std::string GroupLockModeStr[10] = {"NON_LOCK", "IS",  "IX",
                                                  "S",        "SIX", "X"};
 
+/* 锁表中std::list和std::unordered_map结点的分配器。释放的结点放在本线程的空闲链表中，
+ * 下次分配同样的结点时直接取出，加锁解锁不再每次调用malloc/free。
+ * 一次分配多个对象（哈希桶数组）时直接使用operator new。向系统申请和归还的内存记入MemTag::LOCK_TABLE，
+ * 空闲链表中缓存的结点仍然算作锁表占用 */
+template <typename T>
+class LockNodeAllocator {
+ public:
+  using value_type = T;
+
+  LockNodeAllocator() = default;
+
+  template <typename U>
+  LockNodeAllocator(const LockNodeAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if constexpr (sizeof(T) >= sizeof(FreeNode)) {
+      auto& pool = free_pool();
+      if (n == 1 && pool.head != nullptr) {
+        FreeNode* node = pool.head;
+        pool.head = node->next;
+        --pool.size;
+        return reinterpret_cast<T*>(node);
+      }
+    }
+    MemoryAccounting::instance().alloc(MemTag::LOCK_TABLE, n * sizeof(T));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if constexpr (sizeof(T) >= sizeof(FreeNode)) {
+      auto& pool = free_pool();
+      if (n == 1 && pool.size < LOCK_NODE_POOL_SIZE) {
+        auto node = reinterpret_cast<FreeNode*>(p);
+        node->next = pool.head;
+        pool.head = node;
+        ++pool.size;
+        return;
+      }
+    }
+    MemoryAccounting::instance().free(MemTag::LOCK_TABLE, n * sizeof(T));
+    ::operator delete(p);
+  }
+
+  friend bool operator==(const LockNodeAllocator&, const LockNodeAllocator&) {
+    return true;
+  }
+  friend bool operator!=(const LockNodeAllocator&, const LockNodeAllocator&) {
+    return false;
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  // 每个线程、每种结点一个空闲链表；结点可以在别的线程释放，释放后归那个线程所有
+  struct FreePool {
+    FreeNode* head = nullptr;
+    size_t size = 0;
+
+    ~FreePool() {
+      while (head != nullptr) {
+        FreeNode* next = head->next;
+        MemoryAccounting::instance().free(MemTag::LOCK_TABLE, sizeof(T));
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  };
+
+  static FreePool& free_pool() {
+    thread_local FreePool pool;
+    return pool;
+  }
+};
+
+/* 死锁的处理方式，每个服务器启动时选定 */
+enum class DeadlockPolicy {
+  WAIT_DIE,  // 比队列中最老的事务年轻的事务不等待，直接回滚
+  DETECTION  // 总是等待，后台线程每隔cycle_detection_interval检查等待图，回滚环中最年轻的事务
+};
+
 class LockManager {
   /* 加锁类型，包括共享锁、排他锁、意向共享锁、意向排他锁、SIX（意向排他锁+共享锁）
    */
@@ -47,7 +137,8 @@ class LockManager {
   /* 数据项上的加锁队列 */
   class LockRequestQueue {
    public:
-    std::list<LockRequest> request_queue_;  // 加锁队列
+    std::list<LockRequest, LockNodeAllocator<LockRequest>>
+        request_queue_;  // 加锁队列
     std::condition_variable
         cv_;  // 条件变量，用于唤醒正在等待加锁的申请，在no-wait策略下无需使用
     GroupLockMode group_lock_mode_ =
@@ -59,27 +150,52 @@ class LockManager {
         INT32_MAX;  // 维护等待队列中最老（时间戳最小）的事务id
   };
 
+  using LockTable =
+      std::unordered_map<LockDataId, LockRequestQueue, std::hash<LockDataId>,
+                         std::equal_to<LockDataId>,
+                         LockNodeAllocator<std::pair<const LockDataId,
+                                                     LockRequestQueue>>>;
+
+  /* 锁表的一个分片。每个数据项的锁只在它自己的分片中，加锁解锁只持有这个分片的latch */
+  struct alignas(64) LockTableShard {
+    std::mutex latch_;
+    LockTable lock_table_;
+  };
+
  public:
-  LockManager() {
-    lock_table_.reserve(200);
-    gap_lock_table_.reserve(10);
-  }
+  /* 锁表中的一个加锁请求，SHOW LOCKS用 */
+  struct LockInfo {
+    LockDataId id;
+    txn_id_t txn_id;
+    const char* mode;  // IS、IX、S、SIX、X；间隙上的IX是插入意向锁，记录上的IX是递增锁
+    bool granted;      // 已经授予还是正在等待
+  };
+
+  /* 一个文件（表或者索引）上某类锁的等待统计，SHOW LOCK STATUS用 */
+  struct LockWaitStats {
+    uint64_t waits = 0;      // 真正阻塞的次数
+    uint64_t wait_us = 0;    // 阻塞的总时间
+    uint64_t dies = 0;       // wait-die下不等待直接回滚的次数
+    uint64_t deadlocks = 0;  // 死锁检测选为牺牲者回滚的次数
+  };
 
-  ~LockManager() = default;
+  explicit LockManager(DeadlockPolicy policy = DeadlockPolicy::WAIT_DIE);
 
-  bool lock_shared_on_gap(Transaction* txn, IndexMeta& index_meta, Gap& gap,
-                          int tab_fd);
+  ~LockManager();
 
-  bool lock_exclusive_on_gap(Transaction* txn, IndexMeta& index_meta, Gap& gap,
-                             int tab_fd);
+  bool lock_shared_on_gap(Transaction* txn, int ix_fd, const Rid& next_rid);
 
-  bool isSafeInGap(Transaction* txn, IndexMeta& index_meta, RmRecord& record,
-                   int tab_fd);
+  bool lock_insert_on_gap(Transaction* txn, int ix_fd, const Rid& next_rid);
 
   bool lock_shared_on_record(Transaction* txn, const Rid& rid, int tab_fd);
 
   bool lock_exclusive_on_record(Transaction* txn, const Rid& rid, int tab_fd);
 
+  bool lock_increment_on_record(Transaction* txn, const Rid& rid, int tab_fd);
+
+  // 事务在tab_fd上还有推迟的递增时，给这些记录加X锁，拿到锁时递增即被应用。快照读不加锁，读表之前调用
+  void settle_increments(Transaction* txn, int tab_fd);
+
   bool lock_shared_on_table(Transaction* txn, int tab_fd);
 
   bool lock_exclusive_on_table(Transaction* txn, int tab_fd);
@@ -90,10 +206,107 @@ class LockManager {
 
   bool unlock(Transaction* txn, const LockDataId& lock_data_id);
 
+  // 临时表的数据文件和索引文件只有创建它的会话访问，在这些文件上加锁直接成功。关闭文件前要清除
+  void set_lock_free(int fd, bool lock_free) {
+    if (fd >= 0 && fd < LOCK_FREE_MAX_FD) {
+      lock_free_files_[fd].store(lock_free, std::memory_order_relaxed);
+    }
+  }
+
+  // 事务拿到记录（rid为空时是整张表）上的读写锁之后，应用它在上面推迟的递增，由TransactionManager提供
+  using IncrementFlusher = std::function<void(Transaction*, int, const Rid*)>;
+
+  void set_increment_flusher(IncrementFlusher flusher) {
+    increment_flusher_ = std::move(flusher);
+  }
+
+  // 锁表中所有的加锁请求，每个分片各自加latch，不是同一时刻的快照
+  void get_locks(std::vector<LockInfo>& locks);
+
+  // 按(文件fd, 锁类型)排列的等待统计，间隙锁的fd是索引文件
+  void get_wait_stats(
+      std::vector<std::pair<std::pair<int, LockDataType>, LockWaitStats>>&
+          stats);
+
  private:
-  std::mutex latch_;  // 用于锁表的并发
-  std::unordered_map<LockDataId, LockRequestQueue> lock_table_;  // 全局锁表
-  std::unordered_map<IndexMeta,
-                     std::unordered_map<LockDataId, LockRequestQueue> >
-      gap_lock_table_;  // 全局间隙锁表
+  bool lock_on_gap(Transaction* txn, const LockDataId& lock_data_id,
+                   LockMode lock_mode);
+
+  bool request_shared_on_record(Transaction* txn, const Rid& rid, int tab_fd);
+
+  bool request_exclusive_on_record(Transaction* txn, const Rid& rid,
+                                   int tab_fd);
+
+  bool request_shared_on_table(Transaction* txn, int tab_fd);
+
+  bool request_exclusive_on_table(Transaction* txn, int tab_fd);
+
+  void flush_increments(Transaction* txn, int tab_fd, const Rid* rid) {
+    if (increment_flusher_ && !txn->get_pending_increments().empty()) {
+      increment_flusher_(txn, tab_fd, rid);
+    }
+  }
+
+  void escalate(Transaction* txn, int tab_fd, TableLockState& table);
+
+  // 释放事务在lock_data_id上的锁，不改变事务状态
+  void release(txn_id_t txn_id, const LockDataId& lock_data_id);
+
+  // 按队列中剩下的请求重新计算锁模式和最老的事务
+  static void refresh_queue(LockRequestQueue& queue);
+
+  // wait-die下比队列中最老的事务年轻的事务不等待，记到lock_data_id的统计中；检测死锁时总是等待
+  bool should_die(txn_id_t txn_id, const LockDataId& lock_data_id,
+                  const LockRequestQueue& queue) {
+    if (policy_ == DeadlockPolicy::WAIT_DIE && txn_id > queue.oldest_txn_id_) {
+      add_wait_stats(lock_data_id, {0, 0, 1, 0});
+      return true;
+    }
+    return false;
+  }
+
+  static bool compatible(LockMode held, LockMode requested);
+
+  template <typename Pred>
+  void wait_for_lock(Transaction* txn, const LockDataId& lock_data_id,
+                     LockRequestQueue& queue, std::unique_lock<std::mutex>& ul,
+                     Pred pred);
+
+  void add_wait_stats(const LockDataId& lock_data_id,
+                      const LockWaitStats& delta);
+
+  void detect_deadlocks();
+
+  bool is_victim(txn_id_t txn_id);
+
+  bool take_victim(txn_id_t txn_id);
+
+  // 表锁、行锁和间隙锁所在的分片，按LockDataId的哈希值选取
+  LockTableShard& get_shard(const LockDataId& lock_data_id) {
+    uint64_t hash = std::hash<LockDataId>()(lock_data_id);
+    // std::hash<int64_t>是恒等映射，乘一个奇数常量把高位也混进来
+    return shards_[((hash * 0x9E3779B97F4A7C15ULL) >> 32) % LOCK_TABLE_SHARDS];
+  }
+
+  bool is_lock_free(int fd) const {
+    return fd >= 0 && fd < LOCK_FREE_MAX_FD &&
+           lock_free_files_[fd].load(std::memory_order_relaxed);
+  }
+
+  std::array<LockTableShard, LOCK_TABLE_SHARDS> shards_;  // 锁表
+  std::array<std::atomic<bool>, LOCK_FREE_MAX_FD> lock_free_files_{};  // 按文件描述符标记临时表的文件
+
+  DeadlockPolicy policy_;
+  IncrementFlusher increment_flusher_;
+  std::atomic<int> num_waiting_{0};  // 正在等待锁的请求数，为0时不用检查等待图
+  std::mutex victim_latch_;          // 在分片的latch之后获取
+  std::unordered_set<txn_id_t> victims_;  // 被选中回滚、还没有醒来的等待者
+
+  std::mutex stats_latch_;  // 只在等待和回滚时获取，在分片的latch之后
+  std::map<std::pair<int, LockDataType>, LockWaitStats> wait_stats_;
+
+  std::thread detector_;
+  std::mutex detector_latch_;
+  std::condition_variable detector_cv_;
+  bool stop_detector_ = false;
 };
@@ -0,0 +1,66 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "occ_manager.h"
+
+#include <unordered_map>
+
+OccManager& OccManager::instance() {
+  static OccManager manager;
+  return manager;
+}
+
+bool OccManager::read(Transaction* txn, int fd, const Rid& rid) {
+  size_t idx = slot(fd, rid);
+  uint64_t word = words_[idx].load(std::memory_order_acquire);
+  if (word >= WRITER_ONE) {
+    return false;
+  }
+  txn->get_occ_state().reads.emplace_back(idx, word);
+  return true;
+}
+
+void OccManager::write(Transaction* txn, int fd, const Rid& rid) {
+  if (txn->get_occ_state()
+          .writes.emplace(fd, rid, LockDataType::RECORD)
+          .second) {
+    words_[slot(fd, rid)].fetch_add(WRITER_ONE, std::memory_order_acq_rel);
+  }
+}
+
+bool OccManager::validate(Transaction* txn) {
+  auto& state = txn->get_occ_state();
+  if (state.reads.empty()) {
+    return true;
+  }
+  // 读的时候版本字上没有修改者，之后自己加上的修改者都在读之后
+  std::unordered_map<size_t, uint64_t> own;
+  for (auto& id : state.writes) {
+    own[slot(id.fd_, id.rid_)] += WRITER_ONE;
+  }
+  for (auto& [idx, word] : state.reads) {
+    auto it = own.find(idx);
+    uint64_t expected = word + (it == own.end() ? 0 : it->second);
+    if (words_[idx].load(std::memory_order_acquire) != expected) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void OccManager::release(Transaction* txn) {
+  auto& state = txn->get_occ_state();
+  for (auto& id : state.writes) {
+    words_[slot(id.fd_, id.rid_)].fetch_add(VERSION_ONE - WRITER_ONE,
+                                            std::memory_order_acq_rel);
+  }
+  state.reads.clear();
+  state.writes.clear();
+}
@@ -0,0 +1,55 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "transaction/transaction.h"
+
+/**
+ * @description: 乐观并发控制的记录版本字。记录按(fd, rid)的哈希值映射到OCC_VERSION_SLOTS个版本字之一，
+ * 版本字的高16位是正在修改映射到它的记录的事务数，低48位是版本号。
+ * 写事务拿到记录的 X 锁时修改者加一，提交或回滚后修改者减一、版本号加一；
+ * 读事务不加行锁，只记下读之前的版本字（有修改者时退回加 S 锁），提交时版本字没有变过（除了自己的修改）就说明读到的记录
+ * 从读的时候到现在没有被其他事务修改过，事务可以串行化在这一刻。
+ * 不同记录映射到同一个版本字时只会多回滚，不会漏掉冲突
+ */
+class OccManager {
+ public:
+  static OccManager& instance();
+
+  // 读fd中rid上的记录之前调用：没有事务正在修改时记到事务的读集中并返回true，不用加锁；
+  // 否则返回false，调用者退回加 S 锁
+  bool read(Transaction* txn, int fd, const Rid& rid);
+
+  // 事务拿到rid上的 X 锁之后调用，同一条记录只记一次
+  void write(Transaction* txn, int fd, const Rid& rid);
+
+  // 提交前验证读集中的版本字，只多了自己的修改时返回true
+  bool validate(Transaction* txn);
+
+  // 提交或回滚之后、放锁之前调用：结束事务对记录的修改，清空读写集
+  void release(Transaction* txn);
+
+ private:
+  static constexpr uint64_t WRITER_ONE = 1ULL << 48;
+  static constexpr uint64_t VERSION_ONE = 1;
+
+  static size_t slot(int fd, const Rid& rid) {
+    uint64_t key = (static_cast<uint64_t>(fd) << 40) ^
+                   (static_cast<uint64_t>(rid.page_no) << 16) ^
+                   static_cast<uint32_t>(rid.slot_no);
+    return (key * 0x9E3779B97F4A7C15ULL >> 32) % OCC_VERSION_SLOTS;
+  }
+
+  std::array<std::atomic<uint64_t>, OCC_VERSION_SLOTS> words_{};
+};
@@ -15,10 +15,30 @@ See the Mulan PSL v2 for more details. */
 #include <memory>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "txn_defs.h"
 
+/* 事务在一张表上的锁，由LockManager维护：行锁之前先加的意向锁只申请一次，
+ * 行锁超过阈值时升级为表锁，之后表锁覆盖的行不再加行锁 */
+struct TableLockState {
+  bool intention_shared = false;     // 持有IS或更强的表锁
+  bool intention_exclusive = false;  // 持有IX或更强的表锁
+  bool shared = false;     // 升级得到了表上的S（或SIX、X）锁，行上不再加S锁
+  bool exclusive = false;  // 升级得到了表上的X锁，行上不再加锁
+  bool has_exclusive_rows = false;  // 持有过行上的X锁，升级时要升级为X
+  size_t rows = 0;                  // 持有的行锁数
+  size_t next_escalation = LOCK_ESCALATION_THRESHOLD;  // 行锁数到达时尝试升级
+};
+
+/* 乐观并发控制下事务的读写集，由OccManager维护 */
+struct OccState {
+  bool enabled = false;  // 服务器使用乐观并发控制
+  std::vector<std::pair<size_t, uint64_t> > reads;  // 不加锁读过的记录的版本字和读之前的值
+  std::unordered_set<LockDataId> writes;  // 持有 X 锁的记录
+};
+
 class Transaction {
  public:
   explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level =
@@ -26,16 +46,35 @@ class Transaction {
       : state_(TransactionState::DEFAULT),
         isolation_level_(isolation_level),
         txn_id_(txn_id) {
-    write_set_ = std::make_shared<std::deque<WriteRecord*> >();
-    lock_set_ = std::make_shared<std::unordered_set<LockDataId> >();
-    index_latch_page_set_ = std::make_shared<std::deque<Page*> >();
-    index_deleted_page_set_ = std::make_shared<std::deque<Page*> >();
     prev_lsn_ = INVALID_LSN;
     thread_id_ = std::this_thread::get_id();
   }
 
   ~Transaction() = default;
 
+  // 结束的事务对象由TransactionManager回收，作为新事务重新使用，容器清空但保留已分配的空间
+  void reset(txn_id_t txn_id) {
+    state_ = TransactionState::DEFAULT;
+    txn_id_ = txn_id;
+    txn_mode_ = false;
+    prev_lsn_ = INVALID_LSN;
+    begin_lsn_ = INVALID_LSN;
+    thread_id_ = std::this_thread::get_id();
+    snapshot_ts_ = INVALID_TIMESTAMP;
+    read_only_ = false;
+    synchronous_commit_ = true;
+    write_set_.clear();
+    lock_set_.clear();
+    index_latch_page_set_.clear();
+    index_deleted_page_set_.clear();
+    version_set_.clear();
+    table_locks_.clear();
+    occ_state_.enabled = false;
+    occ_state_.reads.clear();
+    occ_state_.writes.clear();
+    pending_increments_.clear();
+  }
+
   inline txn_id_t get_transaction_id() { return txn_id_; }
 
   inline std::thread::id get_thread_id() { return thread_id_; }
@@ -46,6 +85,23 @@ class Transaction {
   inline void set_start_ts(timestamp_t start_ts) { start_ts_ = start_ts; }
   inline timestamp_t get_start_ts() { return start_ts_; }
 
+  // 只读事务在快照上读，不加锁；不是快照读时为INVALID_TIMESTAMP
+  inline void set_snapshot_ts(timestamp_t snapshot_ts) {
+    snapshot_ts_ = snapshot_ts;
+  }
+  inline timestamp_t get_snapshot_ts() { return snapshot_ts_; }
+  inline bool is_snapshot() { return snapshot_ts_ != INVALID_TIMESTAMP; }
+
+  // 只读事务：在快照上读，不加锁、不写日志，其中修改数据的语句报错
+  inline void set_read_only(bool read_only) { read_only_ = read_only; }
+  inline bool is_read_only() { return read_only_; }
+
+  // 为false时提交只把commit日志追加到日志缓冲区，不等待落盘，由刷盘线程在log_timeout内持久化
+  inline void set_synchronous_commit(bool synchronous_commit) {
+    synchronous_commit_ = synchronous_commit;
+  }
+  inline bool get_synchronous_commit() { return synchronous_commit_; }
+
   inline IsolationLevel get_isolation_level() { return isolation_level_; }
 
   inline TransactionState& get_state() { return state_; }
@@ -54,29 +110,47 @@ class Transaction {
   inline lsn_t get_prev_lsn() { return prev_lsn_; }
   inline void set_prev_lsn(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
-  inline std::shared_ptr<std::deque<WriteRecord*> > get_write_set() {
-    return write_set_;
+  // begin日志的lsn，begin日志推迟到事务写第一条数据日志时才写，为INVALID_LSN说明事务没有写过日志
+  inline lsn_t get_begin_lsn() { return begin_lsn_; }
+  inline void set_begin_lsn(lsn_t begin_lsn) { begin_lsn_ = begin_lsn; }
+
+  inline std::deque<WriteRecord*>* get_write_set() {
+    return &write_set_;
   }
   inline void append_write_record(WriteRecord* write_record) {
-    write_set_->push_back(write_record);
+    write_set_.push_back(write_record);
   }
 
-  inline std::shared_ptr<std::deque<Page*> > get_index_deleted_page_set() {
-    return index_deleted_page_set_;
+  inline std::deque<Page*>* get_index_deleted_page_set() {
+    return &index_deleted_page_set_;
   }
   inline void append_index_deleted_page(Page* page) {
-    index_deleted_page_set_->push_back(page);
+    index_deleted_page_set_.push_back(page);
   }
 
-  inline std::shared_ptr<std::deque<Page*> > get_index_latch_page_set() {
-    return index_latch_page_set_;
+  inline std::deque<Page*>* get_index_latch_page_set() {
+    return &index_latch_page_set_;
   }
   inline void append_index_latch_page_set(Page* page) {
-    index_latch_page_set_->push_back(page);
+    index_latch_page_set_.push_back(page);
   }
 
-  inline std::shared_ptr<std::unordered_set<LockDataId> > get_lock_set() {
-    return lock_set_;
+  inline std::unordered_set<LockDataId>* get_lock_set() {
+    return &lock_set_;
+  }
+
+  inline std::vector<std::pair<int, Rid> >& get_version_set() {
+    return version_set_;
+  }
+
+  inline std::unordered_map<int, TableLockState>& get_table_locks() {
+    return table_locks_;
+  }
+
+  inline OccState& get_occ_state() { return occ_state_; }
+
+  inline std::vector<PendingIncrement>& get_pending_increments() {
+    return pending_increments_;
   }
 
  private:
@@ -85,15 +159,22 @@ class Transaction {
   IsolationLevel isolation_level_;  // 事务的隔离级别，默认隔离级别为可串行化
   std::thread::id thread_id_;       // 当前事务对应的线程id
   lsn_t prev_lsn_;   // 当前事务执行的最后一条操作对应的lsn，用于系统故障恢复
+  lsn_t begin_lsn_ = INVALID_LSN;  // 事务begin日志的lsn
   txn_id_t txn_id_;  // 事务的ID，唯一标识符
   timestamp_t start_ts_;  // 事务的开始时间戳
-
-  std::shared_ptr<std::deque<WriteRecord*> >
-      write_set_;  // 事务包含的所有写操作
-  std::shared_ptr<std::unordered_set<LockDataId> >
-      lock_set_;  // 事务申请的所有锁
-  std::shared_ptr<std::deque<Page*> >
-      index_latch_page_set_;  // 维护事务执行过程中加锁的索引页面
-  std::shared_ptr<std::deque<Page*> >
-      index_deleted_page_set_;  // 维护事务执行过程中删除的索引页面
+  timestamp_t snapshot_ts_ = INVALID_TIMESTAMP;  // 快照读的时间戳
+  bool read_only_ = false;  // 只读事务
+  bool synchronous_commit_ = true;  // 提交时是否等待commit日志持久化
+
+  std::deque<WriteRecord*> write_set_;  // 事务包含的所有写操作
+  std::unordered_set<LockDataId> lock_set_;  // 事务申请的所有锁
+  std::deque<Page*> index_latch_page_set_;  // 维护事务执行过程中加锁的索引页面
+  std::deque<Page*> index_deleted_page_set_;  // 维护事务执行过程中删除的索引页面
+  std::vector<std::pair<int, Rid> >
+      version_set_;  // 事务在版本存储中保存过版本的记录（表文件fd和rid）
+  std::unordered_map<int, TableLockState>
+      table_locks_;  // 表文件fd -> 事务在表上的锁
+  OccState occ_state_;
+  std::vector<PendingIncrement> pending_increments_;  // 还没有应用的递增，按执行顺序
+  MemoryCharge charge_{MemTag::TRANSACTION, sizeof(Transaction)};
 };
@@ -12,11 +12,14 @@ See the Mulan PSL v2 for more details. */
 
 #include <record/rm_manager.h>
 
+#include <algorithm>
+#include <numeric>
+
+#include "common/metrics.h"
+#include "concurrency/occ_manager.h"
 #include "record/rm_file_handle.h"
 #include "system/sm_manager.h"
 
-std::unordered_map<txn_id_t, Transaction*> TransactionManager::txn_map = {};
-
 /**
  * @description: 事务的开始方法
  * @return {Transaction*} 开始事务的指针
@@ -32,22 +35,45 @@ Transaction* TransactionManager::begin(Transaction* txn,
   // 3. 把开始事务加入到全局事务表中
   // 4. 返回当前事务指针
   if (txn == nullptr) {
-    txn = new Transaction(next_txn_id_++);
+    // 优先重新使用当前线程回收的事务对象，不用重新分配事务和其中的容器
+    auto& pool = txn_pool();
+    if (pool.empty()) {
+      txn = new Transaction(next_txn_id_++);
+    } else {
+      txn = pool.back().release();
+      pool.pop_back();
+      txn->reset(next_txn_id_++);
+    }
   }
   txn->set_start_ts(next_timestamp_++);
-  latch_.lock();
-  txn_map.emplace(txn->get_transaction_id(), txn);
-  latch_.unlock();
-#ifdef ENABLE_LOGGING
-  auto* begin_log_record = new BeginLogRecord(txn->get_transaction_id());
-  begin_log_record->prev_lsn_ = txn->get_prev_lsn();
-  // TODO 日志管理
-  txn->set_prev_lsn(log_manager->add_log_to_buffer(begin_log_record));
-  delete begin_log_record;
-#endif
+  txn->get_occ_state().enabled =
+      concurrency_mode_ == ConcurrencyMode::OPTIMISTIC;
+  auto& shard = get_shard(txn->get_transaction_id());
+  {
+    std::lock_guard lock(shard.latch_);
+    shard.txns_.emplace(txn->get_transaction_id(), txn);
+  }
+  // begin日志推迟到事务第一次写数据日志时（log_begin），只读的事务从头到尾不写日志
   return txn;
 }
 
+/**
+ * @description: 事务写第一条数据日志之前写begin日志，已经写过时什么也不做
+ * @param {Transaction*} txn 事务
+ * @param {LogManager*} log_manager 日志管理器指针
+ */
+void TransactionManager::log_begin(Transaction* txn, LogManager* log_manager) {
+  if (txn->get_begin_lsn() != INVALID_LSN) {
+    return;
+  }
+  // 先于分配lsn设置一个不大于begin日志lsn的值，并发的检查点据此保留事务的全部日志
+  txn->set_begin_lsn(log_manager->get_next_lsn());
+  BeginLogRecord begin_log_record(txn->get_transaction_id());
+  begin_log_record.prev_lsn_ = txn->get_prev_lsn();
+  txn->set_prev_lsn(log_manager->add_log_to_buffer(&begin_log_record));
+  txn->set_begin_lsn(txn->get_prev_lsn());
+}
+
 /**
  * @description: 事务的提交方法
  * @param {Transaction*} txn 需要提交的事务
@@ -62,26 +88,95 @@ void TransactionManager::commit(Transaction* txn, LogManager* log_manager) {
   // 5. 更新事务状态
   // std::lock_guard lock(latch_);
 
+  // 乐观并发控制：写过的记录都还持有 X 锁，读过的记录的版本字都没有变过时事务串行化在这里，
+  // 否则抛出异常，由调用者回滚
+  if (txn->get_occ_state().enabled && !OccManager::instance().validate(txn)) {
+    throw TransactionAbortException(txn->get_transaction_id(),
+                                    AbortReason::VALIDATION_FAILED);
+  }
+
+  // 只读事务的快路径：没有写集、锁和日志，结束快照即可
+  if (txn->is_read_only() && txn->get_write_set()->empty() &&
+      txn->get_lock_set()->empty()) {
+    if (txn->is_snapshot()) {
+      VersionStore::instance().end_snapshot(txn);
+    }
+#ifdef ENABLE_LOGGING
+    // 读到的数据来自已经放锁的写事务，和下面只读事务的提交一样等release_lsn_落盘
+    if (txn->get_synchronous_commit()) {
+      log_manager->wait_for_flush(release_lsn_.load());
+    }
+#endif
+    txn->set_state(TransactionState::COMMITTED);
+    Metrics::instance().add(MetricCounter::COMMITS);
+    return;
+  }
+
+  // 推迟的递增在这里才修改记录，直到标上提交时间戳之前其他带递增的事务不能提交
+  std::unique_lock escrow_lock(escrow_latch_, std::defer_lock);
+  if (!txn->get_pending_increments().empty()) {
+    escrow_lock.lock();
+    apply_increments(txn, log_manager);
+  }
+  auto changed = changed_tables(txn);
   // 释放写集指针
   for (auto& it : *txn->get_write_set()) {
     delete it;
   }
+  txn->get_write_set()->clear();
+
+#ifdef ENABLE_LOGGING
+  // 没有写过日志的事务不写commit日志，恢复时看不到它
+  bool read_only = txn->get_begin_lsn() == INVALID_LSN;
+  if (!read_only) {
+    auto* commit_log_record = new CommitLogRecord(txn->get_transaction_id());
+    commit_log_record->prev_lsn_ = txn->get_prev_lsn();
+    txn->set_prev_lsn(log_manager->add_log_to_buffer(commit_log_record));
+    delete commit_log_record;
+    // 在其他事务能看到本事务的修改（标上提交时间戳、放锁）之前记下 commit 日志的 lsn
+    lsn_t release_lsn = release_lsn_.load();
+    while (release_lsn < txn->get_prev_lsn() &&
+           !release_lsn_.compare_exchange_weak(release_lsn, txn->get_prev_lsn())) {
+    }
+  }
+#endif
+
+  // 放锁之前标上提交时间戳，之后修改同一条记录的事务提交时间戳一定更大
+  auto& version_store = VersionStore::instance();
+  version_store.commit(txn, next_timestamp_);
+  if (escrow_lock.owns_lock()) {
+    escrow_lock.unlock();
+  }
+  if (txn->is_snapshot()) {
+    version_store.end_snapshot(txn);
+  }
+  OccManager::instance().release(txn);
+  // 修改已经对之后的快照可见
+  for (auto* fh : changed) {
+    fh->note_change();
+  }
 
   // 释放所有锁
+  // commit 日志已经进入缓冲区，后续依赖本事务的写事务其 commit 日志 lsn 更大，
+  // 一定在本事务之后持久化，因此可以在等待落盘之前提前放锁
   auto&& lock_set = txn->get_lock_set();
   for (auto& it : *lock_set) {
     lock_manager_->unlock(txn, it);
   }
   lock_set->clear();
+  txn->get_table_locks().clear();
 #ifdef ENABLE_LOGGING
-  auto* commit_log_record = new CommitLogRecord(txn->get_transaction_id());
-  commit_log_record->prev_lsn_ = txn->get_prev_lsn();
-  // TODO 日志管理
-  txn->set_prev_lsn(log_manager->add_log_to_buffer(commit_log_record));
-  // log_manager->flush_log_to_disk();
-  delete commit_log_record;
+  // 组提交：等待刷盘线程把本事务的 commit 日志持久化。异步提交不等待，
+  // 崩溃时最多丢失最近 log_timeout 内提交的事务，但不会破坏一致性：
+  // 数据页写盘前仍然要等对应的日志落盘。
+  // 只读事务的 commit 日志丢了也不用回滚任何东西，它只依赖读到的数据：
+  // 这些数据来自已经放锁的写事务，等 release_lsn_ 落盘即可，通常已经持久化，不用等
+  if (txn->get_synchronous_commit()) {
+    log_manager->wait_for_flush(read_only ? release_lsn_.load() : txn->get_prev_lsn());
+  }
 #endif
   txn->set_state(TransactionState::COMMITTED);
+  Metrics::instance().add(MetricCounter::COMMITS);
 }
 
 /**
@@ -96,105 +191,92 @@ void TransactionManager::abort(Transaction* txn, LogManager* log_manager) {
   // 3. 清空事务相关资源，eg.锁集
   // 4. 把事务日志刷入磁盘中
   // 5. 更新事务状态
-  std::lock_guard lock(latch_);
-
   auto&& write_set = txn->get_write_set();
   auto* context = new Context(lock_manager_, log_manager, txn);
-  // 从最后一个向前回滚
+  auto changed = changed_tables(txn);
+  // 还没有应用的递增没有改过记录，丢掉即可
+  txn->get_pending_increments().clear();
+
+  // 索引上要撤销的操作先按回滚顺序收集起来，记录全部恢复之后每个索引按key排好序一次执行完，
+  // 相邻的key大多落在同一个叶子上。不同的key上的操作互不影响，同一个key上的操作用稳定排序保持回滚顺序
+  struct IndexUndo {
+    IxIndexHandle* ih = nullptr;
+    const IndexMeta* index = nullptr;
+    std::vector<char> keys;  // 第i个操作的key从i * col_tot_len开始
+    std::vector<std::pair<bool, Rid>> ops;  // 插入（true）和插入的rid，或者删除
+  };
+  std::vector<IndexUndo> index_undos;  // 按IndexMeta::id存放
+  auto add_index_undo = [&](const IndexMeta& index, const char* record,
+                            bool insert, const Rid& rid) {
+    if (index.id >= static_cast<int>(index_undos.size())) {
+      index_undos.resize(index.id + 1);
+    }
+    auto& undo = index_undos[index.id];
+    if (undo.ih == nullptr) {
+      undo.ih = sm_manager_->get_ih(index.id);
+      undo.index = &index;
+    }
+    size_t pos = undo.keys.size();
+    undo.keys.resize(pos + index.col_tot_len);
+    int offset = 0;
+    for (auto& col : index.cols) {
+      memcpy(undo.keys.data() + pos + offset, record + col.offset, col.len);
+      offset += col.len;
+    }
+    undo.ops.emplace_back(insert, rid);
+  };
+
+  // 从最后一个向前回滚，回滚操作经过 RmFileHandle，会自动写入对应的日志
   for (auto&& it = write_set->rbegin(); it != write_set->rend(); ++it) {
     auto& write_record = *it;
-    auto& table_name = write_record->GetTableName();
-    auto& table_meta = sm_manager_->db_.get_table(table_name);
-    auto& fh = sm_manager_->fhs_[table_name];
+    // 写入时给出了表ID的按ID直接定位表和数据文件，不用按表名查找
+    int tab_id = write_record->GetTableId();
+    auto& table_meta = tab_id >= 0
+                           ? sm_manager_->db_.get_table(tab_id)
+                           : sm_manager_->db_.get_table(write_record->GetTableName());
+    auto* fh = sm_manager_->get_fh(table_meta.id);
     switch (write_record->GetWriteType()) {
       case WType::INSERT_TUPLE: {
-        // 删除记录
+        // 删除记录和索引
         auto& rid = write_record->GetRid();
         auto& record = write_record->GetRecord();
         fh->delete_record(rid, context);
-        // 删除索引
         for (auto& [index_name, index_meta] : table_meta.indexes) {
-          char* key = new char[index_meta.col_tot_len];
-          for (auto& [index_offset, col_meta] : index_meta.cols) {
-            memcpy(key + index_offset, record.data + col_meta.offset,
-                   col_meta.len);
-          }
-          auto ih = sm_manager_->ihs_[index_name].get();
-          ih->rw_latch_.WLock();
-          ih->delete_entry(key, txn);
-          ih->rw_latch_.WUnlock();
-          delete[] key;
+          add_index_undo(index_meta, record.data, false, rid);
         }
-#ifdef ENABLE_LOGGING
-        // 生成删除日志
-        auto* delete_log_record = new DeleteLogRecord(txn->get_transaction_id(),
-                                                      record, rid, table_name);
-        delete_log_record->prev_lsn_ = txn->get_prev_lsn();
-        txn->set_prev_lsn(log_manager->add_log_to_buffer(delete_log_record));
-        delete delete_log_record;
-#endif
         break;
       }
       case WType::DELETE_TUPLE: {
         auto& record = write_record->GetRecord();
-        auto& rid = write_record->GetRid();
-        fh->insert_record(rid, record.data);
+        // 变长格式中原位置放不下时记录会插入到其他位置
+        auto rid = fh->insert_record(write_record->GetRid(), record.data, context);
         // 插入索引
         for (auto& [index_name, index_meta] : table_meta.indexes) {
-          char* key = new char[index_meta.col_tot_len];
-          for (auto& [index_offset, col_meta] : index_meta.cols) {
-            memcpy(key + index_offset, record.data + col_meta.offset,
-                   col_meta.len);
-          }
-          auto ih = sm_manager_->ihs_[index_name].get();
-          ih->rw_latch_.WLock();
-          ih->insert_entry(key, rid, txn);
-          ih->rw_latch_.WUnlock();
-          delete[] key;
+          add_index_undo(index_meta, record.data, true, rid);
         }
-#ifdef ENABLE_LOGGING
-        // 生成插入日志
-        auto* insert_log_record = new InsertLogRecord(txn->get_transaction_id(),
-                                                      record, rid, table_name);
-        insert_log_record->prev_lsn_ = txn->get_prev_lsn();
-        txn->set_prev_lsn(log_manager->add_log_to_buffer(insert_log_record));
-        delete insert_log_record;
-#endif
         break;
       }
       case WType::UPDATE_TUPLE: {
         auto& old_record = write_record->GetRecord();
         auto& new_record = write_record->GetUpdatedRecord();
         auto& rid = write_record->GetRid();
-        fh->update_record(rid, old_record.data, context);
-        // 删除新索引，插入旧索引
-        if (write_record->is_set_index_key()) {
+        auto new_rid = fh->update_record(rid, old_record.data, context);
+        // 删除新索引，插入旧索引，key没有变的索引不用动；记录被移到其他位置时所有索引都要更新
+        if (write_record->is_set_index_key() || new_rid != rid) {
           for (auto& [index_name, index_meta] : table_meta.indexes) {
-            char* old_key = new char[index_meta.col_tot_len];
-            char* new_key = new char[index_meta.col_tot_len];
-            for (auto& [index_offset, col_meta] : index_meta.cols) {
-              memcpy(old_key + index_offset, old_record.data + col_meta.offset,
-                     col_meta.len);
-              memcpy(new_key + index_offset, new_record.data + col_meta.offset,
-                     col_meta.len);
+            if (new_rid == rid &&
+                std::all_of(index_meta.cols.begin(), index_meta.cols.end(),
+                            [&](const ColMeta& col) {
+                              return memcmp(old_record.data + col.offset,
+                                            new_record.data + col.offset,
+                                            col.len) == 0;
+                            })) {
+              continue;
             }
-            auto ih = sm_manager_->ihs_[index_name].get();
-            ih->rw_latch_.WLock();
-            ih->delete_entry(new_key, txn);
-            ih->insert_entry(old_key, rid, txn);
-            ih->rw_latch_.WUnlock();
-            delete[] old_key;
-            delete[] new_key;
+            add_index_undo(index_meta, new_record.data, false, rid);
+            add_index_undo(index_meta, old_record.data, true, new_rid);
           }
         }
-#ifdef ENABLE_LOGGING
-        // 生成插入日志
-        auto* update_log_record = new UpdateLogRecord(
-            txn->get_transaction_id(), new_record, old_record, rid, table_name);
-        update_log_record->prev_lsn_ = txn->get_prev_lsn();
-        txn->set_prev_lsn(log_manager->add_log_to_buffer(update_log_record));
-        delete update_log_record;
-#endif
         break;
       }
       default:
@@ -202,22 +284,249 @@ void TransactionManager::abort(Transaction* txn, LogManager* log_manager) {
     }
     delete write_record;
   }
+
+  for (auto& undo : index_undos) {
+    if (undo.ih == nullptr) {
+      continue;
+    }
+    std::vector<ColType> col_types;
+    std::vector<int> col_lens;
+    for (auto& col : undo.index->cols) {
+      col_types.push_back(col.type);
+      col_lens.push_back(col.len);
+    }
+    size_t key_len = undo.index->col_tot_len;
+    auto key_of = [&undo, key_len](size_t i) {
+      return undo.keys.data() + i * key_len;
+    };
+    std::vector<size_t> order(undo.ops.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return ix_compare(key_of(a), key_of(b), col_types, col_lens) < 0;
+    });
+    for (size_t i : order) {
+      if (undo.ops[i].first) {
+        undo.ih->insert_entry(key_of(i), undo.ops[i].second, txn);
+      } else {
+        undo.ih->delete_entry(key_of(i), txn);
+      }
+    }
+  }
   delete context;
   write_set->clear();
 
+  // 记录都已经恢复成保存的版本。版本不能直接删掉：快照读可能读到了回滚之前的页面，
+  // 还要靠版本替换，所以和提交一样标上时间戳，等所有快照都不需要时再回收
+  VersionStore::instance().commit(txn, next_timestamp_);
+  if (txn->is_snapshot()) {
+    VersionStore::instance().end_snapshot(txn);
+  }
+  OccManager::instance().release(txn);
+  // 快照读不受回滚影响，但记录数等不看快照的统计回到了原来的值
+  for (auto* fh : changed) {
+    fh->note_change();
+  }
+
   // 释放所有锁
   auto&& lock_set = txn->get_lock_set();
   for (auto& it : *lock_set) {
     lock_manager_->unlock(txn, it);
   }
   lock_set->clear();
+  txn->get_table_locks().clear();
 #ifdef ENABLE_LOGGING
-  auto* abort_log_record = new AbortLogRecord(txn->get_transaction_id());
-  abort_log_record->prev_lsn_ = txn->get_prev_lsn();
-  // TODO 日志管理
-  txn->set_prev_lsn(log_manager->add_log_to_buffer(abort_log_record));
-  // log_manager->flush_log_to_disk();
-  delete abort_log_record;
+  if (txn->get_begin_lsn() != INVALID_LSN) {
+    auto* abort_log_record = new AbortLogRecord(txn->get_transaction_id());
+    abort_log_record->prev_lsn_ = txn->get_prev_lsn();
+    txn->set_prev_lsn(log_manager->add_log_to_buffer(abort_log_record));
+    delete abort_log_record;
+  }
 #endif
   txn->set_state(TransactionState::ABORTED);
+  Metrics::instance().add(MetricCounter::ABORTS);
+}
+
+void TransactionManager::apply_increments(Transaction* txn,
+                                          LogManager* log_manager, int fd,
+                                          const Rid* rid) {
+  auto& pending = txn->get_pending_increments();
+  Context context(lock_manager_, log_manager, txn);
+  size_t kept = 0;
+  for (size_t i = 0; i < pending.size(); ++i) {
+    auto& increment = pending[i];
+    if ((fd >= 0 && increment.fd != fd) ||
+        (rid != nullptr && increment.rid != *rid)) {
+      if (kept != i) {
+        pending[kept] = std::move(increment);
+      }
+      ++kept;
+      continue;
+    }
+    auto* fh = sm_manager_->get_fh(increment.tab_id);
+    RmRecord old_record(fh->get_file_hdr().record_size);
+    RmRecord new_record(fh->get_file_hdr().record_size);
+    fh->increment_record(increment.rid, increment.deltas, &context, old_record,
+                         new_record);
+    txn->append_write_record(new WriteRecord(
+        WType::UPDATE_TUPLE, increment.tab_name, increment.rid, old_record,
+        new_record, false, increment.tab_id));
+  }
+  pending.resize(kept);
+}
+
+std::vector<RmFileHandle*> TransactionManager::changed_tables(Transaction* txn) {
+  std::vector<RmFileHandle*> tables;
+  WriteRecord* last = nullptr;
+  for (auto* write_record : *txn->get_write_set()) {
+    // 连续写同一个表的记录只查一次
+    if (last != nullptr && last->GetTableId() == write_record->GetTableId() &&
+        last->GetTableName() == write_record->GetTableName()) {
+      continue;
+    }
+    last = write_record;
+    RmFileHandle* fh = nullptr;
+    if (write_record->GetTableId() >= 0) {
+      fh = sm_manager_->get_fh(write_record->GetTableId());
+    } else if (sm_manager_->db_.is_table(write_record->GetTableName())) {
+      fh = sm_manager_->get_fh(
+          sm_manager_->db_.get_table(write_record->GetTableName()).id);
+    }
+    if (fh != nullptr && std::find(tables.begin(), tables.end(), fh) == tables.end()) {
+      tables.push_back(fh);
+    }
+  }
+  return tables;
+}
+
+Transaction* TransactionManager::get_transaction(txn_id_t txn_id) {
+  if (txn_id == INVALID_TXN_ID) {
+    return nullptr;
+  }
+
+  Transaction* res;
+  {
+    auto& shard = get_shard(txn_id);
+    std::lock_guard lock(shard.latch_);
+    auto it = shard.txns_.find(txn_id);
+    if (it == shard.txns_.end()) {
+      return nullptr;
+    }
+    res = it->second;
+  }
+
+  if (res->get_state() == TransactionState::COMMITTED ||
+      res->get_state() == TransactionState::ABORTED) {
+    recycle(res);
+    return nullptr;
+  }
+
+  return res;
+}
+
+void TransactionManager::recycle(Transaction* txn) {
+  {
+    auto& shard = get_shard(txn->get_transaction_id());
+    std::lock_guard lock(shard.latch_);
+    shard.txns_.erase(txn->get_transaction_id());
+  }
+  auto& pool = txn_pool();
+  if (pool.size() < TXN_POOL_SIZE) {
+    pool.emplace_back(txn);
+  } else {
+    delete txn;
+  }
+}
+
+void TransactionManager::delete_all_transactions() {
+  for (auto& shard : txn_table_) {
+    std::lock_guard lock(shard.latch_);
+    for (auto& [txn_id, txn] : shard.txns_) {
+      delete txn;
+    }
+    shard.txns_.clear();
+  }
+}
+
+/**
+ * @description: 开始快照读。单条SELECT语句是只读事务，在开始时的快照上读，不加任何锁，
+ * 不会被写事务阻塞，也不会因为wait-die被回滚；提交时结束快照
+ * @param {Transaction*} txn 只读事务
+ */
+void TransactionManager::begin_snapshot(Transaction* txn) {
+  VersionStore::instance().begin_snapshot(txn, next_timestamp_);
+}
+
+/**
+ * @description: 把txn变为只读事务：在此刻的快照上读，不加锁，提交时不写日志也不用放锁
+ * @param {Transaction*} txn 还没有读写过数据的事务
+ */
+void TransactionManager::begin_read_only(Transaction* txn) {
+  txn->set_read_only(true);
+  begin_snapshot(txn);
+}
+
+/**
+ * @description: 创建模糊检查点，不阻塞正在运行的事务。
+ * 先写begin checkpoint日志，再收集活跃事务表和缓冲池脏页表写入end checkpoint日志并落盘，
+ * 最后把recLSN早于检查点的脏页写回磁盘，使下一次恢复的重做起点不断后移
+ * @param {LogManager*} log_manager 日志管理器指针
+ */
+void TransactionManager::create_fuzzy_checkpoint(LogManager* log_manager) {
+  BeginCheckpointLogRecord begin_checkpoint_log_record;
+  lsn_t begin_lsn = log_manager->add_log_to_buffer(&begin_checkpoint_log_record);
+
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns;
+  // 恢复时需要的最早的日志：回滚活跃事务要读到它们的begin日志
+  lsn_t keep_lsn = begin_lsn;
+  for (auto& shard : txn_table_) {
+    std::lock_guard lock(shard.latch_);
+    for (auto& [txn_id, txn] : shard.txns_) {
+      auto state = txn->get_state();
+      // 还没有写过日志的事务恢复时不需要处理，它之后写的begin日志一定在检查点之后
+      if (state != TransactionState::COMMITTED &&
+          state != TransactionState::ABORTED &&
+          txn->get_begin_lsn() != INVALID_LSN) {
+        active_txns.emplace_back(txn_id, txn->get_prev_lsn());
+        keep_lsn = std::min(keep_lsn, txn->get_begin_lsn());
+      }
+    }
+  }
+
+  // 只有表数据页会设置recLSN，索引在恢复时重建
+  std::vector<std::pair<PageId, lsn_t>> dirty_page_ids;
+  sm_manager_->get_bpm()->get_dirty_pages(dirty_page_ids);
+  std::vector<CheckpointDirtyPage> dirty_pages;
+  dirty_pages.reserve(dirty_page_ids.size());
+  std::unordered_map<int, int> fd2table_id;
+  for (auto& [table_name, fh] : sm_manager_->fhs_) {
+    fd2table_id[fh->GetFd()] = fh->get_table_id();
+  }
+  for (auto& [page_id, rec_lsn] : dirty_page_ids) {
+    auto table_id = fd2table_id.find(page_id.fd);
+    if (table_id != fd2table_id.end()) {
+      dirty_pages.push_back({table_id->second, page_id.page_no, rec_lsn});
+    }
+  }
+
+  EndCheckpointLogRecord end_checkpoint_log_record(
+      begin_lsn, std::move(active_txns), std::move(dirty_pages));
+  lsn_t end_lsn = log_manager->add_log_to_buffer(&end_checkpoint_log_record);
+  log_manager->wait_for_flush(end_lsn);
+
+  sm_manager_->flush_meta();
+  sm_manager_->get_bpm()->flush_dirty_pages_before(begin_lsn);
+  sm_manager_->dump_buffer_pool();
+
+  // 写回的页面落盘之后，检查点之前的日志只有被pin住没能写回的页面和活跃事务还需要
+  for (auto& [table_name, fh] : sm_manager_->fhs_) {
+    sm_manager_->get_disk_manager()->sync_file(fh->GetFd());
+  }
+  dirty_page_ids.clear();
+  sm_manager_->get_bpm()->get_dirty_pages(dirty_page_ids);
+  for (auto& [page_id, rec_lsn] : dirty_page_ids) {
+    if (fd2table_id.count(page_id.fd) != 0 && rec_lsn != INVALID_LSN) {
+      keep_lsn = std::min(keep_lsn, rec_lsn);
+    }
+  }
+  log_manager->recycle_log(keep_lsn);
 }
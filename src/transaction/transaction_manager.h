@@ -10,16 +10,21 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "concurrency/lock_manager.h"
 #include "recovery/log_manager.h"
 #include "system/sm_manager.h"
 #include "transaction.h"
+#include "version_store.h"
 
-/* 系统采用的并发控制算法，当前题目中要求两阶段封锁并发控制算法 */
-enum class ConcurrencyMode { TWO_PHASE_LOCKING = 0, BASIC_TO };
+/* 系统采用的并发控制算法，默认两阶段封锁；OPTIMISTIC时显式事务读记录不加行锁，提交时验证 */
+enum class ConcurrencyMode { TWO_PHASE_LOCKING = 0, BASIC_TO, OPTIMISTIC };
 
 class TransactionManager {
  public:
@@ -31,13 +36,7 @@ class TransactionManager {
     concurrency_mode_ = concurrency_mode;
   }
 
-  ~TransactionManager() = default;
-
-  // 初始化静态成员函数
-  static void Initialize(size_t initial_capacity) {
-    // 实际就 17 个
-    txn_map.reserve(initial_capacity);
-  }
+  ~TransactionManager() { delete_all_transactions(); }
 
   Transaction* begin(Transaction* txn, LogManager* log_manager);
 
@@ -45,6 +44,23 @@ class TransactionManager {
 
   void abort(Transaction* txn, LogManager* log_manager);
 
+  void begin_snapshot(Transaction* txn);
+
+  // 把txn变为只读事务，之后在此刻的快照上读
+  void begin_read_only(Transaction* txn);
+
+  // 事务写第一条数据日志之前补上begin日志
+  static void log_begin(Transaction* txn, LogManager* log_manager);
+
+  void create_fuzzy_checkpoint(LogManager* log_manager);
+
+  /**
+   * @description: 应用事务推迟的递增，写进写集。只应用表fd（为-1时所有表）上、记录rid（为空时所有记录）上的递增。
+   * 提交时应用全部；执行中事务拿到记录上的读写锁时由LockManager回调，其他事务已经不能在这些记录上递增
+   */
+  void apply_increments(Transaction* txn, LogManager* log_manager, int fd = -1,
+                        const Rid* rid = nullptr);
+
   ConcurrencyMode get_concurrency_mode() { return concurrency_mode_; }
 
   void set_concurrency_mode(ConcurrencyMode concurrency_mode) {
@@ -54,37 +70,17 @@ class TransactionManager {
   LockManager* get_lock_manager() { return lock_manager_; }
 
   /**
-   * @description: 获取事务ID为txn_id的事务对象
+   * @description: 获取事务ID为txn_id的事务对象，事务已经结束时回收事务对象并返回空指针
    * @return {Transaction*} 事务对象的指针
    * @param {txn_id_t} txn_id 事务ID
    */
-  Transaction* get_transaction(txn_id_t txn_id) {
-    if (txn_id == INVALID_TXN_ID) {
-      return nullptr;
-    }
-
-    std::unique_lock lock(latch_);
-    if (txn_map.find(txn_id) == txn_map.end()) {
-      return nullptr;
-    }
-
-    auto* res = txn_map[txn_id];
-    if (res->get_state() == TransactionState::COMMITTED ||
-        res->get_state() == TransactionState::ABORTED) {
-      delete res;
-      txn_map.erase(txn_id);
-      return nullptr;
-    }
-
-    lock.unlock();
-    assert(res != nullptr);
-    assert(res->get_thread_id() == std::this_thread::get_id());
-
-    return res;
-  }
+  Transaction* get_transaction(txn_id_t txn_id);
 
-  static std::unordered_map<txn_id_t, Transaction*>
-      txn_map;  // 全局事务表，存放事务ID与事务对象的映射关系
+  // 把结束的事务从事务表中移除，事务对象放回当前线程的池中，之后不能再使用txn
+  void recycle(Transaction* txn);
+
+  // 删除事务表中的所有事务对象，关闭服务器时调用
+  void delete_all_transactions();
 
   inline void set_next_txn_id(txn_id_t next_txn_id) {
     next_txn_id_.store(next_txn_id);
@@ -92,10 +88,34 @@ class TransactionManager {
 
  private:
   ConcurrencyMode
-      concurrency_mode_;  // 事务使用的并发控制算法，目前只需要考虑2PL
+      concurrency_mode_;  // 事务使用的并发控制算法，2PL或者OCC
   std::atomic<txn_id_t> next_txn_id_{0};        // 用于分发事务ID
-  std::atomic<timestamp_t> next_timestamp_{0};  // 用于分发事务时间戳
-  std::mutex latch_;                            // 用于txn_map的并发
+  std::atomic<timestamp_t> next_timestamp_{0};  // 用于分发事务开始、提交和快照的时间戳
+  // 已经提前放锁的写事务中最大的 commit 日志 lsn，只读事务提交时只需等它落盘
+  std::atomic<lsn_t> release_lsn_{INVALID_LSN};
   SmManager* sm_manager_;
   LockManager* lock_manager_;
+  // 提交时应用递增到写出commit日志、标上提交时间戳之间持有：同一条记录上的递增按提交时间戳的顺序应用，
+  // 版本链和回滚用的前像都是对的。只有带递增的事务提交时获取
+  std::mutex escrow_latch_;
+
+  // 全局事务表，存放事务ID与事务对象的映射关系，按事务ID分片
+  struct alignas(64) TxnShard {
+    std::mutex latch_;
+    std::unordered_map<txn_id_t, Transaction*> txns_;
+  };
+  std::array<TxnShard, TXN_TABLE_SHARDS> txn_table_;
+
+  TxnShard& get_shard(txn_id_t txn_id) {
+    return txn_table_[static_cast<size_t>(txn_id) % TXN_TABLE_SHARDS];
+  }
+
+  // 写集中的记录涉及的表，不重复；事务中已经删除的表不在其中
+  std::vector<RmFileHandle*> changed_tables(Transaction* txn);
+
+  // 当前线程缓存的事务对象
+  static std::vector<std::unique_ptr<Transaction>>& txn_pool() {
+    thread_local std::vector<std::unique_ptr<Transaction>> pool;
+    return pool;
+  }
 };
@@ -16,6 +16,7 @@ See the Mulan PSL v2 for more details. */
 
 #include "common/common.h"
 #include "common/config.h"
+#include "common/memory_tracker.h"
 #include "defs.h"
 #include "execution/execution_defs.h"
 #include "record/rm_defs.h"
@@ -52,30 +53,39 @@ class WriteRecord {
 
   // constructor for insert operation
   WriteRecord(WType wtype, const Rid& rid, const RmRecord& record,
-              std::string tab_name)
+              std::string tab_name, int tab_id = -1)
       : wtype_(wtype),
         tab_name_(std::move(tab_name)),
+        tab_id_(tab_id),
         rid_(rid),
-        record_(record) {}
+        record_(record) {
+    charge_.add(record_.size);
+  }
 
   // constructor for delete operation
   WriteRecord(WType wtype, std::string tab_name, const Rid& rid,
-              const RmRecord& record)
+              const RmRecord& record, int tab_id = -1)
       : wtype_(wtype),
         tab_name_(std::move(tab_name)),
+        tab_id_(tab_id),
         rid_(rid),
-        record_(record) {}
+        record_(record) {
+    charge_.add(record_.size);
+  }
 
   // constructor for update operation
   WriteRecord(WType wtype, std::string tab_name, const Rid& rid,
               const RmRecord& old_record, const RmRecord& new_record,
-              bool is_set_index_key)
+              bool is_set_index_key, int tab_id = -1)
       : wtype_(wtype),
         tab_name_(std::move(tab_name)),
+        tab_id_(tab_id),
         rid_(rid),
         record_(old_record),
         updated_record_(new_record),
-        is_set_index_key_(is_set_index_key) {}
+        is_set_index_key_(is_set_index_key) {
+    charge_.add(record_.size + updated_record_.size);
+  }
 
   ~WriteRecord() = default;
 
@@ -89,179 +99,62 @@ class WriteRecord {
 
   inline std::string& GetTableName() { return tab_name_; }
 
+  // 表ID，-1表示写入时没有给出，只能按表名查找
+  inline int GetTableId() const { return tab_id_; }
+
   inline bool& is_set_index_key() { return is_set_index_key_; }
 
  private:
   WType wtype_;
   std::string tab_name_;
+  int tab_id_;
   Rid rid_;
   RmRecord record_;
   RmRecord updated_record_;
   bool is_set_index_key_;
+  MemoryCharge charge_{MemTag::WRITE_SET, sizeof(WriteRecord)};
 };
 
-/* 多粒度锁，加锁对象的类型，包括记录、表和间隙 */
-enum class LockDataType { TABLE = 0, RECORD = 1, GAP = 2 };
-
-class Gap {
- public:
-  Gap() = default;
-
-  explicit Gap(std::vector<std::pair<CondOp, CondOp> >& index_conds) {
-    index_conds_ = index_conds;
-  }
-
-  bool isInGap(const RmRecord& rec) const {
-    return cmpIndexLeftConds(rec) && cmpIndexRightConds(rec);
-  }
-
-  // 结论：A的最小值小于等于B的最大值，并且B的最小值小于等于A的最大值，那么他们就是相交的。(Amin<=Bmax)&&(Amax>=Bmin)
-  bool isCoincide(const Gap& gap) const {
-    for (std::size_t i = 0; i < index_conds_.size(); ++i) {
-      auto& lhs_cond = index_conds_[i].first;
-      auto& rhs_cond = gap.index_conds_[i].second;
-      if (lhs_cond.op != OP_INVALID && rhs_cond.op != OP_INVALID) {
-        auto& type = lhs_cond.rhs_val.type;
-        auto& lhs_rec = lhs_cond.rhs_val.raw;
-        auto& rhs_rec = rhs_cond.rhs_val.raw;
-        int cmp = compare(lhs_rec->data, rhs_rec->data, lhs_rec->size, type);
-        // 1.1 > 5 < 5 不相交
-        // 1.2 > 5 = 5 不相交
-        // 1.3 > 5 <= 5 不相交
-
-        // 2.1 >= 5 < 5 不相交
-        // 2.2 >= 5 = 5 相交
-        // 2.3 >= 5 <= 5 相交
-
-        // 3.1 = 5 < 5 不相交
-        // 3.2 = 5 = 5 相交
-        // 3.3 = 5 <= 5 相交
-        // (OP_GE || OP_EQ) && (OP_LE || OP_EQ) -> (!OP_GE && !OP_EQ) || (!OP_LE
-        // && !OP_EQ) -> (OP_GT) || (OP_LT)
-        if (cmp > 0 ||
-            (cmp == 0 && (lhs_cond.op == OP_GT || rhs_cond.op == OP_LT))) {
-          return false;
-        }
-      }
-    }
-
-    for (size_t i = 0; i < index_conds_.size(); ++i) {
-      auto& lhs_cond = gap.index_conds_[i].first;
-      auto& rhs_cond = index_conds_[i].second;
-      if (lhs_cond.op != OP_INVALID && rhs_cond.op != OP_INVALID) {
-        auto& type = lhs_cond.rhs_val.type;
-        auto& lhs_rec = lhs_cond.rhs_val.raw;
-        auto& rhs_rec = rhs_cond.rhs_val.raw;
-        int cmp = compare(lhs_rec->data, rhs_rec->data, lhs_rec->size, type);
-        // 1.1 > 5 < 5 不相交
-        // 1.2 > 5 = 5 不相交
-        // 1.3 > 5 <= 5 不相交
-
-        // 2.1 >= 5 < 5 不相交
-        // 2.2 >= 5 = 5 相交
-        // 2.3 >= 5 <= 5 相交
-
-        // 3.1 = 5 < 5 不相交
-        // 3.2 = 5 = 5 相交
-        // 3.3 = 5 <= 5 相交
-        // !(OP_GE || OP_EQ) && (OP_LE || OP_EQ) -> (!OP_GE && !OP_EQ) ||
-        // (!OP_LE && !OP_EQ) -> (OP_GT) || (OP_LT)
-        if (cmp > 0 ||
-            (cmp == 0 && (lhs_cond.op == OP_GT || rhs_cond.op == OP_LT))) {
-          return false;
-        }
-      }
-    }
-
-    return true;
-  }
-
-  bool cmpIndexLeftConds(const RmRecord& rec) const {
-    for (auto& [cond, _] : index_conds_) {
-      std::ignore = _;
-      if (cond.op != OP_INVALID && !cmpIndexCond(rec, cond)) {
-        return false;
-      }
-    }
-    return true;
-  }
-
-  bool cmpIndexRightConds(const RmRecord& rec) const {
-    for (auto& [_, cond] : index_conds_) {
-      std::ignore = _;
-      if (cond.op != OP_INVALID && !cmpIndexCond(rec, cond)) {
-        return false;
-      }
-    }
-    return true;
-  }
-
-  static bool cmpIndexCond(const RmRecord& rec, const CondOp& cond) {
-    int cmp = compare(rec.data + cond.offset, cond.rhs_val.raw->data,
-                      cond.rhs_val.raw->size, cond.rhs_val.type);
-    switch (cond.op) {
-      case OP_EQ:
-        return cmp == 0;
-      case OP_NE:
-        return cmp != 0;
-      case OP_LT:
-        return cmp < 0;
-      case OP_GT:
-        return cmp > 0;
-      case OP_LE:
-        return cmp <= 0;
-      case OP_GE:
-        return cmp >= 0;
-      default:
-        throw InternalError("Unexpected op type！");
-    }
-  }
-
-  std::vector<std::pair<CondOp, CondOp> > index_conds_;
+/* 记录中offset处type类型的数值字段上的增量，value是字段类型的原始字节，减法已经取过相反数 */
+struct IncrementDelta {
+  int offset;
+  ColType type;
+  char value[sizeof(int)];
 };
-
-// Hash function for CondOp
-namespace std {
-template <>
-struct hash<CondOp> {
-  std::size_t operator()(const CondOp& cond) const noexcept {
-    std::size_t hash = std::hash<int>()(cond.op);
-    hash ^= std::hash<Value>()(cond.rhs_val) + 0x9e3779b9 + (hash << 6) +
-            (hash >> 2);
-    hash ^=
-        std::hash<int>()(cond.offset) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-    return hash;
+static_assert(sizeof(int) == sizeof(float), "numeric columns are 4 bytes");
+
+// 把value（type类型的原始字节）加到field上
+inline void apply_increment(char* field, const char* value, ColType type) {
+  if (type == TYPE_INT) {
+    int a, b;
+    memcpy(&a, field, sizeof(int));
+    memcpy(&b, value, sizeof(int));
+    a += b;
+    memcpy(field, &a, sizeof(int));
+  } else {
+    float a, b;
+    memcpy(&a, field, sizeof(float));
+    memcpy(&b, value, sizeof(float));
+    a += b;
+    memcpy(field, &a, sizeof(float));
   }
+}
+
+/* 推迟到提交时才应用的递增（col = col + 常量）。语句执行时只在记录上加递增锁，
+ * 不同事务在同一条记录上的递增互不阻塞，见TransactionManager::apply_increments */
+struct PendingIncrement {
+  std::string tab_name;
+  int tab_id;
+  int fd;
+  Rid rid;
+  std::vector<IncrementDelta> deltas;
 };
-}  // namespace std
 
-// Hash function for std::pair<CondOp, CondOp>
-namespace std {
-template <>
-struct hash<std::pair<CondOp, CondOp> > {
-  std::size_t operator()(const std::pair<CondOp, CondOp>& pair) const {
-    std::size_t hash = std::hash<CondOp>()(pair.first);
-    hash ^= std::hash<CondOp>()(pair.second) + 0x9e3779b9 + (hash << 6) +
-            (hash >> 2);
-    return hash;
-  }
-};
-}  // namespace std
+/* 多粒度锁，加锁对象的类型，包括记录、表和间隙 */
+enum class LockDataType { TABLE = 0, RECORD = 1, GAP = 2 };
 
-// Hash function for Gap
-namespace std {
-template <>
-struct hash<Gap> {
-  std::size_t operator()(const Gap& gap) const {
-    std::size_t hash = 0;
-    for (const auto& cond_pair : gap.index_conds_) {
-      hash ^= std::hash<std::pair<CondOp, CondOp> >()(cond_pair) + 0x9e3779b9 +
-              (hash << 6) + (hash >> 2);
-    }
-    return hash;
-  }
-};
-}  // namespace std
+/* 索引末尾之后的间隙：没有比它更大的索引条目，用这个rid作为间隙的上界 */
+constexpr Rid GAP_SUPREMUM{-1, -1};
 
 /**
  * @description: 加锁对象的唯一标识
@@ -277,36 +170,14 @@ class LockDataId {
     rid_.slot_no = -1;
   }
 
-  /* 行级锁 */
+  /* 行级锁；间隙锁的fd是索引文件，rid是间隙上界的索引条目（next key）指向的记录，索引末尾之后为GAP_SUPREMUM */
   LockDataId(int fd, const Rid& rid, LockDataType type) {
-    assert(type == LockDataType::RECORD);
+    assert(type == LockDataType::RECORD || type == LockDataType::GAP);
     fd_ = fd;
     rid_ = rid;
     type_ = type;
   }
 
-  /* 间隙锁 */
-  // 左开右开，如果有相等的情况边界用行锁锁住
-  // LockDataId(int fd, IndexMeta &index_meta, std::optional<RmRecord>& lower,
-  // std::optional<RmRecord>& upper, LockDataType type) {
-  //     assert(type == LockDataType::GAP);
-  //     fd_ = fd;
-  //     index_meta_ = index_meta;
-  //     lower_ = std::move(lower);
-  //     upper_ = std::move(upper);
-  //     type_ = type;
-  // }
-
-  /* 最细粒度间隙锁 */
-  // 查询条件即为锁范围
-  LockDataId(int fd, IndexMeta& index_meta, Gap& gap, LockDataType type) {
-    assert(type == LockDataType::GAP);
-    fd_ = fd;
-    index_meta_ = index_meta;
-    gap_ = std::move(gap);
-    type_ = type;
-  }
-
   inline int64_t Get() const {
     if (type_ == LockDataType::TABLE) {
       // fd_
@@ -318,28 +189,25 @@ class LockDataId {
              ((static_cast<int64_t>(fd_)) << 31) |
              ((static_cast<int64_t>(rid_.page_no)) << 16) | rid_.slot_no;
     }
-    return ((static_cast<int64_t>(type_)) << 63) |
-           (static_cast<int64_t>(fd_) << 31) |
-           (static_cast<int64_t>(gap_hasher_(gap_)));
+    // fd_, rid_，只用于哈希，相等由operator==判断
+    return (static_cast<int64_t>(1) << 62) ^
+           (static_cast<int64_t>(fd_) << 31) ^
+           (static_cast<int64_t>(rid_.page_no) << 16) ^ rid_.slot_no;
   }
 
   bool operator==(const LockDataId& other) const {
     if (type_ != other.type_) return false;
     if (fd_ != other.fd_) return false;
-    if (type_ == LockDataType::RECORD) {
+    if (type_ != LockDataType::TABLE) {
       return rid_ == other.rid_;
     }
-    return index_meta_ == other.index_meta_ &&
-           gap_hasher_(gap_) == gap_hasher_(other.gap_);
+    return true;
   }
 
   bool operator!=(const LockDataId& other) const { return !(*this == other); }
 
-  int fd_;
+  int fd_;  // 表锁和行锁是表的fd，间隙锁是索引的fd
   Rid rid_;
-  IndexMeta index_meta_;  // 间隙锁，锁住的索引
-  Gap gap_;               // 间隙
-  std::hash<Gap> gap_hasher_;
   LockDataType type_;
 };
 
@@ -354,7 +222,11 @@ struct std::hash<LockDataId> {
 enum class AbortReason {
   LOCK_ON_SHIRINKING = 0,
   UPGRADE_CONFLICT,
-  DEADLOCK_PREVENTION
+  DEADLOCK_PREVENTION,
+  DEADLOCK_DETECTED,
+  VALIDATION_FAILED,
+  STATEMENT_TIMEOUT,
+  STATEMENT_CANCELED
 };
 
 /* 事务回滚异常，在rmdb.cpp中进行处理 */
@@ -384,6 +256,22 @@ class TransactionAbortException : public std::exception {
         return "Transaction " + std::to_string(txn_id_) +
                " aborted for deadlock prevention\n";
       }
+      case AbortReason::DEADLOCK_DETECTED: {
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted to break a deadlock cycle\n";
+      }
+      case AbortReason::VALIDATION_FAILED: {
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because a record it read was modified before commit\n";
+      }
+      case AbortReason::STATEMENT_TIMEOUT: {
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because a statement exceeded statement_timeout\n";
+      }
+      case AbortReason::STATEMENT_CANCELED: {
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because its statement was killed\n";
+      }
       default: {
         return "Transaction aborted\n";
       }
@@ -0,0 +1,203 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "version_store.h"
+
+#include <algorithm>
+#include <climits>
+
+VersionStore& VersionStore::instance() {
+  static VersionStore store;
+  return store;
+}
+
+void VersionStore::save(Transaction* txn, int fd, const Rid& rid,
+                        const char* before, int size) {
+  auto key = page_key(fd, rid.page_no);
+  auto& shard = get_shard(key);
+  {
+    std::lock_guard lock(shard.latch_);
+    auto& chain = shard.pages_[key][rid.slot_no];
+    if (!chain.empty() && chain.back().txn_id == txn->get_transaction_id()) {
+      return;
+    }
+    chain.push_back({txn->get_transaction_id(), INT64_MAX,
+                     before != nullptr
+                         ? std::make_shared<RmRecord>(
+                               size, const_cast<char*>(before))
+                         : nullptr});
+  }
+  ++num_versions_;
+  txn->get_version_set().emplace_back(fd, rid);
+}
+
+template <typename Fn>
+void VersionStore::for_each_chain(const std::vector<std::pair<int, Rid>>& rids,
+                                  Fn&& fn) {
+  for (auto& [fd, rid] : rids) {
+    auto key = page_key(fd, rid.page_no);
+    auto& shard = get_shard(key);
+    std::lock_guard lock(shard.latch_);
+    auto page = shard.pages_.find(key);
+    if (page == shard.pages_.end()) {
+      continue;
+    }
+    auto chain = page->second.find(rid.slot_no);
+    if (chain == page->second.end()) {
+      continue;
+    }
+    fn(chain->second);
+    if (chain->second.empty()) {
+      page->second.erase(chain);
+      if (page->second.empty()) {
+        shard.pages_.erase(page);
+      }
+    }
+  }
+}
+
+void VersionStore::commit(Transaction* txn, std::atomic<timestamp_t>& clock) {
+  auto& rids = txn->get_version_set();
+  if (rids.empty()) {
+    return;
+  }
+  auto txn_id = txn->get_transaction_id();
+  std::lock_guard lock(latch_);
+  timestamp_t commit_ts = clock++;
+  for_each_chain(rids, [txn_id, commit_ts](Chain& chain) {
+    for (auto& version : chain) {
+      if (version.txn_id == txn_id) {
+        version.commit_ts = commit_ts;
+      }
+    }
+  });
+  retained_.push_back({commit_ts, txn_id, std::move(rids)});
+  rids.clear();
+  collect_garbage();
+}
+
+void VersionStore::remove(txn_id_t txn_id,
+                          const std::vector<std::pair<int, Rid>>& rids) {
+  for_each_chain(rids, [this, txn_id](Chain& chain) {
+    auto end = std::remove_if(chain.begin(), chain.end(),
+                              [txn_id](const RecordVersion& version) {
+                                return version.txn_id == txn_id;
+                              });
+    num_versions_ -= chain.end() - end;
+    chain.erase(end, chain.end());
+  });
+}
+
+void VersionStore::begin_snapshot(Transaction* txn,
+                                  std::atomic<timestamp_t>& clock) {
+  std::lock_guard lock(latch_);
+  txn->set_snapshot_ts(clock.load());
+  snapshots_.insert(txn->get_snapshot_ts());
+}
+
+void VersionStore::end_snapshot(Transaction* txn) {
+  std::lock_guard lock(latch_);
+  snapshots_.erase(snapshots_.find(txn->get_snapshot_ts()));
+  txn->set_snapshot_ts(INVALID_TIMESTAMP);
+  collect_garbage();
+}
+
+void VersionStore::collect_garbage() {
+  // 提交时间戳小于最早的快照时间戳时，所有活跃快照都能看到这次修改
+  while (!retained_.empty() &&
+         (snapshots_.empty() ||
+          retained_.front().commit_ts < *snapshots_.begin())) {
+    remove(retained_.front().txn_id, retained_.front().rids);
+    retained_.pop_front();
+  }
+}
+
+const RecordVersion* VersionStore::visible_version(const Chain& chain,
+                                                   timestamp_t read_ts) {
+  for (auto& version : chain) {
+    if (version.commit_ts >= read_ts) {
+      return &version;
+    }
+  }
+  return nullptr;
+}
+
+bool VersionStore::read(int fd, const Rid& rid, timestamp_t read_ts,
+                        std::shared_ptr<RmRecord>* visible) const {
+  if (empty()) {
+    return false;
+  }
+  auto key = page_key(fd, rid.page_no);
+  auto& shard = get_shard(key);
+  std::lock_guard lock(shard.latch_);
+  auto page = shard.pages_.find(key);
+  if (page == shard.pages_.end()) {
+    return false;
+  }
+  auto chain = page->second.find(rid.slot_no);
+  if (chain == page->second.end()) {
+    return false;
+  }
+  auto* version = visible_version(chain->second, read_ts);
+  if (version == nullptr) {
+    return false;
+  }
+  *visible = version->record;
+  return true;
+}
+
+void VersionStore::read_page(
+    int fd, int page_no, timestamp_t read_ts,
+    std::vector<std::pair<int, std::shared_ptr<RmRecord>>>& versions) const {
+  versions.clear();
+  if (empty()) {
+    return;
+  }
+  auto key = page_key(fd, page_no);
+  auto& shard = get_shard(key);
+  {
+    std::lock_guard lock(shard.latch_);
+    auto page = shard.pages_.find(key);
+    if (page == shard.pages_.end()) {
+      return;
+    }
+    for (auto& [slot_no, chain] : page->second) {
+      if (auto* version = visible_version(chain, read_ts)) {
+        versions.emplace_back(slot_no, version->record);
+      }
+    }
+  }
+  std::sort(versions.begin(), versions.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+}
+
+std::vector<int> VersionStore::changed_pages(int fd,
+                                             timestamp_t read_ts) const {
+  std::vector<int> pages;
+  if (empty()) {
+    return pages;
+  }
+  for (auto& shard : shards_) {
+    std::lock_guard lock(shard.latch_);
+    for (auto& [key, slots] : shard.pages_) {
+      if (static_cast<int>(key >> 32) != fd) {
+        continue;
+      }
+      for (auto& [slot_no, chain] : slots) {
+        if (visible_version(chain, read_ts) != nullptr) {
+          pages.push_back(static_cast<int>(key & 0xFFFFFFFF));
+          break;
+        }
+      }
+    }
+  }
+  std::sort(pages.begin(), pages.end());
+  return pages;
+}
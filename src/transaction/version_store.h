@@ -0,0 +1,117 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL
+v2. You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "transaction.h"
+
+/* 一条记录在某个事务修改之前的版本 */
+struct RecordVersion {
+  txn_id_t txn_id;                  // 修改记录的事务
+  timestamp_t commit_ts;            // 该事务的提交时间戳，未提交时为INT64_MAX
+  std::shared_ptr<RmRecord> record; // 修改之前的记录，原来没有记录（插入）时为nullptr
+};
+
+/**
+ * @description: 多版本并发控制的版本存储。写事务修改记录之前把原来的记录放进版本链，
+ * 提交或回滚时标上时间戳；页面上始终是最新的记录。
+ * 单条SELECT语句作为只读事务在开始时取一个快照时间戳read_ts，不加任何锁：
+ * 一条记录的版本链中第一个在read_ts及之后提交（或未提交）的版本就是快照中的记录，没有这样的版本时页面上的记录就是。
+ * 写者先保存版本再修改页面，读者先读页面再查版本链，读到的未提交修改一定能在版本链中找到并被替换掉。
+ * 所有活跃快照都能看到的修改不再需要版本，在提交或快照结束时回收
+ */
+class VersionStore {
+ public:
+  static VersionStore& instance();
+
+  // 事务修改fd中rid上的记录之前调用，before是原来的记录，原来没有记录时为nullptr。
+  // 事务已经保存过这条记录时忽略，快照只需要事务第一次修改之前的版本
+  void save(Transaction* txn, int fd, const Rid& rid, const char* before,
+            int size);
+
+  // 事务提交：在latch下从clock分配提交时间戳并标到事务的所有版本上，和开始快照互斥，
+  // 快照要么看到事务的全部修改，要么都看不到。需要在释放锁之前调用。
+  // 回滚时在页面上的记录恢复之后同样调用，恢复后的记录和版本相同
+  void commit(Transaction* txn, std::atomic<timestamp_t>& clock);
+
+  // 开始快照，clock之前分配的提交时间戳都可见
+  void begin_snapshot(Transaction* txn, std::atomic<timestamp_t>& clock);
+
+  void end_snapshot(Transaction* txn);
+
+  // 是否有版本，没有时快照读可以直接使用页面上的记录
+  bool empty() const { return num_versions_.load() == 0; }
+
+  // 读完rid上的记录之后调用：快照之后rid上的记录被修改过时返回true，visible设为快照中的记录，
+  // 快照中没有这条记录时为nullptr；没有被修改过时页面上的记录就是快照中的记录
+  bool read(int fd, const Rid& rid, timestamp_t read_ts,
+            std::shared_ptr<RmRecord>* visible) const;
+
+  // 页面上快照之后被修改过的记录及其在快照中的版本（可能为nullptr），按槽位号排序
+  void read_page(int fd, int page_no, timestamp_t read_ts,
+                 std::vector<std::pair<int, std::shared_ptr<RmRecord>>>&
+                     versions) const;
+
+  // 表中快照之后被修改过的记录所在的页面，按页面号排序
+  std::vector<int> changed_pages(int fd, timestamp_t read_ts) const;
+
+ private:
+  using Chain = std::vector<RecordVersion>;  // 按修改的先后排列
+
+  struct alignas(64) Shard {
+    std::mutex latch_;
+    // (fd, page_no) -> 槽位号 -> 版本链
+    std::unordered_map<int64_t, std::unordered_map<int, Chain>> pages_;
+  };
+
+  static int64_t page_key(int fd, int page_no) {
+    return (static_cast<int64_t>(fd) << 32) | static_cast<uint32_t>(page_no);
+  }
+
+  Shard& get_shard(int64_t key) const {
+    return shards_[(static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL >> 32) %
+                   VERSION_STORE_SHARDS];
+  }
+
+  static const RecordVersion* visible_version(const Chain& chain,
+                                              timestamp_t read_ts);
+
+  // 对事务保存过的每条记录的版本链调用fn
+  template <typename Fn>
+  void for_each_chain(const std::vector<std::pair<int, Rid>>& rids, Fn&& fn);
+
+  // 删除事务保存的所有版本
+  void remove(txn_id_t txn_id, const std::vector<std::pair<int, Rid>>& rids);
+
+  // 回收所有活跃快照都能看到的已提交版本，调用者持有latch_
+  void collect_garbage();
+
+  mutable std::array<Shard, VERSION_STORE_SHARDS> shards_;
+  std::atomic<size_t> num_versions_{0};
+
+  std::mutex latch_;                         // 提交时间戳、快照和回收
+  std::multiset<timestamp_t> snapshots_;     // 活跃快照的read_ts
+  // 提交时还有快照看不到而保留下来的版本，按提交时间戳排列
+  struct Retained {
+    timestamp_t commit_ts;
+    txn_id_t txn_id;
+    std::vector<std::pair<int, Rid>> rids;
+  };
+  std::deque<Retained> retained_;
+};